@@ -20,6 +20,7 @@
 #include "appchoosercombobox.h"
 #include "appchooserdialog.h"
 #include "utilities.h"
+#include "core/appdatabase.h"
 #include "core/iconinfo.h"
 
 namespace Fm {
@@ -43,20 +44,21 @@ void AppChooserComboBox::setMimeType(std::shared_ptr<const Fm::MimeType> mimeTyp
     mimeType_ = std::move(mimeType);
     if (mimeType_) {
         const char* typeName = mimeType_->name();
-        defaultApp_ = Fm::GAppInfoPtr{g_app_info_get_default_for_type(typeName, FALSE), false};
-        GList* appInfos_glist = g_app_info_get_all_for_type(typeName);
+        auto database = Fm::AppDatabase::globalInstance();
+        defaultApp_ = database->defaultAppForType(typeName);
+        // a copy, as adding the items emits signals
+        const auto apps = database->appsForType(typeName);
         int i = 0;
-        for (GList* l = appInfos_glist; l; l = l->next, ++i) {
-            Fm::GAppInfoPtr app{G_APP_INFO(l->data), false};
+        for (const auto& app : apps) {
             GIcon* gicon = g_app_info_get_icon(app.get());
             addItem(gicon ? Fm::IconInfo::fromGIcon(gicon)->qicon() : QIcon(),
                     QString::fromUtf8(g_app_info_get_name(app.get())));
             if (g_app_info_equal(app.get(), defaultApp_.get())) {
                 defaultAppIndex_ = i;
             }
-            appInfos_.push_back(std::move(app));
+            appInfos_.push_back(app);
+            ++i;
         }
-        g_list_free(appInfos_glist);
     }
     // add "Other applications" item
     insertSeparator(count());
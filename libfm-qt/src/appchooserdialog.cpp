@@ -21,6 +21,7 @@
 #include "appchooserdialog.h"
 #include "ui_app-chooser-dialog.h"
 #include "utilities.h"
+#include "core/appdatabase.h"
 #include <QPushButton>
 #include <gio/gdesktopappinfo.h>
 #include <glib/gstdio.h>
@@ -143,21 +144,17 @@ GAppInfo* AppChooserDialog::customCommandToApp() {
         /* We need to ensure that no duplicated items are added */
         if (mimeType_) {
             /* see if the command is already in the list of known apps for this mime-type */
-            GList* apps = g_app_info_get_all_for_type(mimeType_->name());
-            GList* l;
-            for (l = apps; l; l = l->next) {
-                GAppInfo* app2 = G_APP_INFO(l->data);
-                const char* cmd = g_app_info_get_commandline(app2);
+            for (const auto& app2 : AppDatabase::globalInstance()->appsForType(mimeType_->name())) {
+                const char* cmd = g_app_info_get_commandline(app2.get());
                 char* bin2 = get_binary(cmd, nullptr);
                 if (g_strcmp0(bin1, bin2) == 0) {
-                    app = G_APP_INFO(g_object_ref(app2));
+                    app = G_APP_INFO(g_object_ref(app2.get()));
                     qDebug("found in app list");
                     g_free(bin2);
                     break;
                 }
                 g_free(bin2);
             }
-            g_list_free_full(apps, g_object_unref);
             if (app) {
                 goto _out;
             }
@@ -18,9 +18,36 @@
  */
 
 #include "cachedfoldermodel.h"
+#include <QCoreApplication>
+#include <algorithm>
+#include <list>
 
 namespace Fm {
 
+namespace {
+
+// Models that no view uses any more are kept for a while, so that going back to a folder shows
+// it at once; their folders keep them up to date, or are reloaded when they cannot be watched.
+constexpr std::size_t kMaxUnusedModelsCost = 64 * 1024 * 1024;
+constexpr std::size_t kMaxUnusedModels = 16;
+
+// Models of folders the user may open next, which may never be opened; the oldest make room for
+// new ones.
+constexpr std::size_t kMaxGuessedModels = 2;
+constexpr int kPrefetchedThumbnails = 48;  // about a screenful of icons
+
+struct UnusedModel {
+    CachedFolderModel* model;
+    std::size_t cost;
+    bool guessed;  // by prefetchNext(), and no view has used it yet
+};
+
+// the most recently used first
+std::list<UnusedModel> unusedModels;
+std::size_t unusedModelsCost = 0;
+
+}  // namespace
+
 CachedFolderModel::CachedFolderModel(const std::shared_ptr<Fm::Folder>& folder) : FolderModel(), refCount(1) {
     FolderModel::setFolder(folder);
 }
@@ -33,6 +60,15 @@ CachedFolderModel* CachedFolderModel::modelFromFolder(const std::shared_ptr<Fm::
     QVariant cache = folder->property(cacheKey);
     CachedFolderModel* model = cache.value<CachedFolderModel*>();
     if (model) {
+        if (model->refCount <= 0) {  // an unused model, used again
+            auto it = std::find_if(unusedModels.begin(), unusedModels.end(),
+                                   [model](const UnusedModel& unused) { return unused.model == model; });
+            if (it != unusedModels.end()) {
+                unusedModelsCost -= it->cost;
+                unusedModels.erase(it);
+            }
+            folder->revalidate();  // only the differences reach the model
+        }
         model->ref();
     }
     else {
@@ -40,6 +76,8 @@ CachedFolderModel* CachedFolderModel::modelFromFolder(const std::shared_ptr<Fm::
         cache = QVariant::fromValue(model);
         folder->setProperty(cacheKey, cache);
     }
+    // the user went somewhere else than prefetchNext() guessed
+    cancelGuesses();
     return model;
 }
 
@@ -52,12 +90,121 @@ CachedFolderModel* CachedFolderModel::modelFromPath(const Fm::FilePath& path) {
     return nullptr;
 }
 
+// static
+void CachedFolderModel::prefetch(const Fm::FilePath& path) {
+    if (!path || Fm::Folder::findByPath(path)) {
+        return;
+    }
+    auto folder = Fm::Folder::prefetch(path);
+    auto model = new CachedFolderModel(folder);
+    folder->setProperty(cacheKey, QVariant::fromValue(model));
+    // the model goes among the unused ones at once and keeps the folder while it is listed
+    model->unref();
+}
+
+// static
+void CachedFolderModel::prefetchNext(const Fm::FilePath& path, int thumbnailSize) {
+    if (!path || Fm::Folder::findByPath(path)) {
+        return;
+    }
+    trimGuessedModels(kMaxGuessedModels - 1);
+    auto folder = Fm::Folder::prefetch(path);
+    auto model = new CachedFolderModel(folder);
+    folder->setProperty(cacheKey, QVariant::fromValue(model));
+    if (thumbnailSize > 0) {
+        connect(
+            folder.get(), &Fm::Folder::finishLoading, model,
+            [model, thumbnailSize]() {
+                if (model->refCount <= 0) {  // a view showing it loads what it shows by itself
+                    model->prefetchThumbnails(thumbnailSize, kPrefetchedThumbnails);
+                }
+            },
+            Qt::SingleShotConnection);
+    }
+    model->unref();
+    if (!unusedModels.empty() && unusedModels.front().model == model) {
+        unusedModels.front().guessed = true;
+    }
+}
+
+// static
+void CachedFolderModel::trimGuessedModels(std::size_t maxCount) {
+    std::size_t count = 0;
+    for (auto it = unusedModels.begin(); it != unusedModels.end();) {
+        if (!it->guessed || ++count <= maxCount) {
+            ++it;
+            continue;
+        }
+        unusedModelsCost -= it->cost;
+        it->model->folder()->setProperty(cacheKey, QVariant());
+        delete it->model;
+        it = unusedModels.erase(it);
+    }
+}
+
+// static
+void CachedFolderModel::cancelGuesses() {
+    for (auto it = unusedModels.begin(); it != unusedModels.end();) {
+        if (!it->guessed) {
+            ++it;
+            continue;
+        }
+        if (it->model->folder()->isLoaded()) {
+            it->model->cancelThumbnails();
+            ++it;
+            continue;
+        }
+        // deleting the model drops the folder, which cancels its listing
+        unusedModelsCost -= it->cost;
+        it->model->folder()->setProperty(cacheKey, QVariant());
+        delete it->model;
+        it = unusedModels.erase(it);
+    }
+}
+
 void CachedFolderModel::unref() {
     // qDebug("unref cache");
     --refCount;
     if (refCount <= 0) {
-        folder()->setProperty(cacheKey, QVariant());
-        delete (this);
+        const auto& folder = this->folder();
+        // a folder still being listed, as a prefetched one, is kept; one that failed is not
+        if ((folder->isLoaded() && !folder->isValid()) || folder->path().hasUriScheme("search")) {
+            folder->setProperty(cacheKey, QVariant());
+            delete (this);
+            return;
+        }
+        static const bool cleanUp = (qAddPostRoutine(&CachedFolderModel::deleteUnusedModels), true);
+        Q_UNUSED(cleanUp);
+        const std::size_t cost = memoryCost();
+        unusedModels.push_front(UnusedModel{this, cost, false});
+        unusedModelsCost += cost;
+        trimUnusedModels(kMaxUnusedModelsCost, kMaxUnusedModels);
+    }
+}
+
+// static
+void CachedFolderModel::dropUnusedThumbnails() {
+    for (UnusedModel& unused : unusedModels) {
+        unused.model->dropThumbnails();
+        const std::size_t cost = unused.model->memoryCost();
+        unusedModelsCost = unusedModelsCost - unused.cost + cost;
+        unused.cost = cost;
+    }
+}
+
+// static
+std::size_t CachedFolderModel::unusedModelsMemory() {
+    return unusedModelsCost;
+}
+
+// static
+void CachedFolderModel::trimUnusedModels(std::size_t maxCost, std::size_t maxCount) {
+    while (!unusedModels.empty() && (unusedModelsCost > maxCost || unusedModels.size() > maxCount)) {
+        UnusedModel unused = unusedModels.back();
+        unusedModels.pop_back();
+        unusedModelsCost -= unused.cost;
+        unused.model->folder()->setProperty(cacheKey, QVariant());
+        delete unused.model;
     }
 }
 
@@ -38,9 +38,35 @@ class LIBFM_QT_API CachedFolderModel : public FolderModel {
     static CachedFolderModel* modelFromFolder(const std::shared_ptr<Fm::Folder>& folder);
     static CachedFolderModel* modelFromPath(const Fm::FilePath& path);
 
+    // lists |path| at a low priority into a model no view uses yet, unless it is loaded already
+    static void prefetch(const Fm::FilePath& path);
+
+    // Like prefetch(), for a folder the user may open next, as the one under the mouse, and then
+    // loads the thumbnails of its first files at |thumbnailSize| unless it is 0. Only the last few
+    // models listed so are kept, and a view taking any model cancels what they still load.
+    static void prefetchNext(const Fm::FilePath& path, int thumbnailSize);
+
+    // deletes the models no view uses, which are otherwise kept for going back to their folders
+    static void deleteUnusedModels() { trimUnusedModels(0, 0); }
+
+    // forgets the thumbnails of the models no view uses, keeping the models
+    static void dropUnusedThumbnails();
+
+    // the bytes held by the models no view uses
+    static std::size_t unusedModelsMemory();
+
    private:
     ~CachedFolderModel() override;
 
+    // deletes the least recently used of the models no view uses until they fit in the limits
+    static void trimUnusedModels(std::size_t maxCost, std::size_t maxCount);
+
+    // deletes the oldest of the models of prefetchNext() no view has used yet, keeping |maxCount|
+    static void trimGuessedModels(std::size_t maxCount);
+
+    // stops the listings and the thumbnails of the models of prefetchNext() no view has used yet
+    static void cancelGuesses();
+
    private:
     int refCount;
     constexpr static const char* cacheKey = "CachedFolderModel";
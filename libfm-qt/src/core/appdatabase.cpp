@@ -0,0 +1,70 @@
+#include "appdatabase.h"
+#include "cstrptr.h"
+
+namespace Fm {
+
+AppDatabase::AppDatabase() : QObject(), monitor_{g_app_info_monitor_get(), false} {
+    g_signal_connect(monitor_.get(), "changed", G_CALLBACK(onMonitorChanged), this);
+}
+
+AppDatabase::~AppDatabase() {
+    g_signal_handlers_disconnect_by_data(monitor_.get(), this);
+}
+
+// static
+AppDatabase* AppDatabase::globalInstance() {
+    static AppDatabase* database = new AppDatabase();
+    return database;
+}
+
+const std::vector<GAppInfoPtr>& AppDatabase::appsForType(const char* mimeType) {
+    return loadApps(mimeType).apps;
+}
+
+const std::vector<GAppInfoPtr>& AppDatabase::runnableAppsForType(const char* mimeType) {
+    return loadApps(mimeType).runnableApps;
+}
+
+GAppInfoPtr AppDatabase::defaultAppForType(const char* mimeType) {
+    Entry& entry = entries_[mimeType];
+    if (!entry.hasDefault) {
+        entry.defaultApp = GAppInfoPtr{g_app_info_get_default_for_type(mimeType, FALSE), false};
+        entry.hasDefault = true;
+    }
+    return entry.defaultApp;
+}
+
+AppDatabase::Entry& AppDatabase::loadApps(const char* mimeType) {
+    Entry& entry = entries_[mimeType];
+    if (entry.hasApps) {
+        return entry;
+    }
+    GList* apps = g_app_info_get_all_for_type(mimeType);
+    for (GList* l = apps; l; l = l->next) {
+        GAppInfoPtr app{G_APP_INFO(l->data), false};
+        const char* executable = g_app_info_get_executable(app.get());
+        if (executable) {
+            auto it = inPath_.find(executable);
+            if (it == inPath_.end()) {
+                it = inPath_.emplace(executable, bool(CStrPtr{g_find_program_in_path(executable)})).first;
+            }
+            if (it->second) {
+                entry.runnableApps.push_back(app);
+            }
+        }
+        entry.apps.push_back(std::move(app));
+    }
+    g_list_free(apps);
+    entry.hasApps = true;
+    return entry;
+}
+
+// static
+void AppDatabase::onMonitorChanged(GAppInfoMonitor* /* monitor */, gpointer userData) {
+    auto database = static_cast<AppDatabase*>(userData);
+    database->entries_.clear();
+    database->inPath_.clear();
+    Q_EMIT database->changed();
+}
+
+}  // namespace Fm
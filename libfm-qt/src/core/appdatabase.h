@@ -0,0 +1,61 @@
+#ifndef FM2_APPDATABASE_H
+#define FM2_APPDATABASE_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gioptrs.h"
+
+namespace Fm {
+
+// The apps installed for each mime type, looked up with GIO once per type and then kept: the
+// desktop entries of a type are parsed the first time a menu or dialog asks for it, not every
+// time. The lists GIO gives already include the apps of the types a type inherits, and the
+// associations added and removed in mimeapps.list. Everything is dropped, and changed() is
+// emitted, when GIO's monitor of the application directories and of the mimeapps.list files
+// reports a change. Only used in the main thread.
+class LIBFM_QT_API AppDatabase : public QObject {
+    Q_OBJECT
+   public:
+    explicit AppDatabase();
+
+    ~AppDatabase() override;
+
+    static AppDatabase* globalInstance();
+
+    // The apps that can open |mimeType|, in GIO's order of preference. The reference is valid
+    // until control returns to the event loop.
+    const std::vector<GAppInfoPtr>& appsForType(const char* mimeType);
+
+    // The same apps without those whose executable is not in $PATH.
+    const std::vector<GAppInfoPtr>& runnableAppsForType(const char* mimeType);
+
+    // The default app of |mimeType|, or null if there is none.
+    GAppInfoPtr defaultAppForType(const char* mimeType);
+
+   Q_SIGNALS:
+    void changed();
+
+   private:
+    struct Entry {
+        bool hasApps = false;
+        bool hasDefault = false;
+        std::vector<GAppInfoPtr> apps;
+        std::vector<GAppInfoPtr> runnableApps;
+        GAppInfoPtr defaultApp;
+    };
+
+    Entry& loadApps(const char* mimeType);
+
+    static void onMonitorChanged(GAppInfoMonitor* monitor, gpointer userData);
+
+    GObjectPtr<GAppInfoMonitor> monitor_;
+    std::unordered_map<std::string, Entry> entries_;  // by mime type
+    std::unordered_map<std::string, bool> inPath_;    // whether each executable is in $PATH
+};
+
+}  // namespace Fm
+
+#endif  // FM2_APPDATABASE_H
@@ -0,0 +1,30 @@
+#include "asyncfileinfojob.h"
+#include "asynctask.h"
+#include "fileinfo_p.h"
+#include "metadatastore.h"
+
+namespace Fm {
+
+AsyncFileInfoJob::AsyncFileInfoJob(FilePathList paths, FileInfoProfile profile)
+    : AsyncJob(), paths_{std::move(paths)}, profile_{profile} {}
+
+Task<void> AsyncFileInfoJob::exec() {
+    for (const auto& path : paths_) {
+        if (isCancelled()) {
+            break;
+        }
+        GErrorPtr err;
+        GFileInfoPtr inf = co_await queryInfoAsync(path.gfile(), gFileInfoQueryAttribs(profile_, path),
+                                                   G_FILE_QUERY_INFO_NONE, cancellable().get(), err);
+        if (inf) {
+            useFastContentType(inf.get());
+            MetadataStore::addTo(path, inf.get());
+            results_.push_back(std::make_shared<FileInfo>(inf, path));
+        }
+        else {
+            emitError(err);
+        }
+    }
+}
+
+}  // namespace Fm
@@ -0,0 +1,34 @@
+#ifndef FM2_ASYNCFILEINFOJOB_H
+#define FM2_ASYNCFILEINFOJOB_H
+
+#include "../libfmqtglobals.h"
+#include "asyncjob.h"
+#include "filepath.h"
+#include "fileinfo.h"
+
+namespace Fm {
+
+// FileInfoJob as an AsyncJob: the files are queried one after the other with the asynchronous
+// calls of GIO, so that many of these jobs can wait on a slow mount without a thread each.
+class LIBFM_QT_API AsyncFileInfoJob : public AsyncJob {
+    Q_OBJECT
+   public:
+    explicit AsyncFileInfoJob(FilePathList paths, FileInfoProfile profile = FileInfoProfile::Full);
+
+    const FilePathList& paths() const { return paths_; }
+
+    // Only to be read once finished() has been emitted.
+    const FileInfoList& files() const { return results_; }
+
+   protected:
+    Task<void> exec() override;
+
+   private:
+    FilePathList paths_;
+    FileInfoProfile profile_;
+    FileInfoList results_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_ASYNCFILEINFOJOB_H
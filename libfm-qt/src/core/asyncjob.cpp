@@ -0,0 +1,119 @@
+#include "asyncjob.h"
+#include "asynctask.h"
+#include <algorithm>
+#include <thread>
+
+namespace Fm {
+
+namespace {
+
+// The outermost coroutine of a spawned task: it owns the task, starts running when first
+// resumed and frees itself once the task is done.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() noexcept {
+            return Detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+Detached runDetached(Task<void> task, std::atomic<int>& inFlight) {
+    co_await task;
+    inFlight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+gboolean resumeCoroutine(gpointer data) {
+    std::coroutine_handle<>::from_address(data).resume();
+    return G_SOURCE_REMOVE;
+}
+
+}  // namespace
+
+struct AsyncExecutor::Worker {
+    GMainContext* context;
+    GMainLoop* loop;
+    std::thread thread;
+    std::atomic<int> inFlight{0};
+
+    Worker() : context{g_main_context_new()}, loop{g_main_loop_new(context, FALSE)} {
+        thread = std::thread([this] {
+            g_main_context_push_thread_default(context);
+            g_main_loop_run(loop);
+            g_main_context_pop_thread_default(context);
+        });
+    }
+
+    ~Worker() {
+        g_main_loop_quit(loop);
+        thread.join();
+        g_main_loop_unref(loop);
+        g_main_context_unref(context);
+    }
+};
+
+AsyncExecutor::AsyncExecutor(int threadCount) {
+    for (int i = 0; i < std::max(threadCount, 1); ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+}
+
+AsyncExecutor::~AsyncExecutor() = default;
+
+AsyncExecutor* AsyncExecutor::globalInstance() {
+    static AsyncExecutor* executor = new AsyncExecutor();
+    return executor;
+}
+
+void AsyncExecutor::spawn(Task<void> task) {
+    auto worker = std::min_element(workers_.begin(), workers_.end(), [](const auto& a, const auto& b) {
+                      return a->inFlight.load(std::memory_order_relaxed) < b->inFlight.load(std::memory_order_relaxed);
+                  })->get();
+    worker->inFlight.fetch_add(1, std::memory_order_relaxed);
+    auto detached = runDetached(std::move(task), worker->inFlight);
+    // the context of a worker is never acquired by this thread, so this always queues
+    g_main_context_invoke_full(worker->context, G_PRIORITY_DEFAULT, resumeCoroutine, detached.handle.address(),
+                               nullptr);
+}
+
+int AsyncExecutor::inFlight() const {
+    int count = 0;
+    for (const auto& worker : workers_) {
+        count += worker->inFlight.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+AsyncJob::AsyncJob() : cancellable_{g_cancellable_new(), false}, autoDelete_{true} {}
+
+AsyncJob::~AsyncJob() = default;
+
+void AsyncJob::start(AsyncExecutor* executor) {
+    (executor ? executor : AsyncExecutor::globalInstance())->spawn(run());
+}
+
+void AsyncJob::cancel() {
+    g_cancellable_cancel(cancellable_.get());
+}
+
+void AsyncJob::emitError(const GErrorPtr& err) {
+    if (err.domain() == G_IO_ERROR && (err.code() == G_IO_ERROR_CANCELLED || err.code() == G_IO_ERROR_FAILED_HANDLED)) {
+        return;
+    }
+    Q_EMIT error(err.message());
+}
+
+Task<void> AsyncJob::run() {
+    co_await exec();
+    Q_EMIT finished();
+    if (autoDelete_) {
+        deleteLater();
+    }
+}
+
+}  // namespace Fm
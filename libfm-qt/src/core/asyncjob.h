@@ -0,0 +1,96 @@
+#ifndef FM2_ASYNCJOB_H
+#define FM2_ASYNCJOB_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <gio/gio.h>
+#include "gioptrs.h"
+
+namespace Fm {
+
+// defined in asynctask.h, which needs C++20
+template <typename T>
+class Task;
+
+// Runs the coroutines of AsyncJobs on a few threads of its own, each iterating a GLib main
+// context that it has made its thread-default one. A coroutine stays on the thread it was
+// given: the asynchronous GIO calls it awaits call back in that context, which resumes it.
+// A coroutine waiting for GIO holds no thread, so thousands of them can be in flight.
+class LIBFM_QT_API AsyncExecutor {
+   public:
+    explicit AsyncExecutor(int threadCount = 2);
+
+    // Stops the threads; coroutines still waiting then are never resumed.
+    ~AsyncExecutor();
+
+    AsyncExecutor(const AsyncExecutor&) = delete;
+    AsyncExecutor& operator=(const AsyncExecutor&) = delete;
+
+    static AsyncExecutor* globalInstance();
+
+    // Runs |task| on the thread with the fewest coroutines in flight, and frees it once done.
+    void spawn(Task<void> task);
+
+    int threadCount() const { return static_cast<int>(workers_.size()); }
+
+    // the coroutines spawned and not yet done
+    int inFlight() const;
+
+   private:
+    struct Worker;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+// A job made of one coroutine, run by an AsyncExecutor instead of holding a pooled thread
+// while it waits for GIO as a Job does. Unlike a Job it cannot be paused and is not asked
+// what to do about errors: they are reported and the job goes on or gives up by itself.
+class LIBFM_QT_API AsyncJob : public QObject {
+    Q_OBJECT
+   public:
+    explicit AsyncJob();
+
+    ~AsyncJob() override;
+
+    bool isCancelled() const { return g_cancellable_is_cancelled(cancellable_.get()); }
+
+    const GCancellablePtr& cancellable() const { return cancellable_; }
+
+    // On by default: the job is deleted with deleteLater() once it has finished.
+    bool autoDelete() const { return autoDelete_; }
+
+    void setAutoDelete(bool autoDelete) { autoDelete_ = autoDelete; }
+
+    // Spawns exec() on |executor|, by default the global one.
+    void start(AsyncExecutor* executor = nullptr);
+
+   Q_SIGNALS:
+    // Both are emitted in a thread of the executor.
+    void finished();
+
+    void error(const QString& message);
+
+   public Q_SLOTS:
+    void cancel();
+
+   protected:
+    // Emits error() unless |err| only says that the job was cancelled.
+    void emitError(const GErrorPtr& err);
+
+    // all derived job subclasses should do their work in this coroutine.
+    virtual Task<void> exec() = 0;
+
+   private:
+    Task<void> run();
+
+    GCancellablePtr cancellable_;
+    bool autoDelete_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_ASYNCJOB_H
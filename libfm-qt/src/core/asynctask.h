@@ -0,0 +1,235 @@
+#ifndef FM2_ASYNCTASK_H
+#define FM2_ASYNCTASK_H
+
+#include "../libfmqtglobals.h"
+#include <QByteArray>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <gio/gio.h>
+#include "gioptrs.h"
+
+// Coroutines over the asynchronous calls of GIO, for AsyncJob. Needs C++20.
+
+namespace Fm {
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    // resumes whoever awaited the task once it is done
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    // like the GIO callbacks they run in, tasks report errors rather than throw
+    void unhandled_exception() const noexcept { std::terminate(); }
+
+    std::coroutine_handle<> continuation;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    Task<T> get_return_object() noexcept;
+    template <typename Value>
+    void return_value(Value&& value) {
+        value_.emplace(std::forward<Value>(value));
+    }
+
+    std::optional<T> value_;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+};
+
+// Awaits one asynchronous GIO call, which |start| makes with the callback and data it is
+// given, and resumes with its GAsyncResult. GIO calls back in the thread-default main
+// context of the thread that made the call, so the coroutine goes on in that thread.
+template <typename Start>
+class GAsyncAwaiter {
+   public:
+    explicit GAsyncAwaiter(Start start) : start_{std::move(start)} {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        start_(&GAsyncAwaiter::onReady, this);
+    }
+
+    GObjectPtr<GAsyncResult> await_resume() noexcept { return std::move(result_); }
+
+   private:
+    static void onReady(GObject* /*source*/, GAsyncResult* result, gpointer data) {
+        auto self = static_cast<GAsyncAwaiter*>(data);
+        self->result_ = GObjectPtr<GAsyncResult>{result};
+        self->handle_.resume();
+    }
+
+    Start start_;
+    std::coroutine_handle<> handle_;
+    GObjectPtr<GAsyncResult> result_;
+};
+
+}  // namespace detail
+
+// A coroutine returning T. It starts when awaited and resumes its awaiter when done; the
+// outermost task of a job is run by AsyncExecutor::spawn().
+template <typename T>
+class Task {
+   public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_{handle} {}
+
+    Task(Task&& other) noexcept : handle_{std::exchange(other.handle_, nullptr)} {}
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle_.promise().continuation = awaiter;
+        return handle_;
+    }
+
+    T await_resume() {
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*handle_.promise().value_);
+        }
+    }
+
+   private:
+    void reset() {
+        if (handle_) {
+            handle_.destroy();
+            handle_ = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>{std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
+}
+
+}  // namespace detail
+
+// co_await gAsync([&](GAsyncReadyCallback callback, gpointer data) { g_file_foo_async(..., callback, data); })
+// gives the GAsyncResult to pass to g_file_foo_finish().
+template <typename Start>
+detail::GAsyncAwaiter<Start> gAsync(Start start) {
+    return detail::GAsyncAwaiter<Start>{std::move(start)};
+}
+
+// The awaitable counterparts of the blocking GIO calls of the jobs. |attributes| must
+// outlive the call, as the static strings of gFileInfoQueryAttribs() do. Local files are
+// still read on the worker threads of GIO, a few at most; remote ones are asked over D-Bus
+// without holding a thread while the server answers.
+inline Task<GFileInfoPtr> queryInfoAsync(GFilePtr file,
+                                         const char* attributes,
+                                         GFileQueryInfoFlags flags,
+                                         GCancellable* cancellable,
+                                         GErrorPtr& error) {
+    auto result = co_await gAsync([&](GAsyncReadyCallback callback, gpointer data) {
+        g_file_query_info_async(file.get(), attributes, flags, G_PRIORITY_DEFAULT, cancellable, callback, data);
+    });
+    co_return GFileInfoPtr{g_file_query_info_finish(file.get(), result.get(), &error), false};
+}
+
+inline Task<GFileEnumeratorPtr> enumerateChildrenAsync(GFilePtr dir,
+                                                       const char* attributes,
+                                                       GFileQueryInfoFlags flags,
+                                                       GCancellable* cancellable,
+                                                       GErrorPtr& error) {
+    auto result = co_await gAsync([&](GAsyncReadyCallback callback, gpointer data) {
+        g_file_enumerate_children_async(dir.get(), attributes, flags, G_PRIORITY_DEFAULT, cancellable, callback,
+                                        data);
+    });
+    co_return GFileEnumeratorPtr{g_file_enumerate_children_finish(dir.get(), result.get(), &error), false};
+}
+
+// Up to |count| more children; none once all have been listed, or on error.
+inline Task<std::vector<GFileInfoPtr>> nextFilesAsync(GFileEnumeratorPtr enumerator,
+                                                      int count,
+                                                      GCancellable* cancellable,
+                                                      GErrorPtr& error) {
+    auto result = co_await gAsync([&](GAsyncReadyCallback callback, gpointer data) {
+        g_file_enumerator_next_files_async(enumerator.get(), count, G_PRIORITY_DEFAULT, cancellable, callback, data);
+    });
+    GList* list = g_file_enumerator_next_files_finish(enumerator.get(), result.get(), &error);
+    std::vector<GFileInfoPtr> infos;
+    for (GList* l = list; l; l = l->next) {
+        infos.emplace_back(G_FILE_INFO(l->data), false);
+    }
+    g_list_free(list);
+    co_return infos;
+}
+
+// The first |maxBytes| of |file|, or all of it if it is shorter, as for the header of an
+// image or a cached thumbnail. Empty on error.
+inline Task<QByteArray> readFileAsync(GFilePtr file, gsize maxBytes, GCancellable* cancellable, GErrorPtr& error) {
+    auto opened = co_await gAsync([&](GAsyncReadyCallback callback, gpointer data) {
+        g_file_read_async(file.get(), G_PRIORITY_DEFAULT, cancellable, callback, data);
+    });
+    GFileInputStreamPtr stream{g_file_read_finish(file.get(), opened.get(), &error), false};
+    QByteArray contents;
+    while (stream && static_cast<gsize>(contents.size()) < maxBytes) {
+        auto read = co_await gAsync([&](GAsyncReadyCallback callback, gpointer data) {
+            g_input_stream_read_bytes_async(G_INPUT_STREAM(stream.get()), maxBytes - contents.size(),
+                                            G_PRIORITY_DEFAULT, cancellable, callback, data);
+        });
+        GBytes* bytes = g_input_stream_read_bytes_finish(G_INPUT_STREAM(stream.get()), read.get(), &error);
+        if (!bytes) {
+            co_return QByteArray();
+        }
+        gsize size = 0;
+        const auto* chunk = static_cast<const char*>(g_bytes_get_data(bytes, &size));
+        contents.append(chunk, static_cast<qsizetype>(size));
+        g_bytes_unref(bytes);
+        if (size == 0) {
+            break;  // end of file
+        }
+    }
+    co_return contents;
+}
+
+}  // namespace Fm
+
+#endif  // FM2_ASYNCTASK_H
@@ -1,10 +1,13 @@
 #include "basicfilelauncher.h"
+#include "appdatabase.h"
 #include "fileinfojob.h"
 #include "mountoperation.h"
 
 #include <gio/gdesktopappinfo.h>
 #include <glib/gi18n.h>
 
+#include <algorithm>
+#include <memory>
 #include <unordered_map>
 #include <string>
 
@@ -16,6 +19,15 @@
 
 namespace Fm {
 
+namespace {
+
+// Paths are resolved at least this many to a FileInfoJob, the jobs running side by side,
+// and never more jobs than kMaxInfoJobs.
+constexpr std::size_t kInfoBatchSize = 256;
+constexpr std::size_t kMaxInfoJobs = 8;
+
+}  // namespace
+
 BasicFileLauncher::BasicFileLauncher() : quickExec_{false} {}
 
 BasicFileLauncher::~BasicFileLauncher() {}
@@ -80,54 +92,35 @@ bool BasicFileLauncher::launchFiles(const FileInfoList& fileInfos, GAppLaunchCon
 
     // Open files of different mime-types with their default apps,
     // grouping them together appropriately and respecting their order.
+    // An app whose Exec key takes %U or %F is then run once for all of its files.
+    constexpr std::size_t noLaunch = std::size_t(-1);
     std::vector<std::pair<GAppInfoPtr, FileInfoList>> launches;
-    std::unordered_map<std::string, GAppInfoPtr> defaultApps;
+    std::unordered_map<std::string, std::size_t> launchOfType;  // index in launches, or noLaunch
     for (const auto& file : mimeTypeInfos) {
         const char* mimeTypeName = file->mimeType()->name();
-        auto it = defaultApps.find(mimeTypeName);
-        if (it == defaultApps.end()) {
+        auto it = launchOfType.find(mimeTypeName);
+        if (it == launchOfType.end()) {
             GErrorPtr err;
-            GAppInfoPtr app{g_app_info_get_default_for_type(mimeTypeName, false), false};
+            GAppInfoPtr app = AppDatabase::globalInstance()->defaultAppForType(mimeTypeName);
             if (!app) {
                 app = chooseApp(FileInfoList(), mimeTypeName, err);
             }
+            // a null app is remembered too, so that the user is not asked again
+            std::size_t index = noLaunch;
             if (app) {
                 // check whether this app is already found for another mimetype
-                bool alreadyFound = false;
-                for (auto& launch : launches) {
-                    if (g_app_info_equal(app.get(), launch.first.get())) {
-                        alreadyFound = true;
-                        // remember it as the default app for this mimetype
-                        defaultApps[mimeTypeName] = launch.first;
-                        // update this launch (add the file to it)
-                        auto tmp = launch.second;
-                        tmp.push_back(file);
-                        launch.second = tmp;
-                        break;
-                    }
-                }
-                if (!alreadyFound) {
-                    defaultApps[mimeTypeName] = app;
-                    // remember this launch
-                    FileInfoList files;
-                    files.push_back(file);
-                    launches.push_back(std::make_pair(app, files));
+                auto launch = std::find_if(launches.cbegin(), launches.cend(), [&app](const auto& other) {
+                    return g_app_info_equal(app.get(), other.first.get());
+                });
+                index = launch - launches.cbegin();
+                if (launch == launches.cend()) {
+                    launches.emplace_back(app, FileInfoList{});
                 }
             }
-            else {
-                // remember that this mimetype has no default app (don't ask again)
-                defaultApps[mimeTypeName] = nullptr;
-            }
+            it = launchOfType.emplace(mimeTypeName, index).first;
         }
-        else if (auto app = it->second) {  // a default app was found/chosen before
-            for (auto& launch : launches) {
-                if (launch.first == app) {
-                    auto tmp = launch.second;
-                    tmp.push_back(file);
-                    launch.second = tmp;
-                    break;
-                }
-            }
+        if (it->second != noLaunch) {
+            launches[it->second].second.push_back(file);
         }
     }
     // perform the launches
@@ -145,39 +138,60 @@ bool BasicFileLauncher::launchFiles(const FileInfoList& fileInfos, GAppLaunchCon
 bool BasicFileLauncher::launchPaths(FilePathList paths, GAppLaunchContext* ctx) {
     // FIXME: blocking with an event loop is not a good design :-(
     QEventLoop eventLoop;
-    auto job = new FileInfoJob{paths};
-    job->setAutoDelete(false);  // do not automatically delete the job since we want its results later.
+
+    // split a large selection into batches resolved side by side, each job in its own thread
+    const std::size_t batchSize = std::max(kInfoBatchSize, (paths.size() + kMaxInfoJobs - 1) / kMaxInfoJobs);
+    std::vector<std::unique_ptr<FileInfoJob>> jobs;
+    for (std::size_t start = 0; start < paths.size(); start += batchSize) {
+        auto end = paths.cbegin() + std::min(paths.size(), start + batchSize);
+        jobs.emplace_back(new FileInfoJob{FilePathList(paths.cbegin() + start, end)});
+    }
 
     GObjectPtr<GAppLaunchContext> ctxPtr{ctx};
 
-    // error handling (for example: handle path not mounted error)
-    QObject::connect(
-        job, &FileInfoJob::error, &eventLoop,
-        [this, job, ctx](const GErrorPtr& err, Job::ErrorSeverity /* severity */, Job::ErrorAction& act) {
-            auto path = job->currentPath();
-            if (showError(ctx, err, path, nullptr)) {
-                // the user handled the error and ask for retry
-                act = Job::ErrorAction::RETRY;
+    std::size_t running = jobs.size();
+    for (auto& jobPtr : jobs) {
+        auto job = jobPtr.get();
+        job->setAutoDelete(false);  // do not automatically delete the job since we want its results later.
+
+        // error handling (for example: handle path not mounted error)
+        QObject::connect(
+            job, &FileInfoJob::error, &eventLoop,
+            [this, job, ctx](const GErrorPtr& err, Job::ErrorSeverity /* severity */, Job::ErrorAction& act) {
+                auto path = job->currentPath();
+                if (showError(ctx, err, path, nullptr)) {
+                    // the user handled the error and ask for retry
+                    act = Job::ErrorAction::RETRY;
+                }
+            },
+            Qt::BlockingQueuedConnection);  // BlockingQueuedConnection is required here to pause the job and wait for
+                                            // user response
+
+        QObject::connect(job, &FileInfoJob::finished, &eventLoop, [&eventLoop, &running]() {
+            // exit the event loop when the last job is done
+            if (--running == 0) {
+                eventLoop.exit();
             }
-        },
-        Qt::BlockingQueuedConnection);  // BlockingQueuedConnection is required here to pause the job and wait for user
-                                        // response
-
-    QObject::connect(job, &FileInfoJob::finished, [&eventLoop]() {
-        // exit the event loop when the job is done
-        eventLoop.exit();
-    });
+        });
+    }
 
-    // run the job in another thread to not block the UI
-    job->runAsync();
+    // run the jobs in other threads to not block the UI
+    for (auto& job : jobs) {
+        job->runAsync();
+    }
 
-    // blocking until the job is done with a event loop
-    eventLoop.exec();
+    // blocking until the jobs are done with a event loop
+    if (running > 0) {
+        eventLoop.exec();
+    }
 
-    // launch the file info
-    launchFiles(job->files(), ctx);
+    // launch the file infos, in the order of their paths
+    FileInfoList files;
+    for (const auto& job : jobs) {
+        files.insert(files.end(), job->files().cbegin(), job->files().cend());
+    }
+    launchFiles(files, ctx);
 
-    delete job;
     return false;
 }
 
@@ -436,7 +450,7 @@ bool BasicFileLauncher::launchWithDefaultApp(const FileInfoPtr& fileInfo, GAppLa
     FileInfoList files;
     files.emplace_back(fileInfo);
     GErrorPtr err;
-    GAppInfoPtr app{g_app_info_get_default_for_type(fileInfo->mimeType()->name(), false), false};
+    GAppInfoPtr app = AppDatabase::globalInstance()->defaultAppForType(fileInfo->mimeType()->name());
     if (app) {
         return launchWithApp(app.get(), files.paths(), ctx);
     }
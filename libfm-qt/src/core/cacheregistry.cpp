@@ -0,0 +1,176 @@
+#include "cacheregistry.h"
+#include "perftrace.h"
+#include <QSocketNotifier>
+#include <QTimer>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace Fm {
+
+namespace {
+
+// a stall of 200 ms within 2 s, the finest window an unprivileged process may ask for
+constexpr char kPressureTrigger[] = "some 200000 2000000";
+
+// stalls closer than this to the previous one trim the next caches too
+constexpr qint64 kEscalationWindow = 10000;  // ms
+
+constexpr int kBudgetCheckInterval = 30000;  // ms
+
+// the directory of the cgroup (v2) of this process, or an empty string
+std::string cgroupDir() {
+    std::ifstream file{"/proc/self/cgroup"};
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            return "/sys/fs/cgroup" + line.substr(3);
+        }
+    }
+    return std::string();
+}
+
+// the memory.high limit of the cgroup in bytes, or 0 without one
+int64_t cgroupMemoryHigh(const std::string& dir) {
+    std::ifstream file{dir + "/memory.high"};
+    std::string value;
+    if (dir.empty() || !(file >> value) || value == "max") {
+        return 0;
+    }
+    return std::strtoll(value.c_str(), nullptr, 10);
+}
+
+int openPressureTrigger(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    // the trigger is written with its terminating null
+    if (::write(fd, kPressureTrigger, sizeof(kPressureTrigger)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+std::weak_ptr<CacheRegistry> CacheRegistry::globalInstance_;
+
+CacheRegistry::CacheRegistry()
+    : QObject(),
+      budget_{0},
+      pressureFd_{-1},
+      pressureNotifier_{nullptr},
+      budgetTimer_{nullptr},
+      pressureLevel_{DecodedThumbnails} {
+    watchPressure();
+}
+
+CacheRegistry::~CacheRegistry() {
+    if (pressureFd_ >= 0) {
+        delete pressureNotifier_;
+        ::close(pressureFd_);
+    }
+}
+
+std::shared_ptr<CacheRegistry> CacheRegistry::globalInstance() {
+    auto registry = globalInstance_.lock();
+    if (registry == nullptr) {
+        registry = std::make_shared<CacheRegistry>();
+        globalInstance_ = registry;
+    }
+    return registry;
+}
+
+void CacheRegistry::add(const char* name, Priority priority, SizeFunc size, TrimFunc trim) {
+    caches_.push_back(Cache{name, priority, std::move(size), std::move(trim)});
+}
+
+void CacheRegistry::setBudget(int64_t bytes) {
+    budget_ = bytes;
+    if (budget_ > 0 && !budgetTimer_) {
+        budgetTimer_ = new QTimer(this);
+        budgetTimer_->setInterval(kBudgetCheckInterval);
+        budgetTimer_->setTimerType(Qt::VeryCoarseTimer);  // woken up with the other timers
+        connect(budgetTimer_, &QTimer::timeout, this, &CacheRegistry::checkBudget);
+        budgetTimer_->start();
+    }
+    else if (budget_ <= 0 && budgetTimer_) {
+        delete budgetTimer_;
+        budgetTimer_ = nullptr;
+    }
+}
+
+int64_t CacheRegistry::totalSize() const {
+    int64_t total = 0;
+    for (const Cache& cache : caches_) {
+        const int64_t size = cache.size ? cache.size() : -1;
+        if (size > 0) {
+            total += size;
+        }
+    }
+    return total;
+}
+
+void CacheRegistry::trim(Priority priority) {
+    for (int p = DecodedThumbnails; p <= priority; ++p) {
+        for (const Cache& cache : caches_) {
+            if (cache.priority == p && cache.trim) {
+                cache.trim();
+            }
+        }
+    }
+#ifdef __GLIBC__
+    // the freed memory stays with the process otherwise
+    malloc_trim(0);
+#endif
+    Q_EMIT trimmed(priority);
+}
+
+void CacheRegistry::watchPressure() {
+    const std::string dir = cgroupDir();
+    if (!dir.empty()) {
+        pressureFd_ = openPressureTrigger(dir + "/memory.pressure");
+        const int64_t memoryHigh = cgroupMemoryHigh(dir);
+        if (memoryHigh > 0) {
+            setBudget(memoryHigh / 8);
+        }
+    }
+    if (pressureFd_ < 0) {
+        pressureFd_ = openPressureTrigger("/proc/pressure/memory");
+    }
+    if (pressureFd_ < 0) {
+        return;  // a kernel without PSI
+    }
+    // the kernel signals a trigger with POLLPRI
+    pressureNotifier_ = new QSocketNotifier(pressureFd_, QSocketNotifier::Exception, this);
+    connect(pressureNotifier_, &QSocketNotifier::activated, this, &CacheRegistry::onPressure);
+}
+
+void CacheRegistry::onPressure() {
+    if (sinceLastPressure_.isValid() && sinceLastPressure_.elapsed() < kEscalationWindow) {
+        if (pressureLevel_ < IconPixmaps) {
+            pressureLevel_ = static_cast<Priority>(pressureLevel_ + 1);
+        }
+    }
+    else {
+        pressureLevel_ = DecodedThumbnails;
+    }
+    sinceLastPressure_.start();
+    trim(pressureLevel_);
+}
+
+void CacheRegistry::checkBudget() {
+    PerfTrace::add(PerfTrace::WakeupCacheBudget);
+    for (int p = DecodedThumbnails; p < NumPriorities && totalSize() > budget_; ++p) {
+        trim(static_cast<Priority>(p));
+    }
+}
+
+}  // namespace Fm
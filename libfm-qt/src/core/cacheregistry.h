@@ -0,0 +1,83 @@
+#ifndef FM2_CACHEREGISTRY_H
+#define FM2_CACHEREGISTRY_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QElapsedTimer>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class QSocketNotifier;
+class QTimer;
+
+namespace Fm {
+
+// The caches that can give their memory back, trimmed together when memory runs short. The
+// pressure is learned from a Linux PSI trigger on the memory.pressure of the cgroup of the
+// session, or on /proc/pressure/memory without one. The first stall trims the decoded
+// thumbnails; stalls that go on trim the inactive folder models, and then the icon pixmaps.
+// When the cgroup has a memory.high limit, an eighth of it is also the budget of the caches,
+// checked now and then. Only used in the main thread.
+class LIBFM_QT_API CacheRegistry : public QObject {
+    Q_OBJECT
+   public:
+    // in the order the caches are trimmed
+    enum Priority { DecodedThumbnails, InactiveModels, IconPixmaps, NumPriorities };
+
+    using SizeFunc = std::function<int64_t()>;  // the bytes held, or -1 when unknown
+    using TrimFunc = std::function<void()>;
+
+    explicit CacheRegistry();
+
+    ~CacheRegistry() override;
+
+    static std::shared_ptr<CacheRegistry> globalInstance();
+
+    void add(const char* name, Priority priority, SizeFunc size, TrimFunc trim);
+
+    // The bytes the caches may hold together before they are trimmed; 0 for no limit.
+    void setBudget(int64_t bytes);
+
+    int64_t budget() const { return budget_; }
+
+    // The bytes held by the caches of a size known.
+    int64_t totalSize() const;
+
+    // Trims the caches of |priority| and those trimmed before them.
+    void trim(Priority priority);
+
+    void trimAll() { trim(IconPixmaps); }
+
+   Q_SIGNALS:
+    void trimmed(Priority priority);
+
+   private:
+    struct Cache {
+        const char* name;
+        Priority priority;
+        SizeFunc size;
+        TrimFunc trim;
+    };
+
+    void watchPressure();
+
+    void onPressure();
+
+    void checkBudget();
+
+    std::vector<Cache> caches_;
+    int64_t budget_;
+    int pressureFd_;
+    QSocketNotifier* pressureNotifier_;
+    QTimer* budgetTimer_;
+    Priority pressureLevel_;          // trimmed at the last stall
+    QElapsedTimer sinceLastPressure_;  // to tell stalls that go on from new ones
+
+    static std::weak_ptr<CacheRegistry> globalInstance_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_CACHEREGISTRY_H
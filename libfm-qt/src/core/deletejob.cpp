@@ -4,21 +4,83 @@
 
 namespace Fm {
 
+namespace {
+
+// failures listed by name in the report; the rest are only counted
+constexpr qsizetype kMaxListedFailures = 20;
+
+DeleteJob::LocalTreeDeleter& localTreeDeleter() {
+    static DeleteJob::LocalTreeDeleter deleter;
+    return deleter;
+}
+
+DeleteJob::TrashEmptier& trashEmptier() {
+    static DeleteJob::TrashEmptier emptier;
+    return emptier;
+}
+
+bool isTrashRoot(const FilePath& path) {
+    return !path.isNative() && g_strcmp0(path.toString().get(), "trash:///") == 0;
+}
+
+}  // namespace
+
+void DeleteJob::setLocalTreeDeleter(LocalTreeDeleter deleter) {
+    localTreeDeleter() = std::move(deleter);
+}
+
+void DeleteJob::setTrashEmptier(TrashEmptier emptier) {
+    trashEmptier() = std::move(emptier);
+}
+
+bool DeleteJob::deleteLocalTree(const FilePath& path) {
+    setCurrentFile(path);
+    std::uint64_t finishedSize, finishedCount;
+    finishedAmount(finishedSize, finishedCount);
+
+    auto localPath = path.localPath();
+    // every entry visited counts as one file deleted
+    if (localTreeDeleter()(localPath.get(), [this]() {
+            addFinishedAmount(0, 1);
+            return !isCancelled();
+        })) {
+        return true;
+    }
+    if (isCancelled()) {
+        return false;
+    }
+    // let GIO delete what is left and tell which files could not be deleted
+    setFinishedAmount(finishedSize, finishedCount);
+    return deleteFile(path, GFileInfoPtr{nullptr});
+}
+
+bool DeleteJob::emptyTrash(const FilePath& trashRoot) {
+    setCurrentFile(trashRoot);
+    std::uint64_t finishedSize, finishedCount;
+    finishedAmount(finishedSize, finishedCount);
+
+    if (trashEmptier()([this]() {
+            addFinishedAmount(0, 1);
+            return !isCancelled();
+        })) {
+        return true;
+    }
+    if (isCancelled()) {
+        return false;
+    }
+    setFinishedAmount(finishedSize, finishedCount);
+    return deleteFile(trashRoot, GFileInfoPtr{nullptr});
+}
+
 bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
-    ErrorAction act = ErrorAction::CONTINUE;
-    while (!inf) {
+    if (!inf) {
         GErrorPtr err;
         inf = GFileInfoPtr{g_file_query_info(path.gfile().get(), "standard::*", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                              cancellable().get(), &err),
                            false};
-        if (err) {
-            act = emitError(err, ErrorSeverity::SEVERE);
-            if (act == ErrorAction::ABORT) {
-                return false;
-            }
-            if (act != ErrorAction::RETRY) {
-                break;
-            }
+        if (!inf) {
+            addFailure(err);
+            return false;
         }
     }
 
@@ -30,7 +92,12 @@ bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
 
     if (g_file_info_get_file_type(inf.get()) == G_FILE_TYPE_DIRECTORY) {
         // delete the content of the dir prior to deleting itself
+        const auto failureCount = failureCount_;
         deleteDirContent(path, inf);
+        if (failureCount_ != failureCount) {
+            // the dir cannot be empty, and the files left in it were already reported
+            return false;
+        }
     }
 
     bool isTrashRoot = false;
@@ -44,6 +111,7 @@ bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
     }
 
     bool hasError = false;
+    bool contentDeleted = false;
     while (!isCancelled()) {
         GErrorPtr err;
         // try to delete the path directly (but don't delete if it's trash:///)
@@ -51,13 +119,14 @@ bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
             break;
         }
         if (err) {
-            // FIXME: error handling
             /* if it's non-empty dir then descent into it then try again */
-            /* trash root gives G_IO_ERROR_PERMISSION_DENIED */
-            if (err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_NOT_EMPTY) {
+            if (err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_NOT_EMPTY && !contentDeleted) {
+                contentDeleted = true;
                 deleteDirContent(path, inf);
+                continue;
             }
-            else if (err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_PERMISSION_DENIED) {
+            /* trash root gives G_IO_ERROR_PERMISSION_DENIED */
+            if (err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_PERMISSION_DENIED) {
                 /* special case for trash:/// */
                 /* FIXME: is there any better way to handle this? */
                 auto scheme = path.uriScheme();
@@ -65,12 +134,10 @@ bool DeleteJob::deleteFile(const FilePath& path, GFileInfoPtr inf) {
                     break;
                 }
             }
-            act = emitError(err, ErrorSeverity::MODERATE);
-            if (act != ErrorAction::RETRY) {
-                hasError = true;
-                break;
-            }
+            addFailure(err);
         }
+        hasError = true;
+        break;
     }
 
     addFinishedAmount(g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE), 1);
@@ -84,7 +151,7 @@ bool DeleteJob::deleteDirContent(const FilePath& path, GFileInfoPtr inf) {
                                                      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, cancellable().get(), &err),
                            false};
     if (!enu) {
-        emitError(err, ErrorSeverity::MODERATE);
+        addFailure(err);
         return false;
     }
 
@@ -99,8 +166,7 @@ bool DeleteJob::deleteDirContent(const FilePath& path, GFileInfoPtr inf) {
         }
         else {
             if (err) {
-                emitError(err, ErrorSeverity::MODERATE);
-                /* ErrorAction::RETRY is not supported here */
+                addFailure(err);
                 hasError = true;
             }
             else { /* EOF */
@@ -112,6 +178,30 @@ bool DeleteJob::deleteDirContent(const FilePath& path, GFileInfoPtr inf) {
     return !hasError;
 }
 
+void DeleteJob::addFailure(const GErrorPtr& err) {
+    if (isCancelled() || (err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_CANCELLED)) {
+        return;
+    }
+    ++failureCount_;
+    if (failures_.size() < kMaxListedFailures) {
+        failures_.append(err.message());
+    }
+}
+
+void DeleteJob::reportFailures() {
+    if (failureCount_ == 0 || isCancelled()) {
+        return;
+    }
+    const int count = static_cast<int>(failureCount_);
+    QString msg = tr("%n file(s) could not be deleted:", "", count) + QLatin1Char('\n');
+    msg += failures_.join(QLatin1Char('\n'));
+    if (failureCount_ > static_cast<std::size_t>(failures_.size())) {
+        msg += QLatin1Char('\n') + tr("and %n more", "", count - static_cast<int>(failures_.size()));
+    }
+    GErrorPtr err{G_IO_ERROR, G_IO_ERROR_FAILED, msg};
+    emitError(err, ErrorSeverity::MODERATE);
+}
+
 DeleteJob::DeleteJob(const FilePathList& paths) : paths_{paths} {
     setCalcProgressUsingSize(false);
 }
@@ -127,6 +217,11 @@ void DeleteJob::exec() {
     TotalSizeJob totalSizeJob{paths_, TotalSizeJob::Flags::PREPARE_DELETE};
     connect(&totalSizeJob, &TotalSizeJob::error, this, &DeleteJob::error);
     connect(this, &DeleteJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
+    // show the amount counted so far while the counting goes on
+    connect(
+        &totalSizeJob, &TotalSizeJob::totalsChanged, this,
+        [this, &totalSizeJob]() { setTotalAmount(totalSizeJob.totalSize(), totalSizeJob.fileCount()); },
+        Qt::DirectConnection);
     totalSizeJob.run();
 
     if (isCancelled()) {
@@ -140,8 +235,17 @@ void DeleteJob::exec() {
         if (isCancelled()) {
             break;
         }
-        deleteFile(path, GFileInfoPtr{nullptr});
+        if (localTreeDeleter() && path.isNative()) {
+            deleteLocalTree(path);
+        }
+        else if (trashEmptier() && isTrashRoot(path)) {
+            emptyTrash(path);
+        }
+        else {
+            deleteFile(path, GFileInfoPtr{nullptr});
+        }
     }
+    reportFailures();
 }
 
 }  // namespace Fm
@@ -5,6 +5,8 @@
 #include "fileoperationjob.h"
 #include "filepath.h"
 #include "gioptrs.h"
+#include <QStringList>
+#include <functional>
 
 namespace Fm {
 
@@ -17,15 +19,39 @@ class LIBFM_QT_API DeleteJob : public Fm::FileOperationJob {
 
     ~DeleteJob() override;
 
+    // Deletes the local file or directory tree |path|, calling |tick| for each entry on the
+    // way, possibly from several threads but one call at a time; |tick| returns false to
+    // cancel. Returns false when anything was left in place.
+    using LocalTreeDeleter = std::function<bool(const char* path, const std::function<bool()>& tick)>;
+
+    // Makes every job delete local paths with |deleter| rather than file by file with GIO,
+    // which is then only used to finish and report what the deleter could not remove.
+    // Should be set once, before any job is started.
+    static void setLocalTreeDeleter(LocalTreeDeleter deleter);
+
+    // Empties the whole trash, local trash directories of every mounted filesystem included,
+    // calling |tick| like LocalTreeDeleter does. Returns false when anything was left.
+    using TrashEmptier = std::function<bool(const std::function<bool()>& tick)>;
+
+    // Makes jobs deleting trash:/// use |emptier|, with GIO only finishing what it left.
+    static void setTrashEmptier(TrashEmptier emptier);
+
    protected:
     void exec() override;
 
    private:
+    bool deleteLocalTree(const FilePath& path);
+    bool emptyTrash(const FilePath& trashRoot);
     bool deleteFile(const FilePath& path, GFileInfoPtr inf);
     bool deleteDirContent(const FilePath& path, GFileInfoPtr inf);
+    // failures are reported all together once the job is done, not one dialog per file
+    void addFailure(const GErrorPtr& err);
+    void reportFailures();
 
    private:
     FilePathList paths_;
+    QStringList failures_;  // the first few failure messages
+    std::size_t failureCount_ = 0;
 };
 
 }  // namespace Fm
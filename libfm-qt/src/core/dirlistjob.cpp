@@ -2,17 +2,141 @@
 #include <gio/gio.h>
 #include "fileinfo_p.h"
 #include "gioptrs.h"
+#include "localdirlister.h"
+#include "metadatastore.h"
+#include "perftrace.h"
 #include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 
 namespace Fm {
 
+namespace {
+
+// threads reading the directories of a recursive listing at once
+constexpr unsigned int kMaxTreeThreads = 8;
+
+}  // namespace
+
 DirListJob::DirListJob(const FilePath& path, Flags _flags) : dir_path{path}, flags{_flags}, emit_files_found{false} {}
 
 void DirListJob::setIncremental(bool set) {
     emit_files_found = set;
 }
 
+bool DirListJob::listLocalDirectory(FileInfoList& foundFiles) {
+    LocalDirLister lister{dir_path};
+    lister.setDirOnly(flags & DIR_ONLY);
+    lister.setFileInfoPool(pool_.get());
+    bool listed = lister.list(cancellable().get(), kMaxBatchSize, [&](FileInfoList& files) {
+        if (emit_files_found) {
+            Q_EMIT filesFound(files);
+        }
+        foundFiles.insert(foundFiles.end(), files.cbegin(), files.cend());
+    });
+    if (listed) {
+        deferredFiles_ = lister.deferredFiles();
+    }
+    return listed;
+}
+
+bool DirListJob::listLocalTree(FileInfoList& foundFiles) {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<FilePath> pending{dir_path};
+    unsigned int busy = 0;  // threads listing a directory
+    bool rootListed = false;
+    FileInfoList batch;  // found but not handed over yet
+    QElapsedTimer batchTimer;
+    GCancellable* cancellable = this->cancellable().get();
+
+    auto walk = [&]() {
+        std::unique_lock<std::mutex> lock{mutex};
+        for (;;) {
+            wake.wait(lock, [&] { return !pending.empty() || busy == 0 || g_cancellable_is_cancelled(cancellable); });
+            if (pending.empty() || g_cancellable_is_cancelled(cancellable)) {
+                wake.notify_all();  // the tree is done, or given up
+                return;
+            }
+            const FilePath dir = std::move(pending.front());
+            pending.pop_front();
+            ++busy;
+            lock.unlock();
+
+            LocalDirLister lister{dir};
+            lister.setDirOnly(flags & DIR_ONLY);
+            lister.setFileInfoPool(pool_.get());
+            std::vector<FilePath> subdirs;
+            const bool listed = lister.list(cancellable, kMaxBatchSize, [&](FileInfoList& files) {
+                for (const auto& file : files) {
+                    if (file->isDir() && !file->isSymlink() && !file->isHidden()) {
+                        subdirs.push_back(file->path());
+                    }
+                }
+                std::lock_guard<std::mutex> batchLock{mutex};
+                if (batch.empty()) {
+                    batchTimer.start();
+                }
+                batch.insert(batch.end(), files.cbegin(), files.cend());
+                wake.notify_all();
+            });
+
+            lock.lock();
+            if (dir == dir_path) {
+                rootListed = listed;
+            }
+            // subdirectories that cannot be read natively are left out, like unreadable ones
+            if (listed) {
+                deferredFiles_.insert(deferredFiles_.end(), lister.deferredFiles().cbegin(),
+                                      lister.deferredFiles().cend());
+            }
+            pending.insert(pending.end(), subdirs.cbegin(), subdirs.cend());
+            --busy;
+            wake.notify_all();
+        }
+    };
+
+    const unsigned int nThreads = std::max(1u, std::min(kMaxTreeThreads, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        threads.emplace_back(walk);
+    }
+
+    // this thread only hands the files over, so that the walk never waits for the main thread
+    std::unique_lock<std::mutex> lock{mutex};
+    for (;;) {
+        const bool done = pending.empty() && busy == 0;
+        if (done || g_cancellable_is_cancelled(cancellable) || batch.size() >= kMaxBatchSize ||
+            (!batch.empty() && batchTimer.elapsed() >= kMaxBatchDelay)) {
+            FileInfoList files;
+            files.swap(batch);
+            lock.unlock();
+            if (!files.empty()) {
+                if (emit_files_found && !isCancelled()) {
+                    Q_EMIT filesFound(files);
+                }
+                foundFiles.insert(foundFiles.end(), files.cbegin(), files.cend());
+            }
+            lock.lock();
+            if (done || g_cancellable_is_cancelled(cancellable)) {
+                break;
+            }
+            continue;
+        }
+        wake.wait_for(lock, std::chrono::milliseconds(kMaxBatchDelay));
+    }
+    lock.unlock();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return rootListed || isCancelled();
+}
+
 void DirListJob::exec() {
+    PerfTrace::Scope trace{"DirListJob"};
     GErrorPtr err;
     GFileInfoPtr dir_inf;
     GFilePtr dir_gfile = dir_path.gfile();
@@ -26,8 +150,8 @@ void DirListJob::exec() {
     }
 _retry:
     err.reset();
-    dir_inf = GFileInfoPtr{g_file_query_info(dir_gfile.get(), defaultGFileInfoQueryAttribs, G_FILE_QUERY_INFO_NONE,
-                                             cancellable().get(), &err),
+    dir_inf = GFileInfoPtr{g_file_query_info(dir_gfile.get(), gFileInfoQueryAttribs(FileInfoProfile::Full, dir_path),
+                                             G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
                            false};
     if (!dir_inf) {
         ErrorAction act = emitError(err, err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_CANCELLED
@@ -67,35 +191,51 @@ _retry:
             }
         }
 
+        MetadataStore::addTo(dir_path, dir_inf.get());
         std::lock_guard<std::mutex> lock{mutex_};
         dir_fi = std::make_shared<FileInfo>(dir_inf, dir_path);
     }
 
     FileInfoList foundFiles;
+    // local folders are listed natively, which is much faster on big ones
+    if (!isFileSearch && LocalDirLister::isSupported(dir_path) &&
+        ((flags & RECURSIVE) ? listLocalTree(foundFiles) : listLocalDirectory(foundFiles))) {
+        trace.setAmount(foundFiles.size());
+        PerfTrace::add(PerfTrace::DirListEntries, foundFiles.size());
+        std::lock_guard<std::mutex> lock{mutex_};
+        files_.swap(foundFiles);
+        return;
+    }
+
+    FileInfoList batch;
+    QElapsedTimer batchTimer;
+    // search results may trickle in for a long time, so the first are sent one by one and the
+    // batches grow from there, to show the first results as soon as they are found
+    std::size_t batchLimit = isFileSearch ? 1 : kMaxBatchSize;
     /* check if FS is R/O and set attr. into inf */
     // FIXME:  _fm_file_info_job_update_fs_readonly(gf, inf, nullptr, nullptr);
     err.reset();
     GFileEnumeratorPtr enu =
-        GFileEnumeratorPtr{g_file_enumerate_children(dir_gfile.get(), defaultGFileInfoQueryAttribs,
+        GFileEnumeratorPtr{g_file_enumerate_children(dir_gfile.get(), gFileInfoQueryAttribs(profile_, dir_path),
                                                      G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
                            false};
+    // the metadata of all the files at once, when the enumerator leaves it out
+    MetadataStore::DirEntries metadata;
+    if (!isFileSearch && MetadataStore::isEnabled() && dir_path.isNative()) {
+        if (auto localPath = dir_path.localPath()) {
+            metadata = MetadataStore::globalInstance()->directory(localPath.get());
+        }
+    }
     if (enu) {
         // qDebug() << "START LISTING:" << dir_path.toString().get();
         while (!isCancelled()) {
             err.reset();
             GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
             if (inf) {
-#if 0
-                FmPath* dir, *sub;
-                GFile* child;
-                if(G_UNLIKELY(job->flags & FM_DIR_LIST_JOB_DIR_ONLY)) {
-                    /* FIXME: handle symlinks */
-                    if(g_file_info_get_file_type(inf) != G_FILE_TYPE_DIRECTORY) {
-                        g_object_unref(inf);
-                        continue;
-                    }
+                // GIO follows symlinks for the type, so links to directories are kept
+                if ((flags & DIR_ONLY) && g_file_info_get_file_type(inf.get()) != G_FILE_TYPE_DIRECTORY) {
+                    continue;
                 }
-#endif
                 // virtual folders may return children not within them
                 // For example: the search:/// URI implemented by libfm might return files from different folders during
                 // enumeration. So here we call g_file_enumerator_get_container() to get the real parent path rather
@@ -117,9 +257,36 @@ _retry:
                 }
                 fi = fm_file_info_new_from_g_file_data(child, inf, sub);
 #endif
-                auto fileInfo = std::make_shared<FileInfo>(inf, FilePath(), realParentPath);
+                // content is only sniffed later, for the files shown (see Folder::resolveContentType())
+                bool deferred = false;
+                if (!g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+                    if (const char* type = g_file_info_get_attribute_string(
+                            inf.get(), G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE)) {
+                        g_file_info_set_content_type(inf.get(), type);
+                        deferred = g_file_info_get_file_type(inf.get()) == G_FILE_TYPE_REGULAR &&
+                                   g_file_info_get_size(inf.get()) > 0 && g_content_type_is_unknown(type);
+                    }
+                }
+                if (!metadata.empty()) {
+                    auto it = metadata.find(g_file_info_get_name(inf.get()));
+                    if (it != metadata.end()) {
+                        MetadataStore::apply(it->second, inf.get());
+                    }
+                }
+                auto fileInfo = FileInfoPool::makeFileInfo(pool_.get(), inf, FilePath(), realParentPath);
+                if (deferred) {
+                    deferredFiles_.push_back(fileInfo);
+                }
                 if (emit_files_found) {
-                    // Q_EMIT filesFound();
+                    if (batch.empty()) {
+                        batchTimer.start();
+                    }
+                    batch.push_back(fileInfo);
+                    if (batch.size() >= batchLimit || batchTimer.elapsed() >= kMaxBatchDelay) {
+                        Q_EMIT filesFound(batch);
+                        batch.clear();
+                        batchLimit = std::min(batchLimit * 2, kMaxBatchSize);
+                    }
                 }
 
                 foundFiles.push_back(std::move(fileInfo));
@@ -146,6 +313,11 @@ _retry:
     }
 
     // qDebug() << "END LISTING:" << dir_path.toString().get();
+    if (!batch.empty() && !isCancelled()) {
+        Q_EMIT filesFound(batch);
+    }
+    trace.setAmount(foundFiles.size());
+    PerfTrace::add(PerfTrace::DirListEntries, foundFiles.size());
     if (!foundFiles.empty()) {
         std::lock_guard<std::mutex> lock{mutex_};
         files_.swap(foundFiles);
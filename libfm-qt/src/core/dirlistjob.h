@@ -7,22 +7,34 @@
 #include "filepath.h"
 #include "gobjectptr.h"
 #include "fileinfo.h"
+#include "fileinfopool.h"
 
 namespace Fm {
 
 class LIBFM_QT_API DirListJob : public Job {
     Q_OBJECT
    public:
-    enum Flags { FAST = 0, DIR_ONLY = 1 << 0, DETAILED = 1 << 1 };
+    // With DIR_ONLY, only directories are listed, which spares local listings a stat() per file.
+    // RECURSIVE lists a local folder with everything below it, see listLocalTree(); other
+    // folders are listed as if it was not given.
+    enum Flags { FAST = 0, DIR_ONLY = 1 << 0, DETAILED = 1 << 1, RECURSIVE = 1 << 2 };
 
     explicit DirListJob(const FilePath& path, Flags flags);
 
     FileInfoList& files() { return files_; }
 
+    // In incremental mode, files are also delivered in batches through filesFound() while the
+    // directory is being enumerated; the last batch is emitted before finished().
     void setIncremental(bool set);
 
     bool incremental() const { return emit_files_found; }
 
+    // What the files are queried for when listed with GIO; FileInfoProfile::Listing by default.
+    void setProfile(FileInfoProfile profile) { profile_ = profile; }
+
+    // Allocates the files listed from |pool|, see FileInfoPool.
+    void setFileInfoPool(std::shared_ptr<FileInfoPool> pool) { pool_ = std::move(pool); }
+
     FilePath dirPath() const {
         std::lock_guard<std::mutex> lock{mutex_};
         return dir_path;
@@ -33,18 +45,37 @@ class LIBFM_QT_API DirListJob : public Job {
         return dir_fi;
     }
 
+    // Files whose content type was guessed from their names only, to be sniffed later.
+    const FileInfoList& deferredFiles() const { return deferredFiles_; }
+
    Q_SIGNALS:
-    void filesFound(FileInfoList& foundFiles);
+    void filesFound(const FileInfoList& foundFiles);
 
    protected:
     void exec() override;
 
    private:
+    // Lists a local directory without GIO; false if it has to be listed with GIO instead.
+    bool listLocalDirectory(FileInfoList& foundFiles);
+
+    // Lists a local tree without GIO, the subdirectories being read by several threads at once
+    // while this one hands the files over in batches. Hidden folders and links to folders are
+    // listed but not descended into. False if the root has to be listed with GIO instead.
+    bool listLocalTree(FileInfoList& foundFiles);
+
+    // a batch is emitted once it has this many files, or files found this long (in ms) ago;
+    // search results start with batches of one file
+    static constexpr std::size_t kMaxBatchSize = 4096;
+    static constexpr qint64 kMaxBatchDelay = 200;
+
     mutable std::mutex mutex_;
     FilePath dir_path;
     Flags flags;
     std::shared_ptr<const FileInfo> dir_fi;
     FileInfoList files_;
+    FileInfoList deferredFiles_;
+    FileInfoProfile profile_ = FileInfoProfile::Listing;
+    std::shared_ptr<FileInfoPool> pool_;
     bool emit_files_found;
     // guint delay_add_files_handler;
     // GSList* files_to_add;
@@ -0,0 +1,302 @@
+#include "dirsizeindex.h"
+#include "fileinfo.h"
+#include "gioptrs.h"
+#include <QCoreApplication>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'M', 'D', 'S', 'I', 'Z', 'E', '1'};
+
+// the index stops growing at this many directories, a few tens of MiB
+constexpr std::size_t kMaxEntries = 1 << 20;
+// records are written in chunks of about this size, not one write per directory
+constexpr std::size_t kWriteChunk = 64 * 1024;
+// the file is rewritten when it holds this many stale records more than live ones
+constexpr std::size_t kMinStaleRecords = 4096;
+
+// The fixed part of a record, followed by |pathLength| bytes of path. A record without path
+// drops the totals of its directory.
+struct Record {
+    std::uint64_t device;
+    std::uint64_t inode;
+    std::int64_t mtime;
+    std::uint64_t size;
+    std::uint64_t onDiskSize;
+    std::uint64_t fileCount;
+    std::uint32_t pathLength;
+    std::uint32_t reserved;
+};
+
+bool writeAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+}  // namespace
+
+std::size_t DirSizeIndex::KeyHash::operator()(const Key& key) const {
+    return std::hash<std::uint64_t>{}(key.inode ^ (key.device * 0x9e3779b97f4a7c15ULL));
+}
+
+DirSizeIndex::DirSizeIndex(std::string filePath) : filePath_{std::move(filePath)} {}
+
+DirSizeIndex::~DirSizeIndex() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    writePending();
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+std::shared_ptr<DirSizeIndex> DirSizeIndex::globalInstance() {
+    // kept for the whole process, so that the index is only read once
+    static const std::shared_ptr<DirSizeIndex> index = [] {
+        CStrPtr path{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "dirsizes.cache", nullptr)};
+        auto instance = std::make_shared<DirSizeIndex>(path.get());
+        // jobs may ask for it first, but it has to outlive their threads
+        if (auto app = QCoreApplication::instance()) {
+            instance->moveToThread(app->thread());
+        }
+        return instance;
+    }();
+    return index;
+}
+
+bool DirSizeIndex::lookup(std::uint64_t device, std::uint64_t inode, std::int64_t mtime, Sizes& sizes) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    load();
+    auto it = entries_.find(Key{device, inode});
+    if (it == entries_.cend() || it->second.mtime != mtime) {
+        return false;
+    }
+    sizes = it->second.sizes;
+    return true;
+}
+
+bool DirSizeIndex::lookup(const FileInfo& dir, Sizes& sizes) const {
+    // "l<device>:<inode>", as GIO and LocalDirLister make the ids of local files
+    const char* id = dir.fileId();
+    if (!id || id[0] != 'l') {
+        return false;
+    }
+    char* end = nullptr;
+    const std::uint64_t device = std::strtoull(id + 1, &end, 10);
+    if (*end != ':') {
+        return false;
+    }
+    const std::uint64_t inode = std::strtoull(end + 1, &end, 10);
+    if (*end != '\0') {
+        return false;
+    }
+    return lookup(device, inode, static_cast<std::int64_t>(dir.mtime()), sizes);
+}
+
+void DirSizeIndex::store(const std::string& path,
+                         std::uint64_t device,
+                         std::uint64_t inode,
+                         std::int64_t mtime,
+                         const Sizes& sizes) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    load();
+    const Key key{device, inode};
+    if (const Entry* entry = insertEntry(key, Entry{mtime, sizes, path})) {
+        appendRecord(key, entry);
+        hasNewTotals_ = true;
+    }
+}
+
+void DirSizeIndex::invalidate(const std::string& path) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    load();
+    if (entries_.empty()) {
+        return;
+    }
+    std::string dir = path;
+    for (;;) {
+        auto it = keysByPath_.find(dir);
+        if (it != keysByPath_.end()) {
+            const Key key = it->second;
+            eraseEntry(key);
+            appendRecord(key, nullptr);
+        }
+        const auto slash = dir.rfind('/');
+        if (slash == std::string::npos || dir.size() == 1) {
+            break;
+        }
+        dir.resize(slash == 0 ? 1 : slash);
+    }
+}
+
+void DirSizeIndex::flush() {
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        writePending();
+        notify = hasNewTotals_;
+        hasNewTotals_ = false;
+    }
+    if (notify) {
+        Q_EMIT changed();
+    }
+}
+
+void DirSizeIndex::load() const {
+    if (loaded_) {
+        return;
+    }
+    loaded_ = true;
+
+    std::vector<char> data;
+    const int fd = open(filePath_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            data.resize(static_cast<std::size_t>(st.st_size));
+            std::size_t done = 0;
+            while (done < data.size()) {
+                const ssize_t n = read(fd, data.data() + done, data.size() - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                done += static_cast<std::size_t>(n);
+            }
+            data.resize(done);
+        }
+        close(fd);
+    }
+
+    std::size_t validLength = 0;
+    std::size_t records = 0;  // stale ones included
+    if (data.size() >= sizeof(kMagic) && std::memcmp(data.data(), kMagic, sizeof(kMagic)) == 0) {
+        std::size_t pos = sizeof(kMagic);
+        while (pos + sizeof(Record) <= data.size()) {
+            Record record;
+            std::memcpy(&record, data.data() + pos, sizeof(record));
+            if (pos + sizeof(record) + record.pathLength > data.size()) {
+                break;  // cut short by a crash
+            }
+            const Key key{record.device, record.inode};
+            if (record.pathLength > 0) {
+                insertEntry(key, Entry{record.mtime, Sizes{record.size, record.onDiskSize, record.fileCount},
+                                       std::string(data.data() + pos + sizeof(record), record.pathLength)});
+            }
+            else {
+                eraseEntry(key);
+            }
+            pos += sizeof(record) + record.pathLength;
+            ++records;
+        }
+        validLength = pos;
+    }
+
+    if (validLength == 0 || records > 2 * entries_.size() + kMinStaleRecords || validLength < data.size()) {
+        compact();
+    }
+}
+
+const DirSizeIndex::Entry* DirSizeIndex::insertEntry(const Key& key, Entry entry) const {
+    eraseEntry(key);
+    // the path now leads to another directory, so the one indexed under it was replaced
+    auto pathIt = keysByPath_.find(entry.path);
+    if (pathIt != keysByPath_.end()) {
+        eraseEntry(pathIt->second);
+    }
+    if (entries_.size() >= kMaxEntries) {
+        return nullptr;
+    }
+    keysByPath_.emplace(entry.path, key);
+    return &entries_.emplace(key, std::move(entry)).first->second;
+}
+
+void DirSizeIndex::eraseEntry(const Key& key) const {
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        keysByPath_.erase(it->second.path);
+        entries_.erase(it);
+    }
+}
+
+bool DirSizeIndex::compact() const {
+    CStrPtr dir{g_path_get_dirname(filePath_.c_str())};
+    g_mkdir_with_parents(dir.get(), 0700);
+
+    std::string data{kMagic, sizeof(kMagic)};
+    for (const auto& entry : entries_) {
+        Record record{entry.first.device,
+                      entry.first.inode,
+                      entry.second.mtime,
+                      entry.second.sizes.size,
+                      entry.second.sizes.onDiskSize,
+                      entry.second.sizes.fileCount,
+                      static_cast<std::uint32_t>(entry.second.path.size()),
+                      0};
+        data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        data += entry.second.path;
+    }
+    const std::string tmpPath = filePath_ + ".tmp";
+    const int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (!writeAll(fd, data.data(), data.size()) || close(fd) != 0 || rename(tmpPath.c_str(), filePath_.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void DirSizeIndex::appendRecord(const Key& key, const Entry* entry) {
+    Record record{key.device, key.inode, 0, 0, 0, 0, 0, 0};
+    if (entry) {
+        record.mtime = entry->mtime;
+        record.size = entry->sizes.size;
+        record.onDiskSize = entry->sizes.onDiskSize;
+        record.fileCount = entry->sizes.fileCount;
+        record.pathLength = static_cast<std::uint32_t>(entry->path.size());
+    }
+    pending_.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    if (entry) {
+        pending_ += entry->path;
+    }
+    if (pending_.size() >= kWriteChunk) {
+        writePending();
+    }
+}
+
+void DirSizeIndex::writePending() {
+    if (pending_.empty()) {
+        return;
+    }
+    if (fd_ < 0) {
+        // the file was created, with its header, when it was loaded
+        fd_ = open(filePath_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    }
+    if (fd_ >= 0) {
+        writeAll(fd_, pending_.data(), pending_.size());
+    }
+    pending_.clear();
+}
+
+}  // namespace Fm
@@ -0,0 +1,92 @@
+#ifndef FM2_DIRSIZEINDEX_H
+#define FM2_DIRSIZEINDEX_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Fm {
+
+class FileInfo;
+
+// Remembers the total sizes of the local directory trees TotalSizeJob walked, by the device,
+// inode and modification time of each directory, so that they can be shown again without
+// walking the trees. The index is kept in an append-only file below $XDG_CACHE_HOME that is
+// read on first use and compacted when stale records dominate it.
+// Folders drop the totals of their directory and of the directories above it when their
+// monitor reports a change; a change in a directory nobody watches only goes unnoticed until
+// the directory is walked again. Safe to use from any thread.
+class LIBFM_QT_API DirSizeIndex : public QObject {
+    Q_OBJECT
+   public:
+    struct Sizes {
+        std::uint64_t size = 0;
+        std::uint64_t onDiskSize = 0;
+        std::uint64_t fileCount = 0;  // the directory itself included
+    };
+
+    // |filePath| is where the index is kept; it is only read or created on first use.
+    explicit DirSizeIndex(std::string filePath);
+
+    ~DirSizeIndex() override;
+
+    static std::shared_ptr<DirSizeIndex> globalInstance();
+
+    bool lookup(std::uint64_t device, std::uint64_t inode, std::int64_t mtime, Sizes& sizes) const;
+
+    // Looks a directory up by its file id, which holds the device and inode of local files.
+    bool lookup(const FileInfo& dir, Sizes& sizes) const;
+
+    void store(const std::string& path, std::uint64_t device, std::uint64_t inode, std::int64_t mtime,
+               const Sizes& sizes);
+
+    // Drops the totals of |path| and of every directory above it.
+    void invalidate(const std::string& path);
+
+    // Writes out the records stored so far and emits changed() if there were new totals.
+    void flush();
+
+   Q_SIGNALS:
+    // Emitted, from the thread calling flush(), once new totals are stored.
+    void changed();
+
+   private:
+    struct Key {
+        std::uint64_t device;
+        std::uint64_t inode;
+        bool operator==(const Key& other) const { return device == other.device && inode == other.inode; }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const;
+    };
+    struct Entry {
+        std::int64_t mtime;
+        Sizes sizes;
+        std::string path;
+    };
+
+    void load() const;
+    // keeps a single entry per directory and per path; returns null when the index is full
+    const Entry* insertEntry(const Key& key, Entry entry) const;
+    void eraseEntry(const Key& key) const;
+    bool compact() const;
+    void appendRecord(const Key& key, const Entry* entry);
+    void writePending();
+
+    std::string filePath_;
+    mutable std::mutex mutex_;
+    mutable bool loaded_ = false;
+    int fd_ = -1;
+    mutable std::unordered_map<Key, Entry, KeyHash> entries_;
+    mutable std::unordered_map<std::string, Key> keysByPath_;
+    std::string pending_;  // records not written yet
+    bool hasNewTotals_ = false;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_DIRSIZEINDEX_H
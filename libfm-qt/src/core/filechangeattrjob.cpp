@@ -1,10 +1,17 @@
 #include "filechangeattrjob.h"
 #include "totalsizejob.h"
+#include "localattrwalker.h"
 
 #include <sys/stat.h>
 
 namespace Fm {
 
+namespace {
+
+constexpr std::chrono::milliseconds kProgressInterval{200};
+
+}  // namespace
+
 static const char query[] = G_FILE_ATTRIBUTE_STANDARD_TYPE
     "," G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_UNIX_GID "," G_FILE_ATTRIBUTE_UNIX_UID
     "," G_FILE_ATTRIBUTE_UNIX_MODE "," G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME;
@@ -53,7 +60,7 @@ void FileChangeAttrJob::exec() {
     Q_EMIT preparedToRun();
 
     // do the actual change attrs job
-    for (auto& path : paths_) {
+    for (auto& path : execLocal(paths_)) {
         if (isCancelled()) {
             break;
         }
@@ -70,6 +77,52 @@ void FileChangeAttrJob::exec() {
     }
 }
 
+FilePathList FileChangeAttrJob::execLocal(const FilePathList& paths) {
+    // only the owner and the mode can be set without GIO
+    if (!LocalAttrWalker::isSupported() || displayNameEnabled_ || iconEnabled_ || hiddenEnabled_ ||
+        targetUriEnabled_) {
+        return paths;
+    }
+    LocalAttrWalker::Change change;
+    change.setOwner = ownerEnabled_;
+    change.uid = uid_;
+    change.setGroup = groupEnabled_;
+    change.gid = gid_;
+    if (fileModeEnabled_) {
+        change.mode = newMode_;
+        change.modeMask = newModeMask_;
+    }
+    FilePathList remaining;
+    LocalAttrWalker walker{change, recursive_};
+    for (const auto& path : paths) {
+        auto localPath = path.isNative() ? path.localPath() : CStrPtr{};
+        if (!localPath || !walker.addRoot(localPath.get())) {
+            remaining.push_back(path);
+        }
+        else if (!currentFile().isValid()) {
+            setCurrentFile(path);
+        }
+    }
+
+    std::uint64_t baseSize, baseCount;
+    finishedAmount(baseSize, baseCount);
+    walker.walk(cancellable().get(), kProgressInterval, [&](std::uint64_t visited) {
+        setFinishedAmount(baseSize + visited, baseCount + visited);
+    });
+    setFinishedAmount(baseSize + walker.visitedCount(), baseCount + walker.visitedCount());
+
+    for (const auto& error : walker.errors()) {
+        if (isCancelled()) {
+            break;
+        }
+        CStrPtr displayName{g_filename_display_name(error.first.c_str())};
+        GErrorPtr err{g_error_new(G_IO_ERROR, g_io_error_from_errno(error.second), "%s: %s", displayName.get(),
+                                  g_strerror(error.second))};
+        emitError(err, ErrorSeverity::MILD);
+    }
+    return remaining;
+}
+
 bool FileChangeAttrJob::processFile(const FilePath& path, const GFileInfoPtr& info) {
     setCurrentFile(path);
     bool ret = true;
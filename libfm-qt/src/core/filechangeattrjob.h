@@ -55,6 +55,8 @@ class LIBFM_QT_API FileChangeAttrJob : public Fm::FileOperationJob {
     void exec() override;
 
    private:
+    // Changes the owner and mode of the local paths natively and returns the ones left to GIO.
+    FilePathList execLocal(const FilePathList& paths);
     bool processFile(const FilePath& path, const GFileInfoPtr& info);
     bool handleError(GErrorPtr& err,
                      const FilePath& path,
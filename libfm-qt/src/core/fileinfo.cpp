@@ -1,5 +1,8 @@
 #include "fileinfo.h"
 #include "fileinfo_p.h"
+#include "memorystats.h"
+#include "metadatastore.h"
+#include <cstring>
 #include <gio/gio.h>
 
 #define METADATA_TRUST "metadata::trust"
@@ -19,6 +22,114 @@ const char defaultGFileInfoQueryAttribs[] =
     "mountable::can-unmount,"
     "mountable::can-eject," METADATA_TRUST;
 
+const char listingGFileInfoQueryAttribs[] =
+    "standard::type,"
+    "standard::is-hidden,"
+    "standard::is-backup,"
+    "standard::is-symlink,"
+    "standard::is-virtual,"
+    "standard::name,"
+    "standard::display-name,"
+    "standard::edit-name,"
+    "standard::icon,"
+    "standard::fast-content-type,"
+    "standard::size,"
+    "standard::allocated-size,"
+    "standard::symlink-target,"
+    "standard::target-uri,"
+    "standard::sort-order,"
+    "unix::*,"
+    "time::*,"
+    "access::*,"
+    "trash::deletion-date,"
+    "id::filesystem,"
+    "id::file,"
+    "metadata::emblems,"
+    "mountable::can-mount,"
+    "mountable::can-unmount,"
+    "mountable::can-eject," METADATA_TRUST;
+
+const char basicGFileInfoQueryAttribs[] =
+    "standard::type,"
+    "standard::is-hidden,"
+    "standard::is-backup,"
+    "standard::is-symlink,"
+    "standard::is-virtual,"
+    "standard::name,"
+    "standard::display-name,"
+    "standard::edit-name,"
+    "standard::icon,"
+    "standard::fast-content-type,"
+    "standard::symlink-target,"
+    "standard::target-uri,"
+    "access::can-read,"
+    "mountable::can-mount,"
+    "mountable::can-unmount,"
+    "mountable::can-eject";
+
+const char* gFileInfoQueryAttribs(FileInfoProfile profile) {
+    switch (profile) {
+        case FileInfoProfile::Basic:
+            return basicGFileInfoQueryAttribs;
+        case FileInfoProfile::Listing:
+            return listingGFileInfoQueryAttribs;
+        case FileInfoProfile::Full:
+            break;
+    }
+    return defaultGFileInfoQueryAttribs;
+}
+
+// |attribs| without the metadata:: attributes
+static std::string withoutMetadata(const char* attribs) {
+    std::string result;
+    for (const char* attrib = attribs; *attrib;) {
+        const char* end = std::strchr(attrib, ',');
+        const std::size_t length = end ? end - attrib : std::strlen(attrib);
+        if (std::strncmp(attrib, "metadata::", 10) != 0) {
+            if (!result.empty()) {
+                result += ',';
+            }
+            result.append(attrib, length);
+        }
+        attrib += end ? length + 1 : length;
+    }
+    return result;
+}
+
+const char* gFileInfoQueryAttribs(FileInfoProfile profile, const FilePath& path) {
+    if (profile == FileInfoProfile::Basic || !MetadataStore::isEnabled() || !path.isNative()) {
+        return gFileInfoQueryAttribs(profile);
+    }
+    static const std::string listing = withoutMetadata(listingGFileInfoQueryAttribs);
+    static const std::string full = withoutMetadata(defaultGFileInfoQueryAttribs);
+    return profile == FileInfoProfile::Listing ? listing.c_str() : full.c_str();
+}
+
+void useFastContentType(GFileInfo* inf) {
+    if (!g_file_info_has_attribute(inf, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+        if (const char* type = g_file_info_get_attribute_string(inf, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE)) {
+            g_file_info_set_content_type(inf, type);
+        }
+    }
+}
+
+// The part of a GFileInfo a FileInfo needs after it has been set up: the edit name and the
+// metadata it can change. A GFileInfo from a query is a table of some forty attributes,
+// several times the size of the FileInfo itself, which adds up in big folders.
+static GFileInfoPtr compactGFileInfo(const GFileInfoPtr& inf) {
+    GFileInfoPtr compact{g_file_info_new(), false};
+    static const char* const keptAttributes[] = {G_FILE_ATTRIBUTE_STANDARD_EDIT_NAME, METADATA_TRUST,
+                                                 "metadata::emblems"};
+    for (const char* attribute : keptAttributes) {
+        GFileAttributeType type;
+        gpointer value;
+        if (g_file_info_get_attribute_data(inf.get(), attribute, &type, &value, nullptr)) {
+            g_file_info_set_attribute(compact.get(), attribute, type, value);
+        }
+    }
+    return compact;
+}
+
 FileInfo::FileInfo() {
     // FIXME: initialize numeric data members
 }
@@ -27,7 +138,9 @@ FileInfo::FileInfo(const GFileInfoPtr& inf, const FilePath& filePath, const File
     setFromGFileInfo(inf, filePath, parentDirPath);
 }
 
-FileInfo::~FileInfo() {}
+FileInfo::~FileInfo() {
+    MemoryStats::account(MemoryStats::FileInfos, accountedBytes_, 0);
+}
 
 void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf,
                                 const FilePath& filePath,
@@ -51,6 +164,10 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf,
     dispName_ = QString::fromUtf8(g_file_info_get_display_name(inf.get()));
 
     size_ = g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    linkCount_ = g_file_info_get_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_NLINK);
+    hasDetails_ = g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_UNIX_MODE) ||
+                  g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED) ||
+                  g_file_info_has_attribute(inf.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
 
     type = g_file_info_get_file_type(inf.get());
 
@@ -288,13 +405,7 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf,
 #endif
 
     /* if the file has emblems, add them to the icon */
-    auto emblem_names = g_file_info_get_attribute_stringv(inf.get(), "metadata::emblems");
-    if (emblem_names) {
-        auto n_emblems = g_strv_length(emblem_names);
-        for (int i = n_emblems - 1; i >= 0; --i) {
-            emblems_.emplace_front(Fm::IconInfo::fromName(emblem_names[i]));
-        }
-    }
+    setEmblems(inf.get());
 
     tmp = g_file_info_get_attribute_string(inf.get(), G_FILE_ATTRIBUTE_ID_FILESYSTEM);
     filesystemId_ = g_intern_string(tmp);
@@ -361,6 +472,9 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf,
     if (!icon_ && mimeType_)
         icon_ = mimeType_->icon();
 
+    inf_ = compactGFileInfo(inf);
+    accountMemory();
+
 #if 0
     GFile* _gf = nullptr;
     GFileAttributeInfoList* list;
@@ -380,6 +494,29 @@ void FileInfo::setFromGFileInfo(const GObjectPtr<GFileInfo>& inf,
 #endif
 }
 
+void FileInfo::setEmblems(GFileInfo* inf) const {
+    emblems_.clear();
+    if (g_file_info_get_attribute_type(inf, "metadata::emblems") == G_FILE_ATTRIBUTE_TYPE_STRINGV) {
+        auto emblem_names = g_file_info_get_attribute_stringv(inf, "metadata::emblems");
+        if (emblem_names) {
+            auto n_emblems = g_strv_length(emblem_names);
+            for (int i = n_emblems - 1; i >= 0; --i) {
+                emblems_.emplace_front(Fm::IconInfo::fromName(emblem_names[i]));
+            }
+        }
+    }
+}
+
+void FileInfo::accountMemory() {
+    if (MemoryStats::isEnabled()) {
+        // the compact GFileInfo holds a few short attributes
+        constexpr int64_t gfileInfoBytes = 256;
+        MemoryStats::account(MemoryStats::FileInfos, accountedBytes_,
+                             sizeof(FileInfo) + gfileInfoBytes + name_.capacity() + target_.capacity() +
+                                 dispName_.capacity() * sizeof(QChar));
+    }
+}
+
 bool FileInfo::canThumbnail() const {
     /* We cannot use S_ISREG here as this exclude all symlinks */
     if (size_ == 0 || /* don't generate thumbnails for empty files */
@@ -460,6 +597,13 @@ void FileInfo::setTrustable(bool trust) const {
         g_file_info_set_attribute(info.get(), METADATA_TRUST, G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
         g_file_info_set_attribute(inf_.get(), METADATA_TRUST, G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
     }
+    if (MetadataStore::isEnabled() && path().isNative()) {
+        if (auto localPath = path().localPath()) {
+            MetadataStore::globalInstance()->update(localPath.get(),
+                                                    [trust](MetadataStore::Entry& entry) { entry.trusted = trust; });
+        }
+        return;
+    }
     g_file_set_attributes_from_info(path().gfile().get(), info.get(), G_FILE_QUERY_INFO_NONE, nullptr, nullptr);
 }
 
@@ -474,18 +618,19 @@ void FileInfo::setEmblem(const QString& emblmeName, bool setGFileEmblem) const {
         g_file_info_set_attribute(inf_.get(), "metadata::emblems", G_FILE_ATTRIBUTE_TYPE_INVALID, nullptr);
     }
     // update current emblems
-    emblems_.clear();
-    if (g_file_info_get_attribute_type(inf_.get(), "metadata::emblems") == G_FILE_ATTRIBUTE_TYPE_STRINGV) {
-        auto emblem_names = g_file_info_get_attribute_stringv(inf_.get(), "metadata::emblems");
-        if (emblem_names) {
-            auto n_emblems = g_strv_length(emblem_names);
-            for (int i = n_emblems - 1; i >= 0; --i) {
-                emblems_.emplace_front(Fm::IconInfo::fromName(emblem_names[i]));
-            }
+    setEmblems(inf_.get());
+
+    if (setGFileEmblem && MetadataStore::isEnabled() && path().isNative()) {
+        if (auto localPath = path().localPath()) {
+            MetadataStore::globalInstance()->update(localPath.get(), [&str](MetadataStore::Entry& entry) {
+                entry.emblems.clear();
+                if (!str.isEmpty()) {
+                    entry.emblems.emplace_back(str.constData());
+                }
+            });
         }
     }
-
-    if (setGFileEmblem) {  // really give the emblem to GFile
+    else if (setGFileEmblem) {  // really give the emblem to GFile
         GFileInfoPtr info{g_file_info_new(), false};
         if (!str.isEmpty()) {
             char* stringv[] = {str.data(), nullptr};
@@ -45,6 +45,15 @@ namespace Fm {
 class FileInfoList;
 typedef std::set<unsigned int> HashSet;
 
+// The attributes files are queried for with GIO, from what their consumer shows of them. The
+// wider profiles cost more per file, the sniffed content type of Full most, as it reads the
+// file. Files listed natively get what Listing has whatever they ask for, statx() being cheap.
+enum class FileInfoProfile {
+    Basic,    // name, type, icon and link target, and the content type guessed from the name
+    Listing,  // also sizes, times, owners and permissions
+    Full,     // also the content type sniffed from the contents
+};
+
 class LIBFM_QT_API FileInfo {
    public:
     explicit FileInfo();
@@ -90,6 +99,10 @@ class LIBFM_QT_API FileInfo {
 
     bool isAccessible() const { return isAccessible_; }
 
+    // False for files queried with FileInfoProfile::Basic, whose sizes, times, owners and
+    // permissions are unknown; query them again with FileInfoJob before showing those.
+    bool hasDetails() const { return hasDetails_; }
+
     bool isWritable() const { return isWritable_; }
 
     bool isDeletable() const { return isDeletable_; }
@@ -129,6 +142,10 @@ class LIBFM_QT_API FileInfo {
 
     mode_t mode() const { return mode_; }
 
+    // The number of hard links; for a directory on most local filesystems, 2 plus the number of
+    // its subdirectories. 0 when unknown.
+    unsigned int linkCount() const { return linkCount_; }
+
     uint64_t realSize() const { return blksize_ * blocks_; }
 
     uint64_t size() const { return size_; }
@@ -155,9 +172,19 @@ class LIBFM_QT_API FileInfo {
 
     void setTrustable(bool trust) const;
 
+    // Only holds the edit name and the metadata attributes (emblems, trust); everything else
+    // has its own accessor.
     GObjectPtr<GFileInfo> gFileInfo() const { return inf_; }
 
    private:
+    // reads and writes the fields of the files it keeps, see listingsnapshot.h
+    friend class ListingSnapshot;
+
+    void accountMemory();
+
+    // Keeps the emblems named by the metadata::emblems attribute of |inf| as those of the file.
+    void setEmblems(GFileInfo* inf) const;
+
     GObjectPtr<GFileInfo> inf_;
     std::string name_;
     QString dispName_;
@@ -165,11 +192,12 @@ class LIBFM_QT_API FileInfo {
     FilePath filePath_;
     FilePath dirPath_;
 
-    mode_t mode_;
     const char* filesystemId_;
     const char* fileId_;
+    mode_t mode_;
     uid_t uid_;
     gid_t gid_;
+    unsigned int linkCount_ = 0;
     uint64_t size_;
     quint64 mtime_;
     quint64 atime_;
@@ -186,6 +214,8 @@ class LIBFM_QT_API FileInfo {
 
     std::string target_; /* target of shortcut or mountable. */
 
+    int64_t accountedBytes_ = 0;  // in MemoryStats
+
     bool isShortcut_ : 1;         /* TRUE if file is shortcut type */
     bool isMountable_ : 1;        /* TRUE if file is mountable type */
     bool isAccessible_ : 1;       /* TRUE if can be read by user */
@@ -201,6 +231,7 @@ class LIBFM_QT_API FileInfo {
     bool canMount_ : 1;           /* TRUE if can be mounted */
     bool canUnmount_ : 1;         /* TRUE if can be unmounted */
     bool canEject_ : 1;           /* TRUE if can be ejected */
+    bool hasDetails_ : 1;         /* TRUE if queried for more than FileInfoProfile::Basic */
 };
 
 class LIBFM_QT_API FileInfoList : public std::vector<std::shared_ptr<const FileInfo>> {
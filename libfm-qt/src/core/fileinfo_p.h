@@ -1,9 +1,26 @@
 #ifndef FILEINFO_P_H
 #define FILEINFO_P_H
 
+#include <gio/gio.h>
+#include "fileinfo.h"
+
 namespace Fm {
 
 extern const char defaultGFileInfoQueryAttribs[];
+// The same but with standard::fast-content-type, guessed from the file name, instead of the
+// sniffed standard::content-type; used for listing folders.
+extern const char listingGFileInfoQueryAttribs[];
+// Only what FileInfoProfile::Basic asks for.
+extern const char basicGFileInfoQueryAttribs[];
+
+const char* gFileInfoQueryAttribs(FileInfoProfile profile);
+
+// The same for |path|: without the metadata:: attributes while MetadataStore keeps those of local
+// files, which MetadataStore::addTo() then adds.
+const char* gFileInfoQueryAttribs(FileInfoProfile profile, const FilePath& path);
+
+// Takes standard::fast-content-type for the content type of |inf| when it was not sniffed.
+void useFastContentType(GFileInfo* inf);
 
 }  // namespace Fm
 
@@ -1,25 +1,82 @@
 #include "fileinfojob.h"
 #include "fileinfo_p.h"
+#include "localdirlister.h"
+#include "metadatastore.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace Fm {
 
-FileInfoJob::FileInfoJob(FilePathList paths) : Job(), paths_{std::move(paths)} {}
+namespace {
+
+// Fewer files than this in a directory are queried with GIO, which also reads their metadata
+// (emblems and the like); more usually come from a burst of changes, better stat'ed natively.
+constexpr std::size_t kMinNativeBatch = 32;
+
+// Queries the many local files of |paths| that share a directory natively, in parallel.
+// The results are by the index of their path, null for the files left to GIO.
+FileInfoList queryLocalFiles(const FilePathList& paths, GCancellable* cancellable) {
+    std::unordered_map<FilePath, std::vector<std::size_t>, FilePathHash> byDir;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        if (paths[i].isNative() && paths[i].hasParent()) {
+            byDir[paths[i].parent()].push_back(i);
+        }
+    }
+    FileInfoList results;
+    for (const auto& dir : byDir) {
+        const auto& indices = dir.second;
+        if (indices.size() < kMinNativeBatch || !LocalDirLister::isSupported(dir.first)) {
+            continue;
+        }
+        std::vector<std::string> names;
+        names.reserve(indices.size());
+        for (auto i : indices) {
+            names.emplace_back(paths[i].baseName().get());
+        }
+        FileInfoList files;
+        if (!LocalDirLister{dir.first}.query(names, cancellable, files)) {
+            continue;
+        }
+        results.resize(paths.size());
+        for (std::size_t j = 0; j < indices.size(); ++j) {
+            results[indices[j]] = std::move(files[j]);
+        }
+    }
+    return results;
+}
+
+}  // namespace
+
+FileInfoJob::FileInfoJob(FilePathList paths, FileInfoProfile profile)
+    : Job(), paths_{std::move(paths)}, profile_{profile} {}
 
 void FileInfoJob::exec() {
-    for (const auto& path : paths_) {
+    const FileInfoList localFiles = paths_.size() >= kMinNativeBatch ? queryLocalFiles(paths_, cancellable().get())
+                                                                     : FileInfoList{};
+    for (std::size_t i = 0; i < paths_.size(); ++i) {
         if (isCancelled()) {
             break;
         }
+        const auto& path = paths_[i];
         currentPath_ = path;
 
+        if (i < localFiles.size() && localFiles[i]) {
+            results_.push_back(localFiles[i]);
+            Q_EMIT gotInfo(path, results_.back());
+            continue;
+        }
+
         bool retry;
         do {
             retry = false;
             GErrorPtr err;
-            GFileInfoPtr inf{g_file_query_info(path.gfile().get(), defaultGFileInfoQueryAttribs, G_FILE_QUERY_INFO_NONE,
-                                               cancellable().get(), &err),
+            GFileInfoPtr inf{g_file_query_info(path.gfile().get(), gFileInfoQueryAttribs(profile_, path),
+                                               G_FILE_QUERY_INFO_NONE, cancellable().get(), &err),
                              false};
             if (inf) {
+                useFastContentType(inf.get());
+                MetadataStore::addTo(path, inf.get());
                 auto fileInfoPtr = std::make_shared<FileInfo>(inf, path);
                 results_.push_back(fileInfoPtr);
                 Q_EMIT gotInfo(path, results_.back());
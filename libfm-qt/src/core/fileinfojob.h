@@ -11,7 +11,8 @@ namespace Fm {
 class LIBFM_QT_API FileInfoJob : public Job {
     Q_OBJECT
    public:
-    explicit FileInfoJob(FilePathList paths);
+    // |profile| is what the files are queried for with GIO, see FileInfoProfile.
+    explicit FileInfoJob(FilePathList paths, FileInfoProfile profile = FileInfoProfile::Full);
 
     const FilePathList& paths() const { return paths_; }
 
@@ -27,6 +28,7 @@ class LIBFM_QT_API FileInfoJob : public Job {
 
    private:
     FilePathList paths_;
+    FileInfoProfile profile_;
     FileInfoList results_;
     FilePath currentPath_;
 };
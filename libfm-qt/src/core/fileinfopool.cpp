@@ -0,0 +1,77 @@
+#include "fileinfopool.h"
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+namespace Fm {
+
+std::atomic<bool> FileInfoPool::enabled_{true};
+
+std::shared_ptr<FileInfoPool> FileInfoPool::create() {
+    return std::shared_ptr<FileInfoPool>{new FileInfoPool, [](FileInfoPool* pool) { pool->release(); }};
+}
+
+FileInfoPool::~FileInfoPool() {
+    for (void* block : blocks_) {
+        ::operator delete(block);
+    }
+}
+
+std::size_t FileInfoPool::liveFiles() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return liveFiles_;
+}
+
+std::size_t FileInfoPool::reservedBytes() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return blocks_.size() * kBlockFiles * slotSize_;
+}
+
+void* FileInfoPool::allocate(std::size_t size) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (slotSize_ == 0) {
+        constexpr std::size_t align = alignof(std::max_align_t);
+        slotSize_ = (std::max(size, sizeof(FreeSlot)) + align - 1) / align * align;
+    }
+    if (size > slotSize_) {
+        return ::operator new(size);
+    }
+    if (!freeSlots_) {
+        // ::operator new aligns for any type, and the slot size keeps that alignment
+        char* block = static_cast<char*>(::operator new(kBlockFiles * slotSize_));
+        blocks_.push_back(block);
+        for (std::size_t i = kBlockFiles; i-- > 0;) {
+            auto slot = reinterpret_cast<FreeSlot*>(block + i * slotSize_);
+            slot->next = freeSlots_;
+            freeSlots_ = slot;
+        }
+    }
+    FreeSlot* slot = freeSlots_;
+    freeSlots_ = slot->next;
+    ++liveFiles_;
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+void FileInfoPool::deallocate(void* p, std::size_t size) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (size > slotSize_) {
+            ::operator delete(p);
+            return;
+        }
+        auto slot = static_cast<FreeSlot*>(p);
+        slot->next = freeSlots_;
+        freeSlots_ = slot;
+        --liveFiles_;
+    }
+    release();
+}
+
+void FileInfoPool::release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+}  // namespace Fm
@@ -0,0 +1,104 @@
+#ifndef FM2_FILEINFOPOOL_H
+#define FM2_FILEINFOPOOL_H
+
+#include "../libfmqtglobals.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "fileinfo.h"
+
+namespace Fm {
+
+// Allocates the FileInfos listed for a Folder kBlockFiles at a time, each with its shared_ptr
+// control block, instead of one heap allocation per file: a big folder then costs a few
+// hundred allocations rather than one per file, and its files lie next to each other. The
+// slots of the files that go are reused by the next listings of the folder. The pool lives
+// until the folder and the last FileInfo made from it are gone, so that files outliving the
+// folder stay valid. Safe to share between threads.
+class LIBFM_QT_API FileInfoPool {
+   public:
+    static constexpr std::size_t kBlockFiles = 256;
+
+    // On unless setEnabled(false), which has the folders allocate each file on its own again,
+    // as to compare the two.
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // A new pool, held by the returned pointer and by each FileInfo made from it.
+    static std::shared_ptr<FileInfoPool> create();
+
+    FileInfoPool(const FileInfoPool&) = delete;
+    FileInfoPool& operator=(const FileInfoPool&) = delete;
+
+    // A FileInfo made with |args|, allocated from |pool|, or on its own when there is none.
+    template <typename... Args>
+    static std::shared_ptr<FileInfo> makeFileInfo(FileInfoPool* pool, Args&&... args) {
+        if (!pool) {
+            return std::make_shared<FileInfo>(std::forward<Args>(args)...);
+        }
+        return std::allocate_shared<FileInfo>(Allocator<FileInfo>{pool}, std::forward<Args>(args)...);
+    }
+
+    // The files allocated from the pool and not freed yet.
+    std::size_t liveFiles() const;
+
+    // The bytes of the blocks allocated so far.
+    std::size_t reservedBytes() const;
+
+   private:
+    // Takes a slot for one FileInfo with its control block in |pool|, holding the pool until
+    // the slot is given back. Stored with the control block, so only a pointer.
+    template <typename T>
+    struct Allocator {
+        using value_type = T;
+
+        explicit Allocator(FileInfoPool* p) : pool{p} {}
+
+        template <typename U>
+        Allocator(const Allocator<U>& other) : pool{other.pool} {}
+
+        T* allocate(std::size_t n) { return static_cast<T*>(pool->allocate(n * sizeof(T))); }
+
+        void deallocate(T* p, std::size_t n) { pool->deallocate(p, n * sizeof(T)); }
+
+        template <typename U>
+        bool operator==(const Allocator<U>& other) const {
+            return pool == other.pool;
+        }
+
+        template <typename U>
+        bool operator!=(const Allocator<U>& other) const {
+            return pool != other.pool;
+        }
+
+        FileInfoPool* pool;
+    };
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    FileInfoPool() = default;
+    ~FileInfoPool();
+
+    void* allocate(std::size_t size);
+    void deallocate(void* p, std::size_t size);
+    void release();
+
+    mutable std::mutex mutex_;
+    std::size_t slotSize_ = 0;  // set by the first allocation
+    std::vector<void*> blocks_;
+    FreeSlot* freeSlots_ = nullptr;
+    std::size_t liveFiles_ = 0;
+    std::atomic<std::size_t> refs_{1};  // the pointer of create() and the live slots
+
+    static std::atomic<bool> enabled_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_FILEINFOPOOL_H
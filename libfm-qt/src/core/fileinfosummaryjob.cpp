@@ -0,0 +1,98 @@
+#include "fileinfosummaryjob.h"
+#include <sys/stat.h>
+
+namespace Fm {
+
+namespace {
+
+// the files added between two updates of the summary that can be read
+constexpr std::size_t kBatchSize = 4096;
+
+bool sameEmblem(const std::shared_ptr<const IconInfo>& a, const std::shared_ptr<const IconInfo>& b) {
+    // the icons are shared, but one dropped from their cache may come back as another
+    return a == b || (a && b && g_icon_equal(a->gicon().get(), b->gicon().get()));
+}
+
+}  // namespace
+
+void FileInfoSummary::add(const FileInfo& file) {
+    const mode_t mode = file.mode();
+    const auto& emblems = file.emblems();
+    std::shared_ptr<const IconInfo> fileEmblem = emblems.empty() ? nullptr : emblems.front();
+    if (count++ == 0) {
+        mimeType = file.mimeType();
+        emblem = std::move(fileEmblem);
+        allNative = file.isNative();
+        hasDir = S_ISDIR(mode);
+        uid = file.uid();
+        gid = file.gid();
+        ownerPerm = mode & (S_IRUSR | S_IWUSR | S_IXUSR);
+        groupPerm = mode & (S_IRGRP | S_IWGRP | S_IXGRP);
+        otherPerm = mode & (S_IROTH | S_IWOTH | S_IXOTH);
+        execPerm = mode & (S_IXUSR | S_IXGRP | S_IXOTH);
+        return;
+    }
+
+    if (sameType && file.mimeType() != mimeType) {
+        sameType = false;
+        mimeType.reset();
+    }
+    if (emblem && !sameEmblem(emblem, fileEmblem)) {
+        emblem.reset();
+    }
+    allNative = allNative && file.isNative();
+    hasDir = hasDir || S_ISDIR(mode);
+    if (uid != kDifferentUids && uid != file.uid()) {
+        uid = kDifferentUids;
+    }
+    if (gid != kDifferentGids && gid != file.gid()) {
+        gid = kDifferentGids;
+    }
+    if (ownerPerm != kDifferentPerms && ownerPerm != (mode & (S_IRUSR | S_IWUSR | S_IXUSR))) {
+        ownerPerm = kDifferentPerms;
+    }
+    if (groupPerm != kDifferentPerms && groupPerm != (mode & (S_IRGRP | S_IWGRP | S_IXGRP))) {
+        groupPerm = kDifferentPerms;
+    }
+    if (otherPerm != kDifferentPerms && otherPerm != (mode & (S_IROTH | S_IWOTH | S_IXOTH))) {
+        otherPerm = kDifferentPerms;
+    }
+    if (execPerm != kDifferentPerms && execPerm != (mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
+        execPerm = kDifferentPerms;
+    }
+}
+
+FileInfoSummaryJob::FileInfoSummaryJob(FileInfoList files) : files_{std::move(files)} {}
+
+FileInfoSummary FileInfoSummaryJob::summary() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return summary_;
+}
+
+// static
+FileInfoSummary FileInfoSummaryJob::summarize(const FileInfoList& files) {
+    FileInfoSummary summary;
+    for (const auto& file : files) {
+        summary.add(*file);
+    }
+    return summary;
+}
+
+void FileInfoSummaryJob::exec() {
+    FileInfoSummary summary;
+    for (std::size_t i = 0; i < files_.size(); ++i) {
+        summary.add(*files_[i]);
+        if ((i + 1) % kBatchSize == 0 || i + 1 == files_.size()) {
+            if (isCancelled()) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                summary_ = summary;
+            }
+            Q_EMIT summaryChanged();
+        }
+    }
+}
+
+}  // namespace Fm
@@ -0,0 +1,63 @@
+#ifndef FM2_FILEINFOSUMMARYJOB_H
+#define FM2_FILEINFOSUMMARYJOB_H
+
+#include "../libfmqtglobals.h"
+#include "job.h"
+#include "fileinfo.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+
+namespace Fm {
+
+// What a set of files has in common, for showing their properties together.
+struct LIBFM_QT_API FileInfoSummary {
+    // marks a field the files differ in
+    static constexpr uid_t kDifferentUids = static_cast<uid_t>(-1);
+    static constexpr gid_t kDifferentGids = static_cast<gid_t>(-1);
+    static constexpr mode_t kDifferentPerms = static_cast<mode_t>(-1);
+
+    std::size_t count = 0;  // the files added
+    bool sameType = true;
+    std::shared_ptr<const MimeType> mimeType;  // of all the files; null if they differ
+    std::shared_ptr<const IconInfo> emblem;    // the first emblem of all the files; null if they differ
+    bool hasDir = false;
+    bool allNative = true;  // all the files are on native UNIX filesystems
+    uid_t uid = kDifferentUids;
+    gid_t gid = kDifferentGids;
+    mode_t ownerPerm = kDifferentPerms;  // the bits of the owner, in place
+    mode_t groupPerm = kDifferentPerms;
+    mode_t otherPerm = kDifferentPerms;
+    mode_t execPerm = kDifferentPerms;  // the executable bits of all three
+
+    void add(const FileInfo& file);
+};
+
+// Summarizes a list of files off the GUI thread, which takes a while with many thousands of
+// them. The summary so far can be read while the job runs.
+class LIBFM_QT_API FileInfoSummaryJob : public Job {
+    Q_OBJECT
+   public:
+    explicit FileInfoSummaryJob(FileInfoList files);
+
+    FileInfoSummary summary() const;
+
+    static FileInfoSummary summarize(const FileInfoList& files);
+
+   Q_SIGNALS:
+    // Emitted from the job thread every now and then while the files are added.
+    void summaryChanged();
+
+   protected:
+    void exec() override;
+
+   private:
+    FileInfoList files_;
+    mutable std::mutex mutex_;
+    FileInfoSummary summary_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_FILEINFOSUMMARYJOB_H
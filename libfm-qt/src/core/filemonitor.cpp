@@ -1,7 +1,425 @@
 #include "filemonitor.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <QSocketNotifier>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#endif
+
+#ifdef __linux__
+#define FM_INOTIFY 1
+#if defined(FAN_REPORT_DFID_NAME) && defined(FAN_MARK_FILESYSTEM)
+#define FM_FANOTIFY 1
+#endif
+#endif
 
 namespace Fm {
 
-FileMonitor::FileMonitor() {}
+namespace {
+
+constexpr std::size_t kEventBufferSize = 16 * 1024;
+
+#ifdef FM_INOTIFY
+constexpr std::uint32_t kInotifyMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                                       IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR |
+                                       IN_EXCL_UNLINK;
+
+// the same events GIO's inotify backend reports
+bool inotifyEvent(std::uint32_t mask, GFileMonitorEvent& event) {
+    if (mask & (IN_CREATE | IN_MOVED_TO)) {
+        event = G_FILE_MONITOR_EVENT_CREATED;
+    }
+    else if (mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF)) {
+        event = G_FILE_MONITOR_EVENT_DELETED;
+    }
+    else if (mask & IN_MODIFY) {
+        event = G_FILE_MONITOR_EVENT_CHANGED;
+    }
+    else if (mask & IN_CLOSE_WRITE) {
+        event = G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT;
+    }
+    else if (mask & IN_ATTRIB) {
+        event = G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED;
+    }
+    else if (mask & IN_UNMOUNT) {
+        event = G_FILE_MONITOR_EVENT_UNMOUNTED;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+#endif  // FM_INOTIFY
+
+#ifdef FM_FANOTIFY
+// no FAN_CLOSE_WRITE or FAN_OPEN: every program closing a file would wake us up
+constexpr std::uint64_t kFanotifyMask =
+    FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR;
+
+// directories whose path is remembered between events
+constexpr std::size_t kMaxResolvedHandles = 4096;
+#endif
+
+}  // namespace
+
+std::mutex FileMonitor::mutex_;
+std::weak_ptr<FileMonitor> FileMonitor::globalInstance_;
+
+FileMonitor::Watch::~Watch() {
+    monitor_->unsubscribe(id_);
+}
+
+FileMonitor::FileMonitor()
+    : inotifyFd_{-1},
+      inotifyNotifier_{nullptr},
+      fanotifyFd_{-1},
+      fanotifyFailed_{false},
+      fanotifyNotifier_{nullptr},
+      lastId_{0} {
+#ifdef FM_INOTIFY
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ >= 0) {
+        inotifyNotifier_ = new QSocketNotifier(inotifyFd_, QSocketNotifier::Read, this);
+        connect(inotifyNotifier_, &QSocketNotifier::activated, this, &FileMonitor::onInotifyEvents);
+    }
+    else {
+        qDebug("inotify is not available: %s", strerror(errno));
+    }
+#endif
+}
+
+FileMonitor::~FileMonitor() {
+    for (const auto& fs : markedFilesystems_) {
+        close(fs.second);
+    }
+    if (fanotifyFd_ >= 0) {
+        close(fanotifyFd_);  // also drops the marks
+    }
+    if (inotifyFd_ >= 0) {
+        close(inotifyFd_);
+    }
+}
+
+std::shared_ptr<FileMonitor> FileMonitor::globalInstance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto mon = globalInstance_.lock();
+    if (mon == nullptr) {
+        mon = std::make_shared<FileMonitor>();
+        globalInstance_ = mon;
+    }
+    return mon;
+}
+
+int FileMonitor::subscribe(const FilePath& dir, Callback callback) {
+    auto subscriber = std::make_shared<Subscriber>();
+    subscriber->dir = dir;
+    subscriber->callback = std::move(callback);
+    subscribers_.emplace(++lastId_, std::move(subscriber));
+    return lastId_;
+}
+
+std::unique_ptr<FileMonitor::Watch> FileMonitor::watchDirectory(const FilePath& dir, Callback callback) {
+#ifdef FM_INOTIFY
+    if (inotifyFd_ < 0 || !dir.isNative() || !dir.hasUriScheme("file")) {
+        return nullptr;
+    }
+    int wd;
+    auto watched = watchedDirs_.find(dir);
+    if (watched != watchedDirs_.end()) {
+        wd = watched->second;
+    }
+    else {
+        // the same directory through another path (a symlink, a bind mount) gets the same watch back
+        wd = inotify_add_watch(inotifyFd_, dir.localPath().get(), kInotifyMask);
+        if (wd < 0) {  // ENOSPC when the watch limit is reached
+            return nullptr;
+        }
+        watchedDirs_.emplace(dir, wd);
+    }
+    const int id = subscribe(dir, std::move(callback));
+    subscribers_[id]->wd = wd;
+    dirWatches_[wd].push_back(id);
+    return std::unique_ptr<Watch>{new Watch{shared_from_this(), id}};
+#else
+    Q_UNUSED(dir);
+    Q_UNUSED(callback);
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<FileMonitor::Watch> FileMonitor::watchTree(const FilePath& dir, Callback callback) {
+#ifdef FM_FANOTIFY
+    if (fanotifyFailed_ || !dir.isNative() || !dir.hasUriScheme("file")) {
+        return nullptr;
+    }
+    if (fanotifyFd_ < 0) {
+        fanotifyFd_ = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK,
+                                    O_RDONLY | O_CLOEXEC);
+        if (fanotifyFd_ < 0) {  // EPERM without CAP_SYS_ADMIN, EINVAL before Linux 5.9
+            fanotifyFailed_ = true;
+            return nullptr;
+        }
+        fanotifyNotifier_ = new QSocketNotifier(fanotifyFd_, QSocketNotifier::Read, this);
+        connect(fanotifyNotifier_, &QSocketNotifier::activated, this, &FileMonitor::onFanotifyEvents);
+    }
+
+    auto localPath = dir.localPath();
+    struct statfs st;
+    if (statfs(localPath.get(), &st) != 0) {
+        return nullptr;
+    }
+    std::string fsid{reinterpret_cast<const char*>(&st.f_fsid), sizeof(st.f_fsid)};
+    if (markedFilesystems_.find(fsid) == markedFilesystems_.end()) {
+        // also needed to open the directories of events by their handles
+        int fd = open(localPath.get(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        if (fanotify_mark(fanotifyFd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, kFanotifyMask, fd, nullptr) != 0) {
+            close(fd);  // e.g. a filesystem without a fsid
+            return nullptr;
+        }
+        markedFilesystems_.emplace(fsid, fd);
+    }
+    const int id = subscribe(dir, std::move(callback));
+    subscribers_[id]->fsid = std::move(fsid);
+    treeSubscribers_.push_back(id);
+    return std::unique_ptr<Watch>{new Watch{shared_from_this(), id}};
+#else
+    Q_UNUSED(dir);
+    Q_UNUSED(callback);
+    return nullptr;
+#endif
+}
+
+void FileMonitor::unsubscribe(int id) {
+    auto it = subscribers_.find(id);
+    if (it == subscribers_.end()) {
+        return;
+    }
+    auto subscriber = std::move(it->second);
+    subscriber->active = false;
+    subscribers_.erase(it);
+
+#ifdef FM_INOTIFY
+    auto watch = dirWatches_.find(subscriber->wd);
+    if (watch != dirWatches_.end()) {
+        auto& ids = watch->second;
+        ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+        if (std::none_of(ids.cbegin(), ids.cend(),
+                         [&](int other) { return subscribers_.at(other)->dir == subscriber->dir; })) {
+            watchedDirs_.erase(subscriber->dir);
+        }
+        if (ids.empty()) {
+            inotify_rm_watch(inotifyFd_, subscriber->wd);
+            dirWatches_.erase(watch);
+        }
+    }
+#endif
+
+#ifdef FM_FANOTIFY
+    if (!subscriber->fsid.empty()) {
+        treeSubscribers_.erase(std::remove(treeSubscribers_.begin(), treeSubscribers_.end(), id),
+                               treeSubscribers_.end());
+        if (std::none_of(treeSubscribers_.cbegin(), treeSubscribers_.cend(),
+                         [&](int other) { return subscribers_.at(other)->fsid == subscriber->fsid; })) {
+            auto fs = markedFilesystems_.find(subscriber->fsid);
+            fanotify_mark(fanotifyFd_, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, kFanotifyMask, fs->second, nullptr);
+            close(fs->second);
+            markedFilesystems_.erase(fs);
+            resolvedHandles_.clear();
+        }
+    }
+#endif
+}
+
+std::vector<std::shared_ptr<FileMonitor::Subscriber>> FileMonitor::subscribersOf(const std::vector<int>& ids) const {
+    std::vector<std::shared_ptr<Subscriber>> subscribers;
+    subscribers.reserve(ids.size());
+    for (int id : ids) {
+        subscribers.push_back(subscribers_.at(id));
+    }
+    return subscribers;
+}
+
+void FileMonitor::dispatchLostEvents() {
+    std::vector<std::shared_ptr<Subscriber>> subscribers;
+    for (const auto& subscriber : subscribers_) {
+        subscribers.push_back(subscriber.second);
+    }
+    for (const auto& subscriber : subscribers) {
+        if (subscriber->active) {
+            subscriber->callback(FilePath{}, G_FILE_MONITOR_EVENT_CHANGED);
+        }
+    }
+}
+
+void FileMonitor::onInotifyEvents() {
+#ifdef FM_INOTIFY
+    alignas(struct inotify_event) char buffer[kEventBufferSize];
+    bool lostEvents = false;
+    for (;;) {
+        const ssize_t len = read(inotifyFd_, buffer, sizeof(buffer));
+        if (len <= 0) {  // EAGAIN once everything is read
+            break;
+        }
+        for (const char* p = buffer; p < buffer + len;) {
+            const auto event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                lostEvents = true;
+                continue;
+            }
+            auto watch = dirWatches_.find(event->wd);
+            if (watch == dirWatches_.end()) {  // removed meanwhile
+                continue;
+            }
+            auto subscribers = subscribersOf(watch->second);
+            if (event->mask & IN_IGNORED) {  // the directory is gone, and its watch with it
+                for (const auto& subscriber : subscribers) {
+                    subscriber->wd = -1;
+                    watchedDirs_.erase(subscriber->dir);
+                }
+                dirWatches_.erase(watch);
+                continue;
+            }
+            GFileMonitorEvent fileEvent;
+            if (!inotifyEvent(event->mask, fileEvent)) {
+                continue;
+            }
+            const char* name = event->len ? event->name : nullptr;
+            for (const auto& subscriber : subscribers) {
+                if (subscriber->active) {
+                    subscriber->callback(name ? subscriber->dir.child(name) : subscriber->dir, fileEvent);
+                }
+            }
+        }
+    }
+    if (lostEvents) {
+        dispatchLostEvents();
+    }
+#endif
+}
+
+void FileMonitor::onFanotifyEvents() {
+#ifdef FM_FANOTIFY
+    alignas(struct fanotify_event_metadata) char buffer[kEventBufferSize];
+    bool lostEvents = false;
+    for (;;) {
+        ssize_t len = read(fanotifyFd_, buffer, sizeof(buffer));
+        if (len <= 0) {
+            break;
+        }
+        auto meta = reinterpret_cast<const struct fanotify_event_metadata*>(buffer);
+        for (; FAN_EVENT_OK(meta, len); meta = FAN_EVENT_NEXT(meta, len)) {
+            if (meta->vers != FANOTIFY_METADATA_VERSION) {
+                continue;
+            }
+            if (meta->mask & FAN_Q_OVERFLOW) {
+                lostEvents = true;
+                continue;
+            }
+            // with FAN_REPORT_DFID_NAME, the parent directory and the name follow the metadata
+            auto info = reinterpret_cast<const struct fanotify_event_info_fid*>(meta + 1);
+            if (meta->event_len < sizeof(*meta) + sizeof(*info) ||
+                info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                continue;
+            }
+            auto handle = reinterpret_cast<const struct file_handle*>(info->handle);
+            const char* name = reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes);
+            std::string fsid{reinterpret_cast<const char*>(&info->fsid), sizeof(info->fsid)};
+            std::string handleKey{reinterpret_cast<const char*>(handle), sizeof(*handle) + handle->handle_bytes};
+
+            FilePath dir = resolveHandle(fsid, handleKey);
+            if ((meta->mask & FAN_ONDIR) && (meta->mask & (FAN_MOVED_FROM | FAN_DELETE))) {
+                resolvedHandles_.clear();  // the remembered paths below it are wrong now
+            }
+            if (!dir.isValid()) {
+                continue;
+            }
+            std::vector<int> ids;
+            for (int id : treeSubscribers_) {
+                const auto& subscriber = subscribers_.at(id);
+                if (subscriber->fsid == fsid && (subscriber->dir == dir || subscriber->dir.isPrefixOf(dir))) {
+                    ids.push_back(id);
+                }
+            }
+            if (ids.empty()) {  // elsewhere on the filesystem
+                continue;
+            }
+            const FilePath path = (*name && strcmp(name, ".") != 0) ? dir.child(name) : dir;
+            // the kernel merges the events of a file that are still unread
+            std::vector<GFileMonitorEvent> events;
+            if (meta->mask & (FAN_CREATE | FAN_MOVED_TO)) {
+                events.push_back(G_FILE_MONITOR_EVENT_CREATED);
+            }
+            if (meta->mask & FAN_MODIFY) {
+                events.push_back(G_FILE_MONITOR_EVENT_CHANGED);
+            }
+            if (meta->mask & FAN_ATTRIB) {
+                events.push_back(G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED);
+            }
+            if (meta->mask & (FAN_DELETE | FAN_MOVED_FROM)) {
+                events.push_back(G_FILE_MONITOR_EVENT_DELETED);
+            }
+            for (const auto& subscriber : subscribersOf(ids)) {
+                for (auto event : events) {
+                    if (subscriber->active) {
+                        subscriber->callback(path, event);
+                    }
+                }
+            }
+        }
+    }
+    if (lostEvents) {
+        dispatchLostEvents();
+    }
+#endif
+}
+
+FilePath FileMonitor::resolveHandle(const std::string& fsid, const std::string& handle) {
+#ifdef FM_FANOTIFY
+    std::string key = fsid + handle;
+    auto cached = resolvedHandles_.find(key);
+    if (cached != resolvedHandles_.end()) {
+        return cached->second;
+    }
+    auto fs = markedFilesystems_.find(fsid);
+    if (fs == markedFilesystems_.end()) {
+        return FilePath{};
+    }
+    std::string fileHandle = handle;  // open_by_handle_at() wants it writable
+    int fd = open_by_handle_at(fs->second, reinterpret_cast<struct file_handle*>(&fileHandle[0]), O_PATH | O_CLOEXEC);
+    if (fd < 0) {  // deleted already, or no CAP_DAC_READ_SEARCH
+        return FilePath{};
+    }
+    char target[PATH_MAX];
+    const std::string link = "/proc/self/fd/" + std::to_string(fd);
+    const ssize_t len = readlink(link.c_str(), target, sizeof(target) - 1);
+    close(fd);
+    if (len <= 0 || target[0] != '/') {
+        return FilePath{};
+    }
+    target[len] = '\0';
+    auto path = FilePath::fromLocalPath(target);
+    if (resolvedHandles_.size() >= kMaxResolvedHandles) {
+        resolvedHandles_.clear();
+    }
+    resolvedHandles_.emplace(std::move(key), path);
+    return path;
+#else
+    Q_UNUSED(fsid);
+    Q_UNUSED(handle);
+    return FilePath{};
+#endif
+}
 
 }  // namespace Fm
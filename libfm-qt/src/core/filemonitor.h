@@ -3,20 +3,102 @@
 
 #include "../libfmqtglobals.h"
 #include <QObject>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "gioptrs.h"
 #include "filepath.h"
 
+class QSocketNotifier;
+
 namespace Fm {
 
-class LIBFM_QT_API FileMonitor : public QObject {
+// Watches local directories for the whole process over a single inotify descriptor.
+// Every directory gets one kernel watch however many folders, views and models watch it,
+// so a deep tree opened in several places does not use up the inotify watch limit.
+// Recursive watches use a filesystem-wide fanotify mark instead, which needs CAP_SYS_ADMIN.
+// FileMonitor lives in the main thread and is only to be used from there.
+class LIBFM_QT_API FileMonitor : public QObject, public std::enable_shared_from_this<FileMonitor> {
     Q_OBJECT
    public:
+    // Gets the changed file (or the watched directory itself) and what happened to it.
+    // An invalid path means that events were lost and the directory should be read again.
+    using Callback = std::function<void(const FilePath& path, GFileMonitorEvent event)>;
+
+    // A subscription, cancelled when destroyed.
+    class LIBFM_QT_API Watch {
+       public:
+        ~Watch();
+
+       private:
+        friend class FileMonitor;
+        Watch(std::shared_ptr<FileMonitor> monitor, int id) : monitor_{std::move(monitor)}, id_{id} {}
+
+        std::shared_ptr<FileMonitor> monitor_;
+        int id_;
+    };
+
     explicit FileMonitor();
 
-   Q_SIGNALS:
+    ~FileMonitor() override;
+
+    static std::shared_ptr<FileMonitor> globalInstance();
+
+    // Watches the files directly in |dir|. Returns null when |dir| cannot be watched this way,
+    // e.g. when it is not local or no inotify watch is left; a GFileMonitor should be used then.
+    std::unique_ptr<Watch> watchDirectory(const FilePath& dir, Callback callback);
+
+    // Watches every file below |dir|, however deep. Returns null unless the process may mark
+    // whole filesystems with fanotify.
+    std::unique_ptr<Watch> watchTree(const FilePath& dir, Callback callback);
+
+   private Q_SLOTS:
+    void onInotifyEvents();
+
+    void onFanotifyEvents();
 
    private:
-    GFileMonitorPtr monitor_;
+    struct Subscriber {
+        FilePath dir;
+        Callback callback;
+        int wd = -1;         // the inotify watch of a directory subscriber
+        std::string fsid;    // the filesystem of a tree subscriber
+        bool active = true;  // false once unsubscribed, maybe by the callback of another one
+    };
+
+    int subscribe(const FilePath& dir, Callback callback);
+
+    void unsubscribe(int id);
+
+    // callbacks may subscribe and unsubscribe, so they are called on a snapshot of the subscribers
+    std::vector<std::shared_ptr<Subscriber>> subscribersOf(const std::vector<int>& ids) const;
+
+    void dispatchLostEvents();
+
+    // the path of the directory with the given fanotify file handle, or an invalid one
+    FilePath resolveHandle(const std::string& fsid, const std::string& handle);
+
+    int inotifyFd_;
+    QSocketNotifier* inotifyNotifier_;
+    // the subscribers of each inotify watch; a directory reached by several paths has one watch
+    std::unordered_map<int, std::vector<int>> dirWatches_;
+    std::unordered_map<FilePath, int, FilePathHash> watchedDirs_;
+
+    int fanotifyFd_;
+    bool fanotifyFailed_;
+    QSocketNotifier* fanotifyNotifier_;
+    std::unordered_map<std::string, int> markedFilesystems_;     // by fsid, a descriptor on each
+    std::unordered_map<std::string, FilePath> resolvedHandles_;  // recently seen directories
+    std::vector<int> treeSubscribers_;
+
+    std::unordered_map<int, std::shared_ptr<Subscriber>> subscribers_;
+    int lastId_;
+
+    static std::mutex mutex_;
+    static std::weak_ptr<FileMonitor> globalInstance_;
 };
 
 }  // namespace Fm
@@ -1,7 +1,26 @@
 #include "fileoperationjob.h"
+#include "gioptrs.h"
+
+#include <cstring>
+#include <memory>
 
 namespace Fm {
 
+namespace {
+
+constexpr gsize kCompareBufferSize = 256 * 1024;
+
+// Reads up to |size| bytes, less only at the end of the stream. Returns -1 on errors.
+gssize readFully(GInputStream* stream, char* buffer, gsize size, GCancellable* cancellable) {
+    gsize bytesRead = 0;
+    if (!g_input_stream_read_all(stream, buffer, size, &bytesRead, cancellable, nullptr)) {
+        return -1;
+    }
+    return static_cast<gssize>(bytesRead);
+}
+
+}  // namespace
+
 FileOperationJob::FileOperationJob()
     : hasTotalAmount_{false},
       calcProgressUsingSize_{true},
@@ -10,7 +29,9 @@ FileOperationJob::FileOperationJob()
       finishedSize_{0},
       finishedCount_{0},
       currentFileSize_{0},
-      currentFileFinished_{0} {}
+      currentFileFinished_{0},
+      conflictRule_{ConflictRule::ASK},
+      deferConflicts_{false} {}
 
 bool FileOperationJob::totalAmount(uint64_t& fileSize, uint64_t& fileCount) const {
     std::lock_guard<std::mutex> lock{mutex_};
@@ -51,10 +72,82 @@ FileOperationJob::FileExistsAction FileOperationJob::askRename(const FileInfo& s
                                                                const FileInfo& dest,
                                                                FilePath& newDest) {
     FileExistsAction action = SKIP;
+    if (resolveConflict(src, dest, action)) {
+        return action;
+    }
+    if (deferConflicts_) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        deferredConflicts_.emplace_back(src.path(), dest.path());
+        return SKIP;
+    }
     Q_EMIT fileExists(src, dest, action, newDest);
     return action;
 }
 
+std::vector<std::pair<FilePath, FilePath>> FileOperationJob::deferredConflicts() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return deferredConflicts_;
+}
+
+bool FileOperationJob::resolveConflict(const FileInfo& src, const FileInfo& dest, FileExistsAction& action) {
+    // a file copied onto itself always needs a new name
+    if (conflictRule_ == ConflictRule::ASK || src.path() == dest.path()) {
+        return false;
+    }
+    if (src.isDir() || dest.isDir()) {
+        if (src.isDir() && dest.isDir() && !src.isSymlink() && !dest.isSymlink()) {
+            action = OVERWRITE;  // merge the folders, the rule deciding for the files in them
+            return true;
+        }
+        return false;
+    }
+    switch (conflictRule_) {
+        case ConflictRule::NEWER_WINS:
+            action = src.mtime() > dest.mtime() ? OVERWRITE : SKIP;
+            return true;
+        case ConflictRule::SIZE_DIFFERS:
+            action = src.size() != dest.size() ? OVERWRITE : SKIP;
+            return true;
+        case ConflictRule::SKIP_IDENTICAL:
+            if (src.size() == dest.size() && !src.isSymlink() && !dest.isSymlink() &&
+                hasSameContent(src.path(), dest.path())) {
+                action = SKIP;
+                return true;
+            }
+            return false;
+        case ConflictRule::ASK:
+            break;
+    }
+    return false;
+}
+
+bool FileOperationJob::hasSameContent(const FilePath& path1, const FilePath& path2) {
+    GFileInputStreamPtr stream1{g_file_read(path1.gfile().get(), cancellable().get(), nullptr), false};
+    GFileInputStreamPtr stream2{g_file_read(path2.gfile().get(), cancellable().get(), nullptr), false};
+    if (!stream1 || !stream2) {
+        return false;
+    }
+    std::unique_ptr<char[]> buffer1{new char[kCompareBufferSize]};
+    std::unique_ptr<char[]> buffer2{new char[kCompareBufferSize]};
+    bool same = true;
+    for (;;) {
+        const gssize n1 = readFully(G_INPUT_STREAM(stream1.get()), buffer1.get(), kCompareBufferSize,
+                                    cancellable().get());
+        const gssize n2 = readFully(G_INPUT_STREAM(stream2.get()), buffer2.get(), kCompareBufferSize,
+                                    cancellable().get());
+        if (n1 < 0 || n1 != n2 || std::memcmp(buffer1.get(), buffer2.get(), n1) != 0) {
+            same = false;
+            break;
+        }
+        if (n1 == 0) {
+            break;
+        }
+    }
+    g_input_stream_close(G_INPUT_STREAM(stream1.get()), nullptr, nullptr);
+    g_input_stream_close(G_INPUT_STREAM(stream2.get()), nullptr, nullptr);
+    return same;
+}
+
 bool FileOperationJob::finishedAmount(uint64_t& finishedSize, uint64_t& finishedCount) const {
     std::lock_guard<std::mutex> lock{mutex_};
     if (hasTotalAmount_) {
@@ -6,6 +6,8 @@
 #include <string>
 #include <mutex>
 #include <cstdint>
+#include <utility>
+#include <vector>
 #include "fileinfo.h"
 #include "filepath.h"
 
@@ -16,8 +18,28 @@ class LIBFM_QT_API FileOperationJob : public Fm::Job {
    public:
     enum FileExistsAction { CANCEL = 0, OVERWRITE = 1 << 0, RENAME = 1 << 1, SKIP = 1 << 2, SKIP_ERROR = 1 << 3 };
 
+    // How a file already at the destination is dealt with before anyone is asked.
+    enum class ConflictRule {
+        ASK,             // emit fileExists() every time
+        NEWER_WINS,      // replace it when the source is newer, keep it otherwise
+        SIZE_DIFFERS,    // replace it when the sizes differ, keep it otherwise
+        SKIP_IDENTICAL,  // keep it when its content is that of the source, ask otherwise
+    };
+
     explicit FileOperationJob();
 
+    // The rule is applied on the job's thread, without waiting for the GUI; existing folders are
+    // merged with any rule but ASK. With |deferUnresolved|, the conflicts the rule leaves open
+    // skip the source rather than asking, and are listed by deferredConflicts() afterwards.
+    void setConflictRule(ConflictRule rule, bool deferUnresolved = false) {
+        conflictRule_ = rule;
+        deferConflicts_ = deferUnresolved;
+    }
+    ConflictRule conflictRule() const { return conflictRule_; }
+
+    // the (source, existing destination) pairs that were skipped for the user to decide later
+    std::vector<std::pair<FilePath, FilePath>> deferredConflicts() const;
+
     // get total amount of work to do
     bool totalAmount(std::uint64_t& fileSize, std::uint64_t& fileCount) const;
 
@@ -65,6 +87,9 @@ class LIBFM_QT_API FileOperationJob : public Fm::Job {
     std::mutex& mutex() { return mutex_; }
 
    private:
+    bool resolveConflict(const FileInfo& src, const FileInfo& dest, FileExistsAction& action);
+    bool hasSameContent(const FilePath& path1, const FilePath& path2);
+
     bool hasTotalAmount_;
     bool calcProgressUsingSize_;
     std::uint64_t totalSize_;
@@ -75,6 +100,9 @@ class LIBFM_QT_API FileOperationJob : public Fm::Job {
     FilePath currentFile_;
     std::uint64_t currentFileSize_;
     std::uint64_t currentFileFinished_;
+    ConflictRule conflictRule_;
+    bool deferConflicts_;
+    std::vector<std::pair<FilePath, FilePath>> deferredConflicts_;
     mutable std::mutex mutex_;
 };
 
@@ -1,12 +1,227 @@
 #include "filepath.h"
 #include <cstdlib>
+#include <cstring>
+#include <unordered_map>
 #include <utility>
 #include <glib.h>
 
 namespace Fm {
 
+namespace {
+
+// g_str_hash() of a path continued with more of it, so that a node hashes its name only
+unsigned int continueHash(unsigned int hash, const char* str, std::size_t length) {
+    for (std::size_t i = 0; i < length; ++i) {
+        hash = (hash << 5) + hash + static_cast<unsigned int>(static_cast<signed char>(str[i]));
+    }
+    return hash;
+}
+
+// The nodes in use, by the hash of their path. An entry is removed by the destructor of its
+// node; until then a node being destroyed is only found expired, and is replaced.
+struct NativeEntry {
+    const void* node;
+    std::weak_ptr<const void> weak;
+};
+
+struct NativeShard {
+    std::mutex mutex;
+    std::unordered_multimap<unsigned int, NativeEntry> nodes;
+};
+
+constexpr unsigned int kNativeShards = 64;
+
+NativeShard& nativeShard(unsigned int hash) {
+    // never destroyed, as static FilePaths may outlive any other static
+    static NativeShard* shards = new NativeShard[kNativeShards];
+    return shards[(hash ^ (hash >> 16)) % kNativeShards];
+}
+
+}  // namespace
+
 FilePath FilePath::homeDir_;
 
+FilePath::Native::Native(std::shared_ptr<const Native> parentNode, std::string baseName, unsigned int pathHash)
+    : parent{std::move(parentNode)}, name{std::move(baseName)}, hash{pathHash} {}
+
+FilePath::Native::~Native() {
+    if (!parent) {
+        return;  // the root is not in the table
+    }
+    NativeShard& shard = nativeShard(hash);
+    std::lock_guard<std::mutex> lock{shard.mutex};
+    auto range = shard.nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.node == this) {
+            shard.nodes.erase(it);
+            break;
+        }
+    }
+}
+
+std::string FilePath::Native::path() const {
+    CStrPtr path{dupPath()};
+    return std::string{path.get()};
+}
+
+char* FilePath::Native::dupPath() const {
+    if (!parent) {
+        return g_strdup("/");
+    }
+    std::size_t length = 0;
+    for (const Native* node = this; node->parent; node = node->parent.get()) {
+        length += node->name.size() + 1;
+    }
+    char* path = static_cast<char*>(g_malloc(length + 1));
+    path[length] = '\0';
+    for (const Native* node = this; node->parent; node = node->parent.get()) {
+        length -= node->name.size();
+        memcpy(path + length, node->name.data(), node->name.size());
+        path[--length] = '/';
+    }
+    return path;
+}
+
+bool FilePath::Native::hasPath(const char* otherPath) const {
+    // compared from the end, one name at a time
+    std::size_t end = strlen(otherPath);
+    if (!parent) {
+        return end == 1 && otherPath[0] == '/';
+    }
+    for (const Native* node = this; node->parent; node = node->parent.get()) {
+        const std::size_t size = node->name.size();
+        if (end < size + 1 || otherPath[end - size - 1] != '/' ||
+            memcmp(otherPath + end - size, node->name.data(), size) != 0) {
+            return false;
+        }
+        end -= size + 1;
+    }
+    return end == 0;
+}
+
+std::shared_ptr<const FilePath::Native> FilePath::intern(const std::shared_ptr<const Native>& parent,
+                                                         const char* name,
+                                                         std::size_t length) {
+    const unsigned int hash =
+        continueHash(parent->parent ? continueHash(parent->hash, "/", 1) : parent->hash, name, length);
+    NativeShard& shard = nativeShard(hash);
+    std::lock_guard<std::mutex> lock{shard.mutex};
+    auto range = shard.nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        // the node is alive while in the table, even when its last FilePath has gone
+        auto node = static_cast<const Native*>(it->second.node);
+        if (node->parent == parent && node->name.size() == length && memcmp(node->name.data(), name, length) == 0) {
+            if (auto found = it->second.weak.lock()) {
+                return std::static_pointer_cast<const Native>(found);
+            }
+        }
+    }
+    auto node = std::make_shared<const Native>(parent, std::string{name, length}, hash);
+    shard.nodes.emplace(hash, NativeEntry{node.get(), node});
+    return node;
+}
+
+std::shared_ptr<const FilePath::Native> FilePath::internPath(const char* canonicalPath) {
+    static const std::shared_ptr<const Native> root = std::make_shared<const Native>(nullptr, "/", g_str_hash("/"));
+    std::shared_ptr<const Native> node = root;
+    for (const char* name = canonicalPath; *name;) {
+        if (*name == '/') {
+            ++name;
+            continue;
+        }
+        const std::size_t length = strcspn(name, "/");
+        node = intern(node, name, length);
+        name += length;
+    }
+    return node;
+}
+
+FilePath::FilePath(GFile* gfile, bool add_ref) : gfile_{gfile, add_ref} {
+    if (gfile_ && g_file_has_uri_scheme(gfile_.get(), "file")) {
+        if (const char* path = g_file_peek_path(gfile_.get())) {
+            native_ = internPath(path);
+            // keep the GFile we were given rather than creating an equal one later
+            std::call_once(native_->gfileCreated, [this]() { native_->gfile = gfile_; });
+            gfile_.reset();
+        }
+    }
+}
+
+FilePath FilePath::fromLocalPath(const char* path) {
+    // the same canonical form GLocalFile uses, so that hashes and equality agree with GIO
+    CStrPtr canonical{g_canonicalize_filename(path, nullptr)};
+    return FilePath{internPath(canonical.get())};
+}
+
+const GObjectPtr<GFile>& FilePath::gfile() const {
+    if (!native_) {
+        return gfile_;
+    }
+    std::call_once(native_->gfileCreated, [this]() {
+        CStrPtr path{native_->dupPath()};
+        native_->gfile = GObjectPtr<GFile>{g_file_new_for_path(path.get()), false};
+    });
+    return native_->gfile;
+}
+
+CStrPtr FilePath::baseName() const {
+    if (!native_) {
+        return CStrPtr{g_file_get_basename(gfile_.get())};
+    }
+    return CStrPtr{g_strdup(native_->name.c_str())};
+}
+
+FilePath FilePath::parent() const {
+    if (!native_) {
+        return FilePath{g_file_get_parent(gfile_.get()), false};
+    }
+    return native_->parent ? FilePath{native_->parent} : FilePath{};
+}
+
+bool FilePath::isParentOf(const FilePath& other) const {
+    if (native_ && other.native_) {
+        return other.native_->parent == native_;
+    }
+    return g_file_has_parent(other.gfile().get(), gfile().get());
+}
+
+bool FilePath::isPrefixOf(const FilePath& other) const {
+    if (native_ && other.native_) {
+        // like GLocalFile: a path is not a prefix of itself, and "/" is a prefix of any other path
+        for (const Native* node = other.native_->parent.get(); node; node = node->parent.get()) {
+            if (node == native_.get()) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return g_file_has_prefix(other.gfile().get(), gfile().get());
+}
+
+FilePath FilePath::child(const char* name) const {
+    if (native_ && name && *name && !strchr(name, '/') && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+        return FilePath{intern(native_, name, strlen(name))};
+    }
+    return FilePath{g_file_get_child(gfile().get(), name), false};
+}
+
+bool FilePath::operator==(GFile* other_gfile) const {
+    if (native_) {
+        if (!other_gfile || !g_file_has_uri_scheme(other_gfile, "file")) {
+            return false;
+        }
+        const char* path = g_file_peek_path(other_gfile);
+        return path && native_->hasPath(path);
+    }
+    if (gfile_ == other_gfile) {
+        return true;
+    }
+    if (gfile_ && other_gfile) {
+        return g_file_equal(gfile_.get(), other_gfile);
+    }
+    return false;
+}
+
 const FilePath& FilePath::homeDir() {
     if (!homeDir_) {
         const char* home = getenv("HOME");
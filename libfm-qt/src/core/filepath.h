@@ -5,16 +5,24 @@
 #include "gobjectptr.h"
 #include "cstrptr.h"
 #include <gio/gio.h>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <QMetaType>
 
 namespace Fm {
 
+// A file path, backed by a GFile. Local paths are nodes of an interned tree instead, as FmPath
+// of libfm had them: one node per path in use, holding its name, its parent node and a
+// precomputed hash, and a GFile only created once GIO needs it. Equal local paths are the
+// same node, so comparing, hashing, parent() and the ancestry tests are pointer operations,
+// and the files of a folder share the node of the folder rather than copies of its path.
 class LIBFM_QT_API FilePath {
    public:
     explicit FilePath() {}
 
-    explicit FilePath(GFile* gfile, bool add_ref) : gfile_{gfile, add_ref} {}
+    explicit FilePath(GFile* gfile, bool add_ref);
 
     FilePath(const FilePath& other) : FilePath{} { *this = other; }
 
@@ -22,7 +30,7 @@ class LIBFM_QT_API FilePath {
 
     static FilePath fromUri(const char* uri) { return FilePath{g_file_new_for_uri(uri), false}; }
 
-    static FilePath fromLocalPath(const char* path) { return FilePath{g_file_new_for_path(path), false}; }
+    static FilePath fromLocalPath(const char* path);
 
     static FilePath fromDisplayName(const char* path) { return FilePath{g_file_parse_name(path), false}; }
 
@@ -30,15 +38,18 @@ class LIBFM_QT_API FilePath {
         return FilePath{g_file_new_for_commandline_arg(path_str), false};
     }
 
-    bool isValid() const { return gfile_ != nullptr; }
+    bool isValid() const { return native_ || gfile_; }
 
-    unsigned int hash() const { return g_file_hash(gfile_.get()); }
+    unsigned int hash() const { return native_ ? native_->hash : g_file_hash(gfile_.get()); }
 
-    CStrPtr baseName() const { return CStrPtr{g_file_get_basename(gfile_.get())}; }
+    CStrPtr baseName() const;
 
-    CStrPtr localPath() const { return CStrPtr{g_file_get_path(gfile_.get())}; }
+    CStrPtr localPath() const { return CStrPtr{native_ ? native_->dupPath() : g_file_get_path(gfile_.get())}; }
 
-    CStrPtr uri() const { return CStrPtr{g_file_get_uri(gfile_.get())}; }
+    CStrPtr uri() const {
+        return CStrPtr{native_ ? g_filename_to_uri(native_->path().c_str(), nullptr, nullptr)
+                               : g_file_get_uri(gfile_.get())};
+    }
 
     CStrPtr toString() const {
         if (isNative()) {
@@ -48,66 +59,97 @@ class LIBFM_QT_API FilePath {
     }
 
     // a human readable UTF-8 display name for the path
-    CStrPtr displayName() const { return CStrPtr{g_file_get_parse_name(gfile_.get())}; }
+    CStrPtr displayName() const { return CStrPtr{g_file_get_parse_name(gfile().get())}; }
 
-    FilePath parent() const { return FilePath{g_file_get_parent(gfile_.get()), false}; }
+    FilePath parent() const;
 
-    bool hasParent() const { return g_file_has_parent(gfile_.get(), nullptr); }
+    bool hasParent() const { return native_ ? native_->parent != nullptr : g_file_has_parent(gfile_.get(), nullptr); }
 
-    bool isParentOf(const FilePath& other) const { return g_file_has_parent(other.gfile_.get(), gfile_.get()); }
+    bool isParentOf(const FilePath& other) const;
 
-    bool isPrefixOf(const FilePath& other) const { return g_file_has_prefix(other.gfile_.get(), gfile_.get()); }
+    bool isPrefixOf(const FilePath& other) const;
 
-    FilePath child(const char* name) const { return FilePath{g_file_get_child(gfile_.get(), name), false}; }
+    FilePath child(const char* name) const;
 
     CStrPtr relativePathStr(const FilePath& descendant) const {
-        return CStrPtr{g_file_get_relative_path(gfile_.get(), descendant.gfile_.get())};
+        return CStrPtr{g_file_get_relative_path(gfile().get(), descendant.gfile().get())};
     }
 
     FilePath relativePath(const char* relPath) const {
-        return FilePath{g_file_resolve_relative_path(gfile_.get(), relPath), false};
+        return FilePath{g_file_resolve_relative_path(gfile().get(), relPath), false};
     }
 
-    bool isNative() const { return g_file_is_native(gfile_.get()); }
+    bool isNative() const { return native_ || g_file_is_native(gfile_.get()); }
 
-    bool hasUriScheme(const char* scheme) const { return g_file_has_uri_scheme(gfile_.get(), scheme); }
+    bool hasUriScheme(const char* scheme) const {
+        return native_ ? g_ascii_strcasecmp(scheme, "file") == 0 : g_file_has_uri_scheme(gfile_.get(), scheme);
+    }
 
-    CStrPtr uriScheme() const { return CStrPtr{g_file_get_uri_scheme(gfile_.get())}; }
+    CStrPtr uriScheme() const {
+        return CStrPtr{native_ ? g_strdup("file") : g_file_get_uri_scheme(gfile_.get())};
+    }
 
-    const GObjectPtr<GFile>& gfile() const { return gfile_; }
+    const GObjectPtr<GFile>& gfile() const;
 
     FilePath& operator=(const FilePath& other) {
         gfile_ = other.gfile_;
+        native_ = other.native_;
         return *this;
     }
 
     FilePath& operator=(const FilePath&& other) noexcept {
         gfile_ = std::move(other.gfile_);
+        native_ = std::move(other.native_);
         return *this;
     }
 
-    bool operator==(const FilePath& other) const { return operator==(other.gfile_.get()); }
-
-    bool operator==(GFile* other_gfile) const {
-        if (gfile_ == other_gfile) {
-            return true;
-        }
-        if (gfile_ && other_gfile) {
-            return g_file_equal(gfile_.get(), other_gfile);
+    bool operator==(const FilePath& other) const {
+        if (native_ || other.native_) {
+            return native_ == other.native_;  // interned
         }
-        return false;
+        return operator==(other.gfile_.get());
     }
 
+    bool operator==(GFile* other_gfile) const;
+
     bool operator!=(const FilePath& other) const { return !operator==(other); }
 
-    bool operator!=(std::nullptr_t) const { return gfile_ != nullptr; }
+    bool operator!=(std::nullptr_t) const { return isValid(); }
 
-    operator bool() const { return gfile_ != nullptr; }
+    operator bool() const { return isValid(); }
 
     static const FilePath& homeDir();
 
    private:
-    GObjectPtr<GFile> gfile_;
+    // A local path in the tree, shared by the copies of its FilePaths and the nodes of its
+    // children. Only created by intern(), which keeps one node per path.
+    struct Native {
+        explicit Native(std::shared_ptr<const Native> parentNode, std::string baseName, unsigned int pathHash);
+        ~Native();
+
+        std::string path() const;  // from the names of the ancestors
+        char* dupPath() const;     // the same, to be freed with g_free()
+        bool hasPath(const char* otherPath) const;
+
+        const std::shared_ptr<const Native> parent;  // nullptr for "/"
+        const std::string name;                      // "/" for the root
+        const unsigned int hash;                     // the same as g_file_hash() of its GFile
+        mutable std::once_flag gfileCreated;
+        mutable GObjectPtr<GFile> gfile;
+    };
+
+    explicit FilePath(std::shared_ptr<const Native> native) : native_{std::move(native)} {}
+
+    // the node of |name| in |parent|, created if no FilePath uses it
+    static std::shared_ptr<const Native> intern(const std::shared_ptr<const Native>& parent,
+                                                const char* name,
+                                                std::size_t length);
+
+    // the node of an absolute, canonical path
+    static std::shared_ptr<const Native> internPath(const char* canonicalPath);
+
+    GObjectPtr<GFile> gfile_;  // unused for local paths
+    std::shared_ptr<const Native> native_;
     static FilePath homeDir_;
 };
 
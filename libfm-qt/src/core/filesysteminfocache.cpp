@@ -0,0 +1,152 @@
+#include "filesysteminfocache.h"
+#include "filesysteminfojob.h"
+#include "jobscheduler.h"
+#include <QTimer>
+#include <algorithm>
+#include <gio/gunixmounts.h>
+
+namespace Fm {
+
+namespace {
+
+// how long a result is reused before the filesystem is asked again
+constexpr auto kTimeToLive = std::chrono::seconds(3);
+
+// how long the folders wait for a query before they are told the info is unavailable
+constexpr int kQueryTimeout = 3000;
+
+}  // namespace
+
+std::weak_ptr<FileSystemInfoCache> FileSystemInfoCache::globalInstance_;
+
+FileSystemInfoCache::FileSystemInfoCache() : QObject(), mountsRead_{0} {}
+
+FileSystemInfoCache::~FileSystemInfoCache() = default;
+
+std::shared_ptr<FileSystemInfoCache> FileSystemInfoCache::globalInstance() {
+    auto cache = globalInstance_.lock();
+    if (cache == nullptr) {
+        cache = std::make_shared<FileSystemInfoCache>();
+        globalInstance_ = cache;
+    }
+    return cache;
+}
+
+void FileSystemInfoCache::query(const FilePath& path, QObject* receiver, Callback callback, bool refresh) {
+    if (!JobScheduler::globalInstance()->isResponsive(path)) {
+        answer({Waiter{receiver, std::move(callback)}}, Info{});
+        return;
+    }
+    const std::string key = mountKey(path);
+    Entry& entry = entries_[key];
+    if (entry.inFlight) {
+        if (entry.timedOut) {
+            // don't pile another blocked query onto a filesystem which is not answering
+            answer({Waiter{receiver, std::move(callback)}}, Info{});
+        }
+        else {
+            entry.waiters.push_back(Waiter{receiver, std::move(callback)});
+        }
+        return;
+    }
+    if (!refresh && entry.hasInfo && Clock::now() - entry.queried < kTimeToLive) {
+        answer({Waiter{receiver, std::move(callback)}}, entry.info);
+        return;
+    }
+
+    entry.inFlight = true;
+    entry.timedOut = false;
+    const unsigned generation = ++entry.generation;
+    entry.waiters.push_back(Waiter{receiver, std::move(callback)});
+
+    // a thread of its own, so that a hung query never holds up the jobs of the scheduler
+    auto job = new FileSystemInfoJob{path};
+    job->setAutoDelete(true);
+    connect(
+        job, &FileSystemInfoJob::finished, this,
+        [this, key, generation, job]() {
+            Info info;
+            info.isAvailable = job->isAvailable();
+            info.size = job->size();
+            info.freeSize = job->freeSize();
+            onQueryFinished(key, generation, info);
+        },
+        Qt::BlockingQueuedConnection);
+    job->runAsync();
+    QTimer::singleShot(kQueryTimeout, this, [this, key, generation]() { onQueryTimeout(key, generation); });
+}
+
+void FileSystemInfoCache::onQueryFinished(const std::string& key, unsigned generation, const Info& info) {
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.generation != generation) {
+        return;
+    }
+    Entry& entry = it->second;
+    entry.inFlight = false;
+    entry.timedOut = false;
+    entry.info = info;
+    entry.hasInfo = true;
+    entry.queried = Clock::now();
+    answer(std::move(entry.waiters), info);
+    entry.waiters.clear();
+}
+
+void FileSystemInfoCache::onQueryTimeout(const std::string& key, unsigned generation) {
+    auto it = entries_.find(key);
+    if (it == entries_.end() || !it->second.inFlight || it->second.generation != generation) {
+        return;
+    }
+    Entry& entry = it->second;
+    entry.timedOut = true;
+    answer(std::move(entry.waiters), Info{});
+    entry.waiters.clear();
+}
+
+// static
+void FileSystemInfoCache::answer(std::vector<Waiter> waiters, const Info& info) {
+    for (auto& waiter : waiters) {
+        if (waiter.receiver) {
+            // always later, so that no caller is called back from within query()
+            QTimer::singleShot(0, waiter.receiver.data(),
+                               [callback = std::move(waiter.callback), info]() { callback(info); });
+        }
+    }
+}
+
+std::string FileSystemInfoCache::mountKey(const FilePath& path) {
+    if (!path.isNative()) {
+        // a remote location is keyed by its scheme and host, as "sftp://host"
+        std::string uri = path.uri().get();
+        auto sep = uri.find("://");
+        if (sep != std::string::npos) {
+            uri.resize(std::min(uri.size(), uri.find('/', sep + 3)));
+        }
+        return uri;
+    }
+
+    // reading the mount table never touches the filesystems, unlike stat() of the folder
+    if (mountPoints_.empty() || g_unix_mounts_changed_since(mountsRead_)) {
+        mountPoints_.clear();
+        GList* mounts = g_unix_mounts_get(&mountsRead_);
+        for (GList* l = mounts; l; l = l->next) {
+            auto mount = static_cast<GUnixMountEntry*>(l->data);
+            mountPoints_.emplace_back(g_unix_mount_get_mount_path(mount));
+            g_unix_mount_free(mount);
+        }
+        g_list_free(mounts);
+        std::stable_sort(mountPoints_.begin(), mountPoints_.end(),
+                         [](const std::string& a, const std::string& b) { return a.size() > b.size(); });
+    }
+
+    const std::string localPath = path.localPath().get();
+    for (const std::string& mountPoint : mountPoints_) {
+        if (mountPoint == "/" ||
+            (localPath.compare(0, mountPoint.size(), mountPoint) == 0 &&
+             (localPath.size() == mountPoint.size() || localPath[mountPoint.size()] == '/'))) {
+            return "file://" + mountPoint;
+        }
+    }
+    return "file://" + localPath;
+}
+
+}  // namespace Fm
@@ -0,0 +1,81 @@
+#ifndef FM2_FILESYSTEMINFOCACHE_H
+#define FM2_FILESYSTEMINFOCACHE_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QPointer>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "filepath.h"
+
+namespace Fm {
+
+// Shares the size and free space of each mounted filesystem between the folders on it. A
+// result is reused for a few seconds, and while a query of a filesystem is running, every
+// folder asking for it waits for that one query instead of starting its own. A query that
+// hangs, as on a dead NFS server, is given up on after a timeout: its waiters are told the
+// information is unavailable, and no other query of that filesystem is started until it
+// returns. Only used in the main thread.
+class LIBFM_QT_API FileSystemInfoCache : public QObject {
+    Q_OBJECT
+   public:
+    struct Info {
+        bool isAvailable = false;
+        uint64_t size = 0;
+        uint64_t freeSize = 0;
+    };
+
+    using Callback = std::function<void(const Info& info)>;
+
+    explicit FileSystemInfoCache();
+
+    ~FileSystemInfoCache() override;
+
+    static std::shared_ptr<FileSystemInfoCache> globalInstance();
+
+    // Calls |callback| later in the main thread with the info of the filesystem holding
+    // |path|, unless |receiver| is deleted first. |refresh| skips a cached result, for when
+    // the free space is known to have changed.
+    void query(const FilePath& path, QObject* receiver, Callback callback, bool refresh = false);
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Waiter {
+        QPointer<QObject> receiver;
+        Callback callback;
+    };
+
+    struct Entry {
+        Info info;
+        Clock::time_point queried;  // when |info| was read
+        bool hasInfo = false;
+        bool inFlight = false;
+        bool timedOut = false;    // the query in flight has hung
+        unsigned generation = 0;  // of the latest query
+        std::vector<Waiter> waiters;
+    };
+
+    std::string mountKey(const FilePath& path);
+
+    void onQueryFinished(const std::string& key, unsigned generation, const Info& info);
+
+    void onQueryTimeout(const std::string& key, unsigned generation);
+
+    static void answer(std::vector<Waiter> waiters, const Info& info);
+
+    std::unordered_map<std::string, Entry> entries_;  // by mountKey()
+    std::vector<std::string> mountPoints_;             // the longest first
+    uint64_t mountsRead_;                              // when mountPoints_ was read
+
+    static std::weak_ptr<FileSystemInfoCache> globalInstance_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_FILESYSTEMINFOCACHE_H
@@ -1,9 +1,46 @@
 #include "filetransferjob.h"
 #include "totalsizejob.h"
 #include "fileinfo_p.h"
+#include "perftrace.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 namespace Fm {
 
+namespace {
+
+// Remote files from this size on are read over several streams at once; smaller ones are
+// copied with their siblings instead. A single GIO stream waits a round trip per request.
+constexpr std::uint64_t kChunkedCopyMinSize = 16 * 1024 * 1024;
+
+constexpr int kChunkedCopyStreams = 4;
+
+constexpr size_t kChunkedCopyBufferSize = 256 * 1024;
+
+constexpr size_t kSmallFileBatch = 8;
+
+constexpr int kProgressInterval = 100;  // ms
+
+FileTransferJob::LocalFileCopier& localFileCopier() {
+    static FileTransferJob::LocalFileCopier copier;
+    return copier;
+}
+
+FileTransferJob::RemoteFileCopier& remoteFileCopier() {
+    static FileTransferJob::RemoteFileCopier copier;
+    return copier;
+}
+
+}  // namespace
+
 FileTransferJob::FileTransferJob(FilePathList srcPaths, Mode mode)
     : FileOperationJob{}, srcPaths_{std::move(srcPaths)}, mode_{mode}, hasDestDirPath_{false} {}
 
@@ -18,6 +55,14 @@ FileTransferJob::FileTransferJob(FilePathList srcPaths, const FilePath& destDirP
     setDestDirPath(destDirPath);
 }
 
+void FileTransferJob::setLocalFileCopier(LocalFileCopier copier) {
+    localFileCopier() = std::move(copier);
+}
+
+void FileTransferJob::setRemoteFileCopier(RemoteFileCopier copier) {
+    remoteFileCopier() = std::move(copier);
+}
+
 void FileTransferJob::setSrcPaths(FilePathList srcPaths) {
     srcPaths_ = std::move(srcPaths);
 }
@@ -123,8 +168,28 @@ bool FileTransferJob::copyRegularFile(const FilePath& srcPath, const GFileInfoPt
         setCurrentFileProgress(size, 0);
 
         // do the file operation
-        if (!g_file_copy(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags), cancellable().get(),
-                         (GFileProgressCallback)&gfileCopyProgressCallback, this, &err)) {
+        const bool regular = g_file_info_get_file_type(srcInfo.get()) == G_FILE_TYPE_REGULAR;
+        bool copied = false;
+        bool copiedByCopier = false;
+        if (localFileCopier() && regular && srcPath.isNative() && destPath.isNative()) {
+            copied = copyLocalRegularFile(srcPath, destPath, flags, err);
+            copiedByCopier = true;
+        }
+        if (!copiedByCopier && remoteFileCopier() && regular &&
+            (srcPath.hasUriScheme("sftp") || destPath.hasUriScheme("sftp"))) {
+            copiedByCopier = copyRemoteRegularFile(srcPath, destPath, flags, copied, err);
+        }
+        if (!copiedByCopier && size >= kChunkedCopyMinSize && isConcurrentCopy(srcPath, srcInfo, destPath)) {
+            copiedByCopier = copyRegularFileChunked(srcPath, srcInfo, destPath, flags, copied, err);
+        }
+        if (!copiedByCopier) {
+            copied = g_file_copy(srcPath.gfile().get(), destPath.gfile().get(), GFileCopyFlags(flags),
+                                 cancellable().get(), (GFileProgressCallback)&gfileCopyProgressCallback, this, &err);
+        }
+        if (!copied) {
+            if (!err) {
+                return false;  // cancelled
+            }
             retry = handleError(err, srcPath, srcInfo, destPath, flags);
         }
         else {
@@ -134,6 +199,228 @@ bool FileTransferJob::copyRegularFile(const FilePath& srcPath, const GFileInfoPt
     return false;
 }
 
+bool FileTransferJob::copyLocalRegularFile(const FilePath& srcPath,
+                                           const FilePath& destPath,
+                                           int flags,
+                                           GErrorPtr& err) {
+    auto srcName = srcPath.localPath();
+    auto destName = destPath.localPath();
+    // the copier replaces existing files, so ask the user first the way g_file_copy() does
+    struct stat st;
+    if (lstat(destName.get(), &st) == 0) {
+        if (!(flags & G_FILE_COPY_OVERWRITE)) {
+            auto displayName = destPath.displayName();
+            err = GErrorPtr{
+                g_error_new(G_IO_ERROR, G_IO_ERROR_EXISTS, "%s: %s", displayName.get(), g_strerror(EEXIST))};
+            return false;
+        }
+        // a symlink is replaced, not written through
+        if (S_ISLNK(st.st_mode)) {
+            unlink(destName.get());
+        }
+    }
+    const int code =
+        localFileCopier()(srcName.get(), destName.get(), [this](std::uint64_t done, std::uint64_t total) {
+            setCurrentFileProgress(total, done);
+            return !isCancelled();
+        });
+    if (code == 0) {
+        return true;
+    }
+    if (code != ECANCELED || !isCancelled()) {
+        auto displayName = srcPath.displayName();
+        err = GErrorPtr{
+            g_error_new(G_IO_ERROR, g_io_error_from_errno(code), "%s: %s", displayName.get(), g_strerror(code))};
+    }
+    return false;
+}
+
+bool FileTransferJob::copyRemoteRegularFile(const FilePath& srcPath,
+                                            const FilePath& destPath,
+                                            int flags,
+                                            bool& copied,
+                                            GErrorPtr& err) {
+    auto srcUri = srcPath.uri();
+    auto destUri = destPath.uri();
+    const bool overwrite = flags & G_FILE_COPY_OVERWRITE;
+    const int code = remoteFileCopier()(srcUri.get(), destUri.get(), overwrite,
+                                        [this](std::uint64_t done, std::uint64_t total) {
+                                            setCurrentFileProgress(total, done);
+                                            return !isCancelled();
+                                        });
+    if (code == ENOTSUP) {
+        return false;
+    }
+    copied = code == 0;
+    if (!copied && (code != ECANCELED || !isCancelled())) {
+        auto displayName = srcPath.displayName();
+        err = GErrorPtr{
+            g_error_new(G_IO_ERROR, g_io_error_from_errno(code), "%s: %s", displayName.get(), g_strerror(code))};
+    }
+    return true;
+}
+
+bool FileTransferJob::copyRegularFileChunked(const FilePath& srcPath,
+                                             const GFileInfoPtr& srcInfo,
+                                             const FilePath& destPath,
+                                             int flags,
+                                             bool& copied,
+                                             GErrorPtr& err) {
+    copied = false;
+    // the first stream also tells whether the source can seek at all
+    GFileInputStreamPtr firstStream{g_file_read(srcPath.gfile().get(), cancellable().get(), &err), false};
+    if (!firstStream) {
+        return true;
+    }
+    if (!g_seekable_can_seek(G_SEEKABLE(firstStream.get()))) {
+        g_input_stream_close(G_INPUT_STREAM(firstStream.get()), nullptr, nullptr);
+        return false;
+    }
+
+    auto destName = destPath.localPath();
+    auto setErrno = [&err, &destPath](int code) {
+        auto displayName = destPath.displayName();
+        err = GErrorPtr{
+            g_error_new(G_IO_ERROR, g_io_error_from_errno(code), "%s: %s", displayName.get(), g_strerror(code))};
+    };
+    struct stat st;
+    // a symlink is replaced, not written through
+    if ((flags & G_FILE_COPY_OVERWRITE) && lstat(destName.get(), &st) == 0 && S_ISLNK(st.st_mode)) {
+        unlink(destName.get());
+    }
+    const int fd = open(destName.get(),
+                        O_WRONLY | O_CREAT | O_CLOEXEC | ((flags & G_FILE_COPY_OVERWRITE) ? O_TRUNC : O_EXCL), 0666);
+    if (fd < 0) {
+        setErrno(errno);
+        return true;
+    }
+
+    // the ranges are written in place, so give the file its size first
+    const std::uint64_t size = g_file_info_get_attribute_uint64(srcInfo.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    int code = posix_fallocate(fd, 0, off_t(size));
+    if (code != 0 && code != ENOSPC) {
+        code = ftruncate(fd, off_t(size)) == 0 ? 0 : errno;
+    }
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    int running = 0;
+    GErrorPtr firstError;
+    std::atomic<bool> failed{code != 0};
+    std::atomic<std::uint64_t> done{0};
+    auto copyRange = [&](GFileInputStreamPtr stream, std::uint64_t offset, std::uint64_t end) {
+        GErrorPtr rangeError;
+        if (!stream) {
+            stream = GFileInputStreamPtr{g_file_read(srcPath.gfile().get(), cancellable().get(), &rangeError), false};
+        }
+        if (stream && offset > 0 &&
+            !g_seekable_seek(G_SEEKABLE(stream.get()), goffset(offset), G_SEEK_SET, cancellable().get(),
+                             &rangeError)) {
+            g_input_stream_close(G_INPUT_STREAM(stream.get()), nullptr, nullptr);
+            stream = GFileInputStreamPtr{};
+        }
+        std::vector<char> buffer(stream ? kChunkedCopyBufferSize : 0);
+        while (stream && offset < end && !failed && !isCancelled()) {
+            const gssize n =
+                g_input_stream_read(G_INPUT_STREAM(stream.get()), buffer.data(),
+                                    size_t(std::min<std::uint64_t>(buffer.size(), end - offset)),
+                                    cancellable().get(), &rangeError);
+            if (n <= 0) {
+                if (n == 0) {  // the file shrank since it was listed
+                    rangeError = GErrorPtr{g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED, "%s: %s",
+                                                       g_file_info_get_display_name(srcInfo.get()),
+                                                       g_strerror(EIO))};
+                }
+                break;
+            }
+            for (gssize written = 0; written < n;) {
+                const ssize_t w = pwrite(fd, buffer.data() + written, size_t(n - written), off_t(offset + written));
+                if (w < 0 && errno != EINTR) {
+                    auto displayName = destPath.displayName();
+                    rangeError = GErrorPtr{g_error_new(G_IO_ERROR, g_io_error_from_errno(errno), "%s: %s",
+                                                       displayName.get(), g_strerror(errno))};
+                    break;
+                }
+                written += std::max<ssize_t>(w, 0);
+            }
+            if (rangeError) {
+                break;
+            }
+            offset += std::uint64_t(n);
+            done += std::uint64_t(n);
+        }
+        if (stream) {
+            g_input_stream_close(G_INPUT_STREAM(stream.get()), nullptr, nullptr);
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        if (rangeError && !failed.exchange(true)) {
+            firstError = std::move(rangeError);
+        }
+        --running;
+        finished.notify_one();
+    };
+
+    const std::uint64_t rangeSize = (size + kChunkedCopyStreams - 1) / kChunkedCopyStreams;
+    std::vector<std::thread> threads;
+    if (!failed) {
+        for (std::uint64_t offset = 0; offset < size; offset += rangeSize) {
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                ++running;
+            }
+            threads.emplace_back(copyRange, offset == 0 ? std::move(firstStream) : GFileInputStreamPtr{}, offset,
+                                 std::min(offset + rangeSize, size));
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        while (running > 0) {
+            finished.wait_for(lock, std::chrono::milliseconds(kProgressInterval));
+            setCurrentFileProgress(size, done);
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (firstStream) {
+        g_input_stream_close(G_INPUT_STREAM(firstStream.get()), nullptr, nullptr);
+    }
+
+    if (!failed && !isCancelled()) {
+        // keep the mode and times, as G_FILE_COPY_ALL_METADATA does
+        if (g_file_info_has_attribute(srcInfo.get(), G_FILE_ATTRIBUTE_UNIX_MODE)) {
+            fchmod(fd, g_file_info_get_attribute_uint32(srcInfo.get(), G_FILE_ATTRIBUTE_UNIX_MODE) & 07777);
+        }
+        if (g_file_info_has_attribute(srcInfo.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+            struct timespec times[2];
+            times[0].tv_sec = 0;
+            times[0].tv_nsec = UTIME_OMIT;
+            times[1].tv_sec = time_t(g_file_info_get_attribute_uint64(srcInfo.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED));
+            times[1].tv_nsec =
+                long(g_file_info_get_attribute_uint32(srcInfo.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC)) * 1000;
+            futimens(fd, times);
+        }
+    }
+    if (close(fd) != 0 && code == 0) {
+        code = errno;
+    }
+    if (failed || code != 0 || isCancelled()) {
+        unlink(destName.get());
+        if (isCancelled()) {
+            return true;
+        }
+        if (firstError) {
+            err = std::move(firstError);
+        }
+        else if (code != 0) {
+            setErrno(code);
+        }
+        return true;
+    }
+    copied = true;
+    return true;
+}
+
 bool FileTransferJob::copySpecialFile(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath) {
     bool ret = false;
     // only handle FIFO for local files
@@ -162,6 +449,64 @@ bool FileTransferJob::copySpecialFile(const FilePath& srcPath, const GFileInfoPt
     return ret;
 }
 
+bool FileTransferJob::isConcurrentCopy(const FilePath& srcPath,
+                                       const GFileInfoPtr& srcInfo,
+                                       const FilePath& destPath) const {
+    // from a GIO backend to a local folder; sftp:// has a copier of its own
+    return g_file_info_get_file_type(srcInfo.get()) == G_FILE_TYPE_REGULAR && !srcPath.isNative() &&
+           destPath.isNative() && !(remoteFileCopier() && srcPath.hasUriScheme("sftp"));
+}
+
+size_t FileTransferJob::copySmallFiles(std::vector<SmallFile>& files, const FilePath& destDirPath) {
+    // copy them all at once first, without replacing anything
+    std::vector<char> done(files.size(), false);
+    std::vector<std::thread> threads;
+    threads.reserve(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        threads.emplace_back([this, &files, &done, &destDirPath, i]() {
+            auto destPath = destDirPath.child(files[i].name.c_str());
+            GErrorPtr err;
+            done[i] = g_file_copy(files[i].srcPath.gfile().get(), destPath.gfile().get(),
+                                  GFileCopyFlags(G_FILE_COPY_ALL_METADATA | G_FILE_COPY_NOFOLLOW_SYMLINKS),
+                                  cancellable().get(), nullptr, nullptr, &err);
+            if (!done[i] && !(err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_EXISTS)) {
+                // so that the retry below does not take it for an existing file
+                g_file_delete(destPath.gfile().get(), nullptr, nullptr);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // the ones that failed go through copyFile() again, for its questions and error messages
+    size_t copied = 0;
+    for (size_t i = 0; i < files.size() && !isCancelled(); ++i) {
+        const SmallFile& file = files[i];
+        if (!done[i]) {
+            if (copyFile(file.srcPath, file.srcInfo, destDirPath, file.name.c_str())) {
+                ++copied;
+            }
+            continue;
+        }
+        setCurrentFile(file.srcPath);
+        auto size = g_file_info_get_attribute_uint64(file.srcInfo.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
+        addFinishedAmount(size, 1);
+        PerfTrace::add(PerfTrace::TransferFiles);
+        PerfTrace::add(PerfTrace::TransferBytes, size);
+        if (mode_ == Mode::MOVE) {
+            // delete the source file for cross-filesystem move
+            if (!g_file_delete(file.srcPath.gfile().get(), cancellable().get(), nullptr)) {
+                continue;
+            }
+            addFinishedAmount(1, 1);
+        }
+        ++copied;
+    }
+    files.clear();
+    return copied;
+}
+
 bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr /*srcInfo*/, FilePath& destPath, bool skip) {
     bool ret = false;
     // copy dir content
@@ -174,6 +519,16 @@ bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr /*src
         int n_children = 0;
         int n_copied = 0;
         ret = true;
+        // small remote files are copied several at a time, since each waits mostly on the network
+        std::vector<SmallFile> smallFiles;
+        auto flushSmallFiles = [&]() {
+            const size_t n = smallFiles.size();
+            const size_t copied = copySmallFiles(smallFiles, destPath);
+            n_copied += int(copied);
+            if (copied != n) {
+                ret = false;
+            }
+        };
         while (!isCancelled()) {
             err.reset();
             GFileInfoPtr inf{g_file_enumerator_next_file(enu.get(), cancellable().get(), &err), false};
@@ -181,6 +536,14 @@ bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr /*src
                 ++n_children;
                 const char* name = g_file_info_get_name(inf.get());
                 FilePath childPath = srcPath.child(name);
+                if (!skip && mode_ != Mode::LINK && isConcurrentCopy(childPath, inf, destPath) &&
+                    g_file_info_get_size(inf.get()) < goffset(kChunkedCopyMinSize)) {
+                    smallFiles.push_back(SmallFile{std::move(childPath), std::move(inf), name});
+                    if (smallFiles.size() == kSmallFileBatch) {
+                        flushSmallFiles();
+                    }
+                    continue;
+                }
                 bool child_ret = copyFile(childPath, inf, destPath, name, skip);
                 if (child_ret) {
                     ++n_copied;
@@ -190,6 +553,7 @@ bool FileTransferJob::copyDirContent(const FilePath& srcPath, GFileInfoPtr /*src
                 }
             }
             else {
+                flushSmallFiles();
                 if (err) {
                     // fail to read directory content
                     // NOTE: since we cannot read the source dir, we cannot calculate the progress correctly, either.
@@ -443,6 +807,7 @@ bool FileTransferJob::moveFile(const FilePath& srcPath,
         // since the time required to move a file is not related to it's file size.
         auto size = g_file_info_get_attribute_uint64(srcInfo.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
         addFinishedAmount(size, 1);
+        PerfTrace::add(PerfTrace::TransferFiles);
     }
     else {
         // cross device/filesystem move: copy & delete
@@ -494,6 +859,10 @@ bool FileTransferJob::copyFile(const FilePath& srcPath,
         // finish copying the file
         addFinishedAmount(size, 1);
         setCurrentFileProgress(0, 0);
+        if (!skip && file_type != G_FILE_TYPE_DIRECTORY) {
+            PerfTrace::add(PerfTrace::TransferFiles);
+            PerfTrace::add(PerfTrace::TransferBytes, size);
+        }
 
         // recursively copy dir content
         if (file_type == G_FILE_TYPE_DIRECTORY) {
@@ -655,6 +1024,11 @@ void FileTransferJob::exec() {
     TotalSizeJob totalSizeJob{srcPaths_, totalSizeFlags};
     connect(&totalSizeJob, &TotalSizeJob::error, this, &FileTransferJob::error);
     connect(this, &FileTransferJob::cancelled, &totalSizeJob, &TotalSizeJob::cancel);
+    // show the amount counted so far while the counting goes on
+    connect(
+        &totalSizeJob, &TotalSizeJob::totalsChanged, this,
+        [this, &totalSizeJob]() { setTotalAmount(totalSizeJob.totalSize(), totalSizeJob.fileCount()); },
+        Qt::DirectConnection);
     totalSizeJob.run();
     if (isCancelled()) {
         return;
@@ -670,6 +1044,7 @@ void FileTransferJob::exec() {
     }
 
     // copy the files
+    PerfTrace::Scope trace{"FileTransferJob"};
     for (size_t i = 0; i < srcPaths_.size(); ++i) {
         if (isCancelled()) {
             break;
@@ -679,6 +1054,10 @@ void FileTransferJob::exec() {
         auto destDirPath = destPath.parent();
         processPath(srcPath, destDirPath, destPath.baseName().get());
     }
+    std::uint64_t finishedSize, finishedCount;
+    if (finishedAmount(finishedSize, finishedCount)) {
+        trace.setAmount(finishedSize);  // the bytes done, for the throughput
+    }
 }
 
 }  // namespace Fm
@@ -4,6 +4,10 @@
 #include "../libfmqtglobals.h"
 #include "fileoperationjob.h"
 #include "gioptrs.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
 
 namespace Fm {
 
@@ -20,6 +24,28 @@ class LIBFM_QT_API FileTransferJob : public Fm::FileOperationJob {
     void setDestPaths(FilePathList destPaths);
     void setDestDirPath(const FilePath& destDirPath);
 
+    // Copies the local regular file |srcPath| to |destPath|, replacing an existing file, with
+    // mode and times kept. |progress| gets the bytes copied so far and the size of the file
+    // and returns false to cancel. Returns 0 or the errno of the failure.
+    using ProgressFunc = std::function<bool(std::uint64_t done, std::uint64_t total)>;
+    using LocalFileCopier =
+        std::function<int(const char* srcPath, const char* destPath, const ProgressFunc& progress)>;
+
+    // Makes every job copy regular files between local paths with |copier| rather than
+    // g_file_copy(). Should be set once, before any job is started.
+    static void setLocalFileCopier(LocalFileCopier copier);
+
+    // Copies a regular file between a remote URI and a local one, either way, with progress
+    // as for LocalFileCopier. |overwrite| allows replacing an existing destination; without it
+    // an existing one fails with EEXIST. Returns 0, the errno of the failure, or ENOTSUP to
+    // leave the file to g_file_copy().
+    using RemoteFileCopier =
+        std::function<int(const char* srcUri, const char* destUri, bool overwrite, const ProgressFunc& progress)>;
+
+    // Makes every job offer copies of regular files from or to sftp:// locations to |copier|
+    // before g_file_copy(). Should be set once, before any job is started.
+    static void setRemoteFileCopier(RemoteFileCopier copier);
+
    protected:
     void exec() override;
 
@@ -41,9 +67,33 @@ class LIBFM_QT_API FileTransferJob : public Fm::FileOperationJob {
 
     bool moveFileSameFs(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath);
     bool copyRegularFile(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath);
+    bool copyLocalRegularFile(const FilePath& srcPath, const FilePath& destPath, int flags, GErrorPtr& err);
+    // returns false when the remote copier leaves the file to g_file_copy()
+    bool copyRemoteRegularFile(const FilePath& srcPath,
+                               const FilePath& destPath,
+                               int flags,
+                               bool& copied,
+                               GErrorPtr& err);
+    // returns false when the source cannot seek, leaving the file to g_file_copy()
+    bool copyRegularFileChunked(const FilePath& srcPath,
+                                const GFileInfoPtr& srcInfo,
+                                const FilePath& destPath,
+                                int flags,
+                                bool& copied,
+                                GErrorPtr& err);
     bool copySpecialFile(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath);
     bool copyDirContent(const FilePath& srcPath, GFileInfoPtr srcInfo, FilePath& destPath, bool skip = false);
     bool makeDir(const FilePath& srcPath, GFileInfoPtr srcInfo, FilePath& destPath);
+
+    // a small remote file of a folder, copied together with its siblings
+    struct SmallFile {
+        FilePath srcPath;
+        GFileInfoPtr srcInfo;
+        std::string name;
+    };
+    bool isConcurrentCopy(const FilePath& srcPath, const GFileInfoPtr& srcInfo, const FilePath& destPath) const;
+    // returns the number of files copied and clears |files|
+    size_t copySmallFiles(std::vector<SmallFile>& files, const FilePath& destDirPath);
     bool createSymlink(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath);
     bool createShortcut(const FilePath& srcPath, const GFileInfoPtr& srcInfo, FilePath& destPath);
 
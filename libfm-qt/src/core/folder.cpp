@@ -22,42 +22,83 @@
  */
 
 #include "folder.h"
+#include <algorithm>
 #include <cstring>
 #include <cassert>
+#include <QPointer>
 #include <QTimer>
 #include <QDebug>
 
 #include "dirlistjob.h"
-#include "filesysteminfojob.h"
+#include "dirsizeindex.h"
 #include "fileinfojob.h"
+#include "fileinfopool.h"
+#include "listingsnapshot.h"
+#include "sharedlisting.h"
+#include "jobscheduler.h"
+#include "perftrace.h"
 
 namespace Fm {
 
+namespace {
+
+// more monitor events than this between two updates mean the folder is busy
+constexpr std::size_t kBusyUpdateEvents = 64;
+// bounds of the delay (in ms) before processing the changes of a busy folder
+constexpr int kMinBusyUpdateDelay = 50;
+constexpr int kMaxUpdateDelay = 1000;
+// the delay (in ms) before processing the changes of a folder that is not shown
+constexpr int kHiddenUpdateDelay = 5000;
+// queuing more changed paths than this makes the folder reload instead
+constexpr std::size_t kMaxQueuedPaths = 2048;
+// listings of folders that cannot be watched are trusted for this long (in ms) when shown again,
+// and not reused at all past the second limit, even if the directory seems unchanged
+constexpr qint64 kFreshListingAge = 10000;
+constexpr qint64 kMaxListingAge = 300000;
+
+}  // namespace
+
 std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> Folder::cache_;
-std::mutex Folder::mutex_;
+std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> Folder::recursiveCache_;
+std::mutex Folder::cacheMutex_;
 
 Folder::Folder()
-    : dirlist_job{nullptr},
-      fsInfoJob_{nullptr},
+    : recursive_{false},
+      treeWatched_{false},
+      dirlist_job{nullptr},
+      fsInfoQueryPending_{false},
       volumeManager_{VolumeManager::globalInstance()},
+      fsInfoCache_{FileSystemInfoCache::globalInstance()},
       /* for file monitor */
       has_idle_reload_handler{false},
       has_idle_update_handler{false},
+      queuedEvents_{0},
+      updateDelay_{0},
       pending_change_notify{false},
       filesystem_info_pending{false},
-      wants_incremental{false},
+      listingPriority_{JobScheduler::Priority::Interactive},
+      validating_{false},
+      wants_incremental{true},
+      diffReload_{false},
+      fromSnapshot_{false},
+      sharedGeneration_{0},
       stop_emission{false}, /* don't set it 1 bit to not lock other bits */
       /* filesystem info - set in query thread, read in main */
       fs_total_size{0},
       fs_free_size{0},
       has_fs_info{false},
       defer_content_test{false} {
+    updateTimer_.setSingleShot(true);
+    connect(&updateTimer_, &QTimer::timeout, this, &Folder::processPendingChanges);
     connect(volumeManager_.get(), &VolumeManager::mountAdded, this, &Folder::onMountAdded);
     connect(volumeManager_.get(), &VolumeManager::mountRemoved, this, &Folder::onMountRemoved);
 }
 
 Folder::Folder(const FilePath& path) : Folder() {
     dirPath_ = path;
+    if (FileInfoPool::isEnabled()) {
+        fileInfoPool_ = FileInfoPool::create();
+    }
 }
 
 Folder::~Folder() {
@@ -73,20 +114,23 @@ Folder::~Folder() {
     if (dirlist_job) {
         dirlist_job->cancel();
     }
+    for (auto job : subtreeJobs_) {
+        job->cancel();
+    }
 
     // cancel any file info job in progress.
     for (auto job : fileinfoJobs_) {
         job->cancel();
     }
 
-    if (fsInfoJob_) {
-        fsInfoJob_->cancel();
-    }
-
     // We store a weak_ptr instead of shared_ptr in the hash table, so the hash table
     // does not own a reference to the folder. When the last reference to Folder is
     // freed, we need to remove its hash table entry.
-    std::lock_guard<std::mutex> lock{mutex_};
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    if (recursive_) {
+        recursiveCache_.erase(dirPath_);
+        return;
+    }
     auto it = cache_.find(dirPath_);
     if (it != cache_.end()) {
         cache_.erase(it);
@@ -108,7 +152,17 @@ Folder::~Folder() {
 
 // static
 std::shared_ptr<Folder> Folder::fromPath(const FilePath& path) {
-    std::lock_guard<std::mutex> lock{mutex_};
+    return fromPath(path, JobScheduler::Priority::Interactive);
+}
+
+// static
+std::shared_ptr<Folder> Folder::prefetch(const FilePath& path) {
+    return fromPath(path, JobScheduler::Priority::Prefetch);
+}
+
+// static
+std::shared_ptr<Folder> Folder::fromPath(const FilePath& path, JobScheduler::Priority priority) {
+    std::lock_guard<std::mutex> lock{cacheMutex_};
     auto it = cache_.find(path);
     if (it != cache_.end()) {
         auto folder = it->second.lock();
@@ -120,15 +174,33 @@ std::shared_ptr<Folder> Folder::fromPath(const FilePath& path) {
         }
     }
     auto folder = std::make_shared<Folder>(path);
+    folder->listingPriority_ = priority;
     folder->reload();
     cache_.emplace(path, folder);
     return folder;
 }
 
+// static
+std::shared_ptr<Folder> Folder::fromPathRecursive(const FilePath& path) {
+    std::lock_guard<std::mutex> lock{cacheMutex_};
+    auto it = recursiveCache_.find(path);
+    if (it != recursiveCache_.end()) {
+        if (auto folder = it->second.lock()) {
+            return folder;
+        }
+        recursiveCache_.erase(it);
+    }
+    auto folder = std::make_shared<Folder>(path);
+    folder->recursive_ = true;
+    folder->reload();
+    recursiveCache_.emplace(path, folder);
+    return folder;
+}
+
 // static
 // Checks if this is the path of a folder in use.
 std::shared_ptr<Folder> Folder::findByPath(const FilePath& path) {
-    std::lock_guard<std::mutex> lock{mutex_};
+    std::lock_guard<std::mutex> lock{cacheMutex_};
     auto it = cache_.find(path);
     if (it != cache_.end()) {
         auto folder = it->second.lock();
@@ -145,6 +217,27 @@ bool Folder::makeDirectory(const char* /*name*/, GError** /*error*/) {
     return false;
 }
 
+void Folder::setShownBy(const void* viewer, bool shown) {
+    const bool wasShown = isShown();
+    viewers_[viewer] = shown;
+    if (!wasShown && isShown() && updateTimer_.isActive()) {
+        scheduleUpdate();  // the changes queued meanwhile are handled at once
+    }
+}
+
+void Folder::removeViewer(const void* viewer) {
+    const bool wasShown = isShown();
+    viewers_.erase(viewer);
+    if (!wasShown && isShown() && updateTimer_.isActive()) {
+        scheduleUpdate();
+    }
+}
+
+bool Folder::isShown() const {
+    return viewers_.empty() ||
+           std::any_of(viewers_.cbegin(), viewers_.cend(), [](const auto& viewer) { return viewer.second; });
+}
+
 bool Folder::isIncremental() const {
     return wants_incremental;
 }
@@ -154,10 +247,12 @@ bool Folder::isValid() const {
 }
 
 bool Folder::isLoaded() const {
-    return (dirlist_job == nullptr);
+    // while a reload is diffed, files_ still holds a complete (if possibly dated) listing
+    return (dirlist_job == nullptr || diffReload_);
 }
 
 std::shared_ptr<const FileInfo> Folder::fileByName(const char* name) const {
+    std::shared_lock<std::shared_mutex> lock{filesMutex_};
     auto it = files_.find(name);
     if (it != files_.end()) {
         return it->second;
@@ -166,14 +261,25 @@ std::shared_ptr<const FileInfo> Folder::fileByName(const char* name) const {
 }
 
 bool Folder::isEmpty() const {
+    std::shared_lock<std::shared_mutex> lock{filesMutex_};
     return files_.empty();
 }
 
+std::string Folder::fileKey(const FilePath& path) const {
+    if (recursive_) {
+        if (auto relative = dirPath_.relativePathStr(path)) {
+            return relative.get();
+        }
+    }
+    return path.baseName().get();
+}
+
 bool Folder::hasFileMonitor() const {
-    return (dirMonitor_ != nullptr);
+    return (dirMonitor_ != nullptr || dirWatch_ != nullptr);
 }
 
 FileInfoList Folder::files() const {
+    std::shared_lock<std::shared_mutex> lock{filesMutex_};
     FileInfoList ret;
     ret.reserve(files_.size());
     for (const auto& item : files_) {
@@ -244,26 +350,33 @@ void Folder::onFileInfoFinished() {
     FileInfoList files_to_delete;
     std::vector<FileInfoPair> files_to_update;
 
-    const auto& paths = job->paths();
-    const auto& infos = job->files();
-    auto path_it = paths.cbegin();
-    auto info_it = infos.cbegin();
-    for (; path_it != paths.cend() && info_it != infos.cend(); ++path_it, ++info_it) {
-        const auto& path = *path_it;
-        const auto& info = *info_it;
-
-        if (path == dirPath_) {  // got the info for the folder itself.
+    // files() leaves out the paths that could not be queried, so it does not line up with paths()
+    std::unique_lock<std::shared_mutex> filesLock{filesMutex_};
+    for (const auto& info : job->files()) {
+        if (info->path() == dirPath_) {  // got the info for the folder itself.
             dirInfo_ = info;
         }
         else {
-            auto it = files_.find(info->path().baseName().get());
+            std::string key = fileKey(info->path());
+            auto it = files_.find(key);
             if (it != files_.end()) {  // the file already exists, update
+                deferredFiles_.erase(it->second.get());
                 files_to_update.push_back(std::make_pair(it->second, info));
             }
             else {  // newly added
                 files_to_add.push_back(info);
             }
-            files_[info->path().baseName().get()] = info;
+            files_[std::move(key)] = info;
+        }
+    }
+    filesLock.unlock();
+    if (recursive_) {
+        // a directory that came with its content, as when moved in, is listed in full
+        watchSubdirs(files_to_add);
+        for (const auto& info : files_to_add) {
+            if (info->isDir() && !info->isSymlink() && !info->isHidden()) {
+                listSubtree(info->path());
+            }
         }
     }
     if (!files_to_add.empty()) {
@@ -276,8 +389,8 @@ void Folder::onFileInfoFinished() {
 
     // process the changes accumulated during this info job
     if (filesystem_info_pending  // means a pending change; see "onFileSystemInfoFinished()"
-        || !paths_to_update.empty() || !paths_to_add.empty() || !paths_to_del.empty()) {
-        QTimer::singleShot(0, this, &Folder::processPendingChanges);
+        || !queuedPaths_.empty()) {
+        scheduleUpdate();
     }
     // there's no pending change at the moment; let the next one be processed
     else {
@@ -286,8 +399,10 @@ void Folder::onFileInfoFinished() {
 }
 
 void Folder::processPendingChanges() {
+    PerfTrace::Scope trace{"Folder changes"};
+    PerfTrace::add(PerfTrace::WakeupFolderUpdates);
     // FmFileInfoJob* job = nullptr;
-    std::lock_guard<std::mutex> lock{mutex_};
+    std::unique_lock<std::mutex> pathsLock{pathsMutex_};
 
     // idle_handler = 0;
     /* if we were asked to block updates let delay it for now */
@@ -296,14 +411,26 @@ void Folder::processPendingChanges() {
         return;
     }
 
+    /* A folder being written to heavily (a build, an archive extraction) can get thousands of
+       events per second. Every path is queued only once whatever events it gets, and while the
+       events keep coming, they are collected for longer before being processed. */
+    if (queuedEvents_ > kBusyUpdateEvents) {
+        updateDelay_ = std::min(std::max(updateDelay_ * 2, kMinBusyUpdateDelay), kMaxUpdateDelay);
+    }
+    else {
+        updateDelay_ /= 2;
+    }
+    queuedEvents_ = 0;
+
     FileInfoJob* info_job = nullptr;
-    if (!paths_to_update.empty() || !paths_to_add.empty()) {
-        FilePathList paths;
-        paths.insert(paths.end(), paths_to_add.cbegin(), paths_to_add.cend());
-        paths.insert(paths.end(), paths_to_update.cbegin(), paths_to_update.cend());
+    FilePathList paths;
+    for (const auto& queued : queuedPaths_) {
+        if (queued.second & (QueuedAdd | QueuedUpdate)) {
+            paths.push_back(queued.first);
+        }
+    }
+    if (!paths.empty()) {
         info_job = new FileInfoJob{paths};
-        paths_to_update.clear();
-        paths_to_add.clear();
     }
     else {
         // let the next pending changes be processed; see "onFileInfoFinished()"
@@ -314,7 +441,7 @@ void Folder::processPendingChanges() {
         fileinfoJobs_.push_back(info_job);
         info_job->setAutoDelete(true);
         connect(info_job, &FileInfoJob::finished, this, &Folder::onFileInfoFinished, Qt::BlockingQueuedConnection);
-        info_job->runAsync();
+        JobScheduler::globalInstance()->start(info_job, JobScheduler::Priority::Interactive, dirPath_);
 #if 0
         pending_jobs = g_slist_prepend(pending_jobs, job);
         if(!fm_job_run_async(FM_JOB(job))) {
@@ -327,20 +454,36 @@ void Folder::processPendingChanges() {
 
     // process deletion
     FileInfoList deleted_files;
-    auto path_it = paths_to_del.begin();
-    while (path_it != paths_to_del.end()) {
-        const auto& path = *path_it;
-        auto name = path.baseName();
-        auto it = files_.find(name.get());
-        if (it != files_.end()) {
-            deleted_files.push_back(it->second);
-            files_.erase(it);
-            path_it = paths_to_del.erase(path_it);
-        }
-        else {
-            ++path_it;
+    {
+        std::lock_guard<std::shared_mutex> filesLock{filesMutex_};
+        auto path_it = queuedPaths_.begin();
+        while (path_it != queuedPaths_.end()) {
+            if (!(path_it->second & QueuedDel)) {  // handed to the info job
+                path_it = queuedPaths_.erase(path_it);
+                continue;
+            }
+            auto it = files_.find(fileKey(path_it->first));
+            if (it != files_.end()) {
+                deferredFiles_.erase(it->second.get());
+                deleted_files.push_back(it->second);
+                if (recursive_ && it->second->isDir()) {
+                    removeSubtree(it->second, deleted_files);  // leaves |it| valid
+                }
+                files_.erase(it);
+                path_it = queuedPaths_.erase(path_it);
+            }
+            else if (path_it->second & QueuedAdd) {
+                // may be added by the info job just started; check again once it has finished
+                path_it->second = QueuedDel;
+                ++path_it;
+            }
+            else {  // a file that came and went between two updates
+                path_it = queuedPaths_.erase(path_it);
+            }
         }
     }
+    // nothing is locked while the changes are being handled
+    pathsLock.unlock();
     if (!deleted_files.empty()) {
         Q_EMIT filesRemoved(deleted_files);
         Q_EMIT contentChanged();
@@ -348,8 +491,8 @@ void Folder::processPendingChanges() {
 
     if (pending_change_notify) {
         Q_EMIT changed();
-        /* update volume info */
-        queryFilesystemInfo();
+        /* update volume info, which the change may have altered */
+        queryFilesystemInfo(true);
         pending_change_notify = false;
     }
 
@@ -359,83 +502,77 @@ void Folder::processPendingChanges() {
     }
 }
 
-/* should be called only with G_LOCK(lists) on! */
+/* should be called only with pathsMutex_ locked! */
 void Folder::queueUpdate() {
-    // qDebug() << "queue_update:" << !has_idle_handler << paths_to_add.size() << paths_to_update.size() <<
-    // paths_to_del.size();
+    // qDebug() << "queue_update:" << !has_idle_handler << queuedPaths_.size();
+    if (queuedPaths_.size() > kMaxQueuedPaths && !dirlist_job) {
+        /* Past this, stat'ing every path costs more than listing the folder again, and a
+           diffed reload only reports the files that really changed in the meantime. */
+        queuedPaths_.clear();
+        queueReload();
+        return;
+    }
     if (!has_idle_update_handler) {
-        QTimer::singleShot(0, this, &Folder::processPendingChanges);
+        scheduleUpdate();
         has_idle_update_handler = true;
     }
 }
 
+void Folder::scheduleUpdate() {
+    if (isShown()) {
+        updateTimer_.setTimerType(Qt::CoarseTimer);
+        updateTimer_.start(updateDelay_);
+    }
+    else {
+        // woken up together with the other timers of the session
+        updateTimer_.setTimerType(Qt::VeryCoarseTimer);
+        updateTimer_.start(kHiddenUpdateDelay);
+    }
+}
+
 /* NOTE: When queuing files for addition/update/deletion in the following functions,
    the currently detected files (namely, "files_") should not be taken into account
    because they might be changed soon due to a previous call to queueUpdate(). */
 
 /* returns true if reference was taken from path */
 bool Folder::eventFileAdded(const FilePath& path) {
-    bool added = true;
-    // G_LOCK(lists);
-    if (std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) != paths_to_del.cend()) {
+    auto& queued = queuedPaths_[path];
+    if (queued & QueuedDel) {
         // if the file was going to be deleted, its addition means an update,
         // so remove it from the deletion queue and add it to the update queue
-        paths_to_del.erase(std::remove(paths_to_del.begin(), paths_to_del.end(), path), paths_to_del.cend());
-        if (std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend()) {
-            paths_to_update.push_back(path);
-        }
+        queued = (queued & ~QueuedDel) | QueuedUpdate;
     }
-    else if (std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        paths_to_add.push_back(path);
+    else if (!(queued & QueuedAdd)) {
+        queued |= QueuedAdd;
     }
     else {  // file already queued for adding, don't duplicate
-        added = false;
-    }
-
-    if (added) {
-        queueUpdate();
+        return false;
     }
-    // G_UNLOCK(lists);
-    return added;
+    queueUpdate();
+    return true;
 }
 
 bool Folder::eventFileChanged(const FilePath& path) {
-    bool added;
-    // G_LOCK(lists);
-    if (std::find(paths_to_update.cbegin(), paths_to_update.cend(), path) == paths_to_update.cend() &&
-        std::find(paths_to_add.cbegin(), paths_to_add.cend(), path) == paths_to_add.cend()) {
-        paths_to_update.push_back(path);
-        added = true;
-        queueUpdate();
-    }
-    else {
-        added = false;
+    auto& queued = queuedPaths_[path];
+    if (queued & (QueuedAdd | QueuedUpdate)) {
+        return false;
     }
-    // G_UNLOCK(lists);
-    return added;
+    queued |= QueuedUpdate;
+    queueUpdate();
+    return true;
 }
 
 void Folder::eventFileDeleted(const FilePath& path) {
-    bool deleted = true;
     // qDebug() << "delete " << path.baseName().get();
-    // G_LOCK(lists);
-    /* WARNING: If the file is in the addition queue, we should not remove it from that queue
+    /* WARNING: If the file is queued for addition, we should not remove it from that queue
        and ignore its deletion because it may have been added by the directory list job, in
        which case, ignoring an addition-deletion sequence would result in a nonexistent file. */
-    if (std::find(paths_to_del.cbegin(), paths_to_del.cend(), path) == paths_to_del.cend()) {
-        paths_to_del.push_back(path);
-        // the update queue can be cancelled for a file that is going to be deleted
-        paths_to_update.erase(std::remove(paths_to_update.begin(), paths_to_update.end(), path),
-                              paths_to_update.cend());
-    }
-    else {
-        deleted = false;
-    }
-
-    if (deleted) {
+    auto& queued = queuedPaths_[path];
+    if (!(queued & QueuedDel)) {
+        // the update can be cancelled for a file that is going to be deleted
+        queued = (queued & ~QueuedUpdate) | QueuedDel;
         queueUpdate();
     }
-    // G_UNLOCK(lists);
 }
 
 void Folder::onDirChanged(GFileMonitorEvent evt) {
@@ -457,12 +594,9 @@ void Folder::onDirChanged(GFileMonitorEvent evt) {
             break;
         case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
         case G_FILE_MONITOR_EVENT_CHANGED: {
-            std::lock_guard<std::mutex> lock{mutex_};
+            std::lock_guard<std::mutex> lock{pathsMutex_};
             pending_change_notify = true;
-            if (std::find(paths_to_update.cbegin(), paths_to_update.cend(), dirPath_) != paths_to_update.cend()) {
-                paths_to_update.push_back(dirPath_);
-                queueUpdate();
-            }
+            eventFileChanged(dirPath_);
             /* g_debug("folder is changed"); */
             break;
         }
@@ -476,6 +610,11 @@ void Folder::onDirChanged(GFileMonitorEvent evt) {
 }
 
 void Folder::onFileChangeEvents(GFileMonitor* /*monitor*/, GFile* gf, GFile* /*other_file*/, GFileMonitorEvent evt) {
+    PerfTrace::add(PerfTrace::FolderEvents);
+    onFileChanged(FilePath{gf, true}, evt);
+}
+
+void Folder::onFileChanged(const FilePath& path, GFileMonitorEvent evt) {
     /* const char* names[]={
         "G_FILE_MONITOR_EVENT_CHANGED",
         "G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT",
@@ -485,13 +624,23 @@ void Folder::onFileChangeEvents(GFileMonitor* /*monitor*/, GFile* gf, GFile* /*o
         "G_FILE_MONITOR_EVENT_PRE_UNMOUNT",
         "G_FILE_MONITOR_EVENT_UNMOUNTED"
     }; */
-    if (dirPath_ == gf) {
+    if (evt != G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED && evt != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+        // the total sizes of this folder and of those above it no longer hold
+        if (auto localPath = (recursive_ && path.isValid() ? path.parent() : dirPath_).localPath()) {
+            DirSizeIndex::globalInstance()->invalidate(localPath.get());
+        }
+    }
+    if (!path.isValid()) {  // events were lost
+        queueReload();
+        return;
+    }
+    if (dirPath_ == path) {
         onDirChanged(evt);
         return;
     }
     else {
-        std::lock_guard<std::mutex> lock{mutex_};
-        auto path = FilePath{gf, true};
+        std::lock_guard<std::mutex> lock{pathsMutex_};
+        ++queuedEvents_;
         /* NOTE: sometimes, for unknown reasons, GFileMonitor gives us the
          * same event of the same file for multiple times. So we need to
          * check for duplications ourselves here. */
@@ -512,49 +661,128 @@ void Folder::onFileChangeEvents(GFileMonitor* /*monitor*/, GFile* gf, GFile* /*o
     }
 }
 
+// Whether |b| is the same file as |a| in an unchanged state, judged by its identity (device and
+// inode for local files), modification and status change times, and size.
+static bool isSameFileState(const FileInfo& a, const FileInfo& b) {
+    // file ids are interned strings and so can be compared as pointers
+    return a.fileId() == b.fileId() && a.mtime() == b.mtime() && a.ctime() == b.ctime() && a.size() == b.size();
+}
+
+void Folder::onDirListFilesFound(const FileInfoList& foundFiles) {
+    if (sender() != dirlist_job) {  // from a cancelled job
+        return;
+    }
+    FileInfoList files_to_add;
+    std::vector<FileInfoPair> files_to_update;
+    // with "search://", files of the same name may come from different folders and are all added
+    const bool isFileSearch = dirPath_.hasUriScheme("search");
+    std::unique_lock<std::shared_mutex> filesLock{filesMutex_};
+    for (const auto& info : foundFiles) {
+        auto& file = files_[fileKey(info->path())];
+        if (file && !isFileSearch) {  // already reported by the file monitor
+            files_to_update.push_back(std::make_pair(file, info));
+        }
+        else {
+            files_to_add.push_back(info);
+        }
+        file = info;
+    }
+    filesLock.unlock();
+    watchSubdirs(foundFiles);
+    if (!files_to_add.empty()) {
+        Q_EMIT filesAdded(files_to_add);
+    }
+    if (!files_to_update.empty()) {
+        Q_EMIT filesChanged(files_to_update);
+    }
+}
+
 void Folder::onDirListFinished() {
     DirListJob* job = static_cast<DirListJob*>(sender());
     if (job->isCancelled()) {  // this is a cancelled job, ignore!
         if (job == dirlist_job) {
             dirlist_job = nullptr;
+            diffReload_ = false;
             Q_EMIT finishLoading();  // this was the last job until now
         }
         return;
     }
     dirInfo_ = job->dirInfo();
+    listingPriority_ = JobScheduler::Priority::Interactive;  // later listings are asked for
+    sinceListed_.start();
+    if (job->incremental()) {  // every file was delivered by onDirListFilesFound()
+        addDeferredFiles(job);
+        dirlist_job = nullptr;
+        saveSnapshot();
+        Q_EMIT finishLoading();
+        return;
+    }
 
     FileInfoList files_to_add;
     std::vector<FileInfoPair> files_to_update;
+    FileInfoList files_to_remove;
     const auto& infos = job->files();
 
     // with "search://", there is no update for infos and all of them should be added
     if (dirPath_.hasUriScheme("search")) {
         files_to_add = infos;
+        std::lock_guard<std::shared_mutex> filesLock{filesMutex_};
         for (auto& file : files_to_add) {
-            files_[file->path().baseName().get()] = file;
+            files_[fileKey(file->path())] = file;
         }
     }
     else {
-        auto info_it = infos.cbegin();
-        for (; info_it != infos.cend(); ++info_it) {
-            const auto& info = *info_it;
-            auto it = files_.find(info->path().baseName().get());
-            if (it != files_.end()) {
-                files_to_update.push_back(std::make_pair(it->second, info));
+        // List into a scratch map, keeping the current info of every file that has not
+        // changed, so that views are only told about real differences.
+        std::unordered_map<std::string, std::shared_ptr<const FileInfo>> listed;
+        listed.reserve(infos.size());
+        for (const auto& info : infos) {
+            std::string name = fileKey(info->path());
+            auto it = files_.find(name);
+            if (it == files_.end()) {
+                files_to_add.push_back(info);
+                listed[std::move(name)] = info;
+            }
+            else if (isSameFileState(*it->second, *info)) {
+                listed[std::move(name)] = it->second;
             }
             else {
-                files_to_add.push_back(info);
+                files_to_update.push_back(std::make_pair(it->second, info));
+                listed[std::move(name)] = info;
+            }
+        }
+        for (auto& item : files_) {
+            if (listed.find(item.first) == listed.end()) {
+                if (diffReload_) {  // gone since the last listing
+                    files_to_remove.push_back(item.second);
+                }
+                else {  // reported by the monitor after the listing had passed it
+                    listed.insert(item);
+                }
             }
-            files_[info->path().baseName().get()] = info;
         }
+        std::lock_guard<std::shared_mutex> filesLock{filesMutex_};
+        files_.swap(listed);
+    }
+    if (fromSnapshot_) {  // the guessed types of the files the listing replaced are not wanted
+        for (auto it = deferredFiles_.begin(); it != deferredFiles_.end();) {
+            auto file = files_.find(fileKey(it->second->path()));
+            it = file != files_.end() && file->second == it->second ? std::next(it) : deferredFiles_.erase(it);
+        }
+        fromSnapshot_ = false;
     }
+    watchSubdirs(infos);
 
+    if (!files_to_remove.empty()) {
+        Q_EMIT filesRemoved(files_to_remove);
+    }
     if (!files_to_add.empty()) {
         Q_EMIT filesAdded(files_to_add);
     }
     if (!files_to_update.empty()) {
         Q_EMIT filesChanged(files_to_update);
     }
+    addDeferredFiles(job);
 
 #if 0
     if(dirlist_job->isCancelled() && !wants_incremental) {
@@ -612,9 +840,136 @@ void Folder::onDirListFinished() {
 #endif
 
     dirlist_job = nullptr;
+    diffReload_ = false;
+    saveSnapshot();
     Q_EMIT finishLoading();
 }
 
+bool Folder::loadSnapshot() {
+    if (recursive_ || !ListingSnapshot::isEnabled() || !dirPath_.isNative()) {
+        return false;
+    }
+    FileInfoList files;
+    FileInfoList deferred;
+    if (!ListingSnapshot::globalInstance()->load(dirPath_, files, deferred, fileInfoPool_.get()) || files.empty()) {
+        return false;
+    }
+    {
+        std::lock_guard<std::shared_mutex> filesLock{filesMutex_};
+        for (const auto& file : files) {
+            files_[fileKey(file->path())] = file;
+        }
+    }
+    for (const auto& file : deferred) {
+        deferredFiles_.emplace(file.get(), file);
+    }
+    fromSnapshot_ = true;
+    Q_EMIT filesAdded(files);
+    return true;
+}
+
+void Folder::saveSnapshot() {
+    if (recursive_ || !dirInfo_ || !ListingSnapshot::isEnabled() || !dirPath_.isNative() ||
+        !ListingSnapshot::isWorthKeeping(files_.size(), listingTimer_.elapsed())) {
+        return;
+    }
+    ListingSnapshot::globalInstance()->save(dirPath_, dirInfo_->mtime(), files(), [this](const FileInfo& file) {
+        return deferredFiles_.find(&file) != deferredFiles_.end();
+    });
+}
+
+bool Folder::loadShared() {
+    if (recursive_ || !dirPath_.isNative() || !SharedListingClient::isEnabled() ||
+        (!files_.empty() && sharedGeneration_ == 0)) {
+        return false;
+    }
+    SharedListingClient::Listing listing;
+    if (!SharedListingClient::fetch(dirPath_, files_.empty() ? 0 : sharedGeneration_, listing, fileInfoPool_.get()) ||
+        !listing.dirInfo || listing.isDelta == files_.empty()) {
+        sharedGeneration_ = 0;
+        return false;
+    }
+
+    FileInfoList files_to_add;
+    std::vector<FileInfoPair> files_to_update;
+    FileInfoList files_to_remove;
+    {
+        std::lock_guard<std::shared_mutex> filesLock{filesMutex_};
+        for (const auto& name : listing.removedNames) {
+            auto it = files_.find(name);
+            if (it != files_.end()) {
+                deferredFiles_.erase(it->second.get());
+                files_to_remove.push_back(std::move(it->second));
+                files_.erase(it);
+            }
+        }
+        for (const auto& info : listing.files) {
+            auto& file = files_[fileKey(info->path())];
+            if (!file) {
+                files_to_add.push_back(info);
+            }
+            else if (!isSameFileState(*file, *info)) {
+                deferredFiles_.erase(file.get());
+                files_to_update.push_back(std::make_pair(file, info));
+            }
+            else {
+                continue;  // known here already, maybe better than a guess of the other process
+            }
+            file = info;
+        }
+    }
+    for (const auto& file : listing.deferredFiles) {
+        auto it = files_.find(fileKey(file->path()));
+        if (it != files_.end() && it->second == file) {
+            deferredFiles_.emplace(file.get(), file);
+        }
+    }
+    dirInfo_ = listing.dirInfo;
+    sharedGeneration_ = listing.generation;
+    sinceListed_.start();
+
+    if (!listing.isDelta) {
+        // the folder was empty, and is loaded as a listing would load it
+        Q_EMIT startLoading();
+    }
+    if (!files_to_remove.empty()) {
+        Q_EMIT filesRemoved(files_to_remove);
+    }
+    if (!files_to_add.empty()) {
+        Q_EMIT filesAdded(files_to_add);
+    }
+    if (!files_to_update.empty()) {
+        Q_EMIT filesChanged(files_to_update);
+    }
+    return true;
+}
+
+bool Folder::isContentTypeGuessed(const FileInfo& file) const {
+    return deferredFiles_.find(&file) != deferredFiles_.end();
+}
+
+// Files listed with a content type guessed from their names are only sniffed when asked for,
+// see resolveContentType().
+void Folder::addDeferredFiles(const DirListJob* job) {
+    for (const auto& info : job->deferredFiles()) {
+        auto it = files_.find(fileKey(info->path()));
+        if (it != files_.end() && it->second == info) {  // not replaced meanwhile or reused by a diff
+            deferredFiles_.emplace(info.get(), info);
+        }
+    }
+}
+
+void Folder::resolveContentType(const std::shared_ptr<const FileInfo>& file) {
+    auto deferred = deferredFiles_.find(file.get());
+    if (deferred == deferredFiles_.end()) {
+        return;
+    }
+    deferredFiles_.erase(deferred);
+    // a full query sniffs the content; the result comes through filesChanged()
+    std::lock_guard<std::mutex> lock{pathsMutex_};
+    eventFileChanged(file->path());
+}
+
 #if 0
 
 
@@ -656,6 +1011,88 @@ void free_dirlist_job(FmFolder* folder) {
 
 #endif
 
+void Folder::watchSubdirs(const FileInfoList& files) {
+    // without any watch, as on a filesystem out of inotify watches, the folder is not watched at all
+    if (!recursive_ || treeWatched_ || !dirWatch_) {
+        return;
+    }
+    for (const auto& info : files) {
+        if (info->isDir() && !info->isSymlink() && !info->isHidden()) {
+            auto& watch = subdirWatches_[info->path()];
+            if (!watch) {
+                watch = FileMonitor::globalInstance()->watchDirectory(
+                    info->path(), [this](const FilePath& path, GFileMonitorEvent evt) { onFileChanged(path, evt); });
+            }
+        }
+    }
+}
+
+void Folder::listSubtree(const FilePath& dir) {
+    auto job = new DirListJob(dir, DirListJob::Flags(DirListJob::DETAILED | DirListJob::RECURSIVE));
+    job->setAutoDelete(true);
+    job->setFileInfoPool(fileInfoPool_);
+    connect(job, &DirListJob::finished, this, &Folder::onSubtreeListed, Qt::BlockingQueuedConnection);
+    subtreeJobs_.push_back(job);
+    JobScheduler::globalInstance()->start(job, JobScheduler::Priority::Interactive, dir);
+}
+
+void Folder::onSubtreeListed() {
+    DirListJob* job = static_cast<DirListJob*>(sender());
+    auto it = std::find(subtreeJobs_.begin(), subtreeJobs_.end(), job);
+    if (it == subtreeJobs_.end()) {  // from before a reload
+        return;
+    }
+    subtreeJobs_.erase(it);
+    if (job->isCancelled()) {
+        return;
+    }
+    FileInfoList files_to_add;
+    std::vector<FileInfoPair> files_to_update;
+    std::unique_lock<std::shared_mutex> filesLock{filesMutex_};
+    for (const auto& info : job->files()) {
+        auto& file = files_[fileKey(info->path())];
+        if (file) {  // reported by the file monitor meanwhile
+            files_to_update.push_back(std::make_pair(file, info));
+        }
+        else {
+            files_to_add.push_back(info);
+        }
+        file = info;
+    }
+    filesLock.unlock();
+    watchSubdirs(job->files());
+    addDeferredFiles(job);
+    if (!files_to_add.empty()) {
+        Q_EMIT filesAdded(files_to_add);
+    }
+    if (!files_to_update.empty()) {
+        Q_EMIT filesChanged(files_to_update);
+    }
+    Q_EMIT contentChanged();
+}
+
+void Folder::removeSubtree(const std::shared_ptr<const FileInfo>& dir, FileInfoList& removed) {
+    const std::string prefix = fileKey(dir->path()) + '/';
+    for (auto it = files_.begin(); it != files_.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            deferredFiles_.erase(it->second.get());
+            removed.push_back(it->second);
+            it = files_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    for (auto it = subdirWatches_.begin(); it != subdirWatches_.end();) {
+        if (dir->path() == it->first || dir->path().isPrefixOf(it->first)) {
+            it = subdirWatches_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
 void Folder::reload() {
     if (dirlist_job) {
         dirlist_job->cancel();
@@ -676,6 +1113,56 @@ void Folder::reload() {
     }
 }
 
+void Folder::revalidate() {
+    if (dirlist_job) {
+        // a prefetched listing that has not started yet is wanted now
+        if (listingPriority_ != JobScheduler::Priority::Interactive) {
+            listingPriority_ = JobScheduler::Priority::Interactive;
+            JobScheduler::globalInstance()->promote(dirlist_job, listingPriority_);
+        }
+        return;
+    }
+    if (hasFileMonitor() || validating_) {
+        return;
+    }
+    if (!dirInfo_ || !sinceListed_.isValid() || sinceListed_.hasExpired(kMaxListingAge)) {
+        reload();
+        return;
+    }
+    if (!sinceListed_.hasExpired(kFreshListingAge)) {
+        return;
+    }
+
+    // one query of the directory instead of listing it again
+    struct ValidateData {
+        QPointer<Folder> folder;
+        GFilePtr gf;
+    };
+    validating_ = true;
+    ValidateData* data = new ValidateData{this, dirPath_.gfile()};
+    g_file_query_info_async(
+        data->gf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED, G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT, nullptr,
+        [](GObject* /*source_object*/, GAsyncResult* res, gpointer user_data) {
+            ValidateData* data = reinterpret_cast<ValidateData*>(user_data);
+            GFileInfoPtr inf{g_file_query_info_finish(data->gf.get(), res, nullptr), false};
+            if (Folder* _this = data->folder.data()) {
+                _this->validating_ = false;
+                if (_this->dirlist_job == nullptr) {  // not reloaded meanwhile
+                    if (inf && _this->dirInfo_ &&
+                        g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED) ==
+                            _this->dirInfo_->mtime()) {
+                        _this->sinceListed_.start();
+                    }
+                    else {
+                        _this->reload();
+                    }
+                }
+            }
+            delete data;
+        },
+        data);
+}
+
 void Folder::reallyReload() {
     // cancel in-progress jobs if there are any
     if (dirlist_job) {
@@ -687,14 +1174,20 @@ void Folder::reallyReload() {
         g_signal_handlers_disconnect_by_data(dirMonitor_.get(), this);
         dirMonitor_.reset();
     }
+    dirWatch_.reset();
+    subdirWatches_.clear();
+    for (auto job : subtreeJobs_) {
+        job->cancel();
+        disconnect(job, &DirListJob::finished, this, &Folder::onSubtreeListed);
+    }
+    subtreeJobs_.clear();
 
     /* clear all update-lists now, see SF bug #919 - if update comes before
        listing job is finished, a duplicate may be created in the folder */
     if (has_idle_update_handler) {
         // FIXME: cancel the idle handler
-        paths_to_add.clear();
-        paths_to_update.clear();
-        paths_to_del.clear();
+        std::lock_guard<std::mutex> lock{pathsMutex_};
+        queuedPaths_.clear();
 
         // cancel any file info job in progress.
         for (auto job : fileinfoJobs_) {
@@ -707,45 +1200,91 @@ void Folder::reallyReload() {
         has_idle_update_handler = false;
     }
 
-    /* remove all existing files */
-    if (!files_.empty()) {
-        // FIXME: this is not very efficient :(
-        auto tmp = files();
-        files_.clear();
-        Q_EMIT filesRemoved(tmp);
+    /* also re-create a new file monitor, before a listing is borrowed, so that nothing changed
+     * after the other process wrote it is missed */
+    // mon = GFileMonitorPtr{fm_monitor_directory(dir_path.gfile().get(), &err), false};
+    // local folders share one inotify descriptor, and one watch per directory, with every other user;
+    // a recursive one is watched as a whole where fanotify allows, or else by each of its directories
+    auto onChanged = [this](const FilePath& path, GFileMonitorEvent evt) { onFileChanged(path, evt); };
+    dirWatch_ = recursive_ ? FileMonitor::globalInstance()->watchTree(dirPath_, onChanged) : nullptr;
+    treeWatched_ = dirWatch_ != nullptr;
+    if (!dirWatch_) {
+        dirWatch_ = FileMonitor::globalInstance()->watchDirectory(dirPath_, onChanged);
+    }
+    if (!dirWatch_) {
+        // FIXME: should we make this cancellable?
+        dirMonitor_ = GFileMonitorPtr{
+            g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err), false};
+
+        if (dirMonitor_) {
+            g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
+        }
+        else {
+            qDebug("file monitor cannot be created: %s", err->message);
+            g_error_free(err);
+        }
     }
 
-    /* Tell the world that we're about to reload the folder.
-     * It might be a good idea for users of the folder to disconnect
-     * from the folder temporarily and reconnect to it again after
-     * the folder complete the loading. This might reduce some
-     * unnecessary signal handling and UI updates. */
-    Q_EMIT startLoading();
-
-    dirInfo_.reset();  // clear dir info
-
-    /* also re-create a new file monitor */
-    // mon = GFileMonitorPtr{fm_monitor_directory(dir_path.gfile().get(), &err), false};
-    // FIXME: should we make this cancellable?
-    dirMonitor_ = GFileMonitorPtr{
-        g_file_monitor_directory(dirPath_.gfile().get(), G_FILE_MONITOR_WATCH_MOUNTS, nullptr, &err), false};
+    /* A folder that is already listed keeps its files while the new listing runs; when it
+     * finishes, only the differences are emitted. Views then keep their items, selection and
+     * thumbnails. Search results cannot be diffed and are always listed from scratch. A folder
+     * that is not listed yet may be shown from the snapshot of its last listing meanwhile. A
+     * folder whose listing another process lends is not listed at all. */
+    listingTimer_.start();
+    const bool shared = loadShared();
+    if (!shared && files_.empty()) {
+        loadSnapshot();
+    }
+    diffReload_ = !files_.empty() && !dirPath_.hasUriScheme("search");
+    if (!diffReload_) {
+        deferredFiles_.clear();
+        /* remove all existing files */
+        if (!files_.empty()) {
+            auto tmp = files();
+            {
+                std::lock_guard<std::shared_mutex> filesLock{filesMutex_};
+                files_.clear();
+            }
+            Q_EMIT filesRemoved(tmp);
+        }
 
-    if (dirMonitor_) {
-        g_signal_connect(dirMonitor_.get(), "changed", G_CALLBACK(_onFileChangeEvents), this);
+        /* Tell the world that we're about to reload the folder.
+         * It might be a good idea for users of the folder to disconnect
+         * from the folder temporarily and reconnect to it again after
+         * the folder complete the loading. This might reduce some
+         * unnecessary signal handling and UI updates. A borrowed listing
+         * has told them already. */
+        if (!shared) {
+            Q_EMIT startLoading();
+        }
     }
-    else {
-        qDebug("file monitor cannot be created: %s", err->message);
-        g_error_free(err);
+
+    if (!shared) {
+        dirInfo_.reset();  // clear dir info
     }
 
     Q_EMIT contentChanged();
 
+    if (shared) {  // the monitor keeps it up to date from now on
+        diffReload_ = false;
+        Q_EMIT finishLoading();
+        queryFilesystemInfo();
+        return;
+    }
+    sharedGeneration_ = 0;
+
     /* run a new dir listing job */
     // FIXME:
     // defer_content_test = fm_config->defer_content_test;
-    dirlist_job = new DirListJob(dirPath_, defer_content_test ? DirListJob::FAST : DirListJob::DETAILED);
+    dirlist_job = new DirListJob(dirPath_, static_cast<DirListJob::Flags>(
+                                               (defer_content_test ? DirListJob::FAST : DirListJob::DETAILED) |
+                                               (recursive_ ? DirListJob::RECURSIVE : 0)));
     dirlist_job->setAutoDelete(true);
+    dirlist_job->setFileInfoPool(fileInfoPool_);
+    // a diffed reload needs the whole listing at once, so only fresh listings are streamed
+    dirlist_job->setIncremental(wants_incremental && !diffReload_);
     connect(dirlist_job, &DirListJob::error, this, &Folder::error, Qt::BlockingQueuedConnection);
+    connect(dirlist_job, &DirListJob::filesFound, this, &Folder::onDirListFilesFound, Qt::BlockingQueuedConnection);
     connect(dirlist_job, &DirListJob::finished, this, &Folder::onDirListFinished, Qt::BlockingQueuedConnection);
 
 #if 0
@@ -755,7 +1294,7 @@ void Folder::reallyReload() {
     fm_dir_list_job_set_incremental(dirlist_job, wants_incremental);
 #endif
 
-    dirlist_job->runAsync();
+    JobScheduler::globalInstance()->start(dirlist_job, listingPriority_, dirPath_);
 
     /* also reload filesystem info.
      * FIXME: is this needed? */
@@ -804,32 +1343,22 @@ bool Folder::getFilesystemInfo(uint64_t* total_size, uint64_t* free_size) const
     return false;
 }
 
-void Folder::onFileSystemInfoFinished() {
-    FileSystemInfoJob* job = static_cast<FileSystemInfoJob*>(sender());
-    if (job->isCancelled() || job != fsInfoJob_) {  // this is a cancelled job, ignore!
-        fsInfoJob_ = nullptr;
-        has_fs_info = false;
-        return;
-    }
-    has_fs_info = job->isAvailable();
-    fs_total_size = job->size();
-    fs_free_size = job->freeSize();
+void Folder::onFileSystemInfoFinished(const FileSystemInfoCache::Info& info) {
+    fsInfoQueryPending_ = false;
+    has_fs_info = info.isAvailable;
+    fs_total_size = info.size;
+    fs_free_size = info.freeSize;
     filesystem_info_pending = true;
-    fsInfoJob_ = nullptr;
     queueUpdate();
 }
 
-void Folder::queryFilesystemInfo() {
-    // G_LOCK(query);
-    if (fsInfoJob_)
+void Folder::queryFilesystemInfo(bool refresh) {
+    // the folders on a filesystem share its queries and their results
+    if (fsInfoQueryPending_)
         return;
-    fsInfoJob_ = new FileSystemInfoJob{dirPath_};
-    fsInfoJob_->setAutoDelete(true);
-    connect(fsInfoJob_, &FileSystemInfoJob::finished, this, &Folder::onFileSystemInfoFinished,
-            Qt::BlockingQueuedConnection);
-
-    fsInfoJob_->runAsync();
-    // G_UNLOCK(query);
+    fsInfoQueryPending_ = true;
+    fsInfoCache_->query(
+        dirPath_, this, [this](const FileSystemInfoCache::Info& info) { onFileSystemInfoFinished(info); }, refresh);
 }
 
 #if 0
@@ -946,8 +1475,8 @@ void Folder::onMountRemoved(const Mount& mnt) {
      * GFileMonitor does not support remote filesystems at all.
      * So here is the side effect, no unmount notifications.
      * We need to generate the signal ourselves. */
-    if (!dirMonitor_) {
-        // this is only needed when we don't have a GFileMonitor
+    if (!hasFileMonitor()) {
+        // this is only needed when we don't have a file monitor
         auto mountRoot = mnt.root();
         if (mountRoot.isPrefixOf(dirPath_)) {
             // if the current folder is under the unmounted path, generate the event ourselves
@@ -23,25 +23,32 @@
 #include <gio/gio.h>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
 #include <functional>
 
+#include <QElapsedTimer>
 #include <QObject>
+#include <QTimer>
 #include <QtGlobal>
 #include "../libfmqtglobals.h"
 
 #include "gioptrs.h"
 #include "fileinfo.h"
+#include "filemonitor.h"
 #include "job.h"
+#include "jobscheduler.h"
 #include "volumemanager.h"
+#include "filesysteminfocache.h"
 
 namespace Fm {
 
 class DirListJob;
-class FileSystemInfoJob;
 class FileInfoJob;
+class FileInfoPool;
 
 class LIBFM_QT_API Folder : public QObject {
     Q_OBJECT
@@ -56,20 +63,49 @@ class LIBFM_QT_API Folder : public QObject {
 
     static std::shared_ptr<Folder> findByPath(const FilePath& path);
 
+    // Like fromPath(), but a new folder is listed at a low priority, ahead of the user.
+    static std::shared_ptr<Folder> prefetch(const FilePath& path);
+
+    // A flat view of a local folder: its files and those of all its subfolders, listed by
+    // several threads at once (see DirListJob::RECURSIVE) and watched as a whole. The files of
+    // such a folder are keyed by their paths relative to it rather than by their names. Other
+    // folders are only listed themselves. Kept apart from the folders of fromPath().
+    static std::shared_ptr<Folder> fromPathRecursive(const FilePath& path);
+
+    bool isRecursive() const { return recursive_; }
+
     bool makeDirectory(const char* name, GError** error);
 
-    void queryFilesystemInfo();
+    // |refresh| asks the filesystem again even when a recent result is cached
+    void queryFilesystemInfo(bool refresh = false);
 
     bool getFilesystemInfo(uint64_t* total_size, uint64_t* free_size) const;
 
     void reload();
 
+    // Brings a folder that is shown again up to date. A watched folder already is. The listing
+    // of one that cannot be watched, as on sftp:// or smb://, is trusted for a few seconds,
+    // then checked against the modification time of the directory, and listed again when that
+    // changed or the listing is a few minutes old. The old listing is shown meanwhile.
+    void revalidate();
+
+    // A folder none of whose views is shown, as in background tabs and minimized windows,
+    // handles the changes its monitor reports in batches, every few seconds on a coarse timer.
+    // |viewer| tells whether it shows the folder; a folder no viewer told about counts as shown.
+    void setShownBy(const void* viewer, bool shown);
+
+    // |viewer| no longer views the folder.
+    void removeViewer(const void* viewer);
+
+    bool isShown() const;
+
     bool isIncremental() const;
 
     bool isValid() const;
 
     bool isLoaded() const;
 
+    // |name| is the path relative to the folder for a recursive one
     std::shared_ptr<const FileInfo> fileByName(const char* name) const;
 
     bool isEmpty() const;
@@ -78,14 +114,24 @@ class LIBFM_QT_API Folder : public QObject {
 
     FileInfoList files() const;
 
+    // If |file| was listed with a content type guessed from its name alone, queues it for a
+    // full query that sniffs its content; the result is reported by filesChanged(). Views call
+    // this for the files they show, so only those are ever opened.
+    void resolveContentType(const std::shared_ptr<const FileInfo>& file);
+
+    // Whether the content type of |file| is still the guess resolveContentType() would check.
+    bool isContentTypeGuessed(const FileInfo& file) const;
+
     const FilePath& path() const;
 
     const std::shared_ptr<const FileInfo>& info() const;
 
+    // Calls |func| on a snapshot of the files, without holding any lock, so it may take its time
+    // or use the folder without blocking other threads.
     void forEachFile(std::function<void(const std::shared_ptr<const FileInfo>&)> func) const {
-        std::lock_guard<std::mutex> lock{mutex_};
-        for (auto it = files_.begin(); it != files_.end(); ++it) {
-            func(it->second);
+        const FileInfoList snapshot = files();
+        for (const auto& file : snapshot) {
+            func(file);
         }
     }
 
@@ -116,6 +162,8 @@ class LIBFM_QT_API Folder : public QObject {
     void error(const GErrorPtr& err, Job::ErrorSeverity severity, Job::ErrorAction& response);
 
    private:
+    static std::shared_ptr<Folder> fromPath(const FilePath& path, JobScheduler::Priority priority);
+
     static void _onFileChangeEvents(GFileMonitor* monitor,
                                     GFile* file,
                                     GFile* other_file,
@@ -124,11 +172,33 @@ class LIBFM_QT_API Folder : public QObject {
         _this->onFileChangeEvents(monitor, file, other_file, event_type);
     }
     void onFileChangeEvents(GFileMonitor* monitor, GFile* file, GFile* other_file, GFileMonitorEvent event_type);
+    void onFileChanged(const FilePath& path, GFileMonitorEvent event_type);
     void onDirChanged(GFileMonitorEvent event_type);
 
     void queueUpdate();
+    // starts |updateTimer_|, with a longer delay while the folder is not shown
+    void scheduleUpdate();
     void queueReload();
 
+    // the key of a file of the folder in files_
+    std::string fileKey(const FilePath& path) const;
+
+    // Watches the directories among |files| of a recursive folder, unless dirWatch_ covers
+    // the whole tree already.
+    void watchSubdirs(const FileInfoList& files);
+    // Lists a directory that appeared below a recursive folder, with everything inside it.
+    void listSubtree(const FilePath& dir);
+    // Removes what was below a directory gone from a recursive folder; filesMutex_ is held.
+    void removeSubtree(const std::shared_ptr<const FileInfo>& dir, FileInfoList& removed);
+    // Shows the snapshot of the last listing while the folder is listed again, see ListingSnapshot.
+    bool loadSnapshot();
+    void saveSnapshot();
+
+    // Takes the listing of the folder from the service of another process, if there is one,
+    // see SharedListingClient: all of it for a folder without files, or what changed since
+    // it was last taken. Returns false if the folder is to be listed here.
+    bool loadShared();
+
     bool eventFileAdded(const FilePath& path);
     bool eventFileChanged(const FilePath& path);
     void eventFileDeleted(const FilePath& path);
@@ -139,9 +209,15 @@ class LIBFM_QT_API Folder : public QObject {
 
     void processPendingChanges();
 
+    void onDirListFilesFound(const FileInfoList& foundFiles);
+
     void onDirListFinished();
 
-    void onFileSystemInfoFinished();
+    void onSubtreeListed();
+
+    void addDeferredFiles(const DirListJob* job);
+
+    void onFileSystemInfoFinished(const FileSystemInfoCache::Info& info);
 
     void onFileInfoFinished();
 
@@ -154,32 +230,63 @@ class LIBFM_QT_API Folder : public QObject {
    private:
     FilePath dirPath_;
     GFileMonitorPtr dirMonitor_;
+    std::unique_ptr<FileMonitor::Watch> dirWatch_;  // used instead of dirMonitor_ for local folders
+    // of a recursive folder: whether dirWatch_ covers the whole tree, and otherwise the watches
+    // of its subdirectories
+    bool recursive_;
+    bool treeWatched_;
+    std::unordered_map<FilePath, std::unique_ptr<FileMonitor::Watch>, FilePathHash> subdirWatches_;
+    std::vector<DirListJob*> subtreeJobs_;  // listings of directories added to a recursive folder
 
     std::shared_ptr<const FileInfo> dirInfo_;
+    std::shared_ptr<FileInfoPool> fileInfoPool_;  // what the listed files are allocated from
     DirListJob* dirlist_job;
     std::vector<FileInfoJob*> fileinfoJobs_;
-    FileSystemInfoJob* fsInfoJob_;
+    bool fsInfoQueryPending_;
 
     std::shared_ptr<VolumeManager> volumeManager_;
+    std::shared_ptr<FileSystemInfoCache> fsInfoCache_;
 
     /* for file monitor */
     bool has_idle_reload_handler;
     bool has_idle_update_handler;
-    FilePathList paths_to_add;
-    FilePathList paths_to_update;
-    FilePathList paths_to_del;
+    // what each changed path is queued for; a path is listed once however many events it gets
+    enum : unsigned char { QueuedAdd = 1, QueuedUpdate = 2, QueuedDel = 4 };
+    std::unordered_map<FilePath, unsigned char, FilePathHash> queuedPaths_;
+    // monitor events since the queued changes were last processed, and the delay before the
+    // next processing, which grows while the folder keeps changing, see processPendingChanges()
+    std::size_t queuedEvents_;
+    int updateDelay_;
+    QTimer updateTimer_;                             // runs processPendingChanges()
+    std::unordered_map<const void*, bool> viewers_;  // whether each shows the folder
     // GSList* pending_jobs;
     bool pending_change_notify;
     bool filesystem_info_pending;
 
+    // of the running listing, and the time since the last one finished
+    JobScheduler::Priority listingPriority_;
+    QElapsedTimer sinceListed_;
+    bool validating_;  // the directory is being queried by revalidate()
+
     bool wants_incremental;
+    bool diffReload_;             // the running listing is diffed against files_ rather than added to it
+    bool fromSnapshot_;           // files_ holds a snapshot the running listing has not replaced yet
+    quint64 sharedGeneration_;    // of the shared listing files_ was last brought up to, or 0
+    QElapsedTimer listingTimer_;  // since the running listing started
     bool stop_emission; /* don't set it 1 bit to not lock other bits */
 
     // NOTE: Here, FileInfo::path().baseName().get() should be used as the key value, not FileInfo::name(),
     // because the latter is not always the same as the former and the former will be used for comparison.
     std::unordered_map<std::string, std::shared_ptr<const FileInfo>> files_;
-
-    /* filesystem info - set in query thread, read in main */
+    // files_ is only modified in the main thread, which locks this exclusively for that; other
+    // threads read files_ with it shared. Signals are never emitted with it held.
+    mutable std::shared_mutex filesMutex_;
+    // listed files whose content type is still a guess, see resolveContentType()
+    std::unordered_map<const FileInfo*, std::shared_ptr<const FileInfo>> deferredFiles_;
+    // guards queuedPaths_ and queuedEvents_
+    std::mutex pathsMutex_;
+
+    /* filesystem info - only used in the main thread */
     uint64_t fs_total_size;
     uint64_t fs_free_size;
     GCancellablePtr fs_size_cancellable;
@@ -188,7 +295,8 @@ class LIBFM_QT_API Folder : public QObject {
     bool defer_content_test : 1;
 
     static std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> cache_;
-    static std::mutex mutex_;
+    static std::unordered_map<FilePath, std::weak_ptr<Folder>, FilePathHash> recursiveCache_;
+    static std::mutex cacheMutex_;  // guards cache_ and recursiveCache_ only
 };
 
 }  // namespace Fm
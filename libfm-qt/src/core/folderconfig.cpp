@@ -16,16 +16,121 @@
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <QTimer>
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace Fm {
 
-CStrPtr FolderConfig::globalConfigFile_;
+namespace {
+
+// changes are written out together, this long after the first one
+constexpr int kSaveDelay = 2000;
+
+// when more answers of FolderConfig::inheritedPath() are remembered, they are all forgotten
+constexpr std::size_t kMaxInheritedPaths = 4096;
+
+// A group of the global config file. It is kept as the text it was read from until a
+// FolderConfig opens it, and then parsed into a key file of its own.
+struct StoredGroup {
+    std::string text;
+    GKeyFile* keyFile = nullptr;
+    int users = 0;  // of |keyFile|
+};
+
+// The global config file, split by group name. Reading it only looks for the group headers, and
+// writing it copies the groups that were never opened as they were read.
+struct Store {
+    std::string header;  // what comes before the first group
+    std::unordered_map<std::string, StoredGroup> groups;
+    bool changed = false;
+    bool savePending = false;
+};
+
+bool readStore(Store& store, const char* fileName) {
+    char* data;
+    gsize len;
+    if (!g_file_get_contents(fileName, &data, &len, nullptr)) {
+        return false;
+    }
+    std::string* out = &store.header;
+    const char* end = data + len;
+    for (const char* p = data; p < end;) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* next = eol ? eol + 1 : end;
+        const char* s = p;
+        while (s < next && (*s == ' ' || *s == '\t')) {
+            ++s;
+        }
+        if (s < next && *s == '[') {
+            // like GKeyFile, the name ends at the last bracket of the line
+            const char* close = static_cast<const char*>(memrchr(s, ']', next - s));
+            if (close) {
+                out = &store.groups[std::string(s + 1, close)].text;
+            }
+        }
+        out->append(p, next);
+        if (!eol) {
+            out->push_back('\n');
+        }
+        p = next;
+    }
+    g_free(data);
+    return true;
+}
 
-// FIXME: sharing the same keyfile object everywhere is problematic
 // FIXME: this is MT-unsafe
-static GKeyFile* fc_cache = nullptr;
-static bool fc_cache_changed = false;
+Store* fc_store = nullptr;
+
+// the nearest recursively customized folder at or above a folder
+std::unordered_map<FilePath, FilePath, FilePathHash> fc_recursive;
+
+GKeyFile* openStoredGroup(const char* name) {
+    StoredGroup& group = fc_store->groups[name];
+    if (!group.keyFile) {
+        group.keyFile = g_key_file_new();
+        if (!group.text.empty()) {
+            g_key_file_load_from_data(group.keyFile, group.text.data(), group.text.size(), G_KEY_FILE_NONE, nullptr);
+            std::string().swap(group.text);
+        }
+    }
+    ++group.users;
+    return group.keyFile;
+}
+
+void closeStoredGroup(const char* name) {
+    auto it = fc_store->groups.find(name);
+    if (it == fc_store->groups.end()) {
+        return;
+    }
+    StoredGroup& group = it->second;
+    // drop what was only opened to be looked at, or was purged
+    if (--group.users == 0 && !g_key_file_has_group(group.keyFile, name)) {
+        g_key_file_free(group.keyFile);
+        fc_store->groups.erase(it);
+    }
+}
+
+void scheduleSave() {
+    fc_store->changed = true;
+    if (!fc_store->savePending) {
+        fc_store->savePending = true;
+        QTimer::singleShot(kSaveDelay, [] {
+            if (fc_store) {
+                fc_store->savePending = false;
+                FolderConfig::saveCache();
+            }
+        });
+    }
+}
+
+}  // namespace
+
+CStrPtr FolderConfig::globalConfigFile_;
 
 FolderConfig::FolderConfig() : keyFile_{nullptr}, changed_{false} {}
 
@@ -70,9 +175,10 @@ bool FolderConfig::open(const Fm::FilePath& path) {
     configFilePath_.reset();
     group_ = path.toString();
 
-    // FIXME: we should use ref counting here. glib 2.36+ supports g_key_file_ref()
-    keyFile_ = fc_cache;
-    return true;
+    if (fc_store) {
+        keyFile_ = openStoredGroup(group_.get());
+    }
+    return isOpened();
 }
 
 bool FolderConfig::close(GErrorPtr& err) {
@@ -96,10 +202,14 @@ bool FolderConfig::close(GErrorPtr& err) {
         g_key_file_free(keyFile_);
     }
     else {
-        group_.reset();
         if (changed_) {
-            fc_cache_changed = true;
+            scheduleSave();
         }
+        closeStoredGroup(group_.get());
+        group_.reset();
+    }
+    if (changed_) {
+        fc_recursive.clear();
     }
     keyFile_ = nullptr;
     return ret;
@@ -245,44 +355,99 @@ void FolderConfig::purge() {
 }
 
 // static
-void FolderConfig::saveCache(void) {
-    char* out;
-    gsize len;
+FilePath FolderConfig::inheritedPath(const FilePath& path) {
+    if (path.isParentOf(path)) {  // WARNING: menu://applications/ is its own parent
+        return FilePath();
+    }
+    if (fc_recursive.size() > kMaxInheritedPaths) {
+        fc_recursive.clear();
+    }
+    // go up until a folder that is recursively customized, or whose answer is known
+    std::vector<FilePath> walked;
+    FilePath found;
+    for (FilePath dir = path.parent(); dir.isValid(); dir = dir.parent()) {
+        auto it = fc_recursive.find(dir);
+        if (it != fc_recursive.end()) {
+            found = it->second;
+            break;
+        }
+        walked.push_back(dir);
+        FolderConfig cfg(dir);
+        bool recursive;
+        if (!cfg.isEmpty() && cfg.getBoolean("Recursive", &recursive) && recursive) {
+            found = dir;
+            break;
+        }
+        if (dir.isParentOf(dir)) {
+            break;
+        }
+    }
+    for (const auto& dir : walked) {
+        fc_recursive[dir] = found;
+    }
+    return found;
+}
 
+// static
+void FolderConfig::saveCache(void) {
     /* if per-directory cache was changed since last invocation then save it */
-    if (fc_cache_changed && (out = g_key_file_to_data(fc_cache, &len, nullptr))) {
-        /* FIXME: create dir */
-        /* create temp file with settings */
-        GFilePtr gfile{g_file_new_for_path(globalConfigFile_.get()), false};
-        GErrorPtr err;
-        /* do safe replace now, the file is important enough to be lost */
-        if (g_file_replace_contents(gfile.get(), out, len, nullptr, true, G_FILE_CREATE_PRIVATE, nullptr, nullptr,
-                                    &err)) {
-            fc_cache_changed = false;
+    if (!fc_store || !fc_store->changed) {
+        return;
+    }
+    std::vector<const std::string*> names;
+    names.reserve(fc_store->groups.size());
+    for (const auto& group : fc_store->groups) {
+        names.push_back(&group.first);
+    }
+    std::sort(names.begin(), names.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+    std::string out = fc_store->header;
+    for (const std::string* name : names) {
+        const StoredGroup& group = fc_store->groups.at(*name);
+        if (!group.keyFile) {
+            out += group.text;
         }
-        else {
-            g_warning("cannot save %s: %s", globalConfigFile_.get(), err->message);
+        else if (g_key_file_has_group(group.keyFile, name->c_str())) {
+            gsize len;
+            char* data = g_key_file_to_data(group.keyFile, &len, nullptr);
+            out.append(data, len);
+            g_free(data);
         }
-        g_free(out);
+    }
+    /* FIXME: create dir */
+    GFilePtr gfile{g_file_new_for_path(globalConfigFile_.get()), false};
+    GErrorPtr err;
+    /* do safe replace now, the file is important enough to be lost */
+    if (g_file_replace_contents(gfile.get(), out.data(), out.size(), nullptr, true, G_FILE_CREATE_PRIVATE, nullptr,
+                                nullptr, &err)) {
+        fc_store->changed = false;
+    }
+    else {
+        g_warning("cannot save %s: %s", globalConfigFile_.get(), err->message);
     }
 }
 
 // static
 void FolderConfig::finalize(void) {
     saveCache();
-    g_key_file_free(fc_cache);
-    fc_cache = nullptr;
+    for (auto& group : fc_store->groups) {
+        if (group.second.keyFile) {
+            g_key_file_free(group.second.keyFile);
+        }
+    }
+    delete fc_store;
+    fc_store = nullptr;
+    fc_recursive.clear();
 }
 
 // static
 void FolderConfig::init(const char* globalConfigFile) {
     globalConfigFile_ = CStrPtr{g_strdup(globalConfigFile)};
-    fc_cache = g_key_file_new();
-    if (!g_key_file_load_from_file(fc_cache, globalConfigFile_.get(), G_KEY_FILE_NONE, nullptr)) {
+    fc_store = new Store();
+    if (!readStore(*fc_store, globalConfigFile_.get())) {
         // fail to load the config file.
         // fallback to the legacy libfm config file for backward compatibility
         CStrPtr legacyConfigFile{g_build_filename(g_get_user_config_dir(), "libfm/dir-settings.conf", nullptr)};
-        g_key_file_load_from_file(fc_cache, legacyConfigFile.get(), G_KEY_FILE_NONE, nullptr);
+        readStore(*fc_store, legacyConfigFile.get());
     }
 }
 
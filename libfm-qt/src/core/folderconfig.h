@@ -61,6 +61,11 @@ class LIBFM_QT_API FolderConfig {
 
     static void saveCache(void);
 
+    // Returns the nearest folder above |path| whose settings are recursive, or an invalid path.
+    // The answers are remembered until a setting changes, so that looking up the folders below
+    // the same parent again only goes up to it.
+    static FilePath inheritedPath(const FilePath& path);
+
     // the object cannot be copied.
    private:
     FolderConfig(const FolderConfig& other) = delete;
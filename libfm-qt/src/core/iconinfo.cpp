@@ -1,11 +1,11 @@
 #include "iconinfo.h"
 #include "iconinfo_p.h"
+#include "iconpathindex.h"
 #include <cstring>
 
 namespace Fm {
 
-std::unordered_map<GIcon*, std::shared_ptr<IconInfo>, IconInfo::GIconHash, IconInfo::GIconEqual> IconInfo::cache_;
-std::mutex IconInfo::mutex_;
+ShardedCache<GIcon*, std::shared_ptr<IconInfo>, IconInfo::GIconHash, IconInfo::GIconEqual> IconInfo::cache_;
 QList<QIcon> IconInfo::fallbackQicons_;
 
 static const char* fallbackIconNames[] = {"unknown", "application-octet-stream", "application-x-generic",
@@ -34,25 +34,24 @@ std::shared_ptr<const IconInfo> IconInfo::fromName(const char* name) {
 // static
 std::shared_ptr<const IconInfo> IconInfo::fromGIcon(GIconPtr gicon) {
     if (Q_LIKELY(gicon)) {
-        std::lock_guard<std::mutex> lock{mutex_};
-        auto it = cache_.find(gicon.get());
-        if (it != cache_.end()) {
-            return it->second;
+        if (auto cached = cache_.find(gicon.get())) {
+            return cached;
         }
         // not found in the cache, create a new entry for it.
         auto icon = std::make_shared<IconInfo>(std::move(gicon));
-        cache_.insert(std::make_pair(icon->gicon_.get(), icon));
-        return icon;
+        return cache_.insert(icon->gicon_.get(), icon);
     }
     return std::shared_ptr<const IconInfo>{};
 }
 
+int64_t IconInfo::cacheMemory() {
+    // each entry of the cache with its node and shared_ptr control block
+    constexpr int64_t entryBytes = sizeof(IconInfo) + 64;
+    return static_cast<int64_t>(cache_.size()) * entryBytes;
+}
+
 void IconInfo::updateQIcons() {
-    std::lock_guard<std::mutex> lock{mutex_};
-    for (auto& elem : cache_) {
-        auto& info = elem.second;
-        info->internalQicons_.clear();
-    }
+    cache_.forEach([](const std::shared_ptr<IconInfo>& info) { info->internalQicons_.clear(); });
 }
 
 QIcon IconInfo::qicon() const {
@@ -69,10 +68,14 @@ QIcon IconInfo::qicon() const {
 
 QList<QIcon> IconInfo::qiconsFromNames(const char* const* names) {
     QList<QIcon> icons;
-    // qDebug("names: %p", names);
+    auto index = IconPathIndex::globalInstance();
     for (const gchar* const* name = names; *name; ++name) {
-        // qDebug("icon name=%s", *name);
-        icons.push_back(QIcon::fromTheme(QString::fromUtf8(*name)));
+        // the index knows the files of the theme without looking through its directories
+        QIcon icon;
+        if (!index->lookup(*name, icon)) {
+            icon = QIcon::fromTheme(QString::fromUtf8(*name));
+        }
+        icons.push_back(icon);
     }
     return icons;
 }
@@ -32,6 +32,7 @@
 #include <unordered_map>
 #include <forward_list>
 #include <QIcon>
+#include "shardedcache.h"
 
 namespace Fm {
 
@@ -55,6 +56,9 @@ class LIBFM_QT_API IconInfo : public std::enable_shared_from_this<IconInfo> {
 
     static void updateQIcons();
 
+    // A rough estimate of the bytes held by the icons cached, not counting their pixmaps.
+    static int64_t cacheMemory();
+
     GIconPtr gicon() const { return gicon_; }
 
     QIcon qicon() const;
@@ -84,8 +88,7 @@ class LIBFM_QT_API IconInfo : public std::enable_shared_from_this<IconInfo> {
     mutable QIcon qicon_;
     mutable QList<QIcon> internalQicons_;
 
-    static std::unordered_map<GIcon*, std::shared_ptr<IconInfo>, GIconHash, GIconEqual> cache_;
-    static std::mutex mutex_;
+    static ShardedCache<GIcon*, std::shared_ptr<IconInfo>, GIconHash, GIconEqual> cache_;
     static QList<QIcon> fallbackQicons_;
 };
 
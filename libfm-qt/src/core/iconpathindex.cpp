@@ -0,0 +1,579 @@
+#include "iconpathindex.h"
+#include "cstrptr.h"
+#include <QApplication>
+#include <QFile>
+#include <QIconEngine>
+#include <QImageReader>
+#include <QPainter>
+#include <QPixmapCache>
+#include <QStyle>
+#include <QStyleOption>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'M', 'I', 'C', 'O', 'N', 'S', '1'};
+constexpr char kSuffix[] = ".icons";
+
+// an entry drawn from an SVG at any size
+constexpr std::uint32_t kScalable = 1 << 0;
+
+// The icons of the common file types and places, rendered at the pixmap sizes when the
+// theme only has them as SVGs.
+constexpr const char* kCommonIcons[] = {
+    "folder", "folder-documents", "folder-download", "folder-music", "folder-pictures", "folder-videos",
+    "folder-templates", "folder-publicshare", "user-home", "user-desktop", "user-trash", "user-trash-full",
+    "inode-directory", "text-x-generic", "text-plain", "text-x-script", "text-html", "text-markdown", "text-x-csrc",
+    "text-x-chdr", "text-x-c++src", "text-x-python", "text-x-makefile", "application-octet-stream",
+    "application-x-executable", "application-x-sharedlib", "application-x-shellscript", "application-pdf",
+    "application-zip", "application-x-compressed-tar", "application-x-tar", "application-x-archive",
+    "application-json", "application-xml", "application-x-desktop", "image-x-generic", "image-png", "image-jpeg",
+    "image-svg+xml", "audio-x-generic", "video-x-generic", "package-x-generic", "x-office-document",
+    "x-office-spreadsheet", "x-office-presentation", "font-x-generic", "unknown", "emblem-symbolic-link",
+    "drive-harddisk", "media-removable"};
+
+struct Entry {
+    std::string path;
+    std::uint16_t size;  // 0 for the unsized icons of the fallback directories
+    std::uint16_t scale;
+    std::uint32_t flags;
+};
+
+// the entries of an icon, all from the first theme of the chain that has it
+struct Found {
+    std::size_t rank = 0;
+    std::vector<Entry> entries;
+};
+
+std::int64_t mtimeOf(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return -1;
+    }
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool writeAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+std::vector<std::string> localPaths(const QStringList& paths) {
+    std::vector<std::string> result;
+    for (const auto& path : paths) {
+        result.emplace_back(QFile::encodeName(path).constData());
+    }
+    return result;
+}
+
+void scanDir(const std::string& path, std::size_t rank, int size, int scale, bool scalable,
+             std::map<std::string, Found>& icons) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        const char* dot = std::strrchr(entry->d_name, '.');
+        if (!dot || dot == entry->d_name) {
+            continue;
+        }
+        const bool svg = std::strcmp(dot, ".svg") == 0 || std::strcmp(dot, ".svgz") == 0;
+        if (!svg && std::strcmp(dot, ".png") != 0 && std::strcmp(dot, ".xpm") != 0) {
+            continue;
+        }
+        Found& found = icons[std::string(entry->d_name, dot)];
+        if (found.entries.empty()) {
+            found.rank = rank;
+        }
+        else if (found.rank != rank) {  // an inherited theme does not add to an icon of the theme
+            continue;
+        }
+        found.entries.push_back(Entry{path + '/' + entry->d_name, static_cast<std::uint16_t>(size),
+                                      static_cast<std::uint16_t>(scale), (svg || scalable) ? kScalable : 0});
+    }
+    closedir(dir);
+}
+
+// Renders the common icons that only come as SVGs at |sizes|, below |pixmapDir|.
+void renderCommonIcons(const std::vector<int>& sizes, const std::string& pixmapDir,
+                       std::map<std::string, Found>& icons) {
+    for (const char* name : kCommonIcons) {
+        auto it = icons.find(name);
+        if (it == icons.end()) {
+            continue;
+        }
+        auto& entries = it->second.entries;
+        auto svg = std::find_if(entries.begin(), entries.end(), [](const Entry& e) { return e.flags & kScalable; });
+        if (svg == entries.end()) {
+            continue;
+        }
+        const std::string svgPath = svg->path;
+        for (const int size : sizes) {
+            if (std::any_of(entries.begin(), entries.end(), [size](const Entry& e) {
+                    return !(e.flags & kScalable) && e.size * e.scale == size;
+                })) {
+                continue;
+            }
+            QImageReader reader{QFile::decodeName(svgPath.c_str())};
+            reader.setScaledSize(QSize{size, size});
+            const QImage image = reader.read();
+            if (image.isNull()) {
+                break;
+            }
+            g_mkdir_with_parents(pixmapDir.c_str(), 0700);
+            const std::string file = pixmapDir + '/' + name + '-' + std::to_string(size) + ".png";
+            if (image.save(QFile::decodeName(file.c_str()), "PNG")) {
+                entries.push_back(Entry{file, static_cast<std::uint16_t>(size), 1, 0});
+            }
+        }
+    }
+}
+
+// Draws an icon from the files the index has for it, picking them the way the icon loader
+// of Qt picks the directories of a theme: a file of the very size, else an SVG, else the
+// closest bigger file scaled down.
+class IconFileEngine : public QIconEngine {
+   public:
+    struct File {
+        QString path;
+        int pixels;  // 0 for an SVG or an unsized file
+    };
+
+    explicit IconFileEngine(std::vector<File> files) : files_{std::move(files)} {}
+
+    QSize actualSize(const QSize& size, QIcon::Mode /*mode*/, QIcon::State /*state*/) override {
+        const File* file = pick(std::max(size.width(), size.height()));
+        if (!file || file->pixels == 0) {
+            return size;
+        }
+        return QSize{file->pixels, file->pixels}.boundedTo(size);
+    }
+
+    void addFile(const QString& /*fileName*/,
+                 const QSize& /*size*/,
+                 QIcon::Mode /*mode*/,
+                 QIcon::State /*state*/) override {}
+
+    void addPixmap(const QPixmap& /*pixmap*/, QIcon::Mode /*mode*/, QIcon::State /*state*/) override {}
+
+    QIconEngine* clone() const override { return new IconFileEngine{files_}; }
+
+    QString key() const override { return QStringLiteral("Fm::IconFileEngine"); }
+
+    bool isNull() override { return files_.empty(); }
+
+    QList<QSize> availableSizes(QIcon::Mode /*mode*/, QIcon::State /*state*/) override {
+        QList<QSize> sizes;
+        for (const auto& file : files_) {
+            if (file.pixels > 0) {
+                sizes.push_back(QSize{file.pixels, file.pixels});
+            }
+        }
+        return sizes;
+    }
+
+    void paint(QPainter* painter, const QRect& rect, QIcon::Mode mode, QIcon::State state) override {
+        const qreal scale = painter->device()->devicePixelRatioF();
+#if (QT_VERSION < QT_VERSION_CHECK(6, 8, 0))
+        const QPixmap pixmap = scaledPixmap(rect.size() * scale, mode, state, scale);
+#else
+        const QPixmap pixmap = scaledPixmap(rect.size(), mode, state, scale);
+#endif
+        painter->drawPixmap(rect, pixmap);
+    }
+
+    QPixmap pixmap(const QSize& size, QIcon::Mode mode, QIcon::State state) override {
+        return scaledPixmap(size, mode, state, 1);
+    }
+
+    QPixmap scaledPixmap(const QSize& size, QIcon::Mode mode, QIcon::State state, qreal scale) override {
+        // the size is device independent since Qt 6.8
+#if (QT_VERSION < QT_VERSION_CHECK(6, 8, 0))
+        const QSize pixels = size;
+#else
+        const QSize pixels = (size.toSizeF() * scale).toSize();
+#endif
+        const int extent = std::max(pixels.width(), pixels.height());
+        const File* file = pick(extent);
+        if (!file || extent <= 0) {
+            return QPixmap{};
+        }
+        const QString cacheKey =
+            QStringLiteral("Fm::IconFileEngine:%1:%2:%3:%4").arg(file->path).arg(extent).arg(mode).arg(state);
+        QPixmap pixmap;
+        if (!QPixmapCache::find(cacheKey, &pixmap)) {
+            QImageReader reader{file->path};
+            if (file->pixels != extent) {
+                // draw an SVG at the size, and scale a bigger file down keeping its aspect
+                QSize scaled = reader.size().isValid() ? reader.size() : QSize{extent, extent};
+                scaled.scale(QSize{extent, extent}, Qt::KeepAspectRatio);
+                reader.setScaledSize(scaled);
+            }
+            pixmap = QPixmap::fromImage(reader.read());
+            if (!pixmap.isNull() && mode != QIcon::Normal) {
+                QStyleOption option;
+                option.palette = QGuiApplication::palette();
+                pixmap = QApplication::style()->generatedIconPixmap(mode, pixmap, &option);
+            }
+            QPixmapCache::insert(cacheKey, pixmap);
+        }
+        pixmap.setDevicePixelRatio(scale);
+        return pixmap;
+    }
+
+   private:
+    const File* pick(int extent) const {
+        const File* svg = nullptr;
+        const File* best = nullptr;
+        for (const auto& file : files_) {
+            if (file.pixels == extent) {
+                return &file;
+            }
+            if (file.pixels == 0) {
+                svg = svg ? svg : &file;
+            }
+            // the smallest file bigger than asked for, else the biggest
+            else if (!best || (best->pixels < extent ? file.pixels > best->pixels
+                                                     : file.pixels > extent && file.pixels < best->pixels)) {
+                best = &file;
+            }
+        }
+        return svg ? svg : best;
+    }
+
+    std::vector<File> files_;
+};
+
+}  // namespace
+
+struct IconPathIndex::Header {
+    char magic[8];
+    std::uint32_t nameCount;
+    std::uint32_t entryCount;
+    std::uint32_t poolLength;
+    std::uint32_t stampLength;  // the stamp starts the pool
+};
+
+struct IconPathIndex::NameRecord {
+    std::uint32_t offset;  // of the name in the pool
+    std::uint32_t length;
+    std::uint32_t firstEntry;
+    std::uint32_t entryCount;
+};
+
+struct IconPathIndex::EntryRecord {
+    std::uint32_t offset;  // of the file path in the pool
+    std::uint32_t length;
+    std::uint16_t size;
+    std::uint16_t scale;
+    std::uint32_t flags;
+};
+
+IconPathIndex::IconPathIndex(std::string cacheDir) : cacheDir_{std::move(cacheDir)} {}
+
+IconPathIndex::~IconPathIndex() {
+    if (builder_.joinable()) {
+        builder_.join();
+    }
+    unmap();
+}
+
+std::shared_ptr<IconPathIndex> IconPathIndex::globalInstance() {
+    static const std::shared_ptr<IconPathIndex> index = [] {
+        CStrPtr dir{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "icons", nullptr)};
+        return std::make_shared<IconPathIndex>(dir.get());
+    }();
+    return index;
+}
+
+void IconPathIndex::setPixmapSizes(std::vector<int> sizes) {
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    sizes.erase(std::remove_if(sizes.begin(), sizes.end(), [](int size) { return size <= 0 || size > 1024; }),
+                sizes.end());
+    if (sizes != pixmapSizes_) {
+        pixmapSizes_ = std::move(sizes);
+        theme_.clear();  // checked again with the new sizes
+    }
+}
+
+bool IconPathIndex::lookup(const char* name, QIcon& icon) {
+    if (theme_ != QIcon::themeName() || built_.load(std::memory_order_acquire)) {
+        load();
+    }
+    if (!names_) {
+        return false;
+    }
+
+    const std::size_t length = std::strlen(name);
+    const NameRecord* end = names_ + nameCount_;
+    const NameRecord* record = std::lower_bound(names_, end, name, [&](const NameRecord& r, const char* key) {
+        const int cmp = std::memcmp(pool_ + r.offset, key, std::min<std::size_t>(r.length, length));
+        return cmp < 0 || (cmp == 0 && r.length < length);
+    });
+    icon = QIcon{};
+    if (record == end || record->length != length || std::memcmp(pool_ + record->offset, name, length) != 0) {
+        return true;
+    }
+
+    std::vector<IconFileEngine::File> files;
+    files.reserve(record->entryCount);
+    for (std::uint32_t i = record->firstEntry; i < record->firstEntry + record->entryCount; ++i) {
+        const EntryRecord& entry = entries_[i];
+        const int pixels = (entry.flags & kScalable) ? 0 : entry.size * entry.scale;
+        files.push_back(IconFileEngine::File{QFile::decodeName(QByteArray{pool_ + entry.offset,
+                                                                          static_cast<int>(entry.length)}),
+                                             pixels});
+    }
+    icon = QIcon{new IconFileEngine{std::move(files)}};
+    return true;
+}
+
+void IconPathIndex::load() {
+    if (builder_.joinable() && built_.load(std::memory_order_acquire)) {
+        builder_.join();
+        built_.store(false, std::memory_order_relaxed);
+    }
+    unmap();
+    theme_ = QIcon::themeName();
+    if (theme_.isEmpty()) {
+        return;
+    }
+
+    stampHead_ = "theme=" + theme_.toStdString() + "\nsizes=";
+    for (const int size : pixmapSizes_) {
+        stampHead_ += std::to_string(size) + ' ';
+    }
+    stampHead_ += "\npaths=" + QIcon::themeSearchPaths().join(QLatin1Char(':')).toStdString();
+    stampHead_ += "\nfallback=" + QIcon::fallbackSearchPaths().join(QLatin1Char(':')).toStdString() + '\n';
+
+    const std::string file = cacheDir_ + '/' + QFile::encodeName(theme_).constData() + kSuffix;
+    const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(Header)) {
+        void* map = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            map_ = map;
+            mapSize_ = static_cast<std::size_t>(st.st_size);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (map_) {
+        const auto* data = static_cast<const char*>(map_);
+        Header header;
+        std::memcpy(&header, data, sizeof(header));
+        const std::uint64_t expected = sizeof(Header) + std::uint64_t{header.nameCount} * sizeof(NameRecord) +
+                                       std::uint64_t{header.entryCount} * sizeof(EntryRecord) + header.poolLength;
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && expected == mapSize_ &&
+            header.stampLength <= header.poolLength) {
+            names_ = reinterpret_cast<const NameRecord*>(data + sizeof(Header));
+            nameCount_ = header.nameCount;
+            entries_ = reinterpret_cast<const EntryRecord*>(names_ + nameCount_);
+            entryCount_ = header.entryCount;
+            pool_ = reinterpret_cast<const char*>(entries_ + entryCount_);
+            poolLength_ = header.poolLength;
+            if (!isCurrent()) {
+                unmap();
+            }
+        }
+        else {
+            unmap();
+        }
+    }
+    if (!names_) {
+        startRebuild();
+    }
+}
+
+void IconPathIndex::unmap() {
+    if (map_) {
+        munmap(map_, mapSize_);
+    }
+    map_ = nullptr;
+    mapSize_ = 0;
+    names_ = nullptr;
+    entries_ = nullptr;
+    pool_ = nullptr;
+    nameCount_ = entryCount_ = poolLength_ = 0;
+}
+
+bool IconPathIndex::isCurrent() const {
+    Header header;
+    std::memcpy(&header, map_, sizeof(header));
+    const std::string stamp{pool_, header.stampLength};
+    if (stamp.compare(0, stampHead_.size(), stampHead_) != 0) {
+        return false;
+    }
+    // then a line with the modification time and the path of each directory that was read
+    std::size_t pos = stampHead_.size();
+    while (pos < stamp.size()) {
+        const std::size_t space = stamp.find(' ', pos);
+        const std::size_t newline = stamp.find('\n', pos);
+        if (space == std::string::npos || newline == std::string::npos || space > newline) {
+            return false;
+        }
+        const std::string mtime = stamp.substr(pos, space - pos);
+        if (mtime != std::to_string(mtimeOf(stamp.substr(space + 1, newline - space - 1)))) {
+            return false;
+        }
+        pos = newline + 1;
+    }
+
+    // every record within the file, so that lookups need not check
+    for (std::uint32_t i = 0; i < nameCount_; ++i) {
+        const NameRecord& r = names_[i];
+        if (r.offset > poolLength_ || r.length > poolLength_ - r.offset || r.firstEntry > entryCount_ ||
+            r.entryCount > entryCount_ - r.firstEntry) {
+            return false;
+        }
+    }
+    for (std::uint32_t i = 0; i < entryCount_; ++i) {
+        const EntryRecord& e = entries_[i];
+        if (e.offset > poolLength_ || e.length > poolLength_ - e.offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void IconPathIndex::startRebuild() {
+    // already rebuilding, maybe for another theme, which is tried again once it is done; and
+    // an index that was just rebuilt but is not current is not rebuilt over and over
+    if (builder_.joinable() || stampHead_ == rebuiltHead_) {
+        return;
+    }
+    rebuiltHead_ = stampHead_;
+    const std::string theme = QFile::encodeName(theme_).constData();
+    const std::string file = cacheDir_ + '/' + theme + kSuffix;
+    const std::string pixmapDir = cacheDir_ + '/' + theme + "-pixmaps";
+    builder_ = std::thread([this, theme, file, pixmapDir, head = stampHead_, sizes = pixmapSizes_,
+                            searchPaths = localPaths(QIcon::themeSearchPaths()),
+                            fallbackPaths = localPaths(QIcon::fallbackSearchPaths())]() {
+        std::string stamp = head;
+        auto addStamp = [&stamp](const std::string& path) {
+            stamp += std::to_string(mtimeOf(path)) + ' ' + path + '\n';
+        };
+
+        // the theme and those it inherits, hicolor last, as the icon loader of Qt searches them
+        std::map<std::string, Found> icons;
+        std::vector<std::string> chain{theme};
+        for (std::size_t rank = 0; rank < chain.size(); ++rank) {
+            struct Dir {
+                std::string path;
+                int size;
+                int scale;
+                bool scalable;
+            };
+            std::vector<Dir> dirs;
+            bool haveIndex = false;
+            for (const auto& base : searchPaths) {
+                const std::string root = base + '/' + chain[rank];
+                addStamp(root);
+                if (haveIndex) {
+                    continue;
+                }
+                GKeyFile* keyFile = g_key_file_new();
+                const std::string indexFile = root + "/index.theme";
+                if (g_key_file_load_from_file(keyFile, indexFile.c_str(), G_KEY_FILE_NONE, nullptr)) {
+                    haveIndex = true;
+                    addStamp(indexFile);
+                    for (const char* key : {"Directories", "ScaledDirectories"}) {
+                        char** names = g_key_file_get_string_list(keyFile, "Icon Theme", key, nullptr, nullptr);
+                        for (char** name = names; name && *name; ++name) {
+                            CStrPtr type{g_key_file_get_string(keyFile, *name, "Type", nullptr)};
+                            dirs.push_back(Dir{*name, g_key_file_get_integer(keyFile, *name, "Size", nullptr),
+                                               std::max(1, g_key_file_get_integer(keyFile, *name, "Scale", nullptr)),
+                                               type && std::strcmp(type.get(), "Scalable") == 0});
+                        }
+                        g_strfreev(names);
+                    }
+                    char** inherits = g_key_file_get_string_list(keyFile, "Icon Theme", "Inherits", nullptr, nullptr);
+                    for (char** name = inherits; name && *name; ++name) {
+                        if (std::find(chain.begin(), chain.end(), *name) == chain.end()) {
+                            chain.emplace_back(*name);
+                        }
+                    }
+                    g_strfreev(inherits);
+                }
+                g_key_file_free(keyFile);
+            }
+            if (rank + 1 == chain.size() && std::find(chain.begin(), chain.end(), "hicolor") == chain.end()) {
+                chain.emplace_back("hicolor");
+            }
+            for (const auto& base : searchPaths) {
+                for (const auto& dir : dirs) {
+                    scanDir(base + '/' + chain[rank] + '/' + dir.path, rank, dir.size, dir.scale, dir.scalable,
+                            icons);
+                }
+            }
+        }
+        for (const auto& path : fallbackPaths) {
+            addStamp(path);
+            scanDir(path, chain.size(), 0, 1, false, icons);
+        }
+        renderCommonIcons(sizes, pixmapDir, icons);
+
+        // names sorted as std::map keeps them, the entries of each together
+        std::string names, entries, pool = stamp;
+        std::uint32_t entryCount = 0;
+        for (const auto& icon : icons) {
+            const NameRecord name{static_cast<std::uint32_t>(pool.size()),
+                                  static_cast<std::uint32_t>(icon.first.size()), entryCount,
+                                  static_cast<std::uint32_t>(icon.second.entries.size())};
+            pool += icon.first;
+            names.append(reinterpret_cast<const char*>(&name), sizeof(name));
+            for (const auto& e : icon.second.entries) {
+                const EntryRecord entry{static_cast<std::uint32_t>(pool.size()),
+                                        static_cast<std::uint32_t>(e.path.size()), e.size, e.scale, e.flags};
+                pool += e.path;
+                entries.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+                ++entryCount;
+            }
+        }
+        Header header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.nameCount = static_cast<std::uint32_t>(icons.size());
+        header.entryCount = entryCount;
+        header.poolLength = static_cast<std::uint32_t>(pool.size());
+        header.stampLength = static_cast<std::uint32_t>(stamp.size());
+
+        g_mkdir_with_parents(cacheDir_.c_str(), 0700);
+        const std::string tmpFile = file + ".tmp";
+        const int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd >= 0) {
+            const bool ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+                            writeAll(fd, names.data(), names.size()) && writeAll(fd, entries.data(), entries.size()) &&
+                            writeAll(fd, pool.data(), pool.size());
+            if (close(fd) != 0 || !ok || rename(tmpFile.c_str(), file.c_str()) != 0) {
+                unlink(tmpFile.c_str());
+            }
+        }
+        built_.store(true, std::memory_order_release);
+    });
+}
+
+}  // namespace Fm
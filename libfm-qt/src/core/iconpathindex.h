@@ -0,0 +1,74 @@
+#ifndef FM2_ICONPATHINDEX_H
+#define FM2_ICONPATHINDEX_H
+
+#include "../libfmqtglobals.h"
+#include <QIcon>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Fm {
+
+// Remembers which files the icon theme resolves each icon name to, so that IconInfo builds
+// its icons from the files at once rather than having QIcon::fromTheme() look through the
+// directories of the theme and of the themes it inherits on first use. The index of a theme
+// is kept in a file below $XDG_CACHE_HOME, which is mapped and searched in place, and is
+// stamped with the modification times of the theme directories in every icon directory. A
+// stale or missing index is rebuilt by a thread of its own while QIcon::fromTheme() is used;
+// icons added to a subdirectory of a theme go unnoticed until its directory changes, which
+// gtk-update-icon-cache does. The rebuild also renders the common file type icons that only
+// come as SVGs at the sizes given by setPixmapSizes(), so that the first views do not have to.
+// Used from the main thread.
+class LIBFM_QT_API IconPathIndex {
+   public:
+    // |cacheDir| is where the indexes are kept; it is only created when one is written.
+    explicit IconPathIndex(std::string cacheDir);
+
+    ~IconPathIndex();
+
+    static std::shared_ptr<IconPathIndex> globalInstance();
+
+    // The sizes, in pixels, the common icons are rendered at; they are part of the stamp, so
+    // changing them rebuilds the index.
+    void setPixmapSizes(std::vector<int> sizes);
+
+    // Builds the icon of |name| in the current theme from the files of the index. Returns false
+    // when the index of the theme is not current, and true with a null |icon| when the theme
+    // and the fallback directories have no such icon.
+    bool lookup(const char* name, QIcon& icon);
+
+   private:
+    struct Header;
+    struct NameRecord;
+    struct EntryRecord;
+
+    // Maps the index of the current theme, or starts rebuilding it.
+    void load();
+    void unmap();
+    bool isCurrent() const;
+    void startRebuild();
+
+    std::string cacheDir_;
+    std::vector<int> pixmapSizes_;
+    QString theme_;            // the theme of the mapped index, or the one being indexed
+    std::string stampHead_;    // the first lines of the stamp of a current index
+    std::string rebuiltHead_;  // that of the index rebuilt last
+    void* map_ = nullptr;
+    std::size_t mapSize_ = 0;
+    const NameRecord* names_ = nullptr;
+    std::uint32_t nameCount_ = 0;
+    const EntryRecord* entries_ = nullptr;
+    std::uint32_t entryCount_ = 0;
+    const char* pool_ = nullptr;
+    std::uint32_t poolLength_ = 0;
+    std::thread builder_;
+    std::atomic<bool> built_{false};  // the builder has finished
+};
+
+}  // namespace Fm
+
+#endif  // FM2_ICONPATHINDEX_H
@@ -0,0 +1,198 @@
+#include "imagescaler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace Fm {
+
+namespace {
+
+// the weights of the area-averaging filter sum to this
+constexpr int kWeightBits = 14;
+constexpr std::uint32_t kWeightOne = 1u << kWeightBits;
+// the bits below the 8 of a channel kept between the vertical and the horizontal pass
+constexpr int kExtraBits = 8;
+
+// The source pixels each output pixel of a row or column averages, and by how much.
+struct Filter {
+    int taps = 0;                        // the weights per output pixel, the last ones possibly 0
+    std::vector<int> starts;             // the first source pixel of each output pixel
+    std::vector<std::uint16_t> weights;  // |taps| per output pixel
+};
+
+// |extent| is the width of the source in pixels, the last one possibly only partly covered.
+Filter makeFilter(int srcSize, double extent, int dstSize) {
+    Filter filter;
+    const double scale = extent / dstSize;
+    filter.taps = static_cast<int>(std::ceil(scale)) + 1;
+    filter.starts.resize(dstSize);
+    filter.weights.assign(static_cast<std::size_t>(dstSize) * filter.taps, 0);
+    for (int out = 0; out < dstSize; ++out) {
+        const double begin = out * scale;
+        const double end = std::min(extent, (out + 1) * scale);
+        const int first = std::min(srcSize - 1, static_cast<int>(begin));
+        const int last = std::min({srcSize, static_cast<int>(std::ceil(end)), first + filter.taps});
+        std::uint16_t* weights = &filter.weights[static_cast<std::size_t>(out) * filter.taps];
+        std::uint32_t sum = 0;
+        int largest = 0;
+        for (int i = first; i < last; ++i) {
+            const double covered = std::min<double>(end, i + 1) - std::max<double>(begin, i);
+            weights[i - first] = static_cast<std::uint16_t>(std::lround(covered / scale * kWeightOne));
+            sum += weights[i - first];
+            if (weights[i - first] > weights[largest]) {
+                largest = i - first;
+            }
+        }
+        // rounding must neither darken nor brighten the image
+        weights[largest] = static_cast<std::uint16_t>(weights[largest] + kWeightOne - sum);
+        filter.starts[out] = first;
+    }
+    return filter;
+}
+
+// Averages the |factorX| by |factorY| blocks of |src|; those at the right and bottom edges may
+// be smaller.
+QImage shrinkBlocks(const QImage& src, int factorX, int factorY) {
+    const int width = src.width();
+    const int height = src.height();
+    QImage dst{(width + factorX - 1) / factorX, (height + factorY - 1) / factorY, src.format()};
+    if (dst.isNull()) {
+        return dst;
+    }
+    std::vector<std::uint32_t> sums(static_cast<std::size_t>(width) * 4);
+    for (int outY = 0; outY < dst.height(); ++outY) {
+        const int firstRow = outY * factorY;
+        const int rows = std::min(height, firstRow + factorY) - firstRow;
+        std::fill(sums.begin(), sums.end(), 0);
+        for (int y = firstRow; y < firstRow + rows; ++y) {
+            const std::uint8_t* row = src.constScanLine(y);
+            std::uint32_t* sum = sums.data();
+            for (std::size_t i = 0, n = sums.size(); i < n; ++i) {
+                sum[i] += row[i];
+            }
+        }
+        std::uint8_t* out = dst.scanLine(outY);
+        for (int outX = 0; outX < dst.width(); ++outX) {
+            const int firstColumn = outX * factorX;
+            const int columns = std::min(width, firstColumn + factorX) - firstColumn;
+            // a division by multiplication; the sums are small enough for 64 bits
+            const std::uint64_t count = static_cast<std::uint64_t>(rows) * columns;
+            const std::uint64_t inverse = ((std::uint64_t{1} << 32) + count / 2) / count;
+            std::uint32_t block[4] = {0, 0, 0, 0};
+            const std::uint32_t* sum = &sums[static_cast<std::size_t>(firstColumn) * 4];
+            for (int x = 0; x < columns; ++x, sum += 4) {
+                for (int c = 0; c < 4; ++c) {
+                    block[c] += sum[c];
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                out[outX * 4 + c] = static_cast<std::uint8_t>((block[c] * inverse + (std::uint64_t{1} << 31)) >> 32);
+            }
+        }
+    }
+    return dst;
+}
+
+// Scales |src| down to |size| with an area-averaging filter, the columns first. The last
+// column and row of |src| may stand for less than a pixel: |extent| is its real size.
+QImage averageAreas(const QImage& src, double extentX, double extentY, const QSize& size) {
+    QImage dst{size, src.format()};
+    if (dst.isNull()) {
+        return dst;
+    }
+    const Filter columnFilter = makeFilter(src.height(), extentY, size.height());
+    const Filter rowFilter = makeFilter(src.width(), extentX, size.width());
+    const std::size_t rowLength = static_cast<std::size_t>(src.width()) * 4;
+    std::vector<std::uint32_t> sums(rowLength);
+    // the taps of weight 0 may read past the end of the row
+    std::vector<std::uint16_t> column(rowLength + static_cast<std::size_t>(rowFilter.taps) * 4);
+    for (int outY = 0; outY < size.height(); ++outY) {
+        std::fill(sums.begin(), sums.end(), 0);
+        const std::uint16_t* weights = &columnFilter.weights[static_cast<std::size_t>(outY) * columnFilter.taps];
+        for (int tap = 0; tap < columnFilter.taps; ++tap) {
+            const std::uint32_t weight = weights[tap];
+            if (weight == 0) {
+                continue;
+            }
+            const std::uint8_t* row = src.constScanLine(columnFilter.starts[outY] + tap);
+            std::uint32_t* sum = sums.data();
+            for (std::size_t i = 0; i < rowLength; ++i) {
+                sum[i] += row[i] * weight;
+            }
+        }
+        for (std::size_t i = 0; i < rowLength; ++i) {
+            column[i] = static_cast<std::uint16_t>((sums[i] + (1u << (kWeightBits - kExtraBits - 1))) >>
+                                                   (kWeightBits - kExtraBits));
+        }
+
+        std::uint8_t* out = dst.scanLine(outY);
+        for (int outX = 0; outX < size.width(); ++outX) {
+            const std::uint16_t* pixel = &column[static_cast<std::size_t>(rowFilter.starts[outX]) * 4];
+            const std::uint16_t* rowWeights = &rowFilter.weights[static_cast<std::size_t>(outX) * rowFilter.taps];
+            std::uint32_t value[4] = {0, 0, 0, 0};
+            for (int tap = 0; tap < rowFilter.taps; ++tap, pixel += 4) {
+                for (int c = 0; c < 4; ++c) {
+                    value[c] += pixel[c] * std::uint32_t{rowWeights[tap]};
+                }
+            }
+            constexpr int shift = kWeightBits + kExtraBits;
+            for (int c = 0; c < 4; ++c) {
+                out[outX * 4 + c] = static_cast<std::uint8_t>((value[c] + (1u << (shift - 1))) >> shift);
+            }
+        }
+    }
+    return dst;
+}
+
+}  // namespace
+
+QImage ImageScaler::scaled(const QImage& image, const QSize& size, Qt::AspectRatioMode mode) {
+    if (image.isNull()) {
+        return QImage();
+    }
+    const QSize target = image.size().scaled(size, mode);
+    if (target.isEmpty()) {
+        return QImage();
+    }
+    if (target == image.size()) {
+        return image;
+    }
+    if (target.width() > image.width() || target.height() > image.height()) {
+        return image.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    // four 8-bit channels, which average correctly when premultiplied
+    QImage src = image;
+    switch (image.format()) {
+        case QImage::Format_RGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+        case QImage::Format_RGBX8888:
+        case QImage::Format_RGBA8888_Premultiplied:
+            break;
+        case QImage::Format_RGBA8888:
+            src.convertTo(QImage::Format_RGBA8888_Premultiplied);
+            break;
+        default:
+            src.convertTo(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+            break;
+    }
+
+    // the blocks leave the filter two to four source pixels per output pixel: enough for it to
+    // smooth the edges of the blocks, and few enough for it to be cheap
+    const int factorX = std::max(1, src.width() / (2 * target.width()));
+    const int factorY = std::max(1, src.height() / (2 * target.height()));
+    // the blocks at the edges are smaller, so they count for less in the filter
+    const double extentX = static_cast<double>(src.width()) / factorX;
+    const double extentY = static_cast<double>(src.height()) / factorY;
+    if (factorX > 1 || factorY > 1) {
+        src = shrinkBlocks(src, factorX, factorY);
+    }
+    QImage result = src.size() == target ? src : averageAreas(src, extentX, extentY, target);
+    result.setDotsPerMeterX(image.dotsPerMeterX());
+    result.setDotsPerMeterY(image.dotsPerMeterY());
+    result.setColorSpace(image.colorSpace());
+    return result;
+}
+
+}  // namespace Fm
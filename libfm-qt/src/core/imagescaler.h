@@ -0,0 +1,30 @@
+#ifndef FM2_IMAGESCALER_H
+#define FM2_IMAGESCALER_H
+
+#include "../libfmqtglobals.h"
+#include <QImage>
+
+namespace Fm {
+
+// Scales images down for thumbnails and previews, faster than QImage::scaled() with
+// Qt::SmoothTransformation for large reductions. Whole blocks of pixels are averaged first,
+// down to between two and four times the size wanted, and an area-averaging filter then
+// makes the exact size. The loops work on rows of 8-bit channels that compilers vectorize.
+// The result is premultiplied when |image| has an alpha channel.
+class LIBFM_QT_API ImageScaler {
+   public:
+    // Like QImage::scaled() with Qt::SmoothTransformation, which is used as it is when the
+    // image is not scaled down in both directions.
+    static QImage scaled(const QImage& image, const QSize& size, Qt::AspectRatioMode mode = Qt::IgnoreAspectRatio);
+
+    static QImage scaled(const QImage& image,
+                         int width,
+                         int height,
+                         Qt::AspectRatioMode mode = Qt::IgnoreAspectRatio) {
+        return scaled(image, QSize(width, height), mode);
+    }
+};
+
+}  // namespace Fm
+
+#endif  // FM2_IMAGESCALER_H
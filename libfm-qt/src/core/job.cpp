@@ -29,7 +29,13 @@ void Job::cancel() {
 }
 
 void Job::run() {
-    exec();
+    if (failure_) {
+        emitError(failure_, ErrorSeverity::SEVERE);
+        cancel();
+    }
+    else {
+        exec();
+    }
     Q_EMIT finished();
 }
 
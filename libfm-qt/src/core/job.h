@@ -61,6 +61,10 @@ class LIBFM_QT_API Job : public QObject, public QRunnable {
 
     const GCancellablePtr& cancellable() const { return cancellable_; }
 
+    // Makes run() report |err| and finish as cancelled instead of calling exec(), for a job
+    // refused before it started, as on a server that stopped answering.
+    void fail(GErrorPtr err) { failure_ = std::move(err); }
+
    Q_SIGNALS:
     void cancelled();
 
@@ -90,6 +94,7 @@ class LIBFM_QT_API Job : public QObject, public QRunnable {
 
    private:
     bool paused_;
+    GErrorPtr failure_;
     GCancellablePtr cancellable_;
     gulong cancellableHandler_;
 };
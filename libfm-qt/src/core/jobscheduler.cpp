@@ -0,0 +1,395 @@
+#include "jobscheduler.h"
+#include "perftrace.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <QThread>
+#include <gio/gunixmounts.h>
+#include <sys/statvfs.h>
+
+namespace Fm {
+
+namespace {
+
+// how often the mounts with running jobs are checked (in ms)
+constexpr int kWatchdogInterval = 2000;
+// a mount whose jobs neither start nor finish for this long is probed
+constexpr auto kStallTimeout = std::chrono::seconds(10);
+// a probe not answered in this time marks the mount unresponsive, which is then probed again
+// this often
+constexpr auto kProbeTimeout = std::chrono::seconds(5);
+
+// filesystems whose server may stop answering, which would block every call on them
+constexpr const char* kRemoteFsTypes[] = {"nfs",   "nfs4",       "cifs",        "smb3",      "smbfs",
+                                          "9p",    "afs",        "ceph",        "glusterfs", "lustre",
+                                          "davfs", "fuse.sshfs", "fuse.rclone", "fuse.s3fs", "fuse.gvfsd-fuse"};
+
+// the schemes that never reach another machine
+constexpr const char* kLocalSchemes[] = {"trash", "computer", "menu", "search", "recent", "applications", "burn"};
+
+bool isRemoteFsType(const char* type) {
+    return type && std::any_of(std::begin(kRemoteFsTypes), std::end(kRemoteFsTypes),
+                               [type](const char* remote) { return std::strcmp(type, remote) == 0; });
+}
+
+// Whether the mount |mount| answers; blocks for as long as it does not.
+bool probeMount(const std::string& mount) {
+    if (mount.compare(0, 7, "file://") == 0) {
+        // unlike stat(), statvfs() is not answered from the attribute cache of NFS
+        struct statvfs st;
+        return statvfs(mount.c_str() + 7, &st) == 0;
+    }
+    GFilePtr file{g_file_new_for_uri(mount.c_str()), false};
+    GFileInfoPtr info{
+        g_file_query_info(file.get(), G_FILE_ATTRIBUTE_STANDARD_TYPE, G_FILE_QUERY_INFO_NONE, nullptr, nullptr),
+        false};
+    return info != nullptr;
+}
+
+}  // namespace
+
+JobScheduler::JobScheduler() : maxRunningPerMount_{3} {
+    // a hung network folder occupies its slot until cancelled, so listing gets plenty
+    jobClass(Priority::Interactive).maxRunning = 16;
+    jobClass(Priority::VisibleThumbnails).maxRunning = 2;
+    jobClass(Priority::Prefetch).maxRunning = 1;
+    jobClass(Priority::Background).maxRunning = 2;
+    updateThreadCount();
+    watchdog_.setInterval(kWatchdogInterval);
+    watchdog_.setTimerType(Qt::VeryCoarseTimer);
+    connect(&watchdog_, &QTimer::timeout, this, &JobScheduler::onWatchdog);
+}
+
+JobScheduler::~JobScheduler() {
+    pool_.waitForDone();
+}
+
+JobScheduler* JobScheduler::globalInstance() {
+    static JobScheduler* scheduler = new JobScheduler();
+    return scheduler;
+}
+
+void JobScheduler::start(Job* job, Priority priority) {
+    start(job, priority, FilePath());
+}
+
+void JobScheduler::start(Job* job, Priority priority, const FilePath& location) {
+    if (job->autoDelete()) {
+        connect(job, &Job::finished, job, &Job::deleteLater);
+    }
+    connect(job, &Job::cancelled, this, [this, job]() { onJobCancelled(job); }, Qt::DirectConnection);
+    std::string mount = location ? mountKey(location) : std::string();
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (!mount.empty()) {
+        auto inserted = mounts_.emplace(mount, MountGroup{});
+        MountGroup& group = inserted.first->second;
+        if (inserted.second) {
+            group.lastProgress = Clock::now();
+            if (mounts_.size() == 1) {
+                // in the thread of the scheduler, which start() may not be called in
+                QMetaObject::invokeMethod(this, [this]() { watchdog_.start(); }, Qt::QueuedConnection);
+            }
+        }
+        if (group.unresponsive) {
+            // no use waiting in line for a server that does not answer
+            refuse(job, mount);
+            run(job, priority, mount, false);
+            return;
+        }
+        ++group.waiting;
+    }
+    jobClass(priority).waiting.push_back(WaitingJob{job, std::move(mount)});
+    startWaitingJobs();
+}
+
+void JobScheduler::promote(Job* job, Priority priority) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (std::size_t i = static_cast<std::size_t>(priority) + 1; i < classes_.size(); ++i) {
+        auto& waiting = classes_[i].waiting;
+        auto it = std::find_if(waiting.begin(), waiting.end(), [job](const WaitingJob& w) { return w.job == job; });
+        if (it != waiting.end()) {
+            jobClass(priority).waiting.push_back(std::move(*it));
+            waiting.erase(it);
+            startWaitingJobs();
+            return;
+        }
+    }
+}
+
+int JobScheduler::maxRunningJobs(Priority priority) const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return classes_[static_cast<std::size_t>(priority)].maxRunning;
+}
+
+void JobScheduler::setMaxRunningJobs(Priority priority, int count) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    jobClass(priority).maxRunning = std::max(count, 1);
+    updateThreadCount();
+    startWaitingJobs();
+}
+
+int JobScheduler::maxRunningJobsPerMount() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return maxRunningPerMount_;
+}
+
+void JobScheduler::setMaxRunningJobsPerMount(int count) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    maxRunningPerMount_ = std::max(count, 1);
+    startWaitingJobs();
+}
+
+bool JobScheduler::isResponsive(const FilePath& location) {
+    const std::string mount = location ? mountKey(location) : std::string();
+    if (mount.empty()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = mounts_.find(mount);
+    return it == mounts_.end() || !it->second.unresponsive;
+}
+
+std::string JobScheduler::mountKey(const FilePath& path) {
+    if (!path.isNative()) {
+        // a remote location is keyed by its scheme and host, as "sftp://host"
+        std::string uri = path.uri().get();
+        auto sep = uri.find("://");
+        if (sep == std::string::npos) {
+            return std::string();
+        }
+        const std::string scheme = uri.substr(0, sep);
+        if (std::find(std::begin(kLocalSchemes), std::end(kLocalSchemes), scheme) != std::end(kLocalSchemes)) {
+            return std::string();
+        }
+        uri.resize(std::min(uri.size(), uri.find('/', sep + 3)));
+        return uri;
+    }
+
+    std::lock_guard<std::mutex> lock{mountTableMutex_};
+    if (mountPoints_.empty() || g_unix_mounts_changed_since(mountsRead_)) {
+        mountPoints_.clear();
+        GList* mounts = g_unix_mounts_get(&mountsRead_);
+        for (GList* l = mounts; l; l = l->next) {
+            auto mount = static_cast<GUnixMountEntry*>(l->data);
+            mountPoints_.emplace_back(g_unix_mount_get_mount_path(mount),
+                                      isRemoteFsType(g_unix_mount_get_fs_type(mount)));
+            g_unix_mount_free(mount);
+        }
+        g_list_free(mounts);
+        std::stable_sort(mountPoints_.begin(), mountPoints_.end(),
+                         [](const auto& a, const auto& b) { return a.first.size() > b.first.size(); });
+    }
+
+    const std::string localPath = path.localPath().get();
+    for (const auto& mountPoint : mountPoints_) {
+        const std::string& mountPath = mountPoint.first;
+        if (mountPath == "/" || (localPath.compare(0, mountPath.size(), mountPath) == 0 &&
+                                 (localPath.size() == mountPath.size() || localPath[mountPath.size()] == '/'))) {
+            return mountPoint.second ? "file://" + mountPath : std::string();
+        }
+    }
+    return std::string();
+}
+
+void JobScheduler::startWaitingJobs() {
+    // classes in the order of their priority, so that higher ones are started first
+    for (std::size_t i = 0; i < classes_.size(); ++i) {
+        auto& cls = classes_[i];
+        for (auto it = cls.waiting.begin(); it != cls.waiting.end() && cls.running < cls.maxRunning;) {
+            if (!it->mount.empty() && mounts_[it->mount].running >= maxRunningPerMount_) {
+                ++it;  // the jobs of other mounts behind it may start
+                continue;
+            }
+            WaitingJob waiting = std::move(*it);
+            it = cls.waiting.erase(it);
+            ++cls.running;
+            if (!waiting.mount.empty()) {
+                --mounts_[waiting.mount].waiting;
+            }
+            run(waiting.job, static_cast<Priority>(i), waiting.mount, true);
+        }
+    }
+}
+
+void JobScheduler::run(Job* job, Priority priority, const std::string& mount, bool counted) {
+    // a running job stops by itself once cancelled
+    disconnect(job, &Job::cancelled, this, nullptr);
+    const std::uint64_t ticket = nextTicket_++;
+    running_.emplace(ticket, RunningJob{priority, mount, counted, false});
+    if (!mount.empty()) {
+        MountGroup& group = mounts_[mount];
+        if (counted) {
+            ++group.running;
+        }
+        group.lastProgress = Clock::now();
+    }
+    auto runJob = [this, job, priority, ticket]() {
+        const bool lowPriority = priority == Priority::Prefetch || priority == Priority::Background;
+        if (lowPriority) {
+            QThread::currentThread()->setPriority(QThread::LowPriority);
+        }
+        job->run();  // |job| may be deleted from here on
+        if (lowPriority) {
+            QThread::currentThread()->setPriority(QThread::NormalPriority);
+        }
+        onJobFinished(ticket);
+    };
+    // jobs outside the limits only wait for a free thread, and before all others
+    pool_.start(runJob, counted ? 0 : 1);
+}
+
+void JobScheduler::onJobFinished(std::uint64_t ticket) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = running_.find(ticket);
+    const RunningJob job = std::move(it->second);
+    running_.erase(it);
+    if (job.counted) {
+        --jobClass(job.priority).running;
+    }
+    else if (job.writtenOff) {
+        --writtenOff_;
+        updateThreadCount();
+    }
+    if (!job.mount.empty()) {
+        auto group = mounts_.find(job.mount);
+        if (group != mounts_.end()) {
+            if (job.counted) {
+                --group->second.running;
+            }
+            group->second.lastProgress = Clock::now();
+        }
+    }
+    startWaitingJobs();
+}
+
+void JobScheduler::onJobCancelled(Job* job) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (std::size_t i = 0; i < classes_.size(); ++i) {
+        auto& waiting = classes_[i].waiting;
+        auto it = std::find_if(waiting.begin(), waiting.end(), [job](const WaitingJob& w) { return w.job == job; });
+        if (it != waiting.end()) {
+            const std::string mount = std::move(it->mount);
+            waiting.erase(it);
+            if (!mount.empty()) {
+                --mounts_[mount].waiting;
+            }
+            // outside the limit of its class, as it returns as soon as it starts
+            run(job, static_cast<Priority>(i), mount, false);
+            return;
+        }
+    }
+}
+
+void JobScheduler::onWatchdog() {
+    PerfTrace::add(PerfTrace::WakeupJobWatchdog);
+    std::vector<QString> unresponsive;
+    std::vector<QString> responsive;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        const auto now = Clock::now();
+        for (auto it = mounts_.begin(); it != mounts_.end();) {
+            const std::string& mount = it->first;
+            MountGroup& group = it->second;
+            if (group.probe) {
+                const ProbeState state = group.probe->load();
+                if (state == ProbeState::Running) {
+                    if (!group.unresponsive && now - group.probeStarted > kProbeTimeout) {
+                        markUnresponsive(mount, group);
+                        unresponsive.push_back(QString::fromStdString(mount));
+                    }
+                }
+                else {
+                    group.probe.reset();
+                    if (state == ProbeState::Answered) {
+                        group.lastProgress = now;
+                        if (group.unresponsive) {
+                            group.unresponsive = false;
+                            responsive.push_back(QString::fromStdString(mount));
+                        }
+                    }
+                    else if (!group.unresponsive) {
+                        markUnresponsive(mount, group);
+                        unresponsive.push_back(QString::fromStdString(mount));
+                    }
+                }
+            }
+            else if (group.unresponsive ? now - group.probeStarted > kProbeTimeout
+                                        : group.running > 0 && now - group.lastProgress > kStallTimeout) {
+                startProbe(mount, group);
+            }
+
+            if (group.running == 0 && group.waiting == 0 && !group.unresponsive && !group.probe) {
+                it = mounts_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        if (mounts_.empty()) {
+            watchdog_.stop();
+        }
+        startWaitingJobs();
+    }
+    for (const QString& mount : unresponsive) {
+        Q_EMIT mountUnresponsive(mount);
+    }
+    for (const QString& mount : responsive) {
+        Q_EMIT mountResponsive(mount);
+    }
+}
+
+void JobScheduler::startProbe(const std::string& mount, MountGroup& group) {
+    auto probe = std::make_shared<std::atomic<ProbeState>>(ProbeState::Running);
+    group.probe = probe;
+    group.probeStarted = Clock::now();
+    // never joined: on a hung mount, it returns only once the server answers again
+    std::thread([mount, probe]() {
+        probe->store(probeMount(mount) ? ProbeState::Answered : ProbeState::Failed);
+    }).detach();
+}
+
+void JobScheduler::markUnresponsive(const std::string& mount, MountGroup& group) {
+    group.unresponsive = true;
+    // its blocked jobs keep their threads, but no longer hold up the other jobs of their class
+    for (auto& entry : running_) {
+        RunningJob& job = entry.second;
+        if (job.counted && job.mount == mount) {
+            job.counted = false;
+            job.writtenOff = true;
+            --jobClass(job.priority).running;
+            --group.running;
+            ++writtenOff_;
+        }
+    }
+    updateThreadCount();
+    for (std::size_t i = 0; i < classes_.size(); ++i) {
+        auto& waiting = classes_[i].waiting;
+        for (auto it = waiting.begin(); it != waiting.end();) {
+            if (it->mount == mount) {
+                Job* job = it->job;
+                it = waiting.erase(it);
+                --group.waiting;
+                refuse(job, mount);
+                run(job, static_cast<Priority>(i), mount, false);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+}
+
+void JobScheduler::refuse(Job* job, const std::string& mount) {
+    job->fail(GErrorPtr{G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                        tr("%1 is not responding.").arg(QString::fromStdString(mount))});
+}
+
+void JobScheduler::updateThreadCount() {
+    int threads = writtenOff_;
+    for (const auto& cls : classes_) {
+        threads += cls.maxRunning;
+    }
+    pool_.setMaxThreadCount(threads);
+}
+
+}  // namespace Fm
@@ -0,0 +1,160 @@
+#ifndef FM2_JOBSCHEDULER_H
+#define FM2_JOBSCHEDULER_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "filepath.h"
+#include "job.h"
+
+namespace Fm {
+
+// Runs jobs on a shared set of worker threads by priority class. Each class has its own
+// limit of running jobs, so a backlog of thumbnails or size counts never delays listing
+// the folder the user has just opened, and waiting jobs start in the order of their class.
+//
+// The jobs of a location on a network filesystem or a remote server are also limited per
+// mount, so that a server which stops answering holds a few threads, not all of them. When
+// the jobs of a mount make no progress for a while, a watchdog probes the mount on a thread
+// of its own. If the probe does not come back in time, the mount is marked unresponsive: its
+// running jobs no longer count against the limits of their classes, and its new and waiting
+// jobs fail at once, until a later probe gets an answer.
+class LIBFM_QT_API JobScheduler : public QObject {
+    Q_OBJECT
+   public:
+    enum class Priority {
+        Interactive,        // listing and querying what the user is looking at
+        VisibleThumbnails,  // thumbnails of the files on screen
+        Prefetch,           // work the user may need soon
+        Background          // directory sizes and other long-running counts
+    };
+
+    explicit JobScheduler();
+
+    ~JobScheduler() override;
+
+    static JobScheduler* globalInstance();
+
+    // Runs |job| once fewer jobs of its class than the limit are running. As with
+    // Job::runAsync(), an auto-deleted job is deleted after it has finished. A job cancelled
+    // while waiting is run at once, so that it finishes and stops holding anything up.
+    void start(Job* job, Priority priority);
+
+    // Like start(), for a job working in |location|, which is limited and watched with the
+    // other jobs of its mount.
+    void start(Job* job, Priority priority, const FilePath& location);
+
+    // Moves |job| to the class of |priority| if it is still waiting in a lower one, as when
+    // what was prefetched is now asked for.
+    void promote(Job* job, Priority priority);
+
+    int maxRunningJobs(Priority priority) const;
+
+    void setMaxRunningJobs(Priority priority, int count);
+
+    // the limit of the running jobs of each network mount or remote server, of all classes
+    int maxRunningJobsPerMount() const;
+
+    void setMaxRunningJobsPerMount(int count);
+
+    // false while the mount holding |location| is marked unresponsive
+    bool isResponsive(const FilePath& location);
+
+   Q_SIGNALS:
+    // |mount| is the URI of the mount point or server, as "file:///mnt/nfs" or "sftp://host".
+    // Emitted in the thread of the scheduler.
+    void mountUnresponsive(const QString& mount);
+
+    void mountResponsive(const QString& mount);
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class ProbeState { Running, Answered, Failed };
+
+    struct WaitingJob {
+        Job* job;
+        std::string mount;  // empty if it is not limited per mount
+    };
+
+    struct JobClass {
+        std::deque<WaitingJob> waiting;
+        int running = 0;
+        int maxRunning = 1;
+    };
+
+    struct RunningJob {
+        Priority priority;
+        std::string mount;
+        bool counted;     // in the running jobs of its class and mount
+        bool writtenOff;  // no longer counted, as its mount stopped answering
+    };
+
+    struct MountGroup {
+        int running = 0;
+        int waiting = 0;
+        bool unresponsive = false;
+        Clock::time_point lastProgress;  // when a job of the mount last started or finished
+        std::shared_ptr<std::atomic<ProbeState>> probe;
+        Clock::time_point probeStarted;
+    };
+
+    // The key of the mount holding |path| if its jobs are limited per mount, or an empty
+    // string. Only reads the mount table, which never blocks on the filesystems themselves.
+    std::string mountKey(const FilePath& path);
+
+    // should be called with mutex_ locked
+    void startWaitingJobs();
+
+    void run(Job* job, Priority priority, const std::string& mount, bool counted);
+
+    void onJobFinished(std::uint64_t ticket);
+
+    void onJobCancelled(Job* job);
+
+    void onWatchdog();
+
+    // should be called with mutex_ locked
+    void startProbe(const std::string& mount, MountGroup& group);
+
+    // should be called with mutex_ locked
+    void markUnresponsive(const std::string& mount, MountGroup& group);
+
+    // should be called with mutex_ locked
+    void refuse(Job* job, const std::string& mount);
+
+    // should be called with mutex_ locked
+    void updateThreadCount();
+
+    JobClass& jobClass(Priority priority) { return classes_[static_cast<std::size_t>(priority)]; }
+
+    mutable std::mutex mutex_;
+    std::array<JobClass, 4> classes_;
+    std::unordered_map<std::uint64_t, RunningJob> running_;  // by ticket
+    std::uint64_t nextTicket_ = 0;
+    std::unordered_map<std::string, MountGroup> mounts_;  // by mountKey()
+    int maxRunningPerMount_;
+    int writtenOff_ = 0;  // running jobs given threads beyond the limits of the classes
+    QThreadPool pool_;
+    QTimer watchdog_;
+
+    std::mutex mountTableMutex_;
+    std::vector<std::pair<std::string, bool>> mountPoints_;  // and whether each is remote, the longest first
+    std::uint64_t mountsRead_ = 0;                           // when mountPoints_ was read
+};
+
+}  // namespace Fm
+
+#endif  // FM2_JOBSCHEDULER_H
@@ -32,6 +32,7 @@
 
 #include "fm-app-info.h"
 #include "fm-config.h"
+#include "../vfs/vfs-archive.h"
 
 #include <string.h>
 #include <gio/gdesktopappinfo.h>
@@ -58,6 +59,8 @@ static void append_file_to_cmd(GFile* gf, GString* cmd) {
                 file = g_filename_from_uri(orig_path, NULL, NULL);
             g_object_unref(inf);
         }
+        else if (g_file_has_uri_scheme(gf, "archive")) /* hand out an extracted copy of the member */
+            file = _fm_vfs_archive_get_local_copy(gf, NULL, NULL);
         if (file == NULL)
             return;
     }
@@ -92,6 +95,14 @@ static void append_uri_to_cmd(GFile* gf, GString* cmd) {
                 g_object_unref(inf);
             }
         }
+        else if (g_file_has_uri_scheme(gf, "archive")) {
+            /* applications cannot open archive:// so pass them the extracted member */
+            path = _fm_vfs_archive_get_local_copy(gf, NULL, NULL);
+            if (path) {
+                uri = g_filename_to_uri(path, NULL, NULL);
+                g_free(path);
+            }
+        }
     }
     if (!uri) {
         uri = g_file_get_uri(gf);
@@ -0,0 +1,503 @@
+#include "listingsnapshot.h"
+#include "gioptrs.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'M', 'L', 'I', 'S', 'T', 'S', '1'};
+constexpr char kSuffix[] = ".listing";
+
+// listings of at least this many files, or that took this long (in ms), are kept
+constexpr std::size_t kMinFiles = 1000;
+constexpr qint64 kMinElapsed = 1000;
+// a snapshot of more files than this is not read back
+constexpr std::uint32_t kMaxFiles = 1 << 22;
+// snapshots are written in chunks of about this size
+constexpr std::size_t kWriteChunk = 1 << 20;
+// the attribute FileInfo::isTrustable() reads
+constexpr char kTrustAttribute[] = "metadata::trust";
+
+enum Flag : std::uint32_t {
+    Accessible = 1 << 0,
+    Writable = 1 << 1,
+    Deletable = 1 << 2,
+    Hidden = 1 << 3,
+    Backup = 1 << 4,
+    NameChangeable = 1 << 5,
+    IconChangeable = 1 << 6,
+    HiddenChangeable = 1 << 7,
+    ReadOnly = 1 << 8,
+    Remote = 1 << 9,
+    Shortcut = 1 << 10,
+    Mountable = 1 << 11,
+    CanMount = 1 << 12,
+    CanUnmount = 1 << 13,
+    CanEject = 1 << 14,
+    Deferred = 1 << 15,  // the content type is a guess from the name
+};
+
+// the strings of a record, written after it in this order
+enum Field {
+    Name,
+    DisplayName,
+    Target,
+    MimeTypeName,
+    Icon,  // as g_icon_to_string() gives it
+    FileId,
+    FilesystemId,
+    EditName,
+    Trust,
+    Emblems,  // the names, separated by newlines
+    NumFields
+};
+
+// The fixed part of the record of a file, followed by its strings.
+struct Record {
+    std::uint64_t size;
+    std::uint64_t mtime;
+    std::uint64_t atime;
+    std::uint64_t ctime;
+    std::uint64_t crtime;
+    std::uint32_t mode;
+    std::uint32_t uid;
+    std::uint32_t gid;
+    std::uint32_t linkCount;
+    std::uint32_t flags;
+    std::uint32_t lengths[NumFields];
+    std::uint32_t reserved;
+};
+
+// What identifies the directory a snapshot was taken of, after the magic and its path.
+struct DirState {
+    std::uint64_t device;
+    std::uint64_t inode;
+    std::int64_t mtime;  // in nanoseconds
+    std::uint32_t count;
+    std::uint32_t reserved;
+};
+
+std::int64_t mtimeOf(const struct stat& st) {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool writeAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool readAll(const std::string& file, std::string& data) {
+    const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (ok) {
+        data.resize(static_cast<std::size_t>(st.st_size));
+        std::size_t done = 0;
+        while (done < data.size()) {
+            const ssize_t n = read(fd, &data[done], data.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += static_cast<std::size_t>(n);
+        }
+        ok = done == data.size();
+    }
+    close(fd);
+    return ok;
+}
+
+std::string iconString(const std::shared_ptr<const IconInfo>& icon) {
+    if (!icon || !icon->isValid()) {
+        return {};
+    }
+    CStrPtr str{g_icon_to_string(icon->gicon().get())};
+    return str ? str.get() : std::string{};
+}
+
+std::string emblemsString(GFileInfo* inf) {
+    std::string names;
+    if (char** emblems = g_file_info_get_attribute_stringv(inf, "metadata::emblems")) {
+        for (char** name = emblems; *name; ++name) {
+            if (!names.empty()) {
+                names += '\n';
+            }
+            names += *name;
+        }
+    }
+    return names;
+}
+
+}  // namespace
+
+std::atomic<bool> ListingSnapshot::enabled_{false};
+
+ListingSnapshot::ListingSnapshot(std::string cacheDir) : cacheDir_{std::move(cacheDir)} {}
+
+ListingSnapshot::~ListingSnapshot() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    queued_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+std::shared_ptr<ListingSnapshot> ListingSnapshot::globalInstance() {
+    static const std::shared_ptr<ListingSnapshot> snapshots = [] {
+        CStrPtr dir{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "listings", nullptr)};
+        return std::make_shared<ListingSnapshot>(dir.get());
+    }();
+    return snapshots;
+}
+
+bool ListingSnapshot::isWorthKeeping(std::size_t fileCount, qint64 elapsedMs) {
+    return fileCount >= kMinFiles || (fileCount > 0 && elapsedMs >= kMinElapsed);
+}
+
+std::string ListingSnapshot::snapshotFile(const std::string& localPath) const {
+    CStrPtr checksum{g_compute_checksum_for_string(G_CHECKSUM_SHA1, localPath.c_str(), -1)};
+    return cacheDir_ + '/' + checksum.get() + kSuffix;
+}
+
+void ListingSnapshot::appendRecord(std::string& data, const FileInfo& file, bool deferred) {
+    GFileInfo* inf = file.inf_.get();
+    const char* editName = inf ? g_file_info_get_edit_name(inf) : nullptr;
+    const char* trust = inf && g_file_info_get_attribute_type(inf, kTrustAttribute) == G_FILE_ATTRIBUTE_TYPE_STRING
+                            ? g_file_info_get_attribute_string(inf, kTrustAttribute)
+                            : nullptr;
+    const std::string fields[NumFields] = {
+        file.name_,
+        file.dispName_.toStdString(),
+        file.target_,
+        file.mimeType_ ? file.mimeType_->name() : "",
+        iconString(file.icon_),
+        file.fileId_ ? file.fileId_ : "",
+        file.filesystemId_ ? file.filesystemId_ : "",
+        editName ? editName : "",
+        trust ? trust : "",
+        inf ? emblemsString(inf) : std::string{},
+    };
+
+    Record record{};
+    record.size = file.size_;
+    record.mtime = file.mtime_;
+    record.atime = file.atime_;
+    record.ctime = file.ctime_;
+    record.crtime = file.crtime_;
+    record.mode = file.mode_;
+    record.uid = file.uid_;
+    record.gid = file.gid_;
+    record.linkCount = file.linkCount_;
+    auto setFlag = [&record](bool set, Flag flag) {
+        if (set) {
+            record.flags |= flag;
+        }
+    };
+    setFlag(file.isAccessible_, Accessible);
+    setFlag(file.isWritable_, Writable);
+    setFlag(file.isDeletable_, Deletable);
+    setFlag(file.isHidden_, Hidden);
+    setFlag(file.isBackup_, Backup);
+    setFlag(file.isNameChangeable_, NameChangeable);
+    setFlag(file.isIconChangeable_, IconChangeable);
+    setFlag(file.isHiddenChangeable_, HiddenChangeable);
+    setFlag(file.isReadOnly_, ReadOnly);
+    setFlag(file.isRemote_, Remote);
+    setFlag(file.isShortcut_, Shortcut);
+    setFlag(file.isMountable_, Mountable);
+    setFlag(file.canMount_, CanMount);
+    setFlag(file.canUnmount_, CanUnmount);
+    setFlag(file.canEject_, CanEject);
+    setFlag(deferred, Deferred);
+    for (int field = 0; field < NumFields; ++field) {
+        record.lengths[field] = static_cast<std::uint32_t>(fields[field].size());
+    }
+    data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    for (const auto& field : fields) {
+        data += field;
+    }
+}
+
+std::shared_ptr<FileInfo> ListingSnapshot::readRecord(const char* data,
+                                                      std::size_t size,
+                                                      std::size_t& pos,
+                                                      const FilePath& dirPath,
+                                                      bool& deferred,
+                                                      FileInfoPool* pool) {
+    Record record;
+    if (pos + sizeof(record) > size) {
+        return nullptr;
+    }
+    std::memcpy(&record, data + pos, sizeof(record));
+    pos += sizeof(record);
+    std::string fields[NumFields];
+    for (int field = 0; field < NumFields; ++field) {
+        if (record.lengths[field] > size - pos) {
+            return nullptr;
+        }
+        fields[field].assign(data + pos, record.lengths[field]);
+        pos += record.lengths[field];
+    }
+    if (fields[Name].empty() || fields[MimeTypeName].empty()) {
+        return nullptr;
+    }
+
+    auto file = FileInfoPool::makeFileInfo(pool);
+    file->name_ = std::move(fields[Name]);
+    file->dispName_ = QString::fromStdString(fields[DisplayName]);
+    file->dirPath_ = dirPath;
+    file->target_ = std::move(fields[Target]);
+    file->mode_ = record.mode;
+    file->uid_ = record.uid;
+    file->gid_ = record.gid;
+    file->linkCount_ = record.linkCount;
+    file->size_ = record.size;
+    file->mtime_ = record.mtime;
+    file->atime_ = record.atime;
+    file->ctime_ = record.ctime;
+    file->crtime_ = record.crtime;
+    file->dtime_ = 0;
+    file->blksize_ = file->blocks_ = 0;
+    // interned like the ids of a listing, so that the two compare as pointers
+    file->filesystemId_ = fields[FilesystemId].empty() ? nullptr : g_intern_string(fields[FilesystemId].c_str());
+    file->fileId_ = fields[FileId].empty() ? nullptr : g_intern_string(fields[FileId].c_str());
+    file->mimeType_ = MimeType::fromName(fields[MimeTypeName].c_str());
+    if (!fields[Icon].empty()) {
+        GIconPtr gicon{g_icon_new_for_string(fields[Icon].c_str(), nullptr), false};
+        if (gicon) {
+            file->icon_ = IconInfo::fromGIcon(gicon);
+        }
+    }
+    if (!file->icon_) {
+        file->icon_ = file->mimeType_->icon();
+    }
+    file->isAccessible_ = record.flags & Accessible;
+    file->isWritable_ = record.flags & Writable;
+    file->isDeletable_ = record.flags & Deletable;
+    file->isHidden_ = record.flags & Hidden;
+    file->isBackup_ = record.flags & Backup;
+    file->isNameChangeable_ = record.flags & NameChangeable;
+    file->isIconChangeable_ = record.flags & IconChangeable;
+    file->isHiddenChangeable_ = record.flags & HiddenChangeable;
+    file->isReadOnly_ = record.flags & ReadOnly;
+    file->isRemote_ = record.flags & Remote;
+    file->isShortcut_ = record.flags & Shortcut;
+    file->isMountable_ = record.flags & Mountable;
+    file->canMount_ = record.flags & CanMount;
+    file->canUnmount_ = record.flags & CanUnmount;
+    file->canEject_ = record.flags & CanEject;
+    file->hasDetails_ = true;  // only listings are kept
+
+    // what the compact GFileInfo of the file held
+    file->inf_ = GFileInfoPtr{g_file_info_new(), false};
+    if (!fields[EditName].empty()) {
+        g_file_info_set_edit_name(file->inf_.get(), fields[EditName].c_str());
+    }
+    if (!fields[Trust].empty()) {
+        g_file_info_set_attribute_string(file->inf_.get(), kTrustAttribute, fields[Trust].c_str());
+    }
+    if (!fields[Emblems].empty()) {
+        CStrArrayPtr names{g_strsplit(fields[Emblems].c_str(), "\n", -1)};
+        g_file_info_set_attribute_stringv(file->inf_.get(), "metadata::emblems", names.get());
+        file->setEmblems(file->inf_.get());
+    }
+    file->accountMemory();
+    deferred = record.flags & Deferred;
+    return file;
+}
+
+bool ListingSnapshot::load(const FilePath& dirPath,
+                           FileInfoList& files,
+                           FileInfoList& deferredFiles,
+                           FileInfoPool* pool) const {
+    auto localPath = dirPath.localPath();
+    if (!localPath) {
+        return false;
+    }
+    const std::string path{localPath.get()};
+    std::string data;
+    struct stat st;
+    if (!readAll(snapshotFile(path), data) || stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+
+    // the magic, the length of the directory path, the path, and the state of the directory
+    std::size_t pos = sizeof(kMagic);
+    std::uint32_t pathLength = 0;
+    DirState state;
+    if (data.size() < pos + sizeof(pathLength) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        return false;
+    }
+    std::memcpy(&pathLength, data.data() + pos, sizeof(pathLength));
+    pos += sizeof(pathLength);
+    if (data.size() < pos + pathLength + sizeof(state) || data.compare(pos, pathLength, path) != 0) {
+        return false;
+    }
+    pos += pathLength;
+    std::memcpy(&state, data.data() + pos, sizeof(state));
+    pos += sizeof(state);
+    if (state.device != static_cast<std::uint64_t>(st.st_dev) || state.inode != static_cast<std::uint64_t>(st.st_ino) ||
+        state.mtime != mtimeOf(st) || state.count > kMaxFiles) {
+        return false;
+    }
+
+    FileInfoList loaded;
+    FileInfoList deferred;
+    loaded.reserve(state.count);
+    for (std::uint32_t i = 0; i < state.count; ++i) {
+        bool isDeferred = false;
+        auto file = readRecord(data.data(), data.size(), pos, dirPath, isDeferred, pool);
+        if (!file) {
+            return false;
+        }
+        if (isDeferred) {
+            deferred.push_back(file);
+        }
+        loaded.push_back(std::move(file));
+    }
+    if (pos != data.size()) {
+        return false;
+    }
+    files = std::move(loaded);
+    deferredFiles = std::move(deferred);
+    return true;
+}
+
+void ListingSnapshot::save(const FilePath& dirPath,
+                           quint64 dirMtime,
+                           const FileInfoList& files,
+                           const std::function<bool(const FileInfo& file)>& isDeferred) {
+    auto localPath = dirPath.localPath();
+    if (!localPath || files.empty() || files.size() > kMaxFiles) {
+        return;
+    }
+
+    // the files are read here, in the thread that may change them; only the bytes are written later
+    Write write{localPath.get(), dirMtime, static_cast<std::uint32_t>(files.size()), {}};
+    write.data.reserve(files.size() * (sizeof(Record) + 128));
+    for (const auto& file : files) {
+        appendRecord(write.data, *file, isDeferred && isDeferred(*file));
+    }
+
+    const std::string file = snapshotFile(write.localPath);
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        pending_[file] = std::move(write);
+        if (!writer_.joinable()) {
+            writer_ = std::thread([this] { writeQueued(); });
+        }
+    }
+    queued_.notify_one();
+}
+
+void ListingSnapshot::writeQueued() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    for (;;) {
+        queued_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty()) {  // and stopping
+            return;
+        }
+        auto it = pending_.begin();
+        const std::string file = it->first;
+        const Write write = std::move(it->second);
+        pending_.erase(it);
+        lock.unlock();
+        if (writeSnapshot(file, write)) {
+            removeOldest();
+        }
+        lock.lock();
+    }
+}
+
+bool ListingSnapshot::writeSnapshot(const std::string& file, const Write& write) const {
+    // a directory modified since it was listed may hold other files than the listing
+    struct stat st;
+    if (stat(write.localPath.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+        static_cast<quint64>(st.st_mtim.tv_sec) != write.dirMtime) {
+        unlink(file.c_str());
+        return false;
+    }
+
+    g_mkdir_with_parents(cacheDir_.c_str(), 0700);
+    const std::string tmpFile = file + ".tmp";
+    const int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    std::string header{kMagic, sizeof(kMagic)};
+    const auto pathLength = static_cast<std::uint32_t>(write.localPath.size());
+    header.append(reinterpret_cast<const char*>(&pathLength), sizeof(pathLength));
+    header += write.localPath;
+    DirState state{};
+    state.device = st.st_dev;
+    state.inode = st.st_ino;
+    state.mtime = mtimeOf(st);
+    state.count = write.count;
+    header.append(reinterpret_cast<const char*>(&state), sizeof(state));
+
+    bool ok = writeAll(fd, header.data(), header.size());
+    for (std::size_t pos = 0; ok && pos < write.data.size(); pos += kWriteChunk) {
+        ok = writeAll(fd, write.data.data() + pos, std::min(kWriteChunk, write.data.size() - pos));
+    }
+    if (close(fd) != 0 || !ok || rename(tmpFile.c_str(), file.c_str()) != 0) {
+        unlink(tmpFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ListingSnapshot::removeOldest() const {
+    DIR* dir = opendir(cacheDir_.c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<std::pair<std::int64_t, std::string>> snapshots;  // by modification time
+    const std::size_t suffixLength = sizeof(kSuffix) - 1;
+    while (struct dirent* entry = readdir(dir)) {
+        const std::size_t length = std::strlen(entry->d_name);
+        if (length <= suffixLength || std::strcmp(entry->d_name + length - suffixLength, kSuffix) != 0) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            snapshots.emplace_back(mtimeOf(st), entry->d_name);
+        }
+    }
+    if (snapshots.size() > kMaxSnapshots) {
+        const auto oldest = snapshots.begin() + (snapshots.size() - kMaxSnapshots);
+        std::nth_element(snapshots.begin(), oldest, snapshots.end());
+        for (auto it = snapshots.begin(); it != oldest; ++it) {
+            unlinkat(dirfd(dir), it->second.c_str(), 0);
+        }
+    }
+    closedir(dir);
+}
+
+}  // namespace Fm
@@ -0,0 +1,101 @@
+#ifndef FM2_LISTINGSNAPSHOT_H
+#define FM2_LISTINGSNAPSHOT_H
+
+#include "../libfmqtglobals.h"
+#include "fileinfo.h"
+#include "fileinfopool.h"
+#include "filepath.h"
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace Fm {
+
+// Keeps the last listing of big or slow local folders in a file below $XDG_CACHE_HOME, so
+// that a folder opened again can be shown at once while it is listed again; Folder then only
+// reports what the new listing changed. A snapshot is keyed by the path of its directory and
+// only read back while the directory has the device, inode and modification time it had when
+// the listing was taken. Snapshots are written by a thread of their own, and the oldest are
+// removed past kMaxSnapshots. Off until setEnabled(true). Used from the main thread.
+class LIBFM_QT_API ListingSnapshot {
+   public:
+    // more snapshots than this are removed, the least recently written first
+    static constexpr std::size_t kMaxSnapshots = 256;
+
+    // |cacheDir| is where the snapshots are kept; it is only created on the first write.
+    explicit ListingSnapshot(std::string cacheDir);
+
+    ~ListingSnapshot();
+
+    static std::shared_ptr<ListingSnapshot> globalInstance();
+
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // Whether a listing of |fileCount| files that took |elapsedMs| is worth keeping.
+    static bool isWorthKeeping(std::size_t fileCount, qint64 elapsedMs);
+
+    // Reads the snapshot of the local directory |dirPath| if it is still current. The files
+    // whose content type was only guessed from their names are also added to |deferredFiles|.
+    // The files are allocated from |pool| when there is one.
+    bool load(const FilePath& dirPath,
+              FileInfoList& files,
+              FileInfoList& deferredFiles,
+              FileInfoPool* pool = nullptr) const;
+
+    // Keeps |files| as the listing of |dirPath|, listed while the directory had the modification
+    // time |dirMtime|; nothing is kept if it was modified since. |isDeferred| tells the files
+    // whose content type is a guess.
+    void save(const FilePath& dirPath,
+              quint64 dirMtime,
+              const FileInfoList& files,
+              const std::function<bool(const FileInfo& file)>& isDeferred);
+
+    // The record of |file| in a snapshot, also the format in which SharedListingService hands
+    // listings to other processes; |deferred| tells that its content type is a guess.
+    static void appendRecord(std::string& data, const FileInfo& file, bool deferred);
+
+    // Reads the record at |pos| in the |size| bytes of |data|, of a file in |dirPath|, and moves
+    // |pos| past it, allocating the file from |pool| when there is one. Null if the record is
+    // cut short or malformed.
+    static std::shared_ptr<FileInfo> readRecord(const char* data,
+                                                std::size_t size,
+                                                std::size_t& pos,
+                                                const FilePath& dirPath,
+                                                bool& deferred,
+                                                FileInfoPool* pool = nullptr);
+
+   private:
+    struct Write {
+        std::string localPath;  // of the directory
+        quint64 dirMtime;
+        std::uint32_t count;
+        std::string data;  // the records, without the header
+    };
+
+    std::string snapshotFile(const std::string& localPath) const;
+    void writeQueued();
+    bool writeSnapshot(const std::string& file, const Write& write) const;
+    void removeOldest() const;
+
+    static std::atomic<bool> enabled_;
+
+    std::string cacheDir_;
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::unordered_map<std::string, Write> pending_;  // by snapshot file, the latest listing only
+    bool stopping_ = false;
+    std::thread writer_;  // started on the first save()
+};
+
+}  // namespace Fm
+
+#endif  // FM2_LISTINGSNAPSHOT_H
@@ -0,0 +1,382 @@
+#include "localattrwalker.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64)
+#define FM_NATIVE_ATTR_WALK 1
+#endif
+
+namespace Fm {
+
+mode_t LocalAttrWalker::newMode(mode_t oldMode, bool isDir, const Change& change) {
+    mode_t mode = oldMode & 07777;
+    mode &= ~change.modeMask;
+    mode |= (change.mode & change.modeMask);
+    /* FIXME: this behavior should be optional. */
+    /* treat dirs with 'r' as 'rx' */
+    if (isDir) {
+        if ((change.modeMask & S_IRUSR) && (mode & S_IRUSR)) {
+            mode |= S_IXUSR;
+        }
+        if ((change.modeMask & S_IRGRP) && (mode & S_IRGRP)) {
+            mode |= S_IXGRP;
+        }
+        if ((change.modeMask & S_IROTH) && (mode & S_IROTH)) {
+            mode |= S_IXOTH;
+        }
+    }
+    return mode;
+}
+
+LocalAttrWalker::LocalAttrWalker(const Change& change, bool recursive) : change_{change}, recursive_{recursive} {}
+
+#ifdef FM_NATIVE_ATTR_WALK
+
+namespace {
+
+constexpr unsigned int kMaxThreads = 8;
+constexpr std::size_t kDirentBufferSize = 64 * 1024;
+
+struct LinuxDirent64 {
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// A directory descriptor shared by the entries still to be changed relative to it.
+struct DirFd {
+    explicit DirFd(int fd) : fd{fd} {}
+    ~DirFd() { close(fd); }
+    DirFd(const DirFd&) = delete;
+    DirFd& operator=(const DirFd&) = delete;
+
+    const int fd;
+};
+
+// A directory being walked. One whose new mode would keep the walk from reading it is only
+// changed once it and all of its subdirectories are done.
+struct DirNode {
+    DirNode(std::shared_ptr<DirNode> parent, std::string path, std::size_t nameOffset, const struct stat& st)
+        : parent{std::move(parent)}, path{std::move(path)}, nameOffset{nameOffset}, st(st) {}
+
+    const std::shared_ptr<DirNode> parent;
+    const std::string path;
+    const std::size_t nameOffset;  // where the name relative to the parent's descriptor starts
+    const struct stat st;
+
+    std::shared_ptr<DirFd> deferredFd;  // the parent's descriptor, kept while the change waits
+    bool deferred = false;
+    std::atomic<unsigned int> unfinished{1};  // itself and the subdirectories not done yet
+};
+
+struct PendingDir {
+    std::shared_ptr<DirFd> parentFd;  // null for the roots, which are opened by path
+    std::shared_ptr<DirNode> node;
+};
+
+struct WalkState {
+    GCancellable* cancellable = nullptr;
+    LocalAttrWalker::Change change;
+    uid_t euid = 0;
+
+    // directories are taken from the back, so that the walk goes depth first and only the
+    // descriptors of the directories along the paths being walked stay open
+    std::mutex mutex;
+    std::condition_variable workCond;
+    std::condition_variable doneCond;
+    std::vector<PendingDir> pending;
+    unsigned int busy = 0;
+    bool done = false;
+
+    std::atomic<std::uint64_t> visited{0};
+    std::atomic<std::uint64_t> changed{0};
+
+    std::mutex errorMutex;
+    std::vector<std::pair<std::string, int>> errors;
+
+    bool isCancelled() const { return g_cancellable_is_cancelled(cancellable); }
+
+    void addError(const std::string& dirPath, const char* name, int error) {
+        std::string path = dirPath;
+        if (!path.empty() && path.back() != '/') {
+            path += '/';
+        }
+        path += name;
+        std::lock_guard<std::mutex> lock{errorMutex};
+        errors.emplace_back(std::move(path), error);
+    }
+};
+
+// Changes the entry |name| of the directory |dirFd|, whose path is |dirPath|, unless it
+// already is as requested.
+void changeEntry(WalkState& state, int dirFd, const std::string& dirPath, const char* name, const struct stat& st) {
+    const auto& change = state.change;
+    const bool ownerDiffers = change.setOwner && change.uid != st.st_uid;
+    const bool groupDiffers = change.setGroup && change.gid != st.st_gid;
+    bool changed = false;
+    if (ownerDiffers || groupDiffers) {
+        if (fchownat(dirFd, name, ownerDiffers ? change.uid : static_cast<uid_t>(-1),
+                     groupDiffers ? change.gid : static_cast<gid_t>(-1), AT_SYMLINK_NOFOLLOW) != 0) {
+            state.addError(dirPath, name, errno);
+            return;
+        }
+        changed = true;
+    }
+    // the mode of a symlink cannot be changed, and is never used anyway
+    if (change.modeMask && !S_ISLNK(st.st_mode)) {
+        const mode_t oldMode = st.st_mode & 07777;
+        const mode_t mode = LocalAttrWalker::newMode(oldMode, S_ISDIR(st.st_mode), change);
+        // changing the owner may have cleared the set-id bits
+        if (mode != oldMode || (changed && (oldMode & (S_ISUID | S_ISGID)))) {
+            if (fchmodat(dirFd, name, mode, 0) != 0) {
+                state.addError(dirPath, name, errno);
+            }
+            else {
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        state.changed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Whether the directory |st| can be changed before it is read, the user still being allowed
+// to list and enter it afterwards.
+bool canChangeFirst(const WalkState& state, const struct stat& st) {
+    if (state.euid == 0) {
+        return true;
+    }
+    const auto& change = state.change;
+    const uid_t owner = change.setOwner ? change.uid : st.st_uid;
+    const mode_t mode = change.modeMask ? LocalAttrWalker::newMode(st.st_mode, true, change) : st.st_mode;
+    return owner == state.euid && (mode & (S_IRUSR | S_IXUSR)) == (S_IRUSR | S_IXUSR);
+}
+
+// Changes the directory |node| now, or marks it to be changed once its tree is done.
+void changeDirOrDefer(WalkState& state, const std::shared_ptr<DirFd>& parentFd, DirNode& node) {
+    if (canChangeFirst(state, node.st)) {
+        const std::string dirPath = node.path.substr(0, node.nameOffset);
+        changeEntry(state, parentFd ? parentFd->fd : AT_FDCWD, dirPath, node.path.c_str() + node.nameOffset,
+                    node.st);
+    }
+    else {
+        node.deferred = true;
+        node.deferredFd = parentFd;
+    }
+}
+
+// Marks |node| as done, and its parents as well when it was the last one they waited for.
+void finishDir(WalkState& state, std::shared_ptr<DirNode> node) {
+    while (node && node->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (node->deferred && !state.isCancelled()) {
+            const std::string dirPath = node->path.substr(0, node->nameOffset);
+            changeEntry(state, node->deferredFd ? node->deferredFd->fd : AT_FDCWD, dirPath,
+                        node->path.c_str() + node->nameOffset, node->st);
+        }
+        node->deferredFd.reset();
+        node = node->parent;
+    }
+}
+
+// Changes the entries of |dir| and returns its subdirectories in |subdirs|.
+void walkDir(WalkState& state, const PendingDir& dir, std::vector<PendingDir>& subdirs) {
+    DirNode& node = *dir.node;
+    const char* name = node.path.c_str() + node.nameOffset;
+    const int fd = openat(dir.parentFd ? dir.parentFd->fd : AT_FDCWD, name,
+                          O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        state.addError(std::string(), node.path.c_str(), errno);
+        return;
+    }
+    auto dirFd = std::make_shared<DirFd>(fd);
+
+    // 8-byte aligned, as the records are
+    std::unique_ptr<std::uint64_t[]> buffer{new std::uint64_t[kDirentBufferSize / sizeof(std::uint64_t)]};
+    char* const records = reinterpret_cast<char*>(buffer.get());
+    while (!state.isCancelled()) {
+        const long n = syscall(SYS_getdents64, fd, records, kDirentBufferSize);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            state.addError(std::string(), node.path.c_str(), errno);
+        }
+        if (n <= 0) {
+            break;
+        }
+        std::uint64_t visited = 0;
+        for (long pos = 0; pos < n;) {
+            const auto* entry = reinterpret_cast<const LinuxDirent64*>(records + pos);
+            pos += entry->d_reclen;
+            const char* entryName = entry->d_name;
+            if (entryName[0] == '.' && (entryName[1] == '\0' || (entryName[1] == '.' && entryName[2] == '\0'))) {
+                continue;
+            }
+            struct stat st;
+            if (fstatat(fd, entryName, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;  // removed since it was listed
+            }
+            ++visited;
+            if (S_ISDIR(st.st_mode)) {
+                std::string path = node.path;
+                if (path.back() != '/') {
+                    path += '/';
+                }
+                const std::size_t nameOffset = path.size();
+                path += entryName;
+                auto subdir = std::make_shared<DirNode>(dir.node, std::move(path), nameOffset, st);
+                changeDirOrDefer(state, dirFd, *subdir);
+                node.unfinished.fetch_add(1, std::memory_order_relaxed);
+                subdirs.push_back(PendingDir{dirFd, std::move(subdir)});
+            }
+            else {
+                changeEntry(state, fd, node.path, entryName, st);
+            }
+        }
+        state.visited.fetch_add(visited, std::memory_order_relaxed);
+    }
+}
+
+void runWorker(WalkState& state) {
+    std::vector<PendingDir> subdirs;
+    std::unique_lock<std::mutex> lock{state.mutex};
+    for (;;) {
+        state.workCond.wait(lock, [&] { return !state.pending.empty() || state.done; });
+        if (state.done) {
+            return;
+        }
+        PendingDir dir = std::move(state.pending.back());
+        state.pending.pop_back();
+        ++state.busy;
+        lock.unlock();
+
+        if (!state.isCancelled()) {
+            walkDir(state, dir, subdirs);
+        }
+        dir.parentFd.reset();
+        finishDir(state, std::move(dir.node));
+
+        lock.lock();
+        --state.busy;
+        if (state.isCancelled()) {
+            // the deferred directories of the dropped ones are left as they are
+            state.pending.clear();
+            subdirs.clear();
+        }
+        const bool hasSubdirs = !subdirs.empty();
+        std::move(subdirs.begin(), subdirs.end(), std::back_inserter(state.pending));
+        subdirs.clear();
+        if (state.pending.empty() && state.busy == 0) {
+            state.done = true;
+            state.workCond.notify_all();
+            state.doneCond.notify_all();
+        }
+        else if (hasSubdirs) {
+            state.workCond.notify_all();
+        }
+    }
+}
+
+}  // namespace
+
+bool LocalAttrWalker::isSupported() {
+    return true;
+}
+
+bool LocalAttrWalker::addRoot(const std::string& path) {
+    struct stat st;
+    if (path.empty() || lstat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    roots_.push_back(path);
+    return true;
+}
+
+void LocalAttrWalker::walk(GCancellable* cancellable,
+                           std::chrono::milliseconds interval,
+                           const std::function<void(std::uint64_t visited)>& reportProgress) {
+    WalkState state;
+    state.cancellable = cancellable;
+    state.change = change_;
+    state.euid = geteuid();
+    for (const auto& root : roots_) {
+        if (state.isCancelled()) {
+            break;
+        }
+        struct stat st;
+        if (lstat(root.c_str(), &st) != 0) {
+            state.addError(std::string(), root.c_str(), errno);
+            continue;
+        }
+        ++state.visited;
+        if (recursive_ && S_ISDIR(st.st_mode)) {
+            auto node = std::make_shared<DirNode>(nullptr, root, 0, st);
+            changeDirOrDefer(state, nullptr, *node);
+            state.pending.push_back(PendingDir{nullptr, std::move(node)});
+        }
+        else {
+            changeEntry(state, AT_FDCWD, std::string(), root.c_str(), st);
+        }
+    }
+    // the first roots are walked first
+    std::reverse(state.pending.begin(), state.pending.end());
+
+    if (!state.pending.empty()) {
+        const unsigned int nThreads = std::max(1u, std::min(kMaxThreads, std::thread::hardware_concurrency()));
+        std::vector<std::thread> threads;
+        for (unsigned int i = 0; i < nThreads; ++i) {
+            threads.emplace_back(runWorker, std::ref(state));
+        }
+        {
+            std::unique_lock<std::mutex> lock{state.mutex};
+            while (!state.doneCond.wait_for(lock, interval, [&] { return state.done; })) {
+                lock.unlock();
+                if (reportProgress) {
+                    reportProgress(state.visited.load(std::memory_order_relaxed));
+                }
+                lock.lock();
+            }
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    visited_ = state.visited.load(std::memory_order_relaxed);
+    changed_ = state.changed.load(std::memory_order_relaxed);
+    errors_ = std::move(state.errors);
+    roots_.clear();
+}
+
+#else  // !FM_NATIVE_ATTR_WALK
+
+bool LocalAttrWalker::isSupported() {
+    return false;
+}
+
+bool LocalAttrWalker::addRoot(const std::string& /*path*/) {
+    return false;
+}
+
+void LocalAttrWalker::walk(GCancellable* /*cancellable*/,
+                           std::chrono::milliseconds /*interval*/,
+                           const std::function<void(std::uint64_t visited)>& /*reportProgress*/) {}
+
+#endif  // FM_NATIVE_ATTR_WALK
+
+}  // namespace Fm
@@ -0,0 +1,71 @@
+#ifndef FM2_LOCALATTRWALKER_H
+#define FM2_LOCALATTRWALKER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gio/gio.h>
+#include <sys/types.h>
+
+namespace Fm {
+
+// Changes the owner, group and mode of local files with fchownat() and fchmodat() relative to
+// the descriptor of their directory, rather than one g_file_set_attribute() per file. Trees
+// are read by several threads at once, symlinks are never followed, and files that already
+// have the requested owner and mode are left alone, so that only the inodes which really
+// change are written to.
+class LocalAttrWalker {
+   public:
+    struct Change {
+        bool setOwner = false;
+        uid_t uid = 0;
+        bool setGroup = false;
+        gid_t gid = 0;
+        // the bits of |modeMask| are set as in |mode|; nothing changes with an empty mask
+        mode_t mode = 0;
+        mode_t modeMask = 0;
+    };
+
+    // Whether local paths can be changed natively at all.
+    static bool isSupported();
+
+    // The mode |oldMode| becomes with |change|; directories readable by someone are made
+    // searchable by them as well, as FileChangeAttrJob always did.
+    static mode_t newMode(mode_t oldMode, bool isDir, const Change& change);
+
+    // With |recursive|, everything inside the directories added is changed as well.
+    LocalAttrWalker(const Change& change, bool recursive);
+
+    // Adds a file or tree to change. Returns false when |path| cannot be stat'ed natively; the
+    // caller should then change it with GIO, which also reports the error properly.
+    bool addRoot(const std::string& path);
+
+    // Changes the paths added so far, calling |reportProgress| on the calling thread every
+    // |interval| with the number of files visited. Files that cannot be changed and
+    // directories that cannot be read are skipped and listed by errors().
+    void walk(GCancellable* cancellable,
+              std::chrono::milliseconds interval,
+              const std::function<void(std::uint64_t visited)>& reportProgress);
+
+    // the files visited, and those of them which were actually changed
+    std::uint64_t visitedCount() const { return visited_; }
+    std::uint64_t changedCount() const { return changed_; }
+
+    // the files that could not be changed or read, with the errno of the failure
+    const std::vector<std::pair<std::string, int>>& errors() const { return errors_; }
+
+   private:
+    Change change_;
+    bool recursive_;
+    std::vector<std::string> roots_;
+    std::uint64_t visited_ = 0;
+    std::uint64_t changed_ = 0;
+    std::vector<std::pair<std::string, int>> errors_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_LOCALATTRWALKER_H
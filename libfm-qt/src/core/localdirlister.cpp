@@ -0,0 +1,518 @@
+#include "localdirlister.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "gioptrs.h"
+#include "metadatastore.h"
+#include "mimemagic.h"
+
+#if defined(__linux__) && defined(SYS_getdents64) && defined(STATX_BASIC_STATS)
+#define FM_NATIVE_DIR_LISTING 1
+#endif
+
+namespace Fm {
+
+std::atomic<bool> LocalDirLister::enabled_{true};
+
+#ifdef FM_NATIVE_DIR_LISTING
+
+namespace {
+
+// only what FileInfo uses; in particular no STATX_MNT_ID or STATX_DIOALIGN lookups
+constexpr unsigned int kStatxMask = STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID | STATX_ATIME |
+                                    STATX_MTIME | STATX_CTIME | STATX_INO | STATX_SIZE | STATX_BLOCKS | STATX_BTIME;
+
+// below this many files, starting threads costs more than the stat calls they share
+constexpr std::size_t kMinParallelFiles = 256;
+constexpr unsigned int kMaxThreads = 8;
+
+constexpr std::size_t kDirentBufferSize = 64 * 1024;
+
+struct LinuxDirent64 {
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// What is known about the directory being listed and the user listing it.
+struct DirContext {
+    uid_t uid = 0;
+    std::vector<gid_t> groups;
+    uid_t dirOwner = 0;
+    bool dirWritable = false;
+    bool dirSticky = false;
+    std::unordered_set<std::string> hiddenNames;             // from the .hidden file
+    std::unordered_map<std::string, const char*> dirIcons;  // XDG user directories
+
+    bool inGroup(gid_t gid) const { return std::find(groups.cbegin(), groups.cend(), gid) != groups.cend(); }
+
+    // Like access(2) but from the mode bits alone, so without a system call per file.
+    bool mayAccess(uid_t owner, gid_t group, mode_t mode, mode_t bit) const {
+        if (uid == 0) {
+            return bit != S_IXOTH || S_ISDIR(mode) || (mode & (S_IXUSR | S_IXGRP | S_IXOTH));
+        }
+        if (owner == uid) {
+            return mode & (bit << 6);
+        }
+        if (inGroup(group)) {
+            return mode & (bit << 3);
+        }
+        return mode & bit;
+    }
+};
+
+void readHiddenNames(const char* dirPath, std::unordered_set<std::string>& names) {
+    CStrPtr hiddenFile{g_build_filename(dirPath, ".hidden", nullptr)};
+    char* contents = nullptr;
+    gsize length = 0;
+    if (!g_file_get_contents(hiddenFile.get(), &contents, &length, nullptr)) {
+        return;
+    }
+    CStrPtr holder{contents};
+    const char* line = contents;
+    const char* end = contents + length;
+    while (line < end) {
+        const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if (!eol) {
+            eol = end;
+        }
+        if (eol > line) {
+            names.emplace(line, eol - line);
+        }
+        line = eol + 1;
+    }
+}
+
+// GIO gives XDG user directories themed icons of their own.
+void findUserDirIcons(const char* dirPath, std::unordered_map<std::string, const char*>& icons) {
+    static const struct {
+        GUserDirectory dir;
+        const char* icon;
+    } userDirs[] = {
+        {G_USER_DIRECTORY_DESKTOP, "user-desktop"},        {G_USER_DIRECTORY_DOCUMENTS, "folder-documents"},
+        {G_USER_DIRECTORY_DOWNLOAD, "folder-download"},    {G_USER_DIRECTORY_MUSIC, "folder-music"},
+        {G_USER_DIRECTORY_PICTURES, "folder-pictures"},    {G_USER_DIRECTORY_PUBLIC_SHARE, "folder-publicshare"},
+        {G_USER_DIRECTORY_TEMPLATES, "folder-templates"},  {G_USER_DIRECTORY_VIDEOS, "folder-videos"},
+    };
+    auto addIcon = [&](const char* path, const char* icon) {
+        if (!path) {
+            return;
+        }
+        CStrPtr parent{g_path_get_dirname(path)};
+        if (std::strcmp(parent.get(), dirPath) == 0) {
+            CStrPtr name{g_path_get_basename(path)};
+            icons.emplace(name.get(), icon);
+        }
+    };
+    for (const auto& userDir : userDirs) {
+        addIcon(g_get_user_special_dir(userDir.dir), userDir.icon);
+    }
+    addIcon(g_get_home_dir(), "user-home");
+}
+
+// The content type of the regular file |name| from its first bytes, the way GIO sniffs local
+// files, for a name that was not conclusive; |nameType| is the guess from the name. The type
+// of a name matching no glob at all comes from |magic|, without GIO.
+CStrPtr sniffContentType(int dirFd, const std::string& name, const MimeMagic& magic, const char* nameType) {
+    const int fd = openat(dirFd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOCTTY);
+    if (fd < 0) {
+        return CStrPtr{};  // GIO keeps the guess too
+    }
+    std::uint8_t data[4096];
+    ssize_t n;
+    do {
+        n = pread(fd, data, std::min(sizeof(data), magic.maxExtent()), 0);
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+    if (n <= 0) {
+        return CStrPtr{};
+    }
+    if (std::strcmp(nameType, "application/octet-stream") != 0) {
+        // several globs matched: GIO weighs them against the content, so let it do that in memory
+        return CStrPtr{g_content_type_guess(name.c_str(), data, n, nullptr)};
+    }
+    const char* type = magic.match(data, n);
+    if (!type) {
+        type = MimeMagic::looksLikeText(data, n) ? "text/plain" : "application/octet-stream";
+    }
+    else if (std::strcmp(type, "application/x-desktop") == 0) {
+        type = "text/plain";  // GIO never trusts the content of a desktop entry
+    }
+    return CStrPtr{g_strdup(type)};
+}
+
+// Builds the GFileInfo of |name| the way GIO would with defaultGFileInfoQueryAttribs. Without
+// |magic| the content is not sniffed, and |deferred| tells whether the content type is only a
+// guess from the name; with it, inconclusive names are settled from the first bytes of the file.
+// Returns null when the file is gone.
+GFileInfoPtr queryFileInfo(int dirFd,
+                           const std::string& name,
+                           const DirContext& dir,
+                           const MimeMagic* magic,
+                           bool& deferred) {
+    struct statx st;
+    if (statx(dirFd, name.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, kStatxMask, &st) != 0) {
+        return GFileInfoPtr{};
+    }
+    GFileInfoPtr info{g_file_info_new(), false};
+    GFileInfo* inf = info.get();
+
+    if (S_ISLNK(st.stx_mode)) {
+        // like G_FILE_QUERY_INFO_NONE: describe the target and flag the link
+        g_file_info_set_is_symlink(inf, TRUE);
+        std::string target(PATH_MAX, '\0');
+        ssize_t len = readlinkat(dirFd, name.c_str(), &target[0], target.size());
+        if (len >= 0) {
+            target.resize(len);
+            g_file_info_set_symlink_target(inf, target.c_str());
+        }
+        struct statx targetSt;
+        if (statx(dirFd, name.c_str(), AT_NO_AUTOMOUNT, kStatxMask, &targetSt) == 0) {
+            st = targetSt;
+        }
+    }
+
+    const mode_t mode = st.stx_mode;
+    GFileType type;
+    const char* contentType;
+    CStrPtr guessedType;
+    deferred = false;
+    if (S_ISREG(mode)) {
+        type = G_FILE_TYPE_REGULAR;
+        if (st.stx_size == 0) {
+            contentType = "application/x-zerosize";
+        }
+        else {
+            gboolean uncertain = FALSE;
+            guessedType = CStrPtr{g_content_type_guess(name.c_str(), nullptr, 0, &uncertain)};
+            contentType = guessedType.get();
+            deferred = uncertain;
+            if (deferred && magic) {
+                if (CStrPtr sniffedType = sniffContentType(dirFd, name, *magic, contentType)) {
+                    guessedType = std::move(sniffedType);
+                    contentType = guessedType.get();
+                }
+                deferred = false;
+            }
+        }
+    }
+    else if (S_ISDIR(mode)) {
+        type = G_FILE_TYPE_DIRECTORY;
+        contentType = "inode/directory";
+    }
+    else if (S_ISLNK(mode)) {  // a dangling link
+        type = G_FILE_TYPE_SYMBOLIC_LINK;
+        contentType = "inode/symlink";
+    }
+    else {
+        type = G_FILE_TYPE_SPECIAL;
+        contentType = S_ISCHR(mode)    ? "inode/chardevice"
+                      : S_ISBLK(mode)  ? "inode/blockdevice"
+                      : S_ISFIFO(mode) ? "inode/fifo"
+                                       : "inode/socket";
+    }
+    g_file_info_set_file_type(inf, type);
+    g_file_info_set_content_type(inf, contentType);
+    auto dirIcon = type == G_FILE_TYPE_DIRECTORY ? dir.dirIcons.find(name) : dir.dirIcons.cend();
+    if (dirIcon != dir.dirIcons.cend()) {
+        const char* names[] = {dirIcon->second, "folder", nullptr};
+        GIconPtr icon{g_themed_icon_new_from_names(const_cast<char**>(names), -1), false};
+        g_file_info_set_icon(inf, icon.get());
+    }
+    else {
+        GIconPtr icon{g_content_type_get_icon(contentType), false};
+        g_file_info_set_icon(inf, icon.get());
+    }
+
+    g_file_info_set_name(inf, name.c_str());
+    CStrPtr displayName{g_filename_display_name(name.c_str())};
+    g_file_info_set_display_name(inf, displayName.get());
+    g_file_info_set_edit_name(inf, displayName.get());
+    g_file_info_set_size(inf, st.stx_size);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE, st.stx_blocks * 512);
+    g_file_info_set_is_hidden(inf, name[0] == '.' || dir.hiddenNames.count(name) != 0);
+    g_file_info_set_is_backup(inf, name.back() == '~');
+
+    const std::uint64_t device = makedev(st.stx_dev_major, st.stx_dev_minor);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_DEVICE, device);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_UNIX_INODE, st.stx_ino);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_MODE, mode);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_NLINK, st.stx_nlink);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_UID, st.stx_uid);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_GID, st.stx_gid);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_RDEV,
+                                     makedev(st.stx_rdev_major, st.stx_rdev_minor));
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_UNIX_BLOCK_SIZE, st.stx_blksize);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_UNIX_BLOCKS, st.stx_blocks);
+
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_TIME_MODIFIED, st.stx_mtime.tv_sec);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, st.stx_mtime.tv_nsec / 1000);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_TIME_ACCESS, st.stx_atime.tv_sec);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_TIME_ACCESS_USEC, st.stx_atime.tv_nsec / 1000);
+    g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_TIME_CHANGED, st.stx_ctime.tv_sec);
+    g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_TIME_CHANGED_USEC, st.stx_ctime.tv_nsec / 1000);
+    if (st.stx_mask & STATX_BTIME) {
+        g_file_info_set_attribute_uint64(inf, G_FILE_ATTRIBUTE_TIME_CREATED, st.stx_btime.tv_sec);
+        g_file_info_set_attribute_uint32(inf, G_FILE_ATTRIBUTE_TIME_CREATED_USEC, st.stx_btime.tv_nsec / 1000);
+    }
+
+    // the same ids as GIO, so that files listed either way compare equal
+    char id[64];
+    g_snprintf(id, sizeof(id), "l%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT, static_cast<guint64>(device),
+               static_cast<guint64>(st.stx_ino));
+    g_file_info_set_attribute_string(inf, G_FILE_ATTRIBUTE_ID_FILE, id);
+    g_snprintf(id, sizeof(id), "l%" G_GUINT64_FORMAT, static_cast<guint64>(device));
+    g_file_info_set_attribute_string(inf, G_FILE_ATTRIBUTE_ID_FILESYSTEM, id);
+
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_READ,
+                                      dir.mayAccess(st.stx_uid, st.stx_gid, mode, S_IROTH));
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+                                      dir.mayAccess(st.stx_uid, st.stx_gid, mode, S_IWOTH));
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE,
+                                      dir.mayAccess(st.stx_uid, st.stx_gid, mode, S_IXOTH));
+    const bool canRemove = dir.dirWritable && (!dir.dirSticky || dir.uid == 0 || st.stx_uid == dir.uid ||
+                                               dir.dirOwner == dir.uid);
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE, canRemove);
+    g_file_info_set_attribute_boolean(inf, G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME, canRemove);
+    return info;
+}
+
+// Opens |dirPath| and fills in |dir| for it. Returns the descriptor, or -1 when the directory
+// cannot be read natively.
+int openDir(const char* dirPath, DirContext& dir) {
+    const int dirFd = open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) {
+        return -1;
+    }
+    struct statx dirSt;
+    if (statx(dirFd, "", AT_EMPTY_PATH, STATX_MODE | STATX_UID | STATX_GID, &dirSt) != 0) {  // ENOSYS, most likely
+        close(dirFd);
+        return -1;
+    }
+    dir.uid = getuid();
+    dir.groups.push_back(getgid());
+    const int nGroups = getgroups(0, nullptr);
+    if (nGroups > 0) {
+        dir.groups.resize(nGroups + 1);
+        dir.groups.resize(1 + std::max(0, getgroups(nGroups, dir.groups.data() + 1)));
+    }
+    dir.dirOwner = dirSt.stx_uid;
+    dir.dirWritable = dir.mayAccess(dirSt.stx_uid, dirSt.stx_gid, dirSt.stx_mode, S_IWOTH) &&
+                      dir.mayAccess(dirSt.stx_uid, dirSt.stx_gid, dirSt.stx_mode, S_IXOTH);
+    dir.dirSticky = dirSt.stx_mode & S_ISVTX;
+    readHiddenNames(dirPath, dir.hiddenNames);
+    findUserDirIcons(dirPath, dir.dirIcons);
+    return dirFd;
+}
+
+// Queries the files |names| in |dirFd|, on several threads when there are many of them.
+void queryFileInfos(int dirFd,
+                    const DirContext& dir,
+                    const MimeMagic* magic,
+                    const std::vector<std::string>& names,
+                    GCancellable* cancellable,
+                    std::vector<GFileInfoPtr>& infos,
+                    std::unique_ptr<bool[]>& deferred) {
+    infos.assign(names.size(), GFileInfoPtr{});
+    deferred.reset(new bool[names.size()]());
+    std::atomic<std::size_t> next{0};
+    auto queryFiles = [&]() {
+        for (std::size_t i; (i = next.fetch_add(1)) < names.size();) {
+            if (g_cancellable_is_cancelled(cancellable)) {
+                break;
+            }
+            infos[i] = queryFileInfo(dirFd, names[i], dir, magic, deferred[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    if (names.size() >= kMinParallelFiles) {
+        const unsigned int nThreads = std::max(1u, std::min(kMaxThreads, std::thread::hardware_concurrency()));
+        for (unsigned int i = 1; i < nThreads; ++i) {
+            threads.emplace_back(queryFiles);
+        }
+    }
+    queryFiles();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// What MetadataStore keeps for the files of |dirPath|, which GIO would have asked gvfs for.
+MetadataStore::DirEntries readMetadata(const char* dirPath) {
+    return MetadataStore::isEnabled() ? MetadataStore::globalInstance()->directory(dirPath)
+                                      : MetadataStore::DirEntries{};
+}
+
+void addMetadata(const MetadataStore::DirEntries& metadata,
+                 const std::vector<std::string>& names,
+                 std::vector<GFileInfoPtr>& infos) {
+    if (metadata.empty()) {
+        return;
+    }
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        auto it = metadata.find(names[i]);
+        if (infos[i] && it != metadata.end()) {
+            MetadataStore::apply(it->second, infos[i].get());
+        }
+    }
+}
+
+}  // namespace
+
+bool LocalDirLister::isSupported(const FilePath& dirPath) {
+    return isEnabled() && dirPath.isNative() && !dirPath.hasUriScheme("search");
+}
+
+LocalDirLister::LocalDirLister(const FilePath& dirPath) : dirPath_{dirPath} {}
+
+bool LocalDirLister::list(GCancellable* cancellable,
+                          std::size_t batchSize,
+                          const std::function<void(FileInfoList& files)>& addFiles) {
+    auto localPath = dirPath_.localPath();
+    if (!localPath) {
+        return false;
+    }
+    DirContext dir;
+    const int dirFd = openDir(localPath.get(), dir);
+    if (dirFd < 0) {
+        return false;
+    }
+    const MetadataStore::DirEntries metadata = readMetadata(localPath.get());
+
+    auto addBatch = [&](const std::vector<std::string>& names) {
+        std::vector<GFileInfoPtr> infos;
+        std::unique_ptr<bool[]> deferred;
+        queryFileInfos(dirFd, dir, nullptr, names, cancellable, infos, deferred);
+        addMetadata(metadata, names, infos);
+
+        FileInfoList files;
+        files.reserve(names.size());
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            if (infos[i] && (!dirOnly_ || g_file_info_get_file_type(infos[i].get()) == G_FILE_TYPE_DIRECTORY)) {
+                auto file = FileInfoPool::makeFileInfo(pool_, infos[i], FilePath(), dirPath_);
+                if (deferred[i]) {
+                    deferredFiles_.push_back(file);
+                }
+                files.push_back(std::move(file));
+            }
+        }
+        if (!files.empty() && !g_cancellable_is_cancelled(cancellable)) {
+            addFiles(files);
+        }
+    };
+
+    // 8-byte aligned, as the records are
+    std::unique_ptr<std::uint64_t[]> buffer{new std::uint64_t[kDirentBufferSize / sizeof(std::uint64_t)]};
+    char* const records = reinterpret_cast<char*>(buffer.get());
+    std::vector<std::string> names;
+    bool listed = false;
+    for (;;) {
+        if (g_cancellable_is_cancelled(cancellable)) {
+            listed = true;  // not an error: nothing to fall back to
+            break;
+        }
+        const long n = syscall(SYS_getdents64, dirFd, records, kDirentBufferSize);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (long pos = 0; pos < n;) {
+            const auto* entry = reinterpret_cast<const LinuxDirent64*>(records + pos);
+            pos += entry->d_reclen;
+            if (dirOnly_ && entry->d_type != DT_DIR && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+                continue;
+            }
+            if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0) {
+                names.emplace_back(entry->d_name);
+            }
+        }
+        if (n == 0 || names.size() >= batchSize) {
+            if (!names.empty()) {
+                addBatch(names);
+                names.clear();
+            }
+            listed = true;
+        }
+        if (n == 0) {
+            break;
+        }
+    }
+    if (listed && !names.empty()) {  // a read error after some batches: keep what was read
+        addBatch(names);
+    }
+    close(dirFd);
+    return listed;
+}
+
+bool LocalDirLister::query(const std::vector<std::string>& names, GCancellable* cancellable, FileInfoList& files) {
+    auto localPath = dirPath_.localPath();
+    if (!localPath) {
+        return false;
+    }
+    DirContext dir;
+    const int dirFd = openDir(localPath.get(), dir);
+    if (dirFd < 0) {
+        return false;
+    }
+    // the caller asked for the real content type: sniff it here, on the same threads as the
+    // stat calls, rather than have GIO open every file again; without the caches, leave it to GIO
+    auto magic = MimeMagic::globalInstance();
+    std::vector<GFileInfoPtr> infos;
+    std::unique_ptr<bool[]> deferred;
+    queryFileInfos(dirFd, dir, magic->isValid() ? magic.get() : nullptr, names, cancellable, infos, deferred);
+    close(dirFd);
+    addMetadata(readMetadata(localPath.get()), names, infos);
+
+    files.assign(names.size(), nullptr);
+    for (std::size_t i = 0; i < names.size(); ++i) {
+        if (infos[i] && !deferred[i]) {
+            files[i] = std::make_shared<FileInfo>(infos[i], dirPath_.child(names[i].c_str()));
+        }
+    }
+    return true;
+}
+
+#else  // !FM_NATIVE_DIR_LISTING
+
+bool LocalDirLister::isSupported(const FilePath& /*dirPath*/) {
+    return false;
+}
+
+LocalDirLister::LocalDirLister(const FilePath& dirPath) : dirPath_{dirPath} {}
+
+bool LocalDirLister::list(GCancellable* /*cancellable*/,
+                          std::size_t /*batchSize*/,
+                          const std::function<void(FileInfoList& files)>& /*addFiles*/) {
+    return false;
+}
+
+bool LocalDirLister::query(const std::vector<std::string>& /*names*/,
+                           GCancellable* /*cancellable*/,
+                           FileInfoList& /*files*/) {
+    return false;
+}
+
+#endif  // FM_NATIVE_DIR_LISTING
+
+}  // namespace Fm
@@ -0,0 +1,67 @@
+#ifndef FM2_LOCALDIRLISTER_H
+#define FM2_LOCALDIRLISTER_H
+
+#include "../libfmqtglobals.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <gio/gio.h>
+#include "filepath.h"
+#include "fileinfo.h"
+#include "fileinfopool.h"
+
+namespace Fm {
+
+// Lists a local directory with getdents64() and statx() rather than a GFileEnumerator.
+// The GFileInfo of each file only gets the attributes FileInfo reads, the files are
+// stat'ed on several threads, and content types are guessed from file names alone:
+// files whose name is not conclusive are reported by deferredFiles() so that their
+// content can be sniffed once the listing is shown.
+class LIBFM_QT_API LocalDirLister {
+   public:
+    // Whether |dirPath| can be listed natively at all; never while disabled.
+    static bool isSupported(const FilePath& dirPath);
+
+    // On unless setEnabled(false), which leaves all listings to GIO, as to compare them.
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    explicit LocalDirLister(const FilePath& dirPath);
+
+    // Lists directories only (and links to them). The type most filesystems give with each
+    // name is trusted, so other files are skipped without being stat'ed.
+    void setDirOnly(bool dirOnly) { dirOnly_ = dirOnly; }
+
+    // Allocates the files listed from |pool|, which has to outlive the lister.
+    void setFileInfoPool(FileInfoPool* pool) { pool_ = pool; }
+
+    // Lists the directory, handing the files to |addFiles| in batches of up to |batchSize|.
+    // Returns false when the directory cannot be opened or read this way; the caller should
+    // then list it with GIO, which also reports the error properly.
+    bool list(GCancellable* cancellable,
+              std::size_t batchSize,
+              const std::function<void(FileInfoList& files)>& addFiles);
+
+    // Queries the given files of the directory, in that order, leaving null the ones that are
+    // gone. Content types the names leave open are sniffed from the files with MimeMagic; when
+    // the mime caches cannot be read, those files are left null too, for GIO to query. Returns
+    // false when the directory cannot be read this way.
+    bool query(const std::vector<std::string>& names, GCancellable* cancellable, FileInfoList& files);
+
+    const FileInfoList& deferredFiles() const { return deferredFiles_; }
+
+   private:
+    FilePath dirPath_;
+    FileInfoList deferredFiles_;
+    FileInfoPool* pool_ = nullptr;
+    bool dirOnly_ = false;
+
+    static std::atomic<bool> enabled_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_LOCALDIRLISTER_H
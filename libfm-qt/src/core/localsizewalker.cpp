@@ -0,0 +1,414 @@
+#include "localsizewalker.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_getdents64) && defined(STATX_BASIC_STATS)
+#define FM_NATIVE_SIZE_WALK 1
+#endif
+
+namespace Fm {
+
+#ifdef FM_NATIVE_SIZE_WALK
+
+namespace {
+
+constexpr unsigned int kStatxMask =
+    STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_BLOCKS | STATX_MTIME;
+
+constexpr unsigned int kMaxThreads = 8;
+constexpr std::size_t kDirentBufferSize = 64 * 1024;
+// the totals of a large directory are published every so many entries, not only at its end
+constexpr std::size_t kFlushEntries = 4096;
+constexpr std::size_t kInodeShards = 16;
+
+struct LinuxDirent64 {
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// A directory descriptor shared by the subdirectories waiting to be opened relative to it.
+struct DirFd {
+    explicit DirFd(int fd) : fd{fd} {}
+    ~DirFd() { close(fd); }
+    DirFd(const DirFd&) = delete;
+    DirFd& operator=(const DirFd&) = delete;
+
+    const int fd;
+};
+
+// A directory being walked, whose totals are added to those of its parent once the
+// directory and all of its subdirectories are done.
+struct DirNode {
+    DirNode(std::shared_ptr<DirNode> parent,
+            std::string path,
+            std::uint64_t device,
+            std::uint64_t inode,
+            std::int64_t mtime,
+            std::uint64_t onDiskSize)
+        : parent{std::move(parent)},
+          path{std::move(path)},
+          device{device},
+          inode{inode},
+          mtime{mtime},
+          onDiskSize{onDiskSize} {}
+
+    const std::shared_ptr<DirNode> parent;
+    const std::string path;
+    const std::uint64_t device;
+    const std::uint64_t inode;
+    const std::int64_t mtime;
+
+    // the directory itself counts as a file, of no size, like in the job's totals
+    std::atomic<std::uint64_t> size{0};
+    std::atomic<std::uint64_t> onDiskSize;
+    std::atomic<std::uint64_t> fileCount{1};
+    std::atomic<unsigned int> unfinished{1};  // itself and the subdirectories not done yet
+    std::atomic<bool> partial{false};         // some of the tree was not counted
+};
+
+struct PendingDir {
+    std::shared_ptr<DirFd> parentFd;  // null for the roots, which are opened by path
+    std::shared_ptr<DirNode> node;
+    std::size_t nameOffset;  // where the name relative to |parentFd| starts in the path
+    std::uint64_t rootDevice;
+};
+
+// The (device, inode) pairs of the files with several links seen so far, sharded so that the
+// threads rarely wait for each other.
+class InodeSet {
+   public:
+    // Returns false when the file was seen before.
+    bool insert(std::uint64_t device, std::uint64_t inode) {
+        const std::uint64_t key = inode ^ (device * 0x9e3779b97f4a7c15ULL);
+        Shard& shard = shards_[key % kInodeShards];
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        return shard.inodes.insert(Inode{device, inode}).second;
+    }
+
+   private:
+    struct Inode {
+        std::uint64_t device;
+        std::uint64_t inode;
+        bool operator==(const Inode& other) const { return device == other.device && inode == other.inode; }
+    };
+    struct InodeHash {
+        std::size_t operator()(const Inode& i) const {
+            return std::hash<std::uint64_t>{}(i.inode ^ (i.device * 0x9e3779b97f4a7c15ULL));
+        }
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_set<Inode, InodeHash> inodes;
+    };
+    Shard shards_[kInodeShards];
+};
+
+struct WalkState {
+    GCancellable* cancellable = nullptr;
+    bool sameFs = false;
+    const LocalSizeWalker::DirTotalsCallback* dirTotals = nullptr;
+
+    // directories are taken from the back, so that the walk goes depth first and only the
+    // descriptors of the directories along the paths being walked stay open
+    std::mutex mutex;
+    std::condition_variable workCond;
+    std::condition_variable doneCond;
+    std::vector<PendingDir> pending;
+    unsigned int busy = 0;
+    bool done = false;
+
+    std::atomic<std::uint64_t> size{0};
+    std::atomic<std::uint64_t> onDiskSize{0};
+    std::atomic<std::uint64_t> fileCount{0};
+    InodeSet linkedFiles;
+
+    std::mutex errorMutex;
+    std::vector<std::pair<std::string, int>> errors;
+
+    bool isCancelled() const { return g_cancellable_is_cancelled(cancellable); }
+
+    void addError(const std::string& path, int error) {
+        std::lock_guard<std::mutex> lock{errorMutex};
+        errors.emplace_back(path, error);
+    }
+};
+
+// Marks |node| as done, and its parents as well when it was the last one they waited for.
+void finishDir(WalkState& state, std::shared_ptr<DirNode> node) {
+    while (node && node->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        const bool partial = node->partial.load(std::memory_order_relaxed);
+        LocalSizeWalker::Totals totals;
+        totals.size = node->size.load(std::memory_order_relaxed);
+        totals.onDiskSize = node->onDiskSize.load(std::memory_order_relaxed);
+        totals.fileCount = node->fileCount.load(std::memory_order_relaxed);
+        if (!partial && *state.dirTotals) {
+            (*state.dirTotals)(node->path, node->device, node->inode, node->mtime, totals);
+        }
+        const auto& parent = node->parent;
+        if (parent) {
+            parent->size.fetch_add(totals.size, std::memory_order_relaxed);
+            parent->onDiskSize.fetch_add(totals.onDiskSize, std::memory_order_relaxed);
+            parent->fileCount.fetch_add(totals.fileCount, std::memory_order_relaxed);
+            if (partial) {
+                parent->partial.store(true, std::memory_order_relaxed);
+            }
+        }
+        node = parent;
+    }
+}
+
+// Counts the entries of |dir| and returns its subdirectories in |subdirs|.
+void walkDir(WalkState& state, const PendingDir& dir, std::vector<PendingDir>& subdirs) {
+    DirNode& node = *dir.node;
+    const int fd = dir.parentFd ? openat(dir.parentFd->fd, node.path.c_str() + dir.nameOffset,
+                                         O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+                                : open(node.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        state.addError(node.path, errno);
+        node.partial.store(true, std::memory_order_relaxed);
+        return;
+    }
+    auto dirFd = std::make_shared<DirFd>(fd);
+
+    // the files directly in the directory, and its subdirectories as entries of it; these
+    // count in the totals of the walk at once, but in those of the directory once walked
+    std::uint64_t size = 0;
+    std::uint64_t onDiskSize = 0;
+    std::uint64_t fileCount = 0;
+    std::uint64_t subdirOnDiskSize = 0;
+    std::uint64_t subdirCount = 0;
+    auto flush = [&]() {
+        state.size.fetch_add(size, std::memory_order_relaxed);
+        state.onDiskSize.fetch_add(onDiskSize + subdirOnDiskSize, std::memory_order_relaxed);
+        state.fileCount.fetch_add(fileCount + subdirCount, std::memory_order_relaxed);
+        node.size.fetch_add(size, std::memory_order_relaxed);
+        node.onDiskSize.fetch_add(onDiskSize, std::memory_order_relaxed);
+        node.fileCount.fetch_add(fileCount, std::memory_order_relaxed);
+        size = onDiskSize = fileCount = subdirOnDiskSize = subdirCount = 0;
+    };
+
+    // 8-byte aligned, as the records are
+    std::unique_ptr<std::uint64_t[]> buffer{new std::uint64_t[kDirentBufferSize / sizeof(std::uint64_t)]};
+    char* const records = reinterpret_cast<char*>(buffer.get());
+    for (;;) {
+        if (state.isCancelled()) {
+            node.partial.store(true, std::memory_order_relaxed);
+            break;
+        }
+        const long n = syscall(SYS_getdents64, fd, records, kDirentBufferSize);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            state.addError(node.path, errno);
+            node.partial.store(true, std::memory_order_relaxed);
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (long pos = 0; pos < n;) {
+            const auto* entry = reinterpret_cast<const LinuxDirent64*>(records + pos);
+            pos += entry->d_reclen;
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            struct statx st;
+            if (statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, kStatxMask, &st) != 0) {
+                continue;  // removed since it was listed
+            }
+            const std::uint64_t device = makedev(st.stx_dev_major, st.stx_dev_minor);
+            if (S_ISDIR(st.stx_mode)) {
+                // like GIO, the size of a directory is left out but its blocks are not
+                subdirOnDiskSize += st.stx_blocks * 512;
+                ++subdirCount;
+                std::string path = node.path;
+                if (path.back() != '/') {
+                    path += '/';
+                }
+                const std::size_t nameOffset = path.size();
+                path += name;
+                auto subdir = std::make_shared<DirNode>(dir.node, std::move(path), device, st.stx_ino,
+                                                        st.stx_mtime.tv_sec, st.stx_blocks * 512);
+                if (state.sameFs && device != dir.rootDevice) {
+                    // counted, but as an empty directory
+                    subdir->partial.store(true, std::memory_order_relaxed);
+                    node.unfinished.fetch_add(1, std::memory_order_relaxed);
+                    finishDir(state, std::move(subdir));
+                }
+                else {
+                    node.unfinished.fetch_add(1, std::memory_order_relaxed);
+                    subdirs.push_back(PendingDir{dirFd, std::move(subdir), nameOffset, dir.rootDevice});
+                }
+            }
+            else if (st.stx_nlink <= 1 || state.linkedFiles.insert(device, st.stx_ino)) {
+                size += st.stx_size;
+                onDiskSize += st.stx_blocks * 512;
+                ++fileCount;
+            }
+            if (fileCount + subdirCount >= kFlushEntries) {
+                flush();
+            }
+        }
+    }
+    flush();
+}
+
+void runWorker(WalkState& state) {
+    std::vector<PendingDir> subdirs;
+    std::unique_lock<std::mutex> lock{state.mutex};
+    for (;;) {
+        state.workCond.wait(lock, [&] { return !state.pending.empty() || state.done; });
+        if (state.done) {
+            return;
+        }
+        PendingDir dir = std::move(state.pending.back());
+        state.pending.pop_back();
+        ++state.busy;
+        lock.unlock();
+
+        if (state.isCancelled()) {
+            dir.node->partial.store(true, std::memory_order_relaxed);
+        }
+        else {
+            walkDir(state, dir, subdirs);
+        }
+        dir.parentFd.reset();
+        finishDir(state, std::move(dir.node));
+
+        lock.lock();
+        --state.busy;
+        if (state.isCancelled()) {
+            state.pending.clear();
+            subdirs.clear();
+        }
+        const bool hasSubdirs = !subdirs.empty();
+        std::move(subdirs.begin(), subdirs.end(), std::back_inserter(state.pending));
+        subdirs.clear();
+        if (state.pending.empty() && state.busy == 0) {
+            state.done = true;
+            state.workCond.notify_all();
+            state.doneCond.notify_all();
+        }
+        else if (hasSubdirs) {
+            state.workCond.notify_all();
+        }
+    }
+}
+
+}  // namespace
+
+bool LocalSizeWalker::isSupported() {
+    return true;
+}
+
+LocalSizeWalker::LocalSizeWalker(bool followRootLinks, bool sameFs)
+    : followRootLinks_{followRootLinks}, sameFs_{sameFs} {}
+
+bool LocalSizeWalker::addRoot(const std::string& path) {
+    struct statx st;
+    const int flags = (followRootLinks_ ? 0 : AT_SYMLINK_NOFOLLOW) | AT_NO_AUTOMOUNT;
+    if (path.empty() || statx(AT_FDCWD, path.c_str(), flags, kStatxMask, &st) != 0) {
+        return false;
+    }
+    roots_.push_back(Root{path, makedev(st.stx_dev_major, st.stx_dev_minor), st.stx_ino, st.stx_mtime.tv_sec,
+                          st.stx_size, st.stx_blocks * 512, st.stx_nlink, S_ISDIR(st.stx_mode)});
+    return true;
+}
+
+void LocalSizeWalker::walk(GCancellable* cancellable,
+                           std::chrono::milliseconds interval,
+                           const std::function<void(const Totals& totals)>& reportTotals) {
+    WalkState state;
+    state.cancellable = cancellable;
+    state.sameFs = sameFs_;
+    state.dirTotals = &dirTotals_;
+    for (const auto& root : roots_) {
+        if (root.isDir) {
+            state.onDiskSize += root.onDiskSize;
+            ++state.fileCount;
+            auto node =
+                std::make_shared<DirNode>(nullptr, root.path, root.device, root.inode, root.mtime, root.onDiskSize);
+            state.pending.push_back(PendingDir{nullptr, std::move(node), 0, root.device});
+        }
+        else if (root.links <= 1 || state.linkedFiles.insert(root.device, root.inode)) {
+            state.size += root.size;
+            state.onDiskSize += root.onDiskSize;
+            ++state.fileCount;
+        }
+    }
+    // the first roots are walked first
+    std::reverse(state.pending.begin(), state.pending.end());
+
+    auto currentTotals = [&state]() {
+        Totals totals;
+        totals.size = state.size.load(std::memory_order_relaxed);
+        totals.onDiskSize = state.onDiskSize.load(std::memory_order_relaxed);
+        totals.fileCount = state.fileCount.load(std::memory_order_relaxed);
+        return totals;
+    };
+
+    if (!state.pending.empty()) {
+        const unsigned int nThreads = std::max(1u, std::min(kMaxThreads, std::thread::hardware_concurrency()));
+        std::vector<std::thread> threads;
+        for (unsigned int i = 0; i < nThreads; ++i) {
+            threads.emplace_back(runWorker, std::ref(state));
+        }
+        {
+            std::unique_lock<std::mutex> lock{state.mutex};
+            while (!state.doneCond.wait_for(lock, interval, [&] { return state.done; })) {
+                lock.unlock();
+                if (reportTotals) {
+                    reportTotals(currentTotals());
+                }
+                lock.lock();
+            }
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    totals_ = currentTotals();
+    errors_ = std::move(state.errors);
+    roots_.clear();
+}
+
+#else  // !FM_NATIVE_SIZE_WALK
+
+bool LocalSizeWalker::isSupported() {
+    return false;
+}
+
+LocalSizeWalker::LocalSizeWalker(bool followRootLinks, bool sameFs)
+    : followRootLinks_{followRootLinks}, sameFs_{sameFs} {}
+
+bool LocalSizeWalker::addRoot(const std::string& /*path*/) {
+    return false;
+}
+
+void LocalSizeWalker::walk(GCancellable* /*cancellable*/,
+                           std::chrono::milliseconds /*interval*/,
+                           const std::function<void(const Totals& totals)>& /*reportTotals*/) {}
+
+#endif  // FM_NATIVE_SIZE_WALK
+
+}  // namespace Fm
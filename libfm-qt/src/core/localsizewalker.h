@@ -0,0 +1,78 @@
+#ifndef FM2_LOCALSIZEWALKER_H
+#define FM2_LOCALSIZEWALKER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gio/gio.h>
+
+namespace Fm {
+
+// Adds up the sizes of local directory trees with getdents64() and statx() rather than
+// GFileEnumerators. Directories are opened relative to their parent's descriptor and read
+// by several threads at once, files with more than one hard link are only counted once,
+// and the totals counted so far can be reported while the walk goes on.
+class LocalSizeWalker {
+   public:
+    struct Totals {
+        std::uint64_t size = 0;  // of everything but directories, as GIO reports them
+        std::uint64_t onDiskSize = 0;
+        std::uint64_t fileCount = 0;  // directories included
+    };
+
+    // Whether local paths can be walked natively at all.
+    static bool isSupported();
+
+    // |followRootLinks| makes the roots that are symlinks count as their targets; links inside
+    // the trees are never followed. With |sameFs|, directories on another filesystem than their
+    // root are counted but not descended into.
+    LocalSizeWalker(bool followRootLinks, bool sameFs);
+
+    // Called, on any of the walking threads, with the totals of each directory whose tree was
+    // walked in full, neither unreadable in places nor reaching into another filesystem.
+    using DirTotalsCallback = std::function<void(const std::string& path, std::uint64_t device, std::uint64_t inode,
+                                                 std::int64_t mtime, const Totals& totals)>;
+    void setDirTotalsCallback(DirTotalsCallback callback) { dirTotals_ = std::move(callback); }
+
+    // Adds a tree to walk. Returns false when |path| cannot be stat'ed natively; the caller
+    // should then count it with GIO, which also reports the error properly.
+    bool addRoot(const std::string& path);
+
+    // Walks the trees added so far, calling |reportTotals| on the calling thread every
+    // |interval| with the totals counted so far. Directories that cannot be read are skipped
+    // and listed by errors().
+    void walk(GCancellable* cancellable,
+              std::chrono::milliseconds interval,
+              const std::function<void(const Totals& totals)>& reportTotals);
+
+    const Totals& totals() const { return totals_; }
+
+    // the directories that could not be read, with the errno of the failure
+    const std::vector<std::pair<std::string, int>>& errors() const { return errors_; }
+
+   private:
+    struct Root {
+        std::string path;
+        std::uint64_t device;
+        std::uint64_t inode;
+        std::int64_t mtime;
+        std::uint64_t size;
+        std::uint64_t onDiskSize;
+        std::uint32_t links;
+        bool isDir;
+    };
+
+    bool followRootLinks_;
+    bool sameFs_;
+    DirTotalsCallback dirTotals_;
+    std::vector<Root> roots_;
+    Totals totals_;
+    std::vector<std::pair<std::string, int>> errors_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_LOCALSIZEWALKER_H
@@ -0,0 +1,41 @@
+#include "memorystats.h"
+
+namespace Fm {
+
+namespace {
+
+const char* const kSubsystemNames[MemoryStats::NumSubsystems] = {
+    "FileInfo",
+    "Hex documents",
+    "Icons",
+    "Folder model thumbnails",
+    "Thumbnail cache",
+};
+
+MemoryStats::Probe probes[MemoryStats::NumSubsystems];
+
+}  // namespace
+
+std::atomic<bool> MemoryStats::enabled_{false};
+std::atomic<int64_t> MemoryStats::bytes_[MemoryStats::NumSubsystems] = {};
+
+void MemoryStats::setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void MemoryStats::setProbe(Subsystem subsystem, Probe probe) {
+    probes[subsystem] = std::move(probe);
+}
+
+int64_t MemoryStats::liveBytes(Subsystem subsystem) {
+    if (probes[subsystem]) {
+        return probes[subsystem]();
+    }
+    return bytes_[subsystem].load(std::memory_order_relaxed);
+}
+
+const char* MemoryStats::subsystemName(Subsystem subsystem) {
+    return kSubsystemNames[subsystem];
+}
+
+}  // namespace Fm
@@ -0,0 +1,58 @@
+#ifndef FM2_MEMORYSTATS_H
+#define FM2_MEMORYSTATS_H
+
+#include "../libfmqtglobals.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+namespace Fm {
+
+// The bytes held by each subsystem, to find out what a long session grows with. Some are
+// counted as their objects change: each object remembers what it accounted for, so that it
+// gives it back when it goes, and only what is allocated while the accounting is on is
+// counted. It is off unless setEnabled(true). The others are summed up when asked by a
+// probe, as the thumbnails of the folder models. The sizes are estimates of the heap used,
+// not counts of the allocator.
+class LIBFM_QT_API MemoryStats {
+   public:
+    enum Subsystem {
+        FileInfos,              // counted: FileInfo with its strings
+        HexDocuments,           // counted: the added bytes and undo history of the hex editor
+        IconInfos,              // probed: the icons cached by IconInfo
+        FolderModelThumbnails,  // probed: the thumbnails held by the folder models
+        ThumbnailCache,         // probed: the memory cache of ThumbnailJob
+        NumSubsystems
+    };
+
+    using Probe = std::function<int64_t()>;
+
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool enabled);
+
+    // Makes |accounted|, what an object accounts for in |subsystem|, |bytes|. While the
+    // accounting is off, only giving all of it back, with |bytes| 0, is done.
+    static void account(Subsystem subsystem, int64_t& accounted, int64_t bytes) {
+        if (bytes != accounted && (bytes == 0 || isEnabled())) {
+            bytes_[subsystem].fetch_add(bytes - accounted, std::memory_order_relaxed);
+            accounted = bytes;
+        }
+    }
+
+    // Sets how the bytes of a probed subsystem are summed up. Only used in the main thread,
+    // as is liveBytes() of such a subsystem.
+    static void setProbe(Subsystem subsystem, Probe probe);
+
+    static int64_t liveBytes(Subsystem subsystem);
+
+    static const char* subsystemName(Subsystem subsystem);
+
+   private:
+    static std::atomic<bool> enabled_;
+    static std::atomic<int64_t> bytes_[NumSubsystems];
+};
+
+}  // namespace Fm
+
+#endif  // FM2_MEMORYSTATS_H
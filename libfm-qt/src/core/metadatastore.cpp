@@ -0,0 +1,585 @@
+#include "metadatastore.h"
+#include "gioptrs.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'M', 'M', 'E', 'T', 'A', 'D', '1'};
+// another process may have replaced the file, which is checked no more often than this
+constexpr std::chrono::seconds kRecheckInterval{1};
+
+// the keys gvfs uses for what is kept here
+constexpr char kGvfsEmblems[] = "emblems";
+constexpr char kGvfsCustomIcon[] = "custom-icon";  // a URI
+constexpr char kGvfsCustomIconName[] = "custom-icon-name";
+constexpr char kGvfsTrust[] = "trust";
+
+struct Header {
+    char magic[8];
+    std::uint32_t count;
+    std::uint32_t reserved;
+};
+
+// The index of the records after the header, sorted by the hashes; the record of a file is its
+// path, "1" if it is trusted or an empty string, its custom icon, and its emblems, each string
+// followed by a zero byte.
+struct IndexEntry {
+    std::uint64_t dirHash;
+    std::uint64_t nameHash;
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+// FNV-1a, which does not change between builds as std::hash may
+std::uint64_t hashOf(const char* data, std::size_t length) {
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// splits |path| into the path of its directory and its name
+bool splitPath(const std::string& path, std::string& dir, std::string& name) {
+    const std::size_t slash = path.rfind('/');
+    if (slash == std::string::npos || slash + 1 == path.size()) {
+        return false;
+    }
+    dir = slash == 0 ? std::string{"/"} : path.substr(0, slash);
+    name = path.substr(slash + 1);
+    return true;
+}
+
+bool decodeRecord(const char* data, std::size_t length, std::string& path, MetadataStore::Entry& entry) {
+    if (length == 0 || data[length - 1] != '\0') {
+        return false;
+    }
+    std::vector<const char*> strings;
+    for (const char* p = data; p < data + length; p += std::strlen(p) + 1) {
+        strings.push_back(p);
+    }
+    if (strings.size() < 3) {
+        return false;
+    }
+    path = strings[0];
+    entry.trusted = strings[1][0] == '1';
+    entry.customIcon = strings[2];
+    entry.emblems.assign(strings.begin() + 3, strings.end());
+    return true;
+}
+
+void encodeRecord(std::string& data, const std::string& path, const MetadataStore::Entry& entry) {
+    data.append(path).push_back('\0');
+    data.append(entry.trusted ? "1" : "").push_back('\0');
+    data.append(entry.customIcon).push_back('\0');
+    for (const auto& emblem : entry.emblems) {
+        data.append(emblem).push_back('\0');
+    }
+}
+
+bool writeAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Holds an exclusive lock on |file|, made with its directory if needed, while it lives, so that
+// the processes changing the records do not overwrite the changes of each other.
+class FileLock {
+   public:
+    explicit FileLock(const std::string& file) {
+        CStrPtr dir{g_path_get_dirname(file.c_str())};
+        g_mkdir_with_parents(dir.get(), 0700);
+        fd_ = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd_ >= 0) {
+            while (flock(fd_, LOCK_EX) != 0 && errno == EINTR) {
+            }
+        }
+    }
+
+    ~FileLock() {
+        if (fd_ >= 0) {
+            close(fd_);  // which unlocks it
+        }
+    }
+
+   private:
+    int fd_;
+};
+
+// Reads the metadata tree gvfs keeps for a filesystem: a header, then directory entries holding
+// the offsets of their names, children and metadata, all in big endian. See metatree.c in gvfs.
+class GvfsTree {
+   public:
+    GvfsTree(const char* data, std::size_t size) : data_{reinterpret_cast<const unsigned char*>(data)}, size_{size} {}
+
+    // Calls |add| with the path and the entry of each file below |mountPoint| that has one.
+    void read(const std::string& mountPoint,
+              const std::function<void(const std::string& path, const MetadataStore::Entry& entry)>& add) const {
+        static const unsigned char magic[] = {0xda, 0x1a, 'm', 'e', 't', 'a'};
+        std::uint32_t root, attributes;
+        if (size_ < 32 || std::memcmp(data_, magic, sizeof(magic)) != 0 || data_[6] != 1 || !u32(16, root) ||
+            !u32(20, attributes)) {
+            return;
+        }
+        // the names of the keys
+        std::vector<const char*> keys;
+        std::uint32_t count;
+        if (!u32(attributes, count) || count > (size_ - attributes) / 4) {
+            return;
+        }
+        for (std::uint32_t i = 0; i < count; ++i) {
+            std::uint32_t offset;
+            keys.push_back(u32(attributes + 4 + 4 * i, offset) ? string(offset) : nullptr);
+        }
+
+        // a malformed tree could loop; a real one has fewer entries than this
+        std::size_t budget = size_ / 16;
+        std::vector<std::pair<std::uint32_t, std::string>> pending{{root, mountPoint}};
+        while (!pending.empty() && budget > 0) {
+            --budget;
+            const std::uint32_t dirEnt = pending.back().first;
+            const std::string path = std::move(pending.back().second);
+            pending.pop_back();
+            std::uint32_t children, metadata;
+            if (!u32(dirEnt + 4, children) || !u32(dirEnt + 8, metadata)) {
+                continue;
+            }
+            MetadataStore::Entry entry;
+            if (metadata != 0 && readEntry(metadata, keys, entry) && !entry.isEmpty()) {
+                add(path, entry);
+            }
+            std::uint32_t childCount;
+            if (children == 0 || !u32(children, childCount) || childCount > (size_ - children) / 16) {
+                continue;
+            }
+            for (std::uint32_t i = 0; i < childCount; ++i) {
+                const std::uint32_t child = children + 4 + 16 * i;
+                std::uint32_t nameOffset;
+                const char* name = u32(child, nameOffset) ? string(nameOffset) : nullptr;
+                if (name && *name && !std::strchr(name, '/')) {
+                    pending.emplace_back(child, (path == "/" ? std::string{} : path) + '/' + name);
+                }
+            }
+        }
+    }
+
+   private:
+    bool u32(std::size_t pos, std::uint32_t& value) const {
+        if (pos > size_ || size_ - pos < 4) {
+            return false;
+        }
+        value = (std::uint32_t{data_[pos]} << 24) | (std::uint32_t{data_[pos + 1]} << 16) |
+                (std::uint32_t{data_[pos + 2]} << 8) | data_[pos + 3];
+        return true;
+    }
+
+    const char* string(std::uint32_t pos) const {
+        if (pos >= size_ || !std::memchr(data_ + pos, '\0', size_ - pos)) {
+            return nullptr;
+        }
+        return reinterpret_cast<const char*>(data_ + pos);
+    }
+
+    bool readEntry(std::uint32_t metadata, const std::vector<const char*>& keys, MetadataStore::Entry& entry) const {
+        constexpr std::uint32_t isList = 1u << 31;
+        std::uint32_t count;
+        if (!u32(metadata, count) || count > (size_ - metadata) / 8) {
+            return false;
+        }
+        for (std::uint32_t i = 0; i < count; ++i) {
+            std::uint32_t key, value;
+            if (!u32(metadata + 4 + 8 * i, key) || !u32(metadata + 8 + 8 * i, value)) {
+                return false;
+            }
+            const std::uint32_t index = key & ~isList;
+            const char* name = index < keys.size() ? keys[index] : nullptr;
+            if (!name) {
+                continue;
+            }
+            if (key & isList) {
+                std::uint32_t n;
+                if (std::strcmp(name, kGvfsEmblems) != 0 || !u32(value, n) || n > (size_ - value) / 4) {
+                    continue;
+                }
+                for (std::uint32_t j = 0; j < n; ++j) {
+                    std::uint32_t offset;
+                    if (const char* emblem = u32(value + 4 + 4 * j, offset) ? string(offset) : nullptr) {
+                        entry.emblems.emplace_back(emblem);
+                    }
+                }
+            }
+            else if (const char* str = string(value)) {
+                if (std::strcmp(name, kGvfsCustomIcon) == 0 || std::strcmp(name, kGvfsCustomIconName) == 0) {
+                    entry.customIcon = str;
+                }
+                else if (std::strcmp(name, kGvfsTrust) == 0) {
+                    entry.trusted = std::strcmp(str, "true") == 0;
+                }
+            }
+        }
+        return true;
+    }
+
+    const unsigned char* data_;
+    std::size_t size_;
+};
+
+// the mount point of the filesystem holding |path|
+std::string mountPointOf(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return {};
+    }
+    std::string dir = path;
+    while (dir != "/") {
+        std::string parent, name;
+        if (!splitPath(dir, parent, name)) {
+            break;
+        }
+        struct stat parentSt;
+        if (stat(parent.c_str(), &parentSt) != 0 || parentSt.st_dev != st.st_dev) {
+            break;
+        }
+        dir = std::move(parent);
+    }
+    return dir;
+}
+
+}  // namespace
+
+struct MetadataStore::Mapping {
+    const char* data = nullptr;  // null while there are no records
+    std::size_t size = 0;
+    std::uint32_t count = 0;
+    // what the file was when it was mapped
+    dev_t device = 0;
+    ino_t inode = 0;
+    off_t fileSize = -1;
+    std::int64_t mtime = 0;
+
+    ~Mapping() {
+        if (data) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    static std::int64_t mtimeOf(const struct stat& st) {
+        return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    bool isOf(const struct stat& st) const {
+        return device == st.st_dev && inode == st.st_ino && fileSize == st.st_size && mtime == mtimeOf(st);
+    }
+
+    const IndexEntry* index() const { return reinterpret_cast<const IndexEntry*>(data + sizeof(Header)); }
+
+    bool record(const IndexEntry& entry, std::string& path, Entry& result) const {
+        return entry.offset <= size && entry.length <= size - entry.offset &&
+               decodeRecord(data + entry.offset, entry.length, path, result);
+    }
+};
+
+std::atomic<bool> MetadataStore::enabled_{false};
+
+MetadataStore::MetadataStore(std::string file, std::string gvfsDir)
+    : file_{std::move(file)}, gvfsDir_{std::move(gvfsDir)} {}
+
+MetadataStore::~MetadataStore() = default;
+
+std::shared_ptr<MetadataStore> MetadataStore::globalInstance() {
+    static const std::shared_ptr<MetadataStore> store = [] {
+        CStrPtr file{g_build_filename(g_get_user_data_dir(), "libfm-qt", "metadata", nullptr)};
+        CStrPtr gvfsDir{g_build_filename(g_get_user_data_dir(), "gvfs-metadata", nullptr)};
+        return std::make_shared<MetadataStore>(file.get(), gvfsDir.get());
+    }();
+    return store;
+}
+
+MetadataStore::DirEntries MetadataStore::directory(const std::string& dirPath) {
+    std::shared_ptr<const Mapping> mapping;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        mapping = currentMapping();
+    }
+    DirEntries entries;
+    if (!mapping->data) {
+        return entries;
+    }
+    const std::uint64_t dirHash = hashOf(dirPath.data(), dirPath.size());
+    const IndexEntry* begin = mapping->index();
+    const IndexEntry* end = begin + mapping->count;
+    auto it = std::lower_bound(begin, end, dirHash,
+                               [](const IndexEntry& entry, std::uint64_t hash) { return entry.dirHash < hash; });
+    std::string path, dir, name;
+    for (; it != end && it->dirHash == dirHash; ++it) {
+        Entry entry;
+        // another directory may have the same hash
+        if (mapping->record(*it, path, entry) && splitPath(path, dir, name) && dir == dirPath) {
+            entries.emplace(std::move(name), std::move(entry));
+        }
+    }
+    return entries;
+}
+
+bool MetadataStore::lookup(const std::string& path, Entry& entry) {
+    std::string dir, name;
+    if (!splitPath(path, dir, name)) {
+        return false;
+    }
+    std::shared_ptr<const Mapping> mapping;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        mapping = currentMapping();
+    }
+    if (!mapping->data) {
+        return false;
+    }
+    const IndexEntry key{hashOf(dir.data(), dir.size()), hashOf(name.data(), name.size()), 0, 0};
+    const IndexEntry* begin = mapping->index();
+    const IndexEntry* end = begin + mapping->count;
+    auto it = std::lower_bound(begin, end, key, [](const IndexEntry& a, const IndexEntry& b) {
+        return a.dirHash != b.dirHash ? a.dirHash < b.dirHash : a.nameHash < b.nameHash;
+    });
+    std::string recordPath;
+    for (; it != end && it->dirHash == key.dirHash && it->nameHash == key.nameHash; ++it) {
+        if (mapping->record(*it, recordPath, entry) && recordPath == path) {
+            return true;
+        }
+    }
+    entry = Entry{};
+    return false;
+}
+
+bool MetadataStore::update(const std::string& path, const std::function<void(Entry& entry)>& change) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    currentMapping();  // which imports the metadata of gvfs the first time
+    FileLock fileLock{file_ + ".lock"};
+    // the records as they are now, as another process may have changed them a moment ago
+    auto mapping = mapFile();
+    std::vector<Record> records;
+    records.reserve(mapping->count + 1);
+    Entry entry;
+    bool found = false;
+    for (std::uint32_t i = 0; mapping->data && i < mapping->count; ++i) {
+        Record record;
+        if (!mapping->record(mapping->index()[i], record.path, record.entry)) {
+            continue;
+        }
+        if (record.path == path) {
+            entry = std::move(record.entry);
+            found = true;
+            continue;
+        }
+        records.push_back(std::move(record));
+    }
+    change(entry);
+    if (entry.isEmpty() && !found) {
+        return true;
+    }
+    if (!entry.isEmpty()) {
+        records.push_back(Record{path, std::move(entry)});
+    }
+    return writeRecords(records);
+}
+
+void MetadataStore::apply(const Entry& entry, GFileInfo* inf) {
+    if (!entry.emblems.empty()) {
+        std::vector<char*> names;
+        for (const auto& emblem : entry.emblems) {
+            names.push_back(const_cast<char*>(emblem.c_str()));
+        }
+        names.push_back(nullptr);
+        g_file_info_set_attribute_stringv(inf, "metadata::emblems", names.data());
+    }
+    if (entry.trusted) {
+        g_file_info_set_attribute_string(inf, "metadata::trust", "true");
+    }
+    if (!entry.customIcon.empty()) {
+        const std::string& icon = entry.customIcon;
+        GIconPtr gicon;
+        if (icon[0] == '/' || icon.find("://") != std::string::npos) {
+            GFilePtr file{icon[0] == '/' ? g_file_new_for_path(icon.c_str()) : g_file_new_for_uri(icon.c_str()),
+                          false};
+            gicon = GIconPtr{g_file_icon_new(file.get()), false};
+        }
+        else {
+            gicon = GIconPtr{g_themed_icon_new(icon.c_str()), false};
+        }
+        g_file_info_set_icon(inf, gicon.get());
+    }
+}
+
+void MetadataStore::addTo(const FilePath& path, GFileInfo* inf) {
+    if (!isEnabled() || !path.isNative()) {
+        return;
+    }
+    auto localPath = path.localPath();
+    Entry entry;
+    if (localPath && globalInstance()->lookup(localPath.get(), entry)) {
+        apply(entry, inf);
+    }
+}
+
+std::shared_ptr<const MetadataStore::Mapping> MetadataStore::currentMapping() {
+    const auto now = std::chrono::steady_clock::now();
+    if (mapping_ && now - checked_ < kRecheckInterval) {
+        return mapping_;
+    }
+    checked_ = now;
+    struct stat st;
+    if (stat(file_.c_str(), &st) != 0) {
+        if (errno == ENOENT && !mapping_) {
+            importGvfsMetadata();  // which writes the file, even with no records
+        }
+        if (!mapping_) {
+            mapping_ = std::make_shared<Mapping>();
+        }
+        return mapping_;
+    }
+    if (!mapping_ || !mapping_->isOf(st)) {
+        mapping_ = mapFile();
+    }
+    return mapping_;
+}
+
+std::shared_ptr<const MetadataStore::Mapping> MetadataStore::mapFile() const {
+    auto mapping = std::make_shared<Mapping>();
+    const int fd = open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return mapping;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        mapping->device = st.st_dev;
+        mapping->inode = st.st_ino;
+        mapping->fileSize = st.st_size;
+        mapping->mtime = Mapping::mtimeOf(st);
+        Header header;
+        if (static_cast<std::size_t>(st.st_size) > sizeof(header) &&
+            pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+            std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.count > 0 &&
+            header.count <= (static_cast<std::size_t>(st.st_size) - sizeof(header)) / sizeof(IndexEntry)) {
+            void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                mapping->data = static_cast<const char*>(data);
+                mapping->size = st.st_size;
+                mapping->count = header.count;
+            }
+        }
+    }
+    close(fd);
+    return mapping;
+}
+
+bool MetadataStore::writeRecords(std::vector<Record>& records) {
+    std::vector<IndexEntry> index;
+    index.reserve(records.size());
+    std::string dir, name;
+    for (const auto& record : records) {
+        if (splitPath(record.path, dir, name)) {
+            index.push_back(IndexEntry{hashOf(dir.data(), dir.size()), hashOf(name.data(), name.size()), 0, 0});
+        }
+        else {
+            index.push_back(IndexEntry{0, 0, 0, 0});
+        }
+    }
+    std::vector<std::size_t> order(records.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&index](std::size_t a, std::size_t b) {
+        return index[a].dirHash != index[b].dirHash ? index[a].dirHash < index[b].dirHash
+                                                    : index[a].nameHash < index[b].nameHash;
+    });
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.count = static_cast<std::uint32_t>(records.size());
+    std::string payload;
+    std::vector<IndexEntry> sortedIndex;
+    sortedIndex.reserve(records.size());
+    const std::size_t start = sizeof(header) + records.size() * sizeof(IndexEntry);
+    for (std::size_t i : order) {
+        IndexEntry entry = index[i];
+        entry.offset = static_cast<std::uint32_t>(start + payload.size());
+        encodeRecord(payload, records[i].path, records[i].entry);
+        entry.length = static_cast<std::uint32_t>(start + payload.size() - entry.offset);
+        sortedIndex.push_back(entry);
+    }
+    if (start + payload.size() > UINT32_MAX) {
+        return false;
+    }
+
+    const std::string tmpFile = file_ + ".tmp";
+    const int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    const std::size_t indexSize = sortedIndex.size() * sizeof(IndexEntry);
+    bool ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+              writeAll(fd, reinterpret_cast<const char*>(sortedIndex.data()), indexSize) &&
+              writeAll(fd, payload.data(), payload.size()) && fsync(fd) == 0;
+    // the mapping of the old file stays valid once it is replaced
+    if (close(fd) != 0 || !ok || rename(tmpFile.c_str(), file_.c_str()) != 0) {
+        unlink(tmpFile.c_str());
+        return false;
+    }
+    mapping_ = mapFile();
+    checked_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+void MetadataStore::importGvfsMetadata() {
+    FileLock fileLock{file_ + ".lock"};
+    if (access(file_.c_str(), F_OK) == 0) {  // another process imported it meanwhile
+        mapping_ = mapFile();
+        return;
+    }
+    // gvfs keeps a tree for the filesystem of the home directory and one for the root filesystem
+    const std::pair<const char*, std::string> trees[] = {{"home", mountPointOf(g_get_home_dir())}, {"root", "/"}};
+    std::vector<Record> records;
+    std::unordered_map<std::string, std::size_t> seen;  // the records by path
+    for (const auto& tree : trees) {
+        if (tree.second.empty()) {
+            continue;
+        }
+        CStrPtr treeFile{g_build_filename(gvfsDir_.c_str(), tree.first, nullptr)};
+        gchar* contents = nullptr;
+        gsize length = 0;
+        if (!g_file_get_contents(treeFile.get(), &contents, &length, nullptr)) {
+            continue;
+        }
+        CStrPtr holder{contents};
+        GvfsTree{contents, length}.read(tree.second, [&](const std::string& path, const Entry& entry) {
+            if (seen.emplace(path, records.size()).second) {
+                records.push_back(Record{path, entry});
+            }
+        });
+    }
+    // with no records, the file is still written, so that gvfs is not read again
+    writeRecords(records);
+}
+
+}  // namespace Fm
@@ -0,0 +1,100 @@
+#ifndef FM2_METADATASTORE_H
+#define FM2_METADATASTORE_H
+
+#include "../libfmqtglobals.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <gio/gio.h>
+#include "filepath.h"
+
+namespace Fm {
+
+// Keeps the emblems, custom icons and trust flags of local files in a file of its own below
+// $XDG_DATA_HOME, mapped in memory, rather than having GIO ask gvfsd-metadata for them file by
+// file. The records are sorted by the hash of the directory of their file, so that a listing
+// finds those of its directory with one binary search. Each change replaces the file, which is
+// mapped again once another process has replaced it. The first time, what gvfs keeps for local
+// files is imported. Off until setEnabled(true); while on, the metadata of local files is read
+// and written here only. Safe to use from any thread.
+class LIBFM_QT_API MetadataStore {
+   public:
+    struct Entry {
+        std::vector<std::string> emblems;  // icon names
+        std::string customIcon;            // an icon name, or the path or URI of an image
+        bool trusted = false;              // an executable allowed to run, see FileInfo::isTrustable()
+
+        bool isEmpty() const { return emblems.empty() && customIcon.empty() && !trusted; }
+    };
+
+    // the entries of the files of a directory, by name
+    using DirEntries = std::unordered_map<std::string, Entry>;
+
+    // |file| keeps the records; |gvfsDir| is where gvfs keeps its metadata, imported when |file|
+    // does not exist yet.
+    MetadataStore(std::string file, std::string gvfsDir);
+
+    ~MetadataStore();
+
+    static std::shared_ptr<MetadataStore> globalInstance();
+
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // The entries of the files in the local directory |dirPath|.
+    DirEntries directory(const std::string& dirPath);
+
+    // The entry of the local file |path|; false if it has none.
+    bool lookup(const std::string& path, Entry& entry);
+
+    // Changes the entry of the local file |path| with |change|; an entry left empty is removed.
+    // False if the records cannot be written.
+    bool update(const std::string& path, const std::function<void(Entry& entry)>& change);
+
+    // Sets the attributes FileInfo reads from the metadata of a file on |inf|.
+    static void apply(const Entry& entry, GFileInfo* inf);
+
+    // Adds the metadata of |path| to |inf|, queried without it, if |path| is local and the store
+    // is on.
+    static void addTo(const FilePath& path, GFileInfo* inf);
+
+   private:
+    struct Mapping;
+
+    struct Record {
+        std::string path;
+        Entry entry;
+    };
+
+    // The records as they are now, checked for a change by another process once a second at
+    // most. Should be called with mutex_ locked.
+    std::shared_ptr<const Mapping> currentMapping();
+
+    std::shared_ptr<const Mapping> mapFile() const;
+
+    // Replaces the file with |records| and maps it. Should be called with mutex_ locked, and the
+    // file locked.
+    bool writeRecords(std::vector<Record>& records);
+
+    // Imports the metadata trees of gvfs for the local filesystems. Should be called with mutex_
+    // locked, while the file does not exist.
+    void importGvfsMetadata();
+
+    static std::atomic<bool> enabled_;
+
+    std::string file_;
+    std::string gvfsDir_;
+    std::mutex mutex_;
+    std::shared_ptr<const Mapping> mapping_;
+    std::chrono::steady_clock::time_point checked_;  // when the file was last checked for a change
+};
+
+}  // namespace Fm
+
+#endif  // FM2_METADATASTORE_H
@@ -0,0 +1,319 @@
+#include "mimemagic.h"
+#include "cstrptr.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+namespace {
+
+// the offset of the magic list in the header of a cache, after the version and five other lists
+constexpr std::uint32_t kMagicListOffset = 24;
+constexpr std::uint32_t kMatchSize = 16;
+constexpr std::uint32_t kMatchletSize = 32;
+// nested rules deeper than this make a cache damaged
+constexpr int kMaxDepth = 32;
+// GIO never sniffs more than this
+constexpr std::size_t kMaxSniffLength = 4096;
+// how often (in ms) globalInstance() looks for changed caches
+constexpr std::int64_t kCheckInterval = 5000;
+
+// the caches are big-endian
+bool readUint32(const std::uint8_t* data, std::size_t size, std::uint32_t offset, std::uint32_t& value) {
+    if (offset > size || size - offset < 4) {
+        return false;
+    }
+    const std::uint8_t* p = data + offset;
+    value = (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+    return true;
+}
+
+std::int64_t mtimeOf(const std::string& file) {
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0) {
+        return -1;
+    }
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+}  // namespace
+
+MimeMagic::MimeMagic(const std::vector<std::string>& cacheFiles) {
+    for (const auto& file : cacheFiles) {
+        auto cache = std::make_unique<Cache>();
+        if (load(file, *cache)) {
+            index(*cache);
+            maxExtent_ = std::max<std::size_t>(maxExtent_, cache->maxExtent);
+            caches_.push_back(std::move(cache));
+        }
+        else if (cache->map) {
+            munmap(cache->map, cache->size);
+        }
+    }
+    // as GIO, which reads that much when the caches do not tell
+    maxExtent_ = maxExtent_ == 0 ? kMaxSniffLength : std::min(maxExtent_, kMaxSniffLength);
+}
+
+MimeMagic::~MimeMagic() {
+    for (const auto& cache : caches_) {
+        munmap(cache->map, cache->size);
+    }
+}
+
+bool MimeMagic::load(const std::string& file, Cache& cache) {
+    const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < kMagicListOffset + 4) {
+        close(fd);
+        return false;
+    }
+    cache.size = static_cast<std::size_t>(st.st_size);
+    void* map = mmap(nullptr, cache.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    cache.map = map;
+    const auto* data = static_cast<const std::uint8_t*>(map);
+
+    // version 1.x; the magic list holds the number of matches, the largest extent, and the first match
+    std::uint32_t listOffset, count, extent, firstMatch;
+    if (data[0] != 0 || data[1] != 1 || !readUint32(data, cache.size, kMagicListOffset, listOffset) ||
+        !readUint32(data, cache.size, listOffset, count) || !readUint32(data, cache.size, listOffset + 4, extent) ||
+        !readUint32(data, cache.size, listOffset + 8, firstMatch) || count > cache.size / kMatchSize) {
+        return false;
+    }
+    cache.maxExtent = extent;
+    cache.matches.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const std::uint32_t offset = firstMatch + i * kMatchSize;
+        std::uint32_t priority, typeOffset, matchletCount, matchletOffset;
+        if (!readUint32(data, cache.size, offset, priority) || !readUint32(data, cache.size, offset + 4, typeOffset) ||
+            !readUint32(data, cache.size, offset + 8, matchletCount) ||
+            !readUint32(data, cache.size, offset + 12, matchletOffset) || typeOffset >= cache.size ||
+            !std::memchr(data + typeOffset, '\0', cache.size - typeOffset)) {
+            return false;
+        }
+        Match match{priority, reinterpret_cast<const char*>(data + typeOffset),
+                    static_cast<std::uint32_t>(cache.matchlets.size()), matchletCount};
+        if (!addMatchlets(cache, matchletOffset, matchletCount, 0)) {
+            return false;
+        }
+        cache.matches.push_back(match);
+    }
+    return true;
+}
+
+// Adds the |count| matchlets at |offset|, next to each other, then the children of each.
+bool MimeMagic::addMatchlets(Cache& cache, std::uint32_t offset, std::uint32_t count, int depth) {
+    const auto* data = static_cast<const std::uint8_t*>(cache.map);
+    // children shared between rules would make more matchlets than the cache can hold
+    if (depth > kMaxDepth || count > cache.size / kMatchletSize - cache.matchlets.size()) {
+        return false;
+    }
+    const std::size_t first = cache.matchlets.size();
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> children;  // the offset and count of each
+    children.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const std::uint32_t at = offset + i * kMatchletSize;
+        std::uint32_t fields[8];  // range start and length, word size, value length and offset, mask, children
+        for (int field = 0; field < 8; ++field) {
+            if (!readUint32(data, cache.size, at + field * 4, fields[field])) {
+                return false;
+            }
+        }
+        const std::uint32_t valueLength = fields[3];
+        if (valueLength == 0 || fields[4] > cache.size || cache.size - fields[4] < valueLength ||
+            (fields[5] != 0 && (fields[5] > cache.size || cache.size - fields[5] < valueLength))) {
+            return false;
+        }
+        cache.matchlets.push_back(Matchlet{fields[0], fields[1], valueLength, data + fields[4],
+                                           fields[5] != 0 ? data + fields[5] : nullptr, 0, fields[6]});
+        children.emplace_back(fields[7], fields[6]);
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        cache.matchlets[first + i].firstChild = static_cast<std::uint32_t>(cache.matchlets.size());
+        if (!addMatchlets(cache, children[i].first, children[i].second, depth + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MimeMagic::index(Cache& cache) {
+    for (std::uint32_t i = 0; i < cache.matches.size(); ++i) {
+        const Match& match = cache.matches[i];
+        // the first bytes the top-level rules of the match accept, if they all look at it
+        bool accepted[256] = {};
+        bool anchored = match.matchletCount > 0;
+        for (std::uint32_t m = 0; m < match.matchletCount && anchored; ++m) {
+            const Matchlet& matchlet = cache.matchlets[match.firstMatchlet + m];
+            if (matchlet.rangeStart != 0 || matchlet.rangeLength > 1) {
+                anchored = false;
+                break;
+            }
+            const std::uint8_t mask = matchlet.mask ? matchlet.mask[0] : 0xff;
+            for (int byte = 0; byte < 256; ++byte) {
+                if ((byte & mask) == (matchlet.value[0] & mask)) {
+                    accepted[byte] = true;
+                }
+            }
+        }
+        if (!anchored) {
+            cache.unanchored.push_back(i);
+            continue;
+        }
+        for (int byte = 0; byte < 256; ++byte) {
+            if (accepted[byte]) {
+                cache.byFirstByte[byte].push_back(i);
+            }
+        }
+    }
+}
+
+bool MimeMagic::matchletMatches(const Cache& cache,
+                                const Matchlet& matchlet,
+                                const std::uint8_t* data,
+                                std::size_t size) {
+    // the positions the value fits at, within the range
+    const std::uint64_t start = matchlet.rangeStart;
+    if (start + matchlet.valueLength > size) {
+        return false;
+    }
+    const std::uint64_t end = std::min<std::uint64_t>(start + std::max(matchlet.rangeLength, 1u),
+                                                      size - matchlet.valueLength + 1);
+    bool found = false;
+    if (!matchlet.mask) {
+        // memchr() finds the candidates for the first byte much faster than a loop over the range
+        const std::uint8_t first = matchlet.value[0];
+        for (std::uint64_t pos = start; pos < end && !found;) {
+            const void* hit = std::memchr(data + pos, first, end - pos);
+            if (!hit) {
+                break;
+            }
+            pos = static_cast<const std::uint8_t*>(hit) - data;
+            found = std::memcmp(data + pos, matchlet.value, matchlet.valueLength) == 0;
+            ++pos;
+        }
+    }
+    else {
+        for (std::uint64_t pos = start; pos < end && !found; ++pos) {
+            std::uint32_t i = 0;
+            while (i < matchlet.valueLength &&
+                   (data[pos + i] & matchlet.mask[i]) == (matchlet.value[i] & matchlet.mask[i])) {
+                ++i;
+            }
+            found = i == matchlet.valueLength;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    if (matchlet.childCount == 0) {
+        return true;
+    }
+    for (std::uint32_t i = 0; i < matchlet.childCount; ++i) {
+        if (matchletMatches(cache, cache.matchlets[matchlet.firstChild + i], data, size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MimeMagic::matchMatches(const Cache& cache, const Match& match, const std::uint8_t* data, std::size_t size) {
+    for (std::uint32_t i = 0; i < match.matchletCount; ++i) {
+        if (matchletMatches(cache, cache.matchlets[match.firstMatchlet + i], data, size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const MimeMagic::Match* MimeMagic::firstMatch(const Cache& cache, const std::uint8_t* data, std::size_t size) {
+    // both lists are in the order of the matches, so merging them keeps the order of priority
+    const auto& anchored = cache.byFirstByte[data[0]];
+    auto a = anchored.cbegin();
+    auto u = cache.unanchored.cbegin();
+    while (a != anchored.cend() || u != cache.unanchored.cend()) {
+        const bool takeAnchored = u == cache.unanchored.cend() || (a != anchored.cend() && *a < *u);
+        const std::uint32_t i = takeAnchored ? *a++ : *u++;
+        if (matchMatches(cache, cache.matches[i], data, size)) {
+            return &cache.matches[i];
+        }
+    }
+    return nullptr;
+}
+
+const char* MimeMagic::match(const std::uint8_t* data, std::size_t size) const {
+    if (size == 0) {
+        return nullptr;
+    }
+    const Match* best = nullptr;
+    for (const auto& cache : caches_) {
+        const Match* match = firstMatch(*cache, data, size);
+        if (match && (!best || match->priority > best->priority)) {
+            best = match;
+        }
+    }
+    return best ? best->mimeType : nullptr;
+}
+
+bool MimeMagic::looksLikeText(const std::uint8_t* data, std::size_t size) {
+    // control characters other than whitespace and backspace, as g_content_type_guess() checks
+    for (std::size_t i = 0; i < size; ++i) {
+        const std::uint8_t c = data[i];
+        if ((c < 0x20 || c == 0x7f) && c != '\t' && c != '\n' && c != '\v' && c != '\f' && c != '\r' && c != '\b') {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const MimeMagic> MimeMagic::globalInstance() {
+    static std::mutex mutex;
+    static std::shared_ptr<const MimeMagic> instance;
+    static std::vector<std::pair<std::string, std::int64_t>> stamps;  // the caches and their modification times
+    static std::chrono::steady_clock::time_point lastCheck;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    const auto now = std::chrono::steady_clock::now();
+    if (instance && now - lastCheck < std::chrono::milliseconds(kCheckInterval)) {
+        return instance;
+    }
+    lastCheck = now;
+
+    // the user's types first, as GIO reads them
+    std::vector<std::pair<std::string, std::int64_t>> current;
+    CStrPtr userCache{g_build_filename(g_get_user_data_dir(), "mime", "mime.cache", nullptr)};
+    current.emplace_back(userCache.get(), 0);
+    for (const char* const* dir = g_get_system_data_dirs(); *dir; ++dir) {
+        CStrPtr cache{g_build_filename(*dir, "mime", "mime.cache", nullptr)};
+        current.emplace_back(cache.get(), 0);
+    }
+    for (auto& cache : current) {
+        cache.second = mtimeOf(cache.first);
+    }
+    if (!instance || current != stamps) {
+        std::vector<std::string> files;
+        for (const auto& cache : current) {
+            if (cache.second >= 0) {
+                files.push_back(cache.first);
+            }
+        }
+        instance = std::make_shared<const MimeMagic>(files);
+        stamps = std::move(current);
+    }
+    return instance;
+}
+
+}  // namespace Fm
@@ -0,0 +1,92 @@
+#ifndef FM2_MIMEMAGIC_H
+#define FM2_MIMEMAGIC_H
+
+#include "../libfmqtglobals.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Fm {
+
+// The magic rules of the shared-mime-info caches (mime.cache), read from the memory-mapped
+// caches themselves, so that the content of local files can be sniffed without a GIO query
+// per file. The rules are compiled into matches indexed by the first byte they accept; a
+// rule looking past the first byte, or at a range of offsets, is tried for every file. Like
+// GIO, the match of the highest priority wins, the first cache winning a tie. Immutable once
+// built, so it may be used from any thread.
+class LIBFM_QT_API MimeMagic {
+   public:
+    // |cacheFiles| in the order of precedence; those missing or damaged are skipped.
+    explicit MimeMagic(const std::vector<std::string>& cacheFiles);
+
+    ~MimeMagic();
+
+    MimeMagic(const MimeMagic&) = delete;
+    MimeMagic& operator=(const MimeMagic&) = delete;
+
+    // The rules of the caches in the XDG data directories. Built again, for the callers that
+    // come after, when a cache is seen to have changed; that is checked every few seconds.
+    static std::shared_ptr<const MimeMagic> globalInstance();
+
+    bool isValid() const { return !caches_.empty(); }
+
+    // How many bytes at the start of a file the rules may look at.
+    std::size_t maxExtent() const { return maxExtent_; }
+
+    // The type of the rule of the highest priority |data|, the first bytes of a file, matches;
+    // null if none does. Points into a cache, which lives as long as this.
+    const char* match(const std::uint8_t* data, std::size_t size) const;
+
+    // Whether GIO would take |data| for text when no rule matches it.
+    static bool looksLikeText(const std::uint8_t* data, std::size_t size);
+
+   private:
+    struct Matchlet {
+        std::uint32_t rangeStart;
+        std::uint32_t rangeLength;
+        std::uint32_t valueLength;
+        const std::uint8_t* value;
+        const std::uint8_t* mask;  // null if there is none
+        std::uint32_t firstChild;  // in matchlets, the children being next to each other
+        std::uint32_t childCount;
+    };
+
+    struct Match {
+        std::uint32_t priority;
+        const char* mimeType;
+        std::uint32_t firstMatchlet;
+        std::uint32_t matchletCount;
+    };
+
+    struct Cache {
+        void* map = nullptr;
+        std::size_t size = 0;
+        std::uint32_t maxExtent = 0;
+        std::vector<Match> matches;  // by decreasing priority, as in the cache
+        std::vector<Matchlet> matchlets;
+        // the matches whose rules all look at the first byte, by that byte, and the others
+        std::array<std::vector<std::uint32_t>, 256> byFirstByte;
+        std::vector<std::uint32_t> unanchored;
+    };
+
+    static bool load(const std::string& file, Cache& cache);
+    static bool addMatchlets(Cache& cache, std::uint32_t offset, std::uint32_t count, int depth);
+    static void index(Cache& cache);
+    static bool matchletMatches(const Cache& cache,
+                                const Matchlet& matchlet,
+                                const std::uint8_t* data,
+                                std::size_t size);
+    static bool matchMatches(const Cache& cache, const Match& match, const std::uint8_t* data, std::size_t size);
+    // the first match of |cache|, or null
+    static const Match* firstMatch(const Cache& cache, const std::uint8_t* data, std::size_t size);
+
+    std::vector<std::unique_ptr<Cache>> caches_;
+    std::size_t maxExtent_ = 0;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_MIMEMAGIC_H
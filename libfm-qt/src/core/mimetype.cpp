@@ -8,7 +8,7 @@ using namespace std;
 
 namespace Fm {
 
-std::unordered_map<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> MimeType::cache_;
+ShardedCache<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> MimeType::cache_;
 std::mutex MimeType::mutex_;
 
 std::shared_ptr<const MimeType> MimeType::inodeDirectory_;   // inode/directory
@@ -30,17 +30,31 @@ MimeType::~MimeType() {}
 
 // static
 std::shared_ptr<const MimeType> MimeType::fromName(const char* typeName) {
-    std::shared_ptr<const MimeType> ret;
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = cache_.find(typeName);
-    if (it == cache_.end()) {
-        ret = std::make_shared<MimeType>(typeName);
-        cache_.insert(std::make_pair(ret->name_.get(), ret));
+    if (auto cached = cache_.find(typeName)) {
+        return cached;
     }
-    else {
-        ret = it->second;
+    // created unlocked; if another thread cached the type meanwhile, this one is dropped
+    auto type = std::make_shared<const MimeType>(typeName);
+    return cache_.insert(type->name_.get(), type);
+}
+
+// static
+void MimeType::preloadCommonTypes() {
+    // also sets the shortcuts, which are not safe to set lazily from several threads
+    inodeDirectory();
+    inodeShortcut();
+    inodeMountPoint();
+    desktopEntry();
+    static const char* const commonTypes[] = {
+        "application/octet-stream", "application/x-zerosize", "application/x-executable", "application/x-sharedlib",
+        "application/pdf",          "application/zip",        "inode/symlink",            "text/plain",
+        "text/html",                "text/markdown",          "text/x-csrc",              "text/x-chdr",
+        "text/x-c++src",            "text/x-python",          "image/png",                "image/jpeg",
+        "image/svg+xml",            "audio/mpeg",             "video/mp4",
+    };
+    for (const char* type : commonTypes) {
+        fromName(type);
     }
-    return ret;
 }
 
 // static
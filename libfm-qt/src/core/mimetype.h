@@ -38,6 +38,7 @@
 #include "cstrptr.h"
 #include "gobjectptr.h"
 #include "iconinfo.h"
+#include "shardedcache.h"
 #include "thumbnailer.h"
 
 namespace Fm {
@@ -81,6 +82,10 @@ class LIBFM_QT_API MimeType {
 
     static std::shared_ptr<const MimeType> guessFromFileName(const char* fileName);
 
+    // Fills the cache with the types nearly every folder has, so that listings find them
+    // without creating them. Called once at startup, before any other thread uses the types.
+    static void preloadCommonTypes();
+
     bool isUnknownType() const { return g_content_type_is_unknown(name_.get()); }
 
     bool isDesktopEntry() const { return this == desktopEntry().get(); }
@@ -89,6 +94,8 @@ class LIBFM_QT_API MimeType {
 
     bool isImage() const { return !std::strncmp("image/", name_.get(), 6); }
 
+    bool isVideo() const { return !std::strncmp("video/", name_.get(), 6); }
+
     bool isMountable() const { return this == inodeMountPoint().get(); }
 
     bool isShortcut() const { return this == inodeShortcut().get(); }
@@ -137,8 +144,8 @@ class LIBFM_QT_API MimeType {
     CStrPtr name_;
     mutable CStrPtr desc_;
     std::forward_list<std::shared_ptr<const Thumbnailer>> thumbnailers_;
-    static std::unordered_map<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> cache_;
-    static std::mutex mutex_;
+    static ShardedCache<const char*, std::shared_ptr<const MimeType>, CStrHash, CStrEqual> cache_;
+    static std::mutex mutex_;  // guards the thumbnailer lists
 
     static std::shared_ptr<const MimeType> inodeDirectory_;   // inode/directory
     static std::shared_ptr<const MimeType> inodeShortcut_;    // inode/x-shortcut
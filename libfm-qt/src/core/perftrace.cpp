@@ -0,0 +1,170 @@
+#include "perftrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+
+namespace Fm {
+
+namespace {
+
+struct Event {
+    const char* name;
+    int64_t start;
+    int64_t duration;
+    int64_t amount;
+    unsigned int thread;
+};
+
+const char* const kCounterNames[PerfTrace::NumCounters] = {
+    "DirListJob entries",
+    "Folder events",
+    "Thumbnail queue",
+    "Thumbnail memory hits",
+    "Thumbnail disk hits",
+    "Thumbnails generated",
+    "Thumbnails failed",
+    "Thumbnails shown",
+    "Transfer bytes",
+    "Transfer files",
+    "Wakeups: folder updates",
+    "Wakeups: cache budget",
+    "Wakeups: job watchdog",
+    "Wakeups: listing expiry",
+    "Wakeups: trash update",
+};
+
+const auto origin = std::chrono::steady_clock::now();
+
+std::atomic<unsigned int> lastThread{0};
+
+std::mutex mutex;
+std::vector<Event> events;  // a ring of kMaxEvents once full
+std::size_t nextEvent = 0;  // where the ring is written next
+std::vector<PerfTrace::SpanStats> stats;
+
+// threads are numbered as they record their first span, which keeps the numbers small
+unsigned int threadNumber() {
+    thread_local const unsigned int number = ++lastThread;
+    return number;
+}
+
+void appendName(QByteArray& out, const char* name) {
+    out += '"';
+    for (const char* c = name; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out += '\\';
+        }
+        out += *c;
+    }
+    out += '"';
+}
+
+}  // namespace
+
+std::atomic<bool> PerfTrace::enabled_{false};
+std::atomic<int64_t> PerfTrace::counters_[PerfTrace::NumCounters] = {};
+
+void PerfTrace::setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+const char* PerfTrace::counterName(Counter counter) {
+    return kCounterNames[counter];
+}
+
+int64_t PerfTrace::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void PerfTrace::record(const char* name, int64_t start, int64_t duration, int64_t amount) {
+    const unsigned int thread = threadNumber();
+    std::lock_guard<std::mutex> lock{mutex};
+    const Event event{name, start, duration, amount, thread};
+    if (events.size() < kMaxEvents) {
+        events.push_back(event);
+    }
+    else {
+        events[nextEvent] = event;
+    }
+    nextEvent = (nextEvent + 1) % kMaxEvents;
+
+    // few names are used, so a list is as quick as a map
+    auto it = stats.begin();
+    while (it != stats.end() && it->name != name && std::strcmp(it->name, name) != 0) {
+        ++it;
+    }
+    if (it == stats.end()) {
+        it = stats.insert(stats.end(), SpanStats{name});
+    }
+    ++it->count;
+    it->totalUs += duration;
+    it->maxUs = std::max(it->maxUs, duration);
+    it->lastUs = duration;
+    if (amount > 0) {
+        it->amount += amount;
+    }
+}
+
+std::vector<PerfTrace::SpanStats> PerfTrace::spanStats() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return stats;
+}
+
+void PerfTrace::reset() {
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        events.clear();
+        nextEvent = 0;
+        stats.clear();
+    }
+    for (int i = 0; i < NumCounters; ++i) {
+        if (i != ThumbnailQueue) {
+            counters_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+QByteArray PerfTrace::toChromeTrace() {
+    const QByteArray pid = QByteArray::number(static_cast<qint64>(::getpid()));
+    QByteArray out = "{\"traceEvents\":[";
+    bool first = true;
+    auto beginEvent = [&]() {
+        out += first ? "\n" : ",\n";
+        first = false;
+    };
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        out.reserve(events.size() * 96 + 1024);
+        // oldest first: once the ring is full, that is the one written next
+        const std::size_t firstEvent = events.size() < kMaxEvents ? 0 : nextEvent;
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            const Event& event = events[(firstEvent + i) % events.size()];
+            beginEvent();
+            out += "{\"name\":";
+            appendName(out, event.name);
+            out += ",\"cat\":\"libfm-qt\",\"ph\":\"X\",\"ts\":" + QByteArray::number(event.start) +
+                   ",\"dur\":" + QByteArray::number(event.duration) + ",\"pid\":" + pid +
+                   ",\"tid\":" + QByteArray::number(event.thread);
+            if (event.amount >= 0) {
+                out += ",\"args\":{\"amount\":" + QByteArray::number(event.amount) + '}';
+            }
+            out += '}';
+        }
+    }
+
+    // the counters as they are now, each on a track of its own
+    const QByteArray ts = QByteArray::number(now());
+    for (int i = 0; i < NumCounters; ++i) {
+        beginEvent();
+        out += "{\"name\":";
+        appendName(out, kCounterNames[i]);
+        out += ",\"ph\":\"C\",\"ts\":" + ts + ",\"pid\":" + pid + ",\"args\":{\"value\":" +
+               QByteArray::number(counter(static_cast<Counter>(i))) + "}}";
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+}  // namespace Fm
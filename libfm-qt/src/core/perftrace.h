@@ -0,0 +1,111 @@
+#ifndef FM2_PERFTRACE_H
+#define FM2_PERFTRACE_H
+
+#include "../libfmqtglobals.h"
+#include <QByteArray>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace Fm {
+
+// Counters and timed spans of the work done by the jobs, folders and views, to find out where
+// the time goes in a running session. It is compiled in but off until setEnabled(true): while
+// off, a span or a counter costs a relaxed atomic load. While on, the latest kMaxEvents spans
+// are kept, which toChromeTrace() writes as Chrome trace events, the JSON format loaded by
+// chrome://tracing and Perfetto. Used from any thread.
+class LIBFM_QT_API PerfTrace {
+   public:
+    enum Counter {
+        DirListEntries,       // files listed by DirListJob
+        FolderEvents,         // file monitor events handled by Folder
+        ThumbnailQueue,       // files waiting in a ThumbnailJob, a gauge kept even while off
+        ThumbnailMemoryHits,  // thumbnails found in the memory cache
+        ThumbnailDiskHits,    // thumbnails read from ~/.cache/thumbnails
+        ThumbnailGenerated,   // thumbnails made anew, or tried to be
+        ThumbnailFailed,      // of those, the files no thumbnail could be made of
+        ThumbnailShown,       // loaded thumbnails a view asked FolderModel for, each counted once
+        TransferBytes,        // bytes copied by FileTransferJob
+        TransferFiles,        // files copied or moved by FileTransferJob
+        // the timers that wake an idle session up, each counted when it fires
+        WakeupFolderUpdates,  // Folder handling a batch of monitor events
+        WakeupCacheBudget,    // CacheRegistry checking the memory budget
+        WakeupJobWatchdog,    // JobScheduler checking the remote mounts
+        WakeupListingExpiry,  // SharedListingService dropping unused listings
+        WakeupTrashUpdate,    // PlacesModel counting the files in the trash
+        NumCounters
+    };
+
+    struct SpanStats {
+        const char* name;
+        uint64_t count = 0;
+        int64_t totalUs = 0;
+        int64_t maxUs = 0;
+        int64_t lastUs = 0;
+        int64_t amount = 0;  // the sum of the amounts given to the spans, as files or bytes
+    };
+
+    static constexpr std::size_t kMaxEvents = 100000;
+
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool enabled);
+
+    static void add(Counter counter, int64_t amount = 1) {
+        if (isEnabled()) {
+            counters_[counter].fetch_add(amount, std::memory_order_relaxed);
+        }
+    }
+
+    static void addToGauge(Counter counter, int64_t amount) {
+        counters_[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    static int64_t counter(Counter counter) { return counters_[counter].load(std::memory_order_relaxed); }
+
+    static const char* counterName(Counter counter);
+
+    // The spans by name, in the order their names were first seen.
+    static std::vector<SpanStats> spanStats();
+
+    // Forgets the spans and the counters, but for the gauges.
+    static void reset();
+
+    static QByteArray toChromeTrace();
+
+    // Times what happens while it lives, when enabled at its construction. |name| is a string
+    // literal, which is kept by address.
+    class Scope {
+       public:
+        explicit Scope(const char* name) : name_{isEnabled() ? name : nullptr}, start_{name_ ? now() : 0} {}
+
+        ~Scope() {
+            if (name_) {
+                record(name_, start_, now() - start_, amount_);
+            }
+        }
+
+        // What the span worked on, as the files listed; shown in the trace and summed up.
+        void setAmount(int64_t amount) { amount_ = amount; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        const char* name_;
+        int64_t start_;
+        int64_t amount_ = -1;
+    };
+
+   private:
+    static int64_t now();  // microseconds since the library was loaded
+
+    static void record(const char* name, int64_t start, int64_t duration, int64_t amount);
+
+    static std::atomic<bool> enabled_;
+    static std::atomic<int64_t> counters_[NumCounters];
+};
+
+}  // namespace Fm
+
+#endif  // FM2_PERFTRACE_H
@@ -0,0 +1,58 @@
+#include "rowrangeset.h"
+#include <algorithm>
+#include <iterator>
+
+namespace Fm {
+
+void RowRangeSet::insert(int first, int last) {
+    if (first > last) {
+        return;
+    }
+    // start from the range before |first| if it reaches it or ends right before it
+    auto it = ranges_.upper_bound(first);
+    if (it != ranges_.begin() && std::prev(it)->second >= first - 1) {
+        --it;
+    }
+    // and swallow every range up to the one starting right after |last|
+    while (it != ranges_.end() && it->first <= last + 1) {
+        first = std::min(first, it->first);
+        last = std::max(last, it->second);
+        count_ -= static_cast<std::size_t>(it->second - it->first) + 1;
+        it = ranges_.erase(it);
+    }
+    ranges_.emplace_hint(it, first, last);
+    count_ += static_cast<std::size_t>(last - first) + 1;
+}
+
+void RowRangeSet::erase(int first, int last) {
+    if (first > last) {
+        return;
+    }
+    auto it = ranges_.upper_bound(first);
+    if (it != ranges_.begin() && std::prev(it)->second >= first) {
+        --it;
+    }
+    while (it != ranges_.end() && it->first <= last) {
+        const int rangeFirst = it->first;
+        const int rangeLast = it->second;
+        count_ -= static_cast<std::size_t>(rangeLast - rangeFirst) + 1;
+        it = ranges_.erase(it);
+        // keep what sticks out on either side
+        if (rangeFirst < first) {
+            ranges_.emplace_hint(it, rangeFirst, first - 1);
+            count_ += static_cast<std::size_t>(first - rangeFirst);
+        }
+        if (rangeLast > last) {
+            ranges_.emplace_hint(it, last + 1, rangeLast);
+            count_ += static_cast<std::size_t>(rangeLast - last);
+            break;
+        }
+    }
+}
+
+bool RowRangeSet::contains(int row) const {
+    auto it = ranges_.upper_bound(row);
+    return it != ranges_.begin() && std::prev(it)->second >= row;
+}
+
+}  // namespace Fm
@@ -0,0 +1,42 @@
+#ifndef FM2_ROWRANGESET_H
+#define FM2_ROWRANGESET_H
+
+#include "../libfmqtglobals.h"
+#include <cstddef>
+#include <map>
+
+namespace Fm {
+
+// A set of rows kept as disjoint ranges, merged as they touch, in an ordered map by their
+// first rows. Adding or removing a range of rows, or asking whether one row is in the set,
+// takes logarithmic time in the number of ranges, however many rows they hold.
+class LIBFM_QT_API RowRangeSet {
+   public:
+    using Ranges = std::map<int, int>;  // the last row of each range, by its first
+
+    void insert(int first, int last);
+
+    void erase(int first, int last);
+
+    void clear() {
+        ranges_.clear();
+        count_ = 0;
+    }
+
+    bool contains(int row) const;
+
+    bool empty() const { return ranges_.empty(); }
+
+    // the number of rows in the set
+    std::size_t count() const { return count_; }
+
+    const Ranges& ranges() const { return ranges_; }
+
+   private:
+    Ranges ranges_;
+    std::size_t count_ = 0;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_ROWRANGESET_H
@@ -0,0 +1,824 @@
+#include "searchindex.h"
+#include "gioptrs.h"
+#include <QCoreApplication>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <utility>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Fm {
+
+namespace {
+
+constexpr char kMagic[8] = {'F', 'M', 'S', 'R', 'C', 'H', 'I', '1'};
+
+constexpr std::uint32_t kNone = UINT32_MAX;
+constexpr std::uint32_t kRoot = 0;  // the node of the folder itself
+// a folder holding more files than this is not indexed, it would take a few GiB
+constexpr std::uint32_t kMaxFiles = 1 << 24;
+// directories beyond this many per folder are checked by their modification time instead
+constexpr std::size_t kMaxDirWatches = 1 << 16;
+// index files are written in chunks of about this size
+constexpr std::size_t kWriteChunk = 1 << 20;
+// names are packed again once this many bytes of them belong to removed files
+constexpr std::size_t kMinUnusedNameBytes = 1 << 20;
+
+constexpr std::uint8_t kDirectory = 1;
+constexpr std::uint8_t kUnindexed = 2;  // a directory on another filesystem
+constexpr std::uint8_t kFree = 4;
+
+// The fixed part of the record of a file in an index file, followed by |nameLength| bytes
+// of name. Parents are written before their children and referred to by their position.
+struct Record {
+    std::uint32_t parent;
+    std::uint16_t nameLength;
+    std::uint8_t flags;
+    std::uint8_t reserved;
+    std::int64_t mtime;
+};
+
+std::int64_t mtimeOf(const struct stat& st) {
+    return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+std::string childPath(const std::string& dir, const char* name) {
+    std::string path;
+    path.reserve(dir.size() + std::strlen(name) + 1);
+    path = dir;
+    if (path.empty() || path.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+bool writeAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+}  // namespace
+
+// The files below one folder, as a tree of nodes whose names are kept in a single buffer.
+// Not thread-safe; SearchIndex guards it.
+class SearchIndex::Tree {
+   public:
+    explicit Tree(std::string rootPath) : rootPath_{std::move(rootPath)} {}
+
+    // Reads everything below the folder. False when cancelled, or when there are too many files.
+    bool build(const std::atomic<bool>& cancelled);
+
+    // Reads back what save() wrote for the same folder; revalidate() should follow.
+    bool load(const std::string& file);
+
+    bool save(const std::string& file);
+
+    // Reads again the directories whose modification time changed.
+    bool revalidate(const std::atomic<bool>& cancelled);
+
+    // Reads again the directory |dir| if it is indexed, and whatever new is inside it.
+    bool refreshDir(const std::string& dir);
+
+    // Reads again |dir| if it changed since it was read.
+    bool refreshIfModified(const std::string& dir);
+
+    // See SearchIndex::find(); false if |dir| is not an indexed directory.
+    bool find(const std::string& dir,
+              bool showHidden,
+              const std::function<bool(const char* name)>& match,
+              std::vector<std::string>& paths,
+              std::vector<std::string>& unindexedDirs) const;
+
+    // the directories added and removed since the last call, for SearchIndex to watch them
+    std::vector<std::string> takeNewDirs() { return std::move(newDirs_); }
+    std::vector<std::string> takeGoneDirs() { return std::move(goneDirs_); }
+    bool hasDirChanges() const { return !newDirs_.empty() || !goneDirs_.empty(); }
+
+    bool modified() const { return modified_; }
+
+   private:
+    struct Node {
+        std::uint32_t parent = kNone;
+        std::uint32_t firstChild = kNone;
+        std::uint32_t nextSibling = kNone;
+        std::uint32_t nameOffset = 0;
+        std::uint16_t nameLength = 0;
+        std::uint8_t flags = 0;
+        std::int64_t mtime = 0;  // of a directory, in nanoseconds
+    };
+
+    using Queue = std::deque<std::pair<std::uint32_t, std::string>>;
+
+    const char* nameOf(std::uint32_t id) const { return names_.data() + nodes_[id].nameOffset; }
+    std::uint32_t addNode(std::uint32_t parent, const char* name, std::size_t length, std::uint8_t flags);
+    void addDir(std::uint32_t id, std::string path);
+    // frees |id| and everything below it, without unlinking it from its parent
+    void freeSubtree(std::uint32_t id, const std::string& path);
+    // reads the directories in |queue| and the new ones found inside them
+    bool readQueue(Queue& queue, const std::atomic<bool>* cancelled);
+    void readDir(std::uint32_t id, const std::string& path, Queue& queue);
+    void packNames();
+
+    std::string rootPath_;
+    dev_t device_ = 0;
+    std::vector<Node> nodes_;
+    std::string names_;  // NUL-terminated names
+    std::size_t unusedNameBytes_ = 0;
+    std::vector<std::uint32_t> freeNodes_;
+    std::unordered_map<std::string, std::uint32_t> dirs_;
+    std::vector<std::string> newDirs_;
+    std::vector<std::string> goneDirs_;
+    bool tooLarge_ = false;
+    bool modified_ = false;
+};
+
+std::uint32_t SearchIndex::Tree::addNode(std::uint32_t parent,
+                                         const char* name,
+                                         std::size_t length,
+                                         std::uint8_t flags) {
+    if (nodes_.size() - freeNodes_.size() >= kMaxFiles) {
+        tooLarge_ = true;
+        return kNone;
+    }
+    Node node;
+    node.parent = parent;
+    node.nameOffset = static_cast<std::uint32_t>(names_.size());
+    node.nameLength = static_cast<std::uint16_t>(length);
+    node.flags = flags;
+    names_.append(name, length);
+    names_ += '\0';
+
+    std::uint32_t id;
+    if (!freeNodes_.empty()) {
+        id = freeNodes_.back();
+        freeNodes_.pop_back();
+        nodes_[id] = node;
+    }
+    else {
+        id = static_cast<std::uint32_t>(nodes_.size());
+        nodes_.push_back(node);
+    }
+    modified_ = true;
+    return id;
+}
+
+void SearchIndex::Tree::addDir(std::uint32_t id, std::string path) {
+    newDirs_.push_back(path);
+    dirs_.emplace(std::move(path), id);
+}
+
+void SearchIndex::Tree::freeSubtree(std::uint32_t id, const std::string& path) {
+    std::vector<std::pair<std::uint32_t, std::string>> stack{{id, path}};
+    while (!stack.empty()) {
+        auto [node, nodePath] = std::move(stack.back());
+        stack.pop_back();
+        if (nodes_[node].flags & kDirectory) {
+            for (auto child = nodes_[node].firstChild; child != kNone; child = nodes_[child].nextSibling) {
+                stack.emplace_back(child, childPath(nodePath, nameOf(child)));
+            }
+            dirs_.erase(nodePath);
+            goneDirs_.push_back(std::move(nodePath));
+        }
+        unusedNameBytes_ += nodes_[node].nameLength + 1u;
+        nodes_[node].flags = kFree;
+        nodes_[node].firstChild = kNone;
+        freeNodes_.push_back(node);
+    }
+    modified_ = true;
+}
+
+void SearchIndex::Tree::readDir(std::uint32_t id, const std::string& path, Queue& queue) {
+    // the children read before, to keep those still there
+    std::unordered_map<std::string, std::uint32_t> oldChildren;
+    for (auto child = nodes_[id].firstChild; child != kNone; child = nodes_[child].nextSibling) {
+        oldChildren.emplace(nameOf(child), child);
+    }
+    std::uint32_t firstChild = kNone;
+
+    const int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        nodes_[id].mtime = mtimeOf(st);
+        if (st.st_dev != device_) {
+            nodes_[id].flags |= kUnindexed;
+            close(fd);
+        }
+        else if (DIR* dir = fdopendir(fd)) {
+            nodes_[id].flags &= ~kUnindexed;
+            while (const struct dirent* entry = readdir(dir)) {
+                const char* name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+                bool isDir = entry->d_type == DT_DIR;
+                struct stat childSt;
+                if (entry->d_type == DT_UNKNOWN && fstatat(dirfd(dir), name, &childSt, AT_SYMLINK_NOFOLLOW) == 0) {
+                    isDir = S_ISDIR(childSt.st_mode);
+                }
+
+                std::uint32_t child;
+                auto it = oldChildren.find(name);
+                if (it != oldChildren.end() && isDir == bool(nodes_[it->second].flags & kDirectory)) {
+                    child = it->second;
+                    oldChildren.erase(it);
+                }
+                else {
+                    child = addNode(id, name, std::strlen(name), isDir ? kDirectory : 0);
+                    if (child == kNone) {
+                        break;
+                    }
+                    if (isDir) {
+                        std::string subdir = childPath(path, name);
+                        addDir(child, subdir);
+                        queue.emplace_back(child, std::move(subdir));
+                    }
+                }
+                nodes_[child].nextSibling = firstChild;
+                firstChild = child;
+            }
+            closedir(dir);
+        }
+        else {
+            close(fd);
+        }
+    }
+    else if (fd >= 0) {
+        close(fd);
+    }
+    // an unreadable directory is kept, empty, with the time it had; it is read again once it changes
+
+    for (const auto& oldChild : oldChildren) {
+        freeSubtree(oldChild.second, childPath(path, oldChild.first.c_str()));
+    }
+    nodes_[id].firstChild = firstChild;
+}
+
+bool SearchIndex::Tree::readQueue(Queue& queue, const std::atomic<bool>* cancelled) {
+    while (!queue.empty() && !tooLarge_) {
+        if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+            return false;
+        }
+        auto [id, path] = std::move(queue.front());
+        queue.pop_front();
+        readDir(id, path, queue);
+    }
+    if (unusedNameBytes_ >= kMinUnusedNameBytes && unusedNameBytes_ * 2 >= names_.size()) {
+        packNames();
+    }
+    return !tooLarge_;
+}
+
+void SearchIndex::Tree::packNames() {
+    std::string names;
+    names.reserve(names_.size() - unusedNameBytes_);
+    for (auto& node : nodes_) {
+        if (!(node.flags & kFree)) {
+            const auto offset = static_cast<std::uint32_t>(names.size());
+            names.append(names_, node.nameOffset, node.nameLength + 1u);
+            node.nameOffset = offset;
+        }
+    }
+    names_.swap(names);
+    unusedNameBytes_ = 0;
+}
+
+bool SearchIndex::Tree::build(const std::atomic<bool>& cancelled) {
+    struct stat st;
+    if (lstat(rootPath_.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+    device_ = st.st_dev;
+    const std::uint32_t root = addNode(kNone, "", 0, kDirectory);
+    addDir(root, rootPath_);
+    Queue queue{{root, rootPath_}};
+    return readQueue(queue, &cancelled);
+}
+
+bool SearchIndex::Tree::load(const std::string& file) {
+    struct stat rootSt;
+    if (lstat(rootPath_.c_str(), &rootSt) != 0 || !S_ISDIR(rootSt.st_mode)) {
+        return false;
+    }
+    device_ = rootSt.st_dev;
+
+    std::string data;
+    const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data.resize(static_cast<std::size_t>(st.st_size));
+        std::size_t done = 0;
+        while (done < data.size()) {
+            const ssize_t n = read(fd, &data[done], data.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += static_cast<std::size_t>(n);
+        }
+        data.resize(done);
+    }
+    close(fd);
+
+    // the magic, the length of the folder path, the path, and the number of records
+    std::size_t pos = sizeof(kMagic);
+    std::uint32_t rootLength = 0;
+    std::uint32_t count = 0;
+    if (data.size() < pos + sizeof(rootLength) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        return false;
+    }
+    std::memcpy(&rootLength, data.data() + pos, sizeof(rootLength));
+    pos += sizeof(rootLength);
+    if (data.size() < pos + rootLength + sizeof(count) || data.compare(pos, rootLength, rootPath_) != 0) {
+        return false;
+    }
+    pos += rootLength;
+    std::memcpy(&count, data.data() + pos, sizeof(count));
+    pos += sizeof(count);
+    if (count == 0 || count > kMaxFiles) {
+        return false;
+    }
+
+    // records are numbered as they were written, which is how children refer to their parent
+    std::vector<std::uint32_t> ids(count, kNone);
+    std::unordered_map<std::uint32_t, std::string> dirPaths;
+    nodes_.reserve(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        Record record;
+        if (pos + sizeof(record) > data.size()) {
+            return false;
+        }
+        std::memcpy(&record, data.data() + pos, sizeof(record));
+        pos += sizeof(record);
+        if (pos + record.nameLength > data.size() || (i == 0) != (record.parent == kNone) ||
+            (i > 0 && (record.parent >= i || !(nodes_[ids[record.parent]].flags & kDirectory)))) {
+            return false;
+        }
+        const std::uint32_t parent = i == 0 ? kNone : ids[record.parent];
+        const std::uint32_t id = addNode(parent, data.data() + pos, record.nameLength, record.flags & ~kFree);
+        pos += record.nameLength;
+        nodes_[id].mtime = record.mtime;
+        ids[i] = id;
+        if (parent != kNone) {
+            nodes_[id].nextSibling = nodes_[parent].firstChild;
+            nodes_[parent].firstChild = id;
+        }
+        if (record.flags & kDirectory) {
+            std::string path = parent == kNone ? rootPath_ : childPath(dirPaths[parent], nameOf(id));
+            addDir(id, path);
+            dirPaths.emplace(id, std::move(path));
+        }
+    }
+    modified_ = false;
+    return true;
+}
+
+bool SearchIndex::Tree::save(const std::string& file) {
+    CStrPtr dir{g_path_get_dirname(file.c_str())};
+    g_mkdir_with_parents(dir.get(), 0700);
+    const std::string tmpFile = file + ".tmp";
+    const int fd = open(tmpFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::string data{kMagic, sizeof(kMagic)};
+    const auto rootLength = static_cast<std::uint32_t>(rootPath_.size());
+    const auto count = static_cast<std::uint32_t>(nodes_.size() - freeNodes_.size());
+    data.append(reinterpret_cast<const char*>(&rootLength), sizeof(rootLength));
+    data += rootPath_;
+    data.append(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    // breadth first from the folder, so that parents come before their children
+    bool ok = true;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> queue{{kRoot, kNone}};  // the node and its parent record
+    for (std::size_t i = 0; i < queue.size() && ok; ++i) {
+        const auto [id, parent] = queue[i];
+        const Node& node = nodes_[id];
+        const Record record{parent, node.nameLength, node.flags, 0, node.mtime};
+        data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        data.append(nameOf(id), node.nameLength);
+        for (auto child = node.firstChild; child != kNone; child = nodes_[child].nextSibling) {
+            queue.emplace_back(child, static_cast<std::uint32_t>(i));
+        }
+        if (data.size() >= kWriteChunk) {
+            ok = writeAll(fd, data.data(), data.size());
+            data.clear();
+        }
+    }
+    ok = ok && writeAll(fd, data.data(), data.size());
+    if (close(fd) != 0 || !ok || rename(tmpFile.c_str(), file.c_str()) != 0) {
+        unlink(tmpFile.c_str());
+        return false;
+    }
+    modified_ = false;
+    return true;
+}
+
+bool SearchIndex::Tree::revalidate(const std::atomic<bool>& cancelled) {
+    const std::vector<std::pair<std::string, std::uint32_t>> dirs{dirs_.cbegin(), dirs_.cend()};
+    Queue queue;
+    for (const auto& dir : dirs) {
+        if (cancelled.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        auto it = dirs_.find(dir.first);
+        if (it == dirs_.cend() || it->second != dir.second) {
+            continue;  // removed, or replaced, while its parent was read again
+        }
+        const Node& node = nodes_[dir.second];
+        struct stat st;
+        if (lstat(dir.first.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || mtimeOf(st) != node.mtime ||
+            (st.st_dev != device_) != bool(node.flags & kUnindexed)) {
+            queue.emplace_back(dir.second, dir.first);
+            if (!readQueue(queue, &cancelled)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool SearchIndex::Tree::refreshDir(const std::string& dir) {
+    auto it = dirs_.find(dir);
+    if (it == dirs_.cend()) {
+        return true;  // not indexed, or removed already
+    }
+    Queue queue{{it->second, dir}};
+    return readQueue(queue, nullptr);
+}
+
+bool SearchIndex::Tree::refreshIfModified(const std::string& dir) {
+    auto it = dirs_.find(dir);
+    struct stat st;
+    if (it == dirs_.cend() || (lstat(dir.c_str(), &st) == 0 && mtimeOf(st) == nodes_[it->second].mtime)) {
+        return true;
+    }
+    return refreshDir(dir);
+}
+
+bool SearchIndex::Tree::find(const std::string& dir,
+                             bool showHidden,
+                             const std::function<bool(const char* name)>& match,
+                             std::vector<std::string>& paths,
+                             std::vector<std::string>& unindexedDirs) const {
+    auto it = dirs_.find(dir);
+    if (it == dirs_.cend() || (nodes_[it->second].flags & kUnindexed)) {
+        return false;
+    }
+    std::vector<std::pair<std::uint32_t, std::string>> stack{{it->second, dir}};
+    while (!stack.empty()) {
+        const auto [id, path] = std::move(stack.back());
+        stack.pop_back();
+        for (auto child = nodes_[id].firstChild; child != kNone; child = nodes_[child].nextSibling) {
+            const Node& node = nodes_[child];
+            const char* name = nameOf(child);
+            if (match(name)) {
+                paths.push_back(childPath(path, name));
+            }
+            if ((node.flags & kDirectory) && (showHidden || name[0] != '.')) {
+                if (node.flags & kUnindexed) {
+                    unindexedDirs.push_back(childPath(path, name));
+                }
+                else if (node.firstChild != kNone) {
+                    stack.emplace_back(child, childPath(path, name));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+SearchIndex::SearchIndex(std::string cacheDir) : cacheDir_{std::move(cacheDir)} {}
+
+SearchIndex::~SearchIndex() {
+    for (const auto& root : roots_) {
+        stopRoot(*root);
+    }
+}
+
+std::shared_ptr<SearchIndex> SearchIndex::globalInstance() {
+    static const std::shared_ptr<SearchIndex> index = [] {
+        CStrPtr dir{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "search", nullptr)};
+        auto instance = std::make_shared<SearchIndex>(dir.get());
+        // searches may ask for it first, but the folders are watched from the main thread
+        if (auto app = QCoreApplication::instance()) {
+            instance->moveToThread(app->thread());
+        }
+        return instance;
+    }();
+    return index;
+}
+
+void SearchIndex::setRoots(const FilePathList& roots) {
+    std::vector<std::shared_ptr<Root>> kept;
+    std::vector<std::shared_ptr<Root>> dropped;
+    std::vector<std::shared_ptr<Root>> added;
+    {
+        std::lock_guard<std::mutex> lock{rootsMutex_};
+        for (const auto& root : roots_) {
+            auto& list = std::find(roots.cbegin(), roots.cend(), root->path) != roots.cend() ? kept : dropped;
+            list.push_back(root);
+        }
+        for (const auto& path : roots) {
+            auto localPath = path.localPath();
+            auto isKept = [&](const std::shared_ptr<Root>& root) { return root->path == path; };
+            if (!localPath || std::any_of(kept.cbegin(), kept.cend(), isKept)) {
+                continue;
+            }
+            auto root = std::make_shared<Root>();
+            root->path = path;
+            root->localPath = localPath.get();
+            CStrPtr checksum{g_compute_checksum_for_string(G_CHECKSUM_SHA1, root->localPath.c_str(), -1)};
+            root->indexFile = cacheDir_ + '/' + checksum.get() + ".index";
+            kept.push_back(root);
+            added.push_back(root);
+        }
+        roots_ = kept;
+    }
+    for (const auto& root : dropped) {
+        stopRoot(*root);
+    }
+    for (const auto& root : added) {
+        startRoot(root);
+    }
+}
+
+void SearchIndex::startRoot(const std::shared_ptr<Root>& root) {
+    // the thread is joined before |root| goes away
+    root->builder = std::thread([this, root = root.get(), weakRoot = std::weak_ptr<Root>{root}]() {
+        auto tree = std::make_unique<Tree>(root->localPath);
+        bool ok = tree->load(root->indexFile) && tree->revalidate(root->cancelled);
+        if (!ok && !root->cancelled) {
+            tree = std::make_unique<Tree>(root->localPath);
+            ok = tree->build(root->cancelled);
+        }
+        if (!ok) {
+            return;
+        }
+        if (tree->modified()) {
+            tree->save(root->indexFile);
+        }
+        {
+            std::lock_guard<std::mutex> lock{root->mutex};
+            root->tree = std::move(tree);
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, weakRoot]() {
+                if (auto root = weakRoot.lock()) {
+                    onRootBuilt(root);
+                }
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void SearchIndex::stopRoot(Root& root) {
+    root.cancelled = true;
+    if (root.builder.joinable()) {
+        root.builder.join();
+    }
+    root.treeWatch.reset();
+    root.dirWatches.clear();
+    std::lock_guard<std::mutex> lock{root.mutex};
+    if (root.tree && root.tree->modified()) {
+        root.tree->save(root.indexFile);
+    }
+    root.tree.reset();
+}
+
+void SearchIndex::onRootBuilt(const std::shared_ptr<Root>& root) {
+    if (root->cancelled) {
+        return;
+    }
+    root->builder.join();
+    root->treeWatch = FileMonitor::globalInstance()->watchTree(root->path, callbackFor(root));
+    updateWatches(root);
+
+    // what changed while the folder was read, before it was watched, is found by reading again
+    // the directories modified since
+    root->builder = std::thread([this, root = root.get(), weakRoot = std::weak_ptr<Root>{root}]() {
+        {
+            std::lock_guard<std::mutex> lock{root->mutex};
+            if (!root->tree) {
+                return;
+            }
+            if (!root->tree->revalidate(root->cancelled)) {
+                if (!root->cancelled) {
+                    root->tree.reset();  // grew too large
+                }
+                return;
+            }
+            if (!root->tree->hasDirChanges()) {
+                return;
+            }
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, weakRoot]() {
+                if (auto root = weakRoot.lock()) {
+                    updateWatches(root);
+                }
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+FileMonitor::Callback SearchIndex::callbackFor(const std::shared_ptr<Root>& root) {
+    return [this, weakRoot = std::weak_ptr<Root>{root}](const FilePath& path, GFileMonitorEvent event) {
+        if (auto root = weakRoot.lock()) {
+            onChange(*root, path, event);
+        }
+    };
+}
+
+void SearchIndex::updateWatches(const std::shared_ptr<Root>& root) {
+    if (root->cancelled) {
+        return;
+    }
+    std::vector<std::string> newDirs;
+    std::vector<std::string> goneDirs;
+    {
+        std::lock_guard<std::mutex> lock{root->mutex};
+        if (!root->tree) {
+            return;
+        }
+        newDirs = root->tree->takeNewDirs();
+        goneDirs = root->tree->takeGoneDirs();
+    }
+    if (!goneDirs.empty()) {
+        for (const auto& dir : goneDirs) {
+            root->dirWatches.erase(dir);
+        }
+        std::lock_guard<std::mutex> lock{root->eventMutex};
+        for (const auto& dir : goneDirs) {
+            root->unwatchedDirs.erase(dir);
+        }
+    }
+    if (root->treeWatch) {
+        return;
+    }
+    // shallow directories come first, so that these are the ones watched when the limit is hit
+    auto monitor = FileMonitor::globalInstance();
+    std::vector<std::string> unwatchedDirs;
+    for (auto& dir : newDirs) {
+        std::unique_ptr<FileMonitor::Watch> watch;
+        if (root->dirWatches.size() < kMaxDirWatches) {
+            watch = monitor->watchDirectory(FilePath::fromLocalPath(dir.c_str()), callbackFor(root));
+        }
+        if (watch) {
+            root->dirWatches[std::move(dir)] = std::move(watch);
+        }
+        else {
+            unwatchedDirs.push_back(std::move(dir));
+        }
+    }
+    if (!unwatchedDirs.empty()) {
+        std::lock_guard<std::mutex> lock{root->eventMutex};
+        root->unwatchedDirs.insert(std::make_move_iterator(unwatchedDirs.begin()),
+                                   std::make_move_iterator(unwatchedDirs.end()));
+    }
+}
+
+void SearchIndex::onChange(Root& root, const FilePath& path, GFileMonitorEvent event) {
+    std::lock_guard<std::mutex> lock{root.eventMutex};
+    if (!path.isValid()) {
+        root.eventsLost = true;
+        return;
+    }
+    // only names are indexed, so only files that come and go matter
+    if (event != G_FILE_MONITOR_EVENT_CREATED && event != G_FILE_MONITOR_EVENT_DELETED) {
+        return;
+    }
+    if (auto parent = path.parent()) {
+        if (auto localPath = parent.localPath()) {
+            root.changedDirs.emplace(localPath.get());
+        }
+    }
+}
+
+bool SearchIndex::refresh(Root& root) {
+    std::unordered_set<std::string> changedDirs;
+    std::vector<std::string> unwatchedDirs;
+    bool eventsLost;
+    {
+        std::lock_guard<std::mutex> lock{root.eventMutex};
+        changedDirs.swap(root.changedDirs);
+        unwatchedDirs.assign(root.unwatchedDirs.cbegin(), root.unwatchedDirs.cend());
+        eventsLost = root.eventsLost;
+        root.eventsLost = false;
+    }
+    Tree& tree = *root.tree;
+    bool ok = true;
+    if (eventsLost) {
+        ok = tree.revalidate(root.cancelled);
+    }
+    else {
+        for (auto it = changedDirs.cbegin(); ok && it != changedDirs.cend(); ++it) {
+            ok = tree.refreshDir(*it);
+        }
+        for (auto it = unwatchedDirs.cbegin(); ok && it != unwatchedDirs.cend(); ++it) {
+            ok = tree.refreshIfModified(*it);
+        }
+    }
+    if (!ok && !root.cancelled) {
+        root.tree.reset();  // grew too large
+    }
+    return ok;
+}
+
+bool SearchIndex::find(const std::string& dir,
+                       bool showHidden,
+                       const std::function<bool(const char* name)>& match,
+                       std::vector<std::string>& paths,
+                       std::vector<std::string>& unindexedDirs) {
+    std::string path = dir;
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+
+    // the innermost folder holding |path|
+    std::shared_ptr<Root> root;
+    {
+        std::lock_guard<std::mutex> lock{rootsMutex_};
+        for (const auto& candidate : roots_) {
+            const std::string& rootPath = candidate->localPath;
+            if (path.compare(0, rootPath.size(), rootPath) == 0 &&
+                (path.size() == rootPath.size() || path[rootPath.size()] == '/' || rootPath == "/") &&
+                (!root || rootPath.size() > root->localPath.size())) {
+                root = candidate;
+            }
+        }
+    }
+    if (!root) {
+        return false;
+    }
+
+    bool found;
+    bool dirsChanged;
+    {
+        std::lock_guard<std::mutex> lock{root->mutex};
+        if (!root->tree || !refresh(*root)) {
+            return false;
+        }
+        found = root->tree->find(path, showHidden, match, paths, unindexedDirs);
+        dirsChanged = root->tree->hasDirChanges();
+    }
+    if (dirsChanged) {
+        QMetaObject::invokeMethod(
+            this,
+            [this, weakRoot = std::weak_ptr<Root>{root}]() {
+                if (auto root = weakRoot.lock()) {
+                    updateWatches(root);
+                }
+            },
+            Qt::QueuedConnection);
+    }
+    return found;
+}
+
+}  // namespace Fm
+
+// used by vfs-search.c
+extern "C" gboolean _fm_search_index_find(const char* dir,
+                                          gboolean show_hidden,
+                                          gboolean (*match)(const char* name, gpointer user_data),
+                                          gpointer user_data,
+                                          GPtrArray* paths,
+                                          GPtrArray* unindexed_dirs) {
+    std::vector<std::string> found;
+    std::vector<std::string> unindexed;
+    auto matchName = [match, user_data](const char* name) { return match(name, user_data) != FALSE; };
+    if (!Fm::SearchIndex::globalInstance()->find(dir, show_hidden, matchName, found, unindexed)) {
+        return FALSE;
+    }
+    for (const auto& path : found) {
+        g_ptr_array_add(paths, g_strndup(path.data(), path.size()));
+    }
+    for (const auto& path : unindexed) {
+        g_ptr_array_add(unindexed_dirs, g_strndup(path.data(), path.size()));
+    }
+    return TRUE;
+}
@@ -0,0 +1,92 @@
+#ifndef FM2_SEARCHINDEX_H
+#define FM2_SEARCHINDEX_H
+
+#include "../libfmqtglobals.h"
+#include <QObject>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "filemonitor.h"
+#include "filepath.h"
+
+namespace Fm {
+
+// Keeps the names of all the files below a few local folders in memory, so that searching
+// them by name scans a list of names instead of walking the trees. Every folder is read once by
+// a thread of its own, and its index is kept below $XDG_CACHE_HOME; an index read back from
+// there is checked against the modification time of each directory before it is used.
+// Afterwards FileMonitor tells which directories changed, and these are read again before the
+// next search; directories that cannot be watched are checked by their modification time.
+// Filesystems mounted inside a folder are not indexed but left to be searched the usual way.
+// The folders are set from the main thread; searches may run on any thread.
+class LIBFM_QT_API SearchIndex : public QObject {
+    Q_OBJECT
+   public:
+    // |cacheDir| is where the indexes are kept.
+    explicit SearchIndex(std::string cacheDir);
+
+    ~SearchIndex() override;
+
+    static std::shared_ptr<SearchIndex> globalInstance();
+
+    // Indexes the local folders |roots|, and drops the indexes of the others after writing them out.
+    void setRoots(const FilePathList& roots);
+
+    // Finds the files below the local directory |dir| whose name |match| accepts. Unless
+    // |showHidden|, hidden directories are not looked into, as a search does. The directories on
+    // other filesystems are added to |unindexedDirs|, to be searched by walking them.
+    // Returns false when no finished index covers |dir|.
+    bool find(const std::string& dir,
+              bool showHidden,
+              const std::function<bool(const char* name)>& match,
+              std::vector<std::string>& paths,
+              std::vector<std::string>& unindexedDirs);
+
+   private:
+    class Tree;
+
+    struct Root {
+        FilePath path;
+        std::string localPath;
+        std::string indexFile;
+        std::atomic<bool> cancelled{false};
+        std::thread builder;
+
+        std::mutex mutex;  // guards |tree|
+        std::unique_ptr<Tree> tree;
+
+        // what the monitor reported since the last search, guarded by |eventMutex|
+        std::mutex eventMutex;
+        std::unordered_set<std::string> changedDirs;
+        std::unordered_set<std::string> unwatchedDirs;
+        bool eventsLost = false;
+
+        // used in the main thread only
+        std::unique_ptr<FileMonitor::Watch> treeWatch;
+        std::unordered_map<std::string, std::unique_ptr<FileMonitor::Watch>> dirWatches;
+    };
+
+    void startRoot(const std::shared_ptr<Root>& root);
+    void stopRoot(Root& root);
+    void onRootBuilt(const std::shared_ptr<Root>& root);
+    FileMonitor::Callback callbackFor(const std::shared_ptr<Root>& root);
+    // watches the directories added since the last call, and forgets those removed
+    void updateWatches(const std::shared_ptr<Root>& root);
+    void onChange(Root& root, const FilePath& path, GFileMonitorEvent event);
+    // reads again what changed since the last search; |root.mutex| is held
+    bool refresh(Root& root);
+
+    std::string cacheDir_;
+    std::mutex rootsMutex_;  // guards |roots_|, which is only changed in the main thread
+    std::vector<std::shared_ptr<Root>> roots_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_SEARCHINDEX_H
@@ -0,0 +1,75 @@
+#ifndef FM2_SHARDEDCACHE_H
+#define FM2_SHARDEDCACHE_H
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace Fm {
+
+// A cache map split into shards, each behind its own reader/writer lock. Lookups only take a
+// shared lock, so threads reading the cache never wait for each other, and an insertion
+// only holds up readers of the same shard.
+template <typename Key, typename Value, typename Hash, typename Equal, std::size_t ShardCount = 16>
+class ShardedCache {
+   public:
+    // The cached value of |key|, or a default-constructed (null) one.
+    Value find(const Key& key) const {
+        const Shard& shard = shardOf(key);
+        std::shared_lock<std::shared_mutex> lock{shard.mutex};
+        auto it = shard.map.find(key);
+        return it != shard.map.end() ? it->second : Value{};
+    }
+
+    // Caches |value| for |key| unless another thread got there first, and returns the value
+    // cached in the end. |key| must stay valid as long as |value| is cached.
+    Value insert(const Key& key, Value value) {
+        Shard& shard = shardOf(key);
+        std::lock_guard<std::shared_mutex> lock{shard.mutex};
+        return shard.map.emplace(key, std::move(value)).first->second;
+    }
+
+    template <typename Func>
+    void forEach(Func func) {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::shared_mutex> lock{shard.mutex};
+            for (auto& item : shard.map) {
+                func(item.second);
+            }
+        }
+    }
+
+    std::size_t size() const {
+        std::size_t count = 0;
+        for (const auto& shard : shards_) {
+            std::shared_lock<std::shared_mutex> lock{shard.mutex};
+            count += shard.map.size();
+        }
+        return count;
+    }
+
+   private:
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<Key, Value, Hash, Equal> map;
+    };
+
+    const Shard& shardOf(const Key& key) const { return shards_[shardIndex(key)]; }
+
+    Shard& shardOf(const Key& key) { return shards_[shardIndex(key)]; }
+
+    static std::size_t shardIndex(const Key& key) {
+        // the maps use the low bits of the same hash for their buckets
+        const std::size_t hash = Hash{}(key);
+        return (hash ^ (hash >> 16)) % ShardCount;
+    }
+
+    std::array<Shard, ShardCount> shards_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_SHARDEDCACHE_H
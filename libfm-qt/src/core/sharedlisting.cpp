@@ -0,0 +1,374 @@
+#include "sharedlisting.h"
+#include "folder.h"
+#include "gioptrs.h"
+#include "listingsnapshot.h"
+#include "perftrace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <gio/gunixfdlist.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Fm {
+
+namespace {
+
+// where the resident PCManFM-Qt serves its listings
+constexpr char kServiceName[] = "org.pcmanfm.PCManFM";
+constexpr char kObjectPath[] = "/Application";
+constexpr char kInterfaceName[] = "org.pcmanfm.Application";
+// a client lists the folder itself rather than wait longer than this (in ms)
+constexpr int kCallTimeout = 250;
+
+// listings not asked for in this long are dropped, checked as often as this (in ms)
+constexpr qint64 kUnusedExpiry = 5 * 60 * 1000;
+constexpr int kExpiryInterval = 60 * 1000;
+
+constexpr char kMagic[8] = {'F', 'M', 'S', 'H', 'A', 'R', 'E', '1'};
+constexpr unsigned int kSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+enum Kind : std::uint32_t {
+    NotListed,  // nothing follows
+    Full,
+    Delta,
+};
+
+// The start of a memfd. The record of the directory itself follows if there is one, then the
+// records of the files, then the names of the removed files, each after its length as a
+// std::uint32_t.
+struct Header {
+    char magic[8];
+    std::uint64_t generation;
+    std::uint32_t kind;
+    std::uint32_t count;
+    std::uint32_t removedCount;
+    std::uint32_t hasDirInfo;
+};
+
+bool writeAll(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+        const ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        length -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+std::string encode(Kind kind,
+                   quint64 generation,
+                   const Folder* folder,
+                   const FileInfoList& files,
+                   const std::vector<std::string>& removedNames) {
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.generation = generation;
+    header.kind = kind;
+    header.count = static_cast<std::uint32_t>(files.size());
+    header.removedCount = static_cast<std::uint32_t>(removedNames.size());
+    const std::shared_ptr<const FileInfo> dirInfo = folder ? folder->info() : nullptr;
+    header.hasDirInfo = dirInfo && folder->path().hasParent();
+
+    std::string data{reinterpret_cast<const char*>(&header), sizeof(header)};
+    if (header.hasDirInfo) {
+        ListingSnapshot::appendRecord(data, *dirInfo, false);
+    }
+    for (const auto& file : files) {
+        ListingSnapshot::appendRecord(data, *file, folder->isContentTypeGuessed(*file));
+    }
+    for (const auto& name : removedNames) {
+        const auto length = static_cast<std::uint32_t>(name.size());
+        data.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        data += name;
+    }
+    return data;
+}
+
+// A memfd holding |data| that can no longer be changed, so that the client may trust it.
+int sealedMemfd(const std::string& data) {
+    const int fd = memfd_create("fm-shared-listing", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
+    }
+    if (!writeAll(fd, data.data(), data.size()) || fcntl(fd, F_ADD_SEALS, kSeals | F_SEAL_SEAL) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool decode(const char* data,
+            std::size_t size,
+            const FilePath& dirPath,
+            FileInfoPool* pool,
+            SharedListingClient::Listing& listing) {
+    Header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || (header.kind != Full && header.kind != Delta)) {
+        return false;
+    }
+    std::size_t pos = sizeof(header);
+    bool deferred = false;
+    if (header.hasDirInfo) {
+        listing.dirInfo = ListingSnapshot::readRecord(data, size, pos, dirPath.parent(), deferred);
+        if (!listing.dirInfo) {
+            return false;
+        }
+    }
+    // every record takes more than a byte, which bounds what a bad count may reserve
+    listing.files.reserve(std::min<std::size_t>(header.count, size - pos));
+    for (std::uint32_t i = 0; i < header.count; ++i) {
+        auto file = ListingSnapshot::readRecord(data, size, pos, dirPath, deferred, pool);
+        if (!file) {
+            return false;
+        }
+        if (deferred) {
+            listing.deferredFiles.push_back(file);
+        }
+        listing.files.push_back(std::move(file));
+    }
+    for (std::uint32_t i = 0; i < header.removedCount; ++i) {
+        std::uint32_t length = 0;
+        if (size - pos < sizeof(length)) {
+            return false;
+        }
+        std::memcpy(&length, data + pos, sizeof(length));
+        pos += sizeof(length);
+        if (size - pos < length) {
+            return false;
+        }
+        listing.removedNames.emplace_back(data + pos, length);
+        pos += length;
+    }
+    listing.generation = header.generation;
+    listing.isDelta = header.kind == Delta;
+    return pos == size;
+}
+
+}  // namespace
+
+std::atomic<int> SharedListingService::instances_{0};
+
+SharedListingService::Listing::~Listing() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+SharedListingService::SharedListingService(QObject* parent) : QObject(parent) {
+    instances_.fetch_add(1, std::memory_order_relaxed);
+    expiryTimer_.setInterval(kExpiryInterval);
+    expiryTimer_.setTimerType(Qt::VeryCoarseTimer);
+    connect(&expiryTimer_, &QTimer::timeout, this, &SharedListingService::dropUnused);
+}
+
+SharedListingService::~SharedListingService() {
+    for (const auto& listing : listings_) {
+        disconnect(listing.second->folder.get(), nullptr, this, nullptr);
+    }
+    instances_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void SharedListingService::setEnabled(bool enabled) {
+    enabled_ = enabled;
+    if (!enabled_) {
+        for (const auto& listing : listings_) {
+            disconnect(listing.second->folder.get(), nullptr, this, nullptr);
+        }
+        listings_.clear();
+        expiryTimer_.stop();
+    }
+}
+
+SharedListingService::Listing& SharedListingService::listingOf(const FilePath& dirPath) {
+    auto it = listings_.find(dirPath);
+    if (it != listings_.end()) {
+        return *it->second;
+    }
+    if (listings_.size() >= kMaxListings) {
+        auto oldest = std::max_element(listings_.begin(), listings_.end(), [](const auto& a, const auto& b) {
+            return a.second->lastUsed.elapsed() < b.second->lastUsed.elapsed();
+        });
+        disconnect(oldest->second->folder.get(), nullptr, this, nullptr);
+        listings_.erase(oldest);
+    }
+
+    auto listing = std::make_unique<Listing>();
+    Listing* raw = listing.get();
+    // listed behind what the user of this process is waiting for
+    listing->folder = Folder::prefetch(dirPath);
+    Folder* folder = listing->folder.get();
+    connect(folder, &Folder::filesAdded, this, [this, raw](FileInfoList& files) { addChange(*raw, files, {}); });
+    connect(folder, &Folder::filesChanged, this, [this, raw](std::vector<FileInfoPair>& pairs) {
+        FileInfoList files;
+        files.reserve(pairs.size());
+        for (const auto& pair : pairs) {
+            files.push_back(pair.second);
+        }
+        addChange(*raw, std::move(files), {});
+    });
+    connect(folder, &Folder::filesRemoved, this, [this, raw](FileInfoList& files) {
+        std::vector<std::string> names;
+        names.reserve(files.size());
+        for (const auto& file : files) {
+            names.push_back(file->name());
+        }
+        addChange(*raw, {}, std::move(names));
+    });
+    // listed again from scratch: what was taken before can only be replaced
+    connect(folder, &Folder::startLoading, this, [this, raw] {
+        addChange(*raw, {}, {});
+        raw->changes.clear();
+    });
+    if (!expiryTimer_.isActive()) {
+        expiryTimer_.start();
+    }
+    return *listings_.emplace(dirPath, std::move(listing)).first->second;
+}
+
+void SharedListingService::addChange(Listing& listing, FileInfoList files, std::vector<std::string> removedNames) {
+    ++listing.generation;
+    if (listing.fd >= 0) {
+        close(listing.fd);
+        listing.fd = -1;
+    }
+    listing.changes.push_back(Change{listing.generation, std::move(files), std::move(removedNames)});
+    while (listing.changes.size() > kMaxChanges) {
+        listing.changes.pop_front();
+    }
+}
+
+int SharedListingService::open(const FilePath& dirPath, quint64 knownGeneration) {
+    if (!enabled_ || !dirPath.isNative()) {
+        return sealedMemfd(encode(NotListed, 0, nullptr, {}, {}));
+    }
+    Listing& listing = listingOf(dirPath);
+    listing.lastUsed.start();
+    const Folder* folder = listing.folder.get();
+    if (!folder->isLoaded() || !folder->isValid()) {
+        return sealedMemfd(encode(NotListed, 0, nullptr, {}, {}));
+    }
+
+    // the changes since |knownGeneration|, merged by name, if none of them was dropped
+    const bool recent = knownGeneration != 0 && knownGeneration <= listing.generation &&
+                        (knownGeneration == listing.generation ||
+                         (!listing.changes.empty() && listing.changes.front().generation <= knownGeneration + 1));
+    if (recent) {
+        std::unordered_map<std::string, std::shared_ptr<const FileInfo>> merged;  // null if removed
+        for (const auto& change : listing.changes) {
+            if (change.generation <= knownGeneration) {
+                continue;
+            }
+            for (const auto& name : change.removedNames) {
+                merged[name] = nullptr;
+            }
+            for (const auto& file : change.files) {
+                merged[file->name()] = file;
+            }
+        }
+        FileInfoList files;
+        std::vector<std::string> removedNames;
+        for (auto& item : merged) {
+            if (item.second) {
+                files.push_back(std::move(item.second));
+            }
+            else {
+                removedNames.push_back(item.first);
+            }
+        }
+        return sealedMemfd(encode(Delta, listing.generation, folder, files, removedNames));
+    }
+
+    if (listing.fd < 0) {
+        listing.fd = sealedMemfd(encode(Full, listing.generation, folder, folder->files(), {}));
+        if (listing.fd < 0) {
+            return -1;
+        }
+    }
+    return fcntl(listing.fd, F_DUPFD_CLOEXEC, 0);
+}
+
+void SharedListingService::dropUnused() {
+    PerfTrace::add(PerfTrace::WakeupListingExpiry);
+    for (auto it = listings_.begin(); it != listings_.end();) {
+        if (it->second->lastUsed.hasExpired(kUnusedExpiry)) {
+            disconnect(it->second->folder.get(), nullptr, this, nullptr);
+            it = listings_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    if (listings_.empty()) {
+        expiryTimer_.stop();
+    }
+}
+
+std::atomic<bool> SharedListingClient::enabled_{false};
+
+bool SharedListingClient::fetch(const FilePath& dirPath,
+                                quint64 knownGeneration,
+                                Listing& listing,
+                                FileInfoPool* pool) {
+    if (!isEnabled() || !dirPath.isNative()) {
+        return false;
+    }
+    static const GObjectPtr<GDBusConnection> bus{g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr), false};
+    if (!bus) {
+        return false;
+    }
+    const CStrPtr uri = dirPath.uri();
+    GUnixFDList* fdList = nullptr;
+    GVariant* reply = g_dbus_connection_call_with_unix_fd_list_sync(
+        bus.get(), kServiceName, kObjectPath, kInterfaceName, "openListing",
+        g_variant_new("(st)", uri.get(), static_cast<guint64>(knownGeneration)), G_VARIANT_TYPE("(h)"),
+        G_DBUS_CALL_FLAGS_NO_AUTO_START, kCallTimeout, nullptr, &fdList, nullptr, nullptr);
+    const GObjectPtr<GUnixFDList> fds{fdList, false};
+    if (!reply) {
+        return false;
+    }
+    gint32 handle = -1;
+    g_variant_get(reply, "(h)", &handle);
+    g_variant_unref(reply);
+    const int fd = fds ? g_unix_fd_list_get(fds.get(), handle, nullptr) : -1;
+    if (fd < 0) {
+        return false;
+    }
+
+    // only a memfd sealed against writes is read, as nothing can change it while it is mapped
+    // F_GET_SEALS fails with -1, all bits set, for a file that is no memfd
+    const int seals = fcntl(fd, F_GET_SEALS);
+    struct stat st;
+    bool ok = seals >= 0 && (static_cast<unsigned int>(seals) & kSeals) == kSeals && fstat(fd, &st) == 0 &&
+              st.st_size >= static_cast<off_t>(sizeof(Header));
+    if (ok) {
+        const auto size = static_cast<std::size_t>(st.st_size);
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ok = map != MAP_FAILED;
+        if (ok) {
+            Listing decoded;
+            ok = decode(static_cast<const char*>(map), size, dirPath, pool, decoded) &&
+                 (!decoded.isDelta || knownGeneration != 0);
+            munmap(map, size);
+            if (ok) {
+                listing = std::move(decoded);
+            }
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+}  // namespace Fm
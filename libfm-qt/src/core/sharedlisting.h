@@ -0,0 +1,121 @@
+#ifndef FM2_SHAREDLISTING_H
+#define FM2_SHAREDLISTING_H
+
+#include "../libfmqtglobals.h"
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QtGlobal>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "filepath.h"
+#include "fileinfo.h"
+#include "fileinfopool.h"
+
+namespace Fm {
+
+class Folder;
+
+// Lends the listings of the folders of this process to others, as the resident file manager
+// does for the file dialogs of other applications, so that they do not list and stat the same
+// directories again. A listing is handed out as a sealed memfd holding the records of its
+// files in the format of ListingSnapshot, which the other process maps and reads at once. The
+// listing is kept up to date by a Folder of its own; each change makes a new generation, and
+// a process that took an earlier one is given only the files added, changed or removed since.
+// Only local folders are lent. Used from the main thread.
+class LIBFM_QT_API SharedListingService : public QObject {
+    Q_OBJECT
+   public:
+    // more listings than this are dropped, the least recently asked for first
+    static constexpr std::size_t kMaxListings = 64;
+    // the changes of a listing kept for the processes that took an earlier generation
+    static constexpr std::size_t kMaxChanges = 32;
+
+    explicit SharedListingService(QObject* parent = nullptr);
+
+    ~SharedListingService() override;
+
+    // Whether a service lives in this process, whose folders then never ask it.
+    static bool isRunningHere() { return instances_.load(std::memory_order_relaxed) > 0; }
+
+    // Off until setEnabled(true), every folder is said not to be listed.
+    bool isEnabled() const { return enabled_; }
+
+    void setEnabled(bool enabled);
+
+    // A sealed memfd holding the listing of |dirPath|, owned by the caller: what changed since
+    // |knownGeneration| if that is recent enough, or else all of it. While the folder is not
+    // listed yet, and for folders that are not lent, it only says so; the folder is listed
+    // then, to be lent the next time. -1 if no memfd can be made.
+    int open(const FilePath& dirPath, quint64 knownGeneration);
+
+   private:
+    struct Change {
+        quint64 generation;
+        FileInfoList files;  // added or changed
+        std::vector<std::string> removedNames;
+    };
+
+    struct Listing {
+        std::shared_ptr<Folder> folder;
+        quint64 generation = 1;
+        int fd = -1;                 // all of the listing at |generation|, made when first asked for
+        std::deque<Change> changes;  // the last ones, up to |generation|
+        QElapsedTimer lastUsed;
+
+        ~Listing();
+    };
+
+    Listing& listingOf(const FilePath& dirPath);
+
+    void addChange(Listing& listing, FileInfoList files, std::vector<std::string> removedNames);
+
+    void dropUnused();
+
+    static std::atomic<int> instances_;
+
+    bool enabled_ = false;
+    std::unordered_map<FilePath, std::unique_ptr<Listing>, FilePathHash> listings_;
+    QTimer expiryTimer_;
+};
+
+// Takes listings from the SharedListingService of the resident file manager, over D-Bus.
+// Off until setEnabled(true), and always off in the process of a service.
+class LIBFM_QT_API SharedListingClient {
+   public:
+    struct Listing {
+        quint64 generation = 0;
+        bool isDelta = false;  // only what changed since the known generation
+        std::shared_ptr<const FileInfo> dirInfo;
+        FileInfoList files;          // all of them, or those added or changed
+        FileInfoList deferredFiles;  // of |files|, those whose content type is a guess
+        std::vector<std::string> removedNames;
+    };
+
+    static bool isEnabled() {
+        return enabled_.load(std::memory_order_relaxed) && !SharedListingService::isRunningHere();
+    }
+
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // Takes the listing of |dirPath| from the service, or what changed since |knownGeneration|
+    // (0 for all of it). Waits a fraction of a second at most. False if no service runs or
+    // answers, or it has not listed the folder yet. The files are allocated from |pool| when
+    // there is one.
+    static bool fetch(const FilePath& dirPath,
+                      quint64 knownGeneration,
+                      Listing& listing,
+                      FileInfoPool* pool = nullptr);
+
+   private:
+    static std::atomic<bool> enabled_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_SHAREDLISTING_H
@@ -0,0 +1,302 @@
+#include "thumbnailcache.h"
+#include "cstrptr.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace Fm {
+
+namespace {
+
+// a pass runs at most this often (in s)
+constexpr std::time_t kMaintenanceInterval = 24 * 60 * 60;
+// eviction goes down to this fraction of the limit, so that the next pass has nothing to do
+constexpr std::uint64_t kEvictToPercent = 90;
+// unlinks are made in batches of this many, with a pause between them for the other I/O
+constexpr std::size_t kUnlinkBatch = 256;
+constexpr auto kBatchPause = std::chrono::milliseconds(50);
+// the tEXt chunks of a thumbnail come before its pixels, within the first bytes of the file
+constexpr std::size_t kHeaderSize = 4096;
+constexpr char kUriKey[] = "Thumb::URI";
+
+struct Thumbnail {
+    std::uint32_t dir;  // in the directories of the pass
+    std::string name;
+    std::int64_t usedTime;  // the later of its access and modification times, in ns
+    std::uint64_t bytes;    // on disk
+};
+
+std::int64_t nanoseconds(const struct timespec& time) {
+    return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+std::uint32_t readUint32(const unsigned char* p) {
+    return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+// The URI of the file the PNG |data| is the thumbnail of, from its tEXt chunks; empty if there
+// is none before its image data.
+std::string thumbnailUri(const unsigned char* data, std::size_t size) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (size < sizeof(signature) || std::memcmp(data, signature, sizeof(signature)) != 0) {
+        return {};
+    }
+    for (std::size_t pos = sizeof(signature); size - pos >= 8;) {
+        const std::uint32_t length = readUint32(data + pos);
+        const unsigned char* type = data + pos + 4;
+        if (std::memcmp(type, "IDAT", 4) == 0 || length > size - pos - 8) {
+            break;
+        }
+        const char* text = reinterpret_cast<const char*>(data + pos + 8);
+        if (std::memcmp(type, "tEXt", 4) == 0 && length > sizeof(kUriKey) &&
+            std::memcmp(text, kUriKey, sizeof(kUriKey)) == 0) {  // the key and its null
+            return std::string(text + sizeof(kUriKey), length - sizeof(kUriKey));
+        }
+        pos += 12 + std::size_t{length};  // the length, type, data and CRC
+        if (pos > size) {
+            break;
+        }
+    }
+    return {};
+}
+
+// Whether the thumbnail |name| in |dirFd| is of a local file that is gone. A file whose
+// directory is gone as well is not: it may be on a disk that is not mounted now.
+bool isOrphan(int dirFd, const char* name) {
+    const int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+    unsigned char header[kHeaderSize];
+    const ssize_t n = pread(fd, header, sizeof(header), 0);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    const std::string uri = thumbnailUri(header, static_cast<std::size_t>(n));
+    if (uri.compare(0, 7, "file://") != 0) {
+        return false;
+    }
+    CStrPtr path{g_filename_from_uri(uri.c_str(), nullptr, nullptr)};
+    struct stat st;
+    if (!path || lstat(path.get(), &st) == 0 || errno != ENOENT) {
+        return false;
+    }
+    CStrPtr parent{g_path_get_dirname(path.get())};
+    return stat(parent.get(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// The maintenance only uses what the desktop leaves idle.
+void lowerThreadPriority() {
+#ifdef __linux__
+    sched_param param{};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#ifdef SYS_ioprio_set
+    // values from linux/ioprio.h: IOPRIO_WHO_PROCESS with id 0 is the calling thread
+    constexpr int kWhoProcess = 1;
+    constexpr int kClassShift = 13;
+    constexpr int kClassIdle = 3;
+    syscall(SYS_ioprio_set, kWhoProcess, 0, kClassIdle << kClassShift);
+#endif
+#endif
+}
+
+}  // namespace
+
+std::atomic<std::uint64_t> ThumbnailCache::maxSize_{std::uint64_t{1} << 30};
+
+ThumbnailCache::ThumbnailCache(std::string thumbnailsDir, std::string stampFile)
+    : thumbnailsDir_{std::move(thumbnailsDir)}, stampFile_{std::move(stampFile)} {}
+
+ThumbnailCache::~ThumbnailCache() {
+    stopping_ = true;
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+std::shared_ptr<ThumbnailCache> ThumbnailCache::globalInstance() {
+    static const std::shared_ptr<ThumbnailCache> cache = [] {
+        CStrPtr dir{g_build_filename(g_get_user_cache_dir(), "thumbnails", nullptr)};
+        CStrPtr stamp{g_build_filename(g_get_user_cache_dir(), "libfm-qt", "thumbnail-maintenance", nullptr)};
+        return std::make_shared<ThumbnailCache>(dir.get(), stamp.get());
+    }();
+    return cache;
+}
+
+void ThumbnailCache::touch(const std::string& file) {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!touched_.insert(file).second) {
+            return;
+        }
+    }
+    // explicitly, as noatime and relatime mounts would not record most uses
+    const struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_OMIT}};
+    utimensat(AT_FDCWD, file.c_str(), times, 0);
+}
+
+void ThumbnailCache::scheduleMaintenance() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (running_) {
+        return;
+    }
+    struct stat st;
+    if (stat(stampFile_.c_str(), &st) == 0 && std::time(nullptr) - st.st_mtime < kMaintenanceInterval) {
+        return;
+    }
+    // stamped first, so that a pass that never finishes is not retried at every start
+    CStrPtr stampDir{g_path_get_dirname(stampFile_.c_str())};
+    g_mkdir_with_parents(stampDir.get(), 0700);
+    const int fd = open(stampFile_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return;
+    }
+    futimens(fd, nullptr);
+    close(fd);
+
+    if (worker_.joinable()) {
+        worker_.join();  // a pass of a day before
+    }
+    running_ = true;
+    worker_ = std::thread([this] {
+        lowerThreadPriority();
+        maintain(stopping_);
+        running_ = false;
+    });
+}
+
+ThumbnailCache::Stats ThumbnailCache::maintain(const std::atomic<bool>& stop) const {
+    Stats stats;
+    // the directories of the sizes, and those of the failures of each application
+    std::vector<std::string> dirs;
+    std::vector<std::string> pending{thumbnailsDir_};
+    for (int depth = 0; depth < 3 && !pending.empty(); ++depth) {
+        std::vector<std::string> next;
+        for (const auto& path : pending) {
+            DIR* dir = opendir(path.c_str());
+            if (!dir) {
+                continue;
+            }
+            while (struct dirent* entry = readdir(dir)) {
+                if (entry->d_name[0] != '.' && (entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN)) {
+                    struct stat st;
+                    if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+                        next.push_back(path + '/' + entry->d_name);
+                    }
+                }
+            }
+            closedir(dir);
+            if (depth > 0) {
+                dirs.push_back(path);
+            }
+        }
+        pending = std::move(next);
+    }
+
+    std::vector<Thumbnail> thumbnails;
+    std::vector<Thumbnail> orphans;
+    for (std::uint32_t i = 0; i < dirs.size() && !stop; ++i) {
+        DIR* dir = opendir(dirs[i].c_str());
+        if (!dir) {
+            continue;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            if (stop) {
+                break;
+            }
+            const std::size_t length = std::strlen(entry->d_name);
+            if (length <= 4 || std::strcmp(entry->d_name + length - 4, ".png") != 0) {
+                continue;
+            }
+            struct stat st;
+            if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            Thumbnail thumbnail{i, entry->d_name, std::max(nanoseconds(st.st_atim), nanoseconds(st.st_mtim)),
+                                static_cast<std::uint64_t>(st.st_blocks) * 512};
+            ++stats.files;
+            stats.bytes += thumbnail.bytes;
+            if (isOrphan(dirfd(dir), entry->d_name)) {
+                orphans.push_back(std::move(thumbnail));
+            }
+            else {
+                thumbnails.push_back(std::move(thumbnail));
+            }
+        }
+        closedir(dir);
+    }
+    if (stop) {
+        return stats;
+    }
+
+    // the least recently used first, until what is left fits
+    std::vector<Thumbnail> victims = std::move(orphans);
+    stats.orphansRemoved = victims.size();
+    std::uint64_t remaining = stats.bytes;
+    for (const auto& orphan : victims) {
+        remaining -= orphan.bytes;
+    }
+    const std::uint64_t limit = maxSize();
+    if (limit > 0 && remaining > limit) {
+        std::sort(thumbnails.begin(), thumbnails.end(),
+                  [](const Thumbnail& a, const Thumbnail& b) { return a.usedTime < b.usedTime; });
+        const std::uint64_t target = limit / 100 * kEvictToPercent;
+        for (auto& thumbnail : thumbnails) {
+            if (remaining <= target) {
+                break;
+            }
+            remaining -= thumbnail.bytes;
+            victims.push_back(std::move(thumbnail));
+            ++stats.evicted;
+        }
+    }
+
+    // by directory, so that each is opened once
+    std::stable_sort(victims.begin(), victims.end(),
+                     [](const Thumbnail& a, const Thumbnail& b) { return a.dir < b.dir; });
+    int dirFd = -1;
+    std::uint32_t openDir = 0;
+    std::size_t inBatch = 0;
+    for (const auto& victim : victims) {
+        if (stop) {
+            break;
+        }
+        if (dirFd < 0 || victim.dir != openDir) {
+            if (dirFd >= 0) {
+                close(dirFd);
+            }
+            openDir = victim.dir;
+            dirFd = open(dirs[openDir].c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd < 0) {
+                continue;
+            }
+        }
+        if (unlinkat(dirFd, victim.name.c_str(), 0) == 0) {
+            stats.bytesRemoved += victim.bytes;
+        }
+        if (++inBatch == kUnlinkBatch) {
+            inBatch = 0;
+            std::this_thread::sleep_for(kBatchPause);
+        }
+    }
+    if (dirFd >= 0) {
+        close(dirFd);
+    }
+    return stats;
+}
+
+}  // namespace Fm
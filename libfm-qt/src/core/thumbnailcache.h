@@ -0,0 +1,67 @@
+#ifndef FM2_THUMBNAILCACHE_H
+#define FM2_THUMBNAILCACHE_H
+
+#include "../libfmqtglobals.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace Fm {
+
+// Keeps the thumbnails below $XDG_CACHE_HOME/thumbnails from growing without bound. Once a day
+// at most, a pass on a thread of its own, at idle CPU and I/O priority, removes the thumbnails
+// of local files that are gone, and then the least recently used ones while the thumbnails take
+// more than maxSize(). The thumbnails used are touched, so that their access times order them
+// even on filesystems mounted with noatime. Safe to use from any thread.
+class LIBFM_QT_API ThumbnailCache {
+   public:
+    struct Stats {
+        std::size_t files = 0;  // the thumbnails seen
+        std::uint64_t bytes = 0;
+        std::size_t orphansRemoved = 0;
+        std::size_t evicted = 0;
+        std::uint64_t bytesRemoved = 0;
+    };
+
+    // |thumbnailsDir| is the directory of the thumbnail sizes, and |stampFile| records when the
+    // last pass ran.
+    ThumbnailCache(std::string thumbnailsDir, std::string stampFile);
+
+    ~ThumbnailCache();
+
+    static std::shared_ptr<ThumbnailCache> globalInstance();
+
+    // The size, in bytes on disk, the least recently used thumbnails are removed above; 0 for no
+    // limit.
+    static std::uint64_t maxSize() { return maxSize_.load(std::memory_order_relaxed); }
+
+    static void setMaxSize(std::uint64_t bytes) { maxSize_.store(bytes, std::memory_order_relaxed); }
+
+    // Marks the thumbnail file |file| used now. Only the first call for a file costs a system call.
+    void touch(const std::string& file);
+
+    // Starts a maintenance pass, unless one ran in the last day or one is running.
+    void scheduleMaintenance();
+
+    // Runs a maintenance pass on the calling thread. |stop| ends it early when set.
+    Stats maintain(const std::atomic<bool>& stop) const;
+
+   private:
+    static std::atomic<std::uint64_t> maxSize_;
+
+    std::string thumbnailsDir_;
+    std::string stampFile_;
+    std::mutex mutex_;
+    std::unordered_set<std::string> touched_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> stopping_{false};
+    std::thread worker_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_THUMBNAILCACHE_H
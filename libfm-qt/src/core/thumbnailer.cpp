@@ -1,13 +1,28 @@
 #include "thumbnailer.h"
 #include "mimetype.h"
+#include <chrono>
+#include <csignal>
+#include <cerrno>
 #include <string>
 #include <QDebug>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 namespace Fm {
 
+namespace {
+
+// so that slow video thumbnailers cannot keep every thumbnail job thread waiting
+constexpr int kMaxRunningInstances = 2;
+// a thumbnailer still running after this long is killed, and the file given up on
+constexpr gint64 kRunTimeout = 30 * G_TIME_SPAN_SECOND;
+constexpr gulong kPollInterval = 10 * 1000;  // in microseconds
+
+}  // namespace
+
 std::mutex Thumbnailer::mutex_;
+std::once_flag Thumbnailer::loadOnce_;
 std::vector<std::shared_ptr<Thumbnailer>> Thumbnailer::allThumbnailers_;
 
 Thumbnailer::Thumbnailer(const char* id, GKeyFile* kf)
@@ -71,15 +86,58 @@ CStrPtr Thumbnailer::commandForUri(const char* uri, const char* output_file, gui
     return nullptr;
 }
 
-bool Thumbnailer::run(const char* uri, const char* output_file, int size) const {
+bool Thumbnailer::run(const char* uri, const char* output_file, int size, GCancellable* cancellable) const {
     auto cmd = commandForUri(uri, output_file, size);
     if (cmd == nullptr) {
         return false;
     }
     // qDebug() << cmd.get();
-    int status;
-    bool ret = g_spawn_command_line_sync(cmd.get(), nullptr, nullptr, &status, nullptr);
-    return ret && status == 0;
+    char** argv = nullptr;
+    if (!g_shell_parse_argv(cmd.get(), nullptr, &argv, nullptr)) {
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock{runMutex_};
+        while (running_ >= kMaxRunningInstances) {
+            if (g_cancellable_is_cancelled(cancellable)) {
+                g_strfreev(argv);
+                return false;
+            }
+            runCond_.wait_for(lock, std::chrono::milliseconds(50));
+        }
+        ++running_;
+    }
+
+    GPid pid;
+    bool exited = false;
+    int status = 0;
+    if (g_spawn_async(nullptr, argv, nullptr, GSpawnFlags(G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD), nullptr,
+                      nullptr, &pid, nullptr)) {
+        const gint64 deadline = g_get_monotonic_time() + kRunTimeout;
+        for (;;) {
+            pid_t ret = waitpid(pid, &status, WNOHANG);
+            if (ret == pid || (ret < 0 && errno != EINTR)) {
+                exited = ret == pid;
+                break;
+            }
+            if (g_cancellable_is_cancelled(cancellable) || g_get_monotonic_time() > deadline) {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+                break;
+            }
+            g_usleep(kPollInterval);
+        }
+        g_spawn_close_pid(pid);
+    }
+    g_strfreev(argv);
+
+    {
+        std::lock_guard<std::mutex> lock{runMutex_};
+        --running_;
+    }
+    runCond_.notify_one();
+    return exited && WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
 static void find_thumbnailers_in_data_dir(std::unordered_map<std::string, const char*>& hash, const char* data_dir) {
@@ -144,4 +202,8 @@ void Thumbnailer::loadAll() {
     }
 }
 
+void Thumbnailer::ensureLoaded() {
+    std::call_once(loadOnce_, &Thumbnailer::loadAll);
+}
+
 }  // namespace Fm
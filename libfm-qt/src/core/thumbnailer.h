@@ -3,6 +3,8 @@
 
 #include "../libfmqtglobals.h"
 #include "cstrptr.h"
+#include <condition_variable>
+#include <gio/gio.h>
 #include <unordered_map>
 #include <vector>
 #include <memory>
@@ -18,17 +20,28 @@ class LIBFM_QT_API Thumbnailer {
 
     CStrPtr commandForUri(const char* uri, const char* output_file, guint size) const;
 
-    bool run(const char* uri, const char* output_file, int size) const;
+    // Runs the thumbnailer and waits for it. Only a few instances of one thumbnailer run at a time,
+    // and one is killed when |cancellable| is cancelled or when it takes too long.
+    bool run(const char* uri, const char* output_file, int size, GCancellable* cancellable = nullptr) const;
 
     static void loadAll();
 
+    // Loads all the thumbnailers the first time it is called, and returns at once afterwards;
+    // calls from other threads meanwhile wait for the first one to finish.
+    static void ensureLoaded();
+
    private:
     CStrPtr id_;
     CStrPtr try_exec_; /* FIXME: is this useful? */
     CStrPtr exec_;
     // std::vector<std::shared_ptr<const MimeType>> mimeTypes_;
 
+    mutable std::mutex runMutex_;
+    mutable std::condition_variable runCond_;
+    mutable int running_ = 0;  // the instances running now
+
     static std::mutex mutex_;
+    static std::once_flag loadOnce_;
     static std::vector<std::shared_ptr<Thumbnailer>> allThumbnailers_;
 };
 
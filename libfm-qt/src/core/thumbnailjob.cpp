@@ -2,10 +2,21 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <libexif/exif-loader.h>
+#include <QBuffer>
+#include <QCache>
 #include <QImageReader>
 #include <QDir>
+#include "imagescaler.h"
+#include "thumbnailcache.h"
 #include "thumbnailer.h"
+#include "perftrace.h"
+#include "videoframeextractor.h"
 
 #include <algorithm>
 
@@ -13,35 +24,119 @@
 
 namespace Fm {
 
+namespace {
+
+// the decoded thumbnails kept for the whole process, in KiB
+constexpr qsizetype kMemoryCacheCost = 64 * 1024;
+
+struct CachedThumbnail {
+    QImage image;
+    quint64 mtime;
+};
+
+// Thumbnails of folders opened before, by thumbnail file and size, so that reopening a folder
+// does not read and decode its PNG thumbnails again. The job threads share it.
+std::mutex memoryCacheMutex;
+QCache<QString, CachedThumbnail> memoryCache{kMemoryCacheCost};
+
+// where the thumbnail spec has applications record the files they failed to thumbnail
+QString failedThumbnailFilename(const QString& thumbnailFilename) {
+    QString filename{QString::fromUtf8(g_get_user_cache_dir())};
+    filename += QLatin1StringView("/thumbnails/fail/pcmanfm-qt/");
+    filename += thumbnailFilename.section(QLatin1Char('/'), -1);
+    return filename;
+}
+
+}  // namespace
+
 QThreadPool* ThumbnailJob::threadPool_ = nullptr;
 
 bool ThumbnailJob::localFilesOnly_ = true;
 int ThumbnailJob::maxThumbnailFileSize_ = 4096;  // in KiB
 int ThumbnailJob::maxExternalThumbnailFileSize_ = -1;
+// decoding and scaling images is CPU bound, more threads would mostly wait for the disk
+unsigned int ThumbnailJob::maxDecodeThreads_ = 4;
 
 ThumbnailJob::ThumbnailJob(FileInfoList files, int size, bool isRemote)
-    : files_{std::move(files)}, size_{size}, isRemote_{isRemote}, md5Calc_{g_checksum_new(G_CHECKSUM_MD5)} {}
+    : files_{std::move(files)}, size_{size}, isRemote_{isRemote} {
+    PerfTrace::addToGauge(PerfTrace::ThumbnailQueue, files_.size());
+}
 
 ThumbnailJob::~ThumbnailJob() {
-    g_checksum_free(md5Calc_);
     // qDebug("delete  ThumbnailJob");
+    // the files never loaded, as when the job was cancelled
+    PerfTrace::addToGauge(PerfTrace::ThumbnailQueue, -static_cast<int64_t>(files_.size() - results_.size()));
 }
 
 void ThumbnailJob::exec() {
-    for (auto& file : files_) {
+    PerfTrace::Scope trace{"ThumbnailJob"};
+    trace.setAmount(files_.size());
+    // the time to the first thumbnail, which is what the view waits for
+    std::optional<PerfTrace::Scope> firstTrace{std::in_place, "ThumbnailJob first"};
+    const std::size_t count = files_.size();
+    const unsigned int nThreads =
+        std::min<std::size_t>({count, maxDecodeThreads_, std::max(1u, std::thread::hardware_concurrency())});
+    if (nThreads <= 1) {
+        for (auto& file : files_) {
+            if (isCancelled()) {
+                break;
+            }
+            auto image = loadForFile(file);
+            Q_EMIT thumbnailLoaded(file, size_, image);
+            firstTrace.reset();
+            results_.emplace_back(std::move(image));
+            PerfTrace::addToGauge(PerfTrace::ThumbnailQueue, -1);
+        }
+        return;
+    }
+
+    // The files are loaded on several threads, each taking the next one in the list,
+    // while this thread reports the thumbnails in the order of the files.
+    std::vector<QImage> images(count);
+    std::vector<char> loaded(count, 0);
+    std::mutex mutex;
+    std::condition_variable loadedCond;
+    std::atomic<std::size_t> next{0};
+    auto loadFiles = [&] {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            QImage image = isCancelled() ? QImage() : loadForFile(files_[i]);
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                images[i] = std::move(image);
+                loaded[i] = 1;
+            }
+            loadedCond.notify_one();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < nThreads; ++i) {
+        threads.emplace_back(loadFiles);
+    }
+
+    for (std::size_t i = 0; i < count; ++i) {
+        QImage image;
+        {
+            std::unique_lock<std::mutex> lock{mutex};
+            loadedCond.wait(lock, [&] { return loaded[i] != 0; });
+            image = std::move(images[i]);
+        }
         if (isCancelled()) {
             break;
         }
-        auto image = loadForFile(file);
-        Q_EMIT thumbnailLoaded(file, size_, image);
+        Q_EMIT thumbnailLoaded(files_[i], size_, image);
+        firstTrace.reset();
         results_.emplace_back(std::move(image));
+        PerfTrace::addToGauge(PerfTrace::ThumbnailQueue, -1);
+    }
+    for (auto& thread : threads) {
+        thread.join();
     }
 }
 
-QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len) {
+QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len, int targetSize) {
     // The size limit has been set in generateThumbnail().
-    std::unique_ptr<unsigned char[]> buffer{new unsigned char[len]};  // allocate enough buffer
-    unsigned char* pbuffer = buffer.get();
+    QByteArray buffer{static_cast<qsizetype>(len), Qt::Uninitialized};  // allocate enough buffer
+    char* pbuffer = buffer.data();
     size_t totalReadSize = 0;
     while (!isCancelled() && totalReadSize < len) {
         size_t bytesToRead = totalReadSize + 4096 > len ? len - totalReadSize : 4096;
@@ -55,9 +150,17 @@ QImage ThumbnailJob::readImageFromStream(GInputStream* stream, size_t len) {
         totalReadSize += readSize;
         pbuffer += readSize;
     }
-    QImage image;
-    image.loadFromData(buffer.get(), totalReadSize);
-    return image;
+    buffer.truncate(totalReadSize);
+    QBuffer device{&buffer};
+    QImageReader reader{&device};
+    // Let the decoder scale large images down while reading them rather than decoding them
+    // at full size first; the JPEG one then only decodes the DCT coefficients it needs.
+    // Twice the target size is read, so that the smooth scaling after it still has some detail.
+    const QSize imageSize = reader.size();
+    if (imageSize.isValid() && (imageSize.width() > 2 * targetSize || imageSize.height() > 2 * targetSize)) {
+        reader.setScaledSize(imageSize.scaled(2 * targetSize, 2 * targetSize, Qt::KeepAspectRatio));
+    }
+    return reader.read();
 }
 
 QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo>& file) {
@@ -106,18 +209,28 @@ QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo>& file) {
         uri = origPath.uri();
     }
 
-    char thumbnailName[32 + 5];
     // calculate md5 hash for the uri of the original file
-    g_checksum_update(md5Calc_, reinterpret_cast<const unsigned char*>(uri.get()), -1);
-    memcpy(thumbnailName, g_checksum_get_string(md5Calc_), 32);
-    memcpy(thumbnailName + 32, ".png", 5);
-    g_checksum_reset(md5Calc_);  // reset the checksum calculator for next use
+    CStrPtr md5{g_compute_checksum_for_string(G_CHECKSUM_MD5, uri.get(), -1)};
 
     QString thumbnailFilename = thumbnailDir;
     thumbnailFilename += QLatin1Char('/');
-    thumbnailFilename += QString::fromUtf8(thumbnailName);
+    thumbnailFilename += QString::fromUtf8(md5.get());
+    thumbnailFilename += QLatin1StringView(".png");
     // qDebug() << "thumbnail:" << file->getName().c_str() << thumbnailFilename;
 
+    QString cacheKey = thumbnailFilename;
+    cacheKey += QLatin1Char('@');
+    cacheKey += QString::number(size_);
+    {
+        std::lock_guard<std::mutex> lock{memoryCacheMutex};
+        if (const CachedThumbnail* cached = memoryCache.object(cacheKey)) {
+            if (cached->mtime == file->mtime()) {
+                PerfTrace::add(PerfTrace::ThumbnailMemoryHits);
+                return cached->image;
+            }
+        }
+    }
+
     // try to load the thumbnail file if it exists
     QImage thumbnail{thumbnailFilename};
     if (thumbnail.isNull() || isThumbnailOutdated(file, thumbnail)) {
@@ -127,10 +240,23 @@ QImage ThumbnailJob::loadForFile(const std::shared_ptr<const FileInfo>& file) {
         QDir().mkpath(thumbnailDir);
 
         thumbnail = generateThumbnail(file, origPath, uri.get(), thumbnailFilename);
+        PerfTrace::add(PerfTrace::ThumbnailGenerated);
+        if (thumbnail.isNull() && !isCancelled()) {
+            PerfTrace::add(PerfTrace::ThumbnailFailed);
+        }
+    }
+    else {
+        PerfTrace::add(PerfTrace::ThumbnailDiskHits);
+        ThumbnailCache::globalInstance()->touch(thumbnailFilename.toStdString());
     }
     // resize to the size we need
     if (thumbnail.width() > size_ || thumbnail.height() > size_) {
-        thumbnail = thumbnail.scaled(size_, size_, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        thumbnail = ImageScaler::scaled(thumbnail, size_, size_, Qt::KeepAspectRatio);
+    }
+    if (!thumbnail.isNull()) {
+        const qsizetype cost = std::max<qsizetype>(thumbnail.sizeInBytes() / 1024, 1);
+        std::lock_guard<std::mutex> lock{memoryCacheMutex};
+        memoryCache.insert(cacheKey, new CachedThumbnail{thumbnail, file->mtime()}, cost);
     }
     return thumbnail;
 }
@@ -233,20 +359,20 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
                 fromExif = true;
             }
         }
+        // scale the image as needed
+        int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
         if (!fromExif) {  // not able to generate a thumbnail from the EXIF data
             // load the original file and do the scaling ourselves
             g_seekable_seek(G_SEEKABLE(ins.get()), 0, G_SEEK_SET, cancellable_.get(), nullptr);
-            result = readImageFromStream(G_INPUT_STREAM(ins.get()), file->size());
+            result = readImageFromStream(G_INPUT_STREAM(ins.get()), file->size(), target_size);
         }
         g_input_stream_close(G_INPUT_STREAM(ins.get()), nullptr, nullptr);
 
         if (!result.isNull()) {  // the image is successfully loaded
-            // scale the image as needed
-            int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
 
             // only scale the original image if it's too large
             if (result.width() > target_size || result.height() > target_size) {
-                result = result.scaled(target_size, target_size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+                result = ImageScaler::scaled(result, target_size, target_size, Qt::KeepAspectRatio);
             }
 
             if (!matrix.isIdentity()) {  // transform the image if needed
@@ -264,19 +390,56 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
         }
     }
     else {  // the image format is not supported, try to find an external thumbnailer
+        int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
+        // a local video only needs a frame decoded here, which spares a thumbnailer process per file
+        if (mime_type->isVideo() && origPath.isNative() && VideoFrameExtractor::isAvailable() &&
+            VideoFrameExtractor::isEnabled()) {
+            auto localPath = origPath.localPath();
+            result = VideoFrameExtractor::extract(localPath.get(), target_size, cancellable().get());
+            if (!result.isNull()) {
+                result.setText(QStringLiteral("Thumb::MTime"), QString::number(file->mtime()));
+                result.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
+                result.save(thumbnailFilename, "PNG");
+                return result;
+            }
+            if (isCancelled()) {
+                return result;
+            }
+        }
+
         if (maxExternalThumbnailFileSize_ >= 0 &&
             file->size() > static_cast<uint64_t>(maxExternalThumbnailFileSize_) * 1024) {
             return result;
         }
+        // don't retry the files no thumbnailer could handle before, unless they have changed since
+        const QString failedFilename = failedThumbnailFilename(thumbnailFilename);
+        QImage failed{failedFilename};
+        if (!failed.isNull() && !isThumbnailOutdated(file, failed)) {
+            return result;
+        }
+
         // try all available external thumbnailers for it until success
-        int target_size = size_ > 256 ? 512 : size_ > 128 ? 256 : 128;
+        bool hasThumbnailer = false;
+        Thumbnailer::ensureLoaded();
         file->mimeType()->forEachThumbnailer([&](const std::shared_ptr<const Thumbnailer>& thumbnailer) {
-            if (thumbnailer->run(uri, thumbnailFilename.toLocal8Bit().constData(), target_size)) {
+            hasThumbnailer = true;
+            if (thumbnailer->run(uri, thumbnailFilename.toLocal8Bit().constData(), target_size,
+                                 cancellable().get())) {
                 result = QImage(thumbnailFilename);
             }
-            return !result.isNull();  // return true on success, and forEachThumbnailer() will stop.
+            return !result.isNull() || isCancelled();  // return true on success, and forEachThumbnailer() will stop.
         });
 
+        if (result.isNull() && hasThumbnailer && !isCancelled()) {
+            // record the failure as a 1x1 PNG with the metadata of a thumbnail
+            QImage failure{1, 1, QImage::Format_ARGB32};
+            failure.fill(Qt::transparent);
+            failure.setText(QStringLiteral("Thumb::MTime"), QString::number(file->mtime()));
+            failure.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
+            QDir().mkpath(failedFilename.section(QLatin1Char('/'), 0, -2));
+            failure.save(failedFilename, "PNG");
+        }
+
         if (!result.isNull()) {
             // Some thumbnailers did not write the proper metadata required by the xdg spec to the output (such as
             // evince-thumbnailer) Here we waste some time to fix them so next time we don't need to re-generate these
@@ -299,6 +462,16 @@ QImage ThumbnailJob::generateThumbnail(const std::shared_ptr<const FileInfo>& fi
     return result;
 }
 
+int64_t ThumbnailJob::memoryCacheSize() {
+    std::lock_guard<std::mutex> lock{memoryCacheMutex};
+    return static_cast<int64_t>(memoryCache.totalCost()) * 1024;  // the cost is in KiB
+}
+
+void ThumbnailJob::clearMemoryCache() {
+    std::lock_guard<std::mutex> lock{memoryCacheMutex};
+    memoryCache.clear();
+}
+
 QThreadPool* ThumbnailJob::threadPool() {
     if (Q_UNLIKELY(threadPool_ == nullptr)) {
         threadPool_ = new QThreadPool();
@@ -328,4 +501,8 @@ void ThumbnailJob::setMaxExternalThumbnailFileSize(int size) {
     }
 }
 
+void ThumbnailJob::setMaxDecodeThreads(unsigned int count) {
+    maxDecodeThreads_ = std::max(1u, count);
+}
+
 }  // namespace Fm
@@ -32,12 +32,23 @@ class LIBFM_QT_API ThumbnailJob : public Job {
 
     static void setMaxExternalThumbnailFileSize(int size);
 
+    // The threads a job loads its files on, as far as the processors allow; 4 by default.
+    static unsigned int maxDecodeThreads() { return maxDecodeThreads_; }
+
+    static void setMaxDecodeThreads(unsigned int count);
+
+    // The bytes of the thumbnails kept in memory for the next jobs, and forgetting them.
+    static int64_t memoryCacheSize();
+
+    static void clearMemoryCache();
+
     const std::vector<QImage>& results() const { return results_; }
 
    Q_SIGNALS:
     void thumbnailLoaded(const std::shared_ptr<const FileInfo>& file, int size, QImage thumbnail);
 
    protected:
+    // Loads the thumbnails on several threads, but emits thumbnailLoaded() in the order of the files.
     void exec() override;
 
    private:
@@ -50,7 +61,8 @@ class LIBFM_QT_API ThumbnailJob : public Job {
                              const char* uri,
                              const QString& thumbnailFilename);
 
-    QImage readImageFromStream(GInputStream* stream, size_t len);
+    // reads an image of |len| bytes, decoding it at no more than twice |targetSize| when it is larger
+    QImage readImageFromStream(GInputStream* stream, size_t len, int targetSize);
 
     QImage loadForFile(const std::shared_ptr<const FileInfo>& file);
 
@@ -62,13 +74,13 @@ class LIBFM_QT_API ThumbnailJob : public Job {
     bool isRemote_;
     std::vector<QImage> results_;
     GCancellablePtr cancellable_;
-    GChecksum* md5Calc_;
 
     static QThreadPool* threadPool_;
 
     static bool localFilesOnly_;
     static int maxThumbnailFileSize_;
     static int maxExternalThumbnailFileSize_;
+    static unsigned int maxDecodeThreads_;
 };
 
 }  // namespace Fm
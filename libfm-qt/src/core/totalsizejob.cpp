@@ -1,7 +1,15 @@
 #include "totalsizejob.h"
+#include "dirsizeindex.h"
+#include "localsizewalker.h"
 
 namespace Fm {
 
+namespace {
+
+constexpr std::chrono::milliseconds kTotalsInterval{200};
+
+}  // namespace
+
 static const char query_str[] = G_FILE_ATTRIBUTE_STANDARD_TYPE
     "," G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_IS_VIRTUAL "," G_FILE_ATTRIBUTE_STANDARD_SIZE
     "," G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE "," G_FILE_ATTRIBUTE_ID_FILESYSTEM;
@@ -39,6 +47,7 @@ _retry_query_info:
     descend = true;
 
     ++fileCount_;
+    emitTotalsChanged();
     /* SF bug #892: dir file size is not relevant in the summary */
     if (type != G_FILE_TYPE_DIRECTORY) {
         totalSize_ += g_file_info_get_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_STANDARD_SIZE);
@@ -121,10 +130,66 @@ _retry_query_info:
     }
 }
 
+FilePathList TotalSizeJob::execLocal(const FilePathList& paths) {
+    if (!LocalSizeWalker::isSupported()) {
+        return paths;
+    }
+    FilePathList remaining;
+    LocalSizeWalker walker{(flags_ & FOLLOW_LINKS) != 0, (flags_ & SAME_FS) != 0};
+    auto index = DirSizeIndex::globalInstance();
+    walker.setDirTotalsCallback([&index](const std::string& path, std::uint64_t device, std::uint64_t inode,
+                                         std::int64_t mtime, const LocalSizeWalker::Totals& totals) {
+        index->store(path, device, inode, mtime, DirSizeIndex::Sizes{totals.size, totals.onDiskSize, totals.fileCount});
+    });
+    for (const auto& path : paths) {
+        auto localPath = path.isNative() ? path.localPath() : CStrPtr{};
+        if (!localPath || !walker.addRoot(localPath.get())) {
+            remaining.push_back(path);
+        }
+    }
+
+    const std::uint64_t baseSize = totalSize_;
+    const std::uint64_t baseOnDiskSize = totalOndiskSize_;
+    const unsigned int baseCount = fileCount_;
+    auto addTotals = [&](const LocalSizeWalker::Totals& totals) {
+        // a move across devices also deletes each source file, which counts as one more unit of work
+        const std::uint64_t extra = (flags_ & PREPARE_MOVE) ? totals.fileCount : 0;
+        totalSize_ = baseSize + totals.size + extra;
+        totalOndiskSize_ = baseOnDiskSize + totals.onDiskSize + extra;
+        fileCount_ = baseCount + static_cast<unsigned int>(totals.fileCount + extra);
+    };
+    walker.walk(cancellable().get(), kTotalsInterval, [&](const LocalSizeWalker::Totals& totals) {
+        addTotals(totals);
+        emitTotalsChanged(true);
+    });
+    addTotals(walker.totals());
+    index->flush();
+
+    for (const auto& error : walker.errors()) {
+        if (isCancelled()) {
+            break;
+        }
+        CStrPtr displayName{g_filename_display_name(error.first.c_str())};
+        GErrorPtr err{g_error_new(G_IO_ERROR, g_io_error_from_errno(error.second), "%s: %s", displayName.get(),
+                                  g_strerror(error.second))};
+        emitError(err, ErrorSeverity::MILD);
+    }
+    return remaining;
+}
+
+void TotalSizeJob::emitTotalsChanged(bool force) {
+    const auto now = std::chrono::steady_clock::now();
+    if (force || now - lastTotalsChange_ >= kTotalsInterval) {
+        lastTotalsChange_ = now;
+        Q_EMIT totalsChanged();
+    }
+}
+
 void TotalSizeJob::exec() {
-    for (auto& path : paths_) {
+    for (auto& path : execLocal(paths_)) {
         exec(path, GFileInfoPtr{});
     }
+    emitTotalsChanged(true);
 }
 
 }  // namespace Fm
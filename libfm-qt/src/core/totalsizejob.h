@@ -4,6 +4,8 @@
 #include "../libfmqtglobals.h"
 #include "fileoperationjob.h"
 #include "filepath.h"
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include "gioptrs.h"
 
@@ -16,26 +18,35 @@ class LIBFM_QT_API TotalSizeJob : public Fm::FileOperationJob {
 
     explicit TotalSizeJob(FilePathList paths = FilePathList{}, Flags flags = DEFAULT);
 
+    // The totals can be read while the job runs; they then hold what was counted so far.
     std::uint64_t totalSize() const { return totalSize_; }
 
     std::uint64_t totalOnDiskSize() const { return totalOndiskSize_; }
 
     unsigned int fileCount() const { return fileCount_; }
 
+   Q_SIGNALS:
+    // Emitted from the job thread every now and then while the totals grow.
+    void totalsChanged();
+
    protected:
     void exec() override;
 
    private:
     void exec(FilePath path, GFileInfoPtr inf);
+    // Counts the local paths with LocalSizeWalker and returns the ones left to GIO.
+    FilePathList execLocal(const FilePathList& paths);
+    void emitTotalsChanged(bool force = false);
 
    private:
     FilePathList paths_;
 
     int flags_;
-    std::uint64_t totalSize_;
-    std::uint64_t totalOndiskSize_;
-    unsigned int fileCount_;
+    std::atomic<std::uint64_t> totalSize_;
+    std::atomic<std::uint64_t> totalOndiskSize_;
+    std::atomic<unsigned int> fileCount_;
     const char* dest_fs_id;
+    std::chrono::steady_clock::time_point lastTotalsChange_;
 };
 
 }  // namespace Fm
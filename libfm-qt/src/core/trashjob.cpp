@@ -1,73 +1,135 @@
 #include "trashjob.h"
 
 #include "core/legacy/fm-config.h"
+#include <cerrno>
 
 namespace Fm {
 
+namespace {
+
+TrashJob::LocalTrasher& localTrasher() {
+    static TrashJob::LocalTrasher trasher;
+    return trasher;
+}
+
+}  // namespace
+
 TrashJob::TrashJob(FilePathList paths) : paths_{std::move(paths)} {
     // calculate progress using finished file counts rather than their sizes
     setCalcProgressUsingSize(false);
 }
 
+void TrashJob::setLocalTrasher(LocalTrasher trasher) {
+    localTrasher() = std::move(trasher);
+}
+
 void TrashJob::exec() {
     setTotalAmount(paths_.size(), paths_.size());
     Q_EMIT preparedToRun();
 
+    FilePathList paths = localTrasher() ? trashLocalFiles() : paths_;
+
     /* FIXME: we shouldn't trash a file already in trash:/// */
-    for (auto& path : paths_) {
+    for (auto& path : paths) {
         if (isCancelled()) {
             break;
         }
+        if (!trashFile(path)) {
+            return;
+        }
+        addFinishedAmount(1, 1);
+    }
+}
 
-        setCurrentFile(path);
-
-        // TODO: get parent dir of the current path.
-        //       if there is a Fm::Folder object created for it, block the update for the folder temporarily.
-
-        for (;;) {  // retry the i/o operation on errors
-            auto gf = path.gfile();
-            bool ret = false;
-            // FIXME: do not depend on fm_config
-            if (fm_config->no_usb_trash) {
-                GMountPtr mnt{g_file_find_enclosing_mount(gf.get(), nullptr, nullptr), false};
-                if (mnt) {
-                    ret = g_mount_can_unmount(mnt.get()); /* TRUE if it's removable media */
-                    if (ret) {
-                        unsupportedFiles_.push_back(path);
-                        break;  // don't trash the file
-                    }
-                }
-            }
+FilePathList TrashJob::trashLocalFiles() {
+    FilePathList remaining;
+    FilePathList localPaths;
+    std::vector<std::string> localNames;
+    for (auto& path : paths_) {
+        if (!path.isNative()) {
+            remaining.emplace_back(path);
+        }
+        else if (fm_config->no_usb_trash && isOnRemovableMedia(path)) {
+            unsupportedFiles_.emplace_back(path);
+            addFinishedAmount(1, 1);
+        }
+        else {
+            localNames.emplace_back(path.localPath().get());
+            localPaths.emplace_back(path);
+        }
+    }
+    if (localPaths.empty()) {
+        return remaining;
+    }
 
-            // move the file to trash
-            GErrorPtr err;
-            ret = g_file_trash(gf.get(), cancellable().get(), &err);
-            if (ret) {  // trash operation succeeded
+    std::vector<int> errors;
+    localTrasher()(localNames, errors, [this]() {
+        addFinishedAmount(1, 1);
+        return !isCancelled();
+    });
+    for (std::size_t i = 0; i < localPaths.size() && !isCancelled(); ++i) {
+        switch (i < errors.size() ? errors[i] : ECANCELED) {
+            case 0:
                 break;
-            }
-            else {  // failed
-                // if trashing is not supported by the file system
-                if (err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_NOT_SUPPORTED) {
-                    unsupportedFiles_.push_back(path);
-                    break;
-                }
-                else {
-                    ErrorAction act = emitError(err, ErrorSeverity::MODERATE);
-                    if (act == ErrorAction::RETRY) {
-                        err.reset();
-                    }
-                    else if (act == ErrorAction::ABORT) {
-                        cancel();
-                        return;
-                    }
-                    else {
-                        break;
-                    }
+            case EXDEV:
+            case ENOTSUP:
+                // never copied into the trash of another filesystem
+                unsupportedFiles_.emplace_back(localPaths[i]);
+                break;
+            default:
+                // let GIO try it again, and report why it fails
+                setCurrentFile(localPaths[i]);
+                if (!trashFile(localPaths[i])) {
+                    return FilePathList{};
                 }
-            }
+                break;
+        }
+    }
+    return remaining;
+}
+
+bool TrashJob::isOnRemovableMedia(const FilePath& path) const {
+    GMountPtr mnt{g_file_find_enclosing_mount(path.gfile().get(), nullptr, nullptr), false};
+    return mnt && g_mount_can_unmount(mnt.get()); /* TRUE if it's removable media */
+}
+
+bool TrashJob::trashFile(const FilePath& path) {
+    setCurrentFile(path);
+
+    // TODO: get parent dir of the current path.
+    //       if there is a Fm::Folder object created for it, block the update for the folder temporarily.
+
+    for (;;) {  // retry the i/o operation on errors
+        auto gf = path.gfile();
+        // FIXME: do not depend on fm_config
+        if (fm_config->no_usb_trash && isOnRemovableMedia(path)) {
+            unsupportedFiles_.push_back(path);
+            break;  // don't trash the file
+        }
+
+        // move the file to trash
+        GErrorPtr err;
+        if (g_file_trash(gf.get(), cancellable().get(), &err)) {  // trash operation succeeded
+            break;
+        }
+        // if trashing is not supported by the file system
+        if (err.domain() == G_IO_ERROR && err.code() == G_IO_ERROR_NOT_SUPPORTED) {
+            unsupportedFiles_.push_back(path);
+            break;
+        }
+        ErrorAction act = emitError(err, ErrorSeverity::MODERATE);
+        if (act == ErrorAction::RETRY) {
+            err.reset();
+        }
+        else if (act == ErrorAction::ABORT) {
+            cancel();
+            return false;
+        }
+        else {
+            break;
         }
-        addFinishedAmount(1, 1);
     }
+    return true;
 }
 
 }  // namespace Fm
@@ -4,6 +4,9 @@
 #include "../libfmqtglobals.h"
 #include "fileoperationjob.h"
 #include "filepath.h"
+#include <functional>
+#include <string>
+#include <vector>
 
 namespace Fm {
 
@@ -14,10 +17,28 @@ class LIBFM_QT_API TrashJob : public Fm::FileOperationJob {
 
     FilePathList unsupportedFiles() const { return unsupportedFiles_; }
 
+    // Moves the local |paths| to the trash. errors[i] is 0 or the errno for paths[i], EXDEV
+    // when the filesystem of the file has no trash. |tick| is called after each path and
+    // returns false to cancel.
+    using LocalTrasher = std::function<void(const std::vector<std::string>& paths,
+                                            std::vector<int>& errors,
+                                            const std::function<bool()>& tick)>;
+
+    // Makes every job trash local files with |trasher| in one batch rather than one
+    // g_file_trash() call each. Files it fails on for other reasons are retried with GIO.
+    // Should be set once, before any job is started.
+    static void setLocalTrasher(LocalTrasher trasher);
+
    protected:
     void exec() override;
 
    private:
+    // trashes what it can with the local trasher; returns the paths left for GIO
+    FilePathList trashLocalFiles();
+    // returns false when the user aborted the job
+    bool trashFile(const FilePath& path);
+    bool isOnRemovableMedia(const FilePath& path) const;
+
     FilePathList paths_;
     FilePathList unsupportedFiles_;
 };
@@ -1,38 +1,163 @@
 #include "userinfocache.h"
+#include <cerrno>
+#include <thread>
 #include <pwd.h>
 #include <grp.h>
+#include <unistd.h>
 
 namespace Fm {
 
+namespace {
+
+// how long an id found to have no user or group is taken at its word
+constexpr auto kNegativeTimeToLive = std::chrono::minutes(1);
+
+std::shared_ptr<const UserInfo> lookupUser(uid_t uid) {
+    long size = sysconf(_SC_GETPW_R_SIZE_MAX);
+    std::vector<char> buffer(size > 0 ? size : 16384);
+    struct passwd pw;
+    struct passwd* result = nullptr;
+    while (getpwuid_r(uid, &pw, buffer.data(), buffer.size(), &result) == ERANGE) {
+        buffer.resize(buffer.size() * 2);
+    }
+    return result ? std::make_shared<UserInfo>(uid, pw.pw_name, pw.pw_gecos) : nullptr;
+}
+
+std::shared_ptr<const GroupInfo> lookupGroup(gid_t gid) {
+    long size = sysconf(_SC_GETGR_R_SIZE_MAX);
+    std::vector<char> buffer(size > 0 ? size : 16384);
+    struct group gr;
+    struct group* result = nullptr;
+    while (getgrgid_r(gid, &gr, buffer.data(), buffer.size(), &result) == ERANGE) {
+        buffer.resize(buffer.size() * 2);
+    }
+    return result ? std::make_shared<GroupInfo>(gid, gr.gr_name) : nullptr;
+}
+
+}  // namespace
+
 UserInfoCache* UserInfoCache::globalInstance_ = nullptr;
 std::mutex UserInfoCache::mutex_;
 
 UserInfoCache::UserInfoCache() : QObject() {}
 
+template <typename Info>
+bool UserInfoCache::isKnown(const Entry<Info>& entry) {
+    return !entry.pending && (entry.info || Clock::now() - entry.looked < kNegativeTimeToLive);
+}
+
 const std::shared_ptr<const UserInfo>& UserInfoCache::userFromId(uid_t uid) {
     std::lock_guard<std::mutex> lock{mutex_};
     auto it = users_.find(uid);
-    if (it != users_.end())
-        return it->second;
-    std::shared_ptr<const UserInfo> user;
-    auto pw = getpwuid(uid);
-    if (pw) {
-        user = std::make_shared<UserInfo>(uid, pw->pw_name, pw->pw_gecos);
-    }
-    return (users_[uid] = user);
+    if (it != users_.end() && isKnown(it->second))
+        return it->second.info;
+    auto& entry = users_[uid];
+    entry.info = lookupUser(uid);
+    entry.looked = Clock::now();
+    entry.pending = false;  // the worker leaves it alone
+    return entry.info;
 }
 
 const std::shared_ptr<const GroupInfo>& UserInfoCache::groupFromId(gid_t gid) {
     std::lock_guard<std::mutex> lock{mutex_};
     auto it = groups_.find(gid);
-    if (it != groups_.end())
-        return it->second;
-    std::shared_ptr<const GroupInfo> group;
-    auto gr = getgrgid(gid);
-    if (gr) {
-        group = std::make_shared<GroupInfo>(gid, gr->gr_name);
+    if (it != groups_.end() && isKnown(it->second))
+        return it->second.info;
+    auto& entry = groups_[gid];
+    entry.info = lookupGroup(gid);
+    entry.looked = Clock::now();
+    entry.pending = false;
+    return entry.info;
+}
+
+bool UserInfoCache::findUser(uid_t uid, std::shared_ptr<const UserInfo>& user) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& entry = users_[uid];
+    user = entry.info;  // an earlier answer, if any, until the new one comes
+    if (isKnown(entry))
+        return true;
+    if (!entry.pending) {
+        entry.pending = true;
+        pendingUsers_.push_back(uid);
+        startWorker();
+    }
+    return false;
+}
+
+bool UserInfoCache::findGroup(gid_t gid, std::shared_ptr<const GroupInfo>& group) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& entry = groups_[gid];
+    group = entry.info;
+    if (isKnown(entry))
+        return true;
+    if (!entry.pending) {
+        entry.pending = true;
+        pendingGroups_.push_back(gid);
+        startWorker();
+    }
+    return false;
+}
+
+void UserInfoCache::startWorker() {
+    if (!workerStarted_) {
+        workerStarted_ = true;
+        // never joined, as the cache lives as long as the process
+        std::thread([this]() { lookupPending(); }).detach();
+    }
+    workToDo_.notify_one();
+}
+
+void UserInfoCache::lookupPending() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    for (;;) {
+        workToDo_.wait(lock, [this]() { return !pendingUsers_.empty() || !pendingGroups_.empty(); });
+        // all the ids asked for meanwhile, as a view asks for those of its rows in one go
+        std::vector<uid_t> uids = std::move(pendingUsers_);
+        std::vector<gid_t> gids = std::move(pendingGroups_);
+        pendingUsers_.clear();
+        pendingGroups_.clear();
+        lock.unlock();
+
+        std::vector<std::shared_ptr<const UserInfo>> users;
+        for (uid_t uid : uids) {
+            users.push_back(lookupUser(uid));
+        }
+        std::vector<std::shared_ptr<const GroupInfo>> groups;
+        for (gid_t gid : gids) {
+            groups.push_back(lookupGroup(gid));
+        }
+
+        lock.lock();
+        const auto now = Clock::now();
+        for (std::size_t i = 0; i < uids.size(); ++i) {
+            auto& entry = users_[uids[i]];
+            if (entry.pending) {  // not looked up meanwhile by userFromId()
+                entry.info = std::move(users[i]);
+                entry.looked = now;
+                entry.pending = false;
+            }
+        }
+        for (std::size_t i = 0; i < gids.size(); ++i) {
+            auto& entry = groups_[gids[i]];
+            if (entry.pending) {
+                entry.info = std::move(groups[i]);
+                entry.looked = now;
+                entry.pending = false;
+            }
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, uids = std::move(uids), gids = std::move(gids)]() {
+                for (uid_t uid : uids) {
+                    Q_EMIT userChanged(uid);
+                }
+                for (gid_t gid : gids) {
+                    Q_EMIT groupChanged(gid);
+                }
+                Q_EMIT changed();
+            },
+            Qt::QueuedConnection);
     }
-    return (groups_[gid] = group);
 }
 
 // static
@@ -3,8 +3,11 @@
 
 #include "../libfmqtglobals.h"
 #include <QObject>
+#include <chrono>
+#include <condition_variable>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <sys/types.h>
 #include <memory>
 #include <mutex>
@@ -43,23 +46,62 @@ class LIBFM_QT_API GroupInfo {
 
 // FIXME: handle file changes
 
+// Maps user and group ids to names. With NSS backends like sssd or LDAP, a lookup may take
+// long, so findUser() and findGroup() never wait for one: an id not known yet is looked up on
+// a worker thread, together with the others asked for meanwhile, and userChanged() or
+// groupChanged() is emitted in the main thread once it is known. An id found to have no user
+// or group is looked up again after a while, as the directory may have been offline.
 class LIBFM_QT_API UserInfoCache : public QObject {
     Q_OBJECT
    public:
     explicit UserInfoCache();
 
+    // looks |uid| up at once if it is not known yet, however long it takes
     const std::shared_ptr<const UserInfo>& userFromId(uid_t uid);
 
     const std::shared_ptr<const GroupInfo>& groupFromId(gid_t gid);
 
+    // Sets |user| to the user of |uid|, null if there is none, and returns true if it is
+    // known. Otherwise returns false and has it looked up, without waiting.
+    bool findUser(uid_t uid, std::shared_ptr<const UserInfo>& user);
+
+    bool findGroup(gid_t gid, std::shared_ptr<const GroupInfo>& group);
+
     static UserInfoCache* globalInstance();
 
    Q_SIGNALS:
     void changed();
 
+    // a lookup asked for by findUser() is done
+    void userChanged(uid_t uid);
+
+    void groupChanged(gid_t gid);
+
    private:
-    std::unordered_map<uid_t, std::shared_ptr<const UserInfo>> users_;
-    std::unordered_map<gid_t, std::shared_ptr<const GroupInfo>> groups_;
+    using Clock = std::chrono::steady_clock;
+
+    template <typename Info>
+    struct Entry {
+        std::shared_ptr<const Info> info;
+        Clock::time_point looked;  // when it was looked up
+        bool pending = false;      // queued for the worker
+    };
+
+    template <typename Info>
+    static bool isKnown(const Entry<Info>& entry);
+
+    // should be called with mutex_ locked
+    void startWorker();
+
+    // the worker, which looks up the queued ids in batches
+    void lookupPending();
+
+    std::unordered_map<uid_t, Entry<UserInfo>> users_;
+    std::unordered_map<gid_t, Entry<GroupInfo>> groups_;
+    std::vector<uid_t> pendingUsers_;
+    std::vector<gid_t> pendingGroups_;
+    bool workerStarted_ = false;
+    std::condition_variable workToDo_;
     static UserInfoCache* globalInstance_;
     static std::mutex mutex_;
 };
@@ -0,0 +1,1447 @@
+/*
+ *      vfs-archive.c
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Read-only browsing of local archives as folders:
+ *
+ *   archive://<escaped URI of the archive>/<path inside the archive>
+ *
+ * The member list is read once with libarchive (headers only, member data is skipped)
+ * and kept as an index in memory. The index is also written to the user cache dir so
+ * reopening a large archive later does not need another pass over it. Both copies are
+ * keyed by the archive's size and mtime and are dropped when the archive changes.
+ *
+ * Reading a member extracts just that entry into the cache dir and opens the local copy,
+ * so files can be previewed, copied out or handed to applications without unpacking
+ * the whole archive.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "fm-file.h"
+#include "vfs-archive.h"
+
+#include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define ARCHIVE_BLOCK_SIZE (64 * 1024)
+#define ARCHIVE_INDEX_VERSION 1
+#define ARCHIVE_INDEX_FORMAT "(uxta(ssutxub))"
+#define ARCHIVE_CACHE_MAX 8 /* indexes kept in memory */
+#define ARCHIVE_MAX_SYMLINK_HOPS 8
+
+/* ---- Member index ---- */
+typedef struct _FmArchiveNode FmArchiveNode;
+
+struct _FmArchiveNode {
+    char* path;          /* path inside the archive, "" for the root */
+    const char* name;    /* last component of path */
+    char* link_target;   /* symlink target, or the member a hardlink refers to */
+    GFileType type;
+    guint64 size;
+    gint64 mtime;
+    guint32 mode;
+    gboolean hardlink;
+    GPtrArray* children; /* FmArchiveNode*, directories only */
+};
+
+typedef struct {
+    gint ref_count;
+    char* archive_path;
+    guint64 archive_size;
+    gint64 archive_mtime;
+    guint64 last_used;
+    GHashTable* nodes; /* path -> FmArchiveNode*, owns the nodes */
+    FmArchiveNode* root;
+} FmArchiveIndex;
+
+static FmArchiveNode* archive_node_new(const char* path, GFileType type) {
+    FmArchiveNode* node = g_slice_new0(FmArchiveNode);
+    const char* slash;
+
+    node->path = g_strdup(path);
+    slash = strrchr(node->path, '/');
+    node->name = slash ? slash + 1 : node->path;
+    node->type = type;
+    if (type == G_FILE_TYPE_DIRECTORY)
+        node->children = g_ptr_array_new();
+    return node;
+}
+
+static void archive_node_free(gpointer data) {
+    FmArchiveNode* node = data;
+
+    g_free(node->path);
+    g_free(node->link_target);
+    if (node->children)
+        g_ptr_array_free(node->children, TRUE);
+    g_slice_free(FmArchiveNode, node);
+}
+
+static FmArchiveIndex* archive_index_new(const char* archive_path) {
+    FmArchiveIndex* index = g_slice_new0(FmArchiveIndex);
+
+    index->ref_count = 1;
+    index->archive_path = g_strdup(archive_path);
+    index->nodes = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, archive_node_free);
+    index->root = archive_node_new("", G_FILE_TYPE_DIRECTORY);
+    index->root->mode = S_IFDIR | 0755;
+    g_hash_table_insert(index->nodes, index->root->path, index->root);
+    return index;
+}
+
+static FmArchiveIndex* archive_index_ref(FmArchiveIndex* index) {
+    g_atomic_int_inc(&index->ref_count);
+    return index;
+}
+
+static void archive_index_unref(gpointer data) {
+    FmArchiveIndex* index = data;
+
+    if (!g_atomic_int_dec_and_test(&index->ref_count))
+        return;
+    g_hash_table_destroy(index->nodes);
+    g_free(index->archive_path);
+    g_slice_free(FmArchiveIndex, index);
+}
+
+static FmArchiveNode* archive_index_lookup(FmArchiveIndex* index, const char* path) {
+    return g_hash_table_lookup(index->nodes, path);
+}
+
+/* returns the directory node for @path, creating it and any missing parents: many
+   archives (zip in particular) only list files and leave their folders implied */
+static FmArchiveNode* archive_index_ensure_dir(FmArchiveIndex* index, const char* path) {
+    FmArchiveNode *node, *parent;
+    const char* slash;
+    char* parent_path;
+
+    node = archive_index_lookup(index, path);
+    if (node) {
+        if (node->type != G_FILE_TYPE_DIRECTORY) {
+            /* a member was listed both as a file and as a folder of other members */
+            node->type = G_FILE_TYPE_DIRECTORY;
+            node->mode = S_IFDIR | 0755;
+            node->size = 0;
+            if (!node->children)
+                node->children = g_ptr_array_new();
+        }
+        return node;
+    }
+    slash = strrchr(path, '/');
+    parent_path = slash ? g_strndup(path, slash - path) : g_strdup("");
+    parent = archive_index_ensure_dir(index, parent_path);
+    g_free(parent_path);
+
+    node = archive_node_new(path, G_FILE_TYPE_DIRECTORY);
+    node->mode = S_IFDIR | 0755;
+    g_hash_table_insert(index->nodes, node->path, node);
+    g_ptr_array_add(parent->children, node);
+    return node;
+}
+
+static void archive_index_add(FmArchiveIndex* index,
+                              const char* path,
+                              GFileType type,
+                              guint64 size,
+                              gint64 mtime,
+                              guint32 mode,
+                              const char* link_target,
+                              gboolean hardlink) {
+    FmArchiveNode* node;
+
+    if (type == G_FILE_TYPE_DIRECTORY)
+        node = archive_index_ensure_dir(index, path);
+    else {
+        node = archive_index_lookup(index, path);
+        if (node == NULL) {
+            const char* slash = strrchr(path, '/');
+            char* parent_path = slash ? g_strndup(path, slash - path) : g_strdup("");
+            FmArchiveNode* parent = archive_index_ensure_dir(index, parent_path);
+
+            g_free(parent_path);
+            node = archive_node_new(path, type);
+            g_hash_table_insert(index->nodes, node->path, node);
+            g_ptr_array_add(parent->children, node);
+        }
+        else if (node->type == G_FILE_TYPE_DIRECTORY && node->children->len > 0)
+            return; /* keep the folder, it has members of its own */
+        else {
+            /* a later entry with the same name replaces the earlier one, as on extraction */
+            node->type = type;
+            if (node->children && type != G_FILE_TYPE_DIRECTORY) {
+                g_ptr_array_free(node->children, TRUE);
+                node->children = NULL;
+            }
+        }
+        node->size = size;
+        g_free(node->link_target);
+        node->link_target = g_strdup(link_target);
+        node->hardlink = hardlink;
+    }
+    node->mtime = mtime;
+    node->mode = mode;
+}
+
+/* hardlink entries carry no data of their own; report the size of what they point to */
+static void archive_index_resolve_hardlinks(FmArchiveIndex* index) {
+    GHashTableIter it;
+    gpointer value;
+
+    g_hash_table_iter_init(&it, index->nodes);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        FmArchiveNode* node = value;
+        FmArchiveNode* target;
+
+        if (!node->hardlink || !node->link_target)
+            continue;
+        target = archive_index_lookup(index, node->link_target);
+        if (target && target->type == G_FILE_TYPE_REGULAR)
+            node->size = target->size;
+    }
+}
+
+/* ---- Paths ---- */
+
+/* Appends the components of @path to @parts. "" and "." components are dropped; ".."
+   removes the previous component when @allow_dotdot is TRUE (never going above the
+   archive root) and makes the whole path invalid otherwise. */
+static gboolean push_path_components(GPtrArray* parts, const char* path, gboolean allow_dotdot) {
+    char** comps = g_strsplit(path, "/", -1);
+    gboolean ok = TRUE;
+    char** p;
+
+    for (p = comps; *p; ++p) {
+        if (**p == '\0' || strcmp(*p, ".") == 0)
+            continue;
+        if (strcmp(*p, "..") == 0) {
+            if (!allow_dotdot) {
+                ok = FALSE;
+                break;
+            }
+            if (parts->len > 0)
+                g_ptr_array_remove_index(parts, parts->len - 1);
+            continue;
+        }
+        g_ptr_array_add(parts, g_strdup(*p));
+    }
+    g_strfreev(comps);
+    return ok;
+}
+
+/* Canonical form of @rel resolved against @base (both inside the archive): no leading or
+   trailing '/', no empty, "." or ".." components. Returns NULL if the path is invalid. */
+static char* normalize_inner_path(const char* base, const char* rel, gboolean allow_dotdot) {
+    GPtrArray* parts = g_ptr_array_new_with_free_func(g_free);
+    char* result = NULL;
+
+    if ((base == NULL || push_path_components(parts, base, allow_dotdot)) &&
+        push_path_components(parts, rel, allow_dotdot)) {
+        g_ptr_array_add(parts, NULL);
+        result = g_strjoinv("/", (char**)parts->pdata);
+    }
+    g_ptr_array_free(parts, TRUE);
+    return result;
+}
+
+static char* parent_inner_path(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? g_strndup(path, slash - path) : g_strdup("");
+}
+
+/* follows symlinks inside the archive; NULL when a link leaves it or cannot be resolved */
+static FmArchiveNode* archive_index_follow(FmArchiveIndex* index, FmArchiveNode* node) {
+    int hops;
+
+    for (hops = 0; node && node->type == G_FILE_TYPE_SYMBOLIC_LINK; ++hops) {
+        char *dir, *target;
+
+        if (hops >= ARCHIVE_MAX_SYMLINK_HOPS || !node->link_target || node->link_target[0] == '/')
+            return NULL;
+        dir = parent_inner_path(node->path);
+        target = normalize_inner_path(dir, node->link_target, TRUE);
+        g_free(dir);
+        node = target ? archive_index_lookup(index, target) : NULL;
+        g_free(target);
+    }
+    return node;
+}
+
+/* ---- Reading archives ---- */
+static void set_archive_error(GError** error, struct archive* a, const char* archive_path) {
+    int code = archive_errno(a);
+    const char* msg = archive_error_string(a);
+    char* display = g_filename_display_name(archive_path);
+
+    g_set_error(error, G_IO_ERROR, code > 0 ? g_io_error_from_errno(code) : G_IO_ERROR_FAILED, "%s: %s", display,
+                msg ? msg : _("Unknown archive error"));
+    g_free(display);
+}
+
+static struct archive* open_archive(const char* archive_path, GError** error) {
+    struct archive* a = archive_read_new();
+
+    archive_read_support_filter_all(a);
+    archive_read_support_format_all(a);
+    if (archive_read_open_filename(a, archive_path, ARCHIVE_BLOCK_SIZE) != ARCHIVE_OK) {
+        set_archive_error(error, a, archive_path);
+        archive_read_free(a);
+        return NULL;
+    }
+    return a;
+}
+
+/* canonical inner path of the member @entry describes, NULL for unsafe names */
+static char* entry_inner_path(struct archive_entry* entry) {
+    const char* name = archive_entry_pathname_utf8(entry);
+
+    if (name == NULL)
+        name = archive_entry_pathname(entry);
+    if (name == NULL)
+        return NULL;
+    return normalize_inner_path(NULL, name, FALSE);
+}
+
+static GFileType entry_file_type(struct archive_entry* entry, const char* pathname) {
+    switch (archive_entry_filetype(entry)) {
+        case AE_IFDIR:
+            return G_FILE_TYPE_DIRECTORY;
+        case AE_IFLNK:
+            return G_FILE_TYPE_SYMBOLIC_LINK;
+        case AE_IFREG:
+            /* some zip writers mark folders only by the trailing slash */
+            if (pathname && g_str_has_suffix(pathname, "/"))
+                return G_FILE_TYPE_DIRECTORY;
+            return G_FILE_TYPE_REGULAR;
+        case 0:
+            return G_FILE_TYPE_REGULAR;
+        default:
+            return G_FILE_TYPE_SPECIAL;
+    }
+}
+
+static FmArchiveIndex* archive_index_scan(const char* archive_path, GCancellable* cancellable, GError** error) {
+    struct archive* a = open_archive(archive_path, error);
+    struct archive_entry* entry;
+    FmArchiveIndex* index;
+    int r;
+
+    if (a == NULL)
+        return NULL;
+    index = archive_index_new(archive_path);
+    while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK || r == ARCHIVE_WARN) {
+        const char* raw_name = archive_entry_pathname(entry);
+        const char* hardlink = archive_entry_hardlink(entry);
+        char* path = entry_inner_path(entry);
+        char* link_target = NULL;
+        GFileType type;
+
+        if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+            g_free(path);
+            archive_index_unref(index);
+            archive_read_free(a);
+            return NULL;
+        }
+        if (path == NULL) /* absolute or ".." names are skipped, as on extraction */
+            continue;
+        if (*path == '\0') {
+            if (archive_entry_mtime_is_set(entry))
+                index->root->mtime = archive_entry_mtime(entry);
+            g_free(path);
+            continue;
+        }
+        type = entry_file_type(entry, raw_name);
+        if (hardlink) {
+            link_target = normalize_inner_path(NULL, hardlink, FALSE);
+            type = G_FILE_TYPE_REGULAR;
+        }
+        else if (type == G_FILE_TYPE_SYMBOLIC_LINK) {
+            const char* symlink = archive_entry_symlink_utf8(entry);
+            link_target = g_strdup(symlink ? symlink : archive_entry_symlink(entry));
+        }
+        archive_index_add(index, path, type, archive_entry_size_is_set(entry) ? archive_entry_size(entry) : 0,
+                          archive_entry_mtime_is_set(entry) ? archive_entry_mtime(entry) : 0,
+                          archive_entry_mode(entry), link_target, hardlink != NULL);
+        g_free(link_target);
+        g_free(path);
+    }
+    if (r != ARCHIVE_EOF) {
+        set_archive_error(error, a, archive_path);
+        archive_index_unref(index);
+        archive_read_free(a);
+        return NULL;
+    }
+    archive_read_free(a);
+    archive_index_resolve_hardlinks(index);
+    return index;
+}
+
+/* ---- Index cache ---- */
+static char* archive_cache_dir(void) {
+    return g_build_filename(g_get_user_cache_dir(), "libfm-qt", "archives", NULL);
+}
+
+static char* archive_index_cache_file(const char* archive_path) {
+    char* dir = archive_cache_dir();
+    char* key = g_compute_checksum_for_string(G_CHECKSUM_MD5, archive_path, -1);
+    char* name = g_strconcat(key, ".idx", NULL);
+    char* file = g_build_filename(dir, name, NULL);
+
+    g_free(name);
+    g_free(key);
+    g_free(dir);
+    return file;
+}
+
+static void archive_index_save(FmArchiveIndex* index) {
+    GVariantBuilder nodes;
+    GHashTableIter it;
+    gpointer value;
+    GVariant* data;
+    char *file, *dir;
+
+    g_variant_builder_init(&nodes, G_VARIANT_TYPE("a(ssutxub)"));
+    g_hash_table_iter_init(&it, index->nodes);
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        FmArchiveNode* node = value;
+
+        if (node == index->root)
+            continue;
+        g_variant_builder_add(&nodes, "(ssutxub)", node->path, node->link_target ? node->link_target : "",
+                              (guint32)node->type, node->size, node->mtime, node->mode, node->hardlink);
+    }
+    data = g_variant_ref_sink(g_variant_new(ARCHIVE_INDEX_FORMAT, (guint32)ARCHIVE_INDEX_VERSION,
+                                            index->archive_mtime, index->archive_size, &nodes));
+
+    /* best effort: without the cache file the archive is simply scanned again */
+    dir = archive_cache_dir();
+    file = archive_index_cache_file(index->archive_path);
+    if (g_mkdir_with_parents(dir, 0700) == 0)
+        g_file_set_contents(file, g_variant_get_data(data), g_variant_get_size(data), NULL);
+    g_free(file);
+    g_free(dir);
+    g_variant_unref(data);
+}
+
+static FmArchiveIndex* archive_index_load(const char* archive_path, guint64 archive_size, gint64 archive_mtime) {
+    char* file = archive_index_cache_file(archive_path);
+    FmArchiveIndex* index = NULL;
+    GVariantIter* nodes;
+    GVariant* data;
+    GBytes* bytes;
+    char* contents;
+    gsize length;
+    guint32 version;
+    gint64 mtime;
+    guint64 size;
+
+    if (!g_file_get_contents(file, &contents, &length, NULL)) {
+        g_free(file);
+        return NULL;
+    }
+    g_free(file);
+    bytes = g_bytes_new_take(contents, length);
+    data = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(ARCHIVE_INDEX_FORMAT), bytes, FALSE));
+    g_bytes_unref(bytes);
+
+    g_variant_get(data, ARCHIVE_INDEX_FORMAT, &version, &mtime, &size, &nodes);
+    if (version == ARCHIVE_INDEX_VERSION && mtime == archive_mtime && size == archive_size) {
+        const char *path, *link_target;
+        guint32 type, mode;
+        guint64 node_size;
+        gint64 node_mtime;
+        gboolean hardlink;
+
+        index = archive_index_new(archive_path);
+        while (g_variant_iter_next(nodes, "(&s&sutxub)", &path, &link_target, &type, &node_size, &node_mtime, &mode,
+                                   &hardlink)) {
+            /* the file is ours but may still be damaged; never trust its paths blindly */
+            char* inner = normalize_inner_path(NULL, path, FALSE);
+
+            if (inner && *inner)
+                archive_index_add(index, inner, (GFileType)type, node_size, node_mtime, mode,
+                                  *link_target ? link_target : NULL, hardlink);
+            g_free(inner);
+        }
+    }
+    g_variant_iter_free(nodes);
+    g_variant_unref(data);
+    return index;
+}
+
+G_LOCK_DEFINE_STATIC(archive_cache);
+static GHashTable* archive_cache = NULL; /* archive path -> FmArchiveIndex* */
+static guint64 archive_cache_clock = 0;
+
+static gboolean stat_archive(const char* archive_path, GStatBuf* st, GError** error) {
+    if (g_stat(archive_path, st) != 0) {
+        int errsv = errno;
+        char* display = g_filename_display_name(archive_path);
+
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "%s: %s", display, g_strerror(errsv));
+        g_free(display);
+        return FALSE;
+    }
+    if (!S_ISREG(st->st_mode)) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_REGULAR_FILE, _("Not a regular file"));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* returns a new reference to the up to date index of @archive_path */
+static FmArchiveIndex* archive_index_get(const char* archive_path, GCancellable* cancellable, GError** error) {
+    FmArchiveIndex *index, *cached;
+    GStatBuf st;
+
+    if (!stat_archive(archive_path, &st, error))
+        return NULL;
+
+    G_LOCK(archive_cache);
+    if (archive_cache == NULL)
+        archive_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, archive_index_unref);
+    cached = g_hash_table_lookup(archive_cache, archive_path);
+    if (cached && cached->archive_size == (guint64)st.st_size && cached->archive_mtime == (gint64)st.st_mtime) {
+        cached->last_used = ++archive_cache_clock;
+        index = archive_index_ref(cached);
+        G_UNLOCK(archive_cache);
+        return index;
+    }
+    if (cached)
+        g_hash_table_remove(archive_cache, archive_path);
+    G_UNLOCK(archive_cache);
+
+    /* build outside the lock; scanning a big compressed tarball takes a while */
+    index = archive_index_load(archive_path, st.st_size, st.st_mtime);
+    if (index == NULL) {
+        index = archive_index_scan(archive_path, cancellable, error);
+        if (index == NULL)
+            return NULL;
+        index->archive_size = st.st_size;
+        index->archive_mtime = st.st_mtime;
+        archive_index_save(index);
+    }
+    else {
+        index->archive_size = st.st_size;
+        index->archive_mtime = st.st_mtime;
+    }
+
+    G_LOCK(archive_cache);
+    cached = g_hash_table_lookup(archive_cache, archive_path);
+    if (cached && cached->archive_size == index->archive_size && cached->archive_mtime == index->archive_mtime) {
+        /* another thread got there first */
+        archive_index_unref(index);
+        index = archive_index_ref(cached);
+    }
+    else {
+        g_hash_table_replace(archive_cache, g_strdup(archive_path), archive_index_ref(index));
+        while (g_hash_table_size(archive_cache) > ARCHIVE_CACHE_MAX) {
+            GHashTableIter it;
+            gpointer key, value;
+            gpointer oldest = NULL;
+            guint64 oldest_used = G_MAXUINT64;
+
+            g_hash_table_iter_init(&it, archive_cache);
+            while (g_hash_table_iter_next(&it, &key, &value)) {
+                FmArchiveIndex* candidate = value;
+                if (candidate != index && candidate->last_used < oldest_used) {
+                    oldest_used = candidate->last_used;
+                    oldest = key;
+                }
+            }
+            if (oldest == NULL)
+                break;
+            g_hash_table_remove(archive_cache, oldest);
+        }
+    }
+    index->last_used = ++archive_cache_clock;
+    G_UNLOCK(archive_cache);
+    return index;
+}
+
+/* ---- Member extraction ---- */
+
+/* folder for extracted members of one version of an archive */
+static char* archive_member_cache_dir(FmArchiveIndex* index) {
+    char* dir = archive_cache_dir();
+    char* id = g_strdup_printf("%s\n%" G_GUINT64_FORMAT "\n%" G_GINT64_FORMAT, index->archive_path,
+                               index->archive_size, index->archive_mtime);
+    char* key = g_compute_checksum_for_string(G_CHECKSUM_MD5, id, -1);
+    char* result = g_build_filename(dir, key, NULL);
+
+    g_free(key);
+    g_free(id);
+    g_free(dir);
+    return result;
+}
+
+static gboolean write_all(int fd, const void* data, size_t size, GError** error) {
+    const char* p = data;
+
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            int errsv = errno;
+            if (errsv == EINTR)
+                continue;
+            g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+            return FALSE;
+        }
+        p += n;
+        size -= n;
+    }
+    return TRUE;
+}
+
+/* streams the archive up to @member and copies its data to @fd */
+static gboolean extract_member_to_fd(FmArchiveIndex* index,
+                                     const char* member,
+                                     int fd,
+                                     GCancellable* cancellable,
+                                     GError** error) {
+    struct archive* a = open_archive(index->archive_path, error);
+    struct archive_entry* entry;
+    gboolean found = FALSE;
+    gboolean ok = FALSE;
+    int r;
+
+    if (a == NULL)
+        return FALSE;
+    while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK || r == ARCHIVE_WARN) {
+        char* path = entry_inner_path(entry);
+
+        found = path && strcmp(path, member) == 0;
+        g_free(path);
+        if (found)
+            break;
+        if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+            archive_read_free(a);
+            return FALSE;
+        }
+    }
+    if (!found) {
+        if (r == ARCHIVE_EOF)
+            g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("File not found in the archive"));
+        else
+            set_archive_error(error, a, index->archive_path);
+        archive_read_free(a);
+        return FALSE;
+    }
+    for (;;) {
+        const void* buf;
+        size_t len;
+        la_int64_t offset;
+
+        if (g_cancellable_set_error_if_cancelled(cancellable, error))
+            break;
+        r = archive_read_data_block(a, &buf, &len, &offset);
+        if (r == ARCHIVE_EOF) {
+            ok = TRUE;
+            break;
+        }
+        if (r != ARCHIVE_OK && r != ARCHIVE_WARN) {
+            set_archive_error(error, a, index->archive_path);
+            break;
+        }
+        /* sparse members hand out blocks at explicit offsets */
+        if (lseek(fd, offset, SEEK_SET) < 0) {
+            int errsv = errno;
+            g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+            break;
+        }
+        if (!write_all(fd, buf, len, error))
+            break;
+    }
+    if (ok && archive_entry_size_is_set(entry) && ftruncate(fd, archive_entry_size(entry)) != 0) {
+        int errsv = errno;
+        g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+        ok = FALSE;
+    }
+    archive_read_free(a);
+    return ok;
+}
+
+static char* archive_extract_member(FmArchiveIndex* index,
+                                    FmArchiveNode* node,
+                                    GCancellable* cancellable,
+                                    GError** error) {
+    const char* member = node->hardlink && node->link_target ? node->link_target : node->path;
+    char* dir = archive_member_cache_dir(index);
+    char* local = g_build_filename(dir, node->path, NULL);
+    char *parent, *tmp;
+    GStatBuf st;
+    int fd;
+
+    g_free(dir);
+    /* reuse the copy from an earlier request; the folder name changes with the archive */
+    if (g_stat(local, &st) == 0 && S_ISREG(st.st_mode) && (guint64)st.st_size == node->size)
+        return local;
+
+    parent = g_path_get_dirname(local);
+    if (g_mkdir_with_parents(parent, 0700) != 0) {
+        int errsv = errno;
+        g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+        g_free(parent);
+        g_free(local);
+        return NULL;
+    }
+    g_free(parent);
+
+    /* extract next to the final name and rename, so readers never see a partial file */
+    tmp = g_strconcat(local, ".XXXXXX", NULL);
+    fd = g_mkstemp_full(tmp, O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        int errsv = errno;
+        g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+        g_free(tmp);
+        g_free(local);
+        return NULL;
+    }
+    if (!extract_member_to_fd(index, member, fd, cancellable, error)) {
+        close(fd);
+        g_unlink(tmp);
+        g_free(tmp);
+        g_free(local);
+        return NULL;
+    }
+    /* read-only: edits to the copy would never make it back into the archive */
+    fchmod(fd, (node->mode & 0555) | S_IRUSR);
+    if (node->mtime > 0) {
+        struct timeval times[2];
+        times[0].tv_sec = times[1].tv_sec = node->mtime;
+        times[0].tv_usec = times[1].tv_usec = 0;
+        futimes(fd, times);
+    }
+    close(fd);
+    if (g_rename(tmp, local) != 0) {
+        int errsv = errno;
+        g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+        g_unlink(tmp);
+        g_free(tmp);
+        g_free(local);
+        return NULL;
+    }
+    g_free(tmp);
+    return local;
+}
+
+/* ---- File infos ---- */
+static GFileInfo* archive_node_info(FmArchiveIndex* index,
+                                    FmArchiveNode* node,
+                                    const char* name,
+                                    GFileQueryInfoFlags flags) {
+    GFileInfo* info = g_file_info_new();
+    FmArchiveNode* target = node;
+    char* display_name = g_filename_display_name(name);
+    char* content_type;
+    GIcon* icon;
+
+    g_file_info_set_name(info, name);
+    g_file_info_set_display_name(info, display_name);
+    g_file_info_set_edit_name(info, display_name);
+    g_free(display_name);
+    g_file_info_set_is_hidden(info, name[0] == '.');
+
+    if (node->type == G_FILE_TYPE_SYMBOLIC_LINK) {
+        g_file_info_set_is_symlink(info, TRUE);
+        if (node->link_target)
+            g_file_info_set_symlink_target(info, node->link_target);
+        if (!(flags & G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS)) {
+            target = archive_index_follow(index, node);
+            if (target == NULL) /* dangling */
+                target = node;
+        }
+    }
+    g_file_info_set_file_type(info, target->type);
+    if (target->type == G_FILE_TYPE_REGULAR)
+        g_file_info_set_size(info, target->size);
+    if (node->mtime > 0)
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED, node->mtime);
+    g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_MODE, target->mode);
+
+    if (target->type == G_FILE_TYPE_DIRECTORY)
+        content_type = g_strdup("inode/directory");
+    else if (target->type == G_FILE_TYPE_SYMBOLIC_LINK)
+        content_type = g_strdup("inode/symlink");
+    else
+        content_type = g_content_type_guess(name, NULL, 0, NULL);
+    g_file_info_set_content_type(info, content_type);
+    g_file_info_set_attribute_string(info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE, content_type);
+    icon = g_content_type_get_icon(content_type);
+    g_file_info_set_icon(info, icon);
+    g_object_unref(icon);
+    icon = g_content_type_get_symbolic_icon(content_type);
+    g_file_info_set_symbolic_icon(info, icon);
+    g_object_unref(icon);
+    g_free(content_type);
+
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ, TRUE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, FALSE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE,
+                                      target->type == G_FILE_TYPE_DIRECTORY || (target->mode & 0111) != 0);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE, FALSE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH, FALSE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME, FALSE);
+    return info;
+}
+
+/* ---- Classes structures ---- */
+#define FM_TYPE_ARCHIVE_VFILE (fm_vfs_archive_file_get_type())
+#define FM_ARCHIVE_VFILE(o) (G_TYPE_CHECK_INSTANCE_CAST((o), FM_TYPE_ARCHIVE_VFILE, FmArchiveVFile))
+#define FM_IS_ARCHIVE_VFILE(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), FM_TYPE_ARCHIVE_VFILE))
+
+typedef struct _FmArchiveVFile FmArchiveVFile;
+typedef struct _FmArchiveVFileClass FmArchiveVFileClass;
+
+static GType fm_vfs_archive_file_get_type(void);
+
+struct _FmArchiveVFile {
+    GObject parent_object;
+
+    char* archive_uri; /* URI of the archive itself */
+    char* inner;       /* normalized path inside the archive, "" for its root */
+};
+
+struct _FmArchiveVFileClass {
+    GObjectClass parent_class;
+};
+
+#define FM_TYPE_VFS_ARCHIVE_ENUMERATOR (fm_vfs_archive_enumerator_get_type())
+#define FM_VFS_ARCHIVE_ENUMERATOR(o) \
+    (G_TYPE_CHECK_INSTANCE_CAST((o), FM_TYPE_VFS_ARCHIVE_ENUMERATOR, FmVfsArchiveEnumerator))
+
+typedef struct _FmVfsArchiveEnumerator FmVfsArchiveEnumerator;
+typedef struct _FmVfsArchiveEnumeratorClass FmVfsArchiveEnumeratorClass;
+
+struct _FmVfsArchiveEnumerator {
+    GFileEnumerator parent;
+
+    FmArchiveIndex* index; /* keeps dir alive */
+    FmArchiveNode* dir;
+    guint pos;
+    GFileQueryInfoFlags flags;
+};
+
+struct _FmVfsArchiveEnumeratorClass {
+    GFileEnumeratorClass parent_class;
+};
+
+#define ERROR_UNSUPPORTED(err) \
+    g_set_error_literal(err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, _("Operation not supported"))
+#define ERROR_READ_ONLY(err) \
+    g_set_error_literal(err, G_IO_ERROR, G_IO_ERROR_READ_ONLY, _("Archive contents are read-only"))
+
+/* local path of the archive @item lives in, with index and member node */
+static gboolean archive_vfile_lookup(FmArchiveVFile* item,
+                                     FmArchiveIndex** index_out,
+                                     FmArchiveNode** node_out,
+                                     GCancellable* cancellable,
+                                     GError** error) {
+    char* archive_path = g_filename_from_uri(item->archive_uri, NULL, NULL);
+    FmArchiveIndex* index;
+    FmArchiveNode* node;
+
+    if (archive_path == NULL) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, _("Only local archives can be browsed"));
+        return FALSE;
+    }
+    index = archive_index_get(archive_path, cancellable, error);
+    g_free(archive_path);
+    if (index == NULL)
+        return FALSE;
+    node = archive_index_lookup(index, item->inner);
+    if (node == NULL) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("File not found in the archive"));
+        archive_index_unref(index);
+        return FALSE;
+    }
+    *index_out = index;
+    *node_out = node;
+    return TRUE;
+}
+
+static char* archive_vfile_archive_basename(FmArchiveVFile* item) {
+    GFile* archive = g_file_new_for_uri(item->archive_uri);
+    char* name = g_file_get_basename(archive);
+
+    g_object_unref(archive);
+    return name;
+}
+
+/* ---- archive enumerator class ---- */
+static GType fm_vfs_archive_enumerator_get_type(void);
+
+G_DEFINE_TYPE(FmVfsArchiveEnumerator, fm_vfs_archive_enumerator, G_TYPE_FILE_ENUMERATOR)
+
+static void _fm_vfs_archive_enumerator_dispose(GObject* object) {
+    FmVfsArchiveEnumerator* enu = FM_VFS_ARCHIVE_ENUMERATOR(object);
+
+    if (enu->index) {
+        archive_index_unref(enu->index);
+        enu->index = NULL;
+        enu->dir = NULL;
+    }
+
+    G_OBJECT_CLASS(fm_vfs_archive_enumerator_parent_class)->dispose(object);
+}
+
+static GFileInfo* _fm_vfs_archive_enumerator_next_file(GFileEnumerator* enumerator,
+                                                       GCancellable* cancellable,
+                                                       GError** error) {
+    FmVfsArchiveEnumerator* enu = FM_VFS_ARCHIVE_ENUMERATOR(enumerator);
+    FmArchiveNode* node;
+
+    if (g_cancellable_set_error_if_cancelled(cancellable, error))
+        return NULL;
+    if (enu->dir == NULL || enu->pos >= enu->dir->children->len)
+        return NULL;
+    node = g_ptr_array_index(enu->dir->children, enu->pos++);
+    return archive_node_info(enu->index, node, node->name, enu->flags);
+}
+
+static gboolean _fm_vfs_archive_enumerator_close(GFileEnumerator* enumerator,
+                                                 GCancellable* cancellable,
+                                                 GError** error) {
+    return TRUE;
+}
+
+static void fm_vfs_archive_enumerator_class_init(FmVfsArchiveEnumeratorClass* klass) {
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+    GFileEnumeratorClass* enumerator_class = G_FILE_ENUMERATOR_CLASS(klass);
+
+    gobject_class->dispose = _fm_vfs_archive_enumerator_dispose;
+
+    enumerator_class->next_file = _fm_vfs_archive_enumerator_next_file;
+    enumerator_class->close_fn = _fm_vfs_archive_enumerator_close;
+}
+
+static void fm_vfs_archive_enumerator_init(FmVfsArchiveEnumerator* enumerator) {
+    /* nothing */
+}
+
+/* ---- FmArchiveVFile class ---- */
+static void fm_archive_g_file_init(GFileIface* iface);
+static void fm_archive_fm_file_init(FmFileInterface* iface);
+
+G_DEFINE_TYPE_WITH_CODE(FmArchiveVFile,
+                        fm_vfs_archive_file,
+                        G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(G_TYPE_FILE, fm_archive_g_file_init)
+                            G_IMPLEMENT_INTERFACE(FM_TYPE_FILE, fm_archive_fm_file_init))
+
+static void fm_vfs_archive_file_finalize(GObject* object) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(object);
+
+    g_free(item->archive_uri);
+    g_free(item->inner);
+
+    G_OBJECT_CLASS(fm_vfs_archive_file_parent_class)->finalize(object);
+}
+
+static void fm_vfs_archive_file_class_init(FmArchiveVFileClass* klass) {
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->finalize = fm_vfs_archive_file_finalize;
+}
+
+static void fm_vfs_archive_file_init(FmArchiveVFile* item) {
+    /* nothing */
+}
+
+static FmArchiveVFile* _fm_archive_vfile_new(const char* archive_uri, char* inner) {
+    FmArchiveVFile* item = (FmArchiveVFile*)g_object_new(FM_TYPE_ARCHIVE_VFILE, NULL);
+
+    item->archive_uri = g_strdup(archive_uri);
+    item->inner = inner; /* takes ownership */
+    return item;
+}
+
+/* ---- GFile implementation ---- */
+static GFile* _fm_vfs_archive_dup(GFile* file) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(file);
+
+    return (GFile*)_fm_archive_vfile_new(item->archive_uri, g_strdup(item->inner));
+}
+
+static guint _fm_vfs_archive_hash(GFile* file) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(file);
+
+    return g_str_hash(item->archive_uri) * 31 + g_str_hash(item->inner);
+}
+
+static gboolean _fm_vfs_archive_equal(GFile* file1, GFile* file2) {
+    FmArchiveVFile* item1 = FM_ARCHIVE_VFILE(file1);
+    FmArchiveVFile* item2 = FM_ARCHIVE_VFILE(file2);
+
+    return g_str_equal(item1->archive_uri, item2->archive_uri) && g_str_equal(item1->inner, item2->inner);
+}
+
+static gboolean _fm_vfs_archive_is_native(GFile* file) {
+    return FALSE;
+}
+
+static gboolean _fm_vfs_archive_has_uri_scheme(GFile* file, const char* uri_scheme) {
+    return g_ascii_strcasecmp(uri_scheme, "archive") == 0;
+}
+
+static char* _fm_vfs_archive_get_uri_scheme(GFile* file) {
+    return g_strdup("archive");
+}
+
+static char* _fm_vfs_archive_get_basename(GFile* file) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(file);
+    const char* slash;
+
+    if (*item->inner == '\0')
+        return archive_vfile_archive_basename(item);
+    slash = strrchr(item->inner, '/');
+    return g_strdup(slash ? slash + 1 : item->inner);
+}
+
+static char* _fm_vfs_archive_get_path(GFile* file) {
+    return NULL;
+}
+
+static char* _fm_vfs_archive_get_uri(GFile* file) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(file);
+    char* host = g_uri_escape_string(item->archive_uri, NULL, FALSE);
+    char* inner = g_uri_escape_string(item->inner, G_URI_RESERVED_CHARS_ALLOWED_IN_PATH, FALSE);
+    char* uri = g_strconcat("archive://", host, "/", inner, NULL);
+
+    g_free(inner);
+    g_free(host);
+    return uri;
+}
+
+static char* _fm_vfs_archive_get_parse_name(GFile* file) {
+    return _fm_vfs_archive_get_uri(file);
+}
+
+static GFile* _fm_vfs_archive_get_parent(GFile* file) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(file);
+    GFile *archive, *parent;
+
+    if (*item->inner != '\0')
+        return (GFile*)_fm_archive_vfile_new(item->archive_uri, parent_inner_path(item->inner));
+    /* going up from the archive root leaves it for the folder containing the archive */
+    archive = g_file_new_for_uri(item->archive_uri);
+    parent = g_file_get_parent(archive);
+    g_object_unref(archive);
+    return parent;
+}
+
+static gboolean _fm_vfs_archive_prefix_matches(GFile* prefix, GFile* file) {
+    FmArchiveVFile *parent, *item;
+    size_t len;
+
+    if (!FM_IS_ARCHIVE_VFILE(prefix) || !FM_IS_ARCHIVE_VFILE(file))
+        return FALSE;
+    parent = FM_ARCHIVE_VFILE(prefix);
+    item = FM_ARCHIVE_VFILE(file);
+    if (!g_str_equal(parent->archive_uri, item->archive_uri) || *item->inner == '\0')
+        return FALSE;
+    len = strlen(parent->inner);
+    if (len == 0)
+        return TRUE;
+    return strncmp(item->inner, parent->inner, len) == 0 && item->inner[len] == '/';
+}
+
+static char* _fm_vfs_archive_get_relative_path(GFile* parent, GFile* descendant) {
+    size_t len;
+
+    if (!_fm_vfs_archive_prefix_matches(parent, descendant))
+        return NULL;
+    len = strlen(FM_ARCHIVE_VFILE(parent)->inner);
+    return g_strdup(FM_ARCHIVE_VFILE(descendant)->inner + (len ? len + 1 : 0));
+}
+
+static GFile* _fm_vfs_archive_resolve_relative_path(GFile* file, const char* relative_path) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(file);
+    /* absolute paths are taken relative to the archive root */
+    char* inner = normalize_inner_path(relative_path[0] == '/' ? NULL : item->inner, relative_path, TRUE);
+
+    return (GFile*)_fm_archive_vfile_new(item->archive_uri, inner);
+}
+
+static GFile* _fm_vfs_archive_get_child_for_display_name(GFile* file, const char* display_name, GError** error) {
+    g_return_val_if_fail(file != NULL, NULL);
+
+    if (display_name == NULL || *display_name == '\0')
+        return g_object_ref(file);
+    if (strchr(display_name, '/') != NULL) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_FILENAME, _("Invalid filename"));
+        return NULL;
+    }
+    return _fm_vfs_archive_resolve_relative_path(file, display_name);
+}
+
+static GFileEnumerator* _fm_vfs_archive_enumerate_children(GFile* file,
+                                                           const char* attributes,
+                                                           GFileQueryInfoFlags flags,
+                                                           GCancellable* cancellable,
+                                                           GError** error) {
+    FmVfsArchiveEnumerator* enumerator;
+    FmArchiveIndex* index;
+    FmArchiveNode* node;
+
+    if (!archive_vfile_lookup(FM_ARCHIVE_VFILE(file), &index, &node, cancellable, error))
+        return NULL;
+    /* children are looked up by path, so a symlinked folder is not entered */
+    if (node->type != G_FILE_TYPE_DIRECTORY) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY, _("Not a directory"));
+        archive_index_unref(index);
+        return NULL;
+    }
+
+    enumerator = g_object_new(FM_TYPE_VFS_ARCHIVE_ENUMERATOR, "container", file, NULL);
+    enumerator->index = index; /* takes the reference */
+    enumerator->dir = node;
+    enumerator->flags = flags;
+    return G_FILE_ENUMERATOR(enumerator);
+}
+
+static GFileInfo* _fm_vfs_archive_query_info(GFile* file,
+                                             const char* attributes,
+                                             GFileQueryInfoFlags flags,
+                                             GCancellable* cancellable,
+                                             GError** error) {
+    FmArchiveVFile* item = FM_ARCHIVE_VFILE(file);
+    FmArchiveIndex* index;
+    FmArchiveNode* node;
+    GFileInfo* info;
+
+    /* FIXME: use matcher to set only requested data */
+    if (!archive_vfile_lookup(item, &index, &node, cancellable, error))
+        return NULL;
+    if (node == index->root) {
+        char* name = archive_vfile_archive_basename(item);
+        info = archive_node_info(index, node, name, flags);
+        g_free(name);
+    }
+    else
+        info = archive_node_info(index, node, node->name, flags);
+    archive_index_unref(index);
+    return info;
+}
+
+static GFileInfo* _fm_vfs_archive_query_filesystem_info(GFile* file,
+                                                        const char* attributes,
+                                                        GCancellable* cancellable,
+                                                        GError** error) {
+    GFileInfo* info = g_file_info_new();
+
+    g_file_info_set_attribute_string(info, G_FILE_ATTRIBUTE_FILESYSTEM_TYPE, "archive");
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY, TRUE);
+    g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE, FALSE);
+    return info;
+}
+
+static GMount* _fm_vfs_archive_find_enclosing_mount(GFile* file, GCancellable* cancellable, GError** error) {
+    ERROR_UNSUPPORTED(error);
+    return NULL;
+}
+
+static GFile* _fm_vfs_archive_set_display_name(GFile* file,
+                                               const char* display_name,
+                                               GCancellable* cancellable,
+                                               GError** error) {
+    ERROR_READ_ONLY(error);
+    return NULL;
+}
+
+static GFileAttributeInfoList* _fm_vfs_archive_query_settable_attributes(GFile* file,
+                                                                         GCancellable* cancellable,
+                                                                         GError** error) {
+    ERROR_UNSUPPORTED(error);
+    return NULL;
+}
+
+static GFileAttributeInfoList* _fm_vfs_archive_query_writable_namespaces(GFile* file,
+                                                                         GCancellable* cancellable,
+                                                                         GError** error) {
+    ERROR_UNSUPPORTED(error);
+    return NULL;
+}
+
+static gboolean _fm_vfs_archive_set_attribute(GFile* file,
+                                              const char* attribute,
+                                              GFileAttributeType type,
+                                              gpointer value_p,
+                                              GFileQueryInfoFlags flags,
+                                              GCancellable* cancellable,
+                                              GError** error) {
+    ERROR_READ_ONLY(error);
+    return FALSE;
+}
+
+static gboolean _fm_vfs_archive_set_attributes_from_info(GFile* file,
+                                                         GFileInfo* info,
+                                                         GFileQueryInfoFlags flags,
+                                                         GCancellable* cancellable,
+                                                         GError** error) {
+    ERROR_READ_ONLY(error);
+    return FALSE;
+}
+
+static GFileInputStream* _fm_vfs_archive_read_fn(GFile* file, GCancellable* cancellable, GError** error) {
+    char* local = _fm_vfs_archive_get_local_copy(file, cancellable, error);
+    GFileInputStream* stream;
+    GFile* copy;
+
+    if (local == NULL)
+        return NULL;
+    copy = g_file_new_for_path(local);
+    stream = g_file_read(copy, cancellable, error);
+    g_object_unref(copy);
+    g_free(local);
+    return stream;
+}
+
+static GFileOutputStream* _fm_vfs_archive_append_to(GFile* file,
+                                                    GFileCreateFlags flags,
+                                                    GCancellable* cancellable,
+                                                    GError** error) {
+    ERROR_READ_ONLY(error);
+    return NULL;
+}
+
+static GFileOutputStream* _fm_vfs_archive_create(GFile* file,
+                                                 GFileCreateFlags flags,
+                                                 GCancellable* cancellable,
+                                                 GError** error) {
+    ERROR_READ_ONLY(error);
+    return NULL;
+}
+
+static GFileOutputStream* _fm_vfs_archive_replace(GFile* file,
+                                                  const char* etag,
+                                                  gboolean make_backup,
+                                                  GFileCreateFlags flags,
+                                                  GCancellable* cancellable,
+                                                  GError** error) {
+    ERROR_READ_ONLY(error);
+    return NULL;
+}
+
+static gboolean _fm_vfs_archive_delete_file(GFile* file, GCancellable* cancellable, GError** error) {
+    ERROR_READ_ONLY(error);
+    return FALSE;
+}
+
+static gboolean _fm_vfs_archive_trash(GFile* file, GCancellable* cancellable, GError** error) {
+    ERROR_READ_ONLY(error);
+    return FALSE;
+}
+
+static gboolean _fm_vfs_archive_make_directory(GFile* file, GCancellable* cancellable, GError** error) {
+    ERROR_READ_ONLY(error);
+    return FALSE;
+}
+
+static gboolean _fm_vfs_archive_make_symbolic_link(GFile* file,
+                                                   const char* symlink_value,
+                                                   GCancellable* cancellable,
+                                                   GError** error) {
+    ERROR_READ_ONLY(error);
+    return FALSE;
+}
+
+/* copy and move report "not supported" so GIO falls back to reading the member */
+static gboolean _fm_vfs_archive_copy(GFile* source,
+                                     GFile* destination,
+                                     GFileCopyFlags flags,
+                                     GCancellable* cancellable,
+                                     GFileProgressCallback progress_callback,
+                                     gpointer progress_callback_data,
+                                     GError** error) {
+    ERROR_UNSUPPORTED(error);
+    return FALSE;
+}
+
+static gboolean _fm_vfs_archive_move(GFile* source,
+                                     GFile* destination,
+                                     GFileCopyFlags flags,
+                                     GCancellable* cancellable,
+                                     GFileProgressCallback progress_callback,
+                                     gpointer progress_callback_data,
+                                     GError** error) {
+    ERROR_UNSUPPORTED(error);
+    return FALSE;
+}
+
+static GFileMonitor* _fm_vfs_archive_monitor_dir(GFile* file,
+                                                 GFileMonitorFlags flags,
+                                                 GCancellable* cancellable,
+                                                 GError** error) {
+    ERROR_UNSUPPORTED(error);
+    return NULL;
+}
+
+static GFileMonitor* _fm_vfs_archive_monitor_file(GFile* file,
+                                                  GFileMonitorFlags flags,
+                                                  GCancellable* cancellable,
+                                                  GError** error) {
+    ERROR_UNSUPPORTED(error);
+    return NULL;
+}
+
+#if GLIB_CHECK_VERSION(2, 22, 0)
+static GFileIOStream* _fm_vfs_archive_open_readwrite(GFile* file, GCancellable* cancellable, GError** error) {
+    ERROR_READ_ONLY(error);
+    return NULL;
+}
+
+static GFileIOStream* _fm_vfs_archive_create_readwrite(GFile* file,
+                                                       GFileCreateFlags flags,
+                                                       GCancellable* cancellable,
+                                                       GError** error) {
+    ERROR_READ_ONLY(error);
+    return NULL;
+}
+
+static GFileIOStream* _fm_vfs_archive_replace_readwrite(GFile* file,
+                                                        const char* etag,
+                                                        gboolean make_backup,
+                                                        GFileCreateFlags flags,
+                                                        GCancellable* cancellable,
+                                                        GError** error) {
+    ERROR_READ_ONLY(error);
+    return NULL;
+}
+#endif /* Glib >= 2.22 */
+
+static void fm_archive_g_file_init(GFileIface* iface) {
+    iface->dup = _fm_vfs_archive_dup;
+    iface->hash = _fm_vfs_archive_hash;
+    iface->equal = _fm_vfs_archive_equal;
+    iface->is_native = _fm_vfs_archive_is_native;
+    iface->has_uri_scheme = _fm_vfs_archive_has_uri_scheme;
+    iface->get_uri_scheme = _fm_vfs_archive_get_uri_scheme;
+    iface->get_basename = _fm_vfs_archive_get_basename;
+    iface->get_path = _fm_vfs_archive_get_path;
+    iface->get_uri = _fm_vfs_archive_get_uri;
+    iface->get_parse_name = _fm_vfs_archive_get_parse_name;
+    iface->get_parent = _fm_vfs_archive_get_parent;
+    iface->prefix_matches = _fm_vfs_archive_prefix_matches;
+    iface->get_relative_path = _fm_vfs_archive_get_relative_path;
+    iface->resolve_relative_path = _fm_vfs_archive_resolve_relative_path;
+    iface->get_child_for_display_name = _fm_vfs_archive_get_child_for_display_name;
+    iface->enumerate_children = _fm_vfs_archive_enumerate_children;
+    iface->query_info = _fm_vfs_archive_query_info;
+    iface->query_filesystem_info = _fm_vfs_archive_query_filesystem_info;
+    iface->find_enclosing_mount = _fm_vfs_archive_find_enclosing_mount;
+    iface->set_display_name = _fm_vfs_archive_set_display_name;
+    iface->query_settable_attributes = _fm_vfs_archive_query_settable_attributes;
+    iface->query_writable_namespaces = _fm_vfs_archive_query_writable_namespaces;
+    iface->set_attribute = _fm_vfs_archive_set_attribute;
+    iface->set_attributes_from_info = _fm_vfs_archive_set_attributes_from_info;
+    iface->read_fn = _fm_vfs_archive_read_fn;
+    iface->append_to = _fm_vfs_archive_append_to;
+    iface->create = _fm_vfs_archive_create;
+    iface->replace = _fm_vfs_archive_replace;
+    iface->delete_file = _fm_vfs_archive_delete_file;
+    iface->trash = _fm_vfs_archive_trash;
+    iface->make_directory = _fm_vfs_archive_make_directory;
+    iface->make_symbolic_link = _fm_vfs_archive_make_symbolic_link;
+    iface->copy = _fm_vfs_archive_copy;
+    iface->move = _fm_vfs_archive_move;
+    iface->monitor_dir = _fm_vfs_archive_monitor_dir;
+    iface->monitor_file = _fm_vfs_archive_monitor_file;
+#if GLIB_CHECK_VERSION(2, 22, 0)
+    iface->open_readwrite = _fm_vfs_archive_open_readwrite;
+    iface->create_readwrite = _fm_vfs_archive_create_readwrite;
+    iface->replace_readwrite = _fm_vfs_archive_replace_readwrite;
+    iface->supports_thread_contexts = TRUE;
+#endif /* Glib >= 2.22 */
+}
+
+/* ---- FmFile implementation ---- */
+static gboolean _fm_vfs_archive_wants_incremental(GFile* file) {
+    return FALSE;
+}
+
+static void fm_archive_fm_file_init(FmFileInterface* iface) {
+    iface->wants_incremental = _fm_vfs_archive_wants_incremental;
+}
+
+/* ---- interface for loading ---- */
+GFile* _fm_vfs_archive_new_for_uri(const char* uri) {
+    const char *p, *slash;
+    char *host, *archive_uri, *rel, *inner;
+    FmArchiveVFile* item;
+
+    g_return_val_if_fail(uri != NULL, NULL);
+    p = uri;
+    if (g_ascii_strncasecmp(p, "archive://", 10) == 0)
+        p += 10;
+    slash = strchr(p, '/');
+    host = slash ? g_strndup(p, slash - p) : g_strdup(p);
+    archive_uri = g_uri_unescape_string(host, NULL);
+    g_free(host);
+    rel = slash ? g_uri_unescape_string(slash, NULL) : NULL;
+    inner = normalize_inner_path(NULL, rel ? rel : "", TRUE);
+    item = _fm_archive_vfile_new(archive_uri ? archive_uri : "", inner);
+    g_free(rel);
+    g_free(archive_uri);
+    return (GFile*)item;
+}
+
+char* _fm_vfs_archive_get_local_copy(GFile* file, GCancellable* cancellable, GError** error) {
+    FmArchiveIndex* index;
+    FmArchiveNode* node;
+    FmArchiveNode* target;
+    char* local;
+
+    if (!FM_IS_ARCHIVE_VFILE(file)) {
+        ERROR_UNSUPPORTED(error);
+        return NULL;
+    }
+    if (!archive_vfile_lookup(FM_ARCHIVE_VFILE(file), &index, &node, cancellable, error))
+        return NULL;
+    target = archive_index_follow(index, node);
+    if (target == NULL) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("File not found in the archive"));
+        archive_index_unref(index);
+        return NULL;
+    }
+    if (target->type == G_FILE_TYPE_DIRECTORY) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY, _("Can't open directory"));
+        archive_index_unref(index);
+        return NULL;
+    }
+    if (target->type != G_FILE_TYPE_REGULAR) {
+        g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_REGULAR_FILE, _("Not a regular file"));
+        archive_index_unref(index);
+        return NULL;
+    }
+    local = archive_extract_member(index, target, cancellable, error);
+    archive_index_unref(index);
+    return local;
+}
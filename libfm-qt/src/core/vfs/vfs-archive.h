@@ -0,0 +1,36 @@
+/*
+ *      vfs-archive.h
+ *
+ *      This library is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU Lesser General Public
+ *      License as published by the Free Software Foundation; either
+ *      version 2.1 of the License, or (at your option) any later version.
+ *
+ *      This library is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      Lesser General Public License for more details.
+ *
+ *      You should have received a copy of the GNU Lesser General Public
+ *      License along with this library; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _FM_VFS_ARCHIVE_H_
+#define _FM_VFS_ARCHIVE_H_ 1
+
+#include <glib.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* archive://<escaped URI of a local archive>/<path inside the archive> */
+GFile* _fm_vfs_archive_new_for_uri(const char* uri);
+
+/* Extracts the member @file refers to into the per-user cache (or reuses an up to date
+ * copy from an earlier call) and returns the path of that local copy. Used to hand
+ * archive members to applications, which cannot open archive:// URIs themselves. */
+char* _fm_vfs_archive_get_local_copy(GFile* file, GCancellable* cancellable, GError** error);
+
+G_END_DECLS
+#endif /* _FM_VFS_ARCHIVE_H_ */
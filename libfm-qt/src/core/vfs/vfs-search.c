@@ -23,6 +23,10 @@
 #include <config.h>
 #endif
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for FNM_CASEFOLD in fnmatch.h, memmem() and memrchr(), GNU extensions */
+#endif
+
 #include "fm-file.h"
 
 #include <glib/gi18n-lib.h>
@@ -31,8 +35,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#define _GNU_SOURCE /* for FNM_CASEFOLD in fnmatch.h, a GNU extension */
 #include <fnmatch.h>
 
 #if __GNUC__ >= 4
@@ -41,6 +47,8 @@
 
 /* ---- Classes structures ---- */
 typedef struct _FmSearchIntIter FmSearchIntIter;
+typedef struct _FmSearchWalker FmSearchWalker;
+typedef struct _FmSearchGlob FmSearchGlob;
 
 struct _FmSearchIntIter {
     FmSearchIntIter* parent; /* recursion path */
@@ -48,6 +56,23 @@ struct _FmSearchIntIter {
     GFileEnumerator* enu;    /* children enumerator */
 };
 
+/* what it takes to match a name pattern, sorted out when the search starts */
+typedef enum {
+    SEARCH_GLOB_LITERAL, /* "text": the whole name */
+    SEARCH_GLOB_PREFIX,  /* "text*" */
+    SEARCH_GLOB_SUFFIX,  /* "*text", where text does not start with '.' (see name_exts) */
+    SEARCH_GLOB_INFIX,   /* "*text*" */
+    SEARCH_GLOB_ANY,     /* "*" */
+    SEARCH_GLOB_FNMATCH  /* anything else, left to fnmatch() */
+} FmSearchGlobKind;
+
+struct _FmSearchGlob {
+    FmSearchGlobKind kind;
+    char* text;          /* the literal part, case folded for case insensitive searches */
+    gsize len;           /* of text */
+    const char* pattern; /* the pattern itself, in name_patterns */
+};
+
 #define FM_TYPE_VFS_SEACRH_ENUMERATOR (fm_vfs_search_enumerator_get_type())
 #define FM_VFS_SEACRH_ENUMERATOR(o) \
     (G_TYPE_CHECK_INSTANCE_CAST((o), FM_TYPE_VFS_SEACRH_ENUMERATOR, FmVfsSearchEnumerator))
@@ -63,12 +88,17 @@ struct _FmVfsSearchEnumerator {
     GFileQueryInfoFlags flags;
     GSList* target_folders; /* GFile */
     char** name_patterns;
+    FmSearchGlob* name_globs; /* name_patterns, sorted out */
+    guint n_name_globs;
+    GHashTable* name_exts; /* the ".ext" of "*.ext" patterns, which are not in name_globs */
     GRegex* name_regex;
     GRegex* name_regex_utf8; /* to be made without G_REGEX_RAW */
     char* content_pattern;
     GRegex* content_regex;
     GRegex* content_regex_utf8; /* to be made without G_REGEX_RAW */
     char** mime_types;
+    GHashTable* type_verdicts; /* content type => whether it is one of mime_types, guarded by type_lock */
+    GMutex type_lock;
     guint64 min_mtime;
     guint64 max_mtime;
     guint64 min_size;
@@ -77,6 +107,12 @@ struct _FmVfsSearchEnumerator {
     gboolean content_case_insensitive : 1;
     gboolean recursive : 1;
     gboolean show_hidden : 1;
+    GPtrArray* index_hits;  /* paths found by the search index, to be matched yet */
+    guint index_pos;        /* the next of them */
+    FmSearchWalker* walker; /* walks a local folder on several threads */
+    char* content_literal;  /* what any match of content_regex contains, to find lines worth matching */
+    guint max_results;      /* the search ends after this many matches, if not 0 */
+    guint results;          /* matches returned so far */
 };
 
 struct _FmVfsSearchEnumeratorClass {
@@ -113,6 +149,15 @@ static void fm_search_job_match_folder(FmVfsSearchEnumerator* priv,
                                        GCancellable* cancellable,
                                        GError** error);
 static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str);
+static gboolean fm_search_job_match_name(FmVfsSearchEnumerator* priv, const char* name);
+
+/* defined in searchindex.cpp */
+gboolean _fm_search_index_find(const char* dir,
+                               gboolean show_hidden,
+                               gboolean (*match)(const char* name, gpointer user_data),
+                               gpointer user_data,
+                               GPtrArray* paths,
+                               GPtrArray* unindexed_dirs);
 
 /* ---- Directory iterator ---- */
 /* caller should g_object_ref(folder_path) if success */
@@ -142,6 +187,124 @@ static inline void _search_iter_free(FmSearchIntIter* iter, GCancellable* cancel
     g_slice_free(FmSearchIntIter, iter);
 }
 
+/* ---- Parallel walker ---- */
+/* Local folders are read by several threads, each of which queues the subfolders
+ * it finds for the others. Matches are handed to the enumerator as they come. */
+#define SEARCH_MAX_WALK_THREADS 8
+
+typedef struct _FmSearchHit FmSearchHit;
+
+struct _FmSearchHit {
+    GFileInfo* info; /* NULL marks the end of the walk */
+    GFile* parent;
+};
+
+struct _FmSearchWalker {
+    FmVfsSearchEnumerator* enu; /* whose criteria are only read while walking */
+    GThreadPool* pool;
+    GAsyncQueue* hits;         /* FmSearchHit, in the order they were found */
+    GCancellable* cancellable; /* stops the walk */
+    gint pending;              /* folders queued or being read */
+    gboolean finished;         /* the end of the walk was taken from hits */
+    GMutex lock;
+    GError* error; /* the first error, which ends the search */
+};
+
+static gboolean _search_error_is_ignored(GError* err) {
+    return err->domain == G_IO_ERROR &&
+           (err->code == G_IO_ERROR_PERMISSION_DENIED || err->code == G_IO_ERROR_CANCELLED);
+}
+
+static void _search_walker_read_dir(gpointer data, gpointer user_data) {
+    GFile* dir = data;
+    FmSearchWalker* walker = user_data;
+    FmVfsSearchEnumerator* enu = walker->enu;
+    GFileEnumerator* children = NULL;
+    GError* err = NULL;
+
+    if (!g_cancellable_is_cancelled(walker->cancellable))
+        children = g_file_enumerate_children(dir, enu->attributes, enu->flags, walker->cancellable, &err);
+    if (children) {
+        GFileInfo* info;
+        while (err == NULL && (info = g_file_enumerator_next_file(children, walker->cancellable, &err))) {
+            /* SF bug #969: symlinks to directories are not followed */
+            if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY &&
+                !g_file_info_get_attribute_boolean(info, G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK) &&
+                (enu->show_hidden ||
+                 !g_file_info_get_attribute_boolean(info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN))) {
+                /* let another thread read it while this one goes on */
+                g_atomic_int_inc(&walker->pending);
+                g_thread_pool_push(walker->pool, g_file_get_child(dir, g_file_info_get_name(info)), NULL);
+            }
+            if (fm_search_job_match_file(enu, info, dir, walker->cancellable, &err)) {
+                FmSearchHit* hit = g_slice_new(FmSearchHit);
+                hit->info = info;
+                hit->parent = g_object_ref(dir);
+                g_async_queue_push(walker->hits, hit);
+            }
+            else
+                g_object_unref(info);
+            if (err != NULL && err->domain == G_IO_ERROR && err->code == G_IO_ERROR_PERMISSION_DENIED)
+                g_clear_error(&err); /* an unreadable file */
+        }
+        g_file_enumerator_close(children, NULL, NULL);
+        g_object_unref(children);
+    }
+    if (err != NULL) {
+        g_mutex_lock(&walker->lock);
+        if (walker->error == NULL && !_search_error_is_ignored(err)) {
+            walker->error = err;
+            err = NULL;
+            g_cancellable_cancel(walker->cancellable);
+        }
+        g_mutex_unlock(&walker->lock);
+        if (err != NULL)
+            g_error_free(err);
+    }
+    g_object_unref(dir);
+
+    if (g_atomic_int_dec_and_test(&walker->pending))
+        g_async_queue_push(walker->hits, g_slice_new0(FmSearchHit));
+}
+
+/* folder is taken over */
+static FmSearchWalker* _search_walker_new(FmVfsSearchEnumerator* enu, GFile* folder) {
+    FmSearchWalker* walker = g_slice_new0(FmSearchWalker);
+    walker->enu = enu;
+    walker->hits = g_async_queue_new();
+    walker->cancellable = g_cancellable_new();
+    walker->pending = 1;
+    g_mutex_init(&walker->lock);
+    walker->pool = g_thread_pool_new(_search_walker_read_dir, walker,
+                                     MIN(g_get_num_processors(), SEARCH_MAX_WALK_THREADS), FALSE, NULL);
+    g_thread_pool_push(walker->pool, folder, NULL);
+    return walker;
+}
+
+static void _search_walker_free(FmSearchWalker* walker) {
+    FmSearchHit* hit;
+
+    g_cancellable_cancel(walker->cancellable);
+    /* the threads push no folder once they are all done */
+    while (!walker->finished) {
+        hit = g_async_queue_pop(walker->hits);
+        if (hit->info) {
+            g_object_unref(hit->info);
+            g_object_unref(hit->parent);
+        }
+        else
+            walker->finished = TRUE;
+        g_slice_free(FmSearchHit, hit);
+    }
+    g_thread_pool_free(walker->pool, FALSE, TRUE);
+    g_async_queue_unref(walker->hits);
+    g_object_unref(walker->cancellable);
+    if (walker->error)
+        g_error_free(walker->error);
+    g_mutex_clear(&walker->lock);
+    g_slice_free(FmSearchWalker, walker);
+}
+
 /* ---- search enumerator class ---- */
 static GType fm_vfs_search_enumerator_get_type(void);
 
@@ -155,6 +318,12 @@ static void _fm_vfs_search_enumerator_dispose(GObject* object) {
     FmVfsSearchEnumerator* priv = FM_VFS_SEACRH_ENUMERATOR(object);
     FmSearchIntIter* iter;
 
+    /* its threads use the criteria freed below */
+    if (priv->walker) {
+        _search_walker_free(priv->walker);
+        priv->walker = NULL;
+    }
+
     while ((iter = priv->iter)) {
         priv->iter = iter->parent;
         _search_iter_free(iter, NULL);
@@ -171,6 +340,20 @@ static void _fm_vfs_search_enumerator_dispose(GObject* object) {
         priv->target_folders = NULL;
     }
 
+    if (priv->name_globs) {
+        guint i;
+        for (i = 0; i < priv->n_name_globs; ++i)
+            g_free(priv->name_globs[i].text);
+        g_free(priv->name_globs);
+        priv->name_globs = NULL;
+        priv->n_name_globs = 0;
+    }
+
+    if (priv->name_exts) {
+        g_hash_table_destroy(priv->name_exts);
+        priv->name_exts = NULL;
+    }
+
     if (priv->name_patterns) {
         g_strfreev(priv->name_patterns);
         priv->name_patterns = NULL;
@@ -201,33 +384,182 @@ static void _fm_vfs_search_enumerator_dispose(GObject* object) {
         priv->content_regex_utf8 = NULL;
     }
 
+    if (priv->content_literal) {
+        g_free(priv->content_literal);
+        priv->content_literal = NULL;
+    }
+
     if (priv->mime_types) {
         g_strfreev(priv->mime_types);
         priv->mime_types = NULL;
     }
 
+    if (priv->type_verdicts) {
+        g_hash_table_destroy(priv->type_verdicts);
+        priv->type_verdicts = NULL;
+    }
+
+    if (priv->index_hits) {
+        g_ptr_array_free(priv->index_hits, TRUE);
+        priv->index_hits = NULL;
+    }
+
     G_OBJECT_CLASS(fm_vfs_search_enumerator_parent_class)->dispose(object);
 }
 
 /* The next directory that is a match with the recursive search: */
 static GFileInfo* recur_dir_match = NULL;
 
-static GFileInfo* _fm_vfs_search_enumerator_next_file(GFileEnumerator* enumerator,
-                                                      GCancellable* cancellable,
-                                                      GError** error) {
+static gboolean _search_index_match_name(const char* name, gpointer user_data) {
+    return fm_search_job_match_name(user_data, name);
+}
+
+/* Asks the search index for the files below folder whose name matches.
+ * Returns FALSE if the folder is not indexed and should be walked. */
+static gboolean _search_find_indexed(FmVfsSearchEnumerator* enu, GFile* folder) {
+    char* path = g_file_get_path(folder);
+    GPtrArray* hits;
+    GPtrArray* unindexed_dirs;
+    guint i;
+
+    if (path == NULL)
+        return FALSE;
+    hits = g_ptr_array_new_with_free_func(g_free);
+    unindexed_dirs = g_ptr_array_new_with_free_func(g_free);
+    if (!_fm_search_index_find(path, enu->show_hidden, _search_index_match_name, enu, hits, unindexed_dirs)) {
+        g_ptr_array_free(hits, TRUE);
+        g_ptr_array_free(unindexed_dirs, TRUE);
+        g_free(path);
+        return FALSE;
+    }
+    /* other filesystems mounted inside are walked as usual */
+    for (i = 0; i < unindexed_dirs->len; ++i)
+        enu->target_folders =
+            g_slist_prepend(enu->target_folders, g_file_new_for_path(g_ptr_array_index(unindexed_dirs, i)));
+    g_ptr_array_free(unindexed_dirs, TRUE);
+    enu->index_hits = hits;
+    enu->index_pos = 0;
+    g_free(path);
+    return TRUE;
+}
+
+/* Returns the next of the files found by the index that matches all the criteria.
+ * Returns NULL with index_hits freed when there are no more of them. */
+static GFileInfo* _search_next_indexed(FmVfsSearchEnumerator* enu, GCancellable* cancellable, GError** error) {
+    GError* err = NULL;
+
+    while (enu->index_pos < enu->index_hits->len) {
+        GFile* file;
+        GFile* parent;
+        GFileInfo* file_info;
+
+        if (g_cancellable_set_error_if_cancelled(cancellable, error))
+            return NULL;
+        file = g_file_new_for_path(g_ptr_array_index(enu->index_hits, enu->index_pos++));
+        file_info = g_file_query_info(file, enu->attributes, enu->flags, cancellable, &err);
+        parent = g_file_get_parent(file);
+        g_object_unref(file);
+        if (file_info && fm_search_job_match_file(enu, file_info, parent, cancellable, &err)) {
+            FmSearchVFile* container = FM_SEARCH_VFILE(g_file_enumerator_get_container(G_FILE_ENUMERATOR(enu)));
+            if (container->current)
+                g_object_unref(container->current);
+            container->current = parent; /* the folder of the file returned */
+            return file_info;
+        }
+        if (file_info)
+            g_object_unref(file_info);
+        g_object_unref(parent);
+        if (err != NULL) {
+            /* files removed since they were indexed, or not readable, are skipped */
+            if (err->domain == G_IO_ERROR &&
+                (err->code == G_IO_ERROR_NOT_FOUND || err->code == G_IO_ERROR_PERMISSION_DENIED)) {
+                g_error_free(err);
+                err = NULL;
+                continue;
+            }
+            g_propagate_error(error, err);
+            return NULL;
+        }
+    }
+    g_ptr_array_free(enu->index_hits, TRUE);
+    enu->index_hits = NULL;
+    return NULL;
+}
+
+/* Returns the next file the walker found, with the folder it is in set as current.
+ * Returns NULL with walker freed when the walk is over. */
+static GFileInfo* _search_next_walked(FmVfsSearchEnumerator* enu, GCancellable* cancellable, GError** error) {
+    FmSearchWalker* walker = enu->walker;
+
+    while (!walker->finished) {
+        FmSearchHit* hit;
+
+        if (g_cancellable_set_error_if_cancelled(cancellable, error))
+            return NULL;
+        /* wake up now and then to notice cancellation */
+        hit = g_async_queue_timeout_pop(walker->hits, 100000);
+        if (hit == NULL)
+            continue;
+        if (hit->info) {
+            GFileInfo* file_info = hit->info;
+            FmSearchVFile* container = FM_SEARCH_VFILE(g_file_enumerator_get_container(G_FILE_ENUMERATOR(enu)));
+            if (container->current)
+                g_object_unref(container->current);
+            container->current = hit->parent;
+            g_slice_free(FmSearchHit, hit);
+            return file_info;
+        }
+        g_slice_free(FmSearchHit, hit);
+        walker->finished = TRUE;
+        if (walker->error) {
+            g_propagate_error(error, walker->error);
+            walker->error = NULL;
+            return NULL;
+        }
+    }
+    _search_walker_free(walker);
+    enu->walker = NULL;
+    return NULL;
+}
+
+static GFileInfo* _search_next_match(GFileEnumerator* enumerator, GCancellable* cancellable, GError** error) {
     FmVfsSearchEnumerator* enu = FM_VFS_SEACRH_ENUMERATOR(enumerator);
     FmSearchIntIter* iter;
     GFileInfo* file_info;
     GError* err = NULL;
     FmSearchVFile* container;
 
-    /* g_debug("_fm_vfs_search_enumerator_next_file"); */
     while (!g_cancellable_set_error_if_cancelled(cancellable, error)) {
+        if (enu->index_hits) {
+            file_info = _search_next_indexed(enu, cancellable, error);
+            if (file_info || enu->index_hits) /* found, or failed */
+                return file_info;
+        }
+        if (enu->walker) {
+            file_info = _search_next_walked(enu, cancellable, error);
+            if (file_info || enu->walker) /* found, or failed */
+                return file_info;
+        }
         iter = enu->iter;
         if (iter == NULL) /* ended with folder */
         {
             if (enu->target_folders == NULL)
                 break;
+            /* recursive searches are answered by the index when it has the folder */
+            if (enu->recursive) {
+                GFile* folder = enu->target_folders->data;
+                enu->target_folders = g_slist_delete_link(enu->target_folders, enu->target_folders);
+                if (_search_find_indexed(enu, folder)) {
+                    g_object_unref(folder);
+                    continue;
+                }
+                /* local folders are read on several threads */
+                if (g_file_is_native(folder)) {
+                    enu->walker = _search_walker_new(enu, folder);
+                    continue;
+                }
+                enu->target_folders = g_slist_prepend(enu->target_folders, folder);
+            }
             iter = _search_iter_new(NULL, enu->attributes, enu->flags, enu->target_folders->data, cancellable, error);
             if (iter == NULL)
                 break;
@@ -314,6 +646,24 @@ static GFileInfo* _fm_vfs_search_enumerator_next_file(GFileEnumerator* enumerato
     return NULL;
 }
 
+static GFileInfo* _fm_vfs_search_enumerator_next_file(GFileEnumerator* enumerator,
+                                                      GCancellable* cancellable,
+                                                      GError** error) {
+    FmVfsSearchEnumerator* enu = FM_VFS_SEACRH_ENUMERATOR(enumerator);
+    GFileInfo* file_info;
+
+    /* g_debug("_fm_vfs_search_enumerator_next_file"); */
+    if (enu->max_results > 0 && enu->results >= enu->max_results)
+        return NULL;
+    file_info = _search_next_match(enumerator, cancellable, error);
+    if (file_info && enu->max_results > 0 && ++enu->results >= enu->max_results && enu->walker) {
+        /* enough found: stop the threads now rather than when the enumerator is closed */
+        _search_walker_free(enu->walker);
+        enu->walker = NULL;
+    }
+    return file_info;
+}
+
 static gboolean _fm_vfs_search_enumerator_close(GFileEnumerator* enumerator,
                                                 GCancellable* cancellable,
                                                 GError** error) {
@@ -321,6 +671,11 @@ static gboolean _fm_vfs_search_enumerator_close(GFileEnumerator* enumerator,
     FmVfsSearchEnumerator* enu = FM_VFS_SEACRH_ENUMERATOR(enumerator);
     FmSearchIntIter* iter;
 
+    if (enu->walker) {
+        _search_walker_free(enu->walker);
+        enu->walker = NULL;
+    }
+
     while ((iter = enu->iter)) {
         enu->iter = iter->parent;
         _search_iter_free(iter, cancellable);
@@ -328,18 +683,27 @@ static gboolean _fm_vfs_search_enumerator_close(GFileEnumerator* enumerator,
     return TRUE;
 }
 
+static void _fm_vfs_search_enumerator_finalize(GObject* object) {
+    FmVfsSearchEnumerator* priv = FM_VFS_SEACRH_ENUMERATOR(object);
+
+    g_mutex_clear(&priv->type_lock);
+
+    G_OBJECT_CLASS(fm_vfs_search_enumerator_parent_class)->finalize(object);
+}
+
 static void fm_vfs_search_enumerator_class_init(FmVfsSearchEnumeratorClass* klass) {
     GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
     GFileEnumeratorClass* enumerator_class = G_FILE_ENUMERATOR_CLASS(klass);
 
     gobject_class->dispose = _fm_vfs_search_enumerator_dispose;
+    gobject_class->finalize = _fm_vfs_search_enumerator_finalize;
 
     enumerator_class->next_file = _fm_vfs_search_enumerator_next_file;
     enumerator_class->close_fn = _fm_vfs_search_enumerator_close;
 }
 
 static void fm_vfs_search_enumerator_init(FmVfsSearchEnumerator* enumerator) {
-    /* nothing */
+    g_mutex_init(&enumerator->type_lock);
 }
 
 static GFileEnumerator* _fm_vfs_search_enumerator_new(GFile* file,
@@ -379,6 +743,153 @@ static time_t parse_date_str(const char* str) {
     return 0;
 }
 
+/*
+ * _search_regex_literal
+ * @regex: a regular expression
+ * Return: the longest string each match of @regex contains, or NULL if that is
+ * not easily told. Lines without it need not be matched against @regex.
+ */
+static char* _search_regex_literal(const char* regex) {
+    GString* run = g_string_new(NULL);
+    GString* best = g_string_new(NULL);
+    const char* p;
+    char* ret = NULL;
+
+    /* alternatives and inline options are beyond this */
+    if (strchr(regex, '|') || strstr(regex, "(?"))
+        goto out;
+    for (p = regex; *p; ++p) {
+        gboolean literal = FALSE;
+        char c = *p;
+        switch (c) {
+        case '\\':
+            if (p[1] == '\0')
+                goto out;
+            /* escaped punctuation is itself, others are classes or references */
+            c = *++p;
+            literal = !g_ascii_isalnum(c);
+            break;
+        case '[': /* a set of characters */
+            ++p;
+            if (*p == '^')
+                ++p;
+            if (*p == ']')
+                ++p;
+            while (*p && *p != ']') {
+                if (*p == '\\' && p[1])
+                    ++p;
+                ++p;
+            }
+            if (*p == '\0')
+                goto out;
+            break;
+        case '*':
+        case '?':
+        case '{':
+            /* the character before is optional: drop it, with all of its UTF-8 bytes */
+            while (run->len > 0 && (run->str[run->len - 1] & 0xc0) == 0x80)
+                g_string_truncate(run, run->len - 1);
+            if (run->len > 0)
+                g_string_truncate(run, run->len - 1);
+            if (c == '{') {
+                p = strchr(p, '}');
+                if (p == NULL)
+                    goto out;
+            }
+            break;
+        case ')':
+            /* an optional group */
+            if (p[1] == '*' || p[1] == '?' || p[1] == '{')
+                goto out;
+            break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+        case '(':
+            break;
+        default:
+            literal = TRUE;
+        }
+        if (literal) {
+            g_string_append_c(run, c);
+            continue;
+        }
+        /* the run ends here */
+        if (run->len > best->len)
+            g_string_assign(best, run->str);
+        g_string_truncate(run, 0);
+    }
+    if (run->len > best->len)
+        g_string_assign(best, run->str);
+    if (best->len > 0)
+        ret = g_strdup(best->str);
+out:
+    g_string_free(run, TRUE);
+    g_string_free(best, TRUE);
+    return ret;
+}
+
+/* Sorts out the name patterns, so that most of them are matched by comparing strings. The
+ * "*.ext" ones go into a set, to be looked up with the extensions of each name. */
+static void _search_compile_globs(FmVfsSearchEnumerator* priv) {
+    guint n = g_strv_length(priv->name_patterns);
+    guint i;
+
+    priv->name_globs = g_new0(FmSearchGlob, n);
+    for (i = 0; i < n; ++i) {
+        const char* pattern = priv->name_patterns[i];
+        gsize len = strlen(pattern);
+        gsize lead = 0, trail = 0;
+        FmSearchGlobKind kind;
+        FmSearchGlob* glob;
+        char* text;
+
+        while (lead < len && pattern[lead] == '*')
+            ++lead;
+        while (trail < len - lead && pattern[len - 1 - trail] == '*')
+            ++trail;
+        text = g_strndup(pattern + lead, len - lead - trail);
+        if (strpbrk(text, "*?[\\"))
+            kind = SEARCH_GLOB_FNMATCH;
+        else if (lead && *text == '\0')
+            kind = SEARCH_GLOB_ANY;
+        else if (lead && trail)
+            kind = SEARCH_GLOB_INFIX;
+        else if (lead)
+            kind = SEARCH_GLOB_SUFFIX;
+        else if (trail)
+            kind = SEARCH_GLOB_PREFIX;
+        else
+            kind = SEARCH_GLOB_LITERAL;
+
+        if (kind != SEARCH_GLOB_FNMATCH && priv->name_case_insensitive) {
+            if (g_utf8_validate(text, -1, NULL)) {
+                char* folded = g_utf8_casefold(text, -1);
+                g_free(text);
+                text = folded;
+            }
+            else
+                kind = SEARCH_GLOB_FNMATCH;
+        }
+        if (kind == SEARCH_GLOB_FNMATCH) {
+            g_free(text);
+            text = NULL;
+        }
+        else if (kind == SEARCH_GLOB_SUFFIX && text[0] == '.') {
+            if (!priv->name_exts)
+                priv->name_exts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+            g_hash_table_add(priv->name_exts, text);
+            continue;
+        }
+        glob = &priv->name_globs[priv->n_name_globs++];
+        glob->kind = kind;
+        glob->text = text;
+        glob->len = text ? strlen(text) : 0;
+        glob->pattern = pattern;
+    }
+}
+
 /*
  * parse_search_uri
  * @job
@@ -401,6 +912,7 @@ static time_t parse_date_str(const char* str) {
  * max_size=<bytes>
  * min_mtime=YYYY-MM-DD
  * max_mtime=YYYY-MM-DD
+ * max_results=<count>: end the search after this many matches
  *
  * An example to search all *.desktop files in /usr/share and /usr/local/share
  * can be written like this:
@@ -514,6 +1026,8 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str) {
                             }
                         }
 
+                        priv->type_verdicts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
                         if (!g_strstr_len(priv->attributes, -1, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
                             gchar* attributes =
                                 g_strconcat(priv->attributes, ",", G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE, NULL);
@@ -522,6 +1036,8 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str) {
                         }
                     }
                 }
+                else if (strcmp(name, "max_results") == 0)
+                    priv->max_results = (guint)MAX(atoi(value), 0);
                 else if (strcmp(name, "min_size") == 0)
                     priv->min_size = atoll(value);
                 else if (strcmp(name, "max_size") == 0)
@@ -541,6 +1057,9 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str) {
                     break;
             }
 
+            if (priv->name_patterns)
+                _search_compile_globs(priv);
+
             if (name_regex) {
                 /* we set G_REGEX_RAW because GLib might cause a crash
                    if a search is done in a non-utf8 string */
@@ -560,6 +1079,7 @@ static void parse_search_uri(FmVfsSearchEnumerator* priv, const char* uri_str) {
                 priv->content_regex = g_regex_new(content_regex, flags, 0, NULL);
                 priv->content_regex_utf8 =
                     g_regex_new(content_regex, priv->content_case_insensitive ? G_REGEX_CASELESS : 0, 0, NULL);
+                priv->content_literal = _search_regex_literal(content_regex);
                 g_free(content_regex);
             }
 
@@ -595,31 +1115,78 @@ static void fm_search_job_match_folder(FmVfsSearchEnumerator* priv,
     container->current = g_object_ref(folder_path);
 }
 
-static gboolean fm_search_job_match_filename(FmVfsSearchEnumerator* priv, GFileInfo* info) {
+/* Folds the case of name into buf if it fits there and is ASCII, or else into a new string
+ * set to folded. */
+static const char* _search_fold_name(const char* name, char* buf, gsize size, char** folded) {
+    gsize i;
+
+    for (i = 0; name[i]; ++i) {
+        if ((name[i] & 0x80) || i + 1 >= size) {
+            *folded = g_utf8_validate(name, -1, NULL) ? g_utf8_casefold(name, -1) : g_ascii_strdown(name, -1);
+            return *folded;
+        }
+        buf[i] = g_ascii_tolower(name[i]);
+    }
+    buf[i] = '\0';
+    return buf;
+}
+
+/* Whether name matches one of name_patterns, as fnmatch() with FNM_PERIOD would tell. */
+static gboolean _search_match_globs(FmVfsSearchEnumerator* priv, const char* name) {
+    char buf[256];
+    char* folded = NULL;
+    const char* subject = priv->name_case_insensitive ? _search_fold_name(name, buf, sizeof(buf), &folded) : name;
+    gsize len = strlen(subject);
+    /* a leading '*' does not match a leading '.' */
+    gboolean hidden = subject[0] == '.';
+    gboolean ret = FALSE;
+    guint i;
+
+    if (priv->name_exts && !hidden) {
+        const char* dot;
+        for (dot = strchr(subject, '.'); dot && !ret; dot = strchr(dot + 1, '.'))
+            ret = g_hash_table_contains(priv->name_exts, dot);
+    }
+    for (i = 0; i < priv->n_name_globs && !ret; ++i) {
+        const FmSearchGlob* glob = &priv->name_globs[i];
+        switch (glob->kind) {
+            case SEARCH_GLOB_LITERAL:
+                ret = len == glob->len && memcmp(subject, glob->text, len) == 0;
+                break;
+            case SEARCH_GLOB_PREFIX:
+                ret = len >= glob->len && memcmp(subject, glob->text, glob->len) == 0;
+                break;
+            case SEARCH_GLOB_SUFFIX:
+                ret = !hidden && len >= glob->len && memcmp(subject + len - glob->len, glob->text, glob->len) == 0;
+                break;
+            case SEARCH_GLOB_INFIX:
+                ret = !hidden && strstr(subject, glob->text) != NULL;
+                break;
+            case SEARCH_GLOB_ANY:
+                ret = !hidden;
+                break;
+            case SEARCH_GLOB_FNMATCH:
+                /* FIXME: FNM_CASEFOLD is a GNU extension */
+                ret = fnmatch(glob->pattern, name, FNM_PERIOD | (priv->name_case_insensitive ? FNM_CASEFOLD : 0)) == 0;
+                break;
+        }
+    }
+    g_free(folded);
+    return ret;
+}
+
+static gboolean fm_search_job_match_name(FmVfsSearchEnumerator* priv, const char* name) {
     gboolean ret;
 
-    /* g_debug("fm_search_job_match_filename: %s", g_file_info_get_name(info)); */
+    /* g_debug("fm_search_job_match_name: %s", name); */
     if (priv->name_regex) {
-        const char* name = g_file_info_get_name(info);
         if (g_utf8_validate(name, -1, NULL))
             ret = g_regex_match(priv->name_regex_utf8, name, 0, NULL);
         else
             ret = g_regex_match(priv->name_regex, name, 0, NULL);
     }
-    else if (priv->name_patterns) {
-        ret = FALSE;
-        const char* name = g_file_info_get_name(info);
-        char** ppattern;
-        for (ppattern = priv->name_patterns; *ppattern; ++ppattern) {
-            const char* pattern = *ppattern;
-            /* FIXME: FNM_CASEFOLD is a GNU extension */
-            int flags = FNM_PERIOD;
-            if (priv->name_case_insensitive)
-                flags |= FNM_CASEFOLD;
-            if (fnmatch(pattern, name, flags) == 0)
-                ret = TRUE;
-        }
-    }
+    else if (priv->name_globs)
+        ret = _search_match_globs(priv, name);
     else
         ret = TRUE;
     return ret;
@@ -719,6 +1286,171 @@ static gboolean fm_search_job_match_content_exact(FmVfsSearchEnumerator* priv,
     return ret;
 }
 
+/* Local files are read in large blocks, and only the lines holding a literal part of
+ * the pattern are matched against it. */
+#define SEARCH_BLOCK_SIZE (256 * 1024)
+/* lines longer than this are matched in pieces */
+#define SEARCH_MAX_LINE (1024 * 1024)
+/* files with a NUL byte in their first bytes are taken as binary and not searched */
+#define SEARCH_SNIFF_SIZE 8192
+
+static gboolean _search_is_ascii(const char* data, gsize len) {
+    gsize i;
+    for (i = 0; i < len; ++i)
+        if (data[i] & 0x80)
+            return FALSE;
+    return TRUE;
+}
+
+/* Finds needle in haystack, with the case of ASCII letters ignored if case_insensitive. */
+static const char* _search_find_literal(const char* haystack,
+                                        gsize len,
+                                        const char* needle,
+                                        gsize needle_len,
+                                        gboolean case_insensitive) {
+    const char* end = haystack + len;
+    const char* lower_at;
+    const char* upper_at;
+    char lower, upper;
+
+    if (!case_insensitive)
+        return memmem(haystack, len, needle, needle_len);
+    /* look for both cases of the first letter, each with memchr() */
+    lower = g_ascii_tolower(needle[0]);
+    upper = g_ascii_toupper(needle[0]);
+    lower_at = memchr(haystack, lower, len);
+    upper_at = lower == upper ? NULL : memchr(haystack, upper, len);
+    while (lower_at || upper_at) {
+        const char* p = (upper_at == NULL || (lower_at && lower_at < upper_at)) ? lower_at : upper_at;
+        if ((gsize)(end - p) < needle_len)
+            break;
+        if (g_ascii_strncasecmp(p, needle, needle_len) == 0)
+            return p;
+        if (p == lower_at)
+            lower_at = memchr(p + 1, lower, end - p - 1);
+        else
+            upper_at = memchr(p + 1, upper, end - p - 1);
+    }
+    return NULL;
+}
+
+/* Whether a line, without its end, matches as in fm_search_job_match_content_line_based(). */
+static gboolean _search_match_line(FmVfsSearchEnumerator* priv, const char* line, gsize len) {
+    gboolean ret;
+    if (priv->content_regex) {
+        if (g_utf8_validate(line, len, NULL))
+            ret = g_regex_match_full(priv->content_regex_utf8, line, len, 0, 0, NULL, NULL);
+        else
+            ret = g_regex_match_full(priv->content_regex, line, len, 0, 0, NULL, NULL);
+    }
+    else {
+        /* case insensitive; non-UTF8 lines are treated as ASCII */
+        char* down = g_utf8_validate(line, len, NULL) ? g_utf8_strdown(line, len) : g_ascii_strdown(line, len);
+        ret = strstr(down, priv->content_pattern) != NULL;
+        g_free(down);
+    }
+    return ret;
+}
+
+/* Whether one of the lines in data matches. */
+static gboolean _search_match_lines(FmVfsSearchEnumerator* priv, const char* data, gsize len) {
+    const char* end = data + len;
+    const char* p = data;
+    const char* literal = priv->content_regex ? priv->content_literal : priv->content_pattern;
+    gboolean case_insensitive = priv->content_case_insensitive;
+
+    /* without case, non-ASCII letters may fold to ASCII ones, so the literal is not
+     * trusted with such text */
+    if (literal && (*literal == '\0' || (case_insensitive && !_search_is_ascii(data, len))))
+        literal = NULL;
+    while (p < end) {
+        const char* line = p;
+        const char* eol;
+        if (literal) {
+            const char* hit = _search_find_literal(p, end - p, literal, strlen(literal), case_insensitive);
+            if (hit == NULL)
+                return FALSE;
+            line = memrchr(p, '\n', hit - p);
+            line = line ? line + 1 : p;
+        }
+        eol = memchr(line, '\n', end - line);
+        if (eol == NULL)
+            eol = end;
+        if (_search_match_line(priv, line, eol - line))
+            return TRUE;
+        p = eol + 1;
+    }
+    return FALSE;
+}
+
+/* Searches the content of a local file.
+ * NOTE: it is read, not mapped, for the reason given in fm_search_job_match_content(). */
+static gboolean fm_search_job_match_content_local(FmVfsSearchEnumerator* priv,
+                                                  const char* path,
+                                                  GCancellable* cancellable,
+                                                  GError** error) {
+    gboolean ret = FALSE;
+    /* case sensitive patterns are found in the bytes, without looking for lines */
+    gboolean exact = priv->content_pattern && !priv->content_case_insensitive;
+    gsize pattern_len = exact ? strlen(priv->content_pattern) : 0;
+    gboolean first = TRUE;
+    gboolean eof = FALSE;
+    gsize len = 0;
+    char* buf;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        int errsv = errno;
+        g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+        return FALSE;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    buf = g_malloc(MAX(SEARCH_MAX_LINE, pattern_len) + SEARCH_BLOCK_SIZE);
+    while (!ret && !eof) {
+        gsize end;
+        ssize_t n;
+
+        if (g_cancellable_set_error_if_cancelled(cancellable, error))
+            break;
+        n = read(fd, buf + len, SEARCH_BLOCK_SIZE);
+        if (n < 0) {
+            int errsv = errno;
+            if (errsv == EINTR)
+                continue;
+            g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(errsv), g_strerror(errsv));
+            break;
+        }
+        eof = (n == 0);
+        if (first) {
+            first = FALSE;
+            if (memchr(buf, '\0', MIN((gsize)n, SEARCH_SNIFF_SIZE)))
+                break; /* binary */
+        }
+        len += n;
+
+        if (exact) {
+            if (len >= pattern_len && memmem(buf, len, priv->content_pattern, pattern_len))
+                ret = TRUE;
+            /* keep what may be the start of a match */
+            end = (pattern_len > 0 && len >= pattern_len) ? len - (pattern_len - 1) : 0;
+        }
+        else {
+            /* the last line is matched once it is complete, unless it is too long */
+            const char* eol = (eof || len >= SEARCH_MAX_LINE) ? NULL : memrchr(buf, '\n', len);
+            end = (eof || len >= SEARCH_MAX_LINE) ? len : (eol ? (gsize)(eol - buf) + 1 : 0);
+            ret = _search_match_lines(priv, buf, end);
+        }
+        memmove(buf, buf + end, len - end);
+        len -= end;
+    }
+    g_free(buf);
+    close(fd);
+    return ret;
+}
+
 static gboolean fm_search_job_match_content(FmVfsSearchEnumerator* priv,
                                             GFileInfo* info,
                                             GFile* parent,
@@ -730,7 +1462,13 @@ static gboolean fm_search_job_match_content(FmVfsSearchEnumerator* priv,
         if (g_file_info_get_file_type(info) == G_FILE_TYPE_REGULAR &&
             g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_STANDARD_SIZE) > 0) {
             GFile* file = g_file_get_child(parent, g_file_info_get_name(info));
-            if (file) {
+            char* path = file ? g_file_get_path(file) : NULL;
+            if (path) {
+                ret = fm_search_job_match_content_local(priv, path, cancellable, error);
+                g_free(path);
+                g_object_unref(file);
+            }
+            else if (file) {
                 /* NOTE: I disabled mmap-based search since this could cause
                  * unexpected crashes sometimes if the mapped files are
                  * removed or changed during the search. */
@@ -766,6 +1504,17 @@ static gboolean fm_search_job_match_file_type(FmVfsSearchEnumerator* priv, GFile
     if (priv->mime_types) {
         const char* file_type = g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
         char** pmime_type;
+        gpointer verdict;
+
+        if (file_type == NULL)
+            return FALSE;
+        /* a search meets few content types, each of which is judged once */
+        g_mutex_lock(&priv->type_lock);
+        verdict = g_hash_table_lookup(priv->type_verdicts, file_type);
+        g_mutex_unlock(&priv->type_lock);
+        if (verdict)
+            return GPOINTER_TO_INT(verdict) == 2;
+
         ret = FALSE;
         for (pmime_type = priv->mime_types; *pmime_type; ++pmime_type) {
             const char* mime_type = *pmime_type;
@@ -784,6 +1533,9 @@ static gboolean fm_search_job_match_file_type(FmVfsSearchEnumerator* priv, GFile
                 break;
             }
         }
+        g_mutex_lock(&priv->type_lock);
+        g_hash_table_insert(priv->type_verdicts, g_strdup(file_type), GINT_TO_POINTER(ret ? 2 : 1));
+        g_mutex_unlock(&priv->type_lock);
     }
     else
         ret = TRUE;
@@ -825,16 +1577,17 @@ static gboolean fm_search_job_match_file(FmVfsSearchEnumerator* priv,
     if (!priv->show_hidden && g_file_info_get_attribute_boolean(info, G_FILE_ATTRIBUTE_STANDARD_IS_HIDDEN))
         return FALSE;
 
-    if (!fm_search_job_match_filename(priv, info))
+    /* the cheapest tests go first */
+    if (!fm_search_job_match_size(priv, info))
         return FALSE;
 
-    if (!fm_search_job_match_file_type(priv, info))
+    if (!fm_search_job_match_mtime(priv, info))
         return FALSE;
 
-    if (!fm_search_job_match_size(priv, info))
+    if (!fm_search_job_match_file_type(priv, info))
         return FALSE;
 
-    if (!fm_search_job_match_mtime(priv, info))
+    if (!fm_search_job_match_name(priv, g_file_info_get_name(info)))
         return FALSE;
 
     if (!fm_search_job_match_content(priv, info, parent, cancellable, error))
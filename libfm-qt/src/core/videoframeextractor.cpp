@@ -0,0 +1,287 @@
+#include "videoframeextractor.h"
+
+#ifdef HAVE_FFMPEG
+
+#include <QTransform>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/display.h>
+#include <libswscale/swscale.h>
+}
+
+namespace Fm {
+
+namespace {
+
+// the packets of all streams read before giving up on a frame, when keyframes are rare
+constexpr int kMaxPackets = 2048;
+// the decoders kept open for the next files
+constexpr std::size_t kMaxIdleDecoders = 8;
+
+struct FormatDeleter {
+    void operator()(AVFormatContext* format) const { avformat_close_input(&format); }
+};
+
+struct PacketDeleter {
+    void operator()(AVPacket* packet) const { av_packet_free(&packet); }
+};
+
+struct FrameDeleter {
+    void operator()(AVFrame* frame) const { av_frame_free(&frame); }
+};
+
+// An open decoder and the scaler last used with it, for the streams of one codec and parameters.
+struct Decoder {
+    std::string key;
+    AVCodecContext* context = nullptr;
+    SwsContext* scaler = nullptr;
+
+    ~Decoder() {
+        sws_freeContext(scaler);
+        avcodec_free_context(&context);
+    }
+};
+
+std::mutex decoderMutex;
+std::vector<std::unique_ptr<Decoder>> idleDecoders;  // the most recently used last
+
+// What must be the same for a decoder to be used again without being opened again.
+std::string decoderKey(const AVCodecParameters* params, int lowres) {
+    std::string key;
+    const int fields[] = {static_cast<int>(params->codec_id), lowres, params->width, params->height, params->format,
+                          params->profile};
+    key.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+    if (params->extradata) {
+        key.append(reinterpret_cast<const char*>(params->extradata), params->extradata_size);
+    }
+    return key;
+}
+
+std::unique_ptr<Decoder> takeDecoder(const AVCodec* codec, const AVStream* stream, int lowres) {
+    std::string key = decoderKey(stream->codecpar, lowres);
+    {
+        std::lock_guard<std::mutex> lock{decoderMutex};
+        for (auto it = idleDecoders.end(); it != idleDecoders.begin();) {
+            --it;
+            if ((*it)->key == key) {
+                auto decoder = std::move(*it);
+                idleDecoders.erase(it);
+                decoder->context->pkt_timebase = stream->time_base;
+                return decoder;
+            }
+        }
+    }
+    auto decoder = std::make_unique<Decoder>();
+    decoder->key = std::move(key);
+    decoder->context = avcodec_alloc_context3(codec);
+    if (!decoder->context || avcodec_parameters_to_context(decoder->context, stream->codecpar) < 0) {
+        return nullptr;
+    }
+    AVCodecContext* context = decoder->context;
+    context->pkt_timebase = stream->time_base;
+    context->thread_count = 1;  // the thumbnail job already decodes several files at once
+    context->lowres = lowres;
+    context->skip_loop_filter = AVDISCARD_ALL;
+    context->skip_frame = AVDISCARD_NONKEY;  // the seek ends on a keyframe, which is the frame wanted
+    context->flags2 |= AV_CODEC_FLAG2_FAST;
+    if (avcodec_open2(context, codec, nullptr) < 0) {
+        return nullptr;
+    }
+    return decoder;
+}
+
+void returnDecoder(std::unique_ptr<Decoder> decoder) {
+    avcodec_flush_buffers(decoder->context);
+    std::lock_guard<std::mutex> lock{decoderMutex};
+    idleDecoders.push_back(std::move(decoder));
+    if (idleDecoders.size() > kMaxIdleDecoders) {
+        idleDecoders.erase(idleDecoders.begin());
+    }
+}
+
+int isInterrupted(void* cancellable) {
+    return g_cancellable_is_cancelled(static_cast<GCancellable*>(cancellable)) ? 1 : 0;
+}
+
+// Decodes the next frame of |stream| into |frame|.
+bool decodeFrame(AVFormatContext* format, const AVStream* stream, AVCodecContext* decoder, AVFrame* frame) {
+    if (stream->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+        // cover art: a single picture kept with the stream, rather than in the packets
+        if (avcodec_send_packet(decoder, &stream->attached_pic) < 0) {
+            return false;
+        }
+        avcodec_send_packet(decoder, nullptr);
+        return avcodec_receive_frame(decoder, frame) == 0;
+    }
+    std::unique_ptr<AVPacket, PacketDeleter> packet{av_packet_alloc()};
+    if (!packet) {
+        return false;
+    }
+    bool draining = false;
+    for (int packets = 0;;) {
+        const int received = avcodec_receive_frame(decoder, frame);
+        if (received == 0) {
+            return true;
+        }
+        if (received != AVERROR(EAGAIN) || draining) {
+            return false;
+        }
+        if (av_read_frame(format, packet.get()) < 0 || ++packets > kMaxPackets) {
+            // the end of the file, or of the patience: get what the decoder still holds
+            avcodec_send_packet(decoder, nullptr);
+            draining = true;
+            continue;
+        }
+        int sent = 0;
+        if (packet->stream_index == stream->index) {
+            sent = avcodec_send_packet(decoder, packet.get());
+        }
+        av_packet_unref(packet.get());
+        if (sent < 0 && sent != AVERROR_INVALIDDATA) {  // a damaged packet is only skipped
+            return false;
+        }
+    }
+}
+
+}  // namespace
+
+std::atomic<bool> VideoFrameExtractor::enabled_{true};
+
+bool VideoFrameExtractor::isAvailable() {
+    return true;
+}
+
+QImage VideoFrameExtractor::extract(const char* localPath, int size, GCancellable* cancellable) {
+    static std::once_flag quietOnce;
+    std::call_once(quietOnce, [] { av_log_set_level(AV_LOG_FATAL); });  // damaged files are common, and not ours
+
+    AVFormatContext* rawFormat = avformat_alloc_context();
+    if (!rawFormat) {
+        return QImage();
+    }
+    rawFormat->interrupt_callback.callback = isInterrupted;
+    rawFormat->interrupt_callback.opaque = cancellable;
+    if (avformat_open_input(&rawFormat, localPath, nullptr, nullptr) < 0) {  // frees it on failure
+        return QImage();
+    }
+    std::unique_ptr<AVFormatContext, FormatDeleter> format{rawFormat};
+
+    // Most containers describe their streams in their headers; probing them by decoding packets
+    // is only needed when they do not.
+    const AVCodec* codec = nullptr;
+    int index = av_find_best_stream(format.get(), AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (index < 0 || format->streams[index]->codecpar->width <= 0) {
+        if (avformat_find_stream_info(format.get(), nullptr) < 0) {
+            return QImage();
+        }
+        index = av_find_best_stream(format.get(), AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    }
+    if (index < 0 || !codec) {
+        return QImage();
+    }
+    AVStream* stream = format->streams[index];
+    const AVCodecParameters* params = stream->codecpar;
+    for (unsigned int i = 0; i < format->nb_streams; ++i) {
+        if (static_cast<int>(i) != index) {
+            format->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    // the smallest resolution the decoder can give that still fills the thumbnail
+    int lowres = 0;
+    const int longestSide = std::max(params->width, params->height);
+    while (lowres < codec->max_lowres && (longestSide >> (lowres + 1)) >= size) {
+        ++lowres;
+    }
+
+    if (!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC) && format->duration > 0) {
+        // backwards, to the keyframe at or before 10% of the duration; on failure, the start will do
+        std::int64_t target = format->duration / 10;
+        if (format->start_time != AV_NOPTS_VALUE) {
+            target += format->start_time;
+        }
+        av_seek_frame(format.get(), -1, target, AVSEEK_FLAG_BACKWARD);
+    }
+
+    auto decoder = takeDecoder(codec, stream, lowres);
+    if (!decoder) {
+        return QImage();
+    }
+    std::unique_ptr<AVFrame, FrameDeleter> frame{av_frame_alloc()};
+    if (!frame || !decodeFrame(format.get(), stream, decoder->context, frame.get()) || frame->width <= 0 ||
+        frame->height <= 0 || g_cancellable_is_cancelled(cancellable)) {
+        returnDecoder(std::move(decoder));
+        return QImage();
+    }
+
+    // the size it is shown at, from the aspect ratio of its pixels, fitted into |size|
+    double width = frame->width;
+    const double height = frame->height;
+    const AVRational aspect = av_guess_sample_aspect_ratio(format.get(), stream, frame.get());
+    if (aspect.num > 0 && aspect.den > 0) {
+        width = width * aspect.num / aspect.den;
+    }
+    const double scale = std::min({1.0, size / width, size / height});
+    const int scaledWidth = std::max(1, static_cast<int>(std::lround(width * scale)));
+    const int scaledHeight = std::max(1, static_cast<int>(std::lround(height * scale)));
+
+    QImage image{scaledWidth, scaledHeight, QImage::Format_RGB32};
+    decoder->scaler = sws_getCachedContext(decoder->scaler, frame->width, frame->height,
+                                           static_cast<AVPixelFormat>(frame->format), scaledWidth, scaledHeight,
+                                           AV_PIX_FMT_RGB32, SWS_AREA, nullptr, nullptr, nullptr);
+    if (image.isNull() || !decoder->scaler) {
+        returnDecoder(std::move(decoder));
+        return QImage();
+    }
+    std::uint8_t* const planes[4] = {image.bits(), nullptr, nullptr, nullptr};
+    const int strides[4] = {static_cast<int>(image.bytesPerLine()), 0, 0, 0};
+    sws_scale(decoder->scaler, frame->data, frame->linesize, 0, frame->height, planes, strides);
+    returnDecoder(std::move(decoder));
+
+    // as phones record: upright only through the display matrix
+    const AVPacketSideData* sideData =
+        av_packet_side_data_get(params->coded_side_data, params->nb_coded_side_data, AV_PKT_DATA_DISPLAYMATRIX);
+    if (sideData && sideData->size >= 9 * sizeof(std::int32_t)) {
+        const double rotation = -av_display_rotation_get(reinterpret_cast<const std::int32_t*>(sideData->data));
+        if (!std::isnan(rotation) && std::lround(rotation) % 360 != 0) {
+            image = image.transformed(QTransform().rotate(std::lround(rotation / 90) * 90));
+        }
+    }
+    return image;
+}
+
+void VideoFrameExtractor::releaseDecoders() {
+    std::lock_guard<std::mutex> lock{decoderMutex};
+    idleDecoders.clear();
+}
+
+}  // namespace Fm
+
+#else  // !HAVE_FFMPEG
+
+namespace Fm {
+
+std::atomic<bool> VideoFrameExtractor::enabled_{true};
+
+bool VideoFrameExtractor::isAvailable() {
+    return false;
+}
+
+QImage VideoFrameExtractor::extract(const char* /*localPath*/, int /*size*/, GCancellable* /*cancellable*/) {
+    return QImage();
+}
+
+void VideoFrameExtractor::releaseDecoders() {}
+
+}  // namespace Fm
+
+#endif  // HAVE_FFMPEG
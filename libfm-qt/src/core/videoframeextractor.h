@@ -0,0 +1,37 @@
+#ifndef FM2_VIDEOFRAMEEXTRACTOR_H
+#define FM2_VIDEOFRAMEEXTRACTOR_H
+
+#include "../libfmqtglobals.h"
+#include <QImage>
+#include <atomic>
+#include <gio/gio.h>
+
+namespace Fm {
+
+// Decodes a single frame of a local video file in-process with FFmpeg, rather than spawning an
+// external thumbnailer for it. The frame is the keyframe at or before 10% of the duration,
+// decoded without the loop filter and, when the decoder can, at a reduced resolution. Decoders
+// are kept open between files: a file of the same codec and parameters reuses one. Thread safe.
+// Only available when libfm-qt was built with FFmpeg; on unless setEnabled(false).
+class LIBFM_QT_API VideoFrameExtractor {
+   public:
+    static bool isAvailable();
+
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // The frame of |localPath| scaled to fit |size|, with the rotation the file asks for; a null
+    // image when the file has no video or cannot be decoded, or when |cancellable| is cancelled.
+    static QImage extract(const char* localPath, int size, GCancellable* cancellable);
+
+    // Closes the decoders kept for the next files.
+    static void releaseDecoders();
+
+   private:
+    static std::atomic<bool> enabled_;
+};
+
+}  // namespace Fm
+
+#endif  // FM2_VIDEOFRAMEEXTRACTOR_H
@@ -305,17 +305,17 @@ FileAction::FileAction(GKeyFile* kf) : FileActionObject{kf}, target{FILE_ACTION_
     }
 }
 
-std::shared_ptr<FileActionProfile> FileAction::match(const FileInfoList& files) const {
+std::shared_ptr<FileActionProfile> FileAction::match(const FileActionSelection& selection) const {
     // qDebug() << "FileAction.match: " << id.get();
     if (hidden || !enabled) {
         return nullptr;
     }
 
-    if (!condition->match(files)) {
+    if (!condition->match(selection)) {
         return nullptr;
     }
     for (const auto& profile : profiles) {
-        if (profile->match(files)) {
+        if (profile->match(selection)) {
             // qDebug() << "  profile matched!\n\n";
             return profile;
         }
@@ -329,12 +329,12 @@ FileActionMenu::FileActionMenu(GKeyFile* kf) : FileActionObject{kf} {
     items_list = CStrArrayPtr{g_key_file_get_string_list(kf, "Desktop Entry", "ItemsList", nullptr, nullptr)};
 }
 
-bool FileActionMenu::match(const FileInfoList& files) const {
+bool FileActionMenu::match(const FileActionSelection& selection) const {
     // stdout.printf("FileActionMenu.match: %s\n", id);
     if (hidden || !enabled) {
         return false;
     }
-    if (!condition->match(files)) {
+    if (!condition->match(selection)) {
         return false;
     }
     // stdout.printf("menu matched!: %s\n\n", id);
@@ -376,12 +376,12 @@ void FileActionMenu::cache_children(const FileInfoList& files, const char** item
 }
 
 std::shared_ptr<FileActionItem> FileActionItem::fromActionObject(std::shared_ptr<FileActionObject> action_obj,
-                                                                 const FileInfoList& files) {
+                                                                 const FileActionSelection& selection) {
     std::shared_ptr<FileActionItem> item;
     if (action_obj->type == FileActionType::MENU) {
         auto menu = static_pointer_cast<FileActionMenu>(action_obj);
-        if (menu->match(files)) {
-            item = make_shared<FileActionItem>(menu, files);
+        if (menu->match(selection)) {
+            item = make_shared<FileActionItem>(menu, selection);
             // eliminate empty menus
             if (item->children.empty()) {
                 item = nullptr;
@@ -391,9 +391,9 @@ std::shared_ptr<FileActionItem> FileActionItem::fromActionObject(std::shared_ptr
     else {
         // handle profiles here
         auto action = static_pointer_cast<FileAction>(action_obj);
-        auto profile = action->match(files);
+        auto profile = action->match(selection);
         if (profile) {
-            item = make_shared<FileActionItem>(action, profile, files);
+            item = make_shared<FileActionItem>(action, profile, selection.files());
         }
     }
     return item;
@@ -406,14 +406,14 @@ FileActionItem::FileActionItem(std::shared_ptr<FileAction> _action,
     profile = _profile;
 }
 
-FileActionItem::FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileInfoList& files)
-    : FileActionItem{static_pointer_cast<FileActionObject>(menu), files} {
+FileActionItem::FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileActionSelection& selection)
+    : FileActionItem{static_pointer_cast<FileActionObject>(menu), selection.files()} {
     for (auto& action_obj : menu->cached_children) {
         if (action_obj == nullptr) {  // separator
             children.push_back(nullptr);
         }
         else {  // action item or menu
-            auto subitem = fromActionObject(action_obj, files);
+            auto subitem = fromActionObject(action_obj, selection);
             if (subitem != nullptr) {
                 children.push_back(subitem);
             }
@@ -590,12 +590,13 @@ FileActionItemList FileActionItem::get_actions_for_files(const FileInfoList& fil
 
     // Output the menus
     FileActionItemList items;
+    const FileActionSelection selection{files};
 
     for (auto& item : all_actions) {
         auto& action_obj = item.second;
         // only output toplevel items here
         if (action_obj->has_parent == false) {  // this is a toplevel item
-            auto item = FileActionItem::fromActionObject(action_obj, files);
+            auto item = FileActionItem::fromActionObject(action_obj, selection);
             if (item != nullptr) {
                 items.push_back(item);
             }
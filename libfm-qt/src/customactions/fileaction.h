@@ -55,7 +55,7 @@ class FileAction : public FileActionObject {
    public:
     FileAction(GKeyFile* kf);
 
-    std::shared_ptr<FileActionProfile> match(const FileInfoList& files) const;
+    std::shared_ptr<FileActionProfile> match(const FileActionSelection& selection) const;
 
     int target;  // bitwise or of FileActionTarget
     CStrPtr toolbar_label;
@@ -68,7 +68,7 @@ class FileActionMenu : public FileActionObject {
    public:
     FileActionMenu(GKeyFile* kf);
 
-    bool match(const FileInfoList& files) const;
+    bool match(const FileActionSelection& selection) const;
 
     // called during menu generation
     void cache_children(const FileInfoList& files, const char** items_list);
@@ -82,13 +82,13 @@ class FileActionMenu : public FileActionObject {
 class FileActionItem {
    public:
     static std::shared_ptr<FileActionItem> fromActionObject(std::shared_ptr<FileActionObject> action_obj,
-                                                            const FileInfoList& files);
+                                                            const FileActionSelection& selection);
 
     FileActionItem(std::shared_ptr<FileAction> _action,
                    std::shared_ptr<FileActionProfile> _profile,
                    const FileInfoList& files);
 
-    FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileInfoList& files);
+    FileActionItem(std::shared_ptr<FileActionMenu> menu, const FileActionSelection& selection);
 
     FileActionItem(std::shared_ptr<FileActionObject> _action, const FileInfoList& files);
 
@@ -1,11 +1,187 @@
 #include "fileactioncondition.h"
 #include "fileaction.h"
+#include <sys/stat.h>
+#include <algorithm>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
 namespace Fm {
 
+namespace {
+
+// how long a menu may wait for the session bus to tell whether a name has an owner
+constexpr int kNameHasOwnerTimeout = 500;
+
+// The answers of TryExec for the programs looked for in $PATH, kept until the folders of
+// $PATH change.
+unordered_map<string, bool> try_exec_cache;
+vector<pair<string, int64_t>> path_dir_mtimes;
+
+bool program_in_path(const string& program) {
+    // the folders and their modification times, to see whether a program was added or removed
+    vector<pair<string, int64_t>> mtimes;
+    CStrArrayPtr dirs{g_strsplit(g_getenv("PATH") ? g_getenv("PATH") : "", G_SEARCHPATH_SEPARATOR_S, -1)};
+    for (auto dir = dirs.get(); *dir; ++dir) {
+        struct stat st;
+        int64_t mtime = stat(*dir, &st) == 0 ? int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec : -1;
+        mtimes.emplace_back(*dir, mtime);
+    }
+    if (mtimes != path_dir_mtimes) {
+        path_dir_mtimes = std::move(mtimes);
+        try_exec_cache.clear();
+    }
+    auto it = try_exec_cache.find(program);
+    if (it == try_exec_cache.end()) {
+        CStrPtr exec_path{g_find_program_in_path(program.c_str())};
+        it = try_exec_cache.emplace(program, g_file_test(exec_path.get(), G_FILE_TEST_IS_EXECUTABLE)).first;
+    }
+    return it->second;
+}
+
+// The answers of ShowIfRegistered by D-Bus name. Once a name is asked about, the bus tells
+// when its owner changes, so it is only ever asked once.
+GDBusConnection* session_bus = nullptr;
+unordered_map<string, bool> name_has_owner_cache;
+
+void on_name_owner_changed(GDBusConnection* /*connection*/,
+                           const char* /*sender_name*/,
+                           const char* /*object_path*/,
+                           const char* /*interface_name*/,
+                           const char* /*signal_name*/,
+                           GVariant* parameters,
+                           gpointer /*user_data*/) {
+    const char* name;
+    const char* old_owner;
+    const char* new_owner;
+    g_variant_get(parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+    name_has_owner_cache[name] = (new_owner[0] != '\0');
+}
+
+bool name_has_owner(const string& name) {
+    auto it = name_has_owner_cache.find(name);
+    if (it != name_has_owner_cache.end()) {
+        return it->second;
+    }
+    if (session_bus == nullptr) {
+        session_bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+        if (session_bus == nullptr) {
+            return false;
+        }
+    }
+    // watch the name before asking, so that no change is missed
+    g_dbus_connection_signal_subscribe(session_bus, "org.freedesktop.DBus", "org.freedesktop.DBus", "NameOwnerChanged",
+                                       "/org/freedesktop/DBus", name.c_str(), G_DBUS_SIGNAL_FLAGS_NONE,
+                                       on_name_owner_changed, nullptr, nullptr);
+    // References:
+    // http://people.freedesktop.org/~david/eggdbus-20091014/eggdbus-interface-org.freedesktop.DBus.html#eggdbus-method-org.freedesktop.DBus.NameHasOwner
+    // glib source code: gio/tests/gdbus-names.c
+    GVariant* result = g_dbus_connection_call_sync(
+        session_bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "NameHasOwner",
+        g_variant_new("(s)", name.c_str()), G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NONE, kNameHasOwnerTimeout,
+        nullptr, nullptr);
+    gboolean has_owner = false;
+    if (result != nullptr) {
+        g_variant_get(result, "(b)", &has_owner);
+        g_variant_unref(result);
+    }
+    // a bus that did not answer in time is taken as no owner, until the owner changes
+    name_has_owner_cache.emplace(name, has_owner);
+    return has_owner;
+}
+
+}  // namespace
+
+static bool pattern_matches(GPatternSpec* pattern, const string& str) {
+#if GLIB_CHECK_VERSION(2, 70, 0)
+    return g_pattern_spec_match_string(pattern, str.c_str());
+#else
+    return g_pattern_match_string(pattern, str.c_str());
+#endif
+}
+
+FileActionSelection::FileActionSelection(const FileInfoList& files)
+    : files_{files},
+      hasDirs_{false},
+      hasNonDirs_{false},
+      foldersGathered_{false},
+      namesGathered_{false},
+      foldedNamesGathered_{false} {
+    unordered_set<const MimeType*> mime_types;
+    FilePath last_dir;
+    for (auto& fi : files) {
+        auto& mime_type = fi->mimeType();
+        if (mime_types.insert(mime_type.get()).second) {
+            mimeTypes_.push_back(mime_type->name());
+        }
+        if (fi->isDir()) {
+            hasDirs_ = true;
+        }
+        else {
+            hasNonDirs_ = true;
+        }
+        // the files of a folder share its scheme
+        if (fi->dirPath() && fi->dirPath() == last_dir) {
+            continue;
+        }
+        last_dir = fi->dirPath();
+        auto uri_scheme = fi->path().uriScheme();
+        string scheme{uri_scheme ? uri_scheme.get() : ""};
+        if (find(schemes_.cbegin(), schemes_.cend(), scheme) == schemes_.cend()) {
+            schemes_.push_back(std::move(scheme));
+        }
+    }
+}
+
+const vector<string>& FileActionSelection::folders() const {
+    if (!foldersGathered_) {
+        foldersGathered_ = true;
+        unordered_set<string> seen;
+        FilePath last_dir;
+        for (auto& fi : files_) {
+            if (!fi->isDir() && fi->dirPath() && fi->dirPath() == last_dir) {
+                continue;
+            }
+            auto dirname = fi->isDir() ? fi->path().toString()  // also match "folder" itself
+                                       : fi->dirPath().toString();
+            if (!fi->isDir()) {
+                last_dir = fi->dirPath();
+            }
+            // Since the pattern ends with "/*", if the directory path is equal to "folder",
+            // it should end with "/" to be found as a match. Adding "/" is always harmless.
+            auto path_str = string(dirname.get()) + "/";
+            if (seen.insert(path_str).second) {
+                folders_.push_back(std::move(path_str));
+            }
+        }
+    }
+    return folders_;
+}
+
+const vector<string>& FileActionSelection::names(bool folded) const {
+    if (!folded) {
+        if (!namesGathered_) {
+            namesGathered_ = true;
+            names_.reserve(files_.size());
+            for (auto& fi : files_) {
+                names_.push_back(fi->name());
+            }
+        }
+        return names_;
+    }
+    if (!foldedNamesGathered_) {
+        foldedNamesGathered_ = true;
+        foldedNames_.reserve(files_.size());
+        for (auto& fi : files_) {
+            CStrPtr case_fold{g_utf8_casefold(fi->name().c_str(), -1)};
+            foldedNames_.push_back(case_fold.get());
+        }
+    }
+    return foldedNames_;
+}
+
 FileActionCondition::FileActionCondition(GKeyFile* kf, const char* group) {
     only_show_in = CStrArrayPtr{g_key_file_get_string_list(kf, group, "OnlyShowIn", nullptr, nullptr)};
     not_show_in = CStrArrayPtr{g_key_file_get_string_list(kf, group, "NotShowIn", nullptr, nullptr)};
@@ -42,43 +218,82 @@ FileActionCondition::FileActionCondition(GKeyFile* kf, const char* group) {
     auto caps = CStrArrayPtr{g_key_file_get_string_list(kf, group, "Capabilities", nullptr, nullptr)};
 
     // FIXME: implement Capabilities support
+
+    // compile the patterns once, rather than each time a menu is shown
+    if (base_names != nullptr) {
+        for (auto it = base_names.get(); *it; ++it) {
+            const char* name = *it;
+            bool negated = (name[0] == '!');
+            if (negated) {
+                ++name;
+            }
+            if (match_case) {
+                base_name_rules_.push_back({g_pattern_spec_new(name), negated});
+            }
+            else {
+                CStrPtr case_fold{g_utf8_casefold(name, -1)};
+                base_name_rules_.push_back({g_pattern_spec_new(case_fold.get()), negated});  // FIXME: is this correct?
+            }
+        }
+    }
+    if (folders != nullptr) {
+        for (auto it = folders.get(); *it; ++it) {
+            const char* folder = *it;
+            bool negated = (folder[0] == '!');
+            if (negated) {
+                ++folder;
+            }
+            // trailing /* should always be implied.
+            if (g_str_has_suffix(folder, "/*")) {
+                folder_rules_.push_back({g_pattern_spec_new(folder), negated});
+            }
+            else {
+                auto pat_str = g_str_has_suffix(folder, "/") ? string(folder) + "*"  // be tolerant
+                                                             : string(folder) + "/*";
+                folder_rules_.push_back({g_pattern_spec_new(pat_str.c_str()), negated});
+            }
+        }
+    }
+}
+
+FileActionCondition::~FileActionCondition() {
+    for (auto& rule : base_name_rules_) {
+        g_pattern_spec_free(rule.pattern);
+    }
+    for (auto& rule : folder_rules_) {
+        g_pattern_spec_free(rule.pattern);
+    }
 }
 
-bool FileActionCondition::match_try_exec(const FileInfoList& files) {
+bool FileActionCondition::match_try_exec(const FileActionSelection& selection) {
+    const FileInfoList& files = selection.files();
     if (try_exec != nullptr) {
         // stdout.printf("    TryExec: %s\n", try_exec);
-        CStrPtr exec_path{g_find_program_in_path(FileActionObject::expand_str(try_exec.get(), files).c_str())};
-        if (!g_file_test(exec_path.get(), G_FILE_TEST_IS_EXECUTABLE)) {
+        auto program = FileActionObject::expand_str(try_exec.get(), files);
+        if (program.find('/') != string::npos) {  // not looked for in $PATH
+            return g_file_test(program.c_str(), G_FILE_TEST_IS_EXECUTABLE);
+        }
+        if (!program_in_path(program)) {
             return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_show_if_registered(const FileInfoList& files) {
+bool FileActionCondition::match_show_if_registered(const FileActionSelection& selection) {
+    const FileInfoList& files = selection.files();
     if (show_if_registered != nullptr) {
         // stdout.printf("    ShowIfRegistered: %s\n", show_if_registered);
         auto service = FileActionObject::expand_str(show_if_registered.get(), files);
-        // References:
-        // http://people.freedesktop.org/~david/eggdbus-20091014/eggdbus-interface-org.freedesktop.DBus.html#eggdbus-method-org.freedesktop.DBus.NameHasOwner
-        // glib source code: gio/tests/gdbus-names.c
-        auto con = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
-        auto result =
-            g_dbus_connection_call_sync(con, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
-                                        "NameHasOwner", g_variant_new("(s)", service.c_str()),
-                                        g_variant_type_new("(b)"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
-        bool name_has_owner;
-        g_variant_get(result, "(b)", &name_has_owner);
-        g_variant_unref(result);
-        // stdout.printf("check if service: %s is in use: %d\n", service, (int)name_has_owner);
-        if (!name_has_owner) {
+        if (!name_has_owner(service)) {
             return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_show_if_true(const FileInfoList& files) {
+bool FileActionCondition::match_show_if_true(const FileActionSelection& selection) {
+    const FileInfoList& files = selection.files();
     if (show_if_true != nullptr) {
         auto cmd = FileActionObject::expand_str(show_if_true.get(), files);
         int exit_status;
@@ -94,7 +309,8 @@ bool FileActionCondition::match_show_if_true(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_show_if_running(const FileInfoList& files) {
+bool FileActionCondition::match_show_if_running(const FileActionSelection& selection) {
+    const FileInfoList& files = selection.files();
     if (show_if_running != nullptr) {
         auto process_name = FileActionObject::expand_str(show_if_running.get(), files);
         CStrPtr pgrep{g_find_program_in_path("pgrep")};
@@ -120,7 +336,7 @@ bool FileActionCondition::match_show_if_running(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_mime_type(const FileInfoList& files, const char* type, bool negated) {
+bool FileActionCondition::match_mime_type(const FileActionSelection& selection, const char* type, bool negated) {
     // stdout.printf("match_mime_type: %s, neg: %d\n", type, (int)negated);
 
     if (strcmp(type, "all/all") == 0 || strcmp(type, "*") == 0) {
@@ -129,65 +345,38 @@ bool FileActionCondition::match_mime_type(const FileInfoList& files, const char*
     else if (strcmp(type, "all/allfiles") == 0) {
         // see if all fileinfos are files
         if (negated) {  // all fileinfos should not be files
-            for (auto& fi : files) {
-                if (!fi->isDir()) {  // at least 1 of the fileinfos is a file.
-                    return false;
-                }
-            }
+            return !selection.hasNonDirs();
         }
         else {  // all fileinfos should be files
-            for (auto& fi : files) {
-                if (fi->isDir()) {  // at least 1 of the fileinfos is a file.
-                    return false;
-                }
-            }
+            return !selection.hasDirs();
         }
     }
     else if (g_str_has_suffix(type, "/*")) {
         // check if all are subtypes of allowed_type
         string prefix{type};
         prefix.erase(prefix.length() - 1);  // remove the last char
-        if (negated) {                      // all files should not have the prefix
-            for (auto& fi : files) {
-                if (g_str_has_prefix(fi->mimeType()->name(), prefix.c_str())) {
-                    return false;
-                }
-            }
-        }
-        else {  // all files should have the prefix
-            for (auto& fi : files) {
-                if (!g_str_has_prefix(fi->mimeType()->name(), prefix.c_str())) {
-                    return false;
-                }
+        for (const char* mime_type : selection.mimeTypes()) {
+            // all files should have the prefix, or none if negated
+            if (g_str_has_prefix(mime_type, prefix.c_str()) == negated) {
+                return false;
             }
         }
     }
     else {
-        if (negated) {  // all files should not be of the type
-            for (auto& fi : files) {
-                if (strcmp(fi->mimeType()->name(), type) == 0) {
-                    // if(ContentType.is_a(type, fi.get_mime_type().get_type())) {
-                    return false;
-                }
-            }
-        }
-        else {  // all files should be of the type
-            for (auto& fi : files) {
-                // stdout.printf("get_type: %s, type: %s\n", fi.get_mime_type().get_type(), type);
-                if (strcmp(fi->mimeType()->name(), type) != 0) {
-                    // if(!ContentType.is_a(type, fi.get_mime_type().get_type())) {
-                    return false;
-                }
+        for (const char* mime_type : selection.mimeTypes()) {
+            // all files should be of the type, or none if negated
+            if ((strcmp(mime_type, type) == 0) == negated) {
+                // if(!ContentType.is_a(type, fi.get_mime_type().get_type())) {
+                return false;
             }
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_mime_types(const FileInfoList& files) {
+bool FileActionCondition::match_mime_types(const FileActionSelection& selection) {
     if (mime_types != nullptr) {
         bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
         // check if all of the mime_types are allowed
         for (auto mime_type = mime_types.get(); *mime_type; ++mime_type) {
             const char* allowed_type = *mime_type;
@@ -203,7 +392,7 @@ bool FileActionCondition::match_mime_types(const FileInfoList& files) {
             }
 
             if (negated) {  // negated mime_type rules are ANDed
-                bool type_is_allowed = match_mime_type(files, type, negated);
+                bool type_is_allowed = match_mime_type(selection, type, negated);
                 if (!type_is_allowed) {  // so any mismatch is not allowed
                     return false;
                 }
@@ -211,7 +400,7 @@ bool FileActionCondition::match_mime_types(const FileInfoList& files) {
             else {  // other mime_type rules are ORed
                 // matching any one of the mime_type is enough
                 if (!allowed) {  // if no rule is matched yet
-                    allowed = match_mime_type(files, type, false);
+                    allowed = match_mime_type(selection, type, false);
                 }
             }
         }
@@ -220,82 +409,26 @@ bool FileActionCondition::match_mime_types(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_base_name(const FileInfoList& files, const char* base_name, bool negated) const {
+bool FileActionCondition::match_base_name(const FileActionSelection& selection,
+                                          GPatternSpec* pattern,
+                                          bool negated) const {
     // see if all files has the base_name
-    // FIXME: this is inefficient, some optimization is needed later
-    GPatternSpec* pattern;
-    if (match_case) {
-        pattern = g_pattern_spec_new(base_name);
-    }
-    else {
-        CStrPtr case_fold{g_utf8_casefold(base_name, -1)};
-        pattern = g_pattern_spec_new(case_fold.get());  // FIXME: is this correct?
-    }
-    for (auto& fi : files) {
-        const char* name = fi->name().c_str();
-        if (match_case) {
-#if GLIB_CHECK_VERSION(2, 70, 0)
-            if (g_pattern_spec_match_string(pattern, name))
-#else
-            if (g_pattern_match_string(pattern, name))
-#endif
-            {
-                // at least 1 file has the base_name
-                if (negated) {
-                    return false;
-                }
-            }
-            else {
-                // at least 1 file does not has the scheme
-                if (!negated) {
-                    return false;
-                }
-            }
-        }
-        else {
-            CStrPtr case_fold{g_utf8_casefold(name, -1)};
-#if GLIB_CHECK_VERSION(2, 70, 0)
-            if (g_pattern_spec_match_string(pattern, case_fold.get()))
-#else
-            if (g_pattern_match_string(pattern, case_fold.get()))
-#endif
-            {
-                // at least 1 file has the base_name
-                if (negated) {
-                    return false;
-                }
-            }
-            else {
-                // at least 1 file does not has the scheme
-                if (!negated) {
-                    return false;
-                }
-            }
+    for (const auto& name : selection.names(!match_case)) {
+        // at least 1 file has the base_name, or at least 1 does not
+        if (pattern_matches(pattern, name) == negated) {
+            return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_base_names(const FileInfoList& files) {
+bool FileActionCondition::match_base_names(const FileActionSelection& selection) {
     if (base_names != nullptr) {
         bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
         // check if all of the base_names are allowed
-        for (auto it = base_names.get(); *it; ++it) {
-            auto allowed_name = *it;
-            const char* name;
-            bool negated;
-            if (allowed_name[0] == '!') {
-                name = allowed_name + 1;
-                negated = true;
-            }
-            else {
-                name = allowed_name;
-                negated = false;
-            }
-
-            if (negated) {  // negated base_name rules are ANDed
-                bool name_is_allowed = match_base_name(files, name, negated);
+        for (const auto& rule : base_name_rules_) {
+            if (rule.negated) {  // negated base_name rules are ANDed
+                bool name_is_allowed = match_base_name(selection, rule.pattern, true);
                 if (!name_is_allowed) {  // so any mismatch is not allowed
                     return false;
                 }
@@ -303,7 +436,7 @@ bool FileActionCondition::match_base_names(const FileInfoList& files) {
             else {  // other base_name rules are ORed
                 // matching any one of the base_name is enough
                 if (!allowed) {  // if no rule is matched yet
-                    allowed = match_base_name(files, name, false);
+                    allowed = match_base_name(selection, rule.pattern, false);
                 }
             }
         }
@@ -312,30 +445,20 @@ bool FileActionCondition::match_base_names(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_scheme(const FileInfoList& files, const char* scheme, bool negated) {
-    // FIXME: this is inefficient, some optimization is needed later
+bool FileActionCondition::match_scheme(const FileActionSelection& selection, const char* scheme, bool negated) {
     // see if all files has the scheme
-    for (auto& fi : files) {
-        if (fi->path().hasUriScheme(scheme)) {
-            // at least 1 file has the scheme
-            if (negated) {
-                return false;
-            }
-        }
-        else {
-            // at least 1 file does not has the scheme
-            if (!negated) {
-                return false;
-            }
+    for (const auto& file_scheme : selection.schemes()) {
+        // at least 1 file has the scheme, or at least 1 does not
+        if ((g_ascii_strcasecmp(file_scheme.c_str(), scheme) == 0) == negated) {
+            return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_schemes(const FileInfoList& files) {
+bool FileActionCondition::match_schemes(const FileActionSelection& selection) {
     if (schemes != nullptr) {
         bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
         // check if all of the schemes are allowed
         for (auto it = schemes.get(); *it; ++it) {
             auto allowed_scheme = *it;
@@ -351,7 +474,7 @@ bool FileActionCondition::match_schemes(const FileInfoList& files) {
             }
 
             if (negated) {  // negated scheme rules are ANDed
-                bool scheme_is_allowed = match_scheme(files, scheme, negated);
+                bool scheme_is_allowed = match_scheme(selection, scheme, negated);
                 if (!scheme_is_allowed) {  // so any mismatch is not allowed
                     return false;
                 }
@@ -359,7 +482,7 @@ bool FileActionCondition::match_schemes(const FileInfoList& files) {
             else {  // other scheme rules are ORed
                 // matching any one of the scheme is enough
                 if (!allowed) {  // if no rule is matched yet
-                    allowed = match_scheme(files, scheme, false);
+                    allowed = match_scheme(selection, scheme, false);
                 }
             }
         }
@@ -368,63 +491,23 @@ bool FileActionCondition::match_schemes(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_folder(const FileInfoList& files, const char* folder, bool negated) {
-    // trailing /* should always be implied.
-    // FIXME: this is inefficient, some optimization is needed later
-    GPatternSpec* pattern;
-    if (g_str_has_suffix(folder, "/*")) {
-        pattern = g_pattern_spec_new(folder);
-    }
-    else {
-        auto pat_str = g_str_has_suffix(folder, "/") ? string(folder) + "*"  // be tolerant
-                                                     : string(folder) + "/*";
-        pattern = g_pattern_spec_new(pat_str.c_str());
-    }
-    for (auto& fi : files) {
-        auto dirname = fi->isDir() ? fi->path().toString()  // also match "folder" itself
-                                   : fi->dirPath().toString();
-        // Since the pattern ends with "/*", if the directory path is equal to "folder",
-        // it should end with "/" to be found as a match. Adding "/" is always harmless.
-        auto path_str = string(dirname.get()) + "/";
-#if GLIB_CHECK_VERSION(2, 70, 0)
-        if (g_pattern_spec_match_string(pattern, path_str.c_str()))
-#else
-        if (g_pattern_match_string(pattern, path_str.c_str()))
-#endif
-        {  // at least 1 file is in the folder
-            if (negated) {
-                return false;
-            }
-        }
-        else {
-            if (!negated) {
-                return false;
-            }
+bool FileActionCondition::match_folder(const FileActionSelection& selection, GPatternSpec* pattern, bool negated) {
+    for (const auto& path_str : selection.folders()) {
+        // at least 1 file is in the folder, or at least 1 is not
+        if (pattern_matches(pattern, path_str) == negated) {
+            return false;
         }
     }
     return true;
 }
 
-bool FileActionCondition::match_folders(const FileInfoList& files) {
+bool FileActionCondition::match_folders(const FileActionSelection& selection) {
     if (folders != nullptr) {
         bool allowed = false;
-        // FIXME: this is inefficient, but easier to implement
-        // check if all of the schemes are allowed
-        for (auto it = folders.get(); *it; ++it) {
-            auto allowed_folder = *it;
-            const char* folder;
-            bool negated;
-            if (allowed_folder[0] == '!') {
-                folder = allowed_folder + 1;
-                negated = true;
-            }
-            else {
-                folder = allowed_folder;
-                negated = false;
-            }
-
-            if (negated) {  // negated folder rules are ANDed
-                bool folder_is_allowed = match_folder(files, folder, negated);
+        // check if all of the folders are allowed
+        for (const auto& rule : folder_rules_) {
+            if (rule.negated) {  // negated folder rules are ANDed
+                bool folder_is_allowed = match_folder(selection, rule.pattern, true);
                 if (!folder_is_allowed) {  // so any mismatch is not allowed
                     return false;
                 }
@@ -432,7 +515,7 @@ bool FileActionCondition::match_folders(const FileInfoList& files) {
             else {  // other folder rules are ORed
                 // matching any one of the folder is enough
                 if (!allowed) {  // if no rule is matched yet
-                    allowed = match_folder(files, folder, false);
+                    allowed = match_folder(selection, rule.pattern, false);
                 }
             }
         }
@@ -441,8 +524,8 @@ bool FileActionCondition::match_folders(const FileInfoList& files) {
     return true;
 }
 
-bool FileActionCondition::match_selection_count(const FileInfoList& files) const {
-    const int n_files = files.size();
+bool FileActionCondition::match_selection_count(const FileActionSelection& selection) const {
+    const int n_files = selection.files().size();
     switch (selection_count_cmp) {
         case '<':
             if (n_files >= selection_count) {
@@ -463,49 +546,50 @@ bool FileActionCondition::match_selection_count(const FileInfoList& files) const
     return true;
 }
 
-bool FileActionCondition::match_capabilities(const FileInfoList& /*files*/) {
+bool FileActionCondition::match_capabilities(const FileActionSelection& /*selection*/) {
     // TODO
     return true;
 }
 
-bool FileActionCondition::match(const FileInfoList& files) {
+bool FileActionCondition::match(const FileActionSelection& selection) {
     // all of the condition are combined with AND
     // So, if any one of the conditions is not matched, we quit.
+    // The ones that only look at the selection go first, before those that look for programs
+    // or run them.
 
     // TODO: OnlyShowIn, NotShowIn
-    if (!match_try_exec(files)) {
+    if (!match_selection_count(selection)) {
         return false;
     }
-
-    if (!match_mime_types(files)) {
-        return false;
-    }
-    if (!match_base_names(files)) {
+    if (!match_mime_types(selection)) {
         return false;
     }
-    if (!match_selection_count(files)) {
+    if (!match_schemes(selection)) {
         return false;
     }
-    if (!match_schemes(files)) {
+    if (!match_folders(selection)) {
         return false;
     }
-    if (!match_folders(files)) {
+    if (!match_base_names(selection)) {
         return false;
     }
     // TODO: Capabilities
     // currently, due to limitations of Fm.FileInfo, this cannot
     // be implemanted correctly.
-    if (!match_capabilities(files)) {
+    if (!match_capabilities(selection)) {
         return false;
     }
 
-    if (!match_show_if_registered(files)) {
+    if (!match_try_exec(selection)) {
+        return false;
+    }
+    if (!match_show_if_registered(selection)) {
         return false;
     }
-    if (!match_show_if_true(files)) {
+    if (!match_show_if_true(selection)) {
         return false;
     }
-    if (!match_show_if_running(files)) {
+    if (!match_show_if_running(selection)) {
         return false;
     }
 
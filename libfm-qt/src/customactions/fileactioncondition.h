@@ -2,11 +2,53 @@
 #define FILEACTIONCONDITION_H
 
 #include <glib.h>
+#include <string>
+#include <vector>
 #include "../core/gioptrs.h"
 #include "../core/fileinfo.h"
 
 namespace Fm {
 
+// The selected files as the conditions of the actions see them. It is gathered once for all the
+// actions, and reduced to the distinct values where the files share them, so that a condition
+// is checked once per mime type or folder instead of once per file.
+class FileActionSelection {
+   public:
+    explicit FileActionSelection(const FileInfoList& files);
+
+    const FileInfoList& files() const { return files_; }
+
+    // the distinct mime types of the files
+    const std::vector<const char*>& mimeTypes() const { return mimeTypes_; }
+
+    bool hasDirs() const { return hasDirs_; }
+
+    bool hasNonDirs() const { return hasNonDirs_; }
+
+    // the distinct URI schemes of the files
+    const std::vector<std::string>& schemes() const { return schemes_; }
+
+    // the distinct folders the files are in, or are if they are folders, each ending with "/"
+    const std::vector<std::string>& folders() const;
+
+    // the names of the files, case-folded if |folded|
+    const std::vector<std::string>& names(bool folded) const;
+
+   private:
+    const FileInfoList& files_;
+    std::vector<const char*> mimeTypes_;
+    bool hasDirs_;
+    bool hasNonDirs_;
+    std::vector<std::string> schemes_;
+    // gathered when a condition first asks for them
+    mutable std::vector<std::string> folders_;
+    mutable std::vector<std::string> names_;
+    mutable std::vector<std::string> foldedNames_;
+    mutable bool foldersGathered_;
+    mutable bool namesGathered_;
+    mutable bool foldedNamesGathered_;
+};
+
 // FIXME: we can use getgroups() to get groups of current process
 // then, call stat() and stat.st_gid to handle capabilities
 // in this way, we don't have to call euidaccess
@@ -23,6 +65,8 @@ class FileActionCondition {
    public:
     explicit FileActionCondition(GKeyFile* kf, const char* group);
 
+    ~FileActionCondition();
+
 #if 0
     bool match_base_name_(const FileInfoList& files, const char* allowed_base_name) {
         // all files should match the base_name pattern.
@@ -71,35 +115,35 @@ class FileActionCondition {
     }
 #endif
 
-    bool match_try_exec(const FileInfoList& files);
+    bool match_try_exec(const FileActionSelection& selection);
 
-    bool match_show_if_registered(const FileInfoList& files);
+    bool match_show_if_registered(const FileActionSelection& selection);
 
-    bool match_show_if_true(const FileInfoList& files);
+    bool match_show_if_true(const FileActionSelection& selection);
 
-    bool match_show_if_running(const FileInfoList& files);
+    bool match_show_if_running(const FileActionSelection& selection);
 
-    static bool match_mime_type(const FileInfoList& files, const char* type, bool negated);
+    static bool match_mime_type(const FileActionSelection& selection, const char* type, bool negated);
 
-    bool match_mime_types(const FileInfoList& files);
+    bool match_mime_types(const FileActionSelection& selection);
 
-    bool match_base_name(const FileInfoList& files, const char* base_name, bool negated) const;
+    bool match_base_name(const FileActionSelection& selection, GPatternSpec* pattern, bool negated) const;
 
-    bool match_base_names(const FileInfoList& files);
+    bool match_base_names(const FileActionSelection& selection);
 
-    static bool match_scheme(const FileInfoList& files, const char* scheme, bool negated);
+    static bool match_scheme(const FileActionSelection& selection, const char* scheme, bool negated);
 
-    bool match_schemes(const FileInfoList& files);
+    bool match_schemes(const FileActionSelection& selection);
 
-    static bool match_folder(const FileInfoList& files, const char* folder, bool negated);
+    static bool match_folder(const FileActionSelection& selection, GPatternSpec* pattern, bool negated);
 
-    bool match_folders(const FileInfoList& files);
+    bool match_folders(const FileActionSelection& selection);
 
-    bool match_selection_count(const FileInfoList& files) const;
+    bool match_selection_count(const FileActionSelection& selection) const;
 
-    bool match_capabilities(const FileInfoList& files);
+    bool match_capabilities(const FileActionSelection& selection);
 
-    bool match(const FileInfoList& files);
+    bool match(const FileActionSelection& selection);
 
     CStrArrayPtr only_show_in;
     CStrArrayPtr not_show_in;
@@ -115,6 +159,19 @@ class FileActionCondition {
     CStrArrayPtr schemes;
     CStrArrayPtr folders;
     FileActionCapability capabilities;
+
+   private:
+    FileActionCondition(const FileActionCondition& other) = delete;
+    FileActionCondition& operator=(const FileActionCondition& other) = delete;
+
+    // a base name or folder pattern, compiled when the action is loaded
+    struct PatternRule {
+        GPatternSpec* pattern;
+        bool negated;
+    };
+
+    std::vector<PatternRule> base_name_rules_;
+    std::vector<PatternRule> folder_rules_;
 };
 
 }  // namespace Fm
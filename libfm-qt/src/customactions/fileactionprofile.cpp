@@ -117,9 +117,9 @@ bool FileActionProfile::launch(GAppLaunchContext* ctx, const FileInfoList& files
     return ret;
 }
 
-bool FileActionProfile::match(FileInfoList files) {
+bool FileActionProfile::match(const FileActionSelection& selection) {
     // stdout.printf("  match profile: %s\n", id);
-    return condition->match(files);
+    return condition->match(selection);
 }
 
 }  // namespace Fm
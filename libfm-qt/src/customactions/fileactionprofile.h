@@ -23,7 +23,7 @@ class FileActionProfile {
 
     bool launch(GAppLaunchContext* ctx, const FileInfoList& files, CStrPtr& output);
 
-    bool match(FileInfoList files);
+    bool match(const FileActionSelection& selection);
 
     std::string id;
     CStrPtr name;
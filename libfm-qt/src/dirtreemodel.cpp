@@ -21,8 +21,10 @@
 #include "dirtreemodelitem.h"
 #include "fileoperation.h"
 #include "utilities.h"
+#include "filelistmimedata.h"
 #include <QDebug>
 #include "core/fileinfojob.h"
+#include "core/jobscheduler.h"
 
 namespace Fm {
 
@@ -31,10 +33,10 @@ DirTreeModel::DirTreeModel(QObject* parent) : QAbstractItemModel(parent), showHi
 DirTreeModel::~DirTreeModel() {}
 
 void DirTreeModel::addRoots(Fm::FilePathList rootPaths) {
-    auto job = new Fm::FileInfoJob{std::move(rootPaths)};
+    auto job = new Fm::FileInfoJob{std::move(rootPaths), Fm::FileInfoProfile::Basic};
     job->setAutoDelete(true);
     connect(job, &Fm::FileInfoJob::finished, this, &DirTreeModel::onFileInfoJobFinished, Qt::BlockingQueuedConnection);
-    job->runAsync();
+    JobScheduler::globalInstance()->start(job, JobScheduler::Priority::Interactive);
 }
 
 void DirTreeModel::onFileInfoJobFinished() {
@@ -89,7 +91,7 @@ bool DirTreeModel::dropMimeData(const QMimeData* data,
                                 const QModelIndex& parent) {
     if (auto destPath = filePath(parent)) {
         if (data->hasUrls()) {  // files uris are dropped
-            auto paths = pathListFromQUrls(data->urls());
+            auto paths = pathListFromMimeData(data);
             if (!paths.empty()) {
                 switch (action) {
                     case Qt::CopyAction:
@@ -171,7 +173,7 @@ QModelIndex DirTreeModel::index(int row, int column, const QModelIndex& parent)
 
 bool DirTreeModel::hasChildren(const QModelIndex& parent) const {
     DirTreeModelItem* item = itemFromIndex(parent);
-    return item ? !item->isPlaceHolder() : true;
+    return item ? !item->isPlaceHolder() && item->mayHaveSubdirs() : true;
 }
 
 QModelIndex DirTreeModel::indexFromItem(DirTreeModelItem* item) const {
@@ -20,6 +20,10 @@
 #include "dirtreemodelitem.h"
 #include "dirtreemodel.h"
 #include <QDebug>
+#include <QTimer>
+#include <unordered_set>
+#include "core/fileinfojob.h"
+#include "core/jobscheduler.h"
 
 namespace Fm {
 
@@ -31,7 +35,8 @@ DirTreeModelItem::DirTreeModelItem()
       parent_(nullptr),
       placeHolderChild_(nullptr),
       model_(nullptr),
-      queuedForDeletion_(false) {}
+      queuedForDeletion_(false),
+      dirListJob_(nullptr) {}
 
 DirTreeModelItem::DirTreeModelItem(std::shared_ptr<const Fm::FileInfo> info,
                                    DirTreeModel* model,
@@ -42,7 +47,8 @@ DirTreeModelItem::DirTreeModelItem(std::shared_ptr<const Fm::FileInfo> info,
       parent_(parent),
       placeHolderChild_(nullptr),
       model_(model),
-      queuedForDeletion_(false) {
+      queuedForDeletion_(false),
+      dirListJob_(nullptr) {
     if (fileInfo_) {
         displayName_ = fileInfo_->displayName();
         icon_ = fileInfo_->icon()->qicon();
@@ -75,6 +81,34 @@ void DirTreeModelItem::freeFolder() {
         QObject::disconnect(onFolderFilesChangedConn_);
         folder_.reset();
     }
+    if (dirListJob_) {
+        dirListJob_->cancel();
+        dirListJob_ = nullptr;
+    }
+    jobContext_.reset();
+    dirWatch_.reset();
+    changedPaths_.clear();
+}
+
+void DirTreeModelItem::setFileInfo(std::shared_ptr<const Fm::FileInfo> info) {
+    fileInfo_ = std::move(info);
+    displayName_ = fileInfo_->displayName();
+    icon_ = fileInfo_->icon()->qicon();
+    QModelIndex idx = index();
+    if (idx.isValid()) {  // hidden items have no row
+        Q_EMIT model_->dataChanged(idx, idx);
+    }
+}
+
+bool DirTreeModelItem::mayHaveSubdirs() const {
+    if (expanded_ || !fileInfo_ || !parent_ || !parent_->fileInfo_ || !fileInfo_->isNative() ||
+        fileInfo_->isSymlink()) {
+        return true;
+    }
+    // A directory is linked from its parent, from its own "." and from the ".." of each of its
+    // subdirectories. Filesystems that do not count these give 1, or else some constant, which
+    // the parent, having this subdirectory, would then give as well.
+    return fileInfo_->linkCount() != 2 || parent_->fileInfo_->linkCount() <= 2;
 }
 
 void DirTreeModelItem::addPlaceHolderChild() {
@@ -87,6 +121,9 @@ void DirTreeModelItem::addPlaceHolderChild() {
 
 void DirTreeModelItem::loadFolder() {
     if (!expanded_) {
+        if (loadSubdirs()) {
+            return;
+        }
         /* dynamically load content of the folder. */
         folder_ = Fm::Folder::fromPath(fileInfo_->path());
         /* g_debug("fm_dir_tree_model_load_row()"); */
@@ -109,6 +146,192 @@ void DirTreeModelItem::loadFolder() {
             insertFiles(folder_->files());
             onFolderFinishLoading();
         }
+        else if (folder_->isIncremental()) {  // partly loaded
+            insertFiles(folder_->files());
+        }
+    }
+}
+
+bool DirTreeModelItem::loadSubdirs() {
+    if (!fileInfo_->isNative()) {
+        return false;
+    }
+    dirWatch_ = FileMonitor::globalInstance()->watchDirectory(
+        fileInfo_->path(), [this](const Fm::FilePath& path, GFileMonitorEvent event) { onDirChanged(path, event); });
+    if (!dirWatch_) {
+        return false;
+    }
+    /* set 'expanded' flag beforehand as callback may check it */
+    expanded_ = true;
+    listSubdirs(false);
+    return true;
+}
+
+bool DirTreeModelItem::loadListedSubdirs(Fm::FileInfoList dirs, bool stale) {
+    if (expanded_ || !fileInfo_->isNative()) {
+        return false;
+    }
+    dirWatch_ = FileMonitor::globalInstance()->watchDirectory(
+        fileInfo_->path(), [this](const Fm::FilePath& path, GFileMonitorEvent event) { onDirChanged(path, event); });
+    if (!dirWatch_) {
+        return false;
+    }
+    expanded_ = true;
+    jobContext_.reset(new QObject);
+    changedPaths_.clear();
+    insertFiles(std::move(dirs));
+    onFolderFinishLoading();
+    if (stale) {  // compared with a new listing at its end
+        listSubdirs(true);
+    }
+    return true;
+}
+
+void DirTreeModelItem::listSubdirs(bool resync) {
+    if (dirListJob_) {
+        dirListJob_->cancel();
+    }
+    // a new context drops whatever earlier jobs have yet to report
+    jobContext_.reset(new QObject);
+    changedPaths_.clear();
+
+    auto job = new DirListJob(fileInfo_->path(), DirListJob::DIR_ONLY);
+    // the tree only shows names and icons; FilePropsDialog queries the rest when asked
+    job->setProfile(FileInfoProfile::Basic);
+    job->setAutoDelete(true);
+    // a first listing fills the rows as it goes; a later one is compared with them at the end
+    job->setIncremental(!resync);
+    if (!resync) {
+        QObject::connect(
+            job, &DirListJob::filesFound, jobContext_.get(),
+            [this](const Fm::FileInfoList& dirs) { insertFiles(dirs); }, Qt::BlockingQueuedConnection);
+    }
+    QObject::connect(
+        job, &DirListJob::finished, jobContext_.get(),
+        [this, job, resync]() {
+            dirListJob_ = nullptr;
+            if (job->isCancelled()) {
+                return;
+            }
+            if (resync) {
+                onSubdirsListed(job->files());
+            }
+            else {
+                onFolderFinishLoading();
+            }
+        },
+        Qt::BlockingQueuedConnection);
+    dirListJob_ = job;
+    JobScheduler::globalInstance()->start(job, JobScheduler::Priority::Interactive, fileInfo_->path());
+}
+
+void DirTreeModelItem::onSubdirsListed(const Fm::FileInfoList& dirs) {
+    std::unordered_set<std::string> names;
+    for (const auto& dir : dirs) {
+        names.insert(dir->name());
+    }
+    std::vector<std::string> gone;
+    auto findGone = [&](const std::vector<DirTreeModelItem*>& items) {
+        for (const auto item : items) {
+            if (item->fileInfo_ && names.count(item->fileInfo_->name()) == 0) {
+                gone.push_back(item->fileInfo_->name());
+            }
+        }
+    };
+    findGone(children_);
+    findGone(hiddenChildren_);
+    for (const auto& name : gone) {
+        removeChild(name.c_str());
+    }
+    onChangedFilesQueried(dirs);
+}
+
+void DirTreeModelItem::onDirChanged(const Fm::FilePath& path, GFileMonitorEvent event) {
+    if (!path.isValid()) {  // events were lost
+        listSubdirs(true);
+        return;
+    }
+    if (path == fileInfo_->path()) {  // the folder itself, which its parent takes care of
+        return;
+    }
+    switch (event) {
+        case G_FILE_MONITOR_EVENT_DELETED:
+            removeChild(path.baseName().get());
+            break;
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+            // whether it is a directory is only known once it is queried
+            changedPaths_.push_back(path);
+            if (changedPaths_.size() == 1) {
+                QTimer::singleShot(0, jobContext_.get(), [this]() { queryChangedFiles(); });
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void DirTreeModelItem::queryChangedFiles() {
+    auto job = new FileInfoJob{std::move(changedPaths_), FileInfoProfile::Basic};
+    changedPaths_.clear();
+    job->setAutoDelete(true);
+    QObject::connect(
+        job, &FileInfoJob::finished, jobContext_.get(), [this, job]() { onChangedFilesQueried(job->files()); },
+        Qt::BlockingQueuedConnection);
+    JobScheduler::globalInstance()->start(job, JobScheduler::Priority::Interactive, fileInfo_->path());
+}
+
+void DirTreeModelItem::onChangedFilesQueried(const Fm::FileInfoList& files) {
+    Fm::FileInfoList added;
+    for (const auto& file : files) {
+        const char* name = file->name().c_str();
+        DirTreeModelItem* child = childFromName(name, nullptr);
+        if (!child) {
+            auto it = std::find_if(hiddenChildren_.cbegin(), hiddenChildren_.cend(),
+                                   [&](const DirTreeModelItem* item) { return item->fileInfo_->name() == name; });
+            child = it != hiddenChildren_.cend() ? *it : nullptr;
+        }
+        if (!file->isDir()) {
+            if (child) {  // replaced by a file
+                removeChild(name);
+            }
+        }
+        else if (child) {
+            child->setFileInfo(file);
+        }
+        else {
+            added.push_back(file);
+        }
+    }
+    if (!added.empty()) {
+        insertFiles(std::move(added));
+    }
+}
+
+void DirTreeModelItem::removeChild(const char* name) {
+    int pos;
+    if (DirTreeModelItem* child = childFromName(name, &pos)) {
+        // The item shouldn't be deleted now but after its row is removed from QTreeView;
+        // otherwise a freeze will happen when it has a child item (its row is expanded).
+        child->queuedForDeletion_ = true;
+        model_->beginRemoveRows(index(), pos, pos);
+        children_.erase(children_.cbegin() + pos);
+        model_->endRemoveRows();
+    }
+    else {
+        auto it = std::find_if(hiddenChildren_.cbegin(), hiddenChildren_.cend(),
+                               [&](const DirTreeModelItem* item) { return item->fileInfo_->name() == name; });
+        if (it != hiddenChildren_.cend()) {  // not in the view
+            delete *it;
+            hiddenChildren_.erase(it);
+        }
+    }
+
+    if (children_.empty()) {  // no visible children, add a placeholder item to keep the row expanded
+        model_->beginInsertRows(index(), 0, 0);
+        addPlaceHolderChild();
+        placeHolderChild_->displayName_ = DirTreeModel::tr("<No sub folders>");
+        model_->endInsertRows();
     }
 }
 
@@ -288,36 +511,19 @@ void DirTreeModelItem::onFolderFilesAdded(Fm::FileInfoList& files) {
 }
 
 void DirTreeModelItem::onFolderFilesRemoved(Fm::FileInfoList& files) {
-    DirTreeModel* model = model_;
-
     for (auto& fi : files) {
-        int pos;
-        DirTreeModelItem* child = childFromName(fi->name().c_str(), &pos);
-        if (child) {
-            // The item shouldn't be deleted now but after its row is removed from QTreeView;
-            // otherwise a freeze will happen when it has a child item (its row is expanded).
-            child->queuedForDeletion_ = true;
-            model->beginRemoveRows(index(), pos, pos);
-            children_.erase(children_.cbegin() + pos);
-            model->endRemoveRows();
-        }
-    }
-
-    if (children_.empty()) {  // no visible children, add a placeholder item to keep the row expanded
-        addPlaceHolderChild();
-        placeHolderChild_->displayName_ = DirTreeModel::tr("<No sub folders>");
+        removeChild(fi->name().c_str());
     }
 }
 
 void DirTreeModelItem::onFolderFilesChanged(std::vector<Fm::FileInfoPair>& changes) {
-    DirTreeModel* model = model_;
     for (auto& changePair : changes) {
         int pos;
         auto& changedFile = changePair.first;
         DirTreeModelItem* child = childFromName(changedFile->name().c_str(), &pos);
-        if (child) {
-            QModelIndex childIndex = child->index();
-            Q_EMIT model->dataChanged(childIndex, childIndex);
+        if (child && changePair.second->isDir()) {
+            // the new info may also tell whether it has subfolders now
+            child->setFileInfo(changePair.second);
         }
     }
 }
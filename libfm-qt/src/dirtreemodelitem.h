@@ -21,11 +21,14 @@
 #define FM_DIRTREEMODELITEM_H
 
 #include "libfmqtglobals.h"
+#include <memory>
 #include <vector>
 #include <QIcon>
 #include <QModelIndex>
 
+#include "core/dirlistjob.h"
 #include "core/fileinfo.h"
+#include "core/filemonitor.h"
 #include "core/folder.h"
 
 namespace Fm {
@@ -53,8 +56,13 @@ class LIBFM_QT_API DirTreeModelItem {
 
     bool isQueuedForDeletion() const { return queuedForDeletion_; }
 
+    // Whether the folder may have subfolders. Local filesystems that count the subdirectories
+    // of a directory in its link count tell it without the folder being listed.
+    bool mayHaveSubdirs() const;
+
    private:
     void freeFolder();
+    void setFileInfo(std::shared_ptr<const Fm::FileInfo> info);
     void addPlaceHolderChild();
     DirTreeModelItem* childFromName(const char* utf8_name, int* pos);
     DirTreeModelItem* childFromPath(Fm::FilePath path, bool recursive) const;
@@ -69,6 +77,19 @@ class LIBFM_QT_API DirTreeModelItem {
     void onFolderFilesRemoved(Fm::FileInfoList& files);
     void onFolderFilesChanged(std::vector<Fm::FileInfoPair>& changes);
 
+    // Local folders are not loaded as a Folder, which lists and watches every file, but only
+    // their subdirectories are listed and the folder is watched with FileMonitor.
+    bool loadSubdirs();
+    // Like loadSubdirs() with the subdirectories listed already, as DirTreeView does ahead for
+    // the folders it is about to expand. |stale| when the folder changed since it was listed.
+    bool loadListedSubdirs(Fm::FileInfoList dirs, bool stale);
+    void listSubdirs(bool resync);
+    void onSubdirsListed(const Fm::FileInfoList& dirs);  // after events were lost
+    void onDirChanged(const Fm::FilePath& path, GFileMonitorEvent event);
+    void queryChangedFiles();
+    void onChangedFilesQueried(const Fm::FileInfoList& files);
+    void removeChild(const char* name);
+
    private:
     std::shared_ptr<const Fm::FileInfo> fileInfo_;
     std::shared_ptr<Fm::Folder> folder_;
@@ -87,6 +108,11 @@ class LIBFM_QT_API DirTreeModelItem {
     QMetaObject::Connection onFolderFilesAddedConn_;
     QMetaObject::Connection onFolderFilesRemovedConn_;
     QMetaObject::Connection onFolderFilesChangedConn_;
+    // without a Folder
+    std::unique_ptr<QObject> jobContext_;  // receives what the jobs below report, and drops it once deleted
+    Fm::DirListJob* dirListJob_;
+    std::unique_ptr<Fm::FileMonitor::Watch> dirWatch_;
+    Fm::FilePathList changedPaths_;  // to be queried again
 };
 
 }  // namespace Fm
@@ -31,9 +31,21 @@
 #include "fileoperation.h"
 #include "dndactionmenu.h"
 #include "utilities.h"
+#include "filelistmimedata.h"
+#include "core/dirlistjob.h"
+#include "core/filemonitor.h"
+#include "core/folder.h"
+#include "core/jobscheduler.h"
 
 namespace Fm {
 
+struct DirTreeView::PrefetchedDir {
+    Fm::DirListJob* job = nullptr;  // null once the folder is listed
+    Fm::FileInfoList dirs;
+    std::unique_ptr<Fm::FileMonitor::Watch> watch;  // notes changes until the item watches the folder
+    bool changed = false;
+};
+
 DirTreeView::DirTreeView(QWidget* parent) : QTreeView(parent), currentExpandingItem_(nullptr) {
     setSelectionMode(QAbstractItemView::SingleSelection);
     setHeaderHidden(true);
@@ -49,9 +61,12 @@ DirTreeView::DirTreeView(QWidget* parent) : QTreeView(parent), currentExpandingI
     setAcceptDrops(true);
 }
 
-DirTreeView::~DirTreeView() {}
+DirTreeView::~DirTreeView() {
+    cancelPrefetch();
+}
 
 void DirTreeView::cancelPendingChdir() {
+    cancelPrefetch();
     if (!pathsToExpand_.empty()) {
         pathsToExpand_.clear();
         if (!currentExpandingItem_) {
@@ -80,8 +95,7 @@ void DirTreeView::expandPendingPath() {
             onRowLoaded(item->index());
         }
         else {
-            // _model->loadRow(item->index());
-            item->loadFolder();
+            loadPendingItem(item);
         }
     }
     else {
@@ -116,6 +130,7 @@ void DirTreeView::onRowLoaded(const QModelIndex& index) {
         // qDebug() << "Done!";
         selectionModel()->select(index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Clear);
         scrollTo(index, QAbstractItemView::EnsureVisible);
+        cancelPrefetch();  // the folders that were not reached, as hidden ones
     }
     else { /* continue expanding next pending path */
         expandPendingPath();
@@ -164,10 +179,89 @@ void DirTreeView::setCurrentPath(Fm::FilePath path) {
             path = path.parent();
         } while (path);
 
+        prefetchPendingPaths();
         expandPendingPath();
     }
 }
 
+void DirTreeView::prefetchPendingPaths() {
+    DirTreeModel* _model = static_cast<DirTreeModel*>(model());
+    prefetchContext_.reset(new QObject);
+    for (const auto& path : pathsToExpand_) {
+        DirTreeModelItem* item = _model->itemFromPath(path);
+        if (item && item->expanded_) {  // listed or being listed
+            continue;
+        }
+        if (path.isNative()) {  // only the subfolders are listed, as DirTreeModelItem::loadSubdirs() does
+            auto dir = std::make_unique<PrefetchedDir>();
+            PrefetchedDir* prefetched = dir.get();
+            dir->watch = FileMonitor::globalInstance()->watchDirectory(
+                path, [prefetched](const Fm::FilePath& /*path*/, GFileMonitorEvent /*event*/) {
+                    prefetched->changed = true;
+                });
+            if (dir->watch) {
+                auto job = new DirListJob(path, DirListJob::DIR_ONLY);
+                job->setAutoDelete(true);
+                connect(
+                    job, &DirListJob::finished, prefetchContext_.get(),
+                    [this, path, job]() { onPrefetchListed(path, job); }, Qt::BlockingQueuedConnection);
+                dir->job = job;
+                prefetched_[path] = std::move(dir);
+                JobScheduler::globalInstance()->start(job, JobScheduler::Priority::Interactive, path);
+                continue;
+            }
+        }
+        // the item gets the same folder from the folder cache when it is expanded
+        prefetchedFolders_.push_back(Folder::fromPath(path));
+    }
+}
+
+void DirTreeView::cancelPrefetch() {
+    for (auto& prefetched : prefetched_) {
+        if (prefetched.second->job) {
+            prefetched.second->job->cancel();
+        }
+    }
+    prefetchContext_.reset();
+    prefetched_.clear();
+    prefetchedFolders_.clear();
+}
+
+void DirTreeView::onPrefetchListed(const Fm::FilePath& path, Fm::DirListJob* job) {
+    auto it = prefetched_.find(path);
+    if (it == prefetched_.end() || it->second->job != job) {
+        return;
+    }
+    it->second->job = nullptr;
+    if (job->isCancelled()) {  // the folder is then listed by its item
+        prefetched_.erase(it);
+    }
+    else {
+        it->second->dirs = std::move(job->files());
+    }
+    DirTreeModelItem* item = currentExpandingItem_;
+    if (item && !item->expanded_ && item->fileInfo_->path() == path) {  // the expansion waits for it
+        loadPendingItem(item);
+    }
+}
+
+void DirTreeView::loadPendingItem(DirTreeModelItem* item) {
+    auto it = prefetched_.find(item->fileInfo_->path());
+    if (it == prefetched_.end()) {
+        item->loadFolder();
+        return;
+    }
+    if (it->second->job) {  // onPrefetchListed() loads it
+        return;
+    }
+    // the item watches the folder before the watch of the listing goes, so that no change is missed
+    std::unique_ptr<PrefetchedDir> dir = std::move(it->second);
+    prefetched_.erase(it);
+    if (!item->loadListedSubdirs(std::move(dir->dirs), dir->changed)) {
+        item->loadFolder();
+    }
+}
+
 void DirTreeView::setModel(QAbstractItemModel* model) {
     Q_ASSERT(model->inherits("Fm::DirTreeModel"));
 
@@ -347,7 +441,7 @@ void DirTreeView::dropEvent(QDropEvent* event) {
         }
         if (destPath) {
             if (event->mimeData()->hasUrls()) {  // files uris are dropped
-                auto srcPaths = pathListFromQUrls(event->mimeData()->urls());
+                auto srcPaths = pathListFromMimeData(event->mimeData());
                 if (!srcPaths.empty()) {
                     auto curPos = viewport()->mapToGlobal(event->position().toPoint());
                     QTimer::singleShot(0, this, [this, curPos, srcPaths, destPath] {
@@ -25,11 +25,17 @@
 
 #include "core/filepath.h"
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
 class QItemSelection;
 
 namespace Fm {
 
+class DirListJob;
 class FileMenu;
+class Folder;
 class DirTreeModelItem;
 
 class LIBFM_QT_API DirTreeView : public QTreeView {
@@ -56,6 +62,14 @@ class LIBFM_QT_API DirTreeView : public QTreeView {
     void cancelPendingChdir();
     void expandPendingPath();
 
+    // Lists the subfolders of all the folders on the path being expanded at once, instead of
+    // each one after its parent was listed and expanded.
+    void prefetchPendingPaths();
+    void cancelPrefetch();
+    void onPrefetchListed(const Fm::FilePath& path, Fm::DirListJob* job);
+    // Loads |item| with its subfolders listed ahead when they are, or waits for them.
+    void loadPendingItem(DirTreeModelItem* item);
+
    Q_SIGNALS:
     void chdirRequested(int type, const Fm::FilePath& path);
     void openFolderInNewWindowRequested(const Fm::FilePath& path);
@@ -82,6 +96,10 @@ class LIBFM_QT_API DirTreeView : public QTreeView {
     Fm::FilePath currentPath_;
     Fm::FilePathList pathsToExpand_;
     DirTreeModelItem* currentExpandingItem_;
+    struct PrefetchedDir;
+    std::unordered_map<Fm::FilePath, std::unique_ptr<PrefetchedDir>, Fm::FilePathHash> prefetched_;
+    std::vector<std::shared_ptr<Fm::Folder>> prefetchedFolders_;  // not watched locally, so listed as folders
+    std::unique_ptr<QObject> prefetchContext_;  // receives what the listings report, and drops it once deleted
     std::vector<DirTreeModelItem*> queuedForDeletion_;
 };
 
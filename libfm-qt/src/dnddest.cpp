@@ -20,6 +20,7 @@
 #include "dnddest.h"
 #include "fileoperation.h"
 #include "utilities.h"
+#include "filelistmimedata.h"
 
 namespace Fm {
 
@@ -37,7 +38,7 @@ bool DndDest::dropMimeData(const QMimeData* data, Qt::DropAction action) {
     // FIXME: should we put this in dropEvent handler of FolderView instead?
     if (data->hasUrls()) {
         qDebug("drop action: %d", action);
-        auto srcPaths = pathListFromQUrls(data->urls());
+        auto srcPaths = pathListFromMimeData(data);
         switch (action) {
             case Qt::CopyAction:
                 FileOperation::copyFiles(srcPaths, destPath_);
@@ -706,7 +706,8 @@ void FileDialog::accept() {
     ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
 
     auto pathList = pathListFromQUrls(selectedFiles_);
-    auto job = new FileInfoJob(pathList);
+    // only whether they exist and are folders
+    auto job = new FileInfoJob(pathList, FileInfoProfile::Basic);
     job->setAutoDelete(true);
     connect(job, &Job::finished, this, &FileDialog::onFileInfoJobFinished);
     job->runAsync();
@@ -1407,20 +1408,29 @@ bool FileDialog::FileDialogFilter::filterAcceptsRow(const ProxyFolderModel* /*mo
         }
     }
 
-    bool nameMatched = false;
-    auto& name = (!info->name().empty() ? QString::fromStdString(info->name()) : info->displayName());
-    for (const auto& pattern : patterns_) {
-        if (name.indexOf(pattern) == 0) {
-            nameMatched = true;
-            break;
+    if (matchAll_) {
+        return true;
+    }
+    // the common "*.ext" globs are compared with the bytes of the name, without a QString
+    std::string displayName;
+    const std::string* name = &info->name();
+    if (name->empty()) {
+        displayName = info->displayName().toStdString();
+        name = &displayName;
+    }
+    for (const auto& suffix : suffixes_) {
+        if (name->size() >= suffix.size() &&
+            std::equal(suffix.rbegin(), suffix.rend(), name->rbegin(), [](char a, char b) {
+                return a == (b >= 'A' && b <= 'Z' ? char(b - 'A' + 'a') : b);
+            })) {
+            return true;
         }
     }
-    return nameMatched;
+    return !otherGlobs_.pattern().isEmpty() && otherGlobs_.match(QString::fromStdString(*name)).hasMatch();
 }
 
 void FileDialog::FileDialogFilter::update() {
     // update filename patterns
-    patterns_.clear();
     QString nameFilter = dlg_->currentNameFilter_;
     // if the filter contains (...), get the part inside the last pair of parentheses
     // because "NAME (DESCRIPTION) (*.X *.Y)" is also possible
@@ -1433,12 +1443,30 @@ void FileDialog::FileDialogFilter::update() {
         }
         nameFilter = nameFilter.mid(left, right - left);
     }
-    // parse the "*.ext1 *.ext2 *.ext3 ..." list into QRegularExpression objects
+    // parse the "*.ext1 *.ext2 *.ext3 ..." list into suffixes and one QRegularExpression for the rest
+    matchAll_ = false;
+    suffixes_.clear();
+    QStringList otherGlobs;
+    auto isPlainSuffix = [](QStringView suffix) {
+        return std::all_of(suffix.begin(), suffix.end(), [](QChar c) {
+            return c.unicode() < 0x80 && c != QLatin1Char('*') && c != QLatin1Char('?') && c != QLatin1Char('[') &&
+                   c != QLatin1Char('\\');
+        });
+    };
     const auto globs = nameFilter.simplified().split(QLatin1Char(' '));
     for (const auto& glob : globs) {
-        patterns_.emplace_back(QRegularExpression(QRegularExpression::wildcardToRegularExpression(glob),
-                                                  QRegularExpression::CaseInsensitiveOption));
+        if (glob == QLatin1String("*")) {
+            matchAll_ = true;
+        }
+        else if (glob.startsWith(QLatin1String("*.")) && glob.size() > 2 && isPlainSuffix(QStringView{glob}.mid(1))) {
+            suffixes_.push_back(glob.mid(1).toLower().toStdString());
+        }
+        else {
+            otherGlobs << QRegularExpression::wildcardToRegularExpression(glob);
+        }
     }
+    otherGlobs_ = QRegularExpression(otherGlobs.join(QLatin1Char('|')), QRegularExpression::CaseInsensitiveOption);
+    otherGlobs_.optimize();
 }
 
 }  // namespace Fm
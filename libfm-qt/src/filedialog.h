@@ -6,6 +6,7 @@
 
 #include <QFileDialog>
 #include <QRegularExpression>
+#include <string>
 #include <vector>
 #include <memory>
 #include "folderview.h"
@@ -170,7 +171,10 @@ class LIBFM_QT_API FileDialog : public QDialog {
         void update();
 
         FileDialog* dlg_;
-        std::vector<QRegularExpression> patterns_;
+        // the globs of the current name filter, compiled once for every row to be matched with
+        bool matchAll_ = false;
+        std::vector<std::string> suffixes_;  // lower-case ".ext" of the ASCII "*.ext" globs
+        QRegularExpression otherGlobs_;      // the rest, as one expression
     };
 
     bool isLabelExplicitlySet(QFileDialog::DialogLabel label) const { return !explicitLabels_[label].isEmpty(); }
@@ -2,6 +2,9 @@
 
 #include "libfmqt.h"
 #include "filedialog.h"
+#include "cachedfoldermodel.h"
+#include "core/cacheregistry.h"
+#include "core/sharedlisting.h"
 
 #include <QCoreApplication>
 #include <QWindow>
@@ -10,12 +13,75 @@
 #include <QSettings>
 #include <QtGlobal>
 
+#include <algorithm>
+#include <deque>
 #include <memory>
 
 using namespace Qt::Literals::StringLiterals;
 
 namespace Fm {
 
+namespace {
+
+// The models of the folders the last dialogs were closed in are kept, so that the next dialog
+// of the process opening one of them shows it at once while it is revalidated. The folders of
+// the last dialogs of the session are listed in the background when a process makes its first.
+constexpr int kMaxWarmDirectories = 4;
+
+std::deque<CachedFolderModel*>& warmModels() {
+    static std::deque<CachedFolderModel*> models;  // the most recently used first
+    return models;
+}
+
+void releaseWarmModels() {
+    for (CachedFolderModel* model : warmModels()) {
+        model->unref();
+    }
+    warmModels().clear();
+}
+
+void keepWarm(const FilePath& path) {
+    auto& models = warmModels();
+    auto it = std::find_if(models.begin(), models.end(),
+                           [&path](CachedFolderModel* model) { return model->folder()->path() == path; });
+    if (it != models.end()) {
+        CachedFolderModel* model = *it;
+        models.erase(it);
+        models.push_front(model);
+        return;
+    }
+    if (CachedFolderModel* model = CachedFolderModel::modelFromPath(path)) {
+        static const bool registered = [] {
+            CacheRegistry::globalInstance()->add("file dialog folders", CacheRegistry::InactiveModels, nullptr,
+                                                 &releaseWarmModels);
+            qAddPostRoutine(&releaseWarmModels);
+            return true;
+        }();
+        Q_UNUSED(registered);
+        models.push_front(model);
+        if (models.size() > std::size_t(kMaxWarmDirectories)) {
+            models.back()->unref();
+            models.pop_back();
+        }
+    }
+}
+
+void preloadRecentDirectories() {
+    static bool preloaded = false;
+    if (preloaded) {
+        return;
+    }
+    preloaded = true;
+    QSettings settings(QSettings::UserScope, "lxqt"_L1, "filedialog"_L1);
+    const QStringList uris = settings.value("History/RecentDirectories"_L1).toStringList();
+    for (const QString& uri : uris) {
+        // at a low priority, so that the directory the dialog opens in comes first
+        CachedFolderModel::prefetch(FilePath::fromUri(uri.toUtf8().constData()));
+    }
+}
+
+}  // namespace
+
 inline static const QString viewModeToString(Fm::FolderView::ViewMode value);
 inline static Fm::FolderView::ViewMode viewModeFromString(const QString& str);
 
@@ -26,6 +92,8 @@ inline static const QString sortOrderToString(Qt::SortOrder order);
 inline static Qt::SortOrder sortOrderFromString(const QString str);
 
 FileDialogHelper::FileDialogHelper() {
+    // the folders the file manager has listed are taken from it, when it runs
+    SharedListingClient::setEnabled(true);
     // can only be used after libfm-qt initialization
     dlg_ = std::unique_ptr<Fm::FileDialog>(new Fm::FileDialog());
     connect(dlg_.get(), &Fm::FileDialog::accepted, [this]() {
@@ -42,6 +110,8 @@ FileDialogHelper::FileDialogHelper() {
     connect(dlg_.get(), &Fm::FileDialog::currentChanged, this, &FileDialogHelper::currentChanged);
     connect(dlg_.get(), &Fm::FileDialog::directoryEntered, this, &FileDialogHelper::directoryEntered);
     connect(dlg_.get(), &Fm::FileDialog::filterSelected, this, &FileDialogHelper::filterSelected);
+
+    preloadRecentDirectories();
 }
 
 FileDialogHelper::~FileDialogHelper() {}
@@ -421,6 +491,24 @@ void FileDialogHelper::saveSettings() {
     }
     settings.endGroup();
 
+    settings.beginGroup("History"_L1);
+    const QUrl directory = dlg_->directory();
+    if (directory.isValid()) {
+        const QString uri = QString::fromUtf8(directory.toEncoded());
+        const QStringList oldRecent = settings.value("RecentDirectories"_L1).toStringList();
+        QStringList recent = oldRecent;
+        recent.removeAll(uri);
+        recent.prepend(uri);
+        while (recent.size() > kMaxWarmDirectories) {
+            recent.removeLast();
+        }
+        if (recent != oldRecent) {
+            settings.setValue("RecentDirectories"_L1, recent);
+        }
+        keepWarm(FilePath::fromUri(directory.toEncoded().constData()));
+    }
+    settings.endGroup();
+
     settings.beginGroup("Places"_L1);
     QSet<QString> hiddenPlaces = dlg_->getHiddenPlaces();
     if (hiddenPlaces.isEmpty()) {  // don't save "@Invalid()"
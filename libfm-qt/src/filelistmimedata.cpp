@@ -0,0 +1,110 @@
+#include "filelistmimedata.h"
+#include "utilities.h"
+
+namespace Fm {
+
+namespace {
+
+const QString kGnomeFormat = QStringLiteral("x-special/gnome-copied-files");
+const QString kUriListFormat = QStringLiteral("text/uri-list");
+const QString kKdeCutFormat = QStringLiteral("application/x-kde-cutselection");
+// NOTE: The mimetype "text/uri-list" changes the list in QMimeData::setData() to get URLs
+// but some protocols (like MTP) may need the original list to query file info.
+const QString kLibfmFormat = QStringLiteral("libfm/files");
+// offered by QAbstractItemModel::mimeData(); FolderModel::dropMimeData() only checks for it
+const QString kItemModelFormat = QStringLiteral("application/x-qabstractitemmodeldatalist");
+
+}  // namespace
+
+FileListMimeData::FileListMimeData(FilePathList paths, Purpose purpose)
+    : QMimeData{}, paths_{std::move(paths)}, purpose_{purpose} {}
+
+QStringList FileListMimeData::formats() const {
+    QStringList types = QMimeData::formats();
+    switch (purpose_) {
+        case Copy:
+            types << kGnomeFormat << kUriListFormat;
+            break;
+        case Cut:
+            types << kGnomeFormat << kUriListFormat << kKdeCutFormat;
+            break;
+        case Drag:
+            types << kItemModelFormat << kUriListFormat << kLibfmFormat;
+            break;
+    }
+    return types;
+}
+
+bool FileListMimeData::hasFormat(const QString& mimeType) const {
+    return formats().contains(mimeType);
+}
+
+const FileListMimeData* FileListMimeData::fromMimeData(const QMimeData* data) {
+    return qobject_cast<const FileListMimeData*>(data);
+}
+
+QVariant FileListMimeData::retrieveData(const QString& mimeType, QMetaType type) const {
+    if (!hasFormat(mimeType) || QMimeData::formats().contains(mimeType)) {
+        return QMimeData::retrieveData(mimeType, type);
+    }
+    auto it = serialized_.constFind(mimeType);
+    if (it != serialized_.constEnd()) {
+        return *it;
+    }
+    QByteArray data;
+    if (mimeType == kGnomeFormat) {
+        // Gnome, LXDE, and XFCE
+        // Note: the standard text/urilist format uses CRLF for line breaks, but gnome format uses LF only
+        data = (purpose_ == Cut ? QByteArrayLiteral("cut\n") : QByteArrayLiteral("copy\n")) + uriList(false, "\n");
+    }
+    else if (mimeType == kUriListFormat) {
+        // the drag list is for external apps, which may know nothing of remote URIs
+        data = purpose_ == Drag ? uriList(true, "\n") : uriList(false, "\r\n");
+    }
+    else if (mimeType == kKdeCutFormat) {
+        data = QByteArrayLiteral("1");
+    }
+    else if (mimeType == kLibfmFormat) {
+        data = uriList(false, "\n");
+    }
+    serialized_.insert(mimeType, data);
+    return data;
+}
+
+QByteArray FileListMimeData::uriList(bool localPaths, const char* lineEnd) const {
+    QByteArray list;
+    list.reserve(int(paths_.size()) * 64);
+    for (const auto& path : paths_) {
+        if (localPaths) {
+            if (auto localPath = path.localPath()) {
+                list += QUrl::fromLocalFile(QString::fromUtf8(localPath.get())).toEncoded();
+                list += lineEnd;
+                continue;
+            }
+        }
+        list += path.uri().get();
+        list += lineEnd;
+    }
+    return list;
+}
+
+FilePathList pathListFromMimeData(const QMimeData* data) {
+    if (data == nullptr) {
+        return FilePathList{};
+    }
+    if (auto fileList = FileListMimeData::fromMimeData(data)) {
+        return fileList->paths();
+    }
+    FilePathList paths;
+    // try to get paths from the original data
+    if (data->hasFormat(kLibfmFormat)) {
+        QByteArray uris = data->data(kLibfmFormat);
+        paths = pathListFromUriList(uris.constData());
+    }
+    if (paths.empty() && data->hasUrls()) {
+        paths = pathListFromQUrls(data->urls());
+    }
+    return paths;
+}
+
+}  // namespace Fm
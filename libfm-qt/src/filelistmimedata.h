@@ -0,0 +1,53 @@
+#ifndef FM_FILELISTMIMEDATA_H
+#define FM_FILELISTMIMEDATA_H
+
+#include "libfmqtglobals.h"
+#include <QMimeData>
+#include <QHash>
+
+#include "core/filepath.h"
+
+namespace Fm {
+
+// The files of a copy, a cut or a drag. The URI lists other applications ask for are only
+// built when they ask, once per format, and a drop or a paste within this process takes the
+// paths as they are instead of parsing a list back (see fromMimeData()).
+class LIBFM_QT_API FileListMimeData : public QMimeData {
+    Q_OBJECT
+   public:
+    enum Purpose {
+        Copy,  // the clipboard formats of GNOME and KDE
+        Cut,   // the same, marked as cut
+        Drag   // text/uri-list with local paths where possible, and the original URIs
+    };
+
+    explicit FileListMimeData(FilePathList paths, Purpose purpose);
+
+    const FilePathList& paths() const { return paths_; }
+
+    bool isCut() const { return purpose_ == Cut; }
+
+    QStringList formats() const override;
+
+    bool hasFormat(const QString& mimeType) const override;
+
+    // |data| itself when it was made in this process by a FileListMimeData, or nullptr
+    static const FileListMimeData* fromMimeData(const QMimeData* data);
+
+   protected:
+    QVariant retrieveData(const QString& mimeType, QMetaType type) const override;
+
+   private:
+    QByteArray uriList(bool localPaths, const char* lineEnd) const;
+
+    FilePathList paths_;
+    Purpose purpose_;
+    mutable QHash<QString, QByteArray> serialized_;
+};
+
+// The paths of a drop or a paste, from any of the formats this library understands.
+LIBFM_QT_API FilePathList pathListFromMimeData(const QMimeData* data);
+
+}  // namespace Fm
+
+#endif  // FM_FILELISTMIMEDATA_H
@@ -34,6 +34,7 @@
 #include <QDebug>
 #include "filemenu_p.h"
 
+#include "core/appdatabase.h"
 #include "core/archiver.h"
 
 #include "core/legacy/fm-app-info.h"
@@ -112,21 +113,12 @@ FileMenu::FileMenu(Fm::FileInfoList files,
                 }
 
                 QStringList appNames;
-                GList* apps = g_app_info_get_all_for_type(mType->name());
-                GList* l;
-                for (l = apps; l; l = l->next) {
-                    Fm::GAppInfoPtr app{G_APP_INFO(l->data), false};
-                    // check if the command really exists
-                    gchar* program_path = g_find_program_in_path(g_app_info_get_executable(app.get()));
-                    if (!program_path) {
-                        continue;
-                    }
-                    g_free(program_path);
-
+                // only the apps whose command really exists
+                for (const auto& app : AppDatabase::globalInstance()->runnableAppsForType(mType->name())) {
                     if (mTypes.empty()) {
                         // This is the first or perhaps only mime type;
                         // create a QAction for the application.
-                        AppInfoAction* action = new AppInfoAction(std::move(app), menu);
+                        AppInfoAction* action = new AppInfoAction(app, menu);
                         commonActions << action;
                     }
                     else {
@@ -135,7 +127,6 @@ FileMenu::FileMenu(Fm::FileInfoList files,
                         appNames << QString::fromUtf8(g_app_info_get_name(app.get()));
                     }
                 }
-                g_list_free(apps);
                 if (!mTypes.empty()) {
                     // Remove and delete the actions whose corresponding apps
                     // are not associated with the mime types that are checked so far.
@@ -35,6 +35,15 @@ namespace Fm {
 
 #define SHOW_DLG_DELAY 1000
 
+namespace {
+
+FileOperationJob::ConflictRule& defaultRule() {
+    static FileOperationJob::ConflictRule rule = FileOperationJob::ConflictRule::ASK;
+    return rule;
+}
+
+}  // namespace
+
 FileOperation::FileOperation(Type type, Fm::FilePathList srcPaths, QObject* parent)
     : QObject(parent),
       type_{type},
@@ -49,9 +58,11 @@ FileOperation::FileOperation(Type type, Fm::FilePathList srcPaths, QObject* pare
     switch (type_) {
         case Copy:
             job_ = new FileTransferJob(srcPaths_, FileTransferJob::Mode::COPY);
+            setConflictRule(defaultRule());
             break;
         case Move:
             job_ = new FileTransferJob(srcPaths_, FileTransferJob::Mode::MOVE);
+            setConflictRule(defaultRule());
             break;
         case Link:
             job_ = new FileTransferJob(srcPaths_, FileTransferJob::Mode::LINK);
@@ -175,6 +186,22 @@ void FileOperation::setRecursiveChattr(bool recursive) {
     }
 }
 
+void FileOperation::setConflictRule(FileOperationJob::ConflictRule rule) {
+    if (job_ && (type_ == Copy || type_ == Move)) {
+        job_->setConflictRule(rule, rule != FileOperationJob::ConflictRule::ASK);
+    }
+}
+
+// static
+void FileOperation::setDefaultConflictRule(FileOperationJob::ConflictRule rule) {
+    defaultRule() = rule;
+}
+
+// static
+FileOperationJob::ConflictRule FileOperation::defaultConflictRule() {
+    return defaultRule();
+}
+
 bool FileOperation::run() {
     delete uiTimer_;
     // run the job
@@ -224,6 +251,18 @@ void FileOperation::onUiTimeout() {
                 //        elapsedTime(), finishedRatio, remainRatio, remaining);
                 dlg_->setRemainingTime(remaining);
             }
+            else if (!elapsedTimer_) {
+                // still counting the work to do: show what was found so far
+                std::uint64_t totalSize, totalCount;
+                if (job_->totalAmount(totalSize, totalCount)) {
+                    if (job_->calcProgressUsingSize()) {
+                        dlg_->setDataTransferred(0, totalSize);
+                    }
+                    else {
+                        dlg_->setFilesProcessed(0, totalCount);
+                    }
+                }
+            }
             // update currently processed file
             if (curFilePath_ != curFilePath) {
                 curFilePath_ = std::move(curFilePath);
@@ -327,6 +366,10 @@ void FileOperation::onJobFinish() {
         }
     }
 
+    if ((type_ == Copy || type_ == Move) && !job_->isCancelled()) {
+        resolveDeferredConflicts();
+    }
+
     // reload the containing folder if it is in use but does not have a file monitor
     if (tryReload) {
         if (!srcPaths_.empty() && (type_ == Trash || type_ == Delete || type_ == Move)) {
@@ -351,6 +394,34 @@ void FileOperation::onJobFinish() {
     }
 }
 
+void FileOperation::resolveDeferredConflicts() {
+    auto conflicts = job_->deferredConflicts();
+    if (conflicts.empty()) {
+        return;
+    }
+    QWidget* pWidget = qobject_cast<QWidget*>(parent());
+    const int count = static_cast<int>(conflicts.size());
+    if (QMessageBox::question(pWidget ? pWidget->window() : nullptr, tr("Existing Files"),
+                              tr("%n file(s) already existed at the destination and were left as they are.\n"
+                                 "Do you want to decide for them now?",
+                                 "", count)) != QMessageBox::Yes) {
+        return;
+    }
+    // the same operation again, for these files only, asking about each of them
+    FilePathList srcFiles;
+    FilePathList destFiles;
+    srcFiles.reserve(conflicts.size());
+    destFiles.reserve(conflicts.size());
+    for (auto& conflict : conflicts) {
+        srcFiles.push_back(std::move(conflict.first));
+        destFiles.push_back(std::move(conflict.second));
+    }
+    auto op = new FileOperation(type_, std::move(srcFiles), parent());
+    op->setDestFiles(std::move(destFiles));
+    op->setConflictRule(FileOperationJob::ConflictRule::ASK);
+    op->run();
+}
+
 // static
 FileOperation* FileOperation::copyFiles(Fm::FilePathList srcFiles, Fm::FilePath dest, QWidget* parent) {
     FileOperation* op = new FileOperation(FileOperation::Copy, std::move(srcFiles), parent);
@@ -53,6 +53,15 @@ class LIBFM_QT_API FileOperation : public QObject {
     // This only work for change attr jobs.
     void setRecursiveChattr(bool recursive);
 
+    // Only used by copy and move operations. With a rule other than ASK, the existing files the
+    // rule cannot decide for are left until the operation is done, and then offered to the user
+    // all at once.
+    void setConflictRule(FileOperationJob::ConflictRule rule);
+
+    // the rule new copy and move operations start with
+    static void setDefaultConflictRule(FileOperationJob::ConflictRule rule);
+    static FileOperationJob::ConflictRule defaultConflictRule();
+
     bool run();
 
     void cancel();
@@ -124,6 +133,7 @@ class LIBFM_QT_API FileOperation : public QObject {
    private:
     void disconnectJob();
     void showDialog();
+    void resolveDeferredConflicts();
 
     void pauseElapsedTimer() {
         if (Q_LIKELY(elapsedTimer_ != nullptr)) {
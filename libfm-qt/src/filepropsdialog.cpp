@@ -30,14 +30,16 @@
 #include <sys/types.h>
 #include <ctime>
 #include <cmath>
+#include "core/fileinfojob.h"
 #include "core/totalsizejob.h"
+#include "core/jobscheduler.h"
 #include "core/folder.h"
 
 #include "core/legacy/fm-config.h"
 
-#define DIFFERENT_UIDS ((uid) - 1)
-#define DIFFERENT_GIDS ((gid) - 1)
-#define DIFFERENT_PERMS ((mode_t) - 1)
+#define DIFFERENT_UIDS FileInfoSummary::kDifferentUids
+#define DIFFERENT_GIDS FileInfoSummary::kDifferentGids
+#define DIFFERENT_PERMS FileInfoSummary::kDifferentPerms
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -45,25 +47,75 @@ namespace Fm {
 
 enum { ACCESS_NO_CHANGE = 0, ACCESS_READ_ONLY, ACCESS_READ_WRITE, ACCESS_FORBID };
 
+// from this many files on, what they have in common is worked out off the GUI thread
+static const std::size_t kSummaryInBackgroundFrom = 1000;
+
+// Queries again the files that were only queried for their names and types, as those of the
+// directory tree, since the dialog shows all the rest. These are few and mostly local.
+static Fm::FileInfoList withDetails(Fm::FileInfoList files) {
+    Fm::FilePathList paths;
+    for (const auto& file : files) {
+        if (!file->hasDetails()) {
+            paths.push_back(file->path());
+        }
+    }
+    if (paths.empty()) {
+        return files;
+    }
+    Fm::FileInfoJob job{std::move(paths)};
+    job.setAutoDelete(false);
+    job.run();
+    for (auto& file : files) {
+        if (file->hasDetails()) {
+            continue;
+        }
+        for (const auto& detailed : job.files()) {
+            if (detailed->path() == file->path()) {
+                file = detailed;
+                break;
+            }
+        }
+    }
+    return files;
+}
+
 FilePropsDialog::FilePropsDialog(Fm::FileInfoList files, QWidget* parent, Qt::WindowFlags f)
     : QDialog(parent, f),
-      fileInfos_{std::move(files)},
+      fileInfos_{withDetails(std::move(files))},
       fileInfo{fileInfos_.front()},
-      singleType(fileInfos_.isSameType()),
-      singleFile(fileInfos_.size() == 1 ? true : false) {
+      singleType(false),
+      singleFile(fileInfos_.size() == 1 ? true : false),
+      hasDir(false),
+      allNative(false),
+      summaryJob_(nullptr) {
     setAttribute(Qt::WA_DeleteOnClose);
 
     ui = new Ui::FilePropsDialog();
     ui->setupUi(this);
 
-    if (singleType) {
-        mimeType = fileInfo->mimeType();
-    }
-
     totalSizeJob = new Fm::TotalSizeJob(fileInfos_.paths(), Fm::TotalSizeJob::DEFAULT);
 
     initGeneralPage();
-    initPermissionsPage();
+    if (fileInfos_.size() < kSummaryInBackgroundFrom) {
+        applySummary(FileInfoSummaryJob::summarize(fileInfos_));
+    }
+    else {
+        // the dialog opens at once, and the type, owner and permissions follow
+        ui->fileType->setText(tr("Reading the files..."));
+        ui->target->hide();
+        ui->targetLabel->hide();
+        ui->openWith->hide();
+        ui->openWithLabel->hide();
+        setPermissionsEnabled(false);
+
+        summaryJob_ = new Fm::FileInfoSummaryJob(fileInfos_);
+        connect(summaryJob_, &Fm::FileInfoSummaryJob::summaryChanged, this, &FilePropsDialog::onFileSizeTimerTimeout,
+                Qt::QueuedConnection);
+        connect(summaryJob_, &Fm::FileInfoSummaryJob::finished, this, &FilePropsDialog::onSummaryJobFinished,
+                Qt::BlockingQueuedConnection);
+        summaryJob_->setAutoDelete(true);
+        Fm::JobScheduler::globalInstance()->start(summaryJob_, Fm::JobScheduler::Priority::Interactive);
+    }
 
     if (!singleFile || !hasDir) {  // not a single dir
         ui->contentsLabel->hide();
@@ -86,6 +138,10 @@ FilePropsDialog::~FilePropsDialog() {
         totalSizeJob->cancel();
         totalSizeJob = nullptr;
     }
+    if (summaryJob_) {
+        summaryJob_->cancel();
+        summaryJob_ = nullptr;
+    }
 
     // And finally delete the dialog's UI
     delete ui;
@@ -101,53 +157,43 @@ void FilePropsDialog::initApplications() {
     }
 }
 
-void FilePropsDialog::initPermissionsPage() {
-    // ownership handling
-    // get owner/group and mode of the first file in the list
-    uid = fileInfo->uid();
-    gid = fileInfo->gid();
-    mode_t mode = fileInfo->mode();
-    ownerPerm = (mode & (S_IRUSR | S_IWUSR | S_IXUSR));
-    groupPerm = (mode & (S_IRGRP | S_IWGRP | S_IXGRP));
-    otherPerm = (mode & (S_IROTH | S_IWOTH | S_IXOTH));
-    execPerm = (mode & (S_IXUSR | S_IXGRP | S_IXOTH));
-    allNative = fileInfo->isNative();
-    hasDir = S_ISDIR(mode);
-
-    // check if all selected files belongs to the same owner/group or have the same mode
-    // at the same time, check if all files are on native unix filesystems
-    for (auto& fi : fileInfos_) {
-        if (allNative && !fi->isNative()) {
-            allNative = false;  // not all of the files are native
-        }
-
-        mode_t fi_mode = fi->mode();
-        if (S_ISDIR(fi_mode)) {
-            hasDir = true;  // the files list contains dir(s)
-        }
+void FilePropsDialog::applySummary(const FileInfoSummary& summary) {
+    singleType = summary.sameType;
+    mimeType = summary.mimeType;
+    hasDir = summary.hasDir;
+    allNative = summary.allNative;
+    uid = summary.uid;
+    gid = summary.gid;
+    ownerPerm = summary.ownerPerm;
+    groupPerm = summary.groupPerm;
+    otherPerm = summary.otherPerm;
+    execPerm = summary.execPerm;
+
+    initFileType(summary.emblem);
+    setPermissionsEnabled(true);
+    initPermissionsPage();
+}
 
-        if (uid != DIFFERENT_UIDS && static_cast<uid_t>(uid) != fi->uid()) {
-            uid = DIFFERENT_UIDS;  // not all files have the same owner
-        }
-        if (gid != DIFFERENT_GIDS && static_cast<gid_t>(gid) != fi->gid()) {
-            gid = DIFFERENT_GIDS;  // not all files have the same owner group
-        }
+void FilePropsDialog::setPermissionsEnabled(bool enabled) {
+    ui->owner->setEnabled(enabled);
+    ui->ownerGroup->setEnabled(enabled);
+    ui->ownerPerm->setEnabled(enabled);
+    ui->groupPerm->setEnabled(enabled);
+    ui->otherPerm->setEnabled(enabled);
+    ui->executable->setEnabled(enabled);
+}
 
-        if (ownerPerm != DIFFERENT_PERMS && ownerPerm != (fi_mode & (S_IRUSR | S_IWUSR | S_IXUSR))) {
-            ownerPerm = DIFFERENT_PERMS;  // not all files have the same permission for owner
-        }
-        if (groupPerm != DIFFERENT_PERMS && groupPerm != (fi_mode & (S_IRGRP | S_IWGRP | S_IXGRP))) {
-            groupPerm = DIFFERENT_PERMS;  // not all files have the same permission for group
-        }
-        if (otherPerm != DIFFERENT_PERMS && otherPerm != (fi_mode & (S_IROTH | S_IWOTH | S_IXOTH))) {
-            otherPerm = DIFFERENT_PERMS;  // not all files have the same permission for other
-        }
-        if (execPerm != DIFFERENT_PERMS && execPerm != (fi_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
-            execPerm = DIFFERENT_PERMS;  // not all files have the same executable permission
-        }
+void FilePropsDialog::onSummaryJobFinished() {
+    if (summaryJob_ == nullptr || summaryJob_->isCancelled()) {
+        return;
     }
+    const FileInfoSummary summary = summaryJob_->summary();
+    summaryJob_ = nullptr;
+    applySummary(summary);
+}
 
-    // init owner/group
+void FilePropsDialog::initPermissionsPage() {
+    // init owner/group, as set by applySummary()
     initOwner();
 
     // if all files are of the same type, and some of them are dirs => all of the items are dirs
@@ -234,12 +280,12 @@ void FilePropsDialog::initPermissionsPage() {
     execCheckState = Qt::PartiallyChecked;
     if (execPerm != DIFFERENT_PERMS) {  // if all files have the same executable permission
         // check if the files are all executable
-        if ((mode & (S_IXUSR | S_IXGRP | S_IXOTH)) == (S_IXUSR | S_IXGRP | S_IXOTH)) {
+        if (execPerm == (S_IXUSR | S_IXGRP | S_IXOTH)) {
             // owner, group, and other all have exec permission.
             ui->executable->setTristate(false);
             execCheckState = Qt::Checked;
         }
-        else if ((mode & (S_IXUSR | S_IXGRP | S_IXOTH)) == 0) {
+        else if (execPerm == 0) {
             // owner, group, and other all have no exec permission
             ui->executable->setTristate(false);
             execCheckState = Qt::Unchecked;
@@ -248,8 +294,7 @@ void FilePropsDialog::initPermissionsPage() {
     ui->executable->setCheckState(execCheckState);
 }
 
-void FilePropsDialog::initGeneralPage() {
-    // update UI
+void FilePropsDialog::initFileType(const std::shared_ptr<const Fm::IconInfo>& emblem) {
     if (singleType) {  // all files are of the same mime-type
         std::shared_ptr<const Fm::IconInfo> icon;
         // FIXME: handle custom icons for some files
@@ -286,6 +331,18 @@ void FilePropsDialog::initGeneralPage() {
         ui->targetLabel->hide();
     }
 
+    // (common) emblem
+    if (emblem) {
+        auto emblemIcon = emblem->qicon();
+        if (!emblemIcon.isNull()) {
+            ui->emblemButton->setIcon(emblemIcon);
+        }
+    }
+
+    initApplications();  // init applications combo box
+}
+
+void FilePropsDialog::initGeneralPage() {
     // FIXME: check if all files has the same parent dir, mtime, or atime
     if (singleFile) {  // only one file is selected
         auto parent_path = fileInfo->path().parent();
@@ -326,47 +383,23 @@ void FilePropsDialog::initGeneralPage() {
         ui->fileName->setEnabled(false);
     }
 
-    // (common) emblem
     connect(ui->emblemButton, &QAbstractButton::clicked, this, &FilePropsDialog::onEmblemButtonclicked);
     connect(ui->clearEmblemButton, &QAbstractButton::clicked, this, &FilePropsDialog::onClearEmblemButtonclicked);
-    auto emblems = fileInfo->emblems();
-    if (!emblems.empty()) {
-        auto emblemIcon = emblems.front()->qicon();
-        if (!emblemIcon.isNull()) {
-            bool hasCommonEmblem(true);
-            if (!singleFile) {
-                auto emblemName = emblemIcon.name();
-                for (auto& fi : fileInfos_) {
-                    emblems = fi->emblems();
-                    if (!emblems.empty()) {
-                        auto icn = emblems.front()->qicon();
-                        if (!icn.isNull()) {
-                            if (icn.name() == emblemName) {
-                                continue;
-                            }
-                        }
-                    }
-                    hasCommonEmblem = false;
-                    break;
-                }
-            }
-            if (hasCommonEmblem) {
-                ui->emblemButton->setIcon(emblemIcon);
-            }
-        }
-    }
-
-    initApplications();  // init applications combo box
 
     // calculate total file sizes
     fileSizeTimer = new QTimer(this);
     connect(fileSizeTimer, &QTimer::timeout, this, &FilePropsDialog::onFileSizeTimerTimeout);
     fileSizeTimer->start(600);
 
+    // show the totals counted so far as soon as there are some, not only when the timer fires
+    connect(totalSizeJob, &Fm::TotalSizeJob::totalsChanged, this, &FilePropsDialog::onFileSizeTimerTimeout,
+            Qt::QueuedConnection);
     connect(totalSizeJob, &Fm::TotalSizeJob::finished, this, &FilePropsDialog::onDeepCountJobFinished,
             Qt::BlockingQueuedConnection);
     totalSizeJob->setAutoDelete(true);
-    totalSizeJob->runAsync();
+    // the files of a dialog are all in one folder
+    Fm::JobScheduler::globalInstance()->start(totalSizeJob, Fm::JobScheduler::Priority::Background,
+                                              fileInfos_.empty() ? Fm::FilePath() : fileInfos_.front()->path());
 
     // disk usage
     bool canShowDeviceUsage = false;
@@ -428,6 +461,18 @@ void FilePropsDialog::onDeepCountJobFinished() {
 }
 
 void FilePropsDialog::onFileSizeTimerTimeout() {
+    if (summaryJob_) {
+        // what the files read so far have in common
+        const FileInfoSummary summary = summaryJob_->summary();
+        if (summary.sameType) {
+            const auto total = static_cast<qulonglong>(fileInfos_.size());
+            ui->fileType->setText(tr("Reading the files... (%1 of %2)").arg(summary.count).arg(total));
+        }
+        else {
+            ui->fileType->setText(tr("Files of different types"));
+        }
+    }
+
     if (totalSizeJob && !totalSizeJob->isCancelled()) {
         // FIXME:
         // OMG! It's really unbelievable that Qt developers only implement
@@ -558,17 +603,19 @@ void FilePropsDialog::accept() {
         setDefaultAppForType(currentApp, mimeType);
     }
 
-    // check if chown or chmod is needed
+    // check if chown or chmod is needed; nothing could be changed before the files were summarized
+    const bool summarized = summaryJob_ == nullptr;
     uid_t newUid = uidFromName(ui->owner->text());
     gid_t newGid = gidFromName(ui->ownerGroup->text());
-    bool needChown = (newUid != INVALID_UID && newUid != uid) || (newGid != INVALID_GID && newGid != gid);
+    bool needChown =
+        summarized && ((newUid != INVALID_UID && newUid != uid) || (newGid != INVALID_GID && newGid != gid));
 
     int newOwnerPermSel = ui->ownerPerm->currentIndex();
     int newGroupPermSel = ui->groupPerm->currentIndex();
     int newOtherPermSel = ui->otherPerm->currentIndex();
     Qt::CheckState newExecCheckState = ui->executable->checkState();
-    bool needChmod = ((newOwnerPermSel != ownerPermSel) || (newGroupPermSel != groupPermSel) ||
-                      (newOtherPermSel != otherPermSel) || (newExecCheckState != execCheckState));
+    bool needChmod = summarized && ((newOwnerPermSel != ownerPermSel) || (newGroupPermSel != groupPermSel) ||
+                                    (newOtherPermSel != otherPermSel) || (newExecCheckState != execCheckState));
 
     if (needChmod || needChown) {
         FileOperation* op = new FileOperation(FileOperation::ChangeAttr, fileInfos_.paths());
@@ -25,6 +25,7 @@
 #include <QTimer>
 
 #include "core/fileinfo.h"
+#include "core/fileinfosummaryjob.h"
 #include "core/totalsizejob.h"
 
 namespace Ui {
@@ -57,11 +58,16 @@ class LIBFM_QT_API FilePropsDialog : public QDialog {
 
    private:
     void initGeneralPage();
+    // the type, icon, emblem and applications, which depend on what the files have in common
+    void initFileType(const std::shared_ptr<const Fm::IconInfo>& emblem);
     void initApplications();
     void initPermissionsPage();
     void initOwner();
+    void applySummary(const Fm::FileInfoSummary& summary);
+    void setPermissionsEnabled(bool enabled);
 
    private Q_SLOTS:
+    void onSummaryJobFinished();
     void onDeepCountJobFinished();
     void onFileSizeTimerTimeout();
     void onIconButtonclicked();
@@ -93,6 +99,7 @@ class LIBFM_QT_API FilePropsDialog : public QDialog {
 
     Fm::TotalSizeJob* totalSizeJob;  // job used to count total size
     QTimer* fileSizeTimer;
+    Fm::FileInfoSummaryJob* summaryJob_;  // null once the files are summarized
 };
 
 }  // namespace Fm
@@ -90,6 +90,7 @@ void FileSearchDialog::accept() {
 
         fm_search_set_recursive(search, ui->recursiveSearch->isChecked());
         fm_search_set_show_hidden(search, ui->searchHidden->isChecked());
+        fm_search_set_max_results(search, maxResults());
         fm_search_set_name_patterns(search, ui->namePatterns->currentText().toUtf8().constData());
         fm_search_set_name_ci(search, !ui->nameCaseSensitive->isChecked());
         fm_search_set_name_regex(search, ui->nameRegExp->isChecked());
@@ -225,4 +226,15 @@ bool FileSearchDialog::searchhHidden() const {
     return ui->searchHidden->isChecked();
 }
 
+int FileSearchDialog::maxResults() const {
+    return ui->stopAfter->isChecked() ? ui->maxResults->value() : 0;
+}
+
+void FileSearchDialog::setMaxResults(int maxResults) {
+    ui->stopAfter->setChecked(maxResults > 0);
+    if (maxResults > 0) {
+        ui->maxResults->setValue(maxResults);
+    }
+}
+
 }  // namespace Fm
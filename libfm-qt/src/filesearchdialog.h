@@ -59,6 +59,10 @@ class LIBFM_QT_API FileSearchDialog : public QDialog {
     bool searchhHidden() const;
     void setSearchhHidden(bool hidden);
 
+    // The search stops after this many matches; 0 for no limit.
+    int maxResults() const;
+    void setMaxResults(int maxResults);
+
     QString namePattern() const;
     QString contentPattern() const;
 
@@ -38,6 +38,7 @@ struct _FmSearch {
     guint64 min_size;
     char* max_mtime;
     char* min_mtime;
+    guint max_results;
 };
 
 FmSearch* fm_search_new(void) {
@@ -193,6 +194,14 @@ void fm_search_set_min_mtime(FmSearch* search, const char* mtime) {
     search->min_mtime = g_strdup(mtime);
 }
 
+guint fm_search_get_max_results(FmSearch* search) {
+    return search->max_results;
+}
+
+void fm_search_set_max_results(FmSearch* search, guint max_results) {
+    search->max_results = max_results;
+}
+
 /* really build the path */
 GFile* fm_search_to_gfile(FmSearch* search) {
     GFile* search_path = NULL;
@@ -270,6 +279,9 @@ GFile* fm_search_to_gfile(FmSearch* search) {
         if (search->max_mtime)
             g_string_append_printf(search_str, "&max_mtime=%s", search->max_mtime);
 
+        if (search->max_results)
+            g_string_append_printf(search_str, "&max_results=%u", search->max_results);
+
         search_path = g_file_new_for_uri(search_str->str);
         g_string_free(search_str, TRUE);
     }
@@ -84,6 +84,10 @@ void fm_search_set_max_mtime(FmSearch* search, const char* mtime);
 const char* fm_search_get_min_mtime(FmSearch* search);
 void fm_search_set_min_mtime(FmSearch* search, const char* mtime);
 
+/* the search ends after this many matches; 0 for no limit */
+guint fm_search_get_max_results(FmSearch* search);
+void fm_search_set_max_results(FmSearch* search, guint max_results);
+
 G_END_DECLS
 
 #endif /* _FM_SEARCH_H_ */
@@ -24,6 +24,7 @@
 #include <QAbstractItemView>
 #include <QStyleOptionViewItem>
 #include <QApplication>
+#include <QCache>
 #include <QIcon>
 #include <QTextLayout>
 #include <QTextOption>
@@ -31,13 +32,59 @@
 #include <QLineEdit>
 #include <QTextEdit>
 #include <QTimer>
+#include <QPixmapCache>
 #include <QStandardPaths>
 #include <QDebug>
 
 #include <algorithm>
+#include <vector>
 
 namespace Fm {
 
+namespace {
+
+// enough for the labels of several views full of icons
+constexpr qsizetype kMaxCachedLabels = 2048;
+
+// the rows whose icons are counted to find the common ones, and how many of those are prewarmed
+constexpr int kPrewarmRows = 2000;
+constexpr std::size_t kPrewarmIcons = 16;
+
+// what a laid out label depends on; the font also covers zooming the font
+struct LabelKey {
+    QString text;
+    QFont font;
+    QSizeF size;
+    int alignment;
+    int elideMode;
+
+    bool operator==(const LabelKey& other) const {
+        return text == other.text && font == other.font && size == other.size && alignment == other.alignment &&
+               elideMode == other.elideMode;
+    }
+};
+
+size_t qHash(const LabelKey& key, size_t seed = 0) {
+    return qHashMulti(seed, key.text, key.font, key.size.width(), key.size.height(), key.alignment, key.elideMode);
+}
+
+}  // namespace
+
+struct FolderItemDelegate::Label {
+    Label(const QString& text, const QFont& font) : layout{text, font} {}
+
+    QTextLayout layout;
+    int visibleLines = 0;
+    QString elidedText;  // the text of the last visible line, if it had to be elided
+    qreal width = 0;
+    qreal height = 0;
+};
+
+class FolderItemDelegate::LabelCache : public QCache<LabelKey, Label> {
+   public:
+    LabelCache() : QCache<LabelKey, Label>{kMaxCachedLabels} {}
+};
+
 FolderItemDelegate::FolderItemDelegate(QAbstractItemView* view, QObject* parent)
     : QStyledItemDelegate(parent ? parent : view),
       symlinkIcon_(QIcon::fromTheme(QStringLiteral("emblem-symbolic-link"))),
@@ -49,7 +96,9 @@ FolderItemDelegate::FolderItemDelegate(QAbstractItemView* view, QObject* parent)
       iconInfoRole_(-1),
       margins_(QSize(3, 3)),
       shadowHidden_(false),
-      hasEditor_(false) {
+      fastScrolling_(false),
+      hasEditor_(false),
+      labels_{std::make_unique<LabelCache>()} {
     connect(this, &QAbstractItemDelegate::closeEditor, [this] { hasEditor_ = false; });
 }
 
@@ -68,6 +117,12 @@ QSize FolderItemDelegate::iconViewTextSize(const QModelIndex& index) const {
 }
 
 QSize FolderItemDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    // All items have the same size when it is set, so that views can lay out large folders
+    // without measuring each item, or even asking the model about it.
+    if (itemSize_.isValid()) {
+        return itemSize_;
+    }
+
     QVariant value = index.data(Qt::SizeHintRole);
     if (value.isValid()) {
         // no further processing if the size is specified by the data model
@@ -104,6 +159,13 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
     if (!index.isValid())
         return;
 
+    if (fastScrolling_) {
+        QStyleOptionViewItem opt = option;
+        initStyleOption(&opt, index);
+        paintPlaceholder(painter, option, opt);
+        return;
+    }
+
     // get emblems for this icon
     std::forward_list<std::shared_ptr<const Fm::IconInfo>> icon_emblems;
     auto fmicon = index.data(iconInfoRole_).value<std::shared_ptr<const Fm::IconInfo>>();
@@ -126,16 +188,23 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
         shadowIcon = shadowHidden_;
     }
 
-    bool isSymlink = file && file->isSymlink();
-    bool isCut = index.data(FolderModel::FileIsCutRole).toBool();
+    IconEmblems iconEmblems;
+    iconEmblems.symlink = file && file->isSymlink();
+    iconEmblems.cut = index.data(FolderModel::FileIsCutRole).toBool();
     // an emblem is added only to an untrusted, deletable desktop file that isn't inside applications directory
-    bool untrusted = file && !file->isTrustable() && file->isDesktopEntry() && file->isDeletable();
-    if (untrusted) {
+    iconEmblems.untrusted = file && !file->isTrustable() && file->isDesktopEntry() && file->isDeletable();
+    if (iconEmblems.untrusted) {
         auto parentDir = QString::fromUtf8((file->dirPath().toString().get()));
         if (QStandardPaths::standardLocations(QStandardPaths::ApplicationsLocation).contains(parentDir)) {
-            untrusted = false;
+            iconEmblems.untrusted = false;
         }
     }
+    // emblem for mounted mountable files
+    iconEmblems.mounted = file && file->canUnmount();
+    if (!emblems.empty()) {
+        // FIXME: we only support one emblem now
+        iconEmblems.other = emblems.front()->qicon();
+    }
     // vertical layout (icon mode, thumbnail mode)
     if (option.decorationPosition == QStyleOptionViewItem::Top ||
         option.decorationPosition == QStyleOptionViewItem::Bottom) {
@@ -151,43 +220,9 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
                                           : iconModeFromState(opt.state & ~QStyle::State_Selected);
         QPoint iconPos(opt.rect.x() + (opt.rect.width() - option.decorationSize.width()) / 2,
                        opt.rect.y() + margins_.height());
-        QRect iconRect(iconPos, option.decorationSize);
-        if (isCut) {
-            painter->save();
-            painter->setOpacity(0.45);
-        }
-        opt.icon.paint(painter, iconRect, Qt::AlignCenter, iconMode);
-        if (isCut) {
-            painter->restore();
-        }
-
-        // draw some emblems for the item if needed
-        iconRect.setSize(option.decorationSize / 2);
-        if (isSymlink) {
-            // draw the emblem for symlinks
-            symlinkIcon_.paint(painter, iconRect, Qt::AlignCenter, iconMode);
-        }
-
-        if (untrusted) {
-            // emblem for untrusted, deletable desktop files
-            untrustedIcon_.paint(painter, iconRect.translated(0, option.decorationSize.height() / 2), Qt::AlignCenter,
-                                 iconMode);
-        }
-
-        if (file && file->canUnmount()) {
-            // emblem for mounted mountable files
-            mountedIcon_.paint(painter, iconRect.translated(option.decorationSize.width() / 2, 0), Qt::AlignCenter,
-                               iconMode);
-        }
-
-        // draw other emblems if there's any
-        if (!emblems.empty()) {
-            // FIXME: we only support one emblem now
-            QIcon emblem = emblems.front()->qicon();
-            emblem.paint(painter,
-                         iconRect.translated(option.decorationSize.width() / 2, option.decorationSize.height() / 2),
-                         Qt::AlignCenter, iconMode);
-        }
+        // draw it with its emblems, composited once for all the items sharing them
+        painter->drawPixmap(iconPos, iconPixmap(opt.icon, option.decorationSize, painter->device()->devicePixelRatio(),
+                                                iconMode, iconEmblems));
 
         // Draw select/deselect icons outside the main icon but near its top left corner,
         // with its 1/3 size and only if the icon size isn't smaller than 48 px
@@ -210,7 +245,7 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
                 painter->save();
                 painter->setOpacity(0.6);
             }
-            iconRect = QRect(iconPos, QSize(s, s));
+            const QRect iconRect(iconPos, QSize(s, s));
             if (opt.state & QStyle::State_Selected) {
                 removeIcon_.paint(painter, iconRect, Qt::AlignCenter, QIcon::Normal);
             }
@@ -239,61 +274,153 @@ void FolderItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& op
 
         QIcon::Mode iconMode = shadowIcon ? QIcon::Disabled : iconModeFromState(opt.state);
 
+        // the style draws the icon already shadowed, translucent and with its emblems
         if (!opt.icon.isNull()) {
-            if (shadowIcon) {
-                QPixmap pixmap = opt.icon.pixmap(option.decorationSize, iconMode);
-                opt.icon = QIcon(pixmap);
-            }
-
-            if (isCut) {
-                QPixmap pixmap = opt.icon.pixmap(option.decorationSize, iconMode);
-                QImage img = pixmap.toImage().convertToFormat(QImage::Format_ARGB32_Premultiplied);
-                img.fill(Qt::transparent);
-                QPainter p(&img);
-                p.setOpacity(0.45);
-                p.drawPixmap(0, 0, pixmap);
-                p.end();
-                opt.icon = QIcon(QPixmap::fromImage(img));
-            }
+            opt.icon = QIcon(iconPixmap(opt.icon, option.decorationSize, painter->device()->devicePixelRatio(),
+                                        iconMode, iconEmblems));
         }
 
         const QWidget* widget = opt.widget;
         QStyle* style = widget ? widget->style() : QApplication::style();
         opt.decorationSize = option.decorationSize;  // for a better text alignment
         style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+    }
+}
 
-        if (isCut && !opt.icon.isNull()) {
-            // restore the original icon to not make it translucent more than once
-            opt.icon = option.icon;
-        }
-
-        // draw some emblems for the item if needed
-        QRect iconRect = style->subElementRect(QStyle::SE_ItemViewItemDecoration, &opt, widget);
-        iconRect.setSize(option.decorationSize / 2);
-        if (isSymlink) {
-            symlinkIcon_.paint(painter, iconRect, Qt::AlignCenter, iconMode);
+void FolderItemDelegate::paintPlaceholder(QPainter* painter,
+                                          const QStyleOptionViewItem& option,
+                                          QStyleOptionViewItem& opt) const {
+    const qreal devicePixelRatio = painter->device()->devicePixelRatio();
+    if (option.decorationPosition == QStyleOptionViewItem::Top ||
+        option.decorationPosition == QStyleOptionViewItem::Bottom) {
+        painter->save();
+        painter->setClipRect(option.rect);
+        const QPoint iconPos(opt.rect.x() + (opt.rect.width() - option.decorationSize.width()) / 2,
+                             opt.rect.y() + margins_.height());
+        painter->drawPixmap(iconPos, iconPixmap(opt.icon, option.decorationSize, devicePixelRatio,
+                                                iconModeFromState(opt.state & ~QStyle::State_Selected), IconEmblems{}));
+
+        // one line of the name, with the margins of drawText()
+        const QRect textRect(opt.rect.x() + margins_.width() + 2,
+                             opt.rect.y() + margins_.height() + option.decorationSize.height() + 2,
+                             opt.rect.width() - 2 * (margins_.width() + 2), opt.fontMetrics.height());
+        const QString text = opt.fontMetrics.elidedText(opt.text, opt.textElideMode, textRect.width());
+        const int width = opt.fontMetrics.horizontalAdvance(text);
+        QRect selRect(textRect.x() + (textRect.width() - width) / 2, textRect.y(), width, textRect.height());
+        selRect.adjust(-2, -2, 2, 2);
+        if (opt.state & QStyle::State_Selected) {
+            painter->fillRect(selRect, opt.palette.highlight());
+            painter->setPen(opt.palette.color(QPalette::HighlightedText));
         }
-        if (untrusted) {
-            untrustedIcon_.paint(painter, iconRect.translated(0, option.decorationSize.height() / 2), Qt::AlignCenter,
-                                 iconMode);
+        else {
+            if (opt.backgroundBrush.style() != Qt::NoBrush) {  // a highlight of the model
+                painter->fillRect(selRect, opt.backgroundBrush);
+            }
+            painter->setPen(opt.palette.color(QPalette::Text));
         }
-        if (file && file->canUnmount()) {
-            mountedIcon_.paint(painter, iconRect.translated(option.decorationSize.width() / 2, 0), Qt::AlignCenter,
-                               iconMode);
+        painter->setFont(opt.font);
+        painter->drawText(textRect, Qt::AlignHCenter | Qt::AlignTop | Qt::TextSingleLine, text);
+        painter->restore();
+    }
+    else {
+        if (!opt.icon.isNull()) {
+            opt.icon = QIcon(iconPixmap(opt.icon, option.decorationSize, devicePixelRatio, iconModeFromState(opt.state),
+                                        IconEmblems{}));
         }
-        if (!emblems.empty()) {
-            // FIXME: we only support one emblem now
-            QIcon emblem = emblems.front()->qicon();
-            emblem.paint(painter,
-                         iconRect.translated(option.decorationSize.width() / 2, option.decorationSize.height() / 2),
-                         Qt::AlignCenter, iconMode);
+        const QWidget* widget = opt.widget;
+        QStyle* style = widget ? widget->style() : QApplication::style();
+        opt.decorationSize = option.decorationSize;
+        style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+    }
+}
+
+QPixmap FolderItemDelegate::iconPixmap(const QIcon& icon,
+                                       QSize size,
+                                       qreal devicePixelRatio,
+                                       QIcon::Mode mode,
+                                       const IconEmblems& emblems) const {
+    const int flags = int(emblems.symlink) | int(emblems.untrusted) << 1 | int(emblems.mounted) << 2 |
+                      int(emblems.cut) << 3;
+    // the theme is part of the key, as changing it keeps the cache keys of the icons
+    const QString key = QStringLiteral("fm-item-icon:%1:%2:%3:%4x%5@%6:%7:%8")
+                            .arg(QIcon::themeName())
+                            .arg(icon.cacheKey())
+                            .arg(emblems.other.cacheKey())
+                            .arg(size.width())
+                            .arg(size.height())
+                            .arg(devicePixelRatio)
+                            .arg(int(mode))
+                            .arg(flags);
+    QPixmap pixmap;
+    if (QPixmapCache::find(key, &pixmap)) {
+        return pixmap;
+    }
+
+    pixmap = QPixmap{size * devicePixelRatio};
+    pixmap.setDevicePixelRatio(devicePixelRatio);
+    pixmap.fill(Qt::transparent);
+    QPainter painter{&pixmap};
+    const QRect iconRect{QPoint{0, 0}, size};
+    if (emblems.cut) {
+        painter.setOpacity(0.45);
+    }
+    icon.paint(&painter, iconRect, Qt::AlignCenter, mode);
+    painter.setOpacity(1.0);
+
+    // the emblems take the corners of the icon
+    const QRect emblemRect{QPoint{0, 0}, size / 2};
+    if (emblems.symlink) {
+        symlinkIcon_.paint(&painter, emblemRect, Qt::AlignCenter, mode);
+    }
+    if (emblems.untrusted) {
+        untrustedIcon_.paint(&painter, emblemRect.translated(0, size.height() / 2), Qt::AlignCenter, mode);
+    }
+    if (emblems.mounted) {
+        mountedIcon_.paint(&painter, emblemRect.translated(size.width() / 2, 0), Qt::AlignCenter, mode);
+    }
+    if (!emblems.other.isNull()) {
+        emblems.other.paint(&painter, emblemRect.translated(size.width() / 2, size.height() / 2), Qt::AlignCenter,
+                            mode);
+    }
+    painter.end();
+
+    QPixmapCache::insert(key, pixmap);
+    return pixmap;
+}
+
+void FolderItemDelegate::prewarmIcons(const QAbstractItemModel* model, qreal devicePixelRatio) const {
+    if (!model || !iconSize_.isValid()) {
+        return;
+    }
+    // how many items show each icon; thumbnails are each shown once and never make the cut
+    QHash<qint64, std::pair<QIcon, int>> counts;
+    const int rows = std::min(model->rowCount(), kPrewarmRows);
+    for (int row = 0; row < rows; ++row) {
+        const QIcon icon = model->index(row, FolderModel::ColumnFileName).data(Qt::DecorationRole).value<QIcon>();
+        if (!icon.isNull()) {
+            auto& count = counts[icon.cacheKey()];
+            count.first = icon;
+            ++count.second;
         }
     }
+    std::vector<std::pair<QIcon, int>> common{counts.cbegin(), counts.cend()};
+    const auto end = common.begin() + std::min(common.size(), kPrewarmIcons);
+    std::partial_sort(common.begin(), end, common.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+    for (auto it = common.begin(); it != end && it->second > 1; ++it) {
+        iconPixmap(it->first, iconSize_, devicePixelRatio, QIcon::Normal, IconEmblems{});
+    }
 }
 
 // if painter is nullptr, the method calculate the bounding rectangle of the text and save it to textRect
-void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt, QRectF& textRect) const {
-    QTextLayout layout(opt.text, opt.font);
+const FolderItemDelegate::Label& FolderItemDelegate::textLabel(const QStyleOptionViewItem& opt, QSizeF size) const {
+    LabelKey key{opt.text, opt.font, size, static_cast<int>(opt.displayAlignment), opt.textElideMode};
+    if (const Label* cached = labels_->object(key)) {
+        return *cached;
+    }
+
+    auto label = new Label{opt.text, opt.font};
+    QTextLayout& layout = label->layout;
     QTextOption textOption;
     textOption.setAlignment(opt.displayAlignment);
     textOption.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
@@ -310,22 +437,21 @@ void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt,
     int visibleLines = 0;
     layout.beginLayout();
     QString elidedText;
-    textRect.adjust(2, 2, -2, -2);  // a 2-px margin is considered at FolderView::updateGridSize()
     for (;;) {
         QTextLine line = layout.createLine();
         if (!line.isValid()) {
             break;
         }
-        line.setLineWidth(textRect.width());
+        line.setLineWidth(size.width());
         height += opt.fontMetrics.leading();
         line.setPosition(QPointF(0, height));
-        if ((height + line.height() + textRect.y()) > textRect.bottom()) {
+        if ((height + line.height()) > size.height()) {
             // if part of this line falls outside the textRect, ignore it and quit.
             QTextLine lastLine = layout.lineAt(visibleLines - 1);
             elidedText = opt.text.mid(lastLine.textStart());
-            elidedText = opt.fontMetrics.elidedText(elidedText, opt.textElideMode, textRect.width());
+            elidedText = opt.fontMetrics.elidedText(elidedText, opt.textElideMode, size.width());
             if (visibleLines == 1) {  // this is the only visible line
-                width = textRect.width();
+                width = size.width();
             }
             break;
         }
@@ -335,7 +461,22 @@ void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt,
     }
     layout.endLayout();
 
-    width = std::max(width, static_cast<qreal>(opt.fontMetrics.horizontalAdvance(elidedText)));
+    label->width = std::max(width, static_cast<qreal>(opt.fontMetrics.horizontalAdvance(elidedText)));
+    label->height = height;
+    label->visibleLines = visibleLines;
+    label->elidedText = std::move(elidedText);
+    labels_->insert(std::move(key), label);
+    return *label;
+}
+
+void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt, QRectF& textRect) const {
+    textRect.adjust(2, 2, -2, -2);  // a 2-px margin is considered at FolderView::updateGridSize()
+    const Label& label = textLabel(opt, textRect.size());
+    const QTextLayout& layout = label.layout;
+    const qreal width = label.width;
+    const qreal height = label.height;
+    const int visibleLines = label.visibleLines;
+    const QString& elidedText = label.elidedText;
 
     // draw background for selected item
     QRectF boundRect = layout.boundingRect();
@@ -363,6 +504,9 @@ void FolderItemDelegate::drawText(QPainter* painter, QStyleOptionViewItem& opt,
         painter->setPen(opt.palette.color(cg, QPalette::HighlightedText));
     }
     else {
+        if (opt.backgroundBrush.style() != Qt::NoBrush) {  // a highlight of the model
+            painter->fillRect(selRect, opt.backgroundBrush);
+        }
         painter->setPen(opt.palette.color(cg, QPalette::Text));
     }
 
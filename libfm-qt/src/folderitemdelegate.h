@@ -22,6 +22,7 @@
 
 #include "libfmqtglobals.h"
 #include <QStyledItemDelegate>
+#include <memory>
 class QAbstractItemView;
 
 namespace Fm {
@@ -64,6 +65,12 @@ class LIBFM_QT_API FolderItemDelegate : public QStyledItemDelegate {
 
     void setShadowHidden(bool value) { shadowHidden_ = value; }
 
+    // While the view scrolls fast, items are painted as placeholders: their icon without
+    // emblems and one line of their name. The view repaints them once it settles.
+    void setFastScrolling(bool fast) { fastScrolling_ = fast; }
+
+    bool isFastScrolling() const { return fastScrolling_; }
+
     QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
 
     void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
@@ -80,9 +87,38 @@ class LIBFM_QT_API FolderItemDelegate : public QStyledItemDelegate {
 
     QSize iconViewTextSize(const QModelIndex& index) const;
 
+    // Composites the icons shared by the most items among the first rows of |model| at the
+    // icon size, so that the first paint after zooming finds them ready.
+    void prewarmIcons(const QAbstractItemModel* model, qreal devicePixelRatio) const;
+
    private:
+    struct Label;
+    class LabelCache;
+
+    // the emblems drawn onto an item's icon, and whether the item is cut
+    struct IconEmblems {
+        bool symlink = false;
+        bool untrusted = false;
+        bool mounted = false;
+        bool cut = false;
+        QIcon other;  // from the file's metadata
+    };
+
+    // |icon| with |emblems| drawn onto it, from QPixmapCache when it was composited before
+    QPixmap iconPixmap(const QIcon& icon,
+                       QSize size,
+                       qreal devicePixelRatio,
+                       QIcon::Mode mode,
+                       const IconEmblems& emblems) const;
+
     void drawText(QPainter* painter, QStyleOptionViewItem& opt, QRectF& textRect) const;
 
+    // paints the placeholder of an item while the view scrolls fast
+    void paintPlaceholder(QPainter* painter, const QStyleOptionViewItem& option, QStyleOptionViewItem& opt) const;
+
+    // the label of |opt.text| laid out in |size|, from the cache when it was laid out before
+    const Label& textLabel(const QStyleOptionViewItem& opt, QSizeF size) const;
+
     static QIcon::Mode iconModeFromState(QStyle::State state);
 
    private:
@@ -98,7 +134,10 @@ class LIBFM_QT_API FolderItemDelegate : public QStyledItemDelegate {
     QColor shadowColor_;
     QSize margins_;
     bool shadowHidden_;
+    bool fastScrolling_;
     mutable bool hasEditor_;
+    // recently laid out labels, so that repainting an item does not shape its text again
+    std::unique_ptr<LabelCache> labels_;
 };
 
 }  // namespace Fm
@@ -20,6 +20,7 @@
 #include "foldermodel.h"
 #include <iostream>
 #include <algorithm>
+#include <unordered_map>
 #include <QtAlgorithms>
 #include <qmimedata.h>
 #include <QMimeData>
@@ -31,17 +32,49 @@
 #include <QString>
 #include <QApplication>
 #include <QClipboard>
+#include <QCollator>
 #include "utilities.h"
+#include "filelistmimedata.h"
 #include "fileoperation.h"
+#include "core/dirsizeindex.h"
+#include "core/jobscheduler.h"
+#include "core/perftrace.h"
+#include "core/userinfocache.h"
 
 namespace Fm {
 
+// removing rows in more separate ranges than this is reported as a single layout change
+static const std::size_t kMaxRemovedRanges = 64;
+
+// all the models, for thumbnailMemory()
+static QList<const FolderModel*> liveModels;
+
+// Makes room for |count| more entries, growing geometrically so that a folder listed in many
+// batches is not moved over for each of them.
+template <typename Container>
+static void reserveMore(Container& container, qsizetype count) {
+    const qsizetype needed = container.size() + count;
+    if (container.capacity() < needed) {
+        container.reserve(std::max(needed, 2 * container.size()));
+    }
+}
+
 FolderModel::FolderModel()
-    : hasPendingThumbnailHandler_{false}, showFullNames_{false}, isLoaded_{false}, hasCutfile_{false} {
+    : hasPendingThumbnailHandler_{false},
+      showFullNames_{false},
+      showFolderSizes_{false},
+      isLoaded_{false},
+      hasCutfile_{false} {
     connect(QApplication::clipboard(), &QClipboard::dataChanged, this, &FolderModel::onClipboardDataChange);
+    // names looked up in the background only repaint the cells showing them
+    auto userInfoCache = Fm::UserInfoCache::globalInstance();
+    connect(userInfoCache, &Fm::UserInfoCache::userChanged, this, &FolderModel::onUserChanged);
+    connect(userInfoCache, &Fm::UserInfoCache::groupChanged, this, &FolderModel::onGroupChanged);
+    liveModels.append(this);
 }
 
 FolderModel::~FolderModel() {
+    liveModels.removeOne(this);
     // if the thumbnail requests list is not empty, cancel them
     for (auto job : pendingThumbnailJobs_) {
         job->cancel();
@@ -65,6 +98,9 @@ void FolderModel::setFolder(const std::shared_ptr<Fm::Folder>& new_folder) {
             insertFiles(0, folder_->files());
             onClipboardDataChange();  // files may have been cut
         }
+        else if (folder_->isIncremental()) {  // take the files listed so far; the rest will be added
+            insertFiles(0, folder_->files());
+        }
     }
 }
 
@@ -84,16 +120,18 @@ void FolderModel::onFinishLoading() {
 void FolderModel::onFilesAdded(const Fm::FileInfoList& files) {
     int n_files = files.size();
     beginInsertRows(QModelIndex(), items.count(), items.count() + n_files - 1);
+    // a whole batch takes one allocation for the items and one for their rows at most
+    reserveMore(items, n_files);
+    reserveMore(rows_, n_files);
     for (auto& info : files) {
-        FolderModelItem item(info);
+        rows_[info.get()] = items.size();
+        FolderModelItem& item = items.emplaceBack(info);
 
         // cut files may be removed and added again
         if (isLoaded_ && cutFilesHashSet_.count(info->path().hash()) != 0) {
             item.isCut = true;
             hasCutfile_ = true;
         }
-
-        items.append(item);
     }
     endInsertRows();
 
@@ -103,6 +141,8 @@ void FolderModel::onFilesAdded(const Fm::FileInfoList& files) {
 }
 
 void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
+    std::vector<int> changedRows;
+    changedRows.reserve(files.size());
     for (auto& change : files) {
         int row;
         auto& oldInfo = change.first;
@@ -111,27 +151,138 @@ void FolderModel::onFilesChanged(std::vector<Fm::FileInfoPair>& files) {
         if (it != items.end()) {
             FolderModelItem& item = *it;
             // try to update the item
-            item.info = newInfo;
+            item.setInfo(newInfo);
             item.thumbnails.clear();
-            QModelIndex index = createIndex(row, 0, &item);
-            Q_EMIT dataChanged(index, index);
+            rows_.remove(oldInfo.get());
+            rows_[newInfo.get()] = row;
+            changedRows.push_back(row);
             if (oldInfo->size() != newInfo->size()) {
-                Q_EMIT fileSizeChanged(index);
+                Q_EMIT fileSizeChanged(createIndex(row, 0, &item));
             }
         }
     }
+    emitRowsChanged(changedRows, 0, NumOfColumns - 1);
+}
+
+void FolderModel::emitRowsChanged(std::vector<int>& rows, int first, int last) {
+    std::sort(rows.begin(), rows.end());
+    for (std::size_t i = 0; i < rows.size();) {
+        std::size_t end = i;
+        while (end + 1 < rows.size() && rows[end + 1] <= rows[end] + 1) {
+            ++end;
+        }
+        Q_EMIT dataChanged(index(rows[i], first), index(rows[end], last));
+        i = end + 1;
+    }
+}
+
+void FolderModel::onUserChanged(uid_t uid) {
+    std::vector<int> rows;
+    for (int row = 0; row < items.size(); ++row) {
+        if (items.at(row).info->uid() == uid) {
+            rows.push_back(row);
+        }
+    }
+    emitRowsChanged(rows, ColumnFileOwner, ColumnFileOwner);
+}
+
+void FolderModel::onGroupChanged(gid_t gid) {
+    std::vector<int> rows;
+    for (int row = 0; row < items.size(); ++row) {
+        if (items.at(row).info->gid() == gid) {
+            rows.push_back(row);
+        }
+    }
+    emitRowsChanged(rows, ColumnFileGroup, ColumnFileGroup);
 }
 
 void FolderModel::onFilesRemoved(const Fm::FileInfoList& files) {
+    std::vector<int> removedRows;
+    removedRows.reserve(files.size());
     for (auto& info : files) {
         int row;
-        QList<FolderModelItem>::iterator it = findItemByName(info->name().c_str(), &row);
+        QList<FolderModelItem>::iterator it = findItemByFileInfo(info.get(), &row);
+        // names are not unique in a recursive folder
+        if (it == items.end() && !(folder_ && folder_->isRecursive())) {  // not the info we were given
+            it = findItemByName(info->name().c_str(), &row);
+        }
         if (it != items.end()) {
-            beginRemoveRows(QModelIndex(), row, row);
-            items.erase(it);
+            removedRows.push_back(row);
+        }
+    }
+    removeItemRows(removedRows);
+}
+
+void FolderModel::removeItemRows(std::vector<int>& rows) {
+    if (rows.empty()) {
+        return;
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    for (int row : rows) {
+        rows_.remove(items.at(row).info.get());
+    }
+    std::size_t ranges = 1;
+    for (std::size_t i = 1; i < rows.size(); ++i) {
+        if (rows[i] != rows[i - 1] + 1) {
+            ++ranges;
+        }
+    }
+
+    if (ranges <= kMaxRemovedRanges) {
+        // from the last range, so that the rows of the others stay valid
+        for (std::size_t end = rows.size(); end > 0;) {
+            std::size_t first = end - 1;
+            while (first > 0 && rows[first - 1] == rows[first] - 1) {
+                --first;
+            }
+            beginRemoveRows(QModelIndex(), rows[first], rows[end - 1]);
+            items.erase(items.begin() + rows[first], items.begin() + rows[end - 1] + 1);
             endRemoveRows();
+            end = first;
         }
     }
+    else {
+        // rows removed all over the folder: compact the items in one pass, and move the
+        // persistent indexes (selection, current item) along with their items
+        Q_EMIT layoutAboutToBeChanged();
+        std::vector<int> newRows(items.size());
+        int newRow = 0;
+        auto removed = rows.cbegin();
+        for (int row = 0; row < items.size(); ++row) {
+            if (removed != rows.cend() && *removed == row) {
+                newRows[row] = -1;
+                ++removed;
+            }
+            else {
+                newRows[row] = newRow++;
+            }
+        }
+        QList<FolderModelItem> remaining;
+        remaining.reserve(newRow);
+        for (int row = 0; row < items.size(); ++row) {
+            if (newRows[row] >= 0) {
+                remaining.append(std::move(items[row]));
+            }
+        }
+        items = std::move(remaining);
+        const QModelIndexList from = persistentIndexList();
+        QModelIndexList to;
+        to.reserve(from.size());
+        for (const QModelIndex& index : from) {
+            const int row = newRows[index.row()];
+            to.append(row >= 0 ? createIndex(row, index.column(), &items[row]) : QModelIndex());
+        }
+        changePersistentIndexList(from, to);
+        Q_EMIT layoutChanged();
+    }
+    indexRows(rows.front());
+}
+
+void FolderModel::indexRows(int from) {
+    for (int row = from; row < items.size(); ++row) {
+        rows_[items.at(row).info.get()] = row;
+    }
 }
 
 void FolderModel::loadPendingThumbnails() {
@@ -147,7 +298,7 @@ void FolderModel::loadPendingThumbnails() {
                     Qt::BlockingQueuedConnection);
             connect(job, &Fm::ThumbnailJob::finished, this, &FolderModel::onThumbnailJobFinished,
                     Qt::BlockingQueuedConnection);
-            Fm::ThumbnailJob::threadPool()->start(job);
+            Fm::JobScheduler::globalInstance()->start(job, Fm::JobScheduler::Priority::VisibleThumbnails, path());
         }
     }
 }
@@ -167,9 +318,11 @@ void FolderModel::queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>&
 void FolderModel::insertFiles(int row, const Fm::FileInfoList& files) {
     int n_files = files.size();
     beginInsertRows(QModelIndex(), row, row + n_files - 1);
+    reserveMore(items, n_files);
+    reserveMore(rows_, n_files);
     for (auto& info : files) {
-        FolderModelItem item(info);
-        items.append(item);
+        rows_[info.get()] = items.size();
+        items.emplaceBack(info);
     }
     endInsertRows();
 }
@@ -191,6 +344,18 @@ void FolderModel::updateCutFilesSet() {
         return;  // possible under Wayland
     }
 
+    // cut in this process
+    if (auto fileList = FileListMimeData::fromMimeData(data)) {
+        if (fileList->isCut()) {
+            for (const auto& path : fileList->paths()) {
+                if (path.parent() == folder_->path()) {
+                    cutFilesHashSet_.insert(path.hash());
+                }
+            }
+        }
+        return;
+    }
+
     // Gnome, LXDE, XFCE (see utilities.cpp -> pasteFilesFromClipboard)
     if (data->hasFormat(QStringLiteral("x-special/gnome-copied-files"))) {
         QByteArray gnomeData = data->data(QStringLiteral("x-special/gnome-copied-files"));
@@ -269,6 +434,7 @@ void FolderModel::removeAll() {
     }
     beginRemoveRows(QModelIndex(), 0, items.size() - 1);
     items.clear();
+    rows_.clear();
     endRemoveRows();
 }
 
@@ -338,12 +504,33 @@ QString FolderModel::makeTooltip(FolderModelItem* item) const {
     return tip;
 }
 
+void FolderModel::setShowFolderSizes(bool show) {
+    if (show == showFolderSizes_) {
+        return;
+    }
+    showFolderSizes_ = show;
+    if (show) {
+        connect(DirSizeIndex::globalInstance().get(), &DirSizeIndex::changed, this, &FolderModel::onDirSizesChanged);
+    }
+    else {
+        disconnect(DirSizeIndex::globalInstance().get(), &DirSizeIndex::changed, this,
+                   &FolderModel::onDirSizesChanged);
+    }
+    onDirSizesChanged();
+}
+
+void FolderModel::onDirSizesChanged() {
+    if (!items.isEmpty()) {
+        Q_EMIT dataChanged(index(0, ColumnFileSize), index(rowCount() - 1, ColumnFileSize));
+    }
+}
+
 QVariant FolderModel::data(const QModelIndex& index, int role /* = Qt::DisplayRole*/) const {
     if (!index.isValid() || index.row() > items.size() || index.column() >= NumOfColumns) {
         return QVariant();
     }
     FolderModelItem* item = itemFromIndex(index);
-    auto info = item->info;
+    const auto& info = item->info;
     bool isCut = folder_ && item->isCut;
 
     switch (role) {
@@ -355,7 +542,7 @@ QVariant FolderModel::data(const QModelIndex& index, int role /* = Qt::DisplayRo
                     return (showFullNames_ && !item->name().empty() ? QString::fromStdString(item->name())
                                                                     : item->displayName());
                 case ColumnFileType:
-                    return QString::fromUtf8(info->mimeType()->desc());
+                    return item->displayType();
                 case ColumnFileMTime:
                     return item->displayMtime();
                 case ColumnFileCrTime:
@@ -363,16 +550,31 @@ QVariant FolderModel::data(const QModelIndex& index, int role /* = Qt::DisplayRo
                 case ColumnFileDTime:
                     return item->displayDtime();
                 case ColumnFileSize:
+                    if (showFolderSizes_ && info->isDir() && info->isNative()) {
+                        DirSizeIndex::Sizes sizes;
+                        if (DirSizeIndex::globalInstance()->lookup(*info, sizes)) {
+                            return Fm::formatFileSize(sizes.size, false);
+                        }
+                    }
                     return item->displaySize();
                 case ColumnFileOwner:
                     return item->ownerName();
                 case ColumnFileGroup:
                     return item->ownerGroup();
+                case ColumnFileFolder:
+                    if (folder_ && folder_->isRecursive()) {
+                        return QString::fromUtf8(folder_->path().relativePathStr(info->dirPath()).get());
+                    }
+                    return QString();
             }
             break;
         }
         case Qt::DecorationRole: {
             if (index.column() == 0) {
+                // only shown files are worth sniffing
+                if (folder_) {
+                    folder_->resolveContentType(info);
+                }
                 return QVariant(item->icon());
             }
             break;
@@ -422,6 +624,9 @@ QVariant FolderModel::headerData(int section, Qt::Orientation orientation, int r
                 case ColumnFileGroup:
                     title = tr("Group");
                     break;
+                case ColumnFileFolder:
+                    title = tr("Folder");
+                    break;
             }
             return QVariant(title);
         }
@@ -457,19 +662,70 @@ Qt::ItemFlags FolderModel::flags(const QModelIndex& index) const {
 }
 
 std::shared_ptr<const Fm::FileInfo> FolderModel::fileInfoFromPath(const Fm::FilePath& path) const {
-    QList<FolderModelItem>::const_iterator it = items.begin();
-    while (it != items.end()) {
-        const FolderModelItem& item = *it;
-        if (item.info->path() == path) {
-            return item.info;
+    QModelIndex index = indexFromPath(path);
+    return index.isValid() ? items.at(index.row()).info : nullptr;
+}
+
+QModelIndex FolderModel::indexFromPath(const Fm::FilePath& path) const {
+    return indexesFromPaths(Fm::FilePathList{path}).front();
+}
+
+QModelIndexList FolderModel::indexesFromPaths(const Fm::FilePathList& paths) const {
+    QModelIndexList indexes;
+    indexes.reserve(paths.size());
+    // the paths that are not in the folder itself, as in search results, are found in one pass
+    std::unordered_map<Fm::FilePath, int, Fm::FilePathHash> unresolved;
+    for (const auto& path : paths) {
+        int row = -1;
+        if (!findRowByName(path, &row)) {
+            unresolved.emplace(path, indexes.size());
         }
-        ++it;
+        indexes.append(row >= 0 ? index(row, 0) : QModelIndex());
     }
-    return nullptr;
+    for (int row = 0; row < items.size() && !unresolved.empty(); ++row) {
+        auto found = unresolved.find(items.at(row).info->path());
+        if (found != unresolved.end()) {
+            indexes[found->second] = index(row, 0);
+            unresolved.erase(found);
+        }
+    }
+    return indexes;
 }
 
-// FIXME: this is very inefficient and should be replaced with a
-// more reasonable implementation later.
+// Looks a file of the folder itself up by name, or by relative path in a recursive folder. Returns false
+// when a linear search is needed, for files elsewhere (as in search results) or not in the model with the
+// info the folder has.
+bool FolderModel::findRowByName(const Fm::FilePath& path, int* row) const {
+    if (!folder_) {
+        return false;
+    }
+    std::shared_ptr<const FileInfo> info;
+    if (folder_->isRecursive()) {
+        auto relative = folder_->path().relativePathStr(path);
+        if (!relative) {
+            return false;
+        }
+        info = folder_->fileByName(relative.get());
+    }
+    else if (folder_->path().isParentOf(path)) {
+        info = folder_->fileByName(path.baseName().get());
+    }
+    else {
+        return false;
+    }
+    if (!info) {
+        *row = -1;
+        return true;
+    }
+    auto found = rows_.constFind(info.get());
+    if (found == rows_.cend()) {
+        return false;
+    }
+    *row = found.value();
+    return true;
+}
+
+// a linear search, only for file infos that rows_ does not know
 QList<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, int* row) {
     QList<FolderModelItem>::iterator it = items.begin();
     int i = 0;
@@ -486,18 +742,12 @@ QList<FolderModelItem>::iterator FolderModel::findItemByName(const char* name, i
 }
 
 QList<FolderModelItem>::iterator FolderModel::findItemByFileInfo(const Fm::FileInfo* info, int* row) {
-    QList<FolderModelItem>::iterator it = items.begin();
-    int i = 0;
-    while (it != items.end()) {
-        FolderModelItem& item = *it;
-        if (item.info.get() == info) {
-            *row = i;
-            return it;
-        }
-        ++it;
-        ++i;
+    auto found = rows_.constFind(info);
+    if (found == rows_.cend()) {
+        return items.end();
     }
-    return items.end();
+    *row = found.value();
+    return items.begin() + found.value();
 }
 
 QStringList FolderModel::mimeTypes() const {
@@ -515,43 +765,21 @@ QStringList FolderModel::mimeTypes() const {
 }
 
 QMimeData* FolderModel::mimeData(const QModelIndexList& indexes) const {
-    QMimeData* data = QAbstractItemModel::mimeData(indexes);
     // qDebug("FolderModel::mimeData");
-    //  build two uri lists, one for internal DND
-    //  and the other for DNDing to external apps
-    QByteArray urilist, libfmUrilist;
-    urilist.reserve(4096);
-    libfmUrilist.reserve(4096);
-
+    // only the paths are taken here; the uri lists for internal DND and for DNDing to
+    // external apps are built by FileListMimeData if they are asked for
+    Fm::FilePathList paths;
+    paths.reserve(indexes.size());
     for (const auto& index : indexes) {
         FolderModelItem* item = itemFromIndex(index);
         if (item && item->info) {
             auto path = item->info->path();
             if (path.isValid()) {
-                // get the list that will be used by internal DND
-                auto uri = path.uri();
-                libfmUrilist.append(uri.get());
-                libfmUrilist.append('\n');
-
-                // also, get the list that will be used when DNDing to external apps,
-                // using local paths as far as possible (for DNDing from remote folders)
-                if (auto localPath = path.localPath()) {
-                    QUrl url = QUrl::fromLocalFile(QString::fromUtf8(localPath.get()));
-                    urilist.append(url.toEncoded());
-                }
-                else {
-                    urilist.append(uri.get());
-                }
-                urilist.append('\n');
+                paths.push_back(std::move(path));
             }
         }
     }
-    data->setData(QStringLiteral("text/uri-list"), urilist);
-    // NOTE: The mimetype "text/uri-list" changes the list in QMimeData::setData() to get URLs
-    // but some protocols (like MTP) may need the original list to query file info.
-    data->setData(QStringLiteral("libfm/files"), libfmUrilist);
-
-    return data;
+    return new FileListMimeData{std::move(paths), FileListMimeData::Drag};
 }
 
 bool FolderModel::dropMimeData(const QMimeData* data,
@@ -589,15 +817,7 @@ bool FolderModel::dropMimeData(const QMimeData* data,
         destPath = path();
     }
 
-    Fm::FilePathList srcPaths;
-    // try to get paths from the original data
-    if (data->hasFormat(QStringLiteral("libfm/files"))) {
-        QByteArray _data = data->data(QStringLiteral("libfm/files"));
-        srcPaths = pathListFromUriList(_data.data());
-    }
-    if (srcPaths.empty() && data->hasUrls()) {
-        srcPaths = Fm::pathListFromQUrls(data->urls());
-    }
+    Fm::FilePathList srcPaths = pathListFromMimeData(data);
 
     // NOTE: If the DND is done with no key modifier, the current method will not be called.
     // Instead, the dropEvent handler of FolderView will do the job after asking the user.
@@ -639,6 +859,10 @@ void FolderModel::cacheThumbnails(const int size) {
     else {
         thumbnailData_.push_front(ThumbnailData(size));
     }
+    // the thumbnails prefetched for the model, if it was listed ahead, are wanted now
+    for (auto job : pendingThumbnailJobs_) {
+        Fm::JobScheduler::globalInstance()->promote(job, Fm::JobScheduler::Priority::VisibleThumbnails);
+    }
 }
 
 // ask the model to free cached thumbnails of the specified size
@@ -663,6 +887,85 @@ void FolderModel::releaseThumbnails(int size) {
     }
 }
 
+std::size_t FolderModel::memoryCost() const {
+    // a file info with its strings and icon, and its item
+    constexpr std::size_t fileCost = 1024;
+    std::size_t cost = items.size() * fileCost;
+    for (const auto& item : items) {
+        for (const auto& thumbnail : item.thumbnails) {
+            cost += thumbnail.image.sizeInBytes();
+        }
+    }
+    return cost;
+}
+
+void FolderModel::dropThumbnails() {
+    for (auto& item : items) {
+        item.thumbnails.clear();
+    }
+}
+
+void FolderModel::prefetchThumbnails(int size, int count) {
+    std::vector<FolderModelItem*> candidates;
+    for (auto& item : items) {
+        if (!item.info->isDir() && item.findThumbnail(size)->status == FolderModelItem::ThumbnailNotChecked) {
+            candidates.push_back(&item);
+        }
+    }
+    if (candidates.empty() || count <= 0) {
+        return;
+    }
+    // the files a view sorting by name, as it does unless told otherwise, shows first
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    const auto last = candidates.begin() + std::min(candidates.size(), static_cast<std::size_t>(count));
+    std::partial_sort(candidates.begin(), last, candidates.end(),
+                      [&collator](const FolderModelItem* a, const FolderModelItem* b) {
+                          return collator.compare(a->displayName(), b->displayName()) < 0;
+                      });
+    Fm::FileInfoList files;
+    for (auto it = candidates.begin(); it != last; ++it) {
+        (*it)->findThumbnail(size)->status = FolderModelItem::ThumbnailLoading;
+        files.push_back((*it)->info);
+    }
+    auto job = new Fm::ThumbnailJob(std::move(files), size,
+                                    folder_ != nullptr && folder_->isValid() && folder_->info()->isRemoteDirectory());
+    pendingThumbnailJobs_.push_back(job);
+    job->setAutoDelete(true);
+    connect(job, &Fm::ThumbnailJob::thumbnailLoaded, this, &FolderModel::onThumbnailLoaded,
+            Qt::BlockingQueuedConnection);
+    connect(job, &Fm::ThumbnailJob::finished, this, &FolderModel::onThumbnailJobFinished,
+            Qt::BlockingQueuedConnection);
+    Fm::JobScheduler::globalInstance()->start(job, Fm::JobScheduler::Priority::Prefetch, path());
+}
+
+void FolderModel::cancelThumbnails() {
+    for (auto job : pendingThumbnailJobs_) {
+        job->cancel();
+    }
+    for (auto& item : items) {
+        for (auto& thumbnail : item.thumbnails) {
+            if (thumbnail.status == FolderModelItem::ThumbnailLoading) {
+                thumbnail.status = FolderModelItem::ThumbnailNotChecked;
+            }
+        }
+    }
+}
+
+// static
+int64_t FolderModel::thumbnailMemory() {
+    int64_t bytes = 0;
+    for (const FolderModel* model : std::as_const(liveModels)) {
+        for (const auto& item : model->items) {
+            for (const auto& thumbnail : item.thumbnails) {
+                bytes += thumbnail.image.sizeInBytes();
+            }
+        }
+    }
+    return bytes;
+}
+
 void FolderModel::onThumbnailJobFinished() {
     Fm::ThumbnailJob* job = static_cast<Fm::ThumbnailJob*>(sender());
     auto it = std::find(pendingThumbnailJobs_.cbegin(), pendingThumbnailJobs_.cend(), job);
@@ -689,6 +992,7 @@ void FolderModel::onThumbnailLoaded(const std::shared_ptr<const Fm::FileInfo>& f
         else {
             thumbnail->status = FolderModelItem::ThumbnailLoaded;
             thumbnail->image = image;
+            thumbnail->shown = false;
 
             // tell the world that we have the thumbnail loaded
             Q_EMIT thumbnailLoaded(index, size);
@@ -711,6 +1015,11 @@ QImage FolderModel::thumbnailFromIndex(const QModelIndex& index, int size) {
                 break;
             }
             case FolderModelItem::ThumbnailLoaded:
+                // the thumbnails loaded but never asked for were loaded for rows scrolled away
+                if (!thumbnail->shown) {
+                    thumbnail->shown = true;
+                    Fm::PerfTrace::add(Fm::PerfTrace::ThumbnailShown);
+                }
                 return thumbnail->image;
             default:;
         }
@@ -22,6 +22,7 @@
 
 #include "libfmqtglobals.h"
 #include <QAbstractListModel>
+#include <QHash>
 #include <QItemSelection>
 #include <QIcon>
 #include <QImage>
@@ -50,6 +51,7 @@ class LIBFM_QT_API FolderModel : public QAbstractListModel {
         ColumnFileDTime,
         ColumnFileOwner,
         ColumnFileGroup,
+        ColumnFileFolder,  // the subfolder of a file in a recursive folder
         NumOfColumns
     };
 
@@ -84,6 +86,9 @@ class LIBFM_QT_API FolderModel : public QAbstractListModel {
 
     std::shared_ptr<const Fm::FileInfo> fileInfoFromIndex(const QModelIndex& index) const;
     std::shared_ptr<const Fm::FileInfo> fileInfoFromPath(const Fm::FilePath& path) const;
+    QModelIndex indexFromPath(const Fm::FilePath& path) const;
+    // The indexes of |paths|, in the same order; those of files not in the model are invalid.
+    QModelIndexList indexesFromPaths(const Fm::FilePathList& paths) const;
     FolderModelItem* itemFromIndex(const QModelIndex& index) const;
     QImage thumbnailFromIndex(const QModelIndex& index, int size);
 
@@ -92,10 +97,29 @@ class LIBFM_QT_API FolderModel : public QAbstractListModel {
 
     void setShowFullName(bool fullName) { showFullNames_ = fullName; }
 
+    // Shows the sizes of folders in the size column when DirSizeIndex knows them.
+    void setShowFolderSizes(bool show);
+
+    // A rough estimate of the memory held by the items and their thumbnails, in bytes.
+    std::size_t memoryCost() const;
+
+    // The bytes of the thumbnails held by all the models.
+    static int64_t thumbnailMemory();
+
+    // Forgets the thumbnails loaded, which are loaded again when asked for.
+    void dropThumbnails();
+
+    // Loads the thumbnails of the first |count| files by name at |size| at a low priority, as
+    // for a model listed ahead, so that a view showing it later finds them loaded.
+    void prefetchThumbnails(int size, int count);
+
+    // Cancels the thumbnails being loaded, which are loaded again when asked for.
+    void cancelThumbnails();
+
    Q_SIGNALS:
     void thumbnailLoaded(const QModelIndex& index, int size);
     void fileSizeChanged(const QModelIndex& index);
-    void filesAdded(FileInfoList infoList);
+    void filesAdded(const Fm::FileInfoList& infoList);
 
    protected Q_SLOTS:
 
@@ -111,10 +135,20 @@ class LIBFM_QT_API FolderModel : public QAbstractListModel {
 
     void onClipboardDataChange();
 
+    void onDirSizesChanged();
+
+    void onUserChanged(uid_t uid);
+    void onGroupChanged(gid_t gid);
+
    protected:
     void queueLoadThumbnail(const std::shared_ptr<const Fm::FileInfo>& file, int size);
     void insertFiles(int row, const Fm::FileInfoList& files);
     void removeAll();
+    void removeItemRows(std::vector<int>& rows);
+    void indexRows(int from);
+    // one signal per range of adjacent rows in |rows|, for the columns from |first| to |last|
+    void emitRowsChanged(std::vector<int>& rows, int first, int last);
+    bool findRowByName(const Fm::FilePath& path, int* row) const;
     QList<FolderModelItem>::iterator findItemByName(const char* name, int* row);
     QList<FolderModelItem>::iterator findItemByFileInfo(const Fm::FileInfo* info, int* row);
 
@@ -133,12 +167,16 @@ class LIBFM_QT_API FolderModel : public QAbstractListModel {
 
     std::shared_ptr<Fm::Folder> folder_;
     QList<FolderModelItem> items;
+    // the row of each item by its file info, kept in sync with items; a QHash keeps its entries
+    // in blocks, rather than allocating one node per file as std::unordered_map does
+    QHash<const Fm::FileInfo*, int> rows_;
 
     bool hasPendingThumbnailHandler_;
     std::vector<Fm::ThumbnailJob*> pendingThumbnailJobs_;
     std::forward_list<ThumbnailData> thumbnailData_;
 
     bool showFullNames_;
+    bool showFolderSizes_;
 
     bool isLoaded_;
 
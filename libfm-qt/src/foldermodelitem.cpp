@@ -25,27 +25,61 @@
 
 namespace Fm {
 
-FolderModelItem::FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info) : info{_info}, isCut{false} {
-    thumbnails.reserve(2);
-}
+FolderModelItem::FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info)
+    : info{_info}, ownerResolved_{false}, isCut{false} {}
 
 FolderModelItem::FolderModelItem(const FolderModelItem& other)
-    : info{other.info}, thumbnails{other.thumbnails}, isCut{other.isCut} {}
+    : info{other.info}, ownerResolved_{false}, thumbnails{other.thumbnails}, isCut{other.isCut} {}
 
 FolderModelItem::~FolderModelItem() {}
 
-QString FolderModelItem::ownerName() const {
-    QString name;
-    auto user = Fm::UserInfoCache::globalInstance()->userFromId(info->uid());
-    if (user) {
-        name = user->name();
+FolderModelItem& FolderModelItem::operator=(const FolderModelItem& other) {
+    if (this != &other) {
+        setInfo(other.info);
+        dispOwner_.clear();
+        dispGroup_.clear();
+        thumbnails = other.thumbnails;
+        isCut = other.isCut;
     }
-    return name;
+    return *this;
+}
+
+void FolderModelItem::setInfo(const std::shared_ptr<const Fm::FileInfo>& newInfo) {
+    info = newInfo;
+    dispMtime_.clear();
+    dispCrtime_.clear();
+    dispDtime_.clear();
+    dispSize_.clear();
+    dispType_.clear();
+    ownerResolved_ = false;
 }
 
-QString FolderModelItem::ownerGroup() const {
-    auto group = Fm::UserInfoCache::globalInstance()->groupFromId(info->gid());
-    return group ? group->name() : QString();
+const QString& FolderModelItem::ownerName() const {
+    if (!ownerResolved_) {
+        // the owner and group columns are usually shown together, so both names are looked up at once;
+        // the ids stand in for names not known yet, and for those of no user or group
+        auto cache = Fm::UserInfoCache::globalInstance();
+        std::shared_ptr<const Fm::UserInfo> user;
+        const bool userKnown = cache->findUser(info->uid(), user);
+        dispOwner_ = user ? user->name() : QString::number(info->uid());
+        std::shared_ptr<const Fm::GroupInfo> group;
+        const bool groupKnown = cache->findGroup(info->gid(), group);
+        dispGroup_ = group ? group->name() : QString::number(info->gid());
+        ownerResolved_ = userKnown && groupKnown;
+    }
+    return dispOwner_;
+}
+
+const QString& FolderModelItem::ownerGroup() const {
+    ownerName();
+    return dispGroup_;
+}
+
+const QString& FolderModelItem::displayType() const {
+    if (dispType_.isEmpty()) {
+        dispType_ = QString::fromUtf8(info->mimeType()->desc());
+    }
+    return dispType_;
 }
 
 const QString& FolderModelItem::displayMtime() const {
@@ -83,7 +117,7 @@ const QString& FolderModelItem::displayDtime() const {
 }
 
 const QString& FolderModelItem::displaySize() const {
-    if (!info->isDir()) {
+    if (dispSize_.isEmpty() && !info->isDir()) {
         // FIXME: choose IEC or SI units
         dispSize_ = Fm::formatFileSize(info->size(), false);
     }
@@ -38,13 +38,20 @@ class LIBFM_QT_API FolderModelItem {
         int size;
         ThumbnailStatus status;
         QImage image;
+        bool shown = false;  // handed to a view since it was loaded, see PerfTrace::ThumbnailShown
     };
 
    public:
     explicit FolderModelItem(const std::shared_ptr<const Fm::FileInfo>& _info);
     FolderModelItem(const FolderModelItem& other);
+    // moved as the rows of a model are inserted and removed, which spares the reference counts
+    FolderModelItem(FolderModelItem&& other) noexcept = default;
     virtual ~FolderModelItem();
 
+    // like the copy constructor, leaves the display strings to be formatted again
+    FolderModelItem& operator=(const FolderModelItem& other);
+    FolderModelItem& operator=(FolderModelItem&& other) noexcept = default;
+
     const QString& displayName() const { return info->displayName(); }
 
     const std::string& name() const { return info->name(); }
@@ -54,9 +61,12 @@ class LIBFM_QT_API FolderModelItem {
         return i ? i->qicon() : QIcon{};
     }
 
-    QString ownerName() const;
+    // The display strings are formatted when first asked for, and kept until the info changes.
+    const QString& ownerName() const;
+
+    const QString& ownerGroup() const;
 
-    QString ownerGroup() const;
+    const QString& displayType() const;
 
     const QString& displayMtime() const;
 
@@ -70,11 +80,18 @@ class LIBFM_QT_API FolderModelItem {
 
     void removeThumbnail(int size);
 
+    // replaces the file info, and has the display strings formatted from the new one when next asked for
+    void setInfo(const std::shared_ptr<const Fm::FileInfo>& newInfo);
+
     std::shared_ptr<const Fm::FileInfo> info;
     mutable QString dispMtime_;
     mutable QString dispCrtime_;
     mutable QString dispDtime_;
     mutable QString dispSize_;
+    mutable QString dispType_;
+    mutable QString dispOwner_;
+    mutable QString dispGroup_;
+    mutable bool ownerResolved_;  // whether dispOwner_ and dispGroup_ are set, not to placeholders
     QList<Thumbnail> thumbnails;
     bool isCut;
 };
@@ -30,6 +30,7 @@
 #include "filelauncher.h"
 #include "fileoperation.h"
 #include "utilities.h"
+#include "filelistmimedata.h"
 #include <QTimer>
 #include <QDate>
 #include <QDebug>
@@ -48,6 +49,8 @@
 #include <xcb/xcb.h>         // for XDS support
 #include "xdndworkaround.h"  // for XDS support
 #include "folderview_p.h"
+#include "cachedfoldermodel.h"
+#include "core/perftrace.h"
 
 #include <cmath>
 #include <algorithm>
@@ -57,6 +60,27 @@
 
 static const int scrollAnimFrames = SCROLL_FRAMES_PER_SEC * SCROLL_DURATION / 1000;
 
+// From this many files on, all items of the compact mode get the size of a label this long, so
+// that QListView lays them out arithmetically instead of measuring every file name.
+static const int uniformItemsMinCount = 10000;
+
+// how long (in ms) a folder stays under the mouse or the focus before it is listed ahead
+static const int prefetchDelay = 400;
+static const int uniformItemsLabelChars = 32;
+
+// Scrolling faster than this many pages a second paints placeholders, until it is back under
+// half of it or has stopped for scrollSettleDelay ms; the speed is measured every
+// scrollSampleSpan ms.
+static const qreal fastScrollPagesPerSec = 4;
+static const int scrollSampleSpan = 50;
+static const int scrollSettleDelay = 150;
+
+// Whether |range| holds whole items: a row is selected with its first cell, the only one in
+// the list modes, and the files are at the top level of the model.
+static bool isRowRange(const QItemSelectionRange& range) {
+    return range.left() == 0 && !range.parent().isValid();
+}
+
 using namespace Fm;
 
 FolderViewListView::FolderViewListView(QWidget* parent)
@@ -245,6 +269,11 @@ void FolderViewListView::dropEvent(QDropEvent* e) {
     QAbstractItemView::dropEvent(e);
 }
 
+void FolderViewListView::paintEvent(QPaintEvent* event) {
+    PerfTrace::Scope trace{"FolderView paint"};
+    QListView::paintEvent(event);
+}
+
 void FolderViewListView::mouseReleaseEvent(QMouseEvent* event) {
     // NOTE: With mouseReleaseEvent, event->buttons() excludes the button that caused the event
     // and so, it should not be used here. Instead, event->button() is used.
@@ -419,19 +448,23 @@ void FolderViewTreeView::headerContextMenu(const QPoint& p) {
 
         int filenameColumn = header()->visualIndex(FolderModel::ColumnFileName);
         int dTimeColumn = header()->visualIndex(FolderModel::ColumnFileDTime);
+        int folderColumn = header()->visualIndex(FolderModel::ColumnFileFolder);
         bool isTrash = false;
+        bool isRecursive = false;
         if (ProxyFolderModel* proxyModel = qobject_cast<ProxyFolderModel*>(model())) {
             if (auto model = static_cast<FolderModel*>(proxyModel->sourceModel())) {
                 if (model->path() && strcmp(model->path().toString().get(), "trash:///") == 0) {
                     isTrash = true;
                 }
+                isRecursive = model->folder() && model->folder()->isRecursive();
             }
         }
         int numCols = header()->count();
         for (int column = 0; column < numCols; ++column) {
             int columnId = header()->logicalIndex(column);
-            if (!isTrash && columnId == dTimeColumn) {
-                // no action for the deletion time column if this isn't trash
+            if ((!isTrash && columnId == dTimeColumn) || (!isRecursive && columnId == folderColumn)) {
+                // no action for the deletion time column if this isn't trash, nor for the folder
+                // column of a folder that is not shown flat
                 continue;
             }
             if (columnId >= 0 && columnId < FolderModel::NumOfColumns) {
@@ -471,6 +504,7 @@ void FolderViewTreeView::setModel(QAbstractItemModel* model) {
 }
 
 void FolderViewTreeView::paintEvent(QPaintEvent* event) {
+    PerfTrace::Scope trace{"FolderView paint"};
     QTreeView::paintEvent(event);
     if (rubberBandRect_.isValid()) {  // draw rubberband
         QPainter p(viewport());
@@ -633,19 +667,23 @@ void FolderViewTreeView::layoutColumns() {
         QAbstractItemModel* model_ = model();
         int filenameColumn = headerView->visualIndex(FolderModel::ColumnFileName);
         int dTimeColumn = header()->visualIndex(FolderModel::ColumnFileDTime);
+        int folderColumn = header()->visualIndex(FolderModel::ColumnFileFolder);
         bool isTrash = false;
+        bool isRecursive = false;
         if (ProxyFolderModel* proxyModel = qobject_cast<ProxyFolderModel*>(model())) {
             if (auto model = static_cast<FolderModel*>(proxyModel->sourceModel())) {
                 if (model->path() && strcmp(model->path().toString().get(), "trash:///") == 0) {
                     isTrash = true;
                 }
+                isRecursive = model->folder() && model->folder()->isRecursive();
             }
         }
         for (int column = 0; column < numCols; ++column) {
             int columnId = headerView->logicalIndex(column);
 
-            if (!isTrash && columnId == dTimeColumn) {
-                // hide the deletion time column if this isn't trash
+            if ((!isTrash && columnId == dTimeColumn) || (!isRecursive && columnId == folderColumn)) {
+                // hide the deletion time column if this isn't trash, and the folder column if the
+                // folder is not shown flat
                 headerView->setSectionHidden(columnId, true);
                 widths.append(headerView->minimumSectionSize());
                 continue;
@@ -860,11 +898,20 @@ FolderView::FolderView(FolderView::ViewMode _mode, QWidget* parent)
       autoSelectionDelay_(600),
       autoSelectionTimer_(nullptr),
       selChangedTimer_(nullptr),
+      selStatsValid_(false),
+      selRowsValid_(false),
+      prefetchTimer_(nullptr),
       itemDelegateMargins_(QSize(3, 3)),
       shadowHidden_(false),
       scrollPerPixel_(true),
+      uniformItemSizes_(false),
       ctrlRightClick_(false),
-      smoothScrollTimer_(nullptr) {
+      smoothScrollTimer_(nullptr),
+      scrollBar_(nullptr),
+      scrollValue_(0),
+      scrollDistance_(0),
+      scrollSettleTimer_(nullptr),
+      fastScrolling_(false) {
     iconSize_[IconMode - FirstViewMode] = QSize(48, 48);
     iconSize_[CompactMode - FirstViewMode] = QSize(24, 24);
     iconSize_[ThumbnailMode - FirstViewMode] = QSize(128, 128);
@@ -956,13 +1003,10 @@ void FolderView::onItemActivated(QModelIndex index) {
                 data = index.model()->data(index, FolderModel::FileInfoRole);
             }
         }
-        else {  // if index is not valid or selected, activate the first selected index
-            QModelIndexList selIndexes = mode == DetailedListMode ? selectedRows() : selectedIndexes();
-            if (!selIndexes.isEmpty()) {
-                QModelIndex first = selIndexes.first();
-                if (first.model()) {
-                    data = first.model()->data(first, FolderModel::FileInfoRole);
-                }
+        else if (model_) {  // if index is not valid or selected, activate the first selected index
+            const auto& ranges = selectedRowRanges().ranges();
+            if (!ranges.empty()) {
+                data = model_->data(model_->index(ranges.begin()->first, 0), FolderModel::FileInfoRole);
             }
         }
         if (data.isValid()) {
@@ -981,7 +1025,16 @@ void FolderView::onSelChangedTimeout() {
     Q_EMIT selChanged();
 }
 
-void FolderView::onSelectionChanged(const QItemSelection& /*selected*/, const QItemSelection& /*deselected*/) {
+void FolderView::onSelectionChanged(const QItemSelection& selected, const QItemSelection& deselected) {
+    if (selRowsValid_) {
+        addToSelectedRows(deselected, -1);
+        addToSelectedRows(selected, 1);
+    }
+    if (selStatsValid_) {
+        addToSelectionStats(deselected, -1);
+        addToSelectionStats(selected, 1);
+    }
+
     // It's possible that the selected items change too often and this slot gets called for thousands of times.
     // For example, when you select thousands of files and delete them, we will get one selectionChanged() event
     // for every deleted file. So, we use a timer to delay the handling to avoid too frequent updates of the UI.
@@ -1039,6 +1092,7 @@ void FolderView::setViewMode(ViewMode _mode) {
         return;
     }
     // FIXME: retain old selection
+    setFastScrolling(false);
 
     // since only detailed list mode uses QTreeView, and others
     // all use QListView, it's wise to preserve QListView when possible.
@@ -1046,6 +1100,7 @@ void FolderView::setViewMode(ViewMode _mode) {
     if (view && (mode == DetailedListMode || _mode == DetailedListMode)) {
         delete view;
         view = nullptr;
+        scrollBar_ = nullptr;
         recreateView = true;
     }
     mode = _mode;
@@ -1060,6 +1115,7 @@ void FolderView::setViewMode(ViewMode _mode) {
         treeView->setCustomColumnWidths(customColumnWidths_);
         treeView->setHiddenColumns(hiddenColumns_);
         treeView->setAlternatingRowColors(true);
+        watchScrolling(treeView);
         connect(treeView, &FolderViewTreeView::activatedFiltered, this, &FolderView::onItemActivated);
         // update the list of custom widhts when the user changes it
         connect(treeView, &FolderViewTreeView::columnResizedByUser, [this](int visualIndex, int newWidth) {
@@ -1111,6 +1167,7 @@ void FolderView::setViewMode(ViewMode _mode) {
         else {
             listView = new FolderViewListView(this);
             connect(listView, &FolderViewListView::activatedFiltered, this, &FolderView::onItemActivated);
+            watchScrolling(listView);
             view = listView;
         }
         if (scrollPerPixel_ && mode == CompactMode) {
@@ -1171,9 +1228,13 @@ void FolderView::setViewMode(ViewMode _mode) {
             // FIXME: preserve selections
             model_->setThumbnailSize(iconSize.width());
             view->setModel(model_);
+            selStatsValid_ = false;
+            selRowsValid_ = false;
             if (recreateView) {
                 connect(view->selectionModel(), &QItemSelectionModel::selectionChanged, this,
                         &FolderView::onSelectionChanged);
+                connect(view->selectionModel(), &QItemSelectionModel::currentChanged, this,
+                        &FolderView::schedulePrefetch);
             }
         }
     }
@@ -1213,17 +1274,34 @@ void FolderView::updateGridSize() {
 
             break;
         }
-        default:
+        default: {
             // FIXME: set proper item size
             listView->setSpacing(2);
-            ;  // do not use grid size
+            uniformItemSizes_ = model_ && model_->rowCount() >= uniformItemsMinCount;
+            if (uniformItemSizes_) {  // as QStyledItemDelegate measures a name, but only once
+                QStyleOptionViewItem opt;
+                opt.initFrom(listView);
+                opt.features = QStyleOptionViewItem::HasDisplay | QStyleOptionViewItem::HasDecoration;
+                opt.decorationPosition = QStyleOptionViewItem::Left;
+                opt.decorationSize = icon;
+                opt.font = listView->font();
+                opt.text = QString(uniformItemsLabelChars, QLatin1Char('x'));
+                grid = listView->style()->sizeFromContents(QStyle::CT_ItemViewItem, &opt, QSize(), listView);
+            }
+            break;  // the grid size is not used but is given to the delegate as the item size
+        }
     }
+    if (mode != CompactMode) {
+        uniformItemSizes_ = false;
+    }
+    listView->setUniformItemSizes(uniformItemSizes_);
 
     FolderItemDelegate* delegate =
         static_cast<FolderItemDelegate*>(listView->itemDelegateForColumn(FolderModel::ColumnFileName));
     delegate->setItemSize(grid);
     delegate->setIconSize(icon);
     delegate->setMargins(itemDelegateMargins_);
+    delegate->prewarmIcons(model_, listView->devicePixelRatio());
 }
 
 void FolderView::setIconSize(ViewMode mode, QSize size) {
@@ -1294,6 +1372,34 @@ ProxyFolderModel* FolderView::model() const {
 }
 
 void FolderView::setModel(ProxyFolderModel* model) {
+    setFastScrolling(false);
+    if (model) {
+        connect(model, &QAbstractItemModel::rowsInserted, this, &FolderView::onRowCountChanged);
+        connect(model, &QAbstractItemModel::rowsRemoved, this, &FolderView::onRowCountChanged);
+        connect(model, &QAbstractItemModel::modelReset, this, &FolderView::onRowCountChanged);
+        connect(model, &QAbstractItemModel::layoutChanged, this, &FolderView::onRowCountChanged);
+        // count the selection again when it may have changed unannounced: a reset forgets it, a
+        // changed file may have another size, and the rows removed are not left to the deltas;
+        // the selected rows also move when rows are added, removed or sorted
+        auto invalidateSelection = [this]() {
+            selStatsValid_ = false;
+            selRowsValid_ = false;
+        };
+        auto invalidateSelectedRows = [this]() { selRowsValid_ = false; };
+        connect(model, &QAbstractItemModel::modelReset, this, invalidateSelection);
+        // what was under the mouse is gone, as when the view is given another folder
+        connect(model, &QAbstractItemModel::modelReset, this, [this]() { schedulePrefetch(QModelIndex()); });
+        connect(model, &QAbstractItemModel::rowsRemoved, this, invalidateSelection);
+        connect(model, &QAbstractItemModel::rowsInserted, this, invalidateSelectedRows);
+        connect(model, &QAbstractItemModel::rowsMoved, this, invalidateSelectedRows);
+        connect(model, &QAbstractItemModel::layoutChanged, this, invalidateSelectedRows);
+        connect(model, &QAbstractItemModel::dataChanged, this,
+                [this](const QModelIndex& /*topLeft*/, const QModelIndex& /*bottomRight*/, const QList<int>& roles) {
+                    if (roles.isEmpty() || roles.contains(Qt::DisplayRole)) {
+                        selStatsValid_ = false;
+                    }
+                });
+    }
     if (view) {
         view->setModel(model);
         QSize iconSize = iconSize_[mode - FirstViewMode];
@@ -1301,12 +1407,87 @@ void FolderView::setModel(ProxyFolderModel* model) {
         if (view->selectionModel()) {
             connect(view->selectionModel(), &QItemSelectionModel::selectionChanged, this,
                     &FolderView::onSelectionChanged);
+            connect(view->selectionModel(), &QItemSelectionModel::currentChanged, this,
+                    &FolderView::schedulePrefetch);
         }
     }
     if (model_) {
         delete model_;
     }
     model_ = model;
+    selStatsValid_ = false;
+    selRowsValid_ = false;
+    onRowCountChanged();
+}
+
+FolderItemDelegate* FolderView::itemDelegate() const {
+    return view ? static_cast<FolderItemDelegate*>(view->itemDelegateForColumn(FolderModel::ColumnFileName)) : nullptr;
+}
+
+void FolderView::watchScrolling(QAbstractItemView* itemView) {
+    for (const QScrollBar* bar : {itemView->verticalScrollBar(), itemView->horizontalScrollBar()}) {
+        connect(bar, &QScrollBar::valueChanged, this, [this, bar](int value) { onScrolled(bar, value); });
+    }
+}
+
+void FolderView::onScrolled(const QScrollBar* bar, int value) {
+    if (bar != scrollBar_) {  // only the moves of one bar are added up
+        scrollBar_ = bar;
+        scrollDistance_ = 0;
+        scrollClock_.start();
+    }
+    else {
+        scrollDistance_ += std::abs(value - scrollValue_);
+        const qint64 elapsed = scrollClock_.elapsed();
+        if (elapsed >= scrollSampleSpan) {
+            // the page step is in the units of the value, pixels or items
+            const qreal pagesPerSec = scrollDistance_ * 1000.0 / (elapsed * std::max(bar->pageStep(), 1));
+            if (pagesPerSec >= fastScrollPagesPerSec) {
+                setFastScrolling(true);
+            }
+            else if (pagesPerSec < fastScrollPagesPerSec / 2) {
+                setFastScrolling(false);
+            }
+            scrollDistance_ = 0;
+            scrollClock_.start();
+        }
+    }
+    scrollValue_ = value;
+
+    if (!scrollSettleTimer_) {
+        scrollSettleTimer_ = new QTimer(this);
+        scrollSettleTimer_->setSingleShot(true);
+        connect(scrollSettleTimer_, &QTimer::timeout, this, &FolderView::onScrollSettled);
+    }
+    scrollSettleTimer_->start(scrollSettleDelay);
+}
+
+void FolderView::onScrollSettled() {
+    scrollBar_ = nullptr;  // a pause does not count in the next speed
+    setFastScrolling(false);
+}
+
+void FolderView::setFastScrolling(bool fast) {
+    if (fast == fastScrolling_) {
+        return;
+    }
+    fastScrolling_ = fast;
+    if (FolderItemDelegate* delegate = itemDelegate()) {
+        delegate->setFastScrolling(fast);
+    }
+    if (model_) {
+        model_->setThumbnailsSuspended(fast);
+    }
+    if (!fast && view) {
+        // the items shown are painted in full, and their thumbnails loaded
+        view->viewport()->update();
+    }
+}
+
+void FolderView::onRowCountChanged() {
+    if (mode == CompactMode && model_ && (model_->rowCount() >= uniformItemsMinCount) != uniformItemSizes_) {
+        updateGridSize();
+    }
 }
 
 bool FolderView::event(QEvent* event) {
@@ -1405,19 +1586,13 @@ QItemSelectionModel* FolderView::selectionModel() const {
 }
 
 Fm::FilePathList FolderView::selectedFilePaths() const {
-    if (model_) {
-        QModelIndexList selIndexes = mode == DetailedListMode ? selectedRows() : selectedIndexes();
-        if (!selIndexes.isEmpty()) {
-            Fm::FilePathList paths;
-            QModelIndexList::const_iterator it;
-            for (it = selIndexes.constBegin(); it != selIndexes.constEnd(); ++it) {
-                auto file = model_->fileInfoFromIndex(*it);
-                paths.push_back(file->path());
-            }
-            return paths;
-        }
-    }
-    return Fm::FilePathList();
+    Fm::FilePathList paths;
+    paths.reserve(selectedRowRanges().count());
+    forEachSelectedFile([&paths](const std::shared_ptr<const Fm::FileInfo>& file) {
+        paths.push_back(file->path());
+        return true;
+    });
+    return paths;
 }
 
 bool FolderView::hasSelection() const {
@@ -1445,40 +1620,36 @@ bool FolderView::selectFiles(const Fm::FileInfoList& files, bool add) {
     if (!model_ || files.empty()) {
         return false;
     }
-    QModelIndex index, firstIndex;
-    int count = model_->rowCount();
-    Fm::FileInfoList list = files;
-    bool singleFile(files.size() == 1);
-    QItemSelectionModel::SelectionFlags flags = QItemSelectionModel::Select;
-    if (mode == DetailedListMode) {
-        flags |= QItemSelectionModel::Rows;
-    }
-    for (int row = 0; row < count; ++row) {
-        if (list.empty()) {
-            break;
-        }
-        index = model_->index(row, 0);
-        auto info = model_->fileInfoFromIndex(index);
-        for (auto it = list.cbegin(); it != list.cend(); ++it) {
-            auto& item = *it;
-            if (item == info) {
-                if (model_->showHidden() || !info->isHidden()) {
-                    if (!firstIndex.isValid()) {
-                        firstIndex = index;
-                        if (!add) {
-                            selectionModel()->clear();
-                        }
-                    }
-                    selectionModel()->select(index, flags);
-                }
-                list.erase(it);
-                break;
+    Fm::FilePathList paths;
+    paths.reserve(files.size());
+    for (const auto& file : files) {
+        paths.push_back(file->path());
+    }
+    const QModelIndexList indexes = model_->indexesFromPaths(paths);
+
+    // one selection of all the files, so that it is only changed once
+    QItemSelection selection;
+    QModelIndex firstIndex;
+    for (int i = 0; i < indexes.size(); ++i) {
+        const QModelIndex& index = indexes.at(i);
+        if (index.isValid() && model_->fileInfoFromIndex(index) == files[i]) {
+            selection.select(index, index);
+            if (!firstIndex.isValid() || index.row() < firstIndex.row()) {
+                firstIndex = index;
             }
         }
     }
     if (firstIndex.isValid()) {
+        QItemSelectionModel::SelectionFlags flags = QItemSelectionModel::Select;
+        if (mode == DetailedListMode) {
+            flags |= QItemSelectionModel::Rows;
+        }
+        if (!add) {
+            selectionModel()->clear();
+        }
+        selectionModel()->select(selection, flags);
         view->scrollTo(firstIndex, QAbstractItemView::EnsureVisible);
-        if (singleFile) {  // give focus to the single file
+        if (files.size() == 1) {  // give focus to the single file
             selectionModel()->setCurrentIndex(firstIndex, QItemSelectionModel::Current);
         }
         return true;
@@ -1486,20 +1657,91 @@ bool FolderView::selectFiles(const Fm::FileInfoList& files, bool add) {
     return false;
 }
 
-Fm::FileInfoList FolderView::selectedFiles() const {
-    if (model_) {
-        QModelIndexList selIndexes = mode == DetailedListMode ? selectedRows() : selectedIndexes();
-        if (!selIndexes.isEmpty()) {
-            Fm::FileInfoList files;
-            QModelIndexList::const_iterator it;
-            for (it = selIndexes.constBegin(); it != selIndexes.constEnd(); ++it) {
-                auto file = model_->fileInfoFromIndex(*it);
-                files.push_back(file);
+const FolderView::SelectionStats& FolderView::selectionStats() const {
+    if (!selStatsValid_) {
+        selStats_ = SelectionStats{};
+        forEachSelectedFile([this](const std::shared_ptr<const Fm::FileInfo>& file) {
+            addToSelectionStats(file, 1);
+            return true;
+        });
+        selStatsValid_ = true;
+    }
+    return selStats_;
+}
+
+const RowRangeSet& FolderView::selectedRowRanges() const {
+    if (!selRowsValid_) {
+        selRows_.clear();
+        if (QItemSelectionModel* selModel = selectionModel()) {
+            addToSelectedRows(selModel->selection(), 1);
+        }
+        selRowsValid_ = true;
+    }
+    return selRows_;
+}
+
+void FolderView::forEachSelectedFile(
+    const std::function<bool(const std::shared_ptr<const Fm::FileInfo>&)>& visit) const {
+    if (!model_) {
+        return;
+    }
+    for (const auto& range : selectedRowRanges().ranges()) {
+        for (int row = range.first; row <= range.second; ++row) {
+            auto file = model_->fileInfoFromIndex(model_->index(row, 0));
+            if (file && !visit(file)) {
+                return;
+            }
+        }
+    }
+}
+
+void FolderView::addToSelectedRows(const QItemSelection& selection, int sign) const {
+    for (const QItemSelectionRange& range : selection) {
+        if (isRowRange(range)) {
+            if (sign > 0) {
+                selRows_.insert(range.top(), range.bottom());
+            }
+            else {
+                selRows_.erase(range.top(), range.bottom());
+            }
+        }
+    }
+}
+
+void FolderView::addToSelectionStats(const QItemSelection& selection, int sign) const {
+    if (!model_) {
+        return;
+    }
+    for (const QItemSelectionRange& range : selection) {
+        if (isRowRange(range)) {
+            for (int row = range.top(); row <= range.bottom(); ++row) {
+                addToSelectionStats(model_->fileInfoFromIndex(model_->index(row, 0)), sign);
             }
-            return files;
         }
     }
-    return Fm::FileInfoList();
+}
+
+void FolderView::addToSelectionStats(const std::shared_ptr<const Fm::FileInfo>& file, int sign) const {
+    if (!file) {
+        return;
+    }
+    selStats_.count += sign;
+    if (file->isDir()) {
+        selStats_.dirs += sign;
+    }
+    else {
+        selStats_.fileSize += sign * file->size();
+    }
+}
+
+Fm::FileInfoList FolderView::selectedFiles() const {
+    Fm::FileInfoList files;
+    files.reserve(selectedRowRanges().count());
+    forEachSelectedFile([&files](const std::shared_ptr<const Fm::FileInfo>& file) {
+        files.push_back(file);
+        return true;
+    });
+    return files;
 }
 
 void FolderView::selectAll() {
@@ -1620,15 +1862,7 @@ void FolderView::childDropEvent(QDropEvent* e) {
             destPath = path();  // drop on blank area of the folder
         }
 
-        Fm::FilePathList srcPaths;
-        // try to get paths from the original data
-        if (e->mimeData()->hasFormat(QStringLiteral("libfm/files"))) {
-            QByteArray _data = e->mimeData()->data(QStringLiteral("libfm/files"));
-            srcPaths = pathListFromUriList(_data.data());
-        }
-        if (srcPaths.empty() && e->mimeData()->hasUrls()) {
-            srcPaths = Fm::pathListFromQUrls(e->mimeData()->urls());
-        }
+        Fm::FilePathList srcPaths = pathListFromMimeData(e->mimeData());
 
         if (!srcPaths.empty()) {
             Qt::DropActions actions = Qt::IgnoreAction;
@@ -1701,6 +1935,7 @@ bool FolderView::eventFilter(QObject* watched, QEvent* event) {
         switch (event->type()) {
             case QEvent::HoverMove:
             case QEvent::HoverEnter:
+                schedulePrefetch(view->indexAt(static_cast<QHoverEvent*>(event)->position().toPoint()));
                 // activate items on single click
                 if (style()->styleHint(QStyle::SH_ItemView_ActivateItemOnSingleClick)) {
                     QHoverEvent* hoverEvent = static_cast<QHoverEvent*>(event);
@@ -1896,6 +2131,36 @@ void FolderView::scrollSmoothly() {
 }
 
 // this slot handles auto-selection of items.
+void FolderView::schedulePrefetch(const QModelIndex& index) {
+    std::shared_ptr<const Fm::FileInfo> file;
+    if (model_ && index.isValid()) {
+        file = model_->fileInfoFromIndex(index);
+    }
+    if (!file || !file->isDir()) {
+        prefetchPath_ = Fm::FilePath();
+        if (prefetchTimer_) {
+            prefetchTimer_->stop();
+        }
+        return;
+    }
+    if (file->path() == prefetchPath_) {
+        return;
+    }
+    prefetchPath_ = file->path();
+    if (!prefetchTimer_) {
+        prefetchTimer_ = new QTimer(this);
+        prefetchTimer_->setSingleShot(true);
+        connect(prefetchTimer_, &QTimer::timeout, this, &FolderView::onPrefetchTimeout);
+    }
+    prefetchTimer_->start(prefetchDelay);
+}
+
+void FolderView::onPrefetchTimeout() {
+    // the thumbnails of the first screen too, at the size this view shows them
+    CachedFolderModel::prefetchNext(prefetchPath_,
+                                    model_ && model_->showThumbnails() ? model_->thumbnailSize() : 0);
+}
+
 void FolderView::onAutoSelectionTimeout() {
     if (QApplication::mouseButtons() != Qt::NoButton) {
         return;
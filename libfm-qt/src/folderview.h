@@ -22,6 +22,7 @@
 
 #include "libfmqtglobals.h"
 #include <QWidget>
+#include <QElapsedTimer>
 #include <QListView>
 #include <QTreeView>
 #include <QMouseEvent>
@@ -29,7 +30,9 @@
 #include "proxyfoldermodel.h"
 
 #include "core/folder.h"
+#include "core/rowrangeset.h"
 
+class QScrollBar;
 class QTimer;
 
 namespace Fm {
@@ -38,6 +41,7 @@ class FileMenu;
 class FolderMenu;
 class FileLauncher;
 class FolderViewStyle;
+class FolderItemDelegate;
 
 class LIBFM_QT_API FolderView : public QWidget {
     Q_OBJECT
@@ -89,7 +93,24 @@ class LIBFM_QT_API FolderView : public QWidget {
         return _folder ? _folder->path() : Fm::FilePath();
     }
 
+    // the counts of the selection that the status bar shows
+    struct SelectionStats {
+        int count = 0;         // selected items
+        int dirs = 0;          // of which folders
+        int64_t fileSize = 0;  // the total size of the other items
+    };
+
     QItemSelectionModel* selectionModel() const;
+    // Kept up to date from the changes of the selection, so that adjusting a large selection
+    // costs only the items added or removed. Counted again after the model is reset, rows are
+    // removed or a file changes.
+    const SelectionStats& selectionStats() const;
+    // The selected rows of the model, merged into ranges and kept up to date from the changes
+    // of the selection like selectionStats(); built again when rows are added, removed or
+    // moved. The views of a large selection never go over one index per cell.
+    const RowRangeSet& selectedRowRanges() const;
+    // Calls |visit| with each selected file in the order of the rows until it returns false.
+    void forEachSelectedFile(const std::function<bool(const std::shared_ptr<const Fm::FileInfo>&)>& visit) const;
     Fm::FileInfoList selectedFiles() const;
     Fm::FilePathList selectedFilePaths() const;
     bool hasSelection() const;
@@ -158,9 +179,12 @@ class LIBFM_QT_API FolderView : public QWidget {
 
    private Q_SLOTS:
     void onAutoSelectionTimeout();
+    void onPrefetchTimeout();
     void onSelChangedTimeout();
     void onClosingEditor(QWidget* editor, QAbstractItemDelegate::EndEditHint hint);
     void scrollSmoothly();
+    void onRowCountChanged();
+    void onScrollSettled();
 
    Q_SIGNALS:
     void clicked(int type, const std::shared_ptr<const Fm::FileInfo>& file);
@@ -177,6 +201,21 @@ class LIBFM_QT_API FolderView : public QWidget {
     void dropIsDecided(bool accepted);
 
    private:
+    FolderItemDelegate* itemDelegate() const;
+
+    // measures how fast |view| scrolls, to paint placeholders while it scrolls fast
+    void watchScrolling(QAbstractItemView* itemView);
+    void onScrolled(const QScrollBar* bar, int value);
+    void setFastScrolling(bool fast);
+
+    // lists the folder at |index| ahead if it stays under the mouse or the keyboard focus
+    void schedulePrefetch(const QModelIndex& index);
+
+    // add the rows of |selection| to selRows_ or selStats_, or remove them when |sign| is -1
+    void addToSelectedRows(const QItemSelection& selection, int sign) const;
+    void addToSelectionStats(const QItemSelection& selection, int sign) const;
+    void addToSelectionStats(const std::shared_ptr<const Fm::FileInfo>& file, int sign) const;
+
     QAbstractItemView* view;
     ProxyFolderModel* model_;
     ViewMode mode;
@@ -186,10 +225,17 @@ class LIBFM_QT_API FolderView : public QWidget {
     QTimer* autoSelectionTimer_;
     QModelIndex lastAutoSelectionIndex_;
     QTimer* selChangedTimer_;
+    mutable SelectionStats selStats_;
+    mutable bool selStatsValid_;  // false until selStats_ is counted again
+    mutable RowRangeSet selRows_;
+    mutable bool selRowsValid_;  // false until selRows_ is built again
+    QTimer* prefetchTimer_;
+    Fm::FilePath prefetchPath_;
     // the cell margins in the icon and thumbnail modes
     QSize itemDelegateMargins_;
     bool shadowHidden_;
     bool scrollPerPixel_;
+    bool uniformItemSizes_;  // whether the items of the compact mode have one size
     bool ctrlRightClick_;  // show folder context menu with Ctrl + right click
 
     // smooth scrolling:
@@ -200,6 +246,14 @@ class LIBFM_QT_API FolderView : public QWidget {
     QList<scrollData> queuedScrollSteps_;
     QTimer* smoothScrollTimer_;
 
+    // the scrolling speed, measured over short spans
+    const QScrollBar* scrollBar_;  // the last one moved
+    int scrollValue_;
+    int scrollDistance_;  // since |scrollClock_| was started
+    QElapsedTimer scrollClock_;
+    QTimer* scrollSettleTimer_;
+    bool fastScrolling_;
+
     QList<int> customColumnWidths_;
     QSet<int> hiddenColumns_;
 };
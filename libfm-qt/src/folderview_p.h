@@ -45,6 +45,7 @@ class FolderViewListView : public QListView {
     void dragMoveEvent(QDragMoveEvent* e) override;
     void dragLeaveEvent(QDragLeaveEvent* e) override;
     void dropEvent(QDropEvent* e) override;
+    void paintEvent(QPaintEvent* event) override;
 
     QModelIndex indexAt(const QPoint& point) const override;
 
@@ -20,7 +20,14 @@
 #include "libfmqt.h"
 #include <QLocale>
 #include <QPixmapCache>
+#include "core/cacheregistry.h"
+#include "core/iconinfo.h"
+#include "core/memorystats.h"
+#include "core/mimetype.h"
+#include "core/thumbnailjob.h"
 #include "core/thumbnailer.h"
+#include "cachedfoldermodel.h"
+#include "foldermodel.h"
 #include "xdndworkaround.h"
 #include "core/vfs/fm-file.h"
 #include "core/legacy/fm-config.h"
@@ -33,6 +40,7 @@ struct LibFmQtData {
 
     QTranslator translator;
     XdndWorkaround workaround;
+    std::shared_ptr<CacheRegistry> caches;
     int refCount;
     Q_DISABLE_COPY(LibFmQtData)
 };
@@ -40,20 +48,26 @@ struct LibFmQtData {
 static LibFmQtData* theLibFmData = nullptr;
 
 extern "C" {
-GFile* _fm_vfs_search_new_for_uri(const char* uri);  // defined in vfs-search.c
+GFile* _fm_vfs_search_new_for_uri(const char* uri);   // defined in vfs-search.c
+GFile* _fm_vfs_archive_new_for_uri(const char* uri);  // defined in vfs-archive.c
 }
 
 static GFile* lookupSearchUri(GVfs* /*vfs*/, const char* identifier, gpointer /*user_data*/) {
     return _fm_vfs_search_new_for_uri(identifier);
 }
 
+static GFile* lookupArchiveUri(GVfs* /*vfs*/, const char* identifier, gpointer /*user_data*/) {
+    return _fm_vfs_archive_new_for_uri(identifier);
+}
+
 LibFmQtData::LibFmQtData() : refCount(1) {
 #if !GLIB_CHECK_VERSION(2, 36, 0)
     g_type_init();
 #endif
     // turn on glib debug message
     // g_setenv("G_MESSAGES_DEBUG", "all", true);
-    Fm::Thumbnailer::loadAll();
+    // the thumbnailers are loaded when the first thumbnail needs them, see Thumbnailer::ensureLoaded()
+    Fm::MimeType::preloadCommonTypes();
     (void)translator.load(QStringLiteral("libfm-qt_") + QLocale::system().name(),
                           QStringLiteral(LIBFM_QT_DATA_DIR) + QStringLiteral("/translations"));
 
@@ -63,6 +77,27 @@ LibFmQtData::LibFmQtData() : refCount(1) {
     // register some URI schemes implemented by libfm
     GVfs* vfs = g_vfs_get_default();
     g_vfs_register_uri_scheme(vfs, "search", lookupSearchUri, nullptr, nullptr, lookupSearchUri, nullptr, nullptr);
+    g_vfs_register_uri_scheme(vfs, "archive", lookupArchiveUri, nullptr, nullptr, lookupArchiveUri, nullptr, nullptr);
+
+    // the caches whose bytes are summed up when asked
+    MemoryStats::setProbe(MemoryStats::IconInfos, &IconInfo::cacheMemory);
+    MemoryStats::setProbe(MemoryStats::FolderModelThumbnails, &FolderModel::thumbnailMemory);
+    MemoryStats::setProbe(MemoryStats::ThumbnailCache, &ThumbnailJob::memoryCacheSize);
+
+    // the caches given back when memory runs short, in the order of their priorities
+    caches = CacheRegistry::globalInstance();
+    caches->add("thumbnail cache", CacheRegistry::DecodedThumbnails, &ThumbnailJob::memoryCacheSize,
+                &ThumbnailJob::clearMemoryCache);
+    caches->add("thumbnails of inactive models", CacheRegistry::DecodedThumbnails, nullptr,
+                &CachedFolderModel::dropUnusedThumbnails);
+    caches->add(
+        "inactive folder models", CacheRegistry::InactiveModels,
+        []() { return static_cast<int64_t>(CachedFolderModel::unusedModelsMemory()); },
+        &CachedFolderModel::deleteUnusedModels);
+    caches->add("icon pixmaps", CacheRegistry::IconPixmaps, nullptr, []() {
+        IconInfo::updateQIcons();
+        QPixmapCache::clear();
+    });
 
     // Initialize the backend registry
 }
@@ -70,8 +105,13 @@ LibFmQtData::LibFmQtData() : refCount(1) {
 LibFmQtData::~LibFmQtData() {
     // Shutdown the backend registry (if needed, though standard C++ cleanup handles unique_ptrs)
 
+    MemoryStats::setProbe(MemoryStats::IconInfos, nullptr);
+    MemoryStats::setProbe(MemoryStats::FolderModelThumbnails, nullptr);
+    MemoryStats::setProbe(MemoryStats::ThumbnailCache, nullptr);
+
     GVfs* vfs = g_vfs_get_default();
     g_vfs_unregister_uri_scheme(vfs, "search");
+    g_vfs_unregister_uri_scheme(vfs, "archive");
 }
 
 LibFmQt::LibFmQt() {
@@ -29,13 +29,18 @@
 #include <QClipboard>
 #include <QApplication>
 #include <QTimer>
+#include <QThreadPool>
+#include <QPointer>
 #include <QDebug>
 #include "pathedit.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace Fm {
 
+QHash<QString, QString> PathBar::remoteRootNames_;
+
 PathBar::PathBar(QWidget* parent) : QWidget(parent), tempPathEdit_(nullptr), toggledBtn_(nullptr) {
     QHBoxLayout* topLayout = new QHBoxLayout(this);
     topLayout->setContentsMargins(0, 0, 0, 0);
@@ -178,18 +183,7 @@ void PathBar::setScrollButtonVisibility() {
 }
 
 Fm::FilePath PathBar::pathForButton(PathButton* btn) {
-    std::string fullPath;
-    int buttonCount = buttonsLayout_->count() - 1;  // the last item is a spacer
-    for (int i = 0; i < buttonCount; ++i) {
-        if (!fullPath.empty() && fullPath.back() != '/') {
-            fullPath += '/';
-        }
-        PathButton* elem = static_cast<PathButton*>(buttonsLayout_->itemAt(i)->widget());
-        fullPath += elem->name();
-        if (elem == btn)
-            break;
-    }
-    return Fm::FilePath::fromPathStr(fullPath.c_str());
+    return btn->path();
 }
 
 void PathBar::onButtonToggled(bool checked) {
@@ -241,7 +235,7 @@ void PathBar::setPath(Fm::FilePath path) {
     if (oldPath && currentPath_.isPrefixOf(oldPath)) {
         for (int i = buttonCount - 1; i >= 0; --i) {
             auto btn = static_cast<PathButton*>(buttonsLayout_->itemAt(i)->widget());
-            if (pathForButton(btn) == currentPath_) {
+            if (btn->path() == currentPath_) {
                 btn->setChecked(true);  // toggle the button
                 /* we don't need to emit chdir signal here since later
                  * toggled signal will be triggered on the button, which
@@ -251,55 +245,51 @@ void PathBar::setPath(Fm::FilePath path) {
         }
     }
 
-    /* FIXME: if the new path is the subdir of our full path, actually
-     *        we can append several new buttons rather than re-create
-     *        all of the buttons. This can reduce flickers. */
+    // the elements of the new path, from its root
+    std::vector<Fm::FilePath> elements;
+    for (auto btnPath = currentPath_; btnPath;) {
+        elements.push_back(btnPath);
+        auto parent = btnPath.parent();
+        // FIXME: some buggy uri types, such as menu://, fail to return NULL when there is no parent path.
+        // Instead, the path itself is returned. So we check if the parent path is the same as current path.
+        if (!parent.isValid() || parent == btnPath) {
+            break;
+        }
+        btnPath = std::move(parent);
+    }
+    std::reverse(elements.begin(), elements.end());
+
+    // keep the buttons of the elements shared with the old path, and only replace the rest
+    int kept = 0;
+    while (kept < buttonCount && kept < static_cast<int>(elements.size()) &&
+           static_cast<PathButton*>(buttonsLayout_->itemAt(kept)->widget())->path() == elements[kept]) {
+        ++kept;
+    }
 
     setUpdatesEnabled(false);
     toggledBtn_ = nullptr;
-    // we do not have the path in the buttons list
-    // destroy existing path element buttons and the spacer
+    // destroy the other path element buttons and the spacer
     QLayoutItem* item;
-    while ((item = buttonsLayout_->takeAt(0)) != nullptr) {
+    while ((item = buttonsLayout_->takeAt(kept)) != nullptr) {
         delete item->widget();
         delete item;
     }
 
-    // create new buttons for the new path
-    auto btnPath = currentPath_;
-    while (btnPath) {
-        std::string name;
+    // create new buttons for the rest of the new path
+    for (int i = kept; i < static_cast<int>(elements.size()); ++i) {
+        const Fm::FilePath& btnPath = elements[i];
+        const bool isRoot = i == 0;
         QString displayName;
-        auto parent = btnPath.parent();
-        // FIXME: some buggy uri types, such as menu://, fail to return NULL when there is no parent path.
-        // Instead, the path itself is returned. So we check if the parent path is the same as current path.
-        auto isRoot = !parent.isValid() || parent == btnPath;
         if (isRoot) {
-            displayName = QString::fromUtf8(btnPath.displayName().get());
-            name = btnPath.toString().get();
+            displayName = rootDisplayName(btnPath);
         }
         else {
             displayName = QString::fromUtf8(btnPath.baseName().get());
-            // NOTE: "name" is used for making the path from its components in PathBar::pathForButton().
-            // In places like folders inside trashes of mounted volumes, FilePath::baseName() cannot be
-            // used for making a full path. On the other hand, the base name of FilePath::displayName()
-            // causes trouble when a file name contains newline or tab.
-            //
-            // Therefore, we simply set "name" to the last component of FilePath::toString().
-            auto pathStr = QString::fromUtf8(btnPath.toString().get());
-            pathStr = pathStr.section(QLatin1Char('/'), -1);
-            name = pathStr.toStdString();
         }
-        // double ampersands to distinguish them from mnemonics
-        displayName.replace(QLatin1Char('&'), QLatin1StringView("&&"));
-        auto btn = new PathButton(name, displayName, isRoot, buttonsWidget_);
+        auto btn = new PathButton(btnPath, displayName, isRoot, buttonsWidget_);
         btn->show();
         connect(btn, &QAbstractButton::toggled, this, &PathBar::onButtonToggled);
-        buttonsLayout_->insertWidget(0, btn);
-        if (isRoot) {  // this is the root element of the path
-            break;
-        }
-        btnPath = parent;
+        buttonsLayout_->addWidget(btn);
     }
     buttonsLayout_->addStretch(1);  // add a spacer at the tail of the buttons
 
@@ -320,6 +310,44 @@ void PathBar::setPath(Fm::FilePath path) {
     setUpdatesEnabled(true);
 }
 
+QString PathBar::rootDisplayName(const Fm::FilePath& root) {
+    if (root.isNative()) {
+        return QString::fromUtf8(root.displayName().get());
+    }
+    // GIO may ask the daemon behind a remote location for its display name, so that is done in
+    // a worker thread, with the URI shown meanwhile
+    const QString uri = QString::fromUtf8(root.toString().get());
+    auto it = remoteRootNames_.constFind(uri);
+    if (it != remoteRootNames_.constEnd()) {
+        return it.value();
+    }
+    QPointer<PathBar> self{this};
+    QThreadPool::globalInstance()->start([self, root, uri] {
+        const QString name = QString::fromUtf8(root.displayName().get());
+        QMetaObject::invokeMethod(
+            qApp,
+            [self, uri, name] {
+                remoteRootNames_.insert(uri, name);
+                if (self) {
+                    self->onRootDisplayNameResolved(uri, name);
+                }
+            },
+            Qt::QueuedConnection);
+    });
+    return uri;
+}
+
+void PathBar::onRootDisplayNameResolved(const QString& uri, const QString& name) {
+    if (buttonsLayout_->count() <= 1) {
+        return;
+    }
+    auto root = static_cast<PathButton*>(buttonsLayout_->itemAt(0)->widget());
+    if (QString::fromUtf8(root->path().toString().get()) == uri) {
+        root->setDisplayName(name);
+        updateScrollButtonVisibility();
+    }
+}
+
 void PathBar::openEditor() {
     if (tempPathEdit_ == nullptr) {
         tempPathEdit_ = new PathEdit(this);
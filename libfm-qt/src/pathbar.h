@@ -22,6 +22,7 @@
 
 #include "libfmqtglobals.h"
 #include <QWidget>
+#include <QHash>
 #include "core/filepath.h"
 
 class QToolButton;
@@ -70,6 +71,9 @@ class LIBFM_QT_API PathBar : public QWidget {
    private:
     void updateScrollButtonVisibility();
     Fm::FilePath pathForButton(PathButton* btn);
+    // the display name of the root of a path, from remoteRootNames_ for a remote one
+    QString rootDisplayName(const Fm::FilePath& root);
+    void onRootDisplayNameResolved(const QString& uri, const QString& name);
 
    private:
     QToolButton* scrollToStart_;
@@ -81,6 +85,9 @@ class LIBFM_QT_API PathBar : public QWidget {
 
     Fm::FilePath currentPath_;  // currently active path
     PathButton* toggledBtn_;
+
+    // display names of remote roots by URI, shared by all path bars (GUI thread only)
+    static QHash<QString, QString> remoteRootNames_;
 };
 
 }  // namespace Fm
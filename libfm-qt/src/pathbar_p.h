@@ -25,15 +25,16 @@
 #include <QEvent>
 #include <QMouseEvent>
 #include <QString>
-#include <string>
+
+#include "core/filepath.h"
 
 namespace Fm {
 
 class PathButton : public QToolButton {
     Q_OBJECT
    public:
-    PathButton(std::string name, QString displayName, bool isRoot = false, QWidget* parent = nullptr)
-        : QToolButton(parent), name_{name} {
+    PathButton(Fm::FilePath path, const QString& displayName, bool isRoot = false, QWidget* parent = nullptr)
+        : QToolButton(parent), path_{std::move(path)} {
         setSizePolicy(QSizePolicy::Fixed, QSizePolicy::MinimumExpanding);
         setCheckable(true);
         setAutoExclusive(true);
@@ -42,7 +43,7 @@ class PathButton : public QToolButton {
         int icnSize = style()->pixelMetric(QStyle::PM_ToolBarIconSize);
         setIconSize(QSize(icnSize, icnSize));
 
-        setText(displayName.replace(QLatin1Char('\n'), QLatin1Char(' ')));  // single-line text
+        setDisplayName(displayName);
 
         if (isRoot) { /* this element is root */
             QIcon icon = QIcon::fromTheme(QStringLiteral("drive-harddisk"));
@@ -50,6 +51,12 @@ class PathButton : public QToolButton {
         }
     }
 
+    void setDisplayName(QString displayName) {
+        // single-line text, with ampersands doubled to distinguish them from mnemonics
+        displayName.replace(QLatin1Char('\n'), QLatin1Char(' ')).replace(QLatin1Char('&'), QLatin1StringView("&&"));
+        setText(displayName);
+    }
+
     void changeEvent(QEvent* event) override {
         QToolButton::changeEvent(event);
         if (event->type() == QEvent::StyleChange) {
@@ -58,12 +65,11 @@ class PathButton : public QToolButton {
         }
     }
 
-    std::string name() const { return name_; }
-
-    void setName(const std::string& name) { name_ = name; }
+    // the path the button stands for, kept so that it is never parsed again
+    const Fm::FilePath& path() const { return path_; }
 
    private:
-    std::string name_;
+    Fm::FilePath path_;
 };
 
 }  // namespace Fm
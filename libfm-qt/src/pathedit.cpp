@@ -28,9 +28,18 @@
 #include <QKeyEvent>
 #include <QDir>
 #include <QTimer>
+#include <algorithm>
+#include "core/folder.h"
 
 namespace Fm {
 
+namespace {
+
+// rows beyond this are left out of the model until typing narrows the matches down
+constexpr int kMaxCompletionRows = 256;
+
+}  // namespace
+
 void PathEditJob::runJob() {
     GError* err = nullptr;
     GFileEnumerator* enu =
@@ -70,7 +79,11 @@ void PathEditJob::runJob() {
 }
 
 PathEdit::PathEdit(QWidget* parent)
-    : QLineEdit(parent), completer_(new QCompleter()), model_(new QStringListModel()), cancellable_(nullptr) {
+    : QLineEdit(parent),
+      completer_(new QCompleter()),
+      model_(new QStringListModel()),
+      cancellable_(nullptr),
+      modelComplete_(false) {
     completer_->setCaseSensitivity(Qt::CaseInsensitive);
     // we sorted the subdir list case-insensitively, so we do the same thing
     // here for performance improvements (see Qt doc)
@@ -193,6 +206,11 @@ void PathEdit::onTextEdited(const QString& text) {
         return;
     }
     lastTypedText_ = text;
+    // in the same directory, narrow the model down before the completer looks at it
+    if (!dirNames_.isEmpty() && text.lastIndexOf(QLatin1Char('/')) + 1 == currentPrefix_.length() &&
+        text.startsWith(currentPrefix_)) {
+        updateModel(false);
+    }
 }
 
 void PathEdit::onTextChanged(const QString& text) {
@@ -231,6 +249,25 @@ void PathEdit::reloadCompleter(bool triggeredByFocusInEvent) {
     if (cancellable_) {
         g_cancellable_cancel(cancellable_);
         g_object_unref(cancellable_);
+        cancellable_ = nullptr;
+    }
+    dirNames_.clear();
+    model_->setStringList(QStringList());
+
+    // a folder that is already loaded, e.g. by a view, need not be listed again
+    auto folder = Folder::findByPath(FilePath::fromPathStr(currentPrefix_.toLocal8Bit().constData()));
+    if (folder && folder->isLoaded()) {
+        for (const auto& file : folder->files()) {
+            if (file->isDir()) {
+                dirNames_.append(file->displayName() + QLatin1StringView("/"));
+            }
+        }
+        dirNames_.sort(Qt::CaseInsensitive);
+        updateModel(true);
+        if (hasFocus() && !triggeredByFocusInEvent) {
+            completer_->complete();
+        }
+        return;
     }
 
     // create a new job to do dir listing
@@ -261,20 +298,41 @@ void PathEdit::freeCompleter() {
         g_object_unref(cancellable_);
         cancellable_ = nullptr;
     }
+    dirNames_.clear();
+    modelLeaf_.clear();
     model_->setStringList(QStringList());
 }
 
+void PathEdit::updateModel(bool force) {
+    const QString leaf = text().mid(currentPrefix_.length());
+    // the completer itself filters a model that holds all the matches of a shorter name
+    if (!force && modelComplete_ && leaf.startsWith(modelLeaf_, Qt::CaseInsensitive)) {
+        return;
+    }
+    // the names starting with |leaf| follow one another in the sorted list
+    auto it = std::lower_bound(dirNames_.cbegin(), dirNames_.cend(), leaf, [](const QString& a, const QString& b) {
+        return a.compare(b, Qt::CaseInsensitive) < 0;
+    });
+    QStringList rows;
+    modelComplete_ = true;
+    for (; it != dirNames_.cend() && it->startsWith(leaf, Qt::CaseInsensitive); ++it) {
+        if (rows.size() == kMaxCompletionRows) {
+            modelComplete_ = false;
+            break;
+        }
+        rows.append(currentPrefix_ % *it);
+    }
+    modelLeaf_ = leaf;
+    model_->setStringList(rows);
+}
+
 // This slot is called from main thread so it's safe to access the GUI
 void PathEdit::onJobFinished() {
     PathEditJob* data = static_cast<PathEditJob*>(sender());
     if (!g_cancellable_is_cancelled(data->cancellable)) {
         // update the completer only if the job is not cancelled
-        QStringList::iterator it;
-        for (it = data->subDirs.begin(); it != data->subDirs.end(); ++it) {
-            // qDebug("%s", it->toUtf8().constData());
-            *it = (currentPrefix_ % *it);
-        }
-        model_->setStringList(data->subDirs);
+        dirNames_ = std::move(data->subDirs);
+        updateModel(true);
         // trigger completion manually
         if (hasFocus() && !data->triggeredByFocusInEvent) {
             completer_->complete();
@@ -51,6 +51,8 @@ class LIBFM_QT_API PathEdit : public QLineEdit {
     void reloadCompleter(bool triggeredByFocusInEvent = false);
     void freeCompleter();
     void onJobFinished();
+    // fills the model with the subdirectories whose names start with the typed part of the text
+    void updateModel(bool force);
 
    private:
     QCompleter* completer_;
@@ -58,6 +60,9 @@ class LIBFM_QT_API PathEdit : public QLineEdit {
     QString currentPrefix_;
     GCancellable* cancellable_;
     QString lastTypedText_;
+    QStringList dirNames_;  // of the subdirectories below currentPrefix_, sorted without case
+    QString modelLeaf_;     // the typed name the model was filled for
+    bool modelComplete_;    // whether the model holds all the names starting with |modelLeaf_|
 };
 
 }  // namespace Fm
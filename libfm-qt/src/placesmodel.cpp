@@ -27,21 +27,37 @@
 #include "utilities.h"
 #include "placesmodelitem.h"
 #include "fileoperation.h"
+#include "core/perftrace.h"
 
 namespace Fm {
 
+namespace {
+
+// a hotplug or automount storm reaches the model as one pass of changes
+constexpr int kDeviceUpdateDelay = 100;
+
+}  // namespace
+
 std::weak_ptr<PlacesModel> PlacesModel::globalInstance_;
 
 PlacesModel::PlacesModel(QObject* parent)
     : QStandardItemModel(parent),
+      volumeMonitor(nullptr),
       showApplications_(true),
       showDesktop_(true),
+      showTrash_(true),
+      trashQueryPending_(false),
+      trashItem_(nullptr),
       trashMonitor_(nullptr),
       trashUpdateTimer_(nullptr),
+      deviceUpdateTimer_(new QTimer(this)),
       // FIXME: this seems to be broken when porting to new API.
       ejectIcon_(QIcon::fromTheme(QStringLiteral("media-eject"))) {
     setColumnCount(2);
 
+    deviceUpdateTimer_->setSingleShot(true);
+    connect(deviceUpdateTimer_, &QTimer::timeout, this, &PlacesModel::applyDeviceChanges);
+
     placesRoot = new QStandardItem(tr("Places"));
     placesRoot->setSelectable(false);
     placesRoot->setColumnCount(2);
@@ -88,7 +104,21 @@ PlacesModel::PlacesModel(QObject* parent)
     devicesRoot->setColumnCount(2);
     appendRow(devicesRoot);
 
-    // volumes
+    // the volume monitor may have to ask a daemon, so the first window is not kept waiting for it
+    QTimer::singleShot(0, this, &PlacesModel::loadVolumes);
+
+    // bookmarks
+    bookmarksRoot = new QStandardItem(tr("Bookmarks"));
+    bookmarksRoot->setSelectable(false);
+    bookmarksRoot->setColumnCount(2);
+    appendRow(bookmarksRoot);
+
+    bookmarks = Fm::Bookmarks::globalInstance();
+    loadBookmarks();
+    connect(bookmarks.get(), &Fm::Bookmarks::changed, this, &PlacesModel::onBookmarksChanged);
+}
+
+void PlacesModel::loadVolumes() {
     volumeMonitor = g_volume_monitor_get();
     if (volumeMonitor) {
         g_signal_connect(volumeMonitor, "volume-added", G_CALLBACK(onVolumeAdded), this);
@@ -103,7 +133,7 @@ PlacesModel::PlacesModel(QObject* parent)
         GList* l;
         for (l = vols; l; l = l->next) {
             GVolume* volume = G_VOLUME(l->data);
-            onVolumeAdded(volumeMonitor, volume, this);
+            addVolume(volume);
             g_object_unref(volume);
         }
         g_list_free(vols);
@@ -127,25 +157,13 @@ PlacesModel::PlacesModel(QObject* parent)
                     continue;
                 }
                 else {
-                    PlacesModelItem* item = new PlacesModelMountItem(mount);
-                    QStandardItem* eject_btn = new QStandardItem(ejectIcon_, QString());
-                    devicesRoot->appendRow(QList<QStandardItem*>() << item << eject_btn);
+                    appendMountItem(mount);
                 }
             }
             g_object_unref(mount);
         }
         g_list_free(vols);
     }
-
-    // bookmarks
-    bookmarksRoot = new QStandardItem(tr("Bookmarks"));
-    bookmarksRoot->setSelectable(false);
-    bookmarksRoot->setColumnCount(2);
-    appendRow(bookmarksRoot);
-
-    bookmarks = Fm::Bookmarks::globalInstance();
-    loadBookmarks();
-    connect(bookmarks.get(), &Fm::Bookmarks::changed, this, &PlacesModel::onBookmarksChanged);
 }
 
 void PlacesModel::loadBookmarks() {
@@ -173,6 +191,9 @@ PlacesModel::~PlacesModel() {
     for (GMount* const mount : std::as_const(shadowedMounts_)) {
         g_object_unref(mount);
     }
+    for (const PendingDevice& device : std::as_const(pendingDevices_)) {
+        g_object_unref(device.object);
+    }
 }
 
 // static
@@ -187,6 +208,7 @@ void PlacesModel::onTrashChanged(GFileMonitor* /*monitor*/,
 }
 
 void PlacesModel::updateTrash() {
+    PerfTrace::add(PerfTrace::WakeupTrashUpdate);
     struct UpdateTrashData {
         QPointer<PlacesModel> model;
         GFile* gf;
@@ -221,16 +243,38 @@ void PlacesModel::updateTrash() {
 }
 
 void PlacesModel::createTrashItem() {
-    GFile* gf;
-    gf = g_file_new_for_uri("trash:///");
-    // check if trash is supported by the current vfs
-    // if gvfs is not installed, this can be unavailable.
-    if (!g_file_query_exists(gf, nullptr)) {
-        g_object_unref(gf);
-        trashItem_ = nullptr;
-        trashMonitor_ = nullptr;
+    struct TrashQueryData {
+        QPointer<PlacesModel> model;
+        GFile* gf;
+        TrashQueryData(PlacesModel* _model) : model(_model) { gf = g_file_new_for_uri("trash:///"); }
+        ~TrashQueryData() { g_object_unref(gf); }
+    };
+
+    if (trashQueryPending_) {
         return;
     }
+    trashQueryPending_ = true;
+    // check if trash is supported by the current vfs; if gvfs is not installed, this can be
+    // unavailable. Asking gvfsd may take a while, so the item is added when the answer comes.
+    TrashQueryData* data = new TrashQueryData(this);
+    g_file_query_info_async(
+        data->gf, G_FILE_ATTRIBUTE_STANDARD_TYPE, G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT, nullptr,
+        [](GObject* /*source_object*/, GAsyncResult* res, gpointer user_data) {
+            TrashQueryData* data = reinterpret_cast<TrashQueryData*>(user_data);
+            Fm::GFileInfoPtr inf{g_file_query_info_finish(data->gf, res, nullptr), false};
+            if (PlacesModel* _this = data->model.data()) {
+                _this->trashQueryPending_ = false;
+                // the trash may have been hidden again while we were waiting
+                if (inf && _this->showTrash_ && !_this->trashItem_) {
+                    _this->addTrashItem(data->gf);
+                }
+            }
+            delete data;
+        },
+        data);
+}
+
+void PlacesModel::addTrashItem(GFile* gf) {
     trashItem_ = new PlacesModelItem("user-trash", tr("Trash"), Fm::FilePath::fromUri("trash:///"));
 
     trashMonitor_ = g_file_monitor_directory(gf, G_FILE_MONITOR_NONE, nullptr, nullptr);
@@ -242,7 +286,6 @@ void PlacesModel::createTrashItem() {
         }
         g_signal_connect(trashMonitor_, "changed", G_CALLBACK(onTrashChanged), this);
     }
-    g_object_unref(gf);
 
     placesRoot->insertRow(desktopItem->row() + 1, trashItem_);
     QTimer::singleShot(0, this, SLOT(updateTrash()));
@@ -261,6 +304,7 @@ void PlacesModel::setShowDesktop(bool show) {
 }
 
 void PlacesModel::setShowTrash(bool show) {
+    showTrash_ = show;
     if (show) {
         if (!trashItem_) {
             createTrashItem();
@@ -307,31 +351,11 @@ PlacesModelItem* PlacesModel::itemFromPath(QStandardItem* rootItem, const Fm::Fi
 }
 
 PlacesModelVolumeItem* PlacesModel::itemFromVolume(GVolume* volume) {
-    int rowCount = devicesRoot->rowCount();
-    for (int i = 0; i < rowCount; ++i) {
-        PlacesModelItem* item = static_cast<PlacesModelItem*>(devicesRoot->child(i, 0));
-        if (item->type() == PlacesModelItem::Volume) {
-            PlacesModelVolumeItem* volumeItem = static_cast<PlacesModelVolumeItem*>(item);
-            if (volumeItem->volume() == volume) {
-                return volumeItem;
-            }
-        }
-    }
-    return nullptr;
+    return volumeItems_.value(volume, nullptr);
 }
 
 PlacesModelMountItem* PlacesModel::itemFromMount(GMount* mount) {
-    int rowCount = devicesRoot->rowCount();
-    for (int i = 0; i < rowCount; ++i) {
-        PlacesModelItem* item = static_cast<PlacesModelItem*>(devicesRoot->child(i, 0));
-        if (item->type() == PlacesModelItem::Mount) {
-            PlacesModelMountItem* mountItem = static_cast<PlacesModelMountItem*>(item);
-            if (mountItem->mount() == mount) {
-                return mountItem;
-            }
-        }
-    }
-    return nullptr;
+    return mountItems_.value(mount, nullptr);
 }
 
 PlacesModelBookmarkItem* PlacesModel::itemFromBookmark(std::shared_ptr<const Fm::BookmarkItem> bkitem) {
@@ -345,19 +369,138 @@ PlacesModelBookmarkItem* PlacesModel::itemFromBookmark(std::shared_ptr<const Fm:
     return nullptr;
 }
 
+// static
 void PlacesModel::onMountAdded(GVolumeMonitor* /*monitor*/, GMount* mount, PlacesModel* pThis) {
+    pThis->queueDeviceChange(mount, false, DeviceAdded);
+}
+
+// static
+void PlacesModel::onMountChanged(GVolumeMonitor* /*monitor*/, GMount* mount, PlacesModel* pThis) {
+    pThis->queueDeviceChange(mount, false, DeviceChanged);
+}
+
+// static
+void PlacesModel::onMountRemoved(GVolumeMonitor* /*monitor*/, GMount* mount, PlacesModel* pThis) {
+    pThis->queueDeviceChange(mount, false, DeviceRemoved);
+}
+
+// static
+void PlacesModel::onVolumeAdded(GVolumeMonitor* /*monitor*/, GVolume* volume, PlacesModel* pThis) {
+    pThis->queueDeviceChange(volume, true, DeviceAdded);
+}
+
+// static
+void PlacesModel::onVolumeChanged(GVolumeMonitor* /*monitor*/, GVolume* volume, PlacesModel* pThis) {
+    pThis->queueDeviceChange(volume, true, DeviceChanged);
+}
+
+// static
+void PlacesModel::onVolumeRemoved(GVolumeMonitor* /*monitor*/, GVolume* volume, PlacesModel* pThis) {
+    pThis->queueDeviceChange(volume, true, DeviceRemoved);
+}
+
+void PlacesModel::queueDeviceChange(gpointer object, bool isVolume, DeviceChange change) {
+    auto it = pendingDeviceIndexes_.constFind(static_cast<GObject*>(object));
+    if (it == pendingDeviceIndexes_.constEnd()) {
+        pendingDeviceIndexes_.insert(static_cast<GObject*>(object), pendingDevices_.size());
+        pendingDevices_.append(PendingDevice{G_OBJECT(g_object_ref(object)), isVolume, change});
+    }
+    else {
+        // only the end state matters: a removal undoes what came before it, and a device added
+        // within the burst is read afresh anyway
+        unsigned& changes = pendingDevices_[it.value()].changes;
+        switch (change) {
+            case DeviceRemoved:
+                changes = DeviceRemoved;
+                break;
+            case DeviceAdded:
+                changes |= DeviceAdded;
+                break;
+            case DeviceChanged:
+                if (!(changes & (DeviceAdded | DeviceRemoved))) {
+                    changes |= DeviceChanged;
+                }
+                break;
+        }
+    }
+    if (!deviceUpdateTimer_->isActive()) {
+        deviceUpdateTimer_->start(kDeviceUpdateDelay);
+    }
+}
+
+void PlacesModel::applyDeviceChanges() {
+    const QList<PendingDevice> pending = std::move(pendingDevices_);
+    pendingDevices_.clear();
+    pendingDeviceIndexes_.clear();
+
+    // volumes first, as a mount of a volume is shown by the item of its volume
+    for (const bool volumes : {true, false}) {
+        for (const PendingDevice& device : pending) {
+            if (device.isVolume != volumes) {
+                continue;
+            }
+            if (volumes) {
+                GVolume* volume = G_VOLUME(device.object);
+                if (device.changes & DeviceRemoved) {
+                    removeVolume(volume);
+                }
+                if (device.changes & DeviceAdded) {
+                    addVolume(volume);
+                }
+                if (device.changes & DeviceChanged) {
+                    updateVolume(volume);
+                }
+            }
+            else {
+                GMount* mount = G_MOUNT(device.object);
+                if (device.changes & DeviceRemoved) {
+                    removeMount(mount);
+                }
+                if (device.changes & DeviceAdded) {
+                    addMount(mount);
+                }
+                if (device.changes & DeviceChanged) {
+                    updateMount(mount);
+                }
+            }
+        }
+    }
+
+    for (const PendingDevice& device : pending) {
+        g_object_unref(device.object);
+    }
+}
+
+void PlacesModel::appendMountItem(GMount* mount) {
+    PlacesModelMountItem* item = new PlacesModelMountItem(mount);
+    QStandardItem* eject_btn = new QStandardItem(ejectIcon_, QString());
+    devicesRoot->appendRow(QList<QStandardItem*>() << item << eject_btn);
+    mountItems_.insert(item->mount(), item);
+}
+
+void PlacesModel::removeDeviceItem(PlacesModelItem* item) {
+    if (item->type() == PlacesModelItem::Volume) {
+        volumeItems_.remove(static_cast<PlacesModelVolumeItem*>(item)->volume());
+    }
+    else if (item->type() == PlacesModelItem::Mount) {
+        mountItems_.remove(static_cast<PlacesModelMountItem*>(item)->mount());
+    }
+    devicesRoot->removeRow(item->row());
+}
+
+void PlacesModel::addMount(GMount* mount) {
     // according to gio API doc, a shadowed mount should not be visible to the user
 #if GLIB_CHECK_VERSION(2, 20, 0)
     if (g_mount_is_shadowed(mount)) {
-        if (pThis->shadowedMounts_.indexOf(mount) == -1) {
-            pThis->shadowedMounts_.push_back(G_MOUNT(g_object_ref(mount)));
+        if (shadowedMounts_.indexOf(mount) == -1) {
+            shadowedMounts_.push_back(G_MOUNT(g_object_ref(mount)));
         }
         return;
     }
 #endif
     GVolume* vol = g_mount_get_volume(mount);
     if (vol) {  // mount-added is also emitted when a volume is newly mounted.
-        PlacesModelVolumeItem* item = pThis->itemFromVolume(vol);
+        PlacesModelVolumeItem* item = itemFromVolume(vol);
         if (item) {
             if (!item->path()) {
                 // update the mounted volume
@@ -366,35 +509,32 @@ void PlacesModel::onMountAdded(GVolumeMonitor* /*monitor*/, GMount* mount, Place
             }
             // update the mount indicator (eject button)
             if (QStandardItem* ejectBtn = item->parent()->child(item->row(), 1)) {
-                ejectBtn->setIcon(pThis->ejectIcon_);
+                ejectBtn->setIcon(ejectIcon_);
             }
         }
         g_object_unref(vol);
     }
     else {  // network mounts and others
-        PlacesModelMountItem* item = pThis->itemFromMount(mount);
         /* for some unknown reasons, sometimes we get repeated mount-added
          * signals and added a device more than one. So, make a sanity check here. */
-        if (!item) {
-            item = new PlacesModelMountItem(mount);
-            QStandardItem* eject_btn = new QStandardItem(pThis->ejectIcon_, QString());
-            pThis->devicesRoot->appendRow(QList<QStandardItem*>() << item << eject_btn);
+        if (!itemFromMount(mount)) {
+            appendMountItem(mount);
         }
     }
 }
 
-void PlacesModel::onMountChanged(GVolumeMonitor* monitor, GMount* mount, PlacesModel* pThis) {
+void PlacesModel::updateMount(GMount* mount) {
     gboolean shadowed = FALSE;
     // according to gio API doc, a shadowed mount should not be visible to the user
 #if GLIB_CHECK_VERSION(2, 20, 0)
     shadowed = g_mount_is_shadowed(mount);
     // qDebug() << "changed:" << mount << shadowed;
 #endif
-    PlacesModelMountItem* item = pThis->itemFromMount(mount);
+    PlacesModelMountItem* item = itemFromMount(mount);
     if (item) {
         if (shadowed) {  // if a visible item becomes shadowed, remove it from the model
-            pThis->shadowedMounts_.push_back(G_MOUNT(g_object_ref(mount)));  // remember the shadowed mount
-            pThis->devicesRoot->removeRow(item->row());
+            shadowedMounts_.push_back(G_MOUNT(g_object_ref(mount)));  // remember the shadowed mount
+            removeDeviceItem(item);
         }
         else {  // otherwise, update its status
             item->update();
@@ -403,31 +543,31 @@ void PlacesModel::onMountChanged(GVolumeMonitor* monitor, GMount* mount, PlacesM
     else {
 #if GLIB_CHECK_VERSION(2, 20, 0)
         if (!shadowed) {  // if a mount is unshadowed
-            int i = pThis->shadowedMounts_.indexOf(mount);
+            int i = shadowedMounts_.indexOf(mount);
             if (i != -1) {  // a previously shadowed mount is unshadowed
-                pThis->shadowedMounts_.removeAt(i);
-                onMountAdded(monitor, mount, pThis);  // add it to our model again
+                g_object_unref(shadowedMounts_.takeAt(i));
+                addMount(mount);  // add it to our model again
             }
         }
 #endif
     }
 }
 
-void PlacesModel::onMountRemoved(GVolumeMonitor* monitor, GMount* mount, PlacesModel* pThis) {
+void PlacesModel::removeMount(GMount* mount) {
     GVolume* vol = g_mount_get_volume(mount);
     // qDebug() << "mount removed" << mount << "volume umounted: " << vol;
     if (vol) {
         // a volume is being unmounted
         // NOTE: Due to some problems of gvfs, sometimes the volume does not receive
         // "change" signal so it does not update the eject button. Let's workaround
-        // this by calling onVolumeChanged() handler manually. (This is needed for mtp://)
-        onVolumeChanged(monitor, vol, pThis);
+        // this by calling updateVolume() manually. (This is needed for mtp://)
+        updateVolume(vol);
         g_object_unref(vol);
     }
     else {  // network mounts and others
-        PlacesModelMountItem* item = pThis->itemFromMount(mount);
+        PlacesModelMountItem* item = itemFromMount(mount);
         if (item) {
-            pThis->devicesRoot->removeRow(item->row());
+            removeDeviceItem(item);
         }
     }
 
@@ -435,7 +575,7 @@ void PlacesModel::onMountRemoved(GVolumeMonitor* monitor, GMount* mount, PlacesM
     // NOTE: g_mount_is_shadowed() sometimes returns FALSE here even if the mount is shadowed.
     // I don't know whether this is a bug in gvfs or not.
     // So let's check if its in our list instead.
-    if (pThis->shadowedMounts_.removeOne(mount)) {
+    if (shadowedMounts_.removeOne(mount)) {
         // if this is a shadowed mount
         // qDebug() << "remove shadow mount";
         g_object_unref(mount);
@@ -443,12 +583,12 @@ void PlacesModel::onMountRemoved(GVolumeMonitor* monitor, GMount* mount, PlacesM
 #endif
 }
 
-void PlacesModel::onVolumeAdded(GVolumeMonitor* /*monitor*/, GVolume* volume, PlacesModel* pThis) {
+void PlacesModel::addVolume(GVolume* volume) {
     // the item may have been added with "mount-added" (as in loopback mounting)
     bool itemExists = false;
     GMount* mount = g_volume_get_mount(volume);
     if (mount) {
-        if (pThis->itemFromMount(mount)) {
+        if (itemFromMount(mount)) {
             itemExists = true;
         }
         g_object_unref(mount);
@@ -458,19 +598,20 @@ void PlacesModel::onVolumeAdded(GVolumeMonitor* /*monitor*/, GVolume* volume, Pl
     }
     // for some unknown reasons, sometimes we get repeated volume-added
     // signals and added a device more than one. So, make a sanity check here.
-    PlacesModelVolumeItem* volumeItem = pThis->itemFromVolume(volume);
+    PlacesModelVolumeItem* volumeItem = itemFromVolume(volume);
     if (!volumeItem) {
         volumeItem = new PlacesModelVolumeItem(volume);
         QStandardItem* ejectBtn = new QStandardItem();
         if (volumeItem->isMounted()) {
-            ejectBtn->setIcon(pThis->ejectIcon_);
+            ejectBtn->setIcon(ejectIcon_);
         }
-        pThis->devicesRoot->appendRow(QList<QStandardItem*>() << volumeItem << ejectBtn);
+        devicesRoot->appendRow(QList<QStandardItem*>() << volumeItem << ejectBtn);
+        volumeItems_.insert(volumeItem->volume(), volumeItem);
     }
 }
 
-void PlacesModel::onVolumeChanged(GVolumeMonitor* /*monitor*/, GVolume* volume, PlacesModel* pThis) {
-    PlacesModelVolumeItem* item = pThis->itemFromVolume(volume);
+void PlacesModel::updateVolume(GVolume* volume) {
+    PlacesModelVolumeItem* item = itemFromVolume(volume);
     if (item) {
         item->update();
         QStandardItem* ejectBtn = item->parent()->child(item->row(), 1);
@@ -480,17 +621,17 @@ void PlacesModel::onVolumeChanged(GVolumeMonitor* /*monitor*/, GVolume* volume,
             ejectBtn->setIcon(QIcon());
         }
         else if (ejectBtn->icon().isNull()) {
-            // this function may be called before onMountAdded(),
+            // this function may be called before addMount(),
             // so that the path is set but the eject icon isn't added yet
-            ejectBtn->setIcon(pThis->ejectIcon_);
+            ejectBtn->setIcon(ejectIcon_);
         }
     }
 }
 
-void PlacesModel::onVolumeRemoved(GVolumeMonitor* /*monitor*/, GVolume* volume, PlacesModel* pThis) {
-    PlacesModelVolumeItem* item = pThis->itemFromVolume(volume);
+void PlacesModel::removeVolume(GVolume* volume) {
+    PlacesModelVolumeItem* item = itemFromVolume(volume);
     if (item) {
-        pThis->devicesRoot->removeRow(item->row());
+        removeDeviceItem(item);
     }
 }
 
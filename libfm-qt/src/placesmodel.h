@@ -24,6 +24,7 @@
 #include <QStandardItemModel>
 #include <QStandardItem>
 #include <QList>
+#include <QHash>
 #include <QAction>
 
 #include <memory>
@@ -61,7 +62,7 @@ class LIBFM_QT_API PlacesModel : public QStandardItemModel {
     explicit PlacesModel(QObject* parent = nullptr);
     ~PlacesModel() override;
 
-    bool showTrash() { return trashItem_ != nullptr; }
+    bool showTrash() { return showTrash_; }
     void setShowTrash(bool show);
 
     bool showApplications() { return showApplications_; }
@@ -103,7 +104,30 @@ class LIBFM_QT_API PlacesModel : public QStandardItemModel {
     void createTrashItem();
 
    private:
+    // what happened to a volume or mount since the model last caught up with it
+    enum DeviceChange : unsigned { DeviceRemoved = 1, DeviceAdded = 2, DeviceChanged = 4 };
+
+    struct PendingDevice {
+        GObject* object;  // a GVolume or GMount, referenced while pending
+        bool isVolume;
+        unsigned changes;
+    };
+
     void loadBookmarks();
+    void loadVolumes();
+    void addTrashItem(GFile* trash);
+
+    void queueDeviceChange(gpointer object, bool isVolume, DeviceChange change);
+    void applyDeviceChanges();
+
+    void addVolume(GVolume* volume);
+    void removeVolume(GVolume* volume);
+    void updateVolume(GVolume* volume);
+    void addMount(GMount* mount);
+    void removeMount(GMount* mount);
+    void updateMount(GMount* mount);
+    void appendMountItem(GMount* mount);
+    void removeDeviceItem(PlacesModelItem* item);
 
     static void onVolumeAdded(GVolumeMonitor* monitor, GVolume* volume, PlacesModel* pThis);
     static void onVolumeRemoved(GVolumeMonitor* monitor, GVolume* volume, PlacesModel* pThis);
@@ -126,9 +150,16 @@ class LIBFM_QT_API PlacesModel : public QStandardItemModel {
     QStandardItem* placesRoot;
     QStandardItem* devicesRoot;
     QStandardItem* bookmarksRoot;
+    bool showTrash_;
+    bool trashQueryPending_;
     PlacesModelItem* trashItem_;
     GFileMonitor* trashMonitor_;
     QTimer* trashUpdateTimer_;
+    QTimer* deviceUpdateTimer_;
+    QList<PendingDevice> pendingDevices_;              // in the order they first changed
+    QHash<GObject*, qsizetype> pendingDeviceIndexes_;  // into pendingDevices_
+    QHash<GVolume*, PlacesModelVolumeItem*> volumeItems_;
+    QHash<GMount*, PlacesModelMountItem*> mountItems_;
     PlacesModelItem* desktopItem;
     PlacesModelItem* homeItem;
     PlacesModelItem* computerItem;
@@ -22,10 +22,98 @@
 #include <QCollator>
 #include <QApplication>
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <map>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 namespace Fm {
 
+namespace {
+
+// below this many unsorted files, starting threads costs more than the sort keys they share
+constexpr std::size_t kMinParallelSortRecords = 1024;
+constexpr unsigned int kMaxSortThreads = 8;
+// the rows shown in sort order while a folder is listed, more than a screen holds
+constexpr std::size_t kPartialSortRows = 512;
+
+bool isTextColumn(int column) {
+    return column != FolderModel::ColumnFileMTime && column != FolderModel::ColumnFileCrTime &&
+           column != FolderModel::ColumnFileDTime && column != FolderModel::ColumnFileSize;
+}
+
+}  // namespace
+
+struct ProxyFolderModel::SortRecord {
+    // A part of the text of the sort column; to have a more natural sorting like that of GTK,
+    // dots are considered as separators and the parts are compared from left to right.
+    struct Part {
+        QCollatorSortKey key;
+        int size;
+        int end;  // the index of the dot after the part, -1 for the last part
+    };
+
+    // |text| is the text of the sort column when that is a text column, null otherwise
+    SortRecord(const QCollator& collator, std::shared_ptr<const Fm::FileInfo> fileInfo, const QString* text)
+        : info{std::move(fileInfo)},
+          mtime{info->mtime()},
+          crtime{info->crtime()},
+          dtime{info->dtime()},
+          size{info->size()},
+          isDir{info->isDir()},
+          isHidden{info->isHidden()},
+          displayNameKey{collator.sortKey(info->displayName())} {
+        // QString::split() is not used because some dots may not be needed.
+        for (int start = 0; text;) {
+            const int end = text->indexOf(QLatin1Char('.'), start);
+            const QString part = text->sliced(start, (end == -1 ? text->size() : end) - start);
+            parts.push_back(Part{collator.sortKey(part), static_cast<int>(part.size()), end});
+            if (end == -1) {
+                break;
+            }
+            start = end + 1;
+        }
+    }
+
+    std::shared_ptr<const Fm::FileInfo> info;
+    quint64 mtime;
+    quint64 crtime;
+    quint64 dtime;
+    quint64 size;
+    bool isDir;
+    bool isHidden;
+    QCollatorSortKey displayNameKey;
+    std::vector<Part> parts;  // empty unless a text column is sorted
+};
+
+struct ProxyFolderModel::SortRecords {
+    // by the address of the file info, which each record keeps alive
+    std::unordered_map<const Fm::FileInfo*, std::shared_ptr<SortRecord>> records;
+};
+
+// static
+std::shared_ptr<ProxyFolderModel::SortRecords> ProxyFolderModel::sharedSortRecords(const QAbstractItemModel* model,
+                                                                                   int column,
+                                                                                   Qt::CaseSensitivity cs) {
+    // The records of a non-text column hold no text, so they serve every such column. A folder
+    // shown in several views thus has its sort keys made once when they sort it by the same column.
+    using Key = std::tuple<const QAbstractItemModel*, int, Qt::CaseSensitivity>;
+    static std::map<Key, std::weak_ptr<SortRecords>> shared;
+    for (auto it = shared.begin(); it != shared.end();) {
+        it = it->second.expired() ? shared.erase(it) : std::next(it);
+    }
+    std::weak_ptr<SortRecords>& weak = shared[Key{model, isTextColumn(column) ? column : -1, cs}];
+    std::shared_ptr<SortRecords> records = weak.lock();
+    if (!records) {
+        records = std::make_shared<SortRecords>();
+        weak = records;
+    }
+    return records;
+}
+
 ProxyFolderModel::ProxyFolderModel(QObject* parent)
     : QSortFilterProxyModel(parent),
       showHidden_(false),
@@ -33,7 +121,12 @@ ProxyFolderModel::ProxyFolderModel(QObject* parent)
       folderFirst_(true),
       hiddenLast_(false),
       showThumbnails_(false),
-      thumbnailSize_(0) {
+      thumbnailSize_(0),
+      thumbnailsSuspended_(false),
+      sortRecordsColumn_(-1),
+      partialSort_(false),
+      partialSortDropped_(false),
+      narrowing_(false) {
     setDynamicSortFilter(true);
     setSortCaseSensitivity(Qt::CaseInsensitive);
 
@@ -55,6 +148,19 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
     if (model == sourceModel())  // avoid setting the same model twice
         return;
     FolderModel* oldSrcModel = static_cast<FolderModel*>(sourceModel());
+    if (oldSrcModel) {
+        disconnect(oldSrcModel, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanged);
+        disconnect(oldSrcModel, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+                   &ProxyFolderModel::onSourceRowsAboutToBeRemoved);
+        disconnect(oldSrcModel, &QAbstractItemModel::modelAboutToBeReset, this, &ProxyFolderModel::clearSortRecords);
+        if (const auto& folder = oldSrcModel->folder()) {
+            disconnect(folder.get(), nullptr, this, nullptr);
+        }
+    }
+    sortRecords_.reset();
+    partialSort_ = false;
+    firstRecords_.clear();
+    firstFiles_.clear();
     if (model) {
         // we only support Fm::FolderModel
         Q_ASSERT(model->inherits("Fm::FolderModel"));
@@ -70,6 +176,18 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
                 connect(newSrcModel, &FolderModel::thumbnailLoaded, this, &ProxyFolderModel::onThumbnailLoaded);
             }
         }
+        // connected before QSortFilterProxyModel is, so that changed files are sorted with fresh records
+        connect(model, &QAbstractItemModel::dataChanged, this, &ProxyFolderModel::onSourceDataChanged);
+        connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this,
+                &ProxyFolderModel::onSourceRowsAboutToBeRemoved);
+        connect(model, &QAbstractItemModel::modelAboutToBeReset, this, &ProxyFolderModel::clearSortRecords);
+        if (const auto& folder = static_cast<FolderModel*>(model)->folder()) {
+            connect(folder.get(), &Fm::Folder::startLoading, this, &ProxyFolderModel::onFolderStartLoading);
+            connect(folder.get(), &Fm::Folder::finishLoading, this, &ProxyFolderModel::endPartialSort);
+            if (!folder->isLoaded()) {  // the rows listed so far are filtered when the model is set
+                beginPartialSort(*folder);
+            }
+        }
     }
     QSortFilterProxyModel::setSourceModel(model);
 }
@@ -77,6 +195,9 @@ void ProxyFolderModel::setSourceModel(QAbstractItemModel* model) {
 void ProxyFolderModel::sort(int column, Qt::SortOrder order) {
     int oldColumn = sortColumn();
     Qt::SortOrder oldOrder = sortOrder();
+    if (column != oldColumn || order != oldOrder) {
+        endPartialSort();  // the first rows kept are those of the old order
+    }
     QSortFilterProxyModel::sort(column, order);
     if (column != oldColumn || order != oldOrder) {
         Q_EMIT sortFilterChanged();
@@ -104,6 +225,7 @@ void ProxyFolderModel::setBackupAsHidden(bool backupAsHidden) {
 // need to call invalidateFilter() manually.
 void ProxyFolderModel::setFolderFirst(bool folderFirst) {
     if (folderFirst != folderFirst_) {
+        endPartialSort();
         folderFirst_ = folderFirst;
         invalidate();
         Q_EMIT sortFilterChanged();
@@ -112,6 +234,7 @@ void ProxyFolderModel::setFolderFirst(bool folderFirst) {
 
 void ProxyFolderModel::setHiddenLast(bool hiddenLast) {
     if (hiddenLast != hiddenLast_) {
+        endPartialSort();
         hiddenLast_ = hiddenLast;
         invalidate();
         Q_EMIT sortFilterChanged();
@@ -119,119 +242,302 @@ void ProxyFolderModel::setHiddenLast(bool hiddenLast) {
 }
 
 void ProxyFolderModel::setSortCaseSensitivity(Qt::CaseSensitivity cs) {
+    endPartialSort();
     collator_.setCaseSensitivity(cs);
+    sortRecords_.reset();
     QSortFilterProxyModel::setSortCaseSensitivity(cs);
     invalidate();
     Q_EMIT sortFilterChanged();
 }
 
 bool ProxyFolderModel::filterAcceptsRow(int source_row, const QModelIndex& source_parent) const {
-    if (!showHidden_) {
-        if (FolderModel* srcModel = static_cast<FolderModel*>(sourceModel())) {
-            auto info = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
-            if (info && (info->isHidden() || (backupAsHidden_ && info->isBackup()))) {
-                return false;
-            }
-        }
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if (!srcModel) {
+        return true;
+    }
+    const FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(source_row, 0, source_parent));
+    if (!item) {
+        return true;
+    }
+    const auto& info = item->info;
+    if (narrowing_ && narrowedFiles_.count(info.get()) == 0) {
+        return false;
+    }
+    if (!showHidden_ && (info->isHidden() || (backupAsHidden_ && info->isBackup()))) {
+        return false;
     }
     // apply additional filters if there're any
     for (ProxyFolderModelFilter* const filter : std::as_const(filters_)) {
-        if (FolderModel* srcModel = static_cast<FolderModel*>(sourceModel())) {
-            auto fileInfo = srcModel->fileInfoFromIndex(srcModel->index(source_row, 0, source_parent));
-            if (!filter->filterAcceptsRow(this, fileInfo)) {
-                return false;
-            }
+        if (!filter->filterAcceptsRow(this, info)) {
+            return false;
         }
     }
-    return true;
+    return !partialSort_ || isAmongFirstRows(source_row);
 }
 
 bool ProxyFolderModel::lessThan(const QModelIndex& left, const QModelIndex& right) const {
-    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
     // left and right are indexes of source model, not the proxy model.
-    if (srcModel) {
-        auto leftInfo = srcModel->fileInfoFromIndex(left);
-        auto rightInfo = srcModel->fileInfoFromIndex(right);
-
-        if (folderFirst_) {
-            bool leftIsFolder = leftInfo->isDir();
-            bool rightIsFolder = rightInfo->isDir();
-            if (leftIsFolder != rightIsFolder) {
-                return sortOrder() == Qt::AscendingOrder ? leftIsFolder : rightIsFolder;
-            }
-        }
+    if (sourceModel()) {
+        prepareSortRecords();
+        const SortRecord& leftRecord = *sortRecord(left);
+        const SortRecord& rightRecord = *sortRecord(right);
+        return recordLessThan(leftRecord, rightRecord);
+    }
+    return QSortFilterProxyModel::lessThan(left, right);
+}
 
-        if (hiddenLast_) {
-            bool leftIsHidden = leftInfo->isHidden();
-            bool rightIsHidden = rightInfo->isHidden();
-            if (leftIsHidden != rightIsHidden) {
-                return sortOrder() == Qt::AscendingOrder ? rightIsHidden : leftIsHidden;
-            }
-        }
+bool ProxyFolderModel::recordLessThan(const SortRecord& leftRecord, const SortRecord& rightRecord) const {
+    if (folderFirst_ && leftRecord.isDir != rightRecord.isDir) {
+        return sortOrder() == Qt::AscendingOrder ? leftRecord.isDir : rightRecord.isDir;
+    }
 
-        int comp = 0;
-        switch (sortColumn()) {
-            case FolderModel::ColumnFileMTime:
-                if (leftInfo->mtime() != rightInfo->mtime()) {  // quint64
-                    return leftInfo->mtime() < rightInfo->mtime();
-                }
-                break;
-            case FolderModel::ColumnFileCrTime:
-                if (leftInfo->crtime() != rightInfo->crtime()) {  // quint64
-                    return leftInfo->crtime() < rightInfo->crtime();
-                }
-                break;
-            case FolderModel::ColumnFileDTime:
-                if (leftInfo->dtime() != rightInfo->dtime()) {  // quint64
-                    return leftInfo->dtime() < rightInfo->dtime();
-                }
-                break;
-            case FolderModel::ColumnFileSize:
-                if (leftInfo->size() != rightInfo->size()) {  // quint64
-                    return leftInfo->size() < rightInfo->size();
-                }
-                break;
-            default: {
-                // To have a more natural sorting like that of GTK, we consider dot
-                // as a separator and compare sub-strings from left to right.
-                // QString::split() is not used because some dots may not be needed.
-                QString leftText = left.data(Qt::DisplayRole).toString();
-                QString rightText = right.data(Qt::DisplayRole).toString();
-                int leftStart = 0, rightStart = 0;
-                int leftEnd = 0, rightEnd = 0;
-                for (;;) {
-                    leftEnd = leftText.indexOf(QLatin1Char('.'), leftStart);
-                    rightEnd = rightText.indexOf(QLatin1Char('.'), rightStart);
-
-                    QString lefPart = leftEnd == -1 ? leftText.sliced(leftStart, leftText.size() - leftStart)
-                                                    : leftText.sliced(leftStart, leftEnd - leftStart);
-                    QString rightPart = rightEnd == -1 ? rightText.sliced(rightStart, rightText.size() - rightStart)
-                                                       : rightText.sliced(rightStart, rightEnd - rightStart);
-                    comp = collator_.compare(lefPart, rightPart);
-                    if (comp == 0) {
-                        // This is a workaround for QCollator's behavior that, for example,
-                        // considers "A0" and "A00" equal when the numeric mode is enabled.
-                        comp = lefPart.size() - rightPart.size();
-                    }
-                    if (comp != 0 || leftEnd == -1 || rightEnd == -1) {
-                        break;
-                    }
-                    leftStart = leftEnd + 1;
-                    rightStart = rightEnd + 1;
-                }
+    if (hiddenLast_ && leftRecord.isHidden != rightRecord.isHidden) {
+        return sortOrder() == Qt::AscendingOrder ? rightRecord.isHidden : leftRecord.isHidden;
+    }
+
+    int comp = 0;
+    switch (sortColumn()) {
+        case FolderModel::ColumnFileMTime:
+            if (leftRecord.mtime != rightRecord.mtime) {
+                return leftRecord.mtime < rightRecord.mtime;
+            }
+            break;
+        case FolderModel::ColumnFileCrTime:
+            if (leftRecord.crtime != rightRecord.crtime) {
+                return leftRecord.crtime < rightRecord.crtime;
+            }
+            break;
+        case FolderModel::ColumnFileDTime:
+            if (leftRecord.dtime != rightRecord.dtime) {
+                return leftRecord.dtime < rightRecord.dtime;
+            }
+            break;
+        case FolderModel::ColumnFileSize:
+            if (leftRecord.size != rightRecord.size) {
+                return leftRecord.size < rightRecord.size;
+            }
+            break;
+        default: {
+            int leftEnd = 0, rightEnd = 0;
+            for (std::size_t i = 0;; ++i) {
+                const SortRecord::Part& leftPart = leftRecord.parts[i];
+                const SortRecord::Part& rightPart = rightRecord.parts[i];
+                leftEnd = leftPart.end;
+                rightEnd = rightPart.end;
+                comp = leftPart.key.compare(rightPart.key);
                 if (comp == 0) {
-                    comp = leftEnd - rightEnd;  // covers all remaining cases
+                    // This is a workaround for QCollator's behavior that, for example,
+                    // considers "A0" and "A00" equal when the numeric mode is enabled.
+                    comp = leftPart.size - rightPart.size;
+                }
+                if (comp != 0 || leftEnd == -1 || rightEnd == -1) {
+                    break;
                 }
-                break;
             }
+            if (comp == 0) {
+                comp = leftEnd - rightEnd;  // covers all remaining cases
+            }
+            break;
         }
-        // always sort files by their display names when they have the same property
-        if (comp == 0) {
-            return collator_.compare(leftInfo->displayName(), rightInfo->displayName()) < 0;
+    }
+    // always sort files by their display names when they have the same property
+    if (comp == 0) {
+        return leftRecord.displayNameKey.compare(rightRecord.displayNameKey) < 0;
+    }
+    return comp < 0;
+}
+
+void ProxyFolderModel::prepareSortRecords() const {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    const std::size_t rowCount = srcModel->rowCount();
+    if (!sortRecords_ || sortRecordsColumn_ != sortColumn()) {
+        sortRecords_ = sharedSortRecords(srcModel, sortColumn(), collator_.caseSensitivity());
+        sortRecordsColumn_ = sortColumn();
+    }
+    auto& records = sortRecords_->records;
+    if (records.size() > 2 * rowCount + kMinParallelSortRecords) {
+        // the records of changed files stay behind those of their new file infos
+        records.clear();
+    }
+    if (records.size() + kMinParallelSortRecords <= rowCount) {
+        // most files are sorted for the first time, as when a folder is loaded
+        buildSortRecords();
+    }
+}
+
+const std::shared_ptr<ProxyFolderModel::SortRecord>& ProxyFolderModel::sortRecord(
+    const QModelIndex& sourceIndex) const {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    const FolderModelItem* item = srcModel->itemFromIndex(sourceIndex);
+    auto& record = sortRecords_->records[item->info.get()];
+    if (!record) {
+        const bool textColumn = isTextColumn(sortColumn());
+        const QString text = textColumn ? sourceIndex.data(Qt::DisplayRole).toString() : QString{};
+        record = std::make_shared<SortRecord>(collator_, item->info, textColumn ? &text : nullptr);
+    }
+    return record;
+}
+
+void ProxyFolderModel::buildSortRecords() const {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    const int column = sortColumn();
+    const bool textColumn = isTextColumn(column);
+    // the model is only read here, in the main thread; the threads only make sort keys
+    std::vector<std::shared_ptr<const Fm::FileInfo>> infos;
+    std::vector<QString> texts;
+    for (int row = 0, n = srcModel->rowCount(); row < n; ++row) {
+        const QModelIndex index = srcModel->index(row, column);
+        const FolderModelItem* item = srcModel->itemFromIndex(index);
+        if (sortRecords_->records.count(item->info.get()) == 0) {
+            infos.push_back(item->info);
+            texts.push_back(textColumn ? index.data(Qt::DisplayRole).toString() : QString{});
+        }
+    }
+
+    std::vector<std::shared_ptr<SortRecord>> records(infos.size());
+    std::atomic<std::size_t> next{0};
+    auto makeRecords = [&]() {
+        // QCollator is not thread-safe, so each thread sets up its own
+        QCollator collator{collator_.locale()};
+        collator.setCaseSensitivity(collator_.caseSensitivity());
+        collator.setNumericMode(collator_.numericMode());
+        collator.setIgnorePunctuation(collator_.ignorePunctuation());
+        for (std::size_t i; (i = next.fetch_add(1)) < records.size();) {
+            records[i] = std::make_shared<SortRecord>(collator, infos[i], textColumn ? &texts[i] : nullptr);
+        }
+    };
+    std::vector<std::thread> threads;
+    if (records.size() >= kMinParallelSortRecords) {
+        const unsigned int nThreads = std::max(1u, std::min(kMaxSortThreads, std::thread::hardware_concurrency()));
+        for (unsigned int i = 1; i < nThreads; ++i) {
+            threads.emplace_back(makeRecords);
+        }
+    }
+    makeRecords();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto& shared = sortRecords_->records;
+    shared.reserve(shared.size() + records.size());
+    for (auto& record : records) {
+        const Fm::FileInfo* info = record->info.get();
+        shared.emplace(info, std::move(record));
+    }
+}
+
+void ProxyFolderModel::clearSortRecords() {
+    if (sortRecords_) {
+        sortRecords_->records.clear();
+    }
+    firstRecords_.clear();
+    firstFiles_.clear();
+}
+
+void ProxyFolderModel::beginPartialSort(const Fm::Folder& folder) {
+    // search results are looked through while they come, so all of them are shown at once
+    if (sortColumn() < 0 || !dynamicSortFilter() || folder.path().hasUriScheme("search")) {
+        return;
+    }
+    partialSort_ = true;
+    partialSortDropped_ = false;
+    firstRecords_.clear();
+    firstFiles_.clear();
+}
+
+bool ProxyFolderModel::shownBefore(const std::shared_ptr<SortRecord>& left,
+                                   const std::shared_ptr<SortRecord>& right) const {
+    return sortOrder() == Qt::AscendingOrder ? recordLessThan(*left, *right) : recordLessThan(*right, *left);
+}
+
+bool ProxyFolderModel::isAmongFirstRows(int sourceRow) const {
+    prepareSortRecords();
+    const std::shared_ptr<SortRecord>& record = sortRecord(sourceModel()->index(sourceRow, sortColumn()));
+    if (firstFiles_.count(record->info.get()) != 0) {  // filtered again
+        return true;
+    }
+    // ordered by this, the heap has the last of the first rows on its top
+    const auto before = [this](const auto& left, const auto& right) { return shownBefore(left, right); };
+    if (firstRecords_.size() == kPartialSortRows) {
+        if (!before(record, firstRecords_.front())) {
+            partialSortDropped_ = true;
+            return false;
+        }
+        // the last row stays shown; the row that takes its place goes before it
+        std::pop_heap(firstRecords_.begin(), firstRecords_.end(), before);
+        firstFiles_.erase(firstRecords_.back()->info.get());
+        firstRecords_.pop_back();
+    }
+    firstRecords_.push_back(record);
+    std::push_heap(firstRecords_.begin(), firstRecords_.end(), before);
+    firstFiles_.insert(record->info.get());
+    return true;
+}
+
+void ProxyFolderModel::endPartialSort() {
+    if (!partialSort_) {
+        return;
+    }
+    partialSort_ = false;
+    firstRecords_.clear();
+    firstFiles_.clear();
+    if (partialSortDropped_) {
+        partialSortDropped_ = false;
+        // the rows held back are filtered in and all rows sorted at once, with one layout change
+        invalidate();
+    }
+}
+
+void ProxyFolderModel::onFolderStartLoading() {
+    // a folder listed again from scratch; the source model has removed its rows already
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if (srcModel->rowCount() == 0) {
+        beginPartialSort(*srcModel->folder());
+    }
+}
+
+void ProxyFolderModel::onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight) {
+    // a file keeps its info when only its appearance changes, which may still change its text
+    if (!sortRecords_) {
+        return;
+    }
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        if (const FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(row, 0))) {
+            sortRecords_->records.erase(item->info.get());
         }
-        return comp < 0;
     }
-    return QSortFilterProxyModel::lessThan(left, right);
+}
+
+void ProxyFolderModel::onSourceRowsAboutToBeRemoved(const QModelIndex& /*parent*/, int first, int last) {
+    if (!sortRecords_) {
+        return;
+    }
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if (last - first + 1 == srcModel->rowCount()) {
+        sortRecords_->records.clear();
+        firstRecords_.clear();
+        firstFiles_.clear();
+        partialSortDropped_ = false;
+        return;
+    }
+    bool firstRowRemoved = false;
+    for (int row = first; row <= last; ++row) {
+        if (const FolderModelItem* item = srcModel->itemFromIndex(srcModel->index(row, 0))) {
+            const Fm::FileInfo* info = item->info.get();
+            sortRecords_->records.erase(info);
+            if (firstFiles_.erase(info) != 0) {
+                firstRecords_.erase(std::find_if(firstRecords_.begin(), firstRecords_.end(),
+                                                 [info](const auto& record) { return record->info.get() == info; }));
+                firstRowRemoved = true;
+            }
+        }
+    }
+    if (firstRowRemoved) {
+        // no row held back takes the place of a removed one, which still leaves a screen shown
+        std::make_heap(firstRecords_.begin(), firstRecords_.end(),
+                       [this](const auto& left, const auto& right) { return shownBefore(left, right); });
+    }
 }
 
 std::shared_ptr<const Fm::FileInfo> ProxyFolderModel::fileInfoFromIndex(const QModelIndex& index) const {
@@ -246,17 +552,20 @@ std::shared_ptr<const Fm::FileInfo> ProxyFolderModel::fileInfoFromIndex(const QM
 }
 
 QModelIndex ProxyFolderModel::indexFromPath(const FilePath& path) const {
-    QModelIndex ret;
-    int n_rows = rowCount();
-    for (int row = 0; row < n_rows; ++row) {
-        auto idx = index(row, FolderModel::ColumnFileName, QModelIndex());
-        auto fi = fileInfoFromIndex(idx);
-        if (fi && fi->path() == path) {  // found the item
-            ret = idx;
-            break;
-        }
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    return srcModel ? mapFromSource(srcModel->indexFromPath(path)) : QModelIndex();
+}
+
+QModelIndexList ProxyFolderModel::indexesFromPaths(const FilePathList& paths) const {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if (!srcModel) {
+        return QModelIndexList(paths.size());
     }
-    return ret;
+    QModelIndexList indexes = srcModel->indexesFromPaths(paths);
+    for (auto& index : indexes) {
+        index = mapFromSource(index);
+    }
+    return indexes;
 }
 
 std::shared_ptr<const FileInfo> ProxyFolderModel::fileInfoFromPath(const FilePath& path) const {
@@ -313,7 +622,7 @@ void ProxyFolderModel::setThumbnailSize(int size) {
 
 QVariant ProxyFolderModel::data(const QModelIndex& index, int role) const {
     if (index.column() == 0) {  // only show the decoration role for the first column
-        if (role == Qt::DecorationRole && showThumbnails_ && thumbnailSize_) {
+        if (role == Qt::DecorationRole && showThumbnails_ && thumbnailSize_ && !thumbnailsSuspended_) {
             // we need to show thumbnails instead of icons
             FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
             QModelIndex srcIndex = mapToSource(index);
@@ -324,10 +633,27 @@ QVariant ProxyFolderModel::data(const QModelIndex& index, int role) const {
             }
         }
     }
+    if (role == Qt::BackgroundRole && !highlights_.empty()) {
+        auto info = fileInfoFromIndex(index);
+        auto it = info ? highlights_.find(info->name()) : highlights_.end();
+        if (it != highlights_.end()) {
+            return it->second;
+        }
+    }
     // fallback to icons if thumbnails are not available
     return QSortFilterProxyModel::data(index, role);
 }
 
+void ProxyFolderModel::setHighlights(std::unordered_map<std::string, QBrush> highlights) {
+    if (highlights.empty() && highlights_.empty()) {
+        return;
+    }
+    highlights_ = std::move(highlights);
+    if (rowCount() > 0) {
+        Q_EMIT dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1), {Qt::BackgroundRole});
+    }
+}
+
 void ProxyFolderModel::onThumbnailLoaded(const QModelIndex& srcIndex, int size) {
     // FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
     // FolderModelItem* item = srcModel->itemFromIndex(srcIndex);
@@ -359,6 +685,26 @@ void ProxyFolderModel::updateFilters() {
     Q_EMIT sortFilterChanged();
 }
 
+void ProxyFolderModel::narrowFilters() {
+    FolderModel* srcModel = static_cast<FolderModel*>(sourceModel());
+    if (!srcModel) {
+        return;
+    }
+    const int n = rowCount();
+    narrowedFiles_.reserve(n);
+    for (int row = 0; row < n; ++row) {
+        if (const FolderModelItem* item = srcModel->itemFromIndex(mapToSource(index(row, 0)))) {
+            narrowedFiles_.insert(item->info.get());
+        }
+    }
+    narrowing_ = true;
+    beginFilterChange();
+    endFilterChange();
+    narrowing_ = false;
+    narrowedFiles_.clear();
+    Q_EMIT sortFilterChanged();
+}
+
 #if 0
 void ProxyFolderModel::reloadAllThumbnails() {
     // reload all thumbnails and update UI
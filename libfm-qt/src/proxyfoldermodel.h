@@ -22,15 +22,23 @@
 
 #include "libfmqtglobals.h"
 #include <QSortFilterProxyModel>
+#include <QBrush>
 #include <QList>
 #include <QCollator>
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "core/fileinfo.h"
 
 namespace Fm {
 
 // a proxy model used to sort and filter FolderModel
 
+class Folder;
 class FolderModelItem;
 class ProxyFolderModel;
 
@@ -70,18 +78,33 @@ class LIBFM_QT_API ProxyFolderModel : public QSortFilterProxyModel {
     int thumbnailSize() { return thumbnailSize_; }
     void setThumbnailSize(int size);
 
+    // While suspended, the files are shown with their icons and no thumbnail is loaded, as
+    // while the view scrolls fast; the view repaints them to get their thumbnails after.
+    bool thumbnailsSuspended() const { return thumbnailsSuspended_; }
+    void setThumbnailsSuspended(bool suspended) { thumbnailsSuspended_ = suspended; }
+
     std::shared_ptr<const Fm::FileInfo> fileInfoFromIndex(const QModelIndex& index) const;
 
     std::shared_ptr<const Fm::FileInfo> fileInfoFromPath(const FilePath& path) const;
 
     QModelIndex indexFromPath(const FilePath& path) const;
 
+    // The indexes of |paths|, in the same order; those of files not shown are invalid.
+    QModelIndexList indexesFromPaths(const FilePathList& paths) const;
+
     void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
+    // Fills the background of the files named in |highlights|, by their names in the folder,
+    // for instance to show how the folder differs from another one. Empty to clear them.
+    void setHighlights(std::unordered_map<std::string, QBrush> highlights);
+
     void addFilter(ProxyFolderModelFilter* filter);
     void removeFilter(ProxyFolderModelFilter* filter);
     void updateFilters();
+    // Like updateFilters(), for filters that changed to accept no file they rejected before:
+    // only the files shown now are tested again.
+    void narrowFilters();
 
    Q_SIGNALS:
     void sortFilterChanged();
@@ -89,12 +112,56 @@ class LIBFM_QT_API ProxyFolderModel : public QSortFilterProxyModel {
    protected Q_SLOTS:
     void onThumbnailLoaded(const QModelIndex& srcIndex, int size);
 
+   private Q_SLOTS:
+    void onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+
+    void onSourceRowsAboutToBeRemoved(const QModelIndex& parent, int first, int last);
+
+    void onFolderStartLoading();
+
+    void endPartialSort();
+
    protected:
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const override;
     bool lessThan(const QModelIndex& left, const QModelIndex& right) const override;
     // void reloadAllThumbnails();
 
    private:
+    // What lessThan() compares of a file, gathered once instead of on every comparison.
+    struct SortRecord;
+    // The sort records of the files of a source model for one sort column and case
+    // sensitivity, shared by all the proxies that sort that model alike.
+    struct SortRecords;
+
+    static std::shared_ptr<SortRecords> sharedSortRecords(const QAbstractItemModel* model,
+                                                          int column,
+                                                          Qt::CaseSensitivity cs);
+
+    // Gets the records ready for comparing the files of the source model.
+    void prepareSortRecords() const;
+
+    const std::shared_ptr<SortRecord>& sortRecord(const QModelIndex& sourceIndex) const;
+
+    // Whether |left| goes before |right| in the ascending order of the sort column.
+    bool recordLessThan(const SortRecord& left, const SortRecord& right) const;
+
+    // Gathers the missing sort records of all files at once, on several threads.
+    void buildSortRecords() const;
+
+    void clearSortRecords();
+
+    // While a folder is being listed, only the rows that are among the first ones in the sort
+    // order when they arrive are let through, so that a large folder shows its first screen
+    // without sorting all of its rows on every batch. The rest follow once it is listed.
+    void beginPartialSort(const Fm::Folder& folder);
+
+    // Whether the row of |left| is shown before that of |right|.
+    bool shownBefore(const std::shared_ptr<SortRecord>& left, const std::shared_ptr<SortRecord>& right) const;
+
+    // Whether the file of |sourceRow| is among the first rows seen so far, which it is made
+    // one of when it goes before the last of them.
+    bool isAmongFirstRows(int sourceRow) const;
+
     QCollator collator_;
     bool showHidden_;
     bool backupAsHidden_;
@@ -102,7 +169,19 @@ class LIBFM_QT_API ProxyFolderModel : public QSortFilterProxyModel {
     bool hiddenLast_;
     bool showThumbnails_;
     int thumbnailSize_;
+    bool thumbnailsSuspended_;
     QList<ProxyFolderModelFilter*> filters_;
+    mutable std::shared_ptr<SortRecords> sortRecords_;
+    bool partialSort_;
+    mutable bool partialSortDropped_;  // a row was held back
+    // a heap of the records of the first rows, that of the last row of them on top
+    mutable std::vector<std::shared_ptr<SortRecord>> firstRecords_;
+    mutable std::unordered_set<const Fm::FileInfo*> firstFiles_;
+    mutable int sortRecordsColumn_;
+    // the files shown before narrowFilters(), while it filters them again
+    std::unordered_set<const Fm::FileInfo*> narrowedFiles_;
+    bool narrowing_;
+    std::unordered_map<std::string, QBrush> highlights_;
 };
 
 }  // namespace Fm
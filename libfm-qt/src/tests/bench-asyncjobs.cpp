@@ -0,0 +1,172 @@
+/*
+ * Compares querying many files with one FileInfoJob each, run on a pool of threads, against
+ * one AsyncFileInfoJob each, run by an AsyncExecutor of a few threads. The files are made
+ * below --dir; point it at an NFS mount, where the calls wait on a server, to compare them
+ * there. Reports the time to query them all and the most threads the process had while
+ * doing it, as JSON.
+ *
+ *   bench-asyncjobs [--files 2000] [--dir DIR] [--pool-threads 16] [--executor-threads 2]
+ *                   [--json FILE]
+ */
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+#include <functional>
+#include "../core/asyncfileinfojob.h"
+#include "../core/asyncjob.h"
+#include "../core/fileinfojob.h"
+#include "libfmqt.h"
+
+namespace {
+
+double elapsedMs(const QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1e6;
+}
+
+// the threads of this process, from /proc
+int threadCount() {
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (!status.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    for (const QByteArray& line : status.readAll().split('\n')) {
+        if (line.startsWith("Threads:")) {
+            return line.mid(8).trimmed().toInt();
+        }
+    }
+    return 0;
+}
+
+bool makeFiles(const QString& dir, int count, Fm::FilePathList& paths) {
+    if (!QDir().mkpath(dir)) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        const QString name = dir + QStringLiteral("/file-") + QString::number(i) + QStringLiteral(".txt");
+        QFile file(name);
+        if (!file.open(QIODevice::WriteOnly) || file.write(QFile::encodeName(name)) < 0) {
+            return false;
+        }
+        paths.push_back(Fm::FilePath::fromLocalPath(QFile::encodeName(name).constData()));
+    }
+    return true;
+}
+
+// Runs |startJobs|, which starts |count| jobs calling |done| once each, until all are done,
+// and records the time it took and the peak thread count.
+void measure(const QString& name,
+             int count,
+             const std::function<void(const std::function<void()>& done)>& startJobs,
+             QJsonArray& results) {
+    QEventLoop loop;
+    int remaining = count;
+    int peakThreads = threadCount();
+    QTimer sampler;
+    QObject::connect(&sampler, &QTimer::timeout, [&] { peakThreads = std::max(peakThreads, threadCount()); });
+    sampler.start(5);
+
+    QElapsedTimer timer;
+    timer.start();
+    startJobs([&] {
+        if (--remaining == 0) {
+            loop.quit();
+        }
+    });
+    if (remaining > 0) {
+        loop.exec();
+    }
+    const double ms = elapsedMs(timer);
+    sampler.stop();
+    results.append(QJsonObject{{QStringLiteral("name"), name},
+                               {QStringLiteral("jobs"), count},
+                               {QStringLiteral("ms"), ms},
+                               {QStringLiteral("peak_threads"), std::max(peakThreads, threadCount())}});
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    Fm::LibFmQt context;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption filesOption(QStringLiteral("files"), QStringLiteral("Files to query, one job each."),
+                                   QStringLiteral("count"), QStringLiteral("2000"));
+    QCommandLineOption dirOption(QStringLiteral("dir"), QStringLiteral("Where the files are made."),
+                                 QStringLiteral("dir"));
+    QCommandLineOption poolOption(QStringLiteral("pool-threads"),
+                                  QStringLiteral("Threads of the pool of FileInfoJobs."), QStringLiteral("count"),
+                                  QStringLiteral("16"));
+    QCommandLineOption executorOption(QStringLiteral("executor-threads"),
+                                      QStringLiteral("Threads of the executor of AsyncFileInfoJobs."),
+                                      QStringLiteral("count"), QStringLiteral("2"));
+    QCommandLineOption jsonOption(QStringLiteral("json"), QStringLiteral("Write the results to a file."),
+                                  QStringLiteral("file"));
+    parser.addOptions({filesOption, dirOption, poolOption, executorOption, jsonOption});
+    parser.process(app);
+
+    QTemporaryDir tempDir;
+    const QString parent = parser.isSet(dirOption) ? parser.value(dirOption) : tempDir.path();
+    const QString dir = parent + QStringLiteral("/asyncjobs");
+    QDir(dir).removeRecursively();
+    const int count = std::max(1, parser.value(filesOption).toInt());
+    Fm::FilePathList paths;
+    if (parent.isEmpty() || !makeFiles(dir, count, paths)) {
+        qWarning("cannot make the files in %s", qPrintable(dir));
+        return 1;
+    }
+
+    QJsonArray results;
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, parser.value(poolOption).toInt()));
+    measure(QStringLiteral("fileinfo/pool"), count,
+            [&](const std::function<void()>& done) {
+                for (const auto& path : paths) {
+                    auto job = new Fm::FileInfoJob{{path}};
+                    QObject::connect(job, &Fm::Job::finished, &app, done, Qt::QueuedConnection);
+                    pool.start(job);
+                }
+            },
+            results);
+    pool.waitForDone();
+
+    Fm::AsyncExecutor executor{std::max(1, parser.value(executorOption).toInt())};
+    measure(QStringLiteral("fileinfo/async"), count,
+            [&](const std::function<void()>& done) {
+                for (const auto& path : paths) {
+                    auto job = new Fm::AsyncFileInfoJob{{path}};
+                    QObject::connect(job, &Fm::AsyncJob::finished, &app, done, Qt::QueuedConnection);
+                    job->start(&executor);
+                }
+            },
+            results);
+    QDir(dir).removeRecursively();
+
+    const QByteArray json =
+        QJsonDocument(QJsonObject{{QStringLiteral("version"), 1}, {QStringLiteral("results"), results}}).toJson();
+    if (parser.isSet(jsonOption)) {
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            qWarning("cannot write %s", qPrintable(file.fileName()));
+            return 1;
+        }
+    }
+    else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
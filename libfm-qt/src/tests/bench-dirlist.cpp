@@ -0,0 +1,312 @@
+/*
+ * Measures listing a folder end to end, from Folder::fromPath() through DirListJob to the rows
+ * of a FolderModel, on folders of 10k to 1M files it makes below --dir, so that tmpfs, ext4 or
+ * an NFS mount can be compared. Each listing runs in a process of its own, natively with
+ * getdents64() and statx(), natively without a FileInfoPool and then with GIO, and reports the
+ * time to the first rows and to the whole folder, and the heap malloc holds per listed file
+ * once it is shown, which the FileInfo of the file takes most of. With --drop-caches, the
+ * given command runs before each listing to make it cold; it needs root, as with
+ *
+ *   --drop-caches "sudo -n sh -c 'sync; echo 3 > /proc/sys/vm/drop_caches'"
+ *
+ * and the listings are warm without it. With --strace, each way is run once more under
+ * strace -f -c, and the system calls it made are counted. Prints the results as JSON.
+ *
+ *   bench-dirlist [--sizes 10000,100000,1000000] [--dir DIR] [--runs 3] [--drop-caches COMMAND]
+ *                 [--strace] [--json FILE]
+ */
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../core/fileinfopool.h"
+#include "../core/folder.h"
+#include "../core/localdirlister.h"
+#include "../foldermodel.h"
+#include "libfmqt.h"
+
+namespace {
+
+// one file in this many is a folder
+constexpr int kDirEvery = 50;
+
+double elapsedMs(const QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1e6;
+}
+
+double cpuMs() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+double peakMemoryMiB() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss / 1024.0 : 0;  // in KiB
+}
+
+// The bytes malloc hands out and has not got back.
+double heapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// Files of the usual types, a few bytes each, and some empty folders.
+bool makeTree(const QString& path, int count) {
+    static const char* const kExtensions[] = {".txt", ".jpg", ".png", ".pdf", ".cpp", ".tar.gz", ""};
+    if (!QDir().mkpath(path)) {
+        return false;
+    }
+    const QByteArray dir = QFile::encodeName(path);
+    for (int i = 0; i < count; ++i) {
+        const QByteArray name = dir + "/file-" + QByteArray::number(i).rightJustified(7, '0') +
+                                kExtensions[i % (sizeof(kExtensions) / sizeof(kExtensions[0]))];
+        if (i % kDirEvery == 0) {
+            if (mkdir(name.constData(), 0755) != 0) {
+                return false;
+            }
+            continue;
+        }
+        const int fd = open(name.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        const bool written = write(fd, name.constData(), name.size()) == name.size();
+        close(fd);
+        if (!written) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lists |dir| once the given way, as a folder opened in a view, and prints what it took as JSON.
+int runChild(const QString& dir, const QString& way) {
+    Fm::LocalDirLister::setEnabled(way != QLatin1String("gio"));
+    Fm::FileInfoPool::setEnabled(way != QLatin1String("native-unpooled"));
+    const double heapBefore = heapBytes();
+    QElapsedTimer timer;
+    timer.start();
+    auto folder = Fm::Folder::fromPath(Fm::FilePath::fromLocalPath(QFile::encodeName(dir).constData()));
+    Fm::FolderModel model;
+    model.setFolder(folder);
+
+    double firstMs = -1;
+    double completeMs = -1;
+    QEventLoop loop;
+    QObject::connect(&model, &QAbstractItemModel::rowsInserted, [&] {
+        if (firstMs < 0) {
+            firstMs = elapsedMs(timer);
+        }
+    });
+    QObject::connect(folder.get(), &Fm::Folder::finishLoading, [&] {
+        completeMs = elapsedMs(timer);
+        loop.quit();
+    });
+    if (!folder->isLoaded()) {
+        loop.exec();
+    }
+
+    const int rows = model.rowCount();
+    const QJsonObject object{{QStringLiteral("first_batch_ms"), firstMs},
+                             {QStringLiteral("complete_ms"), completeMs},
+                             {QStringLiteral("rows"), rows},
+                             {QStringLiteral("cpu_ms"), cpuMs()},
+                             {QStringLiteral("peak_rss_mib"), peakMemoryMiB()},
+                             {QStringLiteral("heap_bytes_per_file"), rows > 0 ? (heapBytes() - heapBefore) / rows : 0}};
+    const QByteArray json = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    fwrite(json.constData(), 1, json.size(), stdout);
+    return 0;
+}
+
+QString cacheName(bool cold) {
+    return cold ? QStringLiteral("cold") : QStringLiteral("warm");
+}
+
+bool dropCaches(const QString& command) {
+    return QProcess::execute(QStringLiteral("/bin/sh"), {QStringLiteral("-c"), command}) == 0;
+}
+
+// Runs the child listing |dir| and returns what it printed, or an empty object on failure.
+QJsonObject runListing(const QString& program, const QStringList& arguments) {
+    QProcess process;
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.start(program, arguments);
+    if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        return QJsonObject();
+    }
+    return QJsonDocument::fromJson(process.readAllStandardOutput().trimmed()).object();
+}
+
+// The calls per system call of a summary written by strace -c.
+QJsonObject parseStraceSummary(const QByteArray& summary) {
+    QJsonObject calls;
+    qint64 total = 0;
+    for (const QByteArray& line : summary.split('\n')) {
+        const QList<QByteArray> fields = line.simplified().split(' ');
+        // "% time seconds usecs/call calls [errors] syscall"; the total line has no usecs/call
+        if (fields.size() < 5 || fields.constLast() == "total" || fields.constLast() == "syscall") {
+            continue;
+        }
+        bool ok = false;
+        const qint64 count = fields[3].toLongLong(&ok);
+        if (ok) {
+            calls[QString::fromLatin1(fields.constLast())] = count;
+            total += count;
+        }
+    }
+    calls[QStringLiteral("total")] = total;
+    return calls;
+}
+
+void benchSize(int count,
+               const QString& parent,
+               int runs,
+               const QString& dropCommand,
+               bool strace,
+               QJsonArray& results) {
+    const QString dir = parent + QStringLiteral("/dirlist-") + QString::number(count);
+    QDir(dir).removeRecursively();
+    QElapsedTimer timer;
+    timer.start();
+    if (!makeTree(dir, count)) {
+        qWarning("cannot make %s", qPrintable(dir));
+        return;
+    }
+    results.append(QJsonObject{{QStringLiteral("name"), QStringLiteral("make")},
+                               {QStringLiteral("files"), count},
+                               {QStringLiteral("ms"), elapsedMs(timer)}});
+
+    const QString self = QCoreApplication::applicationFilePath();
+    const QString straceProgram = strace ? QStandardPaths::findExecutable(QStringLiteral("strace")) : QString();
+    if (strace && straceProgram.isEmpty()) {
+        qWarning("strace is not on the PATH, no system calls are counted");
+    }
+    for (const QString& way : {QStringLiteral("native"), QStringLiteral("native-unpooled"), QStringLiteral("gio")}) {
+        const QStringList arguments{QStringLiteral("--child-list"), dir, QStringLiteral("--child-way"), way};
+        for (int run = 0; run < runs; ++run) {
+            const bool cold = !dropCommand.isEmpty() && dropCaches(dropCommand);
+            QJsonObject object = runListing(self, arguments);
+            if (object.isEmpty()) {
+                qWarning("listing %s with %s failed", qPrintable(dir), qPrintable(way));
+                continue;
+            }
+            object[QStringLiteral("name")] = QStringLiteral("list/") + way;
+            object[QStringLiteral("files")] = count;
+            object[QStringLiteral("run")] = run;
+            object[QStringLiteral("cache")] = cacheName(cold);
+            object[QStringLiteral("ms")] = object.value(QStringLiteral("complete_ms"));
+            results.append(object);
+        }
+
+        if (!straceProgram.isEmpty()) {
+            QTemporaryFile summary;
+            if (!summary.open()) {
+                continue;
+            }
+            const bool cold = !dropCommand.isEmpty() && dropCaches(dropCommand);
+            const QStringList straceArguments{QStringLiteral("-f"), QStringLiteral("-c"), QStringLiteral("-o"),
+                                              summary.fileName(), self};
+            if (runListing(straceProgram, straceArguments + arguments).isEmpty()) {
+                qWarning("listing %s with %s under strace failed", qPrintable(dir), qPrintable(way));
+                continue;
+            }
+            results.append(QJsonObject{{QStringLiteral("name"), QStringLiteral("syscalls/") + way},
+                                       {QStringLiteral("files"), count},
+                                       {QStringLiteral("cache"), cacheName(cold)},
+                                       {QStringLiteral("calls"), parseStraceSummary(summary.readAll())}});
+        }
+    }
+    QDir(dir).removeRecursively();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    Fm::LibFmQt context;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption sizesOption(QStringLiteral("sizes"), QStringLiteral("Numbers of files, comma-separated."),
+                                   QStringLiteral("list"), QStringLiteral("10000,100000,1000000"));
+    QCommandLineOption dirOption(QStringLiteral("dir"), QStringLiteral("Where the folders are made."),
+                                 QStringLiteral("dir"));
+    QCommandLineOption runsOption(QStringLiteral("runs"), QStringLiteral("Listings per size and way."),
+                                  QStringLiteral("count"), QStringLiteral("3"));
+    QCommandLineOption dropOption(QStringLiteral("drop-caches"),
+                                  QStringLiteral("Command dropping the page cache, run before each listing."),
+                                  QStringLiteral("command"));
+    QCommandLineOption straceOption(QStringLiteral("strace"), QStringLiteral("Count the system calls with strace."));
+    QCommandLineOption jsonOption(QStringLiteral("json"), QStringLiteral("Write the results to a file."),
+                                  QStringLiteral("file"));
+    // what the benchmark runs itself with for each listing
+    QCommandLineOption childListOption(QStringLiteral("child-list"), QString(), QStringLiteral("dir"));
+    childListOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    QCommandLineOption childWayOption(QStringLiteral("child-way"), QString(), QStringLiteral("way"));
+    childWayOption.setFlags(QCommandLineOption::HiddenFromHelp);
+    parser.addOptions(
+        {sizesOption, dirOption, runsOption, dropOption, straceOption, jsonOption, childListOption, childWayOption});
+    parser.process(app);
+
+    if (parser.isSet(childListOption)) {
+        return runChild(parser.value(childListOption), parser.value(childWayOption));
+    }
+
+    QTemporaryDir tempDir;
+    const QString parent = parser.isSet(dirOption) ? parser.value(dirOption) : tempDir.path();
+    if (parent.isEmpty() || !QDir().mkpath(parent)) {
+        qWarning("no directory to make the folders in");
+        return 1;
+    }
+    const int runs = std::max(1, parser.value(runsOption).toInt());
+    QJsonArray results;
+    const auto sizes = parser.value(sizesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    for (const QString& size : sizes) {
+        const int count = size.toInt();
+        if (count > 0) {
+            benchSize(count, parent, runs, parser.value(dropOption), parser.isSet(straceOption), results);
+        }
+    }
+
+    const QByteArray json =
+        QJsonDocument(QJsonObject{{QStringLiteral("version"), 1},
+                                  {QStringLiteral("sizeof_fileinfo"), static_cast<int>(sizeof(Fm::FileInfo))},
+                                  {QStringLiteral("results"), results}})
+            .toJson();
+    if (parser.isSet(jsonOption)) {
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            qWarning("cannot write %s", qPrintable(file.fileName()));
+            return 1;
+        }
+    }
+    else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
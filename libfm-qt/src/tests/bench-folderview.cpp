@@ -0,0 +1,251 @@
+/*
+ * Measures how FolderModel, ProxyFolderModel and FolderView scale with the number of files.
+ * The files are made up in memory, so no disk I/O is timed. Runs on the offscreen platform
+ * unless QT_QPA_PLATFORM says otherwise, and prints the results as JSON.
+ *
+ *   bench-folderview [--sizes 10000,100000,1000000] [--frames 60] [--json FILE]
+ */
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QScrollBar>
+#include <QStringMatcher>
+#include <algorithm>
+#include <random>
+#include <sys/stat.h>
+#include "../core/fileinfo.h"
+#include "../core/gioptrs.h"
+#include "../foldermodel.h"
+#include "../folderview.h"
+#include "../proxyfoldermodel.h"
+#include "libfmqt.h"
+
+namespace {
+
+// files are added in batches of this size, as a folder listing hands them over
+constexpr std::size_t kInsertBatch = 1000;
+
+constexpr int kRemoveBursts = 10;
+
+// FolderModel takes files from a Folder through these slots
+class BenchFolderModel : public Fm::FolderModel {
+   public:
+    using Fm::FolderModel::onFilesAdded;
+    using Fm::FolderModel::onFilesRemoved;
+};
+
+// like the filter bar of PCManFM-Qt: a case-insensitive substring of the name
+class NameFilter : public Fm::ProxyFolderModelFilter {
+   public:
+    void setText(const QString& text) { matcher_.setPattern(text.toCaseFolded()); }
+
+    bool filterAcceptsRow(const Fm::ProxyFolderModel* /*model*/,
+                          const std::shared_ptr<const Fm::FileInfo>& info) const override {
+        return matcher_.pattern().isEmpty() || matcher_.indexIn(info->displayName().toCaseFolded()) != -1;
+    }
+
+   private:
+    QStringMatcher matcher_;
+};
+
+Fm::FileInfoList synthesize(int count) {
+    static const char* const kWords[] = {"report", "IMG", "notes", "Backup", "data", "photo", "build", "draft"};
+    static const char* const kTypes[][2] = {{".txt", "text/plain"},
+                                            {".png", "image/png"},
+                                            {".pdf", "application/pdf"},
+                                            {".cpp", "text/x-c++src"},
+                                            {".tar.gz", "application/x-compressed-tar"},
+                                            {"", "inode/directory"}};
+    const auto dir = Fm::FilePath::fromLocalPath("/pcmanfm-bench");
+    std::mt19937 random{1};
+    Fm::FileInfoList files;
+    files.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const auto& type = kTypes[random() % (sizeof(kTypes) / sizeof(kTypes[0]))];
+        const bool isDir = type[0][0] == '\0';
+        const QByteArray name = QByteArray(kWords[random() % (sizeof(kWords) / sizeof(kWords[0]))]) + '-' +
+                                QByteArray::number(static_cast<quint32>(random() % (count * 4u))) + type[0];
+
+        Fm::GFileInfoPtr inf{g_file_info_new(), false};
+        g_file_info_set_name(inf.get(), name.constData());
+        g_file_info_set_display_name(inf.get(), name.constData());
+        g_file_info_set_file_type(inf.get(), isDir ? G_FILE_TYPE_DIRECTORY : G_FILE_TYPE_REGULAR);
+        g_file_info_set_content_type(inf.get(), type[1]);
+        g_file_info_set_size(inf.get(), isDir ? 4096 : random() % (64u << 20));
+        g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_MODE, (isDir ? S_IFDIR : S_IFREG) | 0644);
+        g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_UID, 1000 + random() % 3);
+        g_file_info_set_attribute_uint32(inf.get(), G_FILE_ATTRIBUTE_UNIX_GID, 1000 + random() % 3);
+        g_file_info_set_attribute_uint64(inf.get(), G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                         1500000000u + random() % 200000000u);
+        files.push_back(std::make_shared<const Fm::FileInfo>(inf, dir.child(name.constData())));
+    }
+    return files;
+}
+
+double elapsedMs(const QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1e6;
+}
+
+QJsonObject result(const QString& name, int files, double ms) {
+    return QJsonObject{{QStringLiteral("name"), name}, {QStringLiteral("files"), files}, {QStringLiteral("ms"), ms}};
+}
+
+// a result made of many steps, as keystrokes or frames
+QJsonObject stepsResult(const QString& name, int files, const std::vector<double>& steps) {
+    double total = 0;
+    for (double step : steps) {
+        total += step;
+    }
+    QJsonObject object = result(name, files, total);
+    object[QStringLiteral("steps")] = static_cast<int>(steps.size());
+    object[QStringLiteral("ms_per_step")] = steps.empty() ? 0 : total / steps.size();
+    object[QStringLiteral("worst_ms")] = steps.empty() ? 0 : *std::max_element(steps.begin(), steps.end());
+    return object;
+}
+
+void benchSize(int count, int frames, QJsonArray& results) {
+    QElapsedTimer timer;
+    timer.start();
+    const Fm::FileInfoList files = synthesize(count);
+    results.append(result(QStringLiteral("synthesize"), count, elapsedMs(timer)));
+
+    BenchFolderModel model;
+    Fm::ProxyFolderModel proxy;
+    proxy.setSortCaseSensitivity(Qt::CaseInsensitive);
+    proxy.setFolderFirst(true);
+    proxy.setSourceModel(&model);
+    proxy.sort(Fm::FolderModel::ColumnFileName, Qt::AscendingOrder);
+
+    // insertion into a sorted model, as when a folder is listed
+    timer.restart();
+    for (std::size_t first = 0; first < files.size(); first += kInsertBatch) {
+        Fm::FileInfoList batch;
+        batch.insert(batch.end(), files.begin() + first, files.begin() + std::min(files.size(), first + kInsertBatch));
+        model.onFilesAdded(batch);
+    }
+    results.append(result(QStringLiteral("insert"), count, elapsedMs(timer)));
+
+    for (int column = 0; column < Fm::FolderModel::NumOfColumns; ++column) {
+        const QString name = model.headerData(column, Qt::Horizontal, Qt::DisplayRole).toString();
+        timer.restart();
+        proxy.sort(column, Qt::AscendingOrder);
+        results.append(result(QStringLiteral("sort/") + name, count, elapsedMs(timer)));
+    }
+    proxy.sort(Fm::FolderModel::ColumnFileName, Qt::AscendingOrder);
+
+    // typing into the filter bar narrows the files shown, erasing it widens them again
+    NameFilter filter;
+    proxy.addFilter(&filter);
+    const QString typed = QStringLiteral("report-12");
+    std::vector<double> keystrokes;
+    for (int length = 1; length <= typed.size(); ++length) {
+        filter.setText(typed.left(length));
+        timer.restart();
+        proxy.narrowFilters();
+        keystrokes.push_back(elapsedMs(timer));
+    }
+    results.append(stepsResult(QStringLiteral("filter/type"), count, keystrokes));
+    keystrokes.clear();
+    for (int length = typed.size() - 1; length >= 0; --length) {
+        filter.setText(typed.left(length));
+        timer.restart();
+        proxy.updateFilters();
+        keystrokes.push_back(elapsedMs(timer));
+    }
+    results.append(stepsResult(QStringLiteral("filter/erase"), count, keystrokes));
+    proxy.removeFilter(&filter);
+
+    Fm::FolderView view;
+    view.resize(1280, 800);
+    view.setModel(&proxy);
+    view.show();
+    for (int mode = Fm::FolderView::FirstViewMode; mode <= Fm::FolderView::LastViewMode; ++mode) {
+        static const char* const kModeNames[] = {"icon", "compact", "detailed", "thumbnail"};
+        const QString modeName = QLatin1String(kModeNames[mode - Fm::FolderView::FirstViewMode]);
+        timer.restart();
+        view.setViewMode(static_cast<Fm::FolderView::ViewMode>(mode));
+        QAbstractItemView* childView = view.childView();
+        childView->doItemsLayout();
+        results.append(result(QStringLiteral("layout/") + modeName, count, elapsedMs(timer)));
+
+        // a page further down on every frame, painted as the window system would ask for it
+        QWidget* viewport = childView->viewport();
+        QImage image(viewport->size(), QImage::Format_ARGB32_Premultiplied);
+        QScrollBar* scrollBar = childView->verticalScrollBar();
+        scrollBar->setValue(0);
+        std::vector<double> frameTimes;
+        for (int frame = 0; frame < frames; ++frame) {
+            timer.restart();
+            scrollBar->setValue(scrollBar->value() + scrollBar->pageStep());
+            viewport->render(&image);
+            frameTimes.push_back(elapsedMs(timer));
+        }
+        results.append(stepsResult(QStringLiteral("paint/") + modeName, count, frameTimes));
+    }
+
+    // bursts of deletions all over the folder, shown in the detailed list
+    view.setViewMode(Fm::FolderView::DetailedListMode);
+    std::vector<std::shared_ptr<const Fm::FileInfo>> remaining(files.begin(), files.end());
+    std::shuffle(remaining.begin(), remaining.end(), std::mt19937{2});
+    const std::size_t burstSize = std::max<std::size_t>(1, files.size() / 100);
+    std::vector<double> bursts;
+    for (int i = 0; i < kRemoveBursts && remaining.size() >= burstSize; ++i) {
+        Fm::FileInfoList burst;
+        burst.insert(burst.end(), remaining.end() - burstSize, remaining.end());
+        remaining.resize(remaining.size() - burstSize);
+        timer.restart();
+        model.onFilesRemoved(burst);
+        bursts.push_back(elapsedMs(timer));
+    }
+    results.append(stepsResult(QStringLiteral("remove"), count, bursts));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    Fm::LibFmQt context;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption sizesOption(QStringLiteral("sizes"), QStringLiteral("Numbers of files, comma-separated."),
+                                   QStringLiteral("list"), QStringLiteral("10000,100000,1000000"));
+    QCommandLineOption framesOption(QStringLiteral("frames"), QStringLiteral("Frames painted per view mode."),
+                                    QStringLiteral("count"), QStringLiteral("60"));
+    QCommandLineOption jsonOption(QStringLiteral("json"), QStringLiteral("Write the results to a file."),
+                                  QStringLiteral("file"));
+    parser.addOptions({sizesOption, framesOption, jsonOption});
+    parser.process(app);
+
+    QJsonArray results;
+    const int frames = std::max(1, parser.value(framesOption).toInt());
+    const auto sizes = parser.value(sizesOption).split(QLatin1Char(','), Qt::SkipEmptyParts);
+    for (const QString& size : sizes) {
+        const int count = size.toInt();
+        if (count > 0) {
+            benchSize(count, frames, results);
+        }
+    }
+
+    const QByteArray json =
+        QJsonDocument(QJsonObject{{QStringLiteral("version"), 1}, {QStringLiteral("results"), results}}).toJson();
+    if (parser.isSet(jsonOption)) {
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            qWarning("cannot write %s", qPrintable(file.fileName()));
+            return 1;
+        }
+    }
+    else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
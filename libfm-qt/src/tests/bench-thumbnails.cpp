@@ -0,0 +1,388 @@
+/*
+ * Measures the thumbnail pipeline on folders of images, RAW files and videos it writes into a
+ * temporary directory: the time to the first thumbnail, thumbnails per second, the hits of the
+ * memory and disk caches and the peak memory with a cold, a disk and a memory cache, for each
+ * number of decode threads; then the thumbnails loaded for rows that were scrolled away before
+ * they were painted, as a view scrolling through the folder page by page asks for them. The
+ * thumbnail cache is kept in the temporary directory too, but the files stay in the page cache.
+ * The RAW files are TIFF images named as DNG, which are left to the thumbnailers installed; the
+ * videos are only made when ffmpeg is on the PATH. Prints the results as JSON.
+ *
+ *   bench-thumbnails [--images 200] [--raws 40] [--videos 20] [--threads 1,2,4,8] [--size 128]
+ *                    [--page 40] [--scroll-ms 50] [--json FILE]
+ */
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QImage>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <algorithm>
+#include "../core/folder.h"
+#include "../core/perftrace.h"
+#include "../core/thumbnailjob.h"
+#include "../core/videoframeextractor.h"
+#include "../foldermodel.h"
+#include "../proxyfoldermodel.h"
+#include "libfmqt.h"
+
+namespace {
+
+// the thumbnails still loading once the view has scrolled to the end are waited for this long
+constexpr int kDrainTimeoutMs = 120000;
+
+double elapsedMs(const QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1e6;
+}
+
+// A photo-like picture: smooth, so that it compresses as a photo does, but different for each file.
+QImage makePicture(int width, int height, int seed) {
+    QImage image(width, height, QImage::Format_RGB32);
+    QPainter painter(&image);
+    QLinearGradient gradient(0, 0, width, height);
+    gradient.setColorAt(0, QColor::fromHsv(seed * 37 % 360, 160, 230));
+    gradient.setColorAt(1, QColor::fromHsv((seed * 37 + 120) % 360, 200, 90));
+    painter.fillRect(image.rect(), gradient);
+    painter.setPen(Qt::NoPen);
+    for (int i = 0; i < 12; ++i) {
+        painter.setBrush(QColor::fromHsv((seed * 53 + i * 29) % 360, 180, 200, 160));
+        const int size = height / 4 + (seed * 7 + i * 13) % (height / 3);
+        painter.drawEllipse((seed * 101 + i * 211) % width, (seed * 59 + i * 97) % height, size, size);
+    }
+    painter.setPen(Qt::white);
+    QFont font = painter.font();
+    font.setPixelSize(height / 8);
+    painter.setFont(font);
+    painter.drawText(image.rect(), Qt::AlignCenter, QString::number(seed));
+    return image;
+}
+
+// camera-sized JPEGs, with a PNG screenshot now and then
+bool makeImages(const QString& dir, int count) {
+    for (int i = 0; i < count; ++i) {
+        const bool png = i % 4 == 3;
+        const QString name = QStringLiteral("%1/IMG_%2.").arg(dir).arg(i, 5, 10, QLatin1Char('0'));
+        const QImage image = png ? makePicture(1600, 1000, i) : makePicture(4000, 3000, i);
+        if (!image.save(png ? name + QStringLiteral("png") : name + QStringLiteral("jpg"), nullptr, 85)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool makeRaws(const QString& dir, int count) {
+    const bool tiff = QImageWriter::supportedImageFormats().contains("tiff");
+    for (int i = 0; i < count; ++i) {
+        QImageWriter writer(QStringLiteral("%1/DSC_%2.dng").arg(dir).arg(i, 5, 10, QLatin1Char('0')),
+                            tiff ? "tiff" : "jpeg");
+        writer.setCompression(1);  // LZW for TIFF
+        if (!writer.write(makePicture(4000, 3000, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// one clip made by ffmpeg, copied under other names, each of them thumbnailed on its own
+bool makeVideos(const QString& dir, int count) {
+    const QString ffmpeg = QStandardPaths::findExecutable(QStringLiteral("ffmpeg"));
+    if (ffmpeg.isEmpty()) {
+        return false;
+    }
+    const QString first = dir + QStringLiteral("/MOV_00000.mp4");
+    const int status = QProcess::execute(
+        ffmpeg, {QStringLiteral("-v"), QStringLiteral("error"), QStringLiteral("-f"), QStringLiteral("lavfi"),
+                 QStringLiteral("-i"), QStringLiteral("testsrc2=duration=10:size=1920x1080:rate=25"),
+                 QStringLiteral("-c:v"), QStringLiteral("mpeg4"), QStringLiteral("-y"), first});
+    if (status != 0) {
+        return false;
+    }
+    for (int i = 1; i < count; ++i) {
+        if (!QFile::copy(first, QStringLiteral("%1/MOV_%2.mp4").arg(dir).arg(i, 5, 10, QLatin1Char('0')))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<Fm::Folder> loadFolder(const QString& dir) {
+    auto folder = Fm::Folder::fromPath(Fm::FilePath::fromLocalPath(QFile::encodeName(dir).constData()));
+    if (!folder->isLoaded()) {
+        QEventLoop loop;
+        QObject::connect(folder.get(), &Fm::Folder::finishLoading, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+    return folder;
+}
+
+// Forgets the thumbnails of the disk cache, or only those kept in memory.
+void dropCaches(const QString& cacheDir, bool disk) {
+    if (disk) {
+        QDir(cacheDir + QStringLiteral("/thumbnails")).removeRecursively();
+    }
+    Fm::ThumbnailJob::clearMemoryCache();
+    Fm::VideoFrameExtractor::releaseDecoders();
+}
+
+// Forgets the peak of the resident memory, so that the next one is that of what follows.
+void resetPeakMemory() {
+    QFile file(QStringLiteral("/proc/self/clear_refs"));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write("5");
+    }
+}
+
+double peakMemoryMiB() {
+    QFile file(QStringLiteral("/proc/self/status"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    for (const QByteArray& line : file.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).trimmed().split(' ').value(0).toDouble() / 1024;  // in KiB
+        }
+    }
+    return 0;
+}
+
+qint64 counter(Fm::PerfTrace::Counter which) {
+    return Fm::PerfTrace::counter(which);
+}
+
+QJsonObject cacheCounters() {
+    using PerfTrace = Fm::PerfTrace;
+    return QJsonObject{{QStringLiteral("memory_hits"), counter(PerfTrace::ThumbnailMemoryHits)},
+                       {QStringLiteral("disk_hits"), counter(PerfTrace::ThumbnailDiskHits)},
+                       {QStringLiteral("generated"), counter(PerfTrace::ThumbnailGenerated)},
+                       {QStringLiteral("failed"), counter(PerfTrace::ThumbnailFailed)}};
+}
+
+// One job over all the files of the folder, run on this thread as the scheduler would run it.
+QJsonObject benchJob(const QString& name, const Fm::FileInfoList& files, int size, unsigned int threads) {
+    Fm::PerfTrace::reset();
+    Fm::ThumbnailJob::setMaxDecodeThreads(threads);
+    resetPeakMemory();
+
+    Fm::ThumbnailJob job{files, size};
+    job.setAutoDelete(false);
+    QElapsedTimer timer;
+    double firstMs = -1;
+    int thumbnails = 0;
+    QObject::connect(&job, &Fm::ThumbnailJob::thumbnailLoaded,
+                     [&](const std::shared_ptr<const Fm::FileInfo>& /*file*/, int /*size*/, const QImage& image) {
+                         if (firstMs < 0) {
+                             firstMs = elapsedMs(timer);
+                         }
+                         thumbnails += !image.isNull();
+                     });
+    timer.start();
+    job.run();
+    const double ms = elapsedMs(timer);
+
+    QJsonObject object = cacheCounters();
+    object[QStringLiteral("name")] = name;
+    object[QStringLiteral("files")] = static_cast<int>(files.size());
+    object[QStringLiteral("threads")] = static_cast<int>(threads);
+    object[QStringLiteral("ms")] = ms;
+    object[QStringLiteral("first_ms")] = firstMs;
+    object[QStringLiteral("thumbnails")] = thumbnails;
+    object[QStringLiteral("per_second")] = ms > 0 ? thumbnails * 1000 / ms : 0;
+    object[QStringLiteral("peak_rss_mib")] = peakMemoryMiB();
+    return object;
+}
+
+// A view showing |page| rows at a time, scrolling a page down every |scrollMs|, from a cold cache.
+// What it asks for goes through FolderModel and the job scheduler as in the file manager.
+QJsonObject benchScroll(const QString& name,
+                        const std::shared_ptr<Fm::Folder>& folder,
+                        int size,
+                        int page,
+                        int scrollMs) {
+    using PerfTrace = Fm::PerfTrace;
+    PerfTrace::reset();
+    resetPeakMemory();
+
+    Fm::FolderModel model;
+    model.setFolder(folder);
+    Fm::ProxyFolderModel proxy;
+    proxy.setSourceModel(&model);
+    proxy.sort(Fm::FolderModel::ColumnFileName, Qt::AscendingOrder);
+    proxy.setShowThumbnails(true);
+    proxy.setThumbnailSize(size);
+
+    // the rows of the page shown are painted again when their thumbnails come
+    QElapsedTimer timer;
+    double firstMs = -1;
+    int first = 0;
+    QObject::connect(&proxy, &QAbstractItemModel::dataChanged, [&](const QModelIndex& topLeft, const QModelIndex&) {
+        const int row = topLeft.row();
+        if (row >= first && row < first + page && !proxy.data(topLeft, Qt::DecorationRole).isNull() && firstMs < 0) {
+            firstMs = elapsedMs(timer);
+        }
+    });
+
+    timer.start();
+    const int rows = proxy.rowCount();
+    for (first = 0; first < rows; first += page) {
+        for (int row = first; row < std::min(rows, first + page); ++row) {
+            proxy.data(proxy.index(row, 0), Qt::DecorationRole);
+        }
+        QElapsedTimer pageTimer;
+        pageTimer.start();
+        do {
+            QCoreApplication::processEvents(QEventLoop::AllEvents, scrollMs);
+        } while (pageTimer.elapsed() < scrollMs);
+    }
+    // the last page stays shown while the rest of the thumbnails are loaded
+    first = std::max(0, rows - page);
+    QElapsedTimer drainTimer;
+    drainTimer.start();
+    while (counter(PerfTrace::ThumbnailQueue) > 0 && drainTimer.elapsed() < kDrainTimeoutMs) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    QCoreApplication::processEvents();
+    const double ms = elapsedMs(timer);
+
+    const qint64 loaded = counter(PerfTrace::ThumbnailMemoryHits) + counter(PerfTrace::ThumbnailDiskHits) +
+                          counter(PerfTrace::ThumbnailGenerated) - counter(PerfTrace::ThumbnailFailed);
+    const qint64 shown = counter(PerfTrace::ThumbnailShown);
+    QJsonObject object = cacheCounters();
+    object[QStringLiteral("name")] = name;
+    object[QStringLiteral("files")] = rows;
+    object[QStringLiteral("threads")] = static_cast<int>(Fm::ThumbnailJob::maxDecodeThreads());
+    object[QStringLiteral("ms")] = ms;
+    object[QStringLiteral("first_ms")] = firstMs;
+    object[QStringLiteral("shown")] = shown;
+    object[QStringLiteral("wasted")] = std::max<qint64>(loaded - shown, 0);
+    object[QStringLiteral("peak_rss_mib")] = peakMemoryMiB();
+    return object;
+}
+
+void benchSet(const QString& set,
+              const QString& dir,
+              const QString& cacheDir,
+              const std::vector<unsigned int>& threadCounts,
+              int size,
+              int page,
+              int scrollMs,
+              QJsonArray& results) {
+    const auto folder = loadFolder(dir);
+    const Fm::FileInfoList files = folder->files();
+    const unsigned int defaultThreads = Fm::ThumbnailJob::maxDecodeThreads();
+    for (unsigned int threads : threadCounts) {
+        dropCaches(cacheDir, true);
+        results.append(benchJob(set + QStringLiteral("/cold"), files, size, threads));
+        dropCaches(cacheDir, false);
+        results.append(benchJob(set + QStringLiteral("/disk"), files, size, threads));
+        results.append(benchJob(set + QStringLiteral("/memory"), files, size, threads));
+    }
+    Fm::ThumbnailJob::setMaxDecodeThreads(defaultThreads);
+
+    dropCaches(cacheDir, true);
+    results.append(benchScroll(set + QStringLiteral("/scroll"), folder, size, page, scrollMs));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    // the thumbnails of the user are neither used nor touched
+    QTemporaryDir root;
+    if (!root.isValid()) {
+        qWarning("cannot create a temporary directory");
+        return 1;
+    }
+    const QString cacheDir = root.filePath(QStringLiteral("cache"));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(cacheDir));
+
+    QApplication app(argc, argv);
+    Fm::LibFmQt context;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption imagesOption(QStringLiteral("images"), QStringLiteral("Number of JPEG and PNG images."),
+                                    QStringLiteral("count"), QStringLiteral("200"));
+    QCommandLineOption rawsOption(QStringLiteral("raws"), QStringLiteral("Number of RAW files."),
+                                  QStringLiteral("count"), QStringLiteral("40"));
+    QCommandLineOption videosOption(QStringLiteral("videos"), QStringLiteral("Number of videos."),
+                                    QStringLiteral("count"), QStringLiteral("20"));
+    QCommandLineOption threadsOption(QStringLiteral("threads"),
+                                     QStringLiteral("Numbers of decode threads, comma-separated."),
+                                     QStringLiteral("list"), QStringLiteral("1,2,4,8"));
+    QCommandLineOption sizeOption(QStringLiteral("size"), QStringLiteral("Thumbnail size in pixels."),
+                                  QStringLiteral("pixels"), QStringLiteral("128"));
+    QCommandLineOption pageOption(QStringLiteral("page"), QStringLiteral("Rows shown at a time while scrolling."),
+                                  QStringLiteral("rows"), QStringLiteral("40"));
+    QCommandLineOption scrollOption(QStringLiteral("scroll-ms"), QStringLiteral("Time each page is shown."),
+                                    QStringLiteral("ms"), QStringLiteral("50"));
+    QCommandLineOption jsonOption(QStringLiteral("json"), QStringLiteral("Write the results to a file."),
+                                  QStringLiteral("file"));
+    parser.addOptions(
+        {imagesOption, rawsOption, videosOption, threadsOption, sizeOption, pageOption, scrollOption, jsonOption});
+    parser.process(app);
+
+    std::vector<unsigned int> threadCounts;
+    for (const QString& threads : parser.value(threadsOption).split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        if (threads.toUInt() > 0) {
+            threadCounts.push_back(threads.toUInt());
+        }
+    }
+    const int size = std::max(1, parser.value(sizeOption).toInt());
+    const int page = std::max(1, parser.value(pageOption).toInt());
+    const int scrollMs = std::max(0, parser.value(scrollOption).toInt());
+    Fm::PerfTrace::setEnabled(true);
+
+    struct Set {
+        const char* name;
+        QCommandLineOption* option;
+        bool (*make)(const QString& dir, int count);
+    };
+    const Set sets[] = {{"image", &imagesOption, makeImages},
+                        {"raw", &rawsOption, makeRaws},
+                        {"video", &videosOption, makeVideos}};
+    QJsonArray results;
+    for (const Set& set : sets) {
+        const int count = parser.value(*set.option).toInt();
+        const QString name = QLatin1String(set.name);
+        const QString dir = root.filePath(name);
+        if (count <= 0 || !QDir().mkpath(dir)) {
+            continue;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        if (!set.make(dir, count)) {
+            qWarning("cannot make the %s files, skipped", set.name);
+            continue;
+        }
+        results.append(QJsonObject{{QStringLiteral("name"), name + QStringLiteral("/make")},
+                                   {QStringLiteral("files"), count},
+                                   {QStringLiteral("ms"), elapsedMs(timer)}});
+        benchSet(name, dir, cacheDir, threadCounts, size, page, scrollMs, results);
+    }
+
+    const QByteArray json =
+        QJsonDocument(QJsonObject{{QStringLiteral("version"), 1}, {QStringLiteral("results"), results}}).toJson();
+    if (parser.isSet(jsonOption)) {
+        QFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+            qWarning("cannot write %s", qPrintable(file.fileName()));
+            return 1;
+        }
+    }
+    else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+    return 0;
+}
@@ -19,6 +19,7 @@
 
 #include "utilities.h"
 #include "utilities_p.h"
+#include "filelistmimedata.h"
 #include <QApplication>
 #include <QClipboard>
 #include <QMimeData>
@@ -37,7 +38,9 @@
 #include <pwd.h>
 #include <grp.h>
 #include <cstdlib>
+#include <cstring>
 #include <glib.h>
+#include <string>
 #include <unistd.h>
 #include <vector>
 
@@ -45,13 +48,17 @@ namespace Fm {
 
 Fm::FilePathList pathListFromUriList(const char* uriList) {
     Fm::FilePathList pathList;
-    char** uris = g_strsplit_set(uriList, "\r\n", -1);
-    for (char** uri = uris; *uri; ++uri) {
-        if (**uri != '\0') {
-            pathList.push_back(Fm::FilePath::fromUri(*uri));
+    // one buffer for every line rather than a copy of the whole list and of each line
+    std::string uri;
+    for (const char* line = uriList; *line;) {
+        const size_t len = strcspn(line, "\r\n");
+        if (len > 0) {
+            uri.assign(line, len);
+            pathList.push_back(Fm::FilePath::fromUri(uri.c_str()));
         }
+        line += len;
+        line += strspn(line, "\r\n");
     }
-    g_strfreev(uris);
     return pathList;
 }
 
@@ -82,7 +89,12 @@ void pasteFilesFromClipboard(const Fm::FilePath& destPath, QWidget* parent) {
     Fm::FilePathList paths;
     bool isCut = false;
 
-    if (data->hasFormat(QStringLiteral("x-special/gnome-copied-files"))) {
+    if (auto fileList = FileListMimeData::fromMimeData(data)) {
+        // copied or cut in this process
+        paths = fileList->paths();
+        isCut = fileList->isCut();
+    }
+    else if (data->hasFormat(QStringLiteral("x-special/gnome-copied-files"))) {
         // Gnome, LXDE, and XFCE
         QByteArray gnomeData = data->data(QStringLiteral("x-special/gnome-copied-files"));
         char* pdata = gnomeData.data();
@@ -116,31 +128,12 @@ void pasteFilesFromClipboard(const Fm::FilePath& destPath, QWidget* parent) {
 }
 
 void copyFilesToClipboard(const Fm::FilePathList& files) {
-    QClipboard* clipboard = QApplication::clipboard();
-    QMimeData* data = new QMimeData();
-    auto urilist = pathListToUriList(files);
-
-    // Gnome, LXDE, and XFCE
-    // Note: the standard text/urilist format uses CRLF for line breaks, but gnome format uses LF only
-    data->setData(QStringLiteral("x-special/gnome-copied-files"), QByteArray("copy\n") + urilist.replace("\r\n", "\n"));
-    // The KDE way
-    data->setData(QStringLiteral("text/uri-list"), urilist);
-    // data->setData(QStringLiteral("application/x-kde-cutselection"), QByteArrayLiteral("0"));
-    clipboard->setMimeData(data);
+    // the URI lists are only built when another application pastes
+    QApplication::clipboard()->setMimeData(new FileListMimeData{files, FileListMimeData::Copy});
 }
 
 void cutFilesToClipboard(const Fm::FilePathList& files) {
-    QClipboard* clipboard = QApplication::clipboard();
-    QMimeData* data = new QMimeData();
-    auto urilist = pathListToUriList(files);
-
-    // Gnome, LXDE, and XFCE
-    // Note: the standard text/urilist format uses CRLF for line breaks, but gnome format uses LF only
-    data->setData(QStringLiteral("x-special/gnome-copied-files"), QByteArray("cut\n") + urilist.replace("\r\n", "\n"));
-    // The KDE way
-    data->setData(QStringLiteral("text/uri-list"), urilist);
-    data->setData(QStringLiteral("application/x-kde-cutselection"), QByteArrayLiteral("1"));
-    clipboard->setMimeData(data);
+    QApplication::clipboard()->setMimeData(new FileListMimeData{files, FileListMimeData::Cut});
 }
 
 bool changeFileName(const Fm::FilePath& filePath, const QString& newName, QWidget* parent, bool showMessage) {
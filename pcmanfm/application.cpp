@@ -12,6 +12,7 @@
 
 // Std Headers
 #include <algorithm>
+#include <cerrno>
 #include <unordered_map>
 #include <vector>
 
@@ -28,6 +29,8 @@
 #include <QFile>
 #include <QFileSystemWatcher>
 #include <QIcon>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QLibraryInfo>
 #include <QLocale>
 #include <QMessageBox>
@@ -36,6 +39,7 @@
 #include <QStandardPaths>
 #include <QTimer>
 #include <QVector>
+#include <QtConcurrent>
 
 // Local Headers
 #include "applicationadaptor.h"
@@ -48,12 +52,20 @@
 #include "../src/ui/fsqt.h"
 #include "../src/ui/filepropertiesdialog.h"
 #include "../src/backends/qt/qt_fileinfo.h"
+#include "../src/core/backend_registry.h"
+#include "../src/core/device_profiles.h"
+#include "../src/core/fs_ops.h"
+#include "../src/core/startup_trace.h"
+#include "../src/core/trash_store.h"
 
 namespace PCManFM {
 
 static const char* serviceName = "org.pcmanfm.PCManFM";
 static const char* ifaceName = "org.pcmanfm.Application";
 
+// how long the daemon keeps its caches once its last window is closed
+static constexpr int kIdleTrimDelay = 10 * 60 * 1000;
+
 //-----------------------------------------------------------------------------
 // ProxyStyle
 //-----------------------------------------------------------------------------
@@ -90,20 +102,105 @@ static void sigtermHandler(int) {
     }
 }
 
+//-----------------------------------------------------------------------------
+// Local File Operations
+//-----------------------------------------------------------------------------
+
+// Lets the paste, drop and move jobs of libfm-qt copy local files with the FsOps engine
+// (reflinks, copy_file_range() and the other in-kernel tiers) instead of g_file_copy().
+static int copyLocalFile(const char* srcPath,
+                         const char* destPath,
+                         const Panel::FileTransferJob::ProgressFunc& progress) {
+    FsOps::CopyOptions options;
+    // like g_file_copy(), leave writing back to the kernel
+    options.durability = FsOps::Durability::None;
+    options.profiles = &FsOps::DeviceProfiles::instance();
+    FsOps::ProgressInfo info;
+    FsOps::Error err;
+    const FsOps::ProgressCallback callback = [&progress](const FsOps::ProgressInfo& p) {
+        return progress(p.bytesDone, p.bytesTotal);
+    };
+    const bool copied = FsOps::copy_path(srcPath, destPath, info, callback, err, options);
+    // only written when a setting changed, not after every file
+    FsOps::Error saveErr;
+    options.profiles->save(saveErr);
+    if (copied) {
+        return 0;
+    }
+    return err.code != 0 ? err.code : EIO;
+}
+
+// Copies files from and to sftp:// locations with the remote backend, which keeps many
+// requests in flight on one connection per server instead of gvfsd-sftp's one at a time.
+static int copyRemoteFile(const char* srcUri,
+                          const char* destUri,
+                          bool overwrite,
+                          const Panel::FileTransferJob::ProgressFunc& progress) {
+    return BackendRegistry::remoteBackend()->copyFile(QUrl(QString::fromUtf8(srcUri)), QUrl(QString::fromUtf8(destUri)),
+                                                      overwrite, progress);
+}
+
+// Deletes local trees with FsOps, sibling subdirectories on several threads.
+static bool deleteLocalTree(const char* path, const std::function<bool()>& tick) {
+    FsOps::DeleteOptions options;
+    options.workerCount = 0;
+    FsOps::ProgressInfo info;
+    FsOps::Error err;
+    return FsOps::delete_path(path, info, [&tick](const FsOps::ProgressInfo&) { return tick(); }, err, options);
+}
+
+// Trashes local files straight into the freedesktop.org trash directories.
+static void trashLocalFiles(const std::vector<std::string>& paths,
+                            std::vector<int>& errors,
+                            const std::function<bool()>& tick) {
+    TrashStore::instance().trash(paths, errors, tick);
+}
+
+static bool emptyTrash(const std::function<bool()>& tick) {
+    FsOps::Error err;
+    return TrashStore::instance().empty(tick, err);
+}
+
+// The trace of the start-up phases when $PCMANFM_QT_STARTUP_TRACE names the file to write it to,
+// with the initialization of libfm-qt begun.
+static StartupTrace* newStartupTrace(const char* path) {
+    if (!path || !*path) {
+        return nullptr;
+    }
+    auto* trace = new StartupTrace();
+    trace->begin("libfm-qt");
+    return trace;
+}
+
 //-----------------------------------------------------------------------------
 // Application Class
 //-----------------------------------------------------------------------------
 
 Application::Application(int& argc, char** argv)
     : QApplication(argc, argv),
+      startupTracePath_(qEnvironmentVariable("PCMANFM_QT_STARTUP_TRACE").toStdString()),
+      startupTrace_(newStartupTrace(startupTracePath_.c_str())),
       libFm_(),
       settings_(),
       profileName_(QStringLiteral("default")),
       daemonMode_(false),
+      idleTrimTimer_(nullptr),
+      listingService_(nullptr),
       preferencesDialog_(),
       editBookmarksialog_(),
       userDirsWatcher_(nullptr),
       openingLastTabs_(false) {
+    if (startupTrace_) {
+        startupTrace_->end();  // libfm-qt
+    }
+    if (qEnvironmentVariableIsSet("PCMANFM_QT_PERF_TRACE")) {
+        Panel::PerfTrace::setEnabled(true);
+    }
+    if (qEnvironmentVariableIsSet("PCMANFM_QT_MEMORY_STATS")) {
+        Panel::MemoryStats::setEnabled(true);
+    }
+    StartupTrace::Scope scope(startupTrace_.get(), "D-Bus registration");
+
     argc_ = argc;
     argv_ = argv;
 
@@ -118,6 +215,7 @@ Application::Application(int& argc, char** argv)
 
         setStyle(new ProxyStyle());
 
+        listingService_ = new Panel::SharedListingService(this);
         new ApplicationAdaptor(this);
         dbus.registerObject(QStringLiteral("/Application"), this);
 
@@ -221,13 +319,25 @@ bool Application::parseCommandLineArgs() {
         }
 
         // load global application configuration
-        settings_.load(profileName_);
+        {
+            StartupTrace::Scope scope(startupTrace_.get(), "settings");
+            settings_.load(profileName_);
+        }
+        if (listingService_) {
+            listingService_->setEnabled(settings_.shareListings());
+        }
         // Disable libfm-qt archiver integration; compression is handled in-process.
         Panel::Archiver::setDefaultArchiver(nullptr);
 
         // initialize per-folder config backed by dir-settings.conf
-        const QString perFolderConfigFile = settings_.profileDir(profileName_) + QStringLiteral("/dir-settings.conf");
-        Panel::FolderConfig::init(perFolderConfigFile.toLocal8Bit().constData());
+        {
+            StartupTrace::Scope scope(startupTrace_.get(), "per-folder config");
+            const QString perFolderConfigFile =
+                settings_.profileDir(profileName_) + QStringLiteral("/dir-settings.conf");
+            Panel::FolderConfig::init(perFolderConfigFile.toLocal8Bit().constData());
+        }
+
+        StartupTrace::Scope scope(startupTrace_.get(), "first window");
 
         if (settings_.useFallbackIconTheme()) {
             QIcon::setThemeName(settings_.fallbackIconThemeName());
@@ -260,6 +370,8 @@ bool Application::parseCommandLineArgs() {
             }
             keepRunning = true;
         }
+        // the windows are shown once the event loop runs
+        QTimer::singleShot(0, this, &Application::onStartupFinished);
     }
     else {
         // secondary instance, forward the request to the primary via DBus
@@ -297,6 +409,8 @@ bool Application::parseCommandLineArgs() {
 }
 
 void Application::init() {
+    StartupTrace::Scope scope(startupTrace_.get(), "translations");
+
     // load Qt translations
     if (qtTranslator.load(QStringLiteral("qt_") + QLocale::system().name(),
                           QLibraryInfo::path(QLibraryInfo::TranslationsPath))) {
@@ -306,6 +420,14 @@ void Application::init() {
     // load libfm-qt translations
     installTranslator(libFm_.translator());
 
+    Panel::FileTransferJob::setLocalFileCopier(&copyLocalFile);
+    if (BackendRegistry::remoteBackend()) {
+        Panel::FileTransferJob::setRemoteFileCopier(&copyRemoteFile);
+    }
+    Panel::DeleteJob::setLocalTreeDeleter(&deleteLocalTree);
+    Panel::DeleteJob::setTrashEmptier(&emptyTrash);
+    Panel::TrashJob::setLocalTrasher(&trashLocalFiles);
+
     // load pcmanfm-qt translations
     if (translator.load(QStringLiteral("pcmanfm-qt_") + QLocale::system().name(),
                         QStringLiteral(PCMANFM_DATA_DIR) + QStringLiteral("/translations"))) {
@@ -313,6 +435,73 @@ void Application::init() {
     }
 }
 
+void Application::onStartupFinished() {
+    // Thumbnailers are loaded on first use; read their definitions off the GUI thread now, so
+    // the first thumbnails need not wait for them.
+    (void)QtConcurrent::run([] { Panel::Thumbnailer::ensureLoaded(); });
+    // at most once a day, on a thread of idle priority
+    Panel::ThumbnailCache::globalInstance()->scheduleMaintenance();
+
+    if (daemonMode_) {
+        warmUp();
+    }
+
+    if (!startupTrace_) {
+        return;
+    }
+    startupTrace_->mark("event loop");
+    std::string error;
+    if (!startupTrace_->write(startupTracePath_, error)) {
+        qWarning("Can't write the start-up trace: %s", error.c_str());
+    }
+    startupTrace_.reset();
+}
+
+void Application::warmUp() {
+    // The places model would be destroyed with the last window, and its volumes scanned again
+    // for the next one.
+    warmPlaces_ = Panel::PlacesModel::globalInstance();
+    // Load the home folder into the pool of unused folder models, from which the first window
+    // of a hotkey or xdg-open takes it.
+    if (auto* model = Panel::CachedFolderModel::modelFromPath(Panel::FilePath::homeDir())) {
+        model->unref();
+    }
+
+    idleTrimTimer_ = new QTimer(this);
+    idleTrimTimer_->setSingleShot(true);
+    idleTrimTimer_->setInterval(kIdleTrimDelay);
+    idleTrimTimer_->setTimerType(Qt::VeryCoarseTimer);
+    connect(idleTrimTimer_, &QTimer::timeout, this, &Application::trimIdleMemory);
+    connect(this, &QGuiApplication::lastWindowClosed, this, &Application::onLastWindowClosed);
+}
+
+void Application::trimIdleMemory() {
+    const QWidgetList windows = topLevelWidgets();
+    for (const auto* win : windows) {
+        if (win->isVisible()) {
+            return;  // in use again
+        }
+    }
+    trimCaches();
+    // a daemon may run for days; if a day has passed, this is a good time to trim the disk cache too
+    Panel::ThumbnailCache::globalInstance()->scheduleMaintenance();
+}
+
+void Application::trimCaches() {
+    Panel::CacheRegistry::globalInstance()->trimAll();
+}
+
+QDBusUnixFileDescriptor Application::openListing(const QString& uri, qulonglong knownGeneration) {
+    QDBusUnixFileDescriptor listing;
+    if (listingService_) {
+        const int fd = listingService_->open(Panel::FilePath::fromUri(uri.toUtf8().constData()), knownGeneration);
+        if (fd >= 0) {
+            listing.giveFileDescriptor(fd);
+        }
+    }
+    return listing;
+}
+
 int Application::exec() {
     if (!parseCommandLineArgs()) {
         return 0;
@@ -329,6 +518,10 @@ int Application::exec() {
 void Application::onAboutToQuit() {
     qDebug("aboutToQuit");
     settings_.save();
+    if (settings_.indexHome()) {
+        // writes the index out, and stops watching the home folder
+        Panel::SearchIndex::globalInstance()->setRoots({});
+    }
 }
 
 void Application::cleanPerFolderConfig() {
@@ -364,7 +557,9 @@ void Application::cleanPerFolderConfig() {
 }
 
 void Application::onLastWindowClosed() {
-    // kept for future use if we need custom behavior when the last window closes
+    if (idleTrimTimer_) {
+        idleTrimTimer_->start();
+    }
 }
 
 void Application::onSaveStateRequest(QSessionManager& /*manager*/) {
@@ -385,6 +580,7 @@ void Application::onFindFileAccepted() {
     settings_.setSearchContentRegexp(dlg->contentRegexp());
     settings_.setSearchRecursive(dlg->recursive());
     settings_.setSearchhHidden(dlg->searchhHidden());
+    settings_.setSearchMaxResults(dlg->maxResults());
     settings_.addNamePattern(dlg->namePattern());
     settings_.addContentPattern(dlg->contentPattern());
 
@@ -424,6 +620,7 @@ void Application::findFiles(QStringList paths) {
     dlg->setContentRegexp(settings_.searchContentRegexp());
     dlg->setRecursive(settings_.searchRecursive());
     dlg->setSearchhHidden(settings_.searchhHidden());
+    dlg->setMaxResults(settings_.searchMaxResults());
     dlg->addNamePatterns(settings_.namePatterns());
     dlg->addContentPatterns(settings_.contentPatterns());
 
@@ -547,6 +744,28 @@ void Application::openFolderInTerminal(Panel::FilePath path) {
     }
 }
 
+void Application::setPerfTracing(bool enabled) {
+    Panel::PerfTrace::setEnabled(enabled);
+}
+
+QString Application::perfTrace() {
+    return QString::fromUtf8(Panel::PerfTrace::toChromeTrace());
+}
+
+void Application::setMemoryStats(bool enabled) {
+    Panel::MemoryStats::setEnabled(enabled);
+}
+
+QString Application::memoryStats() {
+    QJsonObject stats;
+    for (int i = 0; i < Panel::MemoryStats::NumSubsystems; ++i) {
+        const auto subsystem = static_cast<Panel::MemoryStats::Subsystem>(i);
+        stats[QLatin1String(Panel::MemoryStats::subsystemName(subsystem))] =
+            static_cast<qint64>(Panel::MemoryStats::liveBytes(subsystem));
+    }
+    return QString::fromUtf8(QJsonDocument(stats).toJson(QJsonDocument::Compact));
+}
+
 void Application::preferences(const QString& page) {
     // open or reuse the preferences dialog and show the requested page
     if (!preferencesDialog_) {
@@ -673,6 +892,9 @@ void Application::onPropJobFinished() {
 
 // called when Settings is changed to update UI
 void Application::updateFromSettings() {
+    if (listingService_) {
+        listingService_->setEnabled(settings_.shareListings());
+    }
     const QWidgetList windows = this->topLevelWidgets();
     for (QWidget* window : windows) {
         if (window->inherits("PCManFM::MainWindow")) {
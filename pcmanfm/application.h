@@ -23,19 +23,25 @@
 #include "panel/panel.h"
 
 #include <QApplication>
+#include <QDBusUnixFileDescriptor>
 #include <QPointer>
 #include <QProxyStyle>
 #include <QTranslator>
 #include <QVector>
 
+#include <memory>
+#include <string>
+
 #include "settings.h"
 
 class QFileSystemWatcher;
+class QTimer;
 
 namespace PCManFM {
 
 class MainWindow;
 class PreferencesDialog;
+class StartupTrace;
 
 class ProxyStyle : public QProxyStyle {
     Q_OBJECT
@@ -64,6 +70,10 @@ class Application : public QApplication {
 
     bool openingLastTabs() const { return openingLastTabs_; }
 
+    // The timing of the start-up phases, when $PCMANFM_QT_STARTUP_TRACE names a file to write
+    // it to; null otherwise, and once start-up is over.
+    StartupTrace* startupTrace() const { return startupTrace_.get(); }
+
     // public interface exported via dbus
     void launchFiles(const QString& cwd, const QStringList& paths, bool inNewWindow, bool reopenLastTabs);
     void preferences(const QString& page);
@@ -73,6 +83,19 @@ class Application : public QApplication {
     void ShowItems(const QStringList& uriList, const QString& startupId);
     void ShowItemProperties(const QStringList& uriList, const QString& startupId);
     void connectToServer();
+    // Switches the counters and spans of libfm-qt on or off; they start on when
+    // $PCMANFM_QT_PERF_TRACE is set. perfTrace() is what was recorded, as Chrome trace JSON.
+    void setPerfTracing(bool enabled);
+    QString perfTrace();
+    // Switches the accounting of memory per subsystem on or off; it starts on when
+    // $PCMANFM_QT_MEMORY_STATS is set. memoryStats() is the live bytes of each, as JSON.
+    void setMemoryStats(bool enabled);
+    QString memoryStats();
+    // Gives back what the caches hold and nothing shown needs.
+    void trimCaches();
+    // The listing of the folder |uri| for the file dialog of another application, or what
+    // changed in it since |knownGeneration|; see Panel::SharedListingService.
+    QDBusUnixFileDescriptor openListing(const QString& uri, qulonglong knownGeneration);
 
     void updateFromSettings();
 
@@ -99,16 +122,27 @@ class Application : public QApplication {
 
    private Q_SLOTS:
     void onPropJobFinished();
+    // runs once the event loop has started, after the first window was shown
+    void onStartupFinished();
 
    private:
     void initWatch();
     void installSigtermHandler();
+    // keeps what new windows need loaded while the daemon has no window
+    void warmUp();
+    // gives the caches back once the daemon has had no window for a while
+    void trimIdleMemory();
 
     bool isPrimaryInstance;
+    std::string startupTracePath_;
+    std::unique_ptr<StartupTrace> startupTrace_;  // before |libFm_|, to time its initialization
     Panel::LibFmQt libFm_;
     Settings settings_;
     QString profileName_;
     bool daemonMode_;
+    std::shared_ptr<Panel::PlacesModel> warmPlaces_;  // held by the daemon between windows
+    QTimer* idleTrimTimer_;
+    Panel::SharedListingService* listingService_;  // only in the primary instance
     QPointer<PreferencesDialog> preferencesDialog_;
     QPointer<Panel::EditBookmarksDialog> editBookmarksialog_;
     QTranslator translator;
@@ -8,19 +8,50 @@
 // If you are migrating away from libfm-qt entirely, you will eventually
 // replace this header with your own Core/FileOps interface.
 #include "panel/panel.h"
+#include "../src/core/bulk_rename.h"
 
+#include <QEventLoop>
+#include <QFile>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QLocale>
 #include <QMessageBox>
 #include <QProgressDialog>
 #include <QPushButton>
 #include <QRegularExpression>
 #include <QTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 namespace PCManFM {
 
 namespace {
 
+// the problems with new names listed before the rest are only counted
+constexpr int kMaxReportedIssues = 10;
+constexpr int kProgressInterval = 100;  // ms
+
+QString problemText(BulkRename::Problem problem) {
+    switch (problem) {
+        case BulkRename::Problem::EmptyName:
+            return QObject::tr("empty name");
+        case BulkRename::Problem::InvalidName:
+            return QObject::tr("the name may not contain \"/\"");
+        case BulkRename::Problem::NameTooLong:
+            return QObject::tr("the name is too long");
+        case BulkRename::Problem::DuplicateName:
+            return QObject::tr("another file gets the same name");
+        case BulkRename::Problem::NameExists:
+            return QObject::tr("a file with this name exists");
+        case BulkRename::Problem::SourceMissing:
+            return QObject::tr("the file no longer exists");
+    }
+    return QString();
+}
+
 // Helper to resolve a usable name from FileInfo, respecting edit name and encoding
 // Refactored to avoid direct GLib calls where possible if the wrapper allows,
 // otherwise ensuring safe string conversion.
@@ -223,59 +254,27 @@ bool BulkRenamer::rename(const Panel::FileInfoList& files,
     const QRegularExpression extensionRegExp(QStringLiteral("\\.[^.#]+$"));
     const bool preserveExtension = (baseName.indexOf(extensionRegExp) == -1);
 
-    QProgressDialog progress(QObject::tr("Renaming files..."), QObject::tr("Abort"), 0, files.size(), parent);
-    progress.setWindowModality(Qt::WindowModal);
-
+    QStringList newNames;
+    newNames.reserve(files.size());
     int i = 0;
-    int failed = 0;
-
     for (const auto& file : files) {
-        progress.setValue(i);
-
-        if (progress.wasCanceled()) {
-            progress.close();
-            QMessageBox::warning(parent, QObject::tr("Warning"), QObject::tr("Renaming is aborted."));
-            return true;  // Return true because the user explicitly cancelled, not an error
-        }
-
-        QString fileName = effectiveFileName(file);
         QString newName = baseName;
 
         // Append original extension if required
         if (preserveExtension) {
             QRegularExpressionMatch match;
-            if (fileName.indexOf(extensionRegExp, 0, &match) > -1) {
+            if (effectiveFileName(file).indexOf(extensionRegExp, 0, &match) > -1) {
                 newName += match.captured();
             }
         }
 
         // Insert number
         newName.replace(QLatin1Char('#'), specifier.arg(start + i, numSpace, 10, zeroDigit));
-
-        // Skip rename if name hasn't changed
-        if (newName != fileName) {
-            // NOTE: Panel::changeFileName is a LibFM-Qt function.
-            // In the future architecture, this should call BackendRegistry::fileOps()->rename(...)
-            if (!Panel::changeFileName(file->path(), newName, nullptr, false)) {
-                ++failed;
-            }
-        }
-
+        newNames.push_back(newName);
         ++i;
     }
 
-    progress.setValue(i);
-
-    if (failed == i && i > 0) {
-        QMessageBox::critical(parent, QObject::tr("Error"), QObject::tr("No file could be renamed."));
-        return false;
-    }
-
-    if (failed > 0) {
-        QMessageBox::critical(parent, QObject::tr("Error"), QObject::tr("Some files could not be renamed."));
-    }
-
-    return true;
+    return renameFiles(files, newNames, parent);
 }
 
 bool BulkRenamer::renameByReplacing(const Panel::FileInfoList& files,
@@ -300,61 +299,131 @@ bool BulkRenamer::renameByReplacing(const Panel::FileInfoList& files,
             QMessageBox::critical(parent, QObject::tr("Error"), QObject::tr("Invalid regular expression."));
             return false;
         }
+        regexFind.optimize();
     }
 
-    QProgressDialog progress(QObject::tr("Renaming files..."), QObject::tr("Abort"), 0, files.size(), parent);
-    progress.setWindowModality(Qt::WindowModal);
-
-    int i = 0;
-    int failed = 0;
-
+    QStringList newNames;
+    newNames.reserve(files.size());
     for (const auto& file : files) {
-        progress.setValue(i);
-
-        if (progress.wasCanceled()) {
-            progress.close();
-            QMessageBox::warning(parent, QObject::tr("Warning"), QObject::tr("Renaming is aborted."));
-            return true;
-        }
-
-        QString fileName = effectiveFileName(file);
-        QString newName = fileName;
-
+        QString newName = effectiveFileName(file);
         if (regex) {
             newName.replace(regexFind, replaceStr);
         }
         else {
             newName.replace(findStr, replaceStr, cs);
         }
+        newNames.push_back(newName);
+    }
 
-        // Only attempt rename if the name actually changed
-        if (!newName.isEmpty() && newName != fileName) {
-            if (!Panel::changeFileName(file->path(), newName, nullptr, false)) {
-                ++failed;
-            }
-        }
+    return renameFiles(files, newNames, parent);
+}
 
-        ++i;
+bool BulkRenamer::renameByChangingCase(const Panel::FileInfoList& files,
+                                       const QLocale& locale,
+                                       bool toUpperCase,
+                                       QWidget* parent) {
+    QStringList newNames;
+    newNames.reserve(files.size());
+    for (const auto& file : files) {
+        const QString fileName = effectiveFileName(file);
+        newNames.push_back(toUpperCase ? locale.toUpper(fileName) : locale.toLower(fileName));
     }
 
-    progress.setValue(i);
+    return renameFiles(files, newNames, parent);
+}
 
-    if (failed == i && i > 0) {
-        QMessageBox::critical(parent, QObject::tr("Error"), QObject::tr("No file could be renamed."));
-        return false;
+bool BulkRenamer::renameFiles(const Panel::FileInfoList& files, const QStringList& newNames, QWidget* parent) {
+    const bool allLocal =
+        std::all_of(files.cbegin(), files.cend(), [](const std::shared_ptr<const Panel::FileInfo>& file) {
+            return file->path().isNative() && file->path().hasParent();
+        });
+    return allLocal ? renameLocalFiles(files, newNames, parent) : renameOneByOne(files, newNames, parent);
+}
+
+bool BulkRenamer::renameLocalFiles(const Panel::FileInfoList& files, const QStringList& newNames, QWidget* parent) {
+    std::vector<BulkRename::Item> items;
+    items.reserve(files.size());
+    std::vector<QString> displayNames;  // of the items, for reporting issues
+    displayNames.reserve(files.size());
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        const auto& file = files[i];
+        const QString& newName = newNames.at(int(i));
+        const QString fileName = effectiveFileName(file);
+        if (newName.isEmpty() || newName == fileName) {
+            continue;
+        }
+        items.push_back(BulkRename::Item{std::string(file->path().parent().localPath().get()), file->name(),
+                                         QFile::encodeName(newName).toStdString()});
+        displayNames.push_back(fileName + QStringLiteral(" \u2192 ") + newName);
+    }
+    if (items.empty()) {
+        return true;
     }
 
-    if (failed > 0) {
-        QMessageBox::critical(parent, QObject::tr("Error"), QObject::tr("Some files could not be renamed."));
+    BulkRename rename(std::move(items));
+    const auto issues = rename.validate();
+    if (!issues.empty()) {
+        QStringList lines;
+        for (const auto& issue : issues) {
+            if (lines.size() == kMaxReportedIssues) {
+                lines.push_back(QObject::tr("and %n more", nullptr, int(issues.size()) - kMaxReportedIssues));
+                break;
+            }
+            lines.push_back(displayNames[issue.item] + QStringLiteral(": ") + problemText(issue.problem));
+        }
+        QMessageBox::critical(parent, QObject::tr("Error"),
+                              QObject::tr("No file was renamed because some of the new names cannot be used:") +
+                                  QStringLiteral("\n\n") + lines.join(QLatin1Char('\n')));
+        return false;
     }
 
-    return true;
+    // the renaming runs in a worker thread while the progress dialog is polled
+    QProgressDialog progress(QObject::tr("Renaming files..."), QObject::tr("Abort"), 0, int(rename.stepCount()),
+                             parent);
+    progress.setWindowModality(Qt::WindowModal);
+    std::atomic<std::size_t> done{0};
+    std::atomic<bool> cancelled{false};
+    QObject::connect(&progress, &QProgressDialog::canceled, &progress, [&cancelled] { cancelled = true; });
+
+    std::string error;
+    QEventLoop loop;
+    QFutureWatcher<BulkRename::Outcome> watcher;
+    QObject::connect(&watcher, &QFutureWatcher<BulkRename::Outcome>::finished, &loop, &QEventLoop::quit);
+    QTimer progressTimer;
+    QObject::connect(&progressTimer, &QTimer::timeout, &progress, [&progress, &done] {
+        if (!progress.wasCanceled()) {
+            progress.setValue(int(done.load()));
+        }
+    });
+    watcher.setFuture(QtConcurrent::run([&rename, &done, &cancelled, &error] {
+        return rename.run(
+            [&done, &cancelled](std::size_t count) {
+                done = count;
+                return !cancelled;
+            },
+            error);
+    }));
+    progressTimer.start(kProgressInterval);
+    loop.exec();
+    progressTimer.stop();
+    progress.close();
+
+    switch (watcher.result()) {
+        case BulkRename::Outcome::Done:
+            return true;
+        case BulkRename::Outcome::Cancelled:
+            QMessageBox::warning(parent, QObject::tr("Warning"),
+                                 QObject::tr("Renaming is aborted. No file was renamed."));
+            return true;  // the user explicitly cancelled, not an error
+        case BulkRename::Outcome::Failed:
+            break;
+    }
+    QMessageBox::critical(parent, QObject::tr("Error"),
+                          QObject::tr("No file was renamed:") + QStringLiteral("\n\n") + QString::fromStdString(error));
+    return false;
 }
 
-bool BulkRenamer::renameByChangingCase(const Panel::FileInfoList& files,
-                                       const QLocale& locale,
-                                       bool toUpperCase,
-                                       QWidget* parent) {
+bool BulkRenamer::renameOneByOne(const Panel::FileInfoList& files, const QStringList& newNames, QWidget* parent) {
     QProgressDialog progress(QObject::tr("Renaming files..."), QObject::tr("Abort"), 0, files.size(), parent);
     progress.setWindowModality(Qt::WindowModal);
 
@@ -367,13 +436,13 @@ bool BulkRenamer::renameByChangingCase(const Panel::FileInfoList& files,
         if (progress.wasCanceled()) {
             progress.close();
             QMessageBox::warning(parent, QObject::tr("Warning"), QObject::tr("Renaming is aborted."));
-            return true;
+            return true;  // Return true because the user explicitly cancelled, not an error
         }
 
-        QString fileName = effectiveFileName(file);
-        QString newName = toUpperCase ? locale.toUpper(fileName) : locale.toLower(fileName);
+        const QString& newName = newNames.at(i);
 
-        if (!newName.isEmpty() && newName != fileName) {
+        // Only attempt rename if the name actually changed
+        if (!newName.isEmpty() && newName != effectiveFileName(file)) {
             if (!Panel::changeFileName(file->path(), newName, nullptr, false)) {
                 ++failed;
             }
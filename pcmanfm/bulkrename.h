@@ -91,6 +91,13 @@ class BulkRenamer {
                               const QLocale& locale,
                               bool toUpperCase,
                               QWidget* parent);
+
+    // Gives the files the names at the same index of |newNames|; an empty or unchanged name
+    // leaves a file alone. Returns false when the dialog should be shown again.
+    bool renameFiles(const Panel::FileInfoList& files, const QStringList& newNames, QWidget* parent);
+    // Local files are renamed all or none, by BulkRename in a worker thread.
+    bool renameLocalFiles(const Panel::FileInfoList& files, const QStringList& newNames, QWidget* parent);
+    bool renameOneByOne(const Panel::FileInfoList& files, const QStringList& newNames, QWidget* parent);
 };
 
 }  // namespace PCManFM
@@ -0,0 +1,345 @@
+/*
+ * Treemap of the sizes of what a folder holds
+ * pcmanfm/diskusageview.cpp
+ */
+
+#include "diskusageview.h"
+#include "../src/core/treemap_layout.h"
+#include <QHelpEvent>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QToolTip>
+#include <algorithm>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr int kMargin = 4;            // around the header and the map, in pixels
+constexpr qreal kMinLabelWidth = 40;  // narrower cells are drawn without their names
+
+}  // namespace
+
+DiskUsageView::DiskUsageView(QWidget* parent)
+    : QWidget(parent), index_{Panel::DirSizeIndex::globalInstance()}, job_{nullptr} {
+    setFocusPolicy(Qt::StrongFocus);
+    setBackgroundRole(QPalette::Base);
+    setAutoFillBackground(true);
+    // other tabs and the size column measure folders too
+    connect(index_.get(), &Panel::DirSizeIndex::changed, this, &DiskUsageView::onIndexChanged, Qt::QueuedConnection);
+}
+
+DiskUsageView::~DiskUsageView() {
+    cancelMeasure();
+}
+
+void DiskUsageView::setFolder(std::shared_ptr<Panel::Folder> folder) {
+    if (folder == folder_) {
+        return;
+    }
+    cancelMeasure();
+    if (folder_) {
+        disconnect(folder_.get(), nullptr, this, nullptr);
+    }
+    folder_ = std::move(folder);
+    items_.clear();
+    if (folder_ && folder_->path().isNative()) {
+        connect(folder_.get(), &Panel::Folder::finishLoading, this, &DiskUsageView::reload);
+        connect(folder_.get(), &Panel::Folder::filesAdded, this, &DiskUsageView::onFilesAdded);
+        connect(folder_.get(), &Panel::Folder::filesChanged, this, &DiskUsageView::onFilesChanged);
+        connect(folder_.get(), &Panel::Folder::filesRemoved, this, &DiskUsageView::onFilesRemoved);
+        if (folder_->isLoaded()) {
+            reload();
+            return;
+        }
+    }
+    update();
+}
+
+void DiskUsageView::reload() {
+    items_.clear();
+    for (const auto& info : folder_->files()) {
+        items_.push_back(makeItem(info));
+    }
+    measureNext();
+    relayout();
+    update();
+}
+
+void DiskUsageView::onFilesAdded(const Panel::FileInfoList& files) {
+    for (const auto& info : files) {
+        items_.push_back(makeItem(info));
+    }
+    measureNext();
+    relayout();
+    update();
+}
+
+void DiskUsageView::onFilesChanged(const std::vector<Panel::FileInfoPair>& pairs) {
+    for (const auto& pair : pairs) {
+        auto it = std::find_if(items_.begin(), items_.end(),
+                               [&pair](const Item& item) { return item.info->path() == pair.first->path(); });
+        if (it == items_.end()) {
+            continue;
+        }
+        *it = makeItem(pair.second);
+        // the folder changed while it was being counted
+        if (!it->measured && it->info->path() == measuring_) {
+            cancelMeasure();
+        }
+    }
+    measureNext();
+    relayout();
+    update();
+}
+
+void DiskUsageView::onFilesRemoved(const Panel::FileInfoList& files) {
+    for (const auto& info : files) {
+        if (info->path() == measuring_) {
+            cancelMeasure();
+        }
+        items_.erase(std::remove_if(items_.begin(), items_.end(),
+                                    [&info](const Item& item) { return item.info->path() == info->path(); }),
+                     items_.end());
+    }
+    measureNext();
+    relayout();
+    update();
+}
+
+void DiskUsageView::onIndexChanged() {
+    bool found = false;
+    for (auto& item : items_) {
+        if (!item.measured && item.info->path() != measuring_ && lookupSize(item)) {
+            item.measured = true;
+            found = true;
+        }
+    }
+    if (found) {
+        relayout();
+        update();
+    }
+}
+
+void DiskUsageView::onMeasureProgress() {
+    if (!job_) {
+        return;
+    }
+    for (auto& item : items_) {
+        if (item.info->path() == measuring_) {
+            item.size = job_->totalSize();
+            relayout();
+            update();
+            break;
+        }
+    }
+}
+
+void DiskUsageView::onMeasureFinished() {
+    // called while the job waits, so its totals can still be read
+    auto job = static_cast<Panel::TotalSizeJob*>(sender());
+    if (job != job_) {  // cancelled
+        return;
+    }
+    for (auto& item : items_) {
+        if (item.info->path() == measuring_) {
+            // also when parts of the tree could not be read, so that it is not counted forever
+            item.size = job->totalSize();
+            item.measured = true;
+            break;
+        }
+    }
+    job_ = nullptr;
+    measuring_ = Panel::FilePath();
+    measureNext();
+    relayout();
+    update();
+}
+
+DiskUsageView::Item DiskUsageView::makeItem(const std::shared_ptr<const Panel::FileInfo>& info) const {
+    Item item;
+    item.info = info;
+    if (info->isDir() && !info->isSymlink()) {
+        item.measured = lookupSize(item);
+    }
+    else {
+        item.size = info->size();
+    }
+    return item;
+}
+
+bool DiskUsageView::lookupSize(Item& item) const {
+    Panel::DirSizeIndex::Sizes sizes;
+    if (!index_->lookup(*item.info, sizes)) {
+        return false;
+    }
+    item.size = sizes.size;
+    return true;
+}
+
+void DiskUsageView::measureNext() {
+    if (job_) {
+        return;
+    }
+    auto it = std::find_if(items_.begin(), items_.end(), [](const Item& item) { return !item.measured; });
+    if (it == items_.end()) {
+        return;
+    }
+    measuring_ = it->info->path();
+    // what is mounted below a folder does not take up room on its disk
+    job_ = new Panel::TotalSizeJob(Panel::FilePathList{measuring_}, Panel::TotalSizeJob::SAME_FS);
+    connect(job_, &Panel::TotalSizeJob::totalsChanged, this, &DiskUsageView::onMeasureProgress, Qt::QueuedConnection);
+    connect(job_, &Panel::Job::finished, this, &DiskUsageView::onMeasureFinished, Qt::BlockingQueuedConnection);
+    job_->setAutoDelete(true);
+    Panel::JobScheduler::globalInstance()->start(job_, Panel::JobScheduler::Priority::Background, measuring_);
+}
+
+void DiskUsageView::cancelMeasure() {
+    if (job_) {
+        job_->cancel();
+        job_ = nullptr;
+        measuring_ = Panel::FilePath();
+    }
+}
+
+void DiskUsageView::relayout() {
+    std::stable_sort(items_.begin(), items_.end(), [](const Item& a, const Item& b) { return a.size > b.size; });
+    std::vector<std::uint64_t> sizes;
+    sizes.reserve(items_.size());
+    for (const auto& item : items_) {
+        sizes.push_back(item.size);
+    }
+    const QRectF bounds = mapRect();
+    const auto rects =
+        Treemap::squarify(sizes, Treemap::Rect{bounds.x(), bounds.y(), bounds.width(), bounds.height()});
+    for (std::size_t i = 0; i < items_.size(); ++i) {
+        items_[i].rect = QRectF(rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+    }
+}
+
+DiskUsageView::Item* DiskUsageView::itemAt(const QPointF& pos) {
+    for (auto& item : items_) {
+        if (item.rect.contains(pos)) {
+            return &item;
+        }
+    }
+    return nullptr;
+}
+
+QRectF DiskUsageView::mapRect() const {
+    const int top = fontMetrics().height() + 2 * kMargin;
+    return QRectF(rect().adjusted(kMargin, top, -kMargin, -kMargin));
+}
+
+bool DiskUsageView::event(QEvent* event) {
+    if (event->type() == QEvent::ToolTip) {
+        auto helpEvent = static_cast<QHelpEvent*>(event);
+        if (const Item* item = itemAt(helpEvent->pos())) {
+            QString text = item->info->displayName() + QLatin1Char('\n') +
+                           Panel::formatFileSize(item->size, fm_config->si_unit);
+            if (!item->measured) {
+                text += QLatin1Char(' ') + tr("(counting...)");
+            }
+            QToolTip::showText(helpEvent->globalPos(), text, this);
+        }
+        else {
+            QToolTip::hideText();
+            event->ignore();
+        }
+        return true;
+    }
+    return QWidget::event(event);
+}
+
+void DiskUsageView::paintEvent(QPaintEvent* /*event*/) {
+    if (!folder_) {
+        return;
+    }
+    QPainter painter(this);
+    const QFontMetrics metrics = fontMetrics();
+    const QRectF header(kMargin, kMargin, width() - 2 * kMargin, metrics.height());
+
+    std::uint64_t total = 0;
+    bool counting = false;
+    for (const auto& item : items_) {
+        total += item.size;
+        counting = counting || !item.measured;
+    }
+    QString title = QString::fromUtf8(folder_->path().displayName().get());
+    if (folder_->path().isNative()) {
+        title += QStringLiteral("  ") + Panel::formatFileSize(total, fm_config->si_unit);
+        if (counting) {
+            title += QLatin1Char(' ') + tr("(counting...)");
+        }
+    }
+    painter.setPen(palette().color(QPalette::Text));
+    painter.drawText(header, Qt::AlignLeft | Qt::AlignVCenter,
+                     metrics.elidedText(title, Qt::ElideMiddle, static_cast<int>(header.width())));
+
+    if (!folder_->path().isNative()) {
+        painter.drawText(mapRect(), Qt::AlignCenter, tr("Only local folders can be measured."));
+        return;
+    }
+    if (items_.empty() && folder_->isLoaded()) {
+        painter.drawText(mapRect(), Qt::AlignCenter, tr("This folder is empty."));
+        return;
+    }
+
+    const QColor dirColor = palette().color(QPalette::Highlight);
+    const QColor fileColor = palette().color(QPalette::Button);
+    for (const auto& item : items_) {
+        if (item.rect.width() < 1 || item.rect.height() < 1) {
+            continue;
+        }
+        const bool isDir = item.info->isDir() && !item.info->isSymlink();
+        painter.setPen(palette().color(QPalette::Mid));
+        painter.setBrush(isDir ? dirColor : fileColor);
+        painter.drawRect(item.rect);
+        if (!item.measured) {
+            painter.setBrush(QBrush(palette().color(QPalette::Base), Qt::BDiagPattern));
+            painter.drawRect(item.rect);
+        }
+
+        if (item.rect.width() < kMinLabelWidth || item.rect.height() < metrics.height()) {
+            continue;
+        }
+        const QRectF textRect = item.rect.adjusted(kMargin / 2, 0, -kMargin / 2, 0);
+        const int textWidth = static_cast<int>(textRect.width());
+        QString text = metrics.elidedText(item.info->displayName(), Qt::ElideRight, textWidth);
+        if (item.rect.height() >= 2 * metrics.height()) {
+            text += QLatin1Char('\n') +
+                    metrics.elidedText(Panel::formatFileSize(item.size, fm_config->si_unit), Qt::ElideRight, textWidth);
+        }
+        painter.setPen(palette().color(isDir ? QPalette::HighlightedText : QPalette::ButtonText));
+        painter.drawText(textRect, Qt::AlignCenter, text);
+    }
+}
+
+void DiskUsageView::resizeEvent(QResizeEvent* event) {
+    QWidget::resizeEvent(event);
+    relayout();
+}
+
+void DiskUsageView::mouseReleaseEvent(QMouseEvent* event) {
+    if (event->button() == Qt::LeftButton) {
+        const Item* item = itemAt(event->position());
+        if (item && item->info->isDir() && !item->info->isSymlink()) {
+            Q_EMIT folderActivated(item->info->path());
+        }
+    }
+    else if (event->button() == Qt::RightButton && folder_ && folder_->path().parent().isValid()) {
+        Q_EMIT folderActivated(folder_->path().parent());
+    }
+    QWidget::mouseReleaseEvent(event);
+}
+
+void DiskUsageView::keyPressEvent(QKeyEvent* event) {
+    if (event->key() == Qt::Key_Backspace && folder_ && folder_->path().parent().isValid()) {
+        Q_EMIT folderActivated(folder_->path().parent());
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,78 @@
+/*
+ * Treemap of the sizes of what a folder holds
+ * pcmanfm/diskusageview.h
+ */
+
+#ifndef PCMANFM_DISKUSAGEVIEW_H
+#define PCMANFM_DISKUSAGEVIEW_H
+
+#include <QRectF>
+#include <QWidget>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "panel/panel.h"
+
+namespace PCManFM {
+
+// Draws the files and folders of a folder as a squarified treemap, each with an area
+// proportional to its size. The totals of folders are taken from Fm::DirSizeIndex when it
+// knows them, so that going into a folder measured before is instant; the others are
+// measured one after another with TotalSizeJob, which stores the totals of every folder it
+// walks, and drawn as they grow. Changes reported by the folder's monitor only measure again
+// the folders whose totals they dropped. Only native folders are measured.
+class DiskUsageView : public QWidget {
+    Q_OBJECT
+
+   public:
+    explicit DiskUsageView(QWidget* parent = nullptr);
+    ~DiskUsageView() override;
+
+    void setFolder(std::shared_ptr<Panel::Folder> folder);
+
+   Q_SIGNALS:
+    // A folder was clicked, or its parent asked for with a right click or Backspace.
+    void folderActivated(const Panel::FilePath& path);
+
+   protected:
+    bool event(QEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+
+   private:
+    struct Item {
+        std::shared_ptr<const Panel::FileInfo> info;
+        std::uint64_t size = 0;
+        bool measured = true;  // false for a folder whose total is still being counted
+        QRectF rect;
+    };
+
+    void reload();
+    void onFilesAdded(const Panel::FileInfoList& files);
+    void onFilesChanged(const std::vector<Panel::FileInfoPair>& pairs);
+    void onFilesRemoved(const Panel::FileInfoList& files);
+    void onIndexChanged();
+    void onMeasureProgress();
+    void onMeasureFinished();
+
+    Item makeItem(const std::shared_ptr<const Panel::FileInfo>& info) const;
+    bool lookupSize(Item& item) const;
+    // Starts measuring the next folder that is not measured, if none is being measured.
+    void measureNext();
+    void cancelMeasure();
+    void relayout();
+    Item* itemAt(const QPointF& pos);
+    QRectF mapRect() const;
+
+    std::shared_ptr<Panel::Folder> folder_;
+    std::shared_ptr<Panel::DirSizeIndex> index_;
+    std::vector<Item> items_;  // largest first once laid out
+    Panel::TotalSizeJob* job_;
+    Panel::FilePath measuring_;  // the folder job_ counts
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_DISKUSAGEVIEW_H
@@ -30,7 +30,10 @@ HiddenShortcutsDialog::HiddenShortcutsDialog(QWidget* parent) : QDialog(parent)
            "Alt+Up: Go up<br>"
            "Alt+Left: Go back<br>"
            "Alt+Right: Go forward<br>"
-           "Backspace: Go up (optional)<br>"));
+           "Backspace: Go up (optional)<br>"
+           "<br>"
+           "<b>Debugging:</b><br>"
+           "Ctrl+Alt+Shift+P: Performance overlay<br>"));
     layout->addWidget(label);
 
     QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, this);
@@ -0,0 +1,117 @@
+/*
+ * Batch image conversion on parallel ImageMagick workers
+ * pcmanfm/image_batch_job.cpp
+ */
+
+#include "image_batch_job.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr int kMaxWorkers = 8;
+constexpr quint64 kMemoryPerWorker = 256 * 1024 * 1024;
+
+// Destinations for |sourcePaths| that neither exist nor collide with each other, such as
+// photo.jpg and photo.png both becoming photo.webp.
+QStringList destinationPaths(const QStringList& sourcePaths, const QString& outputDir, const QByteArray& format) {
+    QStringList destinations;
+    destinations.reserve(sourcePaths.size());
+    QSet<QString> taken;
+    const QDir dir(outputDir);
+    for (const QString& source : sourcePaths) {
+        const QFileInfo info(source);
+        const QString suffix = format.isEmpty() ? info.suffix() : QString::fromLatin1(format).toLower();
+        QString name = info.completeBaseName() + QLatin1Char('.') + suffix;
+        for (int i = 1; taken.contains(name) || dir.exists(name); ++i) {
+            name = info.completeBaseName() + QLatin1Char('_') + QString::number(i) + QLatin1Char('.') + suffix;
+        }
+        taken.insert(name);
+        destinations.append(dir.filePath(name));
+    }
+    return destinations;
+}
+
+}  // namespace
+
+ImageBatchJob::ImageBatchJob(QObject* parent) : QObject(parent), cancelRequested_(false) {}
+
+void ImageBatchJob::start(const QStringList& sourcePaths,
+                          const QString& outputDir,
+                          const ImageMagickConversion& conversion) {
+    cancelRequested_.store(false, std::memory_order_relaxed);
+
+    const QStringList destinations = destinationPaths(sourcePaths, outputDir, conversion.format);
+    auto future = QtConcurrent::run([this, sourcePaths, destinations, conversion]() -> Result {
+        const int total = static_cast<int>(sourcePaths.size());
+        const int ideal = QThread::idealThreadCount();
+        const int workers = std::clamp(std::min(ideal > 0 ? ideal : 1, total), 1, kMaxWorkers);
+
+        int savedThreads = 0;
+        quint64 savedMemory = 0;
+        ImageMagickSupport::resourceLimits(savedThreads, savedMemory);
+        ImageMagickSupport::setResourceLimits(1, kMemoryPerWorker * static_cast<quint64>(workers));
+
+        Result result;
+        std::mutex resultMutex;
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        auto convertImages = [&] {
+            for (int i; (i = next.fetch_add(1, std::memory_order_relaxed)) < total;) {
+                if (cancelRequested_.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                const QString& source = sourcePaths.at(i);
+                if (!ImageMagickSupport::convertImage(source, destinations.at(i), conversion)) {
+                    std::lock_guard<std::mutex> lock{resultMutex};
+                    result.failed.append(QFileInfo(source).fileName());
+                }
+                const int doneCount = done.fetch_add(1, std::memory_order_relaxed) + 1;
+                QMetaObject::invokeMethod(
+                    this, [this, doneCount, total, source] { Q_EMIT progress(quint64(doneCount), quint64(total), source); },
+                    Qt::QueuedConnection);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < workers; ++i) {
+            threads.emplace_back(convertImages);
+        }
+        convertImages();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        ImageMagickSupport::setResourceLimits(savedThreads, savedMemory);
+        result.cancelled = cancelRequested_.load(std::memory_order_relaxed);
+        return result;
+    });
+
+    connect(&watcher_, &QFutureWatcher<Result>::finished, this, &ImageBatchJob::onFinished);
+    watcher_.setFuture(future);
+}
+
+void ImageBatchJob::cancel() {
+    cancelRequested_.store(true, std::memory_order_relaxed);
+}
+
+void ImageBatchJob::onFinished() {
+    const Result result = watcher_.result();
+    if (result.cancelled || result.failed.isEmpty()) {
+        Q_EMIT finished(!result.cancelled, QString());
+        return;
+    }
+    Q_EMIT finished(false, tr("Could not convert %n image(s): %1", nullptr, static_cast<int>(result.failed.size()))
+                               .arg(result.failed.join(QStringLiteral(", "))));
+}
+
+}  // namespace PCManFM
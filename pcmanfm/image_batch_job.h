@@ -0,0 +1,48 @@
+/*
+ * Batch image conversion on parallel ImageMagick workers
+ * pcmanfm/image_batch_job.h
+ */
+
+#pragma once
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QStringList>
+
+#include <atomic>
+
+#include "imagemagick_support.h"
+
+namespace PCManFM {
+
+// Converts many images at once, each worker reading, transforming and writing one image at a
+// time. While the job runs, ImageMagick operations are limited to one thread each, so that the
+// workers share the cores instead of each spreading over all of them, and the pixel cache in
+// memory is split between the workers.
+class ImageBatchJob : public QObject {
+    Q_OBJECT
+   public:
+    explicit ImageBatchJob(QObject* parent = nullptr);
+
+    // Writes the converted |sourcePaths| to |outputDir|, each under its base name with the
+    // suffix of the new format. Existing files, sources among them, are never overwritten.
+    void start(const QStringList& sourcePaths, const QString& outputDir, const ImageMagickConversion& conversion);
+    void cancel();
+
+   Q_SIGNALS:
+    void progress(quint64 done, quint64 total, const QString& currentPath);
+    void finished(bool success, const QString& errorMessage);
+
+   private:
+    struct Result {
+        QStringList failed;
+        bool cancelled = false;
+    };
+
+    void onFinished();
+
+    QFutureWatcher<Result> watcher_;
+    std::atomic<bool> cancelRequested_;
+};
+
+}  // namespace PCManFM
@@ -5,34 +5,505 @@
 
 #include "image_viewer_window.h"
 
+#include <QCollator>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QMimeDatabase>
 #include <QKeySequence>
-#include <QLabel>
+#include <QMouseEvent>
+#include <QPainter>
 #include <QResizeEvent>
 #include <QShortcut>
 #include <QStatusBar>
-#include <QVBoxLayout>
+#include <QThreadPool>
+#include <QWheelEvent>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QVector4D>
+#endif
 
 #include "imagemagick_qt.h"
+#include "panel/panel.h"
 
 namespace PCManFM {
 
-ImageViewerWindow::ImageViewerWindow(const QString& path, QWidget* parent)
-    : QMainWindow(parent), path_(path), label_(nullptr), fitRatio_(0.9) {
-    setAttribute(Qt::WA_DeleteOnClose);
-    setWindowTitle(path_);
+namespace {
+
+constexpr int kTileSize = 256;
+constexpr int kPreviewSize = 1024;
+constexpr qsizetype kTileCacheCost = 64 * 1024;  // in KiB
+constexpr double kFitRatio = 0.9;
+constexpr double kMinScale = 0.01;
+constexpr double kMaxScale = 32.0;
+constexpr double kZoomStep = 1.25;
+constexpr int kPrefetchAhead = 3;                        // images decoded ahead when browsing a folder
+constexpr qsizetype kScreenImageCacheCost = 128 * 1024;  // in KiB
+constexpr int kFullImageDelay = 250;                     // in ms
+
+// Something to show right away: the preview embedded in the file, or for a JPEG, the image
+// decoded at a reduced size, which its decoder does cheaply. Other formats would have to be
+// decoded in full, so they wait for the image itself.
+QImage loadQuickPreview(const QString& path, const QSize& bounds) {
+    QImage preview = createEmbeddedPreviewImage(path, bounds);
+    if (!preview.isNull()) {
+        return preview;
+    }
+
+    QImageReader reader(path);
+    reader.setAutoTransform(false);  // like the image ImageMagick loads
+    const QSize size = reader.size();
+    if (reader.format() != "jpeg" || !size.isValid()) {
+        return {};
+    }
+    if (size.width() > bounds.width() || size.height() > bounds.height()) {
+        reader.setScaledSize(size.scaled(bounds, Qt::KeepAspectRatio));
+    }
+    return reader.read();
+}
+
+// The image as large as |bounds| allows, for showing it before its tiles are ready.
+QImage loadScreenImage(const QString& path, const QSize& bounds) {
+    QImage image = loadQuickPreview(path, bounds);
+    if (image.isNull()) {
+        image = createFullImageMagick(path);
+    }
+    if (image.width() > bounds.width() || image.height() > bounds.height()) {
+        image = Panel::ImageScaler::scaled(image, bounds, Qt::KeepAspectRatio);
+    }
+    return image;
+}
+
+quint64 tileKey(int level, int column, int row) {
+    return static_cast<quint64>(level) << 48 | static_cast<quint64>(row) << 24 | column;
+}
+
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+// A unit square, placed and sized by the |rect| of the vertex shader.
+constexpr GLfloat kQuad[] = {0, 0, 1, 0, 0, 1, 1, 1};
+constexpr int kPositionAttribute = 0;
+
+constexpr char kVertexShader[] = R"(
+attribute highp vec2 position;
+uniform highp vec4 rect;  // the left, top, width and height in clip coordinates
+varying highp vec2 texCoord;
+void main() {
+    texCoord = position;
+    gl_Position = vec4(rect.xy + position * rect.zw, 0.0, 1.0);
+}
+)";
+
+constexpr char kFragmentShader[] = R"(
+uniform sampler2D tile;
+varying highp vec2 texCoord;
+void main() {
+    gl_FragColor = texture2D(tile, texCoord);
+}
+)";
+
+// |image| is premultiplied RGBA, which is uploaded as it is.
+QOpenGLTexture* createTexture(const QImage& image) {
+    auto* texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    texture->setSize(image.width(), image.height());
+    // OpenGL ES 2 without full support of sizes other than powers of two has no mipmaps of them
+    QOpenGLFunctions* gl = QOpenGLContext::currentContext()->functions();
+    const bool mipmaps = gl->hasOpenGLFeature(QOpenGLFunctions::NPOTTextures);
+    texture->setMipLevels(mipmaps ? texture->maximumMipLevels() : 1);
+    texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+    texture->setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, image.constBits());
+    // the zooms between two levels of the pyramid are smoothed by the GPU
+    if (mipmaps) {
+        texture->generateMipMaps();
+    }
+    texture->setMinMagFilters(mipmaps ? QOpenGLTexture::LinearMipMapLinear : QOpenGLTexture::Linear,
+                              QOpenGLTexture::Linear);
+    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    return texture;
+}
+#endif
+
+}  // namespace
 
-    auto* central = new QWidget(this);
-    auto* layout = new QVBoxLayout(central);
-    layout->setContentsMargins(0, 0, 0, 0);
-    layout->setSpacing(0);
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+TiledImageView::TiledImageView(QWidget* parent) : QOpenGLWidget(parent), textures_(kTileCacheCost) {
+    setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+}
+
+TiledImageView::~TiledImageView() {
+    releaseTextures();
+}
+#else
+TiledImageView::TiledImageView(QWidget* parent) : QWidget(parent), tiles_(kTileCacheCost) {
+    setBackgroundRole(QPalette::Base);
+    setAutoFillBackground(true);
+    setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+}
 
-    label_ = new QLabel(this);
-    label_->setAlignment(Qt::AlignCenter);
-    label_->setBackgroundRole(QPalette::Base);
-    label_->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-    layout->addWidget(label_);
+TiledImageView::~TiledImageView() = default;
+#endif
 
-    setCentralWidget(central);
+std::vector<QImage> TiledImageView::buildLevels(QImage image) {
+    std::vector<QImage> levels;
+    if (image.isNull()) {
+        return levels;
+    }
+    // the same depth, so converted in place
+    image.convertTo(QImage::Format_RGBA8888_Premultiplied);
+    levels.push_back(std::move(image));
+    while (levels.back().width() > kTileSize || levels.back().height() > kTileSize) {
+        const QImage& last = levels.back();
+        QImage half = Panel::ImageScaler::scaled(last, std::max(1, last.width() / 2), std::max(1, last.height() / 2));
+        levels.push_back(std::move(half));
+    }
+    return levels;
+}
+
+void TiledImageView::setPreview(const QImage& preview) {
+    if (!levels_.empty()) {
+        return;  // the image itself was faster
+    }
+    preview_ = preview;
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+    releaseTextures();
+#endif
+    message_.clear();
+    setImageSize(preview_.size());
+    update();
+}
+
+void TiledImageView::setLevels(std::vector<QImage> levels) {
+    levels_ = std::move(levels);
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+    releaseTextures();
+#else
+    tiles_.clear();
+#endif
+    preview_ = QImage();
+    message_.clear();
+    setImageSize(levels_.empty() ? QSize() : levels_.front().size());
+    Q_EMIT scaleChanged(scale_);
+    update();
+}
+
+void TiledImageView::reset() {
+    levels_.clear();
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+    releaseTextures();
+#else
+    tiles_.clear();
+#endif
+    preview_ = QImage();
+    message_.clear();
+    imageSize_ = QSize();
+    fit_ = true;
+    update();
+}
+
+void TiledImageView::setMessage(const QString& message) {
+    message_ = message;
+    update();
+}
+
+void TiledImageView::setImageSize(const QSize& size) {
+    if (size == imageSize_) {
+        return;
+    }
+    // keep the zoom and position when the preview is replaced by the image
+    if (!fit_ && !imageSize_.isEmpty() && !size.isEmpty()) {
+        const double ratio = static_cast<double>(size.width()) / imageSize_.width();
+        center_ *= ratio;
+        scale_ /= ratio;
+    }
+    imageSize_ = size;
+    if (fit_) {
+        fitToWindow();
+    }
+    else {
+        clampCenter();
+        Q_EMIT scaleChanged(scale_);
+    }
+}
+
+void TiledImageView::fitToWindow() {
+    fit_ = true;
+    if (imageSize_.isEmpty()) {
+        return;
+    }
+    center_ = QPointF(imageSize_.width() / 2.0, imageSize_.height() / 2.0);
+    const double fit = std::min(static_cast<double>(width()) / imageSize_.width(),
+                                static_cast<double>(height()) / imageSize_.height());
+    setScale(fit * kFitRatio);
+}
+
+void TiledImageView::zoomBy(double factor) {
+    zoomAt(factor, QPointF(width() / 2.0, height() / 2.0));
+}
+
+void TiledImageView::zoomAt(double factor, const QPointF& anchor) {
+    if (imageSize_.isEmpty()) {
+        return;
+    }
+    // the image point under |anchor| stays there
+    const QPointF fixedPoint = widgetToImage(anchor);
+    fit_ = false;
+    scale_ = std::clamp(scale_ * factor, kMinScale, kMaxScale);
+    center_ = fixedPoint - (anchor - QPointF(width() / 2.0, height() / 2.0)) / scale_;
+    clampCenter();
+    setScale(scale_);
+}
+
+void TiledImageView::setScale(double scale) {
+    scale_ = std::clamp(scale, kMinScale, kMaxScale);
+    Q_EMIT scaleChanged(scale_);
+    update();
+}
+
+void TiledImageView::clampCenter() {
+    center_.setX(std::clamp(center_.x(), 0.0, static_cast<double>(imageSize_.width())));
+    center_.setY(std::clamp(center_.y(), 0.0, static_cast<double>(imageSize_.height())));
+}
+
+QPointF TiledImageView::imageToWidget(const QPointF& point) const {
+    return (point - center_) * scale_ + QPointF(width() / 2.0, height() / 2.0);
+}
+
+QPointF TiledImageView::widgetToImage(const QPointF& point) const {
+    return (point - QPointF(width() / 2.0, height() / 2.0)) / scale_ + center_;
+}
+
+std::size_t TiledImageView::levelToShow() const {
+    std::size_t level = 0;
+    while (level + 1 < levels_.size() && levels_[level + 1].width() >= imageSize_.width() * scale_) {
+        ++level;
+    }
+    return level;
+}
+
+QRect TiledImageView::tilesIn(std::size_t level, const QRect& area) const {
+    const QImage& image = levels_[level];
+    const double sx = static_cast<double>(image.width()) / imageSize_.width();
+    const double sy = static_cast<double>(image.height()) / imageSize_.height();
+    const QPointF topLeft = widgetToImage(area.topLeft());
+    const QPointF bottomRight = widgetToImage(QPointF(area.right() + 1, area.bottom() + 1));
+    const int lastColumn = (image.width() - 1) / kTileSize;
+    const int lastRow = (image.height() - 1) / kTileSize;
+    const int firstColumn = std::clamp(static_cast<int>(std::floor(topLeft.x() * sx / kTileSize)), 0, lastColumn);
+    const int firstRow = std::clamp(static_cast<int>(std::floor(topLeft.y() * sy / kTileSize)), 0, lastRow);
+    const int endColumn = std::clamp(static_cast<int>(std::floor(bottomRight.x() * sx / kTileSize)), 0, lastColumn);
+    const int endRow = std::clamp(static_cast<int>(std::floor(bottomRight.y() * sy / kTileSize)), 0, lastRow);
+    return QRect(QPoint(firstColumn, firstRow), QPoint(endColumn, endRow));
+}
+
+QRectF TiledImageView::tileRect(std::size_t level, int column, int row, const QSize& size) const {
+    const QImage& image = levels_[level];
+    const double sx = static_cast<double>(image.width()) / imageSize_.width();
+    const double sy = static_cast<double>(image.height()) / imageSize_.height();
+    const QPointF origin(column * kTileSize, row * kTileSize);
+    return QRectF(imageToWidget(QPointF(origin.x() / sx, origin.y() / sy)),
+                  imageToWidget(QPointF((origin.x() + size.width()) / sx, (origin.y() + size.height()) / sy)));
+}
+
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+void TiledImageView::initializeGL() {
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, &TiledImageView::releaseTextures);
+    auto program = std::make_unique<QOpenGLShaderProgram>();
+    program->addShaderFromSourceCode(QOpenGLShader::Vertex, kVertexShader);
+    program->addShaderFromSourceCode(QOpenGLShader::Fragment, kFragmentShader);
+    program->bindAttributeLocation("position", kPositionAttribute);
+    if (program->link()) {
+        program_ = std::move(program);
+    }
+    else {
+        qWarning("TiledImageView: cannot link the shaders: %s", qPrintable(program->log()));
+    }
+}
+
+void TiledImageView::releaseTextures() {
+    if (textures_.isEmpty() && !previewTexture_) {
+        return;
+    }
+    makeCurrent();
+    textures_.clear();
+    previewTexture_.reset();
+    doneCurrent();
+}
+
+QOpenGLTexture* TiledImageView::texture(int level, int column, int row) {
+    const quint64 key = tileKey(level, column, row);
+    if (QOpenGLTexture* cached = textures_.object(key)) {
+        return cached;
+    }
+    const QImage& image = levels_[level];
+    const QRect rect = QRect(column * kTileSize, row * kTileSize, kTileSize, kTileSize).intersected(image.rect());
+    QOpenGLTexture* texture = createTexture(image.copy(rect));
+    // the mipmaps add a third
+    textures_.insert(key, texture, std::max<qsizetype>(rect.width() * rect.height() * 4 * 4 / 3 / 1024, 1));
+    return texture;
+}
+
+void TiledImageView::drawTexture(QOpenGLTexture* texture, const QRectF& target) {
+    // from widget to clip coordinates, where y goes up
+    program_->setUniformValue("rect", QVector4D(2 * target.left() / width() - 1, 1 - 2 * target.top() / height(),
+                                                2 * target.width() / width(), -2 * target.height() / height()));
+    texture->bind();
+    context()->functions()->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    texture->release();
+}
+
+void TiledImageView::paintGL() {
+    QOpenGLFunctions* gl = context()->functions();
+    const QColor background = palette().color(QPalette::Base);
+    gl->glClearColor(background.redF(), background.greenF(), background.blueF(), 1);
+    gl->glClear(GL_COLOR_BUFFER_BIT);
+    if (imageSize_.isEmpty() || !program_) {
+        QPainter painter(this);
+        painter.drawText(rect(), Qt::AlignCenter, message_);
+        return;
+    }
+
+    gl->glEnable(GL_BLEND);
+    gl->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);  // the textures are premultiplied
+    program_->bind();
+    program_->setUniformValue("tile", 0);
+    program_->enableAttributeArray(kPositionAttribute);
+    program_->setAttributeArray(kPositionAttribute, GL_FLOAT, kQuad, 2);
+
+    if (levels_.empty()) {
+        if (!previewTexture_) {
+            previewTexture_.reset(createTexture(preview_.convertToFormat(QImage::Format_RGBA8888_Premultiplied)));
+        }
+        drawTexture(previewTexture_.get(), QRectF(imageToWidget(QPointF(0, 0)),
+                                                  imageToWidget(QPointF(imageSize_.width(), imageSize_.height()))));
+    }
+    else {
+        // the whole widget is redrawn, but only the tiles not seen before are uploaded
+        const std::size_t level = levelToShow();
+        const QRect tiles = tilesIn(level, rect());
+        for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+            for (int column = tiles.left(); column <= tiles.right(); ++column) {
+                QOpenGLTexture* tileTexture = texture(static_cast<int>(level), column, row);
+                const QSize size(tileTexture->width(), tileTexture->height());
+                drawTexture(tileTexture, tileRect(level, column, row, size));
+            }
+        }
+    }
+
+    program_->disableAttributeArray(kPositionAttribute);
+    program_->release();
+    gl->glDisable(GL_BLEND);
+}
+#else
+QPixmap TiledImageView::tile(int level, int column, int row) {
+    const quint64 key = tileKey(level, column, row);
+    if (QPixmap* cached = tiles_.object(key)) {
+        return *cached;
+    }
+    const QImage& image = levels_[level];
+    const QRect rect = QRect(column * kTileSize, row * kTileSize, kTileSize, kTileSize).intersected(image.rect());
+    auto* pixmap = new QPixmap(QPixmap::fromImage(image.copy(rect)));
+    const QPixmap result = *pixmap;
+    tiles_.insert(key, pixmap, std::max<qsizetype>(rect.width() * rect.height() * 4 / 1024, 1));
+    return result;
+}
+
+void TiledImageView::paintEvent(QPaintEvent* event) {
+    QPainter painter(this);
+    if (imageSize_.isEmpty()) {
+        painter.drawText(rect(), Qt::AlignCenter, message_);
+        return;
+    }
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+    if (levels_.empty()) {
+        const QRectF imageRect(imageToWidget(QPointF(0, 0)),
+                               imageToWidget(QPointF(imageSize_.width(), imageSize_.height())));
+        painter.drawImage(imageRect, preview_);
+        return;
+    }
+
+    // the tiles of the level in the exposed part of the widget
+    const std::size_t level = levelToShow();
+    const QRect tiles = tilesIn(level, event->rect());
+    for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+        for (int column = tiles.left(); column <= tiles.right(); ++column) {
+            const QPixmap pixmap = tile(static_cast<int>(level), column, row);
+            painter.drawPixmap(tileRect(level, column, row, pixmap.size()), pixmap, QRectF(pixmap.rect()));
+        }
+    }
+}
+#endif
+
+void TiledImageView::resizeEvent(QResizeEvent* event) {
+    TiledImageViewBase::resizeEvent(event);
+    if (fit_) {
+        fitToWindow();
+    }
+}
+
+void TiledImageView::wheelEvent(QWheelEvent* event) {
+    const double steps = event->angleDelta().y() / 120.0;
+    if (steps != 0) {
+        zoomAt(std::pow(kZoomStep, steps), event->position());
+    }
+    event->accept();
+}
+
+void TiledImageView::mousePressEvent(QMouseEvent* event) {
+    if (event->button() == Qt::LeftButton) {
+        dragging_ = true;
+        dragPos_ = event->position();
+        setCursor(Qt::ClosedHandCursor);
+    }
+    TiledImageViewBase::mousePressEvent(event);
+}
+
+void TiledImageView::mouseMoveEvent(QMouseEvent* event) {
+    if (dragging_ && !imageSize_.isEmpty()) {
+        fit_ = false;
+        center_ -= (event->position() - dragPos_) / scale_;
+        dragPos_ = event->position();
+        clampCenter();
+        update();
+    }
+    TiledImageViewBase::mouseMoveEvent(event);
+}
+
+void TiledImageView::mouseReleaseEvent(QMouseEvent* event) {
+    if (event->button() == Qt::LeftButton) {
+        dragging_ = false;
+        unsetCursor();
+    }
+    TiledImageViewBase::mouseReleaseEvent(event);
+}
+
+void TiledImageView::mouseDoubleClickEvent(QMouseEvent* event) {
+    // toggles between fitting the window and showing the image at its real size
+    if (fit_ && !levels_.empty()) {
+        zoomAt(1.0 / scale_, event->position());
+    }
+    else {
+        fitToWindow();
+    }
+}
+
+ImageViewerWindow::ImageViewerWindow(const QString& path, QWidget* parent)
+    : QMainWindow(parent),
+      screenImages_(kScreenImageCacheCost),
+      prefetchGeneration_(std::make_shared<std::atomic<int>>(0)) {
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    view_ = new TiledImageView(this);
+    setCentralWidget(view_);
+    connect(view_, &TiledImageView::scaleChanged, this, &ImageViewerWindow::updateStatus);
 
     auto* shortcutFull = new QShortcut(QKeySequence(Qt::Key_F11), this);
     connect(shortcutFull, &QShortcut::activated, this, &ImageViewerWindow::toggleFullScreen);
@@ -42,28 +513,186 @@ ImageViewerWindow::ImageViewerWindow(const QString& path, QWidget* parent)
             toggleFullScreen();
         }
     });
+    auto* shortcutZoomIn = new QShortcut(QKeySequence::ZoomIn, this);
+    connect(shortcutZoomIn, &QShortcut::activated, this, [this] { view_->zoomBy(kZoomStep); });
+    auto* shortcutZoomOut = new QShortcut(QKeySequence::ZoomOut, this);
+    connect(shortcutZoomOut, &QShortcut::activated, this, [this] { view_->zoomBy(1.0 / kZoomStep); });
+    auto* shortcutFit = new QShortcut(QKeySequence(Qt::CTRL | Qt::Key_0), this);
+    connect(shortcutFit, &QShortcut::activated, view_, &TiledImageView::fitToWindow);
+    for (const int key : {Qt::Key_Right, Qt::Key_Space, Qt::Key_PageDown}) {
+        auto* shortcutNext = new QShortcut(QKeySequence(key), this);
+        connect(shortcutNext, &QShortcut::activated, this, [this] { navigate(1); });
+    }
+    for (const int key : {Qt::Key_Left, Qt::Key_Backspace, Qt::Key_PageUp}) {
+        auto* shortcutPrevious = new QShortcut(QKeySequence(key), this);
+        connect(shortcutPrevious, &QShortcut::activated, this, [this] { navigate(-1); });
+    }
 
-    if (!loadImage(path_)) {
-        label_->setText(tr("Could not load image."));
-        return;
+    // the whole image is only decoded once the user stops flipping through the folder
+    fullImageTimer_.setSingleShot(true);
+    fullImageTimer_.setInterval(kFullImageDelay);
+    connect(&fullImageTimer_, &QTimer::timeout, this, &ImageViewerWindow::loadFullImage);
+
+    resize(800, 600);
+    loadImage(path);
+    fullImageTimer_.start(0);
+}
+
+ImageViewerWindow::~ImageViewerWindow() {
+    // the prefetches still queued need not run any more
+    ++*prefetchGeneration_;
+}
+
+void ImageViewerWindow::loadImage(const QString& path) {
+    path_ = path;
+    ++loadGeneration_;
+    setWindowTitle(path_);
+    view_->reset();
+    statusBar()->clearMessage();
+
+    // a neighbour decoded ahead of time is shown at once; the preview is the next best thing
+    if (const QImage* cached = screenImages_.object(path_)) {
+        showPreview(*cached);
     }
+    else {
+        auto* previewWatcher = new QFutureWatcher<QImage>(this);
+        const int generation = loadGeneration_;
+        connect(previewWatcher, &QFutureWatcherBase::finished, this, [this, previewWatcher, generation] {
+            const QImage preview = previewWatcher->result();
+            previewWatcher->deleteLater();
+            if (generation == loadGeneration_ && !preview.isNull()) {
+                showPreview(preview);
+            }
+        });
+        previewWatcher->setFuture(
+            QtConcurrent::run([path] { return loadQuickPreview(path, QSize(kPreviewSize, kPreviewSize)); }));
+    }
+    fullImageTimer_.start();
+}
 
-    updateScaledPixmap();
-    resize(original_.size().boundedTo(QSize(1600, 1200)));
+void ImageViewerWindow::showPreview(const QImage& preview) {
+    view_->setPreview(preview);
+    if (!sized_) {
+        sized_ = true;
+        resize(view_->imageSize().boundedTo(QSize(1600, 1200)));
+    }
 }
 
-bool ImageViewerWindow::loadImage(const QString& path) {
-    QPixmap pix = createImagePixmapMagick(path);
-    if (pix.isNull()) {
-        return false;
+void ImageViewerWindow::loadFullImage() {
+    // Decoding cannot be interrupted, so a result that comes too late is dropped.
+    const QString path = path_;
+    const int generation = loadGeneration_;
+    auto* imageWatcher = new QFutureWatcher<std::vector<QImage>>(this);
+    connect(imageWatcher, &QFutureWatcherBase::finished, this, [this, imageWatcher, generation] {
+        std::vector<QImage> levels = imageWatcher->result();
+        imageWatcher->deleteLater();
+        if (generation != loadGeneration_) {
+            return;
+        }
+        if (levels.empty()) {
+            if (view_->imageSize().isEmpty()) {
+                view_->setMessage(tr("Could not load image."));
+            }
+            return;
+        }
+        view_->setLevels(std::move(levels));
+        if (!sized_) {
+            sized_ = true;
+            resize(view_->imageSize().boundedTo(QSize(1600, 1200)));
+        }
+        listFolder();
+        prefetchNeighbours();
+    });
+    imageWatcher->setFuture(
+        QtConcurrent::run([path] { return TiledImageView::buildLevels(createFullImageMagick(path)); }));
+}
+
+void ImageViewerWindow::listFolder() {
+    if (!files_.isEmpty()) {
+        return;
     }
-    original_ = std::move(pix);
-    return true;
+    // the images of the folder, in the order of their names
+    const QFileInfo current(path_);
+    QMimeDatabase mimeDb;
+    const auto entries = current.dir().entryInfoList(QDir::Files);
+    for (const QFileInfo& entry : entries) {
+        const QMimeType type = mimeDb.mimeTypeForFile(entry, QMimeDatabase::MatchExtension);
+        if (type.name().startsWith(QLatin1String("image/"))) {
+            files_.append(entry.absoluteFilePath());
+        }
+    }
+    QCollator collator;
+    collator.setNumericMode(true);
+    std::sort(files_.begin(), files_.end(), [&collator](const QString& a, const QString& b) {
+        return collator.compare(QFileInfo(a).fileName(), QFileInfo(b).fileName()) < 0;
+    });
+    current_ = files_.indexOf(current.absoluteFilePath());
 }
 
-void ImageViewerWindow::resizeEvent(QResizeEvent* event) {
-    QMainWindow::resizeEvent(event);
-    updateScaledPixmap();
+void ImageViewerWindow::navigate(int step) {
+    listFolder();
+    if (current_ < 0 || files_.size() < 2) {
+        return;
+    }
+
+    if (step != direction_) {
+        // what was decoded ahead in the other direction is not wanted before it starts
+        direction_ = step;
+        ++*prefetchGeneration_;
+        prefetching_.clear();
+    }
+    current_ = (current_ + step + files_.size()) % files_.size();
+    loadImage(files_.at(current_));
+    prefetchNeighbours();
+}
+
+void ImageViewerWindow::prefetchNeighbours() {
+    if (current_ < 0 || files_.size() < 2) {
+        return;
+    }
+
+    static QThreadPool* pool = [] {
+        auto* threadPool = new QThreadPool();
+        threadPool->setMaxThreadCount(2);
+        return threadPool;
+    }();
+
+    // the images ahead in the direction of browsing first, then the one just left behind
+    QList<int> offsets;
+    for (int i = 1; i <= kPrefetchAhead; ++i) {
+        offsets.append(i * direction_);
+    }
+    offsets.append(-direction_);
+
+    const QSize bounds = view_->size().expandedTo(QSize(640, 480));
+    const std::shared_ptr<std::atomic<int>> generationRef = prefetchGeneration_;
+    const int generation = *prefetchGeneration_;
+    for (const int offset : offsets) {
+        const QString path = files_.at(((current_ + offset) % files_.size() + files_.size()) % files_.size());
+        if (path == path_ || screenImages_.contains(path) || prefetching_.contains(path)) {
+            continue;
+        }
+        prefetching_.insert(path);
+
+        auto* watcher = new QFutureWatcher<QImage>(this);
+        connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, path, generation] {
+            const QImage image = watcher->result();
+            watcher->deleteLater();
+            if (generation != *prefetchGeneration_) {
+                return;  // prefetching_ was cleared when the generation changed
+            }
+            prefetching_.remove(path);
+            if (!image.isNull()) {
+                screenImages_.insert(path, new QImage(image), std::max<qsizetype>(image.sizeInBytes() / 1024, 1));
+            }
+        });
+        watcher->setFuture(QtConcurrent::run(pool, [path, bounds, generationRef, generation] {
+            if (*generationRef != generation) {
+                return QImage();  // the user turned around before this one started
+            }
+            return loadScreenImage(path, bounds);
+        }));
+    }
 }
 
 void ImageViewerWindow::toggleFullScreen() {
@@ -73,26 +702,15 @@ void ImageViewerWindow::toggleFullScreen() {
     else {
         showFullScreen();
     }
-    updateScaledPixmap();
 }
 
-void ImageViewerWindow::updateScaledPixmap() {
-    if (original_.isNull() || !label_) {
-        return;
-    }
-
-    const QSize area = centralWidget() ? centralWidget()->size() : size();
-    const QSize target(static_cast<int>(area.width() * fitRatio_), static_cast<int>(area.height() * fitRatio_));
-
-    scaled_ = original_.scaled(target, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    label_->setPixmap(scaled_);
-
-    if (!scaled_.isNull()) {
-        const double zoom =
-            (original_.width() > 0) ? (100.0 * scaled_.width() / static_cast<double>(original_.width())) : 0.0;
-        statusBar()->showMessage(
-            tr("%1 × %2  (%3%)").arg(scaled_.width()).arg(scaled_.height()).arg(static_cast<int>(zoom)));
+void ImageViewerWindow::updateStatus() {
+    if (!view_->hasImage()) {
+        return;  // the size of the preview means nothing
     }
+    const QSize shown = view_->imageSize() * view_->scale();
+    statusBar()->showMessage(
+        tr("%1 × %2  (%3%)").arg(shown.width()).arg(shown.height()).arg(static_cast<int>(100 * view_->scale())));
 }
 
 }  // namespace PCManFM
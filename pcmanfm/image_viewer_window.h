@@ -5,35 +5,154 @@
 
 #pragma once
 
+#include <QCache>
+#include <QImage>
 #include <QMainWindow>
 #include <QPixmap>
+#include <QPointF>
+#include <QSet>
 #include <QString>
-#include <QLabel>
+#include <QStringList>
+#include <QTimer>
+#include <QWidget>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+#include <QOpenGLWidget>
+class QOpenGLShaderProgram;
+class QOpenGLTexture;
+#endif
 
 namespace PCManFM {
 
-class ImageViewerWindow : public QMainWindow {
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+// The tiles are uploaded once as textures with mipmaps, and the GPU scales and places them.
+using TiledImageViewBase = QOpenGLWidget;
+#else
+using TiledImageViewBase = QWidget;
+#endif
+
+// Shows an image from a pyramid of levels, each half the size of the one before, cut into
+// tiles that are only turned into pixmaps or textures when they become visible. Painting at
+// any zoom draws a few tiles of the level nearest to it, never a scaled copy of the whole
+// image. A low resolution preview stands in for the image until the pyramid is ready.
+class TiledImageView : public TiledImageViewBase {
     Q_OBJECT
    public:
-    explicit ImageViewerWindow(const QString& path, QWidget* parent = nullptr);
-    ~ImageViewerWindow() override = default;
+    explicit TiledImageView(QWidget* parent = nullptr);
+    ~TiledImageView() override;
+
+    void setPreview(const QImage& preview);
+    // |levels| starts with the image at its full size
+    void setLevels(std::vector<QImage> levels);
+    void setMessage(const QString& message);
+    // shows nothing until the next image is set
+    void reset();
+
+    QSize imageSize() const { return imageSize_; }
+    // false while only the preview is shown
+    bool hasImage() const { return !levels_.empty(); }
+    // displayed pixels per image pixel
+    double scale() const { return scale_; }
+
+    void zoomBy(double factor);
+    void fitToWindow();
+
+    static std::vector<QImage> buildLevels(QImage image);
+
+   Q_SIGNALS:
+    void scaleChanged(double scale);
 
    protected:
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+    void initializeGL() override;
+    void paintGL() override;
+#else
+    void paintEvent(QPaintEvent* event) override;
+#endif
     void resizeEvent(QResizeEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+
+   private:
+    void setImageSize(const QSize& size);
+    void zoomAt(double factor, const QPointF& anchor);
+    void setScale(double scale);
+    void clampCenter();
+    QPointF imageToWidget(const QPointF& point) const;
+    QPointF widgetToImage(const QPointF& point) const;
+    // the smallest level that is still at least as large as it is displayed
+    std::size_t levelToShow() const;
+    // the columns and rows of the tiles of |level| that cover |area| of the widget
+    QRect tilesIn(std::size_t level, const QRect& area) const;
+    // where the tile at |column| and |row| of |level|, |size| large, is drawn
+    QRectF tileRect(std::size_t level, int column, int row, const QSize& size) const;
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+    QOpenGLTexture* texture(int level, int column, int row);
+    void drawTexture(QOpenGLTexture* texture, const QRectF& target);
+    // the textures belong to the context, so it is made current to delete them
+    void releaseTextures();
+#else
+    QPixmap tile(int level, int column, int row);
+#endif
+
+    std::vector<QImage> levels_;
+    QImage preview_;
+    QString message_;
+    QSize imageSize_;
+    QPointF center_;  // the image point shown in the middle of the widget
+    double scale_ = 1.0;
+    bool fit_ = true;
+    bool dragging_ = false;
+    QPointF dragPos_;
+#ifdef PCMANFM_HAVE_OPENGL_VIEWER
+    std::unique_ptr<QOpenGLShaderProgram> program_;
+    QCache<quint64, QOpenGLTexture> textures_;
+    std::unique_ptr<QOpenGLTexture> previewTexture_;
+#else
+    QCache<quint64, QPixmap> tiles_;
+#endif
+};
+
+class ImageViewerWindow : public QMainWindow {
+    Q_OBJECT
+   public:
+    explicit ImageViewerWindow(const QString& path, QWidget* parent = nullptr);
+    ~ImageViewerWindow() override;
 
    private Q_SLOTS:
     void toggleFullScreen();
+    void loadFullImage();
 
    private:
-    bool loadImage(const QString& path);
-    void updateScaledPixmap();
+    void loadImage(const QString& path);
+    void showPreview(const QImage& preview);
+    void listFolder();
+    // shows the image |step| places away in the folder
+    void navigate(int step);
+    // decodes the images around the current one in the background, at the size of the window
+    void prefetchNeighbours();
+    void updateStatus();
 
    private:
     QString path_;
-    QPixmap original_;
-    QPixmap scaled_;
-    QLabel* label_ = nullptr;
-    double fitRatio_ = 0.6;
+    TiledImageView* view_ = nullptr;
+    bool sized_ = false;
+    int loadGeneration_ = 0;  // results of the loads of an image shown before are dropped
+    QTimer fullImageTimer_;
+
+    QStringList files_;  // the images of the folder, listed once the user browses it
+    int current_ = -1;
+    int direction_ = 1;
+    QCache<QString, QImage> screenImages_;  // images around the current one, fit to the window
+    QSet<QString> prefetching_;
+    // bumped when the user turns around, so that the prefetches not started yet are skipped
+    std::shared_ptr<std::atomic<int>> prefetchGeneration_;
 };
 
 }  // namespace PCManFM
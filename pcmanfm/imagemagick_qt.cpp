@@ -5,12 +5,18 @@
 
 #include "imagemagick_qt.h"
 
+#include "../src/core/embedded_preview.h"
+
+#include <QBuffer>
+#include <QFile>
 #include <QImage>
+#include <QImageReader>
 #include <QLoggingCategory>
 #include <QThread>
 #include <QFutureWatcher>
 #include <QtConcurrent>
 #include <QString>
+#include <QTransform>
 #include <algorithm>
 #include <cstring>
 
@@ -25,6 +31,39 @@ bool bufferMatchesSize(const ImageMagickBuffer& buf) {
     return expected > 0 && expected <= static_cast<qsizetype>(buf.pixels.size());
 }
 
+// The EXIF orientation |orientation| as a transformation that makes the image upright.
+QTransform orientationTransform(int orientation) {
+    QTransform matrix;
+    switch (orientation) {
+        case 2:  // mirror horizontally
+            matrix.scale(-1, 1);
+            break;
+        case 3:
+            matrix.rotate(180);
+            break;
+        case 4:  // mirror vertically
+            matrix.scale(1, -1);
+            break;
+        case 5:  // transpose
+            matrix.rotate(-90);
+            matrix.scale(1, -1);
+            break;
+        case 6:
+            matrix.rotate(90);
+            break;
+        case 7:  // transverse
+            matrix.rotate(90);
+            matrix.scale(1, -1);
+            break;
+        case 8:
+            matrix.rotate(270);
+            break;
+        default:
+            break;
+    }
+    return matrix;
+}
+
 struct ThumbnailResult {
     QString key;
     quint64 mtime = 0;
@@ -66,11 +105,43 @@ QPixmap pixmapFromMagickBuffer(const ImageMagickBuffer& buf) {
     return QPixmap::fromImage(std::move(img));
 }
 
+// Camera RAW files and most large JPEGs carry a JPEG preview; when it is big enough for the
+// thumbnail, decoding it at the size needed is much cheaper than decoding the whole image.
+QImage createEmbeddedPreviewImage(const QString& path, const QSize& thumbSize) {
+    std::vector<std::uint8_t> jpeg;
+    EmbeddedPreview preview;
+    const auto minSize = static_cast<std::uint32_t>(std::max(thumbSize.width(), thumbSize.height()));
+    if (!read_embedded_preview(QFile::encodeName(path).toStdString(), minSize, jpeg, preview)) {
+        return {};
+    }
+
+    QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(jpeg.data()),
+                                              static_cast<qsizetype>(jpeg.size()));
+    QBuffer device(&data);
+    QImageReader reader(&device, "jpeg");
+    reader.setAutoTransform(false);  // the orientation is that of the file, not of the preview
+    const QSize previewSize(static_cast<int>(preview.width), static_cast<int>(preview.height));
+    // a rotated image fits the thumbnail after the rotation
+    const bool swapped = preview.orientation >= 5;
+    const QSize bounds = swapped ? thumbSize.transposed() : thumbSize;
+    reader.setScaledSize(previewSize.scaled(bounds, Qt::KeepAspectRatio));
+    QImage img = reader.read();
+    if (img.isNull() || preview.orientation == 1) {
+        return img;
+    }
+    return img.transformed(orientationTransform(preview.orientation));
+}
+
 QImage createThumbnailImageMagick(const QString& path, const QSize& thumbSize) {
     if (!ImageMagickSupport::isAvailable()) {
         return {};
     }
 
+    QImage preview = createEmbeddedPreviewImage(path, thumbSize);
+    if (!preview.isNull()) {
+        return preview;
+    }
+
     ImageMagickBuffer buffer;
     if (!ImageMagickSupport::loadThumbnailBuffer(path, thumbSize.width(), thumbSize.height(), buffer)) {
         return {};
@@ -130,6 +201,30 @@ QPixmap createImagePixmapMagick(const QString& path) {
     return pixmapFromMagickBuffer(buffer);
 }
 
+QImage createFullImageMagick(const QString& path) {
+    if (!ImageMagickSupport::isAvailable()) {
+        return {};
+    }
+
+    ImageMagickBuffer buffer;
+    if (!ImageMagickSupport::loadImageBuffer(path, buffer) || !bufferMatchesSize(buffer)) {
+        return {};
+    }
+
+    QImage img(buffer.width, buffer.height, QImage::Format_RGBA8888);
+    if (img.isNull()) {
+        return {};
+    }
+
+    const qsizetype stride = static_cast<qsizetype>(buffer.width) * 4;
+    for (int y = 0; y < buffer.height; ++y) {
+        std::memcpy(img.scanLine(y), buffer.pixels.data() + static_cast<qsizetype>(y) * stride,
+                    static_cast<size_t>(stride));
+    }
+
+    return img;
+}
+
 ImageMagickProxyFolderModel::ImageMagickProxyFolderModel(QObject* parent)
     : Panel::ProxyFolderModel(parent), magickThumbnailsEnabled_(false), magickThumbnailSize_(0) {
     thumbnailCache_.setMaxCost(256);
@@ -144,6 +239,7 @@ void ImageMagickProxyFolderModel::setShowThumbnails(bool show) {
     thumbnailCache_.clear();
     pendingThumbnails_.clear();
     inFlightThumbnails_.clear();
+    queuedThumbnails_.clear();
     Panel::ProxyFolderModel::setShowThumbnails(show);
 }
 
@@ -152,6 +248,7 @@ void ImageMagickProxyFolderModel::setThumbnailSize(int size) {
     thumbnailCache_.clear();
     pendingThumbnails_.clear();
     inFlightThumbnails_.clear();
+    queuedThumbnails_.clear();
     Panel::ProxyFolderModel::setThumbnailSize(size);
 }
 
@@ -169,7 +266,7 @@ QVariant ImageMagickProxyFolderModel::data(const QModelIndex& index, int role) c
                     return QIcon(*cached);
                 }
 
-                requestThumbnailForIndex(index, info);
+                requestThumbnailForIndex(index, info, true);
             }
         }
     }
@@ -178,6 +275,12 @@ QVariant ImageMagickProxyFolderModel::data(const QModelIndex& index, int role) c
 }
 
 void ImageMagickProxyFolderModel::prefetchThumbnails(const QModelIndexList& indexes) const {
+    // the files that were scrolled out of range are not wanted any more
+    for (const auto& request : queuedThumbnails_) {
+        pendingThumbnails_.remove(request.key);
+    }
+    queuedThumbnails_.clear();
+
     if (!magickThumbnailsEnabled_ || !ImageMagickSupport::isAvailable()) {
         return;
     }
@@ -185,7 +288,7 @@ void ImageMagickProxyFolderModel::prefetchThumbnails(const QModelIndexList& inde
     for (const QModelIndex& idx : indexes) {
         auto info = fileInfoFromIndex(idx);
         if (info && info->isNative() && isImageFile(info)) {
-            requestThumbnailForIndex(idx, info);
+            requestThumbnailForIndex(idx, info, false);
         }
     }
 }
@@ -210,7 +313,8 @@ QString ImageMagickProxyFolderModel::cacheKey(const QString& path, int size, qui
 }
 
 void ImageMagickProxyFolderModel::requestThumbnailForIndex(const QModelIndex& index,
-                                                           const std::shared_ptr<const Panel::FileInfo>& info) const {
+                                                           const std::shared_ptr<const Panel::FileInfo>& info,
+                                                           bool urgent) const {
     if (!index.isValid() || !info) {
         return;
     }
@@ -240,35 +344,64 @@ void ImageMagickProxyFolderModel::requestThumbnailForIndex(const QModelIndex& in
         return;
     }
 
-    inFlightThumbnails_.insert(key);
-    auto* self = const_cast<ImageMagickProxyFolderModel*>(this);
-    auto* watcher = new QFutureWatcher<ThumbnailResult>(self);
-    connect(watcher, &QFutureWatcherBase::finished, self, [self, watcher] {
-        ThumbnailResult result = watcher->result();
-        watcher->deleteLater();
-
-        self->inFlightThumbnails_.remove(result.key);
-        const auto indexes = self->pendingThumbnails_.take(result.key);
-
-        if (result.image.isNull()) {
-            return;
+    auto queued = std::find_if(queuedThumbnails_.begin(), queuedThumbnails_.end(),
+                               [&key](const ThumbnailRequest& request) { return request.key == key; });
+    if (queued == queuedThumbnails_.end()) {
+        ThumbnailRequest request{key, path, mtime, size};
+        if (urgent) {
+            queuedThumbnails_.push_front(std::move(request));
         }
-
-        QPixmap pix = QPixmap::fromImage(result.image);
-        if (pix.isNull()) {
-            return;
+        else {
+            queuedThumbnails_.push_back(std::move(request));
         }
+    }
+    else if (urgent && queued != queuedThumbnails_.begin()) {
+        ThumbnailRequest request = std::move(*queued);
+        queuedThumbnails_.erase(queued);
+        queuedThumbnails_.push_front(std::move(request));
+    }
+    startQueuedThumbnails();
+}
 
-        self->thumbnailCache_.insert(result.key, new QPixmap(pix), 1);
-        for (const auto& idx : indexes) {
-            if (idx.isValid()) {
-                Q_EMIT self->dataChanged(idx, idx, {Qt::DecorationRole});
+void ImageMagickProxyFolderModel::startQueuedThumbnails() const {
+    // A bounded number of requests run at a time, so that the others can still be reordered,
+    // or dropped when they are scrolled out of range.
+    auto* self = const_cast<ImageMagickProxyFolderModel*>(this);
+    while (!queuedThumbnails_.empty() && inFlightThumbnails_.size() < thumbnailPool_.maxThreadCount()) {
+        ThumbnailRequest request = std::move(queuedThumbnails_.front());
+        queuedThumbnails_.pop_front();
+        inFlightThumbnails_.insert(request.key);
+
+        auto* watcher = new QFutureWatcher<ThumbnailResult>(self);
+        connect(watcher, &QFutureWatcherBase::finished, self, [self, watcher] {
+            ThumbnailResult result = watcher->result();
+            watcher->deleteLater();
+
+            self->inFlightThumbnails_.remove(result.key);
+            const auto indexes = self->pendingThumbnails_.take(result.key);
+            self->startQueuedThumbnails();
+
+            if (result.image.isNull()) {
+                return;
             }
-        }
-    });
 
-    watcher->setFuture(QtConcurrent::run(&thumbnailPool_,
-                                         [key, path, mtime, size] { return runThumbnailJob(key, path, mtime, size); }));
+            QPixmap pix = QPixmap::fromImage(result.image);
+            if (pix.isNull()) {
+                return;
+            }
+
+            self->thumbnailCache_.insert(result.key, new QPixmap(pix), 1);
+            for (const auto& idx : indexes) {
+                if (idx.isValid()) {
+                    Q_EMIT self->dataChanged(idx, idx, {Qt::DecorationRole});
+                }
+            }
+        });
+
+        watcher->setFuture(QtConcurrent::run(&thumbnailPool_, [request] {
+            return runThumbnailJob(request.key, request.path, request.mtime, request.size);
+        }));
+    }
 }
 
 }  // namespace PCManFM
@@ -16,6 +16,7 @@
 #include <QSet>
 #include <QSize>
 #include <QThreadPool>
+#include <deque>
 #include <memory>
 
 #include "panel/panel.h"
@@ -29,6 +30,10 @@ QPixmap createThumbnailPixmapMagick(const QString& path, const QSize& thumbSize)
 QImage createThumbnailImageMagick(const QString& path, const QSize& thumbSize);
 QPixmap createPreviewPixmapMagick(const QString& path, const QSize& maxSize);
 QPixmap createImagePixmapMagick(const QString& path);
+// the whole image at its full size, as a QImage so that it can be loaded in another thread
+QImage createFullImageMagick(const QString& path);
+// the JPEG preview embedded in a camera RAW or JPEG file, if one covers |thumbSize|
+QImage createEmbeddedPreviewImage(const QString& path, const QSize& thumbSize);
 
 class ImageMagickProxyFolderModel : public Panel::ProxyFolderModel {
     Q_OBJECT
@@ -39,18 +44,33 @@ class ImageMagickProxyFolderModel : public Panel::ProxyFolderModel {
     void setThumbnailSize(int size);
 
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    // Loads the thumbnails of |indexes|, the most wanted first, instead of those asked for by the
+    // previous call that have not been started yet.
     void prefetchThumbnails(const QModelIndexList& indexes) const;
 
    private:
+    struct ThumbnailRequest {
+        QString key;
+        QString path;
+        quint64 mtime;
+        int size;
+    };
+
     bool isImageFile(const std::shared_ptr<const Panel::FileInfo>& info) const;
     QString pathForFile(const std::shared_ptr<const Panel::FileInfo>& info) const;
     QString cacheKey(const QString& path, int size, quint64 mtime) const;
-    void requestThumbnailForIndex(const QModelIndex& index, const std::shared_ptr<const Panel::FileInfo>& info) const;
+    // an urgent request, as for a painted item, goes before all others
+    void requestThumbnailForIndex(const QModelIndex& index,
+                                  const std::shared_ptr<const Panel::FileInfo>& info,
+                                  bool urgent) const;
+    // starts queued requests while fewer are running than the pool has threads
+    void startQueuedThumbnails() const;
 
    private:
     mutable QCache<QString, QPixmap> thumbnailCache_;
     mutable QHash<QString, QList<QPersistentModelIndex>> pendingThumbnails_;
     mutable QSet<QString> inFlightThumbnails_;
+    mutable std::deque<ThumbnailRequest> queuedThumbnails_;  // not started yet, the most wanted first
     mutable QThreadPool thumbnailPool_;
     bool magickThumbnailsEnabled_;
     int magickThumbnailSize_;
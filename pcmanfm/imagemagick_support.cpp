@@ -9,10 +9,11 @@
 
 #ifdef HAVE_MAGICKWAND
 #include <MagickWand/MagickWand.h>
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 #include <fcntl.h>
-#include <limits>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -30,71 +31,50 @@ class MagickInitializer {
 
 MagickInitializer g_magickInitializer;
 
-QByteArray readFilePosix(const QString& path) {
-    const QByteArray encoded = QFile::encodeName(path);
-    int fd = ::open(encoded.constData(), O_RDONLY | O_CLOEXEC);
-    if (fd < 0) {
-        return {};
-    }
-
-    struct stat st{};
-    if (::fstat(fd, &st) != 0) {
-        ::close(fd);
-        return {};
-    }
-
-    if (!S_ISREG(st.st_mode)) {
-        ::close(fd);
-        return {};
-    }
+// A regular file mapped read-only, so that ImageMagick reads it as a blob without a copy and
+// only the pages a decoder touches are read, as when pinging the header of a large image.
+class MappedFile {
+   public:
+    explicit MappedFile(const QString& path) {
+        const QByteArray encoded = QFile::encodeName(path);
+        int fd = ::open(encoded.constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
 
-    const qint64 size = st.st_size;
-    if (size <= 0) {
-        ::close(fd);
-        return {};
+        struct stat st{};
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                data_ = data;
+                size_ = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);  // the mapping stays valid
     }
 
-    if (size > std::numeric_limits<int>::max()) {
-        ::close(fd);
-        return {};
+    ~MappedFile() {
+        if (data_) {
+            ::munmap(data_, size_);
+        }
     }
 
-    QByteArray buffer;
-    buffer.resize(size);
-
-    char* data = buffer.data();
-    qint64 remaining = size;
-    qint64 offset = 0;
-
-    while (remaining > 0) {
-        const ssize_t n = ::read(fd, data + offset, static_cast<size_t>(remaining));
-        if (n < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            buffer.clear();
-            break;
-        }
-        if (n == 0) {
-            break;
-        }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
 
-        offset += n;
-        remaining -= n;
-    }
+    bool isValid() const { return data_ != nullptr; }
 
-    ::close(fd);
+    const unsigned char* data() const { return static_cast<const unsigned char*>(data_); }
 
-    if (buffer.isEmpty()) {
-        return {};
-    }
+    size_t size() const { return size_; }
 
-    if (offset != size) {
-        buffer.truncate(offset);
-    }
+    // a whole decode reads the file from start to end
+    void adviseSequential() const { ::madvise(data_, size_, MADV_SEQUENTIAL); }
 
-    return buffer;
-}
+   private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
 
 bool writeFilePosix(const QString& path, const unsigned char* data, size_t size) {
     const QByteArray encoded = QFile::encodeName(path);
@@ -127,17 +107,43 @@ bool writeFilePosix(const QString& path, const unsigned char* data, size_t size)
 }
 
 bool loadWandFromFile(MagickWand* wand, const QString& path) {
-    QByteArray data = readFilePosix(path);
-    if (data.isEmpty()) {
+    const MappedFile file{path};
+    if (!file.isValid()) {
         return false;
     }
 
-    if (MagickReadImageBlob(wand, reinterpret_cast<const unsigned char*>(data.constData()),
-                            static_cast<size_t>(data.size())) == MagickFalse) {
+    file.adviseSequential();
+    return MagickReadImageBlob(wand, file.data(), file.size()) != MagickFalse;
+}
+
+// Reads only what ImageMagick needs for the size, format and colorspace, without decoding
+// the pixels.
+bool pingWandFromFile(MagickWand* wand, const QString& path) {
+    const MappedFile file{path};
+    if (!file.isValid()) {
         return false;
     }
 
-    return true;
+    return MagickPingImageBlob(wand, file.data(), file.size()) != MagickFalse;
+}
+
+// Lets the decoders that can scale while decoding, as JPEG's does by eighths, produce an
+// image no smaller than |maxWidth| x |maxHeight| instead of the full one.
+void setSizeHint(MagickWand* wand, int maxWidth, int maxHeight) {
+    const QByteArray size = QByteArray::number(maxWidth) + 'x' + QByteArray::number(maxHeight);
+    MagickSetOption(wand, "jpeg:size", size.constData());
+}
+
+// Lanczos costs several taps per source pixel. Whole blocks are averaged first, down to two to
+// four times the size wanted, which leaves it few pixels to filter and looks the same.
+bool resizeWand(MagickWand* wand, size_t width, size_t height) {
+    const size_t w = MagickGetImageWidth(wand);
+    const size_t h = MagickGetImageHeight(wand);
+    const size_t factor = std::min(w / (2 * std::max<size_t>(width, 1)), h / (2 * std::max<size_t>(height, 1)));
+    if (factor > 1 && MagickScaleImage(wand, (w + factor - 1) / factor, (h + factor - 1) / factor) == MagickFalse) {
+        return false;
+    }
+    return MagickResizeImage(wand, width, height, LanczosFilter) != MagickFalse;
 }
 
 bool saveWandToFile(MagickWand* wand, const QString& path) {
@@ -197,7 +203,7 @@ bool ImageMagickSupport::isAvailable() {
 bool ImageMagickSupport::probe(const QString& path, ImageMagickInfo& outInfo) {
 #ifdef HAVE_MAGICKWAND
     MagickWand* wand = NewMagickWand();
-    if (!loadWandFromFile(wand, path)) {
+    if (!pingWandFromFile(wand, path)) {
         DestroyMagickWand(wand);
         return false;
     }
@@ -245,6 +251,7 @@ bool ImageMagickSupport::loadThumbnailBuffer(const QString& path, int maxWidth,
     }
 
     MagickWand* wand = NewMagickWand();
+    setSizeHint(wand, maxWidth, maxHeight);
     if (!loadWandFromFile(wand, path)) {
         DestroyMagickWand(wand);
         return false;
@@ -274,13 +281,13 @@ bool ImageMagickSupport::loadPreviewBuffer(const QString& path, int maxWidth, in
     }
 
     MagickWand* wand = NewMagickWand();
+    setSizeHint(wand, maxWidth, maxHeight);
     if (!loadWandFromFile(wand, path)) {
         DestroyMagickWand(wand);
         return false;
     }
 
-    if (MagickResizeImage(wand, static_cast<size_t>(maxWidth), static_cast<size_t>(maxHeight), LanczosFilter) ==
-        MagickFalse) {
+    if (!resizeWand(wand, static_cast<size_t>(maxWidth), static_cast<size_t>(maxHeight))) {
         DestroyMagickWand(wand);
         return false;
     }
@@ -379,7 +386,7 @@ bool ImageMagickSupport::resizeImage(const QString& srcPath,
         }
     }
 
-    if (MagickResizeImage(wand, newW, newH, LanczosFilter) == MagickFalse) {
+    if (!resizeWand(wand, newW, newH)) {
         DestroyMagickWand(wand);
         return false;
     }
@@ -426,3 +433,78 @@ bool ImageMagickSupport::rotateImage(const QString& srcPath, const QString& dstP
     return false;
 #endif
 }
+
+bool ImageMagickSupport::convertImage(const QString& srcPath,
+                                      const QString& dstPath,
+                                      const ImageMagickConversion& conversion) {
+#ifdef HAVE_MAGICKWAND
+    MagickWand* wand = NewMagickWand();
+    if (!loadWandFromFile(wand, srcPath)) {
+        DestroyMagickWand(wand);
+        return false;
+    }
+
+    const size_t w = MagickGetImageWidth(wand);
+    const size_t h = MagickGetImageHeight(wand);
+    if (w == 0 || h == 0) {
+        DestroyMagickWand(wand);
+        return false;
+    }
+
+    const size_t longest = std::max(w, h);
+    if (conversion.maxSize > 0 && longest > static_cast<size_t>(conversion.maxSize)) {
+        const double scale = static_cast<double>(conversion.maxSize) / static_cast<double>(longest);
+        const size_t newW = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(w) * scale + 0.5));
+        const size_t newH = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(h) * scale + 0.5));
+        if (!resizeWand(wand, newW, newH)) {
+            DestroyMagickWand(wand);
+            return false;
+        }
+    }
+
+    if (conversion.rotation != 0.0) {
+        PixelWand* bg = NewPixelWand();
+        PixelSetColor(bg, "none");
+        const bool rotated = MagickRotateImage(wand, bg, conversion.rotation) != MagickFalse;
+        DestroyPixelWand(bg);
+        if (!rotated) {
+            DestroyMagickWand(wand);
+            return false;
+        }
+    }
+
+    if (!conversion.format.isEmpty() && MagickSetImageFormat(wand, conversion.format.constData()) == MagickFalse) {
+        DestroyMagickWand(wand);
+        return false;
+    }
+
+    const bool ok = saveWandToFile(wand, dstPath);
+    DestroyMagickWand(wand);
+    return ok;
+#else
+    Q_UNUSED(srcPath)
+    Q_UNUSED(dstPath)
+    Q_UNUSED(conversion)
+    return false;
+#endif
+}
+
+void ImageMagickSupport::resourceLimits(int& threads, quint64& memoryBytes) {
+#ifdef HAVE_MAGICKWAND
+    threads = static_cast<int>(MagickGetResourceLimit(ThreadResource));
+    memoryBytes = static_cast<quint64>(MagickGetResourceLimit(MemoryResource));
+#else
+    threads = 0;
+    memoryBytes = 0;
+#endif
+}
+
+void ImageMagickSupport::setResourceLimits(int threads, quint64 memoryBytes) {
+#ifdef HAVE_MAGICKWAND
+    MagickSetResourceLimit(ThreadResource, static_cast<MagickSizeType>(threads));
+    MagickSetResourceLimit(MemoryResource, static_cast<MagickSizeType>(memoryBytes));
+#else
+    Q_UNUSED(threads)
+    Q_UNUSED(memoryBytes)
+#endif
+}
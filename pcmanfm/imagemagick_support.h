@@ -24,6 +24,13 @@ struct ImageMagickInfo {
     bool hasAlpha = false;
 };
 
+// What ImageMagickSupport::convertImage() does to an image, in one read and one write.
+struct ImageMagickConversion {
+    QByteArray format;      // of the output, empty to keep that of the source
+    int maxSize = 0;        // of the longest side in pixels, 0 to keep the size; images are never enlarged
+    double rotation = 0.0;  // in degrees, clockwise
+};
+
 class ImageMagickSupport {
    public:
     static bool isAvailable();
@@ -45,4 +52,11 @@ class ImageMagickSupport {
                             bool keepAspect = true);
 
     static bool rotateImage(const QString& srcPath, const QString& dstPath, double degrees);
+
+    static bool convertImage(const QString& srcPath, const QString& dstPath, const ImageMagickConversion& conversion);
+
+    // ImageMagick's resource limits are process-wide: the threads one image operation may use,
+    // and the pixel cache kept in memory before it spills to disk.
+    static void resourceLimits(int& threads, quint64& memoryBytes);
+    static void setResourceLimits(int threads, quint64 memoryBytes);
 };
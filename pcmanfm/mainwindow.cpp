@@ -7,6 +7,7 @@
 
 #include "createlauncherdialog.h"
 #include "hiddenshortcutsdialog.h"
+#include "perfoverlay.h"
 #include "application.h"
 #include "settings.h"
 #include "tabpage.h"
@@ -30,6 +31,7 @@
 #include <QToolButton>
 #include <unistd.h>
 #include "../src/ui/fsqt.h"
+#include "../src/ui/previewpane.h"
 
 // LibFM-Qt Headers
 #include "panel/panel.h"
@@ -40,6 +42,9 @@ QPointer<MainWindow> MainWindow::lastActive_;
 
 namespace {
 
+constexpr int kPreviewPaneWidth = 300;
+constexpr int kPreviewNeighbors = 2;  // files on either side of the selected one previewed ahead
+
 Settings& appSettings() {
     return static_cast<Application*>(qApp)->settings();
 }
@@ -50,6 +55,7 @@ MainWindow::MainWindow(Panel::FilePath path)
     : pathEntry_(nullptr),
       pathBar_(nullptr),
       fsInfoLabel_(nullptr),
+      previewPane_(nullptr),
       fileLauncher_(this),
       rightClickIndex_(-1),
       updatingViewMenu_(false),
@@ -69,6 +75,9 @@ MainWindow::MainWindow(Panel::FilePath path)
     deleteShortcut->setContext(Qt::WidgetWithChildrenShortcut);
     connect(deleteShortcut, &QShortcut::activated, this, &MainWindow::on_actionDelete_triggered);
 
+    auto* perfShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::ALT | Qt::SHIFT | Qt::Key_P), this);
+    connect(perfShortcut, &QShortcut::activated, this, &MainWindow::onShortcutPerfOverlay);
+
     fsInfoLabel_ = new QLabel(this);
     fsInfoLabel_->setFrameShape(QFrame::NoFrame);
     fsInfoLabel_->setContentsMargins(4, 0, 4, 0);
@@ -114,11 +123,15 @@ MainWindow::MainWindow(Panel::FilePath path)
         connect(ui.sidePane, &Panel::SidePane::hiddenPlaceSet, this, &MainWindow::onSettingHiddenPlace);
     }
 
-    // Initialize splitter
+    // Initialize splitter, with the preview pane right of the views
     if (ui.splitter) {
+        previewPane_ = new PreviewPane(ui.splitter);
+        ui.splitter->addWidget(previewPane_);
+        previewPane_->setVisible(settings.isPreviewPaneVisible());
+        ui.actionPreviewPane->setChecked(settings.isPreviewPaneVisible());
         connect(ui.splitter, &QSplitter::splitterMoved, this, &MainWindow::onSplitterMoved);
         ui.splitter->setStretchFactor(1, 1);
-        ui.splitter->setSizes({settings.splitterPos(), 1});
+        ui.splitter->setSizes({settings.splitterPos(), 1, kPreviewPaneWidth});
     }
 
     // Initialize standard view action icons
@@ -163,6 +176,7 @@ MainWindow::MainWindow(Panel::FilePath path)
     // Add initial view frame
     addViewFrame(path);
     applyFrameActivation(activeViewFrame_);
+    ui.actionCompareFolders->setEnabled(ui.viewSplitter->count() > 1);
 
     // Create the path bar/location bar
     createPathBar(appSettings().pathBarButtons());
@@ -382,6 +396,7 @@ void MainWindow::on_actionSplitView_triggered(bool check) {
             updateUIForCurrentPage();
         }
     }
+    ui.actionCompareFolders->setEnabled(splitView_);
 }
 
 void MainWindow::on_actionSidePane_triggered(bool check) {
@@ -391,6 +406,41 @@ void MainWindow::on_actionSidePane_triggered(bool check) {
     }
 }
 
+void MainWindow::on_actionPreviewPane_triggered(bool checked) {
+    appSettings().showPreviewPane(checked);
+    if (previewPane_) {
+        previewPane_->setVisible(checked);
+        if (checked) {
+            updatePreviewPane();
+        }
+        else {
+            previewPane_->setFile(nullptr);  // nothing is rendered for a hidden pane
+        }
+    }
+}
+
+// Previews the file selected alone in the current page.
+void MainWindow::updatePreviewPane() {
+    if (!previewPane_ || !previewPane_->isVisible()) {
+        return;
+    }
+    TabPage* page = currentPage();
+    auto* changedPage = qobject_cast<TabPage*>(sender());
+    if (changedPage && changedPage != page) {  // the other view of a split window
+        return;
+    }
+    Panel::FileInfoList files;
+    if (page) {
+        files = page->selectedFiles();
+    }
+    if (files.size() == 1) {
+        previewPane_->setFile(files.front(), page->filesAroundCurrent(kPreviewNeighbors));
+    }
+    else {
+        previewPane_->setFile(nullptr);
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Other event handlers
 //-----------------------------------------------------------------------------
@@ -402,7 +452,7 @@ void MainWindow::updateFromSettings(Settings& settings) {
         ui.sidePane->setVisible(settings.isSidePaneVisible());
     }
     if (ui.splitter) {
-        ui.splitter->setSizes({settings.splitterPos(), 1});
+        ui.splitter->setSizes({settings.splitterPos(), 1, kPreviewPaneWidth});
     }
     if (ui.menubar) {
         ui.menubar->setVisible(settings.showMenuBar());
@@ -443,6 +493,10 @@ void MainWindow::onTabPageTitleChanged() {
                 }
             }
         }
+        // a background tab changes only its own label
+        if (page != currentPage()) {
+            return;
+        }
     }
 
     updateUIForCurrentPage();
@@ -457,6 +511,11 @@ void MainWindow::onTabPageStatusChanged(int type, QString statusText) {
     }
     else {
         if (ui.statusbar) {
+            // a cleared selection goes back to the text of the folder, which is only sent when it changes
+            auto* page = qobject_cast<TabPage*>(sender());
+            if (type == TabPage::StatusTextSelectedFiles && statusText.isEmpty() && page) {
+                statusText = page->statusText(TabPage::StatusTextNormal);
+            }
             ui.statusbar->showMessage(statusText);
         }
     }
@@ -502,6 +561,17 @@ void MainWindow::on_actionHiddenShortcuts_triggered() {
     dialog.exec();
 }
 
+void MainWindow::onShortcutPerfOverlay() {
+    // one for all the windows, as what it shows is not per window
+    static QPointer<PerfOverlay> overlay;
+    if (!overlay) {
+        overlay = new PerfOverlay();
+    }
+    overlay->show();
+    overlay->raise();
+    overlay->activateWindow();
+}
+
 void MainWindow::onShortcutPrevTab() {
     if (activeViewFrame_) {
         auto* tab = activeViewFrame_->getTabBar();
@@ -562,8 +632,9 @@ void MainWindow::onSidePaneModeChanged(Panel::SidePane::Mode mode) {
 }
 
 void MainWindow::onSplitterMoved(int pos, int index) {
-    Q_UNUSED(index);
-    appSettings().setSplitterPos(pos);
+    if (index == 1) {  // the handle right of the side pane
+        appSettings().setSplitterPos(pos);
+    }
 }
 
 void MainWindow::onBackForwardContextMenu(QPoint pos) {
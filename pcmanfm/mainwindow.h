@@ -65,6 +65,7 @@ class ViewFrame : public QFrame {
 //======================================================================
 
 class Settings;
+class PreviewPane;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -128,6 +129,8 @@ class MainWindow : public QMainWindow {
 
     void on_actionGo_triggered();
     void on_actionShowHidden_triggered(bool check);
+    void on_actionFlatView_triggered(bool checked);
+    void on_actionDiskUsage_triggered(bool checked);
     void on_actionShowThumbnails_triggered(bool check);
     void on_actionSplitView_triggered(bool check);
     void on_actionPreserveView_triggered(bool checked);
@@ -164,6 +167,7 @@ class MainWindow : public QMainWindow {
     void on_actionCreateLauncher_triggered();
     void on_actionCopyFullPath_triggered();
     void on_actionFindFiles_triggered();
+    void on_actionCompareFolders_triggered();
 
     void on_actionAbout_triggered();
     void on_actionHiddenShortcuts_triggered();
@@ -174,6 +178,7 @@ class MainWindow : public QMainWindow {
     void onTabBarCurrentChanged(int index);
     void onTabBarTabMoved(int from, int to);
 
+    void onShortcutPerfOverlay();
     void onShortcutPrevTab();
     void onShortcutNextTab();
     void onShortcutJumpToTab();
@@ -191,6 +196,8 @@ class MainWindow : public QMainWindow {
     void onSidePaneCreateNewFolderRequested(const Panel::FilePath& path);
     void onSidePaneModeChanged(Panel::SidePane::Mode mode);
     void on_actionSidePane_triggered(bool check);
+    void on_actionPreviewPane_triggered(bool checked);
+    void updatePreviewPane();
     void onSplitterMoved(int pos, int index);
     void onResetFocus();
 
@@ -259,6 +266,7 @@ class MainWindow : public QMainWindow {
     Panel::PathEdit* pathEntry_;
     Panel::PathBar* pathBar_;
     QLabel* fsInfoLabel_;
+    PreviewPane* previewPane_;  // right of the views
     std::shared_ptr<Panel::Bookmarks> bookmarks_;
     Launcher fileLauncher_;
     int rightClickIndex_;
@@ -228,17 +228,6 @@ void MainWindow::on_actionDelete_triggered() {
         }
     }
 
-    auto fileOps = BackendRegistry::createFileOps();
-    if (!fileOps) {
-        QMessageBox::warning(this, tr("Delete Failed"), tr("File operations backend is not available."));
-        return;
-    }
-
-    // Keep the async backend alive until it finishes.
-    IFileOps* fileOpsPtr = fileOps.release();
-    fileOpsPtr->setParent(this);
-    connect(fileOpsPtr, &IFileOps::finished, fileOpsPtr, &QObject::deleteLater);
-
     FileOpRequest req;
     req.type = FileOpType::Delete;
     req.sources = filePathListToStringList(paths);
@@ -247,7 +236,10 @@ void MainWindow::on_actionDelete_triggered() {
     req.overwriteExisting = false;
     req.preserveOwnership = shouldPreserveOwnershipForOps();
 
-    fileOpsPtr->start(req);
+    // The scheduler owns the backend and runs it once no other job is using the device.
+    if (!BackendRegistry::scheduleFileOp(req)) {
+        QMessageBox::warning(this, tr("Delete Failed"), tr("File operations backend is not available."));
+    }
 }
 
 void MainWindow::on_actionRename_triggered() {
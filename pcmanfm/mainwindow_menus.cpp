@@ -104,6 +104,8 @@ void MainWindow::updateViewMenuForCurrentPage() {
     if (tabPage) {
         // update menus
         ui.actionShowHidden->setChecked(tabPage->showHidden());
+        ui.actionFlatView->setChecked(tabPage->flatView());
+        ui.actionDiskUsage->setChecked(tabPage->diskUsage());
         ui.actionPreserveView->setChecked(tabPage->hasCustomizedView() && !tabPage->hasRecursiveCustomizedView());
         ui.actionPreserveViewRecursive->setChecked(tabPage->hasRecursiveCustomizedView());
         ui.actionGoToCustomizedViewSource->setVisible(tabPage->hasInheritedCustomizedView());
@@ -282,6 +284,7 @@ void MainWindow::updateUIForCurrentPage(bool setFocus) {
 
     // also update the enabled state of File and Edit actions
     updateSelectedActions();
+    updatePreviewPane();
 
     bool isWritable = false;
     bool isNative = false;
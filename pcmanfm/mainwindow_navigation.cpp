@@ -6,8 +6,10 @@
 #include "application.h"
 #include "mainwindow.h"
 #include "tabpage.h"
+#include "../src/ui/foldercomparedialog.h"
 
 // Qt Headers
+#include <QMessageBox>
 #include <QStandardPaths>
 #include <QTimer>
 
@@ -138,6 +140,24 @@ void MainWindow::on_actionFindFiles_triggered() {
     app->findFiles(paths);
 }
 
+void MainWindow::on_actionCompareFolders_triggered() {
+    if (ui.viewSplitter->count() < 2) {
+        return;
+    }
+    auto* leftFrame = qobject_cast<ViewFrame*>(ui.viewSplitter->widget(0));
+    auto* rightFrame = qobject_cast<ViewFrame*>(ui.viewSplitter->widget(1));
+    TabPage* left = leftFrame ? currentPage(leftFrame) : nullptr;
+    TabPage* right = rightFrame ? currentPage(rightFrame) : nullptr;
+    if (!left || !right) {
+        return;
+    }
+    if (!left->path().isNative() || !right->path().isNative()) {
+        QMessageBox::information(this, tr("Compare Folders"), tr("Only local folders can be compared."));
+        return;
+    }
+    (new FolderCompareDialog(left, right, this))->show();
+}
+
 void MainWindow::on_actionOpenTerminal_triggered() {
     if (TabPage* page = currentPage()) {
         static_cast<Application*>(qApp)->openFolderInTerminal(page->path());
@@ -98,8 +98,16 @@ int MainWindow::addTabWithPage(TabPage* page, ViewFrame* viewFrame, Panel::FileP
     connect(page, &TabPage::forwardRequested, this, &MainWindow::on_actionGoForward_triggered);
     connect(page, &TabPage::backspacePressed, this, &MainWindow::on_actionGoUp_triggered);
     connect(page, &TabPage::folderUnmounted, this, &MainWindow::onFolderUnmounted);
+    connect(page, &TabPage::selectionChanged, this, &MainWindow::updatePreviewPane);
 
-    if (path) {
+    // Tabs reopened from the last session behind the first one are listed only when first shown,
+    // so that a long session does not list all its folders, some perhaps on slow mounts, at once.
+    auto* app = qobject_cast<Application*>(qApp);
+    const bool deferred = path && index > 0 && app && app->openingLastTabs();
+    if (deferred) {
+        page->deferChdir(path);
+    }
+    else if (path) {
         page->chdir(path, true);
     }
 
@@ -112,7 +120,7 @@ int MainWindow::addTabWithPage(TabPage* page, ViewFrame* viewFrame, Panel::FileP
 
     Settings& settings = appSettings();
 
-    if (settings.switchToNewTab()) {
+    if (settings.switchToNewTab() && !deferred) {
         tabBar->setCurrentIndex(index);  // also focuses the view
         if (isMinimized()) {
             setWindowState((windowState() & ~Qt::WindowMinimized) | Qt::WindowActive);
@@ -215,6 +223,9 @@ void MainWindow::onTabBarCurrentChanged(int index) {
 
     auto* stackedWidget = viewFrame->getStackedWidget();
     stackedWidget->setCurrentIndex(index);
+    if (auto* page = qobject_cast<TabPage*>(stackedWidget->widget(index))) {
+        page->loadDeferredPath();
+    }
     // Keep selection exclusive to the visible tab within this frame
     for (int i = 0; i < stackedWidget->count(); ++i) {
         if (i == index) {
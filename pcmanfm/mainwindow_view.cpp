@@ -112,6 +112,18 @@ void MainWindow::on_actionShowHidden_triggered(bool checked) {
     }
 }
 
+void MainWindow::on_actionFlatView_triggered(bool checked) {
+    if (auto* page = currentPage()) {
+        page->setFlatView(checked);
+    }
+}
+
+void MainWindow::on_actionDiskUsage_triggered(bool checked) {
+    if (auto* page = currentPage()) {
+        page->setDiskUsage(checked);
+    }
+}
+
 void MainWindow::on_actionShowThumbnails_triggered(bool checked) {
     // This is a global setting, so update all pages in all windows
     forEachTabPageGlobal([checked](MainWindow* mw, TabPage* page) {
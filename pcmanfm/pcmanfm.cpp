@@ -6,6 +6,7 @@
 #include "panel/panel.h"
 
 #include "../src/core/backend_registry.h"
+#include "../src/core/startup_trace.h"
 #include "application.h"
 
 int main(int argc, char** argv) {
@@ -16,7 +17,10 @@ int main(int argc, char** argv) {
     PCManFM::Application app(argc, argv);
 
     // Initialize backend registry after QApplication is created
-    PCManFM::BackendRegistry::initDefaults();
+    {
+        PCManFM::StartupTrace::Scope scope(app.startupTrace(), "backends");
+        PCManFM::BackendRegistry::initDefaults();
+    }
 
     app.init();
     return app.exec();
@@ -0,0 +1,191 @@
+/*
+ * Hidden overlay showing Fm::PerfTrace and Fm::MemoryStats
+ * pcmanfm/perfoverlay.cpp
+ */
+
+#include "perfoverlay.h"
+#include "application.h"
+#include "../src/core/device_profiles.h"
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QFile>
+#include <QFileDialog>
+#include <QFontDatabase>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <sys/sysmacros.h>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr int kRefreshInterval = 1000;  // ms
+
+QString cell(const QString& text) {
+    return QStringLiteral("<td align=\"right\">&nbsp;%1&nbsp;</td>").arg(text);
+}
+
+QString ms(int64_t us) {
+    return QString::number(us / 1000.0, 'f', 2);
+}
+
+QString mib(int64_t bytes) {
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1);
+}
+
+}  // namespace
+
+PerfOverlay::PerfOverlay(QWidget* parent) : QDialog(parent, Qt::Tool | Qt::WindowStaysOnTopHint) {
+    setWindowTitle(tr("Performance"));
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+
+    recordCheckBox_ = new QCheckBox(tr("Record"), this);
+    recordCheckBox_->setChecked(Panel::PerfTrace::isEnabled());
+    connect(recordCheckBox_, &QCheckBox::toggled, this, [](bool checked) { Panel::PerfTrace::setEnabled(checked); });
+    layout->addWidget(recordCheckBox_);
+
+    memoryCheckBox_ = new QCheckBox(tr("Count memory"), this);
+    memoryCheckBox_->setChecked(Panel::MemoryStats::isEnabled());
+    connect(memoryCheckBox_, &QCheckBox::toggled, this, [](bool checked) { Panel::MemoryStats::setEnabled(checked); });
+    layout->addWidget(memoryCheckBox_);
+
+    label_ = new QLabel(this);
+    label_->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    label_->setTextFormat(Qt::RichText);
+    label_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    layout->addWidget(label_);
+
+    QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    QPushButton* resetButton = buttonBox->addButton(tr("Reset"), QDialogButtonBox::ResetRole);
+    QPushButton* saveButton = buttonBox->addButton(tr("Save Trace..."), QDialogButtonBox::ActionRole);
+    QPushButton* trimButton = buttonBox->addButton(tr("Trim Caches"), QDialogButtonBox::ActionRole);
+    layout->addWidget(buttonBox);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &PerfOverlay::reject);
+    connect(resetButton, &QPushButton::clicked, this, [this]() {
+        Panel::PerfTrace::reset();
+        refresh();
+    });
+    connect(saveButton, &QPushButton::clicked, this, &PerfOverlay::saveTrace);
+    connect(trimButton, &QPushButton::clicked, this, [this]() {
+        static_cast<Application*>(qApp)->trimCaches();
+        refresh();
+    });
+
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(kRefreshInterval);
+    connect(refreshTimer_, &QTimer::timeout, this, &PerfOverlay::refresh);
+    for (int i = 0; i < Panel::PerfTrace::NumCounters; ++i) {
+        counters_[i] = Panel::PerfTrace::counter(static_cast<Panel::PerfTrace::Counter>(i));
+    }
+    sinceRefresh_.start();
+    refresh();
+}
+
+PerfOverlay::~PerfOverlay() {}
+
+void PerfOverlay::showEvent(QShowEvent* event) {
+    QDialog::showEvent(event);
+    refreshTimer_->start();
+}
+
+void PerfOverlay::hideEvent(QHideEvent* event) {
+    refreshTimer_->stop();
+    QDialog::hideEvent(event);
+}
+
+void PerfOverlay::refresh() {
+    using PerfTrace = Panel::PerfTrace;
+    const double seconds = std::max<qint64>(sinceRefresh_.restart(), 1) / 1000.0;
+    int64_t deltas[PerfTrace::NumCounters];
+    for (int i = 0; i < PerfTrace::NumCounters; ++i) {
+        const int64_t value = PerfTrace::counter(static_cast<PerfTrace::Counter>(i));
+        deltas[i] = value - counters_[i];
+        counters_[i] = value;
+    }
+
+    QString text = QStringLiteral("<table cellspacing=\"0\"><tr><th align=\"left\">%1</th>").arg(tr("Span"));
+    text += QStringLiteral("<th>%1</th><th>%2</th><th>%3</th><th>%4</th><th>%5</th></tr>")
+                .arg(tr("Count"), tr("Avg ms"), tr("Max ms"), tr("Last ms"), tr("Amount/s"));
+    for (const auto& stats : PerfTrace::spanStats()) {
+        text += QStringLiteral("<tr><td>%1</td>").arg(QString::fromUtf8(stats.name).toHtmlEscaped());
+        text += cell(QString::number(stats.count)) + cell(ms(stats.totalUs / static_cast<int64_t>(stats.count))) +
+                cell(ms(stats.maxUs)) + cell(ms(stats.lastUs));
+        // the rate while the spans ran, as the entries listed per second
+        text += cell(stats.amount > 0 && stats.totalUs > 0
+                         ? QString::number(stats.amount * 1e6 / stats.totalUs, 'f', 0)
+                         : QString());
+        text += QStringLiteral("</tr>");
+    }
+    text += QStringLiteral("</table><br>");
+
+    const int64_t memoryHits = counters_[PerfTrace::ThumbnailMemoryHits];
+    const int64_t diskHits = counters_[PerfTrace::ThumbnailDiskHits];
+    const int64_t thumbnails = memoryHits + diskHits + counters_[PerfTrace::ThumbnailGenerated];
+    auto percent = [thumbnails](int64_t hits) {
+        return thumbnails > 0 ? QString::number(hits * 100.0 / thumbnails, 'f', 1) : QStringLiteral("-");
+    };
+    text += tr("Folder events: %1/s").arg(deltas[PerfTrace::FolderEvents] / seconds, 0, 'f', 0);
+    text += QStringLiteral("<br>");
+    const int64_t failed = counters_[PerfTrace::ThumbnailFailed];
+    // loaded for rows that were scrolled away before they were painted
+    const int64_t unshown = std::max<int64_t>(thumbnails - failed - counters_[PerfTrace::ThumbnailShown], 0);
+    text += tr("Thumbnail queue: %1, memory hits: %2%, disk hits: %3%, failed: %4%, not shown: %5")
+                .arg(counters_[PerfTrace::ThumbnailQueue])
+                .arg(percent(memoryHits), percent(diskHits), percent(failed))
+                .arg(unshown) +
+            QStringLiteral("<br>");
+    text += tr("File transfer: %1 MiB/s, %2 files/s")
+                .arg(deltas[PerfTrace::TransferBytes] / seconds / (1024 * 1024), 0, 'f', 1)
+                .arg(deltas[PerfTrace::TransferFiles] / seconds, 0, 'f', 0);
+
+    // what the copies learned about the devices they wrote to
+    const auto profiles = FsOps::DeviceProfiles::instance().profiles();
+    if (!profiles.empty()) {
+        text += QStringLiteral("<br><br><table cellspacing=\"0\"><tr><th align=\"left\">%1</th>").arg(tr("Device"));
+        text += QStringLiteral("<th>%1</th><th>%2</th><th>%3</th><th>%4</th></tr>")
+                    .arg(tr("Chunk KiB"), tr("Workers"), tr("MiB/s"), tr("Chunk ms"));
+        for (const auto& profile : profiles) {
+            const auto device = static_cast<dev_t>(profile.device);
+            text += QStringLiteral("<tr><td>%1:%2</td>").arg(major(device)).arg(minor(device));
+            text += cell(QString::number(profile.chunkSize / 1024)) +
+                    cell(profile.workers > 0 ? QString::number(profile.workers) : QStringLiteral("-")) +
+                    cell(mib(static_cast<int64_t>(profile.bytesPerSecond))) +
+                    cell(QString::number(profile.chunkLatencyMs, 'f', 2)) + QStringLiteral("</tr>");
+        }
+        text += QStringLiteral("</table>");
+    }
+
+    // the counted subsystems only know what was allocated while counting
+    using MemoryStats = Panel::MemoryStats;
+    text += QStringLiteral("<br><br><table cellspacing=\"0\"><tr><th align=\"left\">%1</th><th>%2</th></tr>")
+                .arg(tr("Memory"), tr("MiB"));
+    for (int i = 0; i < MemoryStats::NumSubsystems; ++i) {
+        const auto subsystem = static_cast<MemoryStats::Subsystem>(i);
+        text += QStringLiteral("<tr><td>%1</td>").arg(QString::fromUtf8(MemoryStats::subsystemName(subsystem)));
+        text += cell(mib(MemoryStats::liveBytes(subsystem))) + QStringLiteral("</tr>");
+    }
+    text += QStringLiteral("</table>");
+    label_->setText(text);
+}
+
+void PerfOverlay::saveTrace() {
+    const QString fileName =
+        QFileDialog::getSaveFileName(this, tr("Save Trace"), QStringLiteral("pcmanfm-qt-trace.json"),
+                                     tr("Chrome trace (*.json)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    const QByteArray trace = Panel::PerfTrace::toChromeTrace();
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(trace) != trace.size()) {
+        QMessageBox::critical(this, tr("Error"), tr("Cannot write %1: %2").arg(fileName, file.errorString()));
+    }
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,49 @@
+/*
+ * Hidden overlay showing Fm::PerfTrace and Fm::MemoryStats
+ * pcmanfm/perfoverlay.h
+ */
+
+#ifndef PCMANFM_PERFOVERLAY_H
+#define PCMANFM_PERFOVERLAY_H
+
+#include <QDialog>
+#include <QElapsedTimer>
+#include <cstdint>
+#include "panel/panel.h"
+
+class QCheckBox;
+class QLabel;
+class QTimer;
+
+namespace PCManFM {
+
+// A small window on top of the others, refreshed every second while shown. Recording and
+// the accounting of memory are switched on and off from it, the trace recorded so far can
+// be saved from it, and the caches can be trimmed.
+class PerfOverlay : public QDialog {
+    Q_OBJECT
+
+   public:
+    explicit PerfOverlay(QWidget* parent = nullptr);
+    ~PerfOverlay();
+
+   protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+   private Q_SLOTS:
+    void refresh();
+    void saveTrace();
+
+   private:
+    QCheckBox* recordCheckBox_;
+    QCheckBox* memoryCheckBox_;
+    QLabel* label_;
+    QTimer* refreshTimer_;
+    QElapsedTimer sinceRefresh_;
+    int64_t counters_[Panel::PerfTrace::NumCounters];  // as of the last refresh, for the rates
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_PERFOVERLAY_H
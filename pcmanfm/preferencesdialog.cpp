@@ -170,6 +170,7 @@ void PreferencesDialog::initDisplayPage(Settings& settings) {
     ui.showFullNames->setChecked(settings.showFullNames());
     ui.shadowHidden->setChecked(settings.shadowHidden());
     ui.noItemTooltip->setChecked(settings.noItemTooltip());
+    ui.showFolderSizes->setChecked(settings.showFolderSizes());
     ui.noScrollPerPixel->setChecked(!settings.scrollPerPixel());
 
     // restart warning toggles for settings that affect core view behavior
@@ -190,6 +191,7 @@ void PreferencesDialog::initUiPage(Settings& settings) {
     ui.showTabClose->setChecked(settings.showTabClose());
     ui.switchToNewTab->setChecked(settings.switchToNewTab());
     ui.reopenLastTabs->setChecked(settings.reopenLastTabs());
+    ui.suspendHiddenTabs->setValue(settings.suspendHiddenTabsMinutes());
     ui.rememberWindowSize->setChecked(settings.rememberWindowSize());
     ui.fixedWindowWidth->setValue(settings.fixedWindowWidth());
     ui.fixedWindowHeight->setValue(settings.fixedWindowHeight());
@@ -341,10 +343,23 @@ void PreferencesDialog::initAdvancedPage(Settings& settings) {
     ui.templateRunApp->setChecked(settings.templateRunApp());
     ui.preservePermissions->setChecked(settings.preservePermissions());
 
+    ui.conflictRule->addItem(tr("Ask for each file"), int(Panel::FileOperationJob::ConflictRule::ASK));
+    ui.conflictRule->addItem(tr("Replace older files, keep newer ones"),
+                             int(Panel::FileOperationJob::ConflictRule::NEWER_WINS));
+    ui.conflictRule->addItem(tr("Replace files of another size"),
+                             int(Panel::FileOperationJob::ConflictRule::SIZE_DIFFERS));
+    ui.conflictRule->addItem(tr("Keep identical files, ask for others"),
+                             int(Panel::FileOperationJob::ConflictRule::SKIP_IDENTICAL));
+    int index = ui.conflictRule->findData(int(settings.conflictRule()));
+    if (index != -1) {
+        ui.conflictRule->setCurrentIndex(index);
+    }
+
     // option currently not wired to behavior, keep hidden until support is implemented
     ui.templateRunApp->hide();
 
     ui.maxSearchHistory->setValue(settings.maxSearchHistory());
+    ui.indexHome->setChecked(settings.indexHome());
 }
 
 void PreferencesDialog::initFromSettings() {
@@ -388,6 +403,7 @@ void PreferencesDialog::applyDisplayPage(Settings& settings) {
     settings.setShowFullNames(ui.showFullNames->isChecked());
     settings.setShadowHidden(ui.shadowHidden->isChecked());
     settings.setNoItemTooltip(ui.noItemTooltip->isChecked());
+    settings.setShowFolderSizes(ui.showFolderSizes->isChecked());
     settings.setScrollPerPixel(!ui.noScrollPerPixel->isChecked());
     settings.setFolderViewCellMargins(QSize(ui.hMargin->value(), ui.vMargin->value()));
 }
@@ -397,6 +413,7 @@ void PreferencesDialog::applyUiPage(Settings& settings) {
     settings.setShowTabClose(ui.showTabClose->isChecked());
     settings.setSwitchToNewTab(ui.switchToNewTab->isChecked());
     settings.setReopenLastTabs(ui.reopenLastTabs->isChecked());
+    settings.setSuspendHiddenTabsMinutes(ui.suspendHiddenTabs->value());
     settings.setRememberWindowSize(ui.rememberWindowSize->isChecked());
     settings.setFixedWindowWidth(ui.fixedWindowWidth->value());
     settings.setFixedWindowHeight(ui.fixedWindowHeight->value());
@@ -483,11 +500,13 @@ void PreferencesDialog::applyAdvancedPage(Settings& settings) {
 
     settings.setArchiver(ui.archiver->currentData().toString());
     settings.setPreservePermissions(ui.preservePermissions->isChecked());
+    settings.setConflictRule(Panel::FileOperationJob::ConflictRule(ui.conflictRule->currentData().toInt()));
 
     settings.setOnlyUserTemplates(ui.onlyUserTemplates->isChecked());
     settings.setTemplateTypeOnce(ui.templateTypeOnce->isChecked());
     settings.setTemplateRunApp(ui.templateRunApp->isChecked());
     settings.setMaxSearchHistory(ui.maxSearchHistory->value());
+    settings.setIndexHome(ui.indexHome->isChecked());
 }
 
 void PreferencesDialog::applySettings() {
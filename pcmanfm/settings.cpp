@@ -32,6 +32,37 @@ namespace PCManFM {
 
 inline static const char* bookmarkOpenMethodToString(OpenDirTargetType value);
 
+namespace {
+
+const char* conflictRuleToString(Panel::FileOperationJob::ConflictRule rule) {
+    switch (rule) {
+        case Panel::FileOperationJob::ConflictRule::NEWER_WINS:
+            return "newer";
+        case Panel::FileOperationJob::ConflictRule::SIZE_DIFFERS:
+            return "size";
+        case Panel::FileOperationJob::ConflictRule::SKIP_IDENTICAL:
+            return "identical";
+        case Panel::FileOperationJob::ConflictRule::ASK:
+            break;
+    }
+    return "ask";
+}
+
+Panel::FileOperationJob::ConflictRule conflictRuleFromString(const QString& str) {
+    if (str == QLatin1String("newer")) {
+        return Panel::FileOperationJob::ConflictRule::NEWER_WINS;
+    }
+    if (str == QLatin1String("size")) {
+        return Panel::FileOperationJob::ConflictRule::SIZE_DIFFERS;
+    }
+    if (str == QLatin1String("identical")) {
+        return Panel::FileOperationJob::ConflictRule::SKIP_IDENTICAL;
+    }
+    return Panel::FileOperationJob::ConflictRule::ASK;
+}
+
+}  // namespace
+
 Settings::Settings()
     : QObject(),
       supportTrash_(false),  // trash disabled in this build
@@ -40,11 +71,13 @@ Settings::Settings()
       singleWindowMode_(false),
       bookmarkOpenMethod_(OpenInCurrentTab),
       preservePermissions_(false),
+      conflictRule_(Panel::FileOperationJob::ConflictRule::ASK),
       terminal_(),
       alwaysShowTabs_(true),
       showTabClose_(true),
       switchToNewTab_(false),
       reopenLastTabs_(false),
+      suspendHiddenTabsMinutes_(15),
       splitViewTabsNum_(0),
       rememberWindowSize_(true),
       fixedWindowWidth_(640),
@@ -54,6 +87,7 @@ Settings::Settings()
       lastWindowMaximized_(false),
       splitterPos_(120),
       sidePaneVisible_(true),
+      previewPaneVisible_(false),
       sidePaneMode_(Panel::SidePane::ModePlaces),
       showMenuBar_(true),
       splitView_(false),
@@ -83,7 +117,9 @@ Settings::Settings()
       showFullNames_(true),
       shadowHidden_(true),
       noItemTooltip_(false),
+      showFolderSizes_(false),
       scrollPerPixel_(true),
+      shareListings_(false),
       bigIconSize_(48),
       smallIconSize_(24),
       sidePaneIconSize_(24),
@@ -100,7 +136,9 @@ Settings::Settings()
       searchContentRegexp_(true),
       searchRecursive_(false),
       searchhHidden_(false),
-      maxSearchHistory_(0) {}
+      searchMaxResults_(0),
+      maxSearchHistory_(0),
+      indexHome_(false) {}
 
 Settings::~Settings() = default;
 
@@ -206,6 +244,7 @@ bool Settings::loadFile(QString filePath) {
     bookmarkOpenMethod_ =
         FolderSettings::bookmarkOpenMethodFromString(settings.value(QStringLiteral("BookmarkOpenMethod")).toString());
     preservePermissions_ = settings.value(QStringLiteral("PreservePermissions"), false).toBool();
+    setConflictRule(conflictRuleFromString(settings.value(QStringLiteral("ConflictRule")).toString()));
     // settings for use with libfm
     useTrash_ = false;  // trash disabled
     singleClick_ = settings.value(QStringLiteral("SingleClick"), false).toBool();
@@ -225,6 +264,8 @@ bool Settings::loadFile(QString filePath) {
     setMaxThumbnailFileSize(settings.value(QStringLiteral("MaxThumbnailFileSize"), 4096).toInt());
     setMaxExternalThumbnailFileSize(settings.value(QStringLiteral("MaxExternalThumbnailFileSize"), -1).toInt());
     setThumbnailLocalFilesOnly(settings.value(QStringLiteral("ThumbnailLocalFilesOnly"), true).toBool());
+    setInProcessVideoThumbnails(settings.value(QStringLiteral("InProcessVideoThumbnails"), true).toBool());
+    setThumbnailCacheMaxSize(settings.value(QStringLiteral("ThumbnailCacheMaxSize"), 1024).toInt());
     settings.endGroup();
 
     settings.beginGroup(QStringLiteral("FolderView"));
@@ -242,13 +283,19 @@ bool Settings::loadFile(QString filePath) {
     showFullNames_ = settings.value(QStringLiteral("ShowFullNames"), true).toBool();
     shadowHidden_ = settings.value(QStringLiteral("ShadowHidden"), true).toBool();
     noItemTooltip_ = settings.value(QStringLiteral("NoItemTooltip"), false).toBool();
+    showFolderSizes_ = settings.value(QStringLiteral("ShowFolderSizes"), false).toBool();
     scrollPerPixel_ = settings.value(QStringLiteral("ScrollPerPixel"), true).toBool();
+    setListingSnapshots(settings.value(QStringLiteral("ListingSnapshots"), false).toBool());
+    setNativeMetadata(settings.value(QStringLiteral("NativeMetadata"), false).toBool());
+    shareListings_ = settings.value(QStringLiteral("ShareListings"), false).toBool();
 
     // override config in libfm's FmConfig
     bigIconSize_ = toIconSize(settings.value(QStringLiteral("BigIconSize"), 48).toInt(), Big);
     smallIconSize_ = toIconSize(settings.value(QStringLiteral("SmallIconSize"), 24).toInt(), Small);
     sidePaneIconSize_ = toIconSize(settings.value(QStringLiteral("SidePaneIconSize"), 24).toInt(), Small);
     thumbnailIconSize_ = toIconSize(settings.value(QStringLiteral("ThumbnailIconSize"), 128).toInt(), Thumbnail);
+    // the common icons are rendered at these sizes when the icon index is rebuilt
+    Panel::IconPathIndex::globalInstance()->setPixmapSizes({bigIconSize_, smallIconSize_, sidePaneIconSize_});
 
     folderViewCellMargins_ =
         (settings.value(QStringLiteral("FolderViewCellMargins"), QSize(3, 3)).toSize().expandedTo(QSize(0, 0)))
@@ -278,10 +325,13 @@ bool Settings::loadFile(QString filePath) {
     showTabClose_ = settings.value(QStringLiteral("ShowTabClose"), true).toBool();
     switchToNewTab_ = settings.value(QStringLiteral("SwitchToNewTab"), false).toBool();
     reopenLastTabs_ = settings.value(QStringLiteral("ReopenLastTabs"), false).toBool();
+    suspendHiddenTabsMinutes_ =
+        qBound(0, settings.value(QStringLiteral("SuspendHiddenTabsMinutes"), 15).toInt(), 1440);
     tabPaths_ = settings.value(QStringLiteral("TabPaths")).toStringList();
     splitViewTabsNum_ = settings.value(QStringLiteral("SplitViewTabsNum")).toInt();
     splitterPos_ = settings.value(QStringLiteral("SplitterPos"), 150).toInt();
     sidePaneVisible_ = settings.value(QStringLiteral("SidePaneVisible"), true).toBool();
+    previewPaneVisible_ = settings.value(QStringLiteral("PreviewPaneVisible"), false).toBool();
     sidePaneMode_ = FolderSettings::sidePaneModeFromString(settings.value(QStringLiteral("SidePaneMode")).toString());
     showMenuBar_ = settings.value(QStringLiteral("ShowMenuBar"), true).toBool();
     splitView_ = settings.value(QStringLiteral("SplitView"), false).toBool();
@@ -295,7 +345,9 @@ bool Settings::loadFile(QString filePath) {
     searchContentRegexp_ = settings.value(QStringLiteral("searchContentRegexp"), true).toBool();
     searchRecursive_ = settings.value(QStringLiteral("searchRecursive"), false).toBool();
     searchhHidden_ = settings.value(QStringLiteral("searchhHidden"), false).toBool();
+    searchMaxResults_ = std::max(settings.value(QStringLiteral("MaxResults"), 0).toInt(), 0);
     maxSearchHistory_ = std::clamp(settings.value(QStringLiteral("MaxSearchHistory"), 0).toInt(), 0, 50);
+    setIndexHome(settings.value(QStringLiteral("IndexHome"), false).toBool());
     namePatterns_ = settings.value(QStringLiteral("NamePatterns")).toStringList();
     namePatterns_.removeDuplicates();
     contentPatterns_ = settings.value(QStringLiteral("ContentPatterns")).toStringList();
@@ -325,6 +377,7 @@ bool Settings::saveFile(QString filePath) {
     settings.setValue(QStringLiteral("BookmarkOpenMethod"),
                       QString::fromUtf8(bookmarkOpenMethodToString(bookmarkOpenMethod_)));
     settings.setValue(QStringLiteral("PreservePermissions"), preservePermissions_);
+    settings.setValue(QStringLiteral("ConflictRule"), QString::fromUtf8(conflictRuleToString(conflictRule_)));
     // settings for use with libfm
     settings.setValue(QStringLiteral("UseTrash"), useTrash_);
     settings.setValue(QStringLiteral("SingleClick"), singleClick_);
@@ -344,6 +397,8 @@ bool Settings::saveFile(QString filePath) {
     settings.setValue(QStringLiteral("MaxThumbnailFileSize"), maxThumbnailFileSize());
     settings.setValue(QStringLiteral("MaxExternalThumbnailFileSize"), maxExternalThumbnailFileSize());
     settings.setValue(QStringLiteral("ThumbnailLocalFilesOnly"), thumbnailLocalFilesOnly());
+    settings.setValue(QStringLiteral("InProcessVideoThumbnails"), inProcessVideoThumbnails());
+    settings.setValue(QStringLiteral("ThumbnailCacheMaxSize"), thumbnailCacheMaxSize());
     settings.endGroup();
 
     settings.beginGroup(QStringLiteral("FolderView"));
@@ -360,7 +415,11 @@ bool Settings::saveFile(QString filePath) {
     settings.setValue(QStringLiteral("ShowFullNames"), showFullNames_);
     settings.setValue(QStringLiteral("ShadowHidden"), shadowHidden_);
     settings.setValue(QStringLiteral("NoItemTooltip"), noItemTooltip_);
+    settings.setValue(QStringLiteral("ShowFolderSizes"), showFolderSizes_);
     settings.setValue(QStringLiteral("ScrollPerPixel"), scrollPerPixel_);
+    settings.setValue(QStringLiteral("ListingSnapshots"), listingSnapshots());
+    settings.setValue(QStringLiteral("NativeMetadata"), nativeMetadata());
+    settings.setValue(QStringLiteral("ShareListings"), shareListings_);
 
     // override config in libfm's FmConfig
     settings.setValue(QStringLiteral("BigIconSize"), bigIconSize_);
@@ -398,10 +457,12 @@ bool Settings::saveFile(QString filePath) {
     settings.setValue(QStringLiteral("ShowTabClose"), showTabClose_);
     settings.setValue(QStringLiteral("SwitchToNewTab"), switchToNewTab_);
     settings.setValue(QStringLiteral("ReopenLastTabs"), reopenLastTabs_);
+    settings.setValue(QStringLiteral("SuspendHiddenTabsMinutes"), suspendHiddenTabsMinutes_);
     settings.setValue(QStringLiteral("TabPaths"), tabPaths_);
     settings.setValue(QStringLiteral("SplitViewTabsNum"), splitViewTabsNum_);
     settings.setValue(QStringLiteral("SplitterPos"), splitterPos_);
     settings.setValue(QStringLiteral("SidePaneVisible"), sidePaneVisible_);
+    settings.setValue(QStringLiteral("PreviewPaneVisible"), previewPaneVisible_);
     settings.setValue(QStringLiteral("SidePaneMode"), QString::fromUtf8(sidePaneModeToString(sidePaneMode_)));
     settings.setValue(QStringLiteral("ShowMenuBar"), showMenuBar_);
     settings.setValue(QStringLiteral("SplitView"), splitView_);
@@ -418,7 +479,9 @@ bool Settings::saveFile(QString filePath) {
     settings.setValue(QStringLiteral("searchContentRegexp"), searchContentRegexp_);
     settings.setValue(QStringLiteral("searchRecursive"), searchRecursive_);
     settings.setValue(QStringLiteral("searchhHidden"), searchhHidden_);
+    settings.setValue(QStringLiteral("MaxResults"), searchMaxResults_);
     settings.setValue(QStringLiteral("MaxSearchHistory"), maxSearchHistory_);
+    settings.setValue(QStringLiteral("IndexHome"), indexHome_);
     settings.setValue(QStringLiteral("NamePatterns"), namePatterns_);
     settings.setValue(QStringLiteral("ContentPatterns"), contentPatterns_);
     settings.endGroup();
@@ -447,6 +510,18 @@ void Settings::setMaxSearchHistory(int max) {
     }
 }
 
+void Settings::setIndexHome(bool index) {
+    if (index == indexHome_) {
+        return;
+    }
+    indexHome_ = index;
+    Panel::FilePathList roots;
+    if (index) {
+        roots.push_back(Panel::FilePath::homeDir());
+    }
+    Panel::SearchIndex::globalInstance()->setRoots(roots);
+}
+
 void Settings::addNamePattern(const QString& pattern) {
     if (maxSearchHistory_ == 0 ||
         pattern.isEmpty()
@@ -543,6 +618,9 @@ const char* Settings::sortColumnToString(Panel::FolderModel::ColumnId value) {
         case Panel::FolderModel::ColumnFileGroup:
             ret = "group";
             break;
+        case Panel::FolderModel::ColumnFileFolder:
+            ret = "folder";
+            break;
     }
     return ret;
 }
@@ -652,6 +730,9 @@ Panel::FolderModel::ColumnId FolderSettings::sortColumnFromString(const QString&
     else if (str == QLatin1String("group")) {
         ret = Panel::FolderModel::ColumnFileGroup;
     }
+    else if (str == QLatin1String("folder")) {
+        ret = Panel::FolderModel::ColumnFileFolder;
+    }
     else {
         ret = Panel::FolderModel::ColumnFileName;
     }
@@ -683,23 +764,12 @@ FolderSettings Settings::loadFolderSettings(const Panel::FilePath& path) const {
     Panel::FolderConfig cfg(path);
     bool customized = !cfg.isEmpty();
     Panel::FilePath inheritedPath;
-    if (!customized && !path.isParentOf(path)) {  // WARNING: menu://applications/ is its own parent
-        inheritedPath = path.parent();
-        while (inheritedPath.isValid()) {
+    if (!customized) {
+        inheritedPath = Panel::FolderConfig::inheritedPath(path);
+        if (inheritedPath.isValid()) {
             Panel::GErrorPtr err;
             cfg.close(err);
             cfg.open(inheritedPath);
-            if (!cfg.isEmpty()) {
-                bool recursive;
-                if (cfg.getBoolean("Recursive", &recursive) && recursive) {
-                    break;
-                }
-            }
-            if (inheritedPath.isParentOf(inheritedPath)) {
-                inheritedPath = Panel::FilePath();  // invalidate it
-                break;
-            }
-            inheritedPath = inheritedPath.parent();
         }
     }
     if (!customized && !inheritedPath.isValid()) {
@@ -149,6 +149,13 @@ class Settings : public QObject {
     bool preservePermissions() const { return preservePermissions_; }
     void setPreservePermissions(bool preserve) { preservePermissions_ = preserve; }
 
+    // how copying and moving deal with files already at the destination
+    Panel::FileOperationJob::ConflictRule conflictRule() const { return conflictRule_; }
+    void setConflictRule(Panel::FileOperationJob::ConflictRule rule) {
+        conflictRule_ = rule;
+        Panel::FileOperation::setDefaultConflictRule(rule);
+    }
+
     QString terminal() { return terminal_; }
     void setTerminal(QString terminalCommand);
 
@@ -175,6 +182,11 @@ class Settings : public QObject {
 
     void setReopenLastTabs(bool reopenLastTabs) { reopenLastTabs_ = reopenLastTabs; }
 
+    // Minutes a tab stays hidden before its folder listing is released; 0 = never.
+    int suspendHiddenTabsMinutes() const { return suspendHiddenTabsMinutes_; }
+
+    void setSuspendHiddenTabsMinutes(int minutes) { suspendHiddenTabsMinutes_ = minutes; }
+
     int splitViewTabsNum() const { return splitViewTabsNum_; }
 
     void setSplitViewTabsNum(int n) { splitViewTabsNum_ = n; }
@@ -236,6 +248,10 @@ class Settings : public QObject {
 
     void showSidePane(bool show) { sidePaneVisible_ = show; }
 
+    bool isPreviewPaneVisible() const { return previewPaneVisible_; }
+
+    void showPreviewPane(bool show) { previewPaneVisible_ = show; }
+
     Panel::SidePane::Mode sidePaneMode() const { return sidePaneMode_; }
 
     void setSidePaneMode(Panel::SidePane::Mode sidePaneMode) { sidePaneMode_ = sidePaneMode; }
@@ -386,6 +402,18 @@ class Settings : public QObject {
 
     void setMaxExternalThumbnailFileSize(int size) { Panel::ThumbnailJob::setMaxExternalThumbnailFileSize(size); }
 
+    // in MiB; the least recently used thumbnails on disk are removed above it, 0 for no limit
+    int thumbnailCacheMaxSize() const { return static_cast<int>(Panel::ThumbnailCache::maxSize() >> 20); }
+
+    void setThumbnailCacheMaxSize(int mib) {
+        Panel::ThumbnailCache::setMaxSize(static_cast<std::uint64_t>(std::max(mib, 0)) << 20);
+    }
+
+    // local videos get a frame decoded in-process instead of an external thumbnailer, when built with FFmpeg
+    bool inProcessVideoThumbnails() const { return Panel::VideoFrameExtractor::isEnabled(); }
+
+    void setInProcessVideoThumbnails(bool enabled) { Panel::VideoFrameExtractor::setEnabled(enabled); }
+
     void setThumbnailIconSize(int thumbnailIconSize) { thumbnailIconSize_ = thumbnailIconSize; }
 
     bool siUnit() { return siUnit_; }
@@ -416,10 +444,30 @@ class Settings : public QObject {
 
     void setNoItemTooltip(bool noTooltip) { noItemTooltip_ = noTooltip; }
 
+    // whether the detailed view shows the sizes of folders that were measured before
+    bool showFolderSizes() const { return showFolderSizes_; }
+
+    void setShowFolderSizes(bool value) { showFolderSizes_ = value; }
+
     bool scrollPerPixel() const { return scrollPerPixel_; }
 
     void setScrollPerPixel(bool perPixel) { scrollPerPixel_ = perPixel; }
 
+    // big or slow folders are shown from a snapshot of their last listing while listed again
+    bool listingSnapshots() const { return Panel::ListingSnapshot::isEnabled(); }
+
+    void setListingSnapshots(bool enabled) { Panel::ListingSnapshot::setEnabled(enabled); }
+
+    // emblems, custom icons and trust of local files are kept by libfm-qt instead of gvfs
+    bool nativeMetadata() const { return Panel::MetadataStore::isEnabled(); }
+
+    void setNativeMetadata(bool enabled) { Panel::MetadataStore::setEnabled(enabled); }
+
+    // the folders listed here are lent to the file dialogs of other applications
+    bool shareListings() const { return shareListings_; }
+
+    void setShareListings(bool enabled) { shareListings_ = enabled; }
+
     bool onlyUserTemplates() const { return onlyUserTemplates_; }
 
     void setOnlyUserTemplates(bool value) {
@@ -472,12 +520,22 @@ class Settings : public QObject {
 
     void setSearchhHidden(bool hidden) { searchhHidden_ = hidden; }
 
+    // 0 for searches that are not cut short
+    int searchMaxResults() const { return searchMaxResults_; }
+
+    void setSearchMaxResults(int max) { searchMaxResults_ = max; }
+
     int maxSearchHistory() const { return maxSearchHistory_; }
 
     void setMaxSearchHistory(int max);
 
     void clearSearchHistory();
 
+    bool indexHome() const { return indexHome_; }
+
+    // Indexes the names of the files in the home folder, for searches inside it, or stops doing so.
+    void setIndexHome(bool index);
+
     QStringList namePatterns() const { return namePatterns_; }
 
     void addNamePattern(const QString& pattern);
@@ -533,12 +591,14 @@ class Settings : public QObject {
     bool singleWindowMode_;
     OpenDirTargetType bookmarkOpenMethod_;
     bool preservePermissions_;
+    Panel::FileOperationJob::ConflictRule conflictRule_;
     QString terminal_;
 
     bool alwaysShowTabs_;
     bool showTabClose_;
     bool switchToNewTab_;
     bool reopenLastTabs_;
+    int suspendHiddenTabsMinutes_;
     int splitViewTabsNum_;  // number of tabs in the first view frame when reopening last tabs
     QStringList tabPaths_;
     bool rememberWindowSize_;
@@ -549,6 +609,7 @@ class Settings : public QObject {
     bool lastWindowMaximized_;
     int splitterPos_;
     bool sidePaneVisible_;
+    bool previewPaneVisible_;
     Panel::SidePane::Mode sidePaneMode_;
     bool showMenuBar_;
     bool splitView_;
@@ -582,7 +643,9 @@ class Settings : public QObject {
     bool showFullNames_;
     bool shadowHidden_;
     bool noItemTooltip_;
+    bool showFolderSizes_;
     bool scrollPerPixel_;
+    bool shareListings_;
 
     QSet<QString> hiddenPlaces_;
 
@@ -608,7 +671,9 @@ class Settings : public QObject {
     bool searchContentRegexp_;
     bool searchRecursive_;
     bool searchhHidden_;
+    int searchMaxResults_;
     int maxSearchHistory_;
+    bool indexHome_;
     QStringList namePatterns_;
     QStringList contentPatterns_;
 
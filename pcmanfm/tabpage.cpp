@@ -11,15 +11,19 @@
 #include <QCursor>
 #include <QDebug>
 #include <QDir>
+#include <QHideEvent>
 #include <QLabel>
 #include <QMessageBox>
 #include <QScrollBar>
+#include <QShowEvent>
 #include <QStandardPaths>
 #include <QTimer>
 #include <QToolButton>
 #include <QToolTip>
+#include <chrono>
 
 #include "application.h"
+#include "diskusageview.h"
 #include "launcher.h"
 #include "settings.h"
 
@@ -29,6 +33,11 @@ namespace {
 // Constants for timer delays to avoid magic numbers
 constexpr int kUiUpdateDelay = 10;
 constexpr int kSelectionDelay = 200;
+// in folders with this many files, the filter waits for a pause in typing
+constexpr int kLargeFolderFiles = 20000;
+constexpr int kFilterDelay = 150;
+// once a folder is listed, the folder before it in the history is listed ahead after this long
+constexpr int kHistoryPrefetchDelay = 1000;
 
 // Helper to get settings without repetitive casting
 PCManFM::Settings& appSettings() {
@@ -86,12 +95,26 @@ bool ProxyFilter::filterAcceptsRow(const Panel::ProxyFolderModel* model,
         return true;
     }
 
-    QString baseName = fullName_ && !info->name().empty() ? QString::fromStdString(info->name()) : info->displayName();
+    auto& foldedName = foldedNames_[info];
+    if (foldedName.isNull()) {
+        QString baseName =
+            fullName_ && !info->name().empty() ? QString::fromStdString(info->name()) : info->displayName();
+        foldedName = baseName.toCaseFolded();
+    }
+    return matcher_.indexIn(foldedName) != -1;
+}
 
-    if (!baseName.contains(filterStr_, Qt::CaseInsensitive)) {
-        return false;
+void ProxyFilter::setFilterStr(QString str) {
+    filterStr_ = str;
+    matcher_.setPattern(str.toCaseFolded());
+    if (str.isEmpty()) {
+        foldedNames_.clear();
     }
-    return true;
+}
+
+void ProxyFilter::filterFullName(bool fullName) {
+    fullName_ = fullName;
+    foldedNames_.clear();
 }
 
 //==================================================
@@ -145,14 +168,22 @@ FilterBar::FilterBar(QWidget* parent) : QWidget(parent) {
 TabPage::TabPage(QWidget* parent)
     : QWidget(parent),
       folderView_{nullptr},
+      diskUsageView_{nullptr},
       folderModel_{nullptr},
       proxyModel_{nullptr},
       proxyFilter_{nullptr},
       verticalLayout{nullptr},
       overrideCursor_(false),
       selectionTimer_(nullptr),
+      filterTimer_(nullptr),
+      suspendTimer_(nullptr),
       filterBar_(nullptr),
-      changingDir_(false) {
+      changingDir_(false),
+      flatView_(false),
+      diskUsage_(false),
+      suspended_(false),
+      searchResults_(0),
+      selSizeUpdatePending_(false) {
     Settings& settings = appSettings();
 
     // create proxy folder model to do item filtering
@@ -214,6 +245,14 @@ TabPage::TabPage(QWidget* parent)
         transientFilterBar(true);
     }
     connect(filterBar_, &FilterBar::textChanged, this, &TabPage::onFilterStringChanged);
+
+    filterTimer_ = new QTimer(this);
+    filterTimer_->setSingleShot(true);
+    connect(filterTimer_, &QTimer::timeout, this, &TabPage::applyFilter);
+
+    suspendTimer_ = new QTimer(this);
+    suspendTimer_->setSingleShot(true);
+    connect(suspendTimer_, &QTimer::timeout, this, &TabPage::suspend);
 }
 
 TabPage::~TabPage() {
@@ -319,8 +358,9 @@ void TabPage::onFilterStringChanged(QString str) {
 
         // Because the filter string may be typed inside the view, we should wait
         // for Qt to select an item before deciding about the selection in
-        // applyFilter() Therefore, we use a single-shot timer to apply the filter
-        QTimer::singleShot(0, folderView_, [this] { applyFilter(); });
+        // applyFilter() Therefore, we use a single-shot timer to apply the filter.
+        // In a large folder, it also waits for a pause in typing.
+        filterTimer_->start(folderModel_ && folderModel_->rowCount() >= kLargeFolderFiles ? kFilterDelay : 0);
 
         // show/hide the transient filter-bar appropriately
         if (transientFilterBar) {
@@ -338,6 +378,17 @@ void TabPage::onFilterStringChanged(QString str) {
     }
 }
 
+void TabPage::releaseModel() {
+    if (folderModel_) {
+        disconnect(folderModel_, &Panel::FolderModel::fileSizeChanged, this, &TabPage::onFileSizeChanged);
+        disconnect(folderModel_, &Panel::FolderModel::filesAdded, this, &TabPage::onFilesAdded);
+        proxyModel_->setSourceModel(nullptr);
+        proxyModel_->setHighlights({});
+        folderModel_->unref();  // unref the cached model
+        folderModel_ = nullptr;
+    }
+}
+
 void TabPage::freeFolder() {
     if (folder_) {
         if (folderSettings_.isCustomized()) {
@@ -345,12 +396,17 @@ void TabPage::freeFolder() {
             appSettings().saveFolderSettings(folder_->path(), folderSettings_);
         }
         disconnect(folder_.get(), nullptr, this, nullptr);  // disconnect from all signals
+        folder_->removeViewer(this);
+        if (diskUsageView_) {
+            diskUsageView_->setFolder(nullptr);
+        }
         folder_ = nullptr;
         filesToTrust_.clear();
     }
 }
 
 void TabPage::onFolderStartLoading() {
+    searchResults_ = 0;
     if (folderModel_) {
         disconnect(folderModel_, &Panel::FolderModel::filesAdded, this, &TabPage::onFilesAdded);
     }
@@ -361,6 +417,9 @@ void TabPage::onFolderStartLoading() {
 }
 
 void TabPage::onUiUpdated() {
+    // the proxy model shows the rows it held back while the folder was listed only now
+    updateNormalStatus();
+
     bool scrolled = false;
     // if there are files to select, select them
     if (!filesToSelect_.empty()) {
@@ -425,16 +484,23 @@ void TabPage::onUiUpdated() {
 }
 
 void TabPage::onFileSizeChanged(const QModelIndex& index) {
-    if (folderView_->hasSelection()) {
-        QModelIndexList indexes = folderView_->selectionModel()->selectedIndexes();
-        if (indexes.contains(proxyModel_->mapFromSource(index))) {
+    if (selSizeUpdatePending_ || !folderView_->hasSelection()) {
+        return;
+    }
+    const QModelIndex proxyIndex = proxyModel_->mapFromSource(index);
+    if (proxyIndex.isValid() && folderView_->selectedRowRanges().contains(proxyIndex.row())) {
+        // the model announces the sizes before the rows change, and a batch of them should
+        // show once, so the selection is counted again after the batch
+        selSizeUpdatePending_ = true;
+        QTimer::singleShot(0, this, [this] {
+            selSizeUpdatePending_ = false;
             onSelChanged();
-        }
+        });
     }
 }
 
 // slot
-void TabPage::onFilesAdded(Panel::FileInfoList files) {
+void TabPage::onFilesAdded(const Panel::FileInfoList& files) {
     if (appSettings().selectNewFiles()) {
         if (!selectionTimer_) {
             selectionTimer_ = new QTimer(this);
@@ -515,6 +581,22 @@ void TabPage::onFolderFinishLoading() {
     // After finishing loading the folder, the model is updated, but Qt delays the
     // UI update for performance reasons. We use a singleShot to wait for it.
     QTimer::singleShot(kUiUpdateDelay, this, &TabPage::onUiUpdated);
+
+    if (history_.canBackward()) {
+        QTimer::singleShot(kHistoryPrefetchDelay, this, &TabPage::prefetchHistory);
+    }
+}
+
+void TabPage::prefetchHistory() {
+    // not while another folder is being listed, nor for a tab nobody looks at
+    if (!folder_ || !folder_->isLoaded() || !isVisible() || !history_.canBackward()) {
+        return;
+    }
+    const Panel::FilePath path = history_.at(history_.currentIndex() - 1).path();
+    if (path.hasUriScheme("search")) {  // that would search again
+        return;
+    }
+    CachedFolderModel::prefetchNext(path, proxyModel_->showThumbnails() ? proxyModel_->thumbnailSize() : 0);
 }
 
 void TabPage::onFolderError(const Panel::GErrorPtr& err,
@@ -582,11 +664,30 @@ void TabPage::onFolderUnmount() {
 }
 
 void TabPage::onFolderContentChanged() {
-    /* update status text */
-    statusText_[StatusTextNormal] = formatStatusText();
+    updateNormalStatus();
+}
+
+// The counts are those of the model rows, so the text costs the same however large the folder;
+// it is only sent on when it changed, which most batches of changed files leave it as it was.
+void TabPage::updateNormalStatus() {
+    QString text = formatStatusText();
+    if (text == statusText_[StatusTextNormal]) {
+        return;
+    }
+    statusText_[StatusTextNormal] = std::move(text);
     Q_EMIT statusChanged(StatusTextNormal, statusText_[StatusTextNormal]);
 }
 
+void TabPage::onSearchResultsFound(const Panel::FileInfoList& files) {
+    if (folder_->isLoaded()) {  // the final count is shown by onFolderFinishLoading()
+        return;
+    }
+    searchResults_ += static_cast<int>(files.size());
+    QString& text = statusText_[StatusTextNormal];
+    text = tr("Searching... %n file(s) found", "", searchResults_);
+    Q_EMIT statusChanged(StatusTextNormal, text);
+}
+
 QString TabPage::pathName() {
     auto filePath = path();
     if (!filePath) {
@@ -596,14 +697,116 @@ QString TabPage::pathName() {
     return QString::fromUtf8(dispPath.get());
 }
 
+void TabPage::deferChdir(Panel::FilePath newPath) {
+    deferredPath_ = std::move(newPath);
+    title_ = QString::fromUtf8(deferredPath_.baseName().get());
+    localizeTitle(deferredPath_);
+    Q_EMIT titleChanged();
+}
+
+void TabPage::loadDeferredPath() {
+    if (deferredPath_) {
+        // a suspended tab is already at the current item of its history
+        const bool addHistory = !suspended_;
+        suspended_ = false;
+        chdir(deferredPath_, addHistory);
+    }
+}
+
+void TabPage::suspend() {
+    if (!folder_ || suspended_ || changingDir_ || isVisible() || !folder_->isLoaded() ||
+        appSettings().suspendHiddenTabsMinutes() <= 0) {
+        return;
+    }
+    const Panel::FilePath current = folder_->path();
+    // search results and filtered listings cannot be rebuilt from the path alone
+    if (current.hasUriScheme("search") || !getFilterStr().isEmpty()) {
+        return;
+    }
+
+    history_.currentItem().setScrollPos(folderView_->childView()->verticalScrollBar()->value());
+    filesToSelect_ = folderView_->selectedFilePaths();
+    lastFolderPath_ = Panel::FilePath();
+    statusText_[StatusTextSelectedFiles] = QString();
+
+    releaseModel();
+    freeFolder();
+    deferredPath_ = current;
+    suspended_ = true;
+}
+
+void TabPage::showEvent(QShowEvent* event) {
+    suspendTimer_->stop();
+    if (suspended_) {
+        loadDeferredPath();
+    }
+    else if (folder_) {
+        folder_->setShownBy(this, true);
+    }
+    QWidget::showEvent(event);
+}
+
+void TabPage::hideEvent(QHideEvent* event) {
+    QWidget::hideEvent(event);
+    // the folder only handles the changes of a background tab or a minimized window in batches
+    if (folder_) {
+        folder_->setShownBy(this, false);
+    }
+    // a minimized window hides its tabs spontaneously; only switching away suspends them
+    const int minutes = appSettings().suspendHiddenTabsMinutes();
+    if (!event->spontaneous() && minutes > 0 && folder_) {
+        suspendTimer_->start(std::chrono::minutes(minutes));
+    }
+}
+
+void TabPage::setFlatView(bool flat) {
+    if (flat == flatView_) {
+        return;
+    }
+    flatView_ = flat;
+    if (folder_) {
+        chdir(folder_->path(), false);  // the same folder, listed again the other way
+    }
+}
+
+void TabPage::setDiskUsage(bool show) {
+    if (show == diskUsage_) {
+        return;
+    }
+    diskUsage_ = show;
+    if (show && !diskUsageView_) {
+        diskUsageView_ = new DiskUsageView(this);
+        verticalLayout->insertWidget(verticalLayout->indexOf(folderView_) + 1, diskUsageView_);
+        connect(diskUsageView_, &DiskUsageView::folderActivated, this,
+                [this](const Panel::FilePath& path) { chdir(path); });
+    }
+    if (diskUsageView_) {
+        diskUsageView_->setFolder(show ? folder_ : nullptr);
+        diskUsageView_->setVisible(show);
+    }
+    folderView_->setVisible(!show);
+    if (show) {
+        diskUsageView_->setFocus();
+    }
+    else {
+        folderView_->childView()->setFocus();
+    }
+}
+
 void TabPage::chdir(Panel::FilePath newPath, bool addHistory) {
+    deferredPath_ = Panel::FilePath();
     if (filterBar_) {
         filterBar_->clear();
     }
     if (folder_) {
         // we're already in the specified dir
         if (newPath == folder_->path()) {
-            return;
+            if (folder_->isRecursive() == flatView_) {
+                return;
+            }
+        }
+        else {
+            flatView_ = false;
         }
 
         if (newPath.hasUriScheme("admin")) {
@@ -624,15 +827,7 @@ void TabPage::chdir(Panel::FilePath newPath, bool addHistory) {
             item.setScrollPos(folderView_->childView()->verticalScrollBar()->value());
         }
 
-        // free the previous model
-        if (folderModel_) {
-            disconnect(folderModel_, &Panel::FolderModel::fileSizeChanged, this, &TabPage::onFileSizeChanged);
-            disconnect(folderModel_, &Panel::FolderModel::filesAdded, this, &TabPage::onFilesAdded);
-            proxyModel_->setSourceModel(nullptr);
-            folderModel_->unref();  // unref the cached model
-            folderModel_ = nullptr;
-        }
-
+        releaseModel();
         freeFolder();
     }
 
@@ -645,7 +840,8 @@ void TabPage::chdir(Panel::FilePath newPath, bool addHistory) {
     localizeTitle(newPath);
     Q_EMIT titleChanged();
 
-    folder_ = Panel::Folder::fromPath(newPath);
+    folder_ = flatView_ ? Panel::Folder::fromPathRecursive(newPath) : Panel::Folder::fromPath(newPath);
+    folder_->setShownBy(this, isVisible());
     if (addHistory) {
         // add current path to browse history
         history_.add(path());
@@ -657,6 +853,13 @@ void TabPage::chdir(Panel::FilePath newPath, bool addHistory) {
     connect(folder_.get(), &Panel::Folder::removed, this, &TabPage::onFolderRemoved);
     connect(folder_.get(), &Panel::Folder::unmount, this, &TabPage::onFolderUnmount);
     connect(folder_.get(), &Panel::Folder::contentChanged, this, &TabPage::onFolderContentChanged);
+    if (diskUsage_) {
+        diskUsageView_->setFolder(folder_);
+    }
+    if (newPath.hasUriScheme("search")) {
+        // results stream in while the search runs, so their count is shown as it grows
+        connect(folder_.get(), &Panel::Folder::filesAdded, this, &TabPage::onSearchResultsFound);
+    }
 
     Settings& settings = appSettings();
     folderModel_ = CachedFolderModel::modelFromFolder(folder_);
@@ -664,6 +867,7 @@ void TabPage::chdir(Panel::FilePath newPath, bool addHistory) {
     bool forceShortNames = !settings.showFullNames() || newPath.hasUriScheme("menu") || newPath.hasUriScheme("trash");
 
     folderModel_->setShowFullName(!forceShortNames);
+    folderModel_->setShowFolderSizes(settings.showFolderSizes());
     proxyFilter_->filterFullName(!forceShortNames);
 
     folderSettings_ = settings.loadFolderSettings(path());
@@ -717,40 +921,50 @@ void TabPage::reload() {
 }
 
 // when the current selection in the folder view is changed
+Panel::FileInfoList TabPage::filesAroundCurrent(int count) {
+    Panel::FileInfoList files;
+    const QModelIndex current = folderView_->childView()->currentIndex();
+    if (!current.isValid()) {
+        return files;
+    }
+    const int rows = proxyModel_->rowCount();
+    for (int distance = 1; distance <= count; ++distance) {
+        for (int row : {current.row() + distance, current.row() - distance}) {
+            if (row >= 0 && row < rows) {
+                if (auto info = proxyModel_->fileInfoFromIndex(proxyModel_->index(row, 0))) {
+                    files.push_back(std::move(info));
+                }
+            }
+        }
+    }
+    return files;
+}
+
 void TabPage::onSelChanged() {
     QString msg;
 
+    Q_EMIT selectionChanged();
+
     if (!folderView_->hasSelection()) {
         statusText_[StatusTextSelectedFiles] = QString();
         Q_EMIT statusChanged(StatusTextSelectedFiles, QString());
         return;
     }
 
-    auto files = folderView_->selectedFiles();
-    int numSel = files.size();
-
-    if (numSel == 1) {
+    // the counts follow the selection, so that adjusting a large one does not go over all of it
+    const auto& stats = folderView_->selectionStats();
+    if (stats.count == 1) {
         /* only one file is selected (delegated to helper function) */
-        msg = formatSingleFileStatus(files.front(), appSettings());
+        auto files = folderView_->selectedFiles();
+        if (!files.empty()) {
+            msg = formatSingleFileStatus(files.front(), appSettings());
+        }
     }
     else {
-        goffset sum;
-        msg = tr("%n item(s) selected", nullptr, numSel);
-
-        // show total size only when the number of selected entries is reasonable
-        if (numSel < 1000) {
-            sum = 0;
-            bool dirFound = false;
-            for (auto& fi : files) {
-                if (fi->isDir()) {
-                    dirFound = true;
-                    break;
-                }
-                sum += fi->size();
-            }
-            if (!dirFound) {
-                msg += QStringLiteral(" (%1)").arg(Panel::formatFileSize(sum, fm_config->si_unit));
-            }
+        msg = tr("%n item(s) selected", nullptr, stats.count);
+        // the total size is only known when no folder is selected
+        if (stats.dirs == 0) {
+            msg += QStringLiteral(" (%1)").arg(Panel::formatFileSize(stats.fileSize, fm_config->si_unit));
         }
     }
 
@@ -801,6 +1015,9 @@ void TabPage::up() {
 
 void TabPage::updateFromSettings(Settings& settings) {
     folderView_->updateFromSettings(settings);
+    if (folderModel_) {
+        folderModel_->setShowFolderSizes(settings.showFolderSizes());
+    }
 
     auto* viewport = folderView_->childView()->viewport();
     viewport->removeEventFilter(this);
@@ -904,7 +1121,15 @@ void TabPage::applyFilter() {
 
     int prevSelSize = folderView_->selectionModel()->selectedIndexes().size();
 
-    proxyModel_->updateFilters();
+    // a filter string containing the previous one can only hide more files
+    const QString filterStr = proxyFilter_->getFilterStr();
+    if (filterStr.toCaseFolded().contains(appliedFilterStr_.toCaseFolded())) {
+        proxyModel_->narrowFilters();
+    }
+    else {
+        proxyModel_->updateFilters();
+    }
+    appliedFilterStr_ = filterStr;
 
     QModelIndex firstIndx = proxyModel_->index(0, 0);
 
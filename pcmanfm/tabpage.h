@@ -23,6 +23,8 @@
 #include <QWidget>
 #include <QVBoxLayout>
 #include <QLineEdit>
+#include <QStringMatcher>
+#include <unordered_map>
 #include "panel/panel.h"
 #include "view.h"
 #include "settings.h"
@@ -30,6 +32,7 @@
 
 namespace PCManFM {
 
+class DiskUsageView;
 class Launcher;
 
 class ProxyFilter : public Panel::ProxyFolderModelFilter {
@@ -39,12 +42,15 @@ class ProxyFilter : public Panel::ProxyFolderModelFilter {
                           const std::shared_ptr<const Panel::FileInfo>& info) const;
     virtual ~ProxyFilter() {}
     QString getFilterStr() { return filterStr_; }
-    void setFilterStr(QString str) { filterStr_ = str; }
-    void filterFullName(bool fullName) { fullName_ = fullName; }
+    void setFilterStr(QString str);
+    void filterFullName(bool fullName);
 
    private:
     bool fullName_;
     QString filterStr_;
+    QStringMatcher matcher_;  // of the case-folded filter string
+    // the case-folded names of the files, kept while filtering rather than folded on every key
+    mutable std::unordered_map<std::shared_ptr<const Panel::FileInfo>, QString> foldedNames_;
 };
 
 //==================================================
@@ -99,6 +105,17 @@ class TabPage : public QWidget {
 
     void chdir(Panel::FilePath newPath, bool addHistory = true);
 
+    // Shows |newPath| in the title but lists it only with loadDeferredPath(), when the tab is
+    // first activated.
+    void deferChdir(Panel::FilePath newPath);
+    // Changes to the folder left by deferChdir(), if any.
+    void loadDeferredPath();
+    // Releases the folder and its model of a hidden tab, keeping only its path, history,
+    // scroll position and selection; showing the tab lists the folder again.
+    void suspend();
+
+    bool isSuspended() const { return suspended_; }
+
     Panel::FolderView::ViewMode viewMode() { return folderSettings_.viewMode(); }
 
     void setViewMode(Panel::FolderView::ViewMode mode);
@@ -123,11 +140,21 @@ class TabPage : public QWidget {
 
     void setShowHidden(bool showHidden);
 
+    // Whether the files of all subfolders are listed along with those of the folder (see
+    // Folder::fromPathRecursive()); changing to another folder turns it off.
+    bool flatView() const { return flatView_; }
+    void setFlatView(bool flat);
+
+    // Whether the folder is drawn as a treemap of the sizes of what it holds rather than
+    // listed; unlike the flat view, it stays on while going into other folders.
+    bool diskUsage() const { return diskUsage_; }
+    void setDiskUsage(bool show);
+
     void setShowThumbnails(bool showThumbnails);
 
     void saveFolderSorting();
 
-    Panel::FilePath path() { return folder_ ? folder_->path() : Panel::FilePath(); }
+    Panel::FilePath path() { return folder_ ? folder_->path() : deferredPath_; }
 
     QString pathName();
 
@@ -143,6 +170,10 @@ class TabPage : public QWidget {
 
     Panel::FilePathList selectedFilePaths() { return folderView_->selectedFilePaths(); }
 
+    // Up to |count| files on either side of the current one, in the order of the view, the
+    // nearest first.
+    Panel::FileInfoList filesAroundCurrent(int count);
+
     void selectAll();
 
     void deselectAll();
@@ -182,6 +213,12 @@ class TabPage : public QWidget {
         return QString();
     }
 
+    // Highlights files of the current folder by name, as ProxyFolderModel::setHighlights()
+    // does; cleared when the folder changes.
+    void setHighlights(std::unordered_map<std::string, QBrush> highlights) {
+        proxyModel_->setHighlights(std::move(highlights));
+    }
+
     void setFilterStr(QString str) {
         if (proxyFilter_) {
             proxyFilter_->setFilterStr(str);
@@ -222,25 +259,31 @@ class TabPage : public QWidget {
     void backwardRequested();
     void folderUnmounted();
     void backspacePressed();
+    void selectionChanged();
 
    protected:
     virtual bool eventFilter(QObject* watched, QEvent* event);
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
 
    protected Q_SLOTS:
     void onSelChanged();
     void onUiUpdated();
     void onFileSizeChanged(const QModelIndex& index);
-    void onFilesAdded(const Panel::FileInfoList files);
+    void onFilesAdded(const Panel::FileInfoList& files);
     void onFilterStringChanged(QString str);
     void onLosingFilterBarFocus();
 
    private:
+    void releaseModel();
     void freeFolder();
     QString formatStatusText();
     void localizeTitle(const Panel::FilePath& path);
 
     void onFolderStartLoading();
     void onFolderFinishLoading();
+    // lists the folder going back would open ahead, as the user may well go there
+    void prefetchHistory();
 
     // FIXME: this API design is bad and might be removed later
     void onFolderError(const Panel::GErrorPtr& err,
@@ -251,9 +294,12 @@ class TabPage : public QWidget {
     void onFolderRemoved();
     void onFolderUnmount();
     void onFolderContentChanged();
+    void updateNormalStatus();
+    void onSearchResultsFound(const Panel::FileInfoList& files);
 
    private:
     View* folderView_;
+    DiskUsageView* diskUsageView_;  // created when the disk usage is first shown
     Panel::CachedFolderModel* folderModel_;
     ImageMagickProxyFolderModel* proxyModel_;
     ProxyFilter* proxyFilter_;
@@ -263,13 +309,22 @@ class TabPage : public QWidget {
     QString statusText_[StatusTextNum];
     Panel::BrowseHistory history_;    // browsing history
     Panel::FilePath lastFolderPath_;  // last browsed folder
+    Panel::FilePath deferredPath_;    // the folder to list once the tab is activated
     bool overrideCursor_;
     FolderSettings folderSettings_;
     QTimer* selectionTimer_;
+    QTimer* filterTimer_;
+    QTimer* suspendTimer_;  // suspends the tab once it stayed hidden long enough
+    QString appliedFilterStr_;  // the filter string the shown files were filtered with
     FilterBar* filterBar_;
     QStringList filesToTrust_;
     Panel::FilePathList filesToSelect_;  // files to select
     bool changingDir_;                   // chdir is in progress
+    bool flatView_;
+    bool diskUsage_;
+    bool suspended_;                     // the folder was released by suspend()
+    int searchResults_;                  // files found so far by a search that is running
+    bool selSizeUpdatePending_;          // a selected file changed size since the status was shown
 };
 
 }  // namespace PCManFM
@@ -15,18 +15,19 @@
 #include <QFontDatabase>
 #include <QFormLayout>
 #include <QGroupBox>
-#include <QHash>
 #include <QIcon>
 #include <QInputDialog>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMessageBox>
-#include <QPointer>
 #include <QPushButton>
 #include <QCheckBox>
+#include <QComboBox>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QProgressDialog>
+#include <QSaveFile>
 #include <QPlainTextEdit>
 #include <QAbstractItemView>
 #include <QAbstractItemModel>
@@ -38,6 +39,7 @@
 #include <QVBoxLayout>
 #include <QMimeDatabase>
 #include <QProcess>
+#include <QtConcurrent>
 
 #include <string>
 #include <algorithm>
@@ -53,9 +55,12 @@
 #include "settings.h"
 #include "imagemagick_qt.h"
 #include "image_viewer_window.h"
+#include "image_batch_job.h"
 #include "../src/core/fs_ops.h"
 #include "../src/ui/archivejob.h"
 #include "../src/ui/archiveextractjob.h"
+#include "../src/ui/checksumjob.h"
+#include "../src/ui/duplicatesdialog.h"
 #include "../src/ui/hexeditorwindow.h"
 #include "../src/ui/disassemblywindow.h"
 #include "../src/ui/binarydocument.h"
@@ -69,19 +74,6 @@ Settings& appSettings() {
     return static_cast<Application*>(qApp)->settings();
 }
 
-struct ChecksumWindowWidgets {
-    QPointer<QDialog> dialog;
-    QLabel* pathLabel = nullptr;
-    QPlainTextEdit* checksumEdit = nullptr;
-    QGroupBox* errorBox = nullptr;
-    QPlainTextEdit* errorEdit = nullptr;
-};
-
-QHash<QString, ChecksumWindowWidgets>& checksumWindows() {
-    static QHash<QString, ChecksumWindowWidgets> windows;
-    return windows;
-}
-
 QString stripArchiveExtension(const QString& fileName) {
     const QString lower = fileName.toLower();
     static const QStringList suffixes = {
@@ -116,6 +108,18 @@ bool isSupportedArchive(const QString& path, QString* destinationOut) {
     return true;
 }
 
+// archive://<escaped file URI>/ is the root of the read-only archive folder in libfm-qt
+Panel::FilePath archiveBrowsePath(const QString& archivePath) {
+    auto fileUri = Panel::FilePath::fromLocalPath(QFile::encodeName(archivePath).constData()).uri();
+    if (!fileUri) {
+        return Panel::FilePath();
+    }
+    gchar* escaped = g_uri_escape_string(fileUri.get(), nullptr, FALSE);
+    const QByteArray uri = QByteArrayLiteral("archive://") + escaped + '/';
+    g_free(escaped);
+    return Panel::FilePath::fromUri(uri.constData());
+}
+
 bool isDisassemblySupported(const QString& path) {
     PCManFM::BinaryDocument doc;
     QString error;
@@ -429,7 +433,7 @@ void View::onDisassembleWithCapstone() {
     viewer->show();
 }
 
-void View::onCalculateBlake3() {
+void View::onCalculateChecksums() {
     auto* menu = qobject_cast<Panel::FileMenu*>(sender()->parent());
     if (!menu) {
         return;
@@ -444,142 +448,220 @@ void View::onCalculateBlake3() {
     paths.reserve(static_cast<int>(files.size()));
     for (const auto& file : files) {
         if (!file || file->isDir()) {
-            QMessageBox::warning(window(), tr("BLAKE3 checksum"),
-                                 tr("Checksum calculation is only available for files."));
+            QMessageBox::warning(window(), tr("Checksums"), tr("Checksum calculation is only available for files."));
             return;
         }
         if (file->isSymlink()) {
-            QMessageBox::warning(window(), tr("BLAKE3 checksum"),
+            QMessageBox::warning(window(), tr("Checksums"),
                                  tr("Checksum calculation is not available for symbolic links."));
             return;
         }
         if (!file->isNative()) {
-            QMessageBox::warning(window(), tr("BLAKE3 checksum"),
-                                 tr("BLAKE3 sums can only be calculated for local files."));
+            QMessageBox::warning(window(), tr("Checksums"), tr("Checksums can only be calculated for local files."));
             return;
         }
 
         const auto localPath = file->path().localPath();
         if (!localPath) {
-            QMessageBox::warning(window(), tr("BLAKE3 checksum"),
-                                 tr("Could not resolve a local path for the selection."));
+            QMessageBox::warning(window(), tr("Checksums"), tr("Could not resolve a local path for the selection."));
             return;
         }
         paths << QString::fromUtf8(localPath.get());
     }
 
-    auto& windows = checksumWindows();
-
-    auto ensureWindow = [this, &windows](const QString& path) -> ChecksumWindowWidgets& {
-        auto it = windows.find(path);
-        if (it == windows.end()) {
-            it = windows.insert(path, ChecksumWindowWidgets{});
+    auto* job = new ChecksumJob(this);
+    QProgressDialog* dialog = checksumProgressDialog(job, tr("Calculating checksums…"));
+    connect(job, &ChecksumJob::finished, this, [this, dialog, job, paths](bool ok, const QString& error) {
+        const bool canceled = dialog->wasCanceled();
+        dialog->hide();
+        dialog->deleteLater();
+        job->deleteLater();
+        if (canceled) {
+            return;
         }
-        ChecksumWindowWidgets& widgets = it.value();
-
-        if (!widgets.dialog) {
-            auto* dialog = new QDialog();
-            dialog->setAttribute(Qt::WA_DeleteOnClose);
-            dialog->setModal(false);
-            dialog->setWindowModality(Qt::NonModal);
-            dialog->setMinimumWidth(640);
-            dialog->setSizeGripEnabled(true);
-
-            auto* layout = new QVBoxLayout(dialog);
-            widgets.pathLabel = new QLabel(dialog);
-            widgets.pathLabel->setWordWrap(true);
-            layout->addWidget(widgets.pathLabel);
-
-            const QFont monospace = QFontDatabase::systemFont(QFontDatabase::FixedFont);
-
-            auto* checksumBox = new QGroupBox(tr("Checksums (editable)"), dialog);
-            auto* checksumLayout = new QVBoxLayout(checksumBox);
-            widgets.checksumEdit = new QPlainTextEdit(checksumBox);
-            widgets.checksumEdit->setFont(monospace);
-            widgets.checksumEdit->setLineWrapMode(QPlainTextEdit::NoWrap);
-            widgets.checksumEdit->setMinimumHeight(260);
-            widgets.checksumEdit->setReadOnly(false);
-            checksumLayout->addWidget(widgets.checksumEdit);
-            layout->addWidget(checksumBox);
-
-            widgets.errorBox = new QGroupBox(tr("Errors"), dialog);
-            auto* errorsLayout = new QVBoxLayout(widgets.errorBox);
-            widgets.errorEdit = new QPlainTextEdit(widgets.errorBox);
-            widgets.errorEdit->setReadOnly(true);
-            widgets.errorEdit->setLineWrapMode(QPlainTextEdit::NoWrap);
-            widgets.errorEdit->setFont(monospace);
-            errorsLayout->addWidget(widgets.errorEdit);
-            layout->addWidget(widgets.errorBox);
-            widgets.errorBox->setVisible(false);
-
-            auto* buttons = new QDialogButtonBox(QDialogButtonBox::Close, dialog);
-            auto* copyButton = buttons->addButton(tr("Copy"), QDialogButtonBox::ActionRole);
-            QPointer<QDialog> dialogPtr(dialog);
-            QPlainTextEdit* checksumEdit = widgets.checksumEdit;
-            QPlainTextEdit* errorEdit = widgets.errorEdit;
-            QGroupBox* errorBox = widgets.errorBox;
-            connect(copyButton, &QPushButton::clicked, dialog, [dialogPtr, checksumEdit, errorEdit, errorBox] {
-                if (!dialogPtr) {
-                    return;
-                }
-                QString text = checksumEdit ? checksumEdit->toPlainText() : QString();
-                const QString errorsText =
-                    (errorEdit && errorBox && errorBox->isVisible()) ? errorEdit->toPlainText() : QString();
-                if (!errorsText.isEmpty()) {
-                    if (!text.isEmpty()) {
-                        text += QLatin1Char('\n');
-                    }
-                    text += tr("Errors:\n%1").arg(errorsText);
-                }
-                QApplication::clipboard()->setText(text);
-            });
-            connect(buttons, &QDialogButtonBox::rejected, dialog, &QDialog::close);
-            layout->addWidget(buttons);
 
-            connect(dialog, &QObject::destroyed, this, [path] { checksumWindows().remove(path); });
+        // Manifests list the selection relative to the folder it came from, so they can be
+        // saved next to the files and checked from there.
+        const QString baseDir = QFileInfo(paths.first()).absolutePath();
+        auto* results = new QDialog(window());
+        results->setAttribute(Qt::WA_DeleteOnClose);
+        results->setWindowTitle(paths.size() == 1
+                                    ? tr("Checksums of %1").arg(QFileInfo(paths.first()).fileName())
+                                    : tr("Checksums of %n file(s)", nullptr, static_cast<int>(paths.size())));
+        results->setMinimumWidth(720);
+        results->setSizeGripEnabled(true);
+        auto* layout = new QVBoxLayout(results);
+        const QFont monospace = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+
+        for (const auto algorithm : {FileChecksums::Algorithm::Sha256, FileChecksums::Algorithm::Blake3}) {
+            const QString manifestName = QString::fromLatin1(FileChecksums::manifest_file_name(algorithm));
+            auto* box = new QGroupBox(
+                QStringLiteral("%1 (%2)").arg(QString::fromLatin1(FileChecksums::algorithm_name(algorithm)),
+                                              manifestName),
+                results);
+            auto* boxLayout = new QVBoxLayout(box);
+            auto* edit = new QPlainTextEdit(box);
+            edit->setReadOnly(true);
+            edit->setFont(monospace);
+            edit->setLineWrapMode(QPlainTextEdit::NoWrap);
+            edit->setPlainText(QString::fromLocal8Bit(job->manifest(algorithm, baseDir)));
+            boxLayout->addWidget(edit);
+
+            auto* buttons = new QDialogButtonBox(box);
+            auto* copyButton = buttons->addButton(tr("Copy"), QDialogButtonBox::ActionRole);
+            connect(copyButton, &QPushButton::clicked, edit,
+                    [edit] { QApplication::clipboard()->setText(edit->toPlainText()); });
+            auto* saveButton = buttons->addButton(tr("Save %1…").arg(manifestName), QDialogButtonBox::ActionRole);
+            // The dialog outlives the job, so the manifest is rendered again for wherever it is saved.
+            connect(saveButton, &QPushButton::clicked, results,
+                    [this, results, algorithm, baseDir, manifestName, hashed = job->hashResults()] {
+                        const QString target = QFileDialog::getSaveFileName(
+                            results, tr("Save Checksums"), baseDir + QLatin1Char('/') + manifestName);
+                        if (target.isEmpty()) {
+                            return;
+                        }
+                        const QByteArray dir = QFile::encodeName(QFileInfo(target).absolutePath());
+                        const std::string text = FileChecksums::format_manifest(hashed, algorithm, dir.toStdString());
+                        QSaveFile file(target);
+                        if (!file.open(QIODevice::WriteOnly) ||
+                            file.write(text.data(), static_cast<qint64>(text.size())) !=
+                                static_cast<qint64>(text.size()) ||
+                            !file.commit()) {
+                            QMessageBox::warning(results, tr("Save Checksums"),
+                                                 tr("Could not write %1: %2").arg(target, file.errorString()));
+                        }
+                    });
+            boxLayout->addWidget(buttons);
+            layout->addWidget(box);
+        }
 
-            widgets.dialog = dialog;
+        if (!ok) {
+            QStringList failures;
+            for (const auto& result : job->hashResults()) {
+                if (result.error.isSet()) {
+                    failures << QStringLiteral("%1: %2").arg(QString::fromLocal8Bit(result.path.c_str()),
+                                                             QString::fromLocal8Bit(result.error.message.c_str()));
+                }
+            }
+            if (failures.isEmpty()) {
+                failures << error;
+            }
+            auto* errorBox = new QGroupBox(tr("Errors"), results);
+            auto* errorLayout = new QVBoxLayout(errorBox);
+            auto* errorEdit = new QPlainTextEdit(failures.join(QLatin1Char('\n')), errorBox);
+            errorEdit->setReadOnly(true);
+            errorEdit->setFont(monospace);
+            errorEdit->setLineWrapMode(QPlainTextEdit::NoWrap);
+            errorLayout->addWidget(errorEdit);
+            layout->addWidget(errorBox);
         }
 
-        return widgets;
-    };
+        auto* close = new QDialogButtonBox(QDialogButtonBox::Close, results);
+        connect(close, &QDialogButtonBox::rejected, results, &QDialog::close);
+        layout->addWidget(close);
+        results->show();
+    });
 
-    for (const auto& path : paths) {
-        QString hash;
-        QString error;
+    job->startHash(paths);
+    dialog->show();
+}
 
-        const QByteArray nativePath = QFile::encodeName(path);
-        FsOps::Error err;
-        std::string outHash;
-        if (!FsOps::blake3_file(nativePath.constData(), outHash, err)) {
-            error =
-                err.message.empty() ? tr("Failed to compute BLAKE3 checksum.") : QString::fromStdString(err.message);
+void View::startChecksumVerify(const QString& manifestPath, FileChecksums::Algorithm algorithm) {
+    auto* job = new ChecksumJob(this);
+    QProgressDialog* dialog = checksumProgressDialog(job, tr("Verifying checksums…"));
+    connect(job, &ChecksumJob::finished, this, [this, dialog, job, manifestPath](bool ok, const QString& error) {
+        const bool canceled = dialog->wasCanceled();
+        dialog->hide();
+        dialog->deleteLater();
+        job->deleteLater();
+        if (canceled) {
+            return;
         }
-        else {
-            hash = QString::fromLatin1(outHash.c_str());
+        const auto& verified = job->verifyResults();
+        if (verified.empty()) {
+            if (ok) {
+                QMessageBox::information(window(), tr("Verify Checksums"), tr("The checksum file lists no files."));
+            }
+            else {
+                QMessageBox::warning(window(), tr("Verify Checksums"), error);
+            }
+            return;
         }
 
-        ChecksumWindowWidgets& widgets = ensureWindow(path);
-        if (widgets.dialog) {
-            widgets.dialog->setWindowTitle(path);
+        // The same report sha256sum -c and b3sum -c print.
+        QStringList lines;
+        int mismatched = 0;
+        int unreadable = 0;
+        for (const auto& result : verified) {
+            const QString path = QString::fromLocal8Bit(result.path.c_str());
+            switch (result.status) {
+                case FileChecksums::VerifyStatus::Ok:
+                    lines << tr("%1: OK").arg(path);
+                    break;
+                case FileChecksums::VerifyStatus::Mismatch:
+                    ++mismatched;
+                    lines << tr("%1: FAILED").arg(path);
+                    break;
+                case FileChecksums::VerifyStatus::Unreadable:
+                    ++unreadable;
+                    lines << tr("%1: FAILED open or read (%2)")
+                                 .arg(path, QString::fromLocal8Bit(result.error.message.c_str()));
+                    break;
+            }
         }
-        if (widgets.pathLabel) {
-            widgets.pathLabel->setText(tr("Path: %1").arg(path));
+
+        auto* results = new QDialog(window());
+        results->setAttribute(Qt::WA_DeleteOnClose);
+        results->setWindowTitle(tr("Verify %1").arg(QFileInfo(manifestPath).fileName()));
+        results->setMinimumWidth(640);
+        results->setSizeGripEnabled(true);
+        auto* layout = new QVBoxLayout(results);
+        QString summary = tr("%n file(s) match.", nullptr, static_cast<int>(verified.size()) - mismatched - unreadable);
+        if (mismatched > 0) {
+            summary += QLatin1Char(' ') + tr("%n computed checksum(s) did NOT match.", nullptr, mismatched);
         }
-        if (widgets.checksumEdit) {
-            const QString text = hash.isEmpty() ? QString() : QStringLiteral("%1  %2").arg(hash, path);
-            widgets.checksumEdit->setPlainText(text);
+        if (unreadable > 0) {
+            summary += QLatin1Char(' ') + tr("%n listed file(s) could not be read.", nullptr, unreadable);
         }
-        if (widgets.errorBox && widgets.errorEdit) {
-            widgets.errorEdit->setPlainText(error);
-            widgets.errorBox->setVisible(!error.isEmpty());
+        layout->addWidget(new QLabel(summary, results));
+        auto* edit = new QPlainTextEdit(lines.join(QLatin1Char('\n')), results);
+        edit->setReadOnly(true);
+        edit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+        edit->setLineWrapMode(QPlainTextEdit::NoWrap);
+        layout->addWidget(edit);
+        auto* close = new QDialogButtonBox(QDialogButtonBox::Close, results);
+        connect(close, &QDialogButtonBox::rejected, results, &QDialog::close);
+        layout->addWidget(close);
+        results->show();
+    });
+
+    job->startVerify(manifestPath, algorithm);
+    dialog->show();
+}
+
+QProgressDialog* View::checksumProgressDialog(ChecksumJob* job, const QString& label) {
+    auto* dialog = new QProgressDialog(label, tr("Cancel"), 0, 0, window());
+    dialog->setWindowModality(Qt::WindowModal);
+    dialog->setAutoClose(false);
+    dialog->setAutoReset(false);
+    dialog->setMinimumDuration(0);
+    dialog->setValue(0);
+
+    connect(dialog, &QProgressDialog::canceled, job, &ChecksumJob::cancel);
+    connect(job, &ChecksumJob::progress, dialog, [dialog](quint64 done, quint64 total, const QString& current) {
+        // Scaled to KiB so multi-gigabyte selections still fit the int range.
+        const quint64 totalKiB = total / 1024;
+        if (totalKiB > 0 && totalKiB <= static_cast<quint64>(std::numeric_limits<int>::max())) {
+            if (dialog->maximum() != static_cast<int>(totalKiB)) {
+                dialog->setMaximum(static_cast<int>(totalKiB));
+            }
+            dialog->setValue(static_cast<int>(std::min<quint64>(done / 1024, totalKiB)));
         }
-        if (widgets.dialog) {
-            widgets.dialog->show();
-            widgets.dialog->raise();
-            widgets.dialog->activateWindow();
+        if (!current.isEmpty()) {
+            dialog->setLabelText(QFileInfo(current).fileName());
         }
-    }
+    });
+    return dialog;
 }
 
 void View::onSearch() {
@@ -599,17 +681,64 @@ void View::startArchiveCompression(const QStringList& paths) {
     }
     QString suggested = baseDir + QLatin1Char('/') + defaultStem + QStringLiteral(".tar.zst");
 
-    const QString dest = QFileDialog::getSaveFileName(window(), tr("Save Archive"), suggested,
-                                                      tr("tar.zst archive (*.tar.zst);;Tar archive (*.tar)"));
+    // The zstd preset rides along as the chosen file type so saving stays a single dialog.
+    const QString fastFilter = tr("tar.zst archive, fast (*.tar.zst)");
+    const QString balancedFilter = tr("tar.zst archive (*.tar.zst)");
+    const QString maxFilter = tr("tar.zst archive, smallest (*.tar.zst)");
+    const QString zipFilter = tr("Zip archive (*.zip)");
+    QString selectedFilter = balancedFilter;
+    const QString dest = QFileDialog::getSaveFileName(
+        window(), tr("Save Archive"), suggested,
+        QStringList{balancedFilter, fastFilter, maxFilter, zipFilter, tr("Tar archive (*.tar)")}.join(
+            QStringLiteral(";;")),
+        &selectedFilter, QFileDialog::DontConfirmOverwrite);
     if (dest.isEmpty()) {
         return;
     }
 
+    ArchiveJob::Preset preset = ArchiveJob::Preset::Balanced;
+    if (selectedFilter == fastFilter) {
+        preset = ArchiveJob::Preset::Fast;
+    }
+    else if (selectedFilter == maxFilter) {
+        preset = ArchiveJob::Preset::Max;
+    }
+
+    // ArchiveJob picks the format by the name: a .zip typed under any filter stays a zip
     QString outputPath = dest;
-    if (!outputPath.endsWith(QStringLiteral(".tar.zst")) && !outputPath.endsWith(QStringLiteral(".tar"))) {
+    const bool zip = outputPath.endsWith(QStringLiteral(".zip"), Qt::CaseInsensitive);
+    if (!zip && selectedFilter == zipFilter) {
+        if (outputPath.endsWith(QStringLiteral(".tar.zst"))) {
+            outputPath.chop(8);  // the suggested name
+        }
+        outputPath += QStringLiteral(".zip");
+    }
+    else if (!zip && !outputPath.endsWith(QStringLiteral(".tar.zst")) && !outputPath.endsWith(QStringLiteral(".tar"))) {
         outputPath += QStringLiteral(".tar.zst");
     }
 
+    // An existing tar.zst can take just the changes instead of being written again.
+    ArchiveJob::Mode mode = ArchiveJob::Mode::Create;
+    if (QFileInfo::exists(outputPath)) {
+        QMessageBox box(QMessageBox::Question, tr("Save Archive"),
+                        tr("%1 already exists.").arg(QFileInfo(outputPath).fileName()), QMessageBox::Cancel,
+                        window());
+        QPushButton* update = nullptr;
+        if (outputPath.endsWith(QStringLiteral(".tar.zst"))) {
+            box.setInformativeText(tr("Update adds the files that changed since it was written."));
+            update = box.addButton(tr("Update"), QMessageBox::AcceptRole);
+        }
+        QPushButton* replace = box.addButton(tr("Replace"), QMessageBox::DestructiveRole);
+        box.setDefaultButton(update ? update : replace);
+        box.exec();
+        if (update && box.clickedButton() == update) {
+            mode = ArchiveJob::Mode::Update;
+        }
+        else if (box.clickedButton() != replace) {
+            return;
+        }
+    }
+
     auto* job = new ArchiveJob(this);
     auto* dialog = new QProgressDialog(tr("Compressing files…"), tr("Cancel"), 0, 0, window());
     dialog->setWindowModality(Qt::WindowModal);
@@ -644,10 +773,72 @@ void View::startArchiveCompression(const QStringList& paths) {
         }
     });
 
-    job->start(paths, outputPath);
+    job->start(paths, outputPath, preset, mode);
     dialog->show();
 }
 
+void View::startImageBatch(const QStringList& paths) {
+    QDialog dialog(window());
+    dialog.setWindowTitle(tr("Convert Images"));
+    auto* layout = new QFormLayout(&dialog);
+    auto* formatBox = new QComboBox(&dialog);
+    formatBox->setEditable(true);
+    formatBox->addItems({QStringLiteral("png"), QStringLiteral("jpg"), QStringLiteral("webp"), QStringLiteral("avif"),
+                         QStringLiteral("tiff")});
+    layout->addRow(tr("Output format:"), formatBox);
+    auto* sizeBox = new QSpinBox(&dialog);
+    sizeBox->setRange(0, 65535);
+    sizeBox->setSuffix(tr(" px"));
+    sizeBox->setSpecialValueText(tr("Keep size"));
+    layout->addRow(tr("Longest side at most:"), sizeBox);
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addRow(buttons);
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+
+    ImageMagickConversion conversion;
+    conversion.format = formatBox->currentText().trimmed().toLatin1();
+    conversion.maxSize = sizeBox->value();
+    if (conversion.format.isEmpty()) {
+        return;
+    }
+
+    const QString outputDir = QFileDialog::getExistingDirectory(window(), tr("Save Converted Images To"),
+                                                                QFileInfo(paths.first()).absolutePath());
+    if (outputDir.isEmpty()) {
+        return;
+    }
+
+    auto* job = new ImageBatchJob(this);
+    auto* progressDialog = new QProgressDialog(tr("Converting images…"), tr("Cancel"), 0, paths.size(), window());
+    progressDialog->setWindowModality(Qt::WindowModal);
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setValue(0);
+
+    connect(progressDialog, &QProgressDialog::canceled, job, &ImageBatchJob::cancel);
+    connect(job, &ImageBatchJob::progress, this,
+            [progressDialog](quint64 done, quint64 /*total*/, const QString& current) {
+                progressDialog->setValue(static_cast<int>(done));
+                progressDialog->setLabelText(tr("Converted %1").arg(QFileInfo(current).fileName()));
+            });
+    connect(job, &ImageBatchJob::finished, this, [this, progressDialog, job](bool ok, const QString& error) {
+        progressDialog->hide();
+        progressDialog->deleteLater();
+        job->deleteLater();
+        if (!ok && !error.isEmpty()) {
+            QMessageBox::warning(window(), tr("Image conversion failed"), error);
+        }
+    });
+
+    job->start(paths, outputDir, conversion);
+    progressDialog->show();
+}
+
 void View::startArchiveExtraction(const QString& archivePath, const QString& destinationDir) {
     auto* job = new ArchiveExtractJob(this);
     auto* dialog = new QProgressDialog(tr("Extracting archive…"), tr("Cancel"), 0, 0, window());
@@ -785,10 +976,22 @@ void View::prepareFileMenu(Panel::FileMenu* menu) {
 
         if (allFiles && allNative && !anySymlink) {
             auto* action = new QAction(QIcon::fromTheme(QStringLiteral("accessories-calculator")),
-                                       tr("Calculate BLAKE3 Checksum"), menu);
-            connect(action, &QAction::triggered, this, &View::onCalculateBlake3);
+                                       tr("Calculate Checksums"), menu);
+            connect(action, &QAction::triggered, this, &View::onCalculateChecksums);
             menu->insertAction(menu->separator3(), action);
 
+            const auto localPath = files.front()->path().localPath();
+            FileChecksums::Algorithm algorithm;
+            if (files.size() == 1 && localPath && FileChecksums::algorithm_for_manifest(localPath.get(), algorithm)) {
+                action =
+                    new QAction(QIcon::fromTheme(QStringLiteral("security-high")), tr("Verify Checksums"), menu);
+                connect(action, &QAction::triggered, this,
+                        [this, manifestPath = QString::fromUtf8(localPath.get()), algorithm] {
+                            startChecksumVerify(manifestPath, algorithm);
+                        });
+                menu->insertAction(menu->separator3(), action);
+            }
+
             if (canDisasm) {
                 action = new QAction(QIcon::fromTheme(QStringLiteral("application-x-executable")),
                                      tr("Disassemble (Capstone)"), menu);
@@ -980,6 +1183,16 @@ void View::prepareFileMenu(Panel::FileMenu* menu) {
             startArchiveExtraction(extractArchivePath, extractDestination);
         });
         menu->insertAction(menu->separator3(), action);
+
+        action = new QAction(QIcon::fromTheme(QStringLiteral("folder-open")), tr("Browse Archive"), menu);
+        connect(action, &QAction::triggered, this, [this, extractArchivePath] {
+            auto* win = qobject_cast<MainWindow*>(window());
+            auto path = archiveBrowsePath(extractArchivePath);
+            if (win && path.isValid()) {
+                win->chdir(std::move(path));
+            }
+        });
+        menu->insertAction(menu->separator3(), action);
     }
 
     if (!compressPaths.isEmpty()) {
@@ -988,6 +1201,27 @@ void View::prepareFileMenu(Panel::FileMenu* menu) {
         connect(action, &QAction::triggered, this, [this, compressPaths] { startArchiveCompression(compressPaths); });
         menu->insertAction(menu->separator3(), action);
     }
+
+    if (!compressPaths.isEmpty() && (files.size() > 1 || files.front()->isDir())) {
+        auto* action = new QAction(QIcon::fromTheme(QStringLiteral("edit-find")), tr("Find Duplicates…"), menu);
+        connect(action, &QAction::triggered, this, [this, compressPaths] {
+            (new DuplicatesDialog(compressPaths, window()))->show();
+        });
+        menu->insertAction(menu->separator3(), action);
+    }
+
+    if (ImageMagickSupport::isAvailable() && files.size() > 1 &&
+        compressPaths.size() == static_cast<int>(files.size())) {
+        const bool allImages = std::all_of(files.cbegin(), files.cend(), [](const auto& fi) {
+            return fi && !fi->isDir() && fi->isImage();
+        });
+        if (allImages) {
+            auto* action =
+                new QAction(QIcon::fromTheme(QStringLiteral("image-convert")), tr("Convert Images…"), menu);
+            connect(action, &QAction::triggered, this, [this, compressPaths] { startImageBatch(compressPaths); });
+            menu->insertAction(menu->separator3(), action);
+        }
+    }
 }
 
 void View::prepareFolderMenu(Panel::FolderMenu* menu) {
@@ -1001,6 +1235,13 @@ void View::prepareFolderMenu(Panel::FolderMenu* menu) {
                 [folder] { static_cast<Application*>(qApp)->openFolderInTerminal(folder->path()); });
 
         menu->insertAction(menu->createAction(), action);
+
+        action = new QAction(QIcon::fromTheme(QStringLiteral("edit-find")), tr("Find Duplicates…"), menu);
+        const QString folderPath = QString::fromUtf8(folder->path().localPath().get());
+        connect(action, &QAction::triggered, this, [this, folderPath] {
+            (new DuplicatesDialog(QStringList{folderPath}, window()))->show();
+        });
+        menu->insertAction(menu->createAction(), action);
         menu->insertSeparator(menu->createAction());
     }
 }
@@ -1057,13 +1298,34 @@ void View::requestVisibleThumbnails() {
         return;
     }
 
-    const int predictiveMargin = rect.height() / 2;
-    rect.adjust(0, -predictiveMargin, 0, predictiveMargin);
-
-    const QModelIndexList indexes = indexesInRect(itemView, rect);
-    if (!indexes.isEmpty()) {
-        proxy->prefetchThumbnails(indexes);
+    // the visible items come first, then one screen ahead in the direction of scrolling,
+    // or half a screen on both sides when the view has not been scrolled yet
+    QModelIndexList indexes = indexesInRect(itemView, rect);
+    if (auto* scrollBar = itemView->verticalScrollBar()) {
+        const int value = scrollBar->value();
+        if (value != lastScrollValue_) {
+            scrollDirection_ = value > lastScrollValue_ ? 1 : -1;
+            lastScrollValue_ = value;
+        }
+    }
+    const int height = rect.height();
+    if (scrollDirection_ > 0) {
+        indexes += indexesInRect(itemView, rect.translated(0, height));
+    }
+    else if (scrollDirection_ < 0) {
+        QModelIndexList above = indexesInRect(itemView, rect.translated(0, -height));
+        std::reverse(above.begin(), above.end());  // the nearest first
+        indexes += above;
+    }
+    else {
+        const int margin = height / 2;
+        indexes += indexesInRect(itemView, QRect(rect.left(), rect.bottom() + 1, rect.width(), margin));
+        QModelIndexList above = indexesInRect(itemView, QRect(rect.left(), rect.top() - margin, rect.width(), margin));
+        std::reverse(above.begin(), above.end());
+        indexes += above;
     }
+    // even an empty list drops the requests of the items scrolled out of range
+    proxy->prefetchThumbnails(indexes);
 }
 
 void View::updateFromSettings(Settings& settings) {
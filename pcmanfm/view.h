@@ -25,6 +25,7 @@
 #include <QTimer>
 
 class QEvent;
+class QProgressDialog;
 
 namespace Fm {
 class FileMenu;
@@ -33,8 +34,13 @@ class FolderMenu;
 
 namespace PCManFM {
 
+class ChecksumJob;
 class Settings;
 
+namespace FileChecksums {
+enum class Algorithm;
+}
+
 class View : public Panel::FolderView {
     Q_OBJECT
    public:
@@ -51,7 +57,7 @@ class View : public Panel::FolderView {
     void onNewWindow();
     void onNewTab();
     void onOpenInTerminal();
-    void onCalculateBlake3();
+    void onCalculateChecksums();
     void onOpenInHexEditor();
     void onDisassembleWithCapstone();
     void onSearch();
@@ -67,6 +73,11 @@ class View : public Panel::FolderView {
     void openFolderAndSelectFile(const std::shared_ptr<const Panel::FileInfo>& fileInfo, bool inNewTab = false);
     void startArchiveCompression(const QStringList& paths);
     void startArchiveExtraction(const QString& archivePath, const QString& destinationDir);
+    // checks the files a SHA256SUMS or B3SUMS manifest lists and shows the sha256sum -c style report
+    void startChecksumVerify(const QString& manifestPath, FileChecksums::Algorithm algorithm);
+    QProgressDialog* checksumProgressDialog(ChecksumJob* job, const QString& label);
+    // converts several images at once with ImageBatchJob, after asking for the format and size
+    void startImageBatch(const QStringList& paths);
     static void removeLibfmArchiverActions(Panel::FileMenu* menu);
 
     void setupThumbnailHooks();
@@ -75,6 +86,8 @@ class View : public Panel::FolderView {
 
    private:
     QTimer thumbnailPrefetchTimer_;
+    int lastScrollValue_ = 0;
+    int scrollDirection_ = 0;  // 1 when last scrolled down, -1 when up
 };
 
 }  // namespace PCManFM
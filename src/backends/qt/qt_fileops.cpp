@@ -5,13 +5,20 @@
 
 #include "qt_fileops.h"
 
+#include "../../core/copy_journal.h"
+#include "../../core/device_profiles.h"
 #include "../../core/fs_ops.h"
+#include "../../core/io_throttle.h"
+#include "../../core/progress_board.h"
 
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QObject>
 #include <QThread>
+#include <QTimer>
 
 #include <atomic>
 #include <functional>
@@ -23,6 +30,9 @@ namespace PCManFM {
 
 namespace {
 
+// how often the GUI thread looks at the progress board of a running request
+constexpr int kProgressIntervalMs = 100;
+
 std::string toNativePath(const QString& path) {
     const QByteArray bytes = QFile::encodeName(path);
     return std::string(bytes.constData(), static_cast<std::size_t>(bytes.size()));
@@ -32,27 +42,196 @@ QString fromNativePath(const std::string& path) {
     return QString::fromLocal8Bit(path.c_str());
 }
 
-FileOpProgress toQtProgress(const FsOps::ProgressInfo& core) {
+FsOps::IoPriority toCorePriority(FileOpIoPriority priority) {
+    switch (priority) {
+        case FileOpIoPriority::Default:
+            return FsOps::IoPriority::Default;
+        case FileOpIoPriority::BestEffort:
+            return FsOps::IoPriority::BestEffort;
+        case FileOpIoPriority::Idle:
+            return FsOps::IoPriority::Idle;
+    }
+    return FsOps::IoPriority::Default;
+}
+
+FileOpProgress toQtProgress(const FsOps::ProgressBoard::Snapshot& core) {
     FileOpProgress qt{};
     qt.bytesDone = core.bytesDone;
     qt.bytesTotal = core.bytesTotal;
     qt.filesDone = core.filesDone;
     qt.filesTotal = core.filesTotal;
     qt.currentPath = fromNativePath(core.currentPath);
+    qt.totalsEstimated = core.totalsEstimated;
     return qt;
 }
 
+// Journals of resumable requests live in $XDG_STATE_HOME/pcmanfm-qt/transfers.
+QString transfersDir() {
+    QString base = qEnvironmentVariable("XDG_STATE_HOME");
+    if (base.isEmpty()) {
+        base = QDir::homePath() + QStringLiteral("/.local/state");
+    }
+    return base + QStringLiteral("/pcmanfm-qt/transfers");
+}
+
+// A transfer is identified by what goes where; tuning options may change between runs.
+QString journalPathFor(const FileOpRequest& req) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(static_cast<int>(req.type)));
+    hash.addData(QByteArray(1, '\0'));
+    hash.addData(QFile::encodeName(req.destination));
+    for (const QString& source : req.sources) {
+        hash.addData(QByteArray(1, '\0'));
+        hash.addData(QFile::encodeName(source));
+    }
+    return transfersDir() + QLatin1Char('/') + QString::fromLatin1(hash.result().toHex()) + QStringLiteral(".journal");
+}
+
+const char* durabilityName(FileOpDurability durability) {
+    switch (durability) {
+        case FileOpDurability::None:
+            return "none";
+        case FileOpDurability::BatchEnd:
+            return "batch-end";
+        case FileOpDurability::PerFile:
+            return "per-file";
+    }
+    return "per-file";
+}
+
+// Stored in the journal so interruptedTransfers() can rebuild the request: one key=value
+// pair per line, values percent-encoded.
+QByteArray serializeRequest(const FileOpRequest& req) {
+    QByteArray out;
+    auto add = [&out](const char* key, const QByteArray& value) {
+        out += key;
+        out += '=';
+        out += value.toPercentEncoding();
+        out += '\n';
+    };
+    add("type", req.type == FileOpType::Move ? "move" : "copy");
+    add("destination", req.destination.toUtf8());
+    for (const QString& source : req.sources) {
+        add("source", source.toUtf8());
+    }
+    add("followSymlinks", req.followSymlinks ? "1" : "0");
+    add("overwriteExisting", req.overwriteExisting ? "1" : "0");
+    add("preserveOwnership", req.preserveOwnership ? "1" : "0");
+    add("durability", durabilityName(req.durability));
+    add("copyWorkers", QByteArray::number(req.copyWorkers));
+    add("verifyCopies", req.verifyCopies ? "1" : "0");
+    add("scanAhead", req.scanAhead ? "1" : "0");
+    add("streamingMove", req.streamingMove ? "1" : "0");
+    add("maxBytesPerSecond", QByteArray::number(req.maxBytesPerSecond));
+    add("maxOpsPerSecond", QByteArray::number(req.maxOpsPerSecond));
+    add("adaptiveThrottle", req.adaptiveThrottle ? "1" : "0");
+    add("directIoThreshold", QByteArray::number(req.directIoThreshold));
+    add("deltaThreshold", QByteArray::number(req.deltaThreshold));
+    add("snapshotDirectories", req.snapshotDirectories ? "1" : "0");
+    add("ioPriority", QByteArray::number(static_cast<int>(req.ioPriority)));
+    return out;
+}
+
+bool deserializeRequest(const QByteArray& data, FileOpRequest& req) {
+    req = FileOpRequest{};
+    req.type = FileOpType::Copy;
+    req.followSymlinks = false;
+    req.overwriteExisting = false;
+    req.resumable = true;
+    bool haveType = false;
+    for (const QByteArray& line : data.split('\n')) {
+        const int eq = line.indexOf('=');
+        if (eq <= 0) {
+            continue;
+        }
+        const QByteArray key = line.left(eq);
+        const QByteArray value = QByteArray::fromPercentEncoding(line.mid(eq + 1));
+        if (key == "type") {
+            if (value != "copy" && value != "move") {
+                return false;
+            }
+            req.type = value == "move" ? FileOpType::Move : FileOpType::Copy;
+            haveType = true;
+        }
+        else if (key == "destination") {
+            req.destination = QString::fromUtf8(value);
+        }
+        else if (key == "source") {
+            req.sources << QString::fromUtf8(value);
+        }
+        else if (key == "followSymlinks") {
+            req.followSymlinks = value == "1";
+        }
+        else if (key == "overwriteExisting") {
+            req.overwriteExisting = value == "1";
+        }
+        else if (key == "preserveOwnership") {
+            req.preserveOwnership = value == "1";
+        }
+        else if (key == "durability") {
+            req.durability = value == "none"        ? FileOpDurability::None
+                             : value == "batch-end" ? FileOpDurability::BatchEnd
+                                                    : FileOpDurability::PerFile;
+        }
+        else if (key == "copyWorkers") {
+            req.copyWorkers = value.toUInt();
+        }
+        else if (key == "verifyCopies") {
+            req.verifyCopies = value == "1";
+        }
+        else if (key == "scanAhead") {
+            req.scanAhead = value == "1";
+        }
+        else if (key == "streamingMove") {
+            req.streamingMove = value == "1";
+        }
+        else if (key == "maxBytesPerSecond") {
+            req.maxBytesPerSecond = value.toULongLong();
+        }
+        else if (key == "maxOpsPerSecond") {
+            req.maxOpsPerSecond = value.toUInt();
+        }
+        else if (key == "adaptiveThrottle") {
+            req.adaptiveThrottle = value == "1";
+        }
+        else if (key == "directIoThreshold") {
+            req.directIoThreshold = value.toULongLong();
+        }
+        else if (key == "deltaThreshold") {
+            req.deltaThreshold = value.toULongLong();
+        }
+        else if (key == "snapshotDirectories") {
+            req.snapshotDirectories = value == "1";
+        }
+        else if (key == "ioPriority") {
+            const int priority = value.toInt();
+            if (priority >= static_cast<int>(FileOpIoPriority::Default) &&
+                priority <= static_cast<int>(FileOpIoPriority::Idle)) {
+                req.ioPriority = static_cast<FileOpIoPriority>(priority);
+            }
+        }
+    }
+    return haveType && !req.destination.isEmpty() && !req.sources.isEmpty();
+}
+
 }  // namespace
 
 class QtFileOps::Worker : public QObject {
     Q_OBJECT
 
    public:
-    explicit Worker(QObject* parent = nullptr) : QObject(parent), cancelled_(false) {}
+    explicit Worker(FsOps::ProgressBoard* board, QObject* parent = nullptr)
+        : QObject(parent), cancelled_(false), board_(board) {}
 
    public Q_SLOTS:
     void processRequest(const FileOpRequest& req) {
         cancelled_.store(false);
+        board_->reset();
+        throttle_.setLimits(req.maxBytesPerSecond, req.maxOpsPerSecond);
+        throttle_.setAdaptive(req.adaptiveThrottle);
+        // The worker thread is ours; parallel copy and delete workers inherit the class.
+        FsOps::Error priorityErr;
+        FsOps::set_io_priority(toCorePriority(req.ioPriority), priorityErr);
 
         switch (req.type) {
             case FileOpType::Copy:
@@ -65,22 +244,77 @@ class QtFileOps::Worker : public QObject {
                 performDelete(req);
                 break;
         }
+        // what the copy learned about its devices, for the next one to start from
+        FsOps::Error saveErr;
+        FsOps::DeviceProfiles::instance().save(saveErr);
     }
 
     void cancel() { cancelled_.store(true); }
 
+    // Called from the GUI thread, like setRateLimits().
+    void setPaused(bool paused) { paused_.store(paused); }
+
+    // Called from the GUI thread; IoThrottle is thread-safe.
+    void setRateLimits(quint64 bytesPerSecond, quint32 opsPerSecond) {
+        throttle_.setLimits(bytesPerSecond, opsPerSecond);
+    }
+
    Q_SIGNALS:
-    void progress(const FileOpProgress& info);
     void finished(bool success, const QString& errorMessage);
 
    private:
     FsOps::ProgressCallback makeProgressCallback() {
         return [this](const FsOps::ProgressInfo& coreInfo) {
-            Q_EMIT progress(toQtProgress(coreInfo));
+            // read by the GUI thread on its own schedule; nothing is sent from here
+            board_->post(coreInfo);
+            // A paused request parks here, between two chunks of its current file.
+            while (paused_.load() && !cancelled_.load()) {
+                QThread::msleep(50);
+            }
             return !cancelled_.load();
         };
     }
 
+    FsOps::CopyOptions makeCopyOptions(const FileOpRequest& req) {
+        FsOps::CopyOptions options;
+        options.throttle = &throttle_;
+        options.profiles = &FsOps::DeviceProfiles::instance();
+        options.ioPriority = toCorePriority(req.ioPriority);
+        options.preserveOwnership = req.preserveOwnership;
+        options.workerCount = req.copyWorkers;
+        options.verify = req.verifyCopies;
+        options.scanAhead = req.scanAhead;
+        options.streamingMove = req.streamingMove;
+        options.directIoThreshold = req.directIoThreshold;
+        options.deltaThreshold = req.deltaThreshold;
+        options.snapshotDirectories = req.snapshotDirectories;
+        switch (req.durability) {
+            case FileOpDurability::None:
+                options.durability = FsOps::Durability::None;
+                break;
+            case FileOpDurability::BatchEnd:
+                options.durability = FsOps::Durability::BatchEnd;
+                break;
+            case FileOpDurability::PerFile:
+                options.durability = FsOps::Durability::PerFile;
+                break;
+        }
+        return options;
+    }
+
+    // Opens (or picks up) the journal of a resumable request. Emits finished() on failure.
+    bool openJournal(const FileOpRequest& req, FsOps::CopyJournal& journal) {
+        FsOps::Error err;
+        const QByteArray description = serializeRequest(req);
+        if (!journal.open(toNativePath(journalPathFor(req)), err) ||
+            !journal.setDescription(std::string(description.constData(), static_cast<std::size_t>(description.size())),
+                                    err)) {
+            Q_EMIT finished(false, QString::fromLocal8Bit(err.message.c_str()));
+            return false;
+        }
+        return true;
+    }
+
     bool computeStatsForFile(const std::string& path, FsOps::ProgressInfo& progress, FsOps::Error& err) {
         struct stat st;
         if (::lstat(path.c_str(), &st) < 0) {
@@ -98,7 +332,8 @@ class QtFileOps::Worker : public QObject {
     bool performOperationList(
         const FileOpRequest& req,
         const std::function<bool(const std::string&, const std::string&, FsOps::ProgressInfo&, FsOps::Error&)>& op,
-        bool needsDestination) {
+        bool needsDestination,
+        const std::function<bool(FsOps::Error&)>& finalize = {}) {
         for (const QString& sourcePath : req.sources) {
             if (cancelled_.load()) {
                 Q_EMIT finished(false, QStringLiteral("Operation cancelled"));
@@ -140,63 +375,119 @@ class QtFileOps::Worker : public QObject {
             opProgress(progress);
         }
 
+        FsOps::Error finalizeErr;
+        if (finalize && !finalize(finalizeErr)) {
+            Q_EMIT finished(false, QString::fromLocal8Bit(finalizeErr.message.c_str()));
+            return false;
+        }
+
         Q_EMIT finished(true, QString());
         return true;
     }
 
     void performCopy(const FileOpRequest& req) {
+        // A batch-end sync covers every source at once instead of one syncfs() per item.
+        FsOps::CopyOptions options = makeCopyOptions(req);
+        const bool syncAtEnd = options.durability == FsOps::Durability::BatchEnd;
+        if (syncAtEnd) {
+            options.durability = FsOps::Durability::None;
+        }
+        FsOps::CopyJournal journal;
+        if (req.resumable) {
+            if (!openJournal(req, journal)) {
+                return;
+            }
+            options.journal = &journal;
+        }
         performOperationList(
             req,
-            [this, req](const std::string& src, const std::string& dst, FsOps::ProgressInfo& progress,
-                        FsOps::Error& err) {
+            [this, options](const std::string& src, const std::string& dst, FsOps::ProgressInfo& progress,
+                            FsOps::Error& err) {
                 auto cb = makeProgressCallback();
-                const bool preserve = req.preserveOwnership;
-                return FsOps::copy_path(src, dst, progress, cb, err, preserve);
+                return FsOps::copy_path(src, dst, progress, cb, err, options);
             },
-            /*needsDestination=*/true);
+            /*needsDestination=*/true,
+            [syncAtEnd, &req, &options](FsOps::Error& err) {
+                if (syncAtEnd && !FsOps::sync_filesystem(toNativePath(req.destination), err)) {
+                    return false;
+                }
+                // Only a fully synced transfer may forget its journal.
+                return !options.journal || options.journal->remove(err);
+            });
     }
 
     void performMove(const FileOpRequest& req) {
+        // Whatever the durability, move_path() syncs each cross-device copy before it deletes
+        // the source.
+        FsOps::CopyOptions options = makeCopyOptions(req);
+        FsOps::CopyJournal journal;
+        if (req.resumable) {
+            if (!openJournal(req, journal)) {
+                return;
+            }
+            options.journal = &journal;
+        }
         performOperationList(
             req,
-            [this, req](const std::string& src, const std::string& dst, FsOps::ProgressInfo& progress,
-                        FsOps::Error& err) {
+            [this, options](const std::string& src, const std::string& dst, FsOps::ProgressInfo& progress,
+                            FsOps::Error& err) {
                 auto cb = makeProgressCallback();
-                return FsOps::move_path(src, dst, progress, cb, err, /*forceCopyFallbackForTests=*/false,
-                                        req.preserveOwnership);
+                return FsOps::move_path(src, dst, progress, cb, err, options);
             },
-            /*needsDestination=*/true);
+            /*needsDestination=*/true,
+            [&options](FsOps::Error& err) { return !options.journal || options.journal->remove(err); });
     }
 
     void performDelete(const FileOpRequest& req) {
         performOperationList(
             req,
-            [this](const std::string& src, const std::string& /*unused*/, FsOps::ProgressInfo& progress,
-                   FsOps::Error& err) {
+            [this, req](const std::string& src, const std::string& /*unused*/, FsOps::ProgressInfo& progress,
+                        FsOps::Error& err) {
                 auto cb = makeProgressCallback();
-                return FsOps::delete_path(src, progress, cb, err);
+                FsOps::DeleteOptions options;
+                options.workerCount = req.deleteWorkers;
+                options.ioPriority = toCorePriority(req.ioPriority);
+                return FsOps::delete_path(src, progress, cb, err, options);
             },
             /*needsDestination=*/false);
     }
 
     std::atomic<bool> cancelled_;
+    std::atomic<bool> paused_{false};
+    FsOps::IoThrottle throttle_;
+    FsOps::ProgressBoard* board_;
 };
 
-QtFileOps::QtFileOps(QObject* parent) : IFileOps(parent), worker_(new Worker), workerThread_(new QThread) {
+QtFileOps::QtFileOps(QObject* parent)
+    : IFileOps(parent), worker_(new Worker(&board_)), workerThread_(new QThread), progressTimer_(new QTimer(this)) {
     worker_->moveToThread(workerThread_);
 
     connect(this, &QtFileOps::startRequest, worker_, &Worker::processRequest);
     connect(this, &QtFileOps::cancelRequest, worker_, &Worker::cancel);
-    connect(worker_, &Worker::progress, this, &QtFileOps::progress);
     connect(worker_, &Worker::finished, this, &QtFileOps::onWorkerFinished);
 
+    progressTimer_->setInterval(kProgressIntervalMs);
+    connect(progressTimer_, &QTimer::timeout, this, &QtFileOps::sampleProgress);
+
     workerThread_->start();
 }
 
 void QtFileOps::onWorkerFinished(bool success, const QString& errorMessage) {
+    progressTimer_->stop();
+    // the last state, which the timer may not have seen
+    sampleProgress();
     Q_EMIT finished(success, errorMessage);
 }
 
+void QtFileOps::sampleProgress() {
+    if (board_.version() == sampledVersion_) {
+        return;
+    }
+    board_.read(snapshot_);
+    sampledVersion_ = snapshot_.version;
+    Q_EMIT progress(toQtProgress(snapshot_));
+}
+
 QtFileOps::~QtFileOps() {
     cancel();
     workerThread_->quit();
@@ -206,6 +497,7 @@ QtFileOps::~QtFileOps() {
 }
 
 void QtFileOps::start(const FileOpRequest& req) {
+    progressTimer_->start();
     Q_EMIT startRequest(req);
 }
 
@@ -213,6 +505,34 @@ void QtFileOps::cancel() {
     Q_EMIT cancelRequest();
 }
 
+QList<FileOpRequest> QtFileOps::interruptedTransfers() const {
+    QList<FileOpRequest> transfers;
+    const QDir dir(transfersDir());
+    const QStringList journals = dir.entryList({QStringLiteral("*.journal")}, QDir::Files, QDir::Time);
+    for (const QString& name : journals) {
+        std::string description;
+        FsOps::Error err;
+        FileOpRequest req;
+        if (FsOps::CopyJournal::readDescription(toNativePath(dir.filePath(name)), description, err) &&
+            deserializeRequest(QByteArray::fromStdString(description), req)) {
+            transfers << req;
+        }
+    }
+    return transfers;
+}
+
+bool QtFileOps::discardInterruptedTransfer(const FileOpRequest& req) {
+    return QFile::remove(journalPathFor(req));
+}
+
+void QtFileOps::setPaused(bool paused) {
+    worker_->setPaused(paused);
+}
+
+void QtFileOps::setRateLimits(quint64 bytesPerSecond, quint32 opsPerSecond) {
+    worker_->setRateLimits(bytesPerSecond, opsPerSecond);
+}
+
 }  // namespace PCManFM
 
 #include "qt_fileops.moc"
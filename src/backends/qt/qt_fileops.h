@@ -13,6 +13,9 @@
 #include <QThread>
 
 #include "../../core/ifileops.h"
+#include "../../core/progress_board.h"
+
+class QTimer;
 
 namespace PCManFM {
 
@@ -26,8 +29,17 @@ class QtFileOps : public IFileOps {
     void start(const FileOpRequest& req) override;
     void cancel() override;
 
+    bool supportsResume() const override { return true; }
+    QList<FileOpRequest> interruptedTransfers() const override;
+    bool discardInterruptedTransfer(const FileOpRequest& req) override;
+    void setPaused(bool paused) override;
+    void setRateLimits(quint64 bytesPerSecond, quint32 opsPerSecond) override;
+    const FsOps::ProgressBoard* progressBoard() const override { return &board_; }
+
    private Q_SLOTS:
     void onWorkerFinished(bool success, const QString& errorMessage);
+    // emits progress() when the worker posted anything since the last look
+    void sampleProgress();
 
    Q_SIGNALS:
     void startRequest(const FileOpRequest& req);
@@ -35,8 +47,12 @@ class QtFileOps : public IFileOps {
 
    private:
     class Worker;
+    FsOps::ProgressBoard board_;
     Worker* worker_;
     QThread* workerThread_;
+    QTimer* progressTimer_;
+    FsOps::ProgressBoard::Snapshot snapshot_;  // its path buffer is reused by every sample
+    std::uint64_t sampledVersion_ = 0;
 };
 
 }  // namespace PCManFM
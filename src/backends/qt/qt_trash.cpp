@@ -0,0 +1,42 @@
+/*
+ * Trash backend over the native freedesktop.org trash
+ * src/backends/qt/qt_trash.cpp
+ */
+
+#include "qt_trash.h"
+
+#include <QFile>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../../core/trash_store.h"
+
+namespace PCManFM {
+
+QtTrash::QtTrash() : store_(TrashStore::instance()) {}
+
+bool QtTrash::moveToTrash(const QString& path, QString* errorOut) {
+    std::vector<int> results;
+    if (store_.trash({QFile::encodeName(path).toStdString()}, results)) {
+        return true;
+    }
+    if (errorOut) {
+        *errorOut = QStringLiteral("%1: %2").arg(path, QString::fromLocal8Bit(std::strerror(results.front())));
+    }
+    return false;
+}
+
+bool QtTrash::restore(const QString& trashId, QString* errorOut) {
+    FsOps::Error err;
+    if (store_.restore(QFile::encodeName(trashId).toStdString(), err)) {
+        return true;
+    }
+    if (errorOut) {
+        *errorOut = QString::fromStdString(err.message);
+    }
+    return false;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,29 @@
+/*
+ * Trash backend over the native freedesktop.org trash
+ * src/backends/qt/qt_trash.h
+ */
+
+#ifndef QT_TRASH_H
+#define QT_TRASH_H
+
+#include "../../core/itrashbackend.h"
+
+namespace PCManFM {
+
+class TrashStore;
+
+class QtTrash : public ITrashBackend {
+   public:
+    QtTrash();
+
+    bool moveToTrash(const QString& path, QString* errorOut) override;
+    // |trashId| is the path of the entry in the files/ directory of its trash
+    bool restore(const QString& trashId, QString* errorOut) override;
+
+   private:
+    TrashStore& store_;
+};
+
+}  // namespace PCManFM
+
+#endif  // QT_TRASH_H
@@ -0,0 +1,66 @@
+/*
+ * Remote backend for sftp:// over native libssh sessions
+ * src/backends/sftp/sftp_backend.cpp
+ */
+
+#include "sftp_backend.h"
+
+#include <QFile>
+
+#include "../../core/sftp_session.h"
+
+namespace PCManFM {
+
+bool SftpBackend::isRemote(const QUrl& url) const {
+    return url.scheme() == QLatin1String("sftp");
+}
+
+QString SftpBackend::mapToMountPoint(const QUrl& url) {
+    Q_UNUSED(url);
+    return QString();
+}
+
+int SftpBackend::copyFile(const QUrl& source, const QUrl& destination, bool overwrite, const ProgressFunc& progress) {
+    SftpSession::Direction direction;
+    QUrl remote;
+    QString local;
+    if (isRemote(source) && destination.isLocalFile()) {
+        direction = SftpSession::Direction::Download;
+        remote = source;
+        local = destination.toLocalFile();
+    }
+    else if (source.isLocalFile() && isRemote(destination)) {
+        direction = SftpSession::Direction::Upload;
+        remote = destination;
+        local = source.toLocalFile();
+    }
+    else {  // copies between two servers go through this machine anyway; GIO does that
+        return ENOTSUP;
+    }
+
+    SftpEndpoint endpoint;
+    std::string remotePath;
+    if (!parse_sftp_uri(remote.toString(QUrl::FullyEncoded).toStdString(), endpoint, remotePath)) {
+        return ENOTSUP;
+    }
+    const std::string localPath = QFile::encodeName(local).toStdString();
+    const SftpSession::Progress sessionProgress = [&progress](std::uint64_t done, std::uint64_t total) {
+        return !progress || progress(done, total);
+    };
+
+    // a connection found broken, as after a long idle time, is opened again once
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int error = 0;
+        auto session = SftpSessionPool::instance().acquire(endpoint, error);
+        if (!session) {
+            return ENOTSUP;
+        }
+        error = session->transfer(direction, remotePath, localPath, overwrite, sessionProgress);
+        if (error != ENOTCONN) {
+            return error;
+        }
+    }
+    return ENOTCONN;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,27 @@
+/*
+ * Remote backend for sftp:// over native libssh sessions
+ * src/backends/sftp/sftp_backend.h
+ */
+
+#ifndef SFTP_BACKEND_H
+#define SFTP_BACKEND_H
+
+#include "../../core/iremotebackend.h"
+
+namespace PCManFM {
+
+// Copies files from and to sftp:// locations through SftpSessionPool, bypassing gvfsd-sftp,
+// which sends one request at a time. Servers it cannot log in to without asking are left to
+// GIO. Safe to share between threads.
+class SftpBackend : public IRemoteBackend {
+   public:
+    bool isRemote(const QUrl& url) const override;
+    // its transfers need no mount, so there is none to map to
+    QString mapToMountPoint(const QUrl& url) override;
+
+    int copyFile(const QUrl& source, const QUrl& destination, bool overwrite, const ProgressFunc& progress) override;
+};
+
+}  // namespace PCManFM
+
+#endif  // SFTP_BACKEND_H
@@ -0,0 +1,258 @@
+/*
+ * Append-only store of the bytes added to a hex document (POSIX-only, no Qt)
+ * src/core/added_store.cpp
+ */
+
+#include "added_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+// file chunks are sized to what is appended, in steps of this, up to kFileChunkSize
+constexpr std::uint64_t kFileChunkStep = 16 * 1024 * 1024;
+
+std::string errno_message(const char* context, int error) {
+    return std::string(context) + ": " + std::strerror(error);
+}
+
+// An anonymous file in $TMPDIR, gone as soon as it is closed.
+int open_scratch_file(std::string& errorOut) {
+    const char* env = std::getenv("TMPDIR");
+    const std::string dir = env && *env ? env : "/tmp";
+#ifdef O_TMPFILE
+    const int fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        return fd;
+    }
+#endif
+    std::string pattern = dir + "/.pcmanfm-added.XXXXXX";
+    const int tmp = ::mkostemp(pattern.data(), O_CLOEXEC);
+    if (tmp < 0) {
+        errorOut = errno_message("mkostemp", errno);
+        return -1;
+    }
+    ::unlink(pattern.c_str());
+    return tmp;
+}
+
+}  // namespace
+
+struct AddedStore::Chunk {
+    std::uint64_t start = 0;  // store offset of data[0]
+    std::size_t capacity = 0;
+    std::uint8_t* data = nullptr;
+    bool mapped = false;
+
+    ~Chunk() {
+        if (mapped) {
+            ::munmap(data, capacity);
+        }
+        else {
+            delete[] data;
+        }
+    }
+};
+
+const std::uint8_t* AddedStore::spanIn(const std::vector<std::shared_ptr<const Chunk>>& chunks,
+                                       std::uint64_t size,
+                                       std::uint64_t offset,
+                                       std::size_t length,
+                                       std::size_t& available) {
+    available = 0;
+    if (offset >= size) {
+        return nullptr;
+    }
+    // the last chunk starting at or before offset
+    auto it = std::upper_bound(chunks.begin(), chunks.end(), offset,
+                               [](std::uint64_t value, const std::shared_ptr<const Chunk>& chunk) {
+                                   return value < chunk->start;
+                               });
+    const Chunk& chunk = **(it - 1);
+    const std::uint64_t local = offset - chunk.start;
+    available = static_cast<std::size_t>(
+        std::min<std::uint64_t>({length, chunk.capacity - local, size - offset}));
+    return chunk.data + local;
+}
+
+void AddedStore::copyIn(const std::vector<std::shared_ptr<const Chunk>>& chunks,
+                        std::uint64_t size,
+                        std::uint64_t offset,
+                        std::size_t length,
+                        std::uint8_t* dest) {
+    while (length > 0) {
+        std::size_t available = 0;
+        const std::uint8_t* data = spanIn(chunks, size, offset, length, available);
+        if (available == 0) {
+            return;
+        }
+        std::memcpy(dest, data, available);
+        dest += available;
+        offset += available;
+        length -= available;
+    }
+}
+
+const std::uint8_t* AddedStore::View::span(std::uint64_t offset, std::size_t length, std::size_t& available) const {
+    return spanIn(chunks_, size_, offset, length, available);
+}
+
+void AddedStore::View::copy(std::uint64_t offset, std::size_t length, std::uint8_t* dest) const {
+    copyIn(chunks_, size_, offset, length, dest);
+}
+
+void AddedStore::View::reset() {
+    chunks_.clear();
+    size_ = 0;
+}
+
+AddedStore::AddedStore(std::uint64_t memoryLimit) : memoryLimit_(memoryLimit) {}
+
+AddedStore::~AddedStore() {
+    clear();
+}
+
+void AddedStore::clear() {
+    chunks_.clear();
+    size_ = 0;
+    capacity_ = 0;
+    memoryCapacity_ = 0;
+    fileEnd_ = 0;
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+// The memory chunks all come before the first file chunk.
+std::uint64_t AddedStore::residentBytes() const {
+    return std::min(size_, memoryCapacity_);
+}
+
+std::uint64_t AddedStore::spilledBytes() const {
+    return size_ - residentBytes();
+}
+
+AddedStore::View AddedStore::view() const {
+    View view;
+    view.chunks_ = chunks_;
+    view.size_ = size_;
+    return view;
+}
+
+const std::uint8_t* AddedStore::span(std::uint64_t offset, std::size_t length, std::size_t& available) const {
+    return spanIn(chunks_, size_, offset, length, available);
+}
+
+void AddedStore::copy(std::uint64_t offset, std::size_t length, std::uint8_t* dest) const {
+    copyIn(chunks_, size_, offset, length, dest);
+}
+
+std::uint8_t* AddedStore::writable(std::uint64_t offset, std::size_t& available) const {
+    const std::uint8_t* data = spanIn(chunks_, capacity_, offset, static_cast<std::size_t>(-1), available);
+    return const_cast<std::uint8_t*>(data);  // the chunks are only read through views
+}
+
+bool AddedStore::reserve(std::uint64_t length, std::string& errorOut) {
+    while (capacity_ - size_ < length) {
+        const std::uint64_t missing = length - (capacity_ - size_);
+        auto chunk = std::make_shared<Chunk>();
+        chunk->start = capacity_;
+        if (memoryCapacity_ + kMemoryChunkSize <= memoryLimit_) {
+            chunk->capacity = kMemoryChunkSize;
+            chunk->data = new std::uint8_t[kMemoryChunkSize];
+            memoryCapacity_ += kMemoryChunkSize;
+        }
+        else {
+            if (fd_ < 0) {
+                fd_ = open_scratch_file(errorOut);
+                if (fd_ < 0) {
+                    return false;
+                }
+            }
+            const std::uint64_t rounded = (missing + kFileChunkStep - 1) / kFileChunkStep * kFileChunkStep;
+            chunk->capacity = static_cast<std::size_t>(std::min<std::uint64_t>(rounded, kFileChunkSize));
+            const int error = ::posix_fallocate(fd_, static_cast<off_t>(fileEnd_), static_cast<off_t>(chunk->capacity));
+            if (error != 0) {
+                errorOut = errno_message("fallocate", error);
+                return false;
+            }
+            void* map = ::mmap(nullptr, chunk->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+                               static_cast<off_t>(fileEnd_));
+            if (map == MAP_FAILED) {
+                errorOut = errno_message("mmap", errno);
+                return false;
+            }
+            chunk->data = static_cast<std::uint8_t*>(map);
+            chunk->mapped = true;
+            fileEnd_ += chunk->capacity;
+        }
+        capacity_ += chunk->capacity;
+        chunks_.push_back(std::move(chunk));
+    }
+    return true;
+}
+
+bool AddedStore::append(const std::uint8_t* data, std::size_t length, std::uint64_t& offsetOut, std::string& errorOut) {
+    if (!reserve(length, errorOut)) {
+        return false;
+    }
+    offsetOut = size_;
+    std::uint64_t offset = size_;
+    while (length > 0) {
+        std::size_t available = 0;
+        std::uint8_t* dest = writable(offset, available);
+        available = std::min(available, length);
+        std::memcpy(dest, data, available);
+        data += available;
+        offset += available;
+        length -= available;
+    }
+    size_ = offset;
+    return true;
+}
+
+bool AddedStore::appendFrom(int fd,
+                            std::uint64_t fileOffset,
+                            std::uint64_t length,
+                            std::uint64_t& offsetOut,
+                            std::string& errorOut) {
+    if (!reserve(length, errorOut)) {
+        return false;
+    }
+    std::uint64_t offset = size_;
+    while (length > 0) {
+        std::size_t available = 0;
+        std::uint8_t* dest = writable(offset, available);
+        available = static_cast<std::size_t>(std::min<std::uint64_t>(available, length));
+        const ssize_t n = ::pread(fd, dest, available, static_cast<off_t>(fileOffset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errorOut = errno_message("read", errno);
+            return false;
+        }
+        if (n == 0) {
+            errorOut = "read: the file ended early";
+            return false;
+        }
+        fileOffset += static_cast<std::uint64_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+        length -= static_cast<std::uint64_t>(n);
+    }
+    offsetOut = size_;
+    size_ = offset;
+    return true;
+}
+
+}  // namespace PCManFM
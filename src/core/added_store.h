@@ -0,0 +1,105 @@
+/*
+ * Append-only store of the bytes added to a hex document (POSIX-only, no Qt)
+ * src/core/added_store.h
+ */
+
+#ifndef PCMANFM_ADDED_STORE_H
+#define PCMANFM_ADDED_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PCManFM {
+
+// AddedStore holds the bytes typed, pasted or inserted into a piece table document, which its
+// added pieces point into. It only ever grows, and its bytes live in chunks that never move:
+// in memory up to the memory limit, and past it in chunks mapped from an unlinked temporary
+// file, so the size of an insert is bounded by the disk rather than by memory. Disk blocks are
+// allocated before a chunk is mapped, so a full disk fails the append instead of faulting on
+// the write.
+//
+// A View shares the chunks holding the bytes appended so far; they stay readable through it,
+// from any thread, while the store goes on being appended to or is cleared.
+class AddedStore {
+    struct Chunk;  // defined in the .cpp
+
+   public:
+    static constexpr std::size_t kMemoryChunkSize = 4 * 1024 * 1024;
+    static constexpr std::size_t kFileChunkSize = 256 * 1024 * 1024;
+    static constexpr std::uint64_t kDefaultMemoryLimit = 64 * 1024 * 1024;
+
+    class View {
+       public:
+        std::uint64_t size() const { return size_; }
+        // The bytes at |offset|, contiguous up to |length| or the end of their chunk, whichever
+        // comes first; |available| is set to their number, 0 past the end.
+        const std::uint8_t* span(std::uint64_t offset, std::size_t length, std::size_t& available) const;
+        // Copies [offset, offset + length), which must lie below size(), to |dest|.
+        void copy(std::uint64_t offset, std::size_t length, std::uint8_t* dest) const;
+        void reset();
+
+       private:
+        friend class AddedStore;
+
+        std::vector<std::shared_ptr<const Chunk>> chunks_;
+        std::uint64_t size_ = 0;
+    };
+
+    explicit AddedStore(std::uint64_t memoryLimit = kDefaultMemoryLimit);
+    ~AddedStore();
+
+    AddedStore(const AddedStore&) = delete;
+    AddedStore& operator=(const AddedStore&) = delete;
+
+    // Appends |length| bytes and sets |offsetOut| to where they start. On failure nothing is
+    // appended.
+    bool append(const std::uint8_t* data, std::size_t length, std::uint64_t& offsetOut, std::string& errorOut);
+    // Like append(), reading |length| bytes from |fd| at |fileOffset| straight into the store.
+    bool appendFrom(int fd,
+                    std::uint64_t fileOffset,
+                    std::uint64_t length,
+                    std::uint64_t& offsetOut,
+                    std::string& errorOut);
+    // Forgets every byte and closes the temporary file; views taken before keep theirs.
+    void clear();
+
+    std::uint64_t size() const { return size_; }
+    // Bytes held in memory and in the temporary file.
+    std::uint64_t residentBytes() const;
+    std::uint64_t spilledBytes() const;
+
+    View view() const;
+    // Like View::span() and View::copy(), on the thread appending.
+    const std::uint8_t* span(std::uint64_t offset, std::size_t length, std::size_t& available) const;
+    void copy(std::uint64_t offset, std::size_t length, std::uint8_t* dest) const;
+
+   private:
+    static const std::uint8_t* spanIn(const std::vector<std::shared_ptr<const Chunk>>& chunks,
+                                      std::uint64_t size,
+                                      std::uint64_t offset,
+                                      std::size_t length,
+                                      std::size_t& available);
+    static void copyIn(const std::vector<std::shared_ptr<const Chunk>>& chunks,
+                       std::uint64_t size,
+                       std::uint64_t offset,
+                       std::size_t length,
+                       std::uint8_t* dest);
+    // Adds chunks until |length| more bytes fit.
+    bool reserve(std::uint64_t length, std::string& errorOut);
+    std::uint8_t* writable(std::uint64_t offset, std::size_t& available) const;
+
+    std::uint64_t memoryLimit_;
+    std::vector<std::shared_ptr<const Chunk>> chunks_;
+    std::uint64_t size_ = 0;
+    std::uint64_t capacity_ = 0;  // bytes of all the chunks
+    std::uint64_t memoryCapacity_ = 0;
+    int fd_ = -1;
+    std::uint64_t fileEnd_ = 0;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_ADDED_STORE_H
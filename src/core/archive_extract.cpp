@@ -6,15 +6,27 @@
 #include "archive_extract.h"
 
 #include "fs_ops.h"
+#include "zip_directory.h"
+#include "zstd_seekable.h"
 
 #include <archive.h>
 #include <archive_entry.h>
+#include <b3sum/blake3.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <climits>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <fcntl.h>
@@ -24,6 +36,11 @@
 #include <sys/xattr.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
 namespace PCManFM::ArchiveExtract {
 namespace {
 
@@ -227,7 +244,10 @@ void apply_metadata(int fd, const std::string& path, archive_entry* entry, const
     times[0].tv_nsec = archive_entry_atime_nsec(entry);
     times[1].tv_sec = archive_entry_mtime(entry);
     times[1].tv_nsec = archive_entry_mtime_nsec(entry);
-    if (!path.empty()) {
+    if (fd >= 0) {
+        ::futimens(fd, times);
+    }
+    else if (!path.empty()) {
         const int flags = isSymlink ? AT_SYMLINK_NOFOLLOW : 0;
         ::utimensat(AT_FDCWD, path.c_str(), times, flags);
     }
@@ -276,7 +296,24 @@ bool open_reader(const std::string& archivePath, const Options& opts, struct arc
     return true;
 }
 
-bool scan_archive(const std::string& archivePath, const Options& opts, ProgressInfo& progress, Error& err) {
+// A regular file (not a hardlink) found by scan_archive; |index| counts every header so a
+// second reader can find the same entry again.
+struct Member {
+    std::size_t index = 0;
+    std::uint64_t size = 0;
+};
+
+struct ScanResult {
+    int format = 0;
+    bool filtered = false;
+    std::vector<Member> files;
+};
+
+bool scan_archive(const std::string& archivePath,
+                  const Options& opts,
+                  ProgressInfo& progress,
+                  ScanResult& scan,
+                  Error& err) {
     struct archive* ar = nullptr;
     if (!open_reader(archivePath, opts, ar, err)) {
         return false;
@@ -284,6 +321,7 @@ bool scan_archive(const std::string& archivePath, const Options& opts, ProgressI
 
     archive_entry* entry = nullptr;
     int r = ARCHIVE_OK;
+    std::size_t index = 0;
     while ((r = archive_read_next_header(ar, &entry)) == ARCHIVE_OK) {
         const char* rawPath = archive_entry_pathname(entry);
         const std::string rel = sanitize_path(rawPath);
@@ -297,14 +335,16 @@ bool scan_archive(const std::string& archivePath, const Options& opts, ProgressI
         const auto type = archive_entry_filetype(entry);
         if (type == AE_IFREG) {
             const la_int64_t sz = archive_entry_size(entry);
-            if (sz > 0) {
-                const std::uint64_t s = static_cast<std::uint64_t>(sz);
-                if (s <= std::numeric_limits<std::uint64_t>::max() - progress.bytesTotal) {
-                    progress.bytesTotal += s;
-                }
+            const std::uint64_t s = sz > 0 ? static_cast<std::uint64_t>(sz) : 0;
+            if (s <= std::numeric_limits<std::uint64_t>::max() - progress.bytesTotal) {
+                progress.bytesTotal += s;
+            }
+            if (!archive_entry_hardlink(entry)) {
+                scan.files.push_back({index, s});
             }
         }
         progress.filesTotal += 1;
+        ++index;
         archive_read_data_skip(ar);
     }
 
@@ -315,6 +355,8 @@ bool scan_archive(const std::string& archivePath, const Options& opts, ProgressI
         return false;
     }
 
+    scan.format = archive_format(ar) & ARCHIVE_FORMAT_BASE_MASK;
+    scan.filtered = archive_filter_code(ar, 0) != ARCHIVE_FILTER_NONE;
     archive_read_close(ar);
     archive_read_free(ar);
     return true;
@@ -340,7 +382,256 @@ bool write_all(int fd, const void* data, std::size_t size, off_t offset, Error&
     return true;
 }
 
-bool extract_regular_file(struct archive* ar,
+// Writes one data block, skipping page-sized runs of zeros so they stay holes in the freshly
+// created output file. libarchive already reports sparse entries (GNU/pax sparse tar) as
+// offset jumps; this also catches formats that store holes as literal zeros.
+bool write_sparse(int fd, const void* data, std::size_t size, off_t offset, Error& err) {
+    constexpr std::size_t kPage = 4096;
+    const std::uint8_t* ptr = static_cast<const std::uint8_t*>(data);
+    std::size_t runStart = 0;
+    std::size_t pos = 0;
+    while (pos < size) {
+        const std::size_t len = std::min(kPage, size - pos);
+        const bool zero = len == kPage && ptr[pos] == 0 && std::memcmp(ptr + pos, ptr + pos + 1, len - 1) == 0;
+        if (zero) {
+            if (pos > runStart &&
+                !write_all(fd, ptr + runStart, pos - runStart, offset + static_cast<off_t>(runStart), err)) {
+                return false;
+            }
+            runStart = pos + len;
+        }
+        pos += len;
+    }
+    if (size > runStart) {
+        return write_all(fd, ptr + runStart, size - runStart, offset + static_cast<off_t>(runStart), err);
+    }
+    return true;
+}
+
+// Files at most this large are held in memory while a written original of the same size
+// exists, so a duplicate is never written at all; larger ones are written and then replaced.
+constexpr std::uint64_t kDedupHoldLimit = 4 * 1024 * 1024;
+
+// BLAKE3 over the logical contents of a member as its blocks stream by, with holes (offset
+// jumps) hashed as zeros so a sparse copy and a dense one of the same bytes match.
+struct MemberHash {
+    blake3_hasher hasher;
+    std::uint64_t pos = 0;
+    bool valid = true;
+
+    MemberHash() { blake3_hasher_init(&hasher); }
+
+    void zeros(std::uint64_t count) {
+        static const std::uint8_t kZeros[64 * 1024] = {};
+        while (count > 0) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(count, sizeof(kZeros)));
+            blake3_hasher_update(&hasher, kZeros, n);
+            count -= n;
+        }
+    }
+
+    void update(const void* data, std::size_t size, std::uint64_t offset) {
+        if (offset < pos) {
+            valid = false;  // overlapping blocks; never seen from libarchive, but not hashable
+            return;
+        }
+        zeros(offset - pos);
+        blake3_hasher_update(&hasher, data, size);
+        pos = offset + size;
+    }
+
+    // Key of the finished contents: logical size followed by the digest.
+    std::string finish(std::uint64_t logicalEnd) {
+        if (logicalEnd > pos) {
+            zeros(logicalEnd - pos);
+            pos = logicalEnd;
+        }
+        std::string key(sizeof(pos) + BLAKE3_OUT_LEN, '\0');
+        std::memcpy(&key[0], &pos, sizeof(pos));
+        blake3_hasher_finalize(&hasher, reinterpret_cast<std::uint8_t*>(&key[sizeof(pos)]), BLAKE3_OUT_LEN);
+        return key;
+    }
+};
+
+// Regular files already written by one extract_archive() call, by contents. Shared by the
+// member readers, hence the mutex.
+class Deduper {
+   public:
+    struct Original {
+        std::string path;
+        mode_t perm = 0;
+        uid_t uid = 0;
+        gid_t gid = 0;
+        std::int64_t mtime = 0;
+        long mtimeNsec = 0;
+        bool xattrs = false;
+    };
+
+    static Original describe(archive_entry* entry, const std::string& path) {
+        Original o;
+        o.path = path;
+        o.perm = archive_entry_perm(entry);
+        o.uid = archive_entry_uid(entry);
+        o.gid = archive_entry_gid(entry);
+        o.mtime = archive_entry_mtime(entry);
+        o.mtimeNsec = archive_entry_mtime_nsec(entry);
+        o.xattrs = archive_entry_xattr_count(entry) > 0;
+        return o;
+    }
+
+    bool has_size(std::uint64_t size) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sizes_.count(size) != 0;
+    }
+
+    bool find(const std::string& key, Original& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = byKey_.find(key);
+        if (it == byKey_.end()) {
+            return false;
+        }
+        out = it->second;
+        return true;
+    }
+
+    void add(const std::string& key, std::uint64_t size, Original original) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        keyByPath_[original.path] = key;
+        sizes_.insert(size);
+        byKey_.emplace(key, std::move(original));
+    }
+
+    // |path| is about to be rewritten (a later member of the same name), so it can no longer
+    // stand in for the contents it was registered with.
+    void forget(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = keyByPath_.find(path);
+        if (it == keyByPath_.end()) {
+            return;
+        }
+        const auto orig = byKey_.find(it->second);
+        if (orig != byKey_.end() && orig->second.path == path) {
+            byKey_.erase(orig);
+        }
+        keyByPath_.erase(it);
+    }
+
+   private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Original> byKey_;
+    std::unordered_map<std::string, std::string> keyByPath_;
+    std::unordered_set<std::uint64_t> sizes_;
+};
+
+// Gives |outFd| the extents of |original|. Works on an empty file as well as on one whose
+// identical bytes were already written; the written blocks are released either way.
+bool reflink_from(const Deduper::Original& original, int outFd) {
+#if defined(__linux__) && defined(FICLONE)
+    Fd in(::open(original.path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+    return in.valid() && ::ioctl(outFd, FICLONE, in.fd) == 0;
+#else
+    (void)original;
+    (void)outFd;
+    return false;
+#endif
+}
+
+// A hard link shares the inode, so it is only used when every piece of metadata the member
+// would get matches the original's; the link replaces |fullPath| atomically.
+bool hardlink_from(const Deduper::Original& original,
+                   archive_entry* entry,
+                   const std::string& fullPath,
+                   const Options& opts) {
+    const Deduper::Original mine = Deduper::describe(entry, fullPath);
+    const bool ownerMatches = !opts.keepOwnership || (mine.uid == original.uid && mine.gid == original.gid);
+    if (mine.perm != original.perm || mine.mtime != original.mtime || mine.mtimeNsec != original.mtimeNsec ||
+        !ownerMatches || ((mine.xattrs || original.xattrs) && opts.keepXattrs)) {
+        return false;
+    }
+    const std::string tmp = fullPath + ".dedup~";
+    ::unlink(tmp.c_str());
+    if (::link(original.path.c_str(), tmp.c_str()) != 0) {
+        return false;
+    }
+    if (::rename(tmp.c_str(), fullPath.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct EntryDeleter {
+    void operator()(archive_entry* entry) const { archive_entry_free(entry); }
+};
+using EntryPtr = std::unique_ptr<archive_entry, EntryDeleter>;
+
+// A regular file the decoder copied out of the archive for a writer thread: its header and its
+// data blocks, back to back in |bytes|.
+struct BufferedFile {
+    struct Block {
+        la_int64_t offset;
+        std::size_t size;
+    };
+
+    EntryPtr entry;
+    std::string fullPath;
+    std::string rel;
+    std::vector<std::uint8_t> bytes;
+    std::vector<Block> blocks;
+};
+
+// Where extract_regular_file() takes the data blocks of a member from: the archive the header
+// was just read from, a BufferedFile, or a zip member reached through the central directory.
+class BlockSource {
+   public:
+    explicit BlockSource(struct archive* ar) : ar_(ar) {}
+    explicit BlockSource(const BufferedFile& file) : file_(&file) {}
+    explicit BlockSource(ZipDirectory::MemberStream& stream) : zip_(&stream) {}
+
+    // ARCHIVE_OK with the next block, ARCHIVE_EOF after the last one; anything else sets |err|.
+    int next(const void*& buff, std::size_t& size, la_int64_t& offset, Error& err) {
+        if (zip_) {
+            const std::uint8_t* data = nullptr;
+            if (!zip_->next(data, size, err)) {
+                return ARCHIVE_FATAL;
+            }
+            if (size == 0) {
+                return ARCHIVE_EOF;
+            }
+            buff = data;
+            offset = static_cast<la_int64_t>(pos_);
+            pos_ += size;
+            return ARCHIVE_OK;
+        }
+        if (!file_) {
+            const int r = archive_read_data_block(ar_, &buff, &size, &offset);
+            if (r != ARCHIVE_OK && r != ARCHIVE_EOF) {
+                set_archive_error(err, ar_, "archive_read_data_block");
+            }
+            return r;
+        }
+        if (block_ == file_->blocks.size()) {
+            return ARCHIVE_EOF;
+        }
+        const BufferedFile::Block& block = file_->blocks[block_++];
+        buff = file_->bytes.data() + pos_;
+        size = block.size;
+        offset = block.offset;
+        pos_ += block.size;
+        return ARCHIVE_OK;
+    }
+
+   private:
+    struct archive* ar_ = nullptr;
+    const BufferedFile* file_ = nullptr;
+    ZipDirectory::MemberStream* zip_ = nullptr;
+    std::size_t block_ = 0;
+    std::size_t pos_ = 0;
+};
+
+// With |dedup| set the member is hashed as it streams; when its contents match a file written
+// earlier it ends up sharing that file's extents (reflink) or, failing that, its inode.
+bool extract_regular_file(BlockSource& source,
                           archive_entry* entry,
                           const std::string& fullPath,
                           const std::string& relPath,
@@ -348,7 +639,8 @@ bool extract_regular_file(struct archive* ar,
                           const Options& opts,
                           ProgressInfo& progress,
                           const ProgressCallback& cb,
-                          Error& err) {
+                          Error& err,
+                          Deduper* dedup = nullptr) {
     if (!ensure_parent_dirs(destinationDir, parent_dir(relPath), err)) {
         return false;
     }
@@ -366,29 +658,67 @@ bool extract_regular_file(struct archive* ar,
         mode = 0666;
     }
 
+    if (dedup) {
+        dedup->forget(fullPath);
+        if (opts.overwriteExisting) {
+            ::unlink(fullPath.c_str());  // O_TRUNC would also empty every hard-linked duplicate
+        }
+    }
+
     Fd fd(::open(fullPath.c_str(), flags, mode));
     if (!fd.valid()) {
         set_error(err, "open");
         return false;
     }
 
+    const bool sizeKnown = archive_entry_size_is_set(entry);
+    const std::uint64_t declared = sizeKnown ? static_cast<std::uint64_t>(archive_entry_size(entry)) : 0;
+    std::unique_ptr<MemberHash> hash;
+    std::vector<std::uint8_t> held;  // contents kept back while a duplicate is possible
+    bool holding = false;
+    if (dedup) {
+        hash = std::make_unique<MemberHash>();
+        holding = sizeKnown && declared > 0 && declared <= kDedupHoldLimit && dedup->has_size(declared);
+        if (holding) {
+            held.resize(static_cast<std::size_t>(declared));
+        }
+    }
+
     const void* buff = nullptr;
     std::size_t size = 0;
     la_int64_t offset = 0;
+    la_int64_t logicalEnd = 0;
     while (true) {
-        const la_int64_t r = archive_read_data_block(ar, &buff, &size, &offset);
+        const int r = source.next(buff, size, offset, err);
         if (r == ARCHIVE_EOF) {
             break;
         }
         if (r != ARCHIVE_OK) {
-            set_archive_error(err, ar, "archive_read_data_block");
             return false;
         }
 
         if (size > 0 && buff) {
-            if (!write_all(fd.fd, buff, size, static_cast<off_t>(offset), err)) {
-                return false;
+            if (hash) {
+                hash->update(buff, size, static_cast<std::uint64_t>(offset));
+            }
+            const std::uint64_t blockEnd = static_cast<std::uint64_t>(offset) + size;
+            if (holding && blockEnd <= held.size()) {
+                std::memcpy(held.data() + offset, buff, size);
+            }
+            else {
+                if (holding) {
+                    // More data than the header announced; stop holding and write what we have.
+                    holding = false;
+                    if (!write_sparse(fd.fd, held.data(), static_cast<std::size_t>(logicalEnd), 0, err)) {
+                        return false;
+                    }
+                    held.clear();
+                }
+                if (!write_sparse(fd.fd, buff, size, static_cast<off_t>(offset), err)) {
+                    return false;
+                }
             }
+            logicalEnd = std::max(logicalEnd, offset + static_cast<la_int64_t>(size));
             progress.bytesDone += static_cast<std::uint64_t>(size);
             progress.currentPath = relPath;
             if (!should_continue(cb, progress)) {
@@ -399,23 +729,65 @@ bool extract_regular_file(struct archive* ar,
         }
     }
 
+    // Skipped zero pages and trailing holes leave the file short; extend it to the logical size.
+    if (sizeKnown) {
+        logicalEnd = std::max(logicalEnd, archive_entry_size(entry));
+    }
+
+    std::string key;
+    bool shared = false;
+    if (hash && hash->valid) {
+        key = hash->finish(static_cast<std::uint64_t>(logicalEnd));
+        Deduper::Original original;
+        if (logicalEnd > 0 && dedup->find(key, original)) {
+            if (reflink_from(original, fd.fd)) {
+                shared = true;
+            }
+            else if (hardlink_from(original, entry, fullPath, opts)) {
+                progress.filesDone += 1;
+                return true;
+            }
+        }
+    }
+    if (holding && !shared && !write_sparse(fd.fd, held.data(), static_cast<std::size_t>(logicalEnd), 0, err)) {
+        return false;
+    }
+
+    struct stat st{};
+    if (!shared && logicalEnd > 0 && ::fstat(fd.fd, &st) == 0 && st.st_size < logicalEnd &&
+        ::ftruncate(fd.fd, static_cast<off_t>(logicalEnd)) != 0) {
+        set_error(err, "ftruncate");
+        return false;
+    }
+
     Error xerr;
     if (!apply_xattrs(fd.fd, fullPath, entry, opts, xerr)) {
         err = xerr;
         return false;
     }
     apply_metadata(fd.fd, fullPath, entry, opts, false);
+    if (!key.empty() && !shared && logicalEnd > 0) {
+        dedup->add(key, static_cast<std::uint64_t>(logicalEnd), Deduper::describe(entry, fullPath));
+    }
     progress.filesDone += 1;
     return true;
 }
 
+// A directory whose metadata is applied once everything below it has been written, since each
+// file created in it would move its modification time again.
+struct DeferredDir {
+    EntryPtr entry;
+    std::string fullPath;
+};
+
 bool extract_directory(archive_entry* entry,
                        const std::string& fullPath,
                        const std::string& relPath,
                        const std::string& destinationDir,
                        const Options& opts,
                        ProgressInfo& progress,
-                       Error& err) {
+                       Error& err,
+                       std::vector<DeferredDir>* deferred) {
     mode_t mode = archive_entry_perm(entry);
     if (mode == 0) {
         mode = 0777;
@@ -430,7 +802,18 @@ bool extract_directory(archive_entry* entry,
         return false;
     }
 
-    apply_metadata(-1, fullPath, entry, opts, false);
+    if (deferred) {
+        EntryPtr clone(archive_entry_clone(entry));
+        if (!clone) {
+            err.code = ENOMEM;
+            err.message = "Failed to copy archive entry";
+            return false;
+        }
+        deferred->push_back({std::move(clone), fullPath});
+    }
+    else {
+        apply_metadata(-1, fullPath, entry, opts, false);
+    }
     progress.filesDone += 1;
     return true;
 }
@@ -500,47 +883,265 @@ bool extract_hardlink(archive_entry* entry,
     return true;
 }
 
-}  // namespace
+// Writes the member whose header was just read from |ar| to |fullPath| and consumes its data.
+// With |deferredDirs| the metadata of a directory is left for the caller to apply.
+bool extract_member(struct archive* ar,
+                    archive_entry* entry,
+                    const std::string& fullPath,
+                    const std::string& rel,
+                    const std::string& destinationDir,
+                    const Options& opts,
+                    ProgressInfo& progress,
+                    const ProgressCallback& callback,
+                    Error& err,
+                    Deduper* dedup = nullptr,
+                    std::vector<DeferredDir>* deferredDirs = nullptr) {
+    if (archive_entry_hardlink(entry)) {
+        if (!extract_hardlink(entry, fullPath, rel, destinationDir, progress, err)) {
+            return false;
+        }
+        archive_read_data_skip(ar);
+        return true;
+    }
 
-bool extract_archive(const std::string& archivePath,
-                     const std::string& destinationDir,
-                     ProgressInfo& progress,
-                     const ProgressCallback& callback,
-                     Error& err,
-                     const Options& opts) {
-    progress = {};
-    err = {};
+    bool ok = true;
+    switch (archive_entry_filetype(entry)) {
+        case AE_IFREG: {
+            BlockSource source(ar);
+            ok = extract_regular_file(source, entry, fullPath, rel, destinationDir, opts, progress, callback, err,
+                                      dedup);
+            break;
+        }
+        case AE_IFDIR: {
+            ok = extract_directory(entry, fullPath, rel, destinationDir, opts, progress, err, deferredDirs);
+            archive_read_data_skip(ar);
+            break;
+        }
+        case AE_IFLNK: {
+            ok = extract_symlink(entry, fullPath, rel, destinationDir, opts, progress, err);
+            archive_read_data_skip(ar);
+            break;
+        }
+        default: {
+            archive_read_data_skip(ar);  // unsupported special files or metadata entries
+            break;
+        }
+    }
+    return ok;
+}
 
-    if (archivePath.empty() || destinationDir.empty()) {
-        err.code = EINVAL;
-        err.message = "Invalid archive or destination path";
-        return false;
+// Regular files up to this size are copied out for the writer threads; larger ones are written
+// by the decoder itself, which keeps the memory of the pipeline bounded.
+constexpr std::uint64_t kMaxBufferedMember = 8 * 1024 * 1024;
+// the decoder waits while the writers hold this much data
+constexpr std::size_t kMaxBufferedBytes = 64 * 1024 * 1024;
+constexpr unsigned kMaxWriterThreads = 4;
+
+unsigned writer_thread_count(const Options& opts) {
+    if (opts.writerThreads > 0) {
+        return opts.writerThreads;
     }
+    const unsigned hc = std::thread::hardware_concurrency();
+    return std::min(hc > 0 ? hc : 1, kMaxWriterThreads);
+}
 
-    if (!ensure_destination_root(destinationDir, err)) {
-        return false;
+// Writes the files a sequential decoder buffered, so creating them, writing them and setting
+// their metadata overlaps with the decompression. A path is never queued twice, so a later
+// member of the same name still replaces an earlier one.
+class WriterPool {
+   public:
+    WriterPool(unsigned threads, const std::string& destinationDir, const Options& opts)
+        : destinationDir_(destinationDir), opts_(opts) {
+        workers_.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            workers_.emplace_back(&WriterPool::run, this);
+        }
     }
 
-    ProgressInfo scanProgress;
-    if (!scan_archive(archivePath, opts, scanProgress, err)) {
-        FsOps::Error cleanupErr;
-        ProgressInfo cleanupProg;
-        FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
-        return false;
+    ~WriterPool() {
+        Error ignored;
+        finish(true, ignored);
     }
-    progress.bytesTotal = scanProgress.bytesTotal;
-    progress.filesTotal = scanProgress.filesTotal;
 
-    struct archive* ar = nullptr;
-    if (!open_reader(archivePath, opts, ar, err)) {
-        FsOps::Error cleanupErr;
-        ProgressInfo cleanupProg;
-        FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
+    WriterPool(const WriterPool&) = delete;
+    WriterPool& operator=(const WriterPool&) = delete;
+
+    // Blocks while the writers hold too much data or still write a file of the same path.
+    void submit(std::unique_ptr<BufferedFile> file) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this, &file] {
+            return failed_ || (bufferedBytes_ < kMaxBufferedBytes && inFlight_.count(file->fullPath) == 0);
+        });
+        if (failed_) {
+            return;
+        }
+        bufferedBytes_ += file->bytes.size();
+        inFlight_.insert(file->fullPath);
+        queue_.push_back(std::move(file));
+        work_.notify_one();
+    }
+
+    // Blocks until no file of |fullPath| is queued or being written.
+    void wait_idle(const std::string& fullPath) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this, &fullPath] { return failed_ || inFlight_.count(fullPath) == 0; });
+    }
+
+    bool failed() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return failed_;
+    }
+
+    // The files written since the last call.
+    std::uint64_t take_files_done() { return filesDone_.exchange(0, std::memory_order_relaxed); }
+
+    // Joins the writers once the queue is empty, or with |abandon| once the files being written
+    // are; false with the first error of a writer.
+    bool finish(bool abandon, Error& err) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+            if (abandon) {
+                queue_.clear();
+            }
+        }
+        work_.notify_all();
+        for (auto& t : workers_) {
+            t.join();
+        }
+        workers_.clear();
+        if (error_.isSet()) {
+            err = error_;
+            return false;
+        }
+        return true;
+    }
+
+   private:
+    void run() {
+        while (true) {
+            std::unique_ptr<BufferedFile> file;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_.wait(lock, [this] { return done_ || failed_ || !queue_.empty(); });
+                if (failed_ || queue_.empty()) {
+                    return;
+                }
+                file = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            Error err;
+            ProgressInfo local;
+            BlockSource source(*file);
+            const bool ok = extract_regular_file(source, file->entry.get(), file->fullPath, file->rel,
+                                                 destinationDir_, opts_, local, ProgressCallback(), err);
+            if (ok) {
+                filesDone_.fetch_add(1, std::memory_order_relaxed);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                bufferedBytes_ -= file->bytes.size();
+                inFlight_.erase(file->fullPath);
+                if (!ok && !failed_) {
+                    failed_ = true;
+                    error_ = err;
+                    queue_.clear();
+                }
+            }
+            idle_.notify_all();
+            if (!ok) {
+                work_.notify_all();
+            }
+        }
+    }
+
+    const std::string& destinationDir_;
+    const Options& opts_;
+    mutable std::mutex mutex_;
+    std::condition_variable work_;  // for the writers: a file was queued, or the pool is ending
+    std::condition_variable idle_;  // for the decoder: a file was written
+    std::deque<std::unique_ptr<BufferedFile>> queue_;
+    std::unordered_set<std::string> inFlight_;
+    std::size_t bufferedBytes_ = 0;
+    bool done_ = false;
+    bool failed_ = false;
+    Error error_;
+    std::atomic<std::uint64_t> filesDone_{0};
+    std::vector<std::thread> workers_;
+};
+
+// Copies the data of the regular file whose header was just read from |ar| and queues it for
+// |writers|. Progress counts the bytes as they are decoded.
+bool buffer_regular_file(struct archive* ar,
+                         archive_entry* entry,
+                         const std::string& fullPath,
+                         const std::string& rel,
+                         WriterPool& writers,
+                         ProgressInfo& progress,
+                         const ProgressCallback& callback,
+                         Error& err) {
+    auto file = std::make_unique<BufferedFile>();
+    file->entry.reset(archive_entry_clone(entry));
+    if (!file->entry) {
+        err.code = ENOMEM;
+        err.message = "Failed to copy archive entry";
         return false;
     }
+    file->fullPath = fullPath;
+    file->rel = rel;
+    file->bytes.reserve(static_cast<std::size_t>(archive_entry_size(entry)));
+
+    BlockSource source(ar);
+    const void* buff = nullptr;
+    std::size_t size = 0;
+    la_int64_t offset = 0;
+    while (true) {
+        const int r = source.next(buff, size, offset, err);
+        if (r == ARCHIVE_EOF) {
+            break;
+        }
+        if (r != ARCHIVE_OK) {
+            return false;
+        }
+        if (size == 0 || !buff) {
+            continue;
+        }
+        const auto* data = static_cast<const std::uint8_t*>(buff);
+        file->bytes.insert(file->bytes.end(), data, data + size);
+        file->blocks.push_back({offset, size});
+        progress.bytesDone += static_cast<std::uint64_t>(size);
+        if (!should_continue(callback, progress)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            return false;
+        }
+    }
+    writers.submit(std::move(file));
+    return true;
+}
+
+// Runs the sequential extraction loop over every header of |ar|. With |skipRegularFiles| the
+// regular files the member readers already wrote are passed over, so only directories, links
+// and their metadata are applied. Otherwise small regular files go to a WriterPool unless dedup
+// needs them in archive order. Directory metadata comes last either way, so times and modes stick.
+bool extract_entries(struct archive* ar,
+                     const std::string& destinationDir,
+                     const Options& opts,
+                     bool skipRegularFiles,
+                     ProgressInfo& progress,
+                     const ProgressCallback& callback,
+                     Error& err,
+                     Deduper* dedup) {
+    std::unique_ptr<WriterPool> writers;
+    const unsigned writerThreads = skipRegularFiles || dedup ? 1 : writer_thread_count(opts);
+    if (writerThreads > 1) {
+        writers = std::make_unique<WriterPool>(writerThreads, destinationDir, opts);
+    }
+    std::vector<DeferredDir> dirs;
 
-    archive_entry* entry = nullptr;
     bool ok = true;
+    archive_entry* entry = nullptr;
     while (archive_read_next_header(ar, &entry) == ARCHIVE_OK) {
         const char* rawPath = archive_entry_pathname(entry);
         std::string rel = sanitize_path(rawPath);
@@ -551,10 +1152,23 @@ bool extract_archive(const std::string& archivePath,
             break;
         }
 
+        const char* hardlink = archive_entry_hardlink(entry);
+        const bool regular = !hardlink && archive_entry_filetype(entry) == AE_IFREG;
+        if (skipRegularFiles && regular) {
+            archive_read_data_skip(ar);
+            continue;
+        }
+
         std::string fullPath = destinationDir;
         fullPath.push_back('/');
         fullPath += rel;
 
+        if (writers) {
+            progress.filesDone += writers->take_files_done();
+            if (writers->failed()) {
+                break;  // finish() below reports the writer's error
+            }
+        }
         progress.currentPath = rel;
         if (!should_continue(callback, progress)) {
             err.code = ECANCELED;
@@ -563,59 +1177,964 @@ bool extract_archive(const std::string& archivePath,
             break;
         }
 
-        const char* hardlink = archive_entry_hardlink(entry);
-        if (hardlink) {
-            if (!extract_hardlink(entry, fullPath, rel, destinationDir, progress, err)) {
-                ok = false;
-                break;
-            }
-            archive_read_data_skip(ar);
-            continue;
-        }
-
-        const auto type = archive_entry_filetype(entry);
-        switch (type) {
-            case AE_IFREG: {
-                if (!extract_regular_file(ar, entry, fullPath, rel, destinationDir, opts, progress, callback, err)) {
-                    ok = false;
-                }
-                break;
-            }
-            case AE_IFDIR: {
-                if (!extract_directory(entry, fullPath, rel, destinationDir, opts, progress, err)) {
-                    ok = false;
-                }
-                archive_read_data_skip(ar);
-                break;
-            }
-            case AE_IFLNK: {
-                if (!extract_symlink(entry, fullPath, rel, destinationDir, opts, progress, err)) {
+        if (writers) {
+            if (regular && archive_entry_size_is_set(entry) &&
+                static_cast<std::uint64_t>(archive_entry_size(entry)) <= kMaxBufferedMember) {
+                if (!buffer_regular_file(ar, entry, fullPath, rel, *writers, progress, callback, err)) {
                     ok = false;
+                    break;
                 }
-                archive_read_data_skip(ar);
-                break;
+                continue;
             }
-            default: {
-                archive_read_data_skip(ar);  // unsupported special files or metadata entries
-                break;
+            // everything else is written here, after the writers are done with the paths involved
+            writers->wait_idle(fullPath);
+            const std::string target = hardlink ? sanitize_path(hardlink) : std::string();
+            if (!target.empty()) {
+                writers->wait_idle(destinationDir + '/' + target);
             }
         }
 
-        if (!ok) {
+        if (!extract_member(ar, entry, fullPath, rel, destinationDir, opts, progress, callback, err, dedup, &dirs)) {
+            ok = false;
             break;
         }
     }
 
-    archive_read_close(ar);
-    archive_read_free(ar);
+    if (writers) {
+        Error writeErr;
+        if (!writers->finish(!ok, writeErr)) {
+            err = writeErr;  // the cause of whatever failed here after it
+            ok = false;
+        }
+        progress.filesDone += writers->take_files_done();
+    }
+    if (ok) {
+        for (const DeferredDir& dir : dirs) {
+            apply_metadata(-1, dir.fullPath, dir.entry.get(), opts, false);
+        }
+    }
+    return ok;
+}
 
-    if (!ok) {
-        FsOps::Error cleanupErr;
-        ProgressInfo cleanupProg;
-        FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
+constexpr unsigned kMaxMemberThreads = 8;
+constexpr std::uint64_t kMemberOverhead = 16 * 1024;  // weight of an entry beyond its bytes
+
+bool random_access_format(int format) {
+    return format == ARCHIVE_FORMAT_ZIP || format == ARCHIVE_FORMAT_7ZIP || format == ARCHIVE_FORMAT_ISO9660;
+}
+
+// Number of readers for |files| regular files of an archive any reader can seek around in.
+unsigned member_thread_count(const Options& opts, std::size_t files) {
+    unsigned threads = opts.memberThreads;
+    if (threads == 0) {
+        const unsigned hc = std::thread::hardware_concurrency();
+        threads = std::min(hc > 0 ? hc : 1, kMaxMemberThreads);
+    }
+    return static_cast<unsigned>(std::min<std::size_t>(threads, files));
+}
+
+// Number of member readers for this archive. Streaming formats and anything behind a compression
+// filter would make every reader decode the file from the start, so those stay sequential.
+unsigned member_thread_count(const Options& opts, const ScanResult& scan) {
+    if (opts.memberThreads == 1 || scan.filtered || !random_access_format(scan.format)) {
+        return 1;
+    }
+    return member_thread_count(opts, scan.files.size());
+}
+
+// Splits the files into |count| contiguous runs of roughly equal weight. Contiguous runs keep a
+// reader inside as few 7z solid blocks as possible; zip and iso skip to any member cheaply.
+std::vector<std::pair<std::size_t, std::size_t>> partition_members(const std::vector<Member>& files,
+                                                                   unsigned count) {
+    std::uint64_t total = 0;
+    for (const Member& m : files) {
+        total += m.size + kMemberOverhead;
+    }
+
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    std::size_t begin = 0;
+    std::uint64_t acc = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        acc += files[i].size + kMemberOverhead;
+        const std::uint64_t target = total / count * (ranges.size() + 1);
+        if (acc >= target && ranges.size() + 1 < count) {
+            ranges.emplace_back(begin, i + 1);
+            begin = i + 1;
+        }
+    }
+    if (begin < files.size()) {
+        ranges.emplace_back(begin, files.size());
+    }
+    return ranges;
+}
+
+// Shared between the member readers; |mutex| guards the aggregate progress, the callback and
+// the first error.
+struct MemberState {
+    std::mutex mutex;
+    ProgressInfo& progress;
+    const ProgressCallback& callback;
+    std::atomic<bool> stop{false};
+    Error error;
+
+    MemberState(ProgressInfo& p, const ProgressCallback& cb) : progress(p), callback(cb) {}
+
+    void fail(const Error& e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error.isSet()) {
+            error = e;
+        }
+        stop.store(true, std::memory_order_relaxed);
+    }
+};
+
+// Forwards the per-file counters of one member reader into the aggregate as deltas.
+class MemberProgress {
+   public:
+    explicit MemberProgress(MemberState& state)
+        : state_(state), callback_([this](const ProgressInfo& local) { return forward(local, false); }) {}
+    MemberProgress(const MemberProgress&) = delete;
+    MemberProgress& operator=(const MemberProgress&) = delete;
+
+    // Starts the next file, whose ProgressInfo counts from zero again.
+    void start() { reported_ = 0; }
+
+    bool forward(const ProgressInfo& local, bool fileDone) {
+        std::lock_guard<std::mutex> lock(state_.mutex);
+        if (state_.stop.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        state_.progress.bytesDone += local.bytesDone - reported_;
+        reported_ = local.bytesDone;
+        if (fileDone) {
+            state_.progress.filesDone += 1;
+        }
+        state_.progress.currentPath = local.currentPath;
+        if (!should_continue(state_.callback, state_.progress)) {
+            state_.stop.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    const ProgressCallback& callback() const { return callback_; }
+
+   private:
+    MemberState& state_;
+    std::uint64_t reported_ = 0;
+    const ProgressCallback callback_;
+};
+
+// Extracts files[begin, end) through a reader of its own, skipping every other header.
+void extract_member_range(const std::string& archivePath,
+                          const std::string& destinationDir,
+                          const Options& opts,
+                          const std::vector<Member>& files,
+                          std::size_t begin,
+                          std::size_t end,
+                          MemberState& state,
+                          Deduper* dedup) {
+    Error err;
+    struct archive* ar = nullptr;
+    if (!open_reader(archivePath, opts, ar, err)) {
+        state.fail(err);
+        return;
+    }
+    MemberProgress forward(state);
+
+    archive_entry* entry = nullptr;
+    std::size_t index = 0;
+    std::size_t next = begin;
+    while (next < end && !state.stop.load(std::memory_order_relaxed)) {
+        const int r = archive_read_next_header(ar, &entry);
+        if (r != ARCHIVE_OK) {
+            set_archive_error(err, ar, "archive_read_next_header");
+            state.fail(err);
+            break;
+        }
+        if (index++ != files[next].index) {
+            archive_read_data_skip(ar);
+            continue;
+        }
+        ++next;
+
+        const std::string rel = sanitize_path(archive_entry_pathname(entry));
+        std::string fullPath = destinationDir;
+        fullPath.push_back('/');
+        fullPath += rel;
+
+        ProgressInfo local;
+        local.currentPath = rel;
+        forward.start();
+        BlockSource source(ar);
+        if (!extract_regular_file(source, entry, fullPath, rel, destinationDir, opts, local, forward.callback(), err,
+                                  dedup)) {
+            state.fail(err);
+            break;
+        }
+        if (!forward.forward(local, true)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            state.fail(err);
+            break;
+        }
+    }
+
+    archive_read_close(ar);
+    archive_read_free(ar);
+}
+
+bool extract_members_parallel(const std::string& archivePath,
+                              const std::string& destinationDir,
+                              const Options& opts,
+                              const ScanResult& scan,
+                              unsigned threads,
+                              ProgressInfo& progress,
+                              const ProgressCallback& callback,
+                              Error& err,
+                              Deduper* dedup) {
+    MemberState state(progress, callback);
+    const auto ranges = partition_members(scan.files, threads);
+    std::vector<std::thread> workers;
+    workers.reserve(ranges.size());
+    for (const auto& range : ranges) {
+        workers.emplace_back(extract_member_range, std::cref(archivePath), std::cref(destinationDir), std::cref(opts),
+                             std::cref(scan.files), range.first, range.second, std::ref(state), dedup);
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    if (state.error.isSet()) {
+        err = state.error;
+        return false;
+    }
+    return true;
+}
+
+// Decides whether extract_members() writes the member at |rel|; unset selects everything.
+using MemberFilter = std::function<bool(const std::string& rel)>;
+
+// Opens |archivePath| as a zip whose members MemberStream can all decode; anything else (another
+// format, encryption, methods other than store and deflate) is left to libarchive.
+bool open_zip(const std::string& archivePath, ZipDirectory::Reader& zip) {
+    Error err;
+    if (!zip.open(archivePath, err)) {
+        return false;
+    }
+    const auto& entries = zip.entries();
+    return std::all_of(entries.begin(), entries.end(), ZipDirectory::Reader::decodable);
+}
+
+// The header libarchive would have read for a zip member. Zip records no owner, so the files
+// belong to whoever extracts them.
+bool zip_entry(const ZipDirectory::Entry& e, EntryPtr& out, Error& err) {
+    out.reset(archive_entry_new());
+    if (!out) {
+        err.code = ENOMEM;
+        err.message = "Failed to allocate archive entry";
+        return false;
+    }
+    archive_entry_copy_pathname(out.get(), e.path.c_str());
+    archive_entry_set_mode(out.get(), static_cast<mode_t>(e.mode));
+    if (S_ISREG(e.mode)) {
+        archive_entry_set_size(out.get(), static_cast<la_int64_t>(e.size));
+    }
+    archive_entry_set_mtime(out.get(), e.mtime, 0);
+    archive_entry_set_atime(out.get(), e.mtime, 0);
+    archive_entry_set_uid(out.get(), ::geteuid());
+    archive_entry_set_gid(out.get(), ::getegid());
+    return true;
+}
+
+// The members of a zip to write, as central directory indices in archive order. Of two members
+// with one path only the later is kept, as it would overwrite the earlier one when streaming.
+struct ZipPlan {
+    std::vector<std::string> rels;  // sanitized path per central directory entry; empty if unselected
+    std::vector<std::size_t> dirs;
+    std::vector<Member> files;
+    std::vector<std::size_t> links;
+};
+
+// Fills |plan| and the totals of |progress| from the central directory alone.
+bool plan_zip(const ZipDirectory::Reader& zip,
+              const MemberFilter& select,
+              ZipPlan& plan,
+              ProgressInfo& progress,
+              Error& err) {
+    const auto& entries = zip.entries();
+    plan.rels.assign(entries.size(), std::string());
+    std::unordered_map<std::string, std::size_t> last;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        std::string rel = sanitize_path(entries[i].path.c_str());
+        if (rel.empty()) {
+            if (select) {
+                continue;  // never selectable
+            }
+            err.code = EINVAL;
+            err.message = "Unsafe path in archive entry";
+            return false;
+        }
+        if (select && !select(rel)) {
+            continue;
+        }
+        last[rel] = i;
+        plan.rels[i] = std::move(rel);
+    }
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (plan.rels[i].empty() || last[plan.rels[i]] != i) {
+            continue;
+        }
+        const std::uint32_t mode = entries[i].mode;
+        if (S_ISDIR(mode)) {
+            plan.dirs.push_back(i);
+        }
+        else if (S_ISREG(mode)) {
+            plan.files.push_back({i, entries[i].size});
+            if (entries[i].size <= std::numeric_limits<std::uint64_t>::max() - progress.bytesTotal) {
+                progress.bytesTotal += entries[i].size;
+            }
+        }
+        else if (S_ISLNK(mode)) {
+            plan.links.push_back(i);
+        }
+        else {
+            continue;  // special files are not extracted
+        }
+        progress.filesTotal += 1;
+    }
+    return true;
+}
+
+// Writes plan.files[begin, end), each read straight from its local header.
+void extract_zip_range(const ZipDirectory::Reader& zip,
+                       const ZipPlan& plan,
+                       const std::string& destinationDir,
+                       const Options& opts,
+                       std::size_t begin,
+                       std::size_t end,
+                       MemberState& state,
+                       Deduper* dedup) {
+    ZipDirectory::MemberStream stream(zip);
+    MemberProgress forward(state);
+    Error err;
+    for (std::size_t i = begin; i < end && !state.stop.load(std::memory_order_relaxed); ++i) {
+        const ZipDirectory::Entry& e = zip.entries()[plan.files[i].index];
+        const std::string& rel = plan.rels[plan.files[i].index];
+        EntryPtr entry;
+        if (!zip_entry(e, entry, err) || !stream.open(e, err)) {
+            state.fail(err);
+            return;
+        }
+
+        ProgressInfo local;
+        local.currentPath = rel;
+        forward.start();
+        BlockSource source(stream);
+        if (!extract_regular_file(source, entry.get(), destinationDir + '/' + rel, rel, destinationDir, opts, local,
+                                  forward.callback(), err, dedup)) {
+            state.fail(err);
+            return;
+        }
+        if (!forward.forward(local, true)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            state.fail(err);
+            return;
+        }
+    }
+}
+
+// Symlinks in zip keep their target as the member data.
+bool read_zip_link(ZipDirectory::MemberStream& stream, const ZipDirectory::Entry& e, std::string& target, Error& err) {
+    if (e.size > PATH_MAX) {
+        err.code = ENAMETOOLONG;
+        err.message = "Symlink target too long in " + e.path;
+        return false;
+    }
+    target.clear();
+    if (!stream.open(e, err)) {
+        return false;
+    }
+    const std::uint8_t* data = nullptr;
+    std::size_t len = 0;
+    do {
+        if (!stream.next(data, len, err)) {
+            return false;
+        }
+        target.append(reinterpret_cast<const char*>(data), len);
+    } while (len > 0);
+    return true;
+}
+
+// Extracts what |plan| selected: the directories, then the regular files through up to
+// member_thread_count() streams of their own, then the symlinks, and directory metadata last.
+bool extract_zip(const ZipDirectory::Reader& zip,
+                 const ZipPlan& plan,
+                 const std::string& destinationDir,
+                 const Options& opts,
+                 ProgressInfo& progress,
+                 const ProgressCallback& callback,
+                 Error& err,
+                 Deduper* dedup) {
+    const auto& entries = zip.entries();
+    std::vector<DeferredDir> dirs;
+    for (std::size_t i : plan.dirs) {
+        const std::string& rel = plan.rels[i];
+        progress.currentPath = rel;
+        if (!should_continue(callback, progress)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            return false;
+        }
+        EntryPtr entry;
+        if (!zip_entry(entries[i], entry, err) || !extract_directory(entry.get(), destinationDir + '/' + rel, rel,
+                                                                     destinationDir, opts, progress, err, &dirs)) {
+            return false;
+        }
+    }
+
+    MemberState state(progress, callback);
+    const auto ranges = partition_members(plan.files, std::max(member_thread_count(opts, plan.files.size()), 1u));
+    if (ranges.size() == 1) {
+        extract_zip_range(zip, plan, destinationDir, opts, 0, plan.files.size(), state, dedup);
+    }
+    else {
+        std::vector<std::thread> workers;
+        workers.reserve(ranges.size());
+        for (const auto& range : ranges) {
+            workers.emplace_back(extract_zip_range, std::cref(zip), std::cref(plan), std::cref(destinationDir),
+                                 std::cref(opts), range.first, range.second, std::ref(state), dedup);
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+    if (state.error.isSet()) {
+        err = state.error;
+        return false;
+    }
+
+    if (opts.keepSymlinks) {
+        ZipDirectory::MemberStream stream(zip);
+        for (std::size_t i : plan.links) {
+            const std::string& rel = plan.rels[i];
+            progress.currentPath = rel;
+            if (!should_continue(callback, progress)) {
+                err.code = ECANCELED;
+                err.message = "Cancelled";
+                return false;
+            }
+            EntryPtr entry;
+            std::string target;
+            if (!zip_entry(entries[i], entry, err) || !read_zip_link(stream, entries[i], target, err)) {
+                return false;
+            }
+            archive_entry_copy_symlink(entry.get(), target.c_str());
+            if (!extract_symlink(entry.get(), destinationDir + '/' + rel, rel, destinationDir, opts, progress, err)) {
+                return false;
+            }
+        }
+    }
+
+    for (const DeferredDir& dir : dirs) {
+        apply_metadata(-1, dir.fullPath, dir.entry.get(), opts, false);
+    }
+    return true;
+}
+
+// libarchive client reading the tar stream out of a seekable zstd archive from wherever the
+// reader was positioned.
+struct IndexedSource {
+    ZstdSeekable::Reader reader;
+    Error error;
+};
+
+la_ssize_t indexed_source_read(struct archive* ar, void* client, const void** buffer) {
+    auto* source = static_cast<IndexedSource*>(client);
+    const std::uint8_t* data = nullptr;
+    std::size_t len = 0;
+    if (!source->reader.next(data, len, source->error)) {
+        archive_set_error(ar, source->error.code, "%s", source->error.message.c_str());
+        return -1;
+    }
+    *buffer = data;
+    return static_cast<la_ssize_t>(len);
+}
+
+bool open_indexed_member(IndexedSource& source, std::uint64_t offset, struct archive*& out, Error& err) {
+    if (!source.reader.seek(offset, err)) {
+        return false;
+    }
+    struct archive* ar = archive_read_new();
+    if (!ar) {
+        err.code = ENOMEM;
+        err.message = "Failed to allocate archive reader";
+        return false;
+    }
+    archive_read_support_format_tar(ar);
+    if (archive_read_open(ar, &source, nullptr, indexed_source_read, nullptr) != ARCHIVE_OK) {
+        set_archive_error(err, ar, "archive_read_open");
+        archive_read_free(ar);
+        return false;
+    }
+    out = ar;
+    return true;
+}
+
+EntryInfo entry_info(archive_entry* entry, std::string path) {
+    EntryInfo info;
+    info.path = std::move(path);
+    info.size = archive_entry_size_is_set(entry) ? static_cast<std::uint64_t>(archive_entry_size(entry)) : 0;
+    info.mtime = archive_entry_mtime(entry);
+    info.mode = archive_entry_mode(entry);
+    if (const char* hardlink = archive_entry_hardlink(entry)) {
+        info.hardlink = true;
+        info.linkTarget = hardlink;
+    }
+    else if (const char* symlink = archive_entry_symlink(entry)) {
+        info.linkTarget = symlink;
+    }
+    return info;
+}
+
+// Writes the member just read from |ar| to |destinationPath| itself rather than below a root.
+bool extract_single(struct archive* ar,
+                    archive_entry* entry,
+                    const std::string& destinationPath,
+                    const Options& opts,
+                    ProgressInfo& progress,
+                    const ProgressCallback& callback,
+                    Error& err) {
+    if (const char* hardlink = archive_entry_hardlink(entry)) {
+        err.code = ENOTSUP;
+        err.message = std::string("Member is a hard link to ") + hardlink;
+        return false;
+    }
+    if (!FsOps::make_dir_parents(parent_dir(destinationPath), err)) {
+        return false;
+    }
+
+    struct stat st{};
+    const bool existed = ::lstat(destinationPath.c_str(), &st) == 0;
+    const auto slash = destinationPath.find_last_of('/');
+    const std::string name = slash == std::string::npos ? destinationPath : destinationPath.substr(slash + 1);
+    progress.bytesTotal = archive_entry_size_is_set(entry) ? static_cast<std::uint64_t>(archive_entry_size(entry)) : 0;
+    progress.filesTotal = 1;
+    progress.currentPath = name;
+    if (extract_member(ar, entry, destinationPath, name, parent_dir(destinationPath), opts, progress, callback, err)) {
+        return true;
+    }
+    if (!existed && archive_entry_filetype(entry) == AE_IFREG) {
+        ::unlink(destinationPath.c_str());
+    }
+    return false;
+}
+
+}  // namespace
+
+bool list_entries(const std::string& archivePath, const EntryCallback& callback, Error& err, const Options& opts) {
+    err = {};
+
+    Fd fd(::open(archivePath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+    ZstdSeekable::Reader index;
+    Error indexErr;
+    if (index.open(fd.fd, indexErr)) {
+        for (const ZstdSeekable::IndexEntry& e : index.entries()) {
+            EntryInfo info;
+            info.path = e.path;
+            info.linkTarget = e.linkTarget;
+            info.size = e.size;
+            info.mtime = e.mtime;
+            info.mode = static_cast<mode_t>(e.mode);
+            if (callback && !callback(info)) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    struct archive* ar = nullptr;
+    if (!open_reader(archivePath, opts, ar, err)) {
+        return false;
+    }
+    archive_entry* entry = nullptr;
+    int r = ARCHIVE_OK;
+    while ((r = archive_read_next_header(ar, &entry)) == ARCHIVE_OK) {
+        std::string rel = sanitize_path(archive_entry_pathname(entry));
+        if (!rel.empty() && callback && !callback(entry_info(entry, std::move(rel)))) {
+            r = ARCHIVE_EOF;
+            break;
+        }
+        archive_read_data_skip(ar);
+    }
+    const bool ok = r == ARCHIVE_EOF;
+    if (!ok) {
+        set_archive_error(err, ar, "archive_read_next_header");
+    }
+    archive_read_close(ar);
+    archive_read_free(ar);
+    return ok;
+}
+
+bool extract_entry(const std::string& archivePath,
+                   const std::string& entryPath,
+                   const std::string& destinationPath,
+                   ProgressInfo& progress,
+                   const ProgressCallback& callback,
+                   Error& err,
+                   const Options& opts) {
+    progress = {};
+    err = {};
+
+    const std::string wanted = sanitize_path(entryPath.c_str());
+    if (archivePath.empty() || destinationPath.empty() || wanted.empty()) {
+        err.code = EINVAL;
+        err.message = "Invalid archive, member or destination path";
+        return false;
+    }
+
+    Fd fd(::open(archivePath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+
+    // Indexed tar.zst: decode from the frame holding the member's header onwards only.
+    IndexedSource source;
+    Error indexErr;
+    if (source.reader.open(fd.fd, indexErr)) {
+        const ZstdSeekable::IndexEntry* member = source.reader.find(wanted);
+        if (!member) {
+            err.code = ENOENT;
+            err.message = "No such member in archive: " + wanted;
+            return false;
+        }
+        struct archive* ar = nullptr;
+        if (!open_indexed_member(source, member->offset, ar, err)) {
+            return false;
+        }
+        archive_entry* entry = nullptr;
+        bool ok = false;
+        if (archive_read_next_header(ar, &entry) != ARCHIVE_OK) {
+            set_archive_error(err, ar, "archive_read_next_header");
+            if (source.error.isSet()) {
+                err = source.error;
+            }
+        }
+        else if (sanitize_path(archive_entry_pathname(entry)) != wanted) {
+            err.code = EBADMSG;
+            err.message = "Archive index does not match member " + wanted;
+        }
+        else {
+            ok = extract_single(ar, entry, destinationPath, opts, progress, callback, err);
+        }
+        archive_read_close(ar);
+        archive_read_free(ar);
+        return ok;
+    }
+
+    struct archive* ar = nullptr;
+    if (!open_reader(archivePath, opts, ar, err)) {
+        return false;
+    }
+    archive_entry* entry = nullptr;
+    int r = ARCHIVE_OK;
+    bool ok = false;
+    while ((r = archive_read_next_header(ar, &entry)) == ARCHIVE_OK) {
+        if (sanitize_path(archive_entry_pathname(entry)) == wanted) {
+            ok = extract_single(ar, entry, destinationPath, opts, progress, callback, err);
+            break;
+        }
+        archive_read_data_skip(ar);
+    }
+    if (r == ARCHIVE_EOF) {
+        err.code = ENOENT;
+        err.message = "No such member in archive: " + wanted;
+    }
+    else if (r != ARCHIVE_OK) {
+        set_archive_error(err, ar, "archive_read_next_header");
+    }
+    archive_read_close(ar);
+    archive_read_free(ar);
+    return ok;
+}
+
+bool extract_archive(const std::string& archivePath,
+                     const std::string& destinationDir,
+                     ProgressInfo& progress,
+                     const ProgressCallback& callback,
+                     Error& err,
+                     const Options& opts) {
+    progress = {};
+    err = {};
+
+    if (archivePath.empty() || destinationDir.empty()) {
+        err.code = EINVAL;
+        err.message = "Invalid archive or destination path";
+        return false;
+    }
+
+    if (!ensure_destination_root(destinationDir, err)) {
+        return false;
+    }
+
+    std::unique_ptr<Deduper> dedup;
+    if (opts.dedupMembers) {
+        dedup = std::make_unique<Deduper>();
+    }
+
+    // Zip: the central directory has the totals up front and leads straight to every member.
+    ZipDirectory::Reader zip;
+    if (open_zip(archivePath, zip)) {
+        ZipPlan plan;
+        const bool ok = plan_zip(zip, MemberFilter(), plan, progress, err) &&
+                        extract_zip(zip, plan, destinationDir, opts, progress, callback, err, dedup.get());
+        if (!ok) {
+            FsOps::Error cleanupErr;
+            ProgressInfo cleanupProg;
+            FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
+        }
+        return ok;
+    }
+
+    ProgressInfo scanProgress;
+    ScanResult scan;
+    if (!scan_archive(archivePath, opts, scanProgress, scan, err)) {
+        FsOps::Error cleanupErr;
+        ProgressInfo cleanupProg;
+        FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
+        return false;
+    }
+    progress.bytesTotal = scanProgress.bytesTotal;
+    progress.filesTotal = scanProgress.filesTotal;
+
+    const unsigned threads = member_thread_count(opts, scan);
+    if (threads > 1 && !extract_members_parallel(archivePath, destinationDir, opts, scan, threads, progress, callback,
+                                                 err, dedup.get())) {
+        FsOps::Error cleanupErr;
+        ProgressInfo cleanupProg;
+        FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
+        return false;
+    }
+
+    struct archive* ar = nullptr;
+    if (!open_reader(archivePath, opts, ar, err)) {
+        FsOps::Error cleanupErr;
+        ProgressInfo cleanupProg;
+        FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
+        return false;
+    }
+
+    bool ok = extract_entries(ar, destinationDir, opts, threads > 1, progress, callback, err, dedup.get());
+    archive_read_close(ar);
+    archive_read_free(ar);
+
+    if (!ok) {
+        FsOps::Error cleanupErr;
+        ProgressInfo cleanupProg;
+        FsOps::delete_path(destinationDir, cleanupProg, ProgressCallback(), cleanupErr);
     }
 
     return ok;
 }
 
+bool extract_members(const std::string& archivePath,
+                     const std::vector<std::string>& members,
+                     const std::string& destinationDir,
+                     ProgressInfo& progress,
+                     const ProgressCallback& callback,
+                     Error& err,
+                     const Options& opts) {
+    progress = {};
+    err = {};
+
+    std::unordered_set<std::string> wanted;
+    for (const std::string& member : members) {
+        std::string rel = sanitize_path(member.c_str());
+        if (rel.empty()) {
+            err.code = EINVAL;
+            err.message = "Invalid member path: " + member;
+            return false;
+        }
+        wanted.insert(std::move(rel));
+    }
+    if (archivePath.empty() || destinationDir.empty() || wanted.empty()) {
+        err.code = EINVAL;
+        err.message = "Invalid archive, member or destination path";
+        return false;
+    }
+    if (!FsOps::make_dir_parents(destinationDir, err)) {
+        return false;
+    }
+
+    // A member is selected when it or one of the directories above it was asked for.
+    std::unordered_set<std::string> matched;
+    const MemberFilter select = [&wanted, &matched](const std::string& rel) {
+        for (std::string p = rel; !p.empty(); p = parent_dir(p)) {
+            if (wanted.count(p)) {
+                matched.insert(p);
+                return true;
+            }
+        }
+        return false;
+    };
+    const auto allMatched = [&wanted, &matched, &err]() {
+        for (const std::string& w : wanted) {
+            if (!matched.count(w)) {
+                err.code = ENOENT;
+                err.message = "No such member in archive: " + w;
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::unique_ptr<Deduper> dedup;
+    if (opts.dedupMembers) {
+        dedup = std::make_unique<Deduper>();
+    }
+
+    ZipDirectory::Reader zip;
+    if (open_zip(archivePath, zip)) {
+        ZipPlan plan;
+        return plan_zip(zip, select, plan, progress, err) && allMatched() &&
+               extract_zip(zip, plan, destinationDir, opts, progress, callback, err, dedup.get());
+    }
+
+    Fd fd(::open(archivePath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+    std::vector<DeferredDir> dirs;
+
+    // Indexed tar.zst: decode from the frame holding each selected header; a run of selected
+    // members is read through one reader.
+    IndexedSource source;
+    Error indexErr;
+    if (source.reader.open(fd.fd, indexErr)) {
+        const auto& entries = source.reader.entries();
+        std::vector<bool> picked(entries.size(), false);
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            if (!select(sanitize_path(entries[i].path.c_str()))) {
+                continue;
+            }
+            picked[i] = true;
+            progress.filesTotal += 1;
+            if (S_ISREG(entries[i].mode) && entries[i].linkTarget.empty()) {
+                progress.bytesTotal += entries[i].size;
+            }
+        }
+        if (!allMatched()) {
+            return false;
+        }
+
+        struct archive* ar = nullptr;
+        std::size_t at = 0;  // index of the header |ar| reads next
+        bool ok = true;
+        for (std::size_t i = 0; i < entries.size() && ok; ++i) {
+            if (!picked[i]) {
+                continue;
+            }
+            if (!ar || at != i) {
+                if (ar) {
+                    archive_read_close(ar);
+                    archive_read_free(ar);
+                    ar = nullptr;
+                }
+                if (!open_indexed_member(source, entries[i].offset, ar, err)) {
+                    return false;
+                }
+                at = i;
+            }
+            archive_entry* entry = nullptr;
+            if (archive_read_next_header(ar, &entry) != ARCHIVE_OK) {
+                set_archive_error(err, ar, "archive_read_next_header");
+                if (source.error.isSet()) {
+                    err = source.error;
+                }
+                ok = false;
+                break;
+            }
+            ++at;
+            const std::string rel = sanitize_path(archive_entry_pathname(entry));
+            if (rel != sanitize_path(entries[i].path.c_str())) {
+                err.code = EBADMSG;
+                err.message = "Archive index does not match member " + rel;
+                ok = false;
+                break;
+            }
+            progress.currentPath = rel;
+            if (!should_continue(callback, progress)) {
+                err.code = ECANCELED;
+                err.message = "Cancelled";
+                ok = false;
+                break;
+            }
+            ok = extract_member(ar, entry, destinationDir + '/' + rel, rel, destinationDir, opts, progress, callback,
+                                err, dedup.get(), &dirs);
+        }
+        if (ar) {
+            archive_read_close(ar);
+            archive_read_free(ar);
+        }
+        if (ok) {
+            for (const DeferredDir& dir : dirs) {
+                apply_metadata(-1, dir.fullPath, dir.entry.get(), opts, false);
+            }
+        }
+        return ok;
+    }
+
+    // Anything else is streamed once; totals grow as selected members turn up.
+    struct archive* ar = nullptr;
+    if (!open_reader(archivePath, opts, ar, err)) {
+        return false;
+    }
+    archive_entry* entry = nullptr;
+    int r = ARCHIVE_OK;
+    bool ok = true;
+    while ((r = archive_read_next_header(ar, &entry)) == ARCHIVE_OK) {
+        const std::string rel = sanitize_path(archive_entry_pathname(entry));
+        if (rel.empty() || !select(rel)) {
+            archive_read_data_skip(ar);
+            continue;
+        }
+        progress.filesTotal += 1;
+        if (archive_entry_filetype(entry) == AE_IFREG && archive_entry_size_is_set(entry)) {
+            progress.bytesTotal += static_cast<std::uint64_t>(archive_entry_size(entry));
+        }
+        progress.currentPath = rel;
+        if (!should_continue(callback, progress)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            ok = false;
+            break;
+        }
+        if (!extract_member(ar, entry, destinationDir + '/' + rel, rel, destinationDir, opts, progress, callback, err,
+                            dedup.get(), &dirs)) {
+            ok = false;
+            break;
+        }
+    }
+    if (ok && r != ARCHIVE_EOF) {
+        set_archive_error(err, ar, "archive_read_next_header");
+        ok = false;
+    }
+    archive_read_close(ar);
+    archive_read_free(ar);
+    if (ok) {
+        for (const DeferredDir& dir : dirs) {
+            apply_metadata(-1, dir.fullPath, dir.entry.get(), opts, false);
+        }
+    }
+    return ok && allMatched();
+}
+
 }  // namespace PCManFM::ArchiveExtract
@@ -8,7 +8,12 @@
 
 #include "fs_ops.h"
 
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
+
+#include <sys/types.h>
 
 namespace PCManFM::ArchiveExtract {
 
@@ -20,11 +25,33 @@ struct Options {
     bool keepSymlinks = true;
     bool enableFilterThreads = true;
     unsigned maxFilterThreads = 0;  // 0 = use hardware_concurrency or libarchive default
+    unsigned memberThreads = 0;     // readers for uncompressed zip/7z/iso; 0 = auto, 1 = sequential
+    bool dedupMembers = false;      // reflink (or hardlink) byte-identical regular files to one copy
+    unsigned writerThreads = 0;     // file writers behind a sequential decoder; 0 = auto, 1 = inline
 };
 
 // Extracts a wide range of archive formats (zip, tar/tgz/tbz2/txz/tzst/tlz4, cpio, ar, 7z, iso,
 // xar, rpm, deb, etc.) into |destinationDir|. The destination directory must not already exist.
 // Progress/cancel semantics match FsOps: the callback can return false to request cancellation.
+// A zip whose members are all stored or deflated is read through its central directory, which
+// gives the totals before the first byte is written; directories are created first, regular
+// files are decoded by several threads straight from their local headers, then come symlinks.
+// Other random-access archives (zip, 7z, iso9660 without an outer compression filter) are
+// unpacked by several readers, each opening the archive itself and decoding a disjoint run of
+// regular files; directories, links and directory metadata are applied afterwards in one
+// sequential pass. The callback is never invoked concurrently, but may run on a worker thread
+// in either mode.
+// Everything else (tar behind any filter, cpio, ...) is decoded by one thread, which copies the
+// data of each regular file of up to 8 MiB out and leaves creating, writing and the metadata of
+// the file to writer threads; larger files, links and directories stay on the decoding thread.
+// Two members of one path are never written at once, so the later one still wins. Directory
+// metadata is applied last, once every file below it has been written.
+// With |dedupMembers| every regular file is hashed (BLAKE3) while it streams; a member whose
+// contents match a file already written is cloned from it (FICLONE), or hard-linked to it when
+// the filesystem cannot clone and all its metadata matches. Files of up to 4 MiB are held in
+// memory while a same-size original exists, so those duplicates are never written at all.
+// Hard-linked duplicates share one inode: editing one edits all of them. Which member becomes
+// the original depends on archive order, so dedup keeps the writes on the decoding thread.
 bool extract_archive(const std::string& archivePath,
                      const std::string& destinationDir,
                      FsOps::ProgressInfo& progress,
@@ -32,6 +59,54 @@ bool extract_archive(const std::string& archivePath,
                      FsOps::Error& err,
                      const Options& opts = {});
 
+// One archive member as seen by list_entries(). |mode| includes the file type bits as in
+// st_mode; |linkTarget| is the symlink target, or for hardlinks the member linked to.
+struct EntryInfo {
+    std::string path;
+    std::string linkTarget;
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    mode_t mode = 0;
+    bool hardlink = false;
+};
+
+// Returning false from the callback stops the listing early; that is not an error.
+using EntryCallback = std::function<bool(const EntryInfo&)>;
+
+// Reports every member of |archivePath| without writing anything. Archives written by
+// ArchiveWriter::create_tar_zst are listed from their member index without decompressing;
+// anything else is streamed header by header with the payload skipped.
+bool list_entries(const std::string& archivePath,
+                  const EntryCallback& callback,
+                  FsOps::Error& err,
+                  const Options& opts = {});
+
+// Extracts the single member |entryPath| (as reported by list_entries) to |destinationPath|.
+// For indexed tar.zst archives only the frames holding that member are decoded; other formats
+// are read up to the member. Fails with ENOENT when the archive has no such member.
+bool extract_entry(const std::string& archivePath,
+                   const std::string& entryPath,
+                   const std::string& destinationPath,
+                   FsOps::ProgressInfo& progress,
+                   const FsOps::ProgressCallback& callback,
+                   FsOps::Error& err,
+                   const Options& opts = {});
+
+// Extracts the members named in |members| (paths as reported by list_entries) below
+// |destinationDir|, keeping their paths inside the archive; naming a directory selects
+// everything below it. The destination is created when missing and may already exist. Zip
+// members are reached through the central directory and indexed tar.zst members from the frames
+// holding them, so neither reads the rest of the archive and both know the totals up front; any
+// other format is streamed once with the unselected members skipped. Fails with ENOENT when a
+// name matches no member; for zip and indexed tar.zst that is found before anything is written.
+bool extract_members(const std::string& archivePath,
+                     const std::vector<std::string>& members,
+                     const std::string& destinationDir,
+                     FsOps::ProgressInfo& progress,
+                     const FsOps::ProgressCallback& callback,
+                     FsOps::Error& err,
+                     const Options& opts = {});
+
 }  // namespace PCManFM::ArchiveExtract
 
 #endif  // PCMANFM_ARCHIVE_EXTRACT_H
@@ -5,18 +5,30 @@
 
 #include "archive_writer.h"
 
+#include "zstd_seekable.h"
+
 #include <archive.h>
 #include <archive_entry.h>
+#include <zlib.h>
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
+#include <condition_variable>
 #include <cstring>
+#include <ctime>
+#include <deque>
 #include <dirent.h>
 #include <fcntl.h>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <string_view>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace PCManFM::ArchiveWriter {
 
@@ -100,29 +112,56 @@ bool ensure_parent_dirs(const std::string& path, Error& err) {
     return FsOps::make_dir_parents(parent, err);
 }
 
-bool accumulate_size(const std::string& path, std::uint64_t& totalBytes, int depth, Error& err) {
+// One archive member in write order, recorded by the tree walk before writing starts so
+// the prefetch readers know which files come next.
+struct Member {
+    std::string path;
+    std::string relPath;
+    struct stat st{};
+    std::string linkTarget;
+};
+
+bool collect_members(const std::string& path,
+                     const std::string& base,
+                     std::vector<Member>& members,
+                     std::uint64_t& totalBytes,
+                     int depth,
+                     Error& err) {
     if (depth > FsOps::kMaxRecursionDepth) {
         err.code = ELOOP;
         err.message = "Maximum recursion depth exceeded";
         return false;
     }
-    struct stat st{};
-    if (::lstat(path.c_str(), &st) != 0) {
+    Member member;
+    if (::lstat(path.c_str(), &member.st) != 0) {
         set_error(err, "lstat");
         return false;
     }
-    if (S_ISREG(st.st_mode)) {
-        totalBytes += static_cast<std::uint64_t>(st.st_size);
-        return true;
-    }
-    if (S_ISLNK(st.st_mode)) {
-        return true;  // track but no data payload
-    }
-    if (!S_ISDIR(st.st_mode)) {
+    const mode_t mode = member.st.st_mode;
+    if (!S_ISREG(mode) && !S_ISLNK(mode) && !S_ISDIR(mode)) {
         err.code = ENOTSUP;
         err.message = "Unsupported file type";
         return false;
     }
+    member.path = path;
+    member.relPath = relative_path(path, base);
+    if (S_ISREG(mode)) {
+        totalBytes += static_cast<std::uint64_t>(member.st.st_size);
+    }
+    else if (S_ISLNK(mode)) {
+        std::string target(static_cast<std::size_t>(member.st.st_size) + 1, '\0');
+        const ssize_t len = ::readlink(path.c_str(), target.data(), target.size());
+        if (len < 0) {
+            set_error(err, "readlink");
+            return false;
+        }
+        target.resize(static_cast<std::size_t>(len));
+        member.linkTarget = std::move(target);
+    }
+    members.push_back(std::move(member));
+    if (!S_ISDIR(mode)) {
+        return true;
+    }
 
     Fd dir_fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY));
     if (!dir_fd.valid()) {
@@ -157,7 +196,7 @@ bool accumulate_size(const std::string& path, std::uint64_t& totalBytes, int dep
             child.push_back('/');
         }
         child += name;
-        if (!accumulate_size(child, totalBytes, depth + 1, err)) {
+        if (!collect_members(child, base, members, totalBytes, depth + 1, err)) {
             ::closedir(dir);
             return false;
         }
@@ -166,27 +205,251 @@ bool accumulate_size(const std::string& path, std::uint64_t& totalBytes, int dep
     return true;
 }
 
-bool write_entry(struct archive* ar,
-                 const std::string& path,
-                 const std::string& base,
-                 ProgressInfo& progress,
-                 const ProgressCallback& cb,
-                 Error& err,
-                 int depth) {
-    if (depth > FsOps::kMaxRecursionDepth) {
-        err.code = ELOOP;
-        err.message = "Maximum recursion depth exceeded";
-        return false;
+constexpr std::size_t kPrefetchChunk = 128 * 1024;
+constexpr std::size_t kDefaultPrefetchBytes = 8 * 1024 * 1024;
+constexpr unsigned kDefaultReaderThreads = 4;
+// Buffers only the reader of the member being archived may take. Readers further ahead
+// can fill the rest of the pool but never these, so the archive thread cannot end up
+// waiting on a member whose reader is starved by files it will only reach later.
+constexpr std::size_t kHeadReserve = 2;
+
+struct Chunk {
+    std::unique_ptr<char[]> data;
+    std::size_t len = 0;
+};
+
+// Opens, reads and queues the regular files of |members| ahead of the archive thread, in
+// member order, on a few reader threads sharing a bounded pool of buffers. Open and read
+// latency (a network mount, a cold disk) then overlaps with compression instead of
+// stalling it once per file.
+class Prefetcher {
+   public:
+    Prefetcher(const std::vector<Member>& members, unsigned threads, std::size_t budgetBytes) : members_(members) {
+        std::size_t files = 0;
+        for (const auto& m : members_) {
+            files += S_ISREG(m.st.st_mode) ? 1 : 0;
+        }
+        const std::size_t buffers = std::max(budgetBytes / kPrefetchChunk, kHeadReserve + 1);
+        wakeThreshold_ = std::max<std::size_t>(buffers / 4, kHeadReserve + 1);
+        free_.reserve(buffers);
+        for (std::size_t i = 0; i < buffers; ++i) {
+            free_.push_back(std::make_unique<char[]>(kPrefetchChunk));
+        }
+        const std::size_t count = std::min<std::size_t>(threads, files);
+        threads_.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            threads_.emplace_back([this] { run(); });
+        }
     }
 
-    struct stat st{};
-    if (::lstat(path.c_str(), &st) != 0) {
-        set_error(err, "lstat");
-        return false;
+    ~Prefetcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        bufferFree_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    // Hands out the next chunk of regular member |index| in file order; chunk.len == 0 marks
+    // the end of the file. Members must be consumed in order. Fails with the reader's
+    // open/read error.
+    bool next(std::size_t index, Chunk& chunk, Error& err) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (head_ != index) {
+            head_ = index;
+            if (headReaderWaiting()) {
+                bufferFree_.notify_all();  // the new head's reader may take the reserve
+            }
+        }
+        for (;;) {
+            auto it = slots_.find(index);
+            if (it != slots_.end()) {
+                Slot& slot = it->second;
+                if (!slot.chunks.empty()) {
+                    chunk = std::move(slot.chunks.front());
+                    slot.chunks.pop_front();
+                    return true;
+                }
+                if (slot.done) {
+                    const Error error = slot.error;
+                    slots_.erase(it);
+                    if (error.isSet()) {
+                        err = error;
+                        return false;
+                    }
+                    chunk.len = 0;
+                    return true;
+                }
+            }
+            consumerWaiting_ = true;
+            dataReady_.wait(lock);
+            consumerWaiting_ = false;
+        }
+    }
+
+    void release(Chunk& chunk) {
+        if (!chunk.data) {
+            return;
+        }
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(std::move(chunk.data));
+            // Readers ahead are woken in batches; waking them per buffer costs more context
+            // switches than the read-ahead saves on a busy core.
+            wake = !waiting_.empty() && (free_.size() >= wakeThreshold_ || headReaderWaiting());
+        }
+        chunk.len = 0;
+        if (wake) {
+            bufferFree_.notify_all();
+        }
+    }
+
+   private:
+    struct Slot {
+        std::deque<Chunk> chunks;
+        bool done = false;
+        Error error;
+    };
+
+    void run() {
+        for (;;) {
+            std::size_t index = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                while (next_ < members_.size() && !S_ISREG(members_[next_].st.st_mode)) {
+                    ++next_;
+                }
+                if (stop_ || next_ == members_.size()) {
+                    return;
+                }
+                index = next_++;
+                slots_[index];
+            }
+            if (!readFile(index)) {
+                return;  // stopping
+            }
+        }
+    }
+
+    // False only when the pipeline is shutting down; file errors are queued for next().
+    bool readFile(std::size_t index) {
+        Error error;
+        Fd fd(::open(members_[index].path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+        if (!fd.valid()) {
+            set_error(error, "open");
+            finish(index, error);
+            return true;
+        }
+        ::posix_fadvise(fd.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        for (;;) {
+            Chunk chunk;
+            if (!acquire(index, chunk)) {
+                return false;
+            }
+            ssize_t n;
+            do {
+                n = ::read(fd.fd, chunk.data.get(), kPrefetchChunk);
+            } while (n < 0 && errno == EINTR);
+            if (n <= 0) {
+                if (n < 0) {
+                    set_error(error, "read");
+                }
+                release(chunk);
+                finish(index, error);
+                return true;
+            }
+            chunk.len = static_cast<std::size_t>(n);
+            publish(index, std::move(chunk), nullptr);
+        }
+    }
+
+    bool acquire(std::size_t index, Chunk& chunk) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_.push_back(index);
+        bufferFree_.wait(lock, [&] { return stop_ || free_.size() > (index == head_ ? 0 : kHeadReserve); });
+        waiting_.erase(std::find(waiting_.begin(), waiting_.end(), index));
+        if (stop_) {
+            return false;
+        }
+        chunk.data = std::move(free_.back());
+        free_.pop_back();
+        return true;
+    }
+
+    bool headReaderWaiting() const { return std::find(waiting_.begin(), waiting_.end(), head_) != waiting_.end(); }
+
+    void finish(std::size_t index, const Error& error) { publish(index, Chunk{}, &error); }
+
+    // Queues |chunk| for the archive thread, or marks the file done when |error| is given.
+    void publish(std::size_t index, Chunk chunk, const Error* error) {
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Slot& slot = slots_[index];
+            if (error) {
+                slot.done = true;
+                slot.error = *error;
+            }
+            else {
+                slot.chunks.push_back(std::move(chunk));
+            }
+            wake = consumerWaiting_ && index == head_;
+        }
+        if (wake) {
+            dataReady_.notify_one();
+        }
+    }
+
+    const std::vector<Member>& members_;
+    std::mutex mutex_;
+    std::condition_variable dataReady_;   // archive thread waits for the head file
+    std::condition_variable bufferFree_;  // readers wait for a pool buffer
+    std::vector<std::unique_ptr<char[]>> free_;
+    std::unordered_map<std::size_t, Slot> slots_;  // files handed to a reader and not yet consumed
+    std::size_t next_ = 0;                          // next member to hand to a reader
+    std::size_t head_ = 0;                          // member the archive thread is writing
+    std::vector<std::size_t> waiting_;  // files whose readers wait for a buffer
+    std::size_t wakeThreshold_ = 0;
+    bool consumerWaiting_ = false;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
+
+// Closes the previous member (so its padding is on the stream) and notes where the next
+// header starts in the member index.
+void record_member(struct archive* ar, ZstdSeekable::Writer* index, const Member& member) {
+    if (!index) {
+        return;
     }
+    archive_write_finish_entry(ar);
+    ZstdSeekable::IndexEntry e;
+    e.path = member.relPath;
+    e.linkTarget = member.linkTarget;
+    e.size = S_ISREG(member.st.st_mode) ? static_cast<std::uint64_t>(member.st.st_size) : 0;
+    e.offset = index->offset();
+    e.mtime = member.st.st_mtime;
+    e.mode = member.st.st_mode;
+    index->addEntry(std::move(e));
+}
 
-    const std::string relPath = relative_path(path, base);
-    progress.currentPath = relPath;
+bool write_member(struct archive* ar,
+                  const std::vector<Member>& members,
+                  std::size_t i,
+                  Prefetcher& prefetch,
+                  ProgressInfo& progress,
+                  const ProgressCallback& cb,
+                  Error& err,
+                  ZstdSeekable::Writer* index) {
+    const Member& member = members[i];
+    const struct stat& st = member.st;
+    progress.currentPath = member.relPath;
     if (!should_continue(cb, progress)) {
         err.code = ECANCELED;
         err.message = "Cancelled";
@@ -200,129 +463,51 @@ bool write_entry(struct archive* ar,
         return false;
     }
 
-    archive_entry_set_pathname(entry, relPath.c_str());
+    archive_entry_set_pathname(entry, member.relPath.c_str());
     archive_entry_set_perm(entry, st.st_mode & 07777);
     archive_entry_set_uid(entry, st.st_uid);
     archive_entry_set_gid(entry, st.st_gid);
     archive_entry_set_mtime(entry, st.st_mtime, 0);
     archive_entry_set_atime(entry, st.st_atime, 0);
-
     if (S_ISDIR(st.st_mode)) {
         archive_entry_set_filetype(entry, AE_IFDIR);
         archive_entry_set_size(entry, 0);
-        if (archive_write_header(ar, entry) != ARCHIVE_OK) {
-            set_archive_error(err, ar, "archive_write_header");
-            archive_entry_free(entry);
-            return false;
-        }
-        archive_entry_free(entry);
-        progress.filesDone += 1;
-
-        Fd dir_fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY));
-        if (!dir_fd.valid()) {
-            set_error(err, "open");
-            return false;
-        }
-        DIR* dir = ::fdopendir(dir_fd.fd);
-        if (!dir) {
-            set_error(err, "fdopendir");
-            return false;
-        }
-        dir_fd.fd = -1;
-
-        for (;;) {
-            errno = 0;
-            dirent* ent = ::readdir(dir);
-            if (!ent) {
-                if (errno != 0) {
-                    set_error(err, "readdir");
-                    ::closedir(dir);
-                    return false;
-                }
-                break;
-            }
-            const char* name = ent->d_name;
-            if (!name || name[0] == '\0' || std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
-                continue;
-            }
-            std::string child = path;
-            if (child.back() != '/') {
-                child.push_back('/');
-            }
-            child += name;
-            if (!write_entry(ar, child, base, progress, cb, err, depth + 1)) {
-                ::closedir(dir);
-                return false;
-            }
-        }
-        ::closedir(dir);
-        return true;
     }
-
-    if (S_ISLNK(st.st_mode)) {
-        std::string target(static_cast<std::size_t>(st.st_size) + 1, '\0');
-        const ssize_t len = ::readlink(path.c_str(), target.data(), target.size());
-        if (len < 0) {
-            set_error(err, "readlink");
-            archive_entry_free(entry);
-            return false;
-        }
-        target.resize(static_cast<std::size_t>(len));
+    else if (S_ISLNK(st.st_mode)) {
         archive_entry_set_filetype(entry, AE_IFLNK);
         archive_entry_set_size(entry, 0);
-        archive_entry_set_symlink(entry, target.c_str());
-
-        if (archive_write_header(ar, entry) != ARCHIVE_OK) {
-            set_archive_error(err, ar, "archive_write_header");
-            archive_entry_free(entry);
-            return false;
-        }
-        archive_entry_free(entry);
-        progress.filesDone += 1;
-        return true;
+        archive_entry_set_symlink(entry, member.linkTarget.c_str());
     }
-
-    if (!S_ISREG(st.st_mode)) {
-        archive_entry_free(entry);
-        err.code = ENOTSUP;
-        err.message = "Unsupported file type";
-        return false;
+    else {
+        archive_entry_set_filetype(entry, AE_IFREG);
+        archive_entry_set_size(entry, st.st_size);
     }
 
-    archive_entry_set_filetype(entry, AE_IFREG);
-    archive_entry_set_size(entry, st.st_size);
-
+    record_member(ar, index, member);
     if (archive_write_header(ar, entry) != ARCHIVE_OK) {
         set_archive_error(err, ar, "archive_write_header");
         archive_entry_free(entry);
         return false;
     }
-
-    Fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
-    if (!fd.valid()) {
-        set_error(err, "open");
-        archive_entry_free(entry);
-        return false;
+    archive_entry_free(entry);
+    if (!S_ISREG(st.st_mode)) {
+        progress.filesDone += 1;
+        return true;
     }
 
-    std::array<char, 128 * 1024> buffer{};
     for (;;) {
-        const ssize_t n = ::read(fd.fd, buffer.data(), buffer.size());
-        if (n < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            set_error(err, "read");
-            archive_entry_free(entry);
+        Chunk chunk;
+        if (!prefetch.next(i, chunk, err)) {
             return false;
         }
-        if (n == 0) {
+        if (chunk.len == 0) {
             break;
         }
-
-        if (archive_write_data(ar, buffer.data(), static_cast<std::size_t>(n)) < 0) {
+        const bool written = archive_write_data(ar, chunk.data.get(), chunk.len) >= 0;
+        const std::size_t n = chunk.len;
+        prefetch.release(chunk);
+        if (!written) {
             set_archive_error(err, ar, "archive_write_data");
-            archive_entry_free(entry);
             return false;
         }
 
@@ -330,23 +515,127 @@ bool write_entry(struct archive* ar,
         if (!should_continue(cb, progress)) {
             err.code = ECANCELED;
             err.message = "Cancelled";
-            archive_entry_free(entry);
             return false;
         }
     }
 
-    archive_entry_free(entry);
     progress.filesDone += 1;
     return true;
 }
 
+unsigned thread_count_from_opts(const Options& opts) {
+    if (!opts.enableFilterThreads) {
+        return 1;
+    }
+    if (opts.maxFilterThreads > 0) {
+        return opts.maxFilterThreads;
+    }
+    const unsigned hc = std::thread::hardware_concurrency();
+    return hc > 0 ? hc : 1;
+}
+
+// Applies |opts| to the zstd filter. An explicit level libarchive rejects is an error; the
+// thread count and window are dropped silently when this libarchive does not know them.
+bool configure_zstd(struct archive* ar, const Options& opts, Error& err) {
+    if (opts.compressionLevel != 0) {
+        const std::string level = std::to_string(opts.compressionLevel);
+        if (archive_write_set_filter_option(ar, "zstd", "compression-level", level.c_str()) < ARCHIVE_WARN) {
+            err.code = EINVAL;
+            err.message = "Unsupported zstd compression level " + level;
+            return false;
+        }
+    }
+
+    const unsigned threads = thread_count_from_opts(opts);
+    if (threads > 1) {
+        archive_write_set_filter_option(ar, "zstd", "threads", std::to_string(threads).c_str());
+    }
+    if (opts.longWindowLog > 0) {
+        archive_write_set_filter_option(ar, "zstd", "long", std::to_string(opts.longWindowLog).c_str());
+    }
+    return true;
+}
+
+// libarchive client that hands the uncompressed tar stream to the seekable writer.
+struct SeekableSink {
+    ZstdSeekable::Writer writer;
+    Error error;
+};
+
+la_ssize_t seekable_sink_write(struct archive* ar, void* client, const void* buffer, size_t length) {
+    auto* sink = static_cast<SeekableSink*>(client);
+    if (!sink->writer.write(buffer, length, sink->error)) {
+        archive_set_error(ar, sink->error.code, "%s", sink->error.message.c_str());
+        return -1;
+    }
+    return static_cast<la_ssize_t>(length);
+}
+
+ZstdSeekable::Writer::Params seekable_params(const Options& opts) {
+    ZstdSeekable::Writer::Params params;
+    params.level = opts.compressionLevel;
+    params.threads = thread_count_from_opts(opts);
+    params.windowLog = opts.longWindowLog;
+    if (opts.frameSize > 0) {
+        params.frameSize = opts.frameSize;
+    }
+    return params;
+}
+
+// libarchive only produces the tar stream; framing and compression happen in the sink.
+// Unblocked output keeps the sink's offset equal to the tar stream position.
+bool open_seekable_archive(struct archive* ar, SeekableSink& sink, Error& err) {
+    archive_write_add_filter_none(ar);
+    archive_write_set_bytes_per_block(ar, 0);
+    if (archive_write_open(ar, &sink, nullptr, seekable_sink_write, nullptr) != ARCHIVE_OK) {
+        set_archive_error(err, ar, "archive_write_open");
+        return false;
+    }
+    return true;
+}
+
+bool write_members(struct archive* ar,
+                   const std::vector<Member>& members,
+                   const Options& opts,
+                   ProgressInfo& progress,
+                   const ProgressCallback& callback,
+                   Error& err,
+                   ZstdSeekable::Writer* index) {
+    Prefetcher prefetch(members, opts.readerThreads > 0 ? opts.readerThreads : kDefaultReaderThreads,
+                        opts.prefetchBytes > 0 ? opts.prefetchBytes : kDefaultPrefetchBytes);
+    for (std::size_t i = 0; i < members.size(); ++i) {
+        if (!write_member(ar, members, i, prefetch, progress, callback, err, index)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Closes |ar|, which writes the tar end marker, frees it and completes the seekable stream
+// behind it. A failed sink write is reported rather than libarchive's wrapper of it.
+bool close_archive(struct archive* ar, SeekableSink* sink, bool ok, Error& err) {
+    if (archive_write_close(ar) != ARCHIVE_OK && ok) {
+        set_archive_error(err, ar, "archive_write_close");
+        ok = false;
+    }
+    archive_write_free(ar);
+    if (ok && sink && !sink->writer.finish(err)) {
+        ok = false;
+    }
+    if (!ok && sink && sink->error.isSet() && err.code == EIO) {
+        err = sink->error;
+    }
+    return ok;
+}
+
 }  // namespace
 
 bool create_tar_zst(const std::vector<std::string>& sources,
                     const std::string& destination,
                     ProgressInfo& progress,
                     const ProgressCallback& callback,
-                    Error& err) {
+                    Error& err,
+                    const Options& opts) {
     progress = {};
     err = {};
 
@@ -360,10 +649,12 @@ bool create_tar_zst(const std::vector<std::string>& sources,
         return false;
     }
 
-    // Pre-scan for total bytes to feed progress.
+    // Walk everything up front: the totals feed progress and the member list tells the
+    // prefetch readers what to open next.
+    std::vector<Member> members;
     std::uint64_t totalBytes = 0;
     for (const auto& src : sources) {
-        if (!accumulate_size(src, totalBytes, 0, err)) {
+        if (!collect_members(src, parent_dir(src), members, totalBytes, 0, err)) {
             return false;
         }
     }
@@ -383,33 +674,1047 @@ bool create_tar_zst(const std::vector<std::string>& sources,
     }
 
     archive_write_set_format_pax_restricted(ar);
-    if (archive_write_add_filter_by_name(ar, "zstd") != ARCHIVE_OK) {
-        archive_write_add_filter_none(ar);  // best-effort fallback
+    std::unique_ptr<SeekableSink> sink;
+    if (opts.seekable) {
+        sink = std::make_unique<SeekableSink>();
+        if (!sink->writer.open(out_fd.fd, seekable_params(opts), err) || !open_seekable_archive(ar, *sink, err)) {
+            archive_write_free(ar);
+            ::unlink(destination.c_str());
+            return false;
+        }
+    }
+    else {
+        if (archive_write_add_filter_by_name(ar, "zstd") != ARCHIVE_OK) {
+            archive_write_add_filter_none(ar);  // best-effort fallback
+        }
+        else if (!configure_zstd(ar, opts, err)) {
+            archive_write_free(ar);
+            ::unlink(destination.c_str());
+            return false;
+        }
+
+        if (archive_write_open_fd(ar, out_fd.fd) != ARCHIVE_OK) {
+            set_archive_error(err, ar, "archive_write_open_fd");
+            archive_write_free(ar);
+            return false;
+        }
     }
 
-    if (archive_write_open_fd(ar, out_fd.fd) != ARCHIVE_OK) {
-        set_archive_error(err, ar, "archive_write_open_fd");
-        archive_write_free(ar);
+    bool ok = write_members(ar, members, opts, progress, callback, err, sink ? &sink->writer : nullptr);
+    ok = close_archive(ar, sink.get(), ok, err);
+    if (!ok) {
+        ::unlink(destination.c_str());
+    }
+    return ok;
+}
+
+namespace {
+
+constexpr std::size_t kZipBlockSize = 1024 * 1024;  // input of one deflate job
+constexpr std::size_t kZipDictSize = 32 * 1024;     // deflate's window: a block is primed with this much
+constexpr unsigned kZipBlocksPerThread = 4;         // blocks compressed ahead of the writer, per thread
+constexpr std::size_t kZipOutputBuffer = 1024 * 1024;
+constexpr std::uint32_t kZip32Max = 0xffffffff;
+constexpr std::uint16_t kZip16Max = 0xffff;
+// Files this large get zip64 sizes in their local header, which is written before the
+// compressed size is known; the margin covers deflate's growth on incompressible data.
+constexpr std::uint64_t kZip64LocalThreshold = 0xf0000000;
+constexpr std::uint16_t kZipMadeBy = (3 << 8) | 45;  // Unix, zip 4.5
+constexpr std::uint16_t kZipMethodStore = 0;
+constexpr std::uint16_t kZipMethodDeflate = 8;
+constexpr std::uint16_t kZipFlagUtf8 = 1 << 11;
+
+// Extensions of formats that are compressed already; deflating them again costs CPU for
+// nothing.
+bool is_compressed_media(const std::string& path) {
+    static const std::unordered_set<std::string> kExtensions = {
+        "7z",   "aac",  "apk", "avi",  "avif", "br",   "bz2", "cab",  "deb", "docx", "epub", "flac",
+        "gif",  "gz",   "heic", "jar", "jpeg", "jpg",  "jxl", "lz",   "lz4", "lzma", "m4a",  "m4v",
+        "mkv",  "mov",  "mp3", "mp4",  "odp",  "ods",  "odt", "ogg",  "opus", "png", "pptx", "rar",
+        "rpm",  "tbz2", "tgz", "txz",  "webm", "webp", "whl", "xlsx", "xz",  "zip", "zst",
+    };
+    const auto slash = path.find_last_of('/');
+    const auto dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
         return false;
     }
+    std::string ext = path.substr(dot + 1);
+    for (char& c : ext) {
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return kExtensions.count(ext) != 0;
+}
 
-    bool ok = true;
-    for (const auto& src : sources) {
-        const std::string base = parent_dir(src);
-        if (!write_entry(ar, src, base, progress, callback, err, 0)) {
-            ok = false;
-            break;
+bool is_utf8(const std::string& s) {
+    for (std::size_t i = 0; i < s.size();) {
+        const auto c = static_cast<unsigned char>(s[i]);
+        const std::size_t len = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xe ? 3 : (c >> 3) == 0x1e ? 4 : 0;
+        if (len == 0 || i + len > s.size()) {
+            return false;
+        }
+        for (std::size_t k = 1; k < len; ++k) {
+            if ((static_cast<unsigned char>(s[i + k]) >> 6) != 0x2) {
+                return false;
+            }
         }
+        i += len;
     }
+    return true;
+}
 
-    if (archive_write_close(ar) != ARCHIVE_OK && ok) {
-        set_archive_error(err, ar, "archive_write_close");
-        ok = false;
+void put16(std::string& out, std::uint16_t v) {
+    out.push_back(static_cast<char>(v & 0xff));
+    out.push_back(static_cast<char>(v >> 8));
+}
+
+void put32(std::string& out, std::uint32_t v) {
+    put16(out, static_cast<std::uint16_t>(v & 0xffff));
+    put16(out, static_cast<std::uint16_t>(v >> 16));
+}
+
+void put64(std::string& out, std::uint64_t v) {
+    put32(out, static_cast<std::uint32_t>(v & 0xffffffff));
+    put32(out, static_cast<std::uint32_t>(v >> 32));
+}
+
+std::uint32_t clamp32(std::uint64_t v) {
+    return v >= kZip32Max ? kZip32Max : static_cast<std::uint32_t>(v);
+}
+
+// One run of a regular file for a compressor thread.
+struct ZipBlock {
+    std::size_t member = 0;
+    std::uint64_t offset = 0;
+    std::size_t size = 0;
+    bool last = false;
+    bool deflate = true;
+};
+
+struct ZipBlockResult {
+    std::string data;  // raw deflate, or the bytes themselves when stored
+    std::uint32_t crc = 0;
+    bool stored = false;
+    Error error;
+};
+
+// A member as the central directory will describe it.
+struct ZipEntry {
+    std::string name;
+    std::uint64_t headerOffset = 0;
+    std::uint16_t method = kZipMethodStore;
+    std::uint32_t crc = 0;
+    std::uint64_t compressedSize = 0;
+    std::uint64_t size = 0;
+    std::uint16_t dosTime = 0;
+    std::uint16_t dosDate = 0;
+    std::int64_t mtime = 0;
+    std::uint32_t externalAttrs = 0;
+    bool zip64Local = false;
+};
+
+void dos_time(std::time_t t, ZipEntry& e) {
+    struct tm tm{};
+    if (!::localtime_r(&t, &tm) || tm.tm_year < 80) {
+        e.dosDate = (1 << 5) | 1;  // 1980-01-01, the earliest a zip can say
+        e.dosTime = 0;
+        return;
     }
-    archive_write_free(ar);
+    const int year = std::min(tm.tm_year - 80, 127);
+    e.dosDate = static_cast<std::uint16_t>((year << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    e.dosTime = static_cast<std::uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+}
 
-    if (!ok) {
-        ::unlink(destination.c_str());
+bool fits_unix_time(std::int64_t t) {
+    return t >= std::numeric_limits<std::int32_t>::min() && t <= std::numeric_limits<std::int32_t>::max();
+}
+
+// The local header of |e|: a placeholder before the data, and the real one once the data is
+// written. Both have the same size.
+std::string local_header(const ZipEntry& e) {
+    std::string out;
+    put32(out, 0x04034b50);
+    put16(out, e.zip64Local ? 45 : 20);
+    put16(out, is_utf8(e.name) ? kZipFlagUtf8 : 0);
+    put16(out, e.method);
+    put16(out, e.dosTime);
+    put16(out, e.dosDate);
+    put32(out, e.crc);
+    put32(out, e.zip64Local ? kZip32Max : static_cast<std::uint32_t>(e.compressedSize));
+    put32(out, e.zip64Local ? kZip32Max : static_cast<std::uint32_t>(e.size));
+    put16(out, static_cast<std::uint16_t>(e.name.size()));
+    const bool ut = fits_unix_time(e.mtime);
+    put16(out, static_cast<std::uint16_t>((e.zip64Local ? 20 : 0) + (ut ? 9 : 0)));
+    out += e.name;
+    if (e.zip64Local) {
+        put16(out, 0x0001);
+        put16(out, 16);
+        put64(out, e.size);
+        put64(out, e.compressedSize);
+    }
+    if (ut) {
+        put16(out, 0x5455);  // extended timestamp: the modification time to the second
+        put16(out, 5);
+        out.push_back(1);
+        put32(out, static_cast<std::uint32_t>(e.mtime));
+    }
+    return out;
+}
+
+void central_header(const ZipEntry& e, std::string& out) {
+    std::string zip64;
+    if (e.size >= kZip32Max || e.zip64Local) {
+        put64(zip64, e.size);
+    }
+    if (e.compressedSize >= kZip32Max || e.zip64Local) {
+        put64(zip64, e.compressedSize);
+    }
+    if (e.headerOffset >= kZip32Max) {
+        put64(zip64, e.headerOffset);
+    }
+    const bool ut = fits_unix_time(e.mtime);
+    put32(out, 0x02014b50);
+    put16(out, kZipMadeBy);
+    put16(out, zip64.empty() ? 20 : 45);
+    put16(out, is_utf8(e.name) ? kZipFlagUtf8 : 0);
+    put16(out, e.method);
+    put16(out, e.dosTime);
+    put16(out, e.dosDate);
+    put32(out, e.crc);
+    put32(out, e.zip64Local ? kZip32Max : clamp32(e.compressedSize));
+    put32(out, e.zip64Local ? kZip32Max : clamp32(e.size));
+    put16(out, static_cast<std::uint16_t>(e.name.size()));
+    put16(out, static_cast<std::uint16_t>((zip64.empty() ? 0 : 4 + zip64.size()) + (ut ? 9 : 0)));
+    put16(out, 0);  // comment
+    put16(out, 0);  // disk
+    put16(out, 0);  // internal attributes
+    put32(out, e.externalAttrs);
+    put32(out, clamp32(e.headerOffset));
+    out += e.name;
+    if (!zip64.empty()) {
+        put16(out, 0x0001);
+        put16(out, static_cast<std::uint16_t>(zip64.size()));
+        out += zip64;
+    }
+    if (ut) {
+        put16(out, 0x5455);
+        put16(out, 5);
+        out.push_back(1);
+        put32(out, static_cast<std::uint32_t>(e.mtime));
+    }
+}
+
+bool write_all_fd(int fd, const char* data, std::size_t size, Error& err) {
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error(err, "write");
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Buffered sequential output that knows its offset and can rewrite what it wrote before.
+class ZipOutput {
+   public:
+    explicit ZipOutput(int fd) : fd_(fd) {}
+
+    std::uint64_t offset() const { return offset_; }
+
+    bool write(const char* data, std::size_t size, Error& err) {
+        offset_ += size;
+        if (buffer_.size() + size > kZipOutputBuffer && !flush(err)) {
+            return false;
+        }
+        if (size >= kZipOutputBuffer) {
+            return write_all_fd(fd_, data, size, err);
+        }
+        buffer_.append(data, size);
+        return true;
+    }
+
+    bool write(const std::string& data, Error& err) { return write(data.data(), data.size(), err); }
+
+    bool patch(std::uint64_t offset, const std::string& data, Error& err) {
+        if (!flush(err)) {
+            return false;
+        }
+        std::size_t done = 0;
+        while (done < data.size()) {
+            const ssize_t n = ::pwrite(fd_, data.data() + done, data.size() - done, static_cast<off_t>(offset + done));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                set_error(err, "pwrite");
+                return false;
+            }
+            done += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool flush(Error& err) {
+        const bool ok = write_all_fd(fd_, buffer_.data(), buffer_.size(), err);
+        buffer_.clear();
+        return ok;
+    }
+
+   private:
+    int fd_;
+    std::uint64_t offset_ = 0;
+    std::string buffer_;
+};
+
+// Reads and deflates the blocks of the regular members on a few threads, at most a window of
+// blocks ahead of the writer, which takes the results in order. A block other than the first
+// of its file is primed with the 32 KiB before it and every block but a file's last ends on a
+// sync flush, so the deflate streams of a file's blocks concatenate into one.
+class ZipCompressor {
+   public:
+    ZipCompressor(const std::vector<Member>& members, const std::vector<ZipBlock>& blocks, int level, unsigned threads)
+        : members_(members), blocks_(blocks), level_(level), window_(std::size_t{threads} * kZipBlocksPerThread) {
+        const std::size_t count = std::min<std::size_t>(threads, blocks_.size());
+        threads_.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~ZipCompressor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        ahead_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    ZipCompressor(const ZipCompressor&) = delete;
+    ZipCompressor& operator=(const ZipCompressor&) = delete;
+
+    // Waits for block |index|; blocks are taken in order. Fails with the error reading it.
+    bool take(std::size_t index, ZipBlockResult& out, Error& err) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        taken_ = index;
+        ahead_.notify_all();
+        done_.wait(lock, [this, index] { return results_.count(index) != 0; });
+        auto it = results_.find(index);
+        out = std::move(it->second);
+        results_.erase(it);
+        if (out.error.isSet()) {
+            err = out.error;
+            return false;
+        }
+        return true;
+    }
+
+   private:
+    void run() {
+        z_stream zs{};
+        const bool ready = ::deflateInit2(&zs, level_, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        std::vector<std::uint8_t> input;
+        for (;;) {
+            std::size_t index = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ahead_.wait(lock, [this] { return stop_ || next_ == blocks_.size() || next_ < taken_ + window_; });
+                if (stop_ || next_ == blocks_.size()) {
+                    break;
+                }
+                index = next_++;
+            }
+            ZipBlockResult result;
+            if (ready) {
+                compress(blocks_[index], zs, input, result);
+            }
+            else {
+                result.error.code = ENOMEM;
+                result.error.message = "Failed to initialize deflate";
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                results_.emplace(index, std::move(result));
+            }
+            done_.notify_all();
+        }
+        if (ready) {
+            ::deflateEnd(&zs);
+        }
+    }
+
+    void compress(const ZipBlock& block, z_stream& zs, std::vector<std::uint8_t>& input, ZipBlockResult& result) {
+        const std::size_t dict =
+            block.deflate ? static_cast<std::size_t>(std::min<std::uint64_t>(kZipDictSize, block.offset)) : 0;
+        input.resize(dict + block.size);
+        Fd fd(::open(members_[block.member].path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+        if (!fd.valid()) {
+            set_error(result.error, "open");
+            return;
+        }
+        std::size_t got = 0;
+        while (got < input.size()) {
+            const ssize_t n = ::pread(fd.fd, input.data() + got, input.size() - got,
+                                      static_cast<off_t>(block.offset - dict + got));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                set_error(result.error, "read");
+                return;
+            }
+            if (n == 0) {
+                result.error.code = EIO;
+                result.error.message = "File shrank while being archived: " + members_[block.member].path;
+                return;
+            }
+            got += static_cast<std::size_t>(n);
+        }
+        const std::uint8_t* raw = input.data() + dict;
+        result.crc = static_cast<std::uint32_t>(::crc32(0, raw, static_cast<uInt>(block.size)));
+        if (!block.deflate) {
+            result.data.assign(reinterpret_cast<const char*>(raw), block.size);
+            result.stored = true;
+            return;
+        }
+
+        ::deflateReset(&zs);
+        if (dict > 0) {
+            ::deflateSetDictionary(&zs, input.data(), static_cast<uInt>(dict));
+        }
+        const int flush = block.last ? Z_FINISH : Z_SYNC_FLUSH;
+        result.data.resize(::deflateBound(&zs, static_cast<uLong>(block.size)) + 16);
+        zs.next_in = input.data() + dict;
+        zs.avail_in = static_cast<uInt>(block.size);
+        std::size_t produced = 0;
+        for (;;) {
+            zs.next_out = reinterpret_cast<Bytef*>(&result.data[produced]);
+            zs.avail_out = static_cast<uInt>(result.data.size() - produced);
+            const int r = ::deflate(&zs, flush);
+            produced = result.data.size() - zs.avail_out;
+            if (r == Z_STREAM_END || (flush == Z_SYNC_FLUSH && r == Z_OK && zs.avail_out > 0)) {
+                break;
+            }
+            if (r != Z_OK && r != Z_BUF_ERROR) {
+                result.error.code = EIO;
+                result.error.message = "deflate failed";
+                return;
+            }
+            result.data.resize(result.data.size() * 2);
+        }
+        result.data.resize(produced);
+        // a file of one block that deflate cannot shrink is stored as it is
+        if (block.offset == 0 && block.last && result.data.size() >= block.size) {
+            result.data.assign(reinterpret_cast<const char*>(raw), block.size);
+            result.stored = true;
+        }
+    }
+
+    const std::vector<Member>& members_;
+    const std::vector<ZipBlock>& blocks_;
+    const int level_;
+    const std::size_t window_;
+    std::mutex mutex_;
+    std::condition_variable ahead_;  // compressors wait for the writer to catch up
+    std::condition_variable done_;   // the writer waits for a block
+    std::unordered_map<std::size_t, ZipBlockResult> results_;
+    std::size_t next_ = 0;   // next block to compress
+    std::size_t taken_ = 0;  // block the writer waits for or writes
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
+
+// Writes member |i|: its local header, its data and, once the sizes and CRC are known, the
+// final local header over the first one.
+bool write_zip_member(ZipOutput& out,
+                      const std::vector<Member>& members,
+                      std::size_t i,
+                      const std::vector<ZipBlock>& blocks,
+                      std::size_t& block,
+                      ZipCompressor& compressor,
+                      std::vector<ZipEntry>& central,
+                      ProgressInfo& progress,
+                      const ProgressCallback& cb,
+                      Error& err) {
+    const Member& member = members[i];
+    const struct stat& st = member.st;
+    progress.currentPath = member.relPath;
+    if (!should_continue(cb, progress)) {
+        err.code = ECANCELED;
+        err.message = "Cancelled";
+        return false;
+    }
+
+    ZipEntry e;
+    e.name = member.relPath;
+    e.headerOffset = out.offset();
+    e.mtime = st.st_mtime;
+    dos_time(st.st_mtime, e);
+    e.externalAttrs = static_cast<std::uint32_t>(st.st_mode & 0xffff) << 16;
+    if (S_ISDIR(st.st_mode)) {
+        e.name.push_back('/');
+        e.externalAttrs |= 0x10;  // MS-DOS directory attribute
+    }
+    if (e.name.size() > kZip16Max) {
+        err.code = ENAMETOOLONG;
+        err.message = "Path too long for a zip archive: " + member.relPath;
+        return false;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        if (S_ISLNK(st.st_mode)) {
+            const std::string& target = member.linkTarget;
+            e.crc = static_cast<std::uint32_t>(
+                ::crc32(0, reinterpret_cast<const Bytef*>(target.data()), static_cast<uInt>(target.size())));
+            e.size = e.compressedSize = target.size();
+        }
+        if (!out.write(local_header(e), err) || !out.write(member.linkTarget, err)) {
+            return false;
+        }
+        central.push_back(std::move(e));
+        progress.filesDone += 1;
+        return true;
+    }
+
+    e.zip64Local = static_cast<std::uint64_t>(st.st_size) >= kZip64LocalThreshold;
+    const std::string placeholder = local_header(e);
+    if (!out.write(placeholder, err)) {
+        return false;
+    }
+    bool deflated = false;
+    while (block < blocks.size() && blocks[block].member == i) {
+        ZipBlockResult result;
+        if (!compressor.take(block, result, err)) {
+            return false;
+        }
+        const std::size_t size = blocks[block].size;
+        ++block;
+        deflated = !result.stored;
+        if (!out.write(result.data, err)) {
+            return false;
+        }
+        e.crc = static_cast<std::uint32_t>(::crc32_combine(e.crc, result.crc, static_cast<z_off_t>(size)));
+        e.compressedSize += result.data.size();
+        e.size += size;
+        progress.bytesDone += static_cast<std::uint64_t>(size);
+        if (!should_continue(cb, progress)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            return false;
+        }
+    }
+    e.method = deflated ? kZipMethodDeflate : kZipMethodStore;
+    if (!e.zip64Local && (e.size >= kZip32Max || e.compressedSize >= kZip32Max)) {
+        err.code = EFBIG;
+        err.message = "File grew past the zip64 threshold while being archived: " + member.path;
+        return false;
+    }
+    if (!out.patch(e.headerOffset, local_header(e), err)) {
+        return false;
+    }
+    central.push_back(std::move(e));
+    progress.filesDone += 1;
+    return true;
+}
+
+bool write_central_directory(ZipOutput& out, const std::vector<ZipEntry>& central, Error& err) {
+    const std::uint64_t start = out.offset();
+    std::string chunk;
+    for (const ZipEntry& e : central) {
+        central_header(e, chunk);
+        if (chunk.size() >= kZipOutputBuffer) {
+            if (!out.write(chunk, err)) {
+                return false;
+            }
+            chunk.clear();
+        }
+    }
+    if (!out.write(chunk, err)) {
+        return false;
+    }
+    const std::uint64_t size = out.offset() - start;
+    const std::uint64_t count = central.size();
+
+    std::string end;
+    if (count >= kZip16Max || size >= kZip32Max || start >= kZip32Max) {
+        const std::uint64_t zip64End = out.offset();
+        put32(end, 0x06064b50);
+        put64(end, 44);  // the size of the rest of the record
+        put16(end, kZipMadeBy);
+        put16(end, 45);
+        put32(end, 0);  // this disk
+        put32(end, 0);  // the disk of the central directory
+        put64(end, count);
+        put64(end, count);
+        put64(end, size);
+        put64(end, start);
+        put32(end, 0x07064b50);  // locator
+        put32(end, 0);
+        put64(end, zip64End);
+        put32(end, 1);  // disks
+    }
+    const std::uint16_t count16 = count >= kZip16Max ? kZip16Max : static_cast<std::uint16_t>(count);
+    put32(end, 0x06054b50);
+    put16(end, 0);
+    put16(end, 0);
+    put16(end, count16);
+    put16(end, count16);
+    put32(end, clamp32(size));
+    put32(end, clamp32(start));
+    put16(end, 0);  // comment
+    return out.write(end, err) && out.flush(err);
+}
+
+}  // namespace
+
+bool create_zip(const std::vector<std::string>& sources,
+                const std::string& destination,
+                ProgressInfo& progress,
+                const ProgressCallback& callback,
+                Error& err,
+                const ZipOptions& opts) {
+    progress = {};
+    err = {};
+
+    if (sources.empty()) {
+        err.code = EINVAL;
+        err.message = "No sources provided for compression";
+        return false;
+    }
+    if (opts.compressionLevel < 0 || opts.compressionLevel > 9) {
+        err.code = EINVAL;
+        err.message = "Unsupported deflate level " + std::to_string(opts.compressionLevel);
+        return false;
+    }
+    if (!ensure_parent_dirs(destination, err)) {
+        return false;
+    }
+
+    std::vector<Member> members;
+    std::uint64_t totalBytes = 0;
+    for (const auto& src : sources) {
+        if (!collect_members(src, parent_dir(src), members, totalBytes, 0, err)) {
+            return false;
+        }
+    }
+    progress.bytesTotal = totalBytes;
+
+    std::vector<ZipBlock> blocks;
+    for (std::size_t i = 0; i < members.size(); ++i) {
+        const Member& m = members[i];
+        if (!S_ISREG(m.st.st_mode)) {
+            continue;
+        }
+        const auto size = static_cast<std::uint64_t>(m.st.st_size);
+        const bool deflate = !(opts.storeCompressedMedia && is_compressed_media(m.relPath));
+        for (std::uint64_t offset = 0; offset < size; offset += kZipBlockSize) {
+            const auto len = static_cast<std::size_t>(std::min<std::uint64_t>(kZipBlockSize, size - offset));
+            blocks.push_back({i, offset, len, offset + len == size, deflate});
+        }
+    }
+
+    Fd out_fd(::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (!out_fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+
+    unsigned threads = opts.compressThreads;
+    if (threads == 0) {
+        const unsigned hc = std::thread::hardware_concurrency();
+        threads = hc > 0 ? hc : 1;
+    }
+    const int level = opts.compressionLevel > 0 ? opts.compressionLevel : Z_DEFAULT_COMPRESSION;
+    ZipOutput out(out_fd.fd);
+    std::vector<ZipEntry> central;
+    central.reserve(members.size());
+    bool ok = true;
+    {
+        ZipCompressor compressor(members, blocks, level, threads);
+        std::size_t block = 0;
+        for (std::size_t i = 0; i < members.size(); ++i) {
+            if (!write_zip_member(out, members, i, blocks, block, compressor, central, progress, callback, err)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (ok) {
+        ok = write_central_directory(out, central, err);
+    }
+    if (!ok) {
+        ::unlink(destination.c_str());
+    }
+    return ok;
+}
+
+namespace {
+
+constexpr std::size_t kTarEndMarker = 1024;  // two zero records close every tar stream
+constexpr std::size_t kCopyChunk = 128 * 1024;
+
+bool pread_all(int fd, std::uint8_t* data, std::size_t size, std::uint64_t offset, Error& err) {
+    while (size > 0) {
+        const ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;
+            }
+            set_error(err, "pread");
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+bool open_seekable(int fd, ZstdSeekable::Reader& reader, const char* action, Error& err) {
+    if (reader.open(fd, err)) {
+        return true;
+    }
+    if (err.code == ENODATA) {
+        err.message = std::string("Only seekable tar.zst archives can be ") + action;
+    }
+    return false;
+}
+
+// The quick check rsync makes: same type and mode, size, mtime and link target.
+bool unchanged(const ZstdSeekable::IndexEntry& e, const Member& m) {
+    return e.mode == static_cast<std::uint32_t>(m.st.st_mode) && e.mtime == m.st.st_mtime &&
+           e.linkTarget == m.linkTarget &&
+           (!S_ISREG(m.st.st_mode) || e.size == static_cast<std::uint64_t>(m.st.st_size));
+}
+
+// libarchive client reading the tar stream of a seekable archive from its start.
+struct SeekableSource {
+    ZstdSeekable::Reader reader;
+    Error error;
+};
+
+la_ssize_t seekable_source_read(struct archive* ar, void* client, const void** buffer) {
+    auto* source = static_cast<SeekableSource*>(client);
+    const std::uint8_t* data = nullptr;
+    std::size_t len = 0;
+    if (!source->reader.next(data, len, source->error)) {
+        archive_set_error(ar, source->error.code, "%s", source->error.message.c_str());
+        return -1;
+    }
+    *buffer = data;
+    return static_cast<la_ssize_t>(len);
+}
+
+// Copies the member whose header was just read from |in| to |out|, indexed as |indexed|.
+bool copy_member(struct archive* in,
+                 archive_entry* entry,
+                 struct archive* out,
+                 ZstdSeekable::Writer& index,
+                 ZstdSeekable::IndexEntry indexed,
+                 std::vector<char>& buffer,
+                 ProgressInfo& progress,
+                 const ProgressCallback& callback,
+                 Error& err) {
+    archive_write_finish_entry(out);
+    indexed.offset = index.offset();
+    index.addEntry(std::move(indexed));
+    if (archive_write_header(out, entry) != ARCHIVE_OK) {
+        set_archive_error(err, out, "archive_write_header");
+        return false;
+    }
+    for (;;) {
+        const la_ssize_t n = archive_read_data(in, buffer.data(), buffer.size());
+        if (n < 0) {
+            set_archive_error(err, in, "archive_read_data");
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (archive_write_data(out, buffer.data(), static_cast<std::size_t>(n)) < 0) {
+            set_archive_error(err, out, "archive_write_data");
+            return false;
+        }
+        progress.bytesDone += static_cast<std::uint64_t>(n);
+        if (!should_continue(callback, progress)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            return false;
+        }
+    }
+    progress.filesDone += 1;
+    return true;
+}
+
+}  // namespace
+
+bool update_tar_zst(const std::vector<std::string>& sources,
+                    const std::string& archivePath,
+                    ProgressInfo& progress,
+                    const ProgressCallback& callback,
+                    Error& err,
+                    const Options& opts) {
+    progress = {};
+    err = {};
+
+    if (sources.empty()) {
+        err.code = EINVAL;
+        err.message = "No sources provided for compression";
+        return false;
+    }
+
+    Fd fd(::open(archivePath.c_str(), O_RDWR | O_CLOEXEC));
+    if (!fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+    ZstdSeekable::Reader reader;
+    if (!open_seekable(fd.fd, reader, "updated", err)) {
+        return false;
+    }
+
+    std::vector<Member> members;
+    std::uint64_t totalBytes = 0;
+    for (const auto& src : sources) {
+        if (!collect_members(src, parent_dir(src), members, totalBytes, 0, err)) {
+            return false;
+        }
+    }
+    std::unordered_map<std::string, const ZstdSeekable::IndexEntry*> indexed;
+    for (const auto& e : reader.entries()) {
+        indexed[e.path] = &e;
+    }
+    std::vector<Member> changed;
+    std::unordered_set<std::string> replaced;
+    for (Member& m : members) {
+        const auto it = indexed.find(m.relPath);
+        if (it != indexed.end() && unchanged(*it->second, m)) {
+            continue;
+        }
+        if (S_ISREG(m.st.st_mode)) {
+            progress.bytesTotal += static_cast<std::uint64_t>(m.st.st_size);
+        }
+        replaced.insert(m.relPath);
+        changed.push_back(std::move(m));
+    }
+    if (changed.empty()) {
+        return true;
+    }
+
+    // The end marker closes the last frame (or two, when that frame is shorter). The frame
+    // holding its start is decoded and dropped, and what it held before the marker becomes
+    // the start of the first new frame.
+    const auto& frames = reader.frames();
+    if (frames.empty() || reader.size() < kTarEndMarker) {
+        err.code = EBADMSG;
+        err.message = "Archive is too short to be a tar stream";
+        return false;
+    }
+    const std::uint64_t markerAt = reader.size() - kTarEndMarker;
+    const auto frameIt = std::upper_bound(frames.begin(), frames.end(), markerAt,
+                                          [](std::uint64_t off, const auto& f) { return off < f.decompressedOffset; });
+    const std::size_t kept = static_cast<std::size_t>(frameIt - frames.begin()) - 1;
+    std::vector<std::uint8_t> tail;
+    if (!reader.seek(frames[kept].decompressedOffset, err)) {
+        return false;
+    }
+    for (;;) {
+        const std::uint8_t* data = nullptr;
+        std::size_t len = 0;
+        if (!reader.next(data, len, err)) {
+            return false;
+        }
+        if (len == 0) {
+            break;
+        }
+        tail.insert(tail.end(), data, data + len);
+    }
+    const std::size_t markerPos = static_cast<std::size_t>(markerAt - frames[kept].decompressedOffset);
+    if (tail.size() != markerPos + kTarEndMarker ||
+        std::any_of(tail.begin() + static_cast<std::ptrdiff_t>(markerPos), tail.end(), [](std::uint8_t b) {
+            return b != 0;
+        })) {
+        err.code = EBADMSG;
+        err.message = "Archive does not end with a tar end marker";
+        return false;
+    }
+    tail.resize(markerPos);
+
+    // Everything from the dropped frame on (its data, the index, the seek table) is kept in
+    // memory, so a failed or cancelled update can put the archive back as it was.
+    struct stat st{};
+    if (::fstat(fd.fd, &st) != 0) {
+        set_error(err, "fstat");
+        return false;
+    }
+    const std::uint64_t cutAt = frames[kept].compressedOffset;
+    std::vector<std::uint8_t> saved(static_cast<std::size_t>(static_cast<std::uint64_t>(st.st_size) - cutAt));
+    if (!pread_all(fd.fd, saved.data(), saved.size(), cutAt, err)) {
+        return false;
+    }
+    const auto truncate = [&fd, cutAt]() {
+        return ::ftruncate(fd.fd, static_cast<off_t>(cutAt)) == 0 &&
+               ::lseek(fd.fd, static_cast<off_t>(cutAt), SEEK_SET) >= 0;
+    };
+    const auto restore = [&fd, &saved, &truncate]() {
+        Error ignored;
+        if (truncate()) {
+            write_all_fd(fd.fd, reinterpret_cast<const char*>(saved.data()), saved.size(), ignored);
+        }
+    };
+    if (!truncate()) {
+        set_error(err, "ftruncate");
+        restore();
+        return false;
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> keptFrames;
+    for (std::size_t i = 0; i < kept; ++i) {
+        keptFrames.emplace_back(frames[i].compressedSize, frames[i].decompressedSize);
+    }
+    std::vector<ZstdSeekable::IndexEntry> entries;
+    for (const auto& e : reader.entries()) {
+        if (!replaced.count(e.path)) {
+            entries.push_back(e);
+        }
+    }
+    auto sink = std::make_unique<SeekableSink>();
+    if (!sink->writer.resume(fd.fd, seekable_params(opts), std::move(keptFrames), std::move(entries), err) ||
+        !sink->writer.write(tail.data(), tail.size(), err)) {
+        restore();
+        return false;
+    }
+
+    struct archive* ar = archive_write_new();
+    if (!ar) {
+        err.code = ENOMEM;
+        err.message = "Failed to allocate archive writer";
+        restore();
+        return false;
+    }
+    archive_write_set_format_pax_restricted(ar);
+    if (!open_seekable_archive(ar, *sink, err)) {
+        archive_write_free(ar);
+        restore();
+        return false;
+    }
+    bool ok = write_members(ar, changed, opts, progress, callback, err, &sink->writer);
+    ok = close_archive(ar, sink.get(), ok, err);
+    if (!ok) {
+        restore();
+    }
+    return ok;
+}
+
+bool compact_tar_zst(const std::string& archivePath,
+                     ProgressInfo& progress,
+                     const ProgressCallback& callback,
+                     Error& err,
+                     const Options& opts) {
+    progress = {};
+    err = {};
+
+    Fd in_fd(::open(archivePath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!in_fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+    struct stat st{};
+    if (::fstat(in_fd.fd, &st) != 0) {
+        set_error(err, "fstat");
+        return false;
+    }
+    SeekableSource source;
+    if (!open_seekable(in_fd.fd, source.reader, "compacted", err)) {
+        return false;
+    }
+
+    // The index names the live copy of every member by the offset of its header; anything else
+    // in the stream was replaced by a later update.
+    std::unordered_map<std::uint64_t, const ZstdSeekable::IndexEntry*> live;
+    for (const auto& e : source.reader.entries()) {
+        live[e.offset] = &e;
+        if (S_ISREG(e.mode) && e.linkTarget.empty()) {
+            progress.bytesTotal += e.size;
+        }
+    }
+
+    std::string tmpPath = archivePath + ".XXXXXX";
+    Fd out_fd(::mkstemp(tmpPath.data()));
+    if (!out_fd.valid()) {
+        set_error(err, "mkstemp");
+        return false;
+    }
+    ::fchmod(out_fd.fd, st.st_mode & 07777);
+
+    struct archive* in = archive_read_new();
+    struct archive* out = archive_write_new();
+    auto sink = std::make_unique<SeekableSink>();
+    bool ok = in && out;
+    if (!ok) {
+        err.code = ENOMEM;
+        err.message = "Failed to allocate archive reader";
+    }
+    if (ok) {
+        archive_read_support_format_tar(in);
+        archive_write_set_format_pax_restricted(out);
+        ok = source.reader.seek(0, err) && sink->writer.open(out_fd.fd, seekable_params(opts), err) &&
+             open_seekable_archive(out, *sink, err);
+    }
+    if (ok && archive_read_open(in, &source, nullptr, seekable_source_read, nullptr) != ARCHIVE_OK) {
+        set_archive_error(err, in, "archive_read_open");
+        ok = false;
+    }
+
+    std::vector<char> buffer(kCopyChunk);
+    archive_entry* entry = nullptr;
+    int r = ARCHIVE_OK;
+    while (ok && (r = archive_read_next_header(in, &entry)) == ARCHIVE_OK) {
+        const auto it = live.find(static_cast<std::uint64_t>(archive_read_header_position(in)));
+        if (it == live.end()) {
+            archive_read_data_skip(in);
+            continue;
+        }
+        progress.currentPath = it->second->path;
+        if (!should_continue(callback, progress)) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            ok = false;
+            break;
+        }
+        ok = copy_member(in, entry, out, sink->writer, *it->second, buffer, progress, callback, err);
+    }
+    if (ok && r != ARCHIVE_EOF) {
+        set_archive_error(err, in, "archive_read_next_header");
+        if (source.error.isSet()) {
+            err = source.error;
+        }
+        ok = false;
+    }
+    if (in) {
+        archive_read_free(in);
+    }
+    if (out) {
+        ok = close_archive(out, sink.get(), ok, err);
+    }
+    if (ok && ::rename(tmpPath.c_str(), archivePath.c_str()) != 0) {
+        set_error(err, "rename");
+        ok = false;
+    }
+    if (!ok) {
+        ::unlink(tmpPath.c_str());
     }
     return ok;
 }
@@ -8,19 +8,79 @@
 
 #include "fs_ops.h"
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
 namespace PCManFM::ArchiveWriter {
 
+// zstd tuning for create_tar_zst. Thread and window settings are best-effort: a zstd built
+// without them still writes a valid (single-threaded, short-window) archive.
+struct Options {
+    int compressionLevel = 0;  // 0 = zstd default (3); 1..19, up to 22 with a long window
+    bool enableFilterThreads = true;
+    unsigned maxFilterThreads = 0;  // 0 = use hardware_concurrency
+    unsigned longWindowLog = 0;     // long-distance matching window as log2 bytes (27 = 128 MiB); 0 = off
+    bool seekable = true;           // independent frames plus member index, see ZstdSeekable
+    std::size_t frameSize = 0;      // seekable input bytes per frame (caps the window); 0 = 8 MiB
+    unsigned readerThreads = 0;     // threads opening and reading upcoming files; 0 = 4
+    std::size_t prefetchBytes = 0;  // read-ahead buffered across those threads; 0 = 8 MiB
+};
+
 // Create a tar archive (compressed with zstd if available in libarchive) at |destination|
 // from the given list of native byte-string paths. Progress and cancellation use the same
-// callback contract as fs_ops.
+// callback contract as fs_ops. With |opts.seekable| the output is still a plain tar.zst for
+// any zstd reader, but ArchiveExtract can list it and pull single members without decoding
+// the rest. Source files are opened and read ahead on |opts.readerThreads| threads while
+// the calling thread feeds libarchive, so per-file latency overlaps with compression.
 bool create_tar_zst(const std::vector<std::string>& sources,
                     const std::string& destination,
                     FsOps::ProgressInfo& progress,
                     const FsOps::ProgressCallback& callback,
-                    FsOps::Error& err);
+                    FsOps::Error& err,
+                    const Options& opts = {});
+
+// Brings the seekable tar.zst at |archivePath| (see Options::seekable) up to date with
+// |sources|, given as for create_tar_zst. Members whose type, mode, size, mtime and link target
+// match the archive's index are left alone; changed and new ones are appended as tar entries
+// in new zstd frames, which later readers let override the earlier copies. Only the frame
+// holding the old tar end marker is compressed again. Files deleted from the sources stay in
+// the archive. On failure or cancellation the archive is put back as it was; a crash midway
+// can still leave it truncated. Fails with ENODATA for any other kind of archive.
+bool update_tar_zst(const std::vector<std::string>& sources,
+                    const std::string& archivePath,
+                    FsOps::ProgressInfo& progress,
+                    const FsOps::ProgressCallback& callback,
+                    FsOps::Error& err,
+                    const Options& opts = {});
+
+// Rewrites a seekable tar.zst grown by update_tar_zst without the copies later updates replaced.
+// The new archive is written next to the old one and renamed over it once complete.
+bool compact_tar_zst(const std::string& archivePath,
+                     FsOps::ProgressInfo& progress,
+                     const FsOps::ProgressCallback& callback,
+                     FsOps::Error& err,
+                     const Options& opts = {});
+
+// Deflate settings for create_zip.
+struct ZipOptions {
+    int compressionLevel = 0;          // 0 = zlib default (6); 1..9
+    unsigned compressThreads = 0;      // 0 = use hardware_concurrency
+    bool storeCompressedMedia = true;  // store jpeg, mp4, zip, ... as they are rather than deflate them
+};
+
+// Create a zip archive at |destination| from native byte-string paths, with the same progress
+// and cancellation contract as create_tar_zst. Regular files are cut into 1 MiB blocks that
+// |opts.compressThreads| threads read and deflate independently (each primed with the 32 KiB
+// before it, as pigz does), so one large file is compressed on every core as well as many
+// small ones. The calling thread writes the blocks in order and keeps the central directory.
+// Zip64 records are added where sizes, offsets or the member count need them.
+bool create_zip(const std::vector<std::string>& sources,
+                const std::string& destination,
+                FsOps::ProgressInfo& progress,
+                const FsOps::ProgressCallback& callback,
+                FsOps::Error& err,
+                const ZipOptions& opts = {});
 
 // Extract a tar or tar.zst archive at |archivePath| into |destinationDir|. The destination
 // directory is created and must not already exist. Progress/cancel semantics match fs_ops.
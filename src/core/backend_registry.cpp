@@ -5,11 +5,14 @@
 
 #include "backend_registry.h"
 
+#include <QCoreApplication>
 #include <QDebug>
 #include <memory>
 
 #include "../backends/qt/qt_fileops.h"
 #include "../backends/qt/qt_foldermodel.h"
+#include "../backends/qt/qt_trash.h"
+#include "../backends/sftp/sftp_backend.h"
 
 namespace PCManFM {
 
@@ -21,8 +24,31 @@ std::unique_ptr<IFileOps> BackendRegistry::createFileOps() {
     return std::make_unique<QtFileOps>();
 }
 
+FileOpScheduler& BackendRegistry::fileOpScheduler() {
+    // Owned by the application so queued and running jobs go away before Qt shuts down.
+    static FileOpScheduler* scheduler = new FileOpScheduler(QCoreApplication::instance());
+    return *scheduler;
+}
+
+FileOpScheduler::JobId BackendRegistry::scheduleFileOp(const FileOpRequest& req) {
+    return fileOpScheduler().enqueue(createFileOps(), req);
+}
+
 std::unique_ptr<IFolderModel> BackendRegistry::createFolderModel(QObject* parent) {
     return std::make_unique<QtFolderModel>(parent);
 }
 
+std::unique_ptr<ITrashBackend> BackendRegistry::createTrashBackend() {
+    return std::make_unique<QtTrash>();
+}
+
+IRemoteBackend* BackendRegistry::remoteBackend() {
+#ifdef PCMANFM_HAVE_LIBSSH
+    static SftpBackend backend;
+    return &backend;
+#else
+    return nullptr;
+#endif
+}
+
 }  // namespace PCManFM
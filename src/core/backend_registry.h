@@ -8,8 +8,11 @@
 
 #include <memory>
 
+#include "fileop_scheduler.h"
 #include "ifileops.h"
 #include "ifoldermodel.h"
+#include "iremotebackend.h"
+#include "itrashbackend.h"
 
 namespace PCManFM {
 
@@ -18,7 +21,16 @@ class BackendRegistry {
     static void initDefaults();
 
     static std::unique_ptr<IFileOps> createFileOps();
+    // Process-wide scheduler that serializes file operations per device.
+    static FileOpScheduler& fileOpScheduler();
+    // Creates a backend for |req| and queues it on fileOpScheduler(). Returns 0 if no
+    // backend is available.
+    static FileOpScheduler::JobId scheduleFileOp(const FileOpRequest& req);
     static std::unique_ptr<IFolderModel> createFolderModel(QObject* parent);
+    static std::unique_ptr<ITrashBackend> createTrashBackend();
+    // Process-wide backend for copies from and to sftp:// locations, or nullptr when libssh
+    // was not compiled in (ENABLE_SFTP).
+    static IRemoteBackend* remoteBackend();
 };
 
 }  // namespace PCManFM
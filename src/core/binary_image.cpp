@@ -0,0 +1,346 @@
+/*
+ * Executable image layout: ELF sections, segments and function symbols (no Qt)
+ * src/core/binary_image.cpp
+ */
+
+#include "binary_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr std::uint32_t kShtSymtab = 2;
+constexpr std::uint32_t kShtNobits = 8;
+constexpr std::uint32_t kShtDynsym = 11;
+constexpr std::uint64_t kShfExecinstr = 0x4;
+constexpr std::uint32_t kPtLoad = 1;
+constexpr std::uint32_t kPfX = 0x1;
+constexpr std::uint8_t kSttFunc = 2;
+constexpr std::uint8_t kSttGnuIfunc = 10;
+constexpr std::uint16_t kEmArm = 0x28;
+constexpr std::uint16_t kShnXindex = 0xFFFF;
+
+// Upper bounds that keep a corrupt header from asking for gigabytes of tables.
+constexpr std::uint64_t kMaxTableEntries = 1u << 20;
+constexpr std::uint64_t kMaxSymbols = 1u << 24;
+constexpr std::uint64_t kMaxStringTable = 64u * 1024 * 1024;
+constexpr std::size_t kSymbolBatch = 4096;
+
+class FieldReader {
+   public:
+    FieldReader(const std::uint8_t* data, bool little) : data_(data), little_(little) {}
+
+    std::uint64_t get(std::size_t offset, std::size_t width) const {
+        std::uint64_t value = 0;
+        for (std::size_t i = 0; i < width; ++i) {
+            const std::uint64_t byte = data_[offset + (little_ ? i : width - 1 - i)];
+            value |= byte << (8 * i);
+        }
+        return value;
+    }
+    std::uint16_t u16(std::size_t offset) const { return static_cast<std::uint16_t>(get(offset, 2)); }
+    std::uint32_t u32(std::size_t offset) const { return static_cast<std::uint32_t>(get(offset, 4)); }
+    std::uint64_t u64(std::size_t offset) const { return get(offset, 8); }
+
+   private:
+    const std::uint8_t* data_;
+    bool little_;
+};
+
+bool fits(std::uint64_t offset, std::uint64_t length, std::uint64_t fileSize) {
+    return offset <= fileSize && length <= fileSize - offset;
+}
+
+bool readTable(const ImageReader& read,
+               std::uint64_t fileSize,
+               std::uint64_t offset,
+               std::uint64_t count,
+               std::uint64_t entrySize,
+               std::vector<std::uint8_t>& out,
+               std::string& errorOut) {
+    if (count > kMaxTableEntries || !fits(offset, count * entrySize, fileSize)) {
+        errorOut = "ELF table lies outside the file";
+        return false;
+    }
+    out.resize(static_cast<std::size_t>(count * entrySize));
+    return out.empty() || read(offset, out.size(), out.data(), errorOut);
+}
+
+std::string stringAt(const std::vector<std::uint8_t>& table, std::uint32_t offset) {
+    if (offset >= table.size()) {
+        return {};
+    }
+    const auto* start = reinterpret_cast<const char*>(table.data()) + offset;
+    return std::string(start, strnlen(start, table.size() - offset));
+}
+
+bool readSymbols(const ImageReader& read,
+                 std::uint64_t fileSize,
+                 const ElfImage& image,
+                 const ElfSection& table,
+                 std::vector<ImageSymbol>& out,
+                 std::string& errorOut) {
+    const std::size_t entrySize = image.is64 ? 24 : 16;
+    if (!fits(table.offset, table.size, fileSize)) {
+        errorOut = "ELF symbol table lies outside the file";
+        return false;
+    }
+    // Names are optional: symbols keep their addresses when the string table is unusable.
+    std::vector<std::uint8_t> names;
+    if (table.link < image.sections.size()) {
+        const ElfSection& strings = image.sections[table.link];
+        if (strings.type != kShtNobits && strings.size <= kMaxStringTable) {
+            names.resize(static_cast<std::size_t>(strings.size));
+            if (!names.empty() && !read(strings.offset, names.size(), names.data(), errorOut)) {
+                return false;
+            }
+        }
+    }
+    const std::uint64_t count = std::min<std::uint64_t>(table.size / entrySize, kMaxSymbols);
+    std::vector<std::uint8_t> batch;
+    for (std::uint64_t first = 0; first < count; first += kSymbolBatch) {
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(kSymbolBatch, count - first));
+        batch.resize(n * entrySize);
+        if (!read(table.offset + first * entrySize, batch.size(), batch.data(), errorOut)) {
+            return false;
+        }
+        const FieldReader fields(batch.data(), image.littleEndian);
+        for (std::size_t i = 0; i < n; ++i) {
+            const std::size_t base = i * entrySize;
+            const std::uint8_t info = batch[base + (image.is64 ? 4 : 12)];
+            const std::uint16_t shndx = fields.u16(base + (image.is64 ? 6 : 14));
+            ImageSymbol symbol;
+            symbol.address = image.is64 ? fields.u64(base + 8) : fields.u32(base + 4);
+            symbol.size = image.is64 ? fields.u64(base + 16) : fields.u32(base + 8);
+            const std::uint8_t type = info & 0x0F;
+            if ((type != kSttFunc && type != kSttGnuIfunc) || shndx == 0 || symbol.address == 0) {
+                continue;
+            }
+            if (image.machine == kEmArm) {
+                symbol.address &= ~std::uint64_t{1};
+            }
+            symbol.name = stringAt(names, fields.u32(base));
+            out.push_back(std::move(symbol));
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool ElfSection::executable() const {
+    return (flags & kShfExecinstr) != 0 && type != kShtNobits && size > 0;
+}
+
+bool ElfSegment::executable() const {
+    return type == kPtLoad && (flags & kPfX) != 0 && fileSize > 0;
+}
+
+bool is_elf_header(const std::uint8_t* data, std::size_t size) {
+    return size >= 4 && data[0] == 0x7F && data[1] == 'E' && data[2] == 'L' && data[3] == 'F';
+}
+
+bool parse_elf_image(std::uint64_t fileSize, const ImageReader& read, ElfImage& out, std::string& errorOut) {
+    out = ElfImage();
+    std::uint8_t header[64];
+    if (fileSize < 52 || !read(0, std::min<std::uint64_t>(sizeof(header), fileSize), header, errorOut)) {
+        if (errorOut.empty()) {
+            errorOut = "File is too small for an ELF header";
+        }
+        return false;
+    }
+    if (!is_elf_header(header, sizeof(header)) || (header[4] != 1 && header[4] != 2) ||
+        (header[5] != 1 && header[5] != 2)) {
+        errorOut = "Not an ELF file";
+        return false;
+    }
+    out.is64 = header[4] == 2;
+    out.littleEndian = header[5] == 1;
+    if (out.is64 && fileSize < 64) {
+        errorOut = "File is too small for an ELF header";
+        return false;
+    }
+
+    const FieldReader h(header, out.littleEndian);
+    out.machine = h.u16(18);
+    out.entry = out.is64 ? h.u64(24) : h.u32(24);
+    const std::uint64_t phoff = out.is64 ? h.u64(32) : h.u32(28);
+    const std::uint64_t shoff = out.is64 ? h.u64(40) : h.u32(32);
+    const std::size_t fieldBase = out.is64 ? 54 : 42;
+    const std::uint16_t phentsize = h.u16(fieldBase);
+    std::uint64_t phnum = h.u16(fieldBase + 2);
+    const std::uint16_t shentsize = h.u16(fieldBase + 4);
+    std::uint64_t shnum = h.u16(fieldBase + 6);
+    std::uint32_t shstrndx = h.u16(fieldBase + 8);
+
+    const std::size_t phSize = out.is64 ? 56 : 32;
+    const std::size_t shSize = out.is64 ? 64 : 40;
+    std::vector<std::uint8_t> table;
+
+    if (shoff != 0 && shentsize >= shSize) {
+        // Section counts that overflow 16 bits live in section 0.
+        if (shnum == 0 || shstrndx == kShnXindex) {
+            if (!readTable(read, fileSize, shoff, 1, shentsize, table, errorOut)) {
+                return false;
+            }
+            const FieldReader first(table.data(), out.littleEndian);
+            if (shnum == 0) {
+                shnum = out.is64 ? first.u64(32) : first.u32(20);
+            }
+            if (shstrndx == kShnXindex) {
+                shstrndx = first.u32(out.is64 ? 40 : 24);
+            }
+        }
+        if (!readTable(read, fileSize, shoff, shnum, shentsize, table, errorOut)) {
+            return false;
+        }
+        out.sections.reserve(static_cast<std::size_t>(shnum));
+        std::vector<std::uint32_t> nameOffsets;
+        for (std::uint64_t i = 0; i < shnum; ++i) {
+            const FieldReader s(table.data() + i * shentsize, out.littleEndian);
+            ElfSection section;
+            nameOffsets.push_back(s.u32(0));
+            section.type = s.u32(4);
+            section.flags = out.is64 ? s.u64(8) : s.u32(8);
+            section.address = out.is64 ? s.u64(16) : s.u32(12);
+            section.offset = out.is64 ? s.u64(24) : s.u32(16);
+            section.size = out.is64 ? s.u64(32) : s.u32(20);
+            section.link = out.is64 ? s.u32(40) : s.u32(24);
+            if (section.type != kShtNobits) {
+                section.size = section.offset < fileSize ? std::min(section.size, fileSize - section.offset) : 0;
+            }
+            out.sections.push_back(section);
+        }
+
+        if (shstrndx < out.sections.size()) {
+            const ElfSection& names = out.sections[shstrndx];
+            if (names.type != kShtNobits && names.size <= kMaxStringTable) {
+                std::vector<std::uint8_t> strings(static_cast<std::size_t>(names.size));
+                if (!strings.empty() && !read(names.offset, strings.size(), strings.data(), errorOut)) {
+                    return false;
+                }
+                for (std::size_t i = 0; i < out.sections.size(); ++i) {
+                    out.sections[i].name = stringAt(strings, nameOffsets[i]);
+                }
+            }
+        }
+    }
+
+    if (phoff != 0 && phentsize >= phSize) {
+        if (!readTable(read, fileSize, phoff, phnum, phentsize, table, errorOut)) {
+            return false;
+        }
+        out.segments.reserve(static_cast<std::size_t>(phnum));
+        for (std::uint64_t i = 0; i < phnum; ++i) {
+            const FieldReader p(table.data() + i * phentsize, out.littleEndian);
+            ElfSegment segment;
+            segment.type = p.u32(0);
+            if (out.is64) {
+                segment.flags = p.u32(4);
+                segment.offset = p.u64(8);
+                segment.address = p.u64(16);
+                segment.fileSize = p.u64(32);
+                segment.memorySize = p.u64(40);
+            }
+            else {
+                segment.offset = p.u32(4);
+                segment.address = p.u32(8);
+                segment.fileSize = p.u32(16);
+                segment.memorySize = p.u32(20);
+                segment.flags = p.u32(24);
+            }
+            segment.fileSize = segment.offset < fileSize ? std::min(segment.fileSize, fileSize - segment.offset) : 0;
+            out.segments.push_back(segment);
+        }
+    }
+
+    for (const ElfSection& section : out.sections) {
+        if (section.type == kShtSymtab || section.type == kShtDynsym) {
+            if (!readSymbols(read, fileSize, out, section, out.functions, errorOut)) {
+                return false;
+            }
+        }
+    }
+    // Named entries sort first at each address, so unique() keeps them.
+    std::stable_sort(out.functions.begin(), out.functions.end(), [](const ImageSymbol& a, const ImageSymbol& b) {
+        return a.address != b.address ? a.address < b.address : !a.name.empty() && b.name.empty();
+    });
+    out.functions.erase(std::unique(out.functions.begin(), out.functions.end(),
+                                    [](const ImageSymbol& a, const ImageSymbol& b) { return a.address == b.address; }),
+                        out.functions.end());
+    out.functionStarts.reserve(out.functions.size());
+    for (const ImageSymbol& symbol : out.functions) {
+        out.functionStarts.push_back(symbol.address);
+    }
+    return true;
+}
+
+std::vector<CodeRegion> elf_code_regions(const ElfImage& image) {
+    std::vector<CodeRegion> regions;
+    for (const ElfSection& section : image.sections) {
+        if (section.executable()) {
+            regions.push_back({section.offset, section.size, section.address});
+        }
+    }
+    if (regions.empty()) {
+        for (const ElfSegment& segment : image.segments) {
+            if (segment.executable()) {
+                regions.push_back({segment.offset, segment.fileSize, segment.address});
+            }
+        }
+    }
+    std::sort(regions.begin(), regions.end(),
+              [](const CodeRegion& a, const CodeRegion& b) { return a.offset < b.offset; });
+    return regions;
+}
+
+std::vector<CodeChunk> split_code_regions(const std::vector<CodeRegion>& regions,
+                                          const std::vector<std::uint64_t>& functionStarts,
+                                          std::uint64_t chunkSize,
+                                          std::uint64_t alignment) {
+    chunkSize = std::max<std::uint64_t>(chunkSize, 1);
+    alignment = std::max<std::uint64_t>(alignment, 1);
+    std::vector<CodeChunk> chunks;
+    for (const CodeRegion& region : regions) {
+        if (region.size == 0) {
+            continue;
+        }
+        const std::uint64_t regionEnd = region.offset + region.size;
+        std::uint64_t start = 0;  // relative to the region
+        bool knownStart = true;
+        while (start < region.size) {
+            std::uint64_t end = region.size;
+            bool nextKnown = true;
+            if (region.size - start > chunkSize + chunkSize / 2) {
+                const std::uint64_t target = start + chunkSize;
+                const std::uint64_t low = target - chunkSize / 2;
+                const std::uint64_t high = target + chunkSize / 2;
+                // The function start closest to the target, if any lies within half a chunk.
+                auto it = std::lower_bound(functionStarts.begin(), functionStarts.end(), region.address + low);
+                std::uint64_t best = 0;
+                bool found = false;
+                for (; it != functionStarts.end() && *it < region.address + high; ++it) {
+                    const std::uint64_t candidate = *it - region.address;
+                    const std::uint64_t distance = candidate > target ? candidate - target : target - candidate;
+                    const std::uint64_t bestDistance = best > target ? best - target : target - best;
+                    if (candidate > start && (!found || distance < bestDistance)) {
+                        best = candidate;
+                        found = true;
+                    }
+                }
+                end = found ? best : target - (region.address + target) % alignment;
+                nextKnown = found;
+            }
+            chunks.push_back({region.offset + start, end - start, region.address + start, regionEnd, knownStart});
+            start = end;
+            knownStart = nextKnown;
+        }
+    }
+    return chunks;
+}
+
+}  // namespace PCManFM
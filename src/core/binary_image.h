@@ -0,0 +1,106 @@
+/*
+ * Executable image layout: ELF sections, segments and function symbols (no Qt)
+ * src/core/binary_image.h
+ */
+
+#ifndef PCMANFM_BINARY_IMAGE_H
+#define PCMANFM_BINARY_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace PCManFM {
+
+// A named function of an executable image.
+struct ImageSymbol {
+    std::uint64_t address = 0;
+    std::uint64_t size = 0;
+    std::string name;
+};
+
+struct ElfSection {
+    std::string name;
+    std::uint32_t type = 0;
+    std::uint64_t flags = 0;
+    std::uint64_t address = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint32_t link = 0;  // for symbol tables, the section holding their names
+
+    // SHF_EXECINSTR with bytes in the file, so not SHT_NOBITS.
+    bool executable() const;
+};
+
+struct ElfSegment {
+    std::uint32_t type = 0;
+    std::uint32_t flags = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t fileSize = 0;
+    std::uint64_t address = 0;
+    std::uint64_t memorySize = 0;
+
+    // A PT_LOAD segment mapped PF_X.
+    bool executable() const;
+};
+
+struct ElfImage {
+    bool is64 = false;
+    bool littleEndian = true;
+    std::uint16_t machine = 0;
+    std::uint64_t entry = 0;
+    std::vector<ElfSection> sections;
+    std::vector<ElfSegment> segments;
+    // The STT_FUNC symbols from .symtab and .dynsym, sorted by address with one per address,
+    // the first named one found. The Thumb bit is cleared on 32-bit ARM.
+    std::vector<ImageSymbol> functions;
+    // Their addresses.
+    std::vector<std::uint64_t> functionStarts;
+};
+
+// Reads exactly |length| bytes at |offset| into |dest|, or fails.
+using ImageReader =
+    std::function<bool(std::uint64_t offset, std::size_t length, std::uint8_t* dest, std::string& errorOut)>;
+
+bool is_elf_header(const std::uint8_t* data, std::size_t size);
+
+// Parses the ELF header, program headers, section headers and function symbols of a file of
+// |fileSize| bytes. Tables that point outside the file are rejected; a missing symbol table
+// is not an error, stripped binaries simply have no function starts.
+bool parse_elf_image(std::uint64_t fileSize, const ImageReader& read, ElfImage& out, std::string& errorOut);
+
+// A contiguous run of code: |size| file bytes at |offset|, loaded at |address|.
+struct CodeRegion {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint64_t address = 0;
+};
+
+// The executable sections of |image|, or its executable segments when it has no section
+// table, ordered by file offset.
+std::vector<CodeRegion> elf_code_regions(const ElfImage& image);
+
+// A piece of a region that can be disassembled on its own. |knownStart| says whether the
+// first byte is known to start an instruction: region starts and function starts are,
+// arbitrary split points are not and need resynchronizing with the piece before.
+struct CodeChunk {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+    std::uint64_t address = 0;
+    std::uint64_t regionEnd = 0;  // file offset where the enclosing region ends
+    bool knownStart = true;
+};
+
+// Splits |regions| into chunks of about |chunkSize| bytes. Each split point moves to the
+// function start in |functionStarts| nearest to it, within half a chunk; without one, it
+// falls on a multiple of |alignment| bytes. Chunks of one region are contiguous.
+std::vector<CodeChunk> split_code_regions(const std::vector<CodeRegion>& regions,
+                                          const std::vector<std::uint64_t>& functionStarts,
+                                          std::uint64_t chunkSize,
+                                          std::uint64_t alignment);
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_BINARY_IMAGE_H
@@ -0,0 +1,92 @@
+/*
+ * Per-block byte statistics for the hex editor overview (no Qt)
+ * src/core/block_stats.cpp
+ */
+
+#include "block_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr int kLanes = 4;
+
+std::uint8_t scaleShare(std::uint64_t part, std::uint64_t total) {
+    return static_cast<std::uint8_t>((part * 255 + total / 2) / total);
+}
+
+}  // namespace
+
+std::uint64_t stats_block_size(std::uint64_t fileSize) {
+    std::uint64_t blockSize = kStatsBlockSize;
+    while ((fileSize + blockSize - 1) / blockSize > kMaxStatsBlocks) {
+        blockSize *= 2;
+    }
+    return blockSize;
+}
+
+void add_byte_histogram(const std::uint8_t* data, std::size_t size, ByteHistogram& counts) {
+    // Each lane gets every fourth byte; a run of one value then updates four counters
+    // instead of serialising on one load-increment-store chain.
+    std::uint32_t lanes[kLanes][256] = {};
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        ++lanes[0][word & 0xff];
+        ++lanes[1][(word >> 8) & 0xff];
+        ++lanes[2][(word >> 16) & 0xff];
+        ++lanes[3][(word >> 24) & 0xff];
+        ++lanes[0][(word >> 32) & 0xff];
+        ++lanes[1][(word >> 40) & 0xff];
+        ++lanes[2][(word >> 48) & 0xff];
+        ++lanes[3][word >> 56];
+    }
+    for (; i < size; ++i) {
+        ++lanes[0][data[i]];
+    }
+    for (std::size_t value = 0; value < 256; ++value) {
+        counts[value] += lanes[0][value] + lanes[1][value] + lanes[2][value] + lanes[3][value];
+    }
+}
+
+BlockStats stats_from_histogram(const ByteHistogram& counts, std::size_t total) {
+    BlockStats stats;
+    stats.known = true;
+    if (total == 0) {
+        return stats;
+    }
+    // H = log2(n) - (1/n) * sum(c * log2(c)) over the non-zero counts c.
+    double weighted = 0.0;
+    std::uint64_t ascii = counts['\t'] + counts['\n'] + counts['\r'];
+    for (std::size_t value = 0; value < 256; ++value) {
+        const std::uint32_t c = counts[value];
+        if (c > 1) {
+            weighted += c * std::log2(static_cast<double>(c));
+        }
+        if (value >= 0x20 && value < 0x7f) {
+            ascii += c;
+        }
+    }
+    const double n = static_cast<double>(total);
+    const double entropy = std::clamp(std::log2(n) - weighted / n, 0.0, 8.0);
+    stats.entropy = static_cast<std::uint8_t>(std::lround(entropy * 255.0 / 8.0));
+    stats.zeros = scaleShare(counts[0], total);
+    stats.ascii = scaleShare(ascii, total);
+    return stats;
+}
+
+void compute_block_stats(const std::uint8_t* data, std::size_t size, std::size_t blockSize, BlockStats* out) {
+    for (std::size_t offset = 0; offset < size; offset += blockSize) {
+        const std::size_t length = std::min(blockSize, size - offset);
+        ByteHistogram counts{};
+        add_byte_histogram(data + offset, length, counts);
+        *out++ = stats_from_histogram(counts, length);
+    }
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,45 @@
+/*
+ * Per-block byte statistics for the hex editor overview (no Qt)
+ * src/core/block_stats.h
+ */
+
+#ifndef PCMANFM_BLOCK_STATS_H
+#define PCMANFM_BLOCK_STATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace PCManFM {
+
+// What the overview strip shows for one block of a file, each share scaled to 0..255 so a
+// map of a large file stays small.
+struct BlockStats {
+    std::uint8_t entropy = 0;  // Shannon entropy; 255 is 8 bits per byte
+    std::uint8_t zeros = 0;    // share of zero bytes
+    std::uint8_t ascii = 0;    // share of printable ASCII, tab, CR and LF
+    bool known = false;        // false until the block has been scanned
+};
+
+using ByteHistogram = std::array<std::uint32_t, 256>;
+
+// Block size used for the map of a |fileSize| byte file: kStatsBlockSize, doubled until the
+// file has at most kMaxStatsBlocks blocks.
+constexpr std::size_t kStatsBlockSize = 4096;
+constexpr std::uint64_t kMaxStatsBlocks = 1u << 20;
+std::uint64_t stats_block_size(std::uint64_t fileSize);
+
+// Adds the byte counts of |size| bytes at |data| to |counts|. Counting goes through several
+// tables in turn, so runs of one byte value do not stall on a single counter.
+void add_byte_histogram(const std::uint8_t* data, std::size_t size, ByteHistogram& counts);
+
+// Statistics of |total| bytes counted into |counts|.
+BlockStats stats_from_histogram(const ByteHistogram& counts, std::size_t total);
+
+// Fills out[0 .. ceil(size / blockSize)) with the statistics of consecutive blocks of |data|;
+// the last block may be short.
+void compute_block_stats(const std::uint8_t* data, std::size_t size, std::size_t blockSize, BlockStats* out);
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_BLOCK_STATS_H
@@ -0,0 +1,278 @@
+/*
+ * Renaming a batch of files as one transaction (POSIX-only, no Qt)
+ * src/core/bulk_rename.cpp
+ */
+
+#include "bulk_rename.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr char kTempPrefix[] = ".pcmanfm-rename-";
+
+// Renames without replacing anything, also where the filesystem lacks RENAME_NOREPLACE.
+int renameNoReplace(int dirFd, const char* from, const char* to) {
+#ifdef RENAME_NOREPLACE
+    if (::renameat2(dirFd, from, dirFd, to, RENAME_NOREPLACE) == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        return errno;
+    }
+#endif
+    struct stat st;
+    if (::fstatat(dirFd, to, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        return EEXIST;
+    }
+    return ::renameat(dirFd, from, dirFd, to) == 0 ? 0 : errno;
+}
+
+// Whether |from| and |to| only differ in case and name the same file, as on a filesystem that
+// ignores case. Two hard links of a file are not the same name.
+bool sameFileInOtherCase(int dirFd, const std::string& from, const std::string& to) {
+    if (::strcasecmp(from.c_str(), to.c_str()) != 0) {
+        return false;
+    }
+    struct stat a, b;
+    return ::fstatat(dirFd, from.c_str(), &a, AT_SYMLINK_NOFOLLOW) == 0 &&
+           ::fstatat(dirFd, to.c_str(), &b, AT_SYMLINK_NOFOLLOW) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+int renameStep(int dirFd, const std::string& from, const std::string& to) {
+    const int error = renameNoReplace(dirFd, from.c_str(), to.c_str());
+    if (error == EEXIST && sameFileInOtherCase(dirFd, from, to)) {
+        return ::renameat(dirFd, from.c_str(), dirFd, to.c_str()) == 0 ? 0 : errno;
+    }
+    return error;
+}
+
+}  // namespace
+
+BulkRename::BulkRename(std::vector<Item> items) {
+    items_.reserve(items.size());
+    for (auto& item : items) {
+        if (item.from != item.to) {
+            items_.push_back(std::move(item));
+        }
+    }
+}
+
+BulkRename::~BulkRename() {
+    for (const Directory& directory : directories_) {
+        if (directory.fd >= 0) {
+            ::close(directory.fd);
+        }
+    }
+}
+
+std::size_t BulkRename::directoryIndex(const std::string& path) {
+    auto it = directoryIndexes_.find(path);
+    if (it != directoryIndexes_.end()) {
+        return it->second;
+    }
+    Directory directory;
+    directory.path = path;
+    directory.fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory.fd >= 0) {
+        const long nameMax = ::fpathconf(directory.fd, _PC_NAME_MAX);
+        if (nameMax > 0) {
+            directory.nameMax = nameMax;
+        }
+    }
+    directories_.push_back(std::move(directory));
+    directoryIndexes_.emplace(path, directories_.size() - 1);
+    return directories_.size() - 1;
+}
+
+std::vector<BulkRename::Issue> BulkRename::validate() {
+    validated_ = true;
+    std::vector<Issue> issues;
+
+    // the names given and taken in each directory, with the items doing it
+    std::vector<std::unordered_map<std::string, std::size_t>> sources;
+    std::vector<std::unordered_map<std::string, std::size_t>> targets;
+    std::vector<bool> usable(items_.size(), false);  // names that passed the checks so far
+    itemDirectories_.clear();
+    itemDirectories_.reserve(items_.size());
+    for (std::size_t i = 0; i < items_.size(); ++i) {
+        const Item& item = items_[i];
+        const std::size_t dir = directoryIndex(item.directory);
+        itemDirectories_.push_back(dir);
+        if (dir >= sources.size()) {
+            sources.resize(dir + 1);
+            targets.resize(dir + 1);
+        }
+        sources[dir].emplace(item.from, i);
+
+        if (item.to.empty() || item.to == "." || item.to == "..") {
+            issues.push_back({i, Problem::EmptyName});
+        }
+        else if (item.to.find('/') != std::string::npos || item.to.find('\0') != std::string::npos) {
+            issues.push_back({i, Problem::InvalidName});
+        }
+        else if (static_cast<long>(item.to.size()) > directories_[dir].nameMax) {
+            issues.push_back({i, Problem::NameTooLong});
+        }
+        else if (!targets[dir].emplace(item.to, i).second) {
+            issues.push_back({i, Problem::DuplicateName});
+        }
+        else {
+            usable[i] = true;
+        }
+    }
+
+    for (std::size_t i = 0; i < items_.size(); ++i) {
+        const Item& item = items_[i];
+        const Directory& directory = directories_[itemDirectories_[i]];
+        struct stat st;
+        if (directory.fd < 0 || ::fstatat(directory.fd, item.from.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            issues.push_back({i, Problem::SourceMissing});
+            continue;
+        }
+        // a name the batch gives up is free by the time it is taken
+        const auto& given = sources[itemDirectories_[i]];
+        if (usable[i] && given.count(item.to) == 0 &&
+            ::fstatat(directory.fd, item.to.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+            !sameFileInOtherCase(directory.fd, item.from, item.to)) {
+            issues.push_back({i, Problem::NameExists});
+        }
+    }
+
+    valid_ = issues.empty();
+    steps_.clear();
+    if (valid_) {
+        plan();
+    }
+    return issues;
+}
+
+void BulkRename::plan() {
+    // Each item takes at most one name another item gives up, and gives up a name at most one
+    // item takes, so the items form chains and cycles.
+    const std::size_t none = items_.size();
+    std::vector<std::unordered_map<std::string, std::size_t>> sources(directories_.size());
+    for (std::size_t i = 0; i < items_.size(); ++i) {
+        sources[itemDirectories_[i]].emplace(items_[i].from, i);
+    }
+    std::vector<std::size_t> next(items_.size(), none);  // the item giving up the name taken
+    std::vector<bool> hasPrevious(items_.size(), false);
+    for (std::size_t i = 0; i < items_.size(); ++i) {
+        const auto& given = sources[itemDirectories_[i]];
+        auto it = given.find(items_[i].to);
+        if (it != given.end() && it->second != i) {
+            next[i] = it->second;
+            hasPrevious[it->second] = true;
+        }
+    }
+
+    steps_.reserve(items_.size());
+    std::vector<bool> planned(items_.size(), false);
+    std::vector<std::size_t> chain;
+    auto addStep = [this](std::size_t i, const std::string& from, const std::string& to) {
+        steps_.push_back(Step{itemDirectories_[i], from, to});
+    };
+
+    // a chain is renamed from its end, which takes a free name
+    for (std::size_t head = 0; head < items_.size(); ++head) {
+        if (hasPrevious[head]) {
+            continue;
+        }
+        chain.clear();
+        for (std::size_t i = head; i != none; i = next[i]) {
+            chain.push_back(i);
+        }
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            addStep(*it, items_[*it].from, items_[*it].to);
+            planned[*it] = true;
+        }
+    }
+
+    // what is left are cycles: one item steps aside to a temporary name to free the others
+    std::size_t tempCount = 0;
+    const std::string tempBase = kTempPrefix + std::to_string(::getpid()) + "-";
+    for (std::size_t start = 0; start < items_.size(); ++start) {
+        if (planned[start]) {
+            continue;
+        }
+        chain.clear();
+        std::size_t i = start;
+        do {
+            chain.push_back(i);
+            i = next[i];
+        } while (i != start);
+
+        const int dirFd = directories_[itemDirectories_[start]].fd;
+        std::string temp;
+        struct stat st;
+        do {
+            temp = tempBase + std::to_string(tempCount++);
+        } while (::fstatat(dirFd, temp.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0);
+
+        addStep(start, items_[start].from, temp);
+        for (auto it = chain.rbegin(); it + 1 != chain.rend(); ++it) {
+            addStep(*it, items_[*it].from, items_[*it].to);
+        }
+        addStep(start, temp, items_[start].to);
+        for (const std::size_t member : chain) {
+            planned[member] = true;
+        }
+    }
+}
+
+BulkRename::Outcome BulkRename::run(const std::function<bool(std::size_t)>& tick, std::string& errorOut) {
+    if (!validated_) {
+        validate();
+    }
+    if (!valid_) {
+        errorOut = "some of the new names cannot be used";
+        return Outcome::Failed;
+    }
+    for (std::size_t done = 0; done < steps_.size(); ++done) {
+        const Step& step = steps_[done];
+        const Directory& directory = directories_[step.directory];
+        const int error = renameStep(directory.fd, step.from, step.to);
+        if (error != 0) {
+            errorOut =
+                "could not rename " + directory.path + "/" + step.from + " to " + step.to + ": " + std::strerror(error);
+            undo(done, errorOut);
+            return Outcome::Failed;
+        }
+        if (tick && !tick(done + 1)) {
+            if (!undo(done + 1, errorOut)) {
+                return Outcome::Failed;
+            }
+            return Outcome::Cancelled;
+        }
+    }
+    return Outcome::Done;
+}
+
+bool BulkRename::undo(std::size_t count, std::string& errorOut) {
+    bool undone = true;
+    while (count > 0) {
+        const Step& step = steps_[--count];
+        const Directory& directory = directories_[step.directory];
+        const int error = renameStep(directory.fd, step.to, step.from);
+        if (error != 0) {
+            // keep undoing the rest, which the failure leaves alone unless it took this name
+            if (!errorOut.empty()) {
+                errorOut += "; ";
+            }
+            errorOut += "could not rename " + directory.path + "/" + step.to + " back to " + step.from + ": " +
+                        std::strerror(error);
+            undone = false;
+        }
+    }
+    return undone;
+}
+
+}  // namespace PCManFM
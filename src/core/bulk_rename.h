@@ -0,0 +1,102 @@
+/*
+ * Renaming a batch of files as one transaction (POSIX-only, no Qt)
+ * src/core/bulk_rename.h
+ */
+
+#ifndef PCMANFM_BULK_RENAME_H
+#define PCMANFM_BULK_RENAME_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace PCManFM {
+
+// BulkRename renames many files within their directories at once. All the new names are
+// checked before anything is renamed: a name may not be empty, "." or "..", hold a '/', be too
+// long for its filesystem, be given to two files, or belong to a file outside the batch. Names
+// passed along the batch ("a" -> "b" while "b" -> "c") are renamed in an order that frees each
+// name before it is taken, and cycles ("a" <-> "b") go through a temporary name. Nothing is
+// ever replaced. When a rename fails or the batch is cancelled, the renames done so far are
+// undone in reverse order, so the batch takes effect whole or not at all. Not thread-safe;
+// run() is meant for a worker thread.
+class BulkRename {
+   public:
+    struct Item {
+        std::string directory;  // absolute
+        std::string from;       // names within |directory|
+        std::string to;
+    };
+
+    enum class Problem {
+        EmptyName,      // "", "." or ".."
+        InvalidName,    // holds '/' or NUL
+        NameTooLong,    // beyond NAME_MAX of the filesystem
+        DuplicateName,  // another item takes the same name
+        NameExists,     // a file outside the batch has the name
+        SourceMissing,  // the file to rename is gone
+    };
+
+    struct Issue {
+        std::size_t item;  // index into items()
+        Problem problem;
+    };
+
+    enum class Outcome {
+        Done,
+        Cancelled,  // every rename was undone
+        Failed,     // every rename was undone, unless the error says otherwise
+    };
+
+    // Items whose name does not change are dropped.
+    explicit BulkRename(std::vector<Item> items);
+    ~BulkRename();
+
+    BulkRename(const BulkRename&) = delete;
+    BulkRename& operator=(const BulkRename&) = delete;
+
+    const std::vector<Item>& items() const { return items_; }
+
+    // Checks all the new names against each other and the directories; empty when the batch
+    // can run.
+    std::vector<Issue> validate();
+
+    // The renames run() makes, more than items() when cycles go through temporary names.
+    // Valid after validate() found no issue.
+    std::size_t stepCount() const { return steps_.size(); }
+
+    // Renames everything, calling |tick| with the number of renames done after each one; it
+    // returns false to cancel. Validates first when validate() was not called.
+    Outcome run(const std::function<bool(std::size_t)>& tick, std::string& errorOut);
+
+   private:
+    struct Step {
+        std::size_t directory;  // index into directories_
+        std::string from;
+        std::string to;
+    };
+
+    struct Directory {
+        std::string path;
+        int fd = -1;
+        long nameMax = 255;
+    };
+
+    std::size_t directoryIndex(const std::string& path);
+    void plan();
+    bool undo(std::size_t count, std::string& errorOut);
+
+    std::vector<Item> items_;
+    std::vector<std::size_t> itemDirectories_;  // of each item, into directories_
+    std::vector<Directory> directories_;
+    std::unordered_map<std::string, std::size_t> directoryIndexes_;
+    std::vector<Step> steps_;
+    bool validated_ = false;
+    bool valid_ = false;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_BULK_RENAME_H
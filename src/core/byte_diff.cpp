@@ -0,0 +1,168 @@
+/*
+ * Byte-level comparison of two buffers for the hex editor (no Qt)
+ * src/core/byte_diff.cpp
+ */
+
+#include "byte_diff.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCMANFM_BYTE_DIFF_AVX2 1
+#endif
+
+namespace PCManFM {
+
+namespace {
+
+// Blocks handed to memcmp; large enough that libc runs at full vector width, small enough
+// that rescanning the block with a mismatch costs little.
+constexpr std::size_t kEqualBlock = 64 * 1024;
+
+constexpr std::uint64_t kLowBits = 0x0101010101010101ull;
+constexpr std::uint64_t kHighBits = 0x8080808080808080ull;
+
+// Loads eight bytes with the first one in the low bits, whatever the byte order.
+std::uint64_t load_word(const std::uint8_t* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+// Word-at-a-time scan for the first index where the bytes of |a| and |b| are equal
+// (|wantEqual|) or differ, or |length|.
+std::size_t scan_words(const std::uint8_t* a, const std::uint8_t* b, std::size_t length, bool wantEqual) {
+    std::size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        const std::uint64_t x = load_word(a + i) ^ load_word(b + i);
+        // For equal bytes, flag the zero bytes of x; the lowest flag is exact even though
+        // borrows can set spurious ones above it.
+        const std::uint64_t mask = wantEqual ? (x - kLowBits) & ~x & kHighBits : x;
+        if (mask != 0) {
+            return i + static_cast<std::size_t>(__builtin_ctzll(mask)) / 8;
+        }
+    }
+    for (; i < length; ++i) {
+        if ((a[i] == b[i]) == wantEqual) {
+            return i;
+        }
+    }
+    return length;
+}
+
+#ifdef PCMANFM_BYTE_DIFF_AVX2
+__attribute__((target("avx2"))) std::size_t scan_avx2(const std::uint8_t* a,
+                                                      const std::uint8_t* b,
+                                                      std::size_t length,
+                                                      bool wantEqual) {
+    std::size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        std::uint32_t equal = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+        if (!wantEqual) {
+            equal = ~equal;
+        }
+        if (equal != 0) {
+            return i + static_cast<std::size_t>(__builtin_ctz(equal));
+        }
+    }
+    return i + scan_words(a + i, b + i, length - i, wantEqual);
+}
+
+const bool kHaveAvx2 = __builtin_cpu_supports("avx2");
+#endif
+
+std::size_t scan(const std::uint8_t* a, const std::uint8_t* b, std::size_t length, bool wantEqual) {
+#ifdef PCMANFM_BYTE_DIFF_AVX2
+    if (kHaveAvx2) {
+        return scan_avx2(a, b, length, wantEqual);
+    }
+#endif
+    return scan_words(a, b, length, wantEqual);
+}
+
+}  // namespace
+
+std::size_t first_mismatch(const std::uint8_t* a, const std::uint8_t* b, std::size_t length) {
+    std::size_t pos = 0;
+    while (pos < length) {
+        const std::size_t n = std::min(kEqualBlock, length - pos);
+        if (std::memcmp(a + pos, b + pos, n) != 0) {
+            return pos + scan(a + pos, b + pos, n, false);
+        }
+        pos += n;
+    }
+    return length;
+}
+
+std::size_t first_match(const std::uint8_t* a, const std::uint8_t* b, std::size_t length) {
+    return scan(a, b, length, true);
+}
+
+void append_diff_range(std::vector<DiffRange>& out, const DiffRange& range) {
+    if (range.length == 0) {
+        return;
+    }
+    if (!out.empty() && out.back().end() == range.offset) {
+        out.back().length += range.length;
+        return;
+    }
+    out.push_back(range);
+}
+
+void collect_diff_ranges(std::uint64_t base,
+                         const std::uint8_t* a,
+                         const std::uint8_t* b,
+                         std::size_t length,
+                         std::vector<DiffRange>& out) {
+    std::size_t pos = 0;
+    while (pos < length) {
+        pos += first_mismatch(a + pos, b + pos, length - pos);
+        if (pos == length) {
+            break;
+        }
+        const std::size_t run = first_match(a + pos, b + pos, length - pos);
+        append_diff_range(out, DiffRange{base + pos, run});
+        pos += run;
+    }
+}
+
+void DiffRangeList::append(const std::vector<DiffRange>& ranges) {
+    for (const DiffRange& range : ranges) {
+        append_diff_range(ranges_, range);
+        differingBytes_ += range.length;
+    }
+}
+
+void DiffRangeList::clear() {
+    ranges_.clear();
+    differingBytes_ = 0;
+}
+
+bool DiffRangeList::contains(std::uint64_t offset) const {
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), offset,
+                               [](std::uint64_t value, const DiffRange& range) { return value < range.offset; });
+    if (it == ranges_.begin()) {
+        return false;
+    }
+    --it;
+    return offset < it->end();
+}
+
+bool DiffRangeList::next(std::uint64_t offset, bool forward, std::size_t& index) const {
+    const auto it = std::lower_bound(ranges_.begin(), ranges_.end(), offset,
+                                     [](const DiffRange& range, std::uint64_t value) { return range.offset < value; });
+    if (forward ? it == ranges_.end() : it == ranges_.begin()) {
+        return false;
+    }
+    index = static_cast<std::size_t>(it - ranges_.begin()) - (forward ? 0 : 1);
+    return true;
+}
+
+}  // namespace PCManFM
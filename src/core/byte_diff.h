@@ -0,0 +1,68 @@
+/*
+ * Byte-level comparison of two buffers for the hex editor (no Qt)
+ * src/core/byte_diff.h
+ */
+
+#ifndef PCMANFM_BYTE_DIFF_H
+#define PCMANFM_BYTE_DIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace PCManFM {
+
+// A run of differing bytes, [offset, offset + length).
+struct DiffRange {
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+
+    std::uint64_t end() const { return offset + length; }
+};
+
+// Index of the first byte where |a| and |b| differ, or |length| when they are equal. Equal
+// 64 KiB blocks are skipped with memcmp; only the block holding the mismatch is searched,
+// 32 bytes at a time with AVX2 when the CPU has it.
+std::size_t first_mismatch(const std::uint8_t* a, const std::uint8_t* b, std::size_t length);
+
+// Index of the first byte where |a| and |b| agree, or |length| when they differ throughout.
+std::size_t first_match(const std::uint8_t* a, const std::uint8_t* b, std::size_t length);
+
+// Appends the runs where |a| and |b| differ to |out|, at |base| plus their index. A run that
+// starts where the last one in |out| ends extends it, so a buffer compared window by window
+// gives the same ranges as one compared whole.
+void collect_diff_ranges(std::uint64_t base,
+                         const std::uint8_t* a,
+                         const std::uint8_t* b,
+                         std::size_t length,
+                         std::vector<DiffRange>& out);
+
+// Appends |range| to |out|, merging it into the last range when they touch.
+void append_diff_range(std::vector<DiffRange>& out, const DiffRange& range);
+
+// The differing ranges of two documents, sorted and disjoint, as the compare mode of the hex
+// editor collects them window by window and navigates them afterwards.
+class DiffRangeList {
+   public:
+    // Adds ranges that start at or after the end of the last one.
+    void append(const std::vector<DiffRange>& ranges);
+    void clear();
+
+    const std::vector<DiffRange>& ranges() const { return ranges_; }
+    std::size_t size() const { return ranges_.size(); }
+    bool empty() const { return ranges_.empty(); }
+    std::uint64_t differingBytes() const { return differingBytes_; }
+
+    bool contains(std::uint64_t offset) const;
+    // Index of the first range starting at or after |offset| when |forward|, else of the last
+    // one starting before it; false when there is none.
+    bool next(std::uint64_t offset, bool forward, std::size_t& index) const;
+
+   private:
+    std::vector<DiffRange> ranges_;
+    std::uint64_t differingBytes_ = 0;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_BYTE_DIFF_H
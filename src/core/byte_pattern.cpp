@@ -0,0 +1,286 @@
+/*
+ * Masked and multi-pattern byte search for the hex editor (no Qt)
+ * src/core/byte_pattern.cpp
+ */
+
+#include "byte_pattern.h"
+
+#include "byte_search.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace PCManFM {
+
+namespace {
+
+// Longer anchors only grow the automaton; past this they add little selectivity.
+constexpr std::size_t kMaxAnchor = 32;
+constexpr std::uint32_t kEmits = 1;
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',';
+}
+
+// Reads one nibble: a hex digit or '?' when |wildcards| is set.
+bool read_nibble(char c, bool wildcards, std::uint8_t& value, std::uint8_t& mask) {
+    if (wildcards && c == '?') {
+        value = 0;
+        mask = 0;
+        return true;
+    }
+    const int v = hex_value(c);
+    if (v < 0) {
+        return false;
+    }
+    value = static_cast<std::uint8_t>(v);
+    mask = 0xF;
+    return true;
+}
+
+}  // namespace
+
+bool parse_byte_pattern(std::string_view text, BytePattern& out, std::string& errorOut) {
+    out = {};
+    std::size_t i = 0;
+    auto pair = [&](bool wildcards, std::uint8_t& value, std::uint8_t& mask) {
+        std::uint8_t hv = 0, hm = 0, lv = 0, lm = 0;
+        if (i + 1 >= text.size() || !read_nibble(text[i], wildcards, hv, hm) ||
+            !read_nibble(text[i + 1], wildcards, lv, lm)) {
+            return false;
+        }
+        value = static_cast<std::uint8_t>(hv << 4 | lv);
+        mask = static_cast<std::uint8_t>(hm << 4 | lm);
+        i += 2;
+        return true;
+    };
+
+    while (i < text.size()) {
+        if (is_space(text[i])) {
+            ++i;
+            continue;
+        }
+        const std::size_t at = i;
+        std::uint8_t value = 0;
+        std::uint8_t mask = 0;
+        if (!pair(true, value, mask)) {
+            errorOut = "Expected a hex byte at position " + std::to_string(at + 1);
+            return false;
+        }
+        if (i < text.size() && text[i] == '/') {
+            ++i;
+            std::uint8_t bits = 0;
+            std::uint8_t ignored = 0;
+            if (!pair(false, bits, ignored)) {
+                errorOut = "Expected a hex mask at position " + std::to_string(i + 1);
+                return false;
+            }
+            mask &= bits;
+        }
+        out.value.push_back(value & mask);
+        out.mask.push_back(mask);
+    }
+    if (out.value.empty()) {
+        errorOut = "Pattern is empty";
+        return false;
+    }
+    return true;
+}
+
+PatternMatcher::PatternMatcher() = default;
+PatternMatcher::~PatternMatcher() = default;
+
+bool PatternMatcher::compile(std::vector<BytePattern> patterns, std::string& errorOut) {
+    patterns_.clear();
+    anchors_.clear();
+    single_.reset();
+    next_.clear();
+    table_.clear();
+    accept_.clear();
+    outputLink_.clear();
+    maxLength_ = 0;
+
+    for (std::size_t p = 0; p < patterns.size(); ++p) {
+        const BytePattern& pattern = patterns[p];
+        if (pattern.value.empty() || pattern.value.size() != pattern.mask.size()) {
+            errorOut = "Pattern " + std::to_string(p + 1) + " is empty";
+            return false;
+        }
+        Anchor best;
+        std::size_t run = 0;
+        for (std::size_t i = 0; i <= pattern.size(); ++i) {
+            if (i < pattern.size() && pattern.mask[i] == 0xFF) {
+                ++run;
+                continue;
+            }
+            if (run > best.length) {
+                best.offset = i - run;
+                best.length = run;
+            }
+            run = 0;
+        }
+        if (best.length == 0) {
+            errorOut = "Pattern " + std::to_string(p + 1) + " needs at least one fully specified byte";
+            return false;
+        }
+        best.length = std::min(best.length, kMaxAnchor);
+        anchors_.push_back(best);
+        maxLength_ = std::max(maxLength_, pattern.size());
+    }
+    patterns_ = std::move(patterns);
+
+    if (patterns_.size() == 1) {
+        single_ = std::make_unique<ByteSearcher>(patterns_[0].value.data() + anchors_[0].offset, anchors_[0].length);
+    }
+    else if (!patterns_.empty()) {
+        build();
+    }
+    return true;
+}
+
+// Builds the anchor trie and resolves it into a full transition table (missing edges follow
+// the failure links), so scanning is one table lookup per byte.
+void PatternMatcher::build() {
+    next_.assign(256, -1);
+    accept_.emplace_back();
+    for (std::size_t p = 0; p < patterns_.size(); ++p) {
+        std::int32_t state = 0;
+        for (std::size_t i = 0; i < anchors_[p].length; ++i) {
+            const std::uint8_t b = patterns_[p].value[anchors_[p].offset + i];
+            std::int32_t& edge = next_[static_cast<std::size_t>(state) * 256 + b];
+            if (edge < 0) {
+                edge = static_cast<std::int32_t>(accept_.size());
+                accept_.emplace_back();
+                next_.resize(next_.size() + 256, -1);
+            }
+            state = next_[static_cast<std::size_t>(state) * 256 + b];
+        }
+        accept_[static_cast<std::size_t>(state)].push_back(static_cast<std::uint32_t>(p));
+    }
+
+    const std::size_t states = accept_.size();
+    std::vector<std::int32_t> fail(states, 0);
+    outputLink_.assign(states, -1);
+    std::deque<std::int32_t> queue;
+    for (std::size_t b = 0; b < 256; ++b) {
+        std::int32_t& edge = next_[b];
+        if (edge < 0) {
+            edge = 0;
+        }
+        else {
+            queue.push_back(edge);
+        }
+    }
+    while (!queue.empty()) {
+        const std::int32_t state = queue.front();
+        queue.pop_front();
+        const std::size_t row = static_cast<std::size_t>(state) * 256;
+        for (std::size_t b = 0; b < 256; ++b) {
+            const std::int32_t child = next_[row + b];
+            const std::int32_t fallback = next_[static_cast<std::size_t>(fail[state]) * 256 + b];
+            if (child < 0) {
+                next_[row + b] = fallback;
+                continue;
+            }
+            fail[child] = fallback;
+            outputLink_[child] = accept_[static_cast<std::size_t>(fallback)].empty() ? outputLink_[fallback] : fallback;
+            queue.push_back(child);
+        }
+    }
+
+    // The scan loop walks |table_|, whose entries are the target's row offset (state * 256)
+    // with the low bit flagging states that complete an anchor, so the common case costs a
+    // single lookup per byte.
+    table_.resize(next_.size());
+    for (std::size_t i = 0; i < next_.size(); ++i) {
+        const std::int32_t target = next_[i];
+        const bool emits = !accept_[static_cast<std::size_t>(target)].empty() || outputLink_[target] >= 0;
+        table_[i] = static_cast<std::uint32_t>(target) << 8 | (emits ? kEmits : 0);
+    }
+    next_.clear();
+    next_.shrink_to_fit();
+}
+
+bool PatternMatcher::verify(std::size_t index, const std::uint8_t* start) const {
+    const BytePattern& pattern = patterns_[index];
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+        if ((start[i] & pattern.mask[i]) != pattern.value[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// |anchorEnd| is one past the last anchor byte of pattern |index| inside the data.
+void PatternMatcher::report(std::size_t index,
+                            std::size_t anchorEnd,
+                            std::size_t length,
+                            std::size_t reportLimit,
+                            std::uint64_t base,
+                            const std::uint8_t* data,
+                            std::vector<PatternHit>& hits) const {
+    const Anchor& anchor = anchors_[index];
+    if (anchorEnd < anchor.offset + anchor.length) {
+        return;  // the pattern would start before the data
+    }
+    const std::size_t start = anchorEnd - anchor.length - anchor.offset;
+    if (start >= reportLimit || start + patterns_[index].size() > length || !verify(index, data + start)) {
+        return;
+    }
+    PatternHit hit;
+    hit.offset = base + start;
+    hit.pattern = index;
+    hits.push_back(hit);
+}
+
+void PatternMatcher::scan(const std::uint8_t* data,
+                          std::size_t length,
+                          std::size_t reportLimit,
+                          std::uint64_t base,
+                          std::vector<PatternHit>& hits) const {
+    if (patterns_.empty() || length == 0) {
+        return;
+    }
+    const std::size_t first = hits.size();
+
+    if (single_) {
+        const Anchor& anchor = anchors_[0];
+        const std::uint8_t* const end = data + length;
+        for (const std::uint8_t* p = single_->find(data, end); p; p = single_->find(p + 1, end)) {
+            report(0, static_cast<std::size_t>(p - data) + anchor.length, length, reportLimit, base, data, hits);
+        }
+        return;  // anchor order is start order for a single pattern
+    }
+
+    std::uint32_t entry = 0;
+    for (std::size_t i = 0; i < length; ++i) {
+        entry = table_[(entry & ~kEmits) + data[i]];
+        if (!(entry & kEmits)) {
+            continue;
+        }
+        const std::int32_t state = static_cast<std::int32_t>(entry >> 8);
+        for (std::int32_t s = accept_[static_cast<std::size_t>(state)].empty() ? outputLink_[state] : state; s >= 0;
+             s = outputLink_[s]) {
+            for (const std::uint32_t index : accept_[static_cast<std::size_t>(s)]) {
+                report(index, i + 1, length, reportLimit, base, data, hits);
+            }
+        }
+    }
+    std::stable_sort(hits.begin() + static_cast<std::ptrdiff_t>(first), hits.end(),
+                     [](const PatternHit& a, const PatternHit& b) { return a.offset < b.offset; });
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,95 @@
+/*
+ * Masked and multi-pattern byte search for the hex editor (no Qt)
+ * src/core/byte_pattern.h
+ */
+
+#ifndef PCMANFM_BYTE_PATTERN_H
+#define PCMANFM_BYTE_PATTERN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace PCManFM {
+
+class ByteSearcher;
+
+// A byte matches when (byte & mask[i]) == value[i]; value is stored pre-masked.
+struct BytePattern {
+    std::vector<std::uint8_t> value;
+    std::vector<std::uint8_t> mask;
+
+    std::size_t size() const { return value.size(); }
+};
+
+// Parses hex pairs such as "48 8B ?? ?? 00". A '?' in place of a digit matches any nibble
+// ("4?", "?F", "??"), and "XX/MM" gives an explicit bit mask ("40/F0" equals "4?").
+// Whitespace between pairs is optional.
+bool parse_byte_pattern(std::string_view text, BytePattern& out, std::string& errorOut);
+
+struct PatternHit {
+    std::uint64_t offset = 0;
+    std::size_t pattern = 0;  // index into the compiled pattern list
+};
+
+// PatternMatcher finds a set of masked patterns in one pass. Each pattern is anchored on its
+// longest run of fully specified bytes; the anchors are matched with an Aho-Corasick
+// automaton (or ByteSearcher when there is a single pattern) and every anchor hit is then
+// verified against the whole masked pattern. Overlapping matches are all reported.
+class PatternMatcher {
+   public:
+    PatternMatcher();
+    ~PatternMatcher();
+
+    PatternMatcher(const PatternMatcher&) = delete;
+    PatternMatcher& operator=(const PatternMatcher&) = delete;
+
+    // Fails when a pattern is empty or has no fixed byte to anchor on.
+    bool compile(std::vector<BytePattern> patterns, std::string& errorOut);
+
+    std::size_t patternCount() const { return patterns_.size(); }
+    const BytePattern& pattern(std::size_t index) const { return patterns_[index]; }
+    std::size_t maxLength() const { return maxLength_; }
+
+    // Appends, in offset order, every match lying wholly inside [data, data + length) whose
+    // start is before data + reportLimit, offset by |base|. Scanning consecutive chunks with
+    // reportLimit = chunk size and maxLength() - 1 bytes of look-ahead reports each match once.
+    void scan(const std::uint8_t* data,
+              std::size_t length,
+              std::size_t reportLimit,
+              std::uint64_t base,
+              std::vector<PatternHit>& hits) const;
+
+   private:
+    struct Anchor {
+        std::size_t offset = 0;  // position of the anchor inside its pattern
+        std::size_t length = 0;
+    };
+
+    bool verify(std::size_t index, const std::uint8_t* start) const;
+    void report(std::size_t index,
+                std::size_t anchorEnd,
+                std::size_t length,
+                std::size_t reportLimit,
+                std::uint64_t base,
+                const std::uint8_t* data,
+                std::vector<PatternHit>& hits) const;
+    void build();
+
+    std::vector<BytePattern> patterns_;
+    std::vector<Anchor> anchors_;
+    std::size_t maxLength_ = 0;
+
+    std::unique_ptr<ByteSearcher> single_;
+    std::vector<std::int32_t> next_;                  // DFA under construction, 256 entries per state
+    std::vector<std::uint32_t> table_;                // resolved DFA used by scan()
+    std::vector<std::vector<std::uint32_t>> accept_;  // patterns whose anchor ends in a state
+    std::vector<std::int32_t> outputLink_;            // nearest proper suffix state that accepts
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_BYTE_PATTERN_H
@@ -0,0 +1,94 @@
+/*
+ * Byte pattern search for the hex editor (no Qt)
+ * src/core/byte_search.cpp
+ */
+
+#include "byte_search.h"
+
+#include <cstring>
+
+namespace PCManFM {
+
+namespace {
+
+// Needles shorter than this gain little from Horspool shifts, so they always use memchr.
+constexpr std::size_t kHorspoolMinLength = 4;
+
+}  // namespace
+
+ByteSearcher::ByteSearcher(const std::uint8_t* needle, std::size_t length) : needle_(needle, needle + length) {
+    const std::size_t m = needle_.size();
+    skip_.fill(m);
+    for (std::size_t i = 0; i + 1 < m; ++i) {
+        skip_[needle_[i]] = m - 1 - i;
+    }
+    horspool_ = m >= kHorspoolMinLength;
+}
+
+void ByteSearcher::tune(const std::uint8_t* sample, std::size_t length) {
+    if (needle_.empty() || length == 0) {
+        return;
+    }
+    std::array<std::size_t, 256> counts{};
+    for (std::size_t i = 0; i < length; ++i) {
+        ++counts[sample[i]];
+    }
+    std::size_t best = 0;
+    for (std::size_t i = 1; i < needle_.size(); ++i) {
+        if (counts[needle_[i]] < counts[needle_[best]]) {
+            best = i;
+        }
+    }
+    anchor_ = best;
+    // memchr stops at every occurrence of the anchor; once it shows up more often than about
+    // one byte in 32, the verification overhead outweighs its speed.
+    horspool_ = needle_.size() >= kHorspoolMinLength && counts[needle_[best]] * 32 > length;
+}
+
+const std::uint8_t* ByteSearcher::find(const std::uint8_t* begin, const std::uint8_t* end) const {
+    const std::size_t m = needle_.size();
+    if (m == 0 || end < begin || static_cast<std::size_t>(end - begin) < m) {
+        return nullptr;
+    }
+    if (m == 1) {
+        return static_cast<const std::uint8_t*>(std::memchr(begin, needle_[0], static_cast<std::size_t>(end - begin)));
+    }
+    return horspool_ ? findHorspool(begin, end) : findAnchored(begin, end);
+}
+
+const std::uint8_t* ByteSearcher::findAnchored(const std::uint8_t* begin, const std::uint8_t* end) const {
+    const std::size_t m = needle_.size();
+    const std::uint8_t anchor = needle_[anchor_];
+    // A candidate must start at or before end - m, so its anchor byte lies before |limit|.
+    const std::uint8_t* limit = end - (m - 1 - anchor_);
+    const std::uint8_t* p = begin + anchor_;
+    while (p < limit) {
+        const auto* hit = static_cast<const std::uint8_t*>(std::memchr(p, anchor, static_cast<std::size_t>(limit - p)));
+        if (!hit) {
+            return nullptr;
+        }
+        const std::uint8_t* candidate = hit - anchor_;
+        if (std::memcmp(candidate, needle_.data(), m) == 0) {
+            return candidate;
+        }
+        p = hit + 1;
+    }
+    return nullptr;
+}
+
+const std::uint8_t* ByteSearcher::findHorspool(const std::uint8_t* begin, const std::uint8_t* end) const {
+    const std::size_t m = needle_.size();
+    const std::uint8_t last = needle_[m - 1];
+    const std::size_t n = static_cast<std::size_t>(end - begin);
+    std::size_t pos = 0;
+    while (pos + m <= n) {
+        const std::uint8_t c = begin[pos + m - 1];
+        if (c == last && std::memcmp(begin + pos, needle_.data(), m - 1) == 0) {
+            return begin + pos;
+        }
+        pos += skip_[c];
+    }
+    return nullptr;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,45 @@
+/*
+ * Byte pattern search for the hex editor (no Qt)
+ * src/core/byte_search.h
+ */
+
+#ifndef PCMANFM_BYTE_SEARCH_H
+#define PCMANFM_BYTE_SEARCH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace PCManFM {
+
+// ByteSearcher finds one fixed needle in memory, typically in windows streamed from a
+// document. Depending on the data it either scans for the needle's rarest byte with memchr
+// (vectorised by libc) and verifies candidates, or runs Boyer-Moore-Horspool, which wins
+// when every needle byte is common in the haystack (zero-filled firmware, text).
+class ByteSearcher {
+   public:
+    ByteSearcher(const std::uint8_t* needle, std::size_t length);
+
+    std::size_t size() const { return needle_.size(); }
+
+    // Picks the strategy from the byte frequencies of |sample|, usually the first window
+    // searched. Without a call the searcher uses Horspool for needles of four bytes or more.
+    void tune(const std::uint8_t* sample, std::size_t length);
+
+    // First occurrence starting in [begin, end - size()], or nullptr.
+    const std::uint8_t* find(const std::uint8_t* begin, const std::uint8_t* end) const;
+
+   private:
+    const std::uint8_t* findAnchored(const std::uint8_t* begin, const std::uint8_t* end) const;
+    const std::uint8_t* findHorspool(const std::uint8_t* begin, const std::uint8_t* end) const;
+
+    std::vector<std::uint8_t> needle_;
+    std::array<std::size_t, 256> skip_{};
+    std::size_t anchor_ = 0;  // needle index scanned for with memchr
+    bool horspool_ = false;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_BYTE_SEARCH_H
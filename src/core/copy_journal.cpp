@@ -0,0 +1,313 @@
+/*
+ * On-disk journal that makes long copies resumable (POSIX-only, no Qt)
+ * src/core/copy_journal.cpp
+ */
+
+#include "copy_journal.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace PCManFM::FsOps {
+
+namespace {
+
+// File layout: magic, then records in native byte order.
+//   record: u8 type | u32 key length | key | u64 size | i64 mtime sec | u32 mtime nsec |
+//           u64 offset | digest[32]
+// Type 0 carries the job description in the key field.
+constexpr char kMagic[8] = {'P', 'C', 'M', 'F', 'C', 'J', 'N', '1'};
+constexpr std::uint8_t kDescriptionRecord = 0;
+constexpr std::size_t kFixedSize = 1 + 4 + 8 + 8 + 4 + 8 + 32;
+constexpr std::uint32_t kMaxKeyLength = 1u << 20;
+
+void set_error(Error& err, const char* context) {
+    err.code = errno;
+    err.message = std::string(context) + ": " + std::strerror(errno);
+}
+
+bool matches_source(const CopyJournal::Entry& entry, const struct stat& src) {
+    return entry.size == static_cast<std::uint64_t>(src.st_size) && entry.mtimeSec == src.st_mtim.tv_sec &&
+           entry.mtimeNsec == static_cast<std::uint32_t>(src.st_mtim.tv_nsec);
+}
+
+CopyJournal::Entry entry_for(const struct stat& src) {
+    CopyJournal::Entry entry;
+    entry.size = static_cast<std::uint64_t>(src.st_size);
+    entry.mtimeSec = src.st_mtim.tv_sec;
+    entry.mtimeNsec = static_cast<std::uint32_t>(src.st_mtim.tv_nsec);
+    return entry;
+}
+
+bool read_fd(int fd, std::vector<std::uint8_t>& data, Error& err) {
+    std::uint8_t buffer[64 * 1024];
+    off_t pos = 0;
+    for (;;) {
+        const ssize_t n = ::pread(fd, buffer, sizeof(buffer), pos);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error(err, "read");
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        data.insert(data.end(), buffer, buffer + n);
+        pos += n;
+    }
+}
+
+// Walks the records after the magic and returns the offset where the last complete one ends.
+template <typename Visit>
+std::size_t parse_records(const std::vector<std::uint8_t>& data, Visit&& visit) {
+    std::size_t pos = sizeof(kMagic);
+    while (data.size() - pos >= kFixedSize) {
+        const std::uint8_t* rec = data.data() + pos;
+        std::uint32_t keyLength = 0;
+        std::memcpy(&keyLength, rec + 1, 4);
+        if (keyLength > kMaxKeyLength || data.size() - pos < kFixedSize + keyLength) {
+            break;
+        }
+        const std::uint8_t type = rec[0];
+        if (type != kDescriptionRecord && type != static_cast<std::uint8_t>(CopyJournal::State::Partial) &&
+            type != static_cast<std::uint8_t>(CopyJournal::State::Done)) {
+            break;
+        }
+        const std::uint8_t* fixed = rec + 5 + keyLength;
+        CopyJournal::Entry entry;
+        entry.state = static_cast<CopyJournal::State>(type);
+        std::memcpy(&entry.size, fixed, 8);
+        std::memcpy(&entry.mtimeSec, fixed + 8, 8);
+        std::memcpy(&entry.mtimeNsec, fixed + 16, 4);
+        std::memcpy(&entry.offset, fixed + 20, 8);
+        std::memcpy(entry.digest, fixed + 28, 32);
+        visit(type, std::string(reinterpret_cast<const char*>(rec + 5), keyLength), entry);
+        pos += kFixedSize + keyLength;
+    }
+    return pos;
+}
+
+}  // namespace
+
+CopyJournal::~CopyJournal() {
+    close();
+}
+
+bool CopyJournal::open(const std::string& path, Error& err) {
+    err = {};
+    close();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !make_dir_parents(path.substr(0, slash), err)) {
+        return false;
+    }
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd_ < 0) {
+        set_error(err, "open");
+        return false;
+    }
+    path_ = path;
+    if (!load(err)) {
+        ::close(fd_);
+        fd_ = -1;
+        path_.clear();
+        return false;
+    }
+    return true;
+}
+
+void CopyJournal::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    path_.clear();
+    resumed_ = false;
+    description_.clear();
+    entries_.clear();
+}
+
+bool CopyJournal::remove(Error& err) {
+    err = {};
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path = path_;
+    }
+    close();
+    if (!path.empty() && ::unlink(path.c_str()) < 0 && errno != ENOENT) {
+        set_error(err, "unlink");
+        return false;
+    }
+    return true;
+}
+
+bool CopyJournal::load(Error& err) {
+    std::vector<std::uint8_t> data;
+    if (!read_fd(fd_, data, err)) {
+        return false;
+    }
+    if (data.size() < sizeof(kMagic) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        // New or unrecognised file: start over.
+        if (::ftruncate(fd_, 0) < 0 || ::write(fd_, kMagic, sizeof(kMagic)) != static_cast<ssize_t>(sizeof(kMagic))) {
+            set_error(err, "write");
+            return false;
+        }
+        return true;
+    }
+
+    const std::size_t end = parse_records(data, [this](std::uint8_t type, std::string key, const Entry& entry) {
+        if (type == kDescriptionRecord) {
+            description_ = std::move(key);
+        }
+        else {
+            entries_[std::move(key)] = entry;
+        }
+    });
+    resumed_ = !entries_.empty();
+
+    // Drop a torn trailing record so new appends start on a record boundary.
+    if (end != data.size() && ::ftruncate(fd_, static_cast<off_t>(end)) < 0) {
+        set_error(err, "ftruncate");
+        return false;
+    }
+    return true;
+}
+
+bool CopyJournal::readDescription(const std::string& path, std::string& description, Error& err) {
+    err = {};
+    description.clear();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        set_error(err, "open");
+        return false;
+    }
+    std::vector<std::uint8_t> data;
+    const bool ok = read_fd(fd, data, err);
+    ::close(fd);
+    if (!ok) {
+        return false;
+    }
+    if (data.size() < sizeof(kMagic) || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        err.code = EINVAL;
+        err.message = "Not a copy journal";
+        return false;
+    }
+    parse_records(data, [&description](std::uint8_t type, std::string key, const Entry&) {
+        if (type == kDescriptionRecord) {
+            description = std::move(key);
+        }
+    });
+    return true;
+}
+
+bool CopyJournal::append(std::uint8_t type, const std::string& key, const Entry& entry, Error& err) {
+    if (fd_ < 0) {
+        err.code = EBADF;
+        err.message = "copy journal is not open";
+        return false;
+    }
+    if (key.size() > kMaxKeyLength) {
+        err.code = ENAMETOOLONG;
+        err.message = "copy journal key too long";
+        return false;
+    }
+    std::vector<std::uint8_t> rec(kFixedSize + key.size());
+    const auto keyLength = static_cast<std::uint32_t>(key.size());
+    rec[0] = type;
+    std::memcpy(rec.data() + 1, &keyLength, 4);
+    std::memcpy(rec.data() + 5, key.data(), key.size());
+    std::uint8_t* fixed = rec.data() + 5 + key.size();
+    std::memcpy(fixed, &entry.size, 8);
+    std::memcpy(fixed + 8, &entry.mtimeSec, 8);
+    std::memcpy(fixed + 16, &entry.mtimeNsec, 4);
+    std::memcpy(fixed + 20, &entry.offset, 8);
+    std::memcpy(fixed + 28, entry.digest, 32);
+
+    // One O_APPEND write per record; a crash can only tear the last one.
+    const ssize_t n = ::write(fd_, rec.data(), rec.size());
+    if (n != static_cast<ssize_t>(rec.size())) {
+        if (n >= 0) {
+            errno = EIO;
+        }
+        set_error(err, "write");
+        return false;
+    }
+    if (::fdatasync(fd_) < 0) {
+        set_error(err, "fdatasync");
+        return false;
+    }
+    return true;
+}
+
+std::string CopyJournal::description() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return description_;
+}
+
+bool CopyJournal::setDescription(const std::string& description, Error& err) {
+    err = {};
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (description_ == description) {
+        return true;
+    }
+    if (!append(kDescriptionRecord, description, Entry{}, err)) {
+        return false;
+    }
+    description_ = description;
+    return true;
+}
+
+bool CopyJournal::find(const std::string& destination, const struct stat& src, Entry& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = entries_.find(destination);
+    if (it == entries_.end() || !matches_source(it->second, src)) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+bool CopyJournal::recordPartial(const std::string& destination,
+                                const struct stat& src,
+                                std::uint64_t offset,
+                                const std::uint8_t* digest,
+                                Error& err) {
+    err = {};
+    Entry entry = entry_for(src);
+    entry.state = State::Partial;
+    entry.offset = offset;
+    std::memcpy(entry.digest, digest, sizeof(entry.digest));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!append(static_cast<std::uint8_t>(State::Partial), destination, entry, err)) {
+        return false;
+    }
+    entries_[destination] = entry;
+    return true;
+}
+
+bool CopyJournal::recordDone(const std::string& destination, const struct stat& src, Error& err) {
+    err = {};
+    Entry entry = entry_for(src);
+    entry.state = State::Done;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!append(static_cast<std::uint8_t>(State::Done), destination, entry, err)) {
+        return false;
+    }
+    entries_[destination] = entry;
+    return true;
+}
+
+}  // namespace PCManFM::FsOps
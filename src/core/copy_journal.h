@@ -0,0 +1,89 @@
+/*
+ * On-disk journal that makes long copies resumable (POSIX-only, no Qt)
+ * src/core/copy_journal.h
+ */
+
+#ifndef PCMANFM_COPY_JOURNAL_H
+#define PCMANFM_COPY_JOURNAL_H
+
+#include "fs_ops.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct stat;
+
+namespace PCManFM::FsOps {
+
+// CopyJournal records which destination files of a copy are complete and how far large
+// files got, so copy_path() can skip finished entries and continue a partial file in place
+// after an interruption. Records are appended as fixed-layout binary entries (destination
+// path, source size and mtime, offset, BLAKE3 of the destination prefix); a torn trailing
+// record is dropped on open. Entries are only written after the data they describe has been
+// synced. Safe to share between copy worker threads.
+class CopyJournal {
+   public:
+    enum class State : std::uint8_t {
+        Partial = 1,
+        Done = 2,
+    };
+
+    struct Entry {
+        State state = State::Partial;
+        std::uint64_t size = 0;
+        std::int64_t mtimeSec = 0;
+        std::uint32_t mtimeNsec = 0;
+        std::uint64_t offset = 0;      // Partial: bytes [0, offset) are on disk
+        std::uint8_t digest[32] = {};  // Partial: BLAKE3 of those bytes
+    };
+
+    CopyJournal() = default;
+    ~CopyJournal();
+
+    CopyJournal(const CopyJournal&) = delete;
+    CopyJournal& operator=(const CopyJournal&) = delete;
+
+    // Opens the journal at |path|, creating it (and its parent directories) if needed and
+    // loading any entries left by an interrupted run.
+    bool open(const std::string& path, Error& err);
+    void close();
+    // Closes and deletes the journal once the job has completed.
+    bool remove(Error& err);
+
+    const std::string& path() const { return path_; }
+    bool resumed() const { return resumed_; }
+
+    // Free-form description of the job (for example the serialized request), stored once.
+    std::string description() const;
+    bool setDescription(const std::string& description, Error& err);
+    // Reads only the description of the journal at |path| without opening it for writing,
+    // e.g. to list interrupted jobs while another one may still be running.
+    static bool readDescription(const std::string& path, std::string& description, Error& err);
+
+    // Looks up |destination| and checks that the recorded source identity still matches |src|.
+    bool find(const std::string& destination, const struct stat& src, Entry& out) const;
+    bool recordPartial(const std::string& destination,
+                       const struct stat& src,
+                       std::uint64_t offset,
+                       const std::uint8_t* digest,
+                       Error& err);
+    bool recordDone(const std::string& destination, const struct stat& src, Error& err);
+
+   private:
+    bool append(std::uint8_t type, const std::string& key, const Entry& entry, Error& err);
+    bool load(Error& err);
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    int fd_ = -1;
+    bool resumed_ = false;
+    std::string description_;
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+}  // namespace PCManFM::FsOps
+
+#endif  // PCMANFM_COPY_JOURNAL_H
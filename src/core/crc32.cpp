@@ -0,0 +1,142 @@
+/*
+ * CRC-32 (the zlib/zip/PNG polynomial) with hardware acceleration (no Qt)
+ * src/core/crc32.cpp
+ */
+
+#include "crc32.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PCMANFM_CRC32_PCLMUL 1
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#define PCMANFM_CRC32_ARMV8 1
+#endif
+
+namespace PCManFM {
+
+namespace {
+
+std::uint32_t crc32_zlib(std::uint32_t crc, const std::uint8_t* data, std::size_t length) {
+    while (length > 0) {
+        const std::size_t n = std::min<std::size_t>(length, UINT_MAX);
+        crc = static_cast<std::uint32_t>(::crc32(crc, data, static_cast<uInt>(n)));
+        data += n;
+        length -= n;
+    }
+    return crc;
+}
+
+#ifdef PCMANFM_CRC32_PCLMUL
+// Folding constants for the bit-reflected polynomial 0xEDB88320, from Intel's "Fast CRC
+// Computation for Generic Polynomials Using PCLMULQDQ Instruction": x^(4*128+32) and
+// x^(4*128-32) mod P for the four-lane fold, x^(128+32) and x^(128-32) for the single one,
+// x^64 for 128 to 64 bits, then P and floor(x^64 / P) for the Barrett reduction.
+alignas(16) constexpr std::uint64_t kFold4[2] = {0x0154442bd4, 0x01c6e41596};
+alignas(16) constexpr std::uint64_t kFold1[2] = {0x01751997d0, 0x00ccaa009e};
+alignas(16) constexpr std::uint64_t kFold64[2] = {0x0163cd6124, 0x0000000000};
+alignas(16) constexpr std::uint64_t kBarrett[2] = {0x01db710641, 0x01f7011641};
+
+// Multiplies the two halves of |acc| by the pair of constants |k| and adds in |next|.
+__attribute__((target("pclmul"))) inline __m128i fold(__m128i acc, __m128i k, __m128i next) {
+    const __m128i lo = _mm_clmulepi64_si128(acc, k, 0x00);
+    const __m128i hi = _mm_clmulepi64_si128(acc, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+// Folds |length| bytes, at least 64 and a multiple of 16, into the raw (not inverted) CRC
+// register |crc| and returns the new register.
+__attribute__((target("pclmul,sse4.1"))) std::uint32_t fold_pclmul(std::uint32_t crc,
+                                                                   const std::uint8_t* data,
+                                                                   std::size_t length) {
+    const auto load = [](const std::uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+
+    __m128i x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    __m128i x2 = load(data + 16);
+    __m128i x3 = load(data + 32);
+    __m128i x4 = load(data + 48);
+    data += 64;
+    length -= 64;
+
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(kFold4));
+    while (length >= 64) {
+        x1 = fold(x1, k, load(data));
+        x2 = fold(x2, k, load(data + 16));
+        x3 = fold(x3, k, load(data + 32));
+        x4 = fold(x4, k, load(data + 48));
+        data += 64;
+        length -= 64;
+    }
+
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(kFold1));
+    x1 = fold(x1, k, x2);
+    x1 = fold(x1, k, x3);
+    x1 = fold(x1, k, x4);
+    while (length >= 16) {
+        x1 = fold(x1, k, load(data));
+        data += 16;
+        length -= 16;
+    }
+
+    // 128 bits to 64.
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k, 0x10));
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(kFold64));
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00), _mm_srli_si128(x1, 4));
+
+    // Barrett reduction to 32 bits.
+    k = _mm_load_si128(reinterpret_cast<const __m128i*>(kBarrett));
+    __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+    t = _mm_clmulepi64_si128(_mm_and_si128(t, mask32), k, 0x00);
+    return static_cast<std::uint32_t>(_mm_extract_epi32(_mm_xor_si128(x1, t), 1));
+}
+
+const bool kHavePclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+
+#ifdef PCMANFM_CRC32_ARMV8
+__attribute__((target("+crc"))) std::uint32_t crc32_armv8(std::uint32_t crc,
+                                                          const std::uint8_t* data,
+                                                          std::size_t length) {
+    crc = ~crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = __crc32d(crc, word);
+    }
+    for (; length > 0; ++data, --length) {
+        crc = __crc32b(crc, *data);
+    }
+    return ~crc;
+}
+
+const bool kHaveArmCrc = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+
+}  // namespace
+
+std::uint32_t crc32_update(std::uint32_t crc, const std::uint8_t* data, std::size_t length) {
+#ifdef PCMANFM_CRC32_PCLMUL
+    if (kHavePclmul && length >= 64) {
+        const std::size_t folded = length & ~static_cast<std::size_t>(15);
+        crc = ~fold_pclmul(~crc, data, folded);
+        data += folded;
+        length -= folded;
+    }
+#endif
+#ifdef PCMANFM_CRC32_ARMV8
+    if (kHaveArmCrc) {
+        return crc32_armv8(crc, data, length);
+    }
+#endif
+    return crc32_zlib(crc, data, length);
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,21 @@
+/*
+ * CRC-32 (the zlib/zip/PNG polynomial) with hardware acceleration (no Qt)
+ * src/core/crc32.h
+ */
+
+#ifndef PCMANFM_CRC32_H
+#define PCMANFM_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace PCManFM {
+
+// Continues |crc| over |length| bytes at |data|; same values as zlib's crc32(), so start from 0
+// and feed the result back in for the next piece. Uses carry-less multiply folding (PCLMULQDQ)
+// on x86-64 and the CRC32 instructions on ARMv8 when the CPU has them, else zlib.
+std::uint32_t crc32_update(std::uint32_t crc, const std::uint8_t* data, std::size_t length);
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_CRC32_H
@@ -0,0 +1,281 @@
+/*
+ * Copy throughput learned per device
+ * src/core/device_profiles.cpp
+ */
+
+#include "device_profiles.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+
+#include <pwd.h>
+#include <unistd.h>
+
+namespace PCManFM::FsOps {
+
+namespace {
+
+constexpr const char* kHeader = "pcmanfm-qt device profiles 1";
+// weight of a new sample in the smoothed rates and latencies
+constexpr double kSmoothing = 0.3;
+// how much faster a neighbouring setting has to be to move to it
+constexpr double kBetter = 1.05;
+
+void smooth(double& value, double sample) {
+    value = value > 0 ? value + (sample - value) * kSmoothing : sample;
+}
+
+// the index of the largest power of two not above |value|, at most |maxIndex|
+int floor_log2(std::uint64_t value, int maxIndex) {
+    int index = 0;
+    while (index < maxIndex && (value >> (index + 1)) > 0) {
+        ++index;
+    }
+    return index;
+}
+
+}  // namespace
+
+std::string DeviceProfiles::defaultPath() {
+    std::string base;
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0] == '/') {
+        base = xdg;
+    }
+    else {
+        const char* home = std::getenv("HOME");
+        if (!home || home[0] == '\0') {
+            const struct passwd* pw = ::getpwuid(::getuid());
+            home = pw ? pw->pw_dir : nullptr;
+        }
+        if (!home || home[0] == '\0') {
+            return std::string();
+        }
+        base = std::string(home) + "/.cache";
+    }
+    return base + "/pcmanfm-qt/device-profiles";
+}
+
+DeviceProfiles& DeviceProfiles::instance() {
+    static DeviceProfiles profiles;
+    static std::once_flag once;
+    std::call_once(once, [] {
+        Error ignored;
+        const std::string path = defaultPath();
+        if (!path.empty()) {
+            profiles.open(path, ignored);
+        }
+    });
+    return profiles;
+}
+
+bool DeviceProfiles::open(const std::string& path, Error& err) {
+    err = {};
+    std::vector<std::uint8_t> data;
+    const bool read = read_file_all(path, data, err);
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    states_.clear();
+    dirty_ = false;
+    if (!read) {
+        if (err.code == ENOENT) {
+            err = {};
+            return true;
+        }
+        return false;
+    }
+    parse(std::string(data.begin(), data.end()));
+    return true;
+}
+
+void DeviceProfiles::parse(const std::string& text) {
+    std::istringstream in(text);
+    std::string line;
+    if (!std::getline(in, line) || line != kHeader) {
+        return;
+    }
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::uint64_t device = 0;
+        State state;
+        fields >> device >> state.chunk >> state.worker >> state.bytesSeen;
+        for (double& rate : state.chunkRates) {
+            fields >> rate;
+        }
+        for (double& latency : state.chunkLatencies) {
+            fields >> latency;
+        }
+        for (double& rate : state.workerRates) {
+            fields >> rate;
+        }
+        if (fields.fail() || state.chunk < 0 || state.chunk >= kChunkSizes || state.worker < -1 ||
+            state.worker >= kWorkerCounts) {
+            continue;
+        }
+        states_[device] = state;
+    }
+}
+
+bool DeviceProfiles::save(Error& err) {
+    err = {};
+    std::ostringstream out;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (path_.empty() || !dirty_) {
+            return true;
+        }
+        path = path_;
+        out << kHeader << '\n';
+        for (const auto& [device, state] : states_) {
+            out << device << ' ' << state.chunk << ' ' << state.worker << ' ' << state.bytesSeen;
+            for (double rate : state.chunkRates) {
+                out << ' ' << rate;
+            }
+            for (double latency : state.chunkLatencies) {
+                out << ' ' << latency;
+            }
+            for (double rate : state.workerRates) {
+                out << ' ' << rate;
+            }
+            out << '\n';
+        }
+        dirty_ = false;
+    }
+
+    const std::string text = out.str();
+    const auto slash = path.find_last_of('/');
+    if ((slash == std::string::npos || slash == 0 || make_dir_parents(path.substr(0, slash), err)) &&
+        write_file_atomic(path, reinterpret_cast<const std::uint8_t*>(text.data()), text.size(), err,
+                          Durability::None)) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirty_ = true;
+    return false;
+}
+
+std::size_t DeviceProfiles::chunkSize(std::uint64_t device) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = states_.find(device);
+    return it != states_.end() ? kMinChunk << it->second.chunk : kDefaultChunk;
+}
+
+unsigned DeviceProfiles::workers(std::uint64_t device, unsigned maxWorkers) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = states_.find(device);
+    if (it == states_.end() || it->second.worker < 0) {
+        return maxWorkers;
+    }
+    return std::min(1u << it->second.worker, maxWorkers);
+}
+
+void DeviceProfiles::recordChunks(std::uint64_t device,
+                                  std::size_t chunkSize,
+                                  std::uint64_t bytes,
+                                  std::uint64_t chunks,
+                                  std::chrono::nanoseconds elapsed) {
+    if (bytes == 0 || chunks == 0) {
+        return;
+    }
+    const double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-6);
+    const int index = floor_log2(std::max<std::size_t>(chunkSize / kMinChunk, 1), kChunkSizes - 1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, added] = states_.try_emplace(device);
+    State& state = it->second;
+    smooth(state.chunkRates[index], bytes / seconds);
+    smooth(state.chunkLatencies[index], seconds * 1000 / chunks);
+    state.bytesSeen += bytes;
+    dirty_ = dirty_ || added;
+    if (index != state.chunk) {
+        // a sample of a size another copy has moved away from meanwhile
+        return;
+    }
+
+    const double maxLatency = static_cast<double>(kMaxChunkLatency.count());
+    const double* rates = state.chunkRates;
+    const double* latencies = state.chunkLatencies;
+    // a larger size not tried yet is tried while the chunks are quick
+    const bool larger = index + 1 < kChunkSizes &&
+                        (rates[index + 1] == 0
+                             ? latencies[index] < maxLatency / 4
+                             : rates[index + 1] > rates[index] * kBetter && latencies[index + 1] <= maxLatency);
+    int next = index;
+    if (index > 0 && (latencies[index] > maxLatency || rates[index - 1] > rates[index] * kBetter)) {
+        next = index - 1;
+    }
+    else if (larger) {
+        next = index + 1;
+    }
+    if (next != state.chunk) {
+        state.chunk = next;
+        dirty_ = true;
+    }
+}
+
+void DeviceProfiles::recordJob(std::uint64_t device,
+                               unsigned workerCount,
+                               std::uint64_t bytes,
+                               std::chrono::nanoseconds elapsed) {
+    if (bytes < kMinJobBytes || workerCount == 0) {
+        return;
+    }
+    const double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-6);
+    const int index = floor_log2(workerCount, kWorkerCounts - 1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    State& state = states_[device];
+    double* rates = state.workerRates;
+    smooth(rates[index], bytes / seconds);
+    if (state.worker >= 0 && index != state.worker) {
+        dirty_ = true;
+        return;
+    }
+    // Starting from the most workers, fewer are tried while that does not get slower;
+    // devices that seek or queue requests one at a time copy faster with fewer.
+    int next = index;
+    if (index + 1 < kWorkerCounts && rates[index + 1] > rates[index] * kBetter) {
+        next = index + 1;
+    }
+    else if (index > 0 && (rates[index - 1] == 0 || rates[index - 1] > rates[index] * kBetter)) {
+        next = index - 1;
+    }
+    state.worker = next;
+    dirty_ = true;
+}
+
+std::vector<DeviceProfiles::Profile> DeviceProfiles::profiles() const {
+    std::vector<Profile> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    result.reserve(states_.size());
+    for (const auto& [device, state] : states_) {
+        Profile profile;
+        profile.device = device;
+        profile.chunkSize = kMinChunk << state.chunk;
+        profile.workers = state.worker >= 0 ? 1u << state.worker : 0;
+        // a size just moved to is not measured yet, unlike the neighbour it was left for
+        int measured = state.chunk;
+        for (int neighbour : {state.chunk - 1, state.chunk + 1}) {
+            if (state.chunkRates[measured] == 0 && neighbour >= 0 && neighbour < kChunkSizes) {
+                measured = neighbour;
+            }
+        }
+        profile.bytesPerSecond = state.chunkRates[measured];
+        profile.chunkLatencyMs = state.chunkLatencies[measured];
+        profile.bytesSeen = state.bytesSeen;
+        result.push_back(profile);
+    }
+    std::sort(result.begin(), result.end(), [](const Profile& a, const Profile& b) { return a.device < b.device; });
+    return result;
+}
+
+void DeviceProfiles::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirty_ = dirty_ || !states_.empty();
+    states_.clear();
+}
+
+}  // namespace PCManFM::FsOps
@@ -0,0 +1,122 @@
+/*
+ * Copy throughput learned per device (POSIX-only, no Qt)
+ * src/core/device_profiles.h
+ */
+
+#ifndef PCMANFM_DEVICE_PROFILES_H
+#define PCMANFM_DEVICE_PROFILES_H
+
+#include "fs_ops.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace PCManFM::FsOps {
+
+// DeviceProfiles learns, for each device copied to (keyed by st_dev), the chunk size of the
+// read/write loop and the number of workers of tree copies that moved data fastest, so that a
+// copy to tmpfs, an NVMe disk, a USB 2 stick or NFS each starts on settings that suit it
+// (CopyOptions::profiles). The chunk size is a power of two from kMinChunk to kMaxChunk. It is
+// measured every kSampleBytes during a copy and moves to the neighbouring size when that one
+// was faster, grows while a chunk takes less than a quarter of kMaxChunkLatency and shrinks
+// when one takes longer, so that pausing and cancelling stay prompt on slow devices. The
+// worker count (1, 2, 4 or 8) is learned the same way from whole tree copies. Rates are
+// smoothed over the samples, and a setting that gets slower than a neighbour's last rate
+// makes the neighbour be tried again. Profiles are kept in a small text file when open() was
+// called. Safe to share between threads.
+class DeviceProfiles {
+   public:
+    static constexpr std::size_t kMinChunk = 64 * 1024;
+    static constexpr std::size_t kMaxChunk = 8 * 1024 * 1024;
+    // the chunk size of a device not seen yet, and of copies without profiles
+    static constexpr std::size_t kDefaultChunk = 128 * 1024;
+    // bytes copied between two samples of the read/write loop
+    static constexpr std::uint64_t kSampleBytes = 16 * 1024 * 1024;
+    static constexpr std::chrono::milliseconds kMaxChunkLatency{100};
+    // smaller tree copies say too little about parallelism to be recorded
+    static constexpr std::uint64_t kMinJobBytes = 64 * 1024 * 1024;
+
+    struct Profile {
+        std::uint64_t device = 0;
+        std::size_t chunkSize = kDefaultChunk;
+        unsigned workers = 0;       // 0 until a tree copy was recorded
+        // of the read/write loop at |chunkSize|, or at the neighbouring size it was moved from
+        double bytesPerSecond = 0;
+        double chunkLatencyMs = 0;  // to read and write one chunk of that size
+        std::uint64_t bytesSeen = 0;
+    };
+
+    DeviceProfiles() = default;
+
+    DeviceProfiles(const DeviceProfiles&) = delete;
+    DeviceProfiles& operator=(const DeviceProfiles&) = delete;
+
+    // $XDG_CACHE_HOME/pcmanfm-qt/device-profiles, falling back to ~/.cache when unset.
+    static std::string defaultPath();
+
+    // Process-wide profiles, loaded from defaultPath() on first use.
+    static DeviceProfiles& instance();
+
+    // Loads the profiles kept at |path|, which save() then writes to. A missing file is no
+    // error, and lines that cannot be parsed are skipped.
+    bool open(const std::string& path, Error& err);
+
+    // Writes the profiles if a setting changed since they were loaded or last saved.
+    bool save(Error& err);
+
+    // The chunk size to copy to |device| with.
+    std::size_t chunkSize(std::uint64_t device) const;
+
+    // The number of workers for a tree copy to |device|, at most |maxWorkers|; |maxWorkers|
+    // itself while nothing better is known.
+    unsigned workers(std::uint64_t device, unsigned maxWorkers) const;
+
+    // Records that |chunks| chunks of |chunkSize|, |bytes| in all, were read and written to
+    // |device| in |elapsed|, not counting the time spent in progress callbacks.
+    void recordChunks(std::uint64_t device,
+                      std::size_t chunkSize,
+                      std::uint64_t bytes,
+                      std::uint64_t chunks,
+                      std::chrono::nanoseconds elapsed);
+
+    // Records that a tree copy of |bytes| to |device| with |workerCount| workers took |elapsed|.
+    // Copies smaller than kMinJobBytes are ignored.
+    void recordJob(std::uint64_t device,
+                   unsigned workerCount,
+                   std::uint64_t bytes,
+                   std::chrono::nanoseconds elapsed);
+
+    // Everything learned so far, by device.
+    std::vector<Profile> profiles() const;
+
+    void clear();
+
+   private:
+    static constexpr int kChunkSizes = 8;    // kMinChunk << 0 .. kMaxChunk
+    static constexpr int kWorkerCounts = 4;  // 1 << 0 .. 8
+
+    struct State {
+        int chunk = 1;                            // kMinChunk << chunk, kDefaultChunk at first
+        int worker = -1;                          // 1 << worker workers, -1 = none learned
+        double chunkRates[kChunkSizes] = {};      // bytes/s, 0 = not measured
+        double chunkLatencies[kChunkSizes] = {};  // ms
+        double workerRates[kWorkerCounts] = {};   // bytes/s, 0 = not measured
+        std::uint64_t bytesSeen = 0;
+    };
+
+    void parse(const std::string& text);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::uint64_t, State> states_;
+    std::string path_;
+    bool dirty_ = false;
+};
+
+}  // namespace PCManFM::FsOps
+
+#endif  // PCMANFM_DEVICE_PROFILES_H
@@ -0,0 +1,435 @@
+/*
+ * Comparing two directory trees and planning their sync (POSIX-only, no Qt)
+ * src/core/dir_compare.cpp
+ */
+
+#include "dir_compare.h"
+
+#include "hash_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace PCManFM::DirCompare {
+
+namespace {
+
+// whole-file digests asked of the hash cache at once, between two progress reports
+constexpr std::size_t kHashBatch = 32;
+
+// directories compared between two progress reports
+constexpr std::uint64_t kReportEvery = 32;
+
+struct Listed {
+    std::string name;
+    Side side;
+    std::string linkTarget;  // of symbolic links
+};
+
+unsigned resolve_worker_count(unsigned requested) {
+    if (requested != 0) {
+        return requested;
+    }
+    return std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+}
+
+std::string join(const std::string& dir, const std::string& name) {
+    if (dir.empty()) {
+        return name;
+    }
+    return dir + '/' + name;
+}
+
+Kind kind_of(mode_t mode) {
+    if (S_ISREG(mode)) {
+        return Kind::File;
+    }
+    if (S_ISDIR(mode)) {
+        return Kind::Directory;
+    }
+    if (S_ISLNK(mode)) {
+        return Kind::Symlink;
+    }
+    return Kind::Other;
+}
+
+std::int64_t mtime_ns(const Side& side) {
+    return side.mtimeSec * 1000000000 + side.mtimeNsec;
+}
+
+// Lists |path| sorted by name, or returns the errno.
+int list_dir(const std::string& path, std::vector<Listed>& listing) {
+    listing.clear();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return errno;
+    }
+    DIR* stream = ::fdopendir(fd);
+    if (!stream) {
+        const int error = errno;
+        ::close(fd);
+        return error;
+    }
+    while (const struct dirent* entry = ::readdir(stream)) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        struct stat st;
+        if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;  // removed since it was listed
+        }
+        Listed listed;
+        listed.name = name;
+        listed.side.kind = kind_of(st.st_mode);
+        listed.side.size = listed.side.kind == Kind::File ? static_cast<std::uint64_t>(st.st_size) : 0;
+        listed.side.mtimeSec = st.st_mtim.tv_sec;
+        listed.side.mtimeNsec = static_cast<std::uint32_t>(st.st_mtim.tv_nsec);
+        if (listed.side.kind == Kind::Symlink) {
+            char target[4096];
+            const ssize_t n = ::readlinkat(fd, name, target, sizeof(target));
+            if (n >= 0) {
+                listed.linkTarget.assign(target, static_cast<std::size_t>(n));
+            }
+        }
+        listing.push_back(std::move(listed));
+    }
+    ::closedir(stream);
+    std::sort(listing.begin(), listing.end(), [](const Listed& a, const Listed& b) { return a.name < b.name; });
+    return 0;
+}
+
+State newer(const Side& left, const Side& right) {
+    return mtime_ns(left) > mtime_ns(right) ? State::LeftNewer : State::RightNewer;
+}
+
+class Walk {
+   public:
+    Walk(const std::string& left, const std::string& right, const Options& options, const Progress& progress)
+        : left_{left}, right_{right}, options_{options}, progress_{progress} {
+        pending_.emplace_back();  // the roots
+    }
+
+    bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    // Runs the walk; |unsure| gets the entries of files that need hashing, still marked Same.
+    void run(unsigned workers, Result& result, std::vector<Entry>& unsure) {
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < workers; ++t) {
+            threads.emplace_back([this] { work(); });
+        }
+        work();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        result.entries = std::move(entries_);
+        result.sameCount = sameCount_;
+        result.errors = std::move(errors_);
+        unsure = std::move(unsure_);
+    }
+
+   private:
+    struct Found {
+        std::vector<Entry> entries;
+        std::vector<Entry> unsure;
+        std::vector<std::pair<std::string, int>> errors;
+        std::uint64_t same = 0;
+    };
+
+    void work() {
+        Found found;
+        std::vector<std::string> subdirs;
+        std::unique_lock<std::mutex> lock{mutex_};
+        for (;;) {
+            cond_.wait(lock, [this] { return !pending_.empty() || done_; });
+            if (done_) {
+                break;
+            }
+            std::string dir = std::move(pending_.back());
+            pending_.pop_back();
+            ++busy_;
+            lock.unlock();
+
+            if (!cancelled()) {
+                compareDir(dir, found, subdirs);
+                report();
+            }
+
+            lock.lock();
+            --busy_;
+            if (cancelled()) {
+                pending_.clear();
+                subdirs.clear();
+            }
+            const bool hasSubdirs = !subdirs.empty();
+            std::move(subdirs.begin(), subdirs.end(), std::back_inserter(pending_));
+            subdirs.clear();
+            if (pending_.empty() && busy_ == 0) {
+                done_ = true;
+                cond_.notify_all();
+            }
+            else if (hasSubdirs) {
+                cond_.notify_all();
+            }
+        }
+        std::move(found.entries.begin(), found.entries.end(), std::back_inserter(entries_));
+        std::move(found.unsure.begin(), found.unsure.end(), std::back_inserter(unsure_));
+        std::move(found.errors.begin(), found.errors.end(), std::back_inserter(errors_));
+        sameCount_ += found.same;
+    }
+
+    void report() {
+        const std::uint64_t done = dirsDone_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (progress_ && done % kReportEvery == 1) {
+            std::lock_guard<std::mutex> lock{progressMutex_};
+            if (!cancelled() && !progress_(done, 0)) {
+                cancelled_.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Merge-joins the listings of |dir| on both sides.
+    void compareDir(const std::string& dir, Found& found, std::vector<std::string>& subdirs) {
+        std::vector<Listed> left;
+        std::vector<Listed> right;
+        int error = list_dir(join(left_, dir), left);
+        if (error == 0) {
+            error = list_dir(join(right_, dir), right);
+        }
+        if (error != 0) {
+            found.errors.emplace_back(dir, error);
+            return;
+        }
+        auto l = left.begin();
+        auto r = right.begin();
+        while (l != left.end() || r != right.end()) {
+            Entry entry;
+            if (r == right.end() || (l != left.end() && l->name < r->name)) {
+                entry.path = join(dir, l->name);
+                entry.state = State::LeftOnly;
+                entry.left = l->side;
+                found.entries.push_back(std::move(entry));
+                ++l;
+                continue;
+            }
+            if (l == left.end() || r->name < l->name) {
+                entry.path = join(dir, r->name);
+                entry.state = State::RightOnly;
+                entry.right = r->side;
+                found.entries.push_back(std::move(entry));
+                ++r;
+                continue;
+            }
+            entry.path = join(dir, l->name);
+            entry.left = l->side;
+            entry.right = r->side;
+            const bool sameTime = std::abs(mtime_ns(l->side) - mtime_ns(r->side)) <= options_.mtimeWindowNs;
+            if (l->side.kind != r->side.kind) {
+                entry.state = State::KindDiffers;
+            }
+            else if (l->side.kind == Kind::Directory) {
+                subdirs.push_back(std::move(entry.path));
+                ++l;
+                ++r;
+                continue;
+            }
+            else if (l->side.kind == Kind::Symlink) {
+                entry.state = l->linkTarget == r->linkTarget ? State::Same
+                              : sameTime                     ? State::ContentDiffers
+                                                             : newer(l->side, r->side);
+            }
+            else if (l->side.kind == Kind::File) {
+                if (l->side.size != r->side.size) {
+                    entry.state = sameTime ? State::ContentDiffers : newer(l->side, r->side);
+                }
+                else if (sameTime ? options_.content == Content::HashAll : options_.content != Content::Metadata) {
+                    found.unsure.push_back(std::move(entry));
+                    ++l;
+                    ++r;
+                    continue;
+                }
+                else {
+                    entry.state = sameTime ? State::Same : newer(l->side, r->side);
+                }
+            }
+            if (entry.state == State::Same) {
+                ++found.same;
+            }
+            else {
+                found.entries.push_back(std::move(entry));
+            }
+            ++l;
+            ++r;
+        }
+    }
+
+    const std::string& left_;
+    const std::string& right_;
+    const Options& options_;
+    const Progress& progress_;
+    std::mutex progressMutex_;
+    std::atomic<bool> cancelled_{false};
+    std::atomic<std::uint64_t> dirsDone_{0};
+
+    std::mutex mutex_;  // for all below
+    std::condition_variable cond_;
+    std::vector<std::string> pending_;  // relative, taken from the back so the walk goes depth first
+    unsigned busy_ = 0;
+    bool done_ = false;
+    std::vector<Entry> entries_;
+    std::vector<Entry> unsure_;
+    std::vector<std::pair<std::string, int>> errors_;
+    std::uint64_t sameCount_ = 0;
+};
+
+bool is_directory(const std::string& path, FsOps::Error& err) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        err.code = errno;
+        err.message = path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        err.code = ENOTDIR;
+        err.message = path + ": " + std::strerror(ENOTDIR);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool compare(const std::string& left,
+             const std::string& right,
+             const Options& options,
+             const Progress& progress,
+             Result& result,
+             FsOps::Error& err) {
+    result = Result{};
+    err = {};
+    if (!is_directory(left, err) || !is_directory(right, err)) {
+        return false;
+    }
+    const unsigned workers = resolve_worker_count(options.workerCount);
+    auto cancelled = [&]() {
+        err.code = ECANCELED;
+        err.message = "compare: " + std::string(std::strerror(ECANCELED));
+        result = Result{};
+        return false;
+    };
+
+    Walk walk{left, right, options, progress};
+    std::vector<Entry> unsure;
+    walk.run(workers, result, unsure);
+    if (walk.cancelled()) {
+        return cancelled();
+    }
+
+    // both sides of the files the metadata could not decide, through the persistent cache
+    HashCache& cache = options.hashCache ? *options.hashCache : HashCache::instance();
+    std::vector<std::string> batch;
+    std::vector<FsOps::Blake3Result> hashes;
+    for (std::size_t begin = 0; begin < unsure.size(); begin += kHashBatch) {
+        if (progress && !progress(begin, unsure.size())) {
+            return cancelled();
+        }
+        const std::size_t end = std::min(unsure.size(), begin + kHashBatch);
+        batch.clear();
+        for (std::size_t i = begin; i < end; ++i) {
+            batch.push_back(join(left, unsure[i].path));
+            batch.push_back(join(right, unsure[i].path));
+        }
+        cache.blake3Files(batch, hashes, workers);
+        for (std::size_t i = begin; i < end; ++i) {
+            Entry& entry = unsure[i];
+            const FsOps::Blake3Result& l = hashes[2 * (i - begin)];
+            const FsOps::Blake3Result& r = hashes[2 * (i - begin) + 1];
+            if (l.error.isSet() || r.error.isSet()) {
+                result.errors.emplace_back(entry.path, l.error.isSet() ? l.error.code : r.error.code);
+                continue;
+            }
+            const bool sameTime = std::abs(mtime_ns(entry.left) - mtime_ns(entry.right)) <= options.mtimeWindowNs;
+            if (l.hexHash == r.hexHash) {
+                ++result.sameCount;
+                continue;
+            }
+            entry.state = sameTime ? State::ContentDiffers : newer(entry.left, entry.right);
+            result.entries.push_back(std::move(entry));
+        }
+    }
+
+    if (progress && !unsure.empty() && !progress(unsure.size(), unsure.size())) {
+        return cancelled();
+    }
+
+    std::sort(result.entries.begin(), result.entries.end(),
+              [](const Entry& a, const Entry& b) { return a.path < b.path; });
+    std::sort(result.errors.begin(), result.errors.end());
+    return true;
+}
+
+SyncPlan plan_sync(const Result& result, Direction direction) {
+    SyncPlan plan;
+    auto toRight = [&](const Entry& entry) {
+        plan.toRight.push_back(entry.path);
+        plan.bytesToRight += entry.left.size;
+    };
+    auto toLeft = [&](const Entry& entry) {
+        plan.toLeft.push_back(entry.path);
+        plan.bytesToLeft += entry.right.size;
+    };
+    for (const Entry& entry : result.entries) {
+        switch (entry.state) {
+            case State::Same:
+                break;
+            case State::LeftOnly:
+                if (direction != Direction::RightToLeft) {
+                    toRight(entry);
+                }
+                break;
+            case State::RightOnly:
+                if (direction != Direction::LeftToRight) {
+                    toLeft(entry);
+                }
+                break;
+            case State::LeftNewer:
+            case State::RightNewer:
+            case State::ContentDiffers:
+                if (direction == Direction::LeftToRight) {
+                    toRight(entry);
+                }
+                else if (direction == Direction::RightToLeft) {
+                    toLeft(entry);
+                }
+                else if (entry.state == State::LeftNewer) {
+                    toRight(entry);
+                }
+                else if (entry.state == State::RightNewer) {
+                    toLeft(entry);
+                }
+                else {
+                    plan.conflicts.push_back(entry.path);
+                }
+                break;
+            case State::KindDiffers:
+                plan.conflicts.push_back(entry.path);
+                break;
+        }
+    }
+    return plan;
+}
+
+}  // namespace PCManFM::DirCompare
@@ -0,0 +1,110 @@
+/*
+ * Comparing two directory trees and planning their sync (POSIX-only, no Qt)
+ * src/core/dir_compare.h
+ */
+
+#ifndef PCMANFM_DIR_COMPARE_H
+#define PCMANFM_DIR_COMPARE_H
+
+#include "fs_ops.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace PCManFM {
+
+class HashCache;
+
+namespace DirCompare {
+
+enum class Kind { Missing, File, Directory, Symlink, Other };
+
+enum class State {
+    Same,
+    LeftNewer,       // on both sides, modified later on the left
+    RightNewer,
+    LeftOnly,        // a directory only on one side is not descended into
+    RightOnly,
+    ContentDiffers,  // same size and modification time but not the same bytes (Content::HashAll)
+    KindDiffers,     // a file on one side and a directory or a link on the other
+};
+
+// How far files of the same size are compared.
+enum class Content {
+    Metadata,        // the modification time decides
+    HashWhenUnsure,  // files whose times differ are hashed; only touched, they count as the same
+    HashAll,         // files whose times agree are hashed as well
+};
+
+struct Options {
+    Content content = Content::Metadata;
+    // Modification times this close count as the same, for filesystems that keep whole
+    // seconds; FAT and exFAT need 2 s.
+    std::int64_t mtimeWindowNs = 1000000000;
+    unsigned workerCount = 0;        // 0 for one per core
+    HashCache* hashCache = nullptr;  // HashCache::instance() if null
+};
+
+struct Side {
+    Kind kind = Kind::Missing;
+    std::uint64_t size = 0;  // of regular files
+    std::int64_t mtimeSec = 0;
+    std::uint32_t mtimeNsec = 0;
+};
+
+struct Entry {
+    std::string path;  // relative to both roots
+    State state = State::Same;
+    Side left;
+    Side right;
+};
+
+struct Result {
+    std::vector<Entry> entries;  // the differences only, sorted by path
+    std::uint64_t sameCount = 0;
+    std::vector<std::pair<std::string, int>> errors;  // relative paths left out, and their errno
+};
+
+// The directories compared so far with |total| 0 during the walk, then the files hashed out
+// of |total|; returning false cancels. Called from the worker threads, one call at a time.
+using Progress = std::function<bool(std::uint64_t done, std::uint64_t total)>;
+
+// Walks |left| and |right| together: every directory found on both sides is listed on both
+// on some worker thread, and the two sorted listings are merge-joined. Regular files are
+// told apart by size and modification time first, and hashed through the hash cache only
+// as |options| asks. Symbolic links compare by target. Returns false with ECANCELED when
+// |progress| cancels, or with the errno of a root that is not a readable directory.
+bool compare(const std::string& left,
+             const std::string& right,
+             const Options& options,
+             const Progress& progress,
+             Result& result,
+             FsOps::Error& err);
+
+enum class Direction {
+    LeftToRight,  // the right side is made like the left one, but keeps what only it has
+    RightToLeft,
+    Both,         // the newer side wins, and what one side lacks is copied to it
+};
+
+// The paths to copy over the other side, relative to the roots. Nothing is ever deleted.
+// Entries whose kinds differ, and in a two-way sync those of different content but the same
+// time, are left as conflicts.
+struct SyncPlan {
+    std::vector<std::string> toRight;
+    std::vector<std::string> toLeft;
+    std::vector<std::string> conflicts;
+    std::uint64_t bytesToRight = 0;  // of the regular files; directories count as 0
+    std::uint64_t bytesToLeft = 0;
+};
+
+SyncPlan plan_sync(const Result& result, Direction direction);
+
+}  // namespace DirCompare
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_DIR_COMPARE_H
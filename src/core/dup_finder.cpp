@@ -0,0 +1,586 @@
+/*
+ * Finding and merging files of the same content (POSIX-only, no Qt)
+ * src/core/dup_finder.cpp
+ */
+
+#include "dup_finder.h"
+
+#include "hash_cache.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <b3sum/blake3.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace PCManFM::DupFinder {
+
+namespace {
+
+// read from each end of a file for the sample; a file of up to twice this is sampled whole
+constexpr std::size_t kSampleSize = 64 * 1024;
+
+// whole-file digests asked of the hash cache at once, between two progress reports
+constexpr std::size_t kHashBatch = 32;
+
+constexpr auto kProgressInterval = std::chrono::milliseconds(100);
+
+using Digest = std::array<std::uint8_t, BLAKE3_OUT_LEN>;
+
+struct Candidate {
+    std::uint64_t size = 0;
+    File file;
+};
+
+struct PendingDir {
+    std::string path;
+    std::uint64_t rootDevice;
+    bool isRoot;  // a root given as a symbolic link is followed
+};
+
+void set_error(FsOps::Error& err, int code, const std::string& context) {
+    err.code = code;
+    err.message = context + ": " + std::strerror(code);
+}
+
+std::string to_hex(const Digest& digest) {
+    static const char* kHex = "0123456789abcdef";
+    std::string hex(digest.size() * 2, '0');
+    for (std::size_t i = 0; i < digest.size(); ++i) {
+        hex[2 * i] = kHex[(digest[i] >> 4) & 0xF];
+        hex[2 * i + 1] = kHex[digest[i] & 0xF];
+    }
+    return hex;
+}
+
+unsigned resolve_worker_count(unsigned requested) {
+    if (requested != 0) {
+        return requested;
+    }
+    return std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+}
+
+File file_from_stat(std::string path, const struct stat& st) {
+    File file;
+    file.path = std::move(path);
+    file.device = st.st_dev;
+    file.inode = st.st_ino;
+    file.mtimeSec = st.st_mtim.tv_sec;
+    file.mtimeNsec = static_cast<std::uint32_t>(st.st_mtim.tv_nsec);
+    return file;
+}
+
+bool same_file(const struct stat& st, const File& file, std::uint64_t size) {
+    return S_ISREG(st.st_mode) && st.st_dev == file.device && st.st_ino == file.inode &&
+           static_cast<std::uint64_t>(st.st_size) == size && st.st_mtim.tv_sec == file.mtimeSec &&
+           static_cast<std::uint32_t>(st.st_mtim.tv_nsec) == file.mtimeNsec;
+}
+
+// Passes the progress of the workers on one at a time, at most every kProgressInterval but
+// for the last report of a stage, and remembers a cancellation.
+class Reporter {
+   public:
+    explicit Reporter(const Progress& progress) : progress_{progress} {}
+
+    bool isCancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    bool report(Stage stage, std::uint64_t done, std::uint64_t total, bool force = false) {
+        if (isCancelled()) {
+            return false;
+        }
+        if (!progress_) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock{mutex_};
+        const auto now = std::chrono::steady_clock::now();
+        if (!force && now - lastReport_ < kProgressInterval) {
+            return true;
+        }
+        lastReport_ = now;
+        if (!progress_(stage, done, total)) {
+            cancelled_.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+   private:
+    const Progress& progress_;
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point lastReport_;
+    std::atomic<bool> cancelled_{false};
+};
+
+// Runs |fn| for every index below |count| on up to |workers| threads, this one included.
+template <typename Fn>
+void parallel_for(std::size_t count, unsigned workers, Fn fn) {
+    std::atomic<std::size_t> next{0};
+    auto run = [&]() {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    const std::size_t extra = std::min<std::size_t>(workers, count) - (count > 0 ? 1 : 0);
+    for (std::size_t t = 0; t < extra; ++t) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// The walk of the roots: directories are taken from the back, so it goes depth first and the
+// pending paths stay few.
+class Walk {
+   public:
+    Walk(const Options& options, Reporter& reporter) : options_{options}, reporter_{reporter} {}
+
+    void add(PendingDir dir) { pending_.push_back(std::move(dir)); }
+
+    void addFile(Candidate candidate) { found_.push_back(std::move(candidate)); }
+
+    std::uint64_t scanned() const { return scanned_.load(std::memory_order_relaxed); }
+
+    std::vector<Candidate> run(unsigned workers) {
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < workers; ++t) {
+            threads.emplace_back([this] { work(); });
+        }
+        work();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return std::move(found_);
+    }
+
+   private:
+    void work() {
+        std::vector<Candidate> found;
+        std::vector<PendingDir> subdirs;
+        std::unique_lock<std::mutex> lock{mutex_};
+        for (;;) {
+            cond_.wait(lock, [this] { return !pending_.empty() || done_; });
+            if (done_) {
+                break;
+            }
+            PendingDir dir = std::move(pending_.back());
+            pending_.pop_back();
+            ++busy_;
+            lock.unlock();
+
+            if (!reporter_.isCancelled()) {
+                listDir(dir, found, subdirs);
+            }
+
+            lock.lock();
+            --busy_;
+            if (reporter_.isCancelled()) {
+                pending_.clear();
+                subdirs.clear();
+            }
+            const bool hasSubdirs = !subdirs.empty();
+            std::move(subdirs.begin(), subdirs.end(), std::back_inserter(pending_));
+            subdirs.clear();
+            if (pending_.empty() && busy_ == 0) {
+                done_ = true;
+                cond_.notify_all();
+            }
+            else if (hasSubdirs) {
+                cond_.notify_all();
+            }
+        }
+        std::move(found.begin(), found.end(), std::back_inserter(found_));
+    }
+
+    void listDir(const PendingDir& dir, std::vector<Candidate>& found, std::vector<PendingDir>& subdirs) {
+        const int fd = ::open(dir.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (dir.isRoot ? 0 : O_NOFOLLOW));
+        if (fd < 0) {
+            return;
+        }
+        DIR* stream = ::fdopendir(fd);
+        if (!stream) {
+            ::close(fd);
+            return;
+        }
+        std::string prefix = dir.path;
+        if (prefix.empty() || prefix.back() != '/') {
+            prefix += '/';
+        }
+        std::uint64_t files = 0;
+        while (const struct dirent* entry = ::readdir(stream)) {
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            struct stat st;
+            if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;  // removed since it was listed
+            }
+            if (S_ISDIR(st.st_mode)) {
+                if (!options_.sameFilesystem || st.st_dev == dir.rootDevice) {
+                    subdirs.push_back(PendingDir{prefix + name, dir.rootDevice, false});
+                }
+            }
+            else if (S_ISREG(st.st_mode) && static_cast<std::uint64_t>(st.st_size) >= options_.minSize) {
+                found.push_back(Candidate{static_cast<std::uint64_t>(st.st_size), file_from_stat(prefix + name, st)});
+            }
+            ++files;
+        }
+        ::closedir(stream);
+        const std::uint64_t scanned = scanned_.fetch_add(files, std::memory_order_relaxed) + files;
+        reporter_.report(Stage::Scanning, scanned, 0);
+    }
+
+    const Options& options_;
+    Reporter& reporter_;
+    std::mutex mutex_;  // for all below
+    std::condition_variable cond_;
+    std::vector<PendingDir> pending_;
+    std::vector<Candidate> found_;
+    unsigned busy_ = 0;
+    bool done_ = false;
+    std::atomic<std::uint64_t> scanned_{0};
+};
+
+// The BLAKE3 of the first and the last kSampleSize bytes of |candidate|, which is the digest
+// of the whole file when it is no larger than both. False when the file is gone or changed.
+bool sample(const Candidate& candidate, Digest& digest) {
+    const int fd = ::open(candidate.file.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0 && same_file(st, candidate.file, candidate.size);
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    std::vector<std::uint8_t> buffer(kSampleSize);
+    auto hashRange = [&](std::uint64_t offset, std::uint64_t length) {
+        while (ok && length > 0) {
+            const ssize_t n = ::pread(fd, buffer.data(), std::min<std::uint64_t>(length, buffer.size()),
+                                      static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                ok = false;  // shrunk, or unreadable
+                break;
+            }
+            blake3_hasher_update(&hasher, buffer.data(), static_cast<std::size_t>(n));
+            offset += static_cast<std::uint64_t>(n);
+            length -= static_cast<std::uint64_t>(n);
+        }
+    };
+    const std::uint64_t size = candidate.size;
+    hashRange(0, std::min<std::uint64_t>(size, kSampleSize));
+    if (size > kSampleSize) {
+        const std::uint64_t tail = std::max<std::uint64_t>(kSampleSize, size - kSampleSize);
+        hashRange(tail, size - tail);
+    }
+    ::close(fd);
+    if (ok) {
+        blake3_hasher_finalize(&hasher, digest.data(), digest.size());
+    }
+    return ok;
+}
+
+// Calls |fn| with every run of two or more indices in |order| that |same| holds equal.
+template <typename Same, typename Fn>
+void for_each_run(const std::vector<std::size_t>& order, Same same, Fn fn) {
+    for (std::size_t begin = 0; begin < order.size();) {
+        std::size_t end = begin + 1;
+        while (end < order.size() && same(order[begin], order[end])) {
+            ++end;
+        }
+        if (end - begin >= 2) {
+            fn(order.begin() + static_cast<std::ptrdiff_t>(begin), order.begin() + static_cast<std::ptrdiff_t>(end));
+        }
+        begin = end;
+    }
+}
+
+}  // namespace
+
+bool find_duplicates(const std::vector<std::string>& roots,
+                     std::vector<Group>& groups,
+                     const Options& options,
+                     const Progress& progress,
+                     FsOps::Error& err) {
+    groups.clear();
+    err = {};
+    const unsigned workers = resolve_worker_count(options.workerCount);
+    Reporter reporter{progress};
+    auto cancelled = [&]() {
+        set_error(err, ECANCELED, "find duplicates");
+        groups.clear();
+        return false;
+    };
+
+    // the walk, stat only
+    Walk walk{options, reporter};
+    for (const std::string& root : roots) {
+        struct stat st;
+        if (::stat(root.c_str(), &st) != 0) {
+            set_error(err, errno, root);
+            return false;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            walk.add(PendingDir{root, static_cast<std::uint64_t>(st.st_dev), true});
+        }
+        else if (S_ISREG(st.st_mode) && static_cast<std::uint64_t>(st.st_size) >= options.minSize) {
+            walk.addFile(Candidate{static_cast<std::uint64_t>(st.st_size), file_from_stat(root, st)});
+        }
+    }
+    std::vector<Candidate> files = walk.run(workers);
+    if (!reporter.report(Stage::Scanning, walk.scanned(), walk.scanned(), true)) {
+        return cancelled();
+    }
+
+    // hard links of one file, and files under two roots, count once
+    std::sort(files.begin(), files.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.file.device != b.file.device) {
+            return a.file.device < b.file.device;
+        }
+        if (a.file.inode != b.file.inode) {
+            return a.file.inode < b.file.inode;
+        }
+        return a.file.path < b.file.path;
+    });
+    files.erase(std::unique(files.begin(), files.end(),
+                            [](const Candidate& a, const Candidate& b) {
+                                return a.file.device == b.file.device && a.file.inode == b.file.inode;
+                            }),
+                files.end());
+
+    // files of a size of their own cannot have a duplicate
+    std::vector<std::size_t> bySize(files.size());
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        bySize[i] = i;
+    }
+    std::sort(bySize.begin(), bySize.end(),
+              [&](std::size_t a, std::size_t b) { return files[a].size < files[b].size; });
+    std::vector<std::size_t> toSample;
+    for_each_run(
+        bySize, [&](std::size_t a, std::size_t b) { return files[a].size == files[b].size; },
+        [&](auto begin, auto end) { toSample.insert(toSample.end(), begin, end); });
+
+    // both ends of the files left; most files that differ already do there
+    std::vector<Digest> samples(files.size());
+    std::vector<char> sampled(files.size(), 0);
+    std::atomic<std::uint64_t> sampledCount{0};
+    parallel_for(toSample.size(), workers, [&](std::size_t i) {
+        if (reporter.isCancelled()) {
+            return;
+        }
+        const std::size_t index = toSample[i];
+        sampled[index] = sample(files[index], samples[index]);
+        const std::uint64_t done = sampledCount.fetch_add(1, std::memory_order_relaxed) + 1;
+        reporter.report(Stage::Sampling, done, toSample.size());
+    });
+    if (!reporter.report(Stage::Sampling, toSample.size(), toSample.size(), true)) {
+        return cancelled();
+    }
+
+    std::vector<std::size_t> bySample;
+    for (const std::size_t index : toSample) {
+        if (sampled[index]) {
+            bySample.push_back(index);
+        }
+    }
+    std::sort(bySample.begin(), bySample.end(), [&](std::size_t a, std::size_t b) {
+        return files[a].size != files[b].size ? files[a].size < files[b].size : samples[a] < samples[b];
+    });
+    auto addGroup = [&](auto begin, auto end, std::string hexHash) {
+        Group group;
+        group.size = files[*begin].size;
+        group.hexHash = std::move(hexHash);
+        for (auto it = begin; it != end; ++it) {
+            group.files.push_back(std::move(files[*it].file));
+        }
+        std::sort(group.files.begin(), group.files.end(),
+                  [](const File& a, const File& b) { return a.path < b.path; });
+        groups.push_back(std::move(group));
+    };
+    std::vector<std::size_t> toHash;
+    for_each_run(
+        bySample,
+        [&](std::size_t a, std::size_t b) { return files[a].size == files[b].size && samples[a] == samples[b]; },
+        [&](auto begin, auto end) {
+            if (files[*begin].size <= 2 * kSampleSize) {
+                addGroup(begin, end, to_hex(samples[*begin]));  // sampled whole
+            }
+            else {
+                toHash.insert(toHash.end(), begin, end);
+            }
+        });
+
+    // whole files only for what is still alike, through the persistent cache
+    HashCache& cache = options.hashCache ? *options.hashCache : HashCache::instance();
+    std::vector<std::string> hashes(files.size());
+    std::vector<std::string> batch;
+    std::vector<FsOps::Blake3Result> results;
+    for (std::size_t begin = 0; begin < toHash.size(); begin += kHashBatch) {
+        if (!reporter.report(Stage::Hashing, begin, toHash.size())) {
+            return cancelled();
+        }
+        const std::size_t end = std::min(toHash.size(), begin + kHashBatch);
+        batch.clear();
+        for (std::size_t i = begin; i < end; ++i) {
+            batch.push_back(files[toHash[i]].file.path);
+        }
+        cache.blake3Files(batch, results, workers);
+        for (std::size_t i = begin; i < end; ++i) {
+            const FsOps::Blake3Result& result = results[i - begin];
+            if (!result.error.isSet()) {
+                hashes[toHash[i]] = result.hexHash;
+            }
+        }
+    }
+    if (!reporter.report(Stage::Hashing, toHash.size(), toHash.size(), true)) {
+        return cancelled();
+    }
+
+    toHash.erase(std::remove_if(toHash.begin(), toHash.end(), [&](std::size_t i) { return hashes[i].empty(); }),
+                 toHash.end());
+    std::sort(toHash.begin(), toHash.end(), [&](std::size_t a, std::size_t b) {
+        return files[a].size != files[b].size ? files[a].size < files[b].size : hashes[a] < hashes[b];
+    });
+    for_each_run(
+        toHash, [&](std::size_t a, std::size_t b) { return files[a].size == files[b].size && hashes[a] == hashes[b]; },
+        [&](auto begin, auto end) { addGroup(begin, end, hashes[*begin]); });
+
+    std::sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) {
+        if (a.reclaimable() != b.reclaimable()) {
+            return a.reclaimable() > b.reclaimable();
+        }
+        return a.files.front().path < b.files.front().path;
+    });
+    return true;
+}
+
+bool dedup_group(const Group& group, Method method, DedupResult& result) {
+    if (group.files.size() < 2) {
+        return true;
+    }
+    const File& keep = group.files.front();
+    auto fail = [&](const File& file, int code, const std::string& context) {
+        FsOps::Error err;
+        set_error(err, code, context);
+        result.failures.emplace_back(file.path, std::move(err));
+    };
+    auto changed = [&](const File& file) {
+        FsOps::Error err;
+        err.code = ESTALE;
+        err.message = file.path + ": changed since it was found";
+        result.failures.emplace_back(file.path, std::move(err));
+    };
+    const std::size_t failuresBefore = result.failures.size();
+
+    if (method == Method::Hardlink) {
+        struct stat keepSt;
+        if (::lstat(keep.path.c_str(), &keepSt) != 0 || !same_file(keepSt, keep, group.size)) {
+            changed(keep);
+            return false;
+        }
+        static std::atomic<unsigned> counter{0};
+        for (std::size_t i = 1; i < group.files.size(); ++i) {
+            const File& file = group.files[i];
+            struct stat st;
+            if (::lstat(file.path.c_str(), &st) != 0 || !same_file(st, file, group.size)) {
+                changed(file);
+                continue;
+            }
+            if (st.st_dev != keepSt.st_dev) {
+                fail(file, EXDEV, file.path);
+                continue;
+            }
+            // linked beside the copy first, so that the copy is replaced whole or not at all
+            const std::size_t slash = file.path.rfind('/');
+            const std::string dir = slash == std::string::npos ? std::string(".") : file.path.substr(0, slash);
+            std::string temp;
+            int linked = -1;
+            for (int attempt = 0; attempt < 8 && linked != 0; ++attempt) {
+                temp = dir + "/.pcmanfm-dedup-" + std::to_string(::getpid()) + "-" +
+                       std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+                linked = ::link(keep.path.c_str(), temp.c_str());
+                if (linked != 0 && errno != EEXIST) {
+                    break;
+                }
+            }
+            if (linked != 0) {
+                fail(file, errno, file.path);
+                continue;
+            }
+            if (::rename(temp.c_str(), file.path.c_str()) != 0) {
+                const int error = errno;
+                ::unlink(temp.c_str());
+                fail(file, error, file.path);
+                continue;
+            }
+            ++result.merged;
+            result.bytesSaved += group.size;
+        }
+        return result.failures.size() == failuresBefore;
+    }
+
+#if defined(__linux__) && defined(FICLONE)
+    const int source = ::open(keep.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat keepSt;
+    if (source < 0 || ::fstat(source, &keepSt) != 0 || !same_file(keepSt, keep, group.size)) {
+        if (source >= 0) {
+            ::close(source);
+        }
+        changed(keep);
+        return false;
+    }
+    for (std::size_t i = 1; i < group.files.size(); ++i) {
+        const File& file = group.files[i];
+        const int fd = ::open(file.path.c_str(), O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0 || !same_file(st, file, group.size)) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            changed(file);
+            continue;
+        }
+        if (::ioctl(fd, FICLONE, source) != 0) {
+            fail(file, errno, file.path);
+            ::close(fd);
+            continue;
+        }
+        // the content is the same, and so is the time it last changed
+        const struct timespec times[2] = {{0, UTIME_OMIT}, st.st_mtim};
+        ::futimens(fd, times);
+        ::close(fd);
+        ++result.merged;
+        result.bytesSaved += group.size;
+    }
+    ::close(source);
+#else
+    for (std::size_t i = 1; i < group.files.size(); ++i) {
+        fail(group.files[i], ENOTSUP, group.files[i].path);
+    }
+#endif
+    return result.failures.size() == failuresBefore;
+}
+
+}  // namespace PCManFM::DupFinder
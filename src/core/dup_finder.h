@@ -0,0 +1,93 @@
+/*
+ * Finding and merging files of the same content (POSIX-only, no Qt)
+ * src/core/dup_finder.h
+ */
+
+#ifndef PCMANFM_DUP_FINDER_H
+#define PCMANFM_DUP_FINDER_H
+
+#include "fs_ops.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace PCManFM {
+
+class HashCache;
+
+namespace DupFinder {
+
+// The stages of find_duplicates(), each one reading less of the tree than the one before it
+// left to decide: the walk only stats, files of a size of their own are dropped, then a
+// BLAKE3 of the first and last 64 KiB splits the sizes shared, and only the files still
+// alike after that are hashed whole.
+enum class Stage { Scanning, Sampling, Hashing };
+
+struct Options {
+    std::uint64_t minSize = 1;       // smaller files are left out; empty ones are all alike
+    bool sameFilesystem = false;     // do not descend into other filesystems than the root's
+    unsigned workerCount = 0;        // 0 for one per core
+    HashCache* hashCache = nullptr;  // for the whole-file digests; HashCache::instance() if null
+};
+
+// A file as it was when the tree was walked, so that it is not merged once it changed.
+struct File {
+    std::string path;
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::int64_t mtimeSec = 0;
+    std::uint32_t mtimeNsec = 0;
+};
+
+// Files of the same size and BLAKE3 digest. Hard links of one file count once, under the
+// first of their paths.
+struct Group {
+    std::uint64_t size = 0;
+    std::string hexHash;      // of the whole content, as FsOps::blake3_file() gives it
+    std::vector<File> files;  // at least two, sorted by path
+
+    // The bytes merging the group would give back.
+    std::uint64_t reclaimable() const { return size * (files.size() - 1); }
+};
+
+// Files done in |stage| out of |total|, 0 while the walk does not know it yet. Called from
+// the worker threads, one call at a time; returning false cancels the search.
+using Progress = std::function<bool(Stage stage, std::uint64_t done, std::uint64_t total)>;
+
+// Looks for files of the same content under |roots|, which may be directories or regular
+// files. Symbolic links are not followed below the roots, and directories that cannot be
+// read are skipped. |groups| comes out with the most bytes to reclaim first. Returns false
+// with ECANCELED when |progress| cancels, or with the errno of a root that cannot be read.
+bool find_duplicates(const std::vector<std::string>& roots,
+                     std::vector<Group>& groups,
+                     const Options& options,
+                     const Progress& progress,
+                     FsOps::Error& err);
+
+enum class Method {
+    Hardlink,  // the copies become links to the first file; they then change together
+    Reflink,   // the copies share the extents of the first file (FICLONE), and stay apart
+};
+
+struct DedupResult {
+    std::size_t merged = 0;
+    std::uint64_t bytesSaved = 0;
+    std::vector<std::pair<std::string, FsOps::Error>> failures;  // path and why it was kept
+};
+
+// Makes every file of |group| but the first share the data of the first one with |method|.
+// A file that changed since it was found, by identity, size or modification time, is left
+// alone and reported, as is one on another filesystem than the first. A hard link takes the
+// place of a copy atomically through a temporary name; a reflink keeps the inode of the copy
+// with its owner, mode and modification time. Returns false if any file was not merged.
+bool dedup_group(const Group& group, Method method, DedupResult& result);
+
+}  // namespace DupFinder
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_DUP_FINDER_H
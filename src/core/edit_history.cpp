@@ -0,0 +1,284 @@
+/*
+ * Undo/redo history of piece table edits (POSIX-only, no Qt)
+ * src/core/edit_history.cpp
+ */
+
+#include "edit_history.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+// Spilled entry layout, native byte order: u64 offset | u8 typing | u64 removed count |
+// u64 inserted count, then per piece u8 kind | u64 source offset | u64 length.
+constexpr std::size_t kEntryHeader = 8 + 1 + 8 + 8;
+constexpr std::size_t kPieceRecord = 1 + 8 + 8;
+
+std::string errno_message(const char* context) {
+    return std::string(context) + ": " + std::strerror(errno);
+}
+
+template <typename T>
+void put(std::vector<std::uint8_t>& out, T value) {
+    const auto* p = reinterpret_cast<const std::uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(value));
+}
+
+template <typename T>
+T take(const std::uint8_t*& p) {
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return value;
+}
+
+void put_pieces(std::vector<std::uint8_t>& out, const std::vector<PieceTree::Piece>& pieces) {
+    for (const PieceTree::Piece& piece : pieces) {
+        put(out, static_cast<std::uint8_t>(piece.kind));
+        put(out, piece.sourceOffset);
+        put(out, piece.length);
+    }
+}
+
+void take_pieces(const std::uint8_t*& p, std::uint64_t count, std::vector<PieceTree::Piece>& out) {
+    out.resize(static_cast<std::size_t>(count));
+    for (PieceTree::Piece& piece : out) {
+        piece.kind = static_cast<PieceTree::Piece::Kind>(take<std::uint8_t>(p));
+        piece.sourceOffset = take<std::uint64_t>(p);
+        piece.length = take<std::uint64_t>(p);
+    }
+}
+
+// An anonymous file in $TMPDIR, gone as soon as it is closed.
+int open_spill_file(std::string& errorOut) {
+    const char* env = std::getenv("TMPDIR");
+    const std::string dir = env && *env ? env : "/tmp";
+#ifdef O_TMPFILE
+    const int fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        return fd;
+    }
+#endif
+    std::string pattern = dir + "/.pcmanfm-undo.XXXXXX";
+    const int tmp = ::mkostemp(pattern.data(), O_CLOEXEC);
+    if (tmp < 0) {
+        errorOut = errno_message("mkostemp");
+        return -1;
+    }
+    ::unlink(pattern.c_str());
+    return tmp;
+}
+
+}  // namespace
+
+EditHistory::EditHistory(std::size_t memoryLimit) : memoryLimit_(memoryLimit) {}
+
+EditHistory::~EditHistory() {
+    reset(undo_);
+    reset(redo_);
+}
+
+void EditHistory::clear() {
+    reset(undo_);
+    reset(redo_);
+}
+
+std::uint64_t EditHistory::lengthOf(const std::vector<Piece>& pieces) {
+    std::uint64_t total = 0;
+    for (const Piece& piece : pieces) {
+        total += piece.length;
+    }
+    return total;
+}
+
+std::size_t EditHistory::footprint(const Entry& entry) {
+    return sizeof(Entry) + (entry.removed.capacity() + entry.inserted.capacity()) * sizeof(Piece);
+}
+
+// Appends |pieces|, extending the last piece when the first new one continues it.
+void EditHistory::appendPieces(std::vector<Piece>& to, const std::vector<Piece>& pieces) {
+    for (const Piece& piece : pieces) {
+        if (!to.empty() && to.back().kind == piece.kind &&
+            to.back().sourceOffset + to.back().length == piece.sourceOffset) {
+            to.back().length += piece.length;
+        }
+        else {
+            to.push_back(piece);
+        }
+    }
+}
+
+void EditHistory::record(Entry entry) {
+    reset(redo_);
+
+    if (entry.typing && !undo_.resident.empty()) {
+        Entry& top = undo_.resident.back();
+        if (top.typing && entry.offset == top.offset + top.insertedLength()) {
+            // Replacing [a, b) and then [b', c) right after the new bytes is the same as
+            // replacing [a, c) in one go with both insertions.
+            undo_.residentBytes -= footprint(top);
+            appendPieces(top.removed, entry.removed);
+            appendPieces(top.inserted, entry.inserted);
+            undo_.residentBytes += footprint(top);
+            return;
+        }
+    }
+    push(undo_, std::move(entry));
+}
+
+bool EditHistory::undo(Entry& out, std::string& errorOut) {
+    if (!pop(undo_, out, errorOut)) {
+        return false;
+    }
+    out.typing = false;  // a redone edit must not absorb new typing
+    push(redo_, out);
+    return true;
+}
+
+bool EditHistory::redo(Entry& out, std::string& errorOut) {
+    if (!pop(redo_, out, errorOut)) {
+        return false;
+    }
+    push(undo_, out);
+    return true;
+}
+
+void EditHistory::push(Stack& stack, Entry entry) {
+    stack.residentBytes += footprint(entry);
+    stack.resident.push_back(std::move(entry));
+    if (stack.residentBytes > memoryLimit_) {
+        // Best effort: without a spill file the history simply stays in memory.
+        std::string ignored;
+        spill(stack, ignored);
+    }
+}
+
+bool EditHistory::pop(Stack& stack, Entry& out, std::string& errorOut) {
+    errorOut.clear();
+    if (stack.resident.empty() && !unspill(stack, errorOut)) {
+        return false;
+    }
+    if (stack.resident.empty()) {
+        return false;
+    }
+    out = std::move(stack.resident.back());
+    stack.resident.pop_back();
+    stack.residentBytes -= footprint(out);
+    return true;
+}
+
+void EditHistory::reset(Stack& stack) {
+    stack.resident.clear();
+    stack.spilled.clear();
+    stack.residentBytes = 0;
+    stack.fileEnd = 0;
+    if (stack.fd >= 0) {
+        ::close(stack.fd);
+        stack.fd = -1;
+    }
+}
+
+// Writes the oldest resident entries to the spill file until half the limit is left in
+// memory, always keeping the newest entry resident.
+bool EditHistory::spill(Stack& stack, std::string& errorOut) {
+    if (stack.fd < 0) {
+        stack.fd = open_spill_file(errorOut);
+        if (stack.fd < 0) {
+            return false;
+        }
+    }
+
+    std::vector<std::uint8_t> buffer;
+    while (stack.resident.size() > 1 && stack.residentBytes > memoryLimit_ / 2) {
+        const Entry& entry = stack.resident.front();
+        buffer.clear();
+        buffer.reserve(kEntryHeader + (entry.removed.size() + entry.inserted.size()) * kPieceRecord);
+        put(buffer, entry.offset);
+        put(buffer, static_cast<std::uint8_t>(entry.typing ? 1 : 0));
+        put(buffer, static_cast<std::uint64_t>(entry.removed.size()));
+        put(buffer, static_cast<std::uint64_t>(entry.inserted.size()));
+        put_pieces(buffer, entry.removed);
+        put_pieces(buffer, entry.inserted);
+
+        std::size_t done = 0;
+        while (done < buffer.size()) {
+            const ssize_t n = ::pwrite(stack.fd, buffer.data() + done, buffer.size() - done,
+                                       static_cast<off_t>(stack.fileEnd + done));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                errorOut = errno_message("pwrite");
+                return false;
+            }
+            done += static_cast<std::size_t>(n);
+        }
+
+        Spilled record;
+        record.fileOffset = stack.fileEnd;
+        record.size = buffer.size();
+        stack.spilled.push_back(record);
+        stack.fileEnd += buffer.size();
+        stack.residentBytes -= footprint(entry);
+        stack.resident.pop_front();
+    }
+    return true;
+}
+
+// Reads the newest spilled entries back until half the limit is in memory again.
+bool EditHistory::unspill(Stack& stack, std::string& errorOut) {
+    std::vector<std::uint8_t> buffer;
+    while (!stack.spilled.empty() && (stack.resident.empty() || stack.residentBytes < memoryLimit_ / 2)) {
+        const Spilled record = stack.spilled.back();
+        buffer.resize(static_cast<std::size_t>(record.size));
+        std::size_t done = 0;
+        while (done < buffer.size()) {
+            const ssize_t n = ::pread(stack.fd, buffer.data() + done, buffer.size() - done,
+                                      static_cast<off_t>(record.fileOffset + done));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                errorOut = errno_message("pread");
+                return false;
+            }
+            if (n == 0) {
+                errorOut = "The undo history file was truncated";
+                return false;
+            }
+            done += static_cast<std::size_t>(n);
+        }
+
+        const std::uint8_t* p = buffer.data();
+        Entry entry;
+        entry.offset = take<std::uint64_t>(p);
+        entry.typing = take<std::uint8_t>(p) != 0;
+        const auto removedCount = take<std::uint64_t>(p);
+        const auto insertedCount = take<std::uint64_t>(p);
+        if (kEntryHeader + (removedCount + insertedCount) * kPieceRecord != record.size) {
+            errorOut = "The undo history file is corrupt";
+            return false;
+        }
+        take_pieces(p, removedCount, entry.removed);
+        take_pieces(p, insertedCount, entry.inserted);
+
+        stack.spilled.pop_back();
+        stack.fileEnd = record.fileOffset;
+        stack.residentBytes += footprint(entry);
+        stack.resident.push_front(std::move(entry));
+    }
+    if (stack.spilled.empty() && stack.fd >= 0) {
+        ::ftruncate(stack.fd, 0);
+    }
+    return true;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,96 @@
+/*
+ * Undo/redo history of piece table edits (POSIX-only, no Qt)
+ * src/core/edit_history.h
+ */
+
+#ifndef PCMANFM_EDIT_HISTORY_H
+#define PCMANFM_EDIT_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "piece_tree.h"
+
+namespace PCManFM {
+
+// EditHistory keeps the undo and redo stacks of a PieceTree document. An entry records the
+// pieces a range held before and after an edit rather than the bytes themselves: both the
+// original file and the added buffer are append-only, so undoing an edit just puts the old
+// pieces back, whatever its size. Consecutive single-byte typing is folded into one entry.
+// Once the entries held in memory pass the memory limit, the oldest ones are moved to an
+// unlinked temporary file and read back when undo reaches them.
+class EditHistory {
+   public:
+    using Piece = PieceTree::Piece;
+
+    struct Entry {
+        std::uint64_t offset = 0;
+        std::vector<Piece> removed;   // what the range held before the edit
+        std::vector<Piece> inserted;  // what it holds after
+        bool typing = false;          // a keystroke the next adjacent keystroke may join
+
+        std::uint64_t removedLength() const { return lengthOf(removed); }
+        std::uint64_t insertedLength() const { return lengthOf(inserted); }
+    };
+
+    static constexpr std::size_t kDefaultMemoryLimit = 4 * 1024 * 1024;
+
+    explicit EditHistory(std::size_t memoryLimit = kDefaultMemoryLimit);
+    ~EditHistory();
+
+    EditHistory(const EditHistory&) = delete;
+    EditHistory& operator=(const EditHistory&) = delete;
+
+    void clear();
+    bool canUndo() const { return !undo_.resident.empty() || !undo_.spilled.empty(); }
+    bool canRedo() const { return !redo_.resident.empty() || !redo_.spilled.empty(); }
+
+    // Records an edit that was just applied and forgets the redo history. A typing entry
+    // starting where the previous typing entry's inserted bytes end is merged into it.
+    void record(Entry entry);
+
+    // Moves the newest undo entry onto the redo stack and copies it to |out|. Returns false
+    // with an empty errorOut when there is nothing to undo; redo() mirrors it.
+    bool undo(Entry& out, std::string& errorOut);
+    bool redo(Entry& out, std::string& errorOut);
+
+    // Approximate bytes held in memory and number of entries moved to disk, over both stacks.
+    std::size_t residentBytes() const { return undo_.residentBytes + redo_.residentBytes; }
+    std::size_t spilledCount() const { return undo_.spilled.size() + redo_.spilled.size(); }
+
+   private:
+    struct Spilled {
+        std::uint64_t fileOffset = 0;
+        std::uint64_t size = 0;
+    };
+
+    // Newest entries at the back of |resident|; everything in |spilled| is older than them.
+    struct Stack {
+        std::deque<Entry> resident;
+        std::vector<Spilled> spilled;
+        std::size_t residentBytes = 0;
+        int fd = -1;
+        std::uint64_t fileEnd = 0;
+    };
+
+    static std::uint64_t lengthOf(const std::vector<Piece>& pieces);
+    static std::size_t footprint(const Entry& entry);
+    static void appendPieces(std::vector<Piece>& to, const std::vector<Piece>& pieces);
+
+    void push(Stack& stack, Entry entry);
+    bool pop(Stack& stack, Entry& out, std::string& errorOut);
+    void reset(Stack& stack);
+    bool spill(Stack& stack, std::string& errorOut);
+    bool unspill(Stack& stack, std::string& errorOut);
+
+    std::size_t memoryLimit_;
+    Stack undo_;
+    Stack redo_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_EDIT_HISTORY_H
@@ -0,0 +1,360 @@
+/*
+ * Embedded JPEG previews of camera RAW and JPEG files (no Qt)
+ * src/core/embedded_preview.cpp
+ */
+
+#include "embedded_preview.h"
+
+#include "windowed_file_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace PCManFM {
+
+namespace {
+
+// guards against loops and garbage in damaged files
+constexpr int kMaxIfds = 32;
+constexpr std::uint16_t kMaxIfdEntries = 1024;
+constexpr int kMaxJpegSegments = 64;
+constexpr std::uint64_t kMaxPreviewLength = 64 * 1024 * 1024;
+
+constexpr std::uint16_t kTagNewSubfileType = 0x00fe;
+constexpr std::uint16_t kTagCompression = 0x0103;
+constexpr std::uint16_t kTagPhotometric = 0x0106;
+constexpr std::uint16_t kTagStripOffsets = 0x0111;
+constexpr std::uint16_t kTagOrientation = 0x0112;
+constexpr std::uint16_t kTagStripByteCounts = 0x0117;
+constexpr std::uint16_t kTagSubIfds = 0x014a;
+constexpr std::uint16_t kTagJpegOffset = 0x0201;
+constexpr std::uint16_t kTagJpegLength = 0x0202;
+
+constexpr std::uint32_t kCompressionOldJpeg = 6;
+constexpr std::uint32_t kCompressionJpeg = 7;
+constexpr std::uint32_t kPhotometricCfa = 32803;        // the raw sensor data itself
+constexpr std::uint32_t kPhotometricLinearRaw = 34892;  // demosaiced but still raw
+
+constexpr std::uint16_t kTypeShort = 3;
+constexpr std::uint16_t kTypeLong = 4;
+constexpr std::uint16_t kTypeIfd = 13;
+
+// Fujifilm RAF files start with this and give the offset and length of their JPEG at 84 and 88.
+constexpr char kRafMagic[] = "FUJIFILMCCD-RAW";
+
+bool readBytes(const WindowedFileReader& reader, std::uint64_t offset, void* dest, std::size_t length) {
+    std::size_t bytesRead = 0;
+    std::string error;
+    return reader.read(offset, length, static_cast<std::uint8_t*>(dest), bytesRead, error) && bytesRead == length;
+}
+
+bool readBigEndian32(const WindowedFileReader& reader, std::uint64_t offset, std::uint32_t& out) {
+    std::uint8_t bytes[4];
+    if (!readBytes(reader, offset, bytes, sizeof(bytes))) {
+        return false;
+    }
+    out = std::uint32_t{bytes[0]} << 24 | std::uint32_t{bytes[1]} << 16 | std::uint32_t{bytes[2]} << 8 | bytes[3];
+    return true;
+}
+
+// Reads the TIFF structure starting at |base|, where TIFF offsets count from.
+class TiffParser {
+   public:
+    TiffParser(const WindowedFileReader& reader, std::uint64_t base) : reader_{reader}, base_{base} {}
+
+    // Adds the previews of every IFD reachable from the header to |candidates|.
+    bool parse(std::vector<EmbeddedPreview>& candidates, int& orientation) {
+        std::uint8_t header[8];
+        if (!readBytes(reader_, base_, header, sizeof(header))) {
+            return false;
+        }
+        if (header[0] == 'I' && header[1] == 'I') {
+            bigEndian_ = false;
+        }
+        else if (header[0] == 'M' && header[1] == 'M') {
+            bigEndian_ = true;
+        }
+        else {
+            return false;
+        }
+        const std::uint16_t magic = decode16(header + 2);
+        // plain TIFF, Olympus ORF and Panasonic RW2
+        if (magic != 42 && magic != 0x4f52 && magic != 0x5352 && magic != 0x55) {
+            return false;
+        }
+
+        std::vector<std::uint32_t> pending{decode32(header + 4)};
+        std::unordered_set<std::uint32_t> visited;
+        bool first = true;
+        while (!pending.empty() && static_cast<int>(visited.size()) < kMaxIfds) {
+            const std::uint32_t ifd = pending.back();
+            pending.pop_back();
+            if (ifd == 0 || !visited.insert(ifd).second) {
+                continue;
+            }
+            parseIfd(ifd, first, candidates, orientation, pending);
+            first = false;
+        }
+        return true;
+    }
+
+   private:
+    struct Entry {
+        std::uint16_t tag;
+        std::uint16_t type;
+        std::uint32_t count;
+        std::uint64_t position;  // of the entry in the file
+    };
+
+    std::uint16_t decode16(const std::uint8_t* p) const {
+        return bigEndian_ ? std::uint16_t(p[0] << 8 | p[1]) : std::uint16_t(p[1] << 8 | p[0]);
+    }
+
+    std::uint32_t decode32(const std::uint8_t* p) const {
+        return bigEndian_ ? std::uint32_t{p[0]} << 24 | std::uint32_t{p[1]} << 16 | std::uint32_t{p[2]} << 8 | p[3]
+                          : std::uint32_t{p[3]} << 24 | std::uint32_t{p[2]} << 16 | std::uint32_t{p[1]} << 8 | p[0];
+    }
+
+    // Up to |maxCount| values of a SHORT, LONG or IFD entry.
+    std::vector<std::uint32_t> values(const Entry& entry, std::uint32_t maxCount) const {
+        const bool isLong = entry.type == kTypeLong || entry.type == kTypeIfd;
+        const std::size_t size = entry.type == kTypeShort ? 2 : isLong ? 4 : 0;
+        const std::uint32_t count = std::min(entry.count, maxCount);
+        std::vector<std::uint32_t> result;
+        if (size == 0 || count == 0) {
+            return result;
+        }
+
+        std::uint64_t offset = entry.position + 8;
+        if (entry.count * size > 4) {  // the values do not fit in the entry
+            std::uint8_t bytes[4];
+            if (!readBytes(reader_, offset, bytes, sizeof(bytes))) {
+                return result;
+            }
+            offset = base_ + decode32(bytes);
+        }
+        std::vector<std::uint8_t> bytes(count * size);
+        if (!readBytes(reader_, offset, bytes.data(), bytes.size())) {
+            return result;
+        }
+        result.reserve(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            result.push_back(size == 2 ? decode16(&bytes[i * 2]) : decode32(&bytes[i * 4]));
+        }
+        return result;
+    }
+
+    std::uint32_t value(const Entry& entry) const {
+        const auto result = values(entry, 1);
+        return result.empty() ? 0 : result.front();
+    }
+
+    void parseIfd(std::uint32_t ifd,
+                  bool isFirst,
+                  std::vector<EmbeddedPreview>& candidates,
+                  int& orientation,
+                  std::vector<std::uint32_t>& pending) const {
+        std::uint8_t countBytes[2];
+        if (!readBytes(reader_, base_ + ifd, countBytes, sizeof(countBytes))) {
+            return;
+        }
+        const std::uint16_t entryCount = std::min(decode16(countBytes), kMaxIfdEntries);
+        std::vector<std::uint8_t> entries(entryCount * 12 + 4);
+        if (!readBytes(reader_, base_ + ifd + 2, entries.data(), entries.size())) {
+            return;
+        }
+
+        std::uint32_t subfileType = 0;
+        std::uint32_t compression = 0;
+        std::uint32_t photometric = 0;
+        std::vector<std::uint32_t> stripOffsets;
+        std::vector<std::uint32_t> stripByteCounts;
+        std::uint32_t jpegOffset = 0;
+        std::uint32_t jpegLength = 0;
+        for (std::uint16_t i = 0; i < entryCount; ++i) {
+            const std::uint8_t* p = &entries[i * 12];
+            const Entry entry{decode16(p), decode16(p + 2), decode32(p + 4), base_ + ifd + 2 + i * 12};
+            switch (entry.tag) {
+                case kTagNewSubfileType:
+                    subfileType = value(entry);
+                    break;
+                case kTagCompression:
+                    compression = value(entry);
+                    break;
+                case kTagPhotometric:
+                    photometric = value(entry);
+                    break;
+                case kTagStripOffsets:
+                    stripOffsets = values(entry, 2);
+                    break;
+                case kTagStripByteCounts:
+                    stripByteCounts = values(entry, 2);
+                    break;
+                case kTagOrientation:
+                    if (isFirst) {
+                        const std::uint32_t tagValue = value(entry);
+                        if (tagValue >= 1 && tagValue <= 8) {
+                            orientation = static_cast<int>(tagValue);
+                        }
+                    }
+                    break;
+                case kTagSubIfds:
+                    for (std::uint32_t subIfd : values(entry, kMaxIfds)) {
+                        pending.push_back(subIfd);
+                    }
+                    break;
+                case kTagJpegOffset:
+                    jpegOffset = value(entry);
+                    break;
+                case kTagJpegLength:
+                    jpegLength = value(entry);
+                    break;
+                default:
+                    break;
+            }
+        }
+        pending.push_back(decode32(&entries[entryCount * 12]));  // the next IFD
+
+        if (jpegOffset != 0 && jpegLength != 0) {
+            candidates.push_back({base_ + jpegOffset, jpegLength});
+        }
+        // A JPEG in a single strip is a preview, unless it holds the raw data, as lossless JPEG
+        // does in DNG files; reduced resolution images are marked so in their subfile type.
+        const bool rawData = photometric == kPhotometricCfa || photometric == kPhotometricLinearRaw;
+        const bool jpeg = compression == kCompressionOldJpeg || (compression == kCompressionJpeg && (subfileType & 1));
+        if (jpeg && !rawData && stripOffsets.size() == 1 && stripByteCounts.size() == 1) {
+            candidates.push_back({base_ + stripOffsets.front(), stripByteCounts.front()});
+        }
+    }
+
+    const WindowedFileReader& reader_;
+    std::uint64_t base_;
+    bool bigEndian_ = false;
+};
+
+// Calls |func| with the marker, the offset and the length of each segment of the JPEG at
+// |offset| until it returns false, or the image data starts.
+template <typename Func>
+void forEachJpegSegment(const WindowedFileReader& reader, std::uint64_t offset, std::uint64_t end, Func func) {
+    std::uint64_t pos = offset + 2;  // after SOI
+    for (int i = 0; i < kMaxJpegSegments && pos + 4 <= end; ++i) {
+        std::uint8_t header[4];
+        if (!readBytes(reader, pos, header, sizeof(header)) || header[0] != 0xff) {
+            return;
+        }
+        const std::uint8_t marker = header[1];
+        if (marker == 0xff) {  // a fill byte
+            ++pos;
+            continue;
+        }
+        if (marker == 0xd9 || marker == 0xda) {  // EOI, SOS
+            return;
+        }
+        const std::uint16_t length = std::uint16_t(header[2] << 8 | header[3]);
+        if (length < 2 || !func(marker, pos, length)) {
+            return;
+        }
+        pos += 2 + length;
+    }
+}
+
+// Checks that |preview| is a JPEG and reads its size from its frame header.
+bool readJpegSize(const WindowedFileReader& reader, EmbeddedPreview& preview) {
+    const std::uint64_t end = preview.offset + preview.length;
+    std::uint8_t soi[2];
+    if (preview.length < 4 || preview.length > kMaxPreviewLength || end > reader.size() ||
+        !readBytes(reader, preview.offset, soi, sizeof(soi)) || soi[0] != 0xff || soi[1] != 0xd8) {
+        return false;
+    }
+    bool found = false;
+    forEachJpegSegment(reader, preview.offset, end, [&](std::uint8_t marker, std::uint64_t pos, std::uint16_t) {
+        // SOF0 to SOF15, except DHT, JPG and DAC
+        if (marker < 0xc0 || marker > 0xcf || marker == 0xc4 || marker == 0xc8 || marker == 0xcc) {
+            return true;
+        }
+        std::uint8_t frame[5];
+        if (readBytes(reader, pos + 4, frame, sizeof(frame))) {
+            preview.height = std::uint32_t(frame[1] << 8 | frame[2]);
+            preview.width = std::uint32_t(frame[3] << 8 | frame[4]);
+            found = preview.width != 0 && preview.height != 0;
+        }
+        return false;
+    });
+    return found;
+}
+
+}  // namespace
+
+bool find_embedded_preview(const WindowedFileReader& reader, std::uint32_t minSize, EmbeddedPreview& out) {
+    std::uint8_t magic[16];
+    if (!reader.valid() || !readBytes(reader, 0, magic, sizeof(magic))) {
+        return false;
+    }
+
+    std::vector<EmbeddedPreview> candidates;
+    int orientation = 1;
+    if (magic[0] == 0xff && magic[1] == 0xd8) {
+        // a JPEG file; its EXIF data is a TIFF structure in an APP1 segment
+        forEachJpegSegment(reader, 0, reader.size(), [&](std::uint8_t marker, std::uint64_t pos, std::uint16_t length) {
+            char exifHeader[6];
+            if (marker != 0xe1 || length < 8 || !readBytes(reader, pos + 4, exifHeader, sizeof(exifHeader)) ||
+                std::memcmp(exifHeader, "Exif\0\0", sizeof(exifHeader)) != 0) {
+                return true;
+            }
+            TiffParser(reader, pos + 4 + sizeof(exifHeader)).parse(candidates, orientation);
+            return false;
+        });
+    }
+    else if (std::memcmp(magic, kRafMagic, sizeof(kRafMagic) - 1) == 0) {
+        std::uint32_t offset = 0;
+        std::uint32_t length = 0;
+        if (readBigEndian32(reader, 84, offset) && readBigEndian32(reader, 88, length)) {
+            candidates.push_back({offset, length});
+            // the JPEG has the EXIF data of the file
+            std::vector<EmbeddedPreview> ignored;
+            forEachJpegSegment(reader, offset, std::uint64_t{offset} + length,
+                               [&](std::uint8_t marker, std::uint64_t pos, std::uint16_t) {
+                                   if (marker != 0xe1) {
+                                       return true;
+                                   }
+                                   TiffParser(reader, pos + 10).parse(ignored, orientation);
+                                   return false;
+                               });
+        }
+    }
+    else if (!TiffParser(reader, 0).parse(candidates, orientation)) {
+        return false;
+    }
+
+    const EmbeddedPreview* best = nullptr;
+    for (auto& candidate : candidates) {
+        if (!readJpegSize(reader, candidate) || std::max(candidate.width, candidate.height) < minSize) {
+            continue;
+        }
+        if (!best || std::max(candidate.width, candidate.height) < std::max(best->width, best->height)) {
+            best = &candidate;
+        }
+    }
+    if (!best) {
+        return false;
+    }
+    out = *best;
+    out.orientation = orientation;
+    return true;
+}
+
+bool read_embedded_preview(const std::string& path,
+                           std::uint32_t minSize,
+                           std::vector<std::uint8_t>& jpegOut,
+                           EmbeddedPreview& previewOut) {
+    // Only the headers and the preview are read, so a couple of windows are plenty.
+    WindowedFileReader reader(path, 0, nullptr, 2);
+    if (!reader.valid() || !find_embedded_preview(reader, minSize, previewOut)) {
+        return false;
+    }
+    jpegOut.resize(previewOut.length);
+    return readBytes(reader, previewOut.offset, jpegOut.data(), jpegOut.size());
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,40 @@
+/*
+ * Embedded JPEG previews of camera RAW and JPEG files (no Qt)
+ * src/core/embedded_preview.h
+ */
+
+#ifndef PCMANFM_EMBEDDED_PREVIEW_H
+#define PCMANFM_EMBEDDED_PREVIEW_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PCManFM {
+
+class WindowedFileReader;
+
+// A JPEG stored whole inside another image file.
+struct EmbeddedPreview {
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    int orientation = 1;  // the EXIF orientation of the image, 1 being upright
+};
+
+// Finds the smallest JPEG preview embedded in the TIFF structure of a camera RAW file (NEF, CR2,
+// ARW, DNG, PEF, ORF, RW2 and the like) or in the EXIF data of a JPEG file whose longer side is
+// at least |minSize| pixels. Only the IFDs and JPEG headers are read, never the image data.
+// Returns false when there is no such preview, and the image has to be decoded in full.
+bool find_embedded_preview(const WindowedFileReader& reader, std::uint32_t minSize, EmbeddedPreview& out);
+
+// Opens |path| and copies the preview find_embedded_preview() picks into |jpegOut|.
+bool read_embedded_preview(const std::string& path,
+                           std::uint32_t minSize,
+                           std::vector<std::uint8_t>& jpegOut,
+                           EmbeddedPreview& previewOut);
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_EMBEDDED_PREVIEW_H
@@ -0,0 +1,779 @@
+/*
+ * Multi-algorithm file checksums and sha256sum/b3sum manifests (POSIX-only, no Qt)
+ * src/core/file_checksums.cpp
+ */
+
+#include "file_checksums.h"
+
+#include <b3sum/blake3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PCMANFM_SHA256_SHANI 1
+#endif
+
+namespace PCManFM::FileChecksums {
+
+namespace {
+
+using FsOps::Error;
+using FsOps::ProgressCallback;
+using FsOps::ProgressInfo;
+
+// read size, and the unit handed to the hashing threads
+constexpr std::size_t kBlockSize = 4 * 1024 * 1024;
+// blocks in flight per file: one being read while the hashers work through the others
+constexpr std::size_t kRingSlots = 3;
+// files hashed at once when the caller leaves it to us
+constexpr unsigned kMaxConcurrentFiles = 4;
+
+constexpr std::uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr std::uint32_t kInitialState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+inline std::uint32_t rotr(std::uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline std::uint32_t load_be32(const std::uint8_t* p) {
+    return (std::uint32_t{p[0]} << 24) | (std::uint32_t{p[1]} << 16) | (std::uint32_t{p[2]} << 8) | p[3];
+}
+
+void compress_portable(std::uint32_t state[8], const std::uint8_t* data, std::size_t blocks) {
+    std::uint32_t w[64];
+    for (; blocks > 0; --blocks, data += 64) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            const std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            const std::uint32_t t1 =
+                h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + kRoundConstants[i] + w[i];
+            const std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef PCMANFM_SHA256_SHANI
+// The SHA-NI round structure from Intel's "New Instructions Supporting the Secure Hash
+// Algorithm on Intel Architecture Processors": the state is kept as the ABEF/CDGH pair the
+// round instruction wants, and each group of four rounds also advances the message schedule
+// held in the rotating msg[] registers.
+__attribute__((target("sha,sse4.1"))) void compress_shani(std::uint32_t state[8],
+                                                          const std::uint8_t* data,
+                                                          std::size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks > 0; --blocks, data += 64) {
+        const __m128i abefSave = state0;
+        const __m128i cdghSave = state1;
+        __m128i msg[4];
+
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; ++g) {
+            if (g < 4) {
+                msg[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * g)), byteSwap);
+            }
+            __m128i m = _mm_add_epi32(msg[g % 4],
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&kRoundConstants[4 * g])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+            if (g >= 3 && g <= 14) {
+                __m128i& ahead = msg[(g + 1) % 4];
+                ahead = _mm_add_epi32(ahead, _mm_alignr_epi8(msg[g % 4], msg[(g + 3) % 4], 4));
+                ahead = _mm_sha256msg2_epu32(ahead, msg[g % 4]);
+            }
+            m = _mm_shuffle_epi32(m, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+            if (g >= 1 && g <= 12) {
+                msg[(g + 3) % 4] = _mm_sha256msg1_epu32(msg[(g + 3) % 4], msg[g % 4]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+const bool kHaveShaNi = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#endif
+
+void compress(std::uint32_t state[8], const std::uint8_t* data, std::size_t blocks) {
+#ifdef PCMANFM_SHA256_SHANI
+    if (kHaveShaNi) {
+        compress_shani(state, data, blocks);
+        return;
+    }
+#endif
+    compress_portable(state, data, blocks);
+}
+
+template <std::size_t N>
+std::string to_hex(const std::uint8_t (&digest)[N]) {
+    static const char* kHex = "0123456789abcdef";
+    std::string hex(N * 2, '0');
+    for (std::size_t i = 0; i < N; ++i) {
+        hex[2 * i] = kHex[(digest[i] >> 4) & 0xF];
+        hex[2 * i + 1] = kHex[digest[i] & 0xF];
+    }
+    return hex;
+}
+
+void set_error(Error& err, int code, const std::string& context) {
+    err.code = code;
+    err.message = context + ": " + std::strerror(code);
+}
+
+struct Fd {
+    int fd;
+    explicit Fd(int f = -1) : fd(f) {}
+    ~Fd() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    Fd(const Fd&) = delete;
+    Fd& operator=(const Fd&) = delete;
+    bool valid() const { return fd >= 0; }
+};
+
+// Fills |buffer| up to |capacity| bytes unless the file ends first; returns the bytes read or -1.
+ssize_t read_full(int fd, std::uint8_t* buffer, std::size_t capacity) {
+    std::size_t done = 0;
+    while (done < capacity) {
+        const ssize_t n = ::read(fd, buffer + done, capacity - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return static_cast<ssize_t>(done);
+}
+
+// The hashers one file runs; each algorithm's state is only ever touched by one thread.
+class Digesters {
+   public:
+    explicit Digesters(const Options& opts) {
+        enabled_[static_cast<std::size_t>(Algorithm::Sha256)] = opts.sha256;
+        enabled_[static_cast<std::size_t>(Algorithm::Blake3)] = opts.blake3;
+        blake3_hasher_init(&blake3_);
+    }
+
+    bool enabled(std::size_t index) const { return enabled_[index]; }
+
+    void update(std::size_t index, const std::uint8_t* data, std::size_t length) {
+        if (index == static_cast<std::size_t>(Algorithm::Sha256)) {
+            sha256_.update(data, length);
+            return;
+        }
+#ifdef PCMANFM_HAVE_BLAKE3_TBB
+        blake3_hasher_update_tbb(&blake3_, data, length);
+#else
+        blake3_hasher_update(&blake3_, data, length);
+#endif
+    }
+
+    void finish(FileResult& out) {
+        if (enabled_[static_cast<std::size_t>(Algorithm::Sha256)]) {
+            std::uint8_t digest[Sha256::kDigestSize];
+            sha256_.finish(digest);
+            out.digests[static_cast<std::size_t>(Algorithm::Sha256)] = to_hex(digest);
+        }
+        if (enabled_[static_cast<std::size_t>(Algorithm::Blake3)]) {
+            std::uint8_t digest[BLAKE3_OUT_LEN];
+            blake3_hasher_finalize(&blake3_, digest, BLAKE3_OUT_LEN);
+            out.digests[static_cast<std::size_t>(Algorithm::Blake3)] = to_hex(digest);
+        }
+    }
+
+   private:
+    bool enabled_[kAlgorithmCount] = {};
+    Sha256 sha256_;
+    blake3_hasher blake3_;
+};
+
+struct Slot {
+    std::vector<std::uint8_t> data;
+    std::size_t length = 0;
+    std::uint64_t seq = std::numeric_limits<std::uint64_t>::max();
+    std::size_t pending = 0;  // hashers still reading this block
+};
+
+// Reads |fd| once into a ring of blocks, each digested by one thread per algorithm. |advance|
+// is told about every block read and returns false to cancel.
+bool hash_pipelined(int fd,
+                    Digesters& digesters,
+                    const std::function<bool(std::uint64_t)>& advance,
+                    Error& err) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    Slot slots[kRingSlots];
+    bool stopped = false;
+
+    std::vector<std::size_t> active;
+    for (std::size_t a = 0; a < kAlgorithmCount; ++a) {
+        if (digesters.enabled(a)) {
+            active.push_back(a);
+        }
+    }
+
+    std::vector<std::thread> hashers;
+    hashers.reserve(active.size());
+    for (const std::size_t algorithm : active) {
+        hashers.emplace_back([&, algorithm] {
+            for (std::uint64_t seq = 0;; ++seq) {
+                Slot& slot = slots[seq % kRingSlots];
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return slot.seq == seq || stopped; });
+                    if (slot.seq != seq) {
+                        return;
+                    }
+                }
+                const bool last = slot.length == 0;
+                if (!last) {
+                    digesters.update(algorithm, slot.data.data(), slot.length);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --slot.pending;
+                }
+                cv.notify_all();
+                if (last) {
+                    return;
+                }
+            }
+        });
+    }
+
+    bool ok = true;
+    for (std::uint64_t seq = 0;; ++seq) {
+        Slot& slot = slots[seq % kRingSlots];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return slot.pending == 0; });
+        }
+        // No hasher looks at the slot again until its sequence number changes below.
+        if (slot.data.empty()) {
+            slot.data.resize(kBlockSize);
+        }
+        const ssize_t n = read_full(fd, slot.data.data(), kBlockSize);
+        if (n < 0) {
+            set_error(err, errno, "read");
+            ok = false;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.length = static_cast<std::size_t>(n);
+            slot.pending = active.size();
+            slot.seq = seq;
+        }
+        cv.notify_all();
+        if (n == 0) {
+            break;
+        }
+        if (!advance(static_cast<std::uint64_t>(n))) {
+            set_error(err, ECANCELED, "checksum");
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        cv.notify_all();
+    }
+    for (auto& t : hashers) {
+        t.join();
+    }
+    return ok;
+}
+
+// Hashes one file into |out|; |buffer| is the worker's block for files read inline.
+bool hash_one(const std::string& path,
+              const Options& opts,
+              std::vector<std::uint8_t>& buffer,
+              const std::function<bool(std::uint64_t)>& advance,
+              FileResult& out) {
+    out.path = path;
+    int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_NOFOLLOW
+    flags |= O_NOFOLLOW;
+#endif
+    Fd fd(::open(path.c_str(), flags));
+    if (!fd.valid()) {
+        set_error(out.error, errno, "open");
+        return false;
+    }
+    struct stat st{};
+    if (::fstat(fd.fd, &st) != 0) {
+        set_error(out.error, errno, "fstat");
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        out.error.code = EINVAL;
+        out.error.message = "not a regular file";
+        return false;
+    }
+    ::posix_fadvise(fd.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Digesters digesters(opts);
+    const int algorithms = int{opts.sha256} + int{opts.blake3};
+    if (algorithms > 1 && static_cast<std::uint64_t>(st.st_size) > kBlockSize) {
+        if (!hash_pipelined(fd.fd, digesters, advance, out.error)) {
+            return false;
+        }
+        digesters.finish(out);
+        return true;
+    }
+
+    if (buffer.empty()) {
+        buffer.resize(kBlockSize);
+    }
+    for (;;) {
+        const ssize_t n = read_full(fd.fd, buffer.data(), buffer.size());
+        if (n < 0) {
+            set_error(out.error, errno, "read");
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (std::size_t a = 0; a < kAlgorithmCount; ++a) {
+            if (digesters.enabled(a)) {
+                digesters.update(a, buffer.data(), static_cast<std::size_t>(n));
+            }
+        }
+        if (!advance(static_cast<std::uint64_t>(n))) {
+            set_error(out.error, ECANCELED, "checksum");
+            return false;
+        }
+    }
+    digesters.finish(out);
+    return true;
+}
+
+unsigned resolve_concurrent_files(const Options& opts, std::size_t files) {
+    unsigned count = opts.concurrentFiles;
+    if (count == 0) {
+        // Each file keeps one thread per algorithm busy, plus its reader.
+        const unsigned algorithms = std::max(1u, unsigned{opts.sha256} + unsigned{opts.blake3});
+        count = std::clamp(std::thread::hardware_concurrency() / algorithms, 1u, kMaxConcurrentFiles);
+    }
+    return static_cast<unsigned>(std::min<std::size_t>(count, files));
+}
+
+std::string escape_path(const std::string& path, bool& escaped) {
+    escaped = path.find_first_of("\\\n\r") != std::string::npos;
+    if (!escaped) {
+        return path;
+    }
+    std::string out;
+    out.reserve(path.size() + 8);
+    for (const char c : path) {
+        switch (c) {
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            default:
+                out += c;
+        }
+    }
+    return out;
+}
+
+bool unescape_path(const std::string& in, std::string& out) {
+    out.clear();
+    out.reserve(in.size());
+    for (std::size_t i = 0; i < in.size(); ++i) {
+        if (in[i] != '\\') {
+            out += in[i];
+            continue;
+        }
+        if (++i == in.size()) {
+            return false;
+        }
+        switch (in[i]) {
+            case '\\':
+                out += '\\';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ends_with(const std::string& s, const char* suffix) {
+    const std::size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+}  // namespace
+
+const char* algorithm_name(Algorithm algorithm) {
+    return algorithm == Algorithm::Sha256 ? "SHA-256" : "BLAKE3";
+}
+
+const char* manifest_file_name(Algorithm algorithm) {
+    return algorithm == Algorithm::Sha256 ? "SHA256SUMS" : "B3SUMS";
+}
+
+bool algorithm_for_manifest(const std::string& path, Algorithm& out) {
+    const std::size_t slash = path.rfind('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (name == "sha256sums" || ends_with(name, ".sha256") || ends_with(name, ".sha256sum")) {
+        out = Algorithm::Sha256;
+        return true;
+    }
+    if (name == "b3sums" || ends_with(name, ".b3") || ends_with(name, ".b3sum")) {
+        out = Algorithm::Blake3;
+        return true;
+    }
+    return false;
+}
+
+Sha256::Sha256() {
+    std::memcpy(state_, kInitialState, sizeof(state_));
+}
+
+void Sha256::update(const std::uint8_t* data, std::size_t length) {
+    length_ += length;
+    if (buffered_ > 0) {
+        const std::size_t n = std::min(length, sizeof(buffer_) - buffered_);
+        std::memcpy(buffer_ + buffered_, data, n);
+        buffered_ += n;
+        data += n;
+        length -= n;
+        if (buffered_ < sizeof(buffer_)) {
+            return;
+        }
+        compress(state_, buffer_, 1);
+        buffered_ = 0;
+    }
+    const std::size_t blocks = length / 64;
+    if (blocks > 0) {
+        compress(state_, data, blocks);
+        data += blocks * 64;
+        length -= blocks * 64;
+    }
+    if (length > 0) {
+        std::memcpy(buffer_, data, length);
+        buffered_ = length;
+    }
+}
+
+void Sha256::finish(std::uint8_t digest[kDigestSize]) {
+    const std::uint64_t bits = length_ * 8;
+    buffer_[buffered_++] = 0x80;
+    if (buffered_ > 56) {
+        std::memset(buffer_ + buffered_, 0, sizeof(buffer_) - buffered_);
+        compress(state_, buffer_, 1);
+        buffered_ = 0;
+    }
+    std::memset(buffer_ + buffered_, 0, 56 - buffered_);
+    for (int i = 0; i < 8; ++i) {
+        buffer_[56 + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+    }
+    compress(state_, buffer_, 1);
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<std::uint8_t>(state_[i] >> 24);
+        digest[4 * i + 1] = static_cast<std::uint8_t>(state_[i] >> 16);
+        digest[4 * i + 2] = static_cast<std::uint8_t>(state_[i] >> 8);
+        digest[4 * i + 3] = static_cast<std::uint8_t>(state_[i]);
+    }
+    std::memcpy(state_, kInitialState, sizeof(state_));
+    length_ = 0;
+    buffered_ = 0;
+}
+
+bool hash_files(const std::vector<std::string>& paths,
+                std::vector<FileResult>& results,
+                ProgressInfo& progress,
+                const ProgressCallback& callback,
+                Error& err,
+                const Options& opts) {
+    err = {};
+    results.clear();
+    results.resize(paths.size());
+    progress.filesDone = 0;
+    progress.filesTotal = static_cast<int>(paths.size());
+    progress.bytesDone = 0;
+    progress.bytesTotal = 0;
+    for (const auto& path : paths) {
+        struct stat st{};
+        if (::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            progress.bytesTotal += static_cast<std::uint64_t>(st.st_size);
+        }
+    }
+    if (paths.empty()) {
+        return true;
+    }
+
+    std::mutex progressMutex;
+    std::atomic<bool> cancelled{false};
+    std::atomic<std::size_t> next{0};
+
+    auto work = [&] {
+        std::vector<std::uint8_t> buffer;
+        for (std::size_t i = next.fetch_add(1); i < paths.size() && !cancelled.load(); i = next.fetch_add(1)) {
+            const auto advance = [&](std::uint64_t bytes) {
+                std::lock_guard<std::mutex> lock(progressMutex);
+                progress.bytesDone += bytes;
+                progress.currentPath = paths[i];
+                if (callback && !cancelled.load() && !callback(progress)) {
+                    cancelled.store(true);
+                }
+                return !cancelled.load();
+            };
+            hash_one(paths[i], opts, buffer, advance, results[i]);
+
+            std::lock_guard<std::mutex> lock(progressMutex);
+            ++progress.filesDone;
+        }
+    };
+
+    const unsigned workers = resolve_concurrent_files(opts, paths.size());
+    std::vector<std::thread> threads;
+    threads.reserve(workers > 0 ? workers - 1 : 0);
+    for (unsigned i = 1; i < workers; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    if (cancelled.load()) {
+        set_error(err, ECANCELED, "checksum");
+        return false;
+    }
+    for (const auto& result : results) {
+        if (result.error.isSet()) {
+            err.code = result.error.code;
+            err.message = result.path + ": " + result.error.message;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string format_manifest(const std::vector<FileResult>& results, Algorithm algorithm, const std::string& baseDir) {
+    std::string prefix = baseDir;
+    if (!prefix.empty() && prefix.back() != '/') {
+        prefix += '/';
+    }
+    std::string out;
+    for (const auto& result : results) {
+        const std::string& digest = result.digests[static_cast<std::size_t>(algorithm)];
+        if (result.error.isSet() || digest.empty()) {
+            continue;
+        }
+        std::string path = result.path;
+        if (!prefix.empty() && path.size() > prefix.size() && path.compare(0, prefix.size(), prefix) == 0) {
+            path.erase(0, prefix.size());
+        }
+        bool escaped = false;
+        path = escape_path(path, escaped);
+        if (escaped) {
+            out += '\\';
+        }
+        out += digest;
+        out += "  ";
+        out += path;
+        out += '\n';
+    }
+    return out;
+}
+
+bool parse_manifest(const std::string& text, std::vector<ManifestEntry>& entries, Error& err) {
+    err = {};
+    entries.clear();
+    std::size_t lineNumber = 0;
+    for (std::size_t pos = 0; pos < text.size();) {
+        std::size_t end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        const bool escaped = line[0] == '\\';
+        const std::size_t start = escaped ? 1 : 0;
+        const std::size_t space = line.find(' ', start);
+        ManifestEntry entry;
+        bool ok = space != std::string::npos && space > start && space + 2 < line.size() &&
+                  (line[space + 1] == ' ' || line[space + 1] == '*');
+        if (ok) {
+            entry.digest = line.substr(start, space - start);
+            std::transform(entry.digest.begin(), entry.digest.end(), entry.digest.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            ok = entry.digest.size() % 2 == 0 &&
+                 entry.digest.find_first_not_of("0123456789abcdef") == std::string::npos;
+        }
+        if (ok) {
+            const std::string path = line.substr(space + 2);
+            if (escaped) {
+                ok = unescape_path(path, entry.path);
+            } else {
+                entry.path = path;
+            }
+        }
+        if (!ok) {
+            err.code = EINVAL;
+            err.message = "malformed checksum line " + std::to_string(lineNumber);
+            entries.clear();
+            return false;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+bool verify_manifest(const std::string& manifestPath,
+                     Algorithm algorithm,
+                     std::vector<VerifyResult>& results,
+                     ProgressInfo& progress,
+                     const ProgressCallback& callback,
+                     Error& err,
+                     const Options& opts) {
+    results.clear();
+    std::vector<std::uint8_t> raw;
+    if (!FsOps::read_file_all(manifestPath, raw, err)) {
+        return false;
+    }
+    std::vector<ManifestEntry> entries;
+    if (!parse_manifest(std::string(raw.begin(), raw.end()), entries, err)) {
+        err.message = manifestPath + ": " + err.message;
+        return false;
+    }
+
+    const std::size_t slash = manifestPath.rfind('/');
+    const std::string dir = slash == std::string::npos ? std::string() : manifestPath.substr(0, slash + 1);
+    std::vector<std::string> paths;
+    paths.reserve(entries.size());
+    for (const auto& entry : entries) {
+        paths.push_back(!entry.path.empty() && entry.path[0] == '/' ? entry.path : dir + entry.path);
+    }
+
+    Options hashOptions = opts;
+    hashOptions.sha256 = algorithm == Algorithm::Sha256;
+    hashOptions.blake3 = algorithm == Algorithm::Blake3;
+    std::vector<FileResult> hashed;
+    Error hashErr;
+    if (!hash_files(paths, hashed, progress, callback, hashErr, hashOptions) && hashErr.code == ECANCELED) {
+        err = hashErr;
+        return false;
+    }
+
+    bool allOk = true;
+    results.resize(entries.size());
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        results[i].path = entries[i].path;
+        if (hashed[i].error.isSet()) {
+            results[i].status = VerifyStatus::Unreadable;
+            results[i].error = hashed[i].error;
+        } else if (hashed[i].digests[static_cast<std::size_t>(algorithm)] == entries[i].digest) {
+            results[i].status = VerifyStatus::Ok;
+            continue;
+        } else {
+            results[i].status = VerifyStatus::Mismatch;
+        }
+        allOk = false;
+    }
+    err = {};
+    if (!allOk) {
+        err.code = EIO;
+        err.message = "some files did not match " + manifestPath;
+    }
+    return allOk;
+}
+
+}  // namespace PCManFM::FileChecksums
@@ -0,0 +1,108 @@
+/*
+ * Multi-algorithm file checksums and sha256sum/b3sum manifests (POSIX-only, no Qt)
+ * src/core/file_checksums.h
+ */
+
+#ifndef PCMANFM_FILE_CHECKSUMS_H
+#define PCMANFM_FILE_CHECKSUMS_H
+
+#include "fs_ops.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PCManFM::FileChecksums {
+
+enum class Algorithm { Sha256, Blake3 };
+constexpr std::size_t kAlgorithmCount = 2;
+
+// "SHA-256" or "BLAKE3".
+const char* algorithm_name(Algorithm algorithm);
+// The conventional manifest name, "SHA256SUMS" or "B3SUMS".
+const char* manifest_file_name(Algorithm algorithm);
+// Which algorithm a manifest holds, judged by its file name: SHA256SUMS, *.sha256 or
+// *.sha256sum, and B3SUMS, *.b3 or *.b3sum. False when the name says neither.
+bool algorithm_for_manifest(const std::string& path, Algorithm& out);
+
+// SHA-256 using the SHA extensions on x86-64 CPUs that have them.
+class Sha256 {
+   public:
+    static constexpr std::size_t kDigestSize = 32;
+
+    Sha256();
+    void update(const std::uint8_t* data, std::size_t length);
+    void finish(std::uint8_t digest[kDigestSize]);
+
+   private:
+    std::uint32_t state_[8];
+    std::uint64_t length_ = 0;
+    std::uint8_t buffer_[64];
+    std::size_t buffered_ = 0;
+};
+
+struct Options {
+    bool sha256 = true;
+    bool blake3 = true;
+    unsigned concurrentFiles = 0;  // files hashed at once; 0 = automatic
+};
+
+struct FileResult {
+    std::string path;
+    std::string digests[kAlgorithmCount];  // lowercase hex by Algorithm; empty when not computed
+    FsOps::Error error;
+};
+
+// Hashes each regular file with every algorithm of |opts| while reading it once: a reader
+// fills a ring of 4 MiB blocks and each algorithm digests them on a thread of its own, so
+// the slowest algorithm, not the sum of them, sets the pace. Files up to one block are
+// hashed inline. Several files are processed at once; results[i] belongs to paths[i].
+// Progress counts bytes over all files, and the callback is serialized but may run on any
+// worker. Returns false when a file failed (|err| holds the first failure; the others are
+// in their results) or the callback cancelled (ECANCELED).
+bool hash_files(const std::vector<std::string>& paths,
+                std::vector<FileResult>& results,
+                FsOps::ProgressInfo& progress,
+                const FsOps::ProgressCallback& callback,
+                FsOps::Error& err,
+                const Options& opts = {});
+
+// The manifest sha256sum or b3sum would print for |results|: the digest, two spaces and the
+// path, one file per line. Paths below |baseDir| are written relative to it; a path with a
+// backslash or line break is escaped and its line starts with a backslash, as those tools do.
+// Files that failed are left out.
+std::string format_manifest(const std::vector<FileResult>& results, Algorithm algorithm, const std::string& baseDir);
+
+struct ManifestEntry {
+    std::string digest;  // lowercase hex
+    std::string path;
+};
+
+// Reads a manifest in that format; binary-mode lines ("<digest> *<path>") are accepted too.
+// Blank lines and lines starting with '#' are skipped. Fails with EINVAL naming the first
+// malformed line.
+bool parse_manifest(const std::string& text, std::vector<ManifestEntry>& entries, FsOps::Error& err);
+
+enum class VerifyStatus { Ok, Mismatch, Unreadable };
+
+struct VerifyResult {
+    std::string path;  // as written in the manifest
+    VerifyStatus status = VerifyStatus::Unreadable;
+    FsOps::Error error;  // why an Unreadable file could not be hashed
+};
+
+// Hashes every file listed in |manifestPath| the same way hash_files() does, relative paths
+// being resolved against the manifest's directory, and compares the digests. Returns false
+// when the manifest cannot be read, a file mismatches or is unreadable, or on cancellation.
+bool verify_manifest(const std::string& manifestPath,
+                     Algorithm algorithm,
+                     std::vector<VerifyResult>& results,
+                     FsOps::ProgressInfo& progress,
+                     const FsOps::ProgressCallback& callback,
+                     FsOps::Error& err,
+                     const Options& opts = {});
+
+}  // namespace PCManFM::FileChecksums
+
+#endif  // PCMANFM_FILE_CHECKSUMS_H
@@ -0,0 +1,222 @@
+/*
+ * Central scheduler for file operations with one queue per destination device
+ * src/core/fileop_scheduler.cpp
+ */
+
+#include "fileop_scheduler.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <sys/stat.h>
+
+namespace PCManFM {
+
+FileOpScheduler::FileOpScheduler(QObject* parent) : QObject(parent) {}
+
+FileOpScheduler::~FileOpScheduler() {
+    // Running backends cancel and join their threads when destroyed.
+    for (auto& [id, job] : jobs_) {
+        if (job->ops) {
+            job->ops->disconnect(this);
+        }
+    }
+}
+
+quint64 FileOpScheduler::deviceFor(const FileOpRequest& req) {
+    QString path = req.type == FileOpType::Delete ? (req.sources.isEmpty() ? QString() : req.sources.first())
+                                                  : req.destination;
+    // The destination may not exist yet; its nearest existing ancestor decides the device.
+    while (!path.isEmpty()) {
+        struct stat st{};
+        if (::stat(QFile::encodeName(path).constData(), &st) == 0) {
+            return static_cast<quint64>(st.st_dev);
+        }
+        const QString parent = QFileInfo(path).path();
+        if (parent == path) {
+            break;
+        }
+        path = parent;
+    }
+    return 0;
+}
+
+FileOpScheduler::JobId FileOpScheduler::enqueue(std::unique_ptr<IFileOps> ops, const FileOpRequest& req) {
+    return enqueue(std::move(ops), req, deviceFor(req));
+}
+
+FileOpScheduler::JobId FileOpScheduler::enqueue(std::unique_ptr<IFileOps> ops,
+                                                const FileOpRequest& req,
+                                                quint64 device) {
+    if (!ops) {
+        return 0;
+    }
+
+    auto job = std::make_unique<Job>();
+    job->id = nextId_++;
+    job->request = req;
+    job->ops = std::move(ops);
+    job->device = device;
+
+    const JobId id = job->id;
+    IFileOps* opsPtr = job->ops.get();
+    connect(opsPtr, &IFileOps::progress, this,
+            [this, id](const FileOpProgress& info) { Q_EMIT jobProgress(id, info); });
+    connect(opsPtr, &IFileOps::finished, this,
+            [this, id](bool success, const QString& errorMessage) { onJobFinished(id, success, errorMessage); });
+
+    jobs_.emplace(id, std::move(job));
+    queues_[device].append(id);
+    Q_EMIT jobQueued(id);
+    dispatch(device);
+    return id;
+}
+
+FileOpScheduler::Job* FileOpScheduler::find(JobId id) const {
+    const auto it = jobs_.find(id);
+    return it == jobs_.end() ? nullptr : it->second.get();
+}
+
+bool FileOpScheduler::contains(JobId id) const {
+    return find(id) != nullptr;
+}
+
+FileOpScheduler::JobState FileOpScheduler::state(JobId id) const {
+    const Job* job = find(id);
+    if (!job) {
+        return JobState::Queued;
+    }
+    if (job->paused) {
+        return JobState::Paused;
+    }
+    return job->running ? JobState::Running : JobState::Queued;
+}
+
+const FileOpRequest* FileOpScheduler::request(JobId id) const {
+    const Job* job = find(id);
+    return job ? &job->request : nullptr;
+}
+
+quint64 FileOpScheduler::device(JobId id) const {
+    const Job* job = find(id);
+    return job ? job->device : 0;
+}
+
+QList<FileOpScheduler::JobId> FileOpScheduler::queuedJobs(quint64 device) const {
+    return queues_.value(device);
+}
+
+FileOpScheduler::JobId FileOpScheduler::runningJob(quint64 device) const {
+    return running_.value(device, 0);
+}
+
+void FileOpScheduler::dispatch(quint64 device) {
+    if (running_.contains(device)) {
+        return;
+    }
+    QList<JobId>& queue = queues_[device];
+    for (int i = 0; i < queue.size(); ++i) {
+        Job* job = find(queue.at(i));
+        if (!job || job->paused) {
+            continue;
+        }
+        queue.removeAt(i);
+        if (queue.isEmpty()) {
+            queues_.remove(device);
+        }
+        job->running = true;
+        running_.insert(device, job->id);
+        Q_EMIT jobStarted(job->id);
+        Q_EMIT jobStateChanged(job->id, JobState::Running);
+        job->ops->start(job->request);
+        return;
+    }
+    if (queue.isEmpty()) {
+        queues_.remove(device);
+    }
+}
+
+void FileOpScheduler::onJobFinished(JobId id, bool success, const QString& errorMessage) {
+    const auto it = jobs_.find(id);
+    if (it == jobs_.end()) {
+        return;
+    }
+    std::unique_ptr<Job> job = std::move(it->second);
+    jobs_.erase(it);
+    if (running_.value(job->device, 0) == id) {
+        running_.remove(job->device);
+    }
+    // We are inside the backend's own signal; let it unwind before it is destroyed.
+    job->ops->disconnect(this);
+    job->ops.release()->deleteLater();
+
+    Q_EMIT jobFinished(id, success, errorMessage);
+    dispatch(job->device);
+}
+
+bool FileOpScheduler::cancel(JobId id) {
+    Job* job = find(id);
+    if (!job) {
+        return false;
+    }
+    if (job->running) {
+        job->ops->setPaused(false);
+        job->ops->cancel();
+        return true;
+    }
+
+    const quint64 device = job->device;
+    queues_[device].removeAll(id);
+    if (queues_[device].isEmpty()) {
+        queues_.remove(device);
+    }
+    jobs_.erase(id);
+    Q_EMIT jobFinished(id, false, tr("Operation cancelled"));
+    return true;
+}
+
+bool FileOpScheduler::pause(JobId id) {
+    Job* job = find(id);
+    if (!job || job->paused) {
+        return false;
+    }
+    job->paused = true;
+    if (job->running) {
+        job->ops->setPaused(true);
+    }
+    Q_EMIT jobStateChanged(id, JobState::Paused);
+    return true;
+}
+
+bool FileOpScheduler::resume(JobId id) {
+    Job* job = find(id);
+    if (!job || !job->paused) {
+        return false;
+    }
+    job->paused = false;
+    if (job->running) {
+        job->ops->setPaused(false);
+        Q_EMIT jobStateChanged(id, JobState::Running);
+    }
+    else {
+        Q_EMIT jobStateChanged(id, JobState::Queued);
+        dispatch(job->device);
+    }
+    return true;
+}
+
+bool FileOpScheduler::moveJob(JobId id, int position) {
+    Job* job = find(id);
+    if (!job || job->running) {
+        return false;
+    }
+    QList<JobId>& queue = queues_[job->device];
+    const int from = queue.indexOf(id);
+    if (from < 0) {
+        return false;
+    }
+    queue.move(from, qBound(0, position, static_cast<int>(queue.size()) - 1));
+    return true;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,96 @@
+/*
+ * Central scheduler for file operations with one queue per destination device
+ * src/core/fileop_scheduler.h
+ */
+
+#ifndef FILEOP_SCHEDULER_H
+#define FILEOP_SCHEDULER_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include <map>
+#include <memory>
+
+#include "ifileops.h"
+
+namespace PCManFM {
+
+// FileOpScheduler runs file operations one at a time per device and side by side across
+// devices. A request is keyed by the st_dev of its destination (the first source for
+// deletes), so five copies to the same USB stick run back to back instead of thrashing it,
+// while a copy to another disk starts right away. Queued jobs can be reordered, paused and
+// resumed; pausing a running job holds it inside its current file and keeps the device.
+// Lives on the GUI thread; all methods must be called from there.
+class FileOpScheduler : public QObject {
+    Q_OBJECT
+
+   public:
+    using JobId = quint64;
+
+    enum class JobState { Queued, Running, Paused };
+    Q_ENUM(JobState)
+
+    explicit FileOpScheduler(QObject* parent = nullptr);
+    ~FileOpScheduler() override;
+
+    // Takes ownership of |ops| and queues |req| on it. Returns 0 when |ops| is null.
+    JobId enqueue(std::unique_ptr<IFileOps> ops, const FileOpRequest& req);
+    // Same, with the device given explicitly instead of derived from the request.
+    JobId enqueue(std::unique_ptr<IFileOps> ops, const FileOpRequest& req, quint64 device);
+
+    // A queued job is dropped (finished with an error); a running one is asked to cancel.
+    bool cancel(JobId id);
+    // A paused queued job is skipped when its device frees up; a paused running job waits
+    // inside its current file. Both keep their queue position.
+    bool pause(JobId id);
+    bool resume(JobId id);
+    // Moves a queued job to |position| within its device queue (0 = next to run).
+    bool moveJob(JobId id, int position);
+
+    bool contains(JobId id) const;
+    // State of a known job; see contains().
+    JobState state(JobId id) const;
+    const FileOpRequest* request(JobId id) const;
+    quint64 device(JobId id) const;
+    // Jobs waiting on |device|, next first; the running job is not included.
+    QList<JobId> queuedJobs(quint64 device) const;
+    // The job currently running on |device|, or 0.
+    JobId runningJob(quint64 device) const;
+
+    // st_dev of the nearest existing ancestor of the request's destination, or of the first
+    // source for deletes.
+    static quint64 deviceFor(const FileOpRequest& req);
+
+   Q_SIGNALS:
+    void jobQueued(JobId id);
+    void jobStarted(JobId id);
+    void jobProgress(JobId id, const FileOpProgress& info);
+    void jobFinished(JobId id, bool success, const QString& errorMessage);
+    void jobStateChanged(JobId id, JobState state);
+
+   private:
+    struct Job {
+        JobId id = 0;
+        FileOpRequest request;
+        std::unique_ptr<IFileOps> ops;
+        quint64 device = 0;
+        bool running = false;
+        bool paused = false;
+    };
+
+    Job* find(JobId id) const;
+    void dispatch(quint64 device);
+    void onJobFinished(JobId id, bool success, const QString& errorMessage);
+
+    JobId nextId_ = 1;
+    std::map<JobId, std::unique_ptr<Job>> jobs_;
+    QHash<quint64, QList<JobId>> queues_;  // waiting jobs per device
+    QHash<quint64, JobId> running_;        // running job per device
+};
+
+}  // namespace PCManFM
+
+#endif  // FILEOP_SCHEDULER_H
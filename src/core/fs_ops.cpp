@@ -5,16 +5,42 @@
 
 #include "fs_ops.h"
 
+#include "copy_journal.h"
+#include "device_profiles.h"
+#include "io_throttle.h"
+#include "io_uring_engine.h"
+#include "mapped_file_registry.h"
+
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <dirent.h>
 #include <array>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <b3sum/blake3.h>
 
+#ifdef __linux__
+#include <linux/btrfs.h>
+#include <linux/fs.h>
+#include <linux/magic.h>
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
 namespace PCManFM::FsOps {
 
 // Forward declaration for use in helpers
@@ -22,6 +48,12 @@ bool ensure_parent_dirs(const std::string& path, Error& err);
 
 namespace {
 
+std::atomic<int> g_ioEngine{static_cast<int>(IoEngine::Auto)};
+
+inline bool use_io_uring() {
+    return io_engine() == IoEngine::IoUring;
+}
+
 struct Fd {
     int fd;
     explicit Fd(int f = -1) : fd(f) {}
@@ -75,6 +107,54 @@ inline void set_error(Error& err, const char* context) {
     err.message = std::string(context) + ": " + std::strerror(errno);
 }
 
+bool finish_blake3(blake3_hasher& hasher, std::string& hexHash, Error& err);
+
+// Files at least this large are hashed from an mmap'd view instead of through a read buffer.
+constexpr std::uint64_t kBlake3MmapThreshold = 16ull * 1024 * 1024;
+
+// Feeds a read-only mapping of the whole file to the hasher in one update, which lets BLAKE3
+// use its widest SIMD path and, when built with TBB, spread the tree across cores. Returns
+// false without touching |hasher| if the file cannot be mapped; the caller then reads it.
+// Like b3sum, this accepts that a writer truncating the file mid-hash raises SIGBUS.
+bool blake3_update_mapped(int fd, std::uint64_t size, blake3_hasher& hasher) {
+    if (size > static_cast<std::uint64_t>(SIZE_MAX)) {
+        return false;
+    }
+    const auto len = static_cast<std::size_t>(size);
+    void* map = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    ::madvise(map, len, MADV_SEQUENTIAL);
+#ifdef PCMANFM_HAVE_BLAKE3_TBB
+    blake3_hasher_update_tbb(&hasher, map, len);
+#else
+    blake3_hasher_update(&hasher, map, len);
+#endif
+    ::munmap(map, len);
+    return true;
+}
+
+// Hashes a file some viewer already has open through the windows of its shared reader, so
+// the file is neither opened nor mapped again and the viewer's cached windows are reused.
+bool blake3_update_shared(const WindowedFileReader& reader, blake3_hasher& hasher, Error& err) {
+    WindowedFileReader::Lease lease;
+    std::string readErr;
+    for (std::uint64_t offset = 0; offset < reader.size(); offset += lease.size()) {
+        if (!reader.borrow(offset, reader.windowSize(), lease, readErr) || lease.empty()) {
+            err.code = EIO;
+            err.message = readErr.empty() ? std::string("read: unexpected end of file") : readErr;
+            return false;
+        }
+#ifdef PCMANFM_HAVE_BLAKE3_TBB
+        blake3_hasher_update_tbb(&hasher, lease.data(), lease.size());
+#else
+        blake3_hasher_update(&hasher, lease.data(), lease.size());
+#endif
+    }
+    return true;
+}
+
 bool blake3_file_impl(const std::string& path, std::string& hexHash, Error& err) {
     hexHash.clear();
 
@@ -95,6 +175,13 @@ bool blake3_file_impl(const std::string& path, std::string& hexHash, Error& err)
         return false;
     }
 
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+
+    if (const auto shared = MappedFileRegistry::instance().find(st)) {
+        return blake3_update_shared(*shared, hasher, err) && finish_blake3(hasher, hexHash, err);
+    }
+
     int flags = O_RDONLY | O_CLOEXEC;
 #ifdef O_NOFOLLOW
     flags |= O_NOFOLLOW;
@@ -105,8 +192,27 @@ bool blake3_file_impl(const std::string& path, std::string& hexHash, Error& err)
         return false;
     }
 
-    blake3_hasher hasher;
-    blake3_hasher_init(&hasher);
+    const auto size = static_cast<std::uint64_t>(st.st_size);
+    if (size >= kBlake3MmapThreshold && blake3_update_mapped(fd.fd, size, hasher)) {
+        return finish_blake3(hasher, hexHash, err);
+    }
+
+    if (use_io_uring()) {
+        const int rc = IoUring::read_stream(fd.fd, [&hasher](const std::uint8_t* data, std::size_t len) {
+            blake3_hasher_update(&hasher, data, len);
+        });
+        if (rc == 0) {
+            return finish_blake3(hasher, hexHash, err);
+        }
+        if (rc != ENOSYS) {
+            errno = rc;
+            set_error(err, "read");
+            return false;
+        }
+        // Ring unavailable on this thread; hash with plain reads below.
+        blake3_hasher_init(&hasher);
+        ::lseek(fd.fd, 0, SEEK_SET);
+    }
 
     std::array<char, 64 * 1024> buffer{};
     for (;;) {
@@ -124,6 +230,10 @@ bool blake3_file_impl(const std::string& path, std::string& hexHash, Error& err)
         blake3_hasher_update(&hasher, reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(n));
     }
 
+    return finish_blake3(hasher, hexHash, err);
+}
+
+bool finish_blake3(blake3_hasher& hasher, std::string& hexHash, Error& err) {
     uint8_t out[BLAKE3_OUT_LEN];
     blake3_hasher_finalize(&hasher, out, BLAKE3_OUT_LEN);
 
@@ -145,14 +255,28 @@ inline bool should_continue(const ProgressCallback& cb, const ProgressInfo& info
     return cb(info);
 }
 
+// Reads fd to EOF straight into |out|. Regular files are presized from fstat() so the common
+// case is one allocation and no intermediate copy; files that report no size (procfs, pipes)
+// or grow while being read fall back to geometric growth.
 bool read_all_fd(int fd, std::vector<std::uint8_t>& out, Error& err) {
     constexpr std::size_t chunk = 64 * 1024;
     std::vector<std::uint8_t> buffer;
-    buffer.reserve(chunk);
 
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        // One spare byte lets the final read() observe EOF without another resize.
+        buffer.resize(static_cast<std::size_t>(st.st_size) + 1);
+    }
+    else {
+        buffer.resize(chunk);
+    }
+
+    std::size_t used = 0;
     for (;;) {
-        std::uint8_t tmp[chunk];
-        const ssize_t n = ::read(fd, tmp, sizeof tmp);
+        if (used == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        const ssize_t n = ::read(fd, buffer.data() + used, buffer.size() - used);
         if (n < 0) {
             if (errno == EINTR) {
                 continue;
@@ -163,9 +287,10 @@ bool read_all_fd(int fd, std::vector<std::uint8_t>& out, Error& err) {
         if (n == 0) {
             break;
         }
-        buffer.insert(buffer.end(), tmp, tmp + n);
+        used += static_cast<std::size_t>(n);
     }
 
+    buffer.resize(used);
     out.swap(buffer);
     return true;
 }
@@ -186,76 +311,139 @@ bool write_all_fd(int fd, const std::uint8_t* data, std::size_t size, Error& err
     return true;
 }
 
-struct StatInfo {
-    struct stat st{};
-};
-
-bool stat_at(int dirfd, const char* name, bool follow, StatInfo& out, Error& err) {
-    int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
-    if (::fstatat(dirfd, name, &out.st, flags) < 0) {
-        set_error(err, "fstatat");
-        return false;
-    }
-    return true;
+inline void set_cancelled(Error& err) {
+    err.code = ECANCELED;
+    err.message = "Cancelled";
 }
 
-bool copy_symlink_at(int srcDir,
-                     const char* srcName,
-                     int dstDir,
-                     const char* dstName,
-                     const StatInfo& info,
-                     Error& err,
-                     bool preserveOwnership) {
-    std::vector<char> buf(static_cast<std::size_t>(info.st.st_size) + 1);
-    ssize_t len = ::readlinkat(srcDir, srcName, buf.data(), buf.size());
-    if (len < 0) {
-        set_error(err, "readlinkat");
-        return false;
-    }
-    buf[static_cast<std::size_t>(len)] = '\0';
-    if (::symlinkat(buf.data(), dstDir, dstName) < 0) {
-        set_error(err, "symlinkat");
-        return false;
-    }
-    // Preserve timestamps if possible
-    struct timespec times[2];
-    times[0] = info.st.st_atim;
-    times[1] = info.st.st_mtim;
-    ::utimensat(dstDir, dstName, times, AT_SYMLINK_NOFOLLOW);  // best effort
-    if (preserveOwnership) {
-        ::fchownat(dstDir, dstName, info.st.st_uid, info.st.st_gid, AT_SYMLINK_NOFOLLOW);  // best effort
-    }
-    return true;
+// Errors that mean "this tier is not available for this pair of files", as opposed to a real
+// I/O failure. The next tier is tried when one of these is returned before any data moved.
+inline bool tier_unsupported(int code) {
+    return code == ENOSYS || code == EOPNOTSUPP || code == ENOTSUP || code == EXDEV || code == EINVAL ||
+           code == ENOTTY || code == EBADF || code == EPERM;
 }
 
-bool copy_file_at(int srcDir,
-                  const char* srcName,
-                  int dstDir,
-                  const char* dstName,
-                  const StatInfo& info,
-                  ProgressInfo& progress,
-                  const ProgressCallback& cb,
-                  Error& err,
-                  bool preserveOwnership) {
-    progress.bytesTotal += static_cast<std::uint64_t>(info.st.st_size);
+// Sentinel range end for "copy until read() reports EOF".
+constexpr std::uint64_t kToEof = ~std::uint64_t{0};
 
-    Fd in_fd(::openat(srcDir, srcName, O_RDONLY | O_CLOEXEC));
-    if (!in_fd.valid()) {
-        set_error(err, "openat");
-        return false;
+// Tier 1: share extents with the source (btrfs, XFS, bcachefs, OCFS2). The whole file is
+// done in one call, holes included, so the callback only sees the final total.
+bool try_reflink(int inFd, int outFd, std::uint64_t size, ProgressInfo& progress) {
+#if defined(__linux__) && defined(FICLONE)
+    if (::ioctl(outFd, FICLONE, inFd) == 0) {
+        progress.bytesDone += size;
+        progress.copyMethod = CopyMethod::Reflink;
+        return true;
     }
+#else
+    (void)inFd;
+    (void)outFd;
+    (void)size;
+    (void)progress;
+#endif
+    return false;
+}
 
-    Fd out_fd(::openat(dstDir, dstName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, info.st.st_mode & 0777));
-    if (!out_fd.valid()) {
-        set_error(err, "openat");
-        return false;
+// Tiers 2-3: in-kernel copies of [pos, end). |pos| is advanced as data lands so a later tier
+// can resume from the same offset. Returns false with err unset when the tier is unsupported,
+// and true with |pos| short of |end| when the kernel stopped copying part way.
+bool copy_in_kernel(int inFd,
+                    int outFd,
+                    std::uint64_t& pos,
+                    std::uint64_t end,
+                    CopyMethod method,
+                    ProgressInfo& progress,
+                    const ProgressCallback& cb,
+                    Error& err) {
+#ifdef __linux__
+    constexpr std::size_t chunk = 8 * 1024 * 1024;
+    const std::uint64_t start = pos;
+    while (pos < end) {
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(chunk, end - pos));
+        ssize_t n;
+        if (method == CopyMethod::CopyFileRange) {
+            off_t inOff = static_cast<off_t>(pos);
+            off_t outOff = static_cast<off_t>(pos);
+            n = ::copy_file_range(inFd, &inOff, outFd, &outOff, want, 0);
+        }
+        else {
+            off_t inOff = static_cast<off_t>(pos);
+            if (::lseek(outFd, static_cast<off_t>(pos), SEEK_SET) < 0) {
+                set_error(err, "lseek");
+                return false;
+            }
+            n = ::sendfile(outFd, inFd, &inOff, want);
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (pos == start && tier_unsupported(errno)) {
+                return false;
+            }
+            set_error(err, method == CopyMethod::CopyFileRange ? "copy_file_range" : "sendfile");
+            return false;
+        }
+        if (n == 0) {
+            if (pos == start) {
+                // Some filesystems copy nothing this way rather than fail (procfs, some FUSE
+                // and network filesystems); leave the file to the next tier.
+                return false;
+            }
+            // Either the source shrank or the kernel gave up; the caller finds out which.
+            break;
+        }
+        pos += static_cast<std::uint64_t>(n);
+        progress.bytesDone += static_cast<std::uint64_t>(n);
+        progress.copyMethod = method;
+        if (!should_continue(cb, progress)) {
+            set_cancelled(err);
+            return false;
+        }
     }
+    progress.copyMethod = method;
+    return true;
+#else
+    (void)inFd;
+    (void)outFd;
+    (void)pos;
+    (void)end;
+    (void)method;
+    (void)progress;
+    (void)cb;
+    (void)err;
+    return false;
+#endif
+}
 
-    constexpr std::size_t chunk = 128 * 1024;  // a bit larger for throughput
-    std::vector<std::uint8_t> buffer(chunk);
-
-    for (;;) {
-        const ssize_t n = ::read(in_fd.fd, buffer.data(), buffer.size());
+// Tier 4: portable user-space loop over [pos, end); end may be kToEof. When |hasher| is set
+// every chunk is also fed to it on its way through the buffer. With |profiles| the chunks
+// have the size learned for the destination's device, which the loop keeps measuring.
+bool copy_read_write(int inFd,
+                     int outFd,
+                     std::uint64_t& pos,
+                     std::uint64_t end,
+                     ProgressInfo& progress,
+                     const ProgressCallback& cb,
+                     Error& err,
+                     blake3_hasher* hasher,
+                     DeviceProfiles* profiles = nullptr) {
+    struct stat outSt{};
+    if (profiles && ::fstat(outFd, &outSt) < 0) {
+        profiles = nullptr;
+    }
+    const std::uint64_t device = static_cast<std::uint64_t>(outSt.st_dev);
+    std::vector<std::uint8_t> buffer(profiles ? profiles->chunkSize(device) : DeviceProfiles::kDefaultChunk);
+    // what was copied since the last sample, and the time its reads and writes took
+    std::uint64_t sampleBytes = 0;
+    std::uint64_t sampleChunks = 0;
+    std::chrono::steady_clock::duration sampleTime{};
+
+    progress.copyMethod = CopyMethod::ReadWrite;
+    while (pos < end) {
+        const auto started = std::chrono::steady_clock::now();
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), end - pos));
+        const ssize_t n = ::pread(inFd, buffer.data(), want, static_cast<off_t>(pos));
         if (n < 0) {
             if (errno == EINTR) {
                 continue;
@@ -266,121 +454,1345 @@ bool copy_file_at(int srcDir,
         if (n == 0) {
             break;
         }
+        if (hasher) {
+            blake3_hasher_update(hasher, buffer.data(), static_cast<std::size_t>(n));
+        }
 
-        if (!write_all_fd(out_fd.fd, buffer.data(), static_cast<std::size_t>(n), err)) {
-            return false;
+        std::size_t written = 0;
+        while (written < static_cast<std::size_t>(n)) {
+            const ssize_t w = ::pwrite(outFd, buffer.data() + written, static_cast<std::size_t>(n) - written,
+                                       static_cast<off_t>(pos + written));
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                set_error(err, "write");
+                return false;
+            }
+            written += static_cast<std::size_t>(w);
         }
 
+        pos += static_cast<std::uint64_t>(n);
+        sampleTime += std::chrono::steady_clock::now() - started;
+        sampleBytes += static_cast<std::uint64_t>(n);
+        ++sampleChunks;
+        if (profiles && sampleBytes >= DeviceProfiles::kSampleBytes) {
+            profiles->recordChunks(device, buffer.size(), sampleBytes, sampleChunks, sampleTime);
+            buffer.resize(profiles->chunkSize(device));
+            sampleBytes = 0;
+            sampleChunks = 0;
+            sampleTime = {};
+        }
         progress.bytesDone += static_cast<std::uint64_t>(n);
         if (!should_continue(cb, progress)) {
-            err.code = ECANCELED;
-            err.message = "Cancelled";
+            set_cancelled(err);
             return false;
         }
     }
+    return true;
+}
 
-    struct timespec times[2];
-    times[0] = info.st.st_atim;
-    times[1] = info.st.st_mtim;
-    ::futimens(out_fd.fd, times);  // best effort; ignore errors
-
-    if (preserveOwnership) {
-        ::fchown(out_fd.fd, info.st.st_uid, info.st.st_gid);  // best effort
+// False, with EIO, when a copy of [.., end) stopped at |pos|, as the source ended early.
+bool reached_end(std::uint64_t pos, std::uint64_t end, Error& err) {
+    if (end != kToEof && pos != end) {
+        err.code = EIO;
+        err.message = "Unexpected end of file";
+        return false;
     }
-    ::fchmod(out_fd.fd, info.st.st_mode & 07777);  // best effort to match source mode, ignore umask
+    return true;
+}
 
-    if (::fsync(out_fd.fd) < 0) {
-        set_error(err, "fsync");
-        return false;
+// Copies [pos, end) with the fastest tier that works, failing with EIO when the source ends
+// before |end|. |tier| remembers the first tier worth trying so ranges after the first do not
+// re-probe tiers the kernel already rejected. With a |hasher| the data has to pass through
+// user space, so only the read/write tier is used.
+bool copy_range(int inFd,
+                int outFd,
+                std::uint64_t pos,
+                std::uint64_t end,
+                CopyMethod& tier,
+                ProgressInfo& progress,
+                const ProgressCallback& cb,
+                Error& err,
+                blake3_hasher* hasher,
+                DeviceProfiles* profiles = nullptr) {
+    if (hasher) {
+        tier = CopyMethod::ReadWrite;
+    }
+    if (end != kToEof) {
+        for (CopyMethod method : {CopyMethod::CopyFileRange, CopyMethod::Sendfile}) {
+            if (tier > method) {
+                continue;
+            }
+            if (copy_in_kernel(inFd, outFd, pos, end, method, progress, cb, err)) {
+                tier = method;
+                // the read/write loop finishes a short copy, or finds that the source shrank
+                return pos == end || (copy_read_write(inFd, outFd, pos, end, progress, cb, err, hasher, profiles) &&
+                                      reached_end(pos, end, err));
+            }
+            if (err.isSet()) {
+                return false;
+            }
+        }
+    }
+    if (tier <= CopyMethod::IoUring && use_io_uring()) {
+        std::uint64_t copied = 0;
+        const int rc = IoUring::copy_range(inFd, outFd, pos, end, copied, [&](std::uint64_t bytes) {
+            progress.bytesDone += bytes;
+            progress.copyMethod = CopyMethod::IoUring;
+            return should_continue(cb, progress);
+        });
+        pos += copied;
+        if (rc == 0 && (pos == end || end == kToEof)) {
+            tier = CopyMethod::IoUring;
+            return true;
+        }
+        if (rc == ECANCELED) {
+            set_cancelled(err);
+            return false;
+        }
+        if (rc != 0 && (rc != ENOSYS || copied > 0)) {
+            errno = rc;
+            set_error(err, "io_uring");
+            return false;
+        }
     }
+    // also finishes a copy that io_uring left short
+    tier = CopyMethod::ReadWrite;
+    return copy_read_write(inFd, outFd, pos, end, progress, cb, err, hasher, profiles) && reached_end(pos, end, err);
+}
 
-    return true;
+// Feeds |count| zero bytes to the hasher; used for holes skipped by the sparse copy.
+void hash_zeros(blake3_hasher* hasher, std::uint64_t count) {
+    static const std::uint8_t kZeros[64 * 1024] = {};
+    while (count > 0) {
+        const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(count, sizeof(kZeros)));
+        blake3_hasher_update(hasher, kZeros, n);
+        count -= n;
+    }
 }
 
-bool copy_dir_at(int srcDir,
-                 const char* srcName,
-                 int dstDir,
-                 const char* dstName,
+// Walks the data extents of a sparse source with SEEK_DATA/SEEK_HOLE and copies only those.
+// The destination was freshly created (O_TRUNC), so skipped ranges stay unallocated and the
+// final ftruncate() recreates a trailing hole.
+bool copy_sparse(int inFd,
+                 int outFd,
+                 std::uint64_t size,
+                 CopyMethod& tier,
                  ProgressInfo& progress,
                  const ProgressCallback& cb,
                  Error& err,
-                 int depth,
-                 bool preserveOwnership);
+                 blake3_hasher* hasher,
+                 DeviceProfiles* profiles) {
+    std::uint64_t pos = 0;
+    while (pos < size) {
+        const off_t data = ::lseek(inFd, static_cast<off_t>(pos), SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO) {
+                // Only a hole remains.
+                break;
+            }
+            if (errno == EINVAL || errno == ENOTSUP || errno == EOPNOTSUPP) {
+                // Filesystem cannot report extents; copy the rest densely.
+                return copy_range(inFd, outFd, pos, size, tier, progress, cb, err, hasher, profiles);
+            }
+            set_error(err, "lseek");
+            return false;
+        }
+        std::uint64_t dataStart = std::min<std::uint64_t>(static_cast<std::uint64_t>(data), size);
+        off_t hole = ::lseek(inFd, data, SEEK_HOLE);
+        std::uint64_t dataEnd = hole < 0 ? size : std::min<std::uint64_t>(static_cast<std::uint64_t>(hole), size);
 
-bool copy_entry_at(int srcDir,
-                   const char* srcName,
-                   int dstDir,
-                   const char* dstName,
-                   ProgressInfo& progress,
-                   const ProgressCallback& cb,
-                   Error& err,
-                   int depth,
-                   bool preserveOwnership) {
-    if (depth > kMaxRecursionDepth) {
-        err.code = ELOOP;
-        err.message = "Maximum recursion depth exceeded";
-        return false;
+        progress.bytesDone += dataStart - pos;  // skipped hole counts as done
+        if (hasher) {
+            hash_zeros(hasher, dataStart - pos);
+        }
+        // copy_range() fails rather than stop short of dataEnd, which the final ftruncate()
+        // would otherwise fill with zeros
+        if (dataEnd > dataStart &&
+            !copy_range(inFd, outFd, dataStart, dataEnd, tier, progress, cb, err, hasher, profiles)) {
+            return false;
+        }
+        pos = dataEnd;
+    }
+    progress.bytesDone += size - pos;
+    if (hasher) {
+        hash_zeros(hasher, size - pos);
     }
 
-    StatInfo info;
-    if (!stat_at(srcDir, srcName, /*follow=*/false, info, err)) {
+    if (::ftruncate(outFd, static_cast<off_t>(size)) < 0) {
+        set_error(err, "ftruncate");
         return false;
     }
+    return true;
+}
 
-    progress.currentPath = "";  // not tracking full path to avoid extra allocations
-    if (!should_continue(cb, progress)) {
-        err.code = ECANCELED;
-        err.message = "Cancelled";
-        return false;
+// O_DIRECT path for huge sequential copies. Offsets, lengths and buffers are aligned to
+// kDirectAlign, which satisfies the logical block size of practically every device; the tail
+// is written rounded up and trimmed with ftruncate().
+constexpr std::size_t kDirectAlign = 4096;
+constexpr std::size_t kDirectBuffer = 8 * 1024 * 1024;
+
+struct AlignedFree {
+    void operator()(std::uint8_t* p) const { std::free(p); }
+};
+using AlignedBuffer = std::unique_ptr<std::uint8_t, AlignedFree>;
+
+AlignedBuffer alloc_aligned(std::size_t size) {
+    void* p = nullptr;
+    if (::posix_memalign(&p, kDirectAlign, size) != 0) {
+        return AlignedBuffer();
     }
+    return AlignedBuffer(static_cast<std::uint8_t*>(p));
+}
 
-    if (S_ISDIR(info.st.st_mode)) {
-        return copy_dir_at(srcDir, srcName, dstDir, dstName, progress, cb, err, depth + 1, preserveOwnership);
+std::size_t align_up(std::size_t n) {
+    return (n + kDirectAlign - 1) & ~(kDirectAlign - 1);
+}
+
+// Reads up to |len| bytes at |pos|, retrying short reads until EOF. Returns -1 with errno set
+// on failure.
+ssize_t pread_full(int fd, std::uint8_t* buf, std::size_t len, std::uint64_t pos) {
+    std::size_t got = 0;
+    while (got < len) {
+        const ssize_t n = ::pread(fd, buf + got, len - got, static_cast<off_t>(pos + got));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        got += static_cast<std::size_t>(n);
+        if (got % kDirectAlign != 0) {
+            break;  // short unaligned read only happens at EOF
+        }
     }
-    if (S_ISREG(info.st.st_mode)) {
-        return copy_file_at(srcDir, srcName, dstDir, dstName, info, progress, cb, err, preserveOwnership);
+    return static_cast<ssize_t>(got);
+}
+
+int pwrite_full(int fd, const std::uint8_t* buf, std::size_t len, std::uint64_t pos) {
+    std::size_t done = 0;
+    while (done < len) {
+        const ssize_t w = ::pwrite(fd, buf + done, len - done, static_cast<off_t>(pos + done));
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        done += static_cast<std::size_t>(w);
     }
-    if (S_ISLNK(info.st.st_mode)) {
-        return copy_symlink_at(srcDir, srcName, dstDir, dstName, info, err, preserveOwnership);
+    return 0;
+}
+
+// Restores the status flags of a descriptor that was switched to O_DIRECT.
+class DirectMode {
+   public:
+    explicit DirectMode(int fd) : fd_(fd), flags_(::fcntl(fd, F_GETFL)) {
+        enabled_ = flags_ >= 0 && ::fcntl(fd_, F_SETFL, flags_ | O_DIRECT) == 0;
+    }
+    ~DirectMode() {
+        if (enabled_) {
+            ::fcntl(fd_, F_SETFL, flags_);
+        }
     }
+    DirectMode(const DirectMode&) = delete;
+    DirectMode& operator=(const DirectMode&) = delete;
 
-    // Unsupported special file types
-    err.code = ENOTSUP;
-    err.message = "Unsupported file type";
-    return false;
-}
+    bool enabled() const { return enabled_; }
 
-bool copy_dir_at(int srcDir,
-                 const char* srcName,
-                 int dstDir,
-                 const char* dstName,
+   private:
+    int fd_;
+    int flags_;
+    bool enabled_ = false;
+};
+
+// Copies [0, size) with O_DIRECT on both descriptors, reading the next buffer while a helper
+// thread writes the previous one. Returns false with |err| unset when O_DIRECT is not usable
+// here (the first aligned read or write was refused), in which case nothing was reported yet
+// and the caller falls back to the normal tiers.
+bool copy_direct(int inFd,
+                 int outFd,
+                 std::uint64_t size,
                  ProgressInfo& progress,
                  const ProgressCallback& cb,
                  Error& err,
-                 int depth,
-                 bool preserveOwnership) {
-    StatInfo info;
-    if (!stat_at(srcDir, srcName, /*follow=*/false, info, err)) {
+                 blake3_hasher* hasher) {
+    DirectMode inMode(inFd);
+    DirectMode outMode(outFd);
+    AlignedBuffer buffers[2] = {alloc_aligned(kDirectBuffer), alloc_aligned(kDirectBuffer)};
+    if (!inMode.enabled() || !outMode.enabled() || !buffers[0] || !buffers[1]) {
         return false;
     }
-    if (!S_ISDIR(info.st.st_mode)) {
-        err.code = ENOTDIR;
-        err.message = "Not a directory";
+
+    // The first chunk is copied synchronously as a probe, so a refused O_DIRECT is noticed
+    // before any byte is reported or hashed.
+    const std::size_t firstWant = static_cast<std::size_t>(std::min<std::uint64_t>(kDirectBuffer, align_up(size)));
+    const ssize_t first = pread_full(inFd, buffers[0].get(), firstWant, 0);
+    if (first < 0) {
+        if (errno == EINVAL) {
+            return false;
+        }
+        set_error(err, "read");
         return false;
     }
-
-    // Create dest dir
-    if (::mkdirat(dstDir, dstName, info.st.st_mode & 0777) < 0) {
-        if (errno != EEXIST) {
-            set_error(err, "mkdirat");
+    const std::size_t firstLen = static_cast<std::size_t>(first);
+    std::memset(buffers[0].get() + firstLen, 0, align_up(firstLen) - firstLen);
+    if (firstLen > 0) {
+        const int rc = pwrite_full(outFd, buffers[0].get(), align_up(firstLen), 0);
+        if (rc == EINVAL) {
+            return false;
+        }
+        if (rc != 0) {
+            errno = rc;
+            set_error(err, "write");
             return false;
         }
     }
 
-    // Open source and destination directories for recursion
-    Fd newSrc(::openat(srcDir, srcName, O_RDONLY | O_CLOEXEC | O_DIRECTORY));
-    if (!newSrc.valid()) {
-        set_error(err, "openat");
+    progress.copyMethod = CopyMethod::DirectIo;
+    if (hasher) {
+        blake3_hasher_update(hasher, buffers[0].get(), firstLen);
+    }
+    progress.bytesDone += firstLen;
+    if (!should_continue(cb, progress)) {
+        set_cancelled(err);
+        return false;
+    }
+
+    // One buffer is filled while the writer drains the other.
+    struct Slot {
+        std::size_t len = 0;
+        std::uint64_t pos = 0;
+        bool full = false;
+    };
+    Slot slots[2];
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool stop = false;
+    int writeError = 0;
+
+    std::thread writer([&] {
+        for (int i = 0;; i ^= 1) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return slots[i].full || stop; });
+            if (!slots[i].full) {
+                return;
+            }
+            const Slot slot = slots[i];
+            lock.unlock();
+            const int rc = pwrite_full(outFd, buffers[i].get(), align_up(slot.len), slot.pos);
+            lock.lock();
+            slots[i].full = false;
+            if (rc != 0) {
+                writeError = rc;
+            }
+            changed.notify_all();
+            if (rc != 0) {
+                return;
+            }
+        }
+    });
+
+    bool ok = true;
+    std::uint64_t pos = firstLen;
+    for (int i = 0; ok && pos < size && firstLen == firstWant; i ^= 1) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return !slots[i].full || writeError != 0; });
+            if (writeError != 0) {
+                break;
+            }
+        }
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(kDirectBuffer, align_up(size - pos)));
+        const ssize_t n = pread_full(inFd, buffers[i].get(), want, pos);
+        if (n < 0) {
+            set_error(err, "read");
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            break;  // source shrank underneath us
+        }
+        const std::size_t len = static_cast<std::size_t>(n);
+        std::memset(buffers[i].get() + len, 0, align_up(len) - len);
+        if (hasher) {
+            blake3_hasher_update(hasher, buffers[i].get(), len);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[i] = {len, pos, true};
+        }
+        changed.notify_all();
+
+        pos += len;
+        progress.bytesDone += len;
+        if (!should_continue(cb, progress)) {
+            set_cancelled(err);
+            ok = false;
+        }
+        if (len < want) {
+            break;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    if (ok && writeError != 0) {
+        errno = writeError;
+        set_error(err, "write");
+        ok = false;
+    }
+    if (!ok) {
+        return false;
+    }
+    // Drop the rounding of the last block.
+    if (::ftruncate(outFd, static_cast<off_t>(std::min(pos, size))) < 0) {
+        set_error(err, "ftruncate");
+        return false;
+    }
+    return true;
+}
+
+// Copies the body of an open regular file, trying reflink, copy_file_range, sendfile and
+// finally read()/write(). Sources with fewer allocated blocks than their size are copied
+// extent by extent so holes survive. The tier that completed the copy is left in
+// progress.copyMethod. A |hasher| receives the source bytes as they are copied, which rules
+// out the reflink and in-kernel tiers. Dense files of at least |directThreshold| bytes
+// (0 = never) go through copy_direct() when both filesystems accept O_DIRECT. |profiles| sizes
+// the chunks of the read/write tier.
+bool copy_file_data(int inFd,
+                    int outFd,
+                    const struct stat& st,
+                    ProgressInfo& progress,
+                    const ProgressCallback& cb,
+                    Error& err,
+                    blake3_hasher* hasher = nullptr,
+                    std::uint64_t directThreshold = 0,
+                    DeviceProfiles* profiles = nullptr) {
+    const std::uint64_t size = static_cast<std::uint64_t>(st.st_size);
+    if (size > 0 && !hasher && try_reflink(inFd, outFd, size, progress)) {
+        if (!should_continue(cb, progress)) {
+            set_cancelled(err);
+            return false;
+        }
+        return true;
+    }
+
+    CopyMethod tier = CopyMethod::CopyFileRange;
+    const bool sparse = size > 0 && static_cast<std::uint64_t>(st.st_blocks) * 512 < size;
+    if (sparse) {
+        return copy_sparse(inFd, outFd, size, tier, progress, cb, err, hasher, profiles);
+    }
+
+    if (directThreshold > 0 && size >= directThreshold) {
+        if (copy_direct(inFd, outFd, size, progress, cb, err, hasher)) {
+            return true;
+        }
+        if (err.isSet()) {
+            return false;
+        }
+        // No O_DIRECT here: stream through the cache but let the kernel drop it behind us.
+        ::posix_fadvise(inFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        ::posix_fadvise(inFd, 0, 0, POSIX_FADV_NOREUSE);
+        if (!copy_range(inFd, outFd, 0, size, tier, progress, cb, err, hasher, profiles)) {
+            return false;
+        }
+        ::posix_fadvise(inFd, 0, 0, POSIX_FADV_DONTNEED);
+        return true;
+    }
+
+    // Zero-sized files may still have content (procfs, sysfs); let read() find the end.
+    return copy_range(inFd, outFd, 0, size > 0 ? size : kToEof, tier, progress, cb, err, hasher, profiles);
+}
+
+// Delta copies (CopyOptions::deltaThreshold) compare blocks of this size, several at a time.
+constexpr std::size_t kDeltaBlock = 1024 * 1024;
+constexpr unsigned kDeltaWorkers = 4;
+
+// Makes the existing destination |outFd| equal to [0, size) of |inFd| by reading both sides
+// block by block on a few threads and writing only the blocks that differ, then cutting off
+// whatever the destination has past |size|. Both ends are read locally, so the blocks are
+// compared directly rather than through digests.
+bool copy_file_delta(int inFd,
+                     int outFd,
+                     std::uint64_t size,
+                     ProgressInfo& progress,
+                     const ProgressCallback& cb,
+                     Error& err) {
+    const std::uint64_t blocks = (size + kDeltaBlock - 1) / kDeltaBlock;
+    std::atomic<std::uint64_t> next{0};
+    std::atomic<bool> stop{false};
+    std::mutex mutex;  // guards progress, cb and err
+
+    progress.copyMethod = CopyMethod::Delta;
+    auto fail = [&](int code, const char* context) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!err.isSet()) {
+            errno = code;
+            set_error(err, context);
+        }
+        stop.store(true);
+    };
+    auto work = [&] {
+        std::vector<std::uint8_t> source(kDeltaBlock);
+        std::vector<std::uint8_t> target(kDeltaBlock);
+        while (!stop.load(std::memory_order_relaxed)) {
+            const std::uint64_t block = next.fetch_add(1, std::memory_order_relaxed);
+            if (block >= blocks) {
+                return;
+            }
+            const std::uint64_t pos = block * kDeltaBlock;
+            const std::size_t len = static_cast<std::size_t>(std::min<std::uint64_t>(kDeltaBlock, size - pos));
+            const ssize_t got = pread_full(inFd, source.data(), len, pos);
+            if (got != static_cast<ssize_t>(len)) {
+                fail(got < 0 ? errno : EIO, "pread");  // a short read means the source shrank
+                return;
+            }
+            const ssize_t have = pread_full(outFd, target.data(), len, pos);
+            if (have < 0) {
+                fail(errno, "pread");
+                return;
+            }
+            if (have != got || std::memcmp(source.data(), target.data(), len) != 0) {
+                if (const int code = pwrite_full(outFd, source.data(), len, pos)) {
+                    fail(code, "pwrite");
+                    return;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            progress.bytesDone += len;
+            if (!stop.load(std::memory_order_relaxed) && !should_continue(cb, progress)) {
+                set_cancelled(err);
+                stop.store(true);
+            }
+        }
+    };
+
+    const unsigned workers = static_cast<unsigned>(std::min<std::uint64_t>(kDeltaWorkers, blocks));
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < workers; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (err.isSet()) {
+        return false;
+    }
+    if (::ftruncate(outFd, static_cast<off_t>(size)) < 0) {
+        set_error(err, "ftruncate");
+        return false;
+    }
+    return true;
+}
+
+// Hashes [0, end) of |fd| with pread(); |end| may be kToEof. Checks the callback between
+// chunks so that re-reading a large file stays cancellable.
+bool hash_fd_range(int fd,
+                   std::uint64_t end,
+                   blake3_hasher& hasher,
+                   ProgressInfo& progress,
+                   const ProgressCallback& cb,
+                   Error& err) {
+    std::vector<std::uint8_t> buffer(128 * 1024);
+    std::uint64_t pos = 0;
+    while (pos < end) {
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), end - pos));
+        const ssize_t n = ::pread(fd, buffer.data(), want, static_cast<off_t>(pos));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error(err, "read");
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        blake3_hasher_update(&hasher, buffer.data(), static_cast<std::size_t>(n));
+        pos += static_cast<std::uint64_t>(n);
+        if (!should_continue(cb, progress)) {
+            set_cancelled(err);
+            return false;
+        }
+    }
+    if (end != kToEof && pos != end) {
+        err.code = EIO;
+        err.message = "Unexpected end of file";
+        return false;
+    }
+    return true;
+}
+
+// Re-reads a just-written destination and compares its BLAKE3 digest with |expected|. The
+// data is synced first and the cached pages are dropped, so the comparison sees what the
+// device returns rather than what is still in the page cache.
+bool verify_destination(int outFd,
+                        const std::uint8_t* expected,
+                        ProgressInfo& progress,
+                        const ProgressCallback& cb,
+                        Error& err) {
+    if (::fdatasync(outFd) < 0) {
+        set_error(err, "fdatasync");
+        return false;
+    }
+    ::posix_fadvise(outFd, 0, 0, POSIX_FADV_DONTNEED);
+
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    if (!hash_fd_range(outFd, kToEof, hasher, progress, cb, err)) {
+        return false;
+    }
+    ::posix_fadvise(outFd, 0, 0, POSIX_FADV_DONTNEED);
+
+    std::uint8_t actual[BLAKE3_OUT_LEN];
+    blake3_hasher_finalize(&hasher, actual, BLAKE3_OUT_LEN);
+    if (std::memcmp(actual, expected, BLAKE3_OUT_LEN) != 0) {
+        err.code = EIO;
+        err.message = "Verification failed: destination does not match source";
+        return false;
+    }
+    return true;
+}
+
+// Large files in a journaled copy (CopyOptions::journal) are copied in segments of this size;
+// after each one the data is synced and the offset is recorded with a digest of the prefix.
+constexpr std::uint64_t kJournalSegment = 64ull * 1024 * 1024;
+
+// Where one file of a journaled copy stands. |key| is the destination path; a non-zero
+// |resumeOffset| means an earlier run recorded [0, resumeOffset) with |digest|.
+struct JournalSlot {
+    CopyJournal* journal = nullptr;
+    std::string key;
+    std::uint64_t resumeOffset = 0;
+    std::uint8_t digest[BLAKE3_OUT_LEN] = {};
+};
+
+// Copies a large file segment by segment for a journaled copy. A recorded prefix is only
+// trusted after re-hashing the destination and matching the journal digest; otherwise the
+// file starts over. On return |hasher| holds the digest of the whole source.
+bool copy_file_journaled(int inFd,
+                         int outFd,
+                         const struct stat& st,
+                         const JournalSlot& slot,
+                         blake3_hasher& hasher,
+                         ProgressInfo& progress,
+                         const ProgressCallback& cb,
+                         Error& err) {
+    const std::uint64_t size = static_cast<std::uint64_t>(st.st_size);
+    std::uint64_t pos = 0;
+    if (slot.resumeOffset > 0 && slot.resumeOffset < size) {
+        if (!hash_fd_range(outFd, slot.resumeOffset, hasher, progress, cb, err)) {
+            return false;
+        }
+        std::uint8_t digest[BLAKE3_OUT_LEN];
+        blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+        if (std::memcmp(digest, slot.digest, BLAKE3_OUT_LEN) == 0) {
+            pos = slot.resumeOffset;
+            progress.bytesDone += pos;
+        }
+        else {
+            blake3_hasher_init(&hasher);
+        }
+    }
+    if (pos == 0 && ::ftruncate(outFd, 0) < 0) {
+        set_error(err, "ftruncate");
+        return false;
+    }
+
+    CopyMethod tier = CopyMethod::ReadWrite;
+    while (pos < size) {
+        const std::uint64_t end = std::min(size, pos + kJournalSegment);
+        if (!copy_range(inFd, outFd, pos, end, tier, progress, cb, err, &hasher)) {
+            return false;
+        }
+        pos = end;
+        if (pos == size) {
+            break;
+        }
+        if (::fdatasync(outFd) < 0) {
+            set_error(err, "fdatasync");
+            return false;
+        }
+        std::uint8_t digest[BLAKE3_OUT_LEN];
+        blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+        if (!slot.journal->recordPartial(slot.key, st, pos, digest, err)) {
+            return false;
+        }
+    }
+    if (::ftruncate(outFd, static_cast<off_t>(size)) < 0) {
+        set_error(err, "ftruncate");
+        return false;
+    }
+    return true;
+}
+
+struct StatInfo {
+    struct stat st{};
+};
+
+bool stat_at(int dirfd, const char* name, bool follow, StatInfo& out, Error& err) {
+    int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+    if (::fstatat(dirfd, name, &out.st, flags) < 0) {
+        set_error(err, "fstatat");
+        return false;
+    }
+    return true;
+}
+
+bool copy_symlink_at(int srcDir,
+                     const char* srcName,
+                     int dstDir,
+                     const char* dstName,
+                     const StatInfo& info,
+                     Error& err,
+                     bool preserveOwnership) {
+    std::vector<char> buf(static_cast<std::size_t>(info.st.st_size) + 1);
+    ssize_t len = ::readlinkat(srcDir, srcName, buf.data(), buf.size());
+    if (len < 0) {
+        set_error(err, "readlinkat");
+        return false;
+    }
+    buf[static_cast<std::size_t>(len)] = '\0';
+    if (::symlinkat(buf.data(), dstDir, dstName) < 0) {
+        set_error(err, "symlinkat");
+        return false;
+    }
+    // Preserve timestamps if possible
+    struct timespec times[2];
+    times[0] = info.st.st_atim;
+    times[1] = info.st.st_mtim;
+    ::utimensat(dstDir, dstName, times, AT_SYMLINK_NOFOLLOW);  // best effort
+    if (preserveOwnership) {
+        ::fchownat(dstDir, dstName, info.st.st_uid, info.st.st_gid, AT_SYMLINK_NOFOLLOW);  // best effort
+    }
+    return true;
+}
+
+class CopyScheduler;
+
+// State shared by one copy_path() call. |mutex| guards |progress| and calls into |cb| once a
+// scheduler or scanner is running, since workers report bytes while the walker and the
+// scanner keep counting totals.
+struct CopyContext {
+    ProgressInfo& progress;
+    const ProgressCallback& cb;
+    const CopyOptions& options;
+    CopyScheduler* scheduler = nullptr;
+    std::mutex mutex;
+
+    // bytesTotal = whatever the caller preset + the larger of what the walker has reached and
+    // what the look-ahead scanner has counted, so the total never double counts or shrinks.
+    std::uint64_t baseTotal = 0;
+    std::uint64_t walkedBytes = 0;
+    std::uint64_t scannedBytes = 0;
+    bool scanning = false;  // a TreeScanner is updating |progress|
+    // Path of the destination directory being filled; only tracked for a journaled copy,
+    // where it forms the journal key of each file.
+    std::string destDir;
+
+    CopyContext(ProgressInfo& p, const ProgressCallback& c, const CopyOptions& o)
+        : progress(p), cb(c), options(o), baseTotal(p.bytesTotal) {}
+
+    bool tick() {
+        std::lock_guard<std::mutex> lock(mutex);
+        progress.currentPath = "";  // not tracking full path to avoid extra allocations
+        return should_continue(cb, progress);
+    }
+
+    void addTotal(std::uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        walkedBytes += bytes;
+        progress.bytesTotal = baseTotal + std::max(walkedBytes, scannedBytes);
+    }
+
+    bool report(std::uint64_t delta, CopyMethod method) {
+        std::lock_guard<std::mutex> lock(mutex);
+        progress.bytesDone += delta;
+        progress.copyMethod = method;
+        return should_continue(cb, progress);
+    }
+
+    void addScanned(std::uint64_t bytes, bool complete) {
+        std::lock_guard<std::mutex> lock(mutex);
+        scannedBytes += bytes;
+        progress.bytesTotal = baseTotal + std::max(walkedBytes, scannedBytes);
+        progress.totalsEstimated = !complete;
+    }
+};
+
+// Look-ahead pass for CopyOptions::scanAhead: enumerates and stats the source tree on its own
+// thread and its own descriptors while the copy runs, publishing the byte total in batches.
+// It only produces an estimate, so errors just end the scan early; the walker reports real
+// failures when it reaches the same entries.
+class TreeScanner {
+   public:
+    TreeScanner(int parentFd, const std::string& name, CopyContext& ctx) : ctx_(ctx) {
+        {
+            std::lock_guard<std::mutex> lock(ctx_.mutex);
+            ctx_.progress.totalsEstimated = true;
+        }
+        Fd root(::openat(parentFd, name.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+        if (!root.valid()) {
+            ctx_.addScanned(0, /*complete=*/true);
+            return;
+        }
+        thread_ = std::thread([this, fd = root.fd] {
+            scan(fd, 0);
+            ctx_.addScanned(pending_, /*complete=*/!stop_.load());
+        });
+        root.fd = -1;  // owned by scan()
+    }
+
+    ~TreeScanner() {
+        stop_.store(true);
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        std::lock_guard<std::mutex> lock(ctx_.mutex);
+        ctx_.progress.totalsEstimated = false;
+    }
+
+    TreeScanner(const TreeScanner&) = delete;
+    TreeScanner& operator=(const TreeScanner&) = delete;
+
+   private:
+    static constexpr std::size_t kPublishEvery = 512;
+
+    // Takes ownership of |fd|.
+    void scan(int fd, int depth) {
+        Dir dir(::fdopendir(fd));
+        if (!dir.valid()) {
+            ::close(fd);
+            return;
+        }
+        while (!stop_.load()) {
+            dirent* ent = ::readdir(dir.dir);
+            if (!ent) {
+                return;
+            }
+            const char* child = ent->d_name;
+            if (std::strcmp(child, ".") == 0 || std::strcmp(child, "..") == 0) {
+                continue;
+            }
+            struct stat st{};
+            if (::fstatat(::dirfd(dir.dir), child, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                continue;
+            }
+            if (S_ISREG(st.st_mode)) {
+                pending_ += static_cast<std::uint64_t>(st.st_size);
+            }
+            if (++entries_ % kPublishEvery == 0) {
+                ctx_.addScanned(pending_, /*complete=*/false);
+                pending_ = 0;
+            }
+            if (S_ISDIR(st.st_mode) && depth < kMaxRecursionDepth) {
+                const int sub = ::openat(::dirfd(dir.dir), child, O_RDONLY | O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW);
+                if (sub >= 0) {
+                    scan(sub, depth + 1);
+                }
+            }
+        }
+    }
+
+    CopyContext& ctx_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    std::uint64_t pending_ = 0;
+    std::size_t entries_ = 0;
+};
+
+// Worker threads take the I/O class the caller asked for; errors only cost the priority.
+void apply_io_priority(IoPriority priority) {
+    if (priority != IoPriority::Default) {
+        Error ignored;
+        set_io_priority(priority, ignored);
+    }
+}
+
+// Charges every chunk reported through |cb| against |throttle| and sleeps off the debt in
+// short slices, so a cancel or a raised limit gets through while the copy is held back.
+// Reflinks move no data and only count as one request.
+ProgressCallback throttled_callback(IoThrottle& throttle, const ProgressCallback& cb, std::uint64_t bytesDone) {
+    return [&throttle, &cb, reported = bytesDone](const ProgressInfo& p) mutable {
+        std::uint64_t delta = p.bytesDone > reported ? p.bytesDone - reported : 0;
+        reported = p.bytesDone;
+        if (p.copyMethod == CopyMethod::Reflink) {
+            delta = 0;
+        }
+        constexpr auto kSlice = std::chrono::milliseconds(50);
+        auto wait = throttle.reserve(delta, 1);
+        while (wait > IoThrottle::Clock::duration::zero()) {
+            std::this_thread::sleep_for(std::min<IoThrottle::Clock::duration>(wait, kSlice));
+            if (!should_continue(cb, p)) {
+                return false;
+            }
+            // Asking again picks up limits changed while sleeping.
+            wait = throttle.reserve(0, 0);
+        }
+        return should_continue(cb, p);
+    };
+}
+
+// Whether an existing destination of |st| is updated in place by copy_file_delta() instead
+// of being truncated and rewritten. Verified and journaled copies keep their own paths.
+bool delta_eligible(const struct stat& st, const CopyOptions& options) {
+    return options.deltaThreshold > 0 && S_ISREG(st.st_mode) &&
+           static_cast<std::uint64_t>(st.st_size) >= options.deltaThreshold && !options.verify && !options.journal;
+}
+
+std::int64_t fstat_size(int fd) {
+    struct stat st{};
+    return ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? static_cast<std::int64_t>(st.st_size) : 0;
+}
+
+// Copies the body and metadata of an already opened source/destination pair.
+bool copy_file_body(int inFd,
+                    int outFd,
+                    const StatInfo& info,
+                    ProgressInfo& progress,
+                    const ProgressCallback& callback,
+                    Error& err,
+                    const CopyOptions& options,
+                    const JournalSlot& slot = {}) {
+    ProgressCallback throttled;
+    if (options.throttle) {
+        throttled = throttled_callback(*options.throttle, callback, progress.bytesDone);
+    }
+    const ProgressCallback& cb = options.throttle ? throttled : callback;
+
+    const std::uint64_t size = static_cast<std::uint64_t>(info.st.st_size);
+    const bool segmented = slot.journal && size >= 2 * kJournalSegment &&
+                           static_cast<std::uint64_t>(info.st.st_blocks) * 512 >= size;
+
+    blake3_hasher hasher;
+    if (options.verify || segmented) {
+        blake3_hasher_init(&hasher);
+    }
+    if (segmented) {
+        if (!copy_file_journaled(inFd, outFd, info.st, slot, hasher, progress, cb, err)) {
+            return false;
+        }
+    }
+    else if (delta_eligible(info.st, options) && fstat_size(outFd) > 0) {
+        // An existing destination was opened without truncating it (see copy_file_at). A
+        // reflink still beats rewriting blocks where the filesystem offers one.
+        if (try_reflink(inFd, outFd, size, progress)) {
+            if (::ftruncate(outFd, static_cast<off_t>(size)) < 0) {
+                set_error(err, "ftruncate");
+                return false;
+            }
+        }
+        else if (!copy_file_delta(inFd, outFd, size, progress, cb, err)) {
+            return false;
+        }
+    }
+    else if (!copy_file_data(inFd, outFd, info.st, progress, cb, err, options.verify ? &hasher : nullptr,
+                             options.directIoThreshold, options.profiles)) {
+        return false;
+    }
+    if (options.verify) {
+        std::uint8_t expected[BLAKE3_OUT_LEN];
+        blake3_hasher_finalize(&hasher, expected, BLAKE3_OUT_LEN);
+        if (!verify_destination(outFd, expected, progress, cb, err)) {
+            return false;
+        }
+    }
+
+    struct timespec times[2];
+    times[0] = info.st.st_atim;
+    times[1] = info.st.st_mtim;
+    ::futimens(outFd, times);  // best effort; ignore errors
+
+    if (options.preserveOwnership) {
+        ::fchown(outFd, info.st.st_uid, info.st.st_gid);  // best effort
+    }
+    ::fchmod(outFd, info.st.st_mode & 07777);  // best effort to match source mode, ignore umask
+
+    if (options.durability == Durability::PerFile && ::fsync(outFd) < 0) {
+        set_error(err, "fsync");
+        return false;
+    }
+
+    if (slot.journal) {
+        // The journal may only claim what is already on disk.
+        if (options.durability != Durability::PerFile && ::fdatasync(outFd) < 0) {
+            set_error(err, "fdatasync");
+            return false;
+        }
+        return slot.journal->recordDone(slot.key, info.st, err);
+    }
+    return true;
+}
+
+// Bounded pool that copies file bodies while the walker keeps creating the tree in order.
+// The walker opens both ends of every file itself, so the namespace is built exactly as in
+// the serial path; only data transfer and per-file metadata run on the workers.
+class CopyScheduler {
+   public:
+    struct Job {
+        Fd in;
+        Fd out;
+        StatInfo info;
+        JournalSlot journal;
+    };
+
+    CopyScheduler(unsigned workers, CopyContext& ctx) : ctx_(ctx), capacity_(workers * 4) {
+        threads_.reserve(workers);
+        for (unsigned i = 0; i < workers; ++i) {
+            threads_.emplace_back([this] {
+                apply_io_priority(ctx_.options.ioPriority);
+                run();
+            });
+        }
+    }
+
+    ~CopyScheduler() {
+        Error ignored;
+        finish(/*abort=*/true, ignored);
+    }
+
+    CopyScheduler(const CopyScheduler&) = delete;
+    CopyScheduler& operator=(const CopyScheduler&) = delete;
+
+    // Queues one file body, blocking while the queue is full. Returns false once any job has
+    // failed or the callback asked to cancel; the caller should stop walking.
+    bool submit(Job job) {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        notFull_.wait(lock, [this] { return queue_.size() < capacity_ || failed_.load(); });
+        if (failed_.load()) {
+            return false;
+        }
+        queue_.push_back(std::move(job));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Drains (or, with |abort|, discards) the queue and joins the workers. Returns false and
+    // the first error seen by any worker if one failed.
+    bool finish(bool abort, Error& err) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (abort) {
+                failed_.store(true);
+                queue_.clear();
+            }
+            stopping_ = true;
+        }
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+        for (auto& t : threads_) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+        threads_.clear();
+
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        if (firstError_.isSet()) {
+            err = firstError_;
+            return false;
+        }
+        return !failed_.load();
+    }
+
+    bool failed() const { return failed_.load(); }
+
+   private:
+    void run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex_);
+                notEmpty_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+                if (queue_.empty()) {
+                    return;
+                }
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            notFull_.notify_one();
+
+            if (failed_.load()) {
+                continue;
+            }
+
+            ProgressInfo local;
+            std::uint64_t reported = 0;
+            const ProgressCallback forward = [this, &reported](const ProgressInfo& p) {
+                const std::uint64_t delta = p.bytesDone - reported;
+                reported = p.bytesDone;
+                return report(delta, p.copyMethod);
+            };
+
+            Error err;
+            if (!copy_file_body(job.in.fd, job.out.fd, job.info, local, forward, err, ctx_.options, job.journal)) {
+                fail(err);
+            }
+        }
+    }
+
+    bool report(std::uint64_t delta, CopyMethod method) {
+        std::lock_guard<std::mutex> lock(ctx_.mutex);
+        ctx_.progress.bytesDone += delta;
+        ctx_.progress.copyMethod = method;
+        if (failed_.load()) {
+            return false;
+        }
+        return should_continue(ctx_.cb, ctx_.progress);
+    }
+
+    void fail(const Error& err) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            if (!firstError_.isSet()) {
+                firstError_ = err;
+            }
+            failed_.store(true);
+        }
+        notFull_.notify_all();
+    }
+
+    CopyContext& ctx_;
+    const std::size_t capacity_;
+    std::vector<std::thread> threads_;
+    std::deque<Job> queue_;
+    std::mutex queueMutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::atomic<bool> failed_{false};
+    bool stopping_ = false;
+    Error firstError_;
+};
+
+// Makes |dstName| in |dstDir| a writable snapshot of the directory |srcName| in |srcDir|, of
+// stat |st|, if that is the root of a btrfs subvolume. A subvolume holding others is declined,
+// as they would be empty directories in the snapshot. False when the directory is not one or
+// the kernel refuses, for the caller to copy the tree instead.
+bool snapshot_dir_at(int srcDir, const char* srcName, const struct stat& st, int dstDir, const char* dstName) {
+#if defined(__linux__) && defined(BTRFS_IOC_SNAP_CREATE_V2) && defined(BTRFS_IOC_GET_SUBVOL_ROOTREF)
+    // the inode of the root directory of every subvolume (BTRFS_FIRST_FREE_OBJECTID)
+    constexpr ino_t kSubvolumeRootInode = 256;
+    if (st.st_ino != kSubvolumeRootInode || std::strlen(dstName) > BTRFS_SUBVOL_NAME_MAX) {
+        return false;
+    }
+    Fd src(::openat(srcDir, srcName, O_RDONLY | O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+    struct statfs fs{};
+    if (!src.valid() || ::fstatfs(src.fd, &fs) != 0 || fs.f_type != BTRFS_SUPER_MAGIC) {
+        return false;
+    }
+    btrfs_ioctl_get_subvol_rootref_args refs{};
+    if (::ioctl(src.fd, BTRFS_IOC_GET_SUBVOL_ROOTREF, &refs) != 0 || refs.num_items > 0) {
+        return false;
+    }
+    btrfs_ioctl_vol_args_v2 args{};
+    args.fd = src.fd;
+    std::memcpy(args.name, dstName, std::strlen(dstName));
+    // fails with EXDEV to another filesystem and EEXIST onto an existing destination
+    return ::ioctl(dstDir, BTRFS_IOC_SNAP_CREATE_V2, &args) == 0;
+#else
+    (void)srcDir;
+    (void)srcName;
+    (void)st;
+    (void)dstDir;
+    (void)dstName;
+    return false;
+#endif
+}
+
+unsigned resolve_worker_count(unsigned requested) {
+    if (requested != 0) {
+        return requested;
+    }
+    const unsigned hw = std::thread::hardware_concurrency();
+    return std::clamp(hw, 1u, 8u);
+}
+
+bool copy_file_at(int srcDir,
+                  const char* srcName,
+                  int dstDir,
+                  const char* dstName,
+                  const StatInfo& info,
+                  CopyContext& ctx,
+                  Error& err) {
+    ctx.addTotal(static_cast<std::uint64_t>(info.st.st_size));
+
+    JournalSlot slot;
+    int create = O_CREAT | O_TRUNC;
+    if (CopyJournal* journal = ctx.options.journal) {
+        slot.journal = journal;
+        slot.key = ctx.destDir + "/" + dstName;
+        CopyJournal::Entry entry;
+        struct stat dst{};
+        if (journal->find(slot.key, info.st, entry) && ::fstatat(dstDir, dstName, &dst, AT_SYMLINK_NOFOLLOW) == 0 &&
+            S_ISREG(dst.st_mode)) {
+            if (entry.state == CopyJournal::State::Done && dst.st_size == info.st.st_size &&
+                dst.st_mtim.tv_sec == info.st.st_mtim.tv_sec && dst.st_mtim.tv_nsec == info.st.st_mtim.tv_nsec) {
+                // Finished by an earlier run.
+                if (!ctx.report(static_cast<std::uint64_t>(info.st.st_size), CopyMethod::None)) {
+                    set_cancelled(err);
+                    return false;
+                }
+                return true;
+            }
+            if (entry.state == CopyJournal::State::Partial &&
+                static_cast<std::uint64_t>(dst.st_size) >= entry.offset) {
+                slot.resumeOffset = entry.offset;
+                std::memcpy(slot.digest, entry.digest, sizeof(slot.digest));
+                create = O_CREAT;
+            }
+        }
+    }
+
+    Fd in_fd(::openat(srcDir, srcName, O_RDONLY | O_CLOEXEC));
+    if (!in_fd.valid()) {
+        set_error(err, "openat");
+        return false;
+    }
+
+    if (delta_eligible(info.st, ctx.options)) {
+        // A delta copy reads the old content back and rewrites only what changed.
+        create = O_CREAT;
+    }
+
+    // Verification, resuming and delta copies re-read the destination through the same descriptor.
+    const int access =
+        ctx.options.verify || slot.resumeOffset > 0 || delta_eligible(info.st, ctx.options) ? O_RDWR : O_WRONLY;
+    Fd out_fd(::openat(dstDir, dstName, access | create | O_CLOEXEC, info.st.st_mode & 0777));
+    if (!out_fd.valid()) {
+        set_error(err, "openat");
+        return false;
+    }
+
+    if (ctx.scheduler) {
+        if (!ctx.scheduler->submit({std::move(in_fd), std::move(out_fd), info, std::move(slot)})) {
+            err.code = ECANCELED;
+            err.message = "Cancelled";
+            return false;
+        }
+        return true;
+    }
+
+    if (ctx.scanning) {
+        // The scanner updates the totals concurrently, so bytes go through the locked path.
+        ProgressInfo local;
+        std::uint64_t reported = 0;
+        const ProgressCallback forward = [&ctx, &reported](const ProgressInfo& p) {
+            const std::uint64_t delta = p.bytesDone - reported;
+            reported = p.bytesDone;
+            return ctx.report(delta, p.copyMethod);
+        };
+        return copy_file_body(in_fd.fd, out_fd.fd, info, local, forward, err, ctx.options, slot);
+    }
+
+    return copy_file_body(in_fd.fd, out_fd.fd, info, ctx.progress, ctx.cb, err, ctx.options, slot);
+}
+
+// Keeps CopyContext::destDir in step with the walk for journaled copies.
+class DestDirScope {
+   public:
+    DestDirScope(CopyContext& ctx, const char* name) : ctx_(ctx), size_(ctx.destDir.size()) {
+        if (ctx_.options.journal) {
+            ctx_.destDir.append("/").append(name);
+        }
+    }
+    ~DestDirScope() { ctx_.destDir.resize(size_); }
+
+    DestDirScope(const DestDirScope&) = delete;
+    DestDirScope& operator=(const DestDirScope&) = delete;
+
+   private:
+    CopyContext& ctx_;
+    const std::size_t size_;
+};
+
+bool copy_dir_at(int srcDir,
+                 const char* srcName,
+                 int dstDir,
+                 const char* dstName,
+                 CopyContext& ctx,
+                 Error& err,
+                 int depth);
+
+bool copy_entry_at(int srcDir,
+                   const char* srcName,
+                   int dstDir,
+                   const char* dstName,
+                   CopyContext& ctx,
+                   Error& err,
+                   int depth) {
+    if (depth > kMaxRecursionDepth) {
+        err.code = ELOOP;
+        err.message = "Maximum recursion depth exceeded";
+        return false;
+    }
+
+    StatInfo info;
+    if (!stat_at(srcDir, srcName, /*follow=*/false, info, err)) {
+        return false;
+    }
+
+    if (!ctx.tick() || (ctx.scheduler && ctx.scheduler->failed())) {
+        err.code = ECANCELED;
+        err.message = "Cancelled";
+        return false;
+    }
+
+    if (S_ISDIR(info.st.st_mode)) {
+        return copy_dir_at(srcDir, srcName, dstDir, dstName, ctx, err, depth + 1);
+    }
+    if (S_ISREG(info.st.st_mode)) {
+        return copy_file_at(srcDir, srcName, dstDir, dstName, info, ctx, err);
+    }
+    if (S_ISLNK(info.st.st_mode)) {
+        return copy_symlink_at(srcDir, srcName, dstDir, dstName, info, err, ctx.options.preserveOwnership);
+    }
+
+    // Unsupported special file types
+    err.code = ENOTSUP;
+    err.message = "Unsupported file type";
+    return false;
+}
+
+bool copy_dir_at(int srcDir,
+                 const char* srcName,
+                 int dstDir,
+                 const char* dstName,
+                 CopyContext& ctx,
+                 Error& err,
+                 int depth) {
+    StatInfo info;
+    if (!stat_at(srcDir, srcName, /*follow=*/false, info, err)) {
+        return false;
+    }
+    if (!S_ISDIR(info.st.st_mode)) {
+        err.code = ENOTDIR;
+        err.message = "Not a directory";
+        return false;
+    }
+
+    // Create dest dir
+    if (::mkdirat(dstDir, dstName, info.st.st_mode & 0777) < 0) {
+        if (errno != EEXIST) {
+            set_error(err, "mkdirat");
+            return false;
+        }
+    }
+
+    // Open source and destination directories for recursion
+    Fd newSrc(::openat(srcDir, srcName, O_RDONLY | O_CLOEXEC | O_DIRECTORY));
+    if (!newSrc.valid()) {
+        set_error(err, "openat");
         return false;
     }
     Fd newDst(::openat(dstDir, dstName, O_RDONLY | O_CLOEXEC | O_DIRECTORY));
@@ -397,6 +1809,7 @@ bool copy_dir_at(int srcDir,
     // fd now owned by DIR; prevent double close
     newSrc.fd = -1;
 
+    DestDirScope scope(ctx, dstName);
     for (;;) {
         errno = 0;
         dirent* ent = ::readdir(dir.dir);
@@ -412,7 +1825,7 @@ bool copy_dir_at(int srcDir,
             continue;
         }
 
-        if (!copy_entry_at(dirfd(dir.dir), child, newDst.fd, child, progress, cb, err, depth + 1, preserveOwnership)) {
+        if (!copy_entry_at(dirfd(dir.dir), child, newDst.fd, child, ctx, err, depth + 1)) {
             return false;
         }
     }
@@ -422,7 +1835,7 @@ bool copy_dir_at(int srcDir,
     times[0] = info.st.st_atim;
     times[1] = info.st.st_mtim;
     ::utimensat(dstDir, dstName, times, 0);
-    if (preserveOwnership) {
+    if (ctx.options.preserveOwnership) {
         ::fchownat(dstDir, dstName, info.st.st_uid, info.st.st_gid, AT_SYMLINK_NOFOLLOW);
     }
     ::fchmodat(dstDir, dstName, info.st.st_mode & 07777, AT_SYMLINK_NOFOLLOW);
@@ -430,38 +1843,408 @@ bool copy_dir_at(int srcDir,
     return true;
 }
 
-bool delete_at(int dirfd, const char* name, ProgressInfo& progress, const ProgressCallback& cb, Error& err, int depth) {
-    if (depth > kMaxRecursionDepth) {
-        err.code = ELOOP;
-        err.message = "Maximum recursion depth exceeded";
-        return false;
+// Streaming cross-device move (CopyOptions::streamingMove). Each source entry is removed as
+// soon as its copy is durable instead of after the whole tree was copied, so peak extra space
+// is one batch of files rather than the whole tree. Removals are batched per directory: the
+// copied files are already fsync'ed, one fsync() of the destination directory then makes
+// their names durable, and only after that are the sources unlinked. Directories go
+// bottom-up once they are empty.
+constexpr std::size_t kMoveBatchFiles = 64;
+constexpr std::uint64_t kMoveBatchBytes = 64ull * 1024 * 1024;
+
+struct MovePending {
+    std::vector<std::pair<std::string, int>> names;  // name, unlinkat() flags
+    std::uint64_t bytes = 0;
+};
+
+bool flush_move_batch(int srcDir, int dstDir, MovePending& pending, Error& err) {
+    if (pending.names.empty()) {
+        return true;
+    }
+    if (::fsync(dstDir) < 0) {
+        set_error(err, "fsync");
+        return false;
+    }
+    for (const auto& [name, flags] : pending.names) {
+        if (::unlinkat(srcDir, name.c_str(), flags) < 0) {
+            set_error(err, "unlinkat");
+            return false;
+        }
+    }
+    pending.names.clear();
+    pending.bytes = 0;
+    return true;
+}
+
+bool move_dir_streaming(int srcDir,
+                        const char* srcName,
+                        int dstDir,
+                        const char* dstName,
+                        CopyContext& ctx,
+                        Error& err,
+                        int depth) {
+    if (depth > kMaxRecursionDepth) {
+        err.code = ELOOP;
+        err.message = "Maximum recursion depth exceeded";
+        return false;
+    }
+
+    StatInfo info;
+    if (!stat_at(srcDir, srcName, /*follow=*/false, info, err)) {
+        return false;
+    }
+    // An interrupted move may already have created the directory.
+    if (::mkdirat(dstDir, dstName, info.st.st_mode & 0777) < 0 && errno != EEXIST) {
+        set_error(err, "mkdirat");
+        return false;
+    }
+
+    Fd src(::openat(srcDir, srcName, O_RDONLY | O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+    if (!src.valid()) {
+        set_error(err, "openat");
+        return false;
+    }
+    Fd dst(::openat(dstDir, dstName, O_RDONLY | O_CLOEXEC | O_DIRECTORY));
+    if (!dst.valid()) {
+        set_error(err, "openat");
+        return false;
+    }
+    Fd scan(::fcntl(src.fd, F_DUPFD_CLOEXEC, 0));
+    Dir dir(scan.valid() ? ::fdopendir(scan.fd) : nullptr);
+    if (!dir.valid()) {
+        set_error(err, "fdopendir");
+        return false;
+    }
+    scan.fd = -1;
+
+    MovePending pending;
+    DestDirScope scope(ctx, dstName);
+    for (;;) {
+        errno = 0;
+        dirent* ent = ::readdir(dir.dir);
+        if (!ent) {
+            if (errno != 0) {
+                set_error(err, "readdir");
+                return false;
+            }
+            break;
+        }
+        const char* child = ent->d_name;
+        if (std::strcmp(child, ".") == 0 || std::strcmp(child, "..") == 0) {
+            continue;
+        }
+
+        StatInfo childInfo;
+        if (!stat_at(src.fd, child, /*follow=*/false, childInfo, err)) {
+            return false;
+        }
+        if (!ctx.tick()) {
+            set_cancelled(err);
+            return false;
+        }
+
+        if (S_ISDIR(childInfo.st.st_mode)) {
+            if (!move_dir_streaming(src.fd, child, dst.fd, child, ctx, err, depth + 1)) {
+                return false;
+            }
+            pending.names.emplace_back(child, AT_REMOVEDIR);
+        }
+        else if (S_ISREG(childInfo.st.st_mode)) {
+            if (!copy_file_at(src.fd, child, dst.fd, child, childInfo, ctx, err)) {
+                return false;
+            }
+            pending.names.emplace_back(child, 0);
+            pending.bytes += static_cast<std::uint64_t>(childInfo.st.st_size);
+        }
+        else if (S_ISLNK(childInfo.st.st_mode)) {
+            // A resumed move may find the link already in place.
+            ::unlinkat(dst.fd, child, 0);
+            if (!copy_symlink_at(src.fd, child, dst.fd, child, childInfo, err, ctx.options.preserveOwnership)) {
+                return false;
+            }
+            pending.names.emplace_back(child, 0);
+        }
+        else {
+            err.code = ENOTSUP;
+            err.message = "Unsupported file type";
+            return false;
+        }
+
+        if ((pending.names.size() >= kMoveBatchFiles || pending.bytes >= kMoveBatchBytes) &&
+            !flush_move_batch(src.fd, dst.fd, pending, err)) {
+            return false;
+        }
+    }
+    if (!flush_move_batch(src.fd, dst.fd, pending, err)) {
+        return false;
+    }
+
+    struct timespec times[2];
+    times[0] = info.st.st_atim;
+    times[1] = info.st.st_mtim;
+    ::futimens(dst.fd, times);
+    if (ctx.options.preserveOwnership) {
+        ::fchown(dst.fd, info.st.st_uid, info.st.st_gid);
+    }
+    ::fchmod(dst.fd, info.st.st_mode & 07777);
+    return true;
+}
+
+// Marker written next to the destination while a streaming move runs. It names the source
+// so an interrupted move can be recognised and resumed by running the same move again.
+std::string move_journal_path(const std::string& destination) {
+    const auto pos = destination.find_last_of('/');
+    const std::string parent = pos == std::string::npos ? std::string() : destination.substr(0, pos + 1);
+    const std::string name = pos == std::string::npos ? destination : destination.substr(pos + 1);
+    return parent + "." + name + ".pcmanfm-move";
+}
+
+constexpr char kMoveJournalHeader[] = "pcmanfm-qt move journal 1\n";
+
+constexpr std::size_t kUnlinkBatchSize = 256;
+
+// Unlinks every name in |names| relative to dirfd through one io_uring batch, falling back to
+// unlinkat() per entry when no ring is available. Clears |names| on success.
+bool unlink_names(int dirfd, std::vector<std::string>& names, Error& err) {
+    std::vector<int> results;
+    const int rc = IoUring::unlink_batch(dirfd, names, 0, results);
+    if (rc == ENOSYS) {
+        for (const auto& name : names) {
+            if (::unlinkat(dirfd, name.c_str(), 0) < 0) {
+                set_error(err, "unlinkat");
+                return false;
+            }
+        }
+        names.clear();
+        return true;
+    }
+    if (rc != 0) {
+        errno = rc;
+        set_error(err, "io_uring");
+        return false;
+    }
+    for (int result : results) {
+        if (result != 0) {
+            errno = result;
+            set_error(err, "unlinkat");
+            return false;
+        }
+    }
+    names.clear();
+    return true;
+}
+
+bool delete_at(int dirfd, const char* name, ProgressInfo& progress, const ProgressCallback& cb, Error& err, int depth) {
+    if (depth > kMaxRecursionDepth) {
+        err.code = ELOOP;
+        err.message = "Maximum recursion depth exceeded";
+        return false;
+    }
+
+    StatInfo info;
+    if (!stat_at(dirfd, name, /*follow=*/false, info, err)) {
+        return false;
+    }
+
+    progress.currentPath = "";
+    if (!should_continue(cb, progress)) {
+        err.code = ECANCELED;
+        err.message = "Cancelled";
+        return false;
+    }
+
+    if (S_ISDIR(info.st.st_mode)) {
+        Fd sub(::openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_DIRECTORY));
+        if (!sub.valid()) {
+            set_error(err, "openat");
+            return false;
+        }
+        Dir dir(::fdopendir(sub.fd));
+        if (!dir.valid()) {
+            set_error(err, "fdopendir");
+            return false;
+        }
+        sub.fd = -1;
+
+        // With io_uring, plain entries whose type readdir already reported are unlinked in
+        // batches; directories and unknown types still go through the recursive path.
+        const bool batched = use_io_uring();
+        std::vector<std::string> batch;
+        for (;;) {
+            errno = 0;
+            dirent* ent = ::readdir(dir.dir);
+            if (!ent) {
+                if (errno != 0) {
+                    set_error(err, "readdir");
+                    return false;
+                }
+                break;
+            }
+            const char* child = ent->d_name;
+            if (!child || child[0] == '\0' || std::strcmp(child, ".") == 0 || std::strcmp(child, "..") == 0) {
+                continue;
+            }
+            if (batched && ent->d_type != DT_UNKNOWN && ent->d_type != DT_DIR) {
+                if (!should_continue(cb, progress)) {
+                    err.code = ECANCELED;
+                    err.message = "Cancelled";
+                    return false;
+                }
+                batch.emplace_back(child);
+                if (batch.size() >= kUnlinkBatchSize && !unlink_names(::dirfd(dir.dir), batch, err)) {
+                    return false;
+                }
+                continue;
+            }
+            if (!delete_at(::dirfd(dir.dir), child, progress, cb, err, depth + 1)) {
+                return false;
+            }
+        }
+        if (!batch.empty() && !unlink_names(::dirfd(dir.dir), batch, err)) {
+            return false;
+        }
+
+        if (::unlinkat(dirfd, name, AT_REMOVEDIR) < 0) {
+            set_error(err, "unlinkat");
+            return false;
+        }
+    }
+    else {
+        if (::unlinkat(dirfd, name, 0) < 0) {
+            set_error(err, "unlinkat");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Deletes a directory tree with sibling subdirectories fanned out to worker threads. Every
+// queued directory holds its own dirfd; a directory is removed once its own entries and all
+// of its queued children are gone, so rmdir always runs after the children finish. When the
+// queue is full a worker deletes the subtree inline instead, which keeps the number of open
+// descriptors bounded on very wide trees.
+class DeleteScheduler {
+   public:
+    DeleteScheduler(unsigned workers,
+                    int rootParentFd,
+                    ProgressInfo& progress,
+                    const ProgressCallback& cb,
+                    IoPriority priority)
+        : rootParentFd_(rootParentFd), progress_(progress), cb_(cb), capacity_(workers * 8) {
+        threads_.reserve(workers);
+        for (unsigned i = 0; i < workers; ++i) {
+            threads_.emplace_back([this, priority] {
+                apply_io_priority(priority);
+                run();
+            });
+        }
+    }
+
+    ~DeleteScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            done_ = true;
+        }
+        notEmpty_.notify_all();
+        for (auto& t : threads_) {
+            if (t.joinable()) {
+                t.join();
+            }
+        }
+    }
+
+    DeleteScheduler(const DeleteScheduler&) = delete;
+    DeleteScheduler& operator=(const DeleteScheduler&) = delete;
+
+    // Removes |name| (a directory already opened as |fd|) below the root parent and blocks
+    // until the whole tree is gone or a worker failed.
+    bool run_root(Fd fd, const char* name, Error& err) {
+        auto* root = new Node;
+        root->fd = std::move(fd);
+        root->name = name;
+        enqueue(root);
+
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        finished_.wait(lock, [this] { return done_; });
+        if (firstError_.isSet()) {
+            err = firstError_;
+            return false;
+        }
+        return true;
+    }
+
+   private:
+    struct Node {
+        Fd fd;
+        Node* parent = nullptr;
+        std::string name;
+        int depth = 0;
+        // One reference for the node's own scan plus one per queued child directory.
+        std::atomic<int> pending{1};
+    };
+
+    void enqueue(Node* node) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            queue_.push_back(node);
+        }
+        notEmpty_.notify_one();
+    }
+
+    bool has_room() {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        return queue_.size() < capacity_;
     }
 
-    StatInfo info;
-    if (!stat_at(dirfd, name, /*follow=*/false, info, err)) {
-        return false;
+    void run() {
+        for (;;) {
+            Node* node = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex_);
+                notEmpty_.wait(lock, [this] { return !queue_.empty() || done_; });
+                if (queue_.empty()) {
+                    return;
+                }
+                node = queue_.front();
+                queue_.pop_front();
+            }
+            if (!failed_.load()) {
+                Error err;
+                if (!scan(node, err)) {
+                    fail(err);
+                }
+            }
+            release(node);
+        }
     }
 
-    progress.currentPath = "";
-    if (!should_continue(cb, progress)) {
-        err.code = ECANCELED;
-        err.message = "Cancelled";
-        return false;
+    // Serialized view of the shared progress for callbacks made from any worker.
+    bool tick() {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        progress_.currentPath = "";
+        if (failed_.load()) {
+            return false;
+        }
+        return should_continue(cb_, progress_);
     }
 
-    if (S_ISDIR(info.st.st_mode)) {
-        Fd sub(::openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_DIRECTORY));
-        if (!sub.valid()) {
-            set_error(err, "openat");
+    bool scan(Node* node, Error& err) {
+        Fd dup(::fcntl(node->fd.fd, F_DUPFD_CLOEXEC, 0));
+        if (!dup.valid()) {
+            set_error(err, "fcntl");
             return false;
         }
-        Dir dir(::fdopendir(sub.fd));
+        Dir dir(::fdopendir(dup.fd));
         if (!dir.valid()) {
             set_error(err, "fdopendir");
             return false;
         }
-        sub.fd = -1;
+        dup.fd = -1;
 
+        const ProgressCallback forward = [this](const ProgressInfo&) { return tick(); };
+        ProgressInfo unused;
+        const bool batched = use_io_uring();
+        std::vector<std::string> batch;
         for (;;) {
             errno = 0;
             dirent* ent = ::readdir(dir.dir);
@@ -476,31 +2259,221 @@ bool delete_at(int dirfd, const char* name, ProgressInfo& progress, const Progre
             if (!child || child[0] == '\0' || std::strcmp(child, ".") == 0 || std::strcmp(child, "..") == 0) {
                 continue;
             }
-            if (!delete_at(::dirfd(dir.dir), child, progress, cb, err, depth + 1)) {
+            if (!tick()) {
+                set_cancelled(err);
                 return false;
             }
-        }
 
-        if (::unlinkat(dirfd, name, AT_REMOVEDIR) < 0) {
-            set_error(err, "unlinkat");
+            unsigned char type = ent->d_type;
+            if (type == DT_UNKNOWN) {
+                StatInfo info;
+                if (!stat_at(node->fd.fd, child, /*follow=*/false, info, err)) {
+                    return false;
+                }
+                type = S_ISDIR(info.st.st_mode) ? DT_DIR : DT_REG;
+            }
+
+            if (type != DT_DIR) {
+                if (batched) {
+                    batch.emplace_back(child);
+                    if (batch.size() >= kUnlinkBatchSize && !unlink_names(node->fd.fd, batch, err)) {
+                        return false;
+                    }
+                }
+                else if (::unlinkat(node->fd.fd, child, 0) < 0) {
+                    set_error(err, "unlinkat");
+                    return false;
+                }
+                continue;
+            }
+
+            if (node->depth + 1 > kMaxRecursionDepth) {
+                err.code = ELOOP;
+                err.message = "Maximum recursion depth exceeded";
+                return false;
+            }
+            if (!has_room()) {
+                if (!delete_at(node->fd.fd, child, unused, forward, err, node->depth + 1)) {
+                    return false;
+                }
+                continue;
+            }
+
+            Fd sub(::openat(node->fd.fd, child, O_RDONLY | O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+            if (!sub.valid()) {
+                set_error(err, "openat");
+                return false;
+            }
+            auto* next = new Node;
+            next->fd = std::move(sub);
+            next->parent = node;
+            next->name = child;
+            next->depth = node->depth + 1;
+            node->pending.fetch_add(1);
+            enqueue(next);
+        }
+        if (!batch.empty() && !unlink_names(node->fd.fd, batch, err)) {
             return false;
         }
+        return true;
     }
-    else {
-        if (::unlinkat(dirfd, name, 0) < 0) {
-            set_error(err, "unlinkat");
-            return false;
+
+    // Drops one reference; the last one removes the directory and walks up to its parent.
+    void release(Node* node) {
+        while (node && node->pending.fetch_sub(1) == 1) {
+            Node* parent = node->parent;
+            node->fd = Fd();
+            if (!failed_.load()) {
+                const int dirfd = parent ? parent->fd.fd : rootParentFd_;
+                if (::unlinkat(dirfd, node->name.c_str(), AT_REMOVEDIR) < 0) {
+                    Error err;
+                    set_error(err, "unlinkat");
+                    fail(err);
+                }
+            }
+            delete node;
+            if (!parent) {
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex_);
+                    done_ = true;
+                }
+                notEmpty_.notify_all();
+                finished_.notify_all();
+            }
+            node = parent;
         }
     }
-    return true;
-}
+
+    void fail(const Error& err) {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        if (!firstError_.isSet()) {
+            firstError_ = err;
+        }
+        failed_.store(true);
+    }
+
+    const int rootParentFd_;
+    ProgressInfo& progress_;
+    const ProgressCallback& cb_;
+    const std::size_t capacity_;
+
+    std::mutex progressMutex_;
+    std::mutex queueMutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable finished_;
+    std::deque<Node*> queue_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> failed_{false};
+    bool done_ = false;
+    Error firstError_;
+};
 
 }  // namespace
 
+const char* copy_method_name(CopyMethod method) {
+    switch (method) {
+        case CopyMethod::None:
+            return "none";
+        case CopyMethod::Reflink:
+            return "reflink";
+        case CopyMethod::CopyFileRange:
+            return "copy_file_range";
+        case CopyMethod::Sendfile:
+            return "sendfile";
+        case CopyMethod::IoUring:
+            return "io_uring";
+        case CopyMethod::ReadWrite:
+            return "read/write";
+        case CopyMethod::DirectIo:
+            return "O_DIRECT";
+        case CopyMethod::Delta:
+            return "delta";
+        case CopyMethod::Snapshot:
+            return "snapshot";
+    }
+    return "unknown";
+}
+
+void set_io_engine(IoEngine engine) {
+    g_ioEngine.store(static_cast<int>(engine));
+}
+
+IoEngine io_engine() {
+    const auto wanted = static_cast<IoEngine>(g_ioEngine.load());
+    if (wanted == IoEngine::Posix) {
+        return IoEngine::Posix;
+    }
+    return IoUring::available() ? IoEngine::IoUring : IoEngine::Posix;
+}
+
+bool set_io_priority(IoPriority priority, Error& err) {
+    err = {};
+#if defined(__linux__) && defined(SYS_ioprio_set)
+    // Values from linux/ioprio.h, which not every libc exposes.
+    constexpr int kWhoProcess = 1;  // IOPRIO_WHO_PROCESS; id 0 is the calling thread
+    constexpr int kClassShift = 13;
+    constexpr int kClassBestEffort = 2;
+    constexpr int kClassIdle = 3;
+    constexpr int kLowestBestEffortLevel = 7;
+
+    int value = 0;  // IOPRIO_CLASS_NONE: follow the CPU nice value
+    switch (priority) {
+        case IoPriority::Default:
+            break;
+        case IoPriority::BestEffort:
+            value = (kClassBestEffort << kClassShift) | kLowestBestEffortLevel;
+            break;
+        case IoPriority::Idle:
+            value = kClassIdle << kClassShift;
+            break;
+    }
+    if (::syscall(SYS_ioprio_set, kWhoProcess, 0, value) < 0) {
+        set_error(err, "ioprio_set");
+        return false;
+    }
+    return true;
+#else
+    (void)priority;
+    err.code = ENOSYS;
+    err.message = "ioprio_set: not supported on this platform";
+    return false;
+#endif
+}
+
 bool blake3_file(const std::string& path, std::string& hexHash, Error& err) {
     return blake3_file_impl(path, hexHash, err);
 }
 
+bool blake3_files(const std::vector<std::string>& paths, std::vector<Blake3Result>& results, unsigned workerCount) {
+    results.clear();
+    results.resize(paths.size());
+    if (paths.empty()) {
+        return true;
+    }
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> allOk{true};
+    auto work = [&] {
+        for (std::size_t i = next.fetch_add(1); i < paths.size(); i = next.fetch_add(1)) {
+            if (!blake3_file_impl(paths[i], results[i].hexHash, results[i].error)) {
+                allOk.store(false);
+            }
+        }
+    };
+
+    const auto workers = static_cast<unsigned>(std::min<std::size_t>(resolve_worker_count(workerCount), paths.size()));
+    std::vector<std::thread> threads;
+    threads.reserve(workers > 0 ? workers - 1 : 0);
+    for (unsigned i = 1; i < workers; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& t : threads) {
+        t.join();
+    }
+    return allOk.load();
+}
+
 bool read_file_all(const std::string& path, std::vector<std::uint8_t>& out, Error& err) {
     err = {};
     out.clear();
@@ -512,7 +2485,122 @@ bool read_file_all(const std::string& path, std::vector<std::uint8_t>& out, Erro
     return read_all_fd(fd.fd, out, err);
 }
 
-bool write_file_atomic(const std::string& path, const std::uint8_t* data, std::size_t size, Error& err) {
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : data_(other.data_), size_(other.size_), open_(other.open_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.open_ = false;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        data_ = other.data_;
+        size_ = other.size_;
+        open_ = other.open_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.open_ = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path, Error& err) {
+    err = {};
+    close();
+
+    Fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+    struct stat st{};
+    if (::fstat(fd.fd, &st) < 0) {
+        set_error(err, "fstat");
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        err.code = EINVAL;
+        err.message = "not a regular file";
+        return false;
+    }
+    if (static_cast<std::uint64_t>(st.st_size) > static_cast<std::uint64_t>(SIZE_MAX)) {
+        err.code = EFBIG;
+        err.message = "file too large to map";
+        return false;
+    }
+
+    const auto size = static_cast<std::size_t>(st.st_size);
+    if (size > 0) {
+        void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.fd, 0);
+        if (map == MAP_FAILED) {
+            set_error(err, "mmap");
+            return false;
+        }
+        data_ = static_cast<const std::uint8_t*>(map);
+    }
+    size_ = size;
+    open_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) {
+        ::munmap(const_cast<std::uint8_t*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+bool read_file_chunked(const std::string& path, std::size_t chunkSize, const ChunkConsumer& consume, Error& err) {
+    err = {};
+    Fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+    ::posix_fadvise(fd.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<std::uint8_t> buffer(std::max<std::size_t>(chunkSize, 1));
+    for (;;) {
+        // Fill the whole chunk unless EOF intervenes, so consumers see fixed-size pieces.
+        std::size_t used = 0;
+        while (used < buffer.size()) {
+            const ssize_t n = ::read(fd.fd, buffer.data() + used, buffer.size() - used);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                set_error(err, "read");
+                return false;
+            }
+            if (n == 0) {
+                break;
+            }
+            used += static_cast<std::size_t>(n);
+        }
+        if (used == 0) {
+            return true;
+        }
+        if (!consume(buffer.data(), used)) {
+            set_cancelled(err);
+            return false;
+        }
+        if (used < buffer.size()) {
+            return true;
+        }
+    }
+}
+
+bool write_file_atomic(const std::string& path,
+                       const std::uint8_t* data,
+                       std::size_t size,
+                       Error& err,
+                       Durability durability) {
     err = {};
 
     if (!ensure_parent_dirs(path, err)) {
@@ -536,7 +2624,9 @@ bool write_file_atomic(const std::string& path, const std::uint8_t* data, std::s
         return false;
     }
 
-    if (::fsync(fd.fd) < 0) {
+    // A single file is a batch of its own: BatchEnd syncs it like PerFile, which is much
+    // cheaper than a syncfs() of the whole filesystem.
+    if (durability != Durability::None && ::fsync(fd.fd) < 0) {
         set_error(err, "fsync");
         ::unlink(tmpl.data());
         return false;
@@ -551,6 +2641,20 @@ bool write_file_atomic(const std::string& path, const std::uint8_t* data, std::s
     return true;
 }
 
+bool sync_filesystem(const std::string& path, Error& err) {
+    err = {};
+    Fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!fd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+    if (::syncfs(fd.fd) < 0) {
+        set_error(err, "syncfs");
+        return false;
+    }
+    return true;
+}
+
 bool make_dir_parents(const std::string& path, Error& err) {
     err = {};
     if (path.empty()) {
@@ -634,6 +2738,17 @@ bool copy_path(const std::string& source,
                const ProgressCallback& callback,
                Error& err,
                bool preserveOwnership) {
+    CopyOptions options;
+    options.preserveOwnership = preserveOwnership;
+    return copy_path(source, destination, progress, callback, err, options);
+}
+
+bool copy_path(const std::string& source,
+               const std::string& destination,
+               ProgressInfo& progress,
+               const ProgressCallback& callback,
+               Error& err,
+               const CopyOptions& options) {
     err = {};
 
     // Ensure destination parent exists
@@ -679,20 +2794,77 @@ bool copy_path(const std::string& source,
         return false;
     }
 
+    CopyContext ctx(progress, callback, options);
+    if (options.journal) {
+        ctx.destDir = destParent;
+    }
+
     bool ok = false;
-    if (srcIsDir) {
-        ok = copy_dir_at(srcParentFd.fd, srcName.c_str(), destParentFd.fd, destName.c_str(), progress, callback, err, 0,
-                         preserveOwnership);
-        if (!ok) {
+    if (srcIsDir && options.snapshotDirectories && !options.journal && !options.verify &&
+        snapshot_dir_at(srcParentFd.fd, srcName.c_str(), rootInfo.st, destParentFd.fd, destName.c_str())) {
+        progress.copyMethod = CopyMethod::Snapshot;
+        ok = true;
+    }
+    else if (srcIsDir) {
+        std::unique_ptr<TreeScanner> scanner;
+        if (options.scanAhead) {
+            scanner = std::make_unique<TreeScanner>(srcParentFd.fd, srcName, ctx);
+            ctx.scanning = true;
+        }
+
+        // Only directory trees benefit from the pool; a single file is copied inline.
+        std::unique_ptr<CopyScheduler> scheduler;
+        unsigned workers = resolve_worker_count(options.workerCount);
+        // An automatic count is learned per destination device.
+        struct stat destSt{};
+        const bool learnWorkers =
+            options.profiles && options.workerCount == 0 && ::fstat(destParentFd.fd, &destSt) == 0;
+        if (learnWorkers) {
+            workers = options.profiles->workers(static_cast<std::uint64_t>(destSt.st_dev), workers);
+        }
+        if (workers > 1) {
+            scheduler = std::make_unique<CopyScheduler>(workers, ctx);
+            ctx.scheduler = scheduler.get();
+        }
+        const std::uint64_t bytesBefore = progress.bytesDone;
+        const auto started = std::chrono::steady_clock::now();
+
+        ok = copy_dir_at(srcParentFd.fd, srcName.c_str(), destParentFd.fd, destName.c_str(), ctx, err, 0);
+
+        if (scheduler) {
+            Error poolErr;
+            if (!scheduler->finish(/*abort=*/!ok, poolErr)) {
+                // Prefer the worker's error when the walker only stopped because the pool failed.
+                if (ok || err.code == ECANCELED) {
+                    if (poolErr.isSet()) {
+                        err = poolErr;
+                    }
+                }
+                ok = false;
+            }
+            ctx.scheduler = nullptr;
+        }
+        scanner.reset();
+        ctx.scanning = false;
+        // A throttled copy tells nothing about the device.
+        const IoThrottle* throttle = options.throttle;
+        const bool throttled = throttle && (throttle->bytesPerSecond() > 0 || throttle->opsPerSecond() > 0 ||
+                                            throttle->adaptive());
+        if (ok && learnWorkers && !throttled) {
+            options.profiles->recordJob(static_cast<std::uint64_t>(destSt.st_dev), workers,
+                                        progress.bytesDone - bytesBefore, std::chrono::steady_clock::now() - started);
+        }
+
+        // A journaled copy keeps its partial result for the next run to continue.
+        if (!ok && !options.journal) {
             // best-effort cleanup
             Error cleanupErr;
             delete_path(destination, progress, ProgressCallback(), cleanupErr);
         }
     }
     else if (S_ISREG(rootInfo.st.st_mode) || S_ISLNK(rootInfo.st.st_mode)) {
-        ok = copy_entry_at(srcParentFd.fd, srcName.c_str(), destParentFd.fd, destName.c_str(), progress, callback, err,
-                           0, preserveOwnership);
-        if (!ok) {
+        ok = copy_entry_at(srcParentFd.fd, srcName.c_str(), destParentFd.fd, destName.c_str(), ctx, err, 0);
+        if (!ok && !options.journal) {
             Error cleanupErr;
             delete_path(destination, progress, ProgressCallback(), cleanupErr);
         }
@@ -703,6 +2875,11 @@ bool copy_path(const std::string& source,
         return false;
     }
 
+    if (ok && options.durability == Durability::BatchEnd && ::syncfs(destParentFd.fd) < 0) {
+        set_error(err, "syncfs");
+        ok = false;
+    }
+
     if (ok) {
         progress.filesDone += 1;
     }
@@ -716,6 +2893,119 @@ bool move_path(const std::string& source,
                Error& err,
                bool forceCopyFallbackForTests,
                bool preserveOwnership) {
+    CopyOptions options;
+    options.preserveOwnership = preserveOwnership;
+    return move_path(source, destination, progress, callback, err, options, forceCopyFallbackForTests);
+}
+
+bool interrupted_move(const std::string& destination, std::string& source) {
+    source.clear();
+    std::vector<std::uint8_t> data;
+    Error err;
+    if (!read_file_all(move_journal_path(destination), data, err)) {
+        return false;
+    }
+    const std::string text(data.begin(), data.end());
+    const std::string header(kMoveJournalHeader);
+    const std::string key = "source=";
+    if (text.compare(0, header.size(), header) != 0 || text.compare(header.size(), key.size(), key) != 0) {
+        return false;
+    }
+    const auto start = header.size() + key.size();
+    const auto end = text.find('\n', start);
+    source = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    return !source.empty();
+}
+
+namespace {
+
+bool move_tree_streaming(const std::string& source,
+                         const std::string& destination,
+                         ProgressInfo& progress,
+                         const ProgressCallback& callback,
+                         Error& err,
+                         const CopyOptions& options) {
+    if (!ensure_parent_dirs(destination, err)) {
+        return false;
+    }
+
+    const std::string journal = move_journal_path(destination);
+    std::string journalSource;
+    if (interrupted_move(destination, journalSource) && journalSource != source) {
+        err.code = EEXIST;
+        err.message = "An interrupted move from " + journalSource + " targets this destination";
+        return false;
+    }
+    const std::string record = std::string(kMoveJournalHeader) + "source=" + source + "\n";
+    if (!write_file_atomic(journal, reinterpret_cast<const std::uint8_t*>(record.data()), record.size(), err)) {
+        return false;
+    }
+
+    auto split = [](const std::string& path, std::string& parent, std::string& name) {
+        const auto pos = path.find_last_of('/');
+        parent = pos == std::string::npos ? "." : path.substr(0, pos);
+        name = pos == std::string::npos ? path : path.substr(pos + 1);
+        if (parent.empty()) {
+            parent = "/";
+        }
+    };
+    std::string srcParent, srcName, dstParent, dstName;
+    split(source, srcParent, srcName);
+    split(destination, dstParent, dstName);
+
+    Fd srcParentFd(::open(srcParent.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY));
+    Fd dstParentFd(::open(dstParent.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY));
+    if (!srcParentFd.valid() || !dstParentFd.valid()) {
+        set_error(err, "open");
+        return false;
+    }
+
+    // Sources are deleted as soon as their copy is on disk, so every file is synced whatever
+    // the caller asked for, and files are copied in walk order.
+    CopyOptions streamOptions = options;
+    streamOptions.durability = Durability::PerFile;
+    streamOptions.workerCount = 1;
+    CopyContext ctx(progress, callback, streamOptions);
+    if (options.journal) {
+        ctx.destDir = dstParent;
+    }
+
+    bool ok;
+    {
+        std::unique_ptr<TreeScanner> scanner;
+        if (options.scanAhead) {
+            scanner = std::make_unique<TreeScanner>(srcParentFd.fd, srcName, ctx);
+            ctx.scanning = true;
+        }
+        ok = move_dir_streaming(srcParentFd.fd, srcName.c_str(), dstParentFd.fd, dstName.c_str(), ctx, err, 0);
+    }
+    if (!ok) {
+        // Keep the journal and what was moved so far; running the same move again resumes.
+        return false;
+    }
+
+    if (::fsync(dstParentFd.fd) < 0) {
+        set_error(err, "fsync");
+        return false;
+    }
+    if (::unlinkat(srcParentFd.fd, srcName.c_str(), AT_REMOVEDIR) < 0) {
+        set_error(err, "unlinkat");
+        return false;
+    }
+    ::unlink(journal.c_str());
+    progress.filesDone += 1;
+    return true;
+}
+
+}  // namespace
+
+bool move_path(const std::string& source,
+               const std::string& destination,
+               ProgressInfo& progress,
+               const ProgressCallback& callback,
+               Error& err,
+               const CopyOptions& options,
+               bool forceCopyFallbackForTests) {
     err = {};
 
     if (!forceCopyFallbackForTests && ::rename(source.c_str(), destination.c_str()) == 0) {
@@ -730,11 +3020,32 @@ bool move_path(const std::string& source,
         return false;
     }
 
+    if (options.streamingMove) {
+        struct stat st{};
+        if (::lstat(source.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            return move_tree_streaming(source, destination, progress, callback, err, options);
+        }
+    }
+
     // Cross-device or forced fallback: copy then delete
-    if (!copy_path(source, destination, progress, callback, err, preserveOwnership)) {
+    if (!copy_path(source, destination, progress, callback, err, options)) {
         return false;
     }
 
+    // The copy has to be on disk before the source goes, whatever |options| asks, or a crash
+    // right after would lose both; with BatchEnd, copy_path() has synced it already.
+    if (options.durability != Durability::BatchEnd) {
+        const auto slash = destination.find_last_of('/');
+        const std::string destParent = slash == std::string::npos ? std::string(".")
+                                       : slash == 0                ? std::string("/")
+                                                                   : destination.substr(0, slash);
+        if (!sync_filesystem(destParent, err)) {
+            Error cleanupErr;
+            delete_path(destination, progress, ProgressCallback(), cleanupErr);
+            return false;
+        }
+    }
+
     if (!delete_path(source, progress, callback, err)) {
         // best-effort cleanup
         delete_path(destination, progress, callback, err);
@@ -745,6 +3056,14 @@ bool move_path(const std::string& source,
 }
 
 bool delete_path(const std::string& path, ProgressInfo& progress, const ProgressCallback& callback, Error& err) {
+    return delete_path(path, progress, callback, err, DeleteOptions{});
+}
+
+bool delete_path(const std::string& path,
+                 ProgressInfo& progress,
+                 const ProgressCallback& callback,
+                 Error& err,
+                 const DeleteOptions& options) {
     err = {};
     // Split path into parent/name
     const auto pos = path.find_last_of('/');
@@ -760,7 +3079,20 @@ bool delete_path(const std::string& path, ProgressInfo& progress, const Progress
         return false;
     }
 
-    if (!delete_at(parentFd.fd, name.c_str(), progress, callback, err, 0)) {
+    const unsigned workers = resolve_worker_count(options.workerCount);
+    StatInfo info;
+    if (workers > 1 && stat_at(parentFd.fd, name.c_str(), /*follow=*/false, info, err) && S_ISDIR(info.st.st_mode)) {
+        Fd root(::openat(parentFd.fd, name.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY | O_NOFOLLOW));
+        if (!root.valid()) {
+            set_error(err, "openat");
+            return false;
+        }
+        DeleteScheduler scheduler(workers, parentFd.fd, progress, callback, options.ioPriority);
+        if (!scheduler.run_root(std::move(root), name.c_str(), err)) {
+            return false;
+        }
+    }
+    else if (err.isSet() || !delete_at(parentFd.fd, name.c_str(), progress, callback, err, 0)) {
         return false;
     }
     progress.filesDone += 1;
@@ -13,6 +13,10 @@
 
 namespace PCManFM::FsOps {
 
+class CopyJournal;
+class DeviceProfiles;
+class IoThrottle;
+
 // Maximum recursion depth to avoid runaway traversal (symlink loops, pathological trees).
 constexpr int kMaxRecursionDepth = 256;
 
@@ -23,18 +27,164 @@ struct Error {
     bool isSet() const { return code != 0 || !message.empty(); }
 };
 
+// Data path used for the most recent regular-file copy, fastest first. Later tiers are only
+// tried when the kernel or filesystem rejects the earlier ones.
+enum class CopyMethod {
+    None,
+    Reflink,        // FICLONE: shares extents, no data is moved
+    CopyFileRange,  // copy_file_range(): in-kernel copy, server-side on NFS 4.2/CIFS
+    Sendfile,       // sendfile(): in-kernel copy through the page cache
+    IoUring,        // pipelined io_uring reads/writes, several chunks in flight
+    ReadWrite,      // user-space read()/write() loop
+    DirectIo,       // O_DIRECT reads/writes past the page cache (CopyOptions::directIoThreshold)
+    Delta,          // only the changed blocks of an existing destination (CopyOptions::deltaThreshold)
+    Snapshot,       // a btrfs snapshot of a whole subvolume (CopyOptions::snapshotDirectories)
+};
+
+const char* copy_method_name(CopyMethod method);
+
+// Syscall engine behind the copy, delete and checksum paths. Auto picks io_uring when it was
+// compiled in (ENABLE_IO_URING) and the kernel allows it, and plain POSIX calls otherwise.
+enum class IoEngine { Auto, Posix, IoUring };
+
+// Process-wide preference; safe to call from any thread.
+void set_io_engine(IoEngine engine);
+// The engine actually in use with Auto and runtime availability resolved.
+IoEngine io_engine();
+
+// Linux I/O scheduling class for threads doing background file operations.
+enum class IoPriority {
+    Default,     // whatever the thread already has (derived from its CPU nice value)
+    BestEffort,  // best-effort class at its lowest level
+    Idle,        // only gets disk time when no other task wants it
+};
+
+// Applies |priority| to the calling thread with ioprio_set(). Default resets the thread to
+// the kernel default. Fails with ENOSYS where ioprio_set() is not available.
+bool set_io_priority(IoPriority priority, Error& err);
+
 struct ProgressInfo {
     std::uint64_t bytesDone = 0;
     std::uint64_t bytesTotal = 0;
     int filesDone = 0;
     int filesTotal = 0;
     std::string currentPath;
+    CopyMethod copyMethod = CopyMethod::None;
+    // True while a look-ahead scan (CopyOptions::scanAhead) is still growing bytesTotal.
+    bool totalsEstimated = false;
 };
 
 using ProgressCallback = std::function<bool(const ProgressInfo&)>;
 
+// When written data is forced to stable storage.
+enum class Durability {
+    None,      // leave it to the kernel's writeback
+    BatchEnd,  // one syncfs() on the destination filesystem after the whole operation
+    PerFile,   // fsync() every file before it is considered done
+};
+
+struct CopyOptions {
+    bool preserveOwnership = false;
+    Durability durability = Durability::PerFile;
+    // Number of threads copying file bodies inside a directory tree. Directories and file
+    // entries are still created in walk order by the calling thread. 1 keeps the copy fully
+    // serial; 0 picks a count from std::thread::hardware_concurrency() (capped at 8).
+    unsigned workerCount = 1;
+    // Hash each file's source bytes while copying, then re-read the destination past the page
+    // cache and compare digests; a mismatch fails the copy with EIO. Forces the read/write
+    // tier and a data sync per file.
+    bool verify = false;
+    // Enumerate and stat a source tree on a separate thread while the copy runs, so
+    // progress.bytesTotal converges early instead of growing only as far as the copy got.
+    bool scanAhead = false;
+    // For moves that have to copy (EXDEV): delete every source entry as soon as its copy is
+    // durable instead of copying the whole tree first. Files are always fsync'ed in this mode.
+    // A journal next to the destination survives an interruption; running the same move
+    // again resumes it.
+    bool streamingMove = false;
+    // Records finished files and the progress of large ones so that running the same copy
+    // again with the same journal skips what is already done and continues partial files in
+    // place. Not owned; the caller removes the journal once the job has fully succeeded.
+    // An interrupted journaled copy keeps what it wrote instead of cleaning up.
+    CopyJournal* journal = nullptr;
+    // Rate limits shared by every file body of the copy, including parallel workers. Not
+    // owned; its limits may be changed while the copy runs.
+    IoThrottle* throttle = nullptr;
+    // I/O class given to the copy's worker threads. The calling thread keeps its own; see
+    // set_io_priority().
+    IoPriority ioPriority = IoPriority::Default;
+    // Regular files at least this large are copied with O_DIRECT through two large aligned
+    // buffers, one being read while the other is written, so a huge sequential copy does not
+    // evict the page cache. Filesystems that reject O_DIRECT get the normal tiers with
+    // sequential/no-reuse hints. Reflinks are still tried first. 0 disables the path.
+    std::uint64_t directIoThreshold = 0;
+    // Regular files at least this large that already exist at the destination are updated in
+    // place: both are read in parallel blocks and only the blocks that differ are written, so
+    // re-copying a large image where little changed costs reads instead of writes. A reflink
+    // is still tried first. Ignored by verified and journaled copies. 0 disables the path.
+    std::uint64_t deltaThreshold = 0;
+    // A source directory that is the root of a btrfs subvolume holding no other subvolume is
+    // duplicated as a writable snapshot of it, at once whatever its size, when the destination
+    // is new and on the same filesystem. The snapshot is a subvolume itself and keeps the
+    // owners of the source files. Other directories, journaled and verified copies are copied
+    // file by file.
+    bool snapshotDirectories = false;
+    // Throughput learned for the device of the destination: the read/write tier copies in the
+    // chunk size found fastest there, adapted during the copy, and with workerCount 0 a tree
+    // copy uses the worker count found fastest. Not owned; null keeps 128 KiB chunks.
+    DeviceProfiles* profiles = nullptr;
+};
+
+struct DeleteOptions {
+    // Number of threads removing sibling subdirectories in parallel. Each directory is removed
+    // only after all of its children are gone. 1 keeps the delete serial; 0 picks a count the
+    // same way as CopyOptions::workerCount.
+    unsigned workerCount = 1;
+    // I/O class given to the delete's worker threads.
+    IoPriority ioPriority = IoPriority::Default;
+};
+
 bool read_file_all(const std::string& path, std::vector<std::uint8_t>& out, Error& err);
-bool write_file_atomic(const std::string& path, const std::uint8_t* data, std::size_t size, Error& err);
+
+// Read-only mapping of a whole regular file that callers can borrow without copying. An
+// empty file maps to an empty view. Movable, not copyable; the mapping lives until close()
+// or destruction. A writer truncating the file while it is mapped makes reads fault.
+class MappedFile {
+   public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, Error& err);
+    void close();
+
+    bool isOpen() const { return open_; }
+    const std::uint8_t* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+   private:
+    const std::uint8_t* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool open_ = false;
+};
+
+// Hands the file to |consume| in chunks of at most |chunkSize| bytes using one reused buffer,
+// so arbitrarily large files are processed in bounded memory. Returning false from |consume|
+// stops with ECANCELED.
+using ChunkConsumer = std::function<bool(const std::uint8_t* data, std::size_t size)>;
+bool read_file_chunked(const std::string& path, std::size_t chunkSize, const ChunkConsumer& consume, Error& err);
+// Writes a temporary file next to |path| and renames it over |path|. BatchEnd is taken as
+// PerFile, as the one file is the whole batch.
+bool write_file_atomic(const std::string& path,
+                       const std::uint8_t* data,
+                       std::size_t size,
+                       Error& err,
+                       Durability durability = Durability::PerFile);
+// syncfs() the filesystem containing |path|; used to flush a batch written with Durability::None.
+bool sync_filesystem(const std::string& path, Error& err);
 bool make_dir_parents(const std::string& path, Error& err);
 bool set_permissions(const std::string& path, unsigned int mode, Error& err);
 bool set_times(const std::string& path,
@@ -60,11 +210,50 @@ bool move_path(const std::string& source,
                bool forceCopyFallbackForTests = false,
                bool preserveOwnership = false);
 
+// Same as above with the full option set. The callback is serialized but may be invoked from
+// worker threads when options.workerCount != 1.
+bool copy_path(const std::string& source,
+               const std::string& destination,
+               ProgressInfo& progress,
+               const ProgressCallback& callback,
+               Error& err,
+               const CopyOptions& options);
+
+// Renames |source|, or copies it across filesystems and then deletes it. Such a copy is
+// synced before the source is deleted, whatever options.durability says.
+bool move_path(const std::string& source,
+               const std::string& destination,
+               ProgressInfo& progress,
+               const ProgressCallback& callback,
+               Error& err,
+               const CopyOptions& options,
+               bool forceCopyFallbackForTests = false);
+
+// True when a streaming move into |destination| was interrupted; |source| receives the path
+// it was moving from.
+bool interrupted_move(const std::string& destination, std::string& source);
+
 bool delete_path(const std::string& path, ProgressInfo& progress, const ProgressCallback& callback, Error& err);
+// The callback is serialized but may be invoked from worker threads when options.workerCount != 1.
+bool delete_path(const std::string& path,
+                 ProgressInfo& progress,
+                 const ProgressCallback& callback,
+                 Error& err,
+                 const DeleteOptions& options);
 
 // Compute a BLAKE3 checksum for a regular file (rejects symlinks and non-regular files).
+// Large files are hashed from a memory mapping, across cores when BLAKE3 was built with TBB.
 bool blake3_file(const std::string& path, std::string& hexHash, Error& err);
 
+struct Blake3Result {
+    std::string hexHash;  // empty when |error| is set
+    Error error;
+};
+
+// Hashes a selection of files concurrently on up to |workerCount| threads (0 = automatic,
+// capped at 8). results[i] belongs to paths[i]. Returns false if any file failed.
+bool blake3_files(const std::vector<std::string>& paths, std::vector<Blake3Result>& results, unsigned workerCount = 0);
+
 }  // namespace PCManFM::FsOps
 
 #endif  // PCMANFM_FS_OPS_H
@@ -0,0 +1,428 @@
+/*
+ * Persistent BLAKE3 digest cache keyed by file identity (POSIX-only, no Qt)
+ * src/core/hash_cache.cpp
+ */
+
+#include "hash_cache.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <pwd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+// On-disk layout: a 16 byte header followed by fixed-size records in native byte order
+// (the table never leaves the machine that wrote it).
+//   header: magic[8] | u32 record size | u32 reserved
+//   record: u64 dev | u64 ino | u64 size | i64 mtime sec | u32 mtime nsec | u32 reserved | digest[32]
+constexpr char kMagic[8] = {'P', 'C', 'M', 'F', 'B', '3', 'H', '1'};
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kRecordSize = 72;
+constexpr std::size_t kDigestSize = 32;
+
+// Compact once the table holds this many records and more than half of them are stale.
+constexpr std::size_t kCompactMinRecords = 4096;
+
+void set_error(FsOps::Error& err, const char* context) {
+    err.code = errno;
+    err.message = std::string(context) + ": " + std::strerror(errno);
+}
+
+void encode_header(std::uint8_t* out) {
+    std::memset(out, 0, kHeaderSize);
+    std::memcpy(out, kMagic, sizeof(kMagic));
+    const auto recordSize = static_cast<std::uint32_t>(kRecordSize);
+    std::memcpy(out + 8, &recordSize, sizeof(recordSize));
+}
+
+bool header_matches(const std::uint8_t* data) {
+    std::uint32_t recordSize = 0;
+    std::memcpy(&recordSize, data + 8, sizeof(recordSize));
+    return std::memcmp(data, kMagic, sizeof(kMagic)) == 0 && recordSize == kRecordSize;
+}
+
+bool write_all(int fd, const std::uint8_t* data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool parse_hex(const std::string& hex, std::uint8_t* out) {
+    if (hex.size() != kDigestSize * 2) {
+        return false;
+    }
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    };
+    for (std::size_t i = 0; i < kDigestSize; ++i) {
+        const int hi = nibble(hex[2 * i]);
+        const int lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = static_cast<std::uint8_t>((hi << 4) | lo);
+    }
+    return true;
+}
+
+std::string to_hex(const std::uint8_t* digest) {
+    static const char* kHex = "0123456789abcdef";
+    std::string hex(kDigestSize * 2, '0');
+    for (std::size_t i = 0; i < kDigestSize; ++i) {
+        hex[2 * i] = kHex[(digest[i] >> 4) & 0xF];
+        hex[2 * i + 1] = kHex[digest[i] & 0xF];
+    }
+    return hex;
+}
+
+bool same_identity(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+           a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+// A file modified within the last second may be written again without its mtime changing
+// on filesystems with coarse timestamps, so its digest is not worth remembering yet.
+bool is_racy(const struct stat& st) {
+    struct timespec now{};
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    return st.st_mtim.tv_sec >= now.tv_sec - 1;
+}
+
+}  // namespace
+
+std::size_t HashCache::KeyHash::operator()(const Key& key) const {
+    return std::hash<std::uint64_t>()(key.ino * 0x9E3779B97F4A7C15ull ^ key.dev);
+}
+
+HashCache::~HashCache() {
+    close();
+}
+
+std::string HashCache::defaultPath() {
+    std::string base;
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0] == '/') {
+        base = xdg;
+    }
+    else {
+        const char* home = std::getenv("HOME");
+        if (!home || home[0] == '\0') {
+            const struct passwd* pw = ::getpwuid(::getuid());
+            home = pw ? pw->pw_dir : nullptr;
+        }
+        if (!home || home[0] == '\0') {
+            return std::string();
+        }
+        base = std::string(home) + "/.cache";
+    }
+    return base + "/pcmanfm-qt/blake3.cache";
+}
+
+HashCache& HashCache::instance() {
+    static HashCache cache;
+    static std::once_flag once;
+    std::call_once(once, [] {
+        FsOps::Error ignored;
+        const std::string path = defaultPath();
+        if (!path.empty()) {
+            cache.open(path, ignored);
+        }
+    });
+    return cache;
+}
+
+bool HashCache::open(const std::string& path, FsOps::Error& err) {
+    err = {};
+    close();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !FsOps::make_dir_parents(path.substr(0, slash), err)) {
+        return false;
+    }
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd_ < 0) {
+        set_error(err, "open");
+        return false;
+    }
+    path_ = path;
+    if (!load(err)) {
+        ::close(fd_);
+        fd_ = -1;
+        path_.clear();
+        return false;
+    }
+    if (records_ >= kCompactMinRecords && records_ > entries_.size() * 2) {
+        FsOps::Error ignored;
+        compact(ignored);  // a stale but valid table is still usable
+    }
+    return true;
+}
+
+bool HashCache::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fd_ >= 0;
+}
+
+void HashCache::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    path_.clear();
+    records_ = 0;
+    entries_.clear();
+}
+
+std::size_t HashCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+bool HashCache::load(FsOps::Error& err) {
+    struct stat st{};
+    if (::fstat(fd_, &st) != 0) {
+        set_error(err, "fstat");
+        return false;
+    }
+    const auto fileSize = static_cast<std::size_t>(st.st_size);
+
+    void* map = MAP_FAILED;
+    if (fileSize >= kHeaderSize) {
+        map = ::mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) {
+            set_error(err, "mmap");
+            return false;
+        }
+    }
+
+    const auto* data = static_cast<const std::uint8_t*>(map);
+    if (map == MAP_FAILED || !header_matches(data)) {
+        if (map != MAP_FAILED) {
+            ::munmap(map, fileSize);
+        }
+        std::uint8_t header[kHeaderSize];
+        encode_header(header);
+        if (::ftruncate(fd_, 0) != 0 || !write_all(fd_, header, sizeof(header))) {
+            set_error(err, "write");
+            return false;
+        }
+        return true;
+    }
+
+    const std::size_t count = (fileSize - kHeaderSize) / kRecordSize;
+    entries_.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::uint8_t* rec = data + kHeaderSize + i * kRecordSize;
+        Key key;
+        Entry entry;
+        std::memcpy(&key.dev, rec, 8);
+        std::memcpy(&key.ino, rec + 8, 8);
+        std::memcpy(&entry.size, rec + 16, 8);
+        std::memcpy(&entry.mtimeSec, rec + 24, 8);
+        std::memcpy(&entry.mtimeNsec, rec + 32, 4);
+        std::memcpy(entry.digest, rec + 40, kDigestSize);
+        entries_[key] = entry;
+    }
+    records_ = count;
+    ::munmap(map, fileSize);
+
+    // Drop a torn trailing record so later appends stay aligned.
+    const std::size_t validSize = kHeaderSize + count * kRecordSize;
+    if (validSize != fileSize && ::ftruncate(fd_, static_cast<off_t>(validSize)) != 0) {
+        set_error(err, "ftruncate");
+        return false;
+    }
+    return true;
+}
+
+bool HashCache::compact(FsOps::Error& err) {
+    std::vector<std::uint8_t> buffer(kHeaderSize + entries_.size() * kRecordSize, 0);
+    encode_header(buffer.data());
+    std::uint8_t* rec = buffer.data() + kHeaderSize;
+    for (const auto& [key, entry] : entries_) {
+        std::memcpy(rec, &key.dev, 8);
+        std::memcpy(rec + 8, &key.ino, 8);
+        std::memcpy(rec + 16, &entry.size, 8);
+        std::memcpy(rec + 24, &entry.mtimeSec, 8);
+        std::memcpy(rec + 32, &entry.mtimeNsec, 4);
+        std::memcpy(rec + 40, entry.digest, kDigestSize);
+        rec += kRecordSize;
+    }
+    if (!FsOps::write_file_atomic(path_, buffer.data(), buffer.size(), err, FsOps::Durability::None)) {
+        return false;
+    }
+
+    const int fd = ::open(path_.c_str(), O_RDWR | O_APPEND | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        set_error(err, "open");
+        return false;
+    }
+    ::close(fd_);
+    fd_ = fd;
+    records_ = entries_.size();
+    return true;
+}
+
+bool HashCache::lookup(const struct stat& st, std::string& hexHash) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = entries_.find(Key{static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)});
+    if (it == entries_.end()) {
+        return false;
+    }
+    const Entry& entry = it->second;
+    if (entry.size != static_cast<std::uint64_t>(st.st_size) || entry.mtimeSec != st.st_mtim.tv_sec ||
+        entry.mtimeNsec != static_cast<std::uint32_t>(st.st_mtim.tv_nsec)) {
+        return false;
+    }
+    hexHash = to_hex(entry.digest);
+    return true;
+}
+
+bool HashCache::store(const struct stat& st, const std::string& hexHash, FsOps::Error& err) {
+    err = {};
+    Key key{static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+    Entry entry;
+    entry.size = static_cast<std::uint64_t>(st.st_size);
+    entry.mtimeSec = st.st_mtim.tv_sec;
+    entry.mtimeNsec = static_cast<std::uint32_t>(st.st_mtim.tv_nsec);
+    if (!parse_hex(hexHash, entry.digest)) {
+        err.code = EINVAL;
+        err.message = "invalid BLAKE3 digest";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+        err.code = EBADF;
+        err.message = "hash cache is not open";
+        return false;
+    }
+    const auto it = entries_.find(key);
+    if (it != entries_.end() && it->second.size == entry.size && it->second.mtimeSec == entry.mtimeSec &&
+        it->second.mtimeNsec == entry.mtimeNsec && std::memcmp(it->second.digest, entry.digest, kDigestSize) == 0) {
+        return true;
+    }
+
+    std::uint8_t rec[kRecordSize] = {};
+    std::memcpy(rec, &key.dev, 8);
+    std::memcpy(rec + 8, &key.ino, 8);
+    std::memcpy(rec + 16, &entry.size, 8);
+    std::memcpy(rec + 24, &entry.mtimeSec, 8);
+    std::memcpy(rec + 32, &entry.mtimeNsec, 4);
+    std::memcpy(rec + 40, entry.digest, kDigestSize);
+    // One O_APPEND write per record keeps concurrent writers from interleaving.
+    const ssize_t n = ::write(fd_, rec, sizeof(rec));
+    if (n != static_cast<ssize_t>(sizeof(rec))) {
+        if (n >= 0) {
+            errno = EIO;
+        }
+        set_error(err, "write");
+        return false;
+    }
+    entries_[key] = entry;
+    ++records_;
+    return true;
+}
+
+void HashCache::storeQuietly(const struct stat& before, const std::string& path, const std::string& hexHash) {
+    struct stat after{};
+    if (::lstat(path.c_str(), &after) != 0 || !same_identity(before, after) || is_racy(after)) {
+        return;
+    }
+    FsOps::Error ignored;
+    store(after, hexHash, ignored);
+}
+
+bool HashCache::blake3File(const std::string& path, std::string& hexHash, FsOps::Error& err, bool* fromCache) {
+    err = {};
+    if (fromCache) {
+        *fromCache = false;
+    }
+
+    struct stat before{};
+    const bool haveStat = ::lstat(path.c_str(), &before) == 0 && S_ISREG(before.st_mode);
+    if (haveStat && lookup(before, hexHash)) {
+        if (fromCache) {
+            *fromCache = true;
+        }
+        return true;
+    }
+
+    if (!FsOps::blake3_file(path, hexHash, err)) {
+        return false;
+    }
+    if (haveStat) {
+        storeQuietly(before, path, hexHash);
+    }
+    return true;
+}
+
+bool HashCache::blake3Files(const std::vector<std::string>& paths,
+                            std::vector<FsOps::Blake3Result>& results,
+                            unsigned workerCount) {
+    results.clear();
+    results.resize(paths.size());
+
+    std::vector<std::size_t> missIndex;
+    std::vector<std::string> missPaths;
+    std::vector<struct stat> missStats;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        struct stat st{};
+        const bool haveStat = ::lstat(paths[i].c_str(), &st) == 0 && S_ISREG(st.st_mode);
+        if (haveStat && lookup(st, results[i].hexHash)) {
+            continue;
+        }
+        if (!haveStat) {
+            st = {};
+        }
+        missIndex.push_back(i);
+        missPaths.push_back(paths[i]);
+        missStats.push_back(st);
+    }
+    if (missPaths.empty()) {
+        return true;
+    }
+
+    std::vector<FsOps::Blake3Result> hashed;
+    const bool ok = FsOps::blake3_files(missPaths, hashed, workerCount);
+    for (std::size_t j = 0; j < missPaths.size(); ++j) {
+        if (!hashed[j].error.isSet() && S_ISREG(missStats[j].st_mode)) {
+            storeQuietly(missStats[j], missPaths[j], hashed[j].hexHash);
+        }
+        results[missIndex[j]] = std::move(hashed[j]);
+    }
+    return ok;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,91 @@
+/*
+ * Persistent BLAKE3 digest cache keyed by file identity (POSIX-only, no Qt)
+ * src/core/hash_cache.h
+ */
+
+#ifndef PCMANFM_HASH_CACHE_H
+#define PCMANFM_HASH_CACHE_H
+
+#include "fs_ops.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct stat;
+
+namespace PCManFM {
+
+// HashCache remembers the BLAKE3 digest of files by (device, inode, size, mtime in ns), so an
+// unchanged file is answered without reading it again. Entries live in an append-only table
+// of fixed-size records that is mapped once on open; later records for the same inode win and
+// the table is compacted when superseded records dominate. Safe to share between threads.
+class HashCache {
+   public:
+    HashCache() = default;
+    ~HashCache();
+
+    HashCache(const HashCache&) = delete;
+    HashCache& operator=(const HashCache&) = delete;
+
+    // $XDG_CACHE_HOME/pcmanfm-qt/blake3.cache, falling back to ~/.cache when unset.
+    static std::string defaultPath();
+
+    // Process-wide cache at defaultPath(), opened on first use. If it cannot be opened the
+    // instance simply misses on every lookup and drops stores.
+    static HashCache& instance();
+
+    // Opens (creating if needed) the table at |path|. A file with an unknown header is reset.
+    bool open(const std::string& path, FsOps::Error& err);
+    bool isOpen() const;
+    void close();
+
+    // Number of distinct files currently known.
+    std::size_t size() const;
+
+    bool lookup(const struct stat& st, std::string& hexHash) const;
+    bool store(const struct stat& st, const std::string& hexHash, FsOps::Error& err);
+
+    // Returns the cached digest when the file's identity still matches, otherwise hashes it
+    // with FsOps::blake3_file and records the result. |fromCache| reports which happened.
+    bool blake3File(const std::string& path, std::string& hexHash, FsOps::Error& err, bool* fromCache = nullptr);
+
+    // Batch form of blake3File(): hits are answered from the table, misses are hashed
+    // concurrently through FsOps::blake3_files. Returns false if any file failed.
+    bool blake3Files(const std::vector<std::string>& paths,
+                     std::vector<FsOps::Blake3Result>& results,
+                     unsigned workerCount = 0);
+
+   private:
+    struct Key {
+        std::uint64_t dev = 0;
+        std::uint64_t ino = 0;
+        bool operator==(const Key& other) const { return dev == other.dev && ino == other.ino; }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const;
+    };
+    struct Entry {
+        std::uint64_t size = 0;
+        std::int64_t mtimeSec = 0;
+        std::uint32_t mtimeNsec = 0;
+        std::uint8_t digest[32] = {};
+    };
+
+    bool load(FsOps::Error& err);
+    bool compact(FsOps::Error& err);
+    void storeQuietly(const struct stat& before, const std::string& path, const std::string& hexHash);
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    int fd_ = -1;
+    std::size_t records_ = 0;
+    std::unordered_map<Key, Entry, KeyHash> entries_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_HASH_CACHE_H
@@ -7,15 +7,26 @@
 #define IFILEOPS_H
 
 #include <QDateTime>
+#include <QList>
 #include <QObject>
 #include <QString>
 #include <QStringList>
 #include <QtGlobal>
 
+#include "progress_board.h"
+
 namespace PCManFM {
 
 enum class FileOpType { Copy, Move, Delete };
 
+// When copied data is flushed to disk: never explicitly, once after the whole request, or
+// after every file (safest, slowest on rotating media and network mounts).
+enum class FileOpDurability { None, BatchEnd, PerFile };
+
+// I/O scheduling class of the threads running a request: unchanged, lowest best-effort, or
+// idle (disk time only when nothing else wants it).
+enum class FileOpIoPriority { Default, BestEffort, Idle };
+
 struct FileOpRequest {
     FileOpType type;
     QStringList sources;
@@ -23,6 +34,21 @@ struct FileOpRequest {
     bool followSymlinks;
     bool overwriteExisting;
     bool preserveOwnership = false;
+    FileOpDurability durability = FileOpDurability::PerFile;
+    unsigned copyWorkers = 0;       // parallel file-body copies in directory trees; 0 = automatic, 1 = serial
+    unsigned deleteWorkers = 0;     // parallel removal of sibling subdirectories; 0 = automatic, 1 = serial
+    bool verifyCopies = false;      // re-read and compare every copied file against the source digest
+    bool scanAhead = true;          // count the source tree on a second thread so totals converge early
+    bool streamingMove = false;     // cross-device moves delete each source as soon as its copy is durable
+    bool resumable = false;         // journal copies and moves so an interrupted run can be resumed
+    quint64 maxBytesPerSecond = 0;  // copy bandwidth limit; 0 = unlimited
+    quint32 maxOpsPerSecond = 0;    // copy I/O request limit; 0 = unlimited
+    bool adaptiveThrottle = false;  // back off further while the system is under I/O pressure
+    quint64 directIoThreshold = 0;  // files at least this large bypass the page cache; 0 = never
+    quint64 deltaThreshold = 0;     // existing destinations this large get only changed blocks; 0 = never
+    // directories that are btrfs subvolumes are duplicated as snapshots of them, at once
+    bool snapshotDirectories = false;
+    FileOpIoPriority ioPriority = FileOpIoPriority::Default;
 };
 
 struct FileOpProgress {
@@ -31,6 +57,7 @@ struct FileOpProgress {
     int filesDone;
     int filesTotal;
     QString currentPath;
+    bool totalsEstimated = false;  // bytesTotal may still grow while the source is scanned
 };
 
 class IFileOps : public QObject {
@@ -43,6 +70,31 @@ class IFileOps : public QObject {
     virtual void start(const FileOpRequest& req) = 0;
     virtual void cancel() = 0;
 
+    // Resuming interrupted transfers. A resumable request that did not finish leaves its
+    // journal behind; starting the same request again skips what was already copied and
+    // continues partial files. Backends without journals report no support and no transfers.
+    virtual bool supportsResume() const { return false; }
+    virtual QList<FileOpRequest> interruptedTransfers() const { return {}; }
+    virtual bool discardInterruptedTransfer(const FileOpRequest& req) {
+        Q_UNUSED(req);
+        return false;
+    }
+
+    // Holds the running request at its next progress report until unpaused. Backends that
+    // cannot pause ignore it.
+    virtual void setPaused(bool paused) { Q_UNUSED(paused); }
+
+    // Changes the rate limits of the running request (see FileOpRequest::maxBytesPerSecond);
+    // 0 lifts a limit. Backends without throttling ignore it.
+    virtual void setRateLimits(quint64 bytesPerSecond, quint32 opsPerSecond) {
+        Q_UNUSED(bytesPerSecond);
+        Q_UNUSED(opsPerSecond);
+    }
+
+    // The live progress of the running request, for UIs that rather read it on their own
+    // timer; progress() is only emitted every so often. Null when the backend has none.
+    virtual const FsOps::ProgressBoard* progressBoard() const { return nullptr; }
+
    Q_SIGNALS:
     void progress(const FileOpProgress& info);
     void finished(bool success, const QString& errorMessage);
@@ -0,0 +1,194 @@
+/*
+ * Token-bucket rate limiter for background file operations
+ * src/core/io_throttle.cpp
+ */
+
+#include "io_throttle.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace PCManFM::FsOps {
+
+namespace {
+
+constexpr double kBurstSeconds = 0.25;
+constexpr auto kSampleInterval = std::chrono::seconds(1);
+// Share of wall time in which at least one task stalled on I/O, in percent. Includes the
+// copy's own stalls, so adaptive mode settles where the device stops being saturated.
+constexpr double kHighPressure = 10.0;
+constexpr double kLowPressure = 2.0;
+constexpr double kMinScale = 1.0 / 64;
+// Floor for the base rate of an unlimited copy that has to back off.
+constexpr double kMinObservedRate = 1024.0 * 1024.0;
+
+// Parses "some avg10=<percent>" from a PSI file.
+bool read_pressure(const std::string& path, double& avg10) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char buffer[256];
+    const ssize_t n = ::read(fd, buffer, sizeof(buffer) - 1);
+    ::close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    buffer[n] = '\0';
+    const char* some = std::strstr(buffer, "some avg10=");
+    if (!some) {
+        return false;
+    }
+    char* end = nullptr;
+    avg10 = std::strtod(some + std::strlen("some avg10="), &end);
+    return end != some + std::strlen("some avg10=");
+}
+
+void clamp_tokens(double& tokens, double rate) {
+    tokens = rate > 0 ? std::min(tokens, rate * kBurstSeconds) : 0;
+}
+
+}  // namespace
+
+IoThrottle::IoThrottle(std::uint64_t bytesPerSecond, std::uint64_t opsPerSecond) {
+    setLimits(bytesPerSecond, opsPerSecond);
+}
+
+void IoThrottle::setLimits(std::uint64_t bytesPerSecond, std::uint64_t opsPerSecond) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const bool bytesWereUnlimited = bytes_.rate <= 0;
+    const bool opsWereUnlimited = ops_.rate <= 0;
+    bytesLimit_ = bytesPerSecond;
+    opsLimit_ = opsPerSecond;
+    bytes_.rate = effectiveByteRate();
+    ops_.rate = opsLimit_ > 0 ? static_cast<double>(opsLimit_) * scale_ : 0;
+    // A newly limited bucket starts full so the change does not stall the copy.
+    if (bytesWereUnlimited) {
+        bytes_.tokens = bytes_.rate * kBurstSeconds;
+    }
+    if (opsWereUnlimited) {
+        ops_.tokens = ops_.rate * kBurstSeconds;
+    }
+    clamp_tokens(bytes_.tokens, bytes_.rate);
+    clamp_tokens(ops_.tokens, ops_.rate);
+}
+
+std::uint64_t IoThrottle::bytesPerSecond() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytesLimit_;
+}
+
+std::uint64_t IoThrottle::opsPerSecond() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return opsLimit_;
+}
+
+void IoThrottle::setAdaptive(bool adaptive) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    adaptive_ = adaptive;
+    if (!adaptive_) {
+        scale_ = 1.0;
+        observedRate_ = 0;
+        bytes_.rate = effectiveByteRate();
+        ops_.rate = opsLimit_ > 0 ? static_cast<double>(opsLimit_) : 0;
+        clamp_tokens(bytes_.tokens, bytes_.rate);
+        clamp_tokens(ops_.tokens, ops_.rate);
+    }
+    windowBytes_ = 0;
+    windowStart_ = Clock::now();
+}
+
+bool IoThrottle::adaptive() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return adaptive_;
+}
+
+double IoThrottle::adaptiveScale() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scale_;
+}
+
+void IoThrottle::setPressurePathForTests(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pressurePath_ = path;
+}
+
+double IoThrottle::effectiveByteRate() const {
+    if (bytesLimit_ > 0) {
+        return static_cast<double>(bytesLimit_) * scale_;
+    }
+    if (scale_ < 1.0 && observedRate_ > 0) {
+        return observedRate_ * scale_;
+    }
+    return 0;
+}
+
+void IoThrottle::refill(Bucket& bucket, double seconds) const {
+    if (bucket.rate <= 0) {
+        bucket.tokens = 0;
+        return;
+    }
+    bucket.tokens = std::min(bucket.tokens + bucket.rate * seconds, bucket.rate * kBurstSeconds);
+}
+
+void IoThrottle::sample(Clock::time_point now) {
+    const double elapsed = std::chrono::duration<double>(now - windowStart_).count();
+    const double observed = elapsed > 0 ? static_cast<double>(windowBytes_) / elapsed : 0;
+    windowBytes_ = 0;
+    windowStart_ = now;
+
+    double pressure = 0;
+    if (!read_pressure(pressurePath_, pressure)) {
+        return;
+    }
+    if (pressure > kHighPressure) {
+        if (scale_ >= 1.0 && bytesLimit_ == 0) {
+            observedRate_ = std::max(observed, kMinObservedRate);
+        }
+        scale_ = std::max(kMinScale, scale_ / 2);
+    }
+    else if (pressure < kLowPressure && scale_ < 1.0) {
+        scale_ = std::min(1.0, scale_ * 1.25);
+        if (scale_ >= 1.0) {
+            observedRate_ = 0;
+        }
+    }
+    else {
+        return;
+    }
+    bytes_.rate = effectiveByteRate();
+    ops_.rate = opsLimit_ > 0 ? static_cast<double>(opsLimit_) * scale_ : 0;
+    clamp_tokens(bytes_.tokens, bytes_.rate);
+    clamp_tokens(ops_.tokens, ops_.rate);
+}
+
+IoThrottle::Clock::duration IoThrottle::reserve(std::uint64_t bytes, std::uint64_t ops) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Clock::time_point now = Clock::now();
+    const double seconds = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+    refill(bytes_, seconds);
+    refill(ops_, seconds);
+
+    windowBytes_ += bytes;
+    if (adaptive_ && now - windowStart_ >= kSampleInterval) {
+        sample(now);
+    }
+
+    double wait = 0;
+    if (bytes_.rate > 0) {
+        bytes_.tokens -= static_cast<double>(bytes);
+        wait = std::max(wait, -bytes_.tokens / bytes_.rate);
+    }
+    if (ops_.rate > 0) {
+        ops_.tokens -= static_cast<double>(ops);
+        wait = std::max(wait, -ops_.tokens / ops_.rate);
+    }
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait));
+}
+
+}  // namespace PCManFM::FsOps
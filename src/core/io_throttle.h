@@ -0,0 +1,83 @@
+/*
+ * Token-bucket rate limiter for background file operations (POSIX-only, no Qt)
+ * src/core/io_throttle.h
+ */
+
+#ifndef PCMANFM_IO_THROTTLE_H
+#define PCMANFM_IO_THROTTLE_H
+
+#include "fs_ops.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace PCManFM::FsOps {
+
+// IoThrottle limits the bytes and I/O requests per second of the copies it is attached to
+// (CopyOptions::throttle). Both limits are token buckets with a quarter second of burst; a
+// copy spends tokens after each chunk and sleeps off the debt, so the rate holds on average
+// even though single kernel copy chunks can be larger than a bucket. Limits may be changed
+// from any thread while copies are running; 0 means unlimited.
+//
+// In adaptive mode the throttle also samples the system's I/O pressure (PSI, "some avg10" of
+// /proc/pressure/io) about once a second. When other tasks stall on I/O the effective rate is
+// halved, down to 1/64 of the starting point, and it grows back by a quarter per calm sample.
+// Without PSI (older kernels, some containers) adaptive mode has no effect.
+class IoThrottle {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    IoThrottle() = default;
+    IoThrottle(std::uint64_t bytesPerSecond, std::uint64_t opsPerSecond);
+
+    IoThrottle(const IoThrottle&) = delete;
+    IoThrottle& operator=(const IoThrottle&) = delete;
+
+    void setLimits(std::uint64_t bytesPerSecond, std::uint64_t opsPerSecond);
+    std::uint64_t bytesPerSecond() const;
+    std::uint64_t opsPerSecond() const;
+
+    void setAdaptive(bool adaptive);
+    bool adaptive() const;
+    // Current back-off factor of adaptive mode, 1.0 when not backing off.
+    double adaptiveScale() const;
+
+    // Charges |bytes| and |ops| against the buckets and returns how long the caller has to
+    // wait before doing more I/O (zero when within the limits).
+    Clock::duration reserve(std::uint64_t bytes, std::uint64_t ops);
+
+    // Overrides the pressure source of adaptive mode; used by tests.
+    void setPressurePathForTests(const std::string& path);
+
+   private:
+    struct Bucket {
+        double tokens = 0;
+        double rate = 0;  // per second, 0 = unlimited
+    };
+
+    void refill(Bucket& bucket, double seconds) const;
+    void sample(Clock::time_point now);
+    double effectiveByteRate() const;
+
+    mutable std::mutex mutex_;
+    std::uint64_t bytesLimit_ = 0;
+    std::uint64_t opsLimit_ = 0;
+    Bucket bytes_;
+    Bucket ops_;
+    Clock::time_point last_ = Clock::now();
+
+    bool adaptive_ = false;
+    double scale_ = 1.0;
+    // Throughput seen when an unlimited copy first had to back off; the base that |scale_|
+    // applies to when no byte limit is configured.
+    double observedRate_ = 0;
+    std::uint64_t windowBytes_ = 0;
+    Clock::time_point windowStart_ = Clock::now();
+    std::string pressurePath_ = "/proc/pressure/io";
+};
+
+}  // namespace PCManFM::FsOps
+
+#endif  // PCMANFM_IO_THROTTLE_H
@@ -0,0 +1,649 @@
+/*
+ * Optional io_uring I/O engine for the POSIX file operation helpers (no Qt includes)
+ * src/core/io_uring_engine.cpp
+ *
+ * Talks to the kernel ABI directly (io_uring_setup/io_uring_enter plus the shared rings)
+ * so the build does not need liburing. Only the handful of opcodes used by fs_ops are
+ * wrapped; every ring is private to one thread.
+ */
+
+#include "io_uring_engine.h"
+
+#include <cerrno>
+
+#ifdef PCMANFM_HAVE_IO_URING
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace PCManFM::IoUring {
+
+namespace {
+
+constexpr unsigned kRingEntries = 64;
+constexpr std::size_t kChunkSize = 256 * 1024;
+constexpr std::size_t kCopyDepth = 4;
+constexpr std::size_t kReadAhead = 2;
+
+class Ring {
+   public:
+    Ring() {
+        io_uring_params params{};
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kRingEntries, &params));
+        if (fd_ < 0) {
+            return;
+        }
+
+        sqLen_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqLen_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            sqLen_ = cqLen_ = std::max(sqLen_, cqLen_);
+        }
+
+        sqPtr_ = ::mmap(nullptr, sqLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sqPtr_ == MAP_FAILED) {
+            sqPtr_ = nullptr;
+            return;
+        }
+        if (singleMmap) {
+            cqPtr_ = sqPtr_;
+        }
+        else {
+            cqPtr_ =
+                ::mmap(nullptr, cqLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            if (cqPtr_ == MAP_FAILED) {
+                cqPtr_ = nullptr;
+                return;
+            }
+        }
+        sqesLen_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes =
+            ::mmap(nullptr, sqesLen_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        auto* sq = static_cast<std::uint8_t*>(sqPtr_);
+        sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto* cq = static_cast<std::uint8_t*>(cqPtr_);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        localTail_ = *sqTail_;
+        valid_ = true;
+    }
+
+    ~Ring() {
+        if (sqes_) {
+            ::munmap(sqes_, sqesLen_);
+        }
+        if (cqPtr_ && cqPtr_ != sqPtr_) {
+            ::munmap(cqPtr_, cqLen_);
+        }
+        if (sqPtr_) {
+            ::munmap(sqPtr_, sqLen_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    bool valid() const { return valid_; }
+
+    // Returns a zeroed SQE, or nullptr when the submission queue is full.
+    io_uring_sqe* nextSqe() {
+        const unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (localTail_ - head >= sqEntries_) {
+            return nullptr;
+        }
+        const unsigned index = localTail_ & sqMask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray_[index] = index;
+        ++localTail_;
+        ++inFlight_;
+        return sqe;
+    }
+
+    // Publishes queued SQEs and optionally waits for |waitFor| completions. Returns 0 or a
+    // positive errno value.
+    int submit(unsigned waitFor) {
+        __atomic_store_n(sqTail_, localTail_, __ATOMIC_RELEASE);
+        // Everything the kernel has not consumed yet, including leftovers from a short submit.
+        const unsigned toSubmit = localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        for (;;) {
+            const unsigned flags = waitFor > 0 ? IORING_ENTER_GETEVENTS : 0;
+            const long rc = ::syscall(__NR_io_uring_enter, fd_, toSubmit, waitFor, flags, nullptr, 0);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            return 0;
+        }
+    }
+
+    bool popCompletion(std::uint64_t& userData, int& result) {
+        const unsigned head = *cqHead_;
+        const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            return false;
+        }
+        const io_uring_cqe& cqe = cqes_[head & cqMask_];
+        userData = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        if (inFlight_ > 0) {
+            --inFlight_;
+        }
+        return true;
+    }
+
+    // Blocks until one completion is available.
+    int waitCompletion(std::uint64_t& userData, int& result) {
+        while (!popCompletion(userData, result)) {
+            if (const int rc = submit(1)) {
+                return rc;
+            }
+        }
+        return 0;
+    }
+
+    // Waits for every queued SQE to complete, dropping the completions. False if the ring
+    // failed before they did.
+    bool drain() {
+        std::uint64_t userData = 0;
+        int result = 0;
+        while (inFlight_ > 0) {
+            if (waitCompletion(userData, result) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether the kernel handles |opcode|. Kernels before 5.6 cannot be asked, and have none
+    // of the opcodes used here (IORING_OP_READ and IORING_OP_WRITE came with 5.6,
+    // IORING_OP_UNLINKAT with 5.11).
+    bool supports(std::uint8_t opcode) const {
+        constexpr unsigned kProbeOps = 256;
+        const std::size_t size = sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op);
+        std::unique_ptr<std::uint8_t[]> buf(new std::uint8_t[size]());
+        auto* probe = reinterpret_cast<io_uring_probe*>(buf.get());
+        if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) {
+            return false;
+        }
+        return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+    }
+
+   private:
+    int fd_ = -1;
+    bool valid_ = false;
+    void* sqPtr_ = nullptr;
+    void* cqPtr_ = nullptr;
+    std::size_t sqLen_ = 0;
+    std::size_t cqLen_ = 0;
+    std::size_t sqesLen_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned localTail_ = 0;
+    unsigned inFlight_ = 0;  // queued SQEs whose completion was not popped yet
+};
+
+thread_local std::unique_ptr<Ring> tlRing;
+thread_local bool tlRingTried = false;
+
+// One ring per thread: copy workers never contend on a shared submission queue.
+Ring* threadRing() {
+    if (!tlRingTried) {
+        tlRingTried = true;
+        auto candidate = std::make_unique<Ring>();
+        if (candidate->valid()) {
+            tlRing = std::move(candidate);
+        }
+    }
+    return tlRing.get();
+}
+
+// Waits, when a helper returns, for whatever it left in flight on the thread's ring, so that
+// no buffer is freed while the kernel may still fill it and no stale completion reaches the
+// next helper. When the ring fails meanwhile, it is replaced by a new one on next use and
+// |leak| is called to give up the buffers, which the kernel may still write to.
+class DrainOnReturn {
+   public:
+    DrainOnReturn(Ring* ring, std::function<void()> leak) : ring_{ring}, leak_{std::move(leak)} {}
+
+    ~DrainOnReturn() {
+        if (!ring_->drain()) {
+            leak_();
+            tlRing.reset();
+            tlRingTried = false;
+        }
+    }
+
+    DrainOnReturn(const DrainOnReturn&) = delete;
+    DrainOnReturn& operator=(const DrainOnReturn&) = delete;
+
+   private:
+    Ring* ring_;
+    std::function<void()> leak_;
+};
+
+struct Support {
+    bool ring = false;
+    bool read = false;
+    bool write = false;
+    bool unlinkat = false;
+};
+
+const Support& support() {
+    static const Support probed = [] {
+        Support result;
+        Ring probe;
+        result.ring = probe.valid();
+        if (result.ring) {
+            result.read = probe.supports(IORING_OP_READ);
+            result.write = probe.supports(IORING_OP_WRITE);
+            result.unlinkat = probe.supports(IORING_OP_UNLINKAT);
+        }
+        return result;
+    }();
+    return probed;
+}
+
+void prepRead(io_uring_sqe* sqe, int fd, void* buf, std::size_t len, std::uint64_t offset, std::uint64_t tag) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len = static_cast<std::uint32_t>(len);
+    sqe->off = offset;
+    sqe->user_data = tag;
+}
+
+void prepWrite(io_uring_sqe* sqe, int fd, const void* buf, std::size_t len, std::uint64_t offset, std::uint64_t tag) {
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(buf);
+    sqe->len = static_cast<std::uint32_t>(len);
+    sqe->off = offset;
+    sqe->user_data = tag;
+}
+
+}  // namespace
+
+bool available() {
+    const Support& s = support();
+    return s.ring && (s.read || s.unlinkat);
+}
+
+int copy_range(int inFd,
+               int outFd,
+               std::uint64_t offset,
+               std::uint64_t end,
+               std::uint64_t& copied,
+               const ByteProgress& progress) {
+    Ring* ring = support().read && support().write ? threadRing() : nullptr;
+    if (!ring) {
+        return ENOSYS;
+    }
+
+    struct Slot {
+        std::unique_ptr<std::uint8_t[]> buf;
+        std::uint64_t offset = 0;  // file offset of buf[0]
+        std::size_t length = 0;    // bytes requested for this chunk
+        std::size_t filled = 0;    // bytes of the chunk already written out
+        std::size_t pending = 0;   // bytes read and waiting to be written
+        std::size_t written = 0;   // bytes of |pending| written so far
+        bool busy = false;
+        bool writing = false;
+    };
+    std::array<Slot, kCopyDepth> slots;
+    for (auto& slot : slots) {
+        slot.buf.reset(new std::uint8_t[kChunkSize]);
+    }
+    DrainOnReturn drainOnReturn{ring, [&slots] {
+                                    for (auto& slot : slots) {
+                                        slot.buf.release();
+                                    }
+                                }};
+
+    std::uint64_t next = offset;
+    bool eof = false;
+    int error = 0;
+    unsigned inFlight = 0;
+
+    auto queueRead = [&](std::size_t i) {
+        Slot& s = slots[i];
+        io_uring_sqe* sqe = ring->nextSqe();
+        if (!sqe) {
+            return false;
+        }
+        prepRead(sqe, inFd, s.buf.get() + s.filled, s.length - s.filled, s.offset + s.filled, i);
+        s.writing = false;
+        ++inFlight;
+        return true;
+    };
+    auto queueWrite = [&](std::size_t i) {
+        Slot& s = slots[i];
+        io_uring_sqe* sqe = ring->nextSqe();
+        if (!sqe) {
+            return false;
+        }
+        prepWrite(sqe, outFd, s.buf.get() + s.filled + s.written, s.pending - s.written,
+                  s.offset + s.filled + s.written, i);
+        s.writing = true;
+        ++inFlight;
+        return true;
+    };
+    auto startChunk = [&](std::size_t i) {
+        if (eof || next >= end || error) {
+            return false;
+        }
+        Slot& s = slots[i];
+        s.offset = next;
+        s.length = static_cast<std::size_t>(std::min<std::uint64_t>(kChunkSize, end - next));
+        s.filled = s.pending = s.written = 0;
+        s.busy = true;
+        next += s.length;
+        return queueRead(i);
+    };
+
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        startChunk(i);
+    }
+
+    while (inFlight > 0) {
+        if (const int rc = ring->submit(0)) {
+            error = rc;
+        }
+        std::uint64_t tag = 0;
+        int res = 0;
+        if (const int rc = ring->waitCompletion(tag, res)) {
+            // The ring itself broke; DrainOnReturn gives it up
+            return rc;
+        }
+        if (tag >= slots.size()) {
+            continue;
+        }
+        --inFlight;
+        Slot& s = slots[tag];
+
+        if (res == -EINTR || res == -EAGAIN) {
+            if (!error && !(s.writing ? queueWrite(tag) : queueRead(tag))) {
+                error = EBUSY;
+            }
+            continue;
+        }
+        if (res < 0) {
+            error = error ? error : -res;
+            s.busy = false;
+            continue;
+        }
+        if (error) {
+            s.busy = false;
+            continue;
+        }
+
+        if (!s.writing) {
+            if (res == 0) {
+                // End of file: later chunks will see EOF too.
+                eof = true;
+                s.busy = false;
+                continue;
+            }
+            s.pending = static_cast<std::size_t>(res);
+            s.written = 0;
+            if (!queueWrite(tag)) {
+                error = EBUSY;
+            }
+            continue;
+        }
+
+        s.written += static_cast<std::size_t>(res);
+        if (s.written < s.pending) {
+            if (!queueWrite(tag)) {
+                error = EBUSY;
+            }
+            continue;
+        }
+
+        s.filled += s.pending;
+        copied += s.pending;
+        if (progress && !progress(s.pending)) {
+            error = ECANCELED;
+            s.busy = false;
+            continue;
+        }
+        s.pending = s.written = 0;
+        if (s.filled < s.length && !eof) {
+            // Short read in the middle of the file; fetch the rest of this chunk.
+            if (!queueRead(tag)) {
+                error = EBUSY;
+            }
+            continue;
+        }
+        s.busy = false;
+        startChunk(tag);
+    }
+
+    return error;
+}
+
+int read_stream(int fd, const std::function<void(const std::uint8_t*, std::size_t)>& consume) {
+    Ring* ring = support().read ? threadRing() : nullptr;
+    if (!ring) {
+        return ENOSYS;
+    }
+
+    struct Slot {
+        std::unique_ptr<std::uint8_t[]> buf;
+        std::uint64_t offset = 0;
+        int result = 0;
+        bool queued = false;
+        bool done = false;
+    };
+    std::array<Slot, kReadAhead> slots;
+    for (auto& slot : slots) {
+        slot.buf.reset(new std::uint8_t[kChunkSize]);
+    }
+    DrainOnReturn drainOnReturn{ring, [&slots] {
+                                    for (auto& slot : slots) {
+                                        slot.buf.release();
+                                    }
+                                }};
+
+    std::uint64_t next = 0;
+    auto queueAt = [&](std::size_t i, std::uint64_t offset) {
+        io_uring_sqe* sqe = ring->nextSqe();
+        if (!sqe) {
+            return false;
+        }
+        prepRead(sqe, fd, slots[i].buf.get(), kChunkSize, offset, i);
+        slots[i].offset = offset;
+        slots[i].queued = true;
+        slots[i].done = false;
+        return true;
+    };
+    auto waitFor = [&](std::size_t i) {
+        while (slots[i].queued && !slots[i].done) {
+            std::uint64_t tag = 0;
+            int res = 0;
+            if (const int rc = ring->waitCompletion(tag, res)) {
+                return rc;
+            }
+            if (tag < slots.size()) {
+                slots[tag].result = res;
+                slots[tag].done = true;
+            }
+        }
+        return 0;
+    };
+    // Waits out every outstanding read so no buffer is released while the kernel uses it.
+    auto drain = [&]() {
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+            if (const int rc = waitFor(i)) {
+                return rc;
+            }
+            slots[i].queued = false;
+        }
+        return 0;
+    };
+    // (Re)starts read-ahead at |offset|: slot |first| first, the others after it in order.
+    auto restart = [&](std::size_t first, std::uint64_t offset) {
+        next = offset;
+        for (std::size_t k = 0; k < slots.size(); ++k) {
+            if (!queueAt((first + k) % slots.size(), next)) {
+                return EBUSY;
+            }
+            next += kChunkSize;
+        }
+        return ring->submit(0);
+    };
+
+    if (const int rc = restart(0, 0)) {
+        drain();
+        return rc;
+    }
+
+    std::size_t current = 0;
+    for (;;) {
+        if (const int rc = waitFor(current)) {
+            return rc;
+        }
+        Slot& s = slots[current];
+        s.queued = false;
+        const int res = s.result;
+
+        if (res == -EINTR || res == -EAGAIN) {
+            if (!queueAt(current, s.offset) || ring->submit(0) != 0) {
+                drain();
+                return EBUSY;
+            }
+            continue;
+        }
+        if (res <= 0) {
+            // EOF or a hard error; anything read ahead is past it.
+            const int rc = drain();
+            return res < 0 ? -res : rc;
+        }
+
+        consume(s.buf.get(), static_cast<std::size_t>(res));
+
+        if (static_cast<std::size_t>(res) < kChunkSize) {
+            // Short read before EOF (or EOF itself next time): drop read-ahead and resume
+            // exactly where this chunk ended.
+            const std::uint64_t resumeAt = s.offset + static_cast<std::uint64_t>(res);
+            if (const int rc = drain()) {
+                return rc;
+            }
+            if (const int rc = restart(current, resumeAt)) {
+                drain();
+                return rc;
+            }
+            continue;
+        }
+
+        if (!queueAt(current, next) || ring->submit(0) != 0) {
+            drain();
+            return EBUSY;
+        }
+        next += kChunkSize;
+        current = (current + 1) % slots.size();
+    }
+}
+
+int unlink_batch(int dirfd, const std::vector<std::string>& names, int flags, std::vector<int>& results) {
+    results.assign(names.size(), 0);
+    Ring* ring = support().unlinkat ? threadRing() : nullptr;
+    if (!ring) {
+        results.assign(names.size(), ENOSYS);
+        return ENOSYS;
+    }
+    // the kernel copies each name as it takes the SQE, so there is nothing to give up
+    DrainOnReturn drainOnReturn{ring, [] {}};
+
+    std::size_t queued = 0;
+    std::size_t completed = 0;
+    while (completed < names.size()) {
+        while (queued < names.size()) {
+            io_uring_sqe* sqe = ring->nextSqe();
+            if (!sqe) {
+                break;
+            }
+            sqe->opcode = IORING_OP_UNLINKAT;
+            sqe->fd = dirfd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(names[queued].c_str());
+            sqe->unlink_flags = static_cast<std::uint32_t>(flags);
+            sqe->user_data = queued;
+            ++queued;
+        }
+        if (const int rc = ring->submit(1)) {
+            return rc;
+        }
+        std::uint64_t tag = 0;
+        int res = 0;
+        while (ring->popCompletion(tag, res)) {
+            if (tag < results.size()) {
+                results[tag] = res < 0 ? -res : 0;
+                ++completed;
+            }
+        }
+    }
+    return 0;
+}
+
+}  // namespace PCManFM::IoUring
+
+#else  // !PCMANFM_HAVE_IO_URING
+
+namespace PCManFM::IoUring {
+
+bool available() {
+    return false;
+}
+
+int copy_range(int, int, std::uint64_t, std::uint64_t, std::uint64_t&, const ByteProgress&) {
+    return ENOSYS;
+}
+
+int read_stream(int, const std::function<void(const std::uint8_t*, std::size_t)>&) {
+    return ENOSYS;
+}
+
+int unlink_batch(int, const std::vector<std::string>& names, int, std::vector<int>& results) {
+    results.assign(names.size(), ENOSYS);
+    return ENOSYS;
+}
+
+}  // namespace PCManFM::IoUring
+
+#endif  // PCMANFM_HAVE_IO_URING
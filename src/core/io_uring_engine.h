@@ -0,0 +1,49 @@
+/*
+ * Optional io_uring I/O engine for the POSIX file operation helpers (no Qt includes)
+ * src/core/io_uring_engine.h
+ */
+
+#ifndef PCMANFM_IO_URING_ENGINE_H
+#define PCMANFM_IO_URING_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace PCManFM::IoUring {
+
+// True when io_uring support was compiled in (PCMANFM_HAVE_IO_URING), the running kernel
+// lets this process create a ring and it handles some of the opcodes used here. Probed once;
+// containers and hardened kernels often disable io_uring, in which case every helper below
+// reports ENOSYS and callers fall back to plain syscalls. So does each helper whose opcodes
+// the kernel lacks: reads and writes need Linux 5.6, unlinkat 5.11.
+bool available();
+
+// Called after every completed write with the number of bytes that landed; returning false
+// cancels the copy. Every helper waits for its requests in flight before it returns.
+using ByteProgress = std::function<bool(std::uint64_t bytes)>;
+
+// Copies [offset, end) from inFd to outFd with several read/write requests in flight on the
+// calling thread's ring. |end| may be UINT64_MAX to copy until EOF. |copied| is advanced by
+// the bytes written so a caller can resume elsewhere. Returns 0 on success, a positive
+// errno value on failure, or ECANCELED when |progress| asked to stop.
+int copy_range(int inFd,
+               int outFd,
+               std::uint64_t offset,
+               std::uint64_t end,
+               std::uint64_t& copied,
+               const ByteProgress& progress);
+
+// Sequentially reads fd from offset 0 to EOF with read-ahead, handing each chunk to
+// |consume| in file order. Returns 0 or a positive errno value.
+int read_stream(int fd, const std::function<void(const std::uint8_t*, std::size_t)>& consume);
+
+// Submits one unlinkat(dirfd, name, flags) per entry as a single batch. results[i] receives
+// 0 or a positive errno value for names[i]. Returns 0 unless the ring itself failed.
+int unlink_batch(int dirfd, const std::vector<std::string>& names, int flags, std::vector<int>& results);
+
+}  // namespace PCManFM::IoUring
+
+#endif  // PCMANFM_IO_URING_ENGINE_H
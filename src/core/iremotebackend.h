@@ -7,11 +7,33 @@
 
 #include <QString>
 #include <QUrl>
+#include <QtGlobal>
+
+#include <cerrno>
+#include <functional>
 
 class IRemoteBackend {
    public:
+    // Bytes copied so far and the size of the file; returns false to cancel.
+    using ProgressFunc = std::function<bool(quint64 done, quint64 total)>;
+
     virtual ~IRemoteBackend() = default;
 
     virtual bool isRemote(const QUrl& url) const = 0;
     virtual QString mapToMountPoint(const QUrl& url) = 0;
-};
\ No newline at end of file
+
+    // Copies the regular file |source| to |destination|, one of them remote and the other
+    // local, replacing an existing destination only with |overwrite|. Returns 0 or the errno
+    // of the failure; ENOTSUP leaves the file to GIO, as for a server that has to ask the
+    // user something first.
+    virtual int copyFile(const QUrl& source,
+                         const QUrl& destination,
+                         bool overwrite,
+                         const ProgressFunc& progress) {
+        Q_UNUSED(source);
+        Q_UNUSED(destination);
+        Q_UNUSED(overwrite);
+        Q_UNUSED(progress);
+        return ENOTSUP;
+    }
+};
@@ -0,0 +1,105 @@
+/*
+ * Process-wide registry of shared file readers (POSIX-only, no Qt)
+ * src/core/mapped_file_registry.cpp
+ */
+
+#include "mapped_file_registry.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+
+#include <sys/stat.h>
+
+namespace PCManFM {
+
+namespace {
+
+WindowedFileReader::Identity identityOf(const struct stat& st) {
+    WindowedFileReader::Identity identity;
+    identity.dev = static_cast<std::uint64_t>(st.st_dev);
+    identity.ino = static_cast<std::uint64_t>(st.st_ino);
+    identity.size = static_cast<std::uint64_t>(st.st_size);
+    identity.mtimeSec = static_cast<std::int64_t>(st.st_mtim.tv_sec);
+    identity.mtimeNsec = static_cast<std::int64_t>(st.st_mtim.tv_nsec);
+    return identity;
+}
+
+}  // namespace
+
+std::size_t MappedFileRegistry::KeyHash::operator()(const Key& key) const {
+    return std::hash<std::uint64_t>()(key.ino * 0x9E3779B97F4A7C15ull ^ key.dev);
+}
+
+MappedFileRegistry& MappedFileRegistry::instance() {
+    static MappedFileRegistry registry;
+    return registry;
+}
+
+std::shared_ptr<const WindowedFileReader> MappedFileRegistry::open(const std::string& path, std::string& errorOut) {
+    // The reader itself refuses symlinks, so looking through one here only finds a key
+    // that open() below then fails on.
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0) {
+        errorOut = std::string("stat: ") + std::strerror(errno);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto shared = findLocked(identityOf(st))) {
+        return shared;
+    }
+    // Opening under the lock keeps two callers from mapping the same file twice; it is an
+    // open() and an fstat(), windows are mapped later on demand.
+    auto reader = std::make_shared<const WindowedFileReader>(path, kWindowSize, &errorOut);
+    if (!reader->valid()) {
+        return nullptr;
+    }
+    pruneLocked();
+    const WindowedFileReader::Identity& identity = reader->identity();
+    readers_[Key{identity.dev, identity.ino}] = reader;
+    return reader;
+}
+
+std::shared_ptr<const WindowedFileReader> MappedFileRegistry::find(const struct stat& st) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return findLocked(identityOf(st));
+}
+
+std::shared_ptr<const WindowedFileReader> MappedFileRegistry::findLocked(
+    const WindowedFileReader::Identity& identity) {
+    const auto it = readers_.find(Key{identity.dev, identity.ino});
+    if (it == readers_.end()) {
+        return nullptr;
+    }
+    auto reader = it->second.lock();
+    if (!reader) {
+        readers_.erase(it);
+        return nullptr;
+    }
+    // A mismatch means the file was rewritten in place since it was mapped; open() then
+    // replaces the entry.
+    return reader->identity() == identity ? reader : nullptr;
+}
+
+void MappedFileRegistry::invalidate(std::uint64_t dev, std::uint64_t ino) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    readers_.erase(Key{dev, ino});
+}
+
+std::size_t MappedFileRegistry::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t alive = 0;
+    for (const auto& entry : readers_) {
+        alive += entry.second.expired() ? 0 : 1;
+    }
+    return alive;
+}
+
+void MappedFileRegistry::pruneLocked() {
+    for (auto it = readers_.begin(); it != readers_.end();) {
+        it = it->second.expired() ? readers_.erase(it) : std::next(it);
+    }
+}
+
+}  // namespace PCManFM
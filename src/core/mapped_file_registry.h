@@ -0,0 +1,72 @@
+/*
+ * Process-wide registry of shared file readers (POSIX-only, no Qt)
+ * src/core/mapped_file_registry.h
+ */
+
+#ifndef PCMANFM_MAPPED_FILE_REGISTRY_H
+#define PCMANFM_MAPPED_FILE_REGISTRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "windowed_file_reader.h"
+
+struct stat;
+
+namespace PCManFM {
+
+// MappedFileRegistry hands out one WindowedFileReader per file, keyed by (device, inode), so
+// the hex editor, the disassembler and hashing share a descriptor and a window cache instead
+// of each mapping the file again. The registry only holds weak references: a reader lives as
+// long as someone uses it. A reader is shared only while the file still has the size and
+// mtime it was opened with; a file rewritten since gets a fresh one. Safe to share between
+// threads.
+class MappedFileRegistry {
+   public:
+    static constexpr std::size_t kWindowSize = 8 * 1024 * 1024;
+
+    MappedFileRegistry() = default;
+
+    MappedFileRegistry(const MappedFileRegistry&) = delete;
+    MappedFileRegistry& operator=(const MappedFileRegistry&) = delete;
+
+    static MappedFileRegistry& instance();
+
+    // The shared reader for |path|, opening one if nobody holds a current one. Returns null
+    // and fills errorOut when the file cannot be opened.
+    std::shared_ptr<const WindowedFileReader> open(const std::string& path, std::string& errorOut);
+
+    // The reader already open for the file described by |st|, or null. Never opens anything.
+    std::shared_ptr<const WindowedFileReader> find(const struct stat& st);
+
+    // Forgets the reader for (dev, ino) so the next open() maps the file afresh. Readers
+    // already handed out keep working on the bytes they mapped.
+    void invalidate(std::uint64_t dev, std::uint64_t ino);
+
+    // Number of readers currently alive.
+    std::size_t size() const;
+
+   private:
+    struct Key {
+        std::uint64_t dev = 0;
+        std::uint64_t ino = 0;
+        bool operator==(const Key& other) const { return dev == other.dev && ino == other.ino; }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const;
+    };
+
+    std::shared_ptr<const WindowedFileReader> findLocked(const WindowedFileReader::Identity& identity);
+    void pruneLocked();
+
+    mutable std::mutex mutex_;
+    std::unordered_map<Key, std::weak_ptr<const WindowedFileReader>, KeyHash> readers_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_MAPPED_FILE_REGISTRY_H
@@ -0,0 +1,323 @@
+/*
+ * In-place file patching with a rollback journal (POSIX-only, no Qt)
+ * src/core/patch_journal.cpp
+ */
+
+#include "patch_journal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+// Journal layout, native byte order: magic | u64 file size | u64 record count, then per
+// record u64 offset | u64 length | the original bytes.
+constexpr char kMagic[8] = {'P', 'C', 'M', 'F', 'H', 'P', 'J', '1'};
+constexpr std::size_t kHeaderSize = sizeof(kMagic) + 8 + 8;
+constexpr std::size_t kChunk = 64 * 1024;
+
+std::string errno_message(const char* context) {
+    return std::string(context) + ": " + std::strerror(errno);
+}
+
+bool write_all(int fd, const void* data, std::size_t size, std::string& errorOut) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errorOut = errno_message("write");
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool pwrite_all(int fd, const void* data, std::size_t size, std::uint64_t offset, std::string& errorOut) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errorOut = errno_message("pwrite");
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+// Reads exactly |size| bytes; running into EOF is reported as a truncated journal.
+bool pread_all(int fd, void* data, std::size_t size, std::uint64_t offset, std::string& errorOut) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::pread(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errorOut = errno_message("pread");
+            return false;
+        }
+        if (n == 0) {
+            errorOut = "Unexpected end of file";
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+// Makes a rename in the directory holding |path| durable. Some filesystems refuse to sync
+// directories, so this is best effort.
+void sync_parent(const std::string& path) {
+    const auto slash = path.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    const int fd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+// Saves the bytes of |fd| covered by |patches| into a new journal at |journalPath|.
+bool write_journal(int fd,
+                   std::uint64_t fileSize,
+                   const std::vector<FilePatch>& patches,
+                   const std::string& journalPath,
+                   std::string& errorOut) {
+    std::vector<char> tmpl(journalPath.begin(), journalPath.end());
+    const char suffix[] = ".XXXXXX";
+    tmpl.insert(tmpl.end(), suffix, suffix + sizeof(suffix));
+    const int out = ::mkstemp(tmpl.data());
+    if (out < 0) {
+        errorOut = errno_message("mkstemp");
+        return false;
+    }
+
+    std::uint8_t header[kHeaderSize];
+    const std::uint64_t count = patches.size();
+    std::memcpy(header, kMagic, sizeof(kMagic));
+    std::memcpy(header + sizeof(kMagic), &fileSize, 8);
+    std::memcpy(header + sizeof(kMagic) + 8, &count, 8);
+    bool ok = write_all(out, header, sizeof(header), errorOut);
+
+    std::vector<std::uint8_t> buffer(kChunk);
+    for (const FilePatch& patch : patches) {
+        if (!ok) {
+            break;
+        }
+        const std::uint64_t length = patch.length;
+        std::uint8_t record[16];
+        std::memcpy(record, &patch.offset, 8);
+        std::memcpy(record + 8, &length, 8);
+        ok = write_all(out, record, sizeof(record), errorOut);
+        for (std::size_t done = 0; ok && done < patch.length;) {
+            const std::size_t n = std::min(kChunk, patch.length - done);
+            ok = pread_all(fd, buffer.data(), n, patch.offset + done, errorOut) &&
+                 write_all(out, buffer.data(), n, errorOut);
+            done += n;
+        }
+    }
+
+    if (ok && ::fsync(out) < 0) {
+        errorOut = errno_message("fsync");
+        ok = false;
+    }
+    if (::close(out) < 0 && ok) {
+        errorOut = errno_message("close");
+        ok = false;
+    }
+    if (ok && ::rename(tmpl.data(), journalPath.c_str()) < 0) {
+        errorOut = errno_message("rename");
+        ok = false;
+    }
+    if (!ok) {
+        ::unlink(tmpl.data());
+        return false;
+    }
+    sync_parent(journalPath);
+    return true;
+}
+
+// Copies every record of the journal on |journal| back into |fd| and syncs it.
+bool replay_journal(int journal, int fd, std::uint64_t fileSize, std::string& errorOut) {
+    std::uint8_t header[kHeaderSize];
+    if (!pread_all(journal, header, sizeof(header), 0, errorOut)) {
+        errorOut = "Cannot read the patch journal: " + errorOut;
+        return false;
+    }
+    std::uint64_t recordedSize = 0;
+    std::uint64_t count = 0;
+    std::memcpy(&recordedSize, header + sizeof(kMagic), 8);
+    std::memcpy(&count, header + sizeof(kMagic) + 8, 8);
+    if (std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        errorOut = "The patch journal is not in a recognised format";
+        return false;
+    }
+    if (recordedSize != fileSize) {
+        errorOut = "The patch journal does not match the size of the file";
+        return false;
+    }
+
+    std::uint64_t pos = kHeaderSize;
+    std::vector<std::uint8_t> buffer(kChunk);
+    for (std::uint64_t i = 0; i < count; ++i) {
+        std::uint8_t record[16];
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+        if (!pread_all(journal, record, sizeof(record), pos, errorOut)) {
+            errorOut = "Cannot read the patch journal: " + errorOut;
+            return false;
+        }
+        std::memcpy(&offset, record, 8);
+        std::memcpy(&length, record + 8, 8);
+        pos += sizeof(record);
+        if (offset > fileSize || length > fileSize - offset) {
+            errorOut = "The patch journal refers to bytes outside the file";
+            return false;
+        }
+        for (std::uint64_t done = 0; done < length;) {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(kChunk, length - done));
+            if (!pread_all(journal, buffer.data(), n, pos, errorOut)) {
+                errorOut = "Cannot read the patch journal: " + errorOut;
+                return false;
+            }
+            if (!pwrite_all(fd, buffer.data(), n, offset + done, errorOut)) {
+                return false;
+            }
+            pos += n;
+            done += n;
+        }
+    }
+    if (::fsync(fd) < 0) {
+        errorOut = errno_message("fsync");
+        return false;
+    }
+    return true;
+}
+
+// Puts the journaled bytes back after a failed patch. Keeps the journal when that fails too,
+// so recover_patch_journal() can retry.
+void roll_back(int fd, std::uint64_t fileSize, const std::string& journalPath) {
+    const int journal = ::open(journalPath.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (journal < 0) {
+        return;
+    }
+    std::string ignored;
+    const bool restored = replay_journal(journal, fd, fileSize, ignored);
+    ::close(journal);
+    if (restored) {
+        ::unlink(journalPath.c_str());
+    }
+}
+
+}  // namespace
+
+bool patch_file_in_place(int fd,
+                         const std::vector<FilePatch>& patches,
+                         const std::string& journalPath,
+                         std::string& errorOut) {
+    struct stat st{};
+    if (::fstat(fd, &st) < 0) {
+        errorOut = errno_message("fstat");
+        return false;
+    }
+    const std::uint64_t fileSize = static_cast<std::uint64_t>(st.st_size);
+    for (const FilePatch& patch : patches) {
+        if (patch.offset > fileSize || patch.length > fileSize - patch.offset) {
+            errorOut = "Patch at offset " + std::to_string(patch.offset) + " extends past the end of the file";
+            return false;
+        }
+    }
+
+    const bool journaled = !journalPath.empty();
+    if (journaled && !write_journal(fd, fileSize, patches, journalPath, errorOut)) {
+        return false;
+    }
+
+    bool ok = true;
+    for (const FilePatch& patch : patches) {
+        if (!pwrite_all(fd, patch.data, patch.length, patch.offset, errorOut)) {
+            ok = false;
+            break;
+        }
+    }
+    if (ok && ::fsync(fd) < 0) {
+        errorOut = errno_message("fsync");
+        ok = false;
+    }
+
+    if (!ok) {
+        if (journaled) {
+            roll_back(fd, fileSize, journalPath);
+        }
+        return false;
+    }
+    if (journaled && ::unlink(journalPath.c_str()) < 0 && errno != ENOENT) {
+        errorOut = errno_message("unlink");
+        return false;
+    }
+    return true;
+}
+
+bool recover_patch_journal(const std::string& path,
+                           const std::string& journalPath,
+                           bool& recovered,
+                           std::string& errorOut) {
+    recovered = false;
+    const int journal = ::open(journalPath.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (journal < 0) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        errorOut = errno_message("open");
+        return false;
+    }
+
+    const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        errorOut = errno_message("open");
+        ::close(journal);
+        return false;
+    }
+
+    struct stat st{};
+    bool ok = true;
+    if (::fstat(fd, &st) < 0) {
+        errorOut = errno_message("fstat");
+        ok = false;
+    }
+    ok = ok && replay_journal(journal, fd, static_cast<std::uint64_t>(st.st_size), errorOut);
+    ::close(fd);
+    ::close(journal);
+    if (!ok) {
+        return false;
+    }
+    if (::unlink(journalPath.c_str()) < 0 && errno != ENOENT) {
+        errorOut = errno_message("unlink");
+        return false;
+    }
+    recovered = true;
+    return true;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,46 @@
+/*
+ * In-place file patching with a rollback journal (POSIX-only, no Qt)
+ * src/core/patch_journal.h
+ */
+
+#ifndef PCMANFM_PATCH_JOURNAL_H
+#define PCMANFM_PATCH_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PCManFM {
+
+// One range to overwrite; |data| must stay valid for the duration of the call.
+struct FilePatch {
+    std::uint64_t offset = 0;
+    const std::uint8_t* data = nullptr;
+    std::size_t length = 0;
+};
+
+// Overwrites |patches| in the file open read-write on |fd| without changing its size, then
+// syncs it, so saving a few edited bytes costs only those bytes of I/O. Every patch must lie
+// inside the file.
+//
+// With a non-empty |journalPath| the bytes about to be replaced are saved there first; the
+// journal is synced and renamed into place before the file is touched, so it either exists
+// complete or not at all. It is deleted once the patched file is synced. When a write fails
+// midway, the saved bytes are put back before returning; a crash leaves the journal behind
+// for recover_patch_journal().
+bool patch_file_in_place(int fd,
+                         const std::vector<FilePatch>& patches,
+                         const std::string& journalPath,
+                         std::string& errorOut);
+
+// Rolls back a patch interrupted by a crash: if a journal exists at |journalPath|, writes the
+// bytes it saved back into |path| and deletes it. |recovered| reports whether there was one.
+bool recover_patch_journal(const std::string& path,
+                           const std::string& journalPath,
+                           bool& recovered,
+                           std::string& errorOut);
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_PATCH_JOURNAL_H
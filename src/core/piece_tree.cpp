@@ -0,0 +1,361 @@
+/*
+ * Balanced piece table for the hex editor (no Qt)
+ * src/core/piece_tree.cpp
+ */
+
+#include "piece_tree.h"
+
+#include <algorithm>
+
+namespace PCManFM {
+
+void PieceTree::Cursor::pushLeftmost(std::int32_t node) {
+    while (node >= 0) {
+        path_.push_back(node);
+        node = tree_->nodes_[node].left;
+    }
+}
+
+void PieceTree::Cursor::pushRightmost(std::int32_t node) {
+    while (node >= 0) {
+        path_.push_back(node);
+        node = tree_->nodes_[node].right;
+    }
+}
+
+void PieceTree::Cursor::next() {
+    if (path_.empty()) {
+        return;
+    }
+    const auto& nodes = tree_->nodes_;
+    start_ += nodes[path_.back()].piece.length;
+    if (nodes[path_.back()].right >= 0) {
+        pushLeftmost(nodes[path_.back()].right);
+        return;
+    }
+    // Climb until we leave a left subtree; its parent is the successor.
+    std::int32_t child = path_.back();
+    path_.pop_back();
+    while (!path_.empty() && nodes[path_.back()].right == child) {
+        child = path_.back();
+        path_.pop_back();
+    }
+}
+
+void PieceTree::Cursor::prev() {
+    if (path_.empty()) {
+        return;
+    }
+    const auto& nodes = tree_->nodes_;
+    if (nodes[path_.back()].left >= 0) {
+        pushRightmost(nodes[path_.back()].left);
+    }
+    else {
+        std::int32_t child = path_.back();
+        path_.pop_back();
+        while (!path_.empty() && nodes[path_.back()].left == child) {
+            child = path_.back();
+            path_.pop_back();
+        }
+    }
+    if (!path_.empty()) {
+        start_ -= nodes[path_.back()].piece.length;
+    }
+}
+
+void PieceTree::clear() {
+    nodes_.clear();
+    free_.clear();
+    root_ = -1;
+}
+
+void PieceTree::reset(std::uint64_t length) {
+    clear();
+    if (length > 0) {
+        Piece piece;
+        piece.kind = Piece::Kind::Original;
+        piece.length = length;
+        root_ = allocate(piece);
+    }
+}
+
+void PieceTree::update(std::int32_t node) {
+    Node& n = nodes_[node];
+    n.total = total(n.left) + n.piece.length + total(n.right);
+    n.added = added(n.left) + (n.piece.kind == Piece::Kind::Added ? 1 : 0) + added(n.right);
+}
+
+std::int32_t PieceTree::allocate(const Piece& piece) {
+    // xorshift32; the priorities only need to look random to keep the treap balanced
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+
+    Node node;
+    node.piece = piece;
+    node.total = piece.length;
+    node.added = piece.kind == Piece::Kind::Added ? 1 : 0;
+    node.priority = seed_;
+    if (!free_.empty()) {
+        const std::int32_t index = free_.back();
+        free_.pop_back();
+        nodes_[index] = node;
+        return index;
+    }
+    nodes_.push_back(node);
+    return static_cast<std::int32_t>(nodes_.size() - 1);
+}
+
+void PieceTree::release(std::int32_t node) {
+    std::vector<std::int32_t> pending;
+    if (node >= 0) {
+        pending.push_back(node);
+    }
+    while (!pending.empty()) {
+        const std::int32_t n = pending.back();
+        pending.pop_back();
+        if (nodes_[n].left >= 0) {
+            pending.push_back(nodes_[n].left);
+        }
+        if (nodes_[n].right >= 0) {
+            pending.push_back(nodes_[n].right);
+        }
+        free_.push_back(n);
+    }
+}
+
+std::int32_t PieceTree::merge(std::int32_t left, std::int32_t right) {
+    if (left < 0) {
+        return right;
+    }
+    if (right < 0) {
+        return left;
+    }
+    if (nodes_[left].priority > nodes_[right].priority) {
+        nodes_[left].right = merge(nodes_[left].right, right);
+        update(left);
+        return left;
+    }
+    nodes_[right].left = merge(left, nodes_[right].left);
+    update(right);
+    return right;
+}
+
+// Splits |node| into the first |offset| bytes and the rest, cutting a piece in two when the
+// offset falls inside it.
+void PieceTree::split(std::int32_t node, std::uint64_t offset, std::int32_t& left, std::int32_t& right) {
+    if (node < 0) {
+        left = right = -1;
+        return;
+    }
+    const std::uint64_t leftTotal = total(nodes_[node].left);
+    const std::uint64_t pieceEnd = leftTotal + nodes_[node].piece.length;
+    if (offset <= leftTotal) {
+        std::int32_t inner = -1;
+        split(nodes_[node].left, offset, left, inner);
+        nodes_[node].left = inner;
+        update(node);
+        right = node;
+    }
+    else if (offset >= pieceEnd) {
+        std::int32_t inner = -1;
+        split(nodes_[node].right, offset - pieceEnd, inner, right);
+        nodes_[node].right = inner;
+        update(node);
+        left = node;
+    }
+    else {
+        const std::uint64_t cut = offset - leftTotal;
+        Piece tail = nodes_[node].piece;
+        tail.sourceOffset += cut;
+        tail.length -= cut;
+        const std::int32_t tailNode = allocate(tail);  // may reallocate nodes_
+        const std::int32_t oldRight = nodes_[node].right;
+        nodes_[node].piece.length = cut;
+        nodes_[node].right = -1;
+        update(node);
+        left = node;
+        right = merge(tailNode, oldRight);
+    }
+}
+
+std::int32_t PieceTree::edge(std::int32_t node, bool rightmost) const {
+    while (node >= 0) {
+        const std::int32_t child = rightmost ? nodes_[node].right : nodes_[node].left;
+        if (child < 0) {
+            break;
+        }
+        node = child;
+    }
+    return node;
+}
+
+// Lengthens the first or last piece of |node| by |delta|, fixing the totals on the way down.
+void PieceTree::grow(std::int32_t node, bool rightmost, std::uint64_t delta) {
+    while (node >= 0) {
+        nodes_[node].total += delta;
+        const std::int32_t child = rightmost ? nodes_[node].right : nodes_[node].left;
+        if (child < 0) {
+            nodes_[node].piece.length += delta;
+            return;
+        }
+        node = child;
+    }
+}
+
+void PieceTree::replace(std::uint64_t offset, std::uint64_t length, const std::vector<Piece>& replacement) {
+    const std::uint64_t docSize = size();
+    offset = std::min(offset, docSize);
+    length = std::min(length, docSize - offset);
+
+    std::int32_t head = -1;
+    std::int32_t rest = -1;
+    std::int32_t removed = -1;
+    std::int32_t tail = -1;
+    split(root_, offset, head, rest);
+    split(rest, length, removed, tail);
+    release(removed);
+
+    for (const Piece& piece : replacement) {
+        if (piece.length == 0) {
+            continue;
+        }
+        const std::int32_t last = edge(head, true);
+        if (last >= 0 && continues(nodes_[last].piece, piece)) {
+            grow(head, true, piece.length);
+        }
+        else {
+            head = merge(head, allocate(piece));
+        }
+    }
+
+    const std::int32_t last = edge(head, true);
+    const std::int32_t first = edge(tail, false);
+    if (last >= 0 && first >= 0 && continues(nodes_[last].piece, nodes_[first].piece)) {
+        const std::uint64_t firstLength = nodes_[first].piece.length;
+        std::int32_t joined = -1;
+        split(tail, firstLength, joined, tail);
+        release(joined);
+        grow(head, true, firstLength);
+    }
+    root_ = merge(head, tail);
+}
+
+void PieceTree::slice(std::uint64_t offset, std::uint64_t length, std::vector<Piece>& out) const {
+    const std::uint64_t docSize = size();
+    offset = std::min(offset, docSize);
+    const std::uint64_t end = offset + std::min(length, docSize - offset);
+    for (auto it = seek(offset); it.valid() && it.start() < end; it.next()) {
+        Piece piece = it.piece();
+        const std::uint64_t skip = offset > it.start() ? offset - it.start() : 0;
+        piece.sourceOffset += skip;
+        piece.length = std::min(piece.length - skip, end - it.start() - skip);
+        out.push_back(piece);
+    }
+}
+
+PieceTree::Cursor PieceTree::seek(std::uint64_t offset) const {
+    Cursor cursor(this);
+    std::int32_t node = root_;
+    std::uint64_t base = 0;
+    while (node >= 0) {
+        cursor.path_.push_back(node);
+        const Node& n = nodes_[node];
+        const std::uint64_t leftTotal = total(n.left);
+        if (offset < base + leftTotal) {
+            node = n.left;
+        }
+        else if (offset < base + leftTotal + n.piece.length) {
+            cursor.start_ = base + leftTotal;
+            return cursor;
+        }
+        else {
+            base += leftTotal + n.piece.length;
+            node = n.right;
+        }
+    }
+    cursor.path_.clear();
+    return cursor;
+}
+
+PieceTree::Cursor PieceTree::last() const {
+    Cursor cursor(this);
+    cursor.pushRightmost(root_);
+    if (cursor.valid()) {
+        cursor.start_ = size() - cursor.piece().length;
+    }
+    return cursor;
+}
+
+// Looks for the added piece nextAdded() or prevAdded() wants below |node|, whose first byte
+// is at |base|, extending the path of |cursor| to it. Subtrees without added pieces or
+// entirely on the wrong side of |offset| are skipped, so O(log n) nodes are visited.
+bool PieceTree::findAdded(std::int32_t node,
+                          std::uint64_t base,
+                          std::uint64_t offset,
+                          bool forward,
+                          Cursor& cursor) const {
+    if (added(node) == 0) {
+        return false;
+    }
+    const Node& n = nodes_[node];
+    const std::uint64_t start = base + total(n.left);
+    const std::uint64_t end = start + n.piece.length;
+    const bool isAdded = n.piece.kind == Piece::Kind::Added;
+    cursor.path_.push_back(node);
+    if (forward) {
+        if (offset < start && findAdded(n.left, base, offset, true, cursor)) {
+            return true;
+        }
+        if (isAdded && end > offset) {
+            cursor.start_ = start;
+            return true;
+        }
+        if (findAdded(n.right, end, offset, true, cursor)) {
+            return true;
+        }
+    }
+    else {
+        if (offset >= end && findAdded(n.right, end, offset, false, cursor)) {
+            return true;
+        }
+        if (isAdded && start <= offset) {
+            cursor.start_ = start;
+            return true;
+        }
+        if (findAdded(n.left, base, offset, false, cursor)) {
+            return true;
+        }
+    }
+    cursor.path_.pop_back();
+    return false;
+}
+
+PieceTree::Cursor PieceTree::nextAdded(std::uint64_t offset) const {
+    Cursor cursor(this);
+    findAdded(root_, 0, offset, true, cursor);
+    return cursor;
+}
+
+PieceTree::Cursor PieceTree::prevAdded(std::uint64_t offset) const {
+    Cursor cursor(this);
+    findAdded(root_, 0, offset, false, cursor);
+    return cursor;
+}
+
+void PieceTree::addedRanges(std::uint64_t offset, std::uint64_t length, std::vector<Range>& out) const {
+    const std::uint64_t end = offset + std::min(length, size() - std::min(offset, size()));
+    const std::size_t first = out.size();
+    for (auto it = nextAdded(offset); it.valid() && it.start() < end; it = nextAdded(it.start() + it.piece().length)) {
+        const std::uint64_t start = std::max(offset, it.start());
+        const std::uint64_t stop = std::min(end, it.start() + it.piece().length);
+        if (out.size() > first && out.back().start + out.back().length == start) {
+            out.back().length += stop - start;
+        }
+        else {
+            out.push_back(Range{start, stop - start});
+        }
+    }
+}
+
+}  // namespace PCManFM
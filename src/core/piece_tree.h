@@ -0,0 +1,123 @@
+/*
+ * Balanced piece table for the hex editor (no Qt)
+ * src/core/piece_tree.h
+ */
+
+#ifndef PCMANFM_PIECE_TREE_H
+#define PCMANFM_PIECE_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace PCManFM {
+
+// PieceTree is the sequence of pieces describing an edited document: runs of the original
+// file or of an append-only buffer of added bytes. The pieces live in a treap ordered by
+// document position, each node caching the length of its subtree, so locating an offset,
+// splitting a piece and replacing a range are O(log n) in the number of pieces no matter
+// how scattered the edits are. Adjacent pieces that continue each other are coalesced. Each
+// node also counts the added pieces below it, so the edited ranges near an offset are found
+// without walking the untouched pieces in between.
+class PieceTree {
+   public:
+    struct Piece {
+        enum class Kind : std::uint8_t { Original, Added };
+        Kind kind = Kind::Original;
+        std::uint64_t sourceOffset = 0;
+        std::uint64_t length = 0;
+    };
+
+    // A range of the document.
+    struct Range {
+        std::uint64_t start = 0;
+        std::uint64_t length = 0;
+    };
+
+   private:
+    struct Node {
+        Piece piece;
+        std::uint64_t total = 0;  // bytes in this subtree
+        std::uint32_t added = 0;  // added pieces in this subtree
+        std::uint32_t priority = 0;
+        std::int32_t left = -1;
+        std::int32_t right = -1;
+    };
+
+   public:
+    // In-order position in the tree. Invalidated by any modification of the tree.
+    class Cursor {
+       public:
+        bool valid() const { return !path_.empty(); }
+        const Piece& piece() const { return tree_->nodes_[path_.back()].piece; }
+        // Document offset of the first byte of piece().
+        std::uint64_t start() const { return start_; }
+        void next();
+        void prev();
+
+       private:
+        friend class PieceTree;
+        explicit Cursor(const PieceTree* tree) : tree_(tree) {}
+        void pushLeftmost(std::int32_t node);
+        void pushRightmost(std::int32_t node);
+
+        const PieceTree* tree_;
+        std::vector<std::int32_t> path_;  // root to current node
+        std::uint64_t start_ = 0;
+    };
+
+    PieceTree() = default;
+
+    void clear();
+    // Replaces the contents with one original piece of |length| bytes (none if zero).
+    void reset(std::uint64_t length);
+
+    std::uint64_t size() const { return root_ < 0 ? 0 : nodes_[root_].total; }
+    std::size_t pieceCount() const { return nodes_.size() - free_.size(); }
+    bool empty() const { return root_ < 0; }
+
+    // Replaces [offset, offset + length) with |replacement|, in order. The range is clamped to
+    // the document; |offset| must not be past its end.
+    void replace(std::uint64_t offset, std::uint64_t length, const std::vector<Piece>& replacement);
+    // Appends the pieces covering [offset, offset + length) to |out|, trimmed to the range and
+    // clamped to the document.
+    void slice(std::uint64_t offset, std::uint64_t length, std::vector<Piece>& out) const;
+
+    // Cursor on the piece containing |offset|, or an invalid one when offset >= size().
+    Cursor seek(std::uint64_t offset) const;
+    Cursor first() const { return seek(0); }
+    // Cursor on the last piece, or an invalid one for an empty tree.
+    Cursor last() const;
+    // Cursor on the first added piece ending after |offset|, or an invalid one when none does.
+    Cursor nextAdded(std::uint64_t offset) const;
+    // Cursor on the last added piece starting at or before |offset|, or an invalid one.
+    Cursor prevAdded(std::uint64_t offset) const;
+    // Appends the ranges of added bytes within [offset, offset + length) to |out|, clipped to
+    // that range; adjacent added pieces make a single range. O(log n) per range.
+    void addedRanges(std::uint64_t offset, std::uint64_t length, std::vector<Range>& out) const;
+
+   private:
+    static bool continues(const Piece& a, const Piece& b) {
+        return a.kind == b.kind && a.sourceOffset + a.length == b.sourceOffset;
+    }
+
+    std::uint64_t total(std::int32_t node) const { return node < 0 ? 0 : nodes_[node].total; }
+    std::uint32_t added(std::int32_t node) const { return node < 0 ? 0 : nodes_[node].added; }
+    void update(std::int32_t node);
+    std::int32_t allocate(const Piece& piece);
+    void release(std::int32_t node);
+    std::int32_t merge(std::int32_t left, std::int32_t right);
+    void split(std::int32_t node, std::uint64_t offset, std::int32_t& left, std::int32_t& right);
+    std::int32_t edge(std::int32_t node, bool rightmost) const;
+    void grow(std::int32_t node, bool rightmost, std::uint64_t delta);
+    bool findAdded(std::int32_t node, std::uint64_t base, std::uint64_t offset, bool forward, Cursor& cursor) const;
+
+    std::vector<Node> nodes_;
+    std::vector<std::int32_t> free_;
+    std::int32_t root_ = -1;
+    std::uint32_t seed_ = 0x9e3779b9u;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_PIECE_TREE_H
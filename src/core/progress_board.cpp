@@ -0,0 +1,75 @@
+/*
+ * Lock-free progress shared between a file operation and the UI
+ * src/core/progress_board.cpp
+ */
+
+#include "progress_board.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace PCManFM::FsOps {
+
+void ProgressBoard::post(const ProgressInfo& info) {
+    if (info.currentPath != lastPath_) {
+        writePath(info.currentPath);
+    }
+    bytesDone_.store(info.bytesDone, std::memory_order_relaxed);
+    bytesTotal_.store(info.bytesTotal, std::memory_order_relaxed);
+    filesDone_.store(info.filesDone, std::memory_order_relaxed);
+    filesTotal_.store(info.filesTotal, std::memory_order_relaxed);
+    totalsEstimated_.store(info.totalsEstimated, std::memory_order_relaxed);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+void ProgressBoard::reset() {
+    post(ProgressInfo{});
+}
+
+void ProgressBoard::writePath(const std::string& path) {
+    lastPath_ = path;
+    const std::size_t length = std::min(path.size(), kMaxPathLength);
+
+    const std::uint64_t sequence = pathSequence_.load(std::memory_order_relaxed);
+    pathSequence_.store(sequence + 1, std::memory_order_relaxed);
+    // release stores, so that a reader seeing any of them also sees the odd sequence
+    for (std::size_t offset = 0, i = 0; offset < length; offset += sizeof(std::uint64_t), ++i) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, path.data() + offset, std::min(sizeof(word), length - offset));
+        path_[i].store(word, std::memory_order_release);
+    }
+    pathLength_.store(length, std::memory_order_release);
+    pathSequence_.store(sequence + 2, std::memory_order_release);
+}
+
+void ProgressBoard::read(Snapshot& snapshot) const {
+    snapshot.version = version_.load(std::memory_order_acquire);
+    snapshot.bytesDone = bytesDone_.load(std::memory_order_relaxed);
+    snapshot.bytesTotal = bytesTotal_.load(std::memory_order_relaxed);
+    snapshot.filesDone = filesDone_.load(std::memory_order_relaxed);
+    snapshot.filesTotal = filesTotal_.load(std::memory_order_relaxed);
+    snapshot.totalsEstimated = totalsEstimated_.load(std::memory_order_relaxed);
+
+    std::string& path = snapshot.currentPath;
+    path.reserve(kMaxPathLength);
+    for (;;) {
+        const std::uint64_t before = pathSequence_.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        // acquire loads, so that the sequence is read again only after them
+        const std::size_t length = pathLength_.load(std::memory_order_acquire);
+        path.resize(length);
+        for (std::size_t offset = 0, i = 0; offset < length; offset += sizeof(std::uint64_t), ++i) {
+            const std::uint64_t word = path_[i].load(std::memory_order_acquire);
+            std::memcpy(&path[offset], &word, std::min(sizeof(word), length - offset));
+        }
+        if (pathSequence_.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+}  // namespace PCManFM::FsOps
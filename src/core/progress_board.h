@@ -0,0 +1,75 @@
+/*
+ * Lock-free progress shared between a file operation and the UI (POSIX-only, no Qt)
+ * src/core/progress_board.h
+ */
+
+#ifndef PCMANFM_PROGRESS_BOARD_H
+#define PCMANFM_PROGRESS_BOARD_H
+
+#include "fs_ops.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace PCManFM::FsOps {
+
+// ProgressBoard is where a running operation posts its progress and where the UI reads it
+// whenever its timer fires, instead of the operation sending every update across threads.
+// Posting is a few relaxed atomic stores, plus a copy of the current path when it changed;
+// the path sits in a fixed buffer guarded by a sequence lock, so neither side allocates or
+// blocks. One thread posts at a time (FsOps serializes its progress callbacks); any number
+// of threads may read.
+class ProgressBoard {
+   public:
+    // Longer current paths are cut to this many bytes.
+    static constexpr std::size_t kMaxPathLength = 4096;
+
+    struct Snapshot {
+        std::uint64_t bytesDone = 0;
+        std::uint64_t bytesTotal = 0;
+        int filesDone = 0;
+        int filesTotal = 0;
+        bool totalsEstimated = false;
+        std::string currentPath;
+        std::uint64_t version = 0;  // of the last post included
+    };
+
+    ProgressBoard() = default;
+    ProgressBoard(const ProgressBoard&) = delete;
+    ProgressBoard& operator=(const ProgressBoard&) = delete;
+
+    void post(const ProgressInfo& info);
+
+    // Back to nothing posted, for the next operation; not while one is posting.
+    void reset();
+
+    // Grows with every post, so readers can tell whether anything changed since they looked.
+    std::uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+    // Fills |snapshot|, reusing the capacity of its path.
+    void read(Snapshot& snapshot) const;
+
+   private:
+    static constexpr std::size_t kPathWords = kMaxPathLength / sizeof(std::uint64_t);
+
+    void writePath(const std::string& path);
+
+    std::atomic<std::uint64_t> version_{0};
+    std::atomic<std::uint64_t> bytesDone_{0};
+    std::atomic<std::uint64_t> bytesTotal_{0};
+    std::atomic<int> filesDone_{0};
+    std::atomic<int> filesTotal_{0};
+    std::atomic<bool> totalsEstimated_{false};
+
+    // even while the path is stable, odd while it is written
+    std::atomic<std::uint64_t> pathSequence_{0};
+    std::atomic<std::size_t> pathLength_{0};
+    std::atomic<std::uint64_t> path_[kPathWords] = {};
+    std::string lastPath_;  // the poster's own copy, to skip writing an unchanged path
+};
+
+}  // namespace PCManFM::FsOps
+
+#endif  // PCMANFM_PROGRESS_BOARD_H
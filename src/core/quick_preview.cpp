@@ -0,0 +1,304 @@
+/*
+ * Bounded previews of file contents: text and hex heads, archive listings (POSIX-only, no Qt)
+ * src/core/quick_preview.cpp
+ */
+
+#include "quick_preview.h"
+
+#include "windowed_file_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace PCManFM::QuickPreview {
+
+namespace {
+
+// enough for every magic number looks_like_archive() knows, tar's being the farthest
+constexpr std::size_t kSniffBytes = 512;
+
+struct Magic {
+    std::size_t offset;
+    const char* bytes;
+    std::size_t length;
+};
+
+constexpr Magic kArchiveMagics[] = {
+    {0, "PK\x03\x04", 4},          // zip, and the formats built on it
+    {0, "PK\x05\x06", 4},          // an empty zip
+    {0, "7z\xbc\xaf\x27\x1c", 6},  // 7z
+    {0, "Rar!\x1a\x07", 6},        // rar
+    {0, "\x1f\x8b", 2},            // gzip
+    {0, "BZh", 3},                 // bzip2
+    {0, "\xfd" "7zXZ\x00", 6},     // xz
+    {0, "\x28\xb5\x2f\xfd", 4},    // zstd
+    {0, "\x04\x22\x4d\x18", 4},    // lz4
+    {0, "!<arch>\n", 8},           // ar, and deb
+    {0, "\xed\xab\xee\xdb", 4},    // rpm
+    {0, "070701", 6},              // cpio, new ASCII
+    {0, "070707", 6},              // cpio, old ASCII
+    {0, "xar!", 4},                // xar
+    {257, "ustar", 5},             // tar
+};
+
+// Whether |c| belongs in text: whitespace, backspace and escape are the control characters
+// plain text and terminal logs carry.
+bool isTextControl(std::uint8_t c) {
+    return c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v' || c == '\b' || c == 0x1b;
+}
+
+// The length of the UTF-8 sequence |lead| starts, or 0 if it starts none.
+std::size_t sequenceLength(std::uint8_t lead) {
+    if (lead < 0x80) {
+        return 1;
+    }
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        return 2;
+    }
+    if (lead >= 0xe0 && lead <= 0xef) {
+        return 3;
+    }
+    if (lead >= 0xf0 && lead <= 0xf4) {
+        return 4;
+    }
+    return 0;
+}
+
+// The end of the last whole UTF-8 sequence in |data|.
+std::size_t wholeSequencesEnd(const std::uint8_t* data, std::size_t size) {
+    std::size_t start = size;
+    while (start > 0 && size - start < 4 && (data[start - 1] & 0xc0) == 0x80) {
+        --start;
+    }
+    if (start == 0) {
+        return size;
+    }
+    const std::size_t lead = start - 1;
+    return lead + sequenceLength(data[lead]) > size ? lead : size;
+}
+
+bool timedOut(const Options& options) {
+    return options.deadline != std::chrono::steady_clock::time_point::max() &&
+           std::chrono::steady_clock::now() >= options.deadline;
+}
+
+bool cancelled(const Options& options) {
+    return options.cancel && options.cancel->load(std::memory_order_relaxed);
+}
+
+void setCancelled(FsOps::Error& err) {
+    err.code = ECANCELED;
+    err.message = "preview: " + std::string(std::strerror(ECANCELED));
+}
+
+bool readHead(const WindowedFileReader& reader,
+              std::size_t length,
+              std::vector<std::uint8_t>& out,
+              FsOps::Error& err) {
+    out.resize(std::min<std::size_t>(length, reader.size()));
+    std::size_t bytesRead = 0;
+    if (!out.empty() && !reader.read(0, out.size(), out.data(), bytesRead, err.message)) {
+        err.code = EIO;
+        return false;
+    }
+    out.resize(bytesRead);
+    return true;
+}
+
+// Keeps the first maxLines lines of |head|, and only whole lines when the file goes on.
+void makeText(const std::vector<std::uint8_t>& head, const Options& options, Preview& out) {
+    std::size_t end = 0;
+    std::size_t lines = 0;
+    while (end < head.size() && lines < options.maxLines) {
+        const void* newline = std::memchr(head.data() + end, '\n', head.size() - end);
+        if (!newline) {
+            break;
+        }
+        end = static_cast<const std::uint8_t*>(newline) - head.data() + 1;
+        ++lines;
+    }
+    if (lines < options.maxLines && (head.size() == out.fileSize || lines == 0)) {
+        end = wholeSequencesEnd(head.data(), head.size());  // the last line too, or a single long one
+    }
+    out.kind = Kind::Text;
+    out.text.assign(reinterpret_cast<const char*>(head.data()), end);
+    out.truncated = end < out.fileSize;
+}
+
+// Lists up to maxEntries members; false if the archive cannot be listed at all.
+bool listArchive(const std::string& path, const Options& options, Preview& out, FsOps::Error& err) {
+    bool stopped = false;
+    FsOps::Error listErr;
+    const bool listed = ArchiveExtract::list_entries(
+        path,
+        [&](const ArchiveExtract::EntryInfo& info) {
+            if (out.entries.size() >= options.maxEntries || cancelled(options) || timedOut(options)) {
+                stopped = true;
+                return false;
+            }
+            out.entries.push_back(info);
+            return true;
+        },
+        listErr);
+    if (cancelled(options)) {
+        setCancelled(err);
+        return false;
+    }
+    if (!listed && out.entries.empty()) {
+        return false;
+    }
+    out.kind = Kind::Archive;
+    out.truncated = stopped || !listed;  // what a damaged archive lists before the damage
+    return true;
+}
+
+}  // namespace
+
+bool looks_like_text(const std::uint8_t* data, std::size_t size) {
+    std::size_t i = 0;
+    while (i < size) {
+        const std::uint8_t c = data[i];
+        if (c < 0x80) {
+            if ((c < 0x20 && !isTextControl(c)) || c == 0x7f) {
+                return false;
+            }
+            ++i;
+            continue;
+        }
+        const std::size_t length = sequenceLength(c);
+        if (length == 0) {
+            return false;
+        }
+        for (std::size_t k = 1; k < length; ++k) {
+            if (i + k == size) {
+                return true;  // cut short by the end of the head
+            }
+            const std::uint8_t next = data[i + k];
+            if ((next & 0xc0) != 0x80) {
+                return false;
+            }
+            // overlong forms, surrogates and code points past U+10FFFF
+            if (k == 1 && ((c == 0xe0 && next < 0xa0) || (c == 0xed && next > 0x9f) || (c == 0xf0 && next < 0x90) ||
+                           (c == 0xf4 && next > 0x8f))) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+bool looks_like_archive(const std::uint8_t* data, std::size_t size) {
+    for (const Magic& magic : kArchiveMagics) {
+        if (size >= magic.offset + magic.length && std::memcmp(data + magic.offset, magic.bytes, magic.length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string hex_dump(const std::uint8_t* data, std::size_t size, std::uint64_t baseOffset) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve((size + 15) / 16 * 79);
+    for (std::size_t line = 0; line < size; line += 16) {
+        const std::uint64_t offset = baseOffset + line;
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            out += kDigits[(offset >> shift) & 0xf];
+        }
+        out += ' ';
+        const std::size_t count = std::min<std::size_t>(16, size - line);
+        for (std::size_t i = 0; i < 16; ++i) {
+            out += i == 8 ? "  " : " ";
+            if (i < count) {
+                out += kDigits[data[line + i] >> 4];
+                out += kDigits[data[line + i] & 0xf];
+            }
+            else {
+                out += "  ";
+            }
+        }
+        out += "  |";
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint8_t c = data[line + i];
+            out += c >= 0x20 && c < 0x7f ? static_cast<char>(c) : '.';
+        }
+        out += "|\n";
+    }
+    return out;
+}
+
+bool make_preview(const std::string& path, const Options& options, Preview& out, FsOps::Error& err) {
+    out = Preview{};
+    err = {};
+
+    // the reader does not follow links, and a FIFO would block it
+    char* resolved = ::realpath(path.c_str(), nullptr);
+    if (!resolved) {
+        err.code = errno;
+        err.message = path + ": " + std::strerror(errno);
+        return false;
+    }
+    const std::string target{resolved};
+    std::free(resolved);
+    struct stat st{};
+    if (::stat(target.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        err.code = errno;
+        if (S_ISDIR(st.st_mode)) {
+            err.code = EISDIR;
+        }
+        else if (st.st_mode != 0) {
+            err.code = EINVAL;  // devices and FIFOs
+        }
+        err.message = path + ": " + std::strerror(err.code);
+        return false;
+    }
+
+    WindowedFileReader reader{target, 0, &err.message, 1};
+    if (!reader.valid()) {
+        err.code = EIO;
+        return false;
+    }
+    out.fileSize = reader.size();
+    if (out.fileSize == 0) {
+        return true;
+    }
+
+    std::vector<std::uint8_t> head;
+    if (!readHead(reader, std::max({options.textBytes, options.hexBytes, kSniffBytes}), head, err)) {
+        return false;
+    }
+    if (cancelled(options)) {
+        setCancelled(err);
+        return false;
+    }
+
+    if (looks_like_archive(head.data(), head.size())) {
+        if (listArchive(target, options, out, err)) {
+            return true;
+        }
+        if (err.code != 0) {
+            return false;
+        }
+    }
+    else {
+        const std::size_t textLength = std::min(head.size(), options.textBytes);
+        if (looks_like_text(head.data(), textLength)) {
+            head.resize(textLength);
+            makeText(head, options, out);
+            return true;
+        }
+    }
+
+    out.kind = Kind::Binary;
+    head.resize(std::min(head.size(), options.hexBytes));
+    out.head = std::move(head);
+    out.truncated = out.head.size() < out.fileSize;
+    return true;
+}
+
+}  // namespace PCManFM::QuickPreview
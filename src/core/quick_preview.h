@@ -0,0 +1,64 @@
+/*
+ * Bounded previews of file contents: text and hex heads, archive listings (POSIX-only, no Qt)
+ * src/core/quick_preview.h
+ */
+
+#ifndef PCMANFM_QUICK_PREVIEW_H
+#define PCMANFM_QUICK_PREVIEW_H
+
+#include "archive_extract.h"
+#include "fs_ops.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PCManFM::QuickPreview {
+
+enum class Kind {
+    Empty,
+    Text,     // UTF-8 without control characters other than whitespace
+    Binary,   // shown as a hex dump of its head
+    Archive,  // a format libarchive lists, by its magic number
+};
+
+struct Options {
+    std::size_t textBytes = 64 * 1024;  // the most read of a text file
+    std::size_t maxLines = 500;
+    std::size_t hexBytes = 4096;
+    std::size_t maxEntries = 1000;
+    // Once this passes an archive listing stops where it got to, marked truncated; the heads
+    // are read regardless, being small. The default never passes.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    const std::atomic<bool>* cancel = nullptr;  // fails with ECANCELED once set
+};
+
+struct Preview {
+    Kind kind = Kind::Empty;
+    std::uint64_t fileSize = 0;
+    std::string text;                                // Text: the head, ending at a whole line or character
+    std::vector<std::uint8_t> head;                  // Binary: the first bytes
+    std::vector<ArchiveExtract::EntryInfo> entries;  // Archive: the first members
+    bool truncated = false;                          // more of the file than was shown
+};
+
+// Reads at most what |options| allows of the regular file |path| through a WindowedFileReader
+// and decides what it is from those bytes alone. Archives are listed only up to maxEntries
+// members or the deadline; one that fails to list is shown as binary.
+bool make_preview(const std::string& path, const Options& options, Preview& out, FsOps::Error& err);
+
+// Whether |data| is UTF-8 text; a sequence cut short by the end of |data| is allowed.
+bool looks_like_text(const std::uint8_t* data, std::size_t size);
+
+// Whether |data| starts like an archive or compressed tarball libarchive can list.
+bool looks_like_archive(const std::uint8_t* data, std::size_t size);
+
+// 16 bytes a line: the offset from |baseOffset|, the bytes in hex, and the printable ASCII.
+std::string hex_dump(const std::uint8_t* data, std::size_t size, std::uint64_t baseOffset = 0);
+
+}  // namespace PCManFM::QuickPreview
+
+#endif  // PCMANFM_QUICK_PREVIEW_H
@@ -0,0 +1,332 @@
+/*
+ * Typed record layouts for the hex editor structure view (no Qt)
+ * src/core/record_layout.cpp
+ */
+
+#include "record_layout.h"
+
+#include <bit>
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr std::uint32_t kMaxCount = 65536;
+
+template <typename T, bool Little>
+T load(const std::uint8_t* data) {
+    using Bits = std::conditional_t<sizeof(T) == 1, std::uint8_t,
+                                    std::conditional_t<sizeof(T) == 2, std::uint16_t,
+                                                       std::conditional_t<sizeof(T) == 4, std::uint32_t,
+                                                                          std::uint64_t>>>;
+    Bits bits;
+    std::memcpy(&bits, data, sizeof(bits));
+    if constexpr (sizeof(T) > 1 && Little != (std::endian::native == std::endian::little)) {
+        if constexpr (sizeof(T) == 2) {
+            bits = __builtin_bswap16(bits);
+        }
+        else if constexpr (sizeof(T) == 4) {
+            bits = __builtin_bswap32(bits);
+        }
+        else {
+            bits = __builtin_bswap64(bits);
+        }
+    }
+    return std::bit_cast<T>(bits);
+}
+
+template <typename T>
+void appendNumber(T value, std::string& out) {
+    char buffer[32];
+    int length = 0;
+    if constexpr (std::is_same_v<T, float>) {
+        length = std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(value));
+    }
+    else if constexpr (std::is_same_v<T, double>) {
+        length = std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    }
+    else if constexpr (std::is_signed_v<T>) {
+        length = std::snprintf(buffer, sizeof(buffer), "%" PRId64, static_cast<std::int64_t>(value));
+    }
+    else {
+        length = std::snprintf(buffer, sizeof(buffer), "%" PRIu64, static_cast<std::uint64_t>(value));
+    }
+    out.append(buffer, static_cast<std::size_t>(length));
+}
+
+template <typename T, bool Little>
+void formatNumbers(const std::uint8_t* data, std::uint32_t count, std::string& out) {
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            out += ' ';
+        }
+        appendNumber(load<T, Little>(data + i * sizeof(T)), out);
+    }
+}
+
+// Printable ASCII as is, anything else escaped; trailing NULs are padding and dropped.
+void formatText(const std::uint8_t* data, std::uint32_t count, std::string& out) {
+    while (count > 0 && data[count - 1] == 0) {
+        --count;
+    }
+    static const char digits[] = "0123456789abcdef";
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const std::uint8_t c = data[i];
+        if (c >= 0x20 && c < 0x7f && c != '\\') {
+            out += static_cast<char>(c);
+        }
+        else {
+            out += "\\x";
+            out += digits[c >> 4];
+            out += digits[c & 0xf];
+        }
+    }
+}
+
+void formatBytes(const std::uint8_t* data, std::uint32_t count, std::string& out) {
+    static const char digits[] = "0123456789abcdef";
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            out += ' ';
+        }
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 0xf];
+    }
+}
+
+template <typename T>
+FieldFormatter numberFormatter(bool little) {
+    return little ? &formatNumbers<T, true> : &formatNumbers<T, false>;
+}
+
+struct TypeName {
+    const char* name;
+    FieldType type;
+    std::uint32_t size;
+};
+
+constexpr TypeName kTypes[] = {
+    {"u8", FieldType::U8, 1},    {"i8", FieldType::I8, 1},     {"u16", FieldType::U16, 2},
+    {"i16", FieldType::I16, 2},  {"u32", FieldType::U32, 4},   {"i32", FieldType::I32, 4},
+    {"u64", FieldType::U64, 8},  {"i64", FieldType::I64, 8},   {"f32", FieldType::F32, 4},
+    {"f64", FieldType::F64, 8},  {"char", FieldType::Char, 1}, {"bytes", FieldType::Byte, 1},
+};
+
+FieldFormatter formatterFor(FieldType type, bool little) {
+    switch (type) {
+        case FieldType::U8:
+            return numberFormatter<std::uint8_t>(little);
+        case FieldType::I8:
+            return numberFormatter<std::int8_t>(little);
+        case FieldType::U16:
+            return numberFormatter<std::uint16_t>(little);
+        case FieldType::I16:
+            return numberFormatter<std::int16_t>(little);
+        case FieldType::U32:
+            return numberFormatter<std::uint32_t>(little);
+        case FieldType::I32:
+            return numberFormatter<std::int32_t>(little);
+        case FieldType::U64:
+            return numberFormatter<std::uint64_t>(little);
+        case FieldType::I64:
+            return numberFormatter<std::int64_t>(little);
+        case FieldType::F32:
+            return numberFormatter<float>(little);
+        case FieldType::F64:
+            return numberFormatter<double>(little);
+        case FieldType::Char:
+            return &formatText;
+        case FieldType::Byte:
+            return &formatBytes;
+    }
+    return nullptr;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+bool isIdentifier(std::string_view name) {
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name.front()))) {
+        return false;
+    }
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// "u16be[4]" into the type, byte order and count.
+bool parseType(std::string_view text, RecordField& field, std::uint32_t& elementSize, std::string& errorOut) {
+    std::string_view base = text;
+    const std::size_t bracket = text.find('[');
+    if (bracket != std::string_view::npos) {
+        if (text.back() != ']') {
+            errorOut = "missing ] in \"" + std::string(text) + "\"";
+            return false;
+        }
+        base = text.substr(0, bracket);
+        const std::string_view digits = text.substr(bracket + 1, text.size() - bracket - 2);
+        std::uint64_t count = 0;
+        for (char c : digits) {
+            if (!std::isdigit(static_cast<unsigned char>(c)) || count > kMaxCount) {
+                errorOut = "bad element count in \"" + std::string(text) + "\"";
+                return false;
+            }
+            count = count * 10 + static_cast<std::uint64_t>(c - '0');
+        }
+        if (digits.empty() || count == 0 || count > kMaxCount) {
+            errorOut = "element count must be 1 to " + std::to_string(kMaxCount);
+            return false;
+        }
+        field.count = static_cast<std::uint32_t>(count);
+    }
+
+    bool explicitOrder = false;
+    if (base.size() > 2 && (base.ends_with("le") || base.ends_with("be"))) {
+        field.littleEndian = base.ends_with("le");
+        base.remove_suffix(2);
+        explicitOrder = true;
+    }
+    for (const TypeName& candidate : kTypes) {
+        if (base == candidate.name) {
+            if (explicitOrder && candidate.size == 1) {
+                errorOut = "byte order makes no sense for \"" + std::string(base) + "\"";
+                return false;
+            }
+            field.type = candidate.type;
+            elementSize = candidate.size;
+            field.format = formatterFor(field.type, field.littleEndian);
+            return true;
+        }
+    }
+    errorOut = "unknown type \"" + std::string(text) + "\"";
+    return false;
+}
+
+void appendCsvCell(const std::string& text, std::string& out) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        out += text;
+        return;
+    }
+    out += '"';
+    for (char c : text) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+}  // namespace
+
+bool RecordLayout::parse(std::string_view text, std::string& errorOut) {
+    fields_.clear();
+    recordSize_ = 0;
+    std::vector<RecordField> fields;
+    std::uint64_t offset = 0;
+    std::size_t lineNumber = 0;
+    while (!text.empty()) {
+        ++lineNumber;
+        const std::size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+        const std::size_t hash = line.find('#');
+        if (hash != std::string_view::npos) {
+            line = line.substr(0, hash);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+
+        const auto fail = [&](const std::string& message) {
+            errorOut = "Line " + std::to_string(lineNumber) + ": " + message;
+            return false;
+        };
+        std::size_t split = 0;
+        while (split < line.size() && !std::isspace(static_cast<unsigned char>(line[split]))) {
+            ++split;
+        }
+        const std::string_view typeText = line.substr(0, split);
+        const std::string_view name = trim(line.substr(split));
+        if (name.empty()) {
+            return fail("expected a field name after the type");
+        }
+        if (!isIdentifier(name)) {
+            return fail("bad field name \"" + std::string(name) + "\"");
+        }
+        RecordField field;
+        field.name = std::string(name);
+        std::uint32_t elementSize = 0;
+        std::string typeError;
+        if (!parseType(typeText, field, elementSize, typeError)) {
+            return fail(typeError);
+        }
+        field.offset = static_cast<std::uint32_t>(offset);
+        field.size = elementSize * field.count;
+        offset += field.size;
+        if (offset > kMaxRecordSize) {
+            return fail("records are limited to " + std::to_string(kMaxRecordSize) + " bytes");
+        }
+        fields.push_back(std::move(field));
+    }
+    if (fields.empty()) {
+        errorOut = "The layout has no fields.";
+        return false;
+    }
+    fields_ = std::move(fields);
+    recordSize_ = static_cast<std::uint32_t>(offset);
+    return true;
+}
+
+std::string RecordLayout::format(std::size_t index, const std::uint8_t* record) const {
+    std::string out;
+    const RecordField& field = fields_[index];
+    field.format(record + field.offset, field.count, out);
+    return out;
+}
+
+std::string RecordLayout::csvHeader(const std::vector<std::size_t>& columns) const {
+    std::string out;
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+        if (i > 0) {
+            out += ',';
+        }
+        appendCsvCell(fields_[columns[i]].name, out);
+    }
+    out += '\n';
+    return out;
+}
+
+void RecordLayout::appendCsvRow(const std::uint8_t* record,
+                                const std::vector<std::size_t>& columns,
+                                std::string& out) const {
+    std::string cell;
+    for (std::size_t i = 0; i < columns.size(); ++i) {
+        if (i > 0) {
+            out += ',';
+        }
+        const RecordField& field = fields_[columns[i]];
+        cell.clear();
+        field.format(record + field.offset, field.count, cell);
+        appendCsvCell(cell, out);
+    }
+    out += '\n';
+}
+
+}  // namespace PCManFM
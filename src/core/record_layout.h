@@ -0,0 +1,69 @@
+/*
+ * Typed record layouts for the hex editor structure view (no Qt)
+ * src/core/record_layout.h
+ */
+
+#ifndef PCMANFM_RECORD_LAYOUT_H
+#define PCMANFM_RECORD_LAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace PCManFM {
+
+enum class FieldType : std::uint8_t { U8, I8, U16, I16, U32, I32, U64, I64, F32, F64, Char, Byte };
+
+// Appends the text of |count| consecutive elements at |data|.
+using FieldFormatter = void (*)(const std::uint8_t* data, std::uint32_t count, std::string& out);
+
+struct RecordField {
+    std::string name;
+    FieldType type = FieldType::U8;
+    bool littleEndian = true;
+    std::uint32_t count = 1;   // elements; char and byte fields are one string of |count|
+    std::uint32_t offset = 0;  // from the start of the record
+    std::uint32_t size = 0;    // bytes
+    FieldFormatter format = nullptr;
+};
+
+// RecordLayout describes a fixed-size record as a list of typed fields, one per line:
+//
+//     # comment
+//     u32le  magic
+//     u16be  version
+//     u8[6]  mac
+//     char[16] label
+//     f64    timestamp
+//
+// Numbers are u8..u64, i8..i64, f32 and f64, with an le or be suffix (little-endian when
+// omitted); char[N] is text and bytes[N] hex. A [N] suffix on a number makes an array.
+// Each field's formatter is chosen when parsing from functions specialised per type and
+// byte order, so decoding a cell is a load, an optional byte swap and a conversion.
+class RecordLayout {
+   public:
+    static constexpr std::uint32_t kMaxRecordSize = 1024 * 1024;
+
+    bool parse(std::string_view text, std::string& errorOut);
+
+    const std::vector<RecordField>& fields() const { return fields_; }
+    std::uint32_t recordSize() const { return recordSize_; }
+    bool empty() const { return fields_.empty(); }
+
+    // The text of field |index| of the record at |record|, recordSize() bytes.
+    std::string format(std::size_t index, const std::uint8_t* record) const;
+
+    // CSV export: the names of |columns| (indices into fields()), then one line per record.
+    std::string csvHeader(const std::vector<std::size_t>& columns) const;
+    void appendCsvRow(const std::uint8_t* record, const std::vector<std::size_t>& columns, std::string& out) const;
+
+   private:
+    std::vector<RecordField> fields_;
+    std::uint32_t recordSize_ = 0;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_RECORD_LAYOUT_H
@@ -0,0 +1,676 @@
+/*
+ * Native SFTP transfers over shared libssh sessions
+ * src/core/sftp_session.cpp
+ */
+
+#include "sftp_session.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef PCMANFM_HAVE_LIBSSH
+#include <libssh/libssh.h>
+#include <libssh/sftp.h>
+#endif
+
+namespace PCManFM {
+
+namespace {
+
+// requests in flight per file, and files interleaved on one session
+constexpr std::size_t kMaxRequestsPerFile = 16;
+constexpr std::size_t kMaxActiveTransfers = 8;
+// the largest request, when the server accepts it
+constexpr std::uint64_t kMaxChunkSize = 256 * 1024;
+// the size of a request to a server that does not tell its limits
+constexpr std::uint64_t kDefaultChunkSize = 32 * 1024;
+constexpr long kConnectTimeout = 15;  // seconds
+// a connection without transfers is closed after this long
+constexpr auto kIdleTimeout = std::chrono::minutes(5);
+// an endpoint that could not be connected to is not tried again for this long
+constexpr auto kRetryConnectAfter = std::chrono::minutes(1);
+// how often a waiting transfer reports its progress
+constexpr auto kProgressInterval = std::chrono::milliseconds(100);
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Malformed escapes are kept as they are.
+std::string percentDecode(const std::string& text) {
+    std::string decoded;
+    decoded.reserve(text.size());
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+            decoded += static_cast<char>(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+            i += 2;
+        }
+        else {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+}  // namespace
+
+std::string SftpEndpoint::key() const {
+    return user + '@' + host + ':' + std::to_string(port);
+}
+
+bool parse_sftp_uri(const std::string& uri, SftpEndpoint& endpoint, std::string& path) {
+    static const std::string scheme = "sftp://";
+    if (uri.compare(0, scheme.size(), scheme) != 0) {
+        return false;
+    }
+    const std::size_t end = std::min(uri.find('?'), uri.find('#'));
+    const std::size_t pathStart = std::min(uri.find('/', scheme.size()), end);
+    std::string authority = uri.substr(scheme.size(), pathStart - scheme.size());
+
+    SftpEndpoint result;
+    const std::size_t at = authority.rfind('@');
+    if (at != std::string::npos) {
+        std::string userInfo = authority.substr(0, at);
+        authority.erase(0, at + 1);
+        const std::size_t colon = userInfo.find(':');
+        if (colon != std::string::npos) {
+            result.password = percentDecode(userInfo.substr(colon + 1));
+            userInfo.erase(colon);
+        }
+        // gvfs may add parameters to the user name
+        const std::size_t semicolon = userInfo.find(';');
+        if (semicolon != std::string::npos) {
+            userInfo.erase(semicolon);
+        }
+        result.user = percentDecode(userInfo);
+    }
+
+    std::string host = authority;
+    std::string port;
+    if (!host.empty() && host[0] == '[') {  // an IPv6 address
+        const std::size_t close = host.find(']');
+        if (close == std::string::npos || (close + 1 < host.size() && host[close + 1] != ':')) {
+            return false;
+        }
+        port = host.substr(std::min(close + 2, host.size()));
+        host = host.substr(1, close - 1);
+    }
+    else {
+        const std::size_t colon = host.rfind(':');
+        if (colon != std::string::npos) {
+            port = host.substr(colon + 1);
+            host.erase(colon);
+        }
+    }
+    if (host.empty()) {
+        return false;
+    }
+    if (!port.empty()) {
+        if (port.size() > 5 || port.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        const unsigned long value = std::stoul(port);
+        if (value == 0 || value > 65535) {
+            return false;
+        }
+        result.port = static_cast<unsigned>(value);
+    }
+    result.host = percentDecode(host);
+
+    path = pathStart < end ? percentDecode(uri.substr(pathStart, end - pathStart)) : std::string("/");
+    endpoint = std::move(result);
+    return true;
+}
+
+#ifdef PCMANFM_HAVE_LIBSSH
+
+struct SftpSession::Transfer {
+    Direction direction;
+    std::string remotePath;
+    std::string localPath;
+    bool overwrite;
+
+    // read by the waiting caller
+    std::atomic<std::uint64_t> done{0};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<bool> cancelled{false};
+    // guarded by mutex_
+    bool finished = false;
+    int error = 0;
+
+    // only used by the thread of the session
+    sftp_file file = nullptr;
+    int fd = -1;
+    bool created = false;  // the destination was created or truncated
+    std::uint64_t size = 0;
+    std::uint64_t nextOffset = 0;
+    std::deque<std::pair<std::uint64_t, std::size_t>> gaps;  // short reads to ask for again
+    std::size_t inFlight = 0;
+    int failure = 0;
+    mode_t mode = 0644;
+    bool hasTimes = false;
+    std::uint64_t atime = 0;
+    std::uint64_t mtime = 0;
+
+    bool isDone() const {
+        return inFlight == 0 && (failure != 0 || cancelled || (gaps.empty() && nextOffset >= size));
+    }
+};
+
+struct SftpSession::Connection {
+    struct Request {
+        Transfer* transfer;
+        sftp_aio aio;
+        std::uint64_t offset;
+        std::size_t length;
+    };
+
+    ssh_session ssh = nullptr;
+    sftp_session sftp = nullptr;
+    std::size_t readChunk = kDefaultChunkSize;
+    std::size_t writeChunk = kDefaultChunkSize;
+    std::deque<Request> requests;  // in the order they were sent, which is how replies come
+    std::vector<char> buffer;
+    bool broken = false;
+
+    ~Connection() {
+        if (sftp) {
+            sftp_free(sftp);
+        }
+        if (ssh) {
+            ssh_disconnect(ssh);
+            ssh_free(ssh);
+        }
+    }
+
+    // the errno of the last SFTP failure; a lost connection breaks every transfer
+    int lastError() {
+        if (!ssh_is_connected(ssh)) {
+            broken = true;
+            return ENOTCONN;
+        }
+        switch (sftp_get_error(sftp)) {
+            case SSH_FX_NO_SUCH_FILE:
+            case SSH_FX_NO_SUCH_PATH:
+                return ENOENT;
+            case SSH_FX_PERMISSION_DENIED:
+            case SSH_FX_WRITE_PROTECT:
+                return EACCES;
+            case SSH_FX_FILE_ALREADY_EXISTS:
+                return EEXIST;
+            case SSH_FX_OP_UNSUPPORTED:
+                return ENOTSUP;
+            case SSH_FX_NO_CONNECTION:
+            case SSH_FX_CONNECTION_LOST:
+                broken = true;
+                return ENOTCONN;
+            default:
+                return EIO;
+        }
+    }
+
+    bool remoteExists(const std::string& path) {
+        sftp_attributes attrs = sftp_lstat(sftp, path.c_str());
+        if (attrs) {
+            sftp_attributes_free(attrs);
+            return true;
+        }
+        return false;
+    }
+
+    int open(Transfer& t) {
+        if (t.direction == Direction::Download) {
+            t.file = sftp_open(sftp, t.remotePath.c_str(), O_RDONLY, 0);
+            if (!t.file) {
+                return lastError();
+            }
+            sftp_attributes attrs = sftp_fstat(t.file);
+            if (!attrs) {
+                return lastError();
+            }
+            const bool isDir = attrs->type == SSH_FILEXFER_TYPE_DIRECTORY;
+            t.size = attrs->size;
+            t.mode = attrs->permissions & 07777;
+            t.hasTimes = attrs->flags & SSH_FILEXFER_ATTR_ACMODTIME;
+            t.atime = attrs->atime;
+            t.mtime = attrs->mtime;
+            sftp_attributes_free(attrs);
+            if (isDir) {
+                return EISDIR;
+            }
+            // readable by the user alone until it is complete
+            const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (t.overwrite ? O_TRUNC : O_EXCL);
+            t.fd = ::open(t.localPath.c_str(), flags, 0600);
+            if (t.fd < 0) {
+                return errno;
+            }
+            t.created = true;
+        }
+        else {
+            t.fd = ::open(t.localPath.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (t.fd < 0 || fstat(t.fd, &st) != 0) {
+                return errno;
+            }
+            if (!S_ISREG(st.st_mode)) {
+                return EINVAL;
+            }
+            t.size = st.st_size;
+            t.mode = st.st_mode & 07777;
+            t.hasTimes = true;
+            t.atime = st.st_atime;
+            t.mtime = st.st_mtime;
+            const int flags = O_WRONLY | O_CREAT | (t.overwrite ? O_TRUNC : O_EXCL);
+            t.file = sftp_open(sftp, t.remotePath.c_str(), flags, t.mode);
+            if (!t.file) {
+                const int error = lastError();
+                // SFTP version 3 servers report an existing file as a plain failure
+                return !t.overwrite && error == EIO && remoteExists(t.remotePath) ? EEXIST : error;
+            }
+            t.created = true;
+        }
+        t.total = t.size;
+        return 0;
+    }
+
+    // Sends requests for |t| until it has as many in flight as allowed.
+    void issue(Transfer& t) {
+        while (t.failure == 0 && !t.cancelled && t.inFlight < kMaxRequestsPerFile &&
+               (!t.gaps.empty() || t.nextOffset < t.size)) {
+            std::uint64_t offset;
+            std::size_t length;
+            const std::size_t chunk = t.direction == Direction::Download ? readChunk : writeChunk;
+            if (!t.gaps.empty()) {
+                offset = t.gaps.front().first;
+                length = std::min(t.gaps.front().second, chunk);
+                t.gaps.pop_front();
+            }
+            else {
+                offset = t.nextOffset;
+                length = static_cast<std::size_t>(std::min<std::uint64_t>(chunk, t.size - offset));
+                t.nextOffset += length;
+            }
+            sftp_seek64(t.file, offset);
+            sftp_aio aio = nullptr;
+            ssize_t sent;
+            if (t.direction == Direction::Download) {
+                sent = sftp_aio_begin_read(t.file, length, &aio);
+            }
+            else {
+                const ssize_t got = pread(t.fd, buffer.data(), length, offset);
+                if (got <= 0) {
+                    if (got < 0) {
+                        t.failure = errno;
+                    }
+                    else {  // the file shrank
+                        t.size = offset;
+                        t.total = offset;
+                    }
+                    return;
+                }
+                length = static_cast<std::size_t>(got);
+                // the data is copied into the request, so |buffer| may be reused at once
+                sent = sftp_aio_begin_write(t.file, buffer.data(), length, &aio);
+            }
+            if (sent == SSH_ERROR) {
+                t.failure = lastError();
+                return;
+            }
+            requests.push_back(Request{&t, aio, offset, length});
+            ++t.inFlight;
+        }
+    }
+
+    // Waits for the reply to the oldest request.
+    void completeOldest() {
+        Request request = requests.front();
+        requests.pop_front();
+        Transfer& t = *request.transfer;
+        --t.inFlight;
+        if (t.direction == Direction::Download) {
+            const ssize_t got = sftp_aio_wait_read(&request.aio, buffer.data(), request.length);
+            if (got < 0) {
+                if (t.failure == 0) {
+                    t.failure = lastError();
+                }
+            }
+            else if (got == 0) {  // the file shrank
+                t.size = std::min(t.size, request.offset);
+                t.total = t.size;
+            }
+            else if (t.failure == 0) {
+                for (ssize_t written = 0; written < got;) {
+                    const ssize_t n = pwrite(t.fd, buffer.data() + written, got - written, request.offset + written);
+                    if (n < 0 && errno != EINTR) {
+                        t.failure = errno;
+                        break;
+                    }
+                    written += std::max<ssize_t>(n, 0);
+                }
+                if (static_cast<std::size_t>(got) < request.length && request.offset + got < t.size) {
+                    t.gaps.emplace_back(request.offset + got, request.length - got);
+                }
+                t.done += got;
+            }
+        }
+        else {
+            const ssize_t written = sftp_aio_wait_write(&request.aio);
+            if (written < 0) {
+                if (t.failure == 0) {
+                    t.failure = lastError();
+                }
+            }
+            else {
+                t.done += written;
+            }
+        }
+        if (request.aio) {
+            sftp_aio_free(request.aio);
+        }
+    }
+
+    // Closes the files of |t| and returns its result; a failed transfer removes what it wrote.
+    int close(Transfer& t) {
+        int error = t.failure != 0 ? t.failure : (t.cancelled ? ECANCELED : 0);
+        if (error == 0 && t.direction == Direction::Download) {
+            if (ftruncate(t.fd, t.size) != 0 || fchmod(t.fd, t.mode) != 0) {
+                error = errno;
+            }
+            else if (t.hasTimes) {
+                const struct timespec times[2] = {{static_cast<time_t>(t.atime), 0},
+                                                  {static_cast<time_t>(t.mtime), 0}};
+                futimens(t.fd, times);
+            }
+        }
+        if (t.file) {
+            if (sftp_close(t.file) != SSH_OK && error == 0) {
+                error = lastError();
+            }
+            t.file = nullptr;
+        }
+        if (t.fd >= 0) {
+            if (::close(t.fd) != 0 && error == 0 && t.direction == Direction::Download) {
+                error = errno;
+            }
+            t.fd = -1;
+        }
+        if (error == 0 && t.direction == Direction::Upload && t.hasTimes) {
+            const struct timeval times[2] = {{static_cast<time_t>(t.atime), 0}, {static_cast<time_t>(t.mtime), 0}};
+            sftp_utimes(sftp, t.remotePath.c_str(), times);
+        }
+        if (error != 0 && t.created) {
+            if (t.direction == Direction::Download) {
+                unlink(t.localPath.c_str());
+            }
+            else if (!broken) {
+                sftp_unlink(sftp, t.remotePath.c_str());
+            }
+        }
+        return broken ? ENOTCONN : error;
+    }
+};
+
+SftpSession::SftpSession(std::unique_ptr<Connection> connection)
+    : connection_{std::move(connection)}, open_{true}, stopping_{false}, thread_{&SftpSession::run, this} {}
+
+std::shared_ptr<SftpSession> SftpSession::connect(const SftpEndpoint& endpoint, int& error) {
+    static const int initialized = ssh_init();
+    if (initialized != SSH_OK) {
+        error = ENOTSUP;
+        return nullptr;
+    }
+    auto connection = std::make_unique<Connection>();
+    connection->ssh = ssh_new();
+    if (!connection->ssh) {
+        error = ENOMEM;
+        return nullptr;
+    }
+    ssh_session ssh = connection->ssh;
+    ssh_options_set(ssh, SSH_OPTIONS_HOST, endpoint.host.c_str());
+    if (!endpoint.user.empty()) {
+        ssh_options_set(ssh, SSH_OPTIONS_USER, endpoint.user.c_str());
+    }
+    if (endpoint.port != 0) {
+        const unsigned int port = endpoint.port;
+        ssh_options_set(ssh, SSH_OPTIONS_PORT, &port);
+    }
+    const long timeout = kConnectTimeout;
+    ssh_options_set(ssh, SSH_OPTIONS_TIMEOUT, &timeout);
+    // host aliases, user names, ports and identity files of ~/.ssh/config
+    ssh_options_parse_config(ssh, nullptr);
+    if (ssh_connect(ssh) != SSH_OK) {
+        error = EHOSTUNREACH;
+        return nullptr;
+    }
+    // unknown or changed host keys are left to gvfs, which asks the user
+    if (ssh_session_is_known_server(ssh) != SSH_KNOWN_HOSTS_OK) {
+        error = EACCES;
+        return nullptr;
+    }
+    const int auth = endpoint.password.empty() ? ssh_userauth_publickey_auto(ssh, nullptr, nullptr)
+                                               : ssh_userauth_password(ssh, nullptr, endpoint.password.c_str());
+    if (auth != SSH_AUTH_SUCCESS) {
+        error = EACCES;
+        return nullptr;
+    }
+    connection->sftp = sftp_new(ssh);
+    if (!connection->sftp || sftp_init(connection->sftp) != SSH_OK) {
+        error = EPROTO;
+        return nullptr;
+    }
+    if (sftp_limits_t limits = sftp_limits(connection->sftp)) {
+        if (limits->max_read_length > 0) {
+            connection->readChunk = static_cast<std::size_t>(std::min(limits->max_read_length, kMaxChunkSize));
+        }
+        if (limits->max_write_length > 0) {
+            connection->writeChunk = static_cast<std::size_t>(std::min(limits->max_write_length, kMaxChunkSize));
+        }
+        sftp_limits_free(limits);
+    }
+    connection->buffer.resize(std::max(connection->readChunk, connection->writeChunk));
+    error = 0;
+    return std::shared_ptr<SftpSession>(new SftpSession(std::move(connection)));
+}
+
+void SftpSession::run() {
+    Connection& connection = *connection_;
+    std::vector<Transfer*> active;
+    for (;;) {
+        std::vector<Transfer*> added;
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            if (connection.broken) {
+                // what is still queued fails too, and may be tried again on a new session
+                open_ = false;
+                for (Transfer* t : queued_) {
+                    t->finished = true;
+                    t->error = ENOTCONN;
+                }
+                queued_.clear();
+                finished_.notify_all();
+                break;
+            }
+            if (active.empty()) {
+                wake_.wait_for(lock, kIdleTimeout, [this] { return stopping_ || !queued_.empty(); });
+                if (queued_.empty()) {  // idle for long enough, or the last user is gone
+                    open_ = false;
+                    break;
+                }
+            }
+            while (!queued_.empty() && active.size() < kMaxActiveTransfers) {
+                added.push_back(queued_.front());
+                active.push_back(queued_.front());
+                queued_.pop_front();
+            }
+        }
+
+        for (Transfer* t : added) {
+            if (!t->cancelled) {
+                t->failure = connection.open(*t);
+            }
+        }
+        for (Transfer* t : active) {
+            connection.issue(*t);
+        }
+        if (!connection.requests.empty()) {
+            connection.completeOldest();
+        }
+
+        for (auto it = active.begin(); it != active.end();) {
+            Transfer* t = *it;
+            if (t->isDone() || (connection.broken && t->inFlight == 0)) {
+                const int error = connection.close(*t);
+                std::lock_guard<std::mutex> lock{mutex_};
+                t->finished = true;
+                t->error = error;
+                finished_.notify_all();
+                it = active.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        if (connection.broken) {
+            // the replies still awaited will not come
+            for (auto& request : connection.requests) {
+                sftp_aio_free(request.aio);
+                --request.transfer->inFlight;
+            }
+            connection.requests.clear();
+            for (Transfer* t : active) {
+                const int error = connection.close(*t);
+                std::lock_guard<std::mutex> lock{mutex_};
+                t->finished = true;
+                t->error = error;
+            }
+            active.clear();
+        }
+    }
+    connection_.reset();
+}
+
+int SftpSession::transfer(Direction direction,
+                          const std::string& remotePath,
+                          const std::string& localPath,
+                          bool overwrite,
+                          const Progress& progress) {
+    Transfer t;
+    t.direction = direction;
+    t.remotePath = remotePath;
+    t.localPath = localPath;
+    t.overwrite = overwrite;
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (!open_) {
+        return ENOTCONN;
+    }
+    queued_.push_back(&t);
+    wake_.notify_one();
+    while (!t.finished) {
+        finished_.wait_for(lock, kProgressInterval);
+        if (!t.finished && progress) {
+            lock.unlock();
+            if (!progress(t.done, t.total)) {
+                t.cancelled = true;
+            }
+            lock.lock();
+        }
+    }
+    return t.error;
+}
+
+#else  // PCMANFM_HAVE_LIBSSH
+
+struct SftpSession::Transfer {};
+struct SftpSession::Connection {};
+
+SftpSession::SftpSession(std::unique_ptr<Connection> connection)
+    : connection_{std::move(connection)}, open_{false}, stopping_{false} {}
+
+std::shared_ptr<SftpSession> SftpSession::connect(const SftpEndpoint& /*endpoint*/, int& error) {
+    error = ENOTSUP;
+    return nullptr;
+}
+
+void SftpSession::run() {}
+
+int SftpSession::transfer(Direction /*direction*/,
+                          const std::string& /*remotePath*/,
+                          const std::string& /*localPath*/,
+                          bool /*overwrite*/,
+                          const Progress& /*progress*/) {
+    return ENOTSUP;
+}
+
+#endif  // PCMANFM_HAVE_LIBSSH
+
+SftpSession::~SftpSession() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool SftpSession::isOpen() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return open_;
+}
+
+SftpSessionPool& SftpSessionPool::instance() {
+    static SftpSessionPool pool;
+    return pool;
+}
+
+std::shared_ptr<SftpSession> SftpSessionPool::acquire(const SftpEndpoint& endpoint, int& error) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const std::string key = endpoint.key();
+    auto it = sessions_.find(key);
+    if (it != sessions_.end() && it->second->isOpen()) {
+        error = 0;
+        return it->second;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    auto failure = failures_.find(key);
+    if (failure != failures_.end()) {
+        if (now < failure->second.until) {
+            error = failure->second.error;
+            return nullptr;
+        }
+        failures_.erase(failure);
+    }
+    auto session = SftpSession::connect(endpoint, error);
+    if (session) {
+        sessions_[key] = session;
+    }
+    else {
+        if (it != sessions_.end()) {
+            sessions_.erase(it);
+        }
+        failures_[key] = Failure{error, now + kRetryConnectAfter};
+    }
+    return session;
+}
+
+}  // namespace PCManFM
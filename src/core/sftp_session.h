@@ -0,0 +1,118 @@
+/*
+ * Native SFTP transfers over shared libssh sessions (POSIX-only, no Qt)
+ * src/core/sftp_session.h
+ */
+
+#ifndef PCMANFM_SFTP_SESSION_H
+#define PCMANFM_SFTP_SESSION_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace PCManFM {
+
+// Where an sftp:// URI points: sftp://[user[:password]@]host[:port]/path.
+struct SftpEndpoint {
+    std::string user;      // empty for the one of ~/.ssh/config or the login name
+    std::string host;
+    unsigned port = 0;     // 0 for the one of ~/.ssh/config or 22
+    std::string password;  // empty to authenticate with the agent or the default keys
+
+    // Identifies the sessions that may be shared: the same user on the same server.
+    std::string key() const;
+};
+
+// Splits |uri| into its endpoint and the percent-decoded absolute path on the server. Returns
+// false for anything but an sftp:// URI with a host.
+bool parse_sftp_uri(const std::string& uri, SftpEndpoint& endpoint, std::string& path);
+
+// One SSH connection with its SFTP channel, driven by a thread of its own. Every transfer
+// handed to it is interleaved with the others on the one channel: each file keeps several
+// read or write requests in flight, so a transfer is bound by the bandwidth of the link
+// rather than by its round-trip time, and several files share it. The connection closes by
+// itself after a while without transfers. Safe to share between threads.
+class SftpSession {
+   public:
+    enum class Direction { Download, Upload };
+
+    // Bytes done and the size of the file; returning false cancels the transfer.
+    using Progress = std::function<bool(std::uint64_t done, std::uint64_t total)>;
+
+    ~SftpSession();
+
+    SftpSession(const SftpSession&) = delete;
+    SftpSession& operator=(const SftpSession&) = delete;
+
+    // Connects and authenticates without asking anything: the host key must already be known
+    // and the agent, a key without a passphrase or the password of |endpoint| must be
+    // accepted. Returns nullptr with |error| set to an errno, ENOTSUP when libssh was not
+    // compiled in (PCMANFM_HAVE_LIBSSH), or EACCES when the server could not be trusted or
+    // logged in to without asking.
+    static std::shared_ptr<SftpSession> connect(const SftpEndpoint& endpoint, int& error);
+
+    // False once the connection is closed or broken; new transfers then need a new session.
+    bool isOpen() const;
+
+    // Copies the regular file |remotePath| to or from |localPath| and waits for it, with mode
+    // and times kept. An existing destination is replaced only when |overwrite| is set, and
+    // fails with EEXIST otherwise. |progress| is called on the calling thread. Returns 0 or
+    // the errno of the failure; ENOTCONN means the connection broke and the transfer may be
+    // tried again on a new session. A failed or cancelled transfer removes what it wrote.
+    int transfer(Direction direction,
+                 const std::string& remotePath,
+                 const std::string& localPath,
+                 bool overwrite,
+                 const Progress& progress);
+
+   private:
+    struct Connection;
+    struct Transfer;
+
+    explicit SftpSession(std::unique_ptr<Connection> connection);
+
+    void run();
+
+    std::unique_ptr<Connection> connection_;  // only used by thread_ once it has started
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;      // new transfers or closing
+    std::condition_variable finished_;  // a transfer finished
+    std::deque<Transfer*> queued_;
+    bool open_;
+    bool stopping_;
+    std::thread thread_;
+};
+
+// The sessions in use, one per endpoint, so that every job and tab copying to or from a
+// server goes through the same connection. Safe to share between threads.
+class SftpSessionPool {
+   public:
+    static SftpSessionPool& instance();
+
+    // The open session of |endpoint|, connected first if there is none. See
+    // SftpSession::connect() for the errors. An endpoint that could not be connected to is
+    // not tried again for a minute, so that a job of many files gives up on it at once.
+    std::shared_ptr<SftpSession> acquire(const SftpEndpoint& endpoint, int& error);
+
+   private:
+    struct Failure {
+        int error;
+        std::chrono::steady_clock::time_point until;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<SftpSession>> sessions_;
+    std::map<std::string, Failure> failures_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_SFTP_SESSION_H
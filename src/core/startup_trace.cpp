@@ -0,0 +1,106 @@
+/*
+ * Timing of the start-up phases, written as Chrome trace events
+ * src/core/startup_trace.cpp
+ */
+
+#include "startup_trace.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+void appendJsonString(std::string& out, const std::string& str) {
+    out += '"';
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            out += escaped;
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+}  // namespace
+
+StartupTrace::StartupTrace() : origin_(Clock::now()) {}
+
+std::int64_t StartupTrace::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - origin_).count();
+}
+
+void StartupTrace::begin(const std::string& name) {
+    running_.push_back(events_.size());
+    events_.push_back(Event{name, 'X', now(), -1});
+}
+
+void StartupTrace::end() {
+    if (running_.empty()) {
+        return;
+    }
+    Event& event = events_[running_.back()];
+    running_.pop_back();
+    event.duration = now() - event.start;
+}
+
+void StartupTrace::mark(const std::string& name) {
+    events_.push_back(Event{name, 'i', now(), 0});
+}
+
+std::string StartupTrace::toJson() const {
+    const std::string pid = std::to_string(::getpid());
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    for (const Event& event : events_) {
+        if (event.phase == 'X' && event.duration < 0) {
+            continue;
+        }
+        out += first ? "\n" : ",\n";
+        first = false;
+        out += "{\"name\":";
+        appendJsonString(out, event.name);
+        out += ",\"cat\":\"startup\",\"ph\":\"";
+        out += event.phase;
+        out += "\",\"ts\":" + std::to_string(event.start);
+        if (event.phase == 'X') {
+            out += ",\"dur\":" + std::to_string(event.duration);
+        }
+        else {
+            out += ",\"s\":\"p\"";  // an instant of the whole process
+        }
+        out += ",\"pid\":" + pid + ",\"tid\":1}";
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+bool StartupTrace::write(const std::string& path, std::string& error) const {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    const std::string json = toJson();
+    const bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+    const int writeErrno = errno;
+    if (std::fclose(file) != 0 || !written) {
+        error = path + ": " + std::strerror(written ? errno : writeErrno);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,78 @@
+/*
+ * Timing of the start-up phases, written as Chrome trace events (POSIX-only, no Qt)
+ * src/core/startup_trace.h
+ */
+
+#ifndef PCMANFM_STARTUP_TRACE_H
+#define PCMANFM_STARTUP_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PCManFM {
+
+// StartupTrace records how long the phases of start-up take, timed from its construction, and
+// writes them in the JSON format of Chrome trace events, which chrome://tracing and Perfetto
+// load. Phases nest; a phase becomes a complete event ("X") when it ends, and a mark an instant
+// event ("i"). Phases still running when the trace is written are left out. Only one thread
+// records.
+class StartupTrace {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        std::string name;
+        char phase = 'X';            // 'X' for a phase, 'i' for a mark
+        std::int64_t start = 0;      // microseconds since the construction of the trace
+        std::int64_t duration = -1;  // microseconds, -1 while the phase runs
+    };
+
+    StartupTrace();
+
+    // Starts a phase, which ends with the matching end().
+    void begin(const std::string& name);
+    // Ends the innermost running phase; does nothing when none runs.
+    void end();
+    // Records a moment, such as the event loop starting.
+    void mark(const std::string& name);
+
+    const std::vector<Event>& events() const { return events_; }
+
+    std::string toJson() const;
+    // Writes toJson() to |path|; on failure, returns false with the reason in |error|.
+    bool write(const std::string& path, std::string& error) const;
+
+    // Times a phase for as long as it lives; does nothing without a trace.
+    class Scope {
+       public:
+        Scope(StartupTrace* trace, const char* name) : trace_(trace) {
+            if (trace_) {
+                trace_->begin(name);
+            }
+        }
+        ~Scope() {
+            if (trace_) {
+                trace_->end();
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        StartupTrace* trace_;
+    };
+
+   private:
+    std::int64_t now() const;
+
+    Clock::time_point origin_;
+    std::vector<Event> events_;
+    std::vector<std::size_t> running_;  // indexes of the phases begun and not ended yet
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_STARTUP_TRACE_H
@@ -0,0 +1,646 @@
+/*
+ * Native freedesktop.org trash (POSIX-only, no Qt)
+ * src/core/trash_store.cpp
+ */
+
+#include "trash_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr char kInfoSuffix[] = ".trashinfo";
+constexpr std::size_t kInfoSuffixLength = sizeof(kInfoSuffix) - 1;
+// .trashinfo files are a few hundred bytes; anything larger is not one
+constexpr std::size_t kMaxInfoSize = 64 * 1024;
+constexpr std::size_t kMaxMountsSize = 4 * 1024 * 1024;
+// names tried for an entry before giving up, "name", "name.2", "name.3", ...
+constexpr int kMaxNameAttempts = 1000;
+
+void set_error(FsOps::Error& err, int code, const std::string& context) {
+    err.code = code;
+    err.message = context + ": " + std::strerror(code);
+}
+
+std::string parentOf(const std::string& path) {
+    const auto slash = path.find_last_of('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? std::string("/") : path.substr(0, slash);
+}
+
+std::string baseNameOf(const std::string& path) {
+    const auto slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool isInside(const std::string& path, const std::string& dir) {
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+           (dir == "/" || path[dir.size()] == '/');
+}
+
+// Percent-encodes everything but unreserved characters and '/', as the Path key requires.
+std::string encodePath(const std::string& path) {
+    static const char kHex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(path.size());
+    for (const unsigned char c : path) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || std::strchr("-_.~/", c)) {
+            out += static_cast<char>(c);
+        }
+        else {
+            out += '%';
+            out += kHex[c >> 4];
+            out += kHex[c & 0xf];
+        }
+    }
+    return out;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+std::string decodePath(const std::string& encoded) {
+    std::string out;
+    out.reserve(encoded.size());
+    for (std::size_t i = 0; i < encoded.size(); ++i) {
+        if (encoded[i] == '%' && i + 2 < encoded.size() && hexValue(encoded[i + 1]) >= 0 &&
+            hexValue(encoded[i + 2]) >= 0) {
+            out += static_cast<char>(hexValue(encoded[i + 1]) * 16 + hexValue(encoded[i + 2]));
+            i += 2;
+        }
+        else {
+            out += encoded[i];
+        }
+    }
+    return out;
+}
+
+std::string localDate() {
+    const std::time_t now = std::time(nullptr);
+    struct tm tm;
+    char buf[32] = {};
+    if (::localtime_r(&now, &tm)) {
+        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    }
+    return buf;
+}
+
+bool writeAll(int fd, const std::string& data) {
+    std::size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool readSmallFile(int dirfd, const char* name, std::size_t maxSize, std::string& out) {
+    const int fd = ::openat(dirfd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        return false;
+    }
+    out.clear();
+    char buf[4096];
+    for (;;) {
+        const ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || out.size() + static_cast<std::size_t>(n) > maxSize) {
+            break;
+        }
+        out.append(buf, static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+    return true;
+}
+
+// Renames without replacing anything, also where the filesystem lacks RENAME_NOREPLACE.
+int renameNoReplace(int oldDirFd, const char* oldName, int newDirFd, const char* newName) {
+#ifdef RENAME_NOREPLACE
+    if (::renameat2(oldDirFd, oldName, newDirFd, newName, RENAME_NOREPLACE) == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        return errno;
+    }
+#endif
+    struct stat st;
+    if (::fstatat(newDirFd, newName, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        return EEXIST;
+    }
+    return ::renameat(oldDirFd, oldName, newDirFd, newName) == 0 ? 0 : errno;
+}
+
+// Opens or creates the subdirectory |name| of |dirfd|, owned by the user and private.
+int openPrivateDir(int dirfd, const char* name, bool create, uid_t uid) {
+    if (create && ::mkdirat(dirfd, name, 0700) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    const int fd = ::openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || st.st_uid != uid) {
+        ::close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+TrashStore::TrashStore(std::string homeTrash, std::string mountsFile)
+    : homeTrash_(std::move(homeTrash)), mountsFile_(std::move(mountsFile)), uid_(::getuid()) {}
+
+TrashStore::~TrashStore() {
+    for (auto& entry : dirs_) {
+        ::close(entry.second->filesFd);
+        ::close(entry.second->infoFd);
+    }
+}
+
+std::string TrashStore::defaultHomeTrash() {
+    std::string base;
+    const char* xdg = std::getenv("XDG_DATA_HOME");
+    if (xdg && xdg[0] == '/') {
+        base = xdg;
+    }
+    else {
+        const char* home = std::getenv("HOME");
+        if (!home || home[0] == '\0') {
+            const struct passwd* pw = ::getpwuid(::getuid());
+            home = pw ? pw->pw_dir : nullptr;
+        }
+        if (!home || home[0] == '\0') {
+            return std::string();
+        }
+        base = std::string(home) + "/.local/share";
+    }
+    return base + "/Trash";
+}
+
+TrashStore& TrashStore::instance() {
+    static TrashStore store(defaultHomeTrash());
+    return store;
+}
+
+bool TrashStore::trash(const std::vector<std::string>& paths,
+                       std::vector<int>& results,
+                       const std::function<bool()>& tick) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    results.assign(paths.size(), ECANCELED);
+    const std::string date = localDate();
+    bool ok = true;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        const std::string& path = paths[i];
+        int error = 0;
+        struct stat st;
+        if (path.empty() || path[0] != '/' || path == "/") {
+            error = EINVAL;
+        }
+        else if (::lstat(path.c_str(), &st) < 0) {
+            error = errno;
+        }
+        else if (TrashDir* dir = trashDirFor(st.st_dev, path, error)) {
+            if (path == dir->path || isInside(path, dir->path) || isInside(dir->path, path)) {
+                error = EINVAL;
+            }
+            else {
+                trashOne(*dir, path, date, error);
+            }
+        }
+        results[i] = error;
+        ok = ok && error == 0;
+        if (tick && !tick()) {
+            return i + 1 == paths.size() && ok;
+        }
+    }
+    return ok;
+}
+
+bool TrashStore::trashOne(TrashDir& dir, const std::string& path, const std::string& date, int& error) {
+    const std::string baseName = baseNameOf(path);
+    std::string original = path;
+    if (!dir.topDir.empty()) {
+        original = path.substr(dir.topDir == "/" ? 1 : dir.topDir.size() + 1);
+    }
+    const std::string info = "[Trash Info]\nPath=" + encodePath(original) + "\nDeletionDate=" + date + "\n";
+
+    for (int attempt = 1; attempt <= kMaxNameAttempts; ++attempt) {
+        const std::string name = attempt == 1 ? baseName : baseName + "." + std::to_string(attempt);
+        const std::string infoName = name + kInfoSuffix;
+        // creating the info file reserves the name, as the specification asks
+        const int fd = ::openat(dir.infoFd, infoName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            if (errno == EEXIST) {
+                continue;
+            }
+            error = errno;
+            return false;
+        }
+        const bool written = writeAll(fd, info);
+        const int writeError = errno;
+        ::close(fd);
+        if (!written) {
+            ::unlinkat(dir.infoFd, infoName.c_str(), 0);
+            error = writeError;
+            return false;
+        }
+
+        error = renameNoReplace(AT_FDCWD, path.c_str(), dir.filesFd, name.c_str());
+        if (error != 0) {
+            ::unlinkat(dir.infoFd, infoName.c_str(), 0);
+            if (error == EEXIST) {
+                continue;  // a file without info holds the name
+            }
+            return false;
+        }
+
+        if (dir.indexed) {
+            dir.items[name] = Item{dir.path, name, path, date};
+            noteInfoChanged(dir);
+        }
+        return true;
+    }
+    error = EEXIST;
+    return false;
+}
+
+TrashStore::TrashDir* TrashStore::trashDirFor(dev_t device, const std::string& path, int& error) {
+    auto it = dirsByDevice_.find(device);
+    if (it != dirsByDevice_.end()) {
+        error = it->second ? 0 : EXDEV;
+        return it->second;
+    }
+
+    TrashDir* found = nullptr;
+    struct stat st;
+    if (!homeTrash_.empty()) {
+        if (TrashDir* home = openTrashDir(homeTrash_, true, error)) {
+            if (::fstat(home->filesFd, &st) == 0 && st.st_dev == device) {
+                found = home;
+            }
+        }
+    }
+
+    if (!found) {
+        // the top directory is the highest one still on the device
+        std::string topDir = parentOf(path);
+        while (topDir != "/") {
+            const std::string parent = parentOf(topDir);
+            if (::stat(parent.c_str(), &st) < 0 || st.st_dev != device) {
+                break;
+            }
+            topDir = parent;
+        }
+        const std::string prefix = topDir == "/" ? std::string() : topDir;
+        const std::string uid = std::to_string(uid_);
+        // $topdir/.Trash is only used when it is a real directory with the sticky bit set
+        const std::string shared = prefix + "/.Trash";
+        const bool sharedUsable =
+            ::lstat(shared.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && (st.st_mode & S_ISVTX) != 0;
+        const std::string candidates[] = {sharedUsable ? shared + "/" + uid : std::string(), prefix + "/.Trash-" + uid};
+        for (const std::string& candidate : candidates) {
+            if (candidate.empty()) {
+                continue;
+            }
+            TrashDir* dir = openTrashDir(candidate, true, error);
+            if (dir && ::fstat(dir->filesFd, &st) == 0 && st.st_dev == device) {
+                found = dir;
+                break;
+            }
+        }
+    }
+
+    dirsByDevice_[device] = found;
+    error = found ? 0 : EXDEV;
+    return found;
+}
+
+TrashStore::TrashDir* TrashStore::openTrashDir(const std::string& path, bool create, int& error) {
+    auto it = dirs_.find(path);
+    if (it != dirs_.end()) {
+        return it->second.get();
+    }
+
+    std::string topDir;
+    if (path != homeTrash_) {
+        const std::string parent = parentOf(path);
+        topDir = baseNameOf(path).compare(0, 7, ".Trash-") == 0 ? parent : parentOf(parent);
+    }
+
+    if (path == homeTrash_ && create) {
+        FsOps::Error err;
+        if (!FsOps::make_dir_parents(parentOf(path), err)) {
+            error = err.code;
+            return nullptr;
+        }
+    }
+    const int dirFd = openPrivateDir(AT_FDCWD, path.c_str(), create, uid_);
+    if (dirFd < 0) {
+        error = errno;
+        return nullptr;
+    }
+    const int filesFd = openPrivateDir(dirFd, "files", create, uid_);
+    const int infoFd = filesFd >= 0 ? openPrivateDir(dirFd, "info", create, uid_) : -1;
+    if (infoFd < 0) {
+        error = errno;
+        if (filesFd >= 0) {
+            ::close(filesFd);
+        }
+        ::close(dirFd);
+        return nullptr;
+    }
+    ::close(dirFd);
+
+    auto dir = std::make_unique<TrashDir>();
+    dir->path = path;
+    dir->topDir = std::move(topDir);
+    dir->filesFd = filesFd;
+    dir->infoFd = infoFd;
+    error = 0;
+    return dirs_.emplace(path, std::move(dir)).first->second.get();
+}
+
+std::vector<TrashStore::TrashDir*> TrashStore::knownTrashDirs() {
+    std::vector<TrashDir*> dirs;
+    int error = 0;
+    if (!homeTrash_.empty()) {
+        if (TrashDir* home = openTrashDir(homeTrash_, false, error)) {
+            dirs.push_back(home);
+        }
+    }
+
+    std::string mounts;
+    if (readSmallFile(AT_FDCWD, mountsFile_.c_str(), kMaxMountsSize, mounts)) {
+        const std::string uid = std::to_string(uid_);
+        std::size_t pos = 0;
+        while (pos < mounts.size()) {
+            auto end = mounts.find('\n', pos);
+            if (end == std::string::npos) {
+                end = mounts.size();
+            }
+            // "<device> <mount point> ...", spaces and the like escaped as \ooo
+            const std::string line = mounts.substr(pos, end - pos);
+            pos = end + 1;
+            const auto first = line.find(' ');
+            const auto second = first == std::string::npos ? first : line.find(' ', first + 1);
+            if (second == std::string::npos) {
+                continue;
+            }
+            std::string mountPoint;
+            for (std::size_t i = first + 1; i < second; ++i) {
+                if (line[i] == '\\' && i + 3 < second) {
+                    mountPoint += static_cast<char>(((line[i + 1] - '0') & 3) * 64 + ((line[i + 2] - '0') & 7) * 8 +
+                                                    ((line[i + 3] - '0') & 7));
+                    i += 3;
+                }
+                else {
+                    mountPoint += line[i];
+                }
+            }
+            const std::string prefix = mountPoint == "/" ? std::string() : mountPoint;
+            for (const std::string& candidate : {prefix + "/.Trash/" + uid, prefix + "/.Trash-" + uid}) {
+                TrashDir* dir = openTrashDir(candidate, false, error);
+                if (dir && std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+                    dirs.push_back(dir);
+                }
+            }
+        }
+    }
+    // trash directories found while trashing, in case the mount list was not readable
+    for (auto& entry : dirs_) {
+        if (std::find(dirs.begin(), dirs.end(), entry.second.get()) == dirs.end()) {
+            dirs.push_back(entry.second.get());
+        }
+    }
+    return dirs;
+}
+
+void TrashStore::refreshIndex(TrashDir& dir) {
+    struct stat st;
+    if (::fstat(dir.infoFd, &st) < 0) {
+        return;
+    }
+    if (dir.indexed && st.st_mtim.tv_sec == dir.infoMtime.tv_sec && st.st_mtim.tv_nsec == dir.infoMtime.tv_nsec) {
+        return;
+    }
+    dir.items.clear();
+    dir.infoMtime = st.st_mtim;
+    dir.indexed = true;
+
+    const int fd = ::fcntl(dir.infoFd, F_DUPFD_CLOEXEC, 0);
+    DIR* stream = fd >= 0 ? ::fdopendir(fd) : nullptr;
+    if (!stream) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return;
+    }
+    ::rewinddir(stream);
+    std::string data;
+    while (dirent* ent = ::readdir(stream)) {
+        const std::size_t length = std::strlen(ent->d_name);
+        if (length <= kInfoSuffixLength || std::strcmp(ent->d_name + length - kInfoSuffixLength, kInfoSuffix) != 0) {
+            continue;
+        }
+        const std::string name(ent->d_name, length - kInfoSuffixLength);
+        // info without its file is left over from an interrupted trashing
+        if (::fstatat(dir.filesFd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+            !readSmallFile(dir.infoFd, ent->d_name, kMaxInfoSize, data) || data.compare(0, 12, "[Trash Info]") != 0) {
+            continue;
+        }
+        Item item{dir.path, name, std::string(), std::string()};
+        std::size_t pos = 0;
+        while (pos < data.size()) {
+            auto end = data.find('\n', pos);
+            if (end == std::string::npos) {
+                end = data.size();
+            }
+            if (data.compare(pos, 5, "Path=") == 0) {
+                item.originalPath = decodePath(data.substr(pos + 5, end - pos - 5));
+            }
+            else if (data.compare(pos, 13, "DeletionDate=") == 0) {
+                item.deletionDate = data.substr(pos + 13, end - pos - 13);
+            }
+            pos = end + 1;
+        }
+        if (item.originalPath.empty()) {
+            continue;
+        }
+        if (item.originalPath[0] != '/') {
+            item.originalPath = (dir.topDir == "/" ? std::string() : dir.topDir) + "/" + item.originalPath;
+        }
+        dir.items.emplace(name, std::move(item));
+    }
+    ::closedir(stream);
+}
+
+void TrashStore::noteInfoChanged(TrashDir& dir) {
+    struct stat st;
+    if (::fstat(dir.infoFd, &st) == 0) {
+        dir.infoMtime = st.st_mtim;
+    }
+}
+
+std::vector<TrashStore::Item> TrashStore::items() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Item> items;
+    for (TrashDir* dir : knownTrashDirs()) {
+        refreshIndex(*dir);
+        for (const auto& entry : dir->items) {
+            items.push_back(entry.second);
+        }
+    }
+    return items;
+}
+
+bool TrashStore::restore(const std::string& trashedPath, FsOps::Error& err) {
+    err = {};
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto marker = trashedPath.rfind("/files/");
+    if (marker == std::string::npos || trashedPath.find('/', marker + 7) != std::string::npos) {
+        set_error(err, EINVAL, "Not in a trash directory: " + trashedPath);
+        return false;
+    }
+    int error = 0;
+    TrashDir* dir = openTrashDir(trashedPath.substr(0, marker), false, error);
+    if (!dir) {
+        set_error(err, error, "open " + trashedPath.substr(0, marker));
+        return false;
+    }
+    refreshIndex(*dir);
+    const std::string name = trashedPath.substr(marker + 7);
+    auto it = dir->items.find(name);
+    if (it == dir->items.end()) {
+        set_error(err, ENOENT, "No trash info for " + trashedPath);
+        return false;
+    }
+    const std::string original = it->second.originalPath;
+    if (!FsOps::make_dir_parents(parentOf(original), err)) {
+        return false;
+    }
+    error = renameNoReplace(dir->filesFd, name.c_str(), AT_FDCWD, original.c_str());
+    if (error != 0) {
+        set_error(err, error, "rename " + original);
+        return false;
+    }
+    ::unlinkat(dir->infoFd, (name + kInfoSuffix).c_str(), 0);
+    dir->items.erase(it);
+    noteInfoChanged(*dir);
+    return true;
+}
+
+bool TrashStore::empty(const std::function<bool()>& tick, FsOps::Error& err) {
+    err = {};
+    std::lock_guard<std::mutex> lock(mutex_);
+    FsOps::DeleteOptions options;
+    options.workerCount = 0;
+    const FsOps::ProgressCallback callback = [&tick](const FsOps::ProgressInfo&) { return !tick || tick(); };
+
+    for (TrashDir* dir : knownTrashDirs()) {
+        // everything in files/, with or without info, then whatever info is left
+        const int fd = ::fcntl(dir->filesFd, F_DUPFD_CLOEXEC, 0);
+        DIR* stream = fd >= 0 ? ::fdopendir(fd) : nullptr;
+        if (!stream) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            continue;
+        }
+        ::rewinddir(stream);
+        std::vector<std::string> names;
+        while (dirent* ent = ::readdir(stream)) {
+            if (std::strcmp(ent->d_name, ".") != 0 && std::strcmp(ent->d_name, "..") != 0) {
+                names.emplace_back(ent->d_name);
+            }
+        }
+        ::closedir(stream);
+
+        for (const std::string& name : names) {
+            if (tick && !tick()) {
+                set_error(err, ECANCELED, "empty trash");
+                noteInfoChanged(*dir);
+                return false;
+            }
+            FsOps::ProgressInfo progress;
+            FsOps::Error deleteErr;
+            if (!FsOps::delete_path(dir->path + "/files/" + name, progress, callback, deleteErr, options)) {
+                if (deleteErr.code == ECANCELED) {
+                    err = deleteErr;
+                    return false;
+                }
+                if (!err.isSet()) {
+                    err = deleteErr;
+                }
+                continue;
+            }
+            ::unlinkat(dir->infoFd, (name + kInfoSuffix).c_str(), 0);
+            dir->items.erase(name);
+        }
+
+        const int infoFd = ::fcntl(dir->infoFd, F_DUPFD_CLOEXEC, 0);
+        stream = infoFd >= 0 ? ::fdopendir(infoFd) : nullptr;
+        if (stream) {
+            ::rewinddir(stream);
+            names.clear();
+            while (dirent* ent = ::readdir(stream)) {
+                const std::size_t length = std::strlen(ent->d_name);
+                if (length > kInfoSuffixLength &&
+                    std::strcmp(ent->d_name + length - kInfoSuffixLength, kInfoSuffix) == 0) {
+                    names.emplace_back(ent->d_name, length - kInfoSuffixLength);
+                }
+            }
+            ::closedir(stream);
+            struct stat st;
+            for (const std::string& name : names) {
+                if (::fstatat(dir->filesFd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0 && errno == ENOENT) {
+                    ::unlinkat(dir->infoFd, (name + kInfoSuffix).c_str(), 0);
+                }
+            }
+        }
+        else if (infoFd >= 0) {
+            ::close(infoFd);
+        }
+        noteInfoChanged(*dir);
+        // cached sizes of trashed directories, kept by some file managers
+        const std::string sizes = dir->path + "/directorysizes";
+        ::unlink(sizes.c_str());
+    }
+    return !err.isSet();
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,108 @@
+/*
+ * Native freedesktop.org trash (POSIX-only, no Qt)
+ * src/core/trash_store.h
+ */
+
+#ifndef PCMANFM_TRASH_STORE_H
+#define PCMANFM_TRASH_STORE_H
+
+#include "fs_ops.h"
+
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace PCManFM {
+
+// TrashStore moves files to the trash as the freedesktop.org Trash specification lays it out:
+// the home trash for files on the home trash's filesystem, and $topdir/.Trash/$uid or
+// $topdir/.Trash-$uid on the filesystem of any other file. Files are renamed into place with
+// renameat2(RENAME_NOREPLACE) right after their .trashinfo is written; nothing is ever copied
+// across filesystems. The trash directories stay open between calls, and the entries of each
+// one are indexed in memory and only read again when its info/ directory changed behind the
+// store's back. Safe to share between threads.
+class TrashStore {
+   public:
+    struct Item {
+        std::string trashDir;  // holds files/ and info/
+        std::string name;      // of the entry in files/; its info is name + ".trashinfo"
+        std::string originalPath;
+        std::string deletionDate;  // "YYYY-MM-DDThh:mm:ss", local time
+
+        std::string path() const { return trashDir + "/files/" + name; }
+    };
+
+    // |homeTrash| is the trash of the user's home; |mountsFile| lists the mount points whose
+    // trash directories items() and empty() look at.
+    explicit TrashStore(std::string homeTrash, std::string mountsFile = "/proc/self/mounts");
+    ~TrashStore();
+
+    TrashStore(const TrashStore&) = delete;
+    TrashStore& operator=(const TrashStore&) = delete;
+
+    // $XDG_DATA_HOME/Trash, falling back to ~/.local/share/Trash when unset.
+    static std::string defaultHomeTrash();
+
+    // Process-wide store for defaultHomeTrash().
+    static TrashStore& instance();
+
+    // Moves every absolute path of |paths| to the trash of its filesystem. results[i] is 0 or
+    // the errno for paths[i]: EXDEV when its filesystem has no trash directory the user may
+    // use, EINVAL for a trash directory itself or a directory holding one. |tick| is called
+    // after each path and returns false to stop; the paths not reached get ECANCELED.
+    // Returns true when every path was trashed.
+    bool trash(const std::vector<std::string>& paths,
+               std::vector<int>& results,
+               const std::function<bool()>& tick = std::function<bool()>());
+
+    // Everything in the home trash and in the trash directories of the mounted filesystems.
+    std::vector<Item> items();
+
+    // Moves the entry at |trashedPath| (see Item::path()) back to its original path, which
+    // must not exist yet; missing parent directories are created.
+    bool restore(const std::string& trashedPath, FsOps::Error& err);
+
+    // Deletes everything items() lists, each entry with the parallel FsOps::delete_path().
+    // |tick| returns false to stop. Entries that cannot be deleted are skipped; the first
+    // failure is returned in |err|.
+    bool empty(const std::function<bool()>& tick, FsOps::Error& err);
+
+   private:
+    struct TrashDir {
+        std::string path;
+        std::string topDir;  // original paths are stored relative to it; empty for the home trash
+        int filesFd = -1;
+        int infoFd = -1;
+        bool indexed = false;
+        struct timespec infoMtime = {};
+        std::map<std::string, Item> items;  // by name
+    };
+
+    // The trash directory for files on |device|, |path| being one of them; null with |error|
+    // set when there is none.
+    TrashDir* trashDirFor(dev_t device, const std::string& path, int& error);
+    TrashDir* openTrashDir(const std::string& path, bool create, int& error);
+    std::vector<TrashDir*> knownTrashDirs();
+    bool trashOne(TrashDir& dir, const std::string& path, const std::string& date, int& error);
+    void refreshIndex(TrashDir& dir);
+    // records the info/ change made by the store itself, so that it does not cause a rescan
+    void noteInfoChanged(TrashDir& dir);
+
+    const std::string homeTrash_;
+    const std::string mountsFile_;
+    const uid_t uid_;
+    std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<TrashDir>> dirs_;  // by path
+    std::unordered_map<dev_t, TrashDir*> dirsByDevice_;      // null for devices without trash
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_TRASH_STORE_H
@@ -0,0 +1,85 @@
+/*
+ * Squarified treemap layout (no Qt)
+ * src/core/treemap_layout.cpp
+ */
+
+#include "treemap_layout.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace PCManFM::Treemap {
+
+namespace {
+
+// The worst aspect ratio in a row of total |rowArea| laid along a side of |side|, whose
+// largest and smallest rectangles have the areas |largest| and |smallest|.
+double worst_ratio(double rowArea, double largest, double smallest, double side) {
+    const double side2 = side * side;
+    const double rowArea2 = rowArea * rowArea;
+    return std::max(side2 * largest / rowArea2, rowArea2 / (side2 * smallest));
+}
+
+}  // namespace
+
+std::vector<Rect> squarify(const std::vector<std::uint64_t>& sizes, const Rect& bounds) {
+    std::vector<Rect> rects(sizes.size(), Rect{bounds.x, bounds.y, 0, 0});
+    double total = 0;
+    for (const std::uint64_t size : sizes) {
+        total += static_cast<double>(size);
+    }
+    if (total <= 0 || bounds.width <= 0 || bounds.height <= 0) {
+        return rects;
+    }
+
+    const double scale = bounds.width * bounds.height / total;
+    Rect free = bounds;
+    std::size_t pos = 0;
+    while (pos < sizes.size() && sizes[pos] != 0 && free.width > 0 && free.height > 0) {
+        const double side = std::min(free.width, free.height);
+        const double largest = static_cast<double>(sizes[pos]) * scale;
+        double rowArea = 0;
+        double worst = std::numeric_limits<double>::infinity();
+        std::size_t end = pos;
+        for (; end < sizes.size() && sizes[end] != 0; ++end) {
+            const double area = static_cast<double>(sizes[end]) * scale;
+            const double ratio = worst_ratio(rowArea + area, largest, area, side);
+            if (end > pos && ratio > worst) {
+                break;
+            }
+            worst = ratio;
+            rowArea += area;
+        }
+
+        // the last row takes what is left, whatever rounding left over
+        const bool lastRow = end == sizes.size() || sizes[end] == 0;
+        const bool vertical = free.width >= free.height;  // the row is a column on the left
+        const double length = vertical ? free.height : free.width;
+        double thickness = rowArea / length;
+        if (lastRow) {
+            thickness = vertical ? free.width : free.height;
+        }
+        double offset = 0;
+        for (std::size_t i = pos; i < end; ++i) {
+            double extent = static_cast<double>(sizes[i]) * scale / rowArea * length;
+            if (i + 1 == end) {
+                extent = length - offset;
+            }
+            rects[i] = vertical ? Rect{free.x, free.y + offset, thickness, extent}
+                                : Rect{free.x + offset, free.y, extent, thickness};
+            offset += extent;
+        }
+        if (vertical) {
+            free.x += thickness;
+            free.width = std::max(0.0, free.width - thickness);
+        }
+        else {
+            free.y += thickness;
+            free.height = std::max(0.0, free.height - thickness);
+        }
+        pos = end;
+    }
+    return rects;
+}
+
+}  // namespace PCManFM::Treemap
@@ -0,0 +1,29 @@
+/*
+ * Squarified treemap layout (no Qt)
+ * src/core/treemap_layout.h
+ */
+
+#ifndef PCMANFM_TREEMAP_LAYOUT_H
+#define PCMANFM_TREEMAP_LAYOUT_H
+
+#include <cstdint>
+#include <vector>
+
+namespace PCManFM::Treemap {
+
+struct Rect {
+    double x = 0;
+    double y = 0;
+    double width = 0;
+    double height = 0;
+};
+
+// Divides |bounds| into one rectangle per size, each with an area proportional to its size,
+// using the squarified layout of Bruls, Huizing and van Wijk: rows are laid along the shorter
+// side and grow for as long as that brings their rectangles closer to squares. |sizes| must be
+// sorted from the largest down; zero sizes get empty rectangles at the corner of |bounds|.
+std::vector<Rect> squarify(const std::vector<std::uint64_t>& sizes, const Rect& bounds);
+
+}  // namespace PCManFM::Treemap
+
+#endif  // PCMANFM_TREEMAP_LAYOUT_H
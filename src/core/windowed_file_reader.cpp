@@ -1,5 +1,5 @@
 /*
- * Sliding mmap-based reader for large files (POSIX-only, no Qt)
+ * Windowed mmap-based reader for large files (POSIX-only, no Qt)
  * src/core/windowed_file_reader.cpp
  */
 
@@ -19,14 +19,19 @@ namespace PCManFM {
 
 namespace {
 
+constexpr std::uint64_t kNoWindow = ~std::uint64_t{0};
+
 std::string errnoString(const char* context) {
     return std::string(context) + ": " + std::strerror(errno);
 }
 
 }  // namespace
 
-WindowedFileReader::WindowedFileReader(const std::string& path, std::size_t windowSizeBytes, std::string* errorOut)
-    : windowSize_(windowSizeBytes) {
+WindowedFileReader::WindowedFileReader(const std::string& path,
+                                       std::size_t windowSizeBytes,
+                                       std::string* errorOut,
+                                       std::size_t windowCount)
+    : windowSize_(windowSizeBytes), lastIndex_(kNoWindow) {
     fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
     if (fd_ < 0) {
         lastError_ = errnoString("open");
@@ -66,143 +71,172 @@ WindowedFileReader::WindowedFileReader(const std::string& path, std::size_t wind
         return;
     }
     fileSize_ = static_cast<std::size_t>(st.st_size);
-
-    const long page = ::sysconf(_SC_PAGESIZE);
-    pageSize_ = page > 0 ? static_cast<std::size_t>(page) : 4096;
-    if (windowSize_ == 0) {
-        windowSize_ = pageSize_ * 256;  // default ~1 MiB
-    }
-    windowSize_ = ((windowSize_ + pageSize_ - 1) / pageSize_) * pageSize_;
-
-    fallback_.resize(windowSize_);
+    identity_.dev = static_cast<std::uint64_t>(st.st_dev);
+    identity_.ino = static_cast<std::uint64_t>(st.st_ino);
+    identity_.size = static_cast<std::uint64_t>(st.st_size);
+    identity_.mtimeSec = static_cast<std::int64_t>(st.st_mtim.tv_sec);
+    identity_.mtimeNsec = static_cast<std::int64_t>(st.st_mtim.tv_nsec);
+
+    // Aligned windows start on huge page boundaries, which is also a multiple of any page size
+    // mmap() requires for its offset.
+    windowSize_ = std::max<std::size_t>(1, (windowSize_ + kWindowAlignment - 1) / kWindowAlignment) * kWindowAlignment;
+    entriesPerShard_ = std::max<std::size_t>(1, (windowCount + kShardCount - 1) / kShardCount);
     valid_ = true;
 }
 
 WindowedFileReader::~WindowedFileReader() {
-    clearWindow();
     if (fd_ >= 0) {
         ::close(fd_);
     }
 }
 
-void WindowedFileReader::clearWindow() const {
-    if (window_.isMmap && window_.ptr) {
-        ::munmap(window_.ptr, window_.length);
-    }
-    window_.ptr = nullptr;
-    window_.length = 0;
-    window_.offset = 0;
-    window_.isMmap = false;
-}
-
-bool WindowedFileReader::mapWindow(std::uint64_t offset, std::size_t length, std::string& errorOut) const {
-    if (!valid_) {
-        errorOut = lastError_;
-        return false;
-    }
-    clearWindow();
-    if (fileSize_ == 0) {
-        return true;
-    }
-    const std::uint64_t aligned = (offset / pageSize_) * pageSize_;
-    const std::size_t maxLen = std::min<std::size_t>(windowSize_, fileSize_ - aligned);
-    if (maxLen == 0) {
-        return true;
-    }
-
-    void* m = ::mmap(nullptr, maxLen, PROT_READ, MAP_SHARED, fd_, static_cast<off_t>(aligned));
-    if (m == MAP_FAILED) {
-        return fillFallback(offset, length, errorOut);
+// One window of the file, either mapped or read into |buffer|. Readers hold it through a
+// shared_ptr, so a window evicted from the cache stays valid until the last copy finishes.
+struct WindowedFileReader::Mapping {
+    const std::uint8_t* data = nullptr;
+    std::size_t length = 0;
+    bool isMmap = false;
+    std::vector<std::uint8_t> buffer;
+
+    ~Mapping() {
+        if (isMmap) {
+            ::munmap(const_cast<std::uint8_t*>(data), length);
+        }
     }
+};
 
-    window_.ptr = m;
-    window_.length = maxLen;
-    window_.offset = aligned;
-    window_.isMmap = true;
-
-    return true;
-}
-
-bool WindowedFileReader::fillFallback(std::uint64_t offset, std::size_t /*length*/, std::string& errorOut) const {
-    if (!valid_) {
-        errorOut = lastError_;
-        return false;
-    }
-    clearWindow();
-    if (fileSize_ == 0) {
-        return true;
-    }
+std::shared_ptr<const WindowedFileReader::Mapping> WindowedFileReader::createMapping(std::uint64_t index,
+                                                                                     std::string& errorOut) const {
+    const std::uint64_t start = index * windowSize_;
+    const std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(windowSize_, fileSize_ - start));
+    auto mapping = std::make_shared<Mapping>();
 
-    const std::uint64_t aligned = (offset / pageSize_) * pageSize_;
-    const std::size_t maxLen = std::min<std::size_t>(windowSize_, fileSize_ - aligned);
-    if (fallback_.size() < maxLen) {
-        fallback_.resize(maxLen);
+    void* m = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd_, static_cast<off_t>(start));
+    if (m != MAP_FAILED) {
+        mapping->data = static_cast<const std::uint8_t*>(m);
+        mapping->length = length;
+        mapping->isMmap = true;
+        return mapping;
     }
 
+    mapping->buffer.resize(length);
     std::size_t filled = 0;
-    while (filled < maxLen) {
+    while (filled < length) {
         const ssize_t n =
-            ::pread(fd_, fallback_.data() + filled, maxLen - filled, static_cast<off_t>(aligned + filled));
+            ::pread(fd_, mapping->buffer.data() + filled, length - filled, static_cast<off_t>(start + filled));
         if (n < 0) {
             if (errno == EINTR) {
                 continue;
             }
             errorOut = errnoString("pread");
-            return false;
+            return nullptr;
         }
         if (n == 0) {
             break;
         }
         filled += static_cast<std::size_t>(n);
     }
+    mapping->data = mapping->buffer.data();
+    mapping->length = filled;
+    return mapping;
+}
 
-    window_.ptr = fallback_.data();
-    window_.length = filled;
-    window_.offset = aligned;
-    window_.isMmap = false;
-    return true;
+std::shared_ptr<const WindowedFileReader::Mapping> WindowedFileReader::acquire(std::uint64_t index,
+                                                                               std::string& errorOut) const {
+    Shard& shard = shards_[index % kShardCount];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    const std::uint64_t now = ++shard.clock;
+    for (Entry& entry : shard.entries) {
+        if (entry.index == index) {
+            entry.lastUse = now;
+            return entry.mapping;
+        }
+    }
+
+    std::shared_ptr<const Mapping> mapping = createMapping(index, errorOut);
+    if (!mapping) {
+        return nullptr;
+    }
+    if (shard.entries.size() < entriesPerShard_) {
+        shard.entries.push_back(Entry{index, mapping, now});
+    }
+    else {
+        auto victim = std::min_element(shard.entries.begin(), shard.entries.end(),
+                                       [](const Entry& a, const Entry& b) { return a.lastUse < b.lastUse; });
+        *victim = Entry{index, mapping, now};
+    }
+    return mapping;
 }
 
-bool WindowedFileReader::read(std::uint64_t offset,
-                              std::size_t length,
-                              std::uint8_t* dest,
-                              std::size_t& bytesReadOut,
-                              std::string& errorOut) const {
+void WindowedFileReader::readAhead(std::uint64_t index) const {
+    if (index * windowSize_ >= fileSize_) {
+        return;
+    }
+    std::string ignored;
+    const std::shared_ptr<const Mapping> mapping = acquire(index, ignored);
+    if (mapping && mapping->isMmap) {
+        ::madvise(const_cast<std::uint8_t*>(mapping->data), mapping->length, MADV_WILLNEED);
+    }
+}
+
+// Stepping into a neighbouring window suggests a scroll or scan in that direction.
+void WindowedFileReader::noteAccess(std::uint64_t index) const {
+    const std::uint64_t previous = lastIndex_.exchange(index, std::memory_order_relaxed);
+    if (previous == kNoWindow || previous == index) {
+        return;
+    }
+    if (index == previous + 1) {
+        readAhead(index + 1);
+    }
+    else if (index + 1 == previous && index > 0) {
+        readAhead(index - 1);
+    }
+}
+
+bool WindowedFileReader::borrow(std::uint64_t offset, std::size_t length, Lease& out, std::string& errorOut) const {
+    out.reset();
     if (!valid_) {
         errorOut = lastError_;
         return false;
     }
-    bytesReadOut = 0;
     if (offset >= fileSize_ || length == 0) {
         return true;
     }
 
-    std::lock_guard<std::mutex> guard(windowMutex_);
+    const std::uint64_t index = offset / windowSize_;
+    std::shared_ptr<const Mapping> mapping = acquire(index, errorOut);
+    if (!mapping) {
+        return false;
+    }
+    noteAccess(index);
 
-    std::size_t remaining = std::min<std::size_t>(length, fileSize_ - offset);
-    std::uint64_t pos = offset;
-    std::size_t filled = 0;
+    const std::size_t windowOff = static_cast<std::size_t>(offset - index * windowSize_);
+    if (windowOff >= mapping->length) {
+        return true;  // short pread() fallback: the file shrank
+    }
+    out.data_ = mapping->data + windowOff;
+    out.size_ = std::min<std::size_t>(length, mapping->length - windowOff);
+    out.mapping_ = std::move(mapping);
+    return true;
+}
 
-    while (remaining > 0) {
-        const bool needRemap = !window_.ptr || pos < window_.offset || pos >= window_.offset + window_.length;
-        if (needRemap) {
-            if (!mapWindow(pos, remaining, errorOut)) {
-                return false;
-            }
-            if (!window_.ptr || window_.length == 0) {
-                break;
-            }
+bool WindowedFileReader::read(std::uint64_t offset,
+                              std::size_t length,
+                              std::uint8_t* dest,
+                              std::size_t& bytesReadOut,
+                              std::string& errorOut) const {
+    bytesReadOut = 0;
+    Lease lease;
+    while (bytesReadOut < length) {
+        if (!borrow(offset + bytesReadOut, length - bytesReadOut, lease, errorOut)) {
+            return false;
         }
-
-        const std::size_t windowOff = static_cast<std::size_t>(pos - window_.offset);
-        const std::size_t chunk = std::min<std::size_t>(remaining, window_.length - windowOff);
-        std::memcpy(dest + filled, static_cast<std::uint8_t*>(window_.ptr) + windowOff, chunk);
-        filled += chunk;
-        pos += chunk;
-        remaining -= chunk;
+        if (lease.empty()) {
+            break;
+        }
+        std::memcpy(dest + bytesReadOut, lease.data(), lease.size());
+        bytesReadOut += lease.size();
     }
-
-    bytesReadOut = filled;
     return true;
 }
 
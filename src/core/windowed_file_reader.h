@@ -1,11 +1,13 @@
 /*
- * Sliding mmap-based reader for large files (POSIX-only, no Qt)
+ * Windowed mmap-based reader for large files (POSIX-only, no Qt)
  * src/core/windowed_file_reader.h
  */
 
 #ifndef PCMANFM_WINDOWED_FILE_READER_H
 #define PCMANFM_WINDOWED_FILE_READER_H
 
+#include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
@@ -15,23 +17,81 @@
 
 namespace PCManFM {
 
-// WindowedFileReader maps a moving window of the file. When mmap is unavailable,
-// it transparently falls back to pread() into an internal buffer.
+// WindowedFileReader keeps an LRU cache of mapped windows of the file, so readers that switch
+// between distant regions (the hex view and a search, a disassembly listing and a jump target)
+// do not remap on every switch. The cache is split into shards by window index, each locked
+// only for the lookup; the copy itself runs on a reference-counted mapping without any lock.
+// Moving into an adjacent window maps the next one in the same direction and asks the kernel
+// to read it ahead. When mmap is unavailable, windows are filled with pread() instead.
+// borrow() hands out the cached bytes themselves for callers that can render in place.
 class WindowedFileReader {
+    struct Mapping;  // one cached window, defined in the .cpp
+
    public:
-    WindowedFileReader(const std::string& path, std::size_t windowSizeBytes, std::string* errorOut = nullptr);
+    // The file as it was when the reader opened it. Windows map the file at that size, so a
+    // reader whose file has since changed size or mtime no longer matches it.
+    struct Identity {
+        std::uint64_t dev = 0;
+        std::uint64_t ino = 0;
+        std::uint64_t size = 0;
+        std::int64_t mtimeSec = 0;
+        std::int64_t mtimeNsec = 0;
+
+        bool operator==(const Identity& other) const {
+            return dev == other.dev && ino == other.ino && size == other.size && mtimeSec == other.mtimeSec &&
+                   mtimeNsec == other.mtimeNsec;
+        }
+    };
+
+    static constexpr std::size_t kWindowAlignment = 2 * 1024 * 1024;
+    static constexpr std::size_t kDefaultWindowCount = 8;
+
+    // windowSizeBytes is rounded up to a multiple of kWindowAlignment; 0 selects one unit.
+    // windowCount is the number of windows kept mapped at once.
+    WindowedFileReader(const std::string& path,
+                       std::size_t windowSizeBytes,
+                       std::string* errorOut = nullptr,
+                       std::size_t windowCount = kDefaultWindowCount);
     ~WindowedFileReader();
 
     WindowedFileReader(const WindowedFileReader&) = delete;
     WindowedFileReader& operator=(const WindowedFileReader&) = delete;
 
     std::size_t size() const { return fileSize_; }
+    std::size_t windowSize() const { return windowSize_; }
     bool valid() const { return valid_; }
     const std::string& lastError() const { return lastError_; }
+    const Identity& identity() const { return identity_; }
+
+    // Bytes borrowed straight from a cached window. The lease pins that window, so data()
+    // stays valid for the lease's lifetime even if the cache evicts it meanwhile.
+    class Lease {
+       public:
+        const std::uint8_t* data() const { return data_; }
+        std::size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        void reset() {
+            mapping_.reset();
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+       private:
+        friend class WindowedFileReader;
+
+        std::shared_ptr<const Mapping> mapping_;
+        const std::uint8_t* data_ = nullptr;
+        std::size_t size_ = 0;
+    };
+
+    // Borrows up to length bytes at offset without copying. The span ends at the boundary of
+    // the window holding offset, so it can be shorter than asked for; callers wanting more
+    // borrow again from offset + size(). An offset at or past EOF yields an empty lease.
+    bool borrow(std::uint64_t offset, std::size_t length, Lease& out, std::string& errorOut) const;
 
     // Reads up to length bytes starting at offset into dest. bytesReadOut reports
     // how many bytes were actually copied (short if near EOF). On failure returns
-    // false and fills errorOut.
+    // false and fills errorOut. Safe to call from several threads at once.
     bool read(std::uint64_t offset,
               std::size_t length,
               std::uint8_t* dest,
@@ -39,26 +99,34 @@ class WindowedFileReader {
               std::string& errorOut) const;
 
    private:
-    struct Window {
-        void* ptr = nullptr;
-        std::size_t length = 0;
-        std::uint64_t offset = 0;
-        bool isMmap = false;
+    struct Entry {
+        std::uint64_t index = 0;
+        std::shared_ptr<const Mapping> mapping;
+        std::uint64_t lastUse = 0;
     };
 
-    bool mapWindow(std::uint64_t offset, std::size_t length, std::string& errorOut) const;
-    bool fillFallback(std::uint64_t offset, std::size_t length, std::string& errorOut) const;
-    void clearWindow() const;
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        std::uint64_t clock = 0;
+    };
+
+    static constexpr std::size_t kShardCount = 4;
+
+    std::shared_ptr<const Mapping> acquire(std::uint64_t index, std::string& errorOut) const;
+    std::shared_ptr<const Mapping> createMapping(std::uint64_t index, std::string& errorOut) const;
+    void noteAccess(std::uint64_t index) const;
+    void readAhead(std::uint64_t index) const;
 
     int fd_ = -1;
     bool valid_ = false;
     std::string lastError_;
     std::size_t fileSize_ = 0;
-    std::size_t pageSize_ = 4096;
+    Identity identity_;
     std::size_t windowSize_ = 0;
-    mutable Window window_;
-    mutable std::vector<std::uint8_t> fallback_;
-    mutable std::mutex windowMutex_;
+    std::size_t entriesPerShard_ = 1;
+    mutable std::array<Shard, kShardCount> shards_;
+    mutable std::atomic<std::uint64_t> lastIndex_;  // window of the previous read, for readahead
 };
 
 }  // namespace PCManFM
@@ -0,0 +1,375 @@
+/*
+ * Cross-reference and symbol index for disassembly listings (POSIX-only, no Qt)
+ * src/core/xref_index.cpp
+ */
+
+#include "xref_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace PCManFM {
+
+namespace {
+
+// File layout, native byte order: magic | u64 layout | u64 rows | u64 blocks | u64 references
+// | u64 symbols | u64 string bytes, then the blocks as five u64 each, the references as
+// u64 from | u64 to | u8 kind, the symbols as u64 address | u64 size | u32 name offset | u32
+// name length, and the symbol names.
+constexpr char kMagic[8] = {'P', 'C', 'M', 'F', 'X', 'R', 'F', '1'};
+constexpr std::size_t kHeaderSize = sizeof(kMagic) + 6 * 8;
+constexpr std::size_t kBlockRecord = 5 * 8;
+constexpr std::size_t kReferenceRecord = 8 + 8 + 1;
+constexpr std::size_t kSymbolRecord = 8 + 8 + 4 + 4;
+
+std::string errno_message(const char* context) {
+    return std::string(context) + ": " + std::strerror(errno);
+}
+
+bool write_all(int fd, const void* data, std::size_t size, std::string& errorOut) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errorOut = errno_message("write");
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, std::size_t size, std::string& errorOut) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::read(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errorOut = errno_message("read");
+            return false;
+        }
+        if (n == 0) {
+            errorOut = "Unexpected end of file";
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+class Writer {
+   public:
+    explicit Writer(std::vector<std::uint8_t>& out) : out_(out) {}
+    template <typename T>
+    void put(T value) {
+        const auto* bytes = reinterpret_cast<const std::uint8_t*>(&value);
+        out_.insert(out_.end(), bytes, bytes + sizeof(T));
+    }
+    void putBytes(const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+        out_.insert(out_.end(), bytes, bytes + size);
+    }
+
+   private:
+    std::vector<std::uint8_t>& out_;
+};
+
+class Reader {
+   public:
+    explicit Reader(const std::uint8_t* data) : p_(data) {}
+    template <typename T>
+    T get() {
+        T value;
+        std::memcpy(&value, p_, sizeof(T));
+        p_ += sizeof(T);
+        return value;
+    }
+
+   private:
+    const std::uint8_t* p_;
+};
+
+bool byTarget(const CodeReference& a, const CodeReference& b) {
+    return a.to != b.to ? a.to < b.to : a.from < b.from;
+}
+
+}  // namespace
+
+void XrefIndex::clear() {
+    blocks_.clear();
+    byAddress_.clear();
+    rowCount_ = 0;
+    references_.clear();
+    symbols_.clear();
+}
+
+void XrefIndex::assign(std::vector<CodeBlock> blocks,
+                       std::uint64_t rowCount,
+                       std::vector<CodeReference> references,
+                       std::vector<ImageSymbol> symbols) {
+    blocks_ = std::move(blocks);
+    rowCount_ = rowCount;
+    references_ = std::move(references);
+    std::sort(references_.begin(), references_.end(), byTarget);
+    symbols_ = std::move(symbols);
+    std::stable_sort(symbols_.begin(), symbols_.end(),
+                     [](const ImageSymbol& a, const ImageSymbol& b) { return a.address < b.address; });
+    sortByAddress();
+}
+
+void XrefIndex::sortByAddress() {
+    byAddress_.resize(blocks_.size());
+    for (std::size_t i = 0; i < blocks_.size(); ++i) {
+        byAddress_[i] = static_cast<std::uint32_t>(i);
+    }
+    // Among blocks starting at one address, the later ones hold its instructions; the earlier
+    // ones are empty.
+    std::stable_sort(byAddress_.begin(), byAddress_.end(), [this](std::uint32_t a, std::uint32_t b) {
+        return blocks_[a].firstAddress < blocks_[b].firstAddress;
+    });
+}
+
+std::size_t XrefIndex::blockForAddress(std::uint64_t address) const {
+    const auto it = std::upper_bound(byAddress_.begin(), byAddress_.end(), address,
+                                     [this](std::uint64_t value, std::uint32_t block) {
+                                         return value < blocks_[block].firstAddress;
+                                     });
+    return it == byAddress_.begin() ? blocks_.size() : *(it - 1);
+}
+
+std::pair<std::size_t, std::size_t> XrefIndex::referencesTo(std::uint64_t address) const {
+    const auto first = std::lower_bound(references_.begin(), references_.end(), address,
+                                        [](const CodeReference& ref, std::uint64_t value) { return ref.to < value; });
+    const auto last = std::upper_bound(first, references_.end(), address,
+                                       [](std::uint64_t value, const CodeReference& ref) { return value < ref.to; });
+    return {static_cast<std::size_t>(first - references_.begin()),
+            static_cast<std::size_t>(last - references_.begin())};
+}
+
+bool XrefIndex::isCallTarget(std::uint64_t address) const {
+    const auto range = referencesTo(address);
+    for (std::size_t i = range.first; i < range.second; ++i) {
+        if (references_[i].kind == CodeReference::Kind::Call) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const ImageSymbol* XrefIndex::symbolAt(std::uint64_t address) const {
+    const auto it =
+        std::lower_bound(symbols_.begin(), symbols_.end(), address,
+                         [](const ImageSymbol& symbol, std::uint64_t value) { return symbol.address < value; });
+    return it != symbols_.end() && it->address == address ? &*it : nullptr;
+}
+
+const ImageSymbol* XrefIndex::symbolContaining(std::uint64_t address) const {
+    const auto it =
+        std::upper_bound(symbols_.begin(), symbols_.end(), address,
+                         [](std::uint64_t value, const ImageSymbol& symbol) { return value < symbol.address; });
+    if (it == symbols_.begin()) {
+        return nullptr;
+    }
+    const ImageSymbol& symbol = *(it - 1);
+    return symbol.address == address || address - symbol.address < symbol.size ? &symbol : nullptr;
+}
+
+std::string XrefIndex::cachePath(const std::string& hexDigest) {
+    std::string base;
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0] == '/') {
+        base = xdg;
+    }
+    else {
+        const char* home = std::getenv("HOME");
+        if (!home || home[0] == '\0') {
+            const struct passwd* pw = ::getpwuid(::getuid());
+            home = pw ? pw->pw_dir : nullptr;
+        }
+        if (!home || home[0] == '\0') {
+            return std::string();
+        }
+        base = std::string(home) + "/.cache";
+    }
+    return base + "/pcmanfm-qt/xref/" + hexDigest + ".xref";
+}
+
+bool XrefIndex::save(const std::string& path, std::uint64_t layout, std::string& errorOut) const {
+    std::string names;
+    for (const ImageSymbol& symbol : symbols_) {
+        names += symbol.name;
+    }
+
+    std::vector<std::uint8_t> buffer;
+    buffer.reserve(kHeaderSize + blocks_.size() * kBlockRecord + references_.size() * kReferenceRecord +
+                   symbols_.size() * kSymbolRecord + names.size());
+    Writer out(buffer);
+    out.putBytes(kMagic, sizeof(kMagic));
+    out.put<std::uint64_t>(layout);
+    out.put<std::uint64_t>(rowCount_);
+    out.put<std::uint64_t>(blocks_.size());
+    out.put<std::uint64_t>(references_.size());
+    out.put<std::uint64_t>(symbols_.size());
+    out.put<std::uint64_t>(names.size());
+    for (const CodeBlock& block : blocks_) {
+        out.put(block.firstOffset);
+        out.put(block.endOffset);
+        out.put(block.readEnd);
+        out.put(block.firstAddress);
+        out.put(block.firstRow);
+    }
+    for (const CodeReference& ref : references_) {
+        out.put(ref.from);
+        out.put(ref.to);
+        out.put(static_cast<std::uint8_t>(ref.kind));
+    }
+    std::uint32_t nameOffset = 0;
+    for (const ImageSymbol& symbol : symbols_) {
+        out.put(symbol.address);
+        out.put(symbol.size);
+        out.put(nameOffset);
+        out.put(static_cast<std::uint32_t>(symbol.name.size()));
+        nameOffset += static_cast<std::uint32_t>(symbol.name.size());
+    }
+    out.putBytes(names.data(), names.size());
+
+    std::vector<char> tmpl(path.begin(), path.end());
+    const char suffix[] = ".XXXXXX";
+    tmpl.insert(tmpl.end(), suffix, suffix + sizeof(suffix));
+    const int fd = ::mkostemp(tmpl.data(), O_CLOEXEC);
+    if (fd < 0) {
+        errorOut = errno_message("mkostemp");
+        return false;
+    }
+    bool ok = write_all(fd, buffer.data(), buffer.size(), errorOut);
+    if (::close(fd) != 0 && ok) {
+        errorOut = errno_message("close");
+        ok = false;
+    }
+    if (ok && ::rename(tmpl.data(), path.c_str()) != 0) {
+        errorOut = errno_message("rename");
+        ok = false;
+    }
+    if (!ok) {
+        ::unlink(tmpl.data());
+    }
+    return ok;
+}
+
+bool XrefIndex::load(const std::string& path, std::uint64_t layout, std::string& errorOut) {
+    clear();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        errorOut = errno_message("open");
+        return false;
+    }
+    struct stat st{};
+    std::vector<std::uint8_t> buffer;
+    bool ok = ::fstat(fd, &st) == 0;
+    if (!ok) {
+        errorOut = errno_message("fstat");
+    }
+    else if (static_cast<std::uint64_t>(st.st_size) < kHeaderSize) {
+        errorOut = "Index file is truncated";
+        ok = false;
+    }
+    else {
+        buffer.resize(static_cast<std::size_t>(st.st_size));
+        ok = read_all(fd, buffer.data(), buffer.size(), errorOut);
+    }
+    ::close(fd);
+    if (!ok) {
+        return false;
+    }
+
+    Reader in(buffer.data() + sizeof(kMagic));
+    const std::uint64_t savedLayout = in.get<std::uint64_t>();
+    const std::uint64_t rowCount = in.get<std::uint64_t>();
+    const std::uint64_t blockCount = in.get<std::uint64_t>();
+    const std::uint64_t referenceCount = in.get<std::uint64_t>();
+    const std::uint64_t symbolCount = in.get<std::uint64_t>();
+    const std::uint64_t nameBytes = in.get<std::uint64_t>();
+    if (std::memcmp(buffer.data(), kMagic, sizeof(kMagic)) != 0 || savedLayout != layout) {
+        errorOut = "Index file is from another version";
+        return false;
+    }
+    // Each count is bounded by the file size before the products are formed.
+    const std::uint64_t body = buffer.size() - kHeaderSize;
+    if (blockCount > body / kBlockRecord || referenceCount > body / kReferenceRecord ||
+        symbolCount > body / kSymbolRecord || nameBytes > body ||
+        blockCount * kBlockRecord + referenceCount * kReferenceRecord + symbolCount * kSymbolRecord + nameBytes !=
+            body ||
+        blockCount > UINT32_MAX) {
+        errorOut = "Index file is corrupt";
+        return false;
+    }
+
+    std::vector<CodeBlock> blocks(static_cast<std::size_t>(blockCount));
+    for (CodeBlock& block : blocks) {
+        block.firstOffset = in.get<std::uint64_t>();
+        block.endOffset = in.get<std::uint64_t>();
+        block.readEnd = in.get<std::uint64_t>();
+        block.firstAddress = in.get<std::uint64_t>();
+        block.firstRow = in.get<std::uint64_t>();
+    }
+    std::vector<CodeReference> references(static_cast<std::size_t>(referenceCount));
+    for (CodeReference& ref : references) {
+        ref.from = in.get<std::uint64_t>();
+        ref.to = in.get<std::uint64_t>();
+        const std::uint8_t kind = in.get<std::uint8_t>();
+        if (kind > static_cast<std::uint8_t>(CodeReference::Kind::Branch)) {
+            errorOut = "Index file is corrupt";
+            return false;
+        }
+        ref.kind = static_cast<CodeReference::Kind>(kind);
+    }
+    const char* names = reinterpret_cast<const char*>(buffer.data()) + buffer.size() - nameBytes;
+    std::vector<ImageSymbol> symbols(static_cast<std::size_t>(symbolCount));
+    for (ImageSymbol& symbol : symbols) {
+        symbol.address = in.get<std::uint64_t>();
+        symbol.size = in.get<std::uint64_t>();
+        const std::uint32_t offset = in.get<std::uint32_t>();
+        const std::uint32_t length = in.get<std::uint32_t>();
+        if (static_cast<std::uint64_t>(offset) + length > nameBytes) {
+            errorOut = "Index file is corrupt";
+            return false;
+        }
+        symbol.name.assign(names + offset, length);
+    }
+
+    const bool ordered =
+        std::is_sorted(blocks.begin(), blocks.end(),
+                       [](const CodeBlock& a, const CodeBlock& b) { return a.firstRow < b.firstRow; }) &&
+        (blocks.empty() || blocks.back().firstRow <= rowCount) &&
+        std::is_sorted(references.begin(), references.end(), byTarget) &&
+        std::is_sorted(symbols.begin(), symbols.end(),
+                       [](const ImageSymbol& a, const ImageSymbol& b) { return a.address < b.address; });
+    if (!ordered) {
+        errorOut = "Index file is corrupt";
+        return false;
+    }
+
+    blocks_ = std::move(blocks);
+    rowCount_ = rowCount;
+    references_ = std::move(references);
+    symbols_ = std::move(symbols);
+    sortByAddress();
+    return true;
+}
+
+}  // namespace PCManFM
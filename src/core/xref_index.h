@@ -0,0 +1,89 @@
+/*
+ * Cross-reference and symbol index for disassembly listings (POSIX-only, no Qt)
+ * src/core/xref_index.h
+ */
+
+#ifndef PCMANFM_XREF_INDEX_H
+#define PCMANFM_XREF_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "binary_image.h"
+
+namespace PCManFM {
+
+// A run of instructions a listing decodes together: those starting in [firstOffset,
+// endOffset) of the file, the first at firstAddress and on row firstRow. Decoding may read
+// up to readEnd to complete the last one.
+struct CodeBlock {
+    std::uint64_t firstOffset = 0;
+    std::uint64_t endOffset = 0;
+    std::uint64_t readEnd = 0;
+    std::uint64_t firstAddress = 0;
+    std::uint64_t firstRow = 0;
+};
+
+// A direct call or branch from the instruction at |from| to |to|.
+struct CodeReference {
+    enum class Kind : std::uint8_t { Call, Branch };
+
+    std::uint64_t from = 0;
+    std::uint64_t to = 0;
+    Kind kind = Kind::Call;
+};
+
+// XrefIndex is what a full pass over the code of a binary learns: the blocks mapping rows to
+// addresses, every direct reference sorted by target, and the function symbols. Navigation
+// (jump to a target, list who calls an address, name an address) is then a binary search.
+// The index can be saved and loaded, so a file seen before is not decoded again.
+class XrefIndex {
+   public:
+    void clear();
+    // Takes over the pieces of a finished pass. |blocks| are in row order.
+    void assign(std::vector<CodeBlock> blocks,
+                std::uint64_t rowCount,
+                std::vector<CodeReference> references,
+                std::vector<ImageSymbol> symbols);
+
+    const std::vector<CodeBlock>& blocks() const { return blocks_; }
+    std::uint64_t rowCount() const { return rowCount_; }
+    // Sorted by target, then source.
+    const std::vector<CodeReference>& references() const { return references_; }
+    const std::vector<ImageSymbol>& symbols() const { return symbols_; }
+
+    // The block that would hold an instruction at |address|: the one whose first instruction
+    // is closest below or at it. Returns blocks().size() when none is.
+    std::size_t blockForAddress(std::uint64_t address) const;
+    // The references to |address|, as a range of references().
+    std::pair<std::size_t, std::size_t> referencesTo(std::uint64_t address) const;
+    bool isCallTarget(std::uint64_t address) const;
+    // The symbol starting at |address|, or the sized one covering it; null for neither.
+    const ImageSymbol* symbolAt(std::uint64_t address) const;
+    const ImageSymbol* symbolContaining(std::uint64_t address) const;
+
+    // $XDG_CACHE_HOME/pcmanfm-qt/xref/<digest>.xref, falling back to ~/.cache when unset;
+    // empty when there is no home directory.
+    static std::string cachePath(const std::string& hexDigest);
+
+    // Writes the index to |path| through a temporary file renamed into place. |layout|
+    // identifies how the blocks were cut; load() only accepts an index saved with the same.
+    bool save(const std::string& path, std::uint64_t layout, std::string& errorOut) const;
+    bool load(const std::string& path, std::uint64_t layout, std::string& errorOut);
+
+   private:
+    void sortByAddress();
+
+    std::vector<CodeBlock> blocks_;
+    std::vector<std::uint32_t> byAddress_;  // indices into blocks_, by firstAddress
+    std::uint64_t rowCount_ = 0;
+    std::vector<CodeReference> references_;
+    std::vector<ImageSymbol> symbols_;  // sorted by address
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_XREF_INDEX_H
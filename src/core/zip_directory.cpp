@@ -0,0 +1,381 @@
+/*
+ * Zip central directory reader with direct member access (POSIX-only, no Qt)
+ * src/core/zip_directory.cpp
+ */
+
+#include "zip_directory.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <limits>
+
+#include <sys/stat.h>
+
+namespace PCManFM::ZipDirectory {
+namespace {
+
+using FsOps::Error;
+
+constexpr std::uint32_t kLocalHeaderMagic = 0x04034b50;
+constexpr std::uint32_t kCentralHeaderMagic = 0x02014b50;
+constexpr std::uint32_t kEndMagic = 0x06054b50;
+constexpr std::uint32_t kZip64EndMagic = 0x06064b50;
+constexpr std::uint32_t kZip64LocatorMagic = 0x07064b50;
+constexpr std::size_t kLocalHeaderSize = 30;
+constexpr std::size_t kCentralHeaderSize = 46;
+constexpr std::size_t kEndSize = 22;
+constexpr std::size_t kZip64EndSize = 56;
+constexpr std::size_t kZip64LocatorSize = 20;
+constexpr std::size_t kMaxComment = 0xffff;
+constexpr std::uint32_t kMax32 = 0xffffffff;
+constexpr std::uint16_t kHostUnix = 3;
+constexpr std::uint16_t kFlagEncrypted = 1;
+constexpr std::size_t kReadChunk = 1024 * 1024;
+constexpr std::size_t kInflateChunk = 256 * 1024;
+
+inline void set_corrupt(Error& err, const std::string& what) {
+    err.code = EBADMSG;
+    err.message = "Corrupt zip archive: " + what;
+}
+
+std::uint16_t get_u16(const std::uint8_t* p) {
+    return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+std::uint32_t get_u32(const std::uint8_t* p) {
+    return static_cast<std::uint32_t>(get_u16(p)) | (static_cast<std::uint32_t>(get_u16(p + 2)) << 16);
+}
+
+std::uint64_t get_u64(const std::uint8_t* p) {
+    return static_cast<std::uint64_t>(get_u32(p)) | (static_cast<std::uint64_t>(get_u32(p + 4)) << 32);
+}
+
+bool read_exact(const WindowedFileReader& file,
+                std::uint64_t offset,
+                std::size_t length,
+                std::vector<std::uint8_t>& out,
+                Error& err) {
+    out.resize(length);
+    std::size_t got = 0;
+    std::string error;
+    if (!file.read(offset, length, out.data(), got, error)) {
+        err.code = EIO;
+        err.message = "read: " + error;
+        return false;
+    }
+    if (got != length) {
+        set_corrupt(err, "truncated");
+        return false;
+    }
+    return true;
+}
+
+std::int64_t dos_to_unix(std::uint16_t time, std::uint16_t date) {
+    struct tm tm{};
+    tm.tm_year = ((date >> 9) & 0x7f) + 80;
+    tm.tm_mon = std::max(((date >> 5) & 0xf) - 1, 0);
+    tm.tm_mday = std::max(date & 0x1f, 1);
+    tm.tm_hour = (time >> 11) & 0x1f;
+    tm.tm_min = (time >> 5) & 0x3f;
+    tm.tm_sec = (time & 0x1f) * 2;
+    tm.tm_isdst = -1;  // DOS times are local
+    return static_cast<std::int64_t>(std::mktime(&tm));
+}
+
+// Applies the extra fields of a central header: zip64 sizes and offset, and the Unix mtime.
+bool parse_extra(const std::uint8_t* p, std::size_t size, Entry& e, bool zipSize, bool zipCompressed, bool zipOffset) {
+    while (size >= 4) {
+        const std::uint16_t id = get_u16(p);
+        const std::uint16_t len = get_u16(p + 2);
+        if (len > size - 4) {
+            return false;
+        }
+        const std::uint8_t* field = p + 4;
+        if (id == 0x0001) {
+            // only the values the header left at 0xffffffff are present, in this order
+            std::size_t pos = 0;
+            for (auto [wanted, value] : {std::pair{zipSize, &e.size}, std::pair{zipCompressed, &e.compressedSize},
+                                         std::pair{zipOffset, &e.localHeaderOffset}}) {
+                if (!wanted) {
+                    continue;
+                }
+                if (pos + 8 > len) {
+                    return false;
+                }
+                *value = get_u64(field + pos);
+                pos += 8;
+            }
+        }
+        else if (id == 0x5455 && len >= 5 && (field[0] & 1)) {
+            e.mtime = static_cast<std::int32_t>(get_u32(field + 1));
+        }
+        p += 4 + len;
+        size -= 4 + len;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool Reader::open(const std::string& path, Error& err) {
+    entries_.clear();
+    byPath_.clear();
+    shift_ = 0;
+    std::string error;
+    file_ = std::make_unique<WindowedFileReader>(path, 0, &error);
+    if (!file_->valid()) {
+        err.code = EIO;
+        err.message = "open: " + error;
+        return false;
+    }
+
+    // The end record and its comment close the file, so a zip stored at the end of some other
+    // archive (a tar pads it with zeros) is not mistaken for a self-extractor.
+    const std::uint64_t size = file_->size();
+    const std::size_t tailSize =
+        static_cast<std::size_t>(std::min<std::uint64_t>(size, kEndSize + kMaxComment + kZip64LocatorSize));
+    std::vector<std::uint8_t> tail;
+    if (tailSize < kEndSize || !read_exact(*file_, size - tailSize, tailSize, tail, err)) {
+        err.code = ENODATA;
+        err.message = "Not a zip archive";
+        return false;
+    }
+    std::size_t end = tailSize - kEndSize + 1;
+    bool found = false;
+    while (!found && end > 0) {
+        --end;
+        found = get_u32(&tail[end]) == kEndMagic && end + kEndSize + get_u16(&tail[end + 20]) == tailSize;
+    }
+    if (!found) {
+        err.code = ENODATA;
+        err.message = "Not a zip archive";
+        return false;
+    }
+    const std::uint64_t endOffset = size - tailSize + end;
+    std::uint64_t count = get_u16(&tail[end + 10]);
+    std::uint64_t cdSize = get_u32(&tail[end + 12]);
+    std::uint64_t cdOffset = get_u32(&tail[end + 16]);
+    std::uint64_t cdEnd = endOffset;
+
+    if (end >= kZip64LocatorSize && get_u32(&tail[end - kZip64LocatorSize]) == kZip64LocatorMagic &&
+        endOffset >= kZip64LocatorSize + kZip64EndSize) {
+        // where the zip64 end record says it is, or right before the locator if data was prepended
+        const std::uint64_t recorded = get_u64(&tail[end - kZip64LocatorSize + 8]);
+        const std::uint64_t expected = endOffset - kZip64LocatorSize - kZip64EndSize;
+        std::vector<std::uint8_t> record;
+        std::uint64_t at = recorded;
+        if (recorded > expected || !read_exact(*file_, recorded, kZip64EndSize, record, err) ||
+            get_u32(record.data()) != kZip64EndMagic) {
+            at = expected;
+            if (!read_exact(*file_, at, kZip64EndSize, record, err) || get_u32(record.data()) != kZip64EndMagic) {
+                set_corrupt(err, "no zip64 end record");
+                return false;
+            }
+        }
+        count = get_u64(&record[32]);
+        cdSize = get_u64(&record[40]);
+        cdOffset = get_u64(&record[48]);
+        cdEnd = at;
+    }
+    if (cdSize > cdEnd || cdOffset > cdEnd - cdSize) {
+        set_corrupt(err, "central directory out of range");
+        return false;
+    }
+    shift_ = static_cast<std::int64_t>(cdEnd - cdSize - cdOffset);
+
+    std::vector<std::uint8_t> cd;
+    if (!read_exact(*file_, cdOffset + static_cast<std::uint64_t>(shift_), static_cast<std::size_t>(cdSize), cd, err)) {
+        return false;
+    }
+    entries_.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(count, cdSize / kCentralHeaderSize)));
+    std::size_t pos = 0;
+    while (pos + kCentralHeaderSize <= cd.size()) {
+        const std::uint8_t* h = &cd[pos];
+        if (get_u32(h) != kCentralHeaderMagic) {
+            set_corrupt(err, "bad central directory header");
+            return false;
+        }
+        const std::size_t nameLen = get_u16(h + 28);
+        const std::size_t extraLen = get_u16(h + 30);
+        const std::size_t commentLen = get_u16(h + 32);
+        if (pos + kCentralHeaderSize + nameLen + extraLen + commentLen > cd.size()) {
+            set_corrupt(err, "central directory header out of range");
+            return false;
+        }
+        Entry e;
+        const std::uint16_t madeBy = get_u16(h + 4);
+        e.flags = get_u16(h + 8);
+        e.method = get_u16(h + 10);
+        e.mtime = dos_to_unix(get_u16(h + 12), get_u16(h + 14));
+        e.crc = get_u32(h + 16);
+        e.compressedSize = get_u32(h + 20);
+        e.size = get_u32(h + 24);
+        const std::uint32_t external = get_u32(h + 38);
+        e.localHeaderOffset = get_u32(h + 42);
+        e.path.assign(reinterpret_cast<const char*>(h + kCentralHeaderSize), nameLen);
+        if (!parse_extra(h + kCentralHeaderSize + nameLen, extraLen, e, e.size == kMax32, e.compressedSize == kMax32,
+                         e.localHeaderOffset == kMax32)) {
+            set_corrupt(err, "bad extra field for " + e.path);
+            return false;
+        }
+        e.localHeaderOffset += static_cast<std::uint64_t>(shift_);
+
+        const bool dir = !e.path.empty() && e.path.back() == '/';
+        if ((madeBy >> 8) == kHostUnix && (external >> 16) != 0) {
+            e.mode = external >> 16;
+        }
+        if ((e.mode & S_IFMT) == 0) {
+            e.mode |= (dir || (external & 0x10)) ? S_IFDIR | (e.mode ? 0 : 0755) : S_IFREG | (e.mode ? 0 : 0644);
+        }
+
+        byPath_[e.path] = entries_.size();  // a later member of the same name wins
+        entries_.push_back(std::move(e));
+        pos += kCentralHeaderSize + nameLen + extraLen + commentLen;
+    }
+    return true;
+}
+
+const Entry* Reader::find(const std::string& path) const {
+    const auto it = byPath_.find(path);
+    return it == byPath_.end() ? nullptr : &entries_[it->second];
+}
+
+bool Reader::decodable(const Entry& entry) {
+    return (entry.method == Z_NO_COMPRESSION || entry.method == Z_DEFLATED) && !(entry.flags & kFlagEncrypted);
+}
+
+MemberStream::~MemberStream() {
+    if (zs_) {
+        ::inflateEnd(zs_);
+        delete zs_;
+    }
+}
+
+bool MemberStream::fail(Error& err, const std::string& message) {
+    set_corrupt(err, message + " in " + entry_->path);
+    entry_ = nullptr;
+    return false;
+}
+
+bool MemberStream::open(const Entry& entry, Error& err) {
+    entry_ = &entry;
+    lease_.reset();
+    const WindowedFileReader& file = *reader_.file_;
+    std::vector<std::uint8_t> header;
+    if (!read_exact(file, entry.localHeaderOffset, kLocalHeaderSize, header, err)) {
+        entry_ = nullptr;
+        return false;
+    }
+    if (get_u32(header.data()) != kLocalHeaderMagic) {
+        return fail(err, "bad local header");
+    }
+    pos_ = entry.localHeaderOffset + kLocalHeaderSize + get_u16(&header[26]) + get_u16(&header[28]);
+    if (pos_ > file.size() || entry.compressedSize > file.size() - pos_) {
+        return fail(err, "data out of range");
+    }
+    remaining_ = entry.compressedSize;
+    produced_ = 0;
+    crc_ = 0;
+    finished_ = false;
+
+    if (entry.method == Z_DEFLATED) {
+        if (!zs_) {
+            zs_ = new z_stream{};
+            if (::inflateInit2(zs_, -MAX_WBITS) != Z_OK) {
+                delete zs_;
+                zs_ = nullptr;
+                err.code = ENOMEM;
+                err.message = "Failed to initialize inflate";
+                entry_ = nullptr;
+                return false;
+            }
+        }
+        else {
+            ::inflateReset(zs_);
+        }
+        zs_->avail_in = 0;
+    }
+    return true;
+}
+
+bool MemberStream::next(const std::uint8_t*& data, std::size_t& len, Error& err) {
+    len = 0;
+    if (!entry_) {
+        err.code = EINVAL;
+        err.message = "No zip member open";
+        return false;
+    }
+    const WindowedFileReader& file = *reader_.file_;
+    std::string error;
+    if (entry_->method == Z_NO_COMPRESSION && remaining_ > 0) {
+        if (!file.borrow(pos_, static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, kReadChunk)), lease_,
+                         error)) {
+            err.code = EIO;
+            err.message = "read: " + error;
+            return false;
+        }
+        if (lease_.empty()) {
+            return fail(err, "truncated data");
+        }
+        data = lease_.data();
+        len = lease_.size();
+        pos_ += len;
+        remaining_ -= len;
+    }
+    else if (entry_->method == Z_DEFLATED && !finished_) {
+        out_.resize(kInflateChunk);
+        zs_->next_out = out_.data();
+        zs_->avail_out = static_cast<uInt>(out_.size());
+        while (zs_->avail_out == out_.size()) {
+            if (zs_->avail_in == 0) {
+                if (remaining_ == 0) {
+                    return fail(err, "truncated deflate stream");
+                }
+                if (!file.borrow(pos_, static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, kReadChunk)),
+                                 lease_, error)) {
+                    err.code = EIO;
+                    err.message = "read: " + error;
+                    return false;
+                }
+                if (lease_.empty()) {
+                    return fail(err, "truncated data");
+                }
+                zs_->next_in = const_cast<Bytef*>(lease_.data());
+                zs_->avail_in = static_cast<uInt>(lease_.size());
+                pos_ += lease_.size();
+                remaining_ -= lease_.size();
+            }
+            const int r = ::inflate(zs_, Z_NO_FLUSH);
+            if (r == Z_STREAM_END) {
+                finished_ = true;
+                break;
+            }
+            if (r != Z_OK) {
+                return fail(err, "bad deflate stream");
+            }
+        }
+        data = out_.data();
+        len = out_.size() - zs_->avail_out;
+    }
+
+    if (len > 0) {
+        crc_ = static_cast<std::uint32_t>(::crc32(crc_, data, static_cast<uInt>(len)));
+        produced_ += len;
+        if (produced_ > entry_->size) {
+            return fail(err, "more data than recorded");
+        }
+        return true;
+    }
+    if (produced_ != entry_->size) {
+        return fail(err, "size mismatch");
+    }
+    if (crc_ != entry_->crc) {
+        return fail(err, "CRC mismatch");
+    }
+    return true;
+}
+
+}  // namespace PCManFM::ZipDirectory
@@ -0,0 +1,98 @@
+/*
+ * Zip central directory reader with direct member access (POSIX-only, no Qt)
+ * src/core/zip_directory.h
+ */
+
+#ifndef PCMANFM_ZIP_DIRECTORY_H
+#define PCMANFM_ZIP_DIRECTORY_H
+
+#include "fs_ops.h"
+#include "windowed_file_reader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct z_stream_s;
+
+namespace PCManFM::ZipDirectory {
+
+// A zip ends with a central directory listing every member with its sizes and the offset of
+// its local header, so totals are known and any member can be reached without reading the
+// others. Zip64 records are followed; data before the archive (self-extractors) is allowed,
+// data after it is not.
+
+// One member as the central directory describes it. |mode| carries the file type bits as in
+// st_mode, from the Unix attributes when the archiver recorded them.
+struct Entry {
+    std::string path;  // as stored; directories end in '/'
+    std::uint64_t size = 0;
+    std::uint64_t compressedSize = 0;
+    std::uint64_t localHeaderOffset = 0;
+    std::int64_t mtime = 0;
+    std::uint32_t mode = 0;
+    std::uint32_t crc = 0;
+    std::uint16_t method = 0;
+    std::uint16_t flags = 0;
+};
+
+class Reader {
+   public:
+    Reader() = default;
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // Loads the central directory of |path|. Fails with ENODATA when the file is not a zip.
+    bool open(const std::string& path, FsOps::Error& err);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+    const Entry* find(const std::string& path) const;
+
+    // Whether MemberStream can decode |entry|: stored or deflated, and not encrypted.
+    static bool decodable(const Entry& entry);
+
+   private:
+    friend class MemberStream;
+
+    std::unique_ptr<WindowedFileReader> file_;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, std::size_t> byPath_;
+    std::int64_t shift_ = 0;  // bytes before the archive, which its offsets do not count
+};
+
+// Decodes the data of one member at a time. Streams are independent, so several threads can
+// each read members of one Reader through a stream of their own.
+class MemberStream {
+   public:
+    explicit MemberStream(const Reader& reader) : reader_(reader) {}
+    ~MemberStream();
+    MemberStream(const MemberStream&) = delete;
+    MemberStream& operator=(const MemberStream&) = delete;
+
+    // Positions the stream at the data of |entry|, which must be decodable.
+    bool open(const Entry& entry, FsOps::Error& err);
+
+    // Hands out the next decoded bytes; len == 0 at the end, once the size and CRC matched.
+    bool next(const std::uint8_t*& data, std::size_t& len, FsOps::Error& err);
+
+   private:
+    bool fail(FsOps::Error& err, const std::string& message);
+
+    const Reader& reader_;
+    const Entry* entry_ = nullptr;
+    z_stream_s* zs_ = nullptr;
+    std::uint64_t pos_ = 0;        // next compressed byte in the file
+    std::uint64_t remaining_ = 0;  // compressed bytes not yet read
+    std::uint64_t produced_ = 0;
+    std::uint32_t crc_ = 0;
+    bool finished_ = false;
+    WindowedFileReader::Lease lease_;
+    std::vector<std::uint8_t> out_;
+};
+
+}  // namespace PCManFM::ZipDirectory
+
+#endif  // PCMANFM_ZIP_DIRECTORY_H
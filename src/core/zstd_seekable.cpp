@@ -0,0 +1,456 @@
+/*
+ * Seekable zstd container with a member index for tar streams (POSIX-only, no Qt)
+ * src/core/zstd_seekable.cpp
+ */
+
+#include "zstd_seekable.h"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PCManFM::ZstdSeekable {
+namespace {
+
+using FsOps::Error;
+
+constexpr std::uint32_t kSkippableMagicBase = 0x184D2A50;
+constexpr std::uint32_t kIndexMagic = kSkippableMagicBase + 0xB;
+constexpr std::uint32_t kSeekTableMagic = kSkippableMagicBase + 0xE;
+constexpr std::uint32_t kSeekableFooterMagic = 0x8F92EAB1;
+constexpr std::size_t kFooterSize = 9;  // frame count, descriptor, magic
+constexpr char kIndexTag[8] = {'P', 'C', 'M', 'F', 'T', 'I', 'X', '1'};
+constexpr std::size_t kMinJobSize = 512 * 1024;  // zstd rejects smaller worker jobs
+
+inline void set_error(Error& err, const std::string& context) {
+    err.code = errno;
+    err.message = context + ": " + std::strerror(errno);
+}
+
+inline void set_zstd_error(Error& err, const char* context, std::size_t rc) {
+    err.code = EIO;
+    err.message = std::string(context) + ": " + ZSTD_getErrorName(rc);
+}
+
+inline void set_corrupt(Error& err, const char* what) {
+    err.code = EBADMSG;
+    err.message = std::string("Corrupt seekable archive: ") + what;
+}
+
+void put_u32(std::vector<std::uint8_t>& out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+}
+
+void put_u64(std::vector<std::uint8_t>& out, std::uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+    }
+}
+
+void put_string(std::vector<std::uint8_t>& out, const std::string& s) {
+    put_u32(out, static_cast<std::uint32_t>(s.size()));
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+std::uint32_t get_u32(const std::uint8_t* p) {
+    std::uint32_t v = 0;
+    for (int i = 3; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+std::uint64_t get_u64(const std::uint8_t* p) {
+    std::uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Bounds-checked consumer for the index payload.
+struct Cursor {
+    const std::uint8_t* p;
+    std::size_t left;
+
+    bool u32(std::uint32_t& v) {
+        if (left < 4) {
+            return false;
+        }
+        v = get_u32(p);
+        p += 4;
+        left -= 4;
+        return true;
+    }
+    bool u64(std::uint64_t& v) {
+        if (left < 8) {
+            return false;
+        }
+        v = get_u64(p);
+        p += 8;
+        left -= 8;
+        return true;
+    }
+    bool str(std::string& s) {
+        std::uint32_t len = 0;
+        if (!u32(len) || left < len) {
+            return false;
+        }
+        s.assign(reinterpret_cast<const char*>(p), len);
+        p += len;
+        left -= len;
+        return true;
+    }
+};
+
+bool pread_full(int fd, void* buf, std::size_t len, std::uint64_t offset, Error& err) {
+    auto* p = static_cast<std::uint8_t*>(buf);
+    while (len > 0) {
+        const ssize_t n = ::pread(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error(err, "pread");
+            return false;
+        }
+        if (n == 0) {
+            err.code = EIO;
+            err.message = "Unexpected end of file";
+            return false;
+        }
+        p += n;
+        len -= static_cast<std::size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+}  // namespace
+
+Writer::~Writer() {
+    ZSTD_freeCCtx(cctx_);
+}
+
+bool Writer::open(int fd, const Params& params, Error& err) {
+    if (params.frameSize == 0 || params.frameSize > std::numeric_limits<std::uint32_t>::max() / 2) {
+        err.code = EINVAL;
+        err.message = "Invalid seekable frame size";
+        return false;
+    }
+    cctx_ = ZSTD_createCCtx();
+    if (!cctx_) {
+        err.code = ENOMEM;
+        err.message = "Failed to allocate zstd context";
+        return false;
+    }
+
+    if (params.level != 0) {
+        const std::size_t rc = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, params.level);
+        if (ZSTD_isError(rc)) {
+            err.code = EINVAL;
+            err.message = "Unsupported zstd compression level " + std::to_string(params.level);
+            return false;
+        }
+    }
+    ZSTD_CCtx_setParameter(cctx_, ZSTD_c_checksumFlag, 1);
+    // Workers and long matching are best-effort: a libzstd built without threads still
+    // produces the same format, just on one core.
+    if (params.threads > 1) {
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_nbWorkers, static_cast<int>(params.threads));
+        const std::size_t job = std::max(kMinJobSize, params.frameSize / params.threads);
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_jobSize, static_cast<int>(job));
+    }
+    if (params.windowLog > 0) {
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_enableLongDistanceMatching, 1);
+        ZSTD_CCtx_setParameter(cctx_, ZSTD_c_windowLog, static_cast<int>(params.windowLog));
+    }
+
+    fd_ = fd;
+    params_ = params;
+    in_.reserve(params.frameSize);
+    out_.resize(ZSTD_compressBound(params.frameSize));
+    return true;
+}
+
+bool Writer::resume(int fd,
+                    const Params& params,
+                    std::vector<std::pair<std::uint32_t, std::uint32_t>> frames,
+                    std::vector<IndexEntry> entries,
+                    Error& err) {
+    if (!open(fd, params, err)) {
+        return false;
+    }
+    offset_ = 0;
+    for (const auto& frame : frames) {
+        offset_ += frame.second;
+    }
+    frames_ = std::move(frames);
+    entries_ = std::move(entries);
+    return true;
+}
+
+void Writer::addEntry(IndexEntry entry) {
+    entries_.push_back(std::move(entry));
+}
+
+bool Writer::write(const void* data, std::size_t size, Error& err) {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    while (size > 0) {
+        const std::size_t take = std::min(size, params_.frameSize - in_.size());
+        in_.insert(in_.end(), p, p + take);
+        p += take;
+        size -= take;
+        offset_ += take;
+        if (in_.size() == params_.frameSize && !flushFrame(err)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Writer::flushFrame(Error& err) {
+    if (in_.empty()) {
+        return true;
+    }
+    const std::size_t n = ZSTD_compress2(cctx_, out_.data(), out_.size(), in_.data(), in_.size());
+    if (ZSTD_isError(n)) {
+        set_zstd_error(err, "ZSTD_compress2", n);
+        return false;
+    }
+    if (!writeOut(out_.data(), n, err)) {
+        return false;
+    }
+    frames_.emplace_back(static_cast<std::uint32_t>(n), static_cast<std::uint32_t>(in_.size()));
+    in_.clear();
+    return true;
+}
+
+bool Writer::writeOut(const void* data, std::size_t size, Error& err) {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    while (size > 0) {
+        const ssize_t n = ::write(fd_, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_error(err, "write");
+            return false;
+        }
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool Writer::finish(Error& err) {
+    if (!flushFrame(err)) {
+        return false;
+    }
+
+    std::vector<std::uint8_t> index;
+    put_u32(index, kIndexMagic);
+    put_u32(index, 0);  // frame size, patched below
+    index.insert(index.end(), std::begin(kIndexTag), std::end(kIndexTag));
+    put_u64(index, entries_.size());
+    for (const IndexEntry& e : entries_) {
+        put_u32(index, e.mode);
+        put_u64(index, e.size);
+        put_u64(index, e.offset);
+        put_u64(index, static_cast<std::uint64_t>(e.mtime));
+        put_string(index, e.path);
+        put_string(index, e.linkTarget);
+    }
+    const std::uint32_t indexSize = static_cast<std::uint32_t>(index.size() - 8);
+    for (int i = 0; i < 4; ++i) {
+        index[4 + i] = static_cast<std::uint8_t>(indexSize >> (8 * i));
+    }
+
+    std::vector<std::uint8_t> table;
+    put_u32(table, kSeekTableMagic);
+    put_u32(table, static_cast<std::uint32_t>(frames_.size() * 8 + kFooterSize));
+    for (const auto& frame : frames_) {
+        put_u32(table, frame.first);
+        put_u32(table, frame.second);
+    }
+    put_u32(table, static_cast<std::uint32_t>(frames_.size()));
+    table.push_back(0);  // descriptor: no per-frame checksums (frames carry their own)
+    put_u32(table, kSeekableFooterMagic);
+
+    return writeOut(index.data(), index.size(), err) && writeOut(table.data(), table.size(), err);
+}
+
+Reader::~Reader() {
+    ZSTD_freeDCtx(dctx_);
+}
+
+bool Reader::open(int fd, Error& err) {
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        set_error(err, "fstat");
+        return false;
+    }
+    const std::uint64_t fileSize = static_cast<std::uint64_t>(st.st_size);
+    auto noIndex = [&err]() {
+        err.code = ENODATA;
+        err.message = "Archive has no seekable index";
+        return false;
+    };
+    if (!S_ISREG(st.st_mode) || fileSize < kFooterSize + 8) {
+        return noIndex();
+    }
+
+    std::uint8_t footer[kFooterSize];
+    if (!pread_full(fd, footer, sizeof(footer), fileSize - kFooterSize, err)) {
+        return false;
+    }
+    if (get_u32(footer + 5) != kSeekableFooterMagic) {
+        return noIndex();
+    }
+    const std::uint32_t frameCount = get_u32(footer);
+    const std::uint8_t descriptor = footer[4];
+    if ((descriptor & 0x7c) != 0) {
+        set_corrupt(err, "reserved seek table bits set");
+        return false;
+    }
+    const std::uint64_t entrySize = (descriptor & 0x80) ? 12 : 8;
+    const std::uint64_t tableSize = 8 + frameCount * entrySize + kFooterSize;
+    if (tableSize > fileSize) {
+        set_corrupt(err, "seek table larger than file");
+        return false;
+    }
+    const std::uint64_t tableStart = fileSize - tableSize;
+    std::vector<std::uint8_t> table(static_cast<std::size_t>(tableSize));
+    if (!pread_full(fd, table.data(), table.size(), tableStart, err)) {
+        return false;
+    }
+    if (get_u32(table.data()) != kSeekTableMagic || get_u32(table.data() + 4) != tableSize - 8) {
+        set_corrupt(err, "bad seek table header");
+        return false;
+    }
+
+    std::uint64_t compressed = 0;
+    std::uint64_t decompressed = 0;
+    for (std::uint32_t i = 0; i < frameCount; ++i) {
+        const std::uint8_t* e = table.data() + 8 + i * entrySize;
+        Frame frame;
+        frame.compressedOffset = compressed;
+        frame.decompressedOffset = decompressed;
+        frame.compressedSize = get_u32(e);
+        frame.decompressedSize = get_u32(e + 4);
+        compressed += frame.compressedSize;
+        decompressed += frame.decompressedSize;
+        frames_.push_back(frame);
+    }
+    if (compressed + 8 > tableStart) {
+        set_corrupt(err, "frames overlap the seek table");
+        return false;
+    }
+
+    // The member index is the skippable frame between the data and the seek table.
+    std::uint8_t header[8];
+    if (!pread_full(fd, header, sizeof(header), compressed, err)) {
+        return false;
+    }
+    if (get_u32(header) != kIndexMagic || get_u32(header + 4) != tableStart - compressed - 8) {
+        return noIndex();
+    }
+    std::vector<std::uint8_t> payload(static_cast<std::size_t>(tableStart - compressed - 8));
+    if (!pread_full(fd, payload.data(), payload.size(), compressed + 8, err)) {
+        return false;
+    }
+    if (payload.size() < sizeof(kIndexTag) || std::memcmp(payload.data(), kIndexTag, sizeof(kIndexTag)) != 0) {
+        return noIndex();
+    }
+
+    Cursor cur{payload.data() + sizeof(kIndexTag), payload.size() - sizeof(kIndexTag)};
+    std::uint64_t count = 0;
+    if (!cur.u64(count)) {
+        set_corrupt(err, "truncated member index");
+        return false;
+    }
+    for (std::uint64_t i = 0; i < count; ++i) {
+        IndexEntry e;
+        std::uint64_t mtime = 0;
+        if (!cur.u32(e.mode) || !cur.u64(e.size) || !cur.u64(e.offset) || !cur.u64(mtime) || !cur.str(e.path) ||
+            !cur.str(e.linkTarget)) {
+            set_corrupt(err, "truncated member index");
+            return false;
+        }
+        if (e.offset >= decompressed) {
+            set_corrupt(err, "member offset past end of stream");
+            return false;
+        }
+        e.mtime = static_cast<std::int64_t>(mtime);
+        byPath_.emplace(e.path, entries_.size());
+        entries_.push_back(std::move(e));
+    }
+
+    dctx_ = ZSTD_createDCtx();
+    if (!dctx_) {
+        err.code = ENOMEM;
+        err.message = "Failed to allocate zstd context";
+        return false;
+    }
+    ZSTD_DCtx_setParameter(dctx_, ZSTD_d_windowLogMax, ZSTD_WINDOWLOG_MAX_64);
+    fd_ = fd;
+    size_ = decompressed;
+    current_ = frames_.size();
+    return true;
+}
+
+const IndexEntry* Reader::find(const std::string& path) const {
+    const auto it = byPath_.find(path);
+    return it == byPath_.end() ? nullptr : &entries_[it->second];
+}
+
+bool Reader::seek(std::uint64_t offset, Error& err) {
+    if (offset >= size_) {
+        err.code = EINVAL;
+        err.message = "Seek past end of archive";
+        return false;
+    }
+    const auto it = std::upper_bound(frames_.begin(), frames_.end(), offset,
+                                     [](std::uint64_t off, const Frame& f) { return off < f.decompressedOffset; });
+    current_ = static_cast<std::size_t>(it - frames_.begin()) - 1;
+    skip_ = static_cast<std::size_t>(offset - frames_[current_].decompressedOffset);
+    return true;
+}
+
+bool Reader::next(const std::uint8_t*& data, std::size_t& len, Error& err) {
+    len = 0;
+    if (current_ >= frames_.size()) {
+        return true;
+    }
+    const Frame& frame = frames_[current_];
+    compressed_.resize(frame.compressedSize);
+    decoded_.resize(frame.decompressedSize);
+    if (!pread_full(fd_, compressed_.data(), compressed_.size(), frame.compressedOffset, err)) {
+        return false;
+    }
+    const std::size_t n =
+        ZSTD_decompressDCtx(dctx_, decoded_.data(), decoded_.size(), compressed_.data(), compressed_.size());
+    if (ZSTD_isError(n)) {
+        set_zstd_error(err, "ZSTD_decompressDCtx", n);
+        return false;
+    }
+    if (n != frame.decompressedSize) {
+        set_corrupt(err, "frame size does not match seek table");
+        return false;
+    }
+    data = decoded_.data() + skip_;
+    len = n - skip_;
+    skip_ = 0;
+    ++current_;
+    return true;
+}
+
+}  // namespace PCManFM::ZstdSeekable
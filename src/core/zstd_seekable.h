@@ -0,0 +1,134 @@
+/*
+ * Seekable zstd container with a member index for tar streams (POSIX-only, no Qt)
+ * src/core/zstd_seekable.h
+ */
+
+#ifndef PCMANFM_ZSTD_SEEKABLE_H
+#define PCMANFM_ZSTD_SEEKABLE_H
+
+#include "fs_ops.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+namespace PCManFM::ZstdSeekable {
+
+// The stream is a run of independent zstd frames, each covering a fixed amount of input, so
+// any uncompressed offset can be reached by decoding a single frame. Two skippable frames
+// follow the data and are ignored by ordinary zstd decoders: a member index (one record per
+// tar entry with its metadata and the uncompressed offset of its header), then a seek table
+// in the zstd "seekable format" layout (per-frame sizes, footer with the 0x8F92EAB1 magic).
+
+constexpr std::size_t kDefaultFrameSize = 8 * 1024 * 1024;
+
+// One tar member. |mode| carries the file type bits as in st_mode; |offset| is where the
+// member's header (including any pax extension header) starts in the uncompressed stream.
+struct IndexEntry {
+    std::string path;
+    std::string linkTarget;
+    std::uint64_t size = 0;
+    std::uint64_t offset = 0;
+    std::int64_t mtime = 0;
+    std::uint32_t mode = 0;
+};
+
+class Writer {
+   public:
+    struct Params {
+        int level = 0;           // 0 = zstd default
+        unsigned threads = 1;    // zstd workers used inside each frame
+        unsigned windowLog = 0;  // long-distance matching window (bounded by frameSize); 0 = off
+        std::size_t frameSize = kDefaultFrameSize;
+    };
+
+    Writer() = default;
+    ~Writer();
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Starts a stream on |fd|, which must be positioned at the start of an empty file.
+    bool open(int fd, const Params& params, FsOps::Error& err);
+
+    // Continues a stream after the |frames| (compressed, decompressed sizes) already in |fd|,
+    // whose members are |entries|; |fd| must be positioned right after those frames. The
+    // index written by finish() lists |entries| followed by those added from now on.
+    bool resume(int fd,
+                const Params& params,
+                std::vector<std::pair<std::uint32_t, std::uint32_t>> frames,
+                std::vector<IndexEntry> entries,
+                FsOps::Error& err);
+
+    // Uncompressed bytes accepted so far; the offset the next addEntry() should record.
+    std::uint64_t offset() const { return offset_; }
+    void addEntry(IndexEntry entry);
+
+    bool write(const void* data, std::size_t size, FsOps::Error& err);
+
+    // Flushes the last frame and appends the index and seek table.
+    bool finish(FsOps::Error& err);
+
+   private:
+    bool flushFrame(FsOps::Error& err);
+    bool writeOut(const void* data, std::size_t size, FsOps::Error& err);
+
+    int fd_ = -1;
+    Params params_;
+    ZSTD_CCtx_s* cctx_ = nullptr;
+    std::vector<std::uint8_t> in_;
+    std::vector<std::uint8_t> out_;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> frames_;  // compressed, decompressed
+    std::vector<IndexEntry> entries_;
+    std::uint64_t offset_ = 0;
+};
+
+class Reader {
+   public:
+    struct Frame {
+        std::uint64_t compressedOffset = 0;
+        std::uint64_t decompressedOffset = 0;
+        std::uint32_t compressedSize = 0;
+        std::uint32_t decompressedSize = 0;
+    };
+
+    Reader() = default;
+    ~Reader();
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // Loads the seek table and member index of the stream in |fd|. Fails with ENODATA when
+    // the file is not a seekable stream with an index (e.g. a tar.zst from another tool).
+    bool open(int fd, FsOps::Error& err);
+
+    const std::vector<IndexEntry>& entries() const { return entries_; }
+    const IndexEntry* find(const std::string& path) const;
+    const std::vector<Frame>& frames() const { return frames_; }
+    std::uint64_t size() const { return size_; }
+
+    // Positions the stream at uncompressed |offset|; next() then hands out the decoded bytes
+    // from there, one frame at a time, and reports len == 0 at the end.
+    bool seek(std::uint64_t offset, FsOps::Error& err);
+    bool next(const std::uint8_t*& data, std::size_t& len, FsOps::Error& err);
+
+   private:
+    int fd_ = -1;
+    ZSTD_DCtx_s* dctx_ = nullptr;
+    std::vector<Frame> frames_;
+    std::vector<IndexEntry> entries_;
+    std::unordered_map<std::string, std::size_t> byPath_;
+    std::uint64_t size_ = 0;
+    std::size_t current_ = 0;
+    std::size_t skip_ = 0;
+    std::vector<std::uint8_t> compressed_;
+    std::vector<std::uint8_t> decoded_;
+};
+
+}  // namespace PCManFM::ZstdSeekable
+
+#endif  // PCMANFM_ZSTD_SEEKABLE_H
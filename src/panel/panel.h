@@ -10,15 +10,33 @@
 #include <libfm-qt6/cachedfoldermodel.h>
 #include <libfm-qt6/core/archiver.h>
 #include <libfm-qt6/core/bookmarks.h>
+#include <libfm-qt6/core/cacheregistry.h>
+#include <libfm-qt6/core/deletejob.h>
+#include <libfm-qt6/core/dirsizeindex.h>
 #include <libfm-qt6/core/fileinfo.h>
 #include <libfm-qt6/core/fileinfojob.h>
 #include <libfm-qt6/core/filepath.h>
+#include <libfm-qt6/core/filetransferjob.h>
 #include <libfm-qt6/core/folder.h>
 #include <libfm-qt6/core/folderconfig.h>
 #include <libfm-qt6/core/iconinfo.h>
+#include <libfm-qt6/core/iconpathindex.h>
+#include <libfm-qt6/core/imagescaler.h>
 #include <libfm-qt6/core/mimetype.h>
+#include <libfm-qt6/core/perftrace.h>
+#include <libfm-qt6/core/searchindex.h>
+#include <libfm-qt6/core/sharedlisting.h>
 #include <libfm-qt6/core/job.h>
+#include <libfm-qt6/core/jobscheduler.h>
+#include <libfm-qt6/core/listingsnapshot.h>
+#include <libfm-qt6/core/memorystats.h>
+#include <libfm-qt6/core/metadatastore.h>
+#include <libfm-qt6/core/thumbnailcache.h>
+#include <libfm-qt6/core/thumbnailer.h>
 #include <libfm-qt6/core/thumbnailjob.h>
+#include <libfm-qt6/core/totalsizejob.h>
+#include <libfm-qt6/core/trashjob.h>
+#include <libfm-qt6/core/videoframeextractor.h>
 #include <libfm-qt6/core/terminal.h>
 #include <libfm-qt6/core/gobjectptr.h>
 #include <libfm-qt6/core/legacy/fm-config.h>
@@ -33,6 +51,7 @@
 #include <libfm-qt6/folderview.h>
 #include <libfm-qt6/pathbar.h>
 #include <libfm-qt6/pathedit.h>
+#include <libfm-qt6/placesmodel.h>
 #include <libfm-qt6/proxyfoldermodel.h>
 #include <libfm-qt6/sidepane.h>
 #include <libfm-qt6/utilities.h>
@@ -47,8 +66,15 @@ using FilePathHash = Fm::FilePathHash;
 using FilePath = Fm::FilePath;
 using FileInfo = Fm::FileInfo;
 using FileInfoList = Fm::FileInfoList;
+using FileInfoPair = Fm::FileInfoPair;
 using FilePathList = Fm::FilePathList;
 using FileInfoJob = Fm::FileInfoJob;
+using FileOperationJob = Fm::FileOperationJob;
+using FileTransferJob = Fm::FileTransferJob;
+using DeleteJob = Fm::DeleteJob;
+using DirSizeIndex = Fm::DirSizeIndex;
+using TotalSizeJob = Fm::TotalSizeJob;
+using TrashJob = Fm::TrashJob;
 using FilePropsDialog = Fm::FilePropsDialog;
 using FileSearchDialog = Fm::FileSearchDialog;
 using EditBookmarksDialog = Fm::EditBookmarksDialog;
@@ -61,6 +87,7 @@ using FolderModel = Fm::FolderModel;
 using ProxyFolderModel = Fm::ProxyFolderModel;
 using ProxyFolderModelFilter = Fm::ProxyFolderModelFilter;
 using CachedFolderModel = Fm::CachedFolderModel;
+using CacheRegistry = Fm::CacheRegistry;
 using FolderView = Fm::FolderView;
 using FolderMenu = Fm::FolderMenu;
 using FileMenu = Fm::FileMenu;
@@ -68,14 +95,27 @@ using FileLauncher = Fm::FileLauncher;
 using FileOperation = Fm::FileOperation;
 using FolderConfig = Fm::FolderConfig;
 using IconInfo = Fm::IconInfo;
+using IconPathIndex = Fm::IconPathIndex;
+using ImageScaler = Fm::ImageScaler;
+using ListingSnapshot = Fm::ListingSnapshot;
+using MemoryStats = Fm::MemoryStats;
+using MetadataStore = Fm::MetadataStore;
 using MimeType = Fm::MimeType;
+using PerfTrace = Fm::PerfTrace;
+using SearchIndex = Fm::SearchIndex;
+using SharedListingService = Fm::SharedListingService;
+using ThumbnailCache = Fm::ThumbnailCache;
+using Thumbnailer = Fm::Thumbnailer;
 using ThumbnailJob = Fm::ThumbnailJob;
+using VideoFrameExtractor = Fm::VideoFrameExtractor;
 using Archiver = Fm::Archiver;
 using PathBar = Fm::PathBar;
 using PathEdit = Fm::PathEdit;
+using PlacesModel = Fm::PlacesModel;
 using SidePane = Fm::SidePane;
 using CreateNewMenu = Fm::CreateNewMenu;
 using Job = Fm::Job;
+using JobScheduler = Fm::JobScheduler;
 
 using Fm::allKnownTerminals;
 using Fm::changeFileName;
@@ -14,12 +14,52 @@
 
 namespace PCManFM {
 
+namespace {
+
+ArchiveWriter::Options optionsForPreset(ArchiveJob::Preset preset) {
+    ArchiveWriter::Options opts;
+    switch (preset) {
+        case ArchiveJob::Preset::Fast:
+            opts.compressionLevel = 1;
+            break;
+        case ArchiveJob::Preset::Balanced:
+            opts.compressionLevel = 3;
+            break;
+        case ArchiveJob::Preset::Max:
+            opts.compressionLevel = 19;
+            opts.longWindowLog = 27;
+            opts.frameSize = 64 * 1024 * 1024;  // long matching only reaches within a frame
+            break;
+    }
+    return opts;
+}
+
+ArchiveWriter::ZipOptions zipOptionsForPreset(ArchiveJob::Preset preset) {
+    ArchiveWriter::ZipOptions opts;
+    switch (preset) {
+        case ArchiveJob::Preset::Fast:
+            opts.compressionLevel = 1;
+            break;
+        case ArchiveJob::Preset::Balanced:
+            break;
+        case ArchiveJob::Preset::Max:
+            opts.compressionLevel = 9;
+            break;
+    }
+    return opts;
+}
+
+}  // namespace
+
 ArchiveJob::ArchiveJob(QObject* parent) : QObject(parent), cancelRequested_(false) {}
 
-void ArchiveJob::start(const QStringList& sourcePaths, const QString& destination) {
+void ArchiveJob::start(const QStringList& sourcePaths, const QString& destination, Preset preset, Mode mode) {
     cancelRequested_.store(false, std::memory_order_relaxed);
 
-    auto future = QtConcurrent::run([this, sourcePaths, destination]() -> Result {
+    const ArchiveWriter::Options opts = optionsForPreset(preset);
+    const ArchiveWriter::ZipOptions zipOpts = zipOptionsForPreset(preset);
+    const bool zip = destination.endsWith(QLatin1String(".zip"), Qt::CaseInsensitive);
+    auto future = QtConcurrent::run([this, sourcePaths, destination, opts, zipOpts, zip, mode]() -> Result {
         std::vector<std::string> nativeSources;
         nativeSources.reserve(static_cast<std::size_t>(sourcePaths.size()));
         for (const auto& path : sourcePaths) {
@@ -46,7 +86,14 @@ void ArchiveJob::start(const QStringList& sourcePaths, const QString& destinatio
             return true;
         };
 
-        const bool ok = ArchiveWriter::create_tar_zst(nativeSources, nativeDest, opProgress, cb, err);
+        bool ok = false;
+        if (mode == Mode::Update) {
+            ok = ArchiveWriter::update_tar_zst(nativeSources, nativeDest, opProgress, cb, err, opts);
+        }
+        else {
+            ok = zip ? ArchiveWriter::create_zip(nativeSources, nativeDest, opProgress, cb, err, zipOpts)
+                     : ArchiveWriter::create_tar_zst(nativeSources, nativeDest, opProgress, cb, err, opts);
+        }
         Result result;
         result.success = ok;
         result.error = ok ? QString() : QString::fromLocal8Bit(err.message.c_str());
@@ -17,11 +17,26 @@ namespace PCManFM {
 class ArchiveJob : public QObject {
     Q_OBJECT
    public:
+    // zstd settings: Fast favours throughput, Max favours size (level 19, long matching over
+    // 64 MiB seekable frames). For zip they pick deflate level 1, 6 or 9. All presets compress
+    // on every core.
+    enum class Preset { Fast, Balanced, Max };
+    Q_ENUM(Preset)
+
+    // Update appends what changed since an existing seekable tar.zst was written, see
+    // ArchiveWriter::update_tar_zst.
+    enum class Mode { Create, Update };
+    Q_ENUM(Mode)
+
     explicit ArchiveJob(QObject* parent = nullptr);
 
     // Starts the archive creation asynchronously. Paths are expected to be native, absolute, or
     // otherwise valid for the filesystem; the job converts them with QFile::encodeName.
-    void start(const QStringList& sourcePaths, const QString& destination);
+    // A destination ending in .zip gets a zip archive, anything else a tar.zst.
+    void start(const QStringList& sourcePaths,
+               const QString& destination,
+               Preset preset = Preset::Balanced,
+               Mode mode = Mode::Create);
     void cancel();
 
    Q_SIGNALS:
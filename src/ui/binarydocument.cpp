@@ -11,8 +11,10 @@
 #include <QtEndian>
 
 #include <cstring>
+#include <limits>
+#include <utility>
 
-#include "../core/windowed_file_reader.h"
+#include "../core/mapped_file_registry.h"
 
 namespace PCManFM {
 
@@ -36,12 +38,15 @@ bool BinaryDocument::open(const QString& path, QString& errorOut) {
     baseAddress_ = 0;
     arch_ = CpuArch::X86_64;
     littleEndian_ = true;
+    codeRegions_.clear();
+    functions_.clear();
+    functionStarts_.clear();
     reader_.reset();
 
     const QByteArray encoded = QFile::encodeName(path);
     std::string err;
-    auto reader = std::make_unique<WindowedFileReader>(encoded.constData(), 0, &err);
-    if (!reader->valid()) {
+    auto reader = MappedFileRegistry::instance().open(encoded.toStdString(), err);
+    if (!reader) {
         errorOut = QString::fromStdString(err);
         return false;
     }
@@ -54,6 +59,7 @@ bool BinaryDocument::open(const QString& path, QString& errorOut) {
     if (readSpan(0, kProbeSize, header, readErr)) {
         detectElf(header);
     }
+    loadCodeLayout(header);
     return true;
 }
 
@@ -85,6 +91,53 @@ bool BinaryDocument::readSpan(quint64 offset, quint64 length, QByteArray& out, Q
     return true;
 }
 
+bool BinaryDocument::borrowSpan(quint64 offset,
+                                quint64 length,
+                                WindowedFileReader::Lease& lease,
+                                QString& errorOut) const {
+    errorOut.clear();
+    lease.reset();
+    if (!reader_) {
+        errorOut = QObject::tr("Document not open.");
+        return false;
+    }
+    std::string err;
+    const auto capped = static_cast<std::size_t>(std::min<quint64>(length, std::numeric_limits<std::size_t>::max()));
+    if (!reader_->borrow(offset, capped, lease, err)) {
+        errorOut = QString::fromStdString(err);
+        return false;
+    }
+    return true;
+}
+
+void BinaryDocument::loadCodeLayout(const QByteArray& header) {
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(header.constData());
+    if (is_elf_header(bytes, static_cast<std::size_t>(header.size()))) {
+        const ImageReader read = [this](std::uint64_t offset, std::size_t length, std::uint8_t* dest,
+                                        std::string& errorOut) {
+            std::size_t bytesRead = 0;
+            if (!reader_->read(offset, length, dest, bytesRead, errorOut)) {
+                return false;
+            }
+            if (bytesRead < length) {
+                errorOut = "Unexpected end of file";
+                return false;
+            }
+            return true;
+        };
+        ElfImage image;
+        std::string err;
+        if (parse_elf_image(fileSize_, read, image, err)) {
+            codeRegions_ = elf_code_regions(image);
+            functions_ = std::move(image.functions);
+            functionStarts_ = std::move(image.functionStarts);
+        }
+    }
+    if (codeRegions_.empty() && fileSize_ > 0) {
+        codeRegions_.push_back({0, fileSize_, baseAddress_});
+    }
+}
+
 void BinaryDocument::detectElf(const QByteArray& header) {
     if (header.size() < 20) {
         return;
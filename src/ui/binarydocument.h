@@ -13,8 +13,10 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "disasm_engine.h"
+#include "../core/binary_image.h"
 #include "../core/windowed_file_reader.h"
 
 namespace PCManFM {
@@ -35,19 +37,34 @@ class BinaryDocument {
     CpuArch arch() const { return arch_; }
     bool littleEndian() const { return littleEndian_; }
     quint64 baseAddress() const { return baseAddress_; }
+    // The executable sections of an ELF file, or its executable segments when it has no
+    // section table. Anything else, including ELF files too damaged to parse, is one region
+    // covering the whole file at baseAddress().
+    const std::vector<CodeRegion>& codeRegions() const { return codeRegions_; }
+    // The functions in the symbol tables, sorted by address, and their addresses; empty when
+    // stripped.
+    const std::vector<ImageSymbol>& functions() const { return functions_; }
+    const std::vector<std::uint64_t>& functionStarts() const { return functionStarts_; }
 
     // Reads up to length bytes from offset into out. Returns false on error.
     bool readSpan(quint64 offset, quint64 length, QByteArray& out, QString& errorOut) const;
+    // Borrows the bytes at offset straight from the file mapping. The lease stops at a reader
+    // window boundary, so it can be shorter than length; readSpan() always copies it all.
+    bool borrowSpan(quint64 offset, quint64 length, WindowedFileReader::Lease& lease, QString& errorOut) const;
 
    private:
     void detectElf(const QByteArray& header);
+    void loadCodeLayout(const QByteArray& header);
 
     QString path_;
-    std::unique_ptr<WindowedFileReader> reader_;
+    std::shared_ptr<const WindowedFileReader> reader_;  // from MappedFileRegistry
     std::size_t fileSize_ = 0;
     CpuArch arch_ = CpuArch::X86_64;
     bool littleEndian_ = true;
     quint64 baseAddress_ = 0;
+    std::vector<CodeRegion> codeRegions_;
+    std::vector<ImageSymbol> functions_;
+    std::vector<std::uint64_t> functionStarts_;
 };
 
 }  // namespace PCManFM
@@ -0,0 +1,92 @@
+/*
+ * Qt wrapper around the multi-algorithm file checksums
+ * src/ui/checksumjob.cpp
+ */
+
+#include "checksumjob.h"
+
+#include <QFile>
+#include <QtConcurrent>
+#include <string>
+
+namespace PCManFM {
+
+ChecksumJob::ChecksumJob(QObject* parent) : QObject(parent), cancelRequested_(false) {
+    connect(&watcher_, &QFutureWatcher<Result>::finished, this, &ChecksumJob::onFinished);
+}
+
+FsOps::ProgressCallback ChecksumJob::progressCallback() {
+    return [this](const FsOps::ProgressInfo& info) {
+        if (cancelRequested_.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, info]() {
+                Q_EMIT progress(info.bytesDone, info.bytesTotal, QString::fromLocal8Bit(info.currentPath.c_str()));
+            },
+            Qt::QueuedConnection);
+        return true;
+    };
+}
+
+void ChecksumJob::startHash(const QStringList& paths) {
+    cancelRequested_.store(false, std::memory_order_relaxed);
+    std::vector<std::string> nativePaths;
+    nativePaths.reserve(static_cast<std::size_t>(paths.size()));
+    for (const auto& path : paths) {
+        const QByteArray bytes = QFile::encodeName(path);
+        nativePaths.emplace_back(bytes.constData(), static_cast<std::size_t>(bytes.size()));
+    }
+
+    watch(QtConcurrent::run([nativePaths, cb = progressCallback()]() -> Result {
+        FsOps::ProgressInfo opProgress;
+        FsOps::Error err;
+        Result result;
+        result.success = FileChecksums::hash_files(nativePaths, result.hashed, opProgress, cb, err);
+        result.error = result.success ? QString() : QString::fromLocal8Bit(err.message.c_str());
+        return result;
+    }));
+}
+
+void ChecksumJob::startVerify(const QString& manifestPath, FileChecksums::Algorithm algorithm) {
+    cancelRequested_.store(false, std::memory_order_relaxed);
+    const QByteArray bytes = QFile::encodeName(manifestPath);
+    const std::string nativeManifest(bytes.constData(), static_cast<std::size_t>(bytes.size()));
+
+    watch(QtConcurrent::run([nativeManifest, algorithm, cb = progressCallback()]() -> Result {
+        FsOps::ProgressInfo opProgress;
+        FsOps::Error err;
+        Result result;
+        result.success =
+            FileChecksums::verify_manifest(nativeManifest, algorithm, result.verified, opProgress, cb, err);
+        result.error = result.success ? QString() : QString::fromLocal8Bit(err.message.c_str());
+        return result;
+    }));
+}
+
+void ChecksumJob::cancel() {
+    cancelRequested_.store(true, std::memory_order_relaxed);
+}
+
+QByteArray ChecksumJob::manifest(FileChecksums::Algorithm algorithm, const QString& baseDir) const {
+    const QByteArray dir = QFile::encodeName(baseDir);
+    const std::string text = FileChecksums::format_manifest(
+        hashResults_, algorithm, std::string(dir.constData(), static_cast<std::size_t>(dir.size())));
+    return QByteArray(text.data(), static_cast<qsizetype>(text.size()));
+}
+
+void ChecksumJob::watch(const QFuture<Result>& future) {
+    hashResults_.clear();
+    verifyResults_.clear();
+    watcher_.setFuture(future);
+}
+
+void ChecksumJob::onFinished() {
+    Result result = watcher_.result();
+    hashResults_ = std::move(result.hashed);
+    verifyResults_ = std::move(result.verified);
+    Q_EMIT finished(result.success, result.error);
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,61 @@
+/*
+ * Qt wrapper around the multi-algorithm file checksums
+ * src/ui/checksumjob.h
+ */
+
+#ifndef PCMANFM_CHECKSUMJOB_H
+#define PCMANFM_CHECKSUMJOB_H
+
+#include "../core/file_checksums.h"
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QStringList>
+
+#include <atomic>
+#include <vector>
+
+namespace PCManFM {
+
+class ChecksumJob : public QObject {
+    Q_OBJECT
+   public:
+    explicit ChecksumJob(QObject* parent = nullptr);
+
+    // Hashes |paths| with SHA-256 and BLAKE3 asynchronously, reading each file once.
+    void startHash(const QStringList& paths);
+    // Checks the files listed in the sha256sum/b3sum manifest |manifestPath|.
+    void startVerify(const QString& manifestPath, FileChecksums::Algorithm algorithm);
+    void cancel();
+
+    // Valid once finished() was emitted.
+    const std::vector<FileChecksums::FileResult>& hashResults() const { return hashResults_; }
+    const std::vector<FileChecksums::VerifyResult>& verifyResults() const { return verifyResults_; }
+    // The manifest for the hashed files, paths below |baseDir| written relative to it.
+    QByteArray manifest(FileChecksums::Algorithm algorithm, const QString& baseDir) const;
+
+   Q_SIGNALS:
+    void progress(quint64 bytesDone, quint64 bytesTotal, const QString& currentPath);
+    void finished(bool success, const QString& errorMessage);
+
+   private:
+    struct Result {
+        bool success = false;
+        QString error;
+        std::vector<FileChecksums::FileResult> hashed;
+        std::vector<FileChecksums::VerifyResult> verified;
+    };
+
+    FsOps::ProgressCallback progressCallback();
+    void watch(const QFuture<Result>& future);
+    void onFinished();
+
+    QFutureWatcher<Result> watcher_;
+    std::atomic<bool> cancelRequested_;
+    std::vector<FileChecksums::FileResult> hashResults_;
+    std::vector<FileChecksums::VerifyResult> verifyResults_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_CHECKSUMJOB_H
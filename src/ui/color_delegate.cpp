@@ -5,7 +5,9 @@
 
 #include "color_delegate.h"
 
+#include <QApplication>
 #include <QPainter>
+#include <QStyle>
 #include <QStyleOptionViewItem>
 
 #include "color_roles.h"
@@ -27,11 +29,23 @@ void ColorDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
     QColor fg = opt.palette.color(QPalette::Text);
     QColor bg = opt.palette.color(QPalette::Base);
 
-    const CellCategory cat = static_cast<CellCategory>(index.data(RoleCategory).toInt());
+    // Models that pack their attributes answer in one lookup; others role by role.
+    int attributes = 0;
+    const QVariant packed = index.data(RoleAttributes);
+    if (packed.isValid()) {
+        attributes = packed.toInt();
+    }
+    else {
+        attributes = index.data(RoleCategory).toInt() & kCellCategoryMask;
+        attributes |= index.data(RolePatched).toBool() ? CellPatched : 0;
+        attributes |= index.data(RoleBookmark).toBool() ? CellBookmark : 0;
+        attributes |= index.data(RoleSearchHit).toBool() ? CellSearchHit : 0;
+    }
+    const CellCategory cat = static_cast<CellCategory>(attributes & kCellCategoryMask);
     const bool selected = opt.state.testFlag(QStyle::State_Selected);
-    const bool patched = index.data(RolePatched).toBool();
-    const bool bookmark = index.data(RoleBookmark).toBool();
-    const bool searchHit = index.data(RoleSearchHit).toBool();
+    const bool patched = attributes & CellPatched;
+    const bool bookmark = attributes & CellBookmark;
+    const bool searchHit = attributes & CellSearchHit;
 
     switch (cat) {
         case CellCategory::InstructionAddress:
@@ -77,7 +91,10 @@ void ColorDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
         opt.palette.setColor(QPalette::Base, bg);
     }
 
-    QStyledItemDelegate::paint(painter, opt, index);
+    // What QStyledItemDelegate::paint() does after initStyleOption(), which already ran above.
+    const QWidget* widget = opt.widget;
+    QStyle* style = widget ? widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
 }
 
 }  // namespace PCManFM
@@ -16,9 +16,15 @@ enum CustomRoles {
     RoleOffset = Qt::UserRole + 3,
     RolePatched = Qt::UserRole + 4,
     RoleBookmark = Qt::UserRole + 5,
-    RoleSearchHit = Qt::UserRole + 6
+    RoleSearchHit = Qt::UserRole + 6,
+    // The cell's CellCategory in the low byte with its CellFlag bits above, so a delegate
+    // styles the cell with one lookup instead of one per role.
+    RoleAttributes = Qt::UserRole + 7
 };
 
+enum CellFlag { CellPatched = 1 << 8, CellBookmark = 1 << 9, CellSearchHit = 1 << 10 };
+constexpr int kCellCategoryMask = 0xff;
+
 enum class CellCategory {
     Normal,
     HexByte,
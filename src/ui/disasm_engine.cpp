@@ -7,7 +7,9 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <utility>
 
 namespace PCManFM {
 
@@ -39,7 +41,44 @@ DisasmInstr::Kind classifyMnemonic(const cs_insn& insn) {
 }
 }  // namespace
 
+void DisasmBlock::clear(std::uint64_t baseAddress) {
+    baseAddress_ = baseAddress;
+    insns_.clear();
+    bytes_.clear();
+    operands_.clear();
+    mnemonics_.clear();
+    mnemonicIds_.clear();
+}
+
+void DisasmBlock::append(const DisasmInsnView& insn) {
+    Insn record;
+    record.byteOffset = static_cast<std::uint32_t>(bytes_.size());
+    record.operandOffset = static_cast<std::uint32_t>(operands_.size());
+    record.size = static_cast<std::uint8_t>(insn.size);
+    record.kind = static_cast<std::uint8_t>(insn.kind);
+
+    const auto [it, inserted] =
+        mnemonicIds_.try_emplace(insn.mnemonic, static_cast<std::uint16_t>(mnemonics_.size()));
+    if (inserted) {
+        mnemonics_.emplace_back(insn.mnemonic);
+    }
+    record.mnemonic = it->second;
+
+    bytes_.insert(bytes_.end(), insn.bytes, insn.bytes + insn.size);
+    operands_.append(insn.opStr);
+    operands_.push_back('\0');
+    insns_.push_back(record);
+}
+
 DisasmEngine::~DisasmEngine() {
+    release();
+}
+
+void DisasmEngine::release() {
+    if (insn_) {
+        cs_free(insn_, 1);
+        insn_ = nullptr;
+    }
     if (handle_) {
         cs_close(&handle_);
         handle_ = 0;
@@ -47,10 +86,7 @@ DisasmEngine::~DisasmEngine() {
 }
 
 bool DisasmEngine::configure(CpuArch arch, bool littleEndian) {
-    if (handle_) {
-        cs_close(&handle_);
-        handle_ = 0;
-    }
+    release();
 
     cs_arch csArch = CS_ARCH_X86;
     cs_mode csMode = CS_MODE_LITTLE_ENDIAN;
@@ -113,6 +149,11 @@ bool DisasmEngine::configure(CpuArch arch, bool littleEndian) {
     }
 
     cs_option(handle_, CS_OPT_DETAIL, CS_OPT_OFF);
+    insn_ = cs_malloc(handle_);
+    if (!insn_) {
+        release();
+        return false;
+    }
     return true;
 }
 
@@ -126,28 +167,124 @@ bool DisasmEngine::disassemble(const std::uint8_t* code,
         return false;
     }
 
-    cs_insn* insn = nullptr;
-    const size_t count = cs_disasm(handle_, code, codeSize, baseAddress, 0, &insn);
-    if (count == 0) {
+    out.clear();
+    const std::uint8_t* cursor = code;
+    std::size_t remaining = codeSize;
+    std::uint64_t address = baseAddress;
+    while (cs_disasm_iter(handle_, &cursor, &remaining, &address, insn_)) {
+        DisasmInstr di;
+        di.address = insn_->address;
+        di.mnemonic = insn_->mnemonic;
+        di.opStr = insn_->op_str;
+        di.bytes.assign(insn_->bytes, insn_->bytes + insn_->size);
+        di.kind = classifyMnemonic(*insn_);
+        out.push_back(std::move(di));
+    }
+    if (out.empty()) {
         errorOut = cs_strerror(cs_errno(handle_));
         return false;
     }
+    return true;
+}
 
-    out.clear();
-    out.reserve(count);
+bool DisasmEngine::disassemble(const std::uint8_t* code,
+                               std::size_t codeSize,
+                               std::uint64_t baseAddress,
+                               DisasmBlock& out,
+                               std::string& errorOut) const {
+    out.clear(baseAddress);
+    if (!handle_ || !code || codeSize == 0) {
+        errorOut = "Invalid input to disassemble";
+        return false;
+    }
+    sweep(code, codeSize, codeSize, baseAddress, [&out](const DisasmInsnView& insn) { out.append(insn); });
+    return true;
+}
 
-    for (size_t i = 0; i < count; ++i) {
-        DisasmInstr di;
-        di.address = insn[i].address;
-        di.mnemonic = insn[i].mnemonic;
-        di.opStr = insn[i].op_str;
-        di.bytes.assign(insn[i].bytes, insn[i].bytes + insn[i].size);
-        di.kind = classifyMnemonic(insn[i]);
-        out.push_back(std::move(di));
+std::size_t DisasmEngine::sweep(const std::uint8_t* code,
+                                std::size_t codeSize,
+                                std::size_t limit,
+                                std::uint64_t baseAddress,
+                                const std::function<void(const DisasmInsnView&)>& visit) const {
+    limit = std::min(limit, codeSize);
+    if (!handle_ || !insn_ || !code) {
+        return 0;
+    }
+
+    std::size_t pos = 0;
+    char dataOperand[8];
+    while (pos < limit) {
+        const std::uint8_t* cursor = code + pos;
+        std::size_t remaining = codeSize - pos;
+        std::uint64_t address = baseAddress + pos;
+        DisasmInsnView view;
+        if (cs_disasm_iter(handle_, &cursor, &remaining, &address, insn_)) {
+            view.address = insn_->address;
+            view.bytes = insn_->bytes;
+            view.size = insn_->size;
+            view.mnemonic = insn_->mnemonic;
+            view.opStr = insn_->op_str;
+            view.kind = classifyMnemonic(*insn_);
+        }
+        else {
+            std::snprintf(dataOperand, sizeof(dataOperand), "0x%02x", code[pos]);
+            view.address = baseAddress + pos;
+            view.bytes = code + pos;
+            view.size = 1;
+            view.mnemonic = ".byte";
+            view.opStr = dataOperand;
+        }
+        visit(view);
+        pos += view.size;
     }
+    return pos;
+}
 
-    cs_free(insn, count);
+std::size_t DisasmEngine::instructionAlignment(CpuArch arch) {
+    switch (arch) {
+        case CpuArch::X86_64:
+        case CpuArch::X86_32:
+        case CpuArch::Unknown:
+            return 16;  // function alignment; x86 instructions themselves have none
+        case CpuArch::RISCV64:
+        case CpuArch::RISCV32:
+            return 2;  // compressed instructions
+        case CpuArch::ARM64:
+        case CpuArch::ARM:
+        case CpuArch::MIPS64:
+        case CpuArch::MIPS32:
+        case CpuArch::PPC64:
+        case CpuArch::PPC32:
+            return 4;
+    }
+    return 1;
+}
+
+bool DisasmEngine::directTarget(DisasmInstr::Kind kind, const char* opStr, std::uint64_t& targetOut) {
+    if (kind != DisasmInstr::Kind::Branch && kind != DisasmInstr::Kind::Call) {
+        return false;
+    }
+    const char* text = opStr;
+    if (*text == '#') {
+        ++text;
+    }
+    if (text[0] != '0' || (text[1] != 'x' && text[1] != 'X') || !std::isxdigit(static_cast<unsigned char>(text[2]))) {
+        return false;
+    }
+    std::uint64_t value = 0;
+    for (text += 2; std::isxdigit(static_cast<unsigned char>(*text)); ++text) {
+        const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(*text)));
+        value = (value << 4) | static_cast<std::uint64_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+    if (*text != '\0') {
+        return false;
+    }
+    targetOut = value;
     return true;
 }
 
+unsigned DisasmEngine::version() {
+    return cs_version(nullptr, nullptr);
+}
+
 }  // namespace PCManFM
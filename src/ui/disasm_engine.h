@@ -8,8 +8,11 @@
 
 #include <capstone/capstone.h>
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace PCManFM {
@@ -25,6 +28,55 @@ struct DisasmInstr {
     enum class Kind { Normal, Branch, Call, ReturnIns, Nop } kind = Kind::Normal;
 };
 
+// One decoded instruction, pointing into the engine's scratch space: only valid while the
+// sweep callback runs. Bytes that do not decode come through as a one-byte ".byte".
+struct DisasmInsnView {
+    std::uint64_t address = 0;
+    const std::uint8_t* bytes = nullptr;
+    std::size_t size = 0;
+    const char* mnemonic = "";
+    const char* opStr = "";
+    DisasmInstr::Kind kind = DisasmInstr::Kind::Normal;
+};
+
+// DisasmBlock holds the instructions of one contiguous run of code in columns: a 12-byte
+// record per instruction, the instruction bytes in one arena, operand text in one string pool
+// and mnemonics interned per block, so a block costs a handful of allocations however many
+// instructions it holds.
+class DisasmBlock {
+   public:
+    std::size_t size() const { return insns_.size(); }
+    bool empty() const { return insns_.empty(); }
+    std::uint64_t baseAddress() const { return baseAddress_; }
+
+    std::uint64_t address(std::size_t i) const { return baseAddress_ + insns_[i].byteOffset; }
+    const std::uint8_t* bytes(std::size_t i) const { return bytes_.data() + insns_[i].byteOffset; }
+    std::size_t byteCount(std::size_t i) const { return insns_[i].size; }
+    const std::string& mnemonic(std::size_t i) const { return mnemonics_[insns_[i].mnemonic]; }
+    const char* operands(std::size_t i) const { return operands_.c_str() + insns_[i].operandOffset; }
+    DisasmInstr::Kind kind(std::size_t i) const { return static_cast<DisasmInstr::Kind>(insns_[i].kind); }
+
+    void clear(std::uint64_t baseAddress = 0);
+    // Adds the instruction following the previous one.
+    void append(const DisasmInsnView& insn);
+
+   private:
+    struct Insn {
+        std::uint32_t byteOffset = 0;     // into bytes_, and from baseAddress_
+        std::uint32_t operandOffset = 0;  // NUL-terminated, into operands_
+        std::uint16_t mnemonic = 0;       // into mnemonics_
+        std::uint8_t size = 0;
+        std::uint8_t kind = 0;
+    };
+
+    std::uint64_t baseAddress_ = 0;
+    std::vector<Insn> insns_;
+    std::vector<std::uint8_t> bytes_;
+    std::string operands_;
+    std::vector<std::string> mnemonics_;
+    std::unordered_map<std::string, std::uint16_t> mnemonicIds_;
+};
+
 class DisasmEngine {
    public:
     DisasmEngine() = default;
@@ -41,9 +93,39 @@ class DisasmEngine {
                      std::uint64_t baseAddress,
                      std::vector<DisasmInstr>& out,
                      std::string& errorOut) const;
+    // Like sweep() over all of code, collecting the instructions into |out|.
+    bool disassemble(const std::uint8_t* code,
+                     std::size_t codeSize,
+                     std::uint64_t baseAddress,
+                     DisasmBlock& out,
+                     std::string& errorOut) const;
+
+    // Linear sweep that decodes every instruction starting before code + limit; bytes up to
+    // codeSize only complete the last one. Undecodable bytes are skipped one at a time as
+    // ".byte" entries, so every byte belongs to exactly one entry and sweeping again from the
+    // same offset finds the same boundaries. Returns the offset from code just past the last
+    // entry. Decoding reuses the engine's one cs_insn, so nothing is allocated per instruction,
+    // and an engine must not be shared between threads.
+    std::size_t sweep(const std::uint8_t* code,
+                      std::size_t codeSize,
+                      std::size_t limit,
+                      std::uint64_t baseAddress,
+                      const std::function<void(const DisasmInsnView&)>& visit) const;
+
+    // Alignment instructions keep on |arch|, so a guessed start on such a boundary has a
+    // chance of being a real one.
+    static std::size_t instructionAlignment(CpuArch arch);
+    // The destination of a direct branch or call whose operand is a plain address, as in
+    // "0x401000" or "#0x401000"; false for register and memory operands.
+    static bool directTarget(DisasmInstr::Kind kind, const char* opStr, std::uint64_t& targetOut);
+    // Capstone's version, major << 8 | minor; decoding may differ between versions.
+    static unsigned version();
 
    private:
+    void release();
+
     csh handle_ = 0;
+    cs_insn* insn_ = nullptr;  // scratch for cs_disasm_iter(), allocated by configure()
 };
 
 }  // namespace PCManFM
@@ -6,18 +6,38 @@
 #include "disasmmodel.h"
 
 #include <QColor>
+#include <QFile>
+#include <QFutureWatcher>
 #include <QString>
+#include <QStringList>
+#include <QThread>
 #include <QVariant>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <limits>
 
 #include "color_roles.h"
+#include "../core/fs_ops.h"
+#include "../core/hash_cache.h"
 
 namespace PCManFM {
 
 namespace {
-QString formatBytes(const std::vector<std::uint8_t>& bytes) {
+
+// Records |insn| when it calls or branches to a fixed address.
+void addReference(const DisasmInsnView& insn, std::vector<CodeReference>& out) {
+    std::uint64_t target = 0;
+    if (DisasmEngine::directTarget(insn.kind, insn.opStr, target)) {
+        out.push_back({insn.address, target,
+                       insn.kind == DisasmInstr::Kind::Call ? CodeReference::Kind::Call : CodeReference::Kind::Branch});
+    }
+}
+
+QString formatBytes(const std::uint8_t* bytes, std::size_t size) {
     QString out;
-    out.reserve(static_cast<int>(bytes.size()) * 3);
-    for (std::size_t i = 0; i < bytes.size(); ++i) {
+    out.reserve(static_cast<int>(size) * 3);
+    for (std::size_t i = 0; i < size; ++i) {
         out += QStringLiteral("%1 ").arg(bytes[i], 2, 16, QLatin1Char('0'));
     }
     if (!out.isEmpty()) {
@@ -25,15 +45,41 @@ QString formatBytes(const std::vector<std::uint8_t>& bytes) {
     }
     return out;
 }
+
+// FormattedRow::attributes: four bits of CellCategory per column, the CellFlag bits from 16.
+constexpr quint32 kRowFormatted = 1u << 31;
+constexpr int kCategoryBits = 4;
+constexpr int kRowFlagsShift = 16;
+static_assert(static_cast<int>(CellCategory::CurrentPc) < (1 << kCategoryBits), "categories must fit four bits");
+
+quint32 packCategory(int column, CellCategory category) {
+    return static_cast<quint32>(category) << (column * kCategoryBits);
+}
+
+CellCategory unpackCategory(quint32 attributes, int column) {
+    return static_cast<CellCategory>((attributes >> (column * kCategoryBits)) & ((1u << kCategoryBits) - 1));
+}
+
+// The row's CellFlag bits, in place for RoleAttributes.
+int unpackFlags(quint32 attributes) {
+    return static_cast<int>((attributes >> kRowFlagsShift) & 0xffu) << 8;
+}
+
 }  // namespace
 
-DisasmModel::DisasmModel(QObject* parent) : QAbstractTableModel(parent) {}
+DisasmModel::DisasmModel(QObject* parent) : QAbstractTableModel(parent) {
+    cache_.reserve(kCachedBlocks);  // entries are handed out by pointer
+}
+
+DisasmModel::~DisasmModel() {
+    stopIndexing();
+}
 
 int DisasmModel::rowCount(const QModelIndex& parent) const {
     if (parent.isValid()) {
         return 0;
     }
-    return static_cast<int>(instructions_.size());
+    return rowCount_;
 }
 
 int DisasmModel::columnCount(const QModelIndex& parent) const {
@@ -44,59 +90,152 @@ int DisasmModel::columnCount(const QModelIndex& parent) const {
 }
 
 QVariant DisasmModel::data(const QModelIndex& index, int role) const {
-    if (!index.isValid() || index.row() < 0 || index.row() >= rowCount()) {
-        return {};
+    switch (role) {
+        case Qt::DisplayRole:
+        case Qt::ToolTipRole:
+        case RoleCategory:
+        case RoleAddress:
+        case RolePatched:
+        case RoleBookmark:
+        case RoleSearchHit:
+        case RoleAttributes:
+            break;
+        default:
+            return {};  // before the row lookup: views ask for fonts, icons and the like per cell
     }
-    const DisasmInstr& ins = instructions_[static_cast<std::size_t>(index.row())];
-    if (role == Qt::DisplayRole) {
-        switch (index.column()) {
-            case Address:
-                return QStringLiteral("0x%1").arg(ins.address, 0, 16);
-            case Bytes:
-                return formatBytes(ins.bytes);
-            case Mnemonic:
-                return QString::fromLatin1(ins.mnemonic.c_str());
-            case Operands:
-                return QString::fromLatin1(ins.opStr.c_str());
-            default:
-                break;
+    std::size_t ins = 0;
+    CacheEntry* entry = entryForIndex(index, ins);
+    return entry ? cellData(*entry, ins, index.column(), role) : QVariant();
+}
+
+void DisasmModel::multiData(const QModelIndex& index, QModelRoleDataSpan roleDataSpan) const {
+    std::size_t ins = 0;
+    CacheEntry* entry = entryForIndex(index, ins);
+    for (QModelRoleData& roleData : roleDataSpan) {
+        roleData.setData(entry ? cellData(*entry, ins, index.column(), roleData.role()) : QVariant());
+    }
+}
+
+DisasmModel::CacheEntry* DisasmModel::entryForIndex(const QModelIndex& index, std::size_t& insOut) const {
+    if (!index.isValid() || index.row() < 0 || index.row() >= rowCount_ || !doc_) {
+        return nullptr;
+    }
+    const quint64 row = static_cast<quint64>(index.row());
+
+    // Painting walks the rows of one block in turn, so try the block of the last lookup first.
+    if (lastEntry_ < cache_.size()) {
+        CacheEntry& last = cache_[lastEntry_];
+        const quint64 firstRow = blocks_[last.block].firstRow;
+        const quint64 endRow = last.block + 1 < blocks_.size() ? blocks_[last.block + 1].firstRow
+                                                               : static_cast<quint64>(rowCount_);
+        if (row >= firstRow && row < endRow && row - firstRow < last.rows.size()) {
+            last.lastUse = ++cacheClock_;
+            insOut = static_cast<std::size_t>(row - firstRow);
+            return &last;
         }
     }
-    else if (role == RoleCategory) {
-        switch (index.column()) {
-            case Address:
-                return static_cast<int>(CellCategory::InstructionAddress);
-            case Bytes:
-                return static_cast<int>(CellCategory::InstructionBytes);
-            case Mnemonic: {
-                switch (ins.kind) {
-                    case DisasmInstr::Kind::Branch:
-                        return static_cast<int>(CellCategory::Branch);
-                    case DisasmInstr::Kind::Call:
-                        return static_cast<int>(CellCategory::Call);
-                    case DisasmInstr::Kind::ReturnIns:
-                        return static_cast<int>(CellCategory::ReturnIns);
-                    case DisasmInstr::Kind::Nop:
-                        return static_cast<int>(CellCategory::Nop);
-                    case DisasmInstr::Kind::Normal:
-                        return static_cast<int>(CellCategory::InstructionMnemonic);
-                }
-                break;
-            }
-            case Operands:
-                return static_cast<int>(CellCategory::InstructionOperands);
-            default:
-                break;
+
+    const auto next = std::upper_bound(blocks_.begin(), blocks_.end(), row,
+                                       [](quint64 value, const Block& block) { return value < block.firstRow; });
+    if (next == blocks_.begin()) {
+        return nullptr;
+    }
+    const std::size_t block = static_cast<std::size_t>(next - blocks_.begin() - 1);
+    CacheEntry* entry = cachedBlock(block);
+    const quint64 local = row - blocks_[block].firstRow;
+    if (!entry || local >= entry->rows.size()) {
+        return nullptr;
+    }
+    lastEntry_ = static_cast<std::size_t>(entry - cache_.data());
+    insOut = static_cast<std::size_t>(local);
+    return entry;
+}
+
+const DisasmModel::FormattedRow& DisasmModel::formattedRow(CacheEntry& entry, std::size_t ins) const {
+    FormattedRow& row = entry.rows[ins];
+    if (row.attributes & kRowFormatted) {
+        return row;
+    }
+    const DisasmBlock& decoded = *entry.decoded;
+    const quint64 address = decoded.address(ins);
+
+    row.text[Address] = QStringLiteral("0x%1").arg(address, 0, 16);
+    row.text[Bytes] = formatBytes(decoded.bytes(ins), decoded.byteCount(ins));
+    row.text[Mnemonic] = QString::fromLatin1(decoded.mnemonic(ins).c_str());
+    row.text[Operands] = QString::fromLatin1(decoded.operands(ins));
+    std::uint64_t target = 0;
+    if (DisasmEngine::directTarget(decoded.kind(ins), decoded.operands(ins), target)) {
+        const QString name = symbolName(target);
+        if (!name.isEmpty()) {
+            row.text[Operands] += QStringLiteral(" <%1>").arg(name);
         }
-        return static_cast<int>(CellCategory::Normal);
     }
-    else if (role == RoleAddress) {
-        return static_cast<qulonglong>(ins.address);
+
+    // Called addresses start functions, stripped binaries included.
+    const CellCategory addressCategory =
+        xrefs_ && xrefs_->isCallTarget(address) ? CellCategory::Label : CellCategory::InstructionAddress;
+    CellCategory mnemonicCategory = CellCategory::InstructionMnemonic;
+    switch (decoded.kind(ins)) {
+        case DisasmInstr::Kind::Branch:
+            mnemonicCategory = CellCategory::Branch;
+            break;
+        case DisasmInstr::Kind::Call:
+            mnemonicCategory = CellCategory::Call;
+            break;
+        case DisasmInstr::Kind::ReturnIns:
+            mnemonicCategory = CellCategory::ReturnIns;
+            break;
+        case DisasmInstr::Kind::Nop:
+            mnemonicCategory = CellCategory::Nop;
+            break;
+        case DisasmInstr::Kind::Normal:
+            break;
     }
-    else if (role == RolePatched || role == RoleBookmark || role == RoleSearchHit) {
-        return false;
+    row.attributes = kRowFormatted | packCategory(Address, addressCategory) |
+                     packCategory(Bytes, CellCategory::InstructionBytes) | packCategory(Mnemonic, mnemonicCategory) |
+                     packCategory(Operands, CellCategory::InstructionOperands);
+    return row;
+}
+
+QVariant DisasmModel::cellData(CacheEntry& entry, std::size_t ins, int column, int role) const {
+    if (column < 0 || column >= ColumnCount) {
+        return {};
+    }
+    switch (role) {
+        case Qt::DisplayRole:
+            return formattedRow(entry, ins).text[column];
+        case Qt::ToolTipRole: {
+            if (column != Address || !xrefs_) {
+                return {};
+            }
+            const quint64 address = entry.decoded->address(ins);
+            QStringList lines;
+            if (const ImageSymbol* symbol = xrefs_->symbolAt(address)) {
+                lines << QString::fromStdString(symbol->name);
+            }
+            const auto refs = xrefs_->referencesTo(address);
+            if (refs.second > refs.first) {
+                lines << tr("Referenced from %n place(s)", nullptr, static_cast<int>(refs.second - refs.first));
+            }
+            return lines.isEmpty() ? QVariant() : QVariant(lines.join(QLatin1Char('\n')));
+        }
+        case RoleCategory:
+            return static_cast<int>(unpackCategory(formattedRow(entry, ins).attributes, column));
+        case RoleAttributes: {
+            const quint32 attributes = formattedRow(entry, ins).attributes;
+            return static_cast<int>(unpackCategory(attributes, column)) | unpackFlags(attributes);
+        }
+        case RoleAddress:
+            return static_cast<qulonglong>(entry.decoded->address(ins));
+        case RolePatched:
+            return (unpackFlags(formattedRow(entry, ins).attributes) & CellPatched) != 0;
+        case RoleBookmark:
+            return (unpackFlags(formattedRow(entry, ins).attributes) & CellBookmark) != 0;
+        case RoleSearchHit:
+            return (unpackFlags(formattedRow(entry, ins).attributes) & CellSearchHit) != 0;
+        default:
+            return {};
     }
-    return {};
 }
 
 QVariant DisasmModel::headerData(int section, Qt::Orientation orientation, int role) const {
@@ -117,37 +256,435 @@ QVariant DisasmModel::headerData(int section, Qt::Orientation orientation, int r
     return QAbstractTableModel::headerData(section, orientation, role);
 }
 
-bool DisasmModel::disassemble(const BinaryDocument& doc, quint64 offset, quint64 length, QString& errorOut) {
+bool DisasmModel::setDocument(const BinaryDocument* doc, QString& errorOut) {
     errorOut.clear();
-    QByteArray buffer;
-    if (!doc.readSpan(offset, length, buffer, errorOut)) {
-        return false;
+    clear();
+    if (!doc) {
+        return true;
     }
-
-    if (!engine_.configure(doc.arch(), doc.littleEndian())) {
+    if (!engine_.configure(doc->arch(), doc->littleEndian())) {
         errorOut = tr("Failed to configure Capstone engine.");
         return false;
     }
+    doc_ = doc;
 
-    std::vector<DisasmInstr> out;
-    std::string err;
-    if (!engine_.disassemble(reinterpret_cast<const std::uint8_t*>(buffer.constData()),
-                             static_cast<std::size_t>(buffer.size()), doc.baseAddress() + offset, out, err)) {
-        errorOut = QString::fromStdString(err.empty() ? "Capstone error" : err);
-        return false;
-    }
-
-    beginResetModel();
-    baseAddress_ = doc.baseAddress();
-    instructions_ = std::move(out);
-    endResetModel();
+    const quint64 generation = ++generation_;
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    cancel_ = cancel;
+    auto* watcher = new QFutureWatcher<QString>(this);
+    watcher_ = watcher;
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation]() {
+        const QString error = watcher->future().result();
+        watcher->deleteLater();
+        if (generation != generation_) {
+            return;  // stopIndexing() already dropped the watcher
+        }
+        watcher_ = nullptr;
+        cancel_.reset();
+        Q_EMIT indexFinished(error, indexFromCache_);
+    });
+    watcher->setFuture(QtConcurrent::run(
+        [doc, model = this, generation, cancel]() { return indexBlocks(doc, model, generation, cancel); }));
     return true;
 }
 
 void DisasmModel::clear() {
+    stopIndexing();
     beginResetModel();
-    instructions_.clear();
+    doc_ = nullptr;
+    blocks_.clear();
+    rowCount_ = 0;
+    xrefs_.reset();
+    indexFromCache_ = false;
+    cache_.clear();
     endResetModel();
 }
 
+// Stops the indexing pass and waits for it, so it no longer reads the document.
+void DisasmModel::stopIndexing() {
+    ++generation_;
+    if (cancel_) {
+        cancel_->store(true);
+        cancel_.reset();
+    }
+    if (watcher_) {
+        QFutureWatcherBase* watcher = watcher_;
+        watcher_ = nullptr;
+        watcher->waitForFinished();
+    }
+}
+
+// Reads the bytes of |block| from its first instruction, plus the lookahead. |limitOut| is
+// how many of them can start an instruction of this block; zero when none do.
+bool DisasmModel::readBlock(const BinaryDocument& doc,
+                            const Block& block,
+                            QByteArray& out,
+                            quint64& limitOut,
+                            QString& errorOut) {
+    limitOut = block.firstOffset < block.endOffset ? block.endOffset - block.firstOffset : 0;
+    if (limitOut == 0) {
+        out.clear();
+        return true;
+    }
+    const quint64 length = std::min(limitOut + kLookahead, block.readEnd - block.firstOffset);
+    return doc.readSpan(block.firstOffset, length, out, errorOut);
+}
+
+// Runs on a pool thread: sweeps |chunk| from |firstOffset| with an engine of its own.
+DisasmModel::ChunkIndex DisasmModel::indexChunk(const BinaryDocument& doc,
+                                                const CodeChunk& chunk,
+                                                quint64 firstOffset,
+                                                const Cancel& cancel) {
+    ChunkIndex index;
+    DisasmEngine engine;
+    if (!engine.configure(doc.arch(), doc.littleEndian())) {
+        index.error = tr("Failed to configure Capstone engine.");
+        return index;
+    }
+
+    const quint64 chunkEnd = chunk.offset + chunk.size;
+    QByteArray buffer;
+    quint64 offset = firstOffset;
+    const auto visit = [&index, &chunk](const DisasmInsnView& insn) {
+        if (index.head.size() < kSyncInstructions) {
+            index.head.push_back({chunk.offset + (insn.address - chunk.address), index.references.size()});
+        }
+        ++index.rows;
+        addReference(insn, index.references);
+    };
+    for (quint64 blockStart = chunk.offset; blockStart < chunkEnd; blockStart += kBlockSize) {
+        if (cancel->load()) {
+            break;
+        }
+        Block entry;
+        entry.firstOffset = offset;
+        entry.endOffset = std::min(blockStart + kBlockSize, chunkEnd);
+        entry.readEnd = chunk.regionEnd;
+        entry.firstAddress = chunk.address + (offset - chunk.offset);
+        entry.firstRow = index.rows;
+        index.blocks.push_back(entry);
+
+        quint64 limit = 0;
+        if (!readBlock(doc, entry, buffer, limit, index.error)) {
+            break;
+        }
+        if (limit > 0) {
+            offset += engine.sweep(reinterpret_cast<const std::uint8_t*>(buffer.constData()),
+                                   static_cast<std::size_t>(buffer.size()), static_cast<std::size_t>(limit),
+                                   entry.firstAddress, visit);
+        }
+    }
+    index.endOffset = offset;
+    return index;
+}
+
+// |index| was swept from a guessed boundary, but the chunk before left off at |from|. From
+// there, decodes until it meets an instruction the guess also found: past it the two sweeps
+// agree, so only the rows and targets before it change. Returns false when they do not meet
+// within the first block, and the chunk has to be swept again from |from|.
+bool DisasmModel::resyncChunk(const BinaryDocument& doc, const CodeChunk& chunk, quint64 from, ChunkIndex& index) {
+    if (index.blocks.empty() || index.head.empty() || from < chunk.offset || from > index.head.back().offset) {
+        return false;
+    }
+    Block& first = index.blocks.front();
+    DisasmEngine engine;
+    if (!engine.configure(doc.arch(), doc.littleEndian())) {
+        return false;
+    }
+
+    const quint64 limit = index.head.back().offset - from + 1;
+    QByteArray buffer;
+    QString error;
+    if (!doc.readSpan(from, std::min(limit + kLookahead, chunk.regionEnd - from), buffer, error)) {
+        return false;
+    }
+    std::vector<SyncPoint> walk;
+    std::vector<CodeReference> references;
+    engine.sweep(reinterpret_cast<const std::uint8_t*>(buffer.constData()), static_cast<std::size_t>(buffer.size()),
+                 static_cast<std::size_t>(limit), chunk.address + (from - chunk.offset),
+                 [&](const DisasmInsnView& insn) {
+                     walk.push_back({chunk.offset + (insn.address - chunk.address), references.size()});
+                     addReference(insn, references);
+                 });
+
+    for (std::size_t m = 0; m < walk.size(); ++m) {
+        const auto it = std::lower_bound(index.head.begin(), index.head.end(), walk[m].offset,
+                                         [](const SyncPoint& point, quint64 offset) { return point.offset < offset; });
+        if (it == index.head.end() || it->offset != walk[m].offset) {
+            continue;
+        }
+        if (it->offset >= first.endOffset) {
+            return false;
+        }
+        const std::size_t k = static_cast<std::size_t>(it - index.head.begin());
+        index.references.erase(index.references.begin(),
+                               index.references.begin() + static_cast<std::ptrdiff_t>(it->references));
+        index.references.insert(index.references.begin(), references.begin(),
+                                references.begin() + static_cast<std::ptrdiff_t>(walk[m].references));
+        index.rows = index.rows - k + m;
+        for (std::size_t j = 1; j < index.blocks.size(); ++j) {
+            index.blocks[j].firstRow = index.blocks[j].firstRow - k + m;
+        }
+        first.firstOffset = from;
+        first.firstAddress = chunk.address + (from - chunk.offset);
+        return true;
+    }
+    return false;
+}
+
+quint64 DisasmModel::indexLayout() {
+    return kIndexFormat << 32 | DisasmEngine::version();
+}
+
+// Runs on a worker thread: loads the index cached for this file's contents, or indexes the
+// chunks a thread pool's worth at a time, handing their blocks to the model in file order,
+// and caches the result.
+QString DisasmModel::indexBlocks(const BinaryDocument* doc,
+                                 DisasmModel* model,
+                                 quint64 generation,
+                                 const Cancel& cancel) {
+    const std::vector<CodeChunk> chunks =
+        split_code_regions(doc->codeRegions(), doc->functionStarts(), kChunkSize,
+                           DisasmEngine::instructionAlignment(doc->arch()));
+    quint64 total = 0;
+    for (const CodeChunk& chunk : chunks) {
+        total += chunk.size;
+    }
+
+    std::string cachePath;
+    std::string digest;
+    FsOps::Error hashError;
+    if (HashCache::instance().blake3File(QFile::encodeName(doc->path()).toStdString(), digest, hashError)) {
+        cachePath = XrefIndex::cachePath(digest);
+    }
+    if (!cachePath.empty()) {
+        auto cached = std::make_shared<XrefIndex>();
+        std::string loadError;
+        if (cached->load(cachePath, indexLayout(), loadError)) {
+            QMetaObject::invokeMethod(
+                model,
+                [model, generation, cached, total]() {
+                    model->appendBlocks(generation, cached->blocks(), cached->rowCount(), total, total);
+                    model->setIndex(generation, cached, true);
+                },
+                Qt::QueuedConnection);
+            return {};
+        }
+    }
+
+    const std::size_t wave = static_cast<std::size_t>(std::max(1, QThread::idealThreadCount()));
+    std::vector<Block> allBlocks;
+    std::vector<CodeReference> references;
+    quint64 rows = 0;
+    quint64 scanned = 0;
+    const CodeChunk* previous = nullptr;
+    quint64 previousEnd = 0;
+    for (std::size_t first = 0; first < chunks.size(); first += wave) {
+        const std::vector<CodeChunk> batch(chunks.begin() + static_cast<std::ptrdiff_t>(first),
+                                           chunks.begin() + static_cast<std::ptrdiff_t>(
+                                                                std::min(first + wave, chunks.size())));
+        std::vector<ChunkIndex> indexes = QtConcurrent::blockingMapped<std::vector<ChunkIndex>>(
+            batch, [doc, cancel](const CodeChunk& chunk) { return indexChunk(*doc, chunk, chunk.offset, cancel); });
+        if (cancel->load()) {
+            return {};
+        }
+
+        std::vector<Block> blocks;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            const CodeChunk& chunk = chunks[first + i];
+            ChunkIndex& index = indexes[i];
+            if (!index.error.isEmpty()) {
+                return index.error;
+            }
+            // The chunk before in the same region can end inside this one, when the split
+            // was a guess or a symbol was wrong.
+            const bool follows = previous && previous->regionEnd == chunk.regionEnd &&
+                                 previous->offset + previous->size == chunk.offset;
+            if (follows && previousEnd != chunk.offset && !resyncChunk(*doc, chunk, previousEnd, index)) {
+                index = indexChunk(*doc, chunk, previousEnd, cancel);
+                if (!index.error.isEmpty()) {
+                    return index.error;
+                }
+            }
+            for (Block block : index.blocks) {
+                block.firstRow += rows;
+                blocks.push_back(block);
+            }
+            rows += index.rows;
+            references.insert(references.end(), index.references.begin(), index.references.end());
+            previous = &chunk;
+            previousEnd = index.endOffset;
+            scanned += chunk.size;
+        }
+        allBlocks.insert(allBlocks.end(), blocks.begin(), blocks.end());
+        QMetaObject::invokeMethod(
+            model,
+            [model, generation, blocks = std::move(blocks), rows, scanned, total]() {
+                model->appendBlocks(generation, blocks, rows, scanned, total);
+            },
+            Qt::QueuedConnection);
+    }
+
+    auto index = std::make_shared<XrefIndex>();
+    index->assign(std::move(allBlocks), rows, std::move(references), doc->functions());
+    if (!cachePath.empty()) {
+        // Best effort: without a cache the next open just indexes again.
+        FsOps::Error dirError;
+        std::string saveError;
+        if (FsOps::make_dir_parents(cachePath.substr(0, cachePath.find_last_of('/')), dirError)) {
+            index->save(cachePath, indexLayout(), saveError);
+        }
+    }
+    QMetaObject::invokeMethod(
+        model, [model, generation, index]() { model->setIndex(generation, index, false); }, Qt::QueuedConnection);
+    return {};
+}
+
+void DisasmModel::appendBlocks(quint64 generation,
+                               const std::vector<Block>& blocks,
+                               quint64 rows,
+                               quint64 scanned,
+                               quint64 total) {
+    if (generation != generation_ || !doc_) {
+        return;
+    }
+    blocks_.insert(blocks_.end(), blocks.begin(), blocks.end());
+    const int count = static_cast<int>(std::min<quint64>(rows, std::numeric_limits<int>::max()));
+    if (count > rowCount_) {
+        beginInsertRows(QModelIndex(), rowCount_, count - 1);
+        rowCount_ = count;
+        endInsertRows();
+    }
+    Q_EMIT indexProgress(scanned, total);
+}
+
+void DisasmModel::setIndex(quint64 generation, const std::shared_ptr<const XrefIndex>& index, bool fromCache) {
+    if (generation != generation_ || !doc_) {
+        return;
+    }
+    xrefs_ = index;
+    indexFromCache_ = fromCache;
+    // Symbol names and function starts come with the index; format the rows again.
+    for (CacheEntry& entry : cache_) {
+        std::fill(entry.rows.begin(), entry.rows.end(), FormattedRow{});
+    }
+    if (rowCount_ > 0) {
+        Q_EMIT dataChanged(this->index(0, Address), this->index(rowCount_ - 1, Operands));
+    }
+}
+
+int DisasmModel::rowForAddress(quint64 address) const {
+    if (!xrefs_ || !doc_) {
+        return -1;
+    }
+    const std::size_t block = xrefs_->blockForAddress(address);
+    if (block >= blocks_.size()) {
+        return -1;
+    }
+    const std::shared_ptr<const DisasmBlock> decoded = decodedBlock(block);
+    if (!decoded) {
+        return -1;
+    }
+    for (std::size_t i = decoded->size(); i-- > 0;) {
+        if (decoded->address(i) <= address) {
+            if (address - decoded->address(i) >= decoded->byteCount(i)) {
+                return -1;  // past the block's last instruction, outside the code
+            }
+            const quint64 row = blocks_[block].firstRow + i;
+            return row < static_cast<quint64>(rowCount_) ? static_cast<int>(row) : -1;
+        }
+    }
+    return -1;
+}
+
+std::optional<quint64> DisasmModel::targetAt(int row) const {
+    if (row < 0 || row >= rowCount_ || !doc_) {
+        return std::nullopt;
+    }
+    const quint64 r = static_cast<quint64>(row);
+    const auto next = std::upper_bound(blocks_.begin(), blocks_.end(), r,
+                                       [](quint64 value, const Block& block) { return value < block.firstRow; });
+    if (next == blocks_.begin()) {
+        return std::nullopt;
+    }
+    const std::size_t block = static_cast<std::size_t>(next - blocks_.begin() - 1);
+    const std::shared_ptr<const DisasmBlock> decoded = decodedBlock(block);
+    const quint64 local = r - blocks_[block].firstRow;
+    std::uint64_t target = 0;
+    if (!decoded || local >= decoded->size()) {
+        return std::nullopt;
+    }
+    const std::size_t ins = static_cast<std::size_t>(local);
+    if (!DisasmEngine::directTarget(decoded->kind(ins), decoded->operands(ins), target)) {
+        return std::nullopt;
+    }
+    return target;
+}
+
+std::vector<quint64> DisasmModel::referencesTo(quint64 address) const {
+    std::vector<quint64> sources;
+    if (xrefs_) {
+        const auto range = xrefs_->referencesTo(address);
+        for (std::size_t i = range.first; i < range.second; ++i) {
+            sources.push_back(xrefs_->references()[i].from);
+        }
+    }
+    return sources;
+}
+
+QString DisasmModel::symbolName(quint64 address) const {
+    const ImageSymbol* symbol = xrefs_ ? xrefs_->symbolContaining(address) : nullptr;
+    if (!symbol || symbol->name.empty()) {
+        return {};
+    }
+    const QString name = QString::fromStdString(symbol->name);
+    if (address == symbol->address) {
+        return name;
+    }
+    return QStringLiteral("%1+0x%2").arg(name).arg(address - symbol->address, 0, 16);
+}
+
+// Decodes |block| again, or takes it from the cache of recently shown blocks.
+std::shared_ptr<const DisasmBlock> DisasmModel::decodedBlock(std::size_t block) const {
+    const CacheEntry* entry = cachedBlock(block);
+    return entry ? entry->decoded : nullptr;
+}
+
+DisasmModel::CacheEntry* DisasmModel::cachedBlock(std::size_t block) const {
+    for (CacheEntry& entry : cache_) {
+        if (entry.block == block) {
+            entry.lastUse = ++cacheClock_;
+            return &entry;
+        }
+    }
+
+    QByteArray buffer;
+    quint64 limit = 0;
+    QString error;
+    if (!readBlock(*doc_, blocks_[block], buffer, limit, error)) {
+        return nullptr;
+    }
+
+    auto decoded = std::make_shared<DisasmBlock>();
+    const quint64 blockAddress = blocks_[block].firstAddress;
+    decoded->clear(blockAddress);
+    engine_.sweep(reinterpret_cast<const std::uint8_t*>(buffer.constData()), static_cast<std::size_t>(buffer.size()),
+                  static_cast<std::size_t>(limit), blockAddress,
+                  [&decoded](const DisasmInsnView& insn) { decoded->append(insn); });
+
+    CacheEntry fresh;
+    fresh.block = block;
+    fresh.rows.resize(decoded->size());
+    fresh.decoded = std::move(decoded);
+    fresh.lastUse = ++cacheClock_;
+    if (cache_.size() < kCachedBlocks) {
+        cache_.push_back(std::move(fresh));
+        return &cache_.back();
+    }
+    CacheEntry& oldest = *std::min_element(
+        cache_.begin(), cache_.end(), [](const CacheEntry& a, const CacheEntry& b) { return a.lastUse < b.lastUse; });
+    oldest = std::move(fresh);
+    return &oldest;
+}
+
 }  // namespace PCManFM
@@ -8,34 +8,158 @@
 
 #include <QAbstractTableModel>
 
+#include <atomic>
+#include <memory>
+#include <optional>
 #include <vector>
 
 #include "color_roles.h"
 #include "binarydocument.h"
 #include "disasm_engine.h"
+#include "../core/binary_image.h"
+#include "../core/xref_index.h"
+
+class QFutureWatcherBase;
 
 namespace PCManFM {
 
+// DisasmModel shows a linear sweep over the code of a binary without holding it in memory.
+// A background pass splits the document's code regions into chunks at function starts and
+// decodes them in parallel, each chunk on a pool thread with its own Capstone handle. It
+// keeps only where each fixed-size block's first instruction starts and its first row,
+// adding rows in file order as chunks finish, and collects every direct call and branch into
+// an XrefIndex together with the symbols. The index is cached on disk under the file's
+// BLAKE3 digest, so reopening a file skips the pass. Rows are then decoded on demand, a block
+// at a time, with the most recently used blocks kept decoded together with their rows' text
+// and packed cell attributes, formatted the first time a row is shown.
 class DisasmModel : public QAbstractTableModel {
     Q_OBJECT
 
    public:
     explicit DisasmModel(QObject* parent = nullptr);
+    ~DisasmModel() override;
 
     enum Column { Address = 0, Bytes, Mnemonic, Operands, ColumnCount };
 
     int rowCount(const QModelIndex& parent = QModelIndex()) const override;
     int columnCount(const QModelIndex& parent = QModelIndex()) const override;
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    // Answers all roles of a cell from one row lookup, as the item delegates ask for them.
+    void multiData(const QModelIndex& index, QModelRoleDataSpan roleDataSpan) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
 
-    bool disassemble(const BinaryDocument& doc, quint64 offset, quint64 length, QString& errorOut);
+    // Starts indexing |doc|, which must stay alive until clear() or another setDocument().
+    bool setDocument(const BinaryDocument* doc, QString& errorOut);
+    // Stops the indexing pass, waiting for it, and drops all rows.
     void clear();
+    bool indexing() const { return watcher_ != nullptr; }
+
+    // The cross-references and symbols, once indexing has finished; null before.
+    const XrefIndex* xrefs() const { return xrefs_.get(); }
+    // The row of the instruction covering |address|, or -1 if it is not in the listing.
+    int rowForAddress(quint64 address) const;
+    // The destination of the direct call or branch on |row|, if it is one.
+    std::optional<quint64> targetAt(int row) const;
+    // Addresses of the instructions calling or branching to |address|.
+    std::vector<quint64> referencesTo(quint64 address) const;
+    // "name" or "name+0x1c" for an address inside a known function, else empty.
+    QString symbolName(quint64 address) const;
+
+   Q_SIGNALS:
+    // Progress in bytes of code.
+    void indexProgress(quint64 scanned, quint64 total);
+    // Emitted once the whole file is indexed, or with the reason it could not be.
+    // |fromCache| tells whether the index was loaded from disk.
+    void indexFinished(const QString& error, bool fromCache);
 
    private:
+    // Instructions starting in each kBlockSize bytes of a chunk form a block.
+    static constexpr quint64 kBlockSize = 16 * 1024;
+    // Bytes read past a block so an instruction straddling its end decodes whole.
+    static constexpr quint64 kLookahead = 16;
+    static constexpr std::size_t kCachedBlocks = 16;
+    static constexpr quint64 kChunkSize = 1024 * 1024;
+    // Instructions remembered from the start of each chunk to resynchronize on.
+    static constexpr std::size_t kSyncInstructions = 64;
+    // Bumped whenever the way blocks are cut changes, so cached indexes are rebuilt.
+    static constexpr quint64 kIndexFormat = 1;
+
+    using Block = CodeBlock;
+
+    // An instruction near the start of a chunk, with the number of references found before it.
+    struct SyncPoint {
+        quint64 offset = 0;
+        std::size_t references = 0;
+    };
+
+    // One chunk's share of the index; rows count from the chunk's first instruction.
+    struct ChunkIndex {
+        std::vector<Block> blocks;
+        quint64 rows = 0;
+        quint64 endOffset = 0;  // just past the last instruction
+        std::vector<SyncPoint> head;
+        std::vector<CodeReference> references;
+        QString error;
+    };
+
+    // A row's display text and its attributes word: the CellCategory of each column in four
+    // bits, the row's CellFlag bits from bit 16, and kRowFormatted once the text is filled in.
+    struct FormattedRow {
+        QString text[ColumnCount];
+        quint32 attributes = 0;
+    };
+
+    struct CacheEntry {
+        std::size_t block = 0;
+        std::shared_ptr<const DisasmBlock> decoded;
+        std::vector<FormattedRow> rows;  // one per instruction of |decoded|
+        quint64 lastUse = 0;
+    };
+
+    using Cancel = std::shared_ptr<std::atomic<bool>>;
+
+    static QString indexBlocks(const BinaryDocument* doc,
+                               DisasmModel* model,
+                               quint64 generation,
+                               const Cancel& cancel);
+    static ChunkIndex indexChunk(const BinaryDocument& doc,
+                                 const CodeChunk& chunk,
+                                 quint64 firstOffset,
+                                 const Cancel& cancel);
+    static bool resyncChunk(const BinaryDocument& doc, const CodeChunk& chunk, quint64 from, ChunkIndex& index);
+    static bool readBlock(const BinaryDocument& doc,
+                          const Block& block,
+                          QByteArray& out,
+                          quint64& limitOut,
+                          QString& errorOut);
+    void appendBlocks(quint64 generation,
+                      const std::vector<Block>& blocks,
+                      quint64 rows,
+                      quint64 scanned,
+                      quint64 total);
+    void setIndex(quint64 generation, const std::shared_ptr<const XrefIndex>& index, bool fromCache);
+    static quint64 indexLayout();
+    std::shared_ptr<const DisasmBlock> decodedBlock(std::size_t block) const;
+    CacheEntry* cachedBlock(std::size_t block) const;
+    // The cached block holding |index|'s row, with the row's instruction in it; null when the
+    // row cannot be decoded.
+    CacheEntry* entryForIndex(const QModelIndex& index, std::size_t& insOut) const;
+    const FormattedRow& formattedRow(CacheEntry& entry, std::size_t ins) const;
+    QVariant cellData(CacheEntry& entry, std::size_t ins, int column, int role) const;
+    void stopIndexing();
+
+    const BinaryDocument* doc_ = nullptr;
     DisasmEngine engine_;
-    std::vector<DisasmInstr> instructions_;
-    quint64 baseAddress_ = 0;
+    std::vector<Block> blocks_;  // the sparse instruction-boundary index, one entry per block
+    int rowCount_ = 0;
+    std::shared_ptr<const XrefIndex> xrefs_;
+    bool indexFromCache_ = false;
+    quint64 generation_ = 0;
+    Cancel cancel_;
+    QFutureWatcherBase* watcher_ = nullptr;  // running indexing pass, if any
+    mutable std::vector<CacheEntry> cache_;
+    mutable quint64 cacheClock_ = 0;
+    mutable std::size_t lastEntry_ = 0;  // cache_ entry of the last row looked up
 };
 
 }  // namespace PCManFM
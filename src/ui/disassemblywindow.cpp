@@ -9,8 +9,11 @@
 #include <QClipboard>
 #include <QFileInfo>
 #include <QFontDatabase>
+#include <QFontMetrics>
 #include <QHeaderView>
+#include <QInputDialog>
 #include <QLabel>
+#include <QMenu>
 #include <QMessageBox>
 #include <QStatusBar>
 #include <QTableView>
@@ -20,6 +23,7 @@
 #include "binarydocument.h"
 #include "color_delegate.h"
 #include "color_manager.h"
+#include "color_roles.h"
 #include "disasmmodel.h"
 
 #include <algorithm>
@@ -28,8 +32,11 @@
 namespace PCManFM {
 
 namespace {
-// Avoid loading huge binaries into memory at once; trim to a reasonable preview size.
-constexpr qsizetype kMaxBytes = 512 * 1024;  // 512 KiB
+// The listing covers the whole file; Copy All stops here rather than build a huge string.
+constexpr int kMaxCopyRows = 1000000;
+// References offered in the menu; a popular function can have thousands.
+constexpr std::size_t kMaxReferenceItems = 100;
+constexpr std::size_t kMaxHistory = 256;
 }  // namespace
 
 DisassemblyWindow::DisassemblyWindow(QWidget* parent) : QMainWindow(parent) {
@@ -55,6 +62,9 @@ void DisassemblyWindow::setupUi() {
     view_->setAlternatingRowColors(true);
     view_->setEditTriggers(QAbstractItemView::NoEditTriggers);
     view_->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    // Uniform rows keep scrolling through millions of instructions cheap.
+    view_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view_->verticalHeader()->setDefaultSectionSize(QFontMetrics(view_->font()).height() + 4);
     layout->addWidget(view_);
 
     setCentralWidget(central);
@@ -66,7 +76,7 @@ void DisassemblyWindow::setupUi() {
     connect(copyAction, &QAction::triggered, this, [this] {
         if (model_) {
             QStringList lines;
-            const int rows = model_->rowCount();
+            const int rows = std::min(model_->rowCount(), kMaxCopyRows);
             for (int r = 0; r < rows; ++r) {
                 const QString addr = model_->data(model_->index(r, DisasmModel::Address)).toString();
                 const QString bytes = model_->data(model_->index(r, DisasmModel::Bytes)).toString();
@@ -75,6 +85,9 @@ void DisassemblyWindow::setupUi() {
                 lines << QStringLiteral("%1  %2  %3 %4").arg(addr, bytes, mnem, ops).trimmed();
             }
             QApplication::clipboard()->setText(lines.join(QLatin1Char('\n')));
+            if (rows < model_->rowCount()) {
+                statusBar()->showMessage(tr("Copied the first %1 instructions.").arg(rows));
+            }
         }
     });
 
@@ -89,6 +102,25 @@ void DisassemblyWindow::setupUi() {
         }
     });
 
+    toolbar->addSeparator();
+    auto* backAction = toolbar->addAction(QIcon::fromTheme(QStringLiteral("go-previous")), tr("Back"));
+    backAction->setShortcut(QKeySequence::Back);
+    connect(backAction, &QAction::triggered, this, &DisassemblyWindow::goBack);
+
+    auto* goToAction = toolbar->addAction(QIcon::fromTheme(QStringLiteral("go-jump")), tr("Go to Address…"));
+    goToAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_G));
+    connect(goToAction, &QAction::triggered, this, &DisassemblyWindow::promptGoTo);
+
+    auto* followAction = toolbar->addAction(QIcon::fromTheme(QStringLiteral("go-next")), tr("Follow"));
+    followAction->setToolTip(tr("Jump to the target of the selected call or branch"));
+    connect(followAction, &QAction::triggered, this, &DisassemblyWindow::followCurrent);
+    connect(view_, &QAbstractItemView::doubleClicked, this, &DisassemblyWindow::followCurrent);
+
+    auto* referencesAction = toolbar->addAction(QIcon::fromTheme(QStringLiteral("edit-find")), tr("References"));
+    referencesAction->setToolTip(tr("List the calls and branches to the selected address"));
+    referencesAction->setShortcut(QKeySequence(Qt::Key_X));
+    connect(referencesAction, &QAction::triggered, this, &DisassemblyWindow::showReferences);
+
     colors_ = std::make_unique<ColorManager>(this);
     delegate_ = new ColorDelegate(colors_.get(), view_);
     view_->setItemDelegate(delegate_);
@@ -101,6 +133,10 @@ void DisassemblyWindow::setupUi() {
 
 bool DisassemblyWindow::openFile(const QString& path, QString& errorOut) {
     errorOut.clear();
+    // The model reads the current document until it is cleared.
+    if (model_) {
+        model_->clear();
+    }
     doc_ = std::make_unique<BinaryDocument>();
     if (!doc_->open(path, errorOut)) {
         doc_.reset();
@@ -114,62 +150,176 @@ bool DisassemblyWindow::openFile(const QString& path, QString& errorOut) {
 
     if (!model_) {
         model_ = std::make_unique<DisasmModel>(this);
+        connect(model_.get(), &DisasmModel::indexProgress, this, [this](quint64 scanned, quint64 total) {
+            const int percent = total == 0 ? 100 : static_cast<int>(scanned * 100 / total);
+            statusBar()->showMessage(tr("Indexing instructions… %1%").arg(percent));
+        });
+        connect(model_.get(), &DisasmModel::indexFinished, this, [this](const QString& error, bool fromCache) {
+            if (!error.isEmpty()) {
+                statusBar()->showMessage(tr("Disassembly stopped: %1").arg(error));
+                return;
+            }
+            const XrefIndex* xrefs = model_->xrefs();
+            const QString summary = tr("%1 instructions, %2 references, %3 symbols.")
+                                        .arg(model_->rowCount())
+                                        .arg(xrefs ? xrefs->references().size() : 0)
+                                        .arg(xrefs ? xrefs->symbols().size() : 0);
+            statusBar()->showMessage(fromCache ? tr("%1 Loaded from cache.").arg(summary) : summary);
+        });
         if (view_) {
             view_->setModel(model_.get());
-            view_->horizontalHeader()->setSectionResizeMode(DisasmModel::Address, QHeaderView::ResizeToContents);
-            view_->horizontalHeader()->setSectionResizeMode(DisasmModel::Bytes, QHeaderView::ResizeToContents);
-            view_->horizontalHeader()->setSectionResizeMode(DisasmModel::Mnemonic, QHeaderView::ResizeToContents);
+            // Sized from the first rows instead of every row, which may be millions.
+            view_->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+            connect(model_.get(), &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex&, int first) {
+                if (first == 0 && view_) {
+                    view_->resizeColumnsToContents();
+                }
+            });
         }
     }
 
     currentPath_ = path;
-    return refresh(0);
+    history_.clear();
+    return refresh();
 }
 
-bool DisassemblyWindow::refresh(quint64 offset) {
+bool DisassemblyWindow::refresh() {
     if (!doc_) {
         return false;
     }
 
-    const quint64 safeOffset = std::min<quint64>(offset, doc_->size());
-    const quint64 remaining = doc_->size() > safeOffset ? doc_->size() - safeOffset : 0;
-    const quint64 length = std::min<quint64>(remaining, kMaxBytes);
-    if (length == 0) {
-        if (model_) {
-            model_->clear();
-        }
-        updateLabels(currentPath_, false, 0);
-        return true;
-    }
     QString error;
-    if (!model_->disassemble(*doc_, offset, length, error)) {
+    if (!model_->setDocument(doc_.get(), error)) {
         QMessageBox::warning(this, tr("Disassembly"), error.isEmpty() ? tr("Failed to disassemble file.") : error);
         return false;
     }
 
-    updateLabels(currentPath_, length == kMaxBytes && doc_->size() > kMaxBytes, static_cast<qsizetype>(length));
+    updateLabels(currentPath_);
     if (view_) {
         view_->scrollToTop();
-        if (model_->rowCount() > 0) {
-            view_->selectRow(0);
-        }
     }
     return true;
 }
 
-void DisassemblyWindow::updateLabels(const QString& path, bool truncated, qsizetype bytesRead) {
+void DisassemblyWindow::updateLabels(const QString& path) {
     if (pathLabel_) {
         pathLabel_->setText(tr("Path: %1").arg(path));
     }
+    statusBar()->showMessage(tr("Indexing instructions…"));
+    setWindowTitle(tr("Disassembly - %1").arg(QFileInfo(path).fileName()));
+}
 
-    if (truncated) {
-        statusBar()->showMessage(tr("Showing first %1 bytes (truncated).").arg(bytesRead));
+std::optional<quint64> DisassemblyWindow::currentAddress() const {
+    if (!model_ || !view_ || !view_->currentIndex().isValid()) {
+        return std::nullopt;
     }
-    else {
-        statusBar()->clearMessage();
+    const QModelIndex index = model_->index(view_->currentIndex().row(), DisasmModel::Address);
+    const QVariant address = model_->data(index, RoleAddress);
+    if (!address.isValid()) {
+        return std::nullopt;
     }
+    return address.toULongLong();
+}
 
-    setWindowTitle(tr("Disassembly - %1").arg(QFileInfo(path).fileName()));
+bool DisassemblyWindow::goToAddress(quint64 address, bool remember) {
+    if (!model_ || !view_) {
+        return false;
+    }
+    if (!model_->xrefs()) {
+        statusBar()->showMessage(tr("Navigation is available once indexing has finished."));
+        return false;
+    }
+    const int row = model_->rowForAddress(address);
+    if (row < 0) {
+        statusBar()->showMessage(tr("Address 0x%1 is not in the disassembled code.").arg(address, 0, 16));
+        return false;
+    }
+    if (remember) {
+        if (const std::optional<quint64> current = currentAddress()) {
+            history_.push_back(*current);
+            if (history_.size() > kMaxHistory) {
+                history_.erase(history_.begin());
+            }
+        }
+    }
+    const QModelIndex target = model_->index(row, DisasmModel::Address);
+    view_->setCurrentIndex(target);
+    view_->scrollTo(target, QAbstractItemView::PositionAtCenter);
+    const QString name = model_->symbolName(address);
+    statusBar()->showMessage(name.isEmpty() ? QStringLiteral("0x%1").arg(address, 0, 16)
+                                            : QStringLiteral("0x%1 <%2>").arg(address, 0, 16).arg(name));
+    return true;
+}
+
+void DisassemblyWindow::goBack() {
+    if (history_.empty()) {
+        return;
+    }
+    const quint64 address = history_.back();
+    history_.pop_back();
+    goToAddress(address, false);
+}
+
+void DisassemblyWindow::promptGoTo() {
+    bool ok = false;
+    QString text = QInputDialog::getText(this, tr("Go to Address"), tr("Address (hex):"), QLineEdit::Normal,
+                                         QString(), &ok)
+                       .trimmed();
+    if (!ok || text.isEmpty()) {
+        return;
+    }
+    if (text.startsWith(QLatin1String("0x"), Qt::CaseInsensitive)) {
+        text = text.mid(2);
+    }
+    const quint64 address = text.toULongLong(&ok, 16);
+    if (!ok) {
+        statusBar()->showMessage(tr("\"%1\" is not a hexadecimal address.").arg(text));
+        return;
+    }
+    goToAddress(address, true);
+}
+
+void DisassemblyWindow::followCurrent() {
+    if (!model_ || !view_ || !view_->currentIndex().isValid()) {
+        return;
+    }
+    const std::optional<quint64> target = model_->targetAt(view_->currentIndex().row());
+    if (!target) {
+        statusBar()->showMessage(tr("The selected instruction has no direct target."));
+        return;
+    }
+    goToAddress(*target, true);
+}
+
+void DisassemblyWindow::showReferences() {
+    const std::optional<quint64> address = currentAddress();
+    if (!address || !model_) {
+        return;
+    }
+    if (!model_->xrefs()) {
+        statusBar()->showMessage(tr("Navigation is available once indexing has finished."));
+        return;
+    }
+    const std::vector<quint64> sources = model_->referencesTo(*address);
+    if (sources.empty()) {
+        statusBar()->showMessage(tr("No calls or branches to 0x%1.").arg(*address, 0, 16));
+        return;
+    }
+
+    QMenu menu(this);
+    for (std::size_t i = 0; i < sources.size() && i < kMaxReferenceItems; ++i) {
+        const quint64 source = sources[i];
+        const QString name = model_->symbolName(source);
+        const QString label = name.isEmpty() ? QStringLiteral("0x%1").arg(source, 0, 16)
+                                             : QStringLiteral("0x%1 <%2>").arg(source, 0, 16).arg(name);
+        menu.addAction(label, this, [this, source] { goToAddress(source, true); });
+    }
+    if (sources.size() > kMaxReferenceItems) {
+        menu.addSeparator();
+        menu.addAction(tr("%1 more not shown").arg(sources.size() - kMaxReferenceItems))->setEnabled(false);
+    }
+    const QRect rect = view_->visualRect(view_->currentIndex());
+    menu.exec(view_->viewport()->mapToGlobal(rect.isValid() ? rect.bottomLeft() : QPoint()));
 }
 
 }  // namespace PCManFM
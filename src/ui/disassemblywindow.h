@@ -11,6 +11,7 @@
 
 #include <memory>
 #include <optional>
+#include <vector>
 
 class QLabel;
 class QTableView;
@@ -33,8 +34,17 @@ class DisassemblyWindow : public QMainWindow {
 
    private:
     void setupUi();
-    bool refresh(quint64 offset = 0);
-    void updateLabels(const QString& path, bool truncated, qsizetype bytesRead);
+    bool refresh();
+    void updateLabels(const QString& path);
+
+    std::optional<quint64> currentAddress() const;
+    // Selects the instruction covering |address|; with |remember| the current one can be
+    // returned to with goBack().
+    bool goToAddress(quint64 address, bool remember);
+    void goBack();
+    void promptGoTo();
+    void followCurrent();
+    void showReferences();
 
     std::unique_ptr<BinaryDocument> doc_;
     std::unique_ptr<DisasmModel> model_;
@@ -43,6 +53,7 @@ class DisassemblyWindow : public QMainWindow {
     QTableView* view_ = nullptr;
     QLabel* pathLabel_ = nullptr;
     QString currentPath_;
+    std::vector<quint64> history_;  // addresses left by navigation, most recent last
 };
 
 }  // namespace PCManFM
@@ -0,0 +1,293 @@
+/*
+ * Window listing the duplicate files found under some folders
+ * src/ui/duplicatesdialog.cpp
+ */
+
+#include "duplicatesdialog.h"
+
+#include <QDateTime>
+#include <QDialogButtonBox>
+#include <QFile>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QMessageBox>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QtConcurrent>
+
+#include <cerrno>
+#include <string>
+
+namespace PCManFM {
+
+namespace {
+
+enum Column { NameColumn, FolderColumn, SizeColumn, ModifiedColumn, GroupColumn, NumColumns };
+
+constexpr int kGroupIndexRole = Qt::UserRole + 1;
+
+QString displayPath(const std::string& path) {
+    return QFile::decodeName(QByteArray(path.data(), static_cast<int>(path.size())));
+}
+
+QString formatSize(std::uint64_t size) {
+    return QLocale().formattedDataSize(static_cast<qint64>(size));
+}
+
+}  // namespace
+
+DuplicatesDialog::DuplicatesDialog(const QStringList& roots, QWidget* parent)
+    : QDialog(parent), roots_{roots}, cancel_{false} {
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(roots.size() == 1 ? tr("Duplicates in %1").arg(QFileInfo(roots.first()).fileName())
+                                     : tr("Duplicates"));
+    resize(800, 500);
+
+    auto* layout = new QVBoxLayout(this);
+    statusLabel_ = new QLabel(this);
+    layout->addWidget(statusLabel_);
+    progressBar_ = new QProgressBar(this);
+    layout->addWidget(progressBar_);
+
+    tree_ = new QTreeWidget(this);
+    tree_->setColumnCount(NumColumns);
+    tree_->setHeaderLabels({tr("Name"), tr("Folder"), tr("Size"), tr("Modified"), tr("Group")});
+    tree_->header()->setSectionResizeMode(FolderColumn, QHeaderView::Stretch);
+    tree_->header()->setStretchLastSection(false);
+    tree_->setUniformRowHeights(true);
+    tree_->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    layout->addWidget(tree_, 1);
+
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    hardlinkButton_ = buttons->addButton(tr("Replace with &Hard Links"), QDialogButtonBox::ActionRole);
+    hardlinkButton_->setToolTip(tr("The copies in the checked groups become links to the first file, "
+                                   "and change along with it from then on"));
+    reflinkButton_ = buttons->addButton(tr("Share Data with &Reflinks"), QDialogButtonBox::ActionRole);
+    reflinkButton_->setToolTip(tr("The copies in the checked groups share the blocks of the first file "
+                                  "but remain separate files (Btrfs, XFS and others)"));
+    rescanButton_ = buttons->addButton(tr("&Search Again"), QDialogButtonBox::ActionRole);
+    layout->addWidget(buttons);
+
+    connect(buttons, &QDialogButtonBox::rejected, this, &DuplicatesDialog::reject);
+    connect(hardlinkButton_, &QPushButton::clicked, this, [this] { merge(DupFinder::Method::Hardlink); });
+    connect(reflinkButton_, &QPushButton::clicked, this, [this] { merge(DupFinder::Method::Reflink); });
+    connect(rescanButton_, &QPushButton::clicked, this, &DuplicatesDialog::search);
+    connect(&watcher_, &QFutureWatcher<void>::finished, this, [this] {
+        if (merging_.empty()) {
+            onSearched();
+        }
+        else {
+            onMerged();
+        }
+    });
+
+    search();
+}
+
+DuplicatesDialog::~DuplicatesDialog() {
+    // the worker reports to this window; it stops at the next file
+    cancel_.store(true, std::memory_order_relaxed);
+    watcher_.waitForFinished();
+}
+
+void DuplicatesDialog::reject() {
+    if (watcher_.isRunning() && merging_.empty()) {
+        cancel_.store(true, std::memory_order_relaxed);
+    }
+    QDialog::reject();
+}
+
+void DuplicatesDialog::setBusy(bool busy) {
+    progressBar_->setVisible(busy);
+    hardlinkButton_->setEnabled(!busy && !groups_.empty());
+    reflinkButton_->setEnabled(!busy && !groups_.empty());
+    rescanButton_->setEnabled(!busy);
+}
+
+void DuplicatesDialog::search() {
+    cancel_.store(false, std::memory_order_relaxed);
+    groups_.clear();
+    error_ = {};
+    merging_.clear();
+    tree_->clear();
+    progressBar_->setRange(0, 0);
+    statusLabel_->setText(tr("Looking for files…"));
+    setBusy(true);
+
+    std::vector<std::string> roots;
+    for (const QString& root : roots_) {
+        roots.push_back(QFile::encodeName(root).toStdString());
+    }
+    watcher_.setFuture(QtConcurrent::run([this, roots] {
+        auto progress = [this](DupFinder::Stage stage, std::uint64_t done, std::uint64_t total) {
+            if (cancel_.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            QMetaObject::invokeMethod(
+                this,
+                [this, stage, done, total] {
+                    switch (stage) {
+                        case DupFinder::Stage::Scanning:
+                            statusLabel_->setText(tr("Looking for files… %n found", nullptr, static_cast<int>(done)));
+                            break;
+                        case DupFinder::Stage::Sampling:
+                            statusLabel_->setText(tr("Comparing the files of the same size…"));
+                            break;
+                        case DupFinder::Stage::Hashing:
+                            statusLabel_->setText(tr("Comparing the whole content of the files still alike…"));
+                            break;
+                    }
+                    if (total > 0) {
+                        // in permille, as the counts may not fit an int
+                        progressBar_->setRange(0, 1000);
+                        progressBar_->setValue(static_cast<int>(done * 1000 / total));
+                    }
+                    else {
+                        progressBar_->setRange(0, 0);
+                    }
+                },
+                Qt::QueuedConnection);
+            return true;
+        };
+        DupFinder::Options options;
+        options.sameFilesystem = true;
+        DupFinder::find_duplicates(roots, groups_, options, progress, error_);
+    }));
+}
+
+void DuplicatesDialog::onSearched() {
+    setBusy(false);
+    if (error_.isSet()) {
+        statusLabel_->setText(error_.code == ECANCELED ? tr("The search was cancelled.")
+                                                       : tr("The search failed: %1")
+                                                             .arg(QString::fromLocal8Bit(error_.message.c_str())));
+        return;
+    }
+    showGroups();
+}
+
+void DuplicatesDialog::showGroups() {
+    tree_->clear();
+    std::uint64_t reclaimable = 0;
+    std::size_t copies = 0;
+    QList<QTreeWidgetItem*> items;
+    for (std::size_t i = 0; i < groups_.size(); ++i) {
+        const DupFinder::Group& group = groups_[i];
+        reclaimable += group.reclaimable();
+        copies += group.files.size() - 1;
+
+        auto* groupItem = new QTreeWidgetItem();
+        groupItem->setText(NameColumn, tr("%n files", nullptr, static_cast<int>(group.files.size())));
+        groupItem->setText(SizeColumn, formatSize(group.size));
+        groupItem->setText(GroupColumn, QString::number(i + 1));
+        groupItem->setToolTip(GroupColumn, tr("BLAKE3: %1").arg(QString::fromLatin1(group.hexHash.c_str())));
+        groupItem->setTextAlignment(SizeColumn, Qt::AlignRight | Qt::AlignVCenter);
+        groupItem->setFlags(groupItem->flags() | Qt::ItemIsUserCheckable);
+        groupItem->setCheckState(NameColumn, Qt::Checked);
+        groupItem->setData(NameColumn, kGroupIndexRole, static_cast<qulonglong>(i));
+        for (const DupFinder::File& file : group.files) {
+            const QString path = displayPath(file.path);
+            const int slash = path.lastIndexOf(QLatin1Char('/'));
+            auto* fileItem = new QTreeWidgetItem(groupItem);
+            fileItem->setText(NameColumn, path.mid(slash + 1));
+            fileItem->setText(FolderColumn, path.left(slash));
+            fileItem->setText(SizeColumn, formatSize(group.size));
+            fileItem->setTextAlignment(SizeColumn, Qt::AlignRight | Qt::AlignVCenter);
+            fileItem->setText(ModifiedColumn,
+                              QLocale().toString(QDateTime::fromSecsSinceEpoch(file.mtimeSec), QLocale::ShortFormat));
+            fileItem->setText(GroupColumn, QString::number(i + 1));
+            fileItem->setToolTip(NameColumn, path);
+        }
+        items << groupItem;
+    }
+    tree_->addTopLevelItems(items);
+    tree_->expandAll();
+    tree_->resizeColumnToContents(NameColumn);
+
+    if (groups_.empty()) {
+        statusLabel_->setText(tr("No duplicate files were found."));
+    }
+    else {
+        statusLabel_->setText(tr("%n copies in %1 groups; %2 can be reclaimed.", nullptr, static_cast<int>(copies))
+                                  .arg(groups_.size())
+                                  .arg(formatSize(reclaimable)));
+    }
+    setBusy(false);
+}
+
+void DuplicatesDialog::merge(DupFinder::Method method) {
+    merging_.clear();
+    for (int i = 0; i < tree_->topLevelItemCount(); ++i) {
+        const QTreeWidgetItem* item = tree_->topLevelItem(i);
+        if (item->checkState(NameColumn) == Qt::Checked) {
+            merging_.push_back(static_cast<std::size_t>(item->data(NameColumn, kGroupIndexRole).toULongLong()));
+        }
+    }
+    if (merging_.empty()) {
+        return;
+    }
+    if (method == DupFinder::Method::Hardlink &&
+        QMessageBox::question(this, tr("Replace with Hard Links"),
+                              tr("The copies in %n groups will become hard links to the first file of their group. "
+                                 "Changing one of them will then change all of them. Continue?",
+                                 nullptr, static_cast<int>(merging_.size()))) != QMessageBox::Yes) {
+        merging_.clear();
+        return;
+    }
+
+    statusLabel_->setText(tr("Merging the duplicates…"));
+    progressBar_->setRange(0, 0);
+    setBusy(true);
+    mergeResults_.assign(merging_.size(), DupFinder::DedupResult{});
+    watcher_.setFuture(QtConcurrent::run([this, method] {
+        for (std::size_t i = 0; i < merging_.size(); ++i) {
+            DupFinder::dedup_group(groups_[merging_[i]], method, mergeResults_[i]);
+        }
+    }));
+}
+
+void DuplicatesDialog::onMerged() {
+    std::size_t merged = 0;
+    std::uint64_t saved = 0;
+    QStringList failures;
+    std::vector<char> done(groups_.size(), 0);
+    for (std::size_t i = 0; i < merging_.size(); ++i) {
+        const DupFinder::DedupResult& result = mergeResults_[i];
+        merged += result.merged;
+        saved += result.bytesSaved;
+        for (const auto& failure : result.failures) {
+            failures << QString::fromLocal8Bit(failure.second.message.c_str());
+        }
+        done[merging_[i]] = result.failures.empty();
+    }
+    merging_.clear();
+    mergeResults_.clear();
+
+    // the groups merged whole are gone; those left keep their failed files
+    std::vector<DupFinder::Group> left;
+    for (std::size_t i = 0; i < groups_.size(); ++i) {
+        if (!done[i]) {
+            left.push_back(std::move(groups_[i]));
+        }
+    }
+    groups_ = std::move(left);
+    showGroups();
+
+    const QString summary =
+        tr("%n files merged, %1 reclaimed.", nullptr, static_cast<int>(merged)).arg(formatSize(saved));
+    if (failures.isEmpty()) {
+        statusLabel_->setText(summary);
+    }
+    else {
+        QMessageBox box(QMessageBox::Warning, tr("Some files were not merged"), summary, QMessageBox::Ok, this);
+        box.setInformativeText(tr("These files were left as they were:"));
+        box.setDetailedText(failures.join(QLatin1Char('\n')));
+        box.exec();
+    }
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,66 @@
+/*
+ * Window listing the duplicate files found under some folders
+ * src/ui/duplicatesdialog.h
+ */
+
+#ifndef PCMANFM_DUPLICATESDIALOG_H
+#define PCMANFM_DUPLICATESDIALOG_H
+
+#include <QDialog>
+#include <QFutureWatcher>
+#include <QStringList>
+
+#include <atomic>
+#include <vector>
+
+#include "../core/dup_finder.h"
+
+class QLabel;
+class QProgressBar;
+class QPushButton;
+class QTreeWidget;
+
+namespace PCManFM {
+
+// Runs DupFinder::find_duplicates() on the given folders off the GUI thread and lists the
+// groups found, one branch each with the files as its leaves, most bytes to reclaim first.
+// The checked groups are merged with one click, as hard links or as reflinks. Deletes itself
+// when closed.
+class DuplicatesDialog : public QDialog {
+    Q_OBJECT
+
+   public:
+    explicit DuplicatesDialog(const QStringList& roots, QWidget* parent = nullptr);
+    ~DuplicatesDialog() override;
+
+   protected:
+    void reject() override;
+
+   private:
+    void search();
+    void onSearched();
+    void merge(DupFinder::Method method);
+    void onMerged();
+    void showGroups();
+    void setBusy(bool busy);
+
+    QStringList roots_;
+    // written by the worker while watcher_ runs, read once it has finished
+    std::vector<DupFinder::Group> groups_;
+    FsOps::Error error_;
+    std::vector<DupFinder::DedupResult> mergeResults_;
+    std::vector<std::size_t> merging_;  // indices into groups_
+    QFutureWatcher<void> watcher_;
+    std::atomic<bool> cancel_;
+
+    QLabel* statusLabel_;
+    QProgressBar* progressBar_;
+    QTreeWidget* tree_;
+    QPushButton* hardlinkButton_;
+    QPushButton* reflinkButton_;
+    QPushButton* rescanButton_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_DUPLICATESDIALOG_H
@@ -0,0 +1,420 @@
+/*
+ * Window comparing the folders of the two panes and syncing them
+ * src/ui/foldercomparedialog.cpp
+ */
+
+#include "foldercomparedialog.h"
+
+#include <QBrush>
+#include <QComboBox>
+#include <QDateTime>
+#include <QDialogButtonBox>
+#include <QFile>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QMessageBox>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QtConcurrent>
+
+#include <cerrno>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "../../pcmanfm/tabpage.h"
+#include "../core/backend_registry.h"
+
+namespace PCManFM {
+
+namespace {
+
+enum Column {
+    PathColumn,
+    StateColumn,
+    LeftSizeColumn,
+    LeftModifiedColumn,
+    RightSizeColumn,
+    RightModifiedColumn,
+    NumColumns
+};
+
+QString displayPath(const std::string& path) {
+    return QFile::decodeName(QByteArray(path.data(), static_cast<int>(path.size())));
+}
+
+QString formatSize(const DirCompare::Side& side) {
+    return side.kind == DirCompare::Kind::File ? QLocale().formattedDataSize(static_cast<qint64>(side.size))
+                                               : QString();
+}
+
+QString formatTime(const DirCompare::Side& side) {
+    return side.kind == DirCompare::Kind::Missing
+               ? QString()
+               : QLocale().toString(QDateTime::fromSecsSinceEpoch(side.mtimeSec), QLocale::ShortFormat);
+}
+
+QString stateText(DirCompare::State state) {
+    switch (state) {
+        case DirCompare::State::Same:
+            break;
+        case DirCompare::State::LeftNewer:
+            return FolderCompareDialog::tr("Newer on the left");
+        case DirCompare::State::RightNewer:
+            return FolderCompareDialog::tr("Newer on the right");
+        case DirCompare::State::LeftOnly:
+            return FolderCompareDialog::tr("Only on the left");
+        case DirCompare::State::RightOnly:
+            return FolderCompareDialog::tr("Only on the right");
+        case DirCompare::State::ContentDiffers:
+            return FolderCompareDialog::tr("Content differs");
+        case DirCompare::State::KindDiffers:
+            return FolderCompareDialog::tr("Kind differs");
+    }
+    return QString();
+}
+
+// Translucent, so that the tints read on light and dark themes alike.
+QBrush onlyHereBrush() {
+    return QColor(60, 180, 75, 70);
+}
+QBrush newerHereBrush() {
+    return QColor(0, 130, 200, 70);
+}
+QBrush olderHereBrush() {
+    return QColor(245, 130, 48, 70);
+}
+QBrush conflictBrush() {
+    return QColor(230, 25, 75, 70);
+}
+QBrush containsDifferencesBrush() {
+    return QColor(255, 225, 25, 70);
+}
+
+// Copy requests putting |paths|, relative to |from|, at the same place under |to|; one per
+// parent folder, since a copy request has a single destination.
+std::vector<FileOpRequest> copyRequests(const std::vector<std::string>& paths, const QString& from, const QString& to) {
+    std::map<QString, QStringList> byParent;
+    for (const std::string& path : paths) {
+        const QString relative = displayPath(path);
+        const int slash = relative.lastIndexOf(QLatin1Char('/'));
+        byParent[slash < 0 ? QString() : relative.left(slash)] << from + QLatin1Char('/') + relative;
+    }
+    std::vector<FileOpRequest> requests;
+    for (auto& parent : byParent) {
+        FileOpRequest req;
+        req.type = FileOpType::Copy;
+        req.sources = std::move(parent.second);
+        req.destination = parent.first.isEmpty() ? to : to + QLatin1Char('/') + parent.first;
+        req.followSymlinks = false;
+        req.overwriteExisting = true;
+        requests.push_back(std::move(req));
+    }
+    return requests;
+}
+
+}  // namespace
+
+FolderCompareDialog::FolderCompareDialog(TabPage* left, TabPage* right, QWidget* parent)
+    : QDialog(parent),
+      leftPage_{left},
+      rightPage_{right},
+      leftRoot_{QFile::decodeName(left->path().localPath().get())},
+      rightRoot_{QFile::decodeName(right->path().localPath().get())},
+      cancel_{false} {
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(tr("Compare %1 and %2").arg(QFileInfo(leftRoot_).fileName(), QFileInfo(rightRoot_).fileName()));
+    resize(900, 550);
+
+    auto* layout = new QVBoxLayout(this);
+    auto* rootsLabel = new QLabel(tr("Left: %1\nRight: %2").arg(leftRoot_, rightRoot_), this);
+    rootsLabel->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    layout->addWidget(rootsLabel);
+
+    auto* modeLayout = new QHBoxLayout();
+    modeLayout->addWidget(new QLabel(tr("Compare files by:"), this));
+    contentCombo_ = new QComboBox(this);
+    contentCombo_->addItem(tr("Size and modification time"), static_cast<int>(DirCompare::Content::Metadata));
+    contentCombo_->addItem(tr("Content when the times differ"),
+                           static_cast<int>(DirCompare::Content::HashWhenUnsure));
+    contentCombo_->addItem(tr("Content of all files (slow)"), static_cast<int>(DirCompare::Content::HashAll));
+    modeLayout->addWidget(contentCombo_, 1);
+    compareButton_ = new QPushButton(tr("&Compare"), this);
+    modeLayout->addWidget(compareButton_);
+    layout->addLayout(modeLayout);
+
+    statusLabel_ = new QLabel(this);
+    layout->addWidget(statusLabel_);
+    progressBar_ = new QProgressBar(this);
+    layout->addWidget(progressBar_);
+
+    tree_ = new QTreeWidget(this);
+    tree_->setColumnCount(NumColumns);
+    tree_->setHeaderLabels(
+        {tr("Path"), tr("State"), tr("Left Size"), tr("Left Modified"), tr("Right Size"), tr("Right Modified")});
+    tree_->header()->setSectionResizeMode(PathColumn, QHeaderView::Stretch);
+    tree_->header()->setStretchLastSection(false);
+    tree_->setRootIsDecorated(false);
+    tree_->setUniformRowHeights(true);
+    tree_->setSortingEnabled(true);
+    layout->addWidget(tree_, 1);
+
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+    toRightButton_ = buttons->addButton(tr("Copy to &Right"), QDialogButtonBox::ActionRole);
+    toRightButton_->setToolTip(tr("Copies what is missing or newer on the left over to the right"));
+    toLeftButton_ = buttons->addButton(tr("Copy to &Left"), QDialogButtonBox::ActionRole);
+    toLeftButton_->setToolTip(tr("Copies what is missing or newer on the right over to the left"));
+    bothButton_ = buttons->addButton(tr("Sync &Both Ways"), QDialogButtonBox::ActionRole);
+    bothButton_->setToolTip(tr("Copies the newer side of every difference over the older one; nothing is deleted"));
+    layout->addWidget(buttons);
+
+    connect(buttons, &QDialogButtonBox::rejected, this, &FolderCompareDialog::reject);
+    connect(compareButton_, &QPushButton::clicked, this, &FolderCompareDialog::compare);
+    connect(toRightButton_, &QPushButton::clicked, this, [this] { sync(DirCompare::Direction::LeftToRight); });
+    connect(toLeftButton_, &QPushButton::clicked, this, [this] { sync(DirCompare::Direction::RightToLeft); });
+    connect(bothButton_, &QPushButton::clicked, this, [this] { sync(DirCompare::Direction::Both); });
+    connect(&watcher_, &QFutureWatcher<void>::finished, this, &FolderCompareDialog::onCompared);
+    connect(&BackendRegistry::fileOpScheduler(), &FileOpScheduler::jobFinished, this,
+            [this](FileOpScheduler::JobId id, bool success, const QString& errorMessage) {
+                if (!pendingJobs_.remove(id)) {
+                    return;
+                }
+                if (!success && !errorMessage.isEmpty()) {
+                    jobErrors_ << errorMessage;
+                }
+                if (pendingJobs_.isEmpty()) {
+                    if (!jobErrors_.isEmpty()) {
+                        QMessageBox box(QMessageBox::Warning, tr("Sync"), tr("Some files were not copied."),
+                                        QMessageBox::Ok, this);
+                        box.setDetailedText(jobErrors_.join(QLatin1Char('\n')));
+                        box.exec();
+                    }
+                    compare();
+                }
+            });
+
+    compare();
+}
+
+FolderCompareDialog::~FolderCompareDialog() {
+    // the worker reports to this window; it stops at the next directory or batch of files
+    cancel_.store(true, std::memory_order_relaxed);
+    watcher_.waitForFinished();
+    clearHighlights();
+}
+
+void FolderCompareDialog::reject() {
+    if (watcher_.isRunning()) {
+        cancel_.store(true, std::memory_order_relaxed);
+    }
+    QDialog::reject();
+}
+
+void FolderCompareDialog::setBusy(bool busy) {
+    const bool syncing = !pendingJobs_.isEmpty();
+    const bool idle = !busy && !syncing;
+    progressBar_->setVisible(busy || syncing);
+    compareButton_->setEnabled(idle);
+    contentCombo_->setEnabled(idle);
+    toRightButton_->setEnabled(idle && !result_.entries.empty());
+    toLeftButton_->setEnabled(idle && !result_.entries.empty());
+    bothButton_->setEnabled(idle && !result_.entries.empty());
+}
+
+void FolderCompareDialog::compare() {
+    cancel_.store(false, std::memory_order_relaxed);
+    result_ = DirCompare::Result{};
+    error_ = {};
+    tree_->clear();
+    progressBar_->setRange(0, 0);
+    statusLabel_->setText(tr("Comparing the folders…"));
+    setBusy(true);
+
+    DirCompare::Options options;
+    options.content = static_cast<DirCompare::Content>(contentCombo_->currentData().toInt());
+    const std::string left = QFile::encodeName(leftRoot_).toStdString();
+    const std::string right = QFile::encodeName(rightRoot_).toStdString();
+    watcher_.setFuture(QtConcurrent::run([this, options, left, right] {
+        auto progress = [this](std::uint64_t done, std::uint64_t total) {
+            if (cancel_.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            QMetaObject::invokeMethod(
+                this,
+                [this, done, total] {
+                    if (total > 0) {
+                        statusLabel_->setText(tr("Comparing the content of the files…"));
+                        // in permille, as the counts may not fit an int
+                        progressBar_->setRange(0, 1000);
+                        progressBar_->setValue(static_cast<int>(done * 1000 / total));
+                    }
+                    else {
+                        statusLabel_->setText(
+                            tr("Comparing the folders… %n compared", nullptr, static_cast<int>(done)));
+                        progressBar_->setRange(0, 0);
+                    }
+                },
+                Qt::QueuedConnection);
+            return true;
+        };
+        DirCompare::compare(left, right, options, progress, result_, error_);
+    }));
+}
+
+void FolderCompareDialog::onCompared() {
+    setBusy(false);
+    if (error_.isSet()) {
+        statusLabel_->setText(error_.code == ECANCELED ? tr("The comparison was cancelled.")
+                                                       : tr("The comparison failed: %1")
+                                                             .arg(QString::fromLocal8Bit(error_.message.c_str())));
+        clearHighlights();
+        return;
+    }
+    showResult();
+    highlightPanes();
+}
+
+void FolderCompareDialog::showResult() {
+    tree_->setSortingEnabled(false);
+    tree_->clear();
+    QList<QTreeWidgetItem*> items;
+    for (const DirCompare::Entry& entry : result_.entries) {
+        auto* item = new QTreeWidgetItem();
+        item->setText(PathColumn, displayPath(entry.path));
+        item->setText(StateColumn, stateText(entry.state));
+        item->setText(LeftSizeColumn, formatSize(entry.left));
+        item->setText(LeftModifiedColumn, formatTime(entry.left));
+        item->setText(RightSizeColumn, formatSize(entry.right));
+        item->setText(RightModifiedColumn, formatTime(entry.right));
+        item->setTextAlignment(LeftSizeColumn, Qt::AlignRight | Qt::AlignVCenter);
+        item->setTextAlignment(RightSizeColumn, Qt::AlignRight | Qt::AlignVCenter);
+        items << item;
+    }
+    tree_->addTopLevelItems(items);
+    tree_->setSortingEnabled(true);
+    tree_->sortByColumn(PathColumn, Qt::AscendingOrder);
+    tree_->resizeColumnToContents(StateColumn);
+
+    QString summary = result_.entries.empty()
+                          ? tr("The folders are the same.")
+                          : tr("%n differences, %1 files or folders the same.", nullptr,
+                               static_cast<int>(result_.entries.size()))
+                                .arg(result_.sameCount);
+    if (!result_.errors.empty()) {
+        summary += QLatin1Char(' ') + tr("%n could not be read.", nullptr, static_cast<int>(result_.errors.size()));
+    }
+    statusLabel_->setText(summary);
+    setBusy(false);
+}
+
+// Only the top level of each pane is tinted: an entry there is either a difference itself
+// or a folder that holds some.
+void FolderCompareDialog::highlightPanes() {
+    std::unordered_map<std::string, QBrush> left;
+    std::unordered_map<std::string, QBrush> right;
+    for (const DirCompare::Entry& entry : result_.entries) {
+        const std::size_t slash = entry.path.find('/');
+        if (slash != std::string::npos) {
+            const std::string top = entry.path.substr(0, slash);
+            left.emplace(top, containsDifferencesBrush());
+            right.emplace(top, containsDifferencesBrush());
+            continue;
+        }
+        switch (entry.state) {
+            case DirCompare::State::Same:
+                break;
+            case DirCompare::State::LeftNewer:
+                left[entry.path] = newerHereBrush();
+                right[entry.path] = olderHereBrush();
+                break;
+            case DirCompare::State::RightNewer:
+                left[entry.path] = olderHereBrush();
+                right[entry.path] = newerHereBrush();
+                break;
+            case DirCompare::State::LeftOnly:
+                left[entry.path] = onlyHereBrush();
+                break;
+            case DirCompare::State::RightOnly:
+                right[entry.path] = onlyHereBrush();
+                break;
+            case DirCompare::State::ContentDiffers:
+            case DirCompare::State::KindDiffers:
+                left[entry.path] = conflictBrush();
+                right[entry.path] = conflictBrush();
+                break;
+        }
+    }
+    // a page that has moved on to another folder is not tinted
+    if (leftPage_ && QFile::decodeName(leftPage_->path().localPath().get()) == leftRoot_) {
+        leftPage_->setHighlights(std::move(left));
+    }
+    if (rightPage_ && QFile::decodeName(rightPage_->path().localPath().get()) == rightRoot_) {
+        rightPage_->setHighlights(std::move(right));
+    }
+}
+
+void FolderCompareDialog::clearHighlights() {
+    if (leftPage_) {
+        leftPage_->setHighlights({});
+    }
+    if (rightPage_) {
+        rightPage_->setHighlights({});
+    }
+}
+
+void FolderCompareDialog::sync(DirCompare::Direction direction) {
+    const DirCompare::SyncPlan plan = DirCompare::plan_sync(result_, direction);
+    if (plan.toRight.empty() && plan.toLeft.empty()) {
+        QMessageBox::information(this, tr("Sync"), tr("There is nothing to copy."));
+        return;
+    }
+
+    QStringList lines;
+    if (!plan.toRight.empty()) {
+        lines << tr("%n items (%1) will be copied to the right.", nullptr, static_cast<int>(plan.toRight.size()))
+                     .arg(QLocale().formattedDataSize(static_cast<qint64>(plan.bytesToRight)));
+    }
+    if (!plan.toLeft.empty()) {
+        lines << tr("%n items (%1) will be copied to the left.", nullptr, static_cast<int>(plan.toLeft.size()))
+                     .arg(QLocale().formattedDataSize(static_cast<qint64>(plan.bytesToLeft)));
+    }
+    lines << tr("Files they replace are overwritten; nothing is deleted.");
+    QMessageBox box(QMessageBox::Question, tr("Sync"), lines.join(QLatin1Char('\n')),
+                    QMessageBox::Ok | QMessageBox::Cancel, this);
+    if (!plan.conflicts.empty()) {
+        box.setInformativeText(tr("%n conflicts are left alone.", nullptr, static_cast<int>(plan.conflicts.size())));
+        QStringList conflicts;
+        for (const std::string& path : plan.conflicts) {
+            conflicts << displayPath(path);
+        }
+        box.setDetailedText(conflicts.join(QLatin1Char('\n')));
+    }
+    if (box.exec() != QMessageBox::Ok) {
+        return;
+    }
+
+    jobErrors_.clear();
+    std::vector<FileOpRequest> requests = copyRequests(plan.toRight, leftRoot_, rightRoot_);
+    for (FileOpRequest& req : copyRequests(plan.toLeft, rightRoot_, leftRoot_)) {
+        requests.push_back(std::move(req));
+    }
+    for (const FileOpRequest& req : requests) {
+        if (const FileOpScheduler::JobId id = BackendRegistry::scheduleFileOp(req)) {
+            pendingJobs_.insert(id);
+        }
+    }
+    if (pendingJobs_.isEmpty()) {
+        QMessageBox::warning(this, tr("Sync"), tr("File operations backend is not available."));
+        return;
+    }
+    statusLabel_->setText(tr("Copying… %n jobs queued", nullptr, pendingJobs_.size()));
+    progressBar_->setRange(0, 0);
+    setBusy(false);
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,76 @@
+/*
+ * Window comparing the folders of the two panes and syncing them
+ * src/ui/foldercomparedialog.h
+ */
+
+#ifndef PCMANFM_FOLDERCOMPAREDIALOG_H
+#define PCMANFM_FOLDERCOMPAREDIALOG_H
+
+#include <QDialog>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QSet>
+#include <QString>
+
+#include <atomic>
+
+#include "../core/dir_compare.h"
+
+class QComboBox;
+class QLabel;
+class QProgressBar;
+class QPushButton;
+class QTreeWidget;
+
+namespace PCManFM {
+
+class TabPage;
+
+// Runs DirCompare::compare() on the folders shown by two panes off the GUI thread and lists
+// the differences, tinting the differing files in both panes as well. The sync buttons copy
+// over the other side what DirCompare::plan_sync() picks, as ordinary scheduled copy jobs,
+// and compare again once they are done. Deletes itself when closed.
+class FolderCompareDialog : public QDialog {
+    Q_OBJECT
+
+   public:
+    FolderCompareDialog(TabPage* left, TabPage* right, QWidget* parent = nullptr);
+    ~FolderCompareDialog() override;
+
+   protected:
+    void reject() override;
+
+   private:
+    void compare();
+    void onCompared();
+    void showResult();
+    void highlightPanes();
+    void clearHighlights();
+    void sync(DirCompare::Direction direction);
+    void setBusy(bool busy);
+
+    QPointer<TabPage> leftPage_;
+    QPointer<TabPage> rightPage_;
+    QString leftRoot_;
+    QString rightRoot_;
+    // written by the worker while watcher_ runs, read once it has finished
+    DirCompare::Result result_;
+    FsOps::Error error_;
+    QFutureWatcher<void> watcher_;
+    std::atomic<bool> cancel_;
+    QSet<quint64> pendingJobs_;  // copy jobs of the last sync still queued or running
+    QStringList jobErrors_;
+
+    QLabel* statusLabel_;
+    QProgressBar* progressBar_;
+    QComboBox* contentCombo_;
+    QTreeWidget* tree_;
+    QPushButton* compareButton_;
+    QPushButton* toRightButton_;
+    QPushButton* toLeftButton_;
+    QPushButton* bothButton_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_FOLDERCOMPAREDIALOG_H
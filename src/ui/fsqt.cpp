@@ -24,6 +24,15 @@ QString errorToQString(const FsOps::Error& err) {
 
 bool readFile(const QString& path, QByteArray& out, QString& errorOut) {
     FsOps::Error err;
+    // Copy straight out of the page cache when the file can be mapped. Zero-sized files may
+    // still have content (procfs), so those go through the read loop.
+    FsOps::MappedFile mapped;
+    if (mapped.open(toNative(path), err) && mapped.size() > 0) {
+        errorOut.clear();
+        out = QByteArray(reinterpret_cast<const char*>(mapped.data()), static_cast<qsizetype>(mapped.size()));
+        return true;
+    }
+
     std::vector<std::uint8_t> data;
     const bool ok = FsOps::read_file_all(toNative(path), data, err);
     errorOut = errorToQString(err);
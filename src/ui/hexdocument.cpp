@@ -5,6 +5,10 @@
 
 #include "hexdocument.h"
 
+#include "../core/byte_search.h"
+#include "../core/mapped_file_registry.h"
+#include "../panel/panel.h"
+
 #include <QFile>
 #include <QFileInfo>
 
@@ -15,6 +19,7 @@
 #include <cstddef>
 #include <string>
 #include <exception>
+#include <utility>
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -47,10 +52,27 @@ bool writeAll(int fd, const char* data, std::size_t size, QString& errorOut) {
 
 }  // namespace
 
-HexDocument::HexDocument(QObject* parent) : QObject(parent) {}
+HexDocument::HexDocument(QObject* parent) : QObject(parent) {
+    // every change of the buffers is followed by changed()
+    connect(this, &HexDocument::changed, this, &HexDocument::accountMemory);
+}
 
 HexDocument::~HexDocument() {
     closeDescriptor(sourceFd_);
+    Panel::MemoryStats::account(Panel::MemoryStats::HexDocuments, accountedBytes_, 0);
+}
+
+void HexDocument::accountMemory() {
+    if (!Panel::MemoryStats::isEnabled()) {
+        return;
+    }
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    // a piece with its node in the tree
+    constexpr std::int64_t pieceBytes = sizeof(Segment) + 16;
+    const std::int64_t bytes = static_cast<std::int64_t>(addedBuffer_.residentBytes()) +
+                               static_cast<std::int64_t>(history_.residentBytes()) +
+                               static_cast<std::int64_t>(segments_.pieceCount()) * pieceBytes;
+    Panel::MemoryStats::account(Panel::MemoryStats::HexDocuments, accountedBytes_, bytes);
 }
 
 bool HexDocument::loadStat(const QString& path, FileStat& st, QString& errorOut) const {
@@ -94,8 +116,7 @@ bool HexDocument::openFile(const QString& path, QString& errorOut) {
     closeDescriptor(sourceFd_);
     segments_.clear();
     addedBuffer_.clear();
-    undoStack_.clear();
-    redoStack_.clear();
+    history_.clear();
     totalSize_ = 0;
     dirty_ = false;
     reader_.reset();
@@ -114,14 +135,22 @@ bool HexDocument::openFile(const QString& path, QString& errorOut) {
         return false;
     }
 
+    bool recovered = false;
+    if (!recoverInterruptedSave(path, recovered, errorOut)) {
+        return false;
+    }
+    if (recovered && !loadStat(path, st, errorOut)) {
+        return false;
+    }
+
     int fd = -1;
     if (!openDescriptor(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW, fd, errorOut)) {
         return false;
     }
 
     std::string readerErr;
-    reader_ = std::make_unique<WindowedFileReader>(path.toStdString(), kReadWindowSize, &readerErr);
-    if (!reader_ || !reader_->valid()) {
+    reader_ = MappedFileRegistry::instance().open(QFile::encodeName(path).toStdString(), readerErr);
+    if (!reader_) {
         errorOut = QString::fromLocal8Bit(readerErr.c_str());
         ::close(fd);
         reader_.reset();
@@ -135,53 +164,13 @@ bool HexDocument::openFile(const QString& path, QString& errorOut) {
     totalSize_ = st.size;
     isRegular_ = S_ISREG(st.mode);
 
-    if (totalSize_ > 0) {
-        Segment seg;
-        seg.kind = Segment::Kind::Original;
-        seg.sourceOffset = 0;
-        seg.length = totalSize_;
-        segments_.push_back(seg);
-    }
+    segments_.reset(totalSize_);
 
     lock.unlock();
     Q_EMIT changed();
     return true;
 }
 
-bool HexDocument::ensureSplit(std::uint64_t offset, std::size_t& index, QString& errorOut) {
-    if (offset > totalSize_) {
-        errorOut = tr("Offset %1 is past the end of the file.").arg(offset);
-        return false;
-    }
-
-    std::uint64_t pos = 0;
-    for (std::size_t i = 0; i < segments_.size(); ++i) {
-        const Segment& seg = segments_[i];
-        if (offset == pos) {
-            index = i;
-            return true;
-        }
-        if (offset < pos + seg.length) {
-            // Split the segment
-            const std::uint64_t leftLen = offset - pos;
-            const std::uint64_t rightLen = seg.length - leftLen;
-            Segment left = seg;
-            Segment right = seg;
-            left.length = leftLen;
-            right.sourceOffset += leftLen;
-            right.length = rightLen;
-            segments_[i] = left;
-            segments_.insert(segments_.begin() + static_cast<std::ptrdiff_t>(i + 1), right);
-            index = i + 1;
-            return true;
-        }
-        pos += seg.length;
-    }
-
-    index = segments_.size();
-    return true;
-}
-
 bool HexDocument::replaceRange(std::uint64_t offset,
                                std::uint64_t length,
                                const std::vector<Segment>& replacement,
@@ -190,56 +179,20 @@ bool HexDocument::replaceRange(std::uint64_t offset,
         errorOut = tr("Offset %1 is past the end of the file.").arg(offset);
         return false;
     }
-    if (offset + length > totalSize_) {
-        length = totalSize_ - offset;
-    }
 
-    std::size_t startIdx = 0;
-    std::size_t endIdx = 0;
-    if (!ensureSplit(offset, startIdx, errorOut)) {
-        return false;
-    }
-    if (!ensureSplit(offset + length, endIdx, errorOut)) {
-        return false;
-    }
-
-    segments_.erase(segments_.begin() + static_cast<std::ptrdiff_t>(startIdx),
-                    segments_.begin() + static_cast<std::ptrdiff_t>(endIdx));
-    segments_.insert(segments_.begin() + static_cast<std::ptrdiff_t>(startIdx), replacement.begin(), replacement.end());
-
-    // Merge adjacent compatible segments to keep the list small
-    std::vector<Segment> merged;
-    merged.reserve(segments_.size());
-    for (const auto& seg : segments_) {
-        if (seg.length == 0) {
-            continue;
-        }
-        if (!merged.empty()) {
-            Segment& back = merged.back();
-            if (back.kind == seg.kind) {
-                const std::uint64_t backEnd = back.sourceOffset + back.length;
-                if (backEnd == seg.sourceOffset) {
-                    back.length += seg.length;
-                    continue;
-                }
-            }
-        }
-        merged.push_back(seg);
-    }
-    segments_.swap(merged);
-
-    std::uint64_t newSize = 0;
-    for (const auto& seg : segments_) {
-        newSize += seg.length;
-    }
-    totalSize_ = newSize;
+    // The tree clamps the range, drops empty pieces and merges adjacent compatible ones.
+    segments_.replace(offset, length, replacement);
+    totalSize_ = segments_.size();
     return true;
 }
 
 bool HexDocument::appendAddedData(const QByteArray& data, std::uint64_t& startOffset, QString& errorOut) {
-    Q_UNUSED(errorOut);
-    startOffset = static_cast<std::uint64_t>(addedBuffer_.size());
-    addedBuffer_.append(data);
+    std::string err;
+    if (!addedBuffer_.append(reinterpret_cast<const std::uint8_t*>(data.constData()),
+                             static_cast<std::size_t>(data.size()), startOffset, err)) {
+        errorOut = tr("Cannot store the new bytes: %1").arg(QString::fromLocal8Bit(err.c_str()));
+        return false;
+    }
     return true;
 }
 
@@ -275,18 +228,160 @@ bool HexDocument::readOriginalUnlocked(std::uint64_t offset,
     return true;
 }
 
-bool HexDocument::readFromSegments(std::uint64_t offset,
-                                   std::uint64_t length,
-                                   QByteArray& out,
-                                   QString& errorOut) const {
-    std::vector<bool> modified;
-    return readBytesWithMarkersUnlocked(offset, length, out, modified, errorOut);
+// Copies logical bytes straight into |dest|, without the per-piece buffers of
+// readBytesUnlocked(); used by the search paths and snapshots.
+bool HexDocument::copyLogical(const PieceTree& segments,
+                              const AddedStore::View& added,
+                              const WindowedFileReader* reader,
+                              std::uint64_t offset,
+                              std::size_t length,
+                              std::uint8_t* dest,
+                              std::size_t& copied,
+                              QString& errorOut) {
+    copied = 0;
+    for (auto it = segments.seek(offset); it.valid() && copied < length; it.next()) {
+        const Segment& seg = it.piece();
+        const std::uint64_t localStart = offset + copied - it.start();
+        const std::size_t toCopy =
+            static_cast<std::size_t>(std::min<std::uint64_t>(seg.length - localStart, length - copied));
+        if (seg.kind == Segment::Kind::Original) {
+            if (!reader) {
+                errorOut = tr("File reader is not available.");
+                return false;
+            }
+            std::size_t bytesRead = 0;
+            std::string err;
+            if (!reader->read(seg.sourceOffset + localStart, toCopy, dest + copied, bytesRead, err)) {
+                errorOut = QString::fromLocal8Bit(err.c_str());
+                return false;
+            }
+            copied += bytesRead;
+            if (bytesRead < toCopy) {
+                break;  // file shrank underneath us
+            }
+        }
+        else {
+            added.copy(seg.sourceOffset + localStart, toCopy, dest + copied);
+            copied += toCopy;
+        }
+    }
+    return true;
+}
+
+bool HexDocument::copyLogicalUnlocked(std::uint64_t offset,
+                                      std::size_t length,
+                                      std::uint8_t* dest,
+                                      std::size_t& copied,
+                                      QString& errorOut) const {
+    return copyLogical(segments_, addedBuffer_.view(), reader_.get(), offset, length, dest, copied, errorOut);
+}
+
+std::shared_ptr<const HexDocument::Snapshot> HexDocument::snapshot() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto snap = std::make_shared<Snapshot>();
+    snap->segments_ = segments_;
+    snap->added_ = addedBuffer_.view();
+    snap->reader_ = reader_;
+    snap->size_ = totalSize_;
+    return snap;
+}
+
+bool HexDocument::Snapshot::read(std::uint64_t offset,
+                                 std::size_t length,
+                                 std::uint8_t* dest,
+                                 std::size_t& copied,
+                                 QString& errorOut) const {
+    return copyLogical(segments_, added_, reader_.get(), offset, length, dest, copied, errorOut);
+}
+
+bool HexDocument::Snapshot::findForward(const QByteArray& needle,
+                                        std::uint64_t startOffset,
+                                        std::size_t maxHits,
+                                        std::vector<std::uint64_t>& hits,
+                                        const SearchProgress& progress,
+                                        QString& errorOut) const {
+    return scanForward([this](std::uint64_t offset, std::size_t length, std::uint8_t* dest, std::size_t& copied,
+                              QString& err) { return read(offset, length, dest, copied, err); },
+                       size_, needle, startOffset, maxHits, hits, progress, errorOut);
+}
+
+bool HexDocument::Snapshot::findBackward(const QByteArray& needle,
+                                         std::uint64_t startOffset,
+                                         std::uint64_t& foundOffset,
+                                         const SearchProgress& progress,
+                                         QString& errorOut) const {
+    return scanBackward([this](std::uint64_t offset, std::size_t length, std::uint8_t* dest, std::size_t& copied,
+                               QString& err) { return read(offset, length, dest, copied, err); },
+                        size_, needle, startOffset, foundOffset, progress, errorOut);
+}
+
+void HexDocument::Lease::release() {
+    windows_.clear();
+    added_.reset();
+    runs_.clear();
+    size_ = 0;
+}
+
+bool HexDocument::borrow(std::uint64_t offset, std::uint64_t length, Lease& out, QString& errorOut) const {
+    out.release();
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (offset >= totalSize_) {
+        return true;
+    }
+    length = std::min(length, totalSize_ - offset);
+    out.added_ = addedBuffer_.view();
+
+    for (auto it = segments_.seek(offset); it.valid() && out.size_ < length; it.next()) {
+        const Segment& seg = it.piece();
+        const std::uint64_t localStart = offset + out.size_ - it.start();
+        std::uint64_t want = std::min<std::uint64_t>(seg.length - localStart, length - out.size_);
+        if (seg.kind == Segment::Kind::Added) {
+            // one run per chunk of the store the piece lies in
+            std::uint64_t source = seg.sourceOffset + localStart;
+            while (want > 0) {
+                std::size_t available = 0;
+                const std::uint8_t* data = out.added_.span(source, static_cast<std::size_t>(want), available);
+                if (available == 0) {
+                    break;
+                }
+                out.runs_.push_back(Run{data, available, true});
+                out.size_ += available;
+                source += available;
+                want -= available;
+            }
+            continue;
+        }
+        if (!reader_) {
+            errorOut = tr("File reader is not available.");
+            out.release();
+            return false;
+        }
+        // An original piece can span several reader windows.
+        std::uint64_t source = seg.sourceOffset + localStart;
+        while (want > 0) {
+            WindowedFileReader::Lease window;
+            std::string err;
+            if (!reader_->borrow(source, static_cast<std::size_t>(want), window, err)) {
+                errorOut = QString::fromLocal8Bit(err.c_str());
+                out.release();
+                return false;
+            }
+            if (window.empty()) {
+                return true;  // file shrank underneath us
+            }
+            out.runs_.push_back(Run{window.data(), window.size(), false});
+            out.size_ += window.size();
+            source += window.size();
+            want -= window.size();
+            out.windows_.push_back(std::move(window));
+        }
+    }
+    return true;
 }
 
 bool HexDocument::readBytes(std::uint64_t offset, std::uint64_t length, QByteArray& out, QString& errorOut) const {
     std::shared_lock<std::shared_mutex> lock(mutex_);
-    std::vector<bool> modified;
-    return readBytesWithMarkersUnlocked(offset, length, out, modified, errorOut);
+    return readBytesUnlocked(offset, length, out, errorOut);
 }
 
 bool HexDocument::hasExternalChange(bool& changed, QString& errorOut) const {
@@ -301,6 +396,10 @@ bool HexDocument::hasExternalChange(bool& changed, QString& errorOut) const {
     }
     changed = st.dev != initialStat_.dev || st.ino != initialStat_.ino || st.size != initialStat_.size ||
               st.mtimeSec != initialStat_.mtimeSec || st.mtimeNsec != initialStat_.mtimeNsec;
+    if (changed) {
+        // Other viewers of the old file must not be handed its mapping any more.
+        MappedFileRegistry::instance().invalidate(initialStat_.dev, initialStat_.ino);
+    }
     return true;
 }
 
@@ -336,17 +435,21 @@ bool HexDocument::reload(QString& errorOut) {
 bool HexDocument::readBytesWithMarkers(std::uint64_t offset,
                                        std::uint64_t length,
                                        QByteArray& out,
-                                       std::vector<bool>& modified,
+                                       std::vector<ModifiedRange>& modified,
                                        QString& errorOut) const {
     std::shared_lock<std::shared_mutex> lock(mutex_);
-    return readBytesWithMarkersUnlocked(offset, length, out, modified, errorOut);
+    modified.clear();
+    if (!readBytesUnlocked(offset, length, out, errorOut)) {
+        return false;
+    }
+    segments_.addedRanges(offset, static_cast<std::uint64_t>(out.size()), modified);
+    return true;
 }
 
-bool HexDocument::readBytesWithMarkersUnlocked(std::uint64_t offset,
-                                               std::uint64_t length,
-                                               QByteArray& out,
-                                               std::vector<bool>& modified,
-                                               QString& errorOut) const {
+bool HexDocument::readBytesUnlocked(std::uint64_t offset,
+                                    std::uint64_t length,
+                                    QByteArray& out,
+                                    QString& errorOut) const {
     if (offset >= totalSize_) {
         out.clear();
         return true;
@@ -357,16 +460,10 @@ bool HexDocument::readBytesWithMarkersUnlocked(std::uint64_t offset,
     }
     out.resize(static_cast<int>(length));
 
-    modified.assign(static_cast<std::size_t>(length), false);
-
-    std::uint64_t pos = 0;
     std::size_t outPos = 0;
-    for (const auto& seg : segments_) {
-        if (offset >= pos + seg.length) {
-            pos += seg.length;
-            continue;
-        }
-
+    for (auto it = segments_.seek(offset); it.valid(); it.next()) {
+        const Segment& seg = it.piece();
+        const std::uint64_t pos = it.start();
         const std::uint64_t localStart = offset > pos ? offset - pos : 0;
         const std::uint64_t avail = seg.length - localStart;
         const std::uint64_t toCopy = std::min<std::uint64_t>(avail, length - outPos);
@@ -379,101 +476,57 @@ bool HexDocument::readBytesWithMarkersUnlocked(std::uint64_t offset,
             std::memcpy(out.data() + static_cast<int>(outPos), chunk.constData(), static_cast<std::size_t>(toCopy));
         }
         else {
-            const std::uint64_t start = seg.sourceOffset + localStart;
-            std::memcpy(out.data() + static_cast<int>(outPos), addedBuffer_.constData() + start,
-                        static_cast<std::size_t>(toCopy));
-            std::fill(modified.begin() + static_cast<std::ptrdiff_t>(outPos),
-                      modified.begin() + static_cast<std::ptrdiff_t>(outPos + toCopy), true);
+            addedBuffer_.copy(seg.sourceOffset + localStart, static_cast<std::size_t>(toCopy),
+                              reinterpret_cast<std::uint8_t*>(out.data()) + outPos);
         }
 
         outPos += static_cast<std::size_t>(toCopy);
         if (outPos >= length) {
             break;
         }
-        pos += seg.length;
     }
 
     if (outPos < length) {
         out.truncate(static_cast<int>(outPos));
-        modified.resize(outPos);
     }
     return true;
 }
 
-bool HexDocument::applyOperation(const Operation& op, bool recordUndo, QString& errorOut, bool clearRedo) {
-    std::uint64_t removeLen = 0;
-    QByteArray replacement;
-
-    switch (op.type) {
-        case OperationType::Insert:
-            removeLen = 0;
-            replacement = op.newData;
-            break;
-        case OperationType::Delete:
-            removeLen = op.oldData.size();
-            replacement.clear();
-            break;
-        case OperationType::Overwrite:
-            removeLen = op.oldData.size();
-            replacement = op.newData;
-            break;
-    }
-
-    std::vector<Segment> repl;
-    if (!replacement.isEmpty()) {
-        std::uint64_t addedOffset = 0;
-        if (!appendAddedData(replacement, addedOffset, errorOut)) {
-            return false;
-        }
-        Segment seg;
-        seg.kind = Segment::Kind::Added;
-        seg.sourceOffset = addedOffset;
-        seg.length = static_cast<std::uint64_t>(replacement.size());
-        repl.push_back(seg);
-    }
-
-    if (!replaceRange(op.offset, removeLen, repl, errorOut)) {
+// Replaces [offset, offset + removeLen) with |data| and records the pieces on both sides of
+// the edit, so undo costs no copy of the bytes involved.
+bool HexDocument::applyEdit(std::uint64_t offset,
+                            std::uint64_t removeLen,
+                            const QByteArray& data,
+                            bool typing,
+                            QString& errorOut) {
+    Segment seg;
+    seg.kind = Segment::Kind::Added;
+    seg.length = static_cast<std::uint64_t>(data.size());
+    if (!data.isEmpty() && !appendAddedData(data, seg.sourceOffset, errorOut)) {
         return false;
     }
-
-    if (recordUndo) {
-        undoStack_.push_back(op);
-        if (clearRedo) {
-            redoStack_.clear();
-        }
-    }
-
-    dirty_ = true;
-    return true;
+    return recordEdit(offset, removeLen, seg, typing, errorOut);
 }
 
-bool HexDocument::applyInverseAndPushRedo(const Operation& op, QString& errorOut) {
-    Operation inverse;
-    switch (op.type) {
-        case OperationType::Insert:
-            inverse.type = OperationType::Delete;
-            inverse.offset = op.offset;
-            inverse.oldData = op.newData;
-            break;
-        case OperationType::Delete:
-            inverse.type = OperationType::Insert;
-            inverse.offset = op.offset;
-            inverse.newData = op.oldData;
-            break;
-        case OperationType::Overwrite:
-            inverse.type = OperationType::Overwrite;
-            inverse.offset = op.offset;
-            inverse.oldData = op.newData;
-            inverse.newData = op.oldData;
-            break;
-    }
-
-    // Apply inverse without modifying undo stack
-    if (!applyOperation(inverse, /*recordUndo=*/false, errorOut)) {
+// The part of applyEdit() after the bytes of |inserted| have been added.
+bool HexDocument::recordEdit(std::uint64_t offset,
+                             std::uint64_t removeLen,
+                             const Segment& inserted,
+                             bool typing,
+                             QString& errorOut) {
+    EditHistory::Entry entry;
+    entry.offset = offset;
+    entry.typing = typing;
+    segments_.slice(offset, removeLen, entry.removed);
+    if (inserted.length > 0) {
+        entry.inserted.push_back(inserted);
+    }
+
+    if (!replaceRange(offset, removeLen, entry.inserted, errorOut)) {
         return false;
     }
-
-    redoStack_.push_back(op);
+    history_.record(std::move(entry));
+    dirty_ = true;
     return true;
 }
 
@@ -489,19 +542,7 @@ bool HexDocument::overwrite(std::uint64_t offset, const QByteArray& data, QStrin
 
     const std::uint64_t available = totalSize_ - offset;
     const std::uint64_t removeLen = std::min<std::uint64_t>(available, static_cast<std::uint64_t>(data.size()));
-
-    QByteArray oldData;
-    if (!readFromSegments(offset, removeLen, oldData, errorOut)) {
-        return false;
-    }
-
-    Operation op;
-    op.type = OperationType::Overwrite;
-    op.offset = offset;
-    op.oldData = oldData;
-    op.newData = data;
-
-    const bool ok = applyOperation(op, /*recordUndo=*/true, errorOut);
+    const bool ok = applyEdit(offset, removeLen, data, /*typing=*/data.size() == 1, errorOut);
     lock.unlock();
     if (ok) {
         Q_EMIT changed();
@@ -519,11 +560,7 @@ bool HexDocument::insert(std::uint64_t offset, const QByteArray& data, QString&
         return false;
     }
 
-    Operation op;
-    op.type = OperationType::Insert;
-    op.offset = offset;
-    op.newData = data;
-    const bool ok = applyOperation(op, /*recordUndo=*/true, errorOut);
+    const bool ok = applyEdit(offset, 0, data, /*typing=*/data.size() == 1, errorOut);
     lock.unlock();
     if (ok) {
         Q_EMIT changed();
@@ -531,6 +568,46 @@ bool HexDocument::insert(std::uint64_t offset, const QByteArray& data, QString&
     return ok;
 }
 
+bool HexDocument::insertFile(std::uint64_t offset, const QString& path, QString& errorOut) {
+    int fd = -1;
+    if (!openDescriptor(path, O_RDONLY | O_CLOEXEC, fd, errorOut)) {
+        return false;
+    }
+    struct stat sb{};
+    if (::fstat(fd, &sb) < 0) {
+        errorOut = errnoString("fstat");
+        closeDescriptor(fd);
+        return false;
+    }
+    if (!S_ISREG(sb.st_mode)) {
+        errorOut = tr("Only regular files can be inserted.");
+        closeDescriptor(fd);
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (offset > totalSize_) {
+        closeDescriptor(fd);
+        errorOut = tr("Offset %1 is past the end of the file.").arg(offset);
+        return false;
+    }
+    Segment seg;
+    seg.kind = Segment::Kind::Added;
+    seg.length = static_cast<std::uint64_t>(sb.st_size);
+    std::string err;
+    bool ok = addedBuffer_.appendFrom(fd, 0, seg.length, seg.sourceOffset, err);
+    closeDescriptor(fd);
+    if (!ok) {
+        errorOut = tr("Cannot store the new bytes: %1").arg(QString::fromLocal8Bit(err.c_str()));
+    }
+    ok = ok && (seg.length == 0 || recordEdit(offset, 0, seg, /*typing=*/false, errorOut));
+    lock.unlock();
+    if (ok && seg.length > 0) {
+        Q_EMIT changed();
+    }
+    return ok;
+}
+
 bool HexDocument::erase(std::uint64_t offset, std::uint64_t length, QString& errorOut) {
     std::unique_lock<std::shared_mutex> lock(mutex_);
     if (length == 0) {
@@ -540,17 +617,7 @@ bool HexDocument::erase(std::uint64_t offset, std::uint64_t length, QString& err
         return true;
     }
     const std::uint64_t removeLen = std::min<std::uint64_t>(length, totalSize_ - offset);
-    QByteArray oldData;
-    if (!readFromSegments(offset, removeLen, oldData, errorOut)) {
-        return false;
-    }
-
-    Operation op;
-    op.type = OperationType::Delete;
-    op.offset = offset;
-    op.oldData = oldData;
-
-    const bool ok = applyOperation(op, /*recordUndo=*/true, errorOut);
+    const bool ok = applyEdit(offset, removeLen, QByteArray(), /*typing=*/false, errorOut);
     lock.unlock();
     if (ok) {
         Q_EMIT changed();
@@ -560,12 +627,14 @@ bool HexDocument::erase(std::uint64_t offset, std::uint64_t length, QString& err
 
 bool HexDocument::undo(QString& errorOut) {
     std::unique_lock<std::shared_mutex> lock(mutex_);
-    if (undoStack_.empty()) {
-        return true;
+    EditHistory::Entry entry;
+    std::string err;
+    if (!history_.undo(entry, err)) {
+        errorOut = QString::fromLocal8Bit(err.c_str());
+        return err.empty();
     }
-    const Operation op = undoStack_.back();
-    undoStack_.pop_back();
-    const bool ok = applyInverseAndPushRedo(op, errorOut);
+    const bool ok = replaceRange(entry.offset, entry.insertedLength(), entry.removed, errorOut);
+    dirty_ = true;
     lock.unlock();
     if (ok) {
         Q_EMIT changed();
@@ -575,12 +644,14 @@ bool HexDocument::undo(QString& errorOut) {
 
 bool HexDocument::redo(QString& errorOut) {
     std::unique_lock<std::shared_mutex> lock(mutex_);
-    if (redoStack_.empty()) {
-        return true;
+    EditHistory::Entry entry;
+    std::string err;
+    if (!history_.redo(entry, err)) {
+        errorOut = QString::fromLocal8Bit(err.c_str());
+        return err.empty();
     }
-    const Operation op = redoStack_.back();
-    redoStack_.pop_back();
-    const bool ok = applyOperation(op, /*recordUndo=*/true, errorOut, /*clearRedo=*/false);
+    const bool ok = replaceRange(entry.offset, entry.removedLength(), entry.inserted, errorOut);
+    dirty_ = true;
     lock.unlock();
     if (ok) {
         Q_EMIT changed();
@@ -601,87 +672,155 @@ bool HexDocument::findForwardUnlocked(const QByteArray& needle,
                                       std::uint64_t& foundOffset,
                                       QString& errorOut) const {
     foundOffset = 0;
+    std::vector<std::uint64_t> hits;
+    if (!scanForwardUnlocked(needle, startOffset, 1, hits, errorOut) || hits.empty()) {
+        return false;
+    }
+    foundOffset = hits.front();
+    return true;
+}
+
+// Streams the document from |startOffset| through one reused window buffer and collects up to
+// |maxHits| non-overlapping matches. Consecutive windows overlap by needle.size() - 1 bytes so
+// matches across a window boundary are still seen.
+bool HexDocument::scanForward(const CopyFn& copy,
+                              std::uint64_t totalSize,
+                              const QByteArray& needle,
+                              std::uint64_t startOffset,
+                              std::size_t maxHits,
+                              std::vector<std::uint64_t>& hits,
+                              const SearchProgress& progress,
+                              QString& errorOut) {
     if (needle.isEmpty()) {
         errorOut = tr("Search pattern cannot be empty.");
         return false;
     }
-    if (startOffset > totalSize_) {
-        startOffset = totalSize_;
+    const std::size_t needleSize = static_cast<std::size_t>(needle.size());
+    if (startOffset >= totalSize || totalSize - startOffset < needleSize) {
+        return true;
     }
 
-    constexpr std::uint64_t kWindow = 4096 * 4;
-    const std::uint64_t needleSize = static_cast<std::uint64_t>(needle.size());
+    ByteSearcher searcher(reinterpret_cast<const std::uint8_t*>(needle.constData()), needleSize);
+    std::vector<std::uint8_t> window(std::min<std::uint64_t>(totalSize - startOffset, kSearchWindow + needleSize - 1));
+    bool tuned = false;
+    std::size_t reported = hits.size();
     std::uint64_t pos = startOffset;
-    while (pos < totalSize_) {
-        const std::uint64_t remaining = totalSize_ - pos;
-        const std::uint64_t readLen = std::min<std::uint64_t>(remaining, kWindow + needleSize);
-        QByteArray buffer;
-        if (!readFromSegments(pos, readLen, buffer, errorOut)) {
+    while (pos < totalSize) {
+        const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(totalSize - pos, window.size()));
+        std::size_t len = 0;
+        if (!copy(pos, want, window.data(), len, errorOut)) {
             return false;
         }
-        const int idx = buffer.indexOf(needle);
-        if (idx >= 0) {
-            foundOffset = pos + static_cast<std::uint64_t>(idx);
-            return true;
+        if (!tuned) {
+            searcher.tune(window.data(), len);
+            tuned = true;
+        }
+
+        const std::uint8_t* const begin = window.data();
+        const std::uint8_t* const end = begin + len;
+        std::uint64_t resume = 0;  // first offset a later match may start at
+        for (const std::uint8_t* hit = searcher.find(begin, end); hit; hit = searcher.find(hit + needleSize, end)) {
+            hits.push_back(pos + static_cast<std::uint64_t>(hit - begin));
+            if (hits.size() >= maxHits) {
+                return true;
+            }
+            resume = hits.back() + needleSize;
         }
-        if (readLen <= needleSize) {
+
+        if (progress) {
+            const std::vector<std::uint64_t> batch(hits.begin() + static_cast<std::ptrdiff_t>(reported), hits.end());
+            reported = hits.size();
+            if (!progress(batch, pos + len)) {
+                errorOut.clear();
+                return false;
+            }
+        }
+        if (len < want || pos + len >= totalSize || len < needleSize) {
             break;
         }
-        pos += readLen - needleSize;
+        pos = std::max<std::uint64_t>(pos + len - (needleSize - 1), resume);
     }
-    return false;
+    return true;
 }
 
-bool HexDocument::findBackward(const QByteArray& needle,
-                               std::uint64_t startOffset,
-                               std::uint64_t& foundOffset,
-                               QString& errorOut) const {
-    std::shared_lock<std::shared_mutex> lock(mutex_);
-    return findBackwardUnlocked(needle, startOffset, foundOffset, errorOut);
+bool HexDocument::scanForwardUnlocked(const QByteArray& needle,
+                                      std::uint64_t startOffset,
+                                      std::size_t maxHits,
+                                      std::vector<std::uint64_t>& hits,
+                                      QString& errorOut) const {
+    return scanForward([this](std::uint64_t offset, std::size_t length, std::uint8_t* dest, std::size_t& copied,
+                              QString& err) { return copyLogicalUnlocked(offset, length, dest, copied, err); },
+                       totalSize_, needle, startOffset, maxHits, hits, SearchProgress(), errorOut);
 }
 
-bool HexDocument::findBackwardUnlocked(const QByteArray& needle,
-                                       std::uint64_t startOffset,
-                                       std::uint64_t& foundOffset,
-                                       QString& errorOut) const {
+// Walks windows towards the start of the document and returns the last match in the first
+// window that has one. A match may start at startOffset - 1 (or 0 when startOffset is 0).
+// |progress| is given the lowest offset scanned so far.
+bool HexDocument::scanBackward(const CopyFn& copy,
+                               std::uint64_t totalSize,
+                               const QByteArray& needle,
+                               std::uint64_t startOffset,
+                               std::uint64_t& foundOffset,
+                               const SearchProgress& progress,
+                               QString& errorOut) {
     foundOffset = 0;
     if (needle.isEmpty()) {
         errorOut = tr("Search pattern cannot be empty.");
         return false;
     }
-    const std::uint64_t needleSize = static_cast<std::uint64_t>(needle.size());
-    if (startOffset > totalSize_) {
-        startOffset = totalSize_;
+    const std::size_t needleSize = static_cast<std::size_t>(needle.size());
+    if (totalSize < needleSize) {
+        return false;
     }
-
-    constexpr std::uint64_t kWindow = 4096 * 4;
-    std::uint64_t pos = (startOffset > 0) ? startOffset - 1 : 0;
-
-    while (true) {
-        const std::uint64_t begin = (pos > kWindow) ? pos - kWindow : 0;
-        const std::uint64_t length = pos - begin + needleSize;
-
-        QByteArray buffer;
-        if (!readFromSegments(begin, length, buffer, errorOut)) {
+    startOffset = std::min(startOffset, totalSize);
+    const std::uint64_t lastStart =
+        std::min<std::uint64_t>(startOffset > 0 ? startOffset - 1 : 0, totalSize - needleSize);
+
+    ByteSearcher searcher(reinterpret_cast<const std::uint8_t*>(needle.constData()), needleSize);
+    std::vector<std::uint8_t> window;
+    std::uint64_t limit = lastStart + 1;  // matches in this pass start before |limit|
+    while (limit > 0) {
+        const std::uint64_t begin = limit > kSearchWindow ? limit - kSearchWindow : 0;
+        window.resize(static_cast<std::size_t>(limit - begin) + needleSize - 1);
+        std::size_t len = 0;
+        if (!copy(begin, window.size(), window.data(), len, errorOut)) {
             return false;
         }
-        const int idx = buffer.lastIndexOf(needle);
-        if (idx >= 0) {
-            foundOffset = begin + static_cast<std::uint64_t>(idx);
-            return true;
+        const std::uint8_t* const data = window.data();
+        const std::uint8_t* last = nullptr;
+        for (const std::uint8_t* hit = searcher.find(data, data + len); hit; hit = searcher.find(hit + 1, data + len)) {
+            last = hit;
         }
-
-        if (begin == 0) {
-            break;
+        if (last) {
+            foundOffset = begin + static_cast<std::uint64_t>(last - data);
+            return true;
         }
-        if (begin < needleSize) {
-            break;
+        if (progress && !progress({}, begin)) {
+            errorOut.clear();
+            return false;
         }
-        pos = begin - needleSize;
+        limit = begin;
     }
     return false;
 }
 
+bool HexDocument::findBackward(const QByteArray& needle,
+                               std::uint64_t startOffset,
+                               std::uint64_t& foundOffset,
+                               QString& errorOut) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return findBackwardUnlocked(needle, startOffset, foundOffset, errorOut);
+}
+
+bool HexDocument::findBackwardUnlocked(const QByteArray& needle,
+                                       std::uint64_t startOffset,
+                                       std::uint64_t& foundOffset,
+                                       QString& errorOut) const {
+    return scanBackward([this](std::uint64_t offset, std::size_t length, std::uint8_t* dest, std::size_t& copied,
+                               QString& err) { return copyLogicalUnlocked(offset, length, dest, copied, err); },
+                        totalSize_, needle, startOffset, foundOffset, SearchProgress(), errorOut);
+}
+
 bool HexDocument::findAll(const QByteArray& needle, std::vector<std::uint64_t>& offsets, QString& errorOut) const {
     std::shared_lock<std::shared_mutex> lock(mutex_);
     return findAllUnlocked(needle, offsets, errorOut);
@@ -691,23 +830,7 @@ bool HexDocument::findAllUnlocked(const QByteArray& needle,
                                   std::vector<std::uint64_t>& offsets,
                                   QString& errorOut) const {
     offsets.clear();
-    if (needle.isEmpty()) {
-        errorOut = tr("Search pattern cannot be empty.");
-        return false;
-    }
-    std::uint64_t pos = 0;
-    while (pos < totalSize_) {
-        std::uint64_t found = 0;
-        if (!findForwardUnlocked(needle, pos, found, errorOut)) {
-            if (!errorOut.isEmpty()) {
-                return false;
-            }
-            break;
-        }
-        offsets.push_back(found);
-        pos = found + static_cast<std::uint64_t>(needle.size());
-    }
-    return true;
+    return scanForwardUnlocked(needle, 0, std::numeric_limits<std::size_t>::max(), offsets, errorOut);
 }
 
 bool HexDocument::isModified(std::uint64_t offset) const {
@@ -724,14 +847,8 @@ bool HexDocument::isModifiedUnlocked(std::uint64_t offset) const {
     if (offset >= totalSize_) {
         return false;
     }
-    std::uint64_t pos = 0;
-    for (const auto& seg : segments_) {
-        if (offset < pos + seg.length) {
-            return seg.kind == Segment::Kind::Added;
-        }
-        pos += seg.length;
-    }
-    return false;
+    const auto it = segments_.seek(offset);
+    return it.valid() && it.piece().kind == Segment::Kind::Added;
 }
 
 bool HexDocument::nextModifiedOffsetUnlocked(std::uint64_t startOffset,
@@ -741,65 +858,59 @@ bool HexDocument::nextModifiedOffsetUnlocked(std::uint64_t startOffset,
     if (segments_.empty()) {
         return false;
     }
-    if (!forward && startOffset > 0) {
-        startOffset -= 1;
-    }
-    std::uint64_t pos = 0;
     if (forward) {
-        for (const auto& seg : segments_) {
-            const std::uint64_t segEnd = pos + seg.length;
-            if (segEnd <= startOffset) {
-                pos = segEnd;
-                continue;
-            }
-            if (seg.kind == Segment::Kind::Added) {
-                const std::uint64_t localStart = startOffset > pos ? startOffset : pos;
-                foundOffset = localStart;
-                return true;
-            }
-            pos = segEnd;
+        const auto it = segments_.nextAdded(startOffset);
+        if (!it.valid()) {
+            return false;
         }
-        return false;
+        foundOffset = std::max(startOffset, it.start());
+        return true;
     }
 
-    // backwards
-    for (auto it = segments_.rbegin(); it != segments_.rend(); ++it) {
-        const auto& seg = *it;
-        const std::uint64_t segStart = (pos == 0) ? 0 : pos - seg.length;
-        if (startOffset < segStart) {
-            pos = segStart;
-            continue;
-        }
-        if (seg.kind == Segment::Kind::Added && startOffset >= segStart) {
-            foundOffset = startOffset;
-            return true;
-        }
-        pos = segStart;
-        if (pos == 0) {
-            break;
-        }
+    // backwards: the closest modified byte before startOffset
+    if (startOffset == 0) {
+        return false;
     }
-    return false;
+    startOffset = std::min(startOffset - 1, totalSize_ - 1);
+    const auto it = segments_.prevAdded(startOffset);
+    if (!it.valid()) {
+        return false;
+    }
+    foundOffset = std::min(startOffset, it.start() + it.piece().length - 1);
+    return true;
 }
 
 bool HexDocument::streamLogicalToFd(int fd, QString& errorOut) const {
-    char buffer[64 * 1024];
-    for (const auto& seg : segments_) {
+    constexpr std::size_t kChunk = 64 * 1024;
+    for (auto it = segments_.first(); it.valid(); it.next()) {
+        const Segment& seg = it.piece();
         std::uint64_t remaining = seg.length;
         std::uint64_t offset = seg.sourceOffset;
 
         while (remaining > 0) {
-            const std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, sizeof(buffer)));
-            QByteArray data;
-            if (seg.kind == Segment::Kind::Original) {
-                if (!readOriginalUnlocked(offset, chunk, data, errorOut)) {
+            if (seg.kind == Segment::Kind::Added) {
+                // written straight from the store, a whole chunk of it at a time
+                const std::size_t want = static_cast<std::size_t>(
+                    std::min<std::uint64_t>(remaining, std::numeric_limits<std::size_t>::max()));
+                std::size_t available = 0;
+                const std::uint8_t* data = addedBuffer_.span(offset, want, available);
+                if (available == 0) {
+                    errorOut = tr("The added bytes are missing.");
                     return false;
                 }
-            }
-            else {
-                data = QByteArray(addedBuffer_.constData() + static_cast<int>(offset), static_cast<int>(chunk));
+                if (!writeAll(fd, reinterpret_cast<const char*>(data), available, errorOut)) {
+                    return false;
+                }
+                remaining -= available;
+                offset += available;
+                continue;
             }
 
+            const std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, kChunk));
+            QByteArray data;
+            if (!readOriginalUnlocked(offset, chunk, data, errorOut)) {
+                return false;
+            }
             if (!writeAll(fd, data.constData(), static_cast<std::size_t>(data.size()), errorOut)) {
                 return false;
             }
@@ -916,6 +1027,25 @@ bool HexDocument::saveInternal(QString& errorOut, bool ignoreExternalChange) {
         }
     }
 
+    // Overwrite-only edits of a file nobody else has touched go straight into the file.
+    std::vector<FilePatch> patches;
+    QString changeError;
+    const bool inPlace = collectInPlacePatches(patches) && detectExternalChange(changeError);
+    if (!(inPlace ? saveInPlace(patches, errorOut) : saveByRewrite(errorOut))) {
+        return false;
+    }
+
+    // Rebuild state against the new file contents
+    if (!rebuildFromCurrentFile(errorOut)) {
+        return false;
+    }
+
+    Q_EMIT saved();
+    Q_EMIT changed();
+    return true;
+}
+
+bool HexDocument::saveByRewrite(QString& errorOut) {
     QString tempPath;
     if (!writeTempFile(path_, errorOut, tempPath)) {
         return false;
@@ -947,28 +1077,95 @@ bool HexDocument::saveInternal(QString& errorOut, bool ignoreExternalChange) {
 
     const QByteArray nativeTemp = QFile::encodeName(tempPath);
     const QByteArray nativeDest = QFile::encodeName(path_);
-    if (ok && ::rename(nativeTemp.constData(), nativeDest.constData()) < 0) {
-        errorOut = errnoString("rename");
+    if (!ok || ::rename(nativeTemp.constData(), nativeDest.constData()) < 0) {
+        if (ok) {
+            errorOut = errnoString("rename");
+        }
         ::unlink(nativeTemp.constData());
         return false;
     }
+    return true;
+}
 
-    // Rebuild state against the new file contents
-    if (!rebuildFromCurrentFile(errorOut)) {
+// Lists the added pieces as patches when every original piece is still at its own offset and
+// the size is unchanged, i.e. the edits only overwrote bytes.
+bool HexDocument::collectInPlacePatches(std::vector<FilePatch>& patches) const {
+    patches.clear();
+    if (totalSize_ != initialStat_.size) {
+        return false;
+    }
+    for (auto it = segments_.first(); it.valid(); it.next()) {
+        const Segment& seg = it.piece();
+        if (seg.kind == Segment::Kind::Original) {
+            if (seg.sourceOffset != it.start()) {
+                return false;
+            }
+            continue;
+        }
+        // one patch per chunk of the store the piece lies in
+        for (std::uint64_t done = 0; done < seg.length;) {
+            FilePatch patch;
+            patch.offset = it.start() + done;
+            patch.data = addedBuffer_.span(seg.sourceOffset + done, static_cast<std::size_t>(seg.length - done),
+                                           patch.length);
+            if (patch.length == 0) {
+                return false;
+            }
+            patches.push_back(patch);
+            done += patch.length;
+        }
+    }
+    return true;
+}
+
+bool HexDocument::saveInPlace(const std::vector<FilePatch>& patches, QString& errorOut) {
+    int fd = -1;
+    if (!openDescriptor(path_, O_RDWR | O_CLOEXEC | O_NOFOLLOW, fd, errorOut)) {
         return false;
     }
 
-    Q_EMIT saved();
-    Q_EMIT changed();
+    const std::string journal =
+        journalInPlaceSaves_ ? QFile::encodeName(patchJournalPath(path_)).toStdString() : std::string();
+    std::string patchError;
+    const bool ok = patch_file_in_place(fd, patches, journal, patchError);
+    if (ok) {
+        // Keep the timestamps the same way the rewriting save does.
+        struct timespec times[2];
+        times[0].tv_sec = initialStat_.mtimeSec;
+        times[0].tv_nsec = initialStat_.mtimeNsec;
+        times[1] = times[0];
+        ::futimens(fd, times);
+    }
+    closeDescriptor(fd);
+    if (!ok) {
+        errorOut = QString::fromLocal8Bit(patchError.c_str());
+        return false;
+    }
     return true;
 }
 
+bool HexDocument::recoverInterruptedSave(const QString& path, bool& recovered, QString& errorOut) {
+    const QString journal = patchJournalPath(path);
+    std::string recoverError;
+    if (!recover_patch_journal(QFile::encodeName(path).toStdString(), QFile::encodeName(journal).toStdString(),
+                               recovered, recoverError)) {
+        errorOut = tr("An interrupted save left %1 behind and it could not be rolled back: %2")
+                       .arg(journal, QString::fromLocal8Bit(recoverError.c_str()));
+        return false;
+    }
+    return true;
+}
+
+QString HexDocument::patchJournalPath(const QString& path) {
+    const QFileInfo info(path);
+    return info.absolutePath() + QStringLiteral("/.") + info.fileName() + QStringLiteral(".hexpatch");
+}
+
 bool HexDocument::rebuildFromCurrentFile(QString& errorOut) {
     closeDescriptor(sourceFd_);
     segments_.clear();
     addedBuffer_.clear();
-    undoStack_.clear();
-    redoStack_.clear();
+    history_.clear();
     reader_.reset();
 
     FileStat st;
@@ -982,8 +1179,8 @@ bool HexDocument::rebuildFromCurrentFile(QString& errorOut) {
     }
 
     std::string readerErr;
-    reader_ = std::make_unique<WindowedFileReader>(path_.toStdString(), kReadWindowSize, &readerErr);
-    if (!reader_ || !reader_->valid()) {
+    reader_ = MappedFileRegistry::instance().open(QFile::encodeName(path_).toStdString(), readerErr);
+    if (!reader_) {
         errorOut = QString::fromLocal8Bit(readerErr.c_str());
         return false;
     }
@@ -993,13 +1190,7 @@ bool HexDocument::rebuildFromCurrentFile(QString& errorOut) {
     currentStat_ = st;
     totalSize_ = st.size;
 
-    if (totalSize_ > 0) {
-        Segment seg;
-        seg.kind = Segment::Kind::Original;
-        seg.sourceOffset = 0;
-        seg.length = totalSize_;
-        segments_.push_back(seg);
-    }
+    segments_.reset(totalSize_);
 
     dirty_ = false;
     return true;
@@ -13,11 +13,16 @@
 #include <shared_mutex>
 
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "../core/added_store.h"
+#include "../core/edit_history.h"
+#include "../core/patch_journal.h"
+#include "../core/piece_tree.h"
 #include "../core/windowed_file_reader.h"
 
 namespace PCManFM {
@@ -28,32 +33,106 @@ class HexDocument : public QObject {
     Q_OBJECT
 
    public:
-    enum class OperationType { Insert, Delete, Overwrite };
+    // Receives the matches found since its previous call and the offset scanned up to so far;
+    // returning false cancels the search.
+    using SearchProgress = std::function<bool(const std::vector<std::uint64_t>& hits, std::uint64_t scannedTo)>;
 
-    struct Operation {
-        OperationType type;
-        std::uint64_t offset = 0;
-        QByteArray oldData;
-        QByteArray newData;
+    // A frozen copy of the document for searching on a worker thread while editing goes on.
+    // It copies the piece table and shares the file reader and the chunks of added bytes,
+    // so taking one is cheap and it stays valid across edits, saves and reloads. The
+    // one exception is a save that patches the file in place, which changes the file bytes
+    // the snapshot reads through; the editor cancels searches on every change anyway.
+    class Snapshot {
+       public:
+        std::uint64_t size() const { return size_; }
+
+        bool read(std::uint64_t offset,
+                  std::size_t length,
+                  std::uint8_t* dest,
+                  std::size_t& copied,
+                  QString& errorOut) const;
+        // Like HexDocument::findForward()/findAll(): |maxHits| non-overlapping matches from
+        // |startOffset|. When |progress| cancels, returns false with an empty errorOut.
+        bool findForward(const QByteArray& needle,
+                         std::uint64_t startOffset,
+                         std::size_t maxHits,
+                         std::vector<std::uint64_t>& hits,
+                         const SearchProgress& progress,
+                         QString& errorOut) const;
+        // Last match starting before |startOffset|; false when none or cancelled.
+        bool findBackward(const QByteArray& needle,
+                          std::uint64_t startOffset,
+                          std::uint64_t& foundOffset,
+                          const SearchProgress& progress,
+                          QString& errorOut) const;
+
+       private:
+        friend class HexDocument;
+
+        PieceTree segments_;
+        AddedStore::View added_;
+        std::shared_ptr<const WindowedFileReader> reader_;
+        std::uint64_t size_ = 0;
+    };
+
+    // One stretch of a borrowed range: edited bytes live in the added buffer, untouched ones
+    // point straight into the file mapping.
+    struct Run {
+        const std::uint8_t* data = nullptr;
+        std::size_t length = 0;
+        bool modified = false;
+    };
+
+    // A range of edited bytes, by document offset.
+    using ModifiedRange = PieceTree::Range;
+
+    // A range of the document borrowed without copying. The lease pins the file windows and
+    // the added bytes its runs point into, so they stay valid even if the document is edited.
+    // Reusing one lease keeps its storage between borrows; release() it once done so that the
+    // file windows it pins can be unmapped.
+    class Lease {
+       public:
+        const std::vector<Run>& runs() const { return runs_; }
+        std::uint64_t size() const { return size_; }
+        void release();
+
+       private:
+        friend class HexDocument;
+
+        std::vector<WindowedFileReader::Lease> windows_;
+        AddedStore::View added_;
+        std::vector<Run> runs_;
+        std::uint64_t size_ = 0;
     };
 
     explicit HexDocument(QObject* parent = nullptr);
     ~HexDocument() override;
 
+    // Also rolls back a save that was patching the file in place when it was interrupted.
     bool openFile(const QString& path, QString& errorOut);
+    // Edits that only overwrite bytes of an unchanged file are written in place, touching
+    // just the dirty ranges; anything that changes the size is rewritten to a temporary file
+    // and renamed over the original.
     bool save(QString& errorOut, bool ignoreExternalChange = false);
     bool saveAs(const QString& newPath, QString& errorOut);
     bool isRegularFile() const { return isRegular_; }
+    // Whether in-place saves first journal the bytes they replace so a crash can be undone.
+    bool journalInPlaceSaves() const { return journalInPlaceSaves_; }
+    void setJournalInPlaceSaves(bool enabled) { journalInPlaceSaves_ = enabled; }
 
     QString path() const { return path_; }
     std::uint64_t size() const { return totalSize_; }
     bool modified() const { return dirty_; }
+    std::shared_ptr<const Snapshot> snapshot() const;
 
     bool readBytes(std::uint64_t offset, std::uint64_t length, QByteArray& out, QString& errorOut) const;
+    // Borrows up to length bytes at offset; shorter only at the end of the document.
+    bool borrow(std::uint64_t offset, std::uint64_t length, Lease& out, QString& errorOut) const;
+    // Also returns the edited ranges among the bytes read, in order and clipped to them.
     bool readBytesWithMarkers(std::uint64_t offset,
                               std::uint64_t length,
                               QByteArray& out,
-                              std::vector<bool>& modified,
+                              std::vector<ModifiedRange>& modified,
                               QString& errorOut) const;
     bool hasExternalChange(bool& changed, QString& errorOut) const;
     bool currentFingerprint(quint64& fingerprintOut, QString& errorOut) const;
@@ -72,8 +151,12 @@ class HexDocument : public QObject {
 
     bool overwrite(std::uint64_t offset, const QByteArray& data, QString& errorOut);
     bool insert(std::uint64_t offset, const QByteArray& data, QString& errorOut);
+    // Inserts the contents of the file at |path|, read straight into the added bytes, so that
+    // inserting a file of several GiB takes disk space rather than memory.
+    bool insertFile(std::uint64_t offset, const QString& path, QString& errorOut);
     bool erase(std::uint64_t offset, std::uint64_t length, QString& errorOut);
 
+    // Consecutive single-byte edits undo as one; history past a few MiB is kept on disk.
     bool undo(QString& errorOut);
     bool redo(QString& errorOut);
 
@@ -82,12 +165,7 @@ class HexDocument : public QObject {
     void saved();
 
    private:
-    struct Segment {
-        enum class Kind { Original, Added };
-        Kind kind = Kind::Original;
-        std::uint64_t sourceOffset = 0;
-        std::uint64_t length = 0;
-    };
+    using Segment = PieceTree::Piece;
 
     struct FileStat {
         dev_t dev = 0;
@@ -104,29 +182,70 @@ class HexDocument : public QObject {
     bool openDescriptor(const QString& path, int flags, int& fdOut, QString& errorOut) const;
     void closeDescriptor(int& fd) const;
 
-    bool ensureSplit(std::uint64_t offset, std::size_t& index, QString& errorOut);
     bool replaceRange(std::uint64_t offset,
                       std::uint64_t length,
                       const std::vector<Segment>& replacement,
                       QString& errorOut);
     bool appendAddedData(const QByteArray& data, std::uint64_t& startOffset, QString& errorOut);
-    bool readFromSegments(std::uint64_t offset, std::uint64_t length, QByteArray& out, QString& errorOut) const;
     bool readOriginal(std::uint64_t offset, std::uint64_t length, QByteArray& out, QString& errorOut) const;
+    using CopyFn = std::function<bool(std::uint64_t, std::size_t, std::uint8_t*, std::size_t&, QString&)>;
+    static bool copyLogical(const PieceTree& segments,
+                            const AddedStore::View& added,
+                            const WindowedFileReader* reader,
+                            std::uint64_t offset,
+                            std::size_t length,
+                            std::uint8_t* dest,
+                            std::size_t& copied,
+                            QString& errorOut);
+    static bool scanForward(const CopyFn& copy,
+                            std::uint64_t totalSize,
+                            const QByteArray& needle,
+                            std::uint64_t startOffset,
+                            std::size_t maxHits,
+                            std::vector<std::uint64_t>& hits,
+                            const SearchProgress& progress,
+                            QString& errorOut);
+    static bool scanBackward(const CopyFn& copy,
+                             std::uint64_t totalSize,
+                             const QByteArray& needle,
+                             std::uint64_t startOffset,
+                             std::uint64_t& foundOffset,
+                             const SearchProgress& progress,
+                             QString& errorOut);
+    bool copyLogicalUnlocked(std::uint64_t offset,
+                             std::size_t length,
+                             std::uint8_t* dest,
+                             std::size_t& copied,
+                             QString& errorOut) const;
+    bool scanForwardUnlocked(const QByteArray& needle,
+                             std::uint64_t startOffset,
+                             std::size_t maxHits,
+                             std::vector<std::uint64_t>& hits,
+                             QString& errorOut) const;
 
-    bool applyOperation(const Operation& op, bool recordUndo, QString& errorOut, bool clearRedo = true);
-    bool applyInverseAndPushRedo(const Operation& op, QString& errorOut);
+    bool applyEdit(std::uint64_t offset,
+                   std::uint64_t removeLen,
+                   const QByteArray& data,
+                   bool typing,
+                   QString& errorOut);
+    bool recordEdit(std::uint64_t offset,
+                    std::uint64_t removeLen,
+                    const Segment& inserted,
+                    bool typing,
+                    QString& errorOut);
 
     bool writeTempFile(const QString& destPath, QString& errorOut, QString& tempPathOut) const;
     bool streamLogicalToFd(int fd, QString& errorOut) const;
     bool saveInternal(QString& errorOut, bool ignoreExternalChange);
+    bool saveByRewrite(QString& errorOut);
+    bool collectInPlacePatches(std::vector<FilePatch>& patches) const;
+    bool saveInPlace(const std::vector<FilePatch>& patches, QString& errorOut);
+    bool recoverInterruptedSave(const QString& path, bool& recovered, QString& errorOut);
+    static QString patchJournalPath(const QString& path);
     bool rebuildFromCurrentFile(QString& errorOut);
     bool detectExternalChange(QString& errorOut) const;
     bool readOriginalUnlocked(std::uint64_t offset, std::uint64_t length, QByteArray& out, QString& errorOut) const;
-    bool readBytesWithMarkersUnlocked(std::uint64_t offset,
-                                      std::uint64_t length,
-                                      QByteArray& out,
-                                      std::vector<bool>& modified,
-                                      QString& errorOut) const;
+    bool readBytesUnlocked(std::uint64_t offset, std::uint64_t length, QByteArray& out, QString& errorOut) const;
     bool findForwardUnlocked(const QByteArray& needle,
                              std::uint64_t startOffset,
                              std::uint64_t& foundOffset,
@@ -138,6 +257,8 @@ class HexDocument : public QObject {
     bool findAllUnlocked(const QByteArray& needle, std::vector<std::uint64_t>& offsets, QString& errorOut) const;
     bool isModifiedUnlocked(std::uint64_t offset) const;
     bool nextModifiedOffsetUnlocked(std::uint64_t startOffset, bool forward, std::uint64_t& foundOffset) const;
+    // Updates what the document accounts for in MemoryStats.
+    void accountMemory();
 
     int sourceFd_ = -1;
     QString path_;
@@ -145,16 +266,17 @@ class HexDocument : public QObject {
     FileStat currentStat_{};
     bool isRegular_ = true;
     std::uint64_t totalSize_ = 0;
-    std::vector<Segment> segments_;
-    QByteArray addedBuffer_;
+    PieceTree segments_;
+    AddedStore addedBuffer_;  // in memory up to a limit, then in a temporary file
 
-    static constexpr std::size_t kReadWindowSize = 8 * 1024 * 1024;  // 8 MiB sliding mmap window
-    std::unique_ptr<WindowedFileReader> reader_;
+    static constexpr std::size_t kSearchWindow = 4 * 1024 * 1024;  // bytes scanned per forward search step
+    std::shared_ptr<const WindowedFileReader> reader_;  // from MappedFileRegistry, shared with snapshots
     mutable std::shared_mutex mutex_;
 
-    std::vector<Operation> undoStack_;
-    std::vector<Operation> redoStack_;
+    EditHistory history_;
     bool dirty_ = false;
+    bool journalInPlaceSaves_ = true;
+    std::int64_t accountedBytes_ = 0;
 };
 
 }  // namespace PCManFM
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cctype>
+#include <utility>
 #include <vector>
 
 namespace PCManFM {
@@ -26,6 +27,39 @@ bool isPrintable(char c) {
     return std::isprint(static_cast<unsigned char>(c)) != 0;
 }
 
+// Walks the runs of a borrowed document range one byte at a time.
+class RunCursor {
+   public:
+    explicit RunCursor(const std::vector<HexDocument::Run>& runs) : runs_(&runs) { skipEmpty(); }
+
+    std::uint8_t byte() const { return (*runs_)[run_].data[pos_]; }
+    bool modified() const { return (*runs_)[run_].modified; }
+    void advance() {
+        ++pos_;
+        skipEmpty();
+    }
+    void skip(std::size_t count) {
+        while (count > 0 && run_ < runs_->size()) {
+            const std::size_t step = std::min(count, (*runs_)[run_].length - pos_);
+            pos_ += step;
+            count -= step;
+            skipEmpty();
+        }
+    }
+
+   private:
+    void skipEmpty() {
+        while (run_ < runs_->size() && pos_ >= (*runs_)[run_].length) {
+            ++run_;
+            pos_ = 0;
+        }
+    }
+
+    const std::vector<HexDocument::Run>* runs_;
+    std::size_t run_ = 0;
+    std::size_t pos_ = 0;
+};
+
 QByteArray hexStringToBytes(const QString& text, bool& okOut) {
     QByteArray out;
     QString cleaned = text;
@@ -74,6 +108,8 @@ HexEditorView::HexEditorView(HexDocument* doc, QWidget* parent) : QAbstractScrol
     setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     viewport()->setCursor(Qt::IBeamCursor);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &HexEditorView::emitVisibleRange);
+    connect(verticalScrollBar(), &QScrollBar::rangeChanged, this, &HexEditorView::emitVisibleRange);
 
     if (doc_) {
         connect(doc_, &HexDocument::changed, this, [this] {
@@ -83,6 +119,7 @@ HexEditorView::HexEditorView(HexDocument* doc, QWidget* parent) : QAbstractScrol
             }
             updateAddressDigits();
             updateScrollbars();
+            invalidateRows();
             viewport()->update();
             emitCursorInfo();
         });
@@ -100,6 +137,8 @@ void HexEditorView::setDocument(HexDocument* doc) {
         disconnect(doc_, nullptr, this, nullptr);
     }
     doc_ = doc;
+    searchHits_.clear();
+    invalidateRows();
     if (doc_) {
         connect(doc_, &HexDocument::changed, this, [this] {
             const std::uint64_t sz = doc_ ? doc_->size() : 0;
@@ -108,6 +147,7 @@ void HexEditorView::setDocument(HexDocument* doc) {
             }
             updateAddressDigits();
             updateScrollbars();
+            invalidateRows();
             viewport()->update();
             emitCursorInfo();
         });
@@ -187,12 +227,43 @@ void HexEditorView::setSelection(std::uint64_t start, std::uint64_t length) {
     viewport()->update();
     emitCursorInfo();
 }
-bool HexEditorView::selectionContains(std::uint64_t offset) const {
-    const auto sel = selection();
-    if (!sel) {
+
+void HexEditorView::addSearchHits(const std::vector<std::uint64_t>& offsets, std::uint64_t length) {
+    if (offsets.empty()) {
+        return;
+    }
+    searchHitLength_ = length;
+    searchHits_.insert(searchHits_.end(), offsets.begin(), offsets.end());
+    invalidateRows();
+    viewport()->update();
+}
+
+void HexEditorView::clearSearchHits() {
+    if (searchHits_.empty()) {
+        return;
+    }
+    searchHits_.clear();
+    invalidateRows();
+    viewport()->update();
+}
+
+void HexEditorView::setDiffRanges(const DiffRangeList* ranges) {
+    diffRanges_ = ranges;
+    diffRangesChanged();
+}
+
+void HexEditorView::diffRangesChanged() {
+    invalidateRows();
+    viewport()->update();
+}
+
+bool HexEditorView::searchHitContains(std::uint64_t offset) const {
+    auto it = std::upper_bound(searchHits_.begin(), searchHits_.end(), offset);
+    if (it == searchHits_.begin()) {
         return false;
     }
-    return offset >= sel->first && offset < sel->first + sel->second;
+    --it;
+    return offset < *it + searchHitLength_;
 }
 
 void HexEditorView::copySelectionToClipboard() const {
@@ -235,6 +306,10 @@ bool HexEditorView::deleteSelection(QString& errorOut) {
         errorOut = tr("No document loaded.");
         return false;
     }
+    if (readOnly_) {
+        errorOut = tr("This view is read-only.");
+        return false;
+    }
     const auto sel = selection();
     if (!sel) {
         return true;
@@ -253,6 +328,10 @@ bool HexEditorView::pasteFromClipboard(QString& errorOut) {
         errorOut = tr("No document loaded.");
         return false;
     }
+    if (readOnly_) {
+        errorOut = tr("This view is read-only.");
+        return false;
+    }
     const QMimeData* mime = QApplication::clipboard()->mimeData();
     QByteArray data;
     if (mime->hasFormat(QStringLiteral("application/octet-stream"))) {
@@ -379,7 +458,8 @@ void HexEditorView::paintEvent(QPaintEvent* event) {
     Q_UNUSED(event);
     QPainter painter(viewport());
     const ColorScheme* scheme = colors_ ? &colors_->scheme() : nullptr;
-    painter.fillRect(rect(), scheme ? scheme->background : palette().base());
+    const QColor background = scheme ? scheme->background : palette().base().color();
+    painter.fillRect(rect(), background);
 
     if (!doc_) {
         painter.drawText(rect(), Qt::AlignCenter, tr("No file loaded"));
@@ -388,104 +468,174 @@ void HexEditorView::paintEvent(QPaintEvent* event) {
 
     const QFontMetrics fm(font());
     const int lineHeight = fm.height();
+    const int charWidth = fm.horizontalAdvance(QLatin1Char('0'));
     const int rowsVisible = viewport()->height() / lineHeight + 1;
     const int firstRow = verticalScrollBar()->value();
     const std::uint64_t startOffset = static_cast<std::uint64_t>(firstRow) * static_cast<std::uint64_t>(bytesPerRow_);
 
     const QColor highlightColor = palette().color(QPalette::Highlight);
-    const QColor addrColor = scheme ? scheme->address.lighter(125) : palette().color(QPalette::Mid);
-    const QColor byteColor = scheme ? scheme->bytes : palette().color(QPalette::Text);
-    const QColor asciiColor = scheme ? scheme->bytes : palette().color(QPalette::Text);
-    const QColor asciiNonPrintable = scheme ? scheme->bytes.darker(140) : palette().color(QPalette::Mid);
-    const QColor patchedBg = scheme ? scheme->patchedBg : palette().color(QPalette::Link);
+    QColor searchHitBg = highlightColor;
+    searchHitBg.setAlpha(96);
+    const QColor diffBg(220, 50, 50, 96);
+    const auto differs = [this](std::uint64_t offset) { return diffRanges_ && diffRanges_->contains(offset); };
+
+    HexGlyphAtlas::Style glyphStyle;
+    glyphStyle.font = font();
+    glyphStyle.devicePixelRatio = viewport()->devicePixelRatioF();
+    glyphStyle.hex = scheme ? scheme->bytes : palette().color(QPalette::Text);
+    glyphStyle.ascii = glyphStyle.hex;
+    glyphStyle.nonPrintable = scheme ? scheme->bytes.darker(140) : palette().color(QPalette::Mid);
+    glyphStyle.address = scheme ? scheme->address.lighter(125) : palette().color(QPalette::Mid);
+
+    RowStyle rowStyle;
+    rowStyle.width = viewport()->width();
+    rowStyle.background = background;
+    rowStyle.highlight = highlightColor;
+    rowStyle.patched = scheme ? scheme->patchedBg : palette().color(QPalette::Link);
+
+    if (glyphs_.update(glyphStyle) || !(rowStyle == rowStyle_)) {
+        rowStyle_ = rowStyle;
+        invalidateRows();
+    }
+
+    // Borrow the visible range once: unmodified bytes are drawn straight from the file
+    // mapping, without a copy or allocation per row.
+    QString error;
+    const std::uint64_t visibleLength = static_cast<std::uint64_t>(rowsVisible) * bytesPerRow_;
+    if (!doc_->borrow(startOffset, visibleLength, paintLease_, error)) {
+        painter.setPen(palette().color(QPalette::Text));
+        painter.drawText(0, lineHeight, error);
+        return;
+    }
+    RunCursor bytes(paintLease_.runs());
+    const auto sel = selection();
+    const int asciiX = asciiColumnX(fm);
+    const int cellWidth = fm.horizontalAdvance(QStringLiteral("FF "));
 
     for (int row = 0; row < rowsVisible; ++row) {
         const std::uint64_t rowOffset = startOffset + static_cast<std::uint64_t>(row) * bytesPerRow_;
         if (rowOffset > doc_->size()) {
             break;
         }
+        const std::uint64_t rowStart = rowOffset - startOffset;
+        const int rowBytes =
+            rowStart < paintLease_.size()
+                ? static_cast<int>(std::min<std::uint64_t>(bytesPerRow_, paintLease_.size() - rowStart))
+                : 0;
+
+        // Only the cells of this row under the cursor or the selection decide whether an
+        // already painted copy of it can be reused.
+        const std::uint64_t rowEnd = rowOffset + static_cast<std::uint64_t>(bytesPerRow_);
+        CachedRow key;
+        key.epoch = rowEpoch_;
+        if (cursorOffset_ >= rowOffset && cursorOffset_ < rowEnd) {
+            key.cursorColumn = static_cast<int>(cursorOffset_ - rowOffset);
+            key.cursorAscii = cursorAscii_;
+        }
+        if (sel && sel->first < rowEnd && sel->first + sel->second > rowOffset) {
+            key.selectionFirst = static_cast<int>(std::max(sel->first, rowOffset) - rowOffset);
+            key.selectionLast = static_cast<int>(std::min(sel->first + sel->second, rowEnd) - rowOffset - 1);
+        }
 
-        QByteArray data;
-        std::vector<bool> modified;
-        QString error;
-        if (!doc_->readBytesWithMarkers(rowOffset, bytesPerRow_, data, modified, error)) {
-            painter.setPen(palette().color(QPalette::Text));
-            painter.drawText(0, (row + 1) * lineHeight, error);
-            break;
+        const std::uint64_t rowIndex = static_cast<std::uint64_t>(firstRow) + static_cast<std::uint64_t>(row);
+        CachedRow& cached = rowCache_[rowIndex];
+        if (!cached.pixmap.isNull() && cached.epoch == key.epoch && cached.cursorColumn == key.cursorColumn &&
+            cached.cursorAscii == key.cursorAscii && cached.selectionFirst == key.selectionFirst &&
+            cached.selectionLast == key.selectionLast) {
+            bytes.skip(static_cast<std::size_t>(rowBytes));
+            painter.drawPixmap(0, row * lineHeight, cached.pixmap);
+            continue;
         }
 
-        const int y = (row + 1) * lineHeight - fm.descent();
+        const qreal dpr = glyphStyle.devicePixelRatio;
+        key.pixmap = QPixmap(qRound(rowStyle.width * dpr), qRound(lineHeight * dpr));
+        key.pixmap.setDevicePixelRatio(dpr);
+        key.pixmap.fill(background);
+        QPainter rowPainter(&key.pixmap);
+        rowPainter.setPen(highlightColor);
+
+        glyphs_.drawAddress(rowPainter, 0, 0, rowOffset, addressDigits_);
 
-        // Address
-        painter.setPen(addrColor);
-        const QString addr = QStringLiteral("%1").arg(rowOffset, addressDigits_, 16, QLatin1Char('0')).toUpper();
-        painter.drawText(0, y, addr);
+        const auto selected = [&key](int column) {
+            return column >= key.selectionFirst && column <= key.selectionLast;
+        };
 
         // Hex bytes
+        const RunCursor rowBegin = bytes;
         for (int i = 0; i < bytesPerRow_; ++i) {
-            const std::uint64_t byteOffset = rowOffset + static_cast<std::uint64_t>(i);
-            const bool hasByte = i < data.size();
-            const bool isCursor = byteOffset == cursorOffset_;
-            const bool isSelected = selectionContains(byteOffset);
-
-            QRect cellRect(hexColumnX(i, fm), y - lineHeight + fm.descent(),
-                           fm.horizontalAdvance(QStringLiteral("FF ")), lineHeight);
-            if (!isSelected && hasByte && modified.size() > static_cast<std::size_t>(i) &&
-                modified[static_cast<std::size_t>(i)]) {
-                painter.fillRect(cellRect.adjusted(0, 0, fm.horizontalAdvance(QLatin1Char('0')), 0), patchedBg);
+            const bool hasByte = i < rowBytes;
+            const bool isSelected = selected(i);
+
+            const QRect cellRect(hexColumnX(i, fm), 0, cellWidth + charWidth, lineHeight);
+            if (!isSelected && hasByte && bytes.modified()) {
+                rowPainter.fillRect(cellRect, rowStyle.patched);
+            }
+            if (!isSelected && hasByte && differs(rowOffset + static_cast<std::uint64_t>(i))) {
+                rowPainter.fillRect(cellRect, diffBg);
+            }
+            if (!isSelected && hasByte && searchHitContains(rowOffset + static_cast<std::uint64_t>(i))) {
+                rowPainter.fillRect(cellRect, searchHitBg);
             }
             if (isSelected) {
-                painter.fillRect(cellRect.adjusted(0, 0, fm.horizontalAdvance(QLatin1Char('0')), 0), highlightColor);
+                rowPainter.fillRect(cellRect, highlightColor);
             }
 
             if (hasByte) {
-                const QString text =
-                    QStringLiteral("%1").arg(static_cast<unsigned char>(data.at(i)), 2, 16, QLatin1Char('0')).toUpper();
-                painter.setPen(byteColor);
-                painter.drawText(cellRect, Qt::AlignLeft | Qt::AlignVCenter, text);
-            }
-            else {
-                painter.setPen(addrColor);
-                painter.drawText(cellRect, Qt::AlignLeft | Qt::AlignVCenter, QStringLiteral("  "));
+                glyphs_.drawHex(rowPainter, cellRect.x(), 0, bytes.byte());
+                bytes.advance();
             }
 
-            if (isCursor && !cursorAscii_) {
-                painter.setPen(palette().color(QPalette::Highlight));
-                painter.drawRect(cellRect.adjusted(0, 1, 0, -1));
+            if (i == key.cursorColumn && !key.cursorAscii) {
+                rowPainter.drawRect(QRect(cellRect.x(), 0, cellWidth, lineHeight).adjusted(0, 1, 0, -1));
             }
         }
 
         // ASCII
-        const int asciiX = asciiColumnX(fm);
+        RunCursor asciiBytes = rowBegin;
         for (int i = 0; i < bytesPerRow_; ++i) {
-            const std::uint64_t byteOffset = rowOffset + static_cast<std::uint64_t>(i);
-            const bool hasByte = i < data.size();
-            const bool isCursor = byteOffset == cursorOffset_;
-            const bool isSelected = selectionContains(byteOffset);
-
-            QRect cell(asciiX + i * fm.horizontalAdvance(QLatin1Char('0')), y - lineHeight + fm.descent(),
-                       fm.horizontalAdvance(QLatin1Char('0')), lineHeight);
-            if (isSelected) {
-                painter.fillRect(cell, highlightColor);
+            const bool hasByte = i < rowBytes;
+            const QRect cell(asciiX + i * charWidth, 0, charWidth, lineHeight);
+            if (selected(i)) {
+                rowPainter.fillRect(cell, highlightColor);
+            }
+            else if (hasByte && searchHitContains(rowOffset + static_cast<std::uint64_t>(i))) {
+                rowPainter.fillRect(cell, searchHitBg);
+            }
+            else if (hasByte && differs(rowOffset + static_cast<std::uint64_t>(i))) {
+                rowPainter.fillRect(cell, diffBg);
             }
             if (hasByte) {
-                const char c = data.at(i);
-                const bool printable = isPrintable(c);
-                painter.setPen(printable ? asciiColor : asciiNonPrintable);
-                painter.drawText(cell, Qt::AlignLeft | Qt::AlignVCenter,
-                                 printable ? QString(QChar::fromLatin1(c)) : QStringLiteral("."));
+                glyphs_.drawAscii(rowPainter, cell.x(), 0, asciiBytes.byte());
+                asciiBytes.advance();
             }
-            if (isCursor && cursorAscii_) {
-                painter.setPen(palette().color(QPalette::Highlight));
-                painter.drawRect(cell.adjusted(0, 1, 0, -1));
+            if (i == key.cursorColumn && key.cursorAscii) {
+                rowPainter.drawRect(cell.adjusted(0, 1, 0, -1));
             }
         }
+        rowPainter.end();
+
+        painter.drawPixmap(0, row * lineHeight, key.pixmap);
+        cached = std::move(key);
+    }
+    paintLease_.release();
+
+    // Keep the rows around the visible page, so scrolling back and forth reuses them.
+    const std::uint64_t keepFrom = firstRow > rowsVisible ? static_cast<std::uint64_t>(firstRow - rowsVisible) : 0;
+    const std::uint64_t keepTo = static_cast<std::uint64_t>(firstRow) + 2 * static_cast<std::uint64_t>(rowsVisible);
+    for (auto it = rowCache_.begin(); it != rowCache_.end();) {
+        if (it->first < keepFrom || it->first >= keepTo || it->second.epoch != rowEpoch_) {
+            it = rowCache_.erase(it);
+        }
+        else {
+            ++it;
+        }
     }
 }
 
 void HexEditorView::resizeEvent(QResizeEvent* event) {
     QAbstractScrollArea::resizeEvent(event);
     updateScrollbars();
+    emitVisibleRange();
     viewport()->update();
 }
 
@@ -526,6 +676,30 @@ void HexEditorView::updateScrollbars() {
     verticalScrollBar()->setRange(0, std::max(0, totalRows - rowsVisible));
 }
 
+void HexEditorView::scrollToOffset(std::uint64_t offset) {
+    const QFontMetrics fm(font());
+    const int rowsVisible = std::max(1, viewport()->height() / fm.height());
+    const int row = static_cast<int>(offset / static_cast<std::uint64_t>(bytesPerRow_));
+    verticalScrollBar()->setValue(std::max(0, row - rowsVisible / 2));
+}
+
+std::pair<std::uint64_t, std::uint64_t> HexEditorView::visibleRange() const {
+    if (!doc_) {
+        return {0, 0};
+    }
+    const QFontMetrics fm(font());
+    const std::uint64_t rowsVisible = static_cast<std::uint64_t>(std::max(1, viewport()->height() / fm.height()));
+    const std::uint64_t start =
+        static_cast<std::uint64_t>(verticalScrollBar()->value()) * static_cast<std::uint64_t>(bytesPerRow_);
+    const std::uint64_t end = start + rowsVisible * static_cast<std::uint64_t>(bytesPerRow_);
+    return {std::min(start, doc_->size()), std::min(end, doc_->size())};
+}
+
+void HexEditorView::emitVisibleRange() {
+    const auto range = visibleRange();
+    Q_EMIT visibleRangeChanged(range.first, range.second);
+}
+
 void HexEditorView::moveCursorRelative(std::int64_t delta, bool keepAnchor) {
     if (!doc_) {
         return;
@@ -561,6 +735,10 @@ bool HexEditorView::commitErase(std::uint64_t offset, std::uint64_t length, QStr
         errorOut = tr("No document loaded.");
         return false;
     }
+    if (readOnly_) {
+        errorOut = tr("This view is read-only.");
+        return false;
+    }
     if (!doc_->erase(offset, length, errorOut)) {
         return false;
     }
@@ -577,6 +755,10 @@ bool HexEditorView::commitByteEdit(quint8 value, QString& errorOut) {
         errorOut = tr("No document loaded.");
         return false;
     }
+    if (readOnly_) {
+        errorOut = tr("This view is read-only.");
+        return false;
+    }
     if (auto sel = selection()) {
         if (!doc_->erase(sel->first, sel->second, errorOut)) {
             return false;
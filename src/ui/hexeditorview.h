@@ -7,12 +7,17 @@
 #define PCMANFM_HEXEDITORVIEW_H
 
 #include <QAbstractScrollArea>
+#include <QPixmap>
 #include <QPointer>
 
 #include <optional>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "hexdocument.h"
+#include "hexglyphatlas.h"
+#include "../core/byte_diff.h"
 #include "color_manager.h"
 
 namespace PCManFM {
@@ -26,6 +31,7 @@ class HexEditorView : public QAbstractScrollArea {
     void setDocument(HexDocument* doc);
     void setColorManager(ColorManager* colors) {
         colors_ = colors;
+        invalidateRows();
         viewport()->update();
     }
     HexDocument* document() const { return doc_; }
@@ -33,13 +39,33 @@ class HexEditorView : public QAbstractScrollArea {
     void setInsertMode(bool insert);
     bool insertMode() const { return insertMode_; }
 
+    // A read-only view moves the cursor and selects, but leaves the document alone.
+    void setReadOnly(bool readOnly) { readOnly_ = readOnly; }
+    bool isReadOnly() const { return readOnly_; }
+
     void setCursorOffset(std::uint64_t offset, bool keepAnchor = false);
     std::uint64_t cursorOffset() const { return cursorOffset_; }
 
+    // Scrolls so |offset| is in the middle of the view, leaving the cursor where it is.
+    void scrollToOffset(std::uint64_t offset);
+    // The document bytes on screen, as [start, end).
+    std::pair<std::uint64_t, std::uint64_t> visibleRange() const;
+
     std::optional<std::pair<std::uint64_t, std::uint64_t>> selection() const;
     void setSelection(std::uint64_t start, std::uint64_t length);
     void clearSelection();
 
+    // Highlights matches of a running or finished search. Batches arrive in increasing offset
+    // order and matches do not overlap.
+    void addSearchHits(const std::vector<std::uint64_t>& offsets, std::uint64_t length);
+    void clearSearchHits();
+    std::size_t searchHitCount() const { return searchHits_.size(); }
+
+    // Highlights the bytes in |ranges|, which the caller owns and keeps alive until it sets
+    // another list or nullptr; call diffRangesChanged() after adding to it.
+    void setDiffRanges(const DiffRangeList* ranges);
+    void diffRangesChanged();
+
     void copySelectionToClipboard() const;
     void copySelectionAsHexToClipboard() const;
     bool pasteFromClipboard(QString& errorOut);
@@ -49,6 +75,7 @@ class HexEditorView : public QAbstractScrollArea {
     void cursorChanged(std::uint64_t offset, int byteValue, bool hasSelection);
     void modeChanged(bool insertMode);
     void statusMessage(const QString& message);
+    void visibleRangeChanged(std::uint64_t start, std::uint64_t end);
 
    protected:
     void paintEvent(QPaintEvent* event) override;
@@ -59,10 +86,37 @@ class HexEditorView : public QAbstractScrollArea {
     void wheelEvent(QWheelEvent* event) override;
 
    private:
+    // A painted row is reused while nothing it shows has changed: same epoch, and the cursor
+    // and selection cover the same cells of it.
+    struct CachedRow {
+        QPixmap pixmap;
+        std::uint64_t epoch = 0;
+        int cursorColumn = -1;
+        bool cursorAscii = false;
+        int selectionFirst = -1;
+        int selectionLast = -1;
+    };
+
+    // What a cached row depends on besides the glyphs and the row's own contents.
+    struct RowStyle {
+        int width = 0;
+        QColor background;
+        QColor highlight;
+        QColor patched;
+
+        bool operator==(const RowStyle& other) const {
+            return width == other.width && background == other.background && highlight == other.highlight &&
+                   patched == other.patched;
+        }
+    };
+
+    // Drops every cached row; called whenever bytes, search hits or styling change.
+    void invalidateRows() { ++rowEpoch_; }
     void ensureVisible();
     void updateAddressDigits();
     void updateScrollbars();
-    bool selectionContains(std::uint64_t offset) const;
+    void emitVisibleRange();
+    bool searchHitContains(std::uint64_t offset) const;
     int addressWidth(const QFontMetrics& fm) const;
     int hexColumnX(int byteIndex, const QFontMetrics& fm) const;
     int asciiColumnX(const QFontMetrics& fm) const;
@@ -84,6 +138,15 @@ class HexEditorView : public QAbstractScrollArea {
     int bytesPerRow_ = 16;
     int addressDigits_ = 8;
     ColorManager* colors_ = nullptr;
+    HexDocument::Lease paintLease_;  // reused so repaints keep its storage
+    HexGlyphAtlas glyphs_;
+    std::unordered_map<std::uint64_t, CachedRow> rowCache_;  // keyed by row index
+    std::uint64_t rowEpoch_ = 0;
+    RowStyle rowStyle_;
+    std::vector<std::uint64_t> searchHits_;
+    std::uint64_t searchHitLength_ = 0;
+    const DiffRangeList* diffRanges_ = nullptr;
+    bool readOnly_ = false;
 };
 
 }  // namespace PCManFM
@@ -18,20 +18,36 @@
 #include <QLabel>
 #include <QDockWidget>
 #include <QFormLayout>
+#include <QHBoxLayout>
 #include <QCryptographicHash>
 #include <QDialog>
 #include <QDialogButtonBox>
 #include <QPlainTextEdit>
+#include <QListWidget>
+#include <QHeaderView>
+#include <QTableView>
+#include <QPushButton>
+#include <QProgressBar>
+#include <QFontDatabase>
+#include <QFile>
 #include <QFutureWatcher>
 #include <QtConcurrent>
 
 #include "color_manager.h"
+#include "../core/byte_pattern.h"
+#include "../core/crc32.h"
+#include "../core/record_layout.h"
 
 #include <algorithm>
 #include <cctype>
 #include <vector>
 #include <cstring>
+#include <limits>
 #include <cmath>
+#include <cinttypes>
+
+#include <b3sum/blake3.h>
+#include <zlib.h>
 
 namespace PCManFM {
 
@@ -65,6 +81,79 @@ QByteArray parseHexString(const QString& text, bool& okOut) {
     return out;
 }
 
+// Find Patterns reads the document in chunks of this size, one QtConcurrent task each.
+constexpr std::uint64_t kPatternChunk = 8 * 1024 * 1024;
+// Matches past this are counted but not listed.
+constexpr int kMaxPatternResults = 10000;
+
+struct SearchResult {
+    bool found = false;
+    bool cancelled = false;
+    std::uint64_t offset = 0;  // first match (Forward) or last match (Backward)
+    std::uint64_t count = 0;   // matches found by Find All
+    QString error;
+};
+
+struct PatternChunk {
+    std::vector<PatternHit> hits;
+    QString error;
+};
+
+// The minimap scan reads this much per QtConcurrent task; a multiple of any stats block size.
+constexpr std::uint64_t kStatsChunk = 4 * 1024 * 1024;
+// Edits restart the scan once they pause this long.
+constexpr int kStatsDelayMs = 500;
+
+// A structure export reads this much of the document per step.
+constexpr std::uint64_t kExportChunk = 4 * 1024 * 1024;
+
+struct ExportResult {
+    std::uint64_t rows = 0;
+    bool cancelled = false;
+    QString error;
+};
+
+// "0x10" or "16"; false when neither.
+bool parseOffset(QString text, std::uint64_t& out) {
+    text = text.trimmed();
+    int base = 10;
+    if (text.startsWith(QStringLiteral("0x"), Qt::CaseInsensitive)) {
+        base = 16;
+        text = text.mid(2);
+    }
+    bool ok = false;
+    out = text.toULongLong(&ok, base);
+    return ok;
+}
+
+struct StatsChunk {
+    std::uint64_t firstBlock = 0;
+    std::vector<BlockStats> stats;
+    QString error;
+};
+
+// Compare mode reads this much of both documents per step and posts the ranges found in it.
+constexpr std::size_t kCompareWindow = 4 * 1024 * 1024;
+// The comparison stops after this many ranges, so two unrelated files cannot exhaust memory.
+constexpr std::size_t kMaxDiffRanges = 1u << 20;
+
+// What the checksum panel lists, all computed in the same pass.
+const char* const kChecksumNames[] = {"CRC32", "Adler-32", "MD5", "SHA-256", "BLAKE3"};
+// The checksum pass reads this much of the document per step.
+constexpr std::size_t kChecksumWindow = 4 * 1024 * 1024;
+
+struct ChecksumResult {
+    bool cancelled = false;
+    QString error;
+    QStringList values;  // in kChecksumNames order
+};
+
+struct CompareResult {
+    bool cancelled = false;
+    bool truncated = false;
+    QString error;
+};
+
 }  // namespace
 
 HexEditorWindow::HexEditorWindow(QWidget* parent) : QMainWindow(parent), doc_(std::make_unique<HexDocument>()) {
@@ -72,13 +161,30 @@ HexEditorWindow::HexEditorWindow(QWidget* parent) : QMainWindow(parent), doc_(st
     updateWindowTitle();
 }
 
-HexEditorWindow::~HexEditorWindow() = default;
+HexEditorWindow::~HexEditorWindow() {
+    cancelChecksums();
+    cancelCompare();
+    cancelSearch();
+    cancelPatternSearch();
+    cancelBlockStats();
+    cancelRecordExport();
+}
 
 void HexEditorWindow::setupUi() {
     colors_ = std::make_unique<ColorManager>(this);
-    view_ = new HexEditorView(doc_.get(), this);
+    auto* central = new QWidget(this);
+    auto* centralLayout = new QHBoxLayout(central);
+    centralLayout->setContentsMargins(0, 0, 0, 0);
+    centralLayout->setSpacing(0);
+    view_ = new HexEditorView(doc_.get(), central);
     view_->setColorManager(colors_.get());
-    setCentralWidget(view_);
+    centralLayout->addWidget(view_, 1);
+    minimap_ = new HexMinimap(central);
+    minimap_->setToolTip(tr("Entropy, zero bytes and text per block"));
+    centralLayout->addWidget(minimap_);
+    setCentralWidget(central);
+    connect(view_, &HexEditorView::visibleRangeChanged, minimap_, &HexMinimap::setVisibleRange);
+    connect(minimap_, &HexMinimap::offsetRequested, view_, &HexEditorView::scrollToOffset);
 
     auto* toolbar = addToolBar(tr("Hex Editor"));
     toolbar->setMovable(false);
@@ -129,6 +235,15 @@ void HexEditorWindow::setupUi() {
         }
     });
 
+    insertFileAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("insert-object")), tr("Insert File…"));
+    connect(insertFileAction_, &QAction::triggered, this, [this] {
+        const QString path = QFileDialog::getOpenFileName(this, tr("Select file to insert"));
+        QString err;
+        if (!path.isEmpty() && !doc_->insertFile(view_->cursorOffset(), path, err)) {
+            QMessageBox::warning(this, tr("Insert failed"), err);
+        }
+    });
+
     deleteAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("edit-delete")), tr("Delete"));
     deleteAction_->setShortcut(QKeySequence::Delete);
     connect(deleteAction_, &QAction::triggered, this, [this] {
@@ -167,19 +282,19 @@ void HexEditorWindow::setupUi() {
 
     findAllAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("edit-find")), tr("Find All"));
     connect(findAllAction_, &QAction::triggered, this, [this] {
-        performFind(true);
-        std::vector<std::uint64_t> offsets;
-        QString err;
-        if (!doc_->findAll(lastSearch_, offsets, err)) {
-            if (!err.isEmpty()) {
-                QMessageBox::warning(this, tr("Find All"), err);
+        if (lastSearch_.isEmpty()) {
+            bool ok = false;
+            lastSearch_ = promptForPattern(tr("Find All"), ok);
+            if (!ok || lastSearch_.isEmpty()) {
+                return;
             }
-            return;
         }
-        QMessageBox::information(this, tr("Find All"),
-                                 tr("Found %1 occurrence(s).").arg(static_cast<int>(offsets.size())));
+        startSearch(SearchKind::All, 0);
     });
 
+    findPatternsAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("edit-find")), tr("Find Patterns…"));
+    connect(findPatternsAction_, &QAction::triggered, this, &HexEditorWindow::findPatterns);
+
     toolbar->addSeparator();
 
     nextModifiedAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("go-next")), tr("Next Modified"));
@@ -203,8 +318,9 @@ void HexEditorWindow::setupUi() {
         toolbar->addAction(QIcon::fromTheme(QStringLiteral("view-list-bookmarks")), tr("List Bookmarks"));
     connect(bookmarkListAction_, &QAction::triggered, this, &HexEditorWindow::listBookmarks);
 
-    diffAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("diff")), tr("Diff With File…"));
-    connect(diffAction_, &QAction::triggered, this, &HexEditorWindow::diffWithFile);
+    diffAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("diff")), tr("Compare With File…"));
+    diffAction_->setToolTip(tr("Show another file beside this one and highlight where they differ"));
+    connect(diffAction_, &QAction::triggered, this, &HexEditorWindow::compareWithFile);
     nextDiffAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("go-down")), tr("Next Diff"));
     connect(nextDiffAction_, &QAction::triggered, this, [this] { nextDiff(true); });
     prevDiffAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("go-up")), tr("Prev Diff"));
@@ -213,6 +329,11 @@ void HexEditorWindow::setupUi() {
         toolbar->addAction(QIcon::fromTheme(QStringLiteral("view-split-left-right")), tr("Side-by-Side Diff…"));
     connect(diffSideBySideAction_, &QAction::triggered, this, &HexEditorWindow::sideBySideDiff);
 
+    structureAction_ =
+        toolbar->addAction(QIcon::fromTheme(QStringLiteral("view-form-table")), tr("Apply Structure…"));
+    structureAction_->setToolTip(tr("Decode an array of typed records"));
+    connect(structureAction_, &QAction::triggered, this, &HexEditorWindow::applyStructure);
+
     insertToggleAction_ = toolbar->addAction(QIcon::fromTheme(QStringLiteral("insert-text")), tr("Insert mode"));
     insertToggleAction_->setCheckable(true);
     insertToggleAction_->setChecked(false);
@@ -226,11 +347,36 @@ void HexEditorWindow::setupUi() {
     connect(view_, &HexEditorView::statusMessage, this, [this](const QString& msg) { statusBar()->showMessage(msg); });
 
     connect(doc_.get(), &HexDocument::changed, this, [this]() {
+        // Running searches and highlighted matches refer to the previous contents.
+        cancelSearch();
+        if (checksumWatcher_) {
+            cancelChecksums();
+            checksumRange_->setText(tr("Cancelled: the document changed."));
+        }
+        view_->clearSearchHits();
         updateWindowTitle();
         updateActionStates(view_ && view_->selection().has_value());
+        statsTimer_->start();
+        if (recordModel_) {
+            recordModel_->refresh();
+        }
+        if (compareDoc_) {
+            cancelCompare();
+            compareTimer_->start();
+        }
     });
     connect(doc_.get(), &HexDocument::saved, this, &HexEditorWindow::updateWindowTitle);
 
+    statsTimer_ = new QTimer(this);
+    statsTimer_->setSingleShot(true);
+    statsTimer_->setInterval(kStatsDelayMs);
+    connect(statsTimer_, &QTimer::timeout, this, &HexEditorWindow::startBlockStats);
+
+    compareTimer_ = new QTimer(this);
+    compareTimer_->setSingleShot(true);
+    compareTimer_->setInterval(kStatsDelayMs);
+    connect(compareTimer_, &QTimer::timeout, this, [this] { startCompare(false); });
+
     changeTimer_ = new QTimer(this);
     changeTimer_->setInterval(2000);
     connect(changeTimer_, &QTimer::timeout, this, &HexEditorWindow::checkExternalChanges);
@@ -281,6 +427,16 @@ void HexEditorWindow::setupUi() {
 
 bool HexEditorWindow::openFile(const QString& path, QString& errorOut) {
     lastSearch_.clear();
+    closeCompare();
+    cancelChecksums();
+    cancelSearch();
+    cancelPatternSearch();
+    if (patternResults_) {
+        patternResults_->clear();
+    }
+    if (recordModel_) {
+        recordModel_->clear();
+    }
     const bool ok = doc_->openFile(path, errorOut);
     if (ok) {
         view_->setCursorOffset(0);
@@ -292,6 +448,7 @@ bool HexEditorWindow::openFile(const QString& path, QString& errorOut) {
                                  tr("The selected path is not a regular file; editing may not be safe."));
         }
         updateInspector(0);
+        startBlockStats();
     }
     return ok;
 }
@@ -355,12 +512,18 @@ void HexEditorWindow::updateActionStates(bool hasSelection) {
     if (deleteAction_) {
         deleteAction_->setEnabled(hasSelection);
     }
+    if (insertFileAction_) {
+        insertFileAction_->setEnabled(hasDoc);
+    }
     if (findAction_) {
         findAction_->setEnabled(hasDoc);
     }
     if (findAllAction_) {
         findAllAction_->setEnabled(hasDoc);
     }
+    if (findPatternsAction_) {
+        findPatternsAction_->setEnabled(hasDoc);
+    }
     if (replaceAction_) {
         replaceAction_->setEnabled(hasDoc);
     }
@@ -394,7 +557,7 @@ void HexEditorWindow::updateActionStates(bool hasSelection) {
     if (diffAction_) {
         diffAction_->setEnabled(hasDoc);
     }
-    const bool hasDiffs = hasDoc && !diffOffsets_.empty();
+    const bool hasDiffs = hasDoc && !diffRanges_.empty();
     if (nextDiffAction_) {
         nextDiffAction_->setEnabled(hasDiffs);
     }
@@ -616,21 +779,572 @@ void HexEditorWindow::performFind(bool forward) {
     if (sel) {
         start = forward ? sel->first + sel->second : (sel->first == 0 ? 0 : sel->first - 1);
     }
+    startSearch(forward ? SearchKind::Forward : SearchKind::Backward, start);
+}
 
-    std::uint64_t found = 0;
-    QString error;
-    const bool ok = forward ? doc_->findForward(lastSearch_, start, found, error)
-                            : doc_->findBackward(lastSearch_, start, found, error);
-    if (ok) {
-        view_->setSelection(found, static_cast<std::uint64_t>(lastSearch_.size()));
-        statusBar()->showMessage(tr("Found at offset 0x%1").arg(found, 0, 16));
+// Runs a search for lastSearch_ on a worker thread against a snapshot of the document, so the
+// window stays responsive on large files. Progress, and for Find All the matches found so far,
+// are posted back per scanned window; a new search, an edit or reopening the file cancels it.
+void HexEditorWindow::startSearch(SearchKind kind, std::uint64_t startOffset) {
+    cancelSearch();
+    view_->clearSearchHits();
+
+    const quint64 generation = searchGeneration_;
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    searchCancel_ = cancel;
+    const std::shared_ptr<const HexDocument::Snapshot> snapshot = doc_->snapshot();
+    const QByteArray needle = lastSearch_;
+    const std::uint64_t needleSize = static_cast<std::uint64_t>(needle.size());
+    const std::uint64_t total = snapshot->size();
+
+    HexDocument::SearchProgress progress = [this, cancel, generation, kind, needleSize, total](
+                                               const std::vector<std::uint64_t>& hits, std::uint64_t scannedTo) {
+        if (cancel->load()) {
+            return false;
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, kind, needleSize, total, hits, scannedTo]() {
+                if (generation != searchGeneration_) {
+                    return;
+                }
+                const std::uint64_t done = kind == SearchKind::Backward ? total - scannedTo : scannedTo;
+                const int percent = total == 0 ? 100 : static_cast<int>(done * 100 / total);
+                if (kind == SearchKind::All) {
+                    view_->addSearchHits(hits, needleSize);
+                    statusBar()->showMessage(
+                        tr("Searching… %1% (%2 found)").arg(percent).arg(view_->searchHitCount()));
+                }
+                else {
+                    statusBar()->showMessage(tr("Searching… %1%").arg(percent));
+                }
+            },
+            Qt::QueuedConnection);
+        return true;
+    };
+
+    auto* watcher = new QFutureWatcher<SearchResult>(this);
+    searchWatcher_ = watcher;
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, kind, needleSize]() {
+        const SearchResult result = watcher->future().result();
+        watcher->deleteLater();
+        if (generation != searchGeneration_ || result.cancelled) {
+            return;  // superseded; cancelSearch() already dropped the watcher
+        }
+        searchWatcher_ = nullptr;
+        searchCancel_.reset();
+        const QString title = kind == SearchKind::All ? tr("Find All") : tr("Find");
+        if (!result.error.isEmpty()) {
+            QMessageBox::warning(this, title, result.error);
+            return;
+        }
+        if (kind == SearchKind::All) {
+            statusBar()->showMessage(tr("Found %1 occurrence(s).").arg(result.count));
+            QMessageBox::information(this, title, tr("Found %1 occurrence(s).").arg(result.count));
+            return;
+        }
+        if (!result.found) {
+            statusBar()->clearMessage();
+            QMessageBox::information(this, title, tr("Pattern not found."));
+            return;
+        }
+        view_->setSelection(result.offset, needleSize);
+        statusBar()->showMessage(tr("Found at offset 0x%1").arg(result.offset, 0, 16));
+    });
+
+    watcher->setFuture(QtConcurrent::run([snapshot, needle, kind, startOffset, progress, cancel]() -> SearchResult {
+        SearchResult result;
+        if (kind == SearchKind::Backward) {
+            result.found = snapshot->findBackward(needle, startOffset, result.offset, progress, result.error);
+        }
+        else {
+            const std::size_t maxHits = kind == SearchKind::All ? std::numeric_limits<std::size_t>::max() : 1;
+            std::vector<std::uint64_t> hits;
+            if (snapshot->findForward(needle, startOffset, maxHits, hits, progress, result.error) && !hits.empty()) {
+                result.found = true;
+                result.offset = hits.front();
+            }
+            result.count = hits.size();
+        }
+        result.cancelled = cancel->load();
+        return result;
+    }));
+    statusBar()->showMessage(tr("Searching…"));
+}
+
+// Stops the running search and waits for its worker, which holds at most one search window,
+// so nothing from it reaches the view afterwards.
+void HexEditorWindow::cancelSearch() {
+    ++searchGeneration_;
+    if (searchCancel_) {
+        searchCancel_->store(true);
+        searchCancel_.reset();
+    }
+    if (searchWatcher_) {
+        QFutureWatcherBase* watcher = searchWatcher_;
+        searchWatcher_ = nullptr;
+        watcher->waitForFinished();
+    }
+}
+
+// Searches the whole document for a list of masked patterns. Chunks are scanned in parallel,
+// each reading maxLength() - 1 bytes past its end so matches across a seam are found by the
+// chunk they start in, and hits are added to the results dock as each chunk completes.
+void HexEditorWindow::findPatterns() {
+    if (!doc_ || !view_) {
         return;
     }
-    if (!error.isEmpty()) {
-        QMessageBox::warning(this, tr("Find"), error);
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Find Patterns"));
+    auto* layout = new QVBoxLayout(&dialog);
+    auto* hint = new QLabel(tr("One hex pattern per line. Use ? for any nibble and XX/MM for a bit mask, "
+                               "e.g. 48 8B ?? ?? 00 or 4?/F0."),
+                            &dialog);
+    hint->setWordWrap(true);
+    layout->addWidget(hint);
+    auto* edit = new QPlainTextEdit(&dialog);
+    edit->setPlainText(lastPatterns_);
+    layout->addWidget(edit);
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+    dialog.resize(480, 320);
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
     }
-    else {
-        QMessageBox::information(this, tr("Find"), tr("Pattern not found."));
+    lastPatterns_ = edit->toPlainText();
+
+    std::vector<BytePattern> patterns;
+    QStringList labels;
+    const QStringList lines = lastPatterns_.split(QLatin1Char('\n'));
+    for (int i = 0; i < lines.size(); ++i) {
+        const QString line = lines.at(i).trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        BytePattern pattern;
+        std::string error;
+        if (!parse_byte_pattern(line.toStdString(), pattern, error)) {
+            QMessageBox::warning(this, tr("Find Patterns"),
+                                 tr("Line %1: %2").arg(i + 1).arg(QString::fromStdString(error)));
+            return;
+        }
+        patterns.push_back(std::move(pattern));
+        labels << line;
+    }
+    if (patterns.empty()) {
+        return;
+    }
+    auto matcher = std::make_shared<PatternMatcher>();
+    std::string error;
+    if (!matcher->compile(std::move(patterns), error)) {
+        QMessageBox::warning(this, tr("Find Patterns"), QString::fromStdString(error));
+        return;
+    }
+
+    cancelPatternSearch();
+    patternMatcher_ = matcher;
+    patternLabels_ = labels;
+    patternHitCount_ = 0;
+
+    if (!patternDock_) {
+        patternDock_ = new QDockWidget(tr("Pattern Matches"), this);
+        patternDock_->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+        patternResults_ = new QListWidget(patternDock_);
+        // Offsets are zero-padded, so sorting by text keeps chunks that finish out of order in place.
+        patternResults_->setSortingEnabled(true);
+        patternDock_->setWidget(patternResults_);
+        addDockWidget(Qt::RightDockWidgetArea, patternDock_);
+        if (inspectorDock_) {
+            tabifyDockWidget(inspectorDock_, patternDock_);
+        }
+        connect(patternResults_, &QListWidget::itemClicked, this, [this](QListWidgetItem* item) {
+            const auto offset = item->data(Qt::UserRole).toULongLong();
+            const auto length = item->data(Qt::UserRole + 1).toULongLong();
+            view_->setSelection(offset, length);
+            view_->setCursorOffset(offset);
+        });
+    }
+    patternResults_->clear();
+    patternDock_->show();
+    patternDock_->raise();
+
+    HexDocument* doc = doc_.get();
+    const std::uint64_t total = doc->size();
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> chunks;
+    for (std::uint64_t pos = 0; pos < total; pos += kPatternChunk) {
+        chunks.emplace_back(pos, std::min<std::uint64_t>(total - pos, kPatternChunk));
+    }
+    const int width = QString::number(total, 16).size();
+
+    auto* watcher = new QFutureWatcher<PatternChunk>(this);
+    patternWatcher_ = watcher;
+    auto firstError = std::make_shared<QString>();
+    connect(watcher, &QFutureWatcherBase::resultReadyAt, this, [this, watcher, width, firstError](int index) {
+        if (watcher != patternWatcher_) {
+            return;
+        }
+        const PatternChunk chunk = watcher->resultAt(index);
+        if (!chunk.error.isEmpty() && firstError->isEmpty()) {
+            *firstError = chunk.error;
+        }
+        patternHitCount_ += chunk.hits.size();
+        for (const PatternHit& hit : chunk.hits) {
+            if (patternResults_->count() >= kMaxPatternResults) {
+                break;
+            }
+            auto* item = new QListWidgetItem(QStringLiteral("0x%1  %2")
+                                                 .arg(hit.offset, width, 16, QLatin1Char('0'))
+                                                 .arg(patternLabels_.at(static_cast<int>(hit.pattern))));
+            item->setData(Qt::UserRole, QVariant::fromValue<qulonglong>(hit.offset));
+            const std::size_t length = patternMatcher_->pattern(hit.pattern).size();
+            item->setData(Qt::UserRole + 1, QVariant::fromValue<qulonglong>(length));
+            patternResults_->addItem(item);
+        }
+        statusBar()->showMessage(tr("Searching patterns… %1 match(es)").arg(patternHitCount_));
+    });
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, firstError]() {
+        watcher->deleteLater();
+        if (watcher != patternWatcher_) {
+            return;  // cancelled or superseded
+        }
+        patternWatcher_ = nullptr;
+        if (!firstError->isEmpty()) {
+            QMessageBox::warning(this, tr("Find Patterns"), *firstError);
+        }
+        QString message = tr("Found %1 pattern match(es).").arg(patternHitCount_);
+        if (patternHitCount_ > static_cast<std::uint64_t>(kMaxPatternResults)) {
+            message += QLatin1Char(' ') + tr("Only the first %1 are listed.").arg(kMaxPatternResults);
+        }
+        statusBar()->showMessage(message);
+    });
+
+    const std::shared_ptr<const PatternMatcher> scanner = matcher;
+    watcher->setFuture(QtConcurrent::mapped(
+        chunks, [doc, scanner, total](const std::pair<std::uint64_t, std::uint64_t>& chunk) -> PatternChunk {
+            PatternChunk result;
+            const std::uint64_t span =
+                std::min<std::uint64_t>(total - chunk.first, chunk.second + scanner->maxLength() - 1);
+            QByteArray data;
+            if (!doc->readBytes(chunk.first, span, data, result.error)) {
+                return result;
+            }
+            const auto* bytes = reinterpret_cast<const std::uint8_t*>(data.constData());
+            scanner->scan(bytes, static_cast<std::size_t>(data.size()), static_cast<std::size_t>(chunk.second),
+                          chunk.first, result.hits);
+            return result;
+        }));
+    statusBar()->showMessage(tr("Searching patterns…"));
+}
+
+// Scan tasks read through doc_, so this waits for the chunks already running (at most one
+// chunk per thread) before the document can be reopened or destroyed.
+void HexEditorWindow::cancelPatternSearch() {
+    if (!patternWatcher_) {
+        return;
+    }
+    QFutureWatcherBase* watcher = patternWatcher_;
+    patternWatcher_ = nullptr;  // its queued signals are ignored and it deletes itself
+    watcher->cancel();
+    watcher->waitForFinished();
+}
+
+// Fills the minimap with the statistics of every block, in parallel chunks over a snapshot of
+// the document, so the scan neither blocks editing nor needs waiting for when cancelled.
+void HexEditorWindow::startBlockStats() {
+    cancelBlockStats();
+    statsTimer_->stop();
+    if (!doc_ || !minimap_) {
+        return;
+    }
+    const std::shared_ptr<const HexDocument::Snapshot> snapshot = doc_->snapshot();
+    const std::uint64_t total = snapshot->size();
+    const std::uint64_t blockSize = stats_block_size(total);
+    minimap_->reset(total, blockSize);
+    if (view_) {
+        const auto range = view_->visibleRange();
+        minimap_->setVisibleRange(range.first, range.second);
+    }
+    if (total == 0) {
+        return;
+    }
+
+    const std::uint64_t chunkSize = std::max(kStatsChunk, blockSize);
+    std::vector<std::uint64_t> chunks;
+    for (std::uint64_t pos = 0; pos < total; pos += chunkSize) {
+        chunks.push_back(pos);
+    }
+
+    auto* watcher = new QFutureWatcher<StatsChunk>(this);
+    statsWatcher_ = watcher;
+    connect(watcher, &QFutureWatcherBase::resultReadyAt, this, [this, watcher](int index) {
+        if (watcher != statsWatcher_) {
+            return;
+        }
+        const StatsChunk chunk = watcher->resultAt(index);
+        if (chunk.error.isEmpty()) {
+            minimap_->setStats(chunk.firstBlock, chunk.stats);
+        }
+        else {
+            statusBar()->showMessage(tr("Minimap: %1").arg(chunk.error));
+        }
+    });
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+        if (watcher == statsWatcher_) {
+            statsWatcher_ = nullptr;
+        }
+    });
+
+    watcher->setFuture(QtConcurrent::mapped(
+        chunks, [snapshot, total, chunkSize, blockSize](std::uint64_t offset) -> StatsChunk {
+            StatsChunk result;
+            result.firstBlock = offset / blockSize;
+            const std::size_t length = static_cast<std::size_t>(std::min(chunkSize, total - offset));
+            thread_local std::vector<std::uint8_t> buffer;
+            buffer.resize(length);
+            std::size_t copied = 0;
+            if (!snapshot->read(offset, length, buffer.data(), copied, result.error)) {
+                return result;
+            }
+            result.stats.resize((copied + blockSize - 1) / blockSize);
+            compute_block_stats(buffer.data(), copied, static_cast<std::size_t>(blockSize), result.stats.data());
+            return result;
+        }));
+}
+
+// The scan only holds a snapshot, so unlike Find Patterns it is dropped without waiting.
+void HexEditorWindow::cancelBlockStats() {
+    if (!statsWatcher_) {
+        return;
+    }
+    QFutureWatcherBase* watcher = statsWatcher_;
+    statsWatcher_ = nullptr;  // its queued signals are ignored and it deletes itself
+    watcher->cancel();
+}
+
+// Asks for a record layout and where the records are, then lists them in the Structure dock.
+// The model decodes only the rows the table shows.
+void HexEditorWindow::applyStructure() {
+    if (!doc_ || !view_) {
+        return;
+    }
+    if (lastLayout_.isEmpty()) {
+        lastLayout_ = QStringLiteral("# type name, one field per line\nu32le id\nu16be flags\nchar[10] name\n");
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Apply Structure"));
+    auto* layout = new QVBoxLayout(&dialog);
+    auto* hint = new QLabel(tr("Types: u8–u64, i8–i64, f32, f64 with an optional le/be suffix, char[N] and "
+                               "bytes[N]. [N] after a number makes an array."),
+                            &dialog);
+    hint->setWordWrap(true);
+    layout->addWidget(hint);
+    auto* edit = new QPlainTextEdit(&dialog);
+    edit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    edit->setPlainText(lastLayout_);
+    layout->addWidget(edit);
+    auto* form = new QFormLayout();
+    auto* startEdit = new QLineEdit(QStringLiteral("0x%1").arg(view_->cursorOffset(), 0, 16), &dialog);
+    auto* countEdit = new QLineEdit(&dialog);
+    countEdit->setPlaceholderText(tr("Up to the end of the file"));
+    form->addRow(tr("Start offset"), startEdit);
+    form->addRow(tr("Records"), countEdit);
+    layout->addLayout(form);
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+    dialog.resize(480, 400);
+    if (dialog.exec() != QDialog::Accepted) {
+        return;
+    }
+    lastLayout_ = edit->toPlainText();
+
+    RecordLayout records;
+    std::string error;
+    if (!records.parse(lastLayout_.toStdString(), error)) {
+        QMessageBox::warning(this, tr("Apply Structure"), QString::fromStdString(error));
+        return;
+    }
+    std::uint64_t start = 0;
+    if (!parseOffset(startEdit->text(), start) || start >= doc_->size()) {
+        QMessageBox::warning(this, tr("Apply Structure"), tr("The start offset is not inside the file."));
+        return;
+    }
+    std::uint64_t count = std::numeric_limits<std::uint64_t>::max();
+    if (!countEdit->text().trimmed().isEmpty() && (!parseOffset(countEdit->text(), count) || count == 0)) {
+        QMessageBox::warning(this, tr("Apply Structure"), tr("Invalid record count."));
+        return;
+    }
+
+    if (!structureDock_) {
+        structureDock_ = new QDockWidget(tr("Structure"), this);
+        structureDock_->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+        auto* panel = new QWidget(structureDock_);
+        auto* panelLayout = new QVBoxLayout(panel);
+        panelLayout->setContentsMargins(0, 0, 0, 0);
+        recordModel_ = new RecordModel(this);
+        structureView_ = new QTableView(panel);
+        structureView_->setModel(recordModel_);
+        structureView_->setSelectionBehavior(QAbstractItemView::SelectItems);
+        structureView_->verticalHeader()->setDefaultSectionSize(structureView_->fontMetrics().height() + 4);
+        structureView_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+        structureView_->horizontalHeader()->setStretchLastSection(true);
+        panelLayout->addWidget(structureView_);
+        auto* exportButton = new QPushButton(QIcon::fromTheme(QStringLiteral("document-export")),
+                                             tr("Export CSV…"), panel);
+        exportButton->setToolTip(tr("Export the selected columns, or all of them, for every record"));
+        connect(exportButton, &QPushButton::clicked, this, &HexEditorWindow::exportRecords);
+        panelLayout->addWidget(exportButton, 0, Qt::AlignRight);
+        structureDock_->setWidget(panel);
+        addDockWidget(Qt::BottomDockWidgetArea, structureDock_);
+        connect(structureView_, &QTableView::clicked, this, [this](const QModelIndex& index) {
+            const std::uint64_t offset = recordModel_->offsetOfRow(index.row());
+            std::uint64_t length = recordModel_->layout().recordSize();
+            std::uint64_t at = offset;
+            if (index.column() > 0) {
+                const auto& fields = recordModel_->layout().fields();
+                const RecordField& field = fields[static_cast<std::size_t>(index.column() - 1)];
+                at += field.offset;
+                length = field.size;
+            }
+            view_->setCursorOffset(at);
+            view_->setSelection(at, length);
+        });
+    }
+    recordModel_->setRecords(doc_.get(), records, start, count);
+    structureDock_->show();
+    structureDock_->raise();
+    statusBar()->showMessage(tr("%1 record(s) of %2 bytes from 0x%3.")
+                                 .arg(recordModel_->rowCount())
+                                 .arg(records.recordSize())
+                                 .arg(start, 0, 16));
+}
+
+// Writes the records shown in the Structure dock to a CSV file from a snapshot of the
+// document, on a worker thread, a few MiB of records at a time.
+void HexEditorWindow::exportRecords() {
+    if (!recordModel_ || recordModel_->rowCount() == 0) {
+        return;
+    }
+    if (exportWatcher_) {
+        QMessageBox::information(this, tr("Export CSV"), tr("An export is already running."));
+        return;
+    }
+    const RecordLayout layout = recordModel_->layout();
+    std::vector<std::size_t> columns;
+    bool withOffset = false;
+    for (const QModelIndex& index : structureView_->selectionModel()->selectedIndexes()) {
+        if (index.column() == 0) {
+            withOffset = true;
+        }
+        else {
+            columns.push_back(static_cast<std::size_t>(index.column() - 1));
+        }
+    }
+    std::sort(columns.begin(), columns.end());
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+    if (columns.empty()) {
+        withOffset = true;
+        for (std::size_t i = 0; i < layout.fields().size(); ++i) {
+            columns.push_back(i);
+        }
+    }
+
+    const QString path = QFileDialog::getSaveFileName(this, tr("Export CSV"), QString(), tr("CSV files (*.csv)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    const std::shared_ptr<const HexDocument::Snapshot> snapshot = doc_->snapshot();
+    const std::uint64_t start = recordModel_->start();
+    const std::uint64_t rows = static_cast<std::uint64_t>(recordModel_->rowCount());
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    exportCancel_ = cancel;
+
+    auto* watcher = new QFutureWatcher<ExportResult>(this);
+    exportWatcher_ = watcher;
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, path]() {
+        const ExportResult result = watcher->future().result();
+        watcher->deleteLater();
+        if (watcher != exportWatcher_) {
+            return;
+        }
+        exportWatcher_ = nullptr;
+        exportCancel_.reset();
+        if (!result.error.isEmpty()) {
+            QMessageBox::warning(this, tr("Export CSV"), result.error);
+            return;
+        }
+        statusBar()->showMessage(tr("Exported %1 record(s) to %2.").arg(result.rows).arg(path));
+    });
+
+    watcher->setFuture(QtConcurrent::run([this, snapshot, layout, columns, withOffset, start, rows, path,
+                                          cancel]() -> ExportResult {
+        ExportResult result;
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            result.error = file.errorString();
+            return result;
+        }
+        std::string text = withOffset ? "offset," : "";
+        text += layout.csvHeader(columns);
+        const std::uint64_t recordSize = layout.recordSize();
+        const std::uint64_t batch = std::max<std::uint64_t>(1, kExportChunk / recordSize);
+        std::vector<std::uint8_t> buffer;
+        for (std::uint64_t row = 0; row < rows; row += batch) {
+            if (cancel->load()) {
+                result.cancelled = true;
+                break;
+            }
+            const std::uint64_t count = std::min(batch, rows - row);
+            buffer.resize(static_cast<std::size_t>(count * recordSize));
+            std::size_t copied = 0;
+            if (!snapshot->read(start + row * recordSize, buffer.size(), buffer.data(), copied, result.error)) {
+                break;
+            }
+            for (std::uint64_t i = 0; i < copied / recordSize; ++i) {
+                if (withOffset) {
+                    char offset[24];
+                    const int length =
+                        std::snprintf(offset, sizeof(offset), "0x%" PRIx64 ",", start + (row + i) * recordSize);
+                    text.append(offset, static_cast<std::size_t>(length));
+                }
+                layout.appendCsvRow(buffer.data() + i * recordSize, columns, text);
+            }
+            if (file.write(text.data(), static_cast<qint64>(text.size())) != static_cast<qint64>(text.size())) {
+                result.error = file.errorString();
+                break;
+            }
+            text.clear();
+            result.rows += copied / recordSize;
+            const int percent = static_cast<int>((row + count) * 100 / rows);
+            QMetaObject::invokeMethod(
+                this, [this, percent]() { statusBar()->showMessage(tr("Exporting… %1%").arg(percent)); },
+                Qt::QueuedConnection);
+        }
+        if (result.error.isEmpty() && !result.cancelled && !text.empty()) {
+            file.write(text.data(), static_cast<qint64>(text.size()));
+        }
+        return result;
+    }));
+    statusBar()->showMessage(tr("Exporting…"));
+}
+
+// The export posts progress to the window, so this waits for its worker.
+void HexEditorWindow::cancelRecordExport() {
+    if (exportCancel_) {
+        exportCancel_->store(true);
+        exportCancel_.reset();
+    }
+    if (exportWatcher_) {
+        QFutureWatcherBase* watcher = exportWatcher_;
+        exportWatcher_ = nullptr;
+        watcher->waitForFinished();
     }
 }
 
@@ -752,87 +1466,167 @@ bool HexEditorWindow::iterateRange(std::uint64_t start,
     return true;
 }
 
+// Hashes the selection, or the whole document, with every algorithm of the checksum panel in
+// one pass over a snapshot, so edits are included and a multi-gigabyte range neither blocks
+// the window nor reads the document more than once.
 void HexEditorWindow::computeChecksums(bool selectionOnly) {
-    if (!doc_) {
+    if (!doc_ || !view_) {
         return;
     }
-    auto sel = view_ ? view_->selection() : std::nullopt;
+    const auto sel = view_->selection();
     std::uint64_t start = 0;
     std::uint64_t length = doc_->size();
     if (selectionOnly && sel) {
         start = sel->first;
         length = sel->second;
     }
-    if (length == 0) {
-        QMessageBox::information(this, tr("Checksum"), tr("Nothing to hash."));
-        return;
-    }
 
-    struct ChecksumResult {
-        bool ok = false;
-        QString error;
-        quint32 crc = 0;
-        QByteArray sha;
+    if (!checksumDock_) {
+        checksumDock_ = new QDockWidget(tr("Checksums"), this);
+        checksumDock_->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+        auto* panel = new QWidget(checksumDock_);
+        auto* form = new QFormLayout(panel);
+        checksumRange_ = new QLabel(panel);
+        checksumRange_->setWordWrap(true);
+        form->addRow(checksumRange_);
+        const QFont fixed = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+        for (const char* name : kChecksumNames) {
+            auto* value = new QLabel(panel);
+            value->setFont(fixed);
+            value->setTextInteractionFlags(Qt::TextSelectableByMouse);
+            form->addRow(QString::fromLatin1(name), value);
+            checksumValues_.push_back(value);
+        }
+        checksumProgress_ = new QProgressBar(panel);
+        checksumProgress_->setRange(0, 100);
+        form->addRow(checksumProgress_);
+        auto* buttons = new QHBoxLayout();
+        auto* selectionButton = new QPushButton(tr("Selection"), panel);
+        connect(selectionButton, &QPushButton::clicked, this, [this] { computeChecksums(true); });
+        auto* documentButton = new QPushButton(tr("Whole Document"), panel);
+        connect(documentButton, &QPushButton::clicked, this, [this] { computeChecksums(false); });
+        checksumCancelButton_ = new QPushButton(tr("Cancel"), panel);
+        connect(checksumCancelButton_, &QPushButton::clicked, this, [this] {
+            cancelChecksums();
+            checksumRange_->setText(tr("Cancelled."));
+        });
+        buttons->addWidget(selectionButton);
+        buttons->addWidget(documentButton);
+        buttons->addWidget(checksumCancelButton_);
+        form->addRow(buttons);
+        checksumDock_->setWidget(panel);
+        addDockWidget(Qt::RightDockWidgetArea, checksumDock_);
+        if (inspectorDock_) {
+            tabifyDockWidget(inspectorDock_, checksumDock_);
+        }
+    }
+    checksumDock_->show();
+    checksumDock_->raise();
+
+    cancelChecksums();
+    for (QLabel* value : checksumValues_) {
+        value->clear();
+    }
+    const QString range = tr("0x%1–0x%2 (%3 bytes)").arg(start, 0, 16).arg(start + length, 0, 16).arg(length);
+    checksumRange_->setText(range);
+    checksumProgress_->setValue(0);
+    checksumCancelButton_->setEnabled(true);
+
+    const quint64 generation = checksumGeneration_;
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    checksumCancel_ = cancel;
+    const std::shared_ptr<const HexDocument::Snapshot> snapshot = doc_->snapshot();
+
+    auto progress = [this, generation, length](std::uint64_t done) {
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, length, done]() {
+                if (generation == checksumGeneration_) {
+                    checksumProgress_->setValue(length == 0 ? 100 : static_cast<int>(done * 100 / length));
+                }
+            },
+            Qt::QueuedConnection);
     };
 
     auto* watcher = new QFutureWatcher<ChecksumResult>(this);
-    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, start, length]() {
-        const auto result = watcher->future().result();
+    checksumWatcher_ = watcher;
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation, range]() {
+        const ChecksumResult result = watcher->future().result();
         watcher->deleteLater();
-        if (!result.ok) {
-            if (!result.error.isEmpty()) {
-                QMessageBox::warning(this, tr("Checksum"), result.error);
-            }
+        if (generation != checksumGeneration_ || result.cancelled) {
+            return;  // superseded; cancelChecksums() already dropped the watcher
+        }
+        checksumWatcher_ = nullptr;
+        checksumCancel_.reset();
+        checksumCancelButton_->setEnabled(false);
+        if (!result.error.isEmpty()) {
+            checksumRange_->setText(tr("%1\nFailed: %2").arg(range, result.error));
             return;
         }
-        const QString message = tr("Range: 0x%1–0x%2 (%3 bytes)\nCRC32: %4\nSHA-256: %5")
-                                    .arg(start, 0, 16)
-                                    .arg(start + length, 0, 16)
-                                    .arg(length)
-                                    .arg(QStringLiteral("%1").arg(result.crc, 8, 16, QLatin1Char('0')).toUpper())
-                                    .arg(QString::fromLatin1(result.sha.toHex()));
-        QMessageBox::information(this, tr("Checksum"), message);
+        checksumProgress_->setValue(100);
+        for (std::size_t i = 0; i < checksumValues_.size() && i < static_cast<std::size_t>(result.values.size()); ++i) {
+            checksumValues_[i]->setText(result.values.at(static_cast<int>(i)));
+        }
     });
 
-    HexDocument* doc = doc_.get();
-    watcher->setFuture(QtConcurrent::run([doc, start, length]() -> ChecksumResult {
-        ChecksumResult res;
+    watcher->setFuture(QtConcurrent::run([snapshot, start, length, cancel, progress]() -> ChecksumResult {
+        ChecksumResult result;
+        std::uint32_t crc = 0;
+        uLong adler = ::adler32(0, nullptr, 0);
+        QCryptographicHash md5(QCryptographicHash::Md5);
         QCryptographicHash sha256(QCryptographicHash::Sha256);
-        quint32 crc = 0xFFFFFFFFu;
-        QString error;
-        QByteArray data;
-        const std::uint64_t kChunk = 2 * 1024 * 1024;
-        std::uint64_t remaining = length;
-        std::uint64_t pos = start;
-
-        while (remaining > 0) {
-            const std::uint64_t chunk = std::min<std::uint64_t>(remaining, kChunk);
-            if (!doc->readBytes(pos, chunk, data, error)) {
-                res.ok = false;
-                res.error = error;
-                return res;
+        blake3_hasher blake3;
+        blake3_hasher_init(&blake3);
+
+        std::vector<std::uint8_t> buffer(static_cast<std::size_t>(std::min<std::uint64_t>(kChecksumWindow, length)));
+        std::uint64_t done = 0;
+        while (done < length) {
+            if (cancel->load()) {
+                result.cancelled = true;
+                return result;
             }
-            sha256.addData(data);
-            for (unsigned char b : data) {
-                crc ^= b;
-                for (int i = 0; i < 8; ++i) {
-                    const bool lsb = crc & 1u;
-                    crc >>= 1;
-                    if (lsb) {
-                        crc ^= 0xEDB88320u;
-                    }
-                }
+            const std::size_t want = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), length - done));
+            std::size_t copied = 0;
+            if (!snapshot->read(start + done, want, buffer.data(), copied, result.error)) {
+                return result;
+            }
+            if (copied == 0) {
+                break;
             }
-            remaining -= chunk;
-            pos += chunk;
+            const std::uint8_t* data = buffer.data();
+            crc = crc32_update(crc, data, copied);
+            adler = ::adler32_z(adler, data, copied);
+            const QByteArrayView view(reinterpret_cast<const char*>(data), static_cast<qsizetype>(copied));
+            md5.addData(view);
+            sha256.addData(view);
+            blake3_hasher_update(&blake3, data, copied);
+            done += copied;
+            progress(done);
         }
 
-        res.ok = true;
-        res.crc = crc ^ 0xFFFFFFFFu;
-        res.sha = sha256.result();
-        return res;
+        std::uint8_t digest[BLAKE3_OUT_LEN];
+        blake3_hasher_finalize(&blake3, digest, sizeof(digest));
+        result.values << QStringLiteral("%1").arg(crc, 8, 16, QLatin1Char('0'))
+                      << QStringLiteral("%1").arg(static_cast<std::uint32_t>(adler), 8, 16, QLatin1Char('0'))
+                      << QString::fromLatin1(md5.result().toHex()) << QString::fromLatin1(sha256.result().toHex())
+                      << QString::fromLatin1(QByteArray(reinterpret_cast<const char*>(digest), sizeof(digest)).toHex());
+        return result;
     }));
-    statusBar()->showMessage(tr("Computing checksums…"), 2000);
+}
+
+// Stops the running checksum pass and waits for its worker, which holds one window at most.
+void HexEditorWindow::cancelChecksums() {
+    ++checksumGeneration_;
+    if (checksumCancel_) {
+        checksumCancel_->store(true);
+        checksumCancel_.reset();
+    }
+    if (checksumWatcher_) {
+        QFutureWatcherBase* watcher = checksumWatcher_;
+        checksumWatcher_ = nullptr;
+        watcher->waitForFinished();
+        checksumCancelButton_->setEnabled(false);
+    }
 }
 
 void HexEditorWindow::computeByteStats(bool selectionOnly) {
@@ -1025,88 +1819,193 @@ void HexEditorWindow::listBookmarks() {
     QMessageBox::information(this, tr("Bookmarks"), lines.join(QStringLiteral("\n")));
 }
 
-void HexEditorWindow::diffWithFile() {
-    if (!doc_) {
+// Opens another file read-only beside this one and compares the two in the background.
+void HexEditorWindow::compareWithFile() {
+    if (!doc_ || !view_) {
         return;
     }
-    const QString otherPath = QFileDialog::getOpenFileName(this, tr("Select file to diff"),
+    const QString otherPath = QFileDialog::getOpenFileName(this, tr("Select file to compare with"),
                                                            doc_->path().isEmpty() ? QString() : doc_->path());
     if (otherPath.isEmpty()) {
         return;
     }
+    auto other = std::make_unique<HexDocument>();
+    QString error;
+    if (!other->openFile(otherPath, error)) {
+        QMessageBox::warning(this, tr("Compare"), error);
+        return;
+    }
 
-    struct DiffResult {
-        bool ok = true;
-        QString error;
-        std::vector<std::uint64_t> diffs;
+    cancelCompare();
+    if (!compareDock_) {
+        compareDock_ = new QDockWidget(this);
+        compareDock_->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+        compareView_ = new HexEditorView(other.get(), compareDock_);
+        compareView_->setColorManager(colors_.get());
+        compareView_->setReadOnly(true);
+        compareView_->setDiffRanges(&diffRanges_);
+        compareDock_->setWidget(compareView_);
+        addDockWidget(Qt::RightDockWidgetArea, compareDock_);
+        view_->setDiffRanges(&diffRanges_);
+    }
+    else {
+        compareView_->setDocument(other.get());
+    }
+    compareDoc_ = std::move(other);
+    const QFileInfo info(otherPath);
+    compareDock_->setWindowTitle(tr("Compared: %1").arg(info.fileName()));
+    compareDock_->show();
+    startCompare(true);
+}
+
+// Compares snapshots of both documents on a worker thread, a window at a time: equal stretches
+// are skipped with block compares and only the differing runs are recorded. Each window's
+// ranges are posted back as it completes, so highlights fill in while the scan goes on; an edit
+// restarts the comparison once typing pauses.
+void HexEditorWindow::startCompare(bool jumpToFirst) {
+    cancelCompare();
+    compareTimer_->stop();
+    diffRanges_.clear();
+    view_->diffRangesChanged();
+    if (compareView_) {
+        compareView_->diffRangesChanged();
+    }
+    updateActionStates(view_->selection().has_value());
+    if (!compareDoc_) {
+        return;
+    }
+
+    const quint64 generation = compareGeneration_;
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    compareCancel_ = cancel;
+    const std::shared_ptr<const HexDocument::Snapshot> left = doc_->snapshot();
+    const std::shared_ptr<const HexDocument::Snapshot> right = compareDoc_->snapshot();
+    const std::uint64_t total = std::max(left->size(), right->size());
+
+    auto post = [this, generation, total, jumpToFirst](std::vector<DiffRange> batch, std::uint64_t comparedTo) {
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, total, jumpToFirst, batch = std::move(batch), comparedTo]() {
+                if (generation != compareGeneration_) {
+                    return;
+                }
+                if (!batch.empty()) {
+                    const bool first = diffRanges_.empty();
+                    diffRanges_.append(batch);
+                    view_->diffRangesChanged();
+                    if (compareView_) {
+                        compareView_->diffRangesChanged();
+                    }
+                    if (first && jumpToFirst) {
+                        view_->setCursorOffset(0);
+                        nextDiff(true);
+                    }
+                    if (first) {
+                        updateActionStates(view_->selection().has_value());
+                    }
+                }
+                const int percent = total == 0 ? 100 : static_cast<int>(comparedTo * 100 / total);
+                statusBar()->showMessage(
+                    tr("Comparing… %1% (%2 difference(s))").arg(percent).arg(diffRanges_.size()));
+            },
+            Qt::QueuedConnection);
     };
 
-    auto* watcher = new QFutureWatcher<DiffResult>(this);
-    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
-        const auto result = watcher->future().result();
+    auto* watcher = new QFutureWatcher<CompareResult>(this);
+    compareWatcher_ = watcher;
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation]() {
+        const CompareResult result = watcher->future().result();
         watcher->deleteLater();
-        if (!result.ok) {
-            QMessageBox::warning(this, tr("Diff"), result.error);
+        if (generation != compareGeneration_ || result.cancelled) {
+            return;  // superseded; cancelCompare() already dropped the watcher
+        }
+        compareWatcher_ = nullptr;
+        compareCancel_.reset();
+        if (!result.error.isEmpty()) {
+            QMessageBox::warning(this, tr("Compare"), result.error);
             return;
         }
-        diffOffsets_ = std::move(result.diffs);
-        currentDiffIndex_ = diffOffsets_.empty() ? -1 : 0;
-
-        if (diffOffsets_.empty()) {
-            QMessageBox::information(this, tr("Diff"), tr("Files are identical."));
+        if (diffRanges_.empty()) {
+            statusBar()->showMessage(tr("Files are identical."));
+            return;
         }
-        else {
-            QMessageBox::information(this, tr("Diff"), tr("Found %1 differing byte(s).").arg(diffOffsets_.size()));
-            nextDiff(true);
+        if (result.truncated) {
+            statusBar()->showMessage(tr("Stopped after %1 differing ranges at 0x%2.")
+                                         .arg(diffRanges_.size())
+                                         .arg(diffRanges_.ranges().back().end(), 0, 16));
+            return;
         }
-        updateActionStates(view_ && view_->selection().has_value());
+        statusBar()->showMessage(
+            tr("%1 differing range(s), %2 byte(s).").arg(diffRanges_.size()).arg(diffRanges_.differingBytes()));
     });
 
-    HexDocument* doc = doc_.get();
-    watcher->setFuture(QtConcurrent::run([doc, otherPath]() -> DiffResult {
-        DiffResult result;
-        QFile other(otherPath);
-        if (!other.open(QIODevice::ReadOnly)) {
-            result.ok = false;
-            result.error = QObject::tr("Cannot open %1").arg(otherPath);
-            return result;
-        }
-
-        const std::uint64_t len = doc->size();
-        const std::uint64_t otherLen = static_cast<std::uint64_t>(other.size());
-        const std::uint64_t maxLen = std::max<std::uint64_t>(len, otherLen);
-
-        constexpr std::uint64_t kChunk = 256 * 1024;
-        std::uint64_t pos = 0;
-        QString error;
-
-        while (pos < maxLen) {
-            const std::uint64_t chunk = std::min<std::uint64_t>(kChunk, maxLen - pos);
-            QByteArray left;
-            if (!doc->readBytes(pos, chunk, left, error)) {
-                result.ok = false;
-                result.error = error;
+    watcher->setFuture(QtConcurrent::run([left, right, cancel, post]() -> CompareResult {
+        CompareResult result;
+        const std::uint64_t common = std::min(left->size(), right->size());
+        std::vector<std::uint8_t> a(static_cast<std::size_t>(std::min<std::uint64_t>(kCompareWindow, common)));
+        std::vector<std::uint8_t> b(a.size());
+        std::size_t found = 0;
+        for (std::uint64_t pos = 0; pos < common;) {
+            if (cancel->load()) {
+                result.cancelled = true;
                 return result;
             }
-            QByteArray right = other.read(static_cast<qint64>(chunk));
-            if (right.size() < static_cast<int>(chunk)) {
-                right.resize(static_cast<int>(chunk));
+            const std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(kCompareWindow, common - pos));
+            std::size_t copiedA = 0;
+            std::size_t copiedB = 0;
+            if (!left->read(pos, length, a.data(), copiedA, result.error) ||
+                !right->read(pos, length, b.data(), copiedB, result.error)) {
+                return result;
             }
-            for (std::uint64_t i = 0; i < chunk; ++i) {
-                const bool diff = left.size() > static_cast<int>(i)
-                                      ? (static_cast<unsigned char>(left.at(static_cast<int>(i))) !=
-                                         static_cast<unsigned char>(right.at(static_cast<int>(i))))
-                                      : (static_cast<unsigned char>(right.at(static_cast<int>(i))) != 0);
-                if (diff) {
-                    result.diffs.push_back(pos + i);
-                }
+            std::vector<DiffRange> batch;
+            collect_diff_ranges(pos, a.data(), b.data(), std::min(copiedA, copiedB), batch);
+            pos += length;
+            found += batch.size();
+            post(std::move(batch), pos);
+            if (found >= kMaxDiffRanges) {
+                result.truncated = true;
+                return result;
             }
-            pos += chunk;
         }
-        result.ok = true;
+        // Whatever one file has past the end of the other counts as one differing range.
+        const std::uint64_t longer = std::max(left->size(), right->size());
+        std::vector<DiffRange> tail;
+        append_diff_range(tail, DiffRange{common, longer - common});
+        post(std::move(tail), longer);
         return result;
     }));
-    statusBar()->showMessage(tr("Diffing files…"), 2000);
+    statusBar()->showMessage(tr("Comparing…"));
+}
+
+// Stops the running comparison and waits for its worker, which holds at most one window of
+// each document, so no batch from it reaches the views afterwards.
+void HexEditorWindow::cancelCompare() {
+    ++compareGeneration_;
+    if (compareCancel_) {
+        compareCancel_->store(true);
+        compareCancel_.reset();
+    }
+    if (compareWatcher_) {
+        QFutureWatcherBase* watcher = compareWatcher_;
+        compareWatcher_ = nullptr;
+        watcher->waitForFinished();
+    }
+}
+
+// Leaves compare mode: drops the other document and every highlight.
+void HexEditorWindow::closeCompare() {
+    cancelCompare();
+    if (compareTimer_) {
+        compareTimer_->stop();
+    }
+    if (!compareDoc_) {
+        return;
+    }
+    diffRanges_.clear();
+    view_->diffRangesChanged();
+    compareView_->setDocument(nullptr);
+    compareDock_->hide();
+    compareDoc_.reset();
 }
 
 void HexEditorWindow::sideBySideDiff() {
@@ -1196,25 +2095,28 @@ void HexEditorWindow::sideBySideDiff() {
     dialog->show();
 }
 
+// Selects the next or previous differing range in both views, wrapping at either end.
 void HexEditorWindow::nextDiff(bool forward) {
-    if (diffOffsets_.empty() || !view_) {
+    if (diffRanges_.empty() || !view_) {
         return;
     }
-    if (currentDiffIndex_ < 0) {
-        currentDiffIndex_ = 0;
-    }
-    if (forward) {
-        currentDiffIndex_ = (currentDiffIndex_ + 1) % static_cast<int>(diffOffsets_.size());
-    }
-    else {
-        currentDiffIndex_ =
-            (currentDiffIndex_ - 1 + static_cast<int>(diffOffsets_.size())) % static_cast<int>(diffOffsets_.size());
-    }
-    const std::uint64_t offset = diffOffsets_[static_cast<std::size_t>(currentDiffIndex_)];
-    view_->clearSelection();
-    view_->setCursorOffset(offset);
-    statusBar()->showMessage(
-        tr("Diff %1/%2 at 0x%3").arg(currentDiffIndex_ + 1).arg(diffOffsets_.size()).arg(offset, 0, 16));
+    const auto sel = view_->selection();
+    const std::uint64_t cursor = view_->cursorOffset();
+    const std::uint64_t from = sel ? sel->first + (forward ? 1 : 0) : cursor;
+    std::size_t index = 0;
+    if (!diffRanges_.next(from, forward, index)) {
+        index = forward ? 0 : diffRanges_.size() - 1;
+    }
+    const DiffRange& range = diffRanges_.ranges()[index];
+    view_->setSelection(range.offset, range.length);
+    if (compareView_) {
+        compareView_->setSelection(range.offset, range.length);
+    }
+    statusBar()->showMessage(tr("Difference %1/%2 at 0x%3, %4 byte(s)")
+                                 .arg(index + 1)
+                                 .arg(diffRanges_.size())
+                                 .arg(range.offset, 0, 16)
+                                 .arg(range.length));
 }
 
 void HexEditorWindow::updateInspector(std::uint64_t offset) {
@@ -1323,15 +2225,8 @@ void HexEditorWindow::goToOffset() {
     if (!ok || input.isEmpty()) {
         return;
     }
-    QString trimmed = input.trimmed();
-    int base = 10;
-    if (trimmed.startsWith(QStringLiteral("0x"), Qt::CaseInsensitive)) {
-        base = 16;
-        trimmed = trimmed.mid(2);
-    }
-    bool parseOk = false;
-    const std::uint64_t offset = trimmed.toULongLong(&parseOk, base);
-    if (!parseOk) {
+    std::uint64_t offset = 0;
+    if (!parseOffset(input, offset)) {
         QMessageBox::warning(this, tr("Go to offset"), tr("Invalid number."));
         return;
     }
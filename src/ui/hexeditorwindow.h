@@ -8,19 +8,31 @@
 
 #include <QMainWindow>
 #include <QPointer>
+#include <QStringList>
 
+#include <atomic>
 #include <memory>
 
 #include "hexdocument.h"
 #include "hexeditorview.h"
+#include "hexminimap.h"
+#include "recordmodel.h"
 #include "color_manager.h"
+#include "../core/byte_diff.h"
 
 class QTimer;
 class QLabel;
 class QDockWidget;
+class QListWidget;
+class QTableView;
+class QProgressBar;
+class QPushButton;
+class QFutureWatcherBase;
 
 namespace PCManFM {
 
+class PatternMatcher;
+
 class HexEditorWindow : public QMainWindow {
     Q_OBJECT
 
@@ -40,8 +52,19 @@ class HexEditorWindow : public QMainWindow {
     void updateActionStates(bool hasSelection);
     bool promptToSave();
     void doSave(bool saveAs);
+    enum class SearchKind { Forward, Backward, All };
+
     void performFind(bool forward);
+    void startSearch(SearchKind kind, std::uint64_t startOffset);
+    void cancelSearch();
     void performReplace(bool replaceAll);
+    void findPatterns();
+    void cancelPatternSearch();
+    void startBlockStats();
+    void cancelBlockStats();
+    void applyStructure();
+    void exportRecords();
+    void cancelRecordExport();
     void jumpToModified(bool forward);
     void checkExternalChanges();
     QByteArray parseSearchInput(const QString& input, bool& okOut) const;
@@ -50,6 +73,7 @@ class HexEditorWindow : public QMainWindow {
     void goToOffset();
     void updateInspector(std::uint64_t offset);
     void computeChecksums(bool selectionOnly);
+    void cancelChecksums();
     void computeByteStats(bool selectionOnly);
     bool iterateRange(std::uint64_t start,
                       std::uint64_t length,
@@ -58,13 +82,17 @@ class HexEditorWindow : public QMainWindow {
     void addBookmark();
     void listBookmarks();
     void jumpBookmark(bool forward);
-    void diffWithFile();
+    void compareWithFile();
+    void startCompare(bool jumpToFirst);
+    void cancelCompare();
+    void closeCompare();
     void nextDiff(bool forward);
     void sideBySideDiff();
 
     std::unique_ptr<HexDocument> doc_;
     std::unique_ptr<ColorManager> colors_;
     QPointer<HexEditorView> view_;
+    HexMinimap* minimap_ = nullptr;
     QTimer* changeTimer_ = nullptr;
     bool suppressExternalPrompt_ = false;
     quint64 lastExternalFingerprint_ = 0;
@@ -76,11 +104,13 @@ class HexEditorWindow : public QMainWindow {
     QAction* copyAction_ = nullptr;
     QAction* copyHexAction_ = nullptr;
     QAction* pasteAction_ = nullptr;
+    QAction* insertFileAction_ = nullptr;
     QAction* deleteAction_ = nullptr;
     QAction* findAction_ = nullptr;
     QAction* findNextAction_ = nullptr;
     QAction* findPrevAction_ = nullptr;
     QAction* findAllAction_ = nullptr;
+    QAction* findPatternsAction_ = nullptr;
     QAction* replaceAction_ = nullptr;
     QAction* replaceAllAction_ = nullptr;
     QAction* gotoAction_ = nullptr;
@@ -97,9 +127,14 @@ class HexEditorWindow : public QMainWindow {
     QAction* nextDiffAction_ = nullptr;
     QAction* prevDiffAction_ = nullptr;
     QAction* diffSideBySideAction_ = nullptr;
+    QAction* structureAction_ = nullptr;
 
     QByteArray lastSearch_;
+    QFutureWatcherBase* searchWatcher_ = nullptr;  // running Find/Find All, if any
+    std::shared_ptr<std::atomic<bool>> searchCancel_;
+    quint64 searchGeneration_ = 0;  // bumped on cancel so stale progress and results are dropped
     QByteArray lastReplace_;
+    QString lastPatterns_;
 
     QLabel* modeLabel_ = nullptr;
     QLabel* modifiedLabel_ = nullptr;
@@ -117,13 +152,47 @@ class HexEditorWindow : public QMainWindow {
     QLabel* inspectorDouble_ = nullptr;
     QLabel* inspectorUtf8_ = nullptr;
 
+    QDockWidget* patternDock_ = nullptr;
+    QListWidget* patternResults_ = nullptr;
+    QFutureWatcherBase* patternWatcher_ = nullptr;  // running Find Patterns scan, if any
+    std::shared_ptr<const PatternMatcher> patternMatcher_;
+    QStringList patternLabels_;
+    std::uint64_t patternHitCount_ = 0;
+
+    QDockWidget* structureDock_ = nullptr;
+    QTableView* structureView_ = nullptr;
+    RecordModel* recordModel_ = nullptr;
+    QString lastLayout_;
+    QFutureWatcherBase* exportWatcher_ = nullptr;  // running CSV export, if any
+    std::shared_ptr<std::atomic<bool>> exportCancel_;
+
+    QDockWidget* checksumDock_ = nullptr;
+    QLabel* checksumRange_ = nullptr;
+    std::vector<QLabel*> checksumValues_;  // one per algorithm, in kChecksumNames order
+    QProgressBar* checksumProgress_ = nullptr;
+    QPushButton* checksumCancelButton_ = nullptr;
+    QFutureWatcherBase* checksumWatcher_ = nullptr;  // running checksum pass, if any
+    std::shared_ptr<std::atomic<bool>> checksumCancel_;
+    quint64 checksumGeneration_ = 0;  // bumped on cancel so stale progress is dropped
+
+    QFutureWatcherBase* statsWatcher_ = nullptr;  // running minimap scan, if any
+    QTimer* statsTimer_ = nullptr;                // restarts the scan once edits pause
+
     struct Bookmark {
         std::uint64_t offset = 0;
         QString label;
     };
     std::vector<Bookmark> bookmarks_;
-    std::vector<std::uint64_t> diffOffsets_;
-    int currentDiffIndex_ = -1;
+
+    // Compare mode: the other file in a read-only view beside this one, and where they differ.
+    std::unique_ptr<HexDocument> compareDoc_;
+    QDockWidget* compareDock_ = nullptr;
+    QPointer<HexEditorView> compareView_;
+    DiffRangeList diffRanges_;
+    QFutureWatcherBase* compareWatcher_ = nullptr;  // running comparison, if any
+    std::shared_ptr<std::atomic<bool>> compareCancel_;
+    quint64 compareGeneration_ = 0;  // bumped on cancel so stale batches are dropped
+    QTimer* compareTimer_ = nullptr;  // compares again once edits pause
 };
 
 }  // namespace PCManFM
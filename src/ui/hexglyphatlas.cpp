@@ -0,0 +1,87 @@
+/*
+ * Pre-rendered glyphs for the hex editor view
+ * src/ui/hexglyphatlas.cpp
+ */
+
+#include "hexglyphatlas.h"
+
+#include <QFontMetrics>
+#include <QPainter>
+
+#include <cctype>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789ABCDEF";
+
+}  // namespace
+
+bool HexGlyphAtlas::Style::operator==(const Style& other) const {
+    return font == other.font && devicePixelRatio == other.devicePixelRatio && hex == other.hex &&
+           ascii == other.ascii && nonPrintable == other.nonPrintable && address == other.address;
+}
+
+bool HexGlyphAtlas::update(const Style& style) {
+    if (valid_ && style == style_) {
+        return false;
+    }
+    style_ = style;
+    valid_ = true;
+
+    const QFontMetrics fm(style.font);
+    charWidth_ = fm.horizontalAdvance(QLatin1Char('0'));
+    lineHeight_ = fm.height();
+    const int slotWidth = 2 * charWidth_;
+
+    pixmap_ = QPixmap(qRound(16 * slotWidth * style.devicePixelRatio),
+                      qRound(kRows * lineHeight_ * style.devicePixelRatio));
+    pixmap_.setDevicePixelRatio(style.devicePixelRatio);
+    pixmap_.fill(Qt::transparent);
+
+    QPainter painter(&pixmap_);
+    painter.setFont(style.font);
+    const int ascent = fm.ascent();
+    for (int value = 0; value < 256; ++value) {
+        const int x = (value % 16) * slotWidth;
+        const char pair[2] = {kHexDigits[value >> 4], kHexDigits[value & 0x0F]};
+        painter.setPen(style.hex);
+        painter.drawText(x, (kHexRow + value / 16) * lineHeight_ + ascent, QString::fromLatin1(pair, 2));
+
+        const bool printable = std::isprint(value) != 0;
+        painter.setPen(printable ? style.ascii : style.nonPrintable);
+        painter.drawText(x, (kAsciiRow + value / 16) * lineHeight_ + ascent,
+                         printable ? QString(QChar::fromLatin1(static_cast<char>(value))) : QStringLiteral("."));
+    }
+    painter.setPen(style.address);
+    for (int digit = 0; digit < 16; ++digit) {
+        painter.drawText(digit * slotWidth, kAddressRow * lineHeight_ + ascent,
+                         QString(QChar::fromLatin1(kHexDigits[digit])));
+    }
+    return true;
+}
+
+void HexGlyphAtlas::blit(QPainter& painter, int x, int top, int slot, int row, int chars) const {
+    const qreal dpr = style_.devicePixelRatio;
+    const QRectF source(slot * 2 * charWidth_ * dpr, row * lineHeight_ * dpr, chars * charWidth_ * dpr,
+                        lineHeight_ * dpr);
+    painter.drawPixmap(QRectF(x, top, chars * charWidth_, lineHeight_), pixmap_, source);
+}
+
+void HexGlyphAtlas::drawHex(QPainter& painter, int x, int top, std::uint8_t value) const {
+    blit(painter, x, top, value % 16, kHexRow + value / 16, 2);
+}
+
+void HexGlyphAtlas::drawAscii(QPainter& painter, int x, int top, std::uint8_t value) const {
+    blit(painter, x, top, value % 16, kAsciiRow + value / 16, 1);
+}
+
+void HexGlyphAtlas::drawAddress(QPainter& painter, int x, int top, std::uint64_t value, int digits) const {
+    for (int i = digits - 1; i >= 0; --i) {
+        blit(painter, x + i * charWidth_, top, static_cast<int>(value & 0x0F), kAddressRow, 1);
+        value >>= 4;
+    }
+}
+
+}  // namespace PCManFM
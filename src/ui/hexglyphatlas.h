@@ -0,0 +1,67 @@
+/*
+ * Pre-rendered glyphs for the hex editor view
+ * src/ui/hexglyphatlas.h
+ */
+
+#ifndef PCMANFM_HEXGLYPHATLAS_H
+#define PCMANFM_HEXGLYPHATLAS_H
+
+#include <QColor>
+#include <QFont>
+#include <QPixmap>
+
+#include <cstdint>
+
+class QPainter;
+
+namespace PCManFM {
+
+// HexGlyphAtlas renders everything the hex view shows as text once: the 256 byte values as
+// hex pairs, each byte as its ASCII character or the '.' stand-in, and the address digits.
+// Drawing a cell is then a pixmap blit rather than a text layout. The atlas is rebuilt
+// whenever the font, device pixel ratio or colors change.
+class HexGlyphAtlas {
+   public:
+    struct Style {
+        QFont font;
+        qreal devicePixelRatio = 1.0;
+        QColor hex;
+        QColor ascii;
+        QColor nonPrintable;
+        QColor address;
+
+        bool operator==(const Style& other) const;
+        bool operator!=(const Style& other) const { return !(*this == other); }
+    };
+
+    // Rebuilds the glyphs for |style| unless they are already current; returns whether it did.
+    bool update(const Style& style);
+
+    int charWidth() const { return charWidth_; }
+    int lineHeight() const { return lineHeight_; }
+
+    // Each draws one cell of lineHeight() with its top-left corner at (x, top).
+    void drawHex(QPainter& painter, int x, int top, std::uint8_t value) const;
+    void drawAscii(QPainter& painter, int x, int top, std::uint8_t value) const;
+    // |digits| upper-case hex digits of |value|, zero-padded.
+    void drawAddress(QPainter& painter, int x, int top, std::uint64_t value, int digits) const;
+
+   private:
+    // Rows of 16 slots, each two characters wide: hex pairs, then ASCII, then address digits.
+    static constexpr int kHexRow = 0;
+    static constexpr int kAsciiRow = 16;
+    static constexpr int kAddressRow = 32;
+    static constexpr int kRows = 33;
+
+    void blit(QPainter& painter, int x, int top, int slot, int row, int chars) const;
+
+    Style style_;
+    bool valid_ = false;
+    QPixmap pixmap_;
+    int charWidth_ = 0;
+    int lineHeight_ = 0;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_HEXGLYPHATLAS_H
@@ -0,0 +1,196 @@
+/*
+ * Overview strip of byte statistics beside the hex editor view
+ * src/ui/hexminimap.cpp
+ */
+
+#include "hexminimap.h"
+
+#include <QHelpEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QToolTip>
+
+#include <algorithm>
+
+namespace PCManFM {
+
+namespace {
+
+constexpr int kStripeWidth = 12;
+constexpr int kStripeCount = 3;
+
+// Low entropy is blue, high is red; 7.2 bits per byte and up is what compression and
+// encryption look like.
+QRgb entropyColor(int entropy) {
+    return QColor::fromHsv(240 - entropy * 240 / 255, 200, 90 + entropy * 165 / 255).rgb();
+}
+
+QRgb shareColor(int share, const QColor& full, const QColor& none) {
+    const auto mix = [share](int a, int b) { return b + (a - b) * share / 255; };
+    return qRgb(mix(full.red(), none.red()), mix(full.green(), none.green()), mix(full.blue(), none.blue()));
+}
+
+}  // namespace
+
+HexMinimap::HexMinimap(QWidget* parent) : QWidget(parent) {
+    setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Expanding);
+    setCursor(Qt::PointingHandCursor);
+}
+
+QSize HexMinimap::sizeHint() const {
+    return QSize(kStripeWidth * kStripeCount + kStripeCount - 1, 200);
+}
+
+void HexMinimap::reset(std::uint64_t documentSize, std::uint64_t blockSize) {
+    documentSize_ = documentSize;
+    blockSize_ = std::max<std::uint64_t>(1, blockSize);
+    stats_.assign(static_cast<std::size_t>((documentSize + blockSize_ - 1) / blockSize_), BlockStats{});
+    knownBlocks_ = 0;
+    imageStale_ = true;
+    update();
+}
+
+void HexMinimap::setStats(std::uint64_t firstBlock, const std::vector<BlockStats>& stats) {
+    if (firstBlock >= stats_.size()) {
+        return;
+    }
+    const std::size_t count = std::min<std::size_t>(stats.size(), stats_.size() - firstBlock);
+    for (std::size_t i = 0; i < count; ++i) {
+        BlockStats& slot = stats_[firstBlock + i];
+        knownBlocks_ += !slot.known && stats[i].known;
+        slot = stats[i];
+    }
+    imageStale_ = true;
+    update();
+}
+
+void HexMinimap::setVisibleRange(std::uint64_t start, std::uint64_t end) {
+    if (start == visibleStart_ && end == visibleEnd_) {
+        return;
+    }
+    visibleStart_ = start;
+    visibleEnd_ = end;
+    update();
+}
+
+std::uint64_t HexMinimap::offsetAt(int y) const {
+    if (documentSize_ == 0 || height() <= 0) {
+        return 0;
+    }
+    const int clamped = std::clamp(y, 0, height() - 1);
+    return static_cast<std::uint64_t>(static_cast<double>(documentSize_) * clamped / height());
+}
+
+int HexMinimap::yForOffset(std::uint64_t offset) const {
+    if (documentSize_ == 0) {
+        return 0;
+    }
+    return static_cast<int>(static_cast<double>(std::min(offset, documentSize_)) * height() / documentSize_);
+}
+
+// Each pixel row covers a range of blocks. Entropy shows the highest in the range, so a small
+// encrypted blob is not averaged away; the shares show the mean.
+void HexMinimap::renderImage() {
+    const qreal dpr = devicePixelRatioF();
+    const int w = std::max(1, static_cast<int>(width() * dpr));
+    const int h = std::max(1, static_cast<int>(height() * dpr));
+    image_ = QImage(w, h, QImage::Format_RGB32);
+    const QRgb blank = palette().color(QPalette::Window).rgb();
+    image_.fill(blank);
+    imageStale_ = false;
+    if (stats_.empty()) {
+        return;
+    }
+
+    const QColor none = palette().color(QPalette::Base);
+    const QColor zeroColor = palette().color(QPalette::Text);
+    const QColor textColor(40, 170, 80);
+    const int stripe = w / kStripeCount;
+    const std::uint64_t blocks = stats_.size();
+    for (int y = 0; y < h; ++y) {
+        const std::uint64_t first = blocks * static_cast<std::uint64_t>(y) / static_cast<std::uint64_t>(h);
+        const std::uint64_t last =
+            std::max(first + 1, blocks * static_cast<std::uint64_t>(y + 1) / static_cast<std::uint64_t>(h));
+        int entropy = 0;
+        std::uint64_t zeros = 0;
+        std::uint64_t ascii = 0;
+        std::uint64_t known = 0;
+        for (std::uint64_t i = first; i < last; ++i) {
+            const BlockStats& s = stats_[static_cast<std::size_t>(i)];
+            if (!s.known) {
+                continue;
+            }
+            entropy = std::max<int>(entropy, s.entropy);
+            zeros += s.zeros;
+            ascii += s.ascii;
+            ++known;
+        }
+        if (known == 0) {
+            continue;
+        }
+        auto* line = reinterpret_cast<QRgb*>(image_.scanLine(y));
+        const QRgb colors[kStripeCount] = {entropyColor(entropy),
+                                           shareColor(static_cast<int>(zeros / known), zeroColor, none),
+                                           shareColor(static_cast<int>(ascii / known), textColor, none)};
+        for (int s = 0; s < kStripeCount; ++s) {
+            // Leave a one pixel gap between stripes.
+            const int end = s + 1 == kStripeCount ? w : (s + 1) * stripe - 1;
+            std::fill(line + s * stripe, line + std::max(s * stripe, end), colors[s]);
+        }
+    }
+    image_.setDevicePixelRatio(dpr);
+}
+
+void HexMinimap::paintEvent(QPaintEvent* event) {
+    Q_UNUSED(event);
+    const qreal dpr = devicePixelRatioF();
+    if (imageStale_ || image_.width() != static_cast<int>(width() * dpr) ||
+        image_.height() != static_cast<int>(height() * dpr)) {
+        renderImage();
+    }
+    QPainter painter(this);
+    painter.drawImage(0, 0, image_);
+    if (documentSize_ == 0 || visibleEnd_ <= visibleStart_) {
+        return;
+    }
+    const int top = yForOffset(visibleStart_);
+    const int bottom = std::max(top + 2, yForOffset(visibleEnd_));
+    QColor frame = palette().color(QPalette::Highlight);
+    painter.setPen(frame);
+    frame.setAlpha(60);
+    painter.setBrush(frame);
+    painter.drawRect(QRect(0, top, width() - 1, bottom - top - 1));
+}
+
+bool HexMinimap::event(QEvent* event) {
+    if (event->type() == QEvent::ToolTip && documentSize_ > 0) {
+        auto* help = static_cast<QHelpEvent*>(event);
+        const std::uint64_t offset = offsetAt(help->pos().y());
+        const std::size_t block = static_cast<std::size_t>(offset / blockSize_);
+        QString text = tr("Offset 0x%1").arg(offset, 0, 16);
+        if (block < stats_.size() && stats_[block].known) {
+            const BlockStats& s = stats_[block];
+            text += QLatin1Char('\n') + tr("Entropy %1 bits/byte, %2% zeros, %3% text")
+                                            .arg(s.entropy * 8.0 / 255.0, 0, 'f', 2)
+                                            .arg(s.zeros * 100 / 255)
+                                            .arg(s.ascii * 100 / 255);
+        }
+        QToolTip::showText(help->globalPos(), text, this);
+        return true;
+    }
+    return QWidget::event(event);
+}
+
+void HexMinimap::mousePressEvent(QMouseEvent* event) {
+    if (event->button() == Qt::LeftButton && documentSize_ > 0) {
+        Q_EMIT offsetRequested(offsetAt(event->position().toPoint().y()));
+    }
+}
+
+void HexMinimap::mouseMoveEvent(QMouseEvent* event) {
+    if ((event->buttons() & Qt::LeftButton) && documentSize_ > 0) {
+        Q_EMIT offsetRequested(offsetAt(event->position().toPoint().y()));
+    }
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,63 @@
+/*
+ * Overview strip of byte statistics beside the hex editor view
+ * src/ui/hexminimap.h
+ */
+
+#ifndef PCMANFM_HEXMINIMAP_H
+#define PCMANFM_HEXMINIMAP_H
+
+#include <QImage>
+#include <QWidget>
+
+#include <cstdint>
+#include <vector>
+
+#include "../core/block_stats.h"
+
+namespace PCManFM {
+
+// HexMinimap draws the whole document top to bottom as three stripes: entropy, zero bytes
+// and printable text per block, so compressed, encrypted, padded and textual regions stand
+// out. Blocks arrive as a background scan finishes them and the rest stay blank. The part
+// shown by the hex view is outlined; clicking or dragging asks to scroll there.
+class HexMinimap : public QWidget {
+    Q_OBJECT
+
+   public:
+    explicit HexMinimap(QWidget* parent = nullptr);
+
+    // Forgets all statistics and expects blocks of |blockSize| bytes over |documentSize|.
+    void reset(std::uint64_t documentSize, std::uint64_t blockSize);
+    void setStats(std::uint64_t firstBlock, const std::vector<BlockStats>& stats);
+    std::uint64_t knownBlocks() const { return knownBlocks_; }
+    void setVisibleRange(std::uint64_t start, std::uint64_t end);
+
+    QSize sizeHint() const override;
+
+   Q_SIGNALS:
+    void offsetRequested(std::uint64_t offset);
+
+   protected:
+    bool event(QEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+
+   private:
+    std::uint64_t offsetAt(int y) const;
+    int yForOffset(std::uint64_t offset) const;
+    void renderImage();
+
+    std::uint64_t documentSize_ = 0;
+    std::uint64_t blockSize_ = kStatsBlockSize;
+    std::vector<BlockStats> stats_;
+    std::uint64_t knownBlocks_ = 0;
+    std::uint64_t visibleStart_ = 0;
+    std::uint64_t visibleEnd_ = 0;
+    QImage image_;  // the stripes at the current height, redrawn when stale
+    bool imageStale_ = true;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_HEXMINIMAP_H
@@ -0,0 +1,349 @@
+/*
+ * Side panel previewing the selected file
+ * src/ui/previewpane.cpp
+ */
+
+#include "previewpane.h"
+
+#include <QFile>
+#include <QFontDatabase>
+#include <QFutureWatcher>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLocale>
+#include <QPixmap>
+#include <QPlainTextEdit>
+#include <QStackedWidget>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QtConcurrent>
+
+#include <sys/stat.h>
+
+#include <cstring>
+#include <string>
+
+namespace PCManFM {
+
+namespace {
+
+// a selection that moves again within this is not previewed, as when an arrow key is held
+constexpr int kSettleDelay = 60;
+// how long an archive is listed before the preview shows what was found so far
+constexpr std::chrono::milliseconds kRenderBudget{150};
+constexpr int kThumbnailSize = 256;  // the XDG "large" size
+constexpr int kCacheBytes = 32 * 1024 * 1024;
+constexpr int kRenderThreads = 2;  // the one wanted, while a cancelled one winds down
+
+QString keyOf(const Panel::FileInfo& file) {
+    return QString::fromUtf8(file.path().toString().get()) + QLatin1Char('\n') + QString::number(file.mtime()) +
+           QLatin1Char('\n') + QString::number(file.size());
+}
+
+// Images, and the documents and videos thumbnailers render a page or frame of.
+bool wantsThumbnail(const Panel::FileInfo& file) {
+    if (file.isImage()) {
+        return true;
+    }
+    const char* type = file.mimeType()->name();
+    return std::strncmp(type, "video/", 6) == 0 || std::strcmp(type, "application/pdf") == 0 ||
+           std::strcmp(type, "application/postscript") == 0;
+}
+
+}  // namespace
+
+PreviewPane::PreviewPane(QWidget* parent)
+    : QWidget(parent),
+      cache_(kCacheBytes),
+      thumbnailJob_{nullptr},
+      titleLabel_{new QLabel(this)},
+      infoLabel_{new QLabel(this)},
+      stack_{new QStackedWidget(this)},
+      messageLabel_{new QLabel(stack_)},
+      imageLabel_{new QLabel(stack_)},
+      textView_{new QPlainTextEdit(stack_)},
+      entryTree_{new QTreeWidget(stack_)} {
+    pool_.setMaxThreadCount(kRenderThreads);
+    settleTimer_.setSingleShot(true);
+    connect(&settleTimer_, &QTimer::timeout, this, &PreviewPane::renderNext);
+
+    QFont titleFont = titleLabel_->font();
+    titleFont.setBold(true);
+    titleLabel_->setFont(titleFont);
+    titleLabel_->setWordWrap(true);
+    titleLabel_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    infoLabel_->setWordWrap(true);
+
+    messageLabel_->setAlignment(Qt::AlignCenter);
+    messageLabel_->setWordWrap(true);
+    messageLabel_->setEnabled(false);
+    imageLabel_->setAlignment(Qt::AlignCenter);
+    imageLabel_->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);  // scaled to fit, never grown by
+    textView_->setReadOnly(true);
+    textView_->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    entryTree_->setHeaderLabels({tr("Name"), tr("Size")});
+    entryTree_->setRootIsDecorated(false);
+    entryTree_->setUniformRowHeights(true);
+    entryTree_->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    entryTree_->header()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+    entryTree_->header()->setStretchLastSection(false);
+    stack_->addWidget(messageLabel_);
+    stack_->addWidget(imageLabel_);
+    stack_->addWidget(textView_);
+    stack_->addWidget(entryTree_);
+
+    auto* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addWidget(titleLabel_);
+    layout->addWidget(infoLabel_);
+    layout->addWidget(stack_, 1);
+    showMessage(tr("No file selected"));
+}
+
+PreviewPane::~PreviewPane() {
+    settleTimer_.stop();
+    cancelRender();
+    pool_.waitForDone();
+}
+
+void PreviewPane::setFile(std::shared_ptr<const Panel::FileInfo> file, Panel::FileInfoList neighbors) {
+    file_ = std::move(file);
+    neighbors_ = std::move(neighbors);
+    key_ = file_ && !file_->isDir() ? keyOf(*file_) : QString();
+    if (!renderKey_.isEmpty() && !isWanted(renderKey_)) {
+        cancelRender();
+    }
+
+    if (!file_) {
+        settleTimer_.stop();
+        titleLabel_->clear();
+        infoLabel_->clear();
+        showMessage(tr("No file selected"));
+        return;
+    }
+    titleLabel_->setText(file_->displayName());
+    const QString size = QLocale().formattedDataSize(static_cast<qint64>(file_->size()));
+    infoLabel_->setText(file_->isDir() ? file_->description() : tr("%1, %2").arg(file_->description(), size));
+    if (file_->isDir()) {
+        showMessage(QString());
+    }
+    else if (const Rendered* rendered = cache_.object(key_)) {
+        showRendered(*rendered);
+    }
+    else {
+        showMessage(QString());  // rather than the previous file
+    }
+    settleTimer_.start(kSettleDelay);  // restarted as long as the selection moves
+}
+
+void PreviewPane::resizeEvent(QResizeEvent* event) {
+    QWidget::resizeEvent(event);
+    if (stack_->currentWidget() == imageLabel_) {
+        showImage();
+    }
+}
+
+// Renders the selected file if it is not cached, or else the first neighbor not cached; called
+// again as each render finishes.
+void PreviewPane::renderNext() {
+    if (!renderKey_.isEmpty() || settleTimer_.isActive()) {
+        return;
+    }
+    if (!key_.isEmpty() && !cache_.contains(key_)) {
+        render(file_, false);
+        return;
+    }
+    for (const auto& neighbor : neighbors_) {
+        if (!neighbor->isDir() && !cache_.contains(keyOf(*neighbor))) {
+            render(neighbor, true);
+            return;
+        }
+    }
+}
+
+void PreviewPane::render(const std::shared_ptr<const Panel::FileInfo>& file, bool ahead) {
+    const QString key = keyOf(*file);
+    renderKey_ = key;
+    renderCancel_ = std::make_shared<std::atomic<bool>>(false);
+    if (!file->isNative()) {
+        Rendered rendered;
+        rendered.error = tr("Remote files are not previewed");
+        finishRender(key, std::move(rendered));
+        return;
+    }
+    if (!wantsThumbnail(*file)) {
+        renderContents(file, key);
+        return;
+    }
+
+    // a file no thumbnailer manages is previewed by its contents
+    auto* job = new Panel::ThumbnailJob({file}, kThumbnailSize);
+    job->setAutoDelete(true);
+    thumbnailJob_ = job;
+    connect(
+        job, &Panel::ThumbnailJob::thumbnailLoaded, this,
+        [this, job, key](const std::shared_ptr<const Panel::FileInfo>& file, int, QImage image) {
+            if (job != thumbnailJob_) {  // cancelled
+                return;
+            }
+            thumbnailJob_ = nullptr;
+            if (image.isNull()) {
+                renderContents(file, key);
+                return;
+            }
+            Rendered rendered;
+            rendered.image = std::move(image);
+            finishRender(key, std::move(rendered));
+        },
+        Qt::BlockingQueuedConnection);
+    connect(
+        job, &Panel::ThumbnailJob::finished, this,
+        [this, job, file, key] {
+            if (job == thumbnailJob_) {  // finished without a thumbnail
+                thumbnailJob_ = nullptr;
+                renderContents(file, key);
+            }
+        },
+        Qt::BlockingQueuedConnection);
+    Panel::JobScheduler::globalInstance()->start(
+        job, ahead ? Panel::JobScheduler::Priority::Prefetch : Panel::JobScheduler::Priority::VisibleThumbnails);
+}
+
+void PreviewPane::renderContents(const std::shared_ptr<const Panel::FileInfo>& file, const QString& key) {
+    const auto localPath = file->path().localPath();
+    const std::string path = localPath ? localPath.get() : "";
+    std::shared_ptr<std::atomic<bool>> cancel = renderCancel_;
+    auto* watcher = new QFutureWatcher<Rendered>(this);
+    connect(watcher, &QFutureWatcher<Rendered>::finished, this, [this, watcher, key, cancel] {
+        watcher->deleteLater();
+        if (!cancel->load()) {  // the render of another file may have started since
+            finishRender(key, watcher->result());
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(&pool_, [path, cancel] {
+        QuickPreview::Options options;
+        options.deadline = std::chrono::steady_clock::now() + kRenderBudget;
+        options.cancel = cancel.get();
+        Rendered rendered;
+        FsOps::Error err;
+        if (!QuickPreview::make_preview(path, options, rendered.preview, err)) {
+            rendered.error = PreviewPane::tr("Cannot preview the file: %1").arg(QString::fromStdString(err.message));
+        }
+        return rendered;
+    }));
+}
+
+void PreviewPane::finishRender(const QString& key, Rendered rendered) {
+    renderKey_.clear();
+    renderCancel_.reset();
+    auto* cached = new Rendered(std::move(rendered));
+    if (key == key_) {
+        showRendered(*cached);
+    }
+    const QuickPreview::Preview& preview = cached->preview;
+    const qsizetype cost = cached->image.sizeInBytes() + static_cast<qsizetype>(preview.text.size()) +
+                           static_cast<qsizetype>(preview.head.size()) +
+                           static_cast<qsizetype>(preview.entries.size() * sizeof(ArchiveExtract::EntryInfo)) + 64;
+    cache_.insert(key, cached, cost);
+    renderNext();
+}
+
+void PreviewPane::cancelRender() {
+    if (renderCancel_) {
+        renderCancel_->store(true);
+        renderCancel_.reset();
+    }
+    if (thumbnailJob_) {
+        thumbnailJob_->cancel();
+        thumbnailJob_ = nullptr;
+    }
+    renderKey_.clear();
+}
+
+bool PreviewPane::isWanted(const QString& key) const {
+    if (key == key_) {
+        return true;
+    }
+    for (const auto& neighbor : neighbors_) {
+        if (keyOf(*neighbor) == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PreviewPane::showRendered(const Rendered& rendered) {
+    if (!rendered.error.isEmpty()) {
+        showMessage(rendered.error);
+        return;
+    }
+    if (!rendered.image.isNull()) {
+        image_ = rendered.image;
+        stack_->setCurrentWidget(imageLabel_);
+        showImage();
+        return;
+    }
+
+    const QuickPreview::Preview& preview = rendered.preview;
+    const QString more = QStringLiteral("…");
+    switch (preview.kind) {
+        case QuickPreview::Kind::Empty:
+            showMessage(tr("Empty file"));
+            return;
+        case QuickPreview::Kind::Text: {
+            QString text = QString::fromUtf8(preview.text.data(), static_cast<qsizetype>(preview.text.size()));
+            textView_->setLineWrapMode(QPlainTextEdit::WidgetWidth);
+            textView_->setPlainText(preview.truncated ? text + more : text);
+            break;
+        }
+        case QuickPreview::Kind::Binary: {
+            const std::string dump = QuickPreview::hex_dump(preview.head.data(), preview.head.size());
+            textView_->setLineWrapMode(QPlainTextEdit::NoWrap);
+            textView_->setPlainText(QString::fromLatin1(dump.data(), static_cast<qsizetype>(dump.size())) +
+                                    (preview.truncated ? more : QString()));
+            break;
+        }
+        case QuickPreview::Kind::Archive: {
+            QList<QTreeWidgetItem*> items;
+            items.reserve(static_cast<qsizetype>(preview.entries.size()) + 1);
+            for (const ArchiveExtract::EntryInfo& entry : preview.entries) {
+                auto* item = new QTreeWidgetItem;
+                item->setText(0, QFile::decodeName(QByteArray(entry.path.data(), static_cast<int>(entry.path.size()))));
+                if (S_ISREG(entry.mode)) {
+                    item->setText(1, QLocale().formattedDataSize(static_cast<qint64>(entry.size)));
+                    item->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+                }
+                items.append(item);
+            }
+            if (preview.truncated) {
+                items.append(new QTreeWidgetItem(QStringList{more}));
+            }
+            entryTree_->clear();
+            entryTree_->addTopLevelItems(items);
+            stack_->setCurrentWidget(entryTree_);
+            return;
+        }
+    }
+    textView_->moveCursor(QTextCursor::Start);
+    stack_->setCurrentWidget(textView_);
+}
+
+void PreviewPane::showMessage(const QString& message) {
+    image_ = QImage();
+    messageLabel_->setText(message);
+    stack_->setCurrentWidget(messageLabel_);
+}
+
+void PreviewPane::showImage() {
+    const QSize bounds = imageLabel_->size();
+    if (image_.isNull() || bounds.isEmpty()) {
+        return;
+    }
+    // thumbnails are never enlarged past their size
+    const QImage scaled = image_.width() <= bounds.width() && image_.height() <= bounds.height()
+                              ? image_
+                              : Panel::ImageScaler::scaled(image_, bounds, Qt::KeepAspectRatio);
+    imageLabel_->setPixmap(QPixmap::fromImage(scaled));
+}
+
+}  // namespace PCManFM
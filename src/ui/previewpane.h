@@ -0,0 +1,89 @@
+/*
+ * Side panel previewing the selected file
+ * src/ui/previewpane.h
+ */
+
+#ifndef PCMANFM_PREVIEWPANE_H
+#define PCMANFM_PREVIEWPANE_H
+
+#include <QCache>
+#include <QImage>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <QWidget>
+
+#include <atomic>
+#include <memory>
+
+#include "../core/quick_preview.h"
+#include "../panel/panel.h"
+
+class QLabel;
+class QPlainTextEdit;
+class QStackedWidget;
+class QTreeWidget;
+
+namespace PCManFM {
+
+// Shows the head of a text file, a hex dump of a binary one, the members of an archive, or
+// the large thumbnail of an image, PDF or video. Previews are rendered one at a time off the
+// GUI thread, only once the selection has settled, with archive listings cut off at a time
+// budget; a change of selection cancels the render of a file no longer wanted. Rendered
+// previews are cached, and the files next to the selected one are previewed ahead.
+class PreviewPane : public QWidget {
+    Q_OBJECT
+
+   public:
+    explicit PreviewPane(QWidget* parent = nullptr);
+    ~PreviewPane() override;
+
+    // Previews |file|, or nothing when it is null or a folder. |neighbors| are rendered ahead,
+    // in their order, once it is shown.
+    void setFile(std::shared_ptr<const Panel::FileInfo> file, Panel::FileInfoList neighbors = {});
+
+   protected:
+    void resizeEvent(QResizeEvent* event) override;
+
+   private:
+    // a cached preview
+    struct Rendered {
+        QImage image;                   // a thumbnail, if not null
+        QuickPreview::Preview preview;  // or the contents
+        QString error;                  // or why there is no preview
+    };
+
+    void renderNext();
+    void render(const std::shared_ptr<const Panel::FileInfo>& file, bool ahead);
+    void renderContents(const std::shared_ptr<const Panel::FileInfo>& file, const QString& key);
+    void finishRender(const QString& key, Rendered rendered);
+    void cancelRender();
+    bool isWanted(const QString& key) const;
+    void showRendered(const Rendered& rendered);
+    void showMessage(const QString& message);
+    void showImage();
+
+    std::shared_ptr<const Panel::FileInfo> file_;
+    QString key_;
+    Panel::FileInfoList neighbors_;
+    QCache<QString, Rendered> cache_;  // by key(), costed in bytes
+
+    QString renderKey_;  // being rendered, if not empty
+    std::shared_ptr<std::atomic<bool>> renderCancel_;
+    Panel::ThumbnailJob* thumbnailJob_;
+    QThreadPool pool_;
+    QTimer settleTimer_;
+
+    QLabel* titleLabel_;
+    QLabel* infoLabel_;
+    QStackedWidget* stack_;
+    QLabel* messageLabel_;
+    QLabel* imageLabel_;
+    QImage image_;  // shown by imageLabel_, scaled to fit
+    QPlainTextEdit* textView_;
+    QTreeWidget* entryTree_;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_PREVIEWPANE_H
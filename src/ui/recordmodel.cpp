@@ -0,0 +1,192 @@
+/*
+ * Qt table model decoding fixed-size records of a hex document
+ * src/ui/recordmodel.cpp
+ */
+
+#include "recordmodel.h"
+
+#include <QFontDatabase>
+
+#include <algorithm>
+#include <limits>
+
+namespace PCManFM {
+
+namespace {
+
+const char* typeName(FieldType type) {
+    switch (type) {
+        case FieldType::U8:
+            return "u8";
+        case FieldType::I8:
+            return "i8";
+        case FieldType::U16:
+            return "u16";
+        case FieldType::I16:
+            return "i16";
+        case FieldType::U32:
+            return "u32";
+        case FieldType::I32:
+            return "i32";
+        case FieldType::U64:
+            return "u64";
+        case FieldType::I64:
+            return "i64";
+        case FieldType::F32:
+            return "f32";
+        case FieldType::F64:
+            return "f64";
+        case FieldType::Char:
+            return "char";
+        case FieldType::Byte:
+            return "bytes";
+    }
+    return "";
+}
+
+}  // namespace
+
+RecordModel::RecordModel(QObject* parent) : QAbstractTableModel(parent) {}
+
+int RecordModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : rows_;
+}
+
+int RecordModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() || layout_.empty() ? 0 : static_cast<int>(layout_.fields().size()) + 1;
+}
+
+QVariant RecordModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rows_) {
+        return {};
+    }
+    if (role == Qt::FontRole) {
+        return QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    }
+    if (role == Qt::TextAlignmentRole && index.column() > 0) {
+        const FieldType type = layout_.fields()[static_cast<std::size_t>(index.column() - 1)].type;
+        if (type != FieldType::Char && type != FieldType::Byte) {
+            return QVariant(Qt::AlignRight | Qt::AlignVCenter);
+        }
+        return {};
+    }
+    if (role != Qt::DisplayRole) {
+        return {};
+    }
+    if (index.column() == 0) {
+        return QStringLiteral("0x%1").arg(offsetOfRow(index.row()), 0, 16);
+    }
+    const std::uint8_t* bytes = record(index.row());
+    if (!bytes) {
+        return tr("(unreadable)");
+    }
+    return QString::fromStdString(layout_.format(static_cast<std::size_t>(index.column() - 1), bytes));
+}
+
+QVariant RecordModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation == Qt::Vertical) {
+        return role == Qt::DisplayRole ? QVariant(section) : QVariant();
+    }
+    if (section == 0) {
+        return role == Qt::DisplayRole ? QVariant(tr("Offset")) : QVariant();
+    }
+    if (section > static_cast<int>(layout_.fields().size())) {
+        return {};
+    }
+    const RecordField& field = layout_.fields()[static_cast<std::size_t>(section - 1)];
+    if (role == Qt::DisplayRole) {
+        return QString::fromStdString(field.name);
+    }
+    if (role == Qt::ToolTipRole) {
+        QString type = QString::fromLatin1(typeName(field.type));
+        if (field.size / field.count > 1) {
+            type += field.littleEndian ? QStringLiteral("le") : QStringLiteral("be");
+        }
+        if (field.count > 1) {
+            type += QStringLiteral("[%1]").arg(field.count);
+        }
+        return tr("%1 at +0x%2").arg(type).arg(field.offset, 0, 16);
+    }
+    return {};
+}
+
+void RecordModel::setRecords(HexDocument* doc, const RecordLayout& layout, std::uint64_t start, std::uint64_t count) {
+    beginResetModel();
+    doc_ = doc;
+    layout_ = layout;
+    start_ = start;
+    requested_ = count;
+    pages_.clear();
+    rows_ = fittingRows();
+    endResetModel();
+}
+
+void RecordModel::clear() {
+    beginResetModel();
+    doc_ = nullptr;
+    layout_ = RecordLayout();
+    start_ = 0;
+    requested_ = 0;
+    rows_ = 0;
+    pages_.clear();
+    endResetModel();
+}
+
+void RecordModel::refresh() {
+    pages_.clear();
+    const int rows = fittingRows();
+    if (rows != rows_) {
+        beginResetModel();
+        rows_ = rows;
+        endResetModel();
+        return;
+    }
+    if (rows_ > 0) {
+        Q_EMIT dataChanged(index(0, 1), index(rows_ - 1, columnCount() - 1), {Qt::DisplayRole});
+    }
+}
+
+int RecordModel::fittingRows() const {
+    if (!doc_ || layout_.empty() || start_ >= doc_->size()) {
+        return 0;
+    }
+    const std::uint64_t fit = (doc_->size() - start_) / layout_.recordSize();
+    return static_cast<int>(std::min<std::uint64_t>({requested_, fit, std::numeric_limits<int>::max()}));
+}
+
+const std::uint8_t* RecordModel::record(int row) const {
+    if (!doc_) {
+        return nullptr;
+    }
+    const std::uint64_t pageIndex = static_cast<std::uint64_t>(row) / kRecordsPerPage;
+    const std::uint64_t within = static_cast<std::uint64_t>(row) % kRecordsPerPage;
+    const std::uint64_t recordSize = layout_.recordSize();
+    auto it = std::find_if(pages_.begin(), pages_.end(), [pageIndex](const Page& page) {
+        return page.index == pageIndex;
+    });
+    if (it == pages_.end()) {
+        const std::uint64_t firstRow = pageIndex * kRecordsPerPage;
+        const std::uint64_t rows =
+            std::min<std::uint64_t>(kRecordsPerPage, static_cast<std::uint64_t>(rows_) - firstRow);
+        Page page;
+        page.index = pageIndex;
+        QString error;
+        if (!doc_->readBytes(start_ + firstRow * recordSize, rows * recordSize, page.bytes, error)) {
+            return nullptr;
+        }
+        if (pages_.size() >= kCachedPages) {
+            pages_.erase(std::min_element(pages_.begin(), pages_.end(), [](const Page& a, const Page& b) {
+                return a.lastUse < b.lastUse;
+            }));
+        }
+        pages_.push_back(std::move(page));
+        it = pages_.end() - 1;
+    }
+    it->lastUse = ++clock_;
+    if (static_cast<std::uint64_t>(it->bytes.size()) < (within + 1) * recordSize) {
+        return nullptr;  // short read at the end of a file that shrank
+    }
+    return reinterpret_cast<const std::uint8_t*>(it->bytes.constData()) + within * recordSize;
+}
+
+}  // namespace PCManFM
@@ -0,0 +1,72 @@
+/*
+ * Qt table model decoding fixed-size records of a hex document
+ * src/ui/recordmodel.h
+ */
+
+#ifndef PCMANFM_RECORDMODEL_H
+#define PCMANFM_RECORDMODEL_H
+
+#include <QAbstractTableModel>
+#include <QByteArray>
+#include <QPointer>
+
+#include <cstdint>
+#include <vector>
+
+#include "hexdocument.h"
+#include "../core/record_layout.h"
+
+namespace PCManFM {
+
+// RecordModel lists an array of fixed-size records in a HexDocument, one row per record and
+// a column per field of a RecordLayout after the offset. Nothing is decoded up front: a cell
+// reads the page of records around it and the most recently used pages are kept, so a view
+// over millions of records only ever reads and formats what it shows.
+class RecordModel : public QAbstractTableModel {
+    Q_OBJECT
+
+   public:
+    explicit RecordModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override;
+
+    // Shows up to |count| records of |layout| from |start| in |doc|, as many as fit in the
+    // document and in an int row count.
+    void setRecords(HexDocument* doc, const RecordLayout& layout, std::uint64_t start, std::uint64_t count);
+    void clear();
+    // Rereads the records after the document changed.
+    void refresh();
+
+    const RecordLayout& layout() const { return layout_; }
+    std::uint64_t start() const { return start_; }
+    std::uint64_t offsetOfRow(int row) const { return start_ + static_cast<std::uint64_t>(row) * layout_.recordSize(); }
+
+   private:
+    static constexpr std::uint64_t kRecordsPerPage = 256;
+    static constexpr std::size_t kCachedPages = 32;
+
+    struct Page {
+        std::uint64_t index = 0;
+        QByteArray bytes;
+        std::uint64_t lastUse = 0;
+    };
+
+    int fittingRows() const;
+    // The bytes of the record on |row|, or null if it cannot be read.
+    const std::uint8_t* record(int row) const;
+
+    QPointer<HexDocument> doc_;
+    RecordLayout layout_;
+    std::uint64_t start_ = 0;
+    std::uint64_t requested_ = 0;
+    int rows_ = 0;
+    mutable std::vector<Page> pages_;
+    mutable std::uint64_t clock_ = 0;
+};
+
+}  // namespace PCManFM
+
+#endif  // PCMANFM_RECORDMODEL_H
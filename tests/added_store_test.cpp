@@ -0,0 +1,130 @@
+/*
+ * Tests for the hex editor added bytes store
+ * tests/added_store_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/added_store.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::vector<std::uint8_t> pattern(std::size_t length, std::uint8_t seed) {
+    std::vector<std::uint8_t> bytes(length);
+    for (std::size_t i = 0; i < length; ++i) {
+        bytes[i] = static_cast<std::uint8_t>(seed + i * 7 + i / 251);
+    }
+    return bytes;
+}
+
+std::vector<std::uint8_t> read(const AddedStore::View& view, std::uint64_t offset, std::size_t length) {
+    std::vector<std::uint8_t> bytes(length);
+    view.copy(offset, length, bytes.data());
+    return bytes;
+}
+
+}  // namespace
+
+class AddedStoreTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void keepsSmallEditsInMemory();
+    void spillsPastTheMemoryLimit();
+    void viewsOutliveClear();
+    void appendsFromAFile();
+};
+
+void AddedStoreTest::keepsSmallEditsInMemory() {
+    AddedStore store;
+    std::string err;
+    std::uint64_t offset = 0;
+    for (std::uint8_t i = 0; i < 100; ++i) {
+        QVERIFY(store.append(&i, 1, offset, err));
+        QCOMPARE(offset, std::uint64_t(i));
+    }
+    QCOMPARE(store.size(), std::uint64_t(100));
+    QCOMPARE(store.residentBytes(), std::uint64_t(100));
+    QCOMPARE(store.spilledBytes(), std::uint64_t(0));
+
+    std::size_t available = 0;
+    const std::uint8_t* data = store.span(10, 50, available);
+    QCOMPARE(available, std::size_t(50));
+    QCOMPARE(int(data[0]), 10);
+    store.span(100, 1, available);
+    QCOMPARE(available, std::size_t(0));
+}
+
+void AddedStoreTest::spillsPastTheMemoryLimit() {
+    // one memory chunk, then the temporary file
+    AddedStore store(AddedStore::kMemoryChunkSize);
+    std::string err;
+    const auto first = pattern(AddedStore::kMemoryChunkSize - 100, 1);
+    const auto second = pattern(20 * 1024 * 1024, 2);  // from the memory chunk into the file
+    std::uint64_t firstOffset = 0;
+    std::uint64_t secondOffset = 0;
+    QVERIFY2(store.append(first.data(), first.size(), firstOffset, err), err.c_str());
+    QVERIFY2(store.append(second.data(), second.size(), secondOffset, err), err.c_str());
+    QCOMPARE(secondOffset, std::uint64_t(first.size()));
+    QCOMPARE(store.residentBytes(), std::uint64_t(AddedStore::kMemoryChunkSize));
+    QCOMPARE(store.spilledBytes(), std::uint64_t(first.size() + second.size() - AddedStore::kMemoryChunkSize));
+
+    const auto view = store.view();
+    QVERIFY(read(view, firstOffset, first.size()) == first);
+    QVERIFY(read(view, secondOffset, second.size()) == second);
+
+    // a span stops at the end of its chunk
+    std::size_t available = 0;
+    view.span(secondOffset, second.size(), available);
+    QCOMPARE(available, std::size_t(100));
+}
+
+void AddedStoreTest::viewsOutliveClear() {
+    AddedStore store(0);
+    std::string err;
+    const auto bytes = pattern(4096, 3);
+    std::uint64_t offset = 0;
+    QVERIFY2(store.append(bytes.data(), bytes.size(), offset, err), err.c_str());
+    const auto view = store.view();
+
+    // appended after the view was taken: not part of it
+    QVERIFY(store.append(bytes.data(), bytes.size(), offset, err));
+    QCOMPARE(view.size(), std::uint64_t(bytes.size()));
+
+    store.clear();
+    QCOMPARE(store.size(), std::uint64_t(0));
+    QVERIFY(read(view, 0, bytes.size()) == bytes);
+}
+
+void AddedStoreTest::appendsFromAFile() {
+    char path[] = "/tmp/added-store-test.XXXXXX";
+    const int fd = ::mkstemp(path);
+    QVERIFY(fd >= 0);
+    ::unlink(path);
+    const auto bytes = pattern(100000, 4);
+    QCOMPARE(::write(fd, bytes.data(), bytes.size()), ssize_t(bytes.size()));
+
+    AddedStore store(0);
+    std::string err;
+    std::uint64_t offset = 0;
+    QVERIFY2(store.appendFrom(fd, 1000, 50000, offset, err), err.c_str());
+    QCOMPARE(offset, std::uint64_t(0));
+    QVERIFY(read(store.view(), 0, 50000) == std::vector<std::uint8_t>(bytes.begin() + 1000, bytes.begin() + 51000));
+
+    // past the end of the file: fails without appending anything
+    QVERIFY(!store.appendFrom(fd, 90000, 20000, offset, err));
+    QVERIFY(!err.empty());
+    QCOMPARE(store.size(), std::uint64_t(50000));
+    ::close(fd);
+}
+
+QTEST_MAIN(AddedStoreTest)
+#include "added_store_test.moc"
@@ -7,16 +7,22 @@
 #include <QTemporaryDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QDir>
 
 #include <archive.h>
 #include <archive_entry.h>
 
 #include "../src/core/archive_extract.h"
+#include "../src/core/archive_writer.h"
 #include "../src/core/fs_ops.h"
 
 #include <vector>
 #include <string>
 #include <cerrno>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
 
 using PCManFM::ArchiveExtract::Options;
 using PCManFM::FsOps::Error;
@@ -157,6 +163,59 @@ bool write_archive_with_symlink(const QString& path,
     return true;
 }
 
+// Writes |files| (path -> contents) as an uncompressed archive of |format|, preceded by a
+// directory entry for "tree" so its metadata can be checked after extraction.
+bool write_archive_tree(const QString& path,
+                        const std::vector<std::pair<QString, QByteArray>>& files,
+                        const QString& format,
+                        QString* errorOut) {
+    struct archive* ar = archive_write_new();
+    if (!ar) {
+        *errorOut = QStringLiteral("archive_write_new failed");
+        return false;
+    }
+    archive_write_add_filter_none(ar);
+    if (archive_write_set_format_by_name(ar, format.toUtf8().constData()) != ARCHIVE_OK ||
+        archive_write_open_filename(ar, path.toUtf8().constData()) != ARCHIVE_OK) {
+        *errorOut = QStringLiteral("open failed: %1").arg(QString::fromUtf8(archive_error_string(ar)));
+        archive_write_free(ar);
+        return false;
+    }
+
+    archive_entry* dirEntry = archive_entry_new();
+    archive_entry_set_pathname(dirEntry, "tree/");
+    archive_entry_set_filetype(dirEntry, AE_IFDIR);
+    archive_entry_set_perm(dirEntry, 0755);
+    archive_entry_set_mtime(dirEntry, 1000000000, 0);
+    const bool dirOk = archive_write_header(ar, dirEntry) == ARCHIVE_OK;
+    archive_entry_free(dirEntry);
+    if (!dirOk) {
+        *errorOut = QStringLiteral("write dir failed: %1").arg(QString::fromUtf8(archive_error_string(ar)));
+        archive_write_free(ar);
+        return false;
+    }
+
+    for (const auto& file : files) {
+        archive_entry* entry = archive_entry_new();
+        archive_entry_set_pathname(entry, file.first.toUtf8().constData());
+        archive_entry_set_size(entry, file.second.size());
+        archive_entry_set_filetype(entry, AE_IFREG);
+        archive_entry_set_perm(entry, 0644);
+        const bool ok = archive_write_header(ar, entry) == ARCHIVE_OK &&
+                        archive_write_data(ar, file.second.constData(), static_cast<size_t>(file.second.size())) >= 0;
+        archive_entry_free(entry);
+        if (!ok) {
+            *errorOut = QStringLiteral("write file failed: %1").arg(QString::fromUtf8(archive_error_string(ar)));
+            archive_write_free(ar);
+            return false;
+        }
+    }
+
+    archive_write_close(ar);
+    archive_write_free(ar);
+    return true;
+}
+
 QString readFile(const QString& path) {
     QFile f(path);
     if (!f.open(QIODevice::ReadOnly)) {
@@ -176,6 +235,15 @@ class ArchiveExtractTest : public QObject {
     void extractPreservesSymlinkInTar();
     void cancelStopsAndCleansUp();
     void rejectsUnsafePaths();
+    void extractZeroRunsKeepsContent();
+    void extractZipWithMemberThreads();
+    void extractTarZstWithWriterThreads();
+    void listAndExtractMemberFromIndexedTarZst();
+    void createTarZstWithPrefetchReaders();
+    void updateTarZstAppendsChangedMembers();
+    void createZipWithCompressorThreads();
+    void extractZipMembersThroughCentralDirectory();
+    void extractDedupSharesIdenticalMembers();
 };
 
 void ArchiveExtractTest::extractKnownFormats_data() {
@@ -331,5 +399,478 @@ void ArchiveExtractTest::rejectsUnsafePaths() {
     QVERIFY(!QFileInfo::exists(destDir));
 }
 
+void ArchiveExtractTest::extractZeroRunsKeepsContent() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Leading data, a zero run big enough to be skipped as a hole, and trailing zeros that
+    // must still be present after extraction.
+    QByteArray payload(64 * 1024, '\0');
+    payload.replace(0, 5, "head!");
+    payload.replace(40 * 1024, 5, "tail!");
+
+    const QString archivePath = dir.path() + QLatin1String("/zeros.zip");
+    QString error;
+    QVERIFY2(write_archive_file(archivePath, QStringLiteral("zeros.bin"), payload, QStringLiteral("zip"),
+                                QStringLiteral(""), &error),
+             qPrintable(error));
+
+    const QString destDir = dir.path() + QLatin1String("/out-zeros");
+    ProgressInfo progress;
+    Error err;
+    auto cb = [](const ProgressInfo&) { return true; };
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archivePath.toLocal8Bit().toStdString(),
+                                                      destDir.toLocal8Bit().toStdString(), progress, cb, err),
+             err.message.c_str());
+
+    QFile extracted(destDir + QLatin1String("/zeros.bin"));
+    QVERIFY(extracted.open(QIODevice::ReadOnly));
+    QCOMPARE(extracted.readAll(), payload);
+}
+
+void ArchiveExtractTest::extractZipWithMemberThreads() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    std::vector<std::pair<QString, QByteArray>> files;
+    for (int i = 0; i < 64; ++i) {
+        QByteArray data;
+        for (int line = 0; line < (i + 1) * 200; ++line) {
+            data += QByteArray::number(i) + ':' + QByteArray::number(line) + '\n';
+        }
+        files.emplace_back(QStringLiteral("tree/sub%1/file%2.txt").arg(i % 4).arg(i), data);
+    }
+    files.emplace_back(QStringLiteral("tree/empty.txt"), QByteArray());
+
+    const QString archivePath = dir.path() + QLatin1String("/tree.zip");
+    QString error;
+    QVERIFY2(write_archive_tree(archivePath, files, QStringLiteral("zip"), &error), qPrintable(error));
+
+    const QString destDir = dir.path() + QLatin1String("/out-tree");
+    ProgressInfo progress;
+    Error err;
+    int callbacks = 0;
+    auto cb = [&callbacks](const ProgressInfo&) {
+        ++callbacks;  // serialized by extract_archive, so no atomic needed
+        return true;
+    };
+    Options opts;
+    opts.memberThreads = 4;
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archivePath.toLocal8Bit().toStdString(),
+                                                      destDir.toLocal8Bit().toStdString(), progress, cb, err, opts),
+             err.message.c_str());
+
+    for (const auto& file : files) {
+        QFile extracted(destDir + QLatin1Char('/') + file.first);
+        QVERIFY2(extracted.open(QIODevice::ReadOnly), qPrintable(file.first));
+        QCOMPARE(extracted.readAll(), file.second);
+    }
+    QCOMPARE(progress.filesDone, progress.filesTotal);
+    QCOMPARE(progress.bytesDone, progress.bytesTotal);
+    QVERIFY(callbacks > 0);
+
+    // Directory metadata is applied after the member readers filled the directory.
+    QCOMPARE(QFileInfo(destDir + QLatin1String("/tree")).lastModified().toSecsSinceEpoch(), qint64(1000000000));
+}
+
+void ArchiveExtractTest::extractTarZstWithWriterThreads() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    std::vector<std::pair<QString, QByteArray>> files;
+    for (int i = 0; i < 200; ++i) {
+        QByteArray data;
+        for (int line = 0; line < (i + 1) * 40; ++line) {
+            data += QByteArray::number(i) + ':' + QByteArray::number(line) + '\n';
+        }
+        files.emplace_back(QStringLiteral("tree/sub%1/file%2.txt").arg(i % 4).arg(i), data);
+    }
+    // too large to be buffered, so written by the decoder between the writers' files
+    files.emplace_back(QStringLiteral("tree/large.bin"), QByteArray(9 * 1024 * 1024, 'L'));
+    // a later member of the same path must replace the earlier one
+    files.emplace_back(QStringLiteral("tree/sub0/file0.txt"), QByteArray("replaced"));
+
+    const QString archivePath = dir.path() + QLatin1String("/tree.tar");
+    QString error;
+    QVERIFY2(write_archive_tree(archivePath, files, QStringLiteral("ustar"), &error), qPrintable(error));
+
+    const QString destDir = dir.path() + QLatin1String("/out-tree");
+    ProgressInfo progress;
+    Error err;
+    int callbacks = 0;
+    auto cb = [&callbacks](const ProgressInfo&) {
+        ++callbacks;  // only called on the decoding thread
+        return true;
+    };
+    Options opts;
+    opts.writerThreads = 4;
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archivePath.toLocal8Bit().toStdString(),
+                                                      destDir.toLocal8Bit().toStdString(), progress, cb, err, opts),
+             err.message.c_str());
+
+    for (std::size_t i = 1; i < files.size(); ++i) {  // files[0] was replaced by the last member
+        const QString path = destDir + QLatin1Char('/') + files[i].first;
+        QFile extracted(path);
+        QVERIFY2(extracted.open(QIODevice::ReadOnly), qPrintable(files[i].first));
+        QCOMPARE(extracted.readAll(), files[i].second);
+        struct stat st{};
+        QCOMPARE(::stat(path.toLocal8Bit().constData(), &st), 0);
+        QCOMPARE(st.st_mode & 07777, mode_t(0644));
+    }
+    QCOMPARE(progress.filesDone, progress.filesTotal);
+    QCOMPARE(progress.bytesDone, progress.bytesTotal);
+    QVERIFY(callbacks > 0);
+
+    // Directory metadata is applied after the writers filled the directory.
+    QCOMPARE(QFileInfo(destDir + QLatin1String("/tree")).lastModified().toSecsSinceEpoch(), qint64(1000000000));
+}
+
+void ArchiveExtractTest::listAndExtractMemberFromIndexedTarZst() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcRoot = dir.path() + QLatin1String("/backup");
+    QVERIFY(QDir().mkpath(srcRoot + QLatin1String("/nested")));
+    QByteArray wanted;
+    for (int i = 0; i < 40; ++i) {
+        QByteArray data;
+        for (int line = 0; line < 4000; ++line) {
+            data += QByteArray::number(i * 7919 + line) + '\n';
+        }
+        QFile f(srcRoot + QStringLiteral("/nested/part%1.txt").arg(i));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(data);
+        if (i == 29) {
+            wanted = data;
+        }
+    }
+
+    const QString archivePath = dir.path() + QLatin1String("/backup.tar.zst");
+    ProgressInfo progress;
+    Error err;
+    PCManFM::ArchiveWriter::Options writeOpts;
+    writeOpts.frameSize = 64 * 1024;  // many frames, so the member sits far into the stream
+    QVERIFY2(PCManFM::ArchiveWriter::create_tar_zst({srcRoot.toLocal8Bit().toStdString()},
+                                                    archivePath.toLocal8Bit().toStdString(), progress, {}, err,
+                                                    writeOpts),
+             err.message.c_str());
+
+    std::vector<PCManFM::ArchiveExtract::EntryInfo> entries;
+    QVERIFY2(PCManFM::ArchiveExtract::list_entries(archivePath.toLocal8Bit().toStdString(),
+                                                   [&entries](const PCManFM::ArchiveExtract::EntryInfo& info) {
+                                                       entries.push_back(info);
+                                                       return true;
+                                                   },
+                                                   err),
+             err.message.c_str());
+    QCOMPARE(entries.size(), std::size_t(42));  // backup/, nested/ and the parts
+    bool sawWanted = false;
+    for (const auto& e : entries) {
+        if (e.path == "backup/nested/part29.txt") {
+            sawWanted = true;
+            QVERIFY(S_ISREG(e.mode));
+            QCOMPARE(e.size, static_cast<std::uint64_t>(wanted.size()));
+        }
+    }
+    QVERIFY(sawWanted);
+
+    const QString outPath = dir.path() + QLatin1String("/restored.txt");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_entry(archivePath.toLocal8Bit().toStdString(),
+                                                    "backup/nested/part29.txt", outPath.toLocal8Bit().toStdString(),
+                                                    progress, {}, err),
+             err.message.c_str());
+    QFile restored(outPath);
+    QVERIFY(restored.open(QIODevice::ReadOnly));
+    QCOMPARE(restored.readAll(), wanted);
+
+    const QString missingPath = dir.path() + QLatin1String("/missing");
+    QVERIFY(!PCManFM::ArchiveExtract::extract_entry(archivePath.toLocal8Bit().toStdString(), "backup/missing",
+                                                    missingPath.toLocal8Bit().toStdString(), progress, {}, err));
+    QCOMPARE(err.code, ENOENT);
+
+    // The seekable layout is still an ordinary tar.zst for the full extractor.
+    const QString destDir = dir.path() + QLatin1String("/out-full");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archivePath.toLocal8Bit().toStdString(),
+                                                      destDir.toLocal8Bit().toStdString(), progress, {}, err),
+             err.message.c_str());
+    QFile full(destDir + QLatin1String("/backup/nested/part29.txt"));
+    QVERIFY(full.open(QIODevice::ReadOnly));
+    QCOMPARE(full.readAll(), wanted);
+}
+
+void ArchiveExtractTest::createTarZstWithPrefetchReaders() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcRoot = dir.path() + QLatin1String("/photos");
+    std::vector<std::pair<QString, QByteArray>> files;
+    for (int i = 0; i < 120; ++i) {
+        files.emplace_back(QStringLiteral("album%1/img%2.txt").arg(i % 5).arg(i),
+                           QByteArray::number(i * 104729).repeated(i * 13));
+    }
+    QByteArray large;
+    for (int line = 0; line < 100000; ++line) {
+        large += QByteArray::number(line * 31) + '\n';
+    }
+    files.emplace_back(QStringLiteral("large.txt"), large);  // several times the read-ahead pool
+    for (const auto& file : files) {
+        const QString path = srcRoot + QLatin1Char('/') + file.first;
+        QVERIFY(QDir().mkpath(QFileInfo(path).absolutePath()));
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(file.second);
+    }
+
+    const QString archivePath = dir.path() + QLatin1String("/photos.tar.zst");
+    ProgressInfo progress;
+    Error err;
+    PCManFM::ArchiveWriter::Options writeOpts;
+    writeOpts.readerThreads = 3;
+    writeOpts.prefetchBytes = 1;  // smallest pool, so readers keep waiting on the archive thread
+    QVERIFY2(PCManFM::ArchiveWriter::create_tar_zst({srcRoot.toLocal8Bit().toStdString()},
+                                                    archivePath.toLocal8Bit().toStdString(), progress, {}, err,
+                                                    writeOpts),
+             err.message.c_str());
+    QCOMPARE(progress.bytesDone, progress.bytesTotal);
+    QCOMPARE(progress.filesDone, static_cast<int>(files.size()) + 6);  // plus photos/ and the albums
+
+    const QString destDir = dir.path() + QLatin1String("/out");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archivePath.toLocal8Bit().toStdString(),
+                                                      destDir.toLocal8Bit().toStdString(), progress, {}, err),
+             err.message.c_str());
+    for (const auto& file : files) {
+        QFile extracted(destDir + QLatin1String("/photos/") + file.first);
+        QVERIFY2(extracted.open(QIODevice::ReadOnly), qPrintable(file.first));
+        QCOMPARE(extracted.readAll(), file.second);
+    }
+}
+
+void ArchiveExtractTest::updateTarZstAppendsChangedMembers() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcRoot = dir.path() + QLatin1String("/nightly");
+    const auto writeFile = [&srcRoot](const QString& name, const QByteArray& data, qint64 mtime) {
+        const QString path = srcRoot + QLatin1Char('/') + name;
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QFile f(path);
+        if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size()) {
+            return false;
+        }
+        f.close();
+        const struct timespec times[2] = {{mtime, 0}, {mtime, 0}};
+        return ::utimensat(AT_FDCWD, QFile::encodeName(path).constData(), times, 0) == 0;
+    };
+    for (int i = 0; i < 30; ++i) {
+        QVERIFY(writeFile(QStringLiteral("build%1.log").arg(i), QByteArray::number(i * 7).repeated(4000), 1000000000));
+    }
+
+    const QString archivePath = dir.path() + QLatin1String("/nightly.tar.zst");
+    const std::string archive = archivePath.toLocal8Bit().toStdString();
+    const std::vector<std::string> sources{srcRoot.toLocal8Bit().toStdString()};
+    ProgressInfo progress;
+    Error err;
+    PCManFM::ArchiveWriter::Options writeOpts;
+    writeOpts.frameSize = 16 * 1024;  // the end marker usually straddles two frames
+    QVERIFY2(PCManFM::ArchiveWriter::create_tar_zst(sources, archive, progress, {}, err, writeOpts),
+             err.message.c_str());
+
+    // Only the changed and the new file are compressed again.
+    QVERIFY(writeFile(QStringLiteral("build3.log"), "rebuilt\n", 1000000100));
+    QVERIFY(writeFile(QStringLiteral("build30.log"), "new\n", 1000000100));
+    QVERIFY2(PCManFM::ArchiveWriter::update_tar_zst(sources, archive, progress, {}, err, writeOpts),
+             err.message.c_str());
+    QCOMPARE(progress.bytesTotal, std::uint64_t(12));
+
+    int listed = 0;
+    QVERIFY(PCManFM::ArchiveExtract::list_entries(
+        archive,
+        [&listed](const PCManFM::ArchiveExtract::EntryInfo& info) {
+            ++listed;
+            return info.path != "nightly/build3.log" || info.size == 8;
+        },
+        err));
+    QCOMPARE(listed, 32);  // the directory (added again, its mtime moved) and 31 files, each once
+
+    const QString destDir = dir.path() + QLatin1String("/out");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archive, destDir.toLocal8Bit().toStdString(), progress, {}, err),
+             err.message.c_str());
+    QCOMPARE(readFile(destDir + QLatin1String("/nightly/build3.log")), QStringLiteral("rebuilt\n"));
+    QCOMPARE(readFile(destDir + QLatin1String("/nightly/build30.log")), QStringLiteral("new\n"));
+    QCOMPARE(readFile(destDir + QLatin1String("/nightly/build4.log")), QString::number(28).repeated(4000));
+
+    // Compaction drops the replaced copy and keeps everything else.
+    const qint64 grown = QFileInfo(archivePath).size();
+    QVERIFY2(PCManFM::ArchiveWriter::compact_tar_zst(archive, progress, {}, err, writeOpts), err.message.c_str());
+    QVERIFY(QFileInfo(archivePath).size() < grown);
+    const QString compactDir = dir.path() + QLatin1String("/compact");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archive, compactDir.toLocal8Bit().toStdString(), progress, {},
+                                                      err),
+             err.message.c_str());
+    QCOMPARE(readFile(compactDir + QLatin1String("/nightly/build3.log")), QStringLiteral("rebuilt\n"));
+    QCOMPARE(progress.filesDone, 32);
+}
+
+void ArchiveExtractTest::createZipWithCompressorThreads() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcRoot = dir.path() + QLatin1String("/docs");
+    std::vector<std::pair<QString, QByteArray>> files;
+    for (int i = 0; i < 40; ++i) {
+        files.emplace_back(QStringLiteral("part%1/note%2.txt").arg(i % 3).arg(i),
+                           QByteArray::number(i * 7919).repeated(i * 17));
+    }
+    QByteArray large;
+    for (int line = 0; line < 400000; ++line) {
+        large += QByteArray::number(line % 1013) + " words\n";
+    }
+    files.emplace_back(QStringLiteral("large.txt"), large);  // several deflate blocks
+    QByteArray noise(200000, '\0');
+    quint32 x = 1;
+    for (char& c : noise) {
+        x = x * 1103515245 + 12345;
+        c = static_cast<char>(x >> 16);
+    }
+    files.emplace_back(QStringLiteral("photo.jpg"), noise);  // stored as it is
+    files.emplace_back(QStringLiteral("empty.txt"), QByteArray());
+    qint64 inputBytes = 0;
+    for (const auto& file : files) {
+        const QString path = srcRoot + QLatin1Char('/') + file.first;
+        QVERIFY(QDir().mkpath(QFileInfo(path).absolutePath()));
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(file.second);
+        inputBytes += file.second.size();
+    }
+
+    const QString archivePath = dir.path() + QLatin1String("/docs.zip");
+    ProgressInfo progress;
+    Error err;
+    PCManFM::ArchiveWriter::ZipOptions zipOpts;
+    zipOpts.compressThreads = 3;
+    QVERIFY2(PCManFM::ArchiveWriter::create_zip({srcRoot.toLocal8Bit().toStdString()},
+                                                archivePath.toLocal8Bit().toStdString(), progress, {}, err, zipOpts),
+             err.message.c_str());
+    QCOMPARE(progress.bytesDone, progress.bytesTotal);
+    QCOMPARE(progress.filesDone, static_cast<int>(files.size()) + 4);  // plus docs/ and the parts
+    QVERIFY(QFileInfo(archivePath).size() < inputBytes / 2);
+
+    const QString destDir = dir.path() + QLatin1String("/out");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archivePath.toLocal8Bit().toStdString(),
+                                                      destDir.toLocal8Bit().toStdString(), progress, {}, err),
+             err.message.c_str());
+    for (const auto& file : files) {
+        QFile extracted(destDir + QLatin1String("/docs/") + file.first);
+        QVERIFY2(extracted.open(QIODevice::ReadOnly), qPrintable(file.first));
+        QCOMPARE(extracted.readAll(), file.second);
+    }
+}
+
+void ArchiveExtractTest::extractZipMembersThroughCentralDirectory() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    std::vector<std::pair<QString, QByteArray>> files;
+    std::uint64_t totalBytes = 0;
+    for (int i = 0; i < 24; ++i) {
+        const QByteArray data = QByteArray::number(i * 31).repeated((i + 1) * 300);
+        files.emplace_back(QStringLiteral("tree/sub%1/file%2.txt").arg(i % 4).arg(i), data);
+        totalBytes += data.size();
+    }
+    const QString archivePath = dir.path() + QLatin1String("/tree.zip");
+    QString error;
+    QVERIFY2(write_archive_tree(archivePath, files, QStringLiteral("zip"), &error), qPrintable(error));
+    const std::string archive = archivePath.toLocal8Bit().toStdString();
+
+    // The totals come from the central directory, before any member is decoded.
+    ProgressInfo progress;
+    Error err;
+    std::uint64_t firstTotal = 0;
+    auto cb = [&firstTotal](const ProgressInfo& info) {
+        if (firstTotal == 0) {
+            firstTotal = info.bytesTotal;
+        }
+        return true;
+    };
+    const QString destDir = dir.path() + QLatin1String("/all");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archive, destDir.toLocal8Bit().toStdString(), progress, cb, err),
+             err.message.c_str());
+    QCOMPARE(firstTotal, totalBytes);
+    QCOMPARE(progress.bytesDone, totalBytes);
+    QCOMPARE(progress.filesDone, progress.filesTotal);
+
+    // A directory selects everything below it; the rest of the archive is left alone.
+    const QString partDir = dir.path() + QLatin1String("/part");
+    QVERIFY2(PCManFM::ArchiveExtract::extract_members(archive, {"tree/sub1", "tree/sub2/file6.txt"},
+                                                      partDir.toLocal8Bit().toStdString(), progress, {}, err),
+             err.message.c_str());
+    std::uint64_t selectedBytes = 0;
+    for (const auto& file : files) {
+        const bool selected =
+            file.first.startsWith(QLatin1String("tree/sub1/")) || file.first == QLatin1String("tree/sub2/file6.txt");
+        QFile extracted(partDir + QLatin1Char('/') + file.first);
+        QCOMPARE(extracted.exists(), selected);
+        if (selected) {
+            QVERIFY(extracted.open(QIODevice::ReadOnly));
+            QCOMPARE(extracted.readAll(), file.second);
+            selectedBytes += file.second.size();
+        }
+    }
+    QCOMPARE(progress.bytesTotal, selectedBytes);
+    QCOMPARE(progress.bytesDone, selectedBytes);
+
+    QVERIFY(!PCManFM::ArchiveExtract::extract_members(archive, {"tree/missing.txt"},
+                                                      partDir.toLocal8Bit().toStdString(), progress, {}, err));
+    QCOMPARE(err.code, ENOENT);
+}
+
+void ArchiveExtractTest::extractDedupSharesIdenticalMembers() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QByteArray dup = QByteArray("same bytes in every copy\n").repeated(500);
+    const std::vector<std::pair<QString, QByteArray>> files = {
+        {QStringLiteral("tree/a.txt"), dup},
+        {QStringLiteral("tree/b.txt"), dup},
+        {QStringLiteral("tree/other.txt"), QByteArray("different")},
+        {QStringLiteral("tree/sub/c.txt"), dup},
+    };
+    const QString archivePath = dir.path() + QLatin1String("/dups.tar");
+    QString error;
+    QVERIFY2(write_archive_tree(archivePath, files, QStringLiteral("ustar"), &error), qPrintable(error));
+
+    const QString destDir = dir.path() + QLatin1String("/out-dups");
+    ProgressInfo progress;
+    Error err;
+    Options opts;
+    opts.dedupMembers = true;
+    QVERIFY2(PCManFM::ArchiveExtract::extract_archive(archivePath.toLocal8Bit().toStdString(),
+                                                      destDir.toLocal8Bit().toStdString(), progress, {}, err, opts),
+             err.message.c_str());
+    QCOMPARE(progress.filesDone, progress.filesTotal);
+    QCOMPARE(progress.bytesDone, progress.bytesTotal);
+
+    std::vector<struct stat> stats;
+    for (const auto& file : files) {
+        const QString path = destDir + QLatin1Char('/') + file.first;
+        QFile extracted(path);
+        QVERIFY2(extracted.open(QIODevice::ReadOnly), qPrintable(file.first));
+        QCOMPARE(extracted.readAll(), file.second);
+        struct stat st{};
+        QCOMPARE(::stat(path.toLocal8Bit().constData(), &st), 0);
+        QCOMPARE(st.st_mode & 07777, mode_t(0644));
+        stats.push_back(st);
+    }
+
+    // Without reflink support the copies fall back to hard links of the first one.
+    QCOMPARE(stats[2].st_nlink, nlink_t(1));
+    if (stats[0].st_nlink > 1) {
+        QCOMPARE(stats[0].st_nlink, nlink_t(3));
+        QCOMPARE(stats[1].st_ino, stats[0].st_ino);
+        QCOMPARE(stats[3].st_ino, stats[0].st_ino);
+    }
+}
+
 QTEST_MAIN(ArchiveExtractTest)
 #include "archive_extract_test.moc"
@@ -0,0 +1,258 @@
+/*
+ * Tests for ELF section, segment and symbol parsing
+ * tests/binary_image_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/binary_image.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace PCManFM;
+
+namespace {
+
+// Writes integers into a growing image in either byte order.
+class ImageBuilder {
+   public:
+    explicit ImageBuilder(bool little) : little_(little) {}
+
+    std::vector<std::uint8_t>& bytes() { return bytes_; }
+
+    void put(std::size_t offset, std::uint64_t value, std::size_t width) {
+        if (bytes_.size() < offset + width) {
+            bytes_.resize(offset + width);
+        }
+        for (std::size_t i = 0; i < width; ++i) {
+            bytes_[offset + (little_ ? i : width - 1 - i)] = static_cast<std::uint8_t>(value >> (8 * i));
+        }
+    }
+    void putBytes(std::size_t offset, const void* data, std::size_t size) {
+        if (bytes_.size() < offset + size) {
+            bytes_.resize(offset + size);
+        }
+        std::memcpy(bytes_.data() + offset, data, size);
+    }
+
+   private:
+    bool little_;
+    std::vector<std::uint8_t> bytes_;
+};
+
+ImageReader readerFor(const std::vector<std::uint8_t>& bytes) {
+    return [&bytes](std::uint64_t offset, std::size_t length, std::uint8_t* dest, std::string& errorOut) {
+        if (offset > bytes.size() || length > bytes.size() - offset) {
+            errorOut = "short read";
+            return false;
+        }
+        std::memcpy(dest, bytes.data() + offset, length);
+        return true;
+    };
+}
+
+void putSection(ImageBuilder& b,
+                std::size_t at,
+                std::uint32_t name,
+                std::uint32_t type,
+                std::uint64_t flags,
+                std::uint64_t address,
+                std::uint64_t offset,
+                std::uint64_t size) {
+    b.put(at + 0, name, 4);
+    b.put(at + 4, type, 4);
+    b.put(at + 8, flags, 8);
+    b.put(at + 16, address, 8);
+    b.put(at + 24, offset, 8);
+    b.put(at + 32, size, 8);
+}
+
+void putSymbol(ImageBuilder& b,
+               std::size_t at,
+               std::uint32_t name,
+               std::uint8_t info,
+               std::uint16_t shndx,
+               std::uint64_t value) {
+    b.put(at + 0, name, 4);
+    b.put(at + 4, info, 1);
+    b.put(at + 6, shndx, 2);
+    b.put(at + 8, value, 8);
+}
+
+// A little-endian x86-64 image: .text at 0x400 loaded at 0x401000, a .symtab with two
+// functions, one object, one undefined function and an unnamed alias, and an executable
+// PT_LOAD.
+std::vector<std::uint8_t> buildElf64() {
+    ImageBuilder b(true);
+    const char ident[] = {0x7F, 'E', 'L', 'F', 2, 1, 1};
+    b.putBytes(0, ident, sizeof(ident));
+    b.put(18, 0x3E, 2);        // e_machine
+    b.put(24, 0x401010, 8);    // e_entry
+    b.put(32, 64, 8);          // e_phoff
+    b.put(40, 0x1000, 8);      // e_shoff
+    b.put(54, 56, 2);          // e_phentsize
+    b.put(56, 1, 2);           // e_phnum
+    b.put(58, 64, 2);          // e_shentsize
+    b.put(60, 4, 2);           // e_shnum
+    b.put(62, 3, 2);           // e_shstrndx
+
+    b.put(64, 1, 4);           // PT_LOAD
+    b.put(68, 5, 4);           // PF_R | PF_X
+    b.put(72, 0, 8);
+    b.put(80, 0x400000, 8);
+    b.put(96, 0x800, 8);
+    b.put(104, 0x800, 8);
+
+    std::vector<std::uint8_t> text(0x100, 0x90);
+    b.putBytes(0x400, text.data(), text.size());
+
+    putSymbol(b, 0x600 + 24, 25, 0x12, 1, 0x401000);  // global func "main"
+    putSymbol(b, 0x600 + 48, 30, 0x02, 1, 0x401080);  // local func "helper"
+    putSymbol(b, 0x600 + 72, 0, 0x11, 1, 0x402000);   // object
+    putSymbol(b, 0x600 + 96, 0, 0x12, 0, 0x401040);   // undefined
+    putSymbol(b, 0x600 + 120, 0, 0x12, 1, 0x401000);  // unnamed duplicate of main
+
+    const char names[] = "\0.text\0.symtab\0.shstrtab\0main\0helper";
+    b.putBytes(0x700, names, sizeof(names));
+
+    putSection(b, 0x1000 + 64, 1, 1, 0x6, 0x401000, 0x400, 0x100);   // .text
+    putSection(b, 0x1000 + 128, 7, 2, 0, 0, 0x600, 6 * 24);          // .symtab
+    b.put(0x1000 + 128 + 40, 3, 4);                                  // names in .shstrtab
+    putSection(b, 0x1000 + 192, 15, 3, 0, 0, 0x700, sizeof(names));  // .shstrtab
+    b.bytes().resize(0x1000 + 4 * 64);
+    return b.bytes();
+}
+
+}  // namespace
+
+class BinaryImageTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void parsesSectionsAndSymbols();
+    void fallsBackToSegments();
+    void rejectsTablesOutsideFile();
+    void splitsAtFunctionStarts();
+    void splitsAlignedWithoutSymbols();
+};
+
+void BinaryImageTest::parsesSectionsAndSymbols() {
+    const std::vector<std::uint8_t> bytes = buildElf64();
+    ElfImage image;
+    std::string err;
+    QVERIFY2(parse_elf_image(bytes.size(), readerFor(bytes), image, err), err.c_str());
+    QVERIFY(image.is64);
+    QVERIFY(image.littleEndian);
+    QCOMPARE(image.machine, static_cast<std::uint16_t>(0x3E));
+    QCOMPARE(image.entry, static_cast<std::uint64_t>(0x401010));
+    QCOMPARE(image.sections.size(), static_cast<std::size_t>(4));
+    QCOMPARE(QString::fromStdString(image.sections[1].name), QStringLiteral(".text"));
+    QVERIFY(image.sections[1].executable());
+    QVERIFY(!image.sections[2].executable());
+    QCOMPARE(image.segments.size(), static_cast<std::size_t>(1));
+    QVERIFY(image.segments[0].executable());
+
+    const std::vector<std::uint64_t> expected = {0x401000, 0x401080};
+    QVERIFY(image.functionStarts == expected);
+    QCOMPARE(image.functions.size(), static_cast<std::size_t>(2));
+    QCOMPARE(QString::fromStdString(image.functions[0].name), QStringLiteral("main"));
+    QCOMPARE(QString::fromStdString(image.functions[1].name), QStringLiteral("helper"));
+
+    const std::vector<CodeRegion> regions = elf_code_regions(image);
+    QCOMPARE(regions.size(), static_cast<std::size_t>(1));
+    QCOMPARE(regions[0].offset, static_cast<std::uint64_t>(0x400));
+    QCOMPARE(regions[0].size, static_cast<std::uint64_t>(0x100));
+    QCOMPARE(regions[0].address, static_cast<std::uint64_t>(0x401000));
+}
+
+void BinaryImageTest::fallsBackToSegments() {
+    // Big-endian 32-bit, program headers only.
+    ImageBuilder b(false);
+    const char ident[] = {0x7F, 'E', 'L', 'F', 1, 2, 1};
+    b.putBytes(0, ident, sizeof(ident));
+    b.put(18, 0x08, 2);     // EM_MIPS
+    b.put(24, 0x80000, 4);  // e_entry
+    b.put(28, 52, 4);       // e_phoff
+    b.put(42, 32, 2);       // e_phentsize
+    b.put(44, 1, 2);        // e_phnum
+    b.put(52, 1, 4);        // PT_LOAD
+    b.put(56, 0x100, 4);    // p_offset
+    b.put(60, 0x80000, 4);  // p_vaddr
+    b.put(68, 0x400, 4);    // p_filesz, larger than the file
+    b.put(72, 0x400, 4);
+    b.put(76, 5, 4);        // PF_R | PF_X
+    b.put(0x1FF, 0, 1);
+    const std::vector<std::uint8_t> bytes = b.bytes();
+
+    ElfImage image;
+    std::string err;
+    QVERIFY2(parse_elf_image(bytes.size(), readerFor(bytes), image, err), err.c_str());
+    QVERIFY(!image.is64);
+    QVERIFY(!image.littleEndian);
+    QCOMPARE(image.entry, static_cast<std::uint64_t>(0x80000));
+    QVERIFY(image.sections.empty());
+
+    const std::vector<CodeRegion> regions = elf_code_regions(image);
+    QCOMPARE(regions.size(), static_cast<std::size_t>(1));
+    QCOMPARE(regions[0].offset, static_cast<std::uint64_t>(0x100));
+    QCOMPARE(regions[0].size, static_cast<std::uint64_t>(0x100));  // clamped to the file
+    QCOMPARE(regions[0].address, static_cast<std::uint64_t>(0x80000));
+}
+
+void BinaryImageTest::rejectsTablesOutsideFile() {
+    std::vector<std::uint8_t> bytes = buildElf64();
+    ImageBuilder b(true);
+    b.bytes() = bytes;
+    b.put(40, 0x100000, 8);  // e_shoff past the end
+    bytes = b.bytes();
+
+    ElfImage image;
+    std::string err;
+    QVERIFY(!parse_elf_image(bytes.size(), readerFor(bytes), image, err));
+    QVERIFY(!err.empty());
+
+    const std::vector<std::uint8_t> text(64, 0x90);
+    QVERIFY(!parse_elf_image(text.size(), readerFor(text), image, err));
+}
+
+void BinaryImageTest::splitsAtFunctionStarts() {
+    const std::vector<CodeRegion> regions = {{0x1000, 0x3000, 0x401000}, {0x8000, 0x100, 0x408000}};
+    const std::vector<std::uint64_t> functions = {0x400f00, 0x401010, 0x401e00, 0x402300};
+    const std::vector<CodeChunk> chunks = split_code_regions(regions, functions, 0x1000, 16);
+
+    QCOMPARE(chunks.size(), static_cast<std::size_t>(4));
+    // 0x401e00 is nearer the first target, 0x402000, than 0x402300.
+    QCOMPARE(chunks[0].offset, static_cast<std::uint64_t>(0x1000));
+    QCOMPARE(chunks[0].size, static_cast<std::uint64_t>(0xe00));
+    QCOMPARE(chunks[1].address, static_cast<std::uint64_t>(0x401e00));
+    QVERIFY(chunks[1].knownStart);
+    // No function near the second target: the split falls on it, and the rest is one chunk.
+    QCOMPARE(chunks[1].size, static_cast<std::uint64_t>(0x1000));
+    QVERIFY(!chunks[2].knownStart);
+    QCOMPARE(chunks[2].offset + chunks[2].size, static_cast<std::uint64_t>(0x4000));
+    QCOMPARE(chunks[2].regionEnd, static_cast<std::uint64_t>(0x4000));
+    QCOMPARE(chunks[3].offset, static_cast<std::uint64_t>(0x8000));
+    QCOMPARE(chunks[3].size, static_cast<std::uint64_t>(0x100));
+    QVERIFY(chunks[3].knownStart);
+}
+
+void BinaryImageTest::splitsAlignedWithoutSymbols() {
+    const std::vector<CodeRegion> regions = {{0x10, 0x3008, 0x1008}};
+    const std::vector<CodeChunk> chunks = split_code_regions(regions, {}, 0x1000, 16);
+
+    QCOMPARE(chunks.size(), static_cast<std::size_t>(3));
+    QVERIFY(chunks[0].knownStart);
+    std::uint64_t total = chunks[0].size;
+    for (std::size_t i = 1; i < chunks.size(); ++i) {
+        QVERIFY(!chunks[i].knownStart);
+        QCOMPARE(chunks[i].address % 16, static_cast<std::uint64_t>(0));
+        QCOMPARE(chunks[i].offset, chunks[i - 1].offset + chunks[i - 1].size);
+        total += chunks[i].size;
+    }
+    QCOMPARE(total, static_cast<std::uint64_t>(0x3008));
+}
+
+QTEST_MAIN(BinaryImageTest)
+#include "binary_image_test.moc"
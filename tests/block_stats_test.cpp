@@ -0,0 +1,117 @@
+/*
+ * Tests for the hex editor block statistics
+ * tests/block_stats_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/block_stats.h"
+
+#include <random>
+#include <vector>
+
+using namespace PCManFM;
+
+class BlockStatsTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void histogramMatchesNaiveCount();
+    void scoresUniformAndConstantData();
+    void sharesOfZerosAndText();
+    void splitsIntoBlocks();
+    void growsBlocksForHugeFiles();
+};
+
+void BlockStatsTest::histogramMatchesNaiveCount() {
+    std::mt19937 rng(5);
+    for (int round = 0; round < 200; ++round) {
+        std::vector<std::uint8_t> data(rng() % 5000);
+        const unsigned alphabet = 1 + rng() % 256;
+        for (auto& c : data) {
+            c = static_cast<std::uint8_t>(rng() % alphabet);
+        }
+        const std::size_t skip = data.empty() ? 0 : rng() % 8 % data.size();
+
+        ByteHistogram expected{};
+        for (std::size_t i = skip; i < data.size(); ++i) {
+            ++expected[data[i]];
+        }
+        ByteHistogram counts{};
+        add_byte_histogram(data.data() + skip, data.size() - skip, counts);
+        QVERIFY(counts == expected);
+    }
+}
+
+void BlockStatsTest::scoresUniformAndConstantData() {
+    std::vector<std::uint8_t> uniform(4096);
+    for (std::size_t i = 0; i < uniform.size(); ++i) {
+        uniform[i] = static_cast<std::uint8_t>(i);
+    }
+    ByteHistogram counts{};
+    add_byte_histogram(uniform.data(), uniform.size(), counts);
+    const BlockStats high = stats_from_histogram(counts, uniform.size());
+    QVERIFY(high.known);
+    QCOMPARE(high.entropy, static_cast<std::uint8_t>(255));
+
+    const std::vector<std::uint8_t> constant(4096, 0x90);
+    counts = {};
+    add_byte_histogram(constant.data(), constant.size(), counts);
+    const BlockStats low = stats_from_histogram(counts, constant.size());
+    QCOMPARE(low.entropy, static_cast<std::uint8_t>(0));
+    QCOMPARE(low.zeros, static_cast<std::uint8_t>(0));
+    QCOMPARE(low.ascii, static_cast<std::uint8_t>(0));
+
+    // Two equally common values carry one bit per byte.
+    std::vector<std::uint8_t> twoValues(4096);
+    for (std::size_t i = 0; i < twoValues.size(); ++i) {
+        twoValues[i] = static_cast<std::uint8_t>(i & 1);
+    }
+    counts = {};
+    add_byte_histogram(twoValues.data(), twoValues.size(), counts);
+    QCOMPARE(stats_from_histogram(counts, twoValues.size()).entropy, static_cast<std::uint8_t>(32));
+}
+
+void BlockStatsTest::sharesOfZerosAndText() {
+    std::vector<std::uint8_t> data(1000, 0);
+    const char text[] = "Hello,\tworld\r\n";
+    for (std::size_t i = 0; i < 500; ++i) {
+        data[i] = static_cast<std::uint8_t>(text[i % (sizeof(text) - 1)]);
+    }
+    ByteHistogram counts{};
+    add_byte_histogram(data.data(), data.size(), counts);
+    const BlockStats stats = stats_from_histogram(counts, data.size());
+    QCOMPARE(stats.zeros, static_cast<std::uint8_t>(128));
+    QCOMPARE(stats.ascii, static_cast<std::uint8_t>(128));
+
+    QVERIFY(stats_from_histogram(ByteHistogram{}, 0).known);
+}
+
+void BlockStatsTest::splitsIntoBlocks() {
+    std::vector<std::uint8_t> data(4096 * 2 + 100, 0);
+    for (std::size_t i = 4096; i < 8192; ++i) {
+        data[i] = static_cast<std::uint8_t>(i);
+    }
+    for (std::size_t i = 8192; i < data.size(); ++i) {
+        data[i] = 'a';
+    }
+    std::vector<BlockStats> out(3);
+    compute_block_stats(data.data(), data.size(), 4096, out.data());
+    QCOMPARE(out[0].zeros, static_cast<std::uint8_t>(255));
+    QCOMPARE(out[0].entropy, static_cast<std::uint8_t>(0));
+    QCOMPARE(out[1].entropy, static_cast<std::uint8_t>(255));
+    QCOMPARE(out[2].ascii, static_cast<std::uint8_t>(255));
+    QVERIFY(out[2].known);
+}
+
+void BlockStatsTest::growsBlocksForHugeFiles() {
+    QCOMPARE(stats_block_size(0), static_cast<std::uint64_t>(kStatsBlockSize));
+    QCOMPARE(stats_block_size(kStatsBlockSize * kMaxStatsBlocks), static_cast<std::uint64_t>(kStatsBlockSize));
+    QCOMPARE(stats_block_size(kStatsBlockSize * kMaxStatsBlocks + 1),
+             static_cast<std::uint64_t>(kStatsBlockSize * 2));
+    const std::uint64_t terabyte = std::uint64_t{1} << 40;
+    QVERIFY((terabyte + stats_block_size(terabyte) - 1) / stats_block_size(terabyte) <= kMaxStatsBlocks);
+}
+
+QTEST_MAIN(BlockStatsTest)
+#include "block_stats_test.moc"
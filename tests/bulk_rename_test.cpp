@@ -0,0 +1,205 @@
+/*
+ * Tests for renaming a batch of files as one transaction
+ * tests/bulk_rename_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+
+#include "../src/core/bulk_rename.h"
+
+#include <sys/stat.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::string nativePath(const QTemporaryDir& dir) {
+    return dir.path().toLocal8Bit().toStdString();
+}
+
+void writeFile(const QTemporaryDir& dir, const char* name, const QByteArray& data) {
+    QFile file(dir.path() + QLatin1Char('/') + QString::fromLocal8Bit(name));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(data), data.size());
+}
+
+QByteArray readFile(const QTemporaryDir& dir, const char* name) {
+    QFile file(dir.path() + QLatin1Char('/') + QString::fromLocal8Bit(name));
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+bool exists(const QTemporaryDir& dir, const char* name) {
+    struct stat st;
+    return ::lstat((nativePath(dir) + "/" + name).c_str(), &st) == 0;
+}
+
+}  // namespace
+
+class BulkRenameTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void renamesAndDropsUnchanged();
+    void reportsBadNames();
+    void refusesNamesOutsideTheBatch();
+    void followsChains();
+    void swapsThroughTemporaryName();
+    void cancelUndoesEverything();
+    void failureUndoesEverything();
+};
+
+void BulkRenameTest::renamesAndDropsUnchanged() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeFile(dir, "a", "1");
+    writeFile(dir, "b", "2");
+
+    const std::string path = nativePath(dir);
+    BulkRename rename({{path, "a", "x"}, {path, "b", "b"}});
+    QCOMPARE(rename.items().size(), std::size_t(1));
+    QVERIFY(rename.validate().empty());
+
+    std::string error;
+    std::size_t ticks = 0;
+    QCOMPARE(rename.run([&ticks](std::size_t) { return ++ticks, true; }, error), BulkRename::Outcome::Done);
+    QCOMPARE(ticks, std::size_t(1));
+    QCOMPARE(readFile(dir, "x"), QByteArray("1"));
+    QVERIFY(!exists(dir, "a"));
+    QVERIFY(exists(dir, "b"));
+}
+
+void BulkRenameTest::reportsBadNames() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    for (const char* name : {"a", "b", "c", "d", "e"}) {
+        writeFile(dir, name, name);
+    }
+
+    const std::string path = nativePath(dir);
+    BulkRename rename({{path, "a", ""},
+                       {path, "b", "x/y"},
+                       {path, "c", std::string(4096, 'n')},
+                       {path, "d", "same"},
+                       {path, "e", "same"},
+                       {path, "missing", "z"}});
+    const auto issues = rename.validate();
+    QCOMPARE(issues.size(), std::size_t(5));
+    QCOMPARE(issues[0].problem, BulkRename::Problem::EmptyName);
+    QCOMPARE(issues[1].problem, BulkRename::Problem::InvalidName);
+    QCOMPARE(issues[2].problem, BulkRename::Problem::NameTooLong);
+    QCOMPARE(issues[3].problem, BulkRename::Problem::DuplicateName);
+    QCOMPARE(issues[3].item, std::size_t(4));
+    QCOMPARE(issues[4].problem, BulkRename::Problem::SourceMissing);
+
+    // nothing is renamed
+    std::string error;
+    QCOMPARE(rename.run({}, error), BulkRename::Outcome::Failed);
+    QVERIFY(exists(dir, "d"));
+    QVERIFY(!exists(dir, "same"));
+}
+
+void BulkRenameTest::refusesNamesOutsideTheBatch() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeFile(dir, "a", "1");
+    writeFile(dir, "taken", "2");
+
+    const std::string path = nativePath(dir);
+    BulkRename rename({{path, "a", "taken"}});
+    const auto issues = rename.validate();
+    QCOMPARE(issues.size(), std::size_t(1));
+    QCOMPARE(issues[0].problem, BulkRename::Problem::NameExists);
+    QCOMPARE(readFile(dir, "taken"), QByteArray("2"));
+}
+
+void BulkRenameTest::followsChains() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeFile(dir, "1", "one");
+    writeFile(dir, "2", "two");
+    writeFile(dir, "3", "three");
+
+    // each name is taken by the file before it
+    const std::string path = nativePath(dir);
+    BulkRename rename({{path, "1", "2"}, {path, "2", "3"}, {path, "3", "4"}});
+    QVERIFY(rename.validate().empty());
+    QCOMPARE(rename.stepCount(), std::size_t(3));
+
+    std::string error;
+    QCOMPARE(rename.run({}, error), BulkRename::Outcome::Done);
+    QCOMPARE(readFile(dir, "2"), QByteArray("one"));
+    QCOMPARE(readFile(dir, "3"), QByteArray("two"));
+    QCOMPARE(readFile(dir, "4"), QByteArray("three"));
+    QVERIFY(!exists(dir, "1"));
+}
+
+void BulkRenameTest::swapsThroughTemporaryName() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeFile(dir, "a", "A");
+    writeFile(dir, "b", "B");
+    writeFile(dir, "c", "C");
+
+    const std::string path = nativePath(dir);
+    BulkRename rename({{path, "a", "b"}, {path, "b", "c"}, {path, "c", "a"}});
+    QVERIFY(rename.validate().empty());
+    QCOMPARE(rename.stepCount(), std::size_t(4));
+
+    std::string error;
+    QCOMPARE(rename.run({}, error), BulkRename::Outcome::Done);
+    QCOMPARE(readFile(dir, "b"), QByteArray("A"));
+    QCOMPARE(readFile(dir, "c"), QByteArray("B"));
+    QCOMPARE(readFile(dir, "a"), QByteArray("C"));
+    QCOMPARE(QDir(dir.path()).entryList(QDir::Files | QDir::Hidden).size(), 3);
+}
+
+void BulkRenameTest::cancelUndoesEverything() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeFile(dir, "a", "A");
+    writeFile(dir, "b", "B");
+    writeFile(dir, "c", "C");
+
+    const std::string path = nativePath(dir);
+    BulkRename rename({{path, "a", "b"}, {path, "b", "a"}, {path, "c", "d"}});
+    std::string error;
+    QCOMPARE(rename.run([](std::size_t done) { return done < 3; }, error), BulkRename::Outcome::Cancelled);
+    QVERIFY(error.empty());
+    QCOMPARE(readFile(dir, "a"), QByteArray("A"));
+    QCOMPARE(readFile(dir, "b"), QByteArray("B"));
+    QCOMPARE(readFile(dir, "c"), QByteArray("C"));
+    QCOMPARE(QDir(dir.path()).entryList(QDir::Files | QDir::Hidden).size(), 3);
+}
+
+void BulkRenameTest::failureUndoesEverything() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeFile(dir, "a", "A");
+    writeFile(dir, "b", "B");
+
+    const std::string path = nativePath(dir);
+    BulkRename rename({{path, "a", "x"}, {path, "b", "y"}});
+    QVERIFY(rename.validate().empty());
+    // another program takes the second name after the check
+    std::string error;
+    const auto outcome = rename.run(
+        [&dir](std::size_t done) {
+            if (done == 1) {
+                writeFile(dir, "y", "other");
+            }
+            return true;
+        },
+        error);
+    QCOMPARE(outcome, BulkRename::Outcome::Failed);
+    QVERIFY(!error.empty());
+    QCOMPARE(readFile(dir, "a"), QByteArray("A"));
+    QCOMPARE(readFile(dir, "b"), QByteArray("B"));
+    QCOMPARE(readFile(dir, "y"), QByteArray("other"));
+    QVERIFY(!exists(dir, "x"));
+}
+
+QTEST_MAIN(BulkRenameTest)
+#include "bulk_rename_test.moc"
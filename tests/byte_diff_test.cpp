@@ -0,0 +1,147 @@
+/*
+ * Tests for the hex editor byte comparison
+ * tests/byte_diff_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/byte_diff.h"
+
+#include <random>
+#include <vector>
+
+using namespace PCManFM;
+
+namespace {
+
+// Differing runs found byte by byte.
+std::vector<DiffRange> naive_ranges(const std::vector<std::uint8_t>& a, const std::vector<std::uint8_t>& b) {
+    std::vector<DiffRange> out;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (a[i] != b[i]) {
+            append_diff_range(out, DiffRange{i, 1});
+        }
+    }
+    return out;
+}
+
+bool same_ranges(const std::vector<DiffRange>& x, const std::vector<DiffRange>& y) {
+    if (x.size() != y.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        if (x[i].offset != y[i].offset || x[i].length != y[i].length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+class ByteDiffTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void findsMismatchAndMatchAtEveryPosition();
+    void rangesMatchNaiveScan();
+    void windowsMergeAcrossSeams();
+    void navigatesRanges();
+};
+
+void ByteDiffTest::findsMismatchAndMatchAtEveryPosition() {
+    // Cover both sides of the vector, word and byte tails and of the 64 KiB memcmp blocks.
+    for (const std::size_t size : {std::size_t{0}, std::size_t{7}, std::size_t{33}, std::size_t{200000}}) {
+        const std::vector<std::uint8_t> a(size, 0x5a);
+        for (std::size_t at = 0; at < size; at += (at < 100 || size - at < 100) ? 1 : 997) {
+            std::vector<std::uint8_t> b = a;
+            b[at] ^= 0x80;
+            QCOMPARE(first_mismatch(a.data(), b.data(), size), at);
+
+            std::vector<std::uint8_t> c(size);
+            for (std::size_t i = 0; i < size; ++i) {
+                c[i] = static_cast<std::uint8_t>(a[i] + 1);
+            }
+            c[at] = a[at];
+            QCOMPARE(first_match(a.data(), c.data(), size), at);
+        }
+        QCOMPARE(first_mismatch(a.data(), a.data(), size), size);
+    }
+}
+
+void ByteDiffTest::rangesMatchNaiveScan() {
+    std::mt19937 rng(11);
+    for (int round = 0; round < 100; ++round) {
+        std::vector<std::uint8_t> a(rng() % 300000);
+        for (auto& c : a) {
+            c = static_cast<std::uint8_t>(rng());
+        }
+        std::vector<std::uint8_t> b = a;
+        const unsigned edits = rng() % 50;
+        for (unsigned i = 0; i < edits && !b.empty(); ++i) {
+            const std::size_t at = rng() % b.size();
+            const std::size_t run = std::min<std::size_t>(1 + rng() % 70, b.size() - at);
+            for (std::size_t k = at; k < at + run; ++k) {
+                b[k] = static_cast<std::uint8_t>(b[k] ^ (1 + rng() % 255));
+            }
+        }
+        std::vector<DiffRange> ranges;
+        collect_diff_ranges(0, a.data(), b.data(), a.size(), ranges);
+        QVERIFY(same_ranges(ranges, naive_ranges(a, b)));
+    }
+}
+
+void ByteDiffTest::windowsMergeAcrossSeams() {
+    std::vector<std::uint8_t> a(1000, 0);
+    std::vector<std::uint8_t> b = a;
+    for (std::size_t i = 90; i < 130; ++i) {
+        b[i] = 1;
+    }
+    b[999] = 1;
+
+    std::vector<DiffRange> windowed;
+    for (std::size_t pos = 0; pos < a.size(); pos += 100) {
+        collect_diff_ranges(pos, a.data() + pos, b.data() + pos, 100, windowed);
+    }
+    QVERIFY(same_ranges(windowed, naive_ranges(a, b)));
+    QCOMPARE(windowed.size(), std::size_t{2});
+
+    DiffRangeList list;
+    list.append({windowed[0]});
+    list.append({DiffRange{windowed[0].end(), 5}, windowed[1]});
+    QCOMPARE(list.size(), std::size_t{2});
+    QCOMPARE(list.ranges()[0].length, std::uint64_t{45});
+    QCOMPARE(list.differingBytes(), std::uint64_t{46});
+}
+
+void ByteDiffTest::navigatesRanges() {
+    DiffRangeList list;
+    list.append({DiffRange{0, 4}, DiffRange{100, 1}, DiffRange{200, 50}});
+    QVERIFY(list.contains(0));
+    QVERIFY(list.contains(3));
+    QVERIFY(!list.contains(4));
+    QVERIFY(list.contains(249));
+    QVERIFY(!list.contains(250));
+
+    std::size_t index = 0;
+    QVERIFY(list.next(0, true, index));
+    QCOMPARE(index, std::size_t{0});
+    QVERIFY(list.next(1, true, index));
+    QCOMPARE(index, std::size_t{1});
+    QVERIFY(list.next(101, true, index));
+    QCOMPARE(index, std::size_t{2});
+    QVERIFY(!list.next(201, true, index));
+
+    QVERIFY(!list.next(0, false, index));
+    QVERIFY(list.next(100, false, index));
+    QCOMPARE(index, std::size_t{0});
+    QVERIFY(list.next(1000, false, index));
+    QCOMPARE(index, std::size_t{2});
+
+    list.clear();
+    QVERIFY(list.empty());
+    QCOMPARE(list.differingBytes(), std::uint64_t{0});
+}
+
+QTEST_MAIN(ByteDiffTest)
+#include "byte_diff_test.moc"
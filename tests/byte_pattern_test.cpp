@@ -0,0 +1,129 @@
+/*
+ * Tests for masked and multi-pattern byte search
+ * tests/byte_pattern_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/byte_pattern.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace PCManFM;
+
+namespace {
+
+BytePattern parsed(const char* text) {
+    BytePattern pattern;
+    std::string error;
+    if (!parse_byte_pattern(text, pattern, error)) {
+        qFatal("failed to parse %s: %s", text, error.c_str());
+    }
+    return pattern;
+}
+
+std::vector<PatternHit> naiveScan(const std::vector<std::uint8_t>& hay, const std::vector<BytePattern>& patterns) {
+    std::vector<PatternHit> hits;
+    for (std::size_t i = 0; i < hay.size(); ++i) {
+        for (std::size_t p = 0; p < patterns.size(); ++p) {
+            const BytePattern& pattern = patterns[p];
+            bool match = i + pattern.size() <= hay.size();
+            for (std::size_t k = 0; match && k < pattern.size(); ++k) {
+                match = (hay[i + k] & pattern.mask[k]) == pattern.value[k];
+            }
+            if (match) {
+                hits.push_back({i, p});
+            }
+        }
+    }
+    return hits;
+}
+
+}  // namespace
+
+class BytePatternTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void parsesWildcardsAndMasks();
+    void rejectsMalformedPatterns();
+    void matchesNaiveScanAcrossChunks();
+};
+
+void BytePatternTest::parsesWildcardsAndMasks() {
+    const BytePattern call = parsed("48 8B ?? ?? 00");
+    QCOMPARE(call.value, (std::vector<std::uint8_t>{0x48, 0x8b, 0x00, 0x00, 0x00}));
+    QCOMPARE(call.mask, (std::vector<std::uint8_t>{0xff, 0xff, 0x00, 0x00, 0xff}));
+
+    const BytePattern nibbles = parsed("4?8b/F0,?f");
+    QCOMPARE(nibbles.value, (std::vector<std::uint8_t>{0x40, 0x80, 0x0f}));
+    QCOMPARE(nibbles.mask, (std::vector<std::uint8_t>{0xf0, 0xf0, 0x0f}));
+}
+
+void BytePatternTest::rejectsMalformedPatterns() {
+    for (const char* text : {"", "  ", "4", "zz", "12/?0", "12/"}) {
+        BytePattern pattern;
+        std::string error;
+        QVERIFY2(!parse_byte_pattern(text, pattern, error), text);
+        QVERIFY(!error.empty());
+    }
+
+    PatternMatcher matcher;
+    std::string error;
+    QVERIFY(!matcher.compile({parsed("?? 4?")}, error));
+    QVERIFY(matcher.compile({parsed("?? 41")}, error));
+}
+
+void BytePatternTest::matchesNaiveScanAcrossChunks() {
+    std::mt19937 rng(5);
+    for (int round = 0; round < 400; ++round) {
+        // A tiny alphabet keeps anchors overlapping each other and the chunk seams.
+        const unsigned alphabet = 2 + rng() % 3;
+        std::vector<BytePattern> patterns(1 + rng() % 5);
+        for (BytePattern& pattern : patterns) {
+            const std::size_t length = 1 + rng() % 6;
+            const std::size_t fixed = rng() % length;
+            for (std::size_t k = 0; k < length; ++k) {
+                const std::uint8_t mask = k == fixed ? 0xff : static_cast<std::uint8_t>(rng() % 3 == 0 ? 0x0f : 0xff);
+                pattern.mask.push_back(mask);
+                pattern.value.push_back(static_cast<std::uint8_t>(rng() % alphabet) & mask);
+            }
+        }
+        std::vector<std::uint8_t> hay(rng() % 400);
+        for (auto& c : hay) {
+            c = static_cast<std::uint8_t>(rng() % alphabet | (rng() % 2) << 4);
+        }
+
+        PatternMatcher matcher;
+        std::string error;
+        QVERIFY(matcher.compile(patterns, error));
+
+        const std::size_t chunk = 1 + rng() % 64;
+        std::vector<PatternHit> hits;
+        for (std::size_t start = 0; start < hay.size(); start += chunk) {
+            const std::size_t reportLimit = std::min(chunk, hay.size() - start);
+            const std::size_t length = std::min(hay.size() - start, reportLimit + matcher.maxLength() - 1);
+            matcher.scan(hay.data() + start, length, reportLimit, start, hits);
+        }
+
+        // Hits come in offset order; ties at one offset may be in any pattern order.
+        std::vector<PatternHit> expected = naiveScan(hay, patterns);
+        auto byOffsetThenPattern = [](const PatternHit& a, const PatternHit& b) {
+            return a.offset != b.offset ? a.offset < b.offset : a.pattern < b.pattern;
+        };
+        QVERIFY(std::is_sorted(hits.begin(), hits.end(),
+                               [](const PatternHit& a, const PatternHit& b) { return a.offset < b.offset; }));
+        std::sort(hits.begin(), hits.end(), byOffsetThenPattern);
+        QCOMPARE(hits.size(), expected.size());
+        for (std::size_t i = 0; i < hits.size(); ++i) {
+            QCOMPARE(hits[i].offset, expected[i].offset);
+            QCOMPARE(hits[i].pattern, expected[i].pattern);
+        }
+    }
+}
+
+QTEST_MAIN(BytePatternTest)
+#include "byte_pattern_test.moc"
@@ -0,0 +1,83 @@
+/*
+ * Tests for the hex editor byte pattern search
+ * tests/byte_search_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/byte_search.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace PCManFM;
+
+namespace {
+
+const std::uint8_t* naiveFind(const std::vector<std::uint8_t>& hay,
+                              std::size_t from,
+                              const std::vector<std::uint8_t>& needle) {
+    for (std::size_t i = from; i + needle.size() <= hay.size(); ++i) {
+        if (std::memcmp(hay.data() + i, needle.data(), needle.size()) == 0) {
+            return hay.data() + i;
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+class ByteSearchTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void matchesNaiveSearch();
+    void findsMagicInZeroFill();
+};
+
+void ByteSearchTest::matchesNaiveSearch() {
+    std::mt19937 rng(3);
+    for (int round = 0; round < 4000; ++round) {
+        // Small alphabets force plenty of partial matches and repeated needle bytes.
+        const unsigned alphabet = 1 + rng() % 4;
+        std::vector<std::uint8_t> hay(rng() % 300);
+        std::vector<std::uint8_t> needle(1 + rng() % 8);
+        for (auto& c : hay) {
+            c = static_cast<std::uint8_t>(rng() % alphabet);
+        }
+        for (auto& c : needle) {
+            c = static_cast<std::uint8_t>(rng() % alphabet);
+        }
+
+        ByteSearcher searcher(needle.data(), needle.size());
+        if (round % 2 == 1) {
+            searcher.tune(hay.data(), hay.size());
+        }
+        for (std::size_t from = 0; from <= hay.size(); from += 1 + rng() % 16) {
+            QCOMPARE(searcher.find(hay.data() + from, hay.data() + hay.size()), naiveFind(hay, from, needle));
+        }
+    }
+}
+
+void ByteSearchTest::findsMagicInZeroFill() {
+    std::vector<std::uint8_t> image(1 << 20, 0);
+    for (std::size_t i = 0; i < image.size(); i += 4096) {
+        image[i] = 0x7f;  // partial matches of the magic on every page
+    }
+    const std::uint8_t magic[] = {0x7f, 'E', 'L', 'F'};
+    const std::size_t at = image.size() - 100;
+    std::memcpy(image.data() + at, magic, sizeof(magic));
+
+    for (bool tuned : {false, true}) {
+        ByteSearcher searcher(magic, sizeof(magic));
+        if (tuned) {
+            searcher.tune(image.data(), image.size());
+        }
+        QCOMPARE(searcher.find(image.data(), image.data() + image.size()), image.data() + at);
+        QVERIFY(!searcher.find(image.data() + at + 1, image.data() + image.size()));
+    }
+}
+
+QTEST_MAIN(ByteSearchTest)
+#include "byte_search_test.moc"
@@ -0,0 +1,631 @@
+/*
+ * Benchmarks of the src/core file engines, reported as JSON
+ * tests/core_bench.cpp
+ */
+
+#include "../src/core/archive_extract.h"
+#include "../src/core/archive_writer.h"
+#include "../src/core/fs_ops.h"
+#include "../src/core/windowed_file_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace PCManFM;
+
+namespace {
+
+constexpr std::uint64_t kKiB = 1024;
+constexpr std::uint64_t kMiB = 1024 * kKiB;
+
+// A tree (or a single file) every case of a kind runs on.
+struct Fixture {
+    std::string name;
+    std::string path;
+    std::uint64_t bytes = 0;  // data written, holes left out
+    std::vector<std::string> files;
+};
+
+struct Sample {
+    double wall = 0;
+    double user = 0;
+    double system = 0;
+    std::uint64_t readCalls = 0;   // syscr of /proc/self/io: read-type syscalls of all threads
+    std::uint64_t writeCalls = 0;  // syscw; I/O submitted through io_uring is not counted
+    std::uint64_t readBytes = 0;   // bytes that had to come from the storage layer
+    std::uint64_t writeBytes = 0;
+    long voluntarySwitches = 0;
+    long involuntarySwitches = 0;
+};
+
+struct Case {
+    std::string name;
+    std::uint64_t bytes = 0;
+    std::size_t files = 0;
+    std::function<bool(FsOps::Error&)> prepare;  // untimed, before each run
+    std::function<bool(FsOps::Error&)> run;
+    std::function<void()> cleanup;  // untimed, after each run
+};
+
+struct Result {
+    const Case* benchCase = nullptr;
+    std::vector<double> walls;
+    Sample best;  // the counters of the fastest run
+    long peakRssKib = 0;
+    std::string error;
+};
+
+struct Config {
+    std::string baseDir;
+    std::string jsonPath;  // empty: stdout
+    std::string filter;
+    int repeat = 3;
+    bool quick = false;
+};
+
+Sample sample() {
+    Sample s;
+    s.wall = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    struct rusage ru;
+    if (::getrusage(RUSAGE_SELF, &ru) == 0) {
+        s.user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+        s.system = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+        s.voluntarySwitches = ru.ru_nvcsw;
+        s.involuntarySwitches = ru.ru_nivcsw;
+    }
+    if (std::FILE* io = std::fopen("/proc/self/io", "r")) {
+        char key[32];
+        unsigned long long value;
+        while (std::fscanf(io, "%31[^:]: %llu\n", key, &value) == 2) {
+            if (std::strcmp(key, "syscr") == 0) {
+                s.readCalls = value;
+            }
+            else if (std::strcmp(key, "syscw") == 0) {
+                s.writeCalls = value;
+            }
+            else if (std::strcmp(key, "read_bytes") == 0) {
+                s.readBytes = value;
+            }
+            else if (std::strcmp(key, "write_bytes") == 0) {
+                s.writeBytes = value;
+            }
+        }
+        std::fclose(io);
+    }
+    return s;
+}
+
+Sample difference(const Sample& after, const Sample& before) {
+    Sample d;
+    d.wall = after.wall - before.wall;
+    d.user = after.user - before.user;
+    d.system = after.system - before.system;
+    d.readCalls = after.readCalls - before.readCalls;
+    d.writeCalls = after.writeCalls - before.writeCalls;
+    d.readBytes = after.readBytes - before.readBytes;
+    d.writeBytes = after.writeBytes - before.writeBytes;
+    d.voluntarySwitches = after.voluntarySwitches - before.voluntarySwitches;
+    d.involuntarySwitches = after.involuntarySwitches - before.involuntarySwitches;
+    return d;
+}
+
+// Starts a new peak of the resident set (Linux 4.0+), so VmHWM covers a single run.
+bool resetPeakRss() {
+    const int fd = ::open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const bool reset = ::write(fd, "5", 1) == 1;
+    ::close(fd);
+    return reset;
+}
+
+long peakRssKib() {
+    long kib = 0;
+    if (std::FILE* status = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        while (std::fgets(line, sizeof(line), status)) {
+            if (std::sscanf(line, "VmHWM: %ld kB", &kib) == 1) {
+                break;
+            }
+        }
+        std::fclose(status);
+    }
+    return kib;
+}
+
+// Half random and half repeated bytes, so that compression has some but not all the work.
+bool writeFile(const std::string& path, std::uint64_t size, std::uint64_t seed, FsOps::Error& err) {
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        err = {errno, "cannot create " + path};
+        return false;
+    }
+    std::mt19937_64 random{seed};
+    std::vector<std::uint64_t> buffer(std::min<std::uint64_t>(size, 4 * kMiB) / 8 + 1);
+    std::uint64_t written = 0;
+    while (written < size) {
+        for (std::size_t i = 0; i < buffer.size(); ++i) {
+            buffer[i] = i % 2 ? random() : 0x2e2e2e2e2e2e2e2eULL;
+        }
+        const std::size_t chunk = std::min<std::uint64_t>(size - written, buffer.size() * 8);
+        if (::write(fd, buffer.data(), chunk) != static_cast<ssize_t>(chunk)) {
+            err = {errno ? errno : EIO, "cannot write " + path};
+            ::close(fd);
+            return false;
+        }
+        written += chunk;
+    }
+    ::close(fd);
+    return true;
+}
+
+bool makeTree(Fixture& fixture, int dirs, int filesPerDir, std::uint64_t fileSize, FsOps::Error& err) {
+    if (::mkdir(fixture.path.c_str(), 0755) != 0) {
+        err = {errno, "cannot create " + fixture.path};
+        return false;
+    }
+    for (int d = 0; d < dirs; ++d) {
+        const std::string dir = fixture.path + "/d" + std::to_string(d);
+        if (::mkdir(dir.c_str(), 0755) != 0) {
+            err = {errno, "cannot create " + dir};
+            return false;
+        }
+        for (int f = 0; f < filesPerDir; ++f) {
+            const std::string file = dir + "/f" + std::to_string(f);
+            if (!writeFile(file, fileSize, fixture.files.size() + 1, err)) {
+                return false;
+            }
+            fixture.files.push_back(file);
+            fixture.bytes += fileSize;
+        }
+    }
+    return true;
+}
+
+// One large file of |dataRuns| runs of data spread over |apparentSize| bytes of holes.
+bool makeSparse(Fixture& fixture, std::uint64_t apparentSize, int dataRuns, std::uint64_t runSize, FsOps::Error& err) {
+    if (::mkdir(fixture.path.c_str(), 0755) != 0) {
+        err = {errno, "cannot create " + fixture.path};
+        return false;
+    }
+    const std::string file = fixture.path + "/sparse.img";
+    const int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(apparentSize)) != 0) {
+        err = {errno, "cannot create " + file};
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    std::vector<char> run(runSize, 's');
+    const std::uint64_t stride = apparentSize / dataRuns;
+    for (int i = 0; i < dataRuns; ++i) {
+        if (::pwrite(fd, run.data(), run.size(), static_cast<off_t>(i * stride)) != static_cast<ssize_t>(runSize)) {
+            err = {errno ? errno : EIO, "cannot write " + file};
+            ::close(fd);
+            return false;
+        }
+    }
+    ::close(fd);
+    fixture.files.push_back(file);
+    fixture.bytes = dataRuns * runSize;
+    return true;
+}
+
+bool removeIfExists(const std::string& path) {
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+        return true;
+    }
+    FsOps::ProgressInfo progress;
+    FsOps::Error err;
+    return FsOps::delete_path(path, progress, {}, err);
+}
+
+void addFsCases(std::vector<Case>& cases, const Fixture& fixture, const std::string& work) {
+    const std::string source = fixture.path;
+    const std::string copy = work + "/" + fixture.name + ".copy";
+    const std::string moved = work + "/" + fixture.name + ".moved";
+    auto cleanup = [copy, moved]() {
+        removeIfExists(copy);
+        removeIfExists(moved);
+    };
+    auto makeCopy = [source, copy](FsOps::Error& err) {
+        FsOps::ProgressInfo progress;
+        FsOps::CopyOptions options;
+        options.durability = FsOps::Durability::None;
+        return FsOps::copy_path(source, copy, progress, {}, err, options);
+    };
+
+    for (const unsigned workers : {1u, 0u}) {
+        Case c;
+        c.name = "copy_path/" + fixture.name + (workers == 1 ? "" : "/workers=auto");
+        c.bytes = fixture.bytes;
+        c.files = fixture.files.size();
+        c.run = [source, copy, workers](FsOps::Error& err) {
+            FsOps::ProgressInfo progress;
+            FsOps::CopyOptions options;
+            options.workerCount = workers;
+            return FsOps::copy_path(source, copy, progress, {}, err, options);
+        };
+        c.cleanup = cleanup;
+        cases.push_back(std::move(c));
+    }
+
+    for (const bool forceCopy : {false, true}) {
+        Case c;
+        c.name = "move_path/" + fixture.name + (forceCopy ? "/copy" : "/rename");
+        c.bytes = fixture.bytes;
+        c.files = fixture.files.size();
+        c.prepare = makeCopy;
+        c.run = [copy, moved, forceCopy](FsOps::Error& err) {
+            FsOps::ProgressInfo progress;
+            return FsOps::move_path(copy, moved, progress, {}, err, FsOps::CopyOptions{}, forceCopy);
+        };
+        c.cleanup = cleanup;
+        cases.push_back(std::move(c));
+    }
+
+    for (const unsigned workers : {1u, 0u}) {
+        Case c;
+        c.name = "delete_path/" + fixture.name + (workers == 1 ? "" : "/workers=auto");
+        c.bytes = fixture.bytes;
+        c.files = fixture.files.size();
+        c.prepare = makeCopy;
+        c.run = [copy, workers](FsOps::Error& err) {
+            FsOps::ProgressInfo progress;
+            FsOps::DeleteOptions options;
+            options.workerCount = workers;
+            return FsOps::delete_path(copy, progress, {}, err, options);
+        };
+        c.cleanup = cleanup;
+        cases.push_back(std::move(c));
+    }
+
+    Case hash;
+    hash.name = "blake3_file/" + fixture.name;
+    hash.bytes = fixture.bytes;
+    hash.files = fixture.files.size();
+    hash.run = [files = fixture.files](FsOps::Error& err) {
+        std::string hexHash;
+        for (const std::string& file : files) {
+            if (!FsOps::blake3_file(file, hexHash, err)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    cases.push_back(std::move(hash));
+}
+
+void addArchiveCases(std::vector<Case>& cases, const Fixture& fixture, const std::string& work) {
+    const std::string source = fixture.path;
+    const std::string archive = work + "/" + fixture.name + ".tar.zst";
+    const std::string extracted = work + "/" + fixture.name + ".extracted";
+    auto createArchive = [source, archive](FsOps::Error& err) {
+        FsOps::ProgressInfo progress;
+        return ArchiveWriter::create_tar_zst({source}, archive, progress, {}, err);
+    };
+
+    Case create;
+    create.name = "create_tar_zst/" + fixture.name;
+    create.bytes = fixture.bytes;
+    create.files = fixture.files.size();
+    create.run = createArchive;
+    create.cleanup = [archive]() { ::unlink(archive.c_str()); };
+    cases.push_back(std::move(create));
+
+    Case extract;
+    extract.name = "extract_archive/" + fixture.name;
+    extract.bytes = fixture.bytes;
+    extract.files = fixture.files.size();
+    extract.prepare = createArchive;
+    extract.run = [archive, extracted](FsOps::Error& err) {
+        FsOps::ProgressInfo progress;
+        return ArchiveExtract::extract_archive(archive, extracted, progress, {}, err);
+    };
+    extract.cleanup = [archive, extracted]() {
+        ::unlink(archive.c_str());
+        removeIfExists(extracted);
+    };
+    cases.push_back(std::move(extract));
+}
+
+void addReaderCases(std::vector<Case>& cases, const Fixture& fixture) {
+    const std::string file = fixture.files.front();
+    struct stat st;
+    const std::uint64_t size = ::stat(file.c_str(), &st) == 0 ? st.st_size : 0;
+
+    Case sequential;
+    sequential.name = "windowed_reader/" + fixture.name + "/sequential";
+    sequential.bytes = size;
+    sequential.files = 1;
+    sequential.run = [file](FsOps::Error& err) {
+        std::string error;
+        WindowedFileReader reader(file, 0, &error);
+        if (!reader.valid()) {
+            err = {EIO, error};
+            return false;
+        }
+        std::vector<std::uint8_t> buffer(kMiB);
+        for (std::uint64_t offset = 0; offset < reader.size();) {
+            std::size_t read = 0;
+            if (!reader.read(offset, buffer.size(), buffer.data(), read, error) || read == 0) {
+                err = {EIO, error};
+                return false;
+            }
+            offset += read;
+        }
+        return true;
+    };
+    cases.push_back(std::move(sequential));
+
+    // page-sized reads all over the file, as the hex view jumping between a search and its hits
+    constexpr int kRandomReads = 20000;
+    Case random;
+    random.name = "windowed_reader/" + fixture.name + "/random";
+    random.bytes = kRandomReads * 4 * kKiB;
+    random.files = 1;
+    random.run = [file](FsOps::Error& err) {
+        std::string error;
+        WindowedFileReader reader(file, 0, &error);
+        if (!reader.valid() || reader.size() < 4 * kKiB) {
+            err = {EIO, error.empty() ? "file too small" : error};
+            return false;
+        }
+        std::mt19937_64 engine{42};
+        std::uniform_int_distribution<std::uint64_t> offsets{0, reader.size() - 4 * kKiB};
+        std::uint8_t buffer[4 * kKiB];
+        for (int i = 0; i < kRandomReads; ++i) {
+            std::size_t read = 0;
+            if (!reader.read(offsets(engine), sizeof(buffer), buffer, read, error)) {
+                err = {EIO, error};
+                return false;
+            }
+        }
+        return true;
+    };
+    cases.push_back(std::move(random));
+}
+
+std::string describe(const FsOps::Error& err) {
+    return err.code ? err.message + ": " + std::strerror(err.code) : err.message;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    const std::size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+Result runCase(const Case& benchCase, int repeat, bool& peakRssReset) {
+    Result result;
+    result.benchCase = &benchCase;
+    for (int i = 0; i < repeat && result.error.empty(); ++i) {
+        FsOps::Error err;
+        if (benchCase.prepare && !benchCase.prepare(err)) {
+            result.error = "prepare: " + describe(err);
+            break;
+        }
+        peakRssReset = resetPeakRss() && peakRssReset;
+        const Sample before = sample();
+        const bool ok = benchCase.run(err);
+        const Sample run = difference(sample(), before);
+        const long peak = peakRssKib();
+        if (benchCase.cleanup) {
+            benchCase.cleanup();
+        }
+        if (!ok) {
+            result.error = describe(err);
+            break;
+        }
+        result.walls.push_back(run.wall);
+        if (result.walls.size() == 1 || run.wall < result.best.wall) {
+            result.best = run;
+            result.peakRssKib = peak;
+        }
+    }
+    return result;
+}
+
+void appendJsonString(std::string& out, const std::string& str) {
+    out += '"';
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            out += escaped;
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string number(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.6f", value);
+    return buffer;
+}
+
+std::string toJson(const Config& config, const std::vector<Result>& results, bool peakRssReset) {
+    std::string out = "{\n  \"version\": 1,\n  \"engine\": ";
+    appendJsonString(out, FsOps::io_engine() == FsOps::IoEngine::IoUring ? "io_uring" : "posix");
+    out += ",\n  \"base_dir\": ";
+    appendJsonString(out, config.baseDir);
+    out += ",\n  \"quick\": " + std::string(config.quick ? "true" : "false");
+    out += ",\n  \"repeat\": " + std::to_string(config.repeat);
+    out += ",\n  \"peak_rss_per_run\": " + std::string(peakRssReset ? "true" : "false");
+    out += ",\n  \"cases\": [";
+    bool first = true;
+    for (const Result& result : results) {
+        const Case& c = *result.benchCase;
+        out += first ? "\n    {" : ",\n    {";
+        first = false;
+        out += "\"name\": ";
+        appendJsonString(out, c.name);
+        out += ", \"bytes\": " + std::to_string(c.bytes) + ", \"files\": " + std::to_string(c.files);
+        if (!result.error.empty()) {
+            out += ", \"error\": ";
+            appendJsonString(out, result.error);
+            out += "}";
+            continue;
+        }
+        const Sample& s = result.best;
+        out += ", \"seconds\": " + number(s.wall) + ", \"median_seconds\": " + number(median(result.walls));
+        out += ", \"mib_per_second\": " + number(s.wall > 0 ? c.bytes / double(kMiB) / s.wall : 0);
+        out += ", \"files_per_second\": " + number(s.wall > 0 ? c.files / s.wall : 0);
+        out += ", \"user_seconds\": " + number(s.user) + ", \"system_seconds\": " + number(s.system);
+        out += ", \"read_syscalls\": " + std::to_string(s.readCalls);
+        out += ", \"write_syscalls\": " + std::to_string(s.writeCalls);
+        out += ", \"storage_read_bytes\": " + std::to_string(s.readBytes);
+        out += ", \"storage_write_bytes\": " + std::to_string(s.writeBytes);
+        out += ", \"voluntary_switches\": " + std::to_string(s.voluntarySwitches);
+        out += ", \"involuntary_switches\": " + std::to_string(s.involuntarySwitches);
+        out += ", \"peak_rss_kib\": " + std::to_string(result.peakRssKib) + "}";
+    }
+    out += "\n  ]\n}\n";
+    return out;
+}
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s [--dir DIR] [--json FILE] [--filter TEXT] [--repeat N] [--quick]\n"
+                 "  --dir     where the fixtures are made, to measure that filesystem (default $TMPDIR or /tmp)\n"
+                 "  --json    write the results there instead of to stdout\n"
+                 "  --filter  only run the cases whose name contains TEXT\n"
+                 "  --repeat  runs per case; the fastest one is reported (default 3)\n"
+                 "  --quick   much smaller fixtures, to check the harness itself\n",
+                 program);
+}
+
+bool parseArgs(int argc, char** argv, Config& config) {
+    const char* tmp = std::getenv("TMPDIR");
+    config.baseDir = tmp && *tmp ? tmp : "/tmp";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--dir" && hasValue) {
+            config.baseDir = argv[++i];
+        }
+        else if (arg == "--json" && hasValue) {
+            config.jsonPath = argv[++i];
+        }
+        else if (arg == "--filter" && hasValue) {
+            config.filter = argv[++i];
+        }
+        else if (arg == "--repeat" && hasValue) {
+            config.repeat = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--quick") {
+            config.quick = true;
+        }
+        else {
+            usage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Config config;
+    if (!parseArgs(argc, argv, config)) {
+        return 2;
+    }
+
+    std::string root = config.baseDir + "/pcmanfm-bench-XXXXXX";
+    if (!::mkdtemp(root.data())) {
+        std::fprintf(stderr, "cannot create a directory in %s: %s\n", config.baseDir.c_str(), std::strerror(errno));
+        return 1;
+    }
+    const std::string work = root + "/work";
+    ::mkdir(work.c_str(), 0755);
+
+    // from many tiny files, where the per-file cost dominates, to a few huge ones
+    const int scale = config.quick ? 8 : 1;
+    std::vector<Fixture> fixtures(4);
+    fixtures[0].name = "tiny";
+    fixtures[1].name = "small";
+    fixtures[2].name = "huge";
+    fixtures[3].name = "sparse";
+    for (Fixture& fixture : fixtures) {
+        fixture.path = root + "/" + fixture.name;
+    }
+    FsOps::Error err;
+    std::fprintf(stderr, "making fixtures in %s\n", root.c_str());
+    const bool made = makeTree(fixtures[0], 20, 400 / scale, 1 * kKiB, err) &&
+                      makeTree(fixtures[1], 10, 80 / scale, 64 * kKiB, err) &&
+                      makeTree(fixtures[2], 1, 2, 256 * kMiB / scale, err) &&
+                      makeSparse(fixtures[3], 1024 * kMiB / scale, 8, 2 * kMiB, err);
+    if (!made) {
+        std::fprintf(stderr, "%s\n", describe(err).c_str());
+        removeIfExists(root);
+        return 1;
+    }
+
+    std::vector<Case> cases;
+    for (const Fixture& fixture : fixtures) {
+        addFsCases(cases, fixture, work);
+    }
+    addArchiveCases(cases, fixtures[0], work);
+    addArchiveCases(cases, fixtures[1], work);
+    addReaderCases(cases, fixtures[2]);
+    addReaderCases(cases, fixtures[3]);
+
+    std::vector<Result> results;
+    bool peakRssReset = true;
+    bool failed = false;
+    for (const Case& benchCase : cases) {
+        if (!config.filter.empty() && benchCase.name.find(config.filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(runCase(benchCase, config.repeat, peakRssReset));
+        const Result& result = results.back();
+        if (!result.error.empty()) {
+            failed = true;
+            std::fprintf(stderr, "%-40s FAILED: %s\n", benchCase.name.c_str(), result.error.c_str());
+        }
+        else {
+            const double seconds = result.best.wall;
+            std::fprintf(stderr, "%-40s %9.3f s %10.1f MiB/s %8ld KiB peak\n", benchCase.name.c_str(), seconds,
+                         seconds > 0 ? benchCase.bytes / double(kMiB) / seconds : 0.0, result.peakRssKib);
+        }
+    }
+    removeIfExists(root);
+
+    const std::string json = toJson(config, results, peakRssReset);
+    if (config.jsonPath.empty()) {
+        std::fputs(json.c_str(), stdout);
+    }
+    else {
+        std::FILE* file = std::fopen(config.jsonPath.c_str(), "w");
+        if (!file || std::fputs(json.c_str(), file) < 0 || std::fclose(file) != 0) {
+            std::fprintf(stderr, "cannot write %s: %s\n", config.jsonPath.c_str(), std::strerror(errno));
+            return 1;
+        }
+    }
+    return failed ? 1 : 0;
+}
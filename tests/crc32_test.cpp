@@ -0,0 +1,63 @@
+/*
+ * Tests for the accelerated CRC-32
+ * tests/crc32_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/crc32.h"
+
+#include <zlib.h>
+
+#include <random>
+#include <vector>
+
+using namespace PCManFM;
+
+class Crc32Test : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void matchesCheckValue();
+    void matchesZlibForAnyLengthAndAlignment();
+    void continuesAcrossPieces();
+};
+
+void Crc32Test::matchesCheckValue() {
+    const char* check = "123456789";
+    QCOMPARE(crc32_update(0, reinterpret_cast<const std::uint8_t*>(check), 9), 0xCBF43926u);
+    QCOMPARE(crc32_update(0, nullptr, 0), 0u);
+}
+
+void Crc32Test::matchesZlibForAnyLengthAndAlignment() {
+    std::mt19937 rng(9);
+    std::vector<std::uint8_t> data(300000);
+    for (auto& c : data) {
+        c = static_cast<std::uint8_t>(rng());
+    }
+    // Short lengths around the 64-byte folding threshold and the 16-byte tail, then long ones.
+    for (int round = 0; round < 4000; ++round) {
+        const std::size_t offset = rng() % 64;
+        const std::size_t length = round < 3000 ? rng() % 300 : rng() % (data.size() - offset);
+        const std::uint32_t seed = round % 3 == 0 ? static_cast<std::uint32_t>(rng()) : 0;
+        const auto expected =
+            static_cast<std::uint32_t>(::crc32(seed, data.data() + offset, static_cast<uInt>(length)));
+        QCOMPARE(crc32_update(seed, data.data() + offset, length), expected);
+    }
+}
+
+void Crc32Test::continuesAcrossPieces() {
+    std::vector<std::uint8_t> data(100000, 0);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<std::uint8_t>(i * 31 + (i >> 8));
+    }
+    const std::uint32_t whole = crc32_update(0, data.data(), data.size());
+    std::uint32_t pieces = 0;
+    for (std::size_t pos = 0, step = 1; pos < data.size(); pos += step, step = step * 3 % 1000 + 1) {
+        pieces = crc32_update(pieces, data.data() + pos, std::min(step, data.size() - pos));
+    }
+    QCOMPARE(pieces, whole);
+}
+
+QTEST_MAIN(Crc32Test)
+#include "crc32_test.moc"
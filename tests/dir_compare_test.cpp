@@ -0,0 +1,184 @@
+/*
+ * Tests for comparing and syncing directory trees
+ * tests/dir_compare_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QByteArray>
+
+#include "../src/core/dir_compare.h"
+#include "../src/core/hash_cache.h"
+
+#include <errno.h>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::string nativePath(const QTemporaryDir& dir, const QString& name) {
+    return (dir.path() + QLatin1Char('/') + name).toLocal8Bit().toStdString();
+}
+
+void writeFile(const std::string& path, const QByteArray& data, std::int64_t mtimeSec) {
+    FsOps::Error err;
+    QVERIFY(FsOps::write_file_atomic(path, reinterpret_cast<const std::uint8_t*>(data.constData()),
+                                     static_cast<std::size_t>(data.size()), err, FsOps::Durability::None));
+    QVERIFY(FsOps::set_times(path, mtimeSec, 0, mtimeSec, 0, err));
+}
+
+QString describe(const DirCompare::Result& result) {
+    static const char* const kStates[] = {"same",       "left-newer", "right-newer", "left-only",
+                                          "right-only", "content",    "kind"};
+    QStringList lines;
+    for (const DirCompare::Entry& entry : result.entries) {
+        lines << QStringLiteral("%1 %2").arg(QString::fromStdString(entry.path),
+                                             QLatin1String(kStates[static_cast<int>(entry.state)]));
+    }
+    return lines.join(QLatin1Char('\n'));
+}
+
+}  // namespace
+
+class DirCompareTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void init();
+    void classifiesByMetadata();
+    void hashingSettlesUnsureFiles();
+    void plansSyncs();
+    void rejectsMissingRoot();
+    void progressCancels();
+
+   private:
+    void makeTrees();
+
+    QTemporaryDir cacheDir_;
+    HashCache cache_;
+    DirCompare::Options options_;
+    std::unique_ptr<QTemporaryDir> left_;
+    std::unique_ptr<QTemporaryDir> right_;
+};
+
+void DirCompareTest::init() {
+    FsOps::Error err;
+    cache_.close();
+    QVERIFY(cacheDir_.isValid());
+    const std::string cachePath = nativePath(cacheDir_, QStringLiteral("blake3.cache"));
+    ::unlink(cachePath.c_str());
+    QVERIFY(cache_.open(cachePath, err));
+    options_ = DirCompare::Options{};
+    options_.hashCache = &cache_;
+    options_.workerCount = 3;
+    makeTrees();
+}
+
+// same        the same on both sides
+// newer       larger and later on the left
+// touched     the same bytes, later on the left
+// sub/silent  other bytes of the same size at the same time
+// sub/only-l, only-r, onlydir/  on one side
+// kind        a file on the left, a directory on the right
+void DirCompareTest::makeTrees() {
+    left_ = std::make_unique<QTemporaryDir>();
+    right_ = std::make_unique<QTemporaryDir>();
+    QVERIFY(left_->isValid() && right_->isValid());
+    for (const auto* dir : {left_.get(), right_.get()}) {
+        QCOMPARE(::mkdir(nativePath(*dir, QStringLiteral("sub")).c_str(), 0755), 0);
+        writeFile(nativePath(*dir, QStringLiteral("same")), QByteArray("same"), 1000000000);
+    }
+    writeFile(nativePath(*left_, QStringLiteral("newer")), QByteArray("newer!"), 1000000200);
+    writeFile(nativePath(*right_, QStringLiteral("newer")), QByteArray("new"), 1000000000);
+    writeFile(nativePath(*left_, QStringLiteral("touched")), QByteArray("touched"), 1000000300);
+    writeFile(nativePath(*right_, QStringLiteral("touched")), QByteArray("touched"), 1000000000);
+    writeFile(nativePath(*left_, QStringLiteral("sub/silent")), QByteArray("aaaa"), 1000000000);
+    writeFile(nativePath(*right_, QStringLiteral("sub/silent")), QByteArray("bbbb"), 1000000000);
+    writeFile(nativePath(*left_, QStringLiteral("sub/only-l")), QByteArray("l"), 1000000000);
+    writeFile(nativePath(*right_, QStringLiteral("only-r")), QByteArray("r"), 1000000000);
+    QCOMPARE(::mkdir(nativePath(*left_, QStringLiteral("onlydir")).c_str(), 0755), 0);
+    writeFile(nativePath(*left_, QStringLiteral("onlydir/inside")), QByteArray("i"), 1000000000);
+    writeFile(nativePath(*left_, QStringLiteral("kind")), QByteArray("k"), 1000000000);
+    QCOMPARE(::mkdir(nativePath(*right_, QStringLiteral("kind")).c_str(), 0755), 0);
+}
+
+void DirCompareTest::classifiesByMetadata() {
+    DirCompare::Result result;
+    FsOps::Error err;
+    QVERIFY(DirCompare::compare(left_->path().toStdString(), right_->path().toStdString(), options_, {}, result, err));
+    QCOMPARE(describe(result), QStringLiteral("kind kind\n"
+                                              "newer left-newer\n"
+                                              "only-r right-only\n"
+                                              "onlydir left-only\n"
+                                              "sub/only-l left-only\n"
+                                              "touched left-newer"));
+    QCOMPARE(result.sameCount, std::uint64_t{2});  // same, and sub/silent as far as metadata goes
+    QVERIFY(result.errors.empty());
+    QCOMPARE(result.entries[1].left.size, std::uint64_t{6});
+    QCOMPARE(result.entries[1].right.size, std::uint64_t{3});
+    QCOMPARE(cache_.size(), std::size_t{0});
+}
+
+void DirCompareTest::hashingSettlesUnsureFiles() {
+    DirCompare::Result result;
+    FsOps::Error err;
+    options_.content = DirCompare::Content::HashWhenUnsure;
+    QVERIFY(DirCompare::compare(left_->path().toStdString(), right_->path().toStdString(), options_, {}, result, err));
+    QVERIFY(!describe(result).contains(QStringLiteral("touched")));
+    QVERIFY(!describe(result).contains(QStringLiteral("silent")));
+    QCOMPARE(result.sameCount, std::uint64_t{3});
+
+    options_.content = DirCompare::Content::HashAll;
+    QVERIFY(DirCompare::compare(left_->path().toStdString(), right_->path().toStdString(), options_, {}, result, err));
+    QVERIFY(describe(result).contains(QStringLiteral("sub/silent content")));
+    QCOMPARE(result.sameCount, std::uint64_t{2});
+}
+
+void DirCompareTest::plansSyncs() {
+    DirCompare::Result result;
+    FsOps::Error err;
+    options_.content = DirCompare::Content::HashAll;
+    QVERIFY(DirCompare::compare(left_->path().toStdString(), right_->path().toStdString(), options_, {}, result, err));
+
+    DirCompare::SyncPlan plan = DirCompare::plan_sync(result, DirCompare::Direction::LeftToRight);
+    QCOMPARE(plan.toRight, (std::vector<std::string>{"newer", "onlydir", "sub/only-l", "sub/silent"}));
+    QVERIFY(plan.toLeft.empty());
+    QCOMPARE(plan.conflicts, std::vector<std::string>{"kind"});
+    QCOMPARE(plan.bytesToRight, std::uint64_t{6 + 1 + 4});
+
+    plan = DirCompare::plan_sync(result, DirCompare::Direction::RightToLeft);
+    QCOMPARE(plan.toLeft, (std::vector<std::string>{"newer", "only-r", "sub/silent"}));
+    QVERIFY(plan.toRight.empty());
+
+    plan = DirCompare::plan_sync(result, DirCompare::Direction::Both);
+    QCOMPARE(plan.toRight, (std::vector<std::string>{"newer", "onlydir", "sub/only-l"}));
+    QCOMPARE(plan.toLeft, std::vector<std::string>{"only-r"});
+    QCOMPARE(plan.conflicts, (std::vector<std::string>{"kind", "sub/silent"}));
+}
+
+void DirCompareTest::rejectsMissingRoot() {
+    DirCompare::Result result;
+    FsOps::Error err;
+    QVERIFY(!DirCompare::compare(left_->path().toStdString(), nativePath(*right_, QStringLiteral("missing")), options_,
+                                 {}, result, err));
+    QCOMPARE(err.code, ENOENT);
+    QVERIFY(!DirCompare::compare(left_->path().toStdString(), nativePath(*right_, QStringLiteral("same")), options_, {},
+                                 result, err));
+    QCOMPARE(err.code, ENOTDIR);
+}
+
+void DirCompareTest::progressCancels() {
+    DirCompare::Result result;
+    FsOps::Error err;
+    auto progress = [](std::uint64_t, std::uint64_t) { return false; };
+    QVERIFY(!DirCompare::compare(left_->path().toStdString(), right_->path().toStdString(), options_, progress,
+                                 result, err));
+    QCOMPARE(err.code, ECANCELED);
+    QVERIFY(result.entries.empty());
+}
+
+QTEST_MAIN(DirCompareTest)
+#include "dir_compare_test.moc"
@@ -14,6 +14,8 @@ class DisasmEngineTest : public QObject {
 
    private slots:
     void disassemblesSimpleX86();
+    void sweepsPastInvalidBytes();
+    void collectsIntoBlock();
 };
 
 void DisasmEngineTest::disassemblesSimpleX86() {
@@ -31,5 +33,56 @@ void DisasmEngineTest::disassemblesSimpleX86() {
     QCOMPARE(out[2].address, static_cast<std::uint64_t>(0x1004));
 }
 
+void DisasmEngineTest::sweepsPastInvalidBytes() {
+    // push rbp; (push es is invalid in 64-bit mode); mov rbp,rsp; ret
+    const std::uint8_t code[] = {0x55, 0x06, 0x48, 0x89, 0xe5, 0xc3};
+    DisasmEngine engine;
+    QVERIFY(engine.configure(CpuArch::X86_64, true));
+
+    std::vector<std::uint64_t> addresses;
+    std::vector<QString> mnemonics;
+    const auto visit = [&](const DisasmInsnView& ins) {
+        addresses.push_back(ins.address);
+        mnemonics.push_back(QString::fromLatin1(ins.mnemonic).toLower());
+    };
+    QCOMPARE(engine.sweep(code, sizeof(code), sizeof(code), 0x1000, visit), sizeof(code));
+    QCOMPARE(mnemonics.size(), static_cast<std::size_t>(4));
+    QCOMPARE(mnemonics[1], QStringLiteral(".byte"));
+    QCOMPARE(addresses[2], static_cast<std::uint64_t>(0x1002));
+    QCOMPARE(mnemonics[3], QStringLiteral("ret"));
+
+    // The instruction starting before the limit is still decoded whole.
+    addresses.clear();
+    mnemonics.clear();
+    QCOMPARE(engine.sweep(code, sizeof(code), 3, 0x1000, visit), static_cast<std::size_t>(5));
+    QCOMPARE(mnemonics.size(), static_cast<std::size_t>(3));
+    QCOMPARE(mnemonics[2], QStringLiteral("mov"));
+}
+
+void DisasmEngineTest::collectsIntoBlock() {
+    // push rbp; push es (invalid); mov rbp,rsp; push rbp; ret
+    const std::uint8_t code[] = {0x55, 0x06, 0x48, 0x89, 0xe5, 0x55, 0xc3};
+    DisasmEngine engine;
+    QVERIFY(engine.configure(CpuArch::X86_64, true));
+
+    DisasmBlock block;
+    std::string err;
+    QVERIFY(engine.disassemble(code, sizeof(code), 0x2000, block, err));
+    QCOMPARE(block.size(), static_cast<std::size_t>(5));
+    QCOMPARE(block.baseAddress(), static_cast<std::uint64_t>(0x2000));
+    QCOMPARE(block.address(2), static_cast<std::uint64_t>(0x2002));
+    QCOMPARE(block.byteCount(2), static_cast<std::size_t>(3));
+    QCOMPARE(block.bytes(2)[2], static_cast<std::uint8_t>(0xe5));
+    QCOMPARE(QString::fromStdString(block.mnemonic(1)), QStringLiteral(".byte"));
+    QCOMPARE(QString::fromLatin1(block.operands(2)).toLower(), QStringLiteral("rbp, rsp"));
+    QCOMPARE(QString::fromLatin1(block.operands(4)), QString());
+    QVERIFY(block.kind(4) == DisasmInstr::Kind::ReturnIns);
+    // Both pushes share one interned mnemonic.
+    QCOMPARE(&block.mnemonic(0), &block.mnemonic(3));
+
+    block.clear();
+    QVERIFY(block.empty());
+}
+
 QTEST_MAIN(DisasmEngineTest)
 #include "disasm_engine_test.moc"
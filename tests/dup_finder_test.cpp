@@ -0,0 +1,244 @@
+/*
+ * Tests for the duplicate finder
+ * tests/dup_finder_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QByteArray>
+#include <QDir>
+
+#include "../src/core/dup_finder.h"
+#include "../src/core/hash_cache.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::string nativePath(const QTemporaryDir& dir, const QString& name) {
+    return (dir.path() + QLatin1Char('/') + name).toLocal8Bit().toStdString();
+}
+
+void writeFile(const std::string& path, const QByteArray& data) {
+    FsOps::Error err;
+    QVERIFY(FsOps::write_file_atomic(path, reinterpret_cast<const std::uint8_t*>(data.constData()),
+                                     static_cast<std::size_t>(data.size()), err, FsOps::Durability::None));
+    // settled, so that the hash cache keeps the digests
+    QVERIFY(FsOps::set_times(path, 1000000000, 0, 1000000000, 0, err));
+}
+
+// |size| bytes that differ from those of another |seed| everywhere
+QByteArray pattern(int size, char seed) {
+    QByteArray data(size, '\0');
+    for (int i = 0; i < size; ++i) {
+        data[i] = static_cast<char>(seed + i * 7);
+    }
+    return data;
+}
+
+QStringList names(const DupFinder::Group& group, const QTemporaryDir& dir) {
+    QStringList result;
+    for (const DupFinder::File& file : group.files) {
+        result << QString::fromLocal8Bit(file.path.c_str()).mid(dir.path().size() + 1);
+    }
+    return result;
+}
+
+}  // namespace
+
+class DupFinderTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void init();
+    void groupsBySizeAndContent();
+    void sameEndsDifferentMiddle();
+    void hardLinksCountOnce();
+    void progressCancels();
+    void missingRootFails();
+    void hardlinkDedup();
+    void changedFileIsKept();
+
+   private:
+    QTemporaryDir cacheDir_;
+    HashCache cache_;
+    DupFinder::Options options_;
+};
+
+void DupFinderTest::init() {
+    FsOps::Error err;
+    cache_.close();
+    QVERIFY(cacheDir_.isValid());
+    const std::string cachePath = nativePath(cacheDir_, QStringLiteral("blake3.cache"));
+    ::unlink(cachePath.c_str());
+    QVERIFY(cache_.open(cachePath, err));
+    options_.hashCache = &cache_;
+    options_.workerCount = 3;
+}
+
+void DupFinderTest::groupsBySizeAndContent() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(::mkdir(nativePath(dir, QStringLiteral("sub")).c_str(), 0755) == 0);
+    QVERIFY(::mkdir(nativePath(dir, QStringLiteral("sub/deeper")).c_str(), 0755) == 0);
+    const QByteArray small = pattern(1000, 'a');
+    const QByteArray large = pattern(300 * 1024, 'b');
+    writeFile(nativePath(dir, QStringLiteral("small1")), small);
+    writeFile(nativePath(dir, QStringLiteral("sub/small2")), small);
+    writeFile(nativePath(dir, QStringLiteral("sub/deeper/small3")), small);
+    writeFile(nativePath(dir, QStringLiteral("other")), pattern(1000, 'c'));  // same size only
+    writeFile(nativePath(dir, QStringLiteral("large1")), large);
+    writeFile(nativePath(dir, QStringLiteral("sub/large2")), large);
+    writeFile(nativePath(dir, QStringLiteral("empty1")), QByteArray());
+    writeFile(nativePath(dir, QStringLiteral("empty2")), QByteArray());
+    QVERIFY(::symlink("large1", nativePath(dir, QStringLiteral("link")).c_str()) == 0);
+
+    std::vector<DupFinder::Group> groups;
+    FsOps::Error err;
+    QVERIFY(DupFinder::find_duplicates({nativePath(dir, QString())}, groups, options_, {}, err));
+    QCOMPARE(groups.size(), std::size_t{2});
+
+    // the most to reclaim first
+    QCOMPARE(groups[0].size, std::uint64_t{300 * 1024});
+    QCOMPARE(names(groups[0], dir), QStringList({QStringLiteral("large1"), QStringLiteral("sub/large2")}));
+    QCOMPARE(groups[1].size, std::uint64_t{1000});
+    QCOMPARE(names(groups[1], dir), QStringList({QStringLiteral("small1"), QStringLiteral("sub/deeper/small3"),
+                                                 QStringLiteral("sub/small2")}));
+    QCOMPARE(groups[1].reclaimable(), std::uint64_t{2000});
+
+    // the digests are those of the whole files, sampled whole or not
+    for (const DupFinder::Group& group : groups) {
+        std::string expected;
+        QVERIFY(FsOps::blake3_file(group.files.front().path, expected, err));
+        QCOMPARE(group.hexHash, expected);
+    }
+    // and only the large files needed the cache
+    QCOMPARE(cache_.size(), std::size_t{2});
+}
+
+void DupFinderTest::sameEndsDifferentMiddle() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QByteArray data = pattern(512 * 1024, 'd');
+    writeFile(nativePath(dir, QStringLiteral("a")), data);
+    writeFile(nativePath(dir, QStringLiteral("b")), data);
+    data[256 * 1024] = static_cast<char>(data[256 * 1024] + 1);
+    writeFile(nativePath(dir, QStringLiteral("c")), data);
+
+    std::vector<DupFinder::Group> groups;
+    FsOps::Error err;
+    QVERIFY(DupFinder::find_duplicates({nativePath(dir, QString())}, groups, options_, {}, err));
+    QCOMPARE(groups.size(), std::size_t{1});
+    QCOMPARE(names(groups[0], dir), QStringList({QStringLiteral("a"), QStringLiteral("b")}));
+}
+
+void DupFinderTest::hardLinksCountOnce() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray data = pattern(4096, 'e');
+    writeFile(nativePath(dir, QStringLiteral("a")), data);
+    QVERIFY(::link(nativePath(dir, QStringLiteral("a")).c_str(), nativePath(dir, QStringLiteral("b")).c_str()) == 0);
+
+    std::vector<DupFinder::Group> groups;
+    FsOps::Error err;
+    // the file is also given as a root of its own
+    QVERIFY(DupFinder::find_duplicates({nativePath(dir, QString()), nativePath(dir, QStringLiteral("a"))}, groups,
+                                       options_, {}, err));
+    QVERIFY(groups.empty());
+
+    writeFile(nativePath(dir, QStringLiteral("c")), data);
+    QVERIFY(DupFinder::find_duplicates({nativePath(dir, QString())}, groups, options_, {}, err));
+    QCOMPARE(groups.size(), std::size_t{1});
+    QCOMPARE(names(groups[0], dir), QStringList({QStringLiteral("a"), QStringLiteral("c")}));
+}
+
+void DupFinderTest::progressCancels() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    for (int i = 0; i < 4; ++i) {
+        writeFile(nativePath(dir, QStringLiteral("f%1").arg(i)), pattern(200 * 1024, 'f'));
+    }
+
+    std::vector<DupFinder::Group> groups;
+    FsOps::Error err;
+    bool sawScanning = false;
+    auto progress = [&](DupFinder::Stage stage, std::uint64_t, std::uint64_t) {
+        sawScanning = sawScanning || stage == DupFinder::Stage::Scanning;
+        return stage != DupFinder::Stage::Sampling;
+    };
+    QVERIFY(!DupFinder::find_duplicates({nativePath(dir, QString())}, groups, options_, progress, err));
+    QCOMPARE(err.code, ECANCELED);
+    QVERIFY(sawScanning);
+    QVERIFY(groups.empty());
+}
+
+void DupFinderTest::missingRootFails() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    std::vector<DupFinder::Group> groups;
+    FsOps::Error err;
+    QVERIFY(!DupFinder::find_duplicates({nativePath(dir, QStringLiteral("missing"))}, groups, options_, {}, err));
+    QCOMPARE(err.code, ENOENT);
+}
+
+void DupFinderTest::hardlinkDedup() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray data = pattern(200 * 1024, 'g');
+    writeFile(nativePath(dir, QStringLiteral("a")), data);
+    writeFile(nativePath(dir, QStringLiteral("b")), data);
+    writeFile(nativePath(dir, QStringLiteral("c")), data);
+
+    std::vector<DupFinder::Group> groups;
+    FsOps::Error err;
+    QVERIFY(DupFinder::find_duplicates({nativePath(dir, QString())}, groups, options_, {}, err));
+    QCOMPARE(groups.size(), std::size_t{1});
+
+    DupFinder::DedupResult result;
+    QVERIFY(DupFinder::dedup_group(groups[0], DupFinder::Method::Hardlink, result));
+    QCOMPARE(result.merged, std::size_t{2});
+    QCOMPARE(result.bytesSaved, std::uint64_t{400 * 1024});
+    QVERIFY(result.failures.empty());
+
+    struct stat a, c;
+    QCOMPARE(::stat(nativePath(dir, QStringLiteral("a")).c_str(), &a), 0);
+    QCOMPARE(::stat(nativePath(dir, QStringLiteral("c")).c_str(), &c), 0);
+    QCOMPARE(a.st_ino, c.st_ino);
+    QCOMPARE(a.st_nlink, nlink_t{3});
+    QVERIFY(QDir(dir.path()).entryList(QDir::Files | QDir::Hidden).size() == 3);  // no temporary left
+
+    QVERIFY(DupFinder::find_duplicates({nativePath(dir, QString())}, groups, options_, {}, err));
+    QVERIFY(groups.empty());
+}
+
+void DupFinderTest::changedFileIsKept() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray data = pattern(2048, 'h');
+    writeFile(nativePath(dir, QStringLiteral("a")), data);
+    writeFile(nativePath(dir, QStringLiteral("b")), data);
+
+    std::vector<DupFinder::Group> groups;
+    FsOps::Error err;
+    QVERIFY(DupFinder::find_duplicates({nativePath(dir, QString())}, groups, options_, {}, err));
+    QCOMPARE(groups.size(), std::size_t{1});
+
+    QVERIFY(FsOps::set_times(nativePath(dir, QStringLiteral("b")), 1000000001, 0, 1000000001, 0, err));
+    DupFinder::DedupResult result;
+    QVERIFY(!DupFinder::dedup_group(groups[0], DupFinder::Method::Hardlink, result));
+    QCOMPARE(result.merged, std::size_t{0});
+    QCOMPARE(result.failures.size(), std::size_t{1});
+    QCOMPARE(result.failures[0].second.code, ESTALE);
+
+    struct stat a, b;
+    QCOMPARE(::stat(nativePath(dir, QStringLiteral("a")).c_str(), &a), 0);
+    QCOMPARE(::stat(nativePath(dir, QStringLiteral("b")).c_str(), &b), 0);
+    QVERIFY(a.st_ino != b.st_ino);
+}
+
+QTEST_MAIN(DupFinderTest)
+#include "dup_finder_test.moc"
@@ -0,0 +1,134 @@
+/*
+ * Tests for the hex editor undo/redo history
+ * tests/edit_history_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/edit_history.h"
+
+#include <string>
+#include <vector>
+
+using namespace PCManFM;
+using Piece = PieceTree::Piece;
+using Entry = EditHistory::Entry;
+
+namespace {
+
+Piece original(std::uint64_t sourceOffset, std::uint64_t length) {
+    Piece piece;
+    piece.sourceOffset = sourceOffset;
+    piece.length = length;
+    return piece;
+}
+
+Piece added(std::uint64_t sourceOffset, std::uint64_t length) {
+    Piece piece = original(sourceOffset, length);
+    piece.kind = Piece::Kind::Added;
+    return piece;
+}
+
+Entry keystroke(std::uint64_t offset, std::uint64_t addedOffset) {
+    Entry entry;
+    entry.offset = offset;
+    entry.removed = {original(offset, 1)};
+    entry.inserted = {added(addedOffset, 1)};
+    entry.typing = true;
+    return entry;
+}
+
+}  // namespace
+
+class EditHistoryTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void coalescesTyping();
+    void keepsSeparateEdits();
+    void spillsOldEntries();
+};
+
+void EditHistoryTest::coalescesTyping() {
+    EditHistory history;
+    for (std::uint64_t i = 0; i < 5; ++i) {
+        history.record(keystroke(100 + i, i));
+    }
+
+    Entry entry;
+    std::string err;
+    QVERIFY(history.undo(entry, err));
+    QCOMPARE(entry.offset, std::uint64_t(100));
+    QCOMPARE(entry.removed.size(), std::size_t(1));
+    QCOMPARE(entry.removed.front().length, std::uint64_t(5));
+    QCOMPARE(entry.inserted.size(), std::size_t(1));
+    QCOMPARE(entry.insertedLength(), std::uint64_t(5));
+    QVERIFY(!history.canUndo());
+
+    QVERIFY(history.redo(entry, err));
+    QCOMPARE(entry.removedLength(), std::uint64_t(5));
+    QVERIFY(!history.redo(entry, err));
+    QVERIFY(err.empty());
+}
+
+void EditHistoryTest::keepsSeparateEdits() {
+    EditHistory history;
+    history.record(keystroke(10, 0));
+    history.record(keystroke(50, 1));  // not adjacent
+
+    Entry paste;
+    paste.offset = 51;
+    paste.inserted = {added(2, 16)};
+    history.record(paste);  // adjacent but not typing
+    history.record(keystroke(67, 18));
+
+    std::uint64_t offsets[] = {67, 51, 50, 10};
+    for (std::uint64_t expected : offsets) {
+        Entry entry;
+        std::string err;
+        QVERIFY(history.undo(entry, err));
+        QCOMPARE(entry.offset, expected);
+    }
+    QVERIFY(!history.canUndo());
+
+    // A new edit drops whatever could have been redone.
+    history.record(keystroke(0, 19));
+    QVERIFY(!history.canRedo());
+}
+
+void EditHistoryTest::spillsOldEntries() {
+    EditHistory history(4096);
+    const int count = 500;
+    for (int i = 0; i < count; ++i) {
+        Entry entry;
+        entry.offset = static_cast<std::uint64_t>(i) * 4;
+        entry.removed = {original(entry.offset, 2), added(1000 + i, 1)};
+        entry.inserted = {added(static_cast<std::uint64_t>(i), 3)};
+        history.record(entry);
+    }
+    QVERIFY(history.spilledCount() > 0);
+    QVERIFY(history.residentBytes() <= 4096);
+
+    for (int i = count - 1; i >= 0; --i) {
+        Entry entry;
+        std::string err;
+        QVERIFY2(history.undo(entry, err), err.c_str());
+        QCOMPARE(entry.offset, static_cast<std::uint64_t>(i) * 4);
+        QCOMPARE(entry.removed.size(), std::size_t(2));
+        QVERIFY(entry.removed[1].kind == Piece::Kind::Added);
+        QCOMPARE(entry.removed[1].sourceOffset, std::uint64_t(1000 + i));
+        QCOMPARE(entry.insertedLength(), std::uint64_t(3));
+    }
+    QVERIFY(!history.canUndo());
+
+    for (int i = 0; i < count; ++i) {
+        Entry entry;
+        std::string err;
+        QVERIFY2(history.redo(entry, err), err.c_str());
+        QCOMPARE(entry.offset, static_cast<std::uint64_t>(i) * 4);
+    }
+    QVERIFY(!history.canRedo());
+}
+
+QTEST_MAIN(EditHistoryTest)
+#include "edit_history_test.moc"
@@ -0,0 +1,245 @@
+/*
+ * Tests for the embedded preview extractor
+ * tests/embedded_preview_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+#include "../src/core/embedded_preview.h"
+#include "../src/core/windowed_file_reader.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace PCManFM;
+
+namespace {
+
+using Bytes = std::vector<std::uint8_t>;
+
+struct IfdEntry {
+    std::uint16_t tag;
+    std::uint16_t type;
+    std::uint32_t count;
+    std::uint32_t value;
+};
+
+class Writer {
+   public:
+    Writer(Bytes& data, bool bigEndian) : data_{data}, bigEndian_{bigEndian} {}
+
+    void put16(std::size_t at, std::uint16_t value) {
+        grow(at + 2);
+        data_[at + (bigEndian_ ? 0 : 1)] = static_cast<std::uint8_t>(value >> 8);
+        data_[at + (bigEndian_ ? 1 : 0)] = static_cast<std::uint8_t>(value);
+    }
+
+    void put32(std::size_t at, std::uint32_t value) {
+        if (bigEndian_) {
+            put16(at, static_cast<std::uint16_t>(value >> 16));
+            put16(at + 2, static_cast<std::uint16_t>(value));
+        }
+        else {
+            put16(at, static_cast<std::uint16_t>(value));
+            put16(at + 2, static_cast<std::uint16_t>(value >> 16));
+        }
+    }
+
+    void putBytes(std::size_t at, const Bytes& bytes) {
+        grow(at + bytes.size());
+        std::copy(bytes.begin(), bytes.end(), data_.begin() + static_cast<std::ptrdiff_t>(at));
+    }
+
+    void header(std::uint32_t firstIfd) {
+        grow(2);
+        data_[0] = data_[1] = bigEndian_ ? 'M' : 'I';
+        put16(2, 42);
+        put32(4, firstIfd);
+    }
+
+    // SHORT values are left-justified in the value field, as TIFF stores them.
+    void ifd(std::size_t at, const std::vector<IfdEntry>& entries, std::uint32_t next) {
+        put16(at, static_cast<std::uint16_t>(entries.size()));
+        std::size_t pos = at + 2;
+        for (const auto& entry : entries) {
+            put16(pos, entry.tag);
+            put16(pos + 2, entry.type);
+            put32(pos + 4, entry.count);
+            if (entry.type == 3 && entry.count == 1) {
+                put16(pos + 8, static_cast<std::uint16_t>(entry.value));
+                put16(pos + 10, 0);
+            }
+            else {
+                put32(pos + 8, entry.value);
+            }
+            pos += 12;
+        }
+        put32(pos, next);
+    }
+
+   private:
+    void grow(std::size_t size) {
+        if (data_.size() < size) {
+            data_.resize(size, 0);
+        }
+    }
+
+    Bytes& data_;
+    bool bigEndian_;
+};
+
+// Just the markers the extractor reads: SOI, a baseline frame header and EOI.
+Bytes fakeJpeg(std::uint16_t width, std::uint16_t height) {
+    Bytes jpeg{0xff, 0xd8, 0xff, 0xc0, 0x00, 0x11, 0x08};
+    jpeg.push_back(static_cast<std::uint8_t>(height >> 8));
+    jpeg.push_back(static_cast<std::uint8_t>(height));
+    jpeg.push_back(static_cast<std::uint8_t>(width >> 8));
+    jpeg.push_back(static_cast<std::uint8_t>(width));
+    jpeg.push_back(3);
+    for (std::uint8_t component = 1; component <= 3; ++component) {
+        jpeg.insert(jpeg.end(), {component, 0x11, 0x00});
+    }
+    jpeg.insert(jpeg.end(), {0xff, 0xd9});
+    return jpeg;
+}
+
+// A NEF-like file: a thumbnail in IFD1, a preview and the raw data in SubIFDs.
+Bytes fakeRaw() {
+    Bytes data;
+    Writer w(data, false);
+    w.header(8);
+    w.ifd(8, {{0x0112, 3, 1, 6}, {0x014a, 4, 2, 40}}, 136);
+    w.put32(40, 48);
+    w.put32(44, 80);
+    w.ifd(48, {{0x0201, 4, 1, 200}, {0x0202, 4, 1, 23}}, 0);
+    w.ifd(80, {{0x0103, 3, 1, 7}, {0x0106, 3, 1, 32803}, {0x0111, 4, 1, 400}, {0x0117, 4, 1, 23}}, 0);
+    w.ifd(136, {{0x0201, 4, 1, 300}, {0x0202, 4, 1, 23}}, 0);
+    w.putBytes(200, fakeJpeg(1600, 1067));
+    w.putBytes(300, fakeJpeg(160, 120));
+    w.putBytes(400, fakeJpeg(6000, 4000));
+    return data;
+}
+
+std::string writeFile(QTemporaryDir& dir, const QString& name, const Bytes& data) {
+    const QString path = dir.path() + QLatin1Char('/') + name;
+    QFile f(path);
+    if (f.open(QIODevice::WriteOnly)) {
+        f.write(reinterpret_cast<const char*>(data.data()), static_cast<qint64>(data.size()));
+    }
+    return path.toStdString();
+}
+
+}  // namespace
+
+class EmbeddedPreviewTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void picksSmallestLargeEnoughRawPreview();
+    void skipsRawSensorData();
+    void readsExifThumbnailOfJpeg();
+    void readsRafPreview();
+    void rejectsOtherFiles();
+};
+
+void EmbeddedPreviewTest::picksSmallestLargeEnoughRawPreview() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const Bytes raw = fakeRaw();
+    const std::string path = writeFile(dir, QStringLiteral("photo.nef"), raw);
+
+    WindowedFileReader reader(path, 0);
+    QVERIFY(reader.valid());
+    EmbeddedPreview preview;
+    QVERIFY(find_embedded_preview(reader, 128, preview));
+    QCOMPARE(preview.offset, std::uint64_t{300});
+    QCOMPARE(preview.width, 160u);
+    QCOMPARE(preview.height, 120u);
+    QCOMPARE(preview.orientation, 6);
+
+    QVERIFY(find_embedded_preview(reader, 256, preview));
+    QCOMPARE(preview.offset, std::uint64_t{200});
+    QCOMPARE(preview.width, 1600u);
+
+    std::vector<std::uint8_t> jpeg;
+    QVERIFY(read_embedded_preview(path, 256, jpeg, preview));
+    QVERIFY(jpeg == fakeJpeg(1600, 1067));
+}
+
+void EmbeddedPreviewTest::skipsRawSensorData() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = writeFile(dir, QStringLiteral("photo.nef"), fakeRaw());
+
+    // the only JPEG this large is the lossless one holding the sensor data
+    WindowedFileReader reader(path, 0);
+    EmbeddedPreview preview;
+    QVERIFY(!find_embedded_preview(reader, 2000, preview));
+}
+
+void EmbeddedPreviewTest::readsExifThumbnailOfJpeg() {
+    Bytes tiff;
+    Writer w(tiff, true);
+    w.header(8);
+    w.ifd(8, {{0x0112, 3, 1, 3}}, 26);
+    w.ifd(26, {{0x0201, 4, 1, 64}, {0x0202, 4, 1, 23}}, 0);
+    w.putBytes(64, fakeJpeg(160, 120));
+
+    Bytes file{0xff, 0xd8, 0xff, 0xe1};
+    const std::size_t segmentLength = 2 + 6 + tiff.size();
+    file.push_back(static_cast<std::uint8_t>(segmentLength >> 8));
+    file.push_back(static_cast<std::uint8_t>(segmentLength));
+    file.insert(file.end(), {'E', 'x', 'i', 'f', 0, 0});
+    file.insert(file.end(), tiff.begin(), tiff.end());
+    const Bytes image = fakeJpeg(4000, 3000);
+    file.insert(file.end(), image.begin() + 2, image.end());
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    WindowedFileReader reader(writeFile(dir, QStringLiteral("photo.jpg"), file), 0);
+    EmbeddedPreview preview;
+    QVERIFY(find_embedded_preview(reader, 128, preview));
+    QCOMPARE(preview.offset, std::uint64_t{12 + 64});
+    QCOMPARE(preview.width, 160u);
+    QCOMPARE(preview.orientation, 3);
+
+    QVERIFY(!find_embedded_preview(reader, 512, preview));
+}
+
+void EmbeddedPreviewTest::readsRafPreview() {
+    Bytes file(100, 0);
+    const char magic[] = "FUJIFILMCCD-RAW 0201";
+    std::copy(magic, magic + sizeof(magic) - 1, file.begin());
+    Writer w(file, true);
+    w.put32(84, 100);
+    w.put32(88, 23);
+    w.putBytes(100, fakeJpeg(1920, 1280));
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    WindowedFileReader reader(writeFile(dir, QStringLiteral("photo.raf"), file), 0);
+    EmbeddedPreview preview;
+    QVERIFY(find_embedded_preview(reader, 256, preview));
+    QCOMPARE(preview.offset, std::uint64_t{100});
+    QCOMPARE(preview.width, 1920u);
+    QCOMPARE(preview.height, 1280u);
+}
+
+void EmbeddedPreviewTest::rejectsOtherFiles() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const Bytes text(256, 'x');
+    WindowedFileReader reader(writeFile(dir, QStringLiteral("notes.txt"), text), 0);
+    EmbeddedPreview preview;
+    QVERIFY(!find_embedded_preview(reader, 0, preview));
+
+    // a JPEG without EXIF data has no preview
+    WindowedFileReader plain(writeFile(dir, QStringLiteral("plain.jpg"), fakeJpeg(800, 600)), 0);
+    QVERIFY(!find_embedded_preview(plain, 0, preview));
+}
+
+QTEST_MAIN(EmbeddedPreviewTest)
+#include "embedded_preview_test.moc"
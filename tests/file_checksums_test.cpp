@@ -0,0 +1,243 @@
+/*
+ * Tests for multi-algorithm file checksums and manifests
+ * tests/file_checksums_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+
+#include "../src/core/file_checksums.h"
+
+#include <b3sum/blake3.h>
+
+#include <errno.h>
+#include <random>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace PCManFM;
+using namespace PCManFM::FileChecksums;
+
+namespace {
+
+std::string toHex(const std::uint8_t* digest, std::size_t size) {
+    static const char* kHex = "0123456789abcdef";
+    std::string hex;
+    for (std::size_t i = 0; i < size; ++i) {
+        hex += kHex[digest[i] >> 4];
+        hex += kHex[digest[i] & 0xF];
+    }
+    return hex;
+}
+
+std::string sha256Hex(const std::string& data) {
+    Sha256 sha;
+    sha.update(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+    std::uint8_t digest[Sha256::kDigestSize];
+    sha.finish(digest);
+    return toHex(digest, sizeof(digest));
+}
+
+std::string blake3Hex(const std::string& data) {
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, data.data(), data.size());
+    std::uint8_t digest[BLAKE3_OUT_LEN];
+    blake3_hasher_finalize(&hasher, digest, BLAKE3_OUT_LEN);
+    return toHex(digest, sizeof(digest));
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+    FsOps::Error err;
+    QVERIFY(FsOps::write_file_atomic(path, reinterpret_cast<const std::uint8_t*>(data.data()), data.size(), err,
+                                     FsOps::Durability::None));
+}
+
+std::string randomData(std::size_t size, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::string data(size, '\0');
+    for (auto& c : data) {
+        c = static_cast<char>(rng());
+    }
+    return data;
+}
+
+}  // namespace
+
+class FileChecksumsTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void sha256MatchesKnownVectors();
+    void sha256ContinuesAcrossPieces();
+    void hashesEveryAlgorithmInOnePass();
+    void manifestRoundTripsEscapedNames();
+    void verifyReportsMismatches();
+    void progressCancels();
+};
+
+void FileChecksumsTest::sha256MatchesKnownVectors() {
+    QCOMPARE(sha256Hex(""), std::string("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+    QCOMPARE(sha256Hex("abc"), std::string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    QCOMPARE(sha256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+             std::string("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+    QCOMPARE(sha256Hex(std::string(1000000, 'a')),
+             std::string("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+}
+
+void FileChecksumsTest::sha256ContinuesAcrossPieces() {
+    const std::string data = randomData(70000, 3);
+    const std::string whole = sha256Hex(data);
+    // Piece sizes around the 64-byte block and the padding boundary at 56.
+    for (const std::size_t step : {std::size_t{1}, std::size_t{55}, std::size_t{56}, std::size_t{63},
+                                   std::size_t{64}, std::size_t{65}, std::size_t{4097}}) {
+        Sha256 sha;
+        for (std::size_t pos = 0; pos < data.size(); pos += step) {
+            sha.update(reinterpret_cast<const std::uint8_t*>(data.data()) + pos, std::min(step, data.size() - pos));
+        }
+        std::uint8_t digest[Sha256::kDigestSize];
+        sha.finish(digest);
+        QCOMPARE(toHex(digest, sizeof(digest)), whole);
+    }
+}
+
+void FileChecksumsTest::hashesEveryAlgorithmInOnePass() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string root = dir.path().toStdString();
+
+    // Empty, inline and pipelined (several blocks with a partial last one) files.
+    const std::vector<std::string> contents = {std::string(), randomData(100, 1), randomData(9 * 1024 * 1024 + 7, 2)};
+    std::vector<std::string> paths;
+    for (std::size_t i = 0; i < contents.size(); ++i) {
+        paths.push_back(root + "/f" + std::to_string(i));
+        writeFile(paths.back(), contents[i]);
+    }
+    paths.push_back(root);
+
+    for (const unsigned concurrent : {1u, 3u}) {
+        std::vector<FileResult> results;
+        FsOps::ProgressInfo progress;
+        FsOps::Error err;
+        Options opts;
+        opts.concurrentFiles = concurrent;
+        QVERIFY(!hash_files(paths, results, progress, {}, err, opts));
+        QCOMPARE(err.code, EINVAL);
+        QCOMPARE(results.size(), paths.size());
+        for (std::size_t i = 0; i < contents.size(); ++i) {
+            QVERIFY(!results[i].error.isSet());
+            QCOMPARE(results[i].path, paths[i]);
+            QCOMPARE(results[i].digests[static_cast<std::size_t>(Algorithm::Sha256)], sha256Hex(contents[i]));
+            QCOMPARE(results[i].digests[static_cast<std::size_t>(Algorithm::Blake3)], blake3Hex(contents[i]));
+        }
+        QVERIFY(results.back().error.isSet());
+        QCOMPARE(progress.filesDone, 4);
+        QCOMPARE(progress.bytesDone, progress.bytesTotal);
+        QCOMPARE(progress.bytesTotal, std::uint64_t{contents[1].size() + contents[2].size()});
+    }
+
+    std::vector<FileResult> results;
+    FsOps::ProgressInfo progress;
+    FsOps::Error err;
+    Options shaOnly;
+    shaOnly.blake3 = false;
+    paths.pop_back();
+    QVERIFY(hash_files(paths, results, progress, {}, err, shaOnly));
+    QCOMPARE(results[2].digests[static_cast<std::size_t>(Algorithm::Sha256)], sha256Hex(contents[2]));
+    QVERIFY(results[2].digests[static_cast<std::size_t>(Algorithm::Blake3)].empty());
+}
+
+void FileChecksumsTest::manifestRoundTripsEscapedNames() {
+    std::vector<FileResult> results(4);
+    results[0].path = "/data/plain.txt";
+    results[1].path = "/data/sub/line\nbreak\\name";
+    results[2].path = "/elsewhere/abs";
+    results[3].path = "/data/failed";
+    results[3].error.code = EIO;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        results[i].digests[static_cast<std::size_t>(Algorithm::Sha256)] = std::string(64, "0a1f"[i]);
+    }
+
+    const std::string text = format_manifest(results, Algorithm::Sha256, "/data");
+    QCOMPARE(text, std::string(64, '0') + "  plain.txt\n" + "\\" + std::string(64, 'a') +
+                       "  sub/line\\nbreak\\\\name\n" + std::string(64, '1') + "  /elsewhere/abs\n");
+    QVERIFY(format_manifest(results, Algorithm::Blake3, "/data").empty());
+
+    std::vector<ManifestEntry> entries;
+    FsOps::Error err;
+    QVERIFY(parse_manifest("# comment\r\n\r\n" + text + std::string(64, 'F') + " *binary\n", entries, err));
+    QCOMPARE(entries.size(), std::size_t{4});
+    QCOMPARE(entries[1].path, std::string("sub/line\nbreak\\name"));
+    QCOMPARE(entries[2].path, std::string("/elsewhere/abs"));
+    QCOMPARE(entries[3].digest, std::string(64, 'f'));
+    QCOMPARE(entries[3].path, std::string("binary"));
+
+    QVERIFY(!parse_manifest(text + "nothex  file\n", entries, err));
+    QCOMPARE(err.code, EINVAL);
+    QVERIFY(entries.empty());
+    QVERIFY(!parse_manifest("\\abcd  bad\\escape\n", entries, err));
+
+    Algorithm algorithm = Algorithm::Blake3;
+    QVERIFY(algorithm_for_manifest("/x/SHA256SUMS", algorithm));
+    QCOMPARE(algorithm, Algorithm::Sha256);
+    QVERIFY(algorithm_for_manifest("release.b3", algorithm));
+    QCOMPARE(algorithm, Algorithm::Blake3);
+    QVERIFY(!algorithm_for_manifest("/x/README", algorithm));
+}
+
+void FileChecksumsTest::verifyReportsMismatches() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string root = dir.path().toStdString();
+    QCOMPARE(::mkdir((root + "/sub").c_str(), 0700), 0);
+    const std::vector<std::string> paths = {root + "/a", root + "/sub/b", root + "/c"};
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        writeFile(paths[i], randomData(1000 + i, static_cast<unsigned>(i)));
+    }
+
+    std::vector<FileResult> hashed;
+    FsOps::ProgressInfo progress;
+    FsOps::Error err;
+    QVERIFY(hash_files(paths, hashed, progress, {}, err));
+    for (const Algorithm algorithm : {Algorithm::Sha256, Algorithm::Blake3}) {
+        const std::string manifest = root + "/" + manifest_file_name(algorithm);
+        writeFile(manifest, format_manifest(hashed, algorithm, root));
+
+        std::vector<VerifyResult> results;
+        QVERIFY(verify_manifest(manifest, algorithm, results, progress, {}, err));
+        QCOMPARE(results.size(), std::size_t{3});
+        QCOMPARE(results[1].path, std::string("sub/b"));
+        QVERIFY(results[1].status == VerifyStatus::Ok);
+    }
+
+    writeFile(paths[0], "changed");
+    QCOMPARE(::unlink(paths[2].c_str()), 0);
+    std::vector<VerifyResult> results;
+    QVERIFY(!verify_manifest(root + "/B3SUMS", Algorithm::Blake3, results, progress, {}, err));
+    QVERIFY(results[0].status == VerifyStatus::Mismatch);
+    QVERIFY(results[1].status == VerifyStatus::Ok);
+    QVERIFY(results[2].status == VerifyStatus::Unreadable);
+    QCOMPARE(results[2].error.code, ENOENT);
+
+    QVERIFY(!verify_manifest(root + "/missing", Algorithm::Sha256, results, progress, {}, err));
+    QCOMPARE(err.code, ENOENT);
+}
+
+void FileChecksumsTest::progressCancels() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = dir.path().toStdString() + "/big";
+    writeFile(path, randomData(12 * 1024 * 1024, 5));
+
+    std::vector<FileResult> results;
+    FsOps::ProgressInfo progress;
+    FsOps::Error err;
+    int calls = 0;
+    QVERIFY(!hash_files({path}, results, progress, [&](const FsOps::ProgressInfo&) { return ++calls < 2; }, err));
+    QCOMPARE(err.code, ECANCELED);
+    QCOMPARE(calls, 2);
+    QVERIFY(results[0].digests[0].empty());
+}
+
+QTEST_MAIN(FileChecksumsTest)
+#include "file_checksums_test.moc"
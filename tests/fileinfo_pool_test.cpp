@@ -0,0 +1,138 @@
+/*
+ * Tests for the pool the folders allocate their files from
+ * tests/fileinfo_pool_test.cpp
+ */
+
+#include <QTest>
+
+#include <libfm-qt6/core/fileinfopool.h>
+
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+using Fm::FileInfo;
+using Fm::FileInfoPool;
+
+class FileInfoPoolTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void countsLiveFiles();
+    void reusesFreedSlots();
+    void growsByBlocks();
+    void filesOutliveThePool();
+    void allocatesWithoutPool();
+    void concurrentFilesGetTheirOwnSlots();
+};
+
+void FileInfoPoolTest::countsLiveFiles() {
+    auto pool = FileInfoPool::create();
+    QCOMPARE(pool->liveFiles(), std::size_t(0));
+    QCOMPARE(pool->reservedBytes(), std::size_t(0));
+
+    std::vector<std::shared_ptr<FileInfo>> files;
+    for (int i = 0; i < 10; ++i) {
+        files.push_back(FileInfoPool::makeFileInfo(pool.get()));
+    }
+    QCOMPARE(pool->liveFiles(), std::size_t(10));
+    QVERIFY(pool->reservedBytes() >= FileInfoPool::kBlockFiles * sizeof(FileInfo));
+
+    files.resize(4);
+    QCOMPARE(pool->liveFiles(), std::size_t(4));
+    files.clear();
+    QCOMPARE(pool->liveFiles(), std::size_t(0));
+}
+
+void FileInfoPoolTest::reusesFreedSlots() {
+    auto pool = FileInfoPool::create();
+    std::set<const FileInfo*> first;
+    std::vector<std::shared_ptr<FileInfo>> files;
+    for (int i = 0; i < 100; ++i) {
+        files.push_back(FileInfoPool::makeFileInfo(pool.get()));
+        first.insert(files.back().get());
+    }
+    const std::size_t reserved = pool->reservedBytes();
+    files.clear();
+
+    // a second listing of the folder takes the same slots
+    for (int i = 0; i < 100; ++i) {
+        files.push_back(FileInfoPool::makeFileInfo(pool.get()));
+        QVERIFY(first.count(files.back().get()));
+    }
+    QCOMPARE(pool->reservedBytes(), reserved);
+}
+
+void FileInfoPoolTest::growsByBlocks() {
+    auto pool = FileInfoPool::create();
+    std::vector<std::shared_ptr<FileInfo>> files;
+    for (std::size_t i = 0; i < FileInfoPool::kBlockFiles; ++i) {
+        files.push_back(FileInfoPool::makeFileInfo(pool.get()));
+    }
+    const std::size_t oneBlock = pool->reservedBytes();
+    files.push_back(FileInfoPool::makeFileInfo(pool.get()));
+    QCOMPARE(pool->reservedBytes(), 2 * oneBlock);
+}
+
+void FileInfoPoolTest::filesOutliveThePool() {
+    auto pool = FileInfoPool::create();
+    std::weak_ptr<FileInfoPool> weak = pool;
+    auto file = FileInfoPool::makeFileInfo(pool.get());
+    auto copy = file;
+    pool.reset();
+
+    // the holder is gone, but the slots of the file are not
+    QVERIFY(weak.expired());
+    QVERIFY(file->name().empty());
+    file.reset();
+    QVERIFY(copy->name().empty());
+    copy.reset();
+}
+
+void FileInfoPoolTest::allocatesWithoutPool() {
+    auto file = FileInfoPool::makeFileInfo(nullptr);
+    QVERIFY(file);
+    QVERIFY(file->name().empty());
+}
+
+void FileInfoPoolTest::concurrentFilesGetTheirOwnSlots() {
+    constexpr int kThreads = 4;
+    constexpr int kFilesPerThread = 1000;
+    auto pool = FileInfoPool::create();
+    std::vector<std::vector<std::shared_ptr<FileInfo>>> files(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&pool, &mine = files[t]]() {
+            for (int i = 0; i < kFilesPerThread; ++i) {
+                mine.push_back(FileInfoPool::makeFileInfo(pool.get()));
+                // free some on the way, so that slots are given back while others are taken
+                if (i % 3 == 0) {
+                    mine.pop_back();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::set<const FileInfo*> taken;
+    std::size_t count = 0;
+    for (const auto& mine : files) {
+        for (const auto& file : mine) {
+            taken.insert(file.get());
+            ++count;
+        }
+    }
+    QCOMPARE(taken.size(), count);
+    QCOMPARE(pool->liveFiles(), count);
+
+    // the last file to go frees the pool, from whichever thread drops it
+    pool.reset();
+    std::thread dropper([&files]() { files.clear(); });
+    dropper.join();
+}
+
+QTEST_MAIN(FileInfoPoolTest)
+#include "fileinfo_pool_test.moc"
@@ -0,0 +1,148 @@
+/*
+ * Tests for the per-device file operation scheduler
+ * tests/fileop_scheduler_test.cpp
+ */
+
+#include <QDir>
+#include <QSignalSpy>
+#include <QTest>
+
+#include "../src/core/fileop_scheduler.h"
+
+#include <memory>
+
+using namespace PCManFM;
+
+// Backend that only records what the scheduler asks of it; tests finish it by hand.
+class FakeOps : public IFileOps {
+    Q_OBJECT
+
+   public:
+    explicit FakeOps(QStringList* log) : log_(log) {}
+
+    void start(const FileOpRequest& req) override { log_->append(QStringLiteral("start ") + req.destination); }
+    void cancel() override {
+        log_->append(QStringLiteral("cancel"));
+        Q_EMIT finished(false, QStringLiteral("Operation cancelled"));
+    }
+    void setPaused(bool paused) override { log_->append(paused ? QStringLiteral("pause") : QStringLiteral("resume")); }
+
+    void finish() { Q_EMIT finished(true, QString()); }
+
+   private:
+    QStringList* log_;
+};
+
+namespace {
+
+FileOpRequest copyTo(const QString& destination) {
+    FileOpRequest req;
+    req.type = FileOpType::Copy;
+    req.sources = QStringList{QStringLiteral("/src")};
+    req.destination = destination;
+    req.followSymlinks = false;
+    req.overwriteExisting = false;
+    return req;
+}
+
+}  // namespace
+
+class FileOpSchedulerTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void serialPerDeviceParallelAcross();
+    void reorderAndPauseQueued();
+    void pauseAndCancelRunning();
+    void deviceForMissingDestination();
+};
+
+void FileOpSchedulerTest::serialPerDeviceParallelAcross() {
+    QStringList log;
+    FileOpScheduler scheduler;
+    QSignalSpy finishedSpy(&scheduler, &FileOpScheduler::jobFinished);
+
+    auto* a = new FakeOps(&log);
+    auto* b = new FakeOps(&log);
+    auto* c = new FakeOps(&log);
+    const auto idA = scheduler.enqueue(std::unique_ptr<IFileOps>(a), copyTo(QStringLiteral("a")), 1);
+    const auto idB = scheduler.enqueue(std::unique_ptr<IFileOps>(b), copyTo(QStringLiteral("b")), 1);
+    const auto idC = scheduler.enqueue(std::unique_ptr<IFileOps>(c), copyTo(QStringLiteral("c")), 2);
+
+    // a and c run at once on their devices; b waits for a.
+    QCOMPARE(log, (QStringList{QStringLiteral("start a"), QStringLiteral("start c")}));
+    QCOMPARE(scheduler.runningJob(1), idA);
+    QCOMPARE(scheduler.runningJob(2), idC);
+    QCOMPARE(scheduler.queuedJobs(1), QList<FileOpScheduler::JobId>{idB});
+    QCOMPARE(scheduler.state(idB), FileOpScheduler::JobState::Queued);
+
+    a->finish();
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(finishedSpy.first().at(0).value<FileOpScheduler::JobId>(), idA);
+    QVERIFY(!scheduler.contains(idA));
+    QCOMPARE(log.last(), QStringLiteral("start b"));
+    QCOMPARE(scheduler.runningJob(1), idB);
+
+    b->finish();
+    c->finish();
+    QCOMPARE(scheduler.runningJob(1), FileOpScheduler::JobId{0});
+    QCOMPARE(scheduler.runningJob(2), FileOpScheduler::JobId{0});
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+}
+
+void FileOpSchedulerTest::reorderAndPauseQueued() {
+    QStringList log;
+    FileOpScheduler scheduler;
+    auto* first = new FakeOps(&log);
+    scheduler.enqueue(std::unique_ptr<IFileOps>(first), copyTo(QStringLiteral("first")), 7);
+    const auto idX = scheduler.enqueue(std::make_unique<FakeOps>(&log), copyTo(QStringLiteral("x")), 7);
+    const auto idY = scheduler.enqueue(std::make_unique<FakeOps>(&log), copyTo(QStringLiteral("y")), 7);
+    const auto idZ = scheduler.enqueue(std::make_unique<FakeOps>(&log), copyTo(QStringLiteral("z")), 7);
+
+    QVERIFY(scheduler.moveJob(idZ, 0));
+    QCOMPARE(scheduler.queuedJobs(7), (QList<FileOpScheduler::JobId>{idZ, idX, idY}));
+    QVERIFY(scheduler.pause(idZ));
+    QCOMPARE(scheduler.state(idZ), FileOpScheduler::JobState::Paused);
+
+    // The paused job keeps its place but is skipped.
+    first->finish();
+    QCOMPARE(log.last(), QStringLiteral("start x"));
+    QCOMPARE(scheduler.queuedJobs(7), (QList<FileOpScheduler::JobId>{idZ, idY}));
+
+    QVERIFY(scheduler.cancel(idY));
+    QVERIFY(!scheduler.contains(idY));
+    QVERIFY(scheduler.resume(idZ));
+    QCOMPARE(scheduler.state(idZ), FileOpScheduler::JobState::Queued);
+    QCOMPARE(log.last(), QStringLiteral("start x"));
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+}
+
+void FileOpSchedulerTest::pauseAndCancelRunning() {
+    QStringList log;
+    FileOpScheduler scheduler;
+    QSignalSpy finishedSpy(&scheduler, &FileOpScheduler::jobFinished);
+    const auto id = scheduler.enqueue(std::make_unique<FakeOps>(&log), copyTo(QStringLiteral("p")), 3);
+    const auto next = scheduler.enqueue(std::make_unique<FakeOps>(&log), copyTo(QStringLiteral("q")), 3);
+
+    QVERIFY(scheduler.pause(id));
+    QCOMPARE(log.last(), QStringLiteral("pause"));
+    QCOMPARE(scheduler.state(id), FileOpScheduler::JobState::Paused);
+    // A paused running job keeps the device.
+    QCOMPARE(scheduler.runningJob(3), id);
+
+    QVERIFY(scheduler.cancel(id));
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(!finishedSpy.first().at(1).toBool());
+    QCOMPARE(log.last(), QStringLiteral("start q"));
+    QCOMPARE(scheduler.runningJob(3), next);
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+}
+
+void FileOpSchedulerTest::deviceForMissingDestination() {
+    FileOpRequest req = copyTo(QDir::tempPath() + QStringLiteral("/pcmanfm-missing/deeper"));
+    QVERIFY(FileOpScheduler::deviceFor(req) != 0);
+    QCOMPARE(FileOpScheduler::deviceFor(req), FileOpScheduler::deviceFor(copyTo(QDir::tempPath())));
+}
+
+QTEST_MAIN(FileOpSchedulerTest)
+#include "fileop_scheduler_test.moc"
@@ -8,14 +8,24 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QByteArray>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QHash>
 
+#include "../src/core/copy_journal.h"
+#include "../src/core/device_profiles.h"
 #include "../src/core/fs_ops.h"
+#include "../src/core/io_throttle.h"
+
+#include <b3sum/blake3.h>
 
 #include <errno.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <limits.h>
+#include <chrono>
 #include <fstream>
+#include <thread>
 
 using namespace PCManFM::FsOps;
 
@@ -33,6 +43,15 @@ QByteArray readQtFile(const QString& path) {
     return f.readAll();
 }
 
+std::string referenceBlake3(const QByteArray& data) {
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, data.constData(), static_cast<size_t>(data.size()));
+    uint8_t out[BLAKE3_OUT_LEN];
+    blake3_hasher_finalize(&hasher, out, BLAKE3_OUT_LEN);
+    return QByteArray(reinterpret_cast<const char*>(out), BLAKE3_OUT_LEN).toHex().toStdString();
+}
+
 QString writeTempFile(const QTemporaryDir& dir, const QString& name, const QByteArray& data) {
     const QString path = makePath(dir, name);
     QFile f(path);
@@ -55,6 +74,7 @@ class FsOpsTest : public QObject {
     void moveFileRenamePath();
     void moveFileCopyFallback();
     void deletePathRecursive();
+    void deletePathParallel();
     void makeDirParentsCreatesHierarchy();
     void setPermissionsChangesMode();
     void copyCancelledViaCallback();
@@ -63,6 +83,27 @@ class FsOpsTest : public QObject {
     void setPermissionsFailsOnMissing();
     void copySymlinkPreservesLink();
     void copyPreservesMtime();
+    void copyReportsCopyMethod();
+    void copyDirectoryParallel();
+    void copyDirectoryParallelCancelled();
+    void copyWithDeferredDurability();
+    void copySparseFileKeepsHoles();
+    void ioEnginesProduceSameResults();
+    void blake3LargeFileAndBatch();
+    void copyWithVerify();
+    void readFileAllFromProcfs();
+    void mappedFileView();
+    void readFileChunked();
+    void copyScanAheadTotals();
+    void moveStreamingResumes();
+    void copyResumesFromJournal();
+    void copyThrottled();
+    void throttleAdaptiveBacksOff();
+    void copyDirectIo();
+    void copyDeltaUpdatesInPlace();
+    void copyDirectorySnapshotOrFallback();
+    void deviceProfilesAdapt();
+    void copyWithDeviceProfiles();
 };
 
 void FsOpsTest::readWriteRoundTrip() {
@@ -202,6 +243,41 @@ void FsOpsTest::deletePathRecursive() {
     QVERIFY(!QFileInfo(subdir).exists());
 }
 
+void FsOpsTest::deletePathParallel() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString root = makePath(dir, QStringLiteral("wide"));
+    Error err;
+    for (int d = 0; d < 8; ++d) {
+        for (int n = 0; n < 4; ++n) {
+            const QString sub = root + QStringLiteral("/d%1/n%2/leaf").arg(d).arg(n);
+            QVERIFY(make_dir_parents(sub.toLocal8Bit().toStdString(), err));
+            for (int f = 0; f < 10; ++f) {
+                writeTempFile(dir, QStringLiteral("wide/d%1/n%2/leaf/f%3").arg(d).arg(n).arg(f), QByteArray("x"));
+            }
+        }
+    }
+    QVERIFY(QFile::link(dir.path(), root + QStringLiteral("/d0/outside")));
+
+    DeleteOptions options;
+    options.workerCount = 4;
+    ProgressInfo progress;
+    int cancelAfter = 20;
+    auto cancellingCb = [&cancelAfter](const ProgressInfo&) { return --cancelAfter > 0; };
+    QVERIFY(!delete_path(root.toLocal8Bit().toStdString(), progress, cancellingCb, err, options));
+    QCOMPARE(err.code, ECANCELED);
+    QVERIFY(QFileInfo(root).isDir());
+
+    err = {};
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    QVERIFY(delete_path(root.toLocal8Bit().toStdString(), progress, progressCb, err, options));
+    QVERIFY(!err.isSet());
+    QVERIFY(!QFileInfo::exists(root));
+    QVERIFY(QFileInfo(dir.path()).isDir());
+    QCOMPARE(progress.filesDone, 1);
+}
+
 void FsOpsTest::makeDirParentsCreatesHierarchy() {
     QTemporaryDir dir;
     QVERIFY(dir.isValid());
@@ -335,5 +411,749 @@ void FsOpsTest::copyPreservesMtime() {
     QCOMPARE(stDst.st_mtim.tv_sec, stSrc.st_mtim.tv_sec);
 }
 
+void FsOpsTest::copyReportsCopyMethod() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QByteArray payload(3 * 1024 * 1024 + 17, '\0');
+    for (int i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>(i * 31);
+    }
+    const QString srcPath = writeTempFile(dir, QStringLiteral("tiered.bin"), payload);
+    const QString dstPath = dir.path() + QLatin1String("/tiered_copy.bin");
+
+    ProgressInfo progress;
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    Error err;
+    QVERIFY(
+        copy_path(srcPath.toLocal8Bit().toStdString(), dstPath.toLocal8Bit().toStdString(), progress, progressCb, err));
+    QVERIFY(!err.isSet());
+    QVERIFY(progress.copyMethod != CopyMethod::None);
+    QCOMPARE(progress.bytesDone, static_cast<std::uint64_t>(payload.size()));
+    QCOMPARE(readQtFile(dstPath), payload);
+}
+
+void FsOpsTest::copyDirectoryParallel() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcDir = makePath(dir, QStringLiteral("partree"));
+    const QString dstDir = makePath(dir, QStringLiteral("partree_copy"));
+    Error err;
+    quint64 expectedBytes = 0;
+    for (int d = 0; d < 4; ++d) {
+        const QString sub = srcDir + QStringLiteral("/d%1/nested").arg(d);
+        QVERIFY(make_dir_parents(sub.toLocal8Bit().toStdString(), err));
+        for (int f = 0; f < 50; ++f) {
+            const QByteArray payload(f * 97 + d, static_cast<char>('a' + f % 26));
+            const QString path = (f % 2 ? sub : srcDir + QStringLiteral("/d%1").arg(d)) + QStringLiteral("/f%1").arg(f);
+            QVERIFY(write_file_atomic(path.toLocal8Bit().toStdString(),
+                                      reinterpret_cast<const std::uint8_t*>(payload.constData()),
+                                      static_cast<std::size_t>(payload.size()), err));
+            expectedBytes += static_cast<quint64>(payload.size());
+        }
+    }
+
+    CopyOptions options;
+    options.workerCount = 4;
+    ProgressInfo progress;
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    QVERIFY(copy_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), progress, progressCb,
+                      err, options));
+    QVERIFY(!err.isSet());
+    QCOMPARE(progress.bytesDone, expectedBytes);
+    QCOMPARE(progress.bytesTotal, expectedBytes);
+
+    const QByteArray sample = readQtFile(dstDir + QStringLiteral("/d3/nested/f49"));
+    QCOMPARE(sample, QByteArray(49 * 97 + 3, static_cast<char>('a' + 49 % 26)));
+    QCOMPARE(readQtFile(dstDir + QStringLiteral("/d0/f0")), QByteArray());
+}
+
+void FsOpsTest::copyDirectoryParallelCancelled() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcDir = makePath(dir, QStringLiteral("cancel_tree"));
+    const QString dstDir = makePath(dir, QStringLiteral("cancel_tree_copy"));
+    Error err;
+    QVERIFY(make_dir_parents(srcDir.toLocal8Bit().toStdString(), err));
+    for (int f = 0; f < 64; ++f) {
+        writeTempFile(dir, QStringLiteral("cancel_tree/f%1").arg(f), QByteArray(4096, 'z'));
+    }
+
+    CopyOptions options;
+    options.workerCount = 3;
+    ProgressInfo progress;
+    int calls = 0;
+    auto cancelCb = [&calls](const ProgressInfo&) { return ++calls < 10; };
+    QVERIFY(!copy_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), progress, cancelCb,
+                       err, options));
+    QCOMPARE(err.code, ECANCELED);
+    QVERIFY(!QFileInfo::exists(dstDir));
+}
+
+void FsOpsTest::copyWithDeferredDurability() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QByteArray payload("durable");
+    const QString srcPath = makePath(dir, QStringLiteral("durable.txt"));
+    Error err;
+    QVERIFY(write_file_atomic(srcPath.toLocal8Bit().toStdString(),
+                              reinterpret_cast<const std::uint8_t*>(payload.constData()),
+                              static_cast<std::size_t>(payload.size()), err, Durability::None));
+    QCOMPARE(readQtFile(srcPath), payload);
+
+    for (Durability mode : {Durability::None, Durability::BatchEnd, Durability::PerFile}) {
+        const QString dstPath = makePath(dir, QStringLiteral("durable_%1.txt").arg(static_cast<int>(mode)));
+        CopyOptions options;
+        options.durability = mode;
+        ProgressInfo progress;
+        auto progressCb = [](const ProgressInfo&) { return true; };
+        QVERIFY(copy_path(srcPath.toLocal8Bit().toStdString(), dstPath.toLocal8Bit().toStdString(), progress,
+                          progressCb, err, options));
+        QVERIFY(!err.isSet());
+        QCOMPARE(readQtFile(dstPath), payload);
+    }
+
+    QVERIFY(sync_filesystem(dir.path().toLocal8Bit().toStdString(), err));
+    QVERIFY(!sync_filesystem("/path/that/does/not/exist", err));
+    QVERIFY(err.isSet());
+}
+
+void FsOpsTest::copySparseFileKeepsHoles() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcPath = makePath(dir, QStringLiteral("sparse.img"));
+    const QString dstPath = makePath(dir, QStringLiteral("sparse_copy.img"));
+    constexpr off_t kSize = 32 * 1024 * 1024;
+    {
+        QFile f(srcPath);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        QVERIFY(f.resize(kSize));
+        QVERIFY(f.seek(8 * 1024 * 1024));
+        QVERIFY(f.write("island", 6) == 6);
+    }
+
+    struct stat stSrc{};
+    QVERIFY(::stat(srcPath.toLocal8Bit().constData(), &stSrc) == 0);
+    if (static_cast<off_t>(stSrc.st_blocks) * 512 >= kSize) {
+        QSKIP("Temporary directory filesystem does not support sparse files");
+    }
+
+    ProgressInfo progress;
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    Error err;
+    QVERIFY(
+        copy_path(srcPath.toLocal8Bit().toStdString(), dstPath.toLocal8Bit().toStdString(), progress, progressCb, err));
+    QVERIFY(!err.isSet());
+    QCOMPARE(progress.bytesDone, static_cast<std::uint64_t>(kSize));
+
+    struct stat stDst{};
+    QVERIFY(::stat(dstPath.toLocal8Bit().constData(), &stDst) == 0);
+    QCOMPARE(stDst.st_size, kSize);
+    QVERIFY(static_cast<off_t>(stDst.st_blocks) * 512 < kSize / 2);
+    QCOMPARE(readQtFile(dstPath), readQtFile(srcPath));
+}
+
+void FsOpsTest::ioEnginesProduceSameResults() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QByteArray payload(700 * 1024 + 3, '\0');
+    for (int i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>((i * 7) ^ (i >> 9));
+    }
+    const QString srcPath = writeTempFile(dir, QStringLiteral("engine.bin"), payload);
+
+    std::string posixHash;
+    Error err;
+    set_io_engine(IoEngine::Posix);
+    QCOMPARE(io_engine(), IoEngine::Posix);
+    QVERIFY(blake3_file(srcPath.toLocal8Bit().toStdString(), posixHash, err));
+
+    set_io_engine(IoEngine::IoUring);
+    const IoEngine active = io_engine();
+    std::string activeHash;
+    QVERIFY(blake3_file(srcPath.toLocal8Bit().toStdString(), activeHash, err));
+    QCOMPARE(activeHash, posixHash);
+
+    const QString treeDir = makePath(dir, QStringLiteral("engine_tree"));
+    QVERIFY(make_dir_parents((treeDir + QStringLiteral("/sub")).toLocal8Bit().toStdString(), err));
+    for (int i = 0; i < 300; ++i) {
+        writeTempFile(dir, QStringLiteral("engine_tree/f%1").arg(i), QByteArray::number(i));
+        writeTempFile(dir, QStringLiteral("engine_tree/sub/g%1").arg(i), QByteArray::number(i));
+    }
+    ProgressInfo progress;
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    QVERIFY(delete_path(treeDir.toLocal8Bit().toStdString(), progress, progressCb, err));
+    QVERIFY(!QFileInfo::exists(treeDir));
+
+    set_io_engine(IoEngine::Auto);
+    if (active == IoEngine::Posix) {
+        QSKIP("io_uring is not available; only the POSIX engine was exercised");
+    }
+}
+
+void FsOpsTest::blake3LargeFileAndBatch() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Above the mmap threshold so the mapped path is exercised.
+    QByteArray large(17 * 1024 * 1024 + 5, '\0');
+    for (int i = 0; i < large.size(); ++i) {
+        large[i] = static_cast<char>(i ^ (i >> 11));
+    }
+    const QString largePath = writeTempFile(dir, QStringLiteral("large.bin"), large);
+    const QByteArray small("small file");
+    const QString smallPath = writeTempFile(dir, QStringLiteral("small.txt"), small);
+
+    std::string hash;
+    Error err;
+    QVERIFY(blake3_file(largePath.toLocal8Bit().toStdString(), hash, err));
+    QCOMPARE(hash, referenceBlake3(large));
+
+    const std::vector<std::string> paths = {
+        largePath.toLocal8Bit().toStdString(),
+        smallPath.toLocal8Bit().toStdString(),
+        makePath(dir, QStringLiteral("missing")).toLocal8Bit().toStdString(),
+        dir.path().toLocal8Bit().toStdString(),
+    };
+    std::vector<Blake3Result> results;
+    QVERIFY(!blake3_files(paths, results, 3));
+    QCOMPARE(results.size(), paths.size());
+    QCOMPARE(results[0].hexHash, referenceBlake3(large));
+    QCOMPARE(results[1].hexHash, referenceBlake3(small));
+    QCOMPARE(results[2].error.code, ENOENT);
+    QCOMPARE(results[3].error.code, EINVAL);
+    QVERIFY(results[3].hexHash.empty());
+
+    QVERIFY(blake3_files({paths[1]}, results));
+    QCOMPARE(results.size(), static_cast<std::size_t>(1));
+    QVERIFY(!results[0].error.isSet());
+}
+
+void FsOpsTest::copyWithVerify() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QByteArray payload(300 * 1024 + 17, '\0');
+    for (int i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>(i * 13);
+    }
+    const QString srcDir = makePath(dir, QStringLiteral("verify_src"));
+    Error err;
+    QVERIFY(make_dir_parents(srcDir.toLocal8Bit().toStdString(), err));
+    writeTempFile(dir, QStringLiteral("verify_src/data.bin"), payload);
+    writeTempFile(dir, QStringLiteral("verify_src/empty"), QByteArray());
+
+    // A sparse member checks that skipped holes are hashed as zeros.
+    const QString sparsePath = srcDir + QStringLiteral("/sparse.bin");
+    {
+        QFile f(sparsePath);
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        QVERIFY(f.seek(4 * 1024 * 1024));
+        f.write("tail");
+    }
+
+    CopyOptions options;
+    options.verify = true;
+    options.workerCount = 2;
+    ProgressInfo progress;
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    const QString dstDir = makePath(dir, QStringLiteral("verify_dst"));
+    QVERIFY(copy_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), progress, progressCb,
+                      err, options));
+    QVERIFY(!err.isSet());
+    QCOMPARE(progress.copyMethod, CopyMethod::ReadWrite);
+    QCOMPARE(readQtFile(dstDir + QStringLiteral("/data.bin")), payload);
+    QCOMPARE(readQtFile(dstDir + QStringLiteral("/sparse.bin")), readQtFile(sparsePath));
+    QVERIFY(QFileInfo(dstDir + QStringLiteral("/empty")).exists());
+}
+
+void FsOpsTest::readFileAllFromProcfs() {
+    // procfs reports a size of zero; the read loop must still return the full content.
+    std::vector<std::uint8_t> out;
+    Error err;
+    QVERIFY(read_file_all("/proc/self/status", out, err));
+    QVERIFY(!out.empty());
+    const QByteArray text(reinterpret_cast<const char*>(out.data()), static_cast<int>(out.size()));
+    QVERIFY(text.contains("Name:"));
+}
+
+void FsOpsTest::mappedFileView() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QByteArray payload(200 * 1024 + 3, 'm');
+    const QString path = writeTempFile(dir, QStringLiteral("mapped.bin"), payload);
+    const QString emptyPath = writeTempFile(dir, QStringLiteral("empty.bin"), QByteArray());
+
+    MappedFile mapped;
+    Error err;
+    QVERIFY(mapped.open(path.toLocal8Bit().toStdString(), err));
+    QVERIFY(mapped.isOpen());
+    QCOMPARE(QByteArray(reinterpret_cast<const char*>(mapped.data()), static_cast<int>(mapped.size())), payload);
+
+    MappedFile moved(std::move(mapped));
+    QVERIFY(!mapped.isOpen());
+    QCOMPARE(moved.size(), static_cast<std::size_t>(payload.size()));
+
+    QVERIFY(moved.open(emptyPath.toLocal8Bit().toStdString(), err));
+    QVERIFY(moved.isOpen());
+    QCOMPARE(moved.size(), static_cast<std::size_t>(0));
+
+    QVERIFY(!moved.open(dir.path().toLocal8Bit().toStdString(), err));
+    QCOMPARE(err.code, EINVAL);
+    QVERIFY(!moved.isOpen());
+}
+
+void FsOpsTest::readFileChunked() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QByteArray payload(10 * 1000 + 7, '\0');
+    for (int i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>(i % 251);
+    }
+    const std::string path = writeTempFile(dir, QStringLiteral("chunks.bin"), payload).toLocal8Bit().toStdString();
+
+    QByteArray collected;
+    int calls = 0;
+    Error err;
+    QVERIFY(read_file_chunked(
+        path, 1000,
+        [&](const std::uint8_t* data, std::size_t size) {
+            ++calls;
+            collected.append(reinterpret_cast<const char*>(data), static_cast<int>(size));
+            return size <= 1000;
+        },
+        err));
+    QCOMPARE(collected, payload);
+    QCOMPARE(calls, 11);
+
+    calls = 0;
+    QVERIFY(!read_file_chunked(
+        path, 4096, [&](const std::uint8_t*, std::size_t) { return ++calls < 2; }, err));
+    QCOMPARE(err.code, ECANCELED);
+    QCOMPARE(calls, 2);
+}
+
+void FsOpsTest::copyScanAheadTotals() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcDir = makePath(dir, QStringLiteral("scan_src"));
+    Error err;
+    quint64 expectedBytes = 0;
+    for (int d = 0; d < 6; ++d) {
+        QVERIFY(make_dir_parents((srcDir + QStringLiteral("/d%1/x").arg(d)).toLocal8Bit().toStdString(), err));
+        for (int f = 0; f < 40; ++f) {
+            const QByteArray payload(f * 31 + d, 's');
+            writeTempFile(dir, QStringLiteral("scan_src/d%1/x/f%2").arg(d).arg(f), payload);
+            expectedBytes += static_cast<quint64>(payload.size());
+        }
+    }
+
+    for (unsigned workers : {1u, 3u}) {
+        CopyOptions options;
+        options.scanAhead = true;
+        options.workerCount = workers;
+        options.durability = Durability::None;
+        ProgressInfo progress;
+        bool totalsShrank = false;
+        std::uint64_t lastTotal = 0;
+        auto progressCb = [&](const ProgressInfo& p) {
+            totalsShrank = totalsShrank || p.bytesTotal < lastTotal;
+            lastTotal = p.bytesTotal;
+            return true;
+        };
+        const QString dstDir = makePath(dir, QStringLiteral("scan_dst%1").arg(workers));
+        QVERIFY(copy_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), progress, progressCb,
+                          err, options));
+        QVERIFY(!totalsShrank);
+        QCOMPARE(progress.bytesDone, expectedBytes);
+        QCOMPARE(progress.bytesTotal, expectedBytes);
+        QVERIFY(!progress.totalsEstimated);
+    }
+}
+
+void FsOpsTest::moveStreamingResumes() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcDir = makePath(dir, QStringLiteral("stream_src"));
+    const QString dstDir = makePath(dir, QStringLiteral("stream_dst"));
+    Error err;
+    for (int d = 0; d < 3; ++d) {
+        QVERIFY(make_dir_parents((srcDir + QStringLiteral("/d%1/x").arg(d)).toLocal8Bit().toStdString(), err));
+        for (int f = 0; f < 100; ++f) {
+            writeTempFile(dir, QStringLiteral("stream_src/d%1/x/f%2").arg(d).arg(f), QByteArray::number(d * 1000 + f));
+        }
+    }
+    QVERIFY(QFile::link(QStringLiteral("f1"), srcDir + QStringLiteral("/d0/x/link")));
+
+    CopyOptions options;
+    options.streamingMove = true;
+    ProgressInfo progress;
+    int ticks = 0;
+    auto interruptingCb = [&ticks](const ProgressInfo&) { return ++ticks < 150; };
+    QVERIFY(!move_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), progress,
+                       interruptingCb, err, options, /*forceCopyFallbackForTests=*/true));
+    QCOMPARE(err.code, ECANCELED);
+
+    // Part of the tree has already left the source, and the journal names it.
+    std::string journalSource;
+    QVERIFY(interrupted_move(dstDir.toLocal8Bit().toStdString(), journalSource));
+    QCOMPARE(QString::fromLocal8Bit(journalSource.c_str()), srcDir);
+    int remaining = 0;
+    QDirIterator it(srcDir, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        ++remaining;
+    }
+    QVERIFY(remaining > 0);
+    QVERIFY(remaining < 300);
+
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    QVERIFY(move_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), progress, progressCb,
+                      err, options, /*forceCopyFallbackForTests=*/true));
+    QVERIFY(!err.isSet());
+    QVERIFY(!QFileInfo::exists(srcDir));
+    QVERIFY(!interrupted_move(dstDir.toLocal8Bit().toStdString(), journalSource));
+    for (int d = 0; d < 3; ++d) {
+        for (int f = 0; f < 100; ++f) {
+            QCOMPARE(readQtFile(dstDir + QStringLiteral("/d%1/x/f%2").arg(d).arg(f)), QByteArray::number(d * 1000 + f));
+        }
+    }
+    QCOMPARE(QFileInfo(dstDir + QStringLiteral("/d0/x/link")).symLinkTarget(), dstDir + QStringLiteral("/d0/x/f1"));
+}
+
+void FsOpsTest::copyResumesFromJournal() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString srcDir = makePath(dir, QStringLiteral("journal_src"));
+    const QString dstDir = makePath(dir, QStringLiteral("journal_dst"));
+    const std::string journalPath = makePath(dir, QStringLiteral("state/copy.journal")).toLocal8Bit().toStdString();
+    Error err;
+    QVERIFY(make_dir_parents(srcDir.toLocal8Bit().toStdString(), err));
+    for (int f = 0; f < 100; ++f) {
+        writeTempFile(dir, QStringLiteral("journal_src/f%1").arg(f), QByteArray::number(f).repeated(100));
+    }
+
+    CopyOptions options;
+    options.durability = Durability::None;
+    ProgressInfo progress;
+    int ticks = 0;
+    auto interruptingCb = [&ticks](const ProgressInfo&) { return ++ticks < 50; };
+    {
+        CopyJournal journal;
+        QVERIFY(journal.open(journalPath, err));
+        QVERIFY(!journal.resumed());
+        options.journal = &journal;
+        QVERIFY(!copy_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), progress,
+                           interruptingCb, err, options));
+        QCOMPARE(err.code, ECANCELED);
+    }
+    // The partial copy is kept for the next run.
+    QVERIFY(QFileInfo::exists(dstDir));
+
+    // A torn trailing record from a crash is ignored.
+    {
+        std::ofstream torn(journalPath, std::ios::binary | std::ios::app);
+        torn << "\x02\x10";
+    }
+
+    CopyJournal journal;
+    QVERIFY(journal.open(journalPath, err));
+    QVERIFY(journal.resumed());
+    QHash<QString, qint64> finished;
+    for (int f = 0; f < 100; ++f) {
+        const std::string src = (srcDir + QStringLiteral("/f%1").arg(f)).toLocal8Bit().toStdString();
+        const std::string dst = (dstDir + QStringLiteral("/f%1").arg(f)).toLocal8Bit().toStdString();
+        struct stat srcSt{};
+        struct stat dstSt{};
+        CopyJournal::Entry entry;
+        QCOMPARE(::stat(src.c_str(), &srcSt), 0);
+        if (journal.find(dst, srcSt, entry) && entry.state == CopyJournal::State::Done) {
+            QCOMPARE(::stat(dst.c_str(), &dstSt), 0);
+            finished.insert(QString::number(f), dstSt.st_ctim.tv_sec * 1000000000LL + dstSt.st_ctim.tv_nsec);
+        }
+    }
+    QVERIFY(!finished.isEmpty());
+    QVERIFY(finished.size() < 100);
+
+    options.journal = &journal;
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    ProgressInfo resumed;
+    QVERIFY(copy_path(srcDir.toLocal8Bit().toStdString(), dstDir.toLocal8Bit().toStdString(), resumed, progressCb,
+                      err, options));
+    QVERIFY(!err.isSet());
+    QCOMPARE(resumed.bytesDone, resumed.bytesTotal);
+    for (int f = 0; f < 100; ++f) {
+        const QString dst = dstDir + QStringLiteral("/f%1").arg(f);
+        QCOMPARE(readQtFile(dst), QByteArray::number(f).repeated(100));
+        const auto it = finished.constFind(QString::number(f));
+        if (it != finished.constEnd()) {
+            // Files the journal already had were not written again.
+            struct stat st{};
+            QCOMPARE(::stat(dst.toLocal8Bit().constData(), &st), 0);
+            QCOMPARE(st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec, it.value());
+        }
+    }
+
+    QVERIFY(journal.remove(err));
+    QVERIFY(!QFileInfo::exists(QString::fromLocal8Bit(journalPath.c_str())));
+}
+
+void FsOpsTest::copyThrottled() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QByteArray payload(4 * 1024 * 1024, 't');
+    const QString src = writeTempFile(dir, QStringLiteral("throttle_src.bin"), payload);
+    const QString dst = makePath(dir, QStringLiteral("throttle_dst.bin"));
+
+    // 4 MiB at 2 MiB/s with a quarter second of burst takes well over a second.
+    IoThrottle throttle(2 * 1024 * 1024, 0);
+    CopyOptions options;
+    options.throttle = &throttle;
+    options.durability = Durability::None;
+    ProgressInfo progress;
+    Error err;
+    auto progressCb = [](const ProgressInfo&) { return true; };
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(copy_path(src.toLocal8Bit().toStdString(), dst.toLocal8Bit().toStdString(), progress, progressCb, err,
+                      options));
+    QVERIFY(timer.elapsed() >= 1200);
+    QCOMPARE(readQtFile(dst), payload);
+
+    // Lifting the limit mid-copy releases a copy that is sleeping off its debt.
+    throttle.setLimits(64 * 1024, 0);
+    QVERIFY(QFile::remove(dst));
+    std::thread lift([&throttle] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        throttle.setLimits(0, 0);
+    });
+    timer.restart();
+    ProgressInfo lifted;
+    QVERIFY(copy_path(src.toLocal8Bit().toStdString(), dst.toLocal8Bit().toStdString(), lifted, progressCb, err,
+                      options));
+    lift.join();
+    QVERIFY(timer.elapsed() < 10000);
+    QCOMPARE(readQtFile(dst), payload);
+}
+
+void FsOpsTest::throttleAdaptiveBacksOff() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString pressure = writeTempFile(dir, QStringLiteral("pressure"),
+                                           "some avg10=40.00 avg60=5.00 avg300=1.00 total=100\n"
+                                           "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+    IoThrottle throttle(64 * 1024 * 1024, 0);
+    throttle.setPressurePathForTests(pressure.toLocal8Bit().toStdString());
+    throttle.setAdaptive(true);
+    QCOMPARE(throttle.adaptiveScale(), 1.0);
+
+    auto spend = [&throttle](int seconds) {
+        QElapsedTimer timer;
+        timer.start();
+        while (timer.elapsed() < seconds * 1100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            throttle.reserve(1024, 1);
+        }
+    };
+    spend(2);
+    QVERIFY(throttle.adaptiveScale() < 1.0);
+    QCOMPARE(throttle.bytesPerSecond(), std::uint64_t{64 * 1024 * 1024});
+
+    writeTempFile(dir, QStringLiteral("pressure"), "some avg10=0.00 avg60=5.00 avg300=1.00 total=100\n");
+    const double backedOff = throttle.adaptiveScale();
+    spend(2);
+    QVERIFY(throttle.adaptiveScale() > backedOff);
+
+    throttle.setAdaptive(false);
+    QCOMPARE(throttle.adaptiveScale(), 1.0);
+}
+
+void FsOpsTest::copyDirectIo() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Not a multiple of the alignment, and larger than one transfer buffer.
+    QByteArray payload(9 * 1024 * 1024 + 1234, Qt::Uninitialized);
+    for (int i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>((i * 31) ^ (i >> 11));
+    }
+    const QString src = writeTempFile(dir, QStringLiteral("direct_src.bin"), payload);
+    auto progressCb = [](const ProgressInfo&) { return true; };
+
+    for (bool verify : {false, true}) {
+        const QString dst =
+            makePath(dir, verify ? QStringLiteral("direct_verified.bin") : QStringLiteral("direct.bin"));
+        CopyOptions options;
+        options.directIoThreshold = 1024 * 1024;
+        options.verify = verify;
+        ProgressInfo progress;
+        Error err;
+        QVERIFY(copy_path(src.toLocal8Bit().toStdString(), dst.toLocal8Bit().toStdString(), progress, progressCb, err,
+                          options));
+        QVERIFY(!err.isSet());
+        // O_DIRECT where the filesystem takes it, a cache-friendly fallback elsewhere.
+        QVERIFY(progress.copyMethod != CopyMethod::None);
+        QCOMPARE(progress.bytesDone, static_cast<std::uint64_t>(payload.size()));
+        QCOMPARE(QFileInfo(dst).size(), static_cast<qint64>(payload.size()));
+        QCOMPARE(readQtFile(dst), payload);
+    }
+}
+
+void FsOpsTest::copyDeltaUpdatesInPlace() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Three and a bit delta blocks, changed in the second block and grown at the end.
+    QByteArray old(3 * 1024 * 1024 + 500, Qt::Uninitialized);
+    for (int i = 0; i < old.size(); ++i) {
+        old[i] = static_cast<char>((i * 13) ^ (i >> 9));
+    }
+    QByteArray payload = old;
+    payload[1024 * 1024 + 7] = static_cast<char>(payload[1024 * 1024 + 7] ^ 0x5a);
+    payload.append(QByteArray(4096, 'x'));
+    const QString src = writeTempFile(dir, QStringLiteral("delta_src.bin"), payload);
+    const QString dst = writeTempFile(dir, QStringLiteral("delta_dst.bin"), old);
+    auto progressCb = [](const ProgressInfo&) { return true; };
+
+    CopyOptions options;
+    options.deltaThreshold = 1024 * 1024;
+    ProgressInfo progress;
+    Error err;
+    QVERIFY(copy_path(src.toLocal8Bit().toStdString(), dst.toLocal8Bit().toStdString(), progress, progressCb, err,
+                      options));
+    QVERIFY(!err.isSet());
+    // In place where the filesystem has no reflinks, shared extents where it has.
+    QVERIFY(progress.copyMethod == CopyMethod::Delta || progress.copyMethod == CopyMethod::Reflink);
+    QCOMPARE(progress.bytesDone, static_cast<std::uint64_t>(payload.size()));
+    QCOMPARE(readQtFile(dst), payload);
+
+    // A destination longer than the source is cut to size.
+    const QString shorter = writeTempFile(dir, QStringLiteral("delta_short.bin"), old.left(2 * 1024 * 1024));
+    progress = {};
+    QVERIFY(copy_path(shorter.toLocal8Bit().toStdString(), dst.toLocal8Bit().toStdString(), progress, progressCb,
+                      err, options));
+    QCOMPARE(readQtFile(dst), old.left(2 * 1024 * 1024));
+}
+
+void FsOpsTest::copyDirectorySnapshotOrFallback() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    Error err;
+    QVERIFY(make_dir_parents(makePath(dir, QStringLiteral("tree/sub")).toStdString(), err));
+    writeTempFile(dir, QStringLiteral("tree/top.txt"), QByteArray("top"));
+    writeTempFile(dir, QStringLiteral("tree/sub/inner.txt"), QByteArray("inner"));
+    const std::string src = makePath(dir, QStringLiteral("tree")).toStdString();
+    const std::string dst = makePath(dir, QStringLiteral("copy")).toStdString();
+
+    // A plain directory is no subvolume, and is copied file by file.
+    CopyOptions options;
+    options.snapshotDirectories = true;
+    ProgressInfo progress;
+    QVERIFY(copy_path(src, dst, progress, [](const ProgressInfo&) { return true; }, err, options));
+    QVERIFY(!err.isSet());
+    QVERIFY(progress.copyMethod != CopyMethod::Snapshot);
+    QCOMPARE(readQtFile(makePath(dir, QStringLiteral("copy/top.txt"))), QByteArray("top"));
+    QCOMPARE(readQtFile(makePath(dir, QStringLiteral("copy/sub/inner.txt"))), QByteArray("inner"));
+}
+
+void FsOpsTest::deviceProfilesAdapt() {
+    using std::chrono::milliseconds;
+    DeviceProfiles profiles;
+    QCOMPARE(profiles.chunkSize(1), DeviceProfiles::kDefaultChunk);
+    QCOMPARE(profiles.workers(1, 8), 8u);
+
+    // Chunks that go by quickly grow as long as the larger ones are not slower.
+    for (int i = 0; i < 20; ++i) {
+        const std::size_t chunk = profiles.chunkSize(1);
+        profiles.recordChunks(1, chunk, DeviceProfiles::kSampleBytes, DeviceProfiles::kSampleBytes / chunk,
+                              milliseconds(10));
+    }
+    QCOMPARE(profiles.chunkSize(1), DeviceProfiles::kMaxChunk);
+
+    // Chunks that take longer than kMaxChunkLatency shrink.
+    for (int i = 0; i < 3; ++i) {
+        const std::size_t chunk = profiles.chunkSize(2);
+        profiles.recordChunks(2, chunk, chunk * 2, 2, milliseconds(400));
+    }
+    QCOMPARE(profiles.chunkSize(2), DeviceProfiles::kMinChunk);
+
+    // Fewer workers are tried, and kept while they are faster.
+    constexpr std::uint64_t job = 256 * 1024 * 1024;
+    profiles.recordJob(3, 8, job, milliseconds(2000));
+    QCOMPARE(profiles.workers(3, 8), 4u);
+    profiles.recordJob(3, 4, job, milliseconds(1000));
+    QCOMPARE(profiles.workers(3, 8), 2u);
+    profiles.recordJob(3, 2, job, milliseconds(1500));
+    QCOMPARE(profiles.workers(3, 8), 4u);
+    profiles.recordJob(3, 4, job, milliseconds(1000));
+    QCOMPARE(profiles.workers(3, 8), 4u);
+    QCOMPARE(profiles.workers(3, 2), 2u);
+    profiles.recordJob(4, 8, DeviceProfiles::kMinJobBytes - 1, milliseconds(1));
+    QCOMPARE(profiles.workers(4, 8), 8u);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = makePath(dir, QStringLiteral("profiles/device-profiles")).toStdString();
+    DeviceProfiles saved;
+    Error err;
+    QVERIFY(saved.open(path, err));
+    QVERIFY(saved.profiles().empty());
+    saved.recordChunks(7, DeviceProfiles::kDefaultChunk, 1024 * 1024, 8, milliseconds(10));
+    saved.recordJob(7, 8, job, milliseconds(1000));
+    QVERIFY(saved.save(err));
+
+    DeviceProfiles loaded;
+    QVERIFY(loaded.open(path, err));
+    const std::vector<DeviceProfiles::Profile> learned = loaded.profiles();
+    QCOMPARE(learned.size(), std::size_t{1});
+    QCOMPARE(learned[0].device, std::uint64_t{7});
+    QCOMPARE(learned[0].chunkSize, saved.chunkSize(7));
+    QCOMPARE(learned[0].workers, 4u);
+    QCOMPARE(learned[0].bytesSeen, std::uint64_t{1024 * 1024});
+}
+
+void FsOpsTest::copyWithDeviceProfiles() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QByteArray payload(static_cast<qsizetype>(DeviceProfiles::kSampleBytes * 2 + 4321), Qt::Uninitialized);
+    for (int i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>((i * 7) ^ (i >> 13));
+    }
+    const QString src = writeTempFile(dir, QStringLiteral("profiled_src.bin"), payload);
+    const QString dst = makePath(dir, QStringLiteral("profiled_dst.bin"));
+
+    // Verified copies always take the read/write tier, the one whose chunks are learned.
+    DeviceProfiles profiles;
+    CopyOptions options;
+    options.verify = true;
+    options.profiles = &profiles;
+    ProgressInfo progress;
+    Error err;
+    QVERIFY(copy_path(src.toLocal8Bit().toStdString(), dst.toLocal8Bit().toStdString(), progress,
+                      [](const ProgressInfo&) { return true; }, err, options));
+    QVERIFY(!err.isSet());
+    QCOMPARE(progress.copyMethod, CopyMethod::ReadWrite);
+    QCOMPARE(readQtFile(dst), payload);
+
+    struct stat st{};
+    QCOMPARE(::stat(dst.toLocal8Bit().constData(), &st), 0);
+    const std::vector<DeviceProfiles::Profile> learned = profiles.profiles();
+    QCOMPARE(learned.size(), std::size_t{1});
+    QCOMPARE(learned[0].device, static_cast<std::uint64_t>(st.st_dev));
+    QCOMPARE(learned[0].bytesSeen, DeviceProfiles::kSampleBytes * 2);
+    QVERIFY(learned[0].bytesPerSecond > 0);
+}
+
 QTEST_MAIN(FsOpsTest)
 #include "fs_ops_test.moc"
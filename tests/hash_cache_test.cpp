@@ -0,0 +1,199 @@
+/*
+ * Tests for the persistent BLAKE3 hash cache
+ * tests/hash_cache_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QByteArray>
+
+#include "../src/core/hash_cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::string nativePath(const QTemporaryDir& dir, const QString& name) {
+    return (dir.path() + QLatin1Char('/') + name).toLocal8Bit().toStdString();
+}
+
+// Writes |data| and backdates the mtime so the cache does not treat the file as still being
+// written.
+void writeSettledFile(const std::string& path, const QByteArray& data, std::int64_t mtimeSec = 1000000000) {
+    FsOps::Error err;
+    QVERIFY(FsOps::write_file_atomic(path, reinterpret_cast<const std::uint8_t*>(data.constData()),
+                                     static_cast<std::size_t>(data.size()), err, FsOps::Durability::None));
+    QVERIFY(FsOps::set_times(path, mtimeSec, 0, mtimeSec, 0, err));
+}
+
+}  // namespace
+
+class HashCacheTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void defaultPathFollowsXdgCacheHome();
+    void storeAndReloadAcrossInstances();
+    void changedFileMisses();
+    void blake3FileUsesCache();
+    void batchMixesHitsAndMisses();
+    void resetsForeignFile();
+};
+
+void HashCacheTest::defaultPathFollowsXdgCacheHome() {
+    const QByteArray saved = qgetenv("XDG_CACHE_HOME");
+    qputenv("XDG_CACHE_HOME", "/tmp/pcmanfm-cache-test");
+    QCOMPARE(HashCache::defaultPath(), std::string("/tmp/pcmanfm-cache-test/pcmanfm-qt/blake3.cache"));
+    qputenv("XDG_CACHE_HOME", "relative/ignored");
+    QVERIFY(HashCache::defaultPath().find("relative") == std::string::npos);
+    if (saved.isNull()) {
+        qunsetenv("XDG_CACHE_HOME");
+    }
+    else {
+        qputenv("XDG_CACHE_HOME", saved);
+    }
+}
+
+void HashCacheTest::storeAndReloadAcrossInstances() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string cachePath = nativePath(dir, QStringLiteral("cache/blake3.cache"));
+    const std::string file = nativePath(dir, QStringLiteral("a.bin"));
+    writeSettledFile(file, QByteArray("alpha"));
+
+    struct stat st{};
+    QCOMPARE(::lstat(file.c_str(), &st), 0);
+    const std::string digest(64, 'a');
+
+    FsOps::Error err;
+    {
+        HashCache cache;
+        QVERIFY(cache.open(cachePath, err));
+        QVERIFY(cache.store(st, digest, err));
+        QVERIFY(!cache.store(st, "not-hex", err));
+        QCOMPARE(err.code, EINVAL);
+    }
+
+    HashCache reopened;
+    QVERIFY(reopened.open(cachePath, err));
+    QCOMPARE(reopened.size(), static_cast<std::size_t>(1));
+    std::string found;
+    QVERIFY(reopened.lookup(st, found));
+    QCOMPARE(found, digest);
+}
+
+void HashCacheTest::changedFileMisses() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string file = nativePath(dir, QStringLiteral("b.bin"));
+    writeSettledFile(file, QByteArray("before"));
+
+    HashCache cache;
+    FsOps::Error err;
+    QVERIFY(cache.open(nativePath(dir, QStringLiteral("blake3.cache")), err));
+    struct stat st{};
+    QCOMPARE(::lstat(file.c_str(), &st), 0);
+    QVERIFY(cache.store(st, std::string(64, 'b'), err));
+
+    struct stat changed = st;
+    changed.st_mtim.tv_nsec += 1;
+    std::string found;
+    QVERIFY(!cache.lookup(changed, found));
+    changed = st;
+    changed.st_size += 1;
+    QVERIFY(!cache.lookup(changed, found));
+    QVERIFY(cache.lookup(st, found));
+}
+
+void HashCacheTest::blake3FileUsesCache() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string file = nativePath(dir, QStringLiteral("c.bin"));
+    writeSettledFile(file, QByteArray(5000, 'c'));
+
+    HashCache cache;
+    FsOps::Error err;
+    QVERIFY(cache.open(nativePath(dir, QStringLiteral("blake3.cache")), err));
+
+    std::string expected;
+    QVERIFY(FsOps::blake3_file(file, expected, err));
+
+    std::string first;
+    bool fromCache = true;
+    QVERIFY(cache.blake3File(file, first, err, &fromCache));
+    QVERIFY(!fromCache);
+    QCOMPARE(first, expected);
+
+    std::string second;
+    QVERIFY(cache.blake3File(file, second, err, &fromCache));
+    QVERIFY(fromCache);
+    QCOMPARE(second, expected);
+
+    // A freshly modified file is hashed but not remembered yet.
+    const std::string fresh = nativePath(dir, QStringLiteral("fresh.bin"));
+    QVERIFY(FsOps::write_file_atomic(fresh, reinterpret_cast<const std::uint8_t*>("new"), 3, err));
+    QVERIFY(cache.blake3File(fresh, first, err, &fromCache));
+    QVERIFY(cache.blake3File(fresh, second, err, &fromCache));
+    QVERIFY(!fromCache);
+}
+
+void HashCacheTest::batchMixesHitsAndMisses() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    std::vector<std::string> paths;
+    for (int i = 0; i < 6; ++i) {
+        paths.push_back(nativePath(dir, QStringLiteral("f%1").arg(i)));
+        writeSettledFile(paths.back(), QByteArray::number(i));
+    }
+
+    HashCache cache;
+    FsOps::Error err;
+    QVERIFY(cache.open(nativePath(dir, QStringLiteral("blake3.cache")), err));
+    std::string ignored;
+    QVERIFY(cache.blake3File(paths[2], ignored, err));
+    QCOMPARE(cache.size(), static_cast<std::size_t>(1));
+
+    paths.push_back(nativePath(dir, QStringLiteral("missing")));
+    std::vector<FsOps::Blake3Result> results;
+    QVERIFY(!cache.blake3Files(paths, results, 2));
+    QCOMPARE(results.size(), paths.size());
+    for (int i = 0; i < 6; ++i) {
+        std::string expected;
+        QVERIFY(FsOps::blake3_file(paths[static_cast<std::size_t>(i)], expected, err));
+        QCOMPARE(results[static_cast<std::size_t>(i)].hexHash, expected);
+    }
+    QCOMPARE(results[6].error.code, ENOENT);
+    QCOMPARE(cache.size(), static_cast<std::size_t>(6));
+}
+
+void HashCacheTest::resetsForeignFile() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string cachePath = nativePath(dir, QStringLiteral("blake3.cache"));
+    {
+        QFile f(QString::fromLocal8Bit(cachePath.c_str()));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+        f.write(QByteArray(200, 'x'));
+    }
+
+    HashCache cache;
+    FsOps::Error err;
+    QVERIFY(cache.open(cachePath, err));
+    QCOMPARE(cache.size(), static_cast<std::size_t>(0));
+
+    const std::string file = nativePath(dir, QStringLiteral("d.bin"));
+    writeSettledFile(file, QByteArray("delta"));
+    std::string hash;
+    QVERIFY(cache.blake3File(file, hash, err));
+    cache.close();
+    QVERIFY(cache.open(cachePath, err));
+    QCOMPARE(cache.size(), static_cast<std::size_t>(1));
+}
+
+QTEST_MAIN(HashCacheTest)
+#include "hash_cache_test.moc"
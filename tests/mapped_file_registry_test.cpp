@@ -0,0 +1,145 @@
+/*
+ * Tests for the shared file reader registry
+ * tests/mapped_file_registry_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+#include "../src/core/mapped_file_registry.h"
+
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::string writeFile(const QTemporaryDir& dir, const QString& name, const QByteArray& data) {
+    const QString path = dir.filePath(name);
+    QFile f(path);
+    if (f.open(QIODevice::WriteOnly)) {
+        f.write(data);
+        f.close();
+    }
+    return QFile::encodeName(path).toStdString();
+}
+
+}  // namespace
+
+class MappedFileRegistryTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void sharesReaderPerInode();
+    void forgetsUnusedReaders();
+    void reopensRewrittenFile();
+    void findsOnlyOpenFiles();
+    void reportsOpenErrors();
+};
+
+void MappedFileRegistryTest::sharesReaderPerInode() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = writeFile(dir, QStringLiteral("a.bin"), QByteArray(5000, 'a'));
+    const std::string link = QFile::encodeName(dir.filePath(QStringLiteral("b.bin"))).toStdString();
+    QCOMPARE(::link(path.c_str(), link.c_str()), 0);
+
+    MappedFileRegistry registry;
+    std::string err;
+    const auto first = registry.open(path, err);
+    QVERIFY2(first, err.c_str());
+    QCOMPARE(first->size(), static_cast<std::size_t>(5000));
+    QCOMPARE(registry.open(path, err), first);
+    QCOMPARE(registry.open(link, err), first);  // a hard link is the same file
+    QCOMPARE(registry.size(), static_cast<std::size_t>(1));
+
+    const std::string other = writeFile(dir, QStringLiteral("c.bin"), QByteArray(10, 'c'));
+    const auto second = registry.open(other, err);
+    QVERIFY(second);
+    QVERIFY(second != first);
+    QCOMPARE(registry.size(), static_cast<std::size_t>(2));
+}
+
+void MappedFileRegistryTest::forgetsUnusedReaders() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = writeFile(dir, QStringLiteral("a.bin"), QByteArray(100, 'a'));
+
+    MappedFileRegistry registry;
+    std::string err;
+    auto reader = registry.open(path, err);
+    QVERIFY(reader);
+    QCOMPARE(registry.size(), static_cast<std::size_t>(1));
+    reader.reset();
+    QCOMPARE(registry.size(), static_cast<std::size_t>(0));
+    reader = registry.open(path, err);
+    QVERIFY(reader);
+    QCOMPARE(registry.size(), static_cast<std::size_t>(1));
+}
+
+void MappedFileRegistryTest::reopensRewrittenFile() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = writeFile(dir, QStringLiteral("a.bin"), QByteArray(100, 'a'));
+
+    MappedFileRegistry registry;
+    std::string err;
+    const auto before = registry.open(path, err);
+    QVERIFY(before);
+
+    // Grown in place: same inode, new size.
+    QFile f(QFile::decodeName(path.c_str()));
+    QVERIFY(f.open(QIODevice::Append));
+    f.write(QByteArray(50, 'b'));
+    f.close();
+    const auto after = registry.open(path, err);
+    QVERIFY(after);
+    QVERIFY(after != before);
+    QCOMPARE(after->size(), static_cast<std::size_t>(150));
+    QCOMPARE(before->size(), static_cast<std::size_t>(100));  // earlier holders keep their view
+
+    registry.invalidate(after->identity().dev, after->identity().ino);
+    const auto fresh = registry.open(path, err);
+    QVERIFY(fresh);
+    QVERIFY(fresh != after);
+}
+
+void MappedFileRegistryTest::findsOnlyOpenFiles() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = writeFile(dir, QStringLiteral("a.bin"), QByteArray(64, 'a'));
+
+    MappedFileRegistry registry;
+    struct stat st{};
+    QCOMPARE(::stat(path.c_str(), &st), 0);
+    QVERIFY(!registry.find(st));
+
+    std::string err;
+    const auto reader = registry.open(path, err);
+    QVERIFY(reader);
+    QCOMPARE(registry.find(st), reader);
+
+    st.st_size += 1;
+    QVERIFY(!registry.find(st));
+    st.st_size -= 1;
+    QCOMPARE(registry.find(st), reader);  // a stale caller does not evict a current reader
+}
+
+void MappedFileRegistryTest::reportsOpenErrors() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    MappedFileRegistry registry;
+    std::string err;
+    QVERIFY(!registry.open(QFile::encodeName(dir.filePath(QStringLiteral("missing"))).toStdString(), err));
+    QVERIFY(!err.empty());
+    err.clear();
+    QVERIFY(!registry.open(QFile::encodeName(dir.path()).toStdString(), err));  // not a regular file
+    QVERIFY(!err.empty());
+}
+
+QTEST_MAIN(MappedFileRegistryTest)
+#include "mapped_file_registry_test.moc"
@@ -0,0 +1,184 @@
+/*
+ * Tests for in-place file patching
+ * tests/patch_journal_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "../src/core/patch_journal.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace PCManFM;
+
+namespace {
+
+QByteArray pattern(int size) {
+    QByteArray data;
+    data.resize(size);
+    for (int i = 0; i < size; ++i) {
+        data[i] = static_cast<char>((i * 7) & 0xFF);
+    }
+    return data;
+}
+
+bool writeFile(const QString& path, const QByteArray& data) {
+    QFile f(path);
+    return f.open(QIODevice::WriteOnly) && f.write(data) == data.size();
+}
+
+QByteArray readFile(const QString& path) {
+    QFile f(path);
+    return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+}
+
+FilePatch patchOf(std::uint64_t offset, const QByteArray& data) {
+    FilePatch patch;
+    patch.offset = offset;
+    patch.data = reinterpret_cast<const std::uint8_t*>(data.constData());
+    patch.length = static_cast<std::size_t>(data.size());
+    return patch;
+}
+
+ino_t inodeOf(const QString& path) {
+    struct stat st{};
+    return ::stat(QFile::encodeName(path).constData(), &st) == 0 ? st.st_ino : 0;
+}
+
+// Appends one journal record in the layout patch_journal.cpp writes.
+void appendRecord(QByteArray& journal, std::uint64_t offset, const QByteArray& original) {
+    const std::uint64_t length = static_cast<std::uint64_t>(original.size());
+    journal.append(reinterpret_cast<const char*>(&offset), 8);
+    journal.append(reinterpret_cast<const char*>(&length), 8);
+    journal.append(original);
+}
+
+}  // namespace
+
+class PatchJournalTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void patchesOnlyGivenRanges();
+    void rollsBackFailedWrite();
+    void rejectsPatchPastEnd();
+    void recoversInterruptedPatch();
+};
+
+void PatchJournalTest::patchesOnlyGivenRanges() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("disk.img"));
+    const QString journal = dir.filePath(QStringLiteral(".disk.img.hexpatch"));
+    const QByteArray original = pattern(256 * 1024);
+    QVERIFY(writeFile(path, original));
+    const ino_t inode = inodeOf(path);
+
+    const QByteArray head("\xde\xad\xbe\xef", 4);
+    const QByteArray tail(200 * 1024, '\x5a');
+    QByteArray expected = original;
+    expected.replace(10, head.size(), head);
+    expected.replace(40000, tail.size(), tail);
+
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CLOEXEC);
+    QVERIFY(fd >= 0);
+    std::string err;
+    const bool ok = patch_file_in_place(fd, {patchOf(10, head), patchOf(40000, tail)},
+                                        QFile::encodeName(journal).toStdString(), err);
+    ::close(fd);
+    QVERIFY2(ok, err.c_str());
+
+    QCOMPARE(readFile(path), expected);
+    QCOMPARE(inodeOf(path), inode);
+    QVERIFY(!QFileInfo::exists(journal));
+}
+
+void PatchJournalTest::rollsBackFailedWrite() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("disk.img"));
+    const QString journal = dir.filePath(QStringLiteral(".disk.img.hexpatch"));
+    const QByteArray original = pattern(4096);
+    QVERIFY(writeFile(path, original));
+
+    // The second patch points at no memory, so its pwrite() fails after the first one landed.
+    const QByteArray first(64, '\x11');
+    FilePatch broken;
+    broken.offset = 1000;
+    broken.length = 16;
+
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CLOEXEC);
+    QVERIFY(fd >= 0);
+    std::string err;
+    const bool ok = patch_file_in_place(fd, {patchOf(0, first), broken}, QFile::encodeName(journal).toStdString(), err);
+    ::close(fd);
+    QVERIFY(!ok);
+    QVERIFY(!err.empty());
+
+    QCOMPARE(readFile(path), original);
+    QVERIFY(!QFileInfo::exists(journal));
+}
+
+void PatchJournalTest::rejectsPatchPastEnd() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("small.bin"));
+    const QByteArray original = pattern(100);
+    QVERIFY(writeFile(path, original));
+
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CLOEXEC);
+    QVERIFY(fd >= 0);
+    std::string err;
+    const QByteArray data(8, 'x');
+    QVERIFY(!patch_file_in_place(fd, {patchOf(96, data)}, std::string(), err));
+    ::close(fd);
+    QVERIFY(!err.empty());
+    QCOMPARE(readFile(path), original);
+}
+
+void PatchJournalTest::recoversInterruptedPatch() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath(QStringLiteral("disk.img"));
+    const QString journal = dir.filePath(QStringLiteral(".disk.img.hexpatch"));
+    const QByteArray original = pattern(8192);
+
+    // A crash after the journal was renamed into place: one range patched, one not yet.
+    QByteArray patched = original;
+    patched.replace(100, 32, QByteArray(32, '\x77'));
+    QVERIFY(writeFile(path, patched));
+
+    QByteArray saved("PCMFHPJ1", 8);
+    const std::uint64_t size = static_cast<std::uint64_t>(original.size());
+    const std::uint64_t count = 2;
+    saved.append(reinterpret_cast<const char*>(&size), 8);
+    saved.append(reinterpret_cast<const char*>(&count), 8);
+    appendRecord(saved, 100, original.mid(100, 32));
+    appendRecord(saved, 5000, original.mid(5000, 500));
+    QVERIFY(writeFile(journal, saved));
+
+    bool recovered = false;
+    std::string err;
+    QVERIFY2(recover_patch_journal(QFile::encodeName(path).toStdString(), QFile::encodeName(journal).toStdString(),
+                                   recovered, err),
+             err.c_str());
+    QVERIFY(recovered);
+    QCOMPARE(readFile(path), original);
+    QVERIFY(!QFileInfo::exists(journal));
+
+    QVERIFY(recover_patch_journal(QFile::encodeName(path).toStdString(), QFile::encodeName(journal).toStdString(),
+                                  recovered, err));
+    QVERIFY(!recovered);
+}
+
+QTEST_MAIN(PatchJournalTest)
+#include "patch_journal_test.moc"
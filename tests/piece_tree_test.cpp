@@ -0,0 +1,232 @@
+/*
+ * Tests for the hex editor piece tree
+ * tests/piece_tree_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/piece_tree.h"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace PCManFM;
+using Piece = PieceTree::Piece;
+
+namespace {
+
+// One entry per document byte: which buffer it comes from and its offset there.
+using Flat = std::vector<std::pair<Piece::Kind, std::uint64_t>>;
+
+Flat flatten(const PieceTree& tree) {
+    Flat out;
+    for (auto it = tree.first(); it.valid(); it.next()) {
+        const Piece& piece = it.piece();
+        if (it.start() != out.size()) {
+            return {};
+        }
+        for (std::uint64_t i = 0; i < piece.length; ++i) {
+            out.emplace_back(piece.kind, piece.sourceOffset + i);
+        }
+    }
+    return out;
+}
+
+Piece added(std::uint64_t sourceOffset, std::uint64_t length) {
+    Piece piece;
+    piece.kind = Piece::Kind::Added;
+    piece.sourceOffset = sourceOffset;
+    piece.length = length;
+    return piece;
+}
+
+}  // namespace
+
+class PieceTreeTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void splitsAndCoalesces();
+    void matchesFlatModel();
+    void walksBackwards();
+    void findsAddedRanges();
+};
+
+void PieceTreeTest::splitsAndCoalesces() {
+    PieceTree tree;
+    tree.reset(100);
+    QCOMPARE(tree.pieceCount(), std::size_t(1));
+
+    tree.replace(10, 5, {added(0, 5)});
+    QCOMPARE(tree.size(), std::uint64_t(100));
+    QCOMPARE(tree.pieceCount(), std::size_t(3));
+
+    auto it = tree.seek(12);
+    QVERIFY(it.valid());
+    QCOMPARE(it.start(), std::uint64_t(10));
+    QVERIFY(it.piece().kind == Piece::Kind::Added);
+
+    // Typing on right after the previous edit extends the same added piece.
+    tree.replace(15, 0, {added(5, 3)});
+    QCOMPARE(tree.pieceCount(), std::size_t(3));
+    QCOMPARE(tree.seek(10).piece().length, std::uint64_t(8));
+
+    // Putting the original bytes back leaves runs that continue each other; they merge.
+    Piece original;
+    original.sourceOffset = 10;
+    original.length = 5;
+    tree.replace(10, 8, {original});
+    QCOMPARE(tree.pieceCount(), std::size_t(1));
+    QCOMPARE(tree.size(), std::uint64_t(100));
+    QVERIFY(!tree.seek(100).valid());
+
+    tree.replace(0, 30, {});
+    QCOMPARE(tree.size(), std::uint64_t(70));
+    QCOMPARE(tree.first().piece().sourceOffset, std::uint64_t(30));
+}
+
+void PieceTreeTest::matchesFlatModel() {
+    std::mt19937_64 rng(7);
+    PieceTree tree;
+    tree.reset(4096);
+    Flat model;
+    for (std::uint64_t i = 0; i < 4096; ++i) {
+        model.emplace_back(Piece::Kind::Original, i);
+    }
+
+    std::uint64_t addedSize = 0;
+    for (int round = 0; round < 3000; ++round) {
+        const std::uint64_t offset = rng() % (model.size() + 1);
+        const std::uint64_t length = rng() % 3 == 0 ? 0 : rng() % 24;
+        std::vector<Piece> replacement;
+        Flat inserted;
+        for (int i = static_cast<int>(rng() % 3); i > 0; --i) {
+            const Piece piece = added(addedSize, rng() % 8);
+            addedSize += piece.length;
+            replacement.push_back(piece);
+            for (std::uint64_t j = 0; j < piece.length; ++j) {
+                inserted.emplace_back(Piece::Kind::Added, piece.sourceOffset + j);
+            }
+        }
+
+        tree.replace(offset, length, replacement);
+        const auto first = model.begin() + static_cast<std::ptrdiff_t>(offset);
+        const auto last = first + static_cast<std::ptrdiff_t>(std::min<std::uint64_t>(length, model.size() - offset));
+        model.insert(model.erase(first, last), inserted.begin(), inserted.end());
+        QCOMPARE(tree.size(), std::uint64_t(model.size()));
+
+        if (!model.empty()) {
+            const std::uint64_t probe = rng() % model.size();
+            const auto it = tree.seek(probe);
+            QVERIFY(it.valid());
+            QVERIFY(it.start() <= probe && probe < it.start() + it.piece().length);
+            QVERIFY(it.piece().kind == model[probe].first);
+            QCOMPARE(it.piece().sourceOffset + (probe - it.start()), model[probe].second);
+        }
+
+        // A slice holds exactly the bytes of its range.
+        const std::uint64_t sliceOffset = rng() % (model.size() + 1);
+        const std::uint64_t sliceLength = rng() % 64;
+        std::vector<Piece> slice;
+        tree.slice(sliceOffset, sliceLength, slice);
+        Flat sliced;
+        for (const Piece& piece : slice) {
+            for (std::uint64_t j = 0; j < piece.length; ++j) {
+                sliced.emplace_back(piece.kind, piece.sourceOffset + j);
+            }
+        }
+        const auto sliceFirst = model.begin() + static_cast<std::ptrdiff_t>(sliceOffset);
+        const auto sliceLast =
+            sliceFirst + static_cast<std::ptrdiff_t>(std::min<std::uint64_t>(sliceLength, model.size() - sliceOffset));
+        QVERIFY(sliced == Flat(sliceFirst, sliceLast));
+    }
+    QVERIFY(flatten(tree) == model);
+}
+
+void PieceTreeTest::walksBackwards() {
+    PieceTree tree;
+    tree.reset(1000);
+    for (std::uint64_t i = 0; i < 50; ++i) {
+        tree.replace(i * 20, 1, {added(i, 1)});
+    }
+    QCOMPARE(tree.size(), std::uint64_t(1000));
+
+    std::uint64_t end = tree.size();
+    std::size_t pieces = 0;
+    for (auto it = tree.last(); it.valid(); it.prev()) {
+        QCOMPARE(it.start() + it.piece().length, end);
+        end = it.start();
+        ++pieces;
+    }
+    QCOMPARE(end, std::uint64_t(0));
+    QCOMPARE(pieces, tree.pieceCount());
+}
+
+void PieceTreeTest::findsAddedRanges() {
+    std::mt19937_64 rng(11);
+    PieceTree tree;
+    tree.reset(2048);
+    Flat model;
+    for (std::uint64_t i = 0; i < 2048; ++i) {
+        model.emplace_back(Piece::Kind::Original, i);
+    }
+    QVERIFY(!tree.nextAdded(0).valid());
+    QVERIFY(!tree.prevAdded(2047).valid());
+
+    std::uint64_t addedSize = 0;
+    for (int round = 0; round < 500; ++round) {
+        // single-byte overwrites, some of them next to each other from unrelated added bytes
+        const std::uint64_t offset = rng() % model.size();
+        addedSize += 1 + rng() % 4;
+        tree.replace(offset, 1, {added(addedSize, 1)});
+        model[offset] = {Piece::Kind::Added, addedSize};
+
+        const std::uint64_t probe = rng() % model.size();
+        std::uint64_t next = probe;
+        while (next < model.size() && model[next].first != Piece::Kind::Added) {
+            ++next;
+        }
+        const auto forward = tree.nextAdded(probe);
+        QCOMPARE(forward.valid(), next < model.size());
+        if (forward.valid()) {
+            QCOMPARE(std::max(probe, forward.start()), next);
+        }
+        std::uint64_t prev = probe + 1;
+        while (prev > 0 && model[prev - 1].first != Piece::Kind::Added) {
+            --prev;
+        }
+        const auto backward = tree.prevAdded(probe);
+        QCOMPARE(backward.valid(), prev > 0);
+        if (backward.valid()) {
+            QCOMPARE(std::min(probe, backward.start() + backward.piece().length - 1), prev - 1);
+        }
+
+        const std::uint64_t rangeOffset = rng() % (model.size() + 1);
+        const std::uint64_t rangeLength = rng() % 256;
+        std::vector<PieceTree::Range> ranges;
+        tree.addedRanges(rangeOffset, rangeLength, ranges);
+        std::vector<PieceTree::Range> expected;
+        const std::uint64_t end = std::min<std::uint64_t>(rangeOffset + rangeLength, model.size());
+        for (std::uint64_t i = rangeOffset; i < end; ++i) {
+            if (model[i].first != Piece::Kind::Added) {
+                continue;
+            }
+            if (!expected.empty() && expected.back().start + expected.back().length == i) {
+                ++expected.back().length;
+            }
+            else {
+                expected.push_back(PieceTree::Range{i, 1});
+            }
+        }
+        QCOMPARE(ranges.size(), expected.size());
+        for (std::size_t i = 0; i < ranges.size(); ++i) {
+            QCOMPARE(ranges[i].start, expected[i].start);
+            QCOMPARE(ranges[i].length, expected[i].length);
+        }
+    }
+}
+
+QTEST_MAIN(PieceTreeTest)
+#include "piece_tree_test.moc"
@@ -0,0 +1,122 @@
+/*
+ * Tests for the lock-free progress board
+ * tests/progress_board_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/progress_board.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace PCManFM::FsOps;
+
+class ProgressBoardTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void readsWhatWasPosted();
+    void versionTracksPosts();
+    void cutsLongPaths();
+    void resetClearsEverything();
+    void concurrentReadsSeeWholePaths();
+};
+
+void ProgressBoardTest::readsWhatWasPosted() {
+    ProgressBoard board;
+    ProgressInfo info;
+    info.bytesDone = 10;
+    info.bytesTotal = 100;
+    info.filesDone = 1;
+    info.filesTotal = 3;
+    info.totalsEstimated = true;
+    info.currentPath = "/tmp/some file.txt";
+    board.post(info);
+
+    ProgressBoard::Snapshot snapshot;
+    board.read(snapshot);
+    QCOMPARE(snapshot.bytesDone, std::uint64_t(10));
+    QCOMPARE(snapshot.bytesTotal, std::uint64_t(100));
+    QCOMPARE(snapshot.filesDone, 1);
+    QCOMPARE(snapshot.filesTotal, 3);
+    QVERIFY(snapshot.totalsEstimated);
+    QCOMPARE(snapshot.currentPath, info.currentPath);
+
+    // a shorter path replaces the longer one entirely
+    info.currentPath = "/a";
+    board.post(info);
+    board.read(snapshot);
+    QCOMPARE(snapshot.currentPath, std::string("/a"));
+}
+
+void ProgressBoardTest::versionTracksPosts() {
+    ProgressBoard board;
+    const std::uint64_t initial = board.version();
+    ProgressInfo info;
+    info.currentPath = "/x";
+    board.post(info);
+    info.bytesDone = 5;
+    board.post(info);
+    QCOMPARE(board.version(), initial + 2);
+
+    ProgressBoard::Snapshot snapshot;
+    board.read(snapshot);
+    QCOMPARE(snapshot.version, board.version());
+    QCOMPARE(snapshot.bytesDone, std::uint64_t(5));
+}
+
+void ProgressBoardTest::cutsLongPaths() {
+    ProgressBoard board;
+    ProgressInfo info;
+    info.currentPath = std::string(ProgressBoard::kMaxPathLength + 100, 'p');
+    board.post(info);
+    ProgressBoard::Snapshot snapshot;
+    board.read(snapshot);
+    QCOMPARE(snapshot.currentPath, std::string(ProgressBoard::kMaxPathLength, 'p'));
+}
+
+void ProgressBoardTest::resetClearsEverything() {
+    ProgressBoard board;
+    ProgressInfo info;
+    info.bytesDone = 7;
+    info.filesTotal = 2;
+    info.currentPath = "/y";
+    board.post(info);
+    board.reset();
+
+    ProgressBoard::Snapshot snapshot;
+    board.read(snapshot);
+    QCOMPARE(snapshot.bytesDone, std::uint64_t(0));
+    QCOMPARE(snapshot.filesTotal, 0);
+    QVERIFY(snapshot.currentPath.empty());
+}
+
+void ProgressBoardTest::concurrentReadsSeeWholePaths() {
+    ProgressBoard board;
+    const std::string first = "/first/" + std::string(300, 'a');
+    const std::string second = "/second/" + std::string(1000, 'b');
+    std::atomic<bool> stop{false};
+
+    std::thread poster([&]() {
+        ProgressInfo info;
+        for (int i = 0; !stop.load(); ++i) {
+            info.currentPath = (i & 1) ? second : first;
+            info.filesDone = i;
+            board.post(info);
+        }
+    });
+
+    ProgressBoard::Snapshot snapshot;
+    bool torn = false;
+    for (int i = 0; i < 20000 && !torn; ++i) {
+        board.read(snapshot);
+        torn = !snapshot.currentPath.empty() && snapshot.currentPath != first && snapshot.currentPath != second;
+    }
+    stop.store(true);
+    poster.join();
+    QVERIFY(!torn);
+}
+
+QTEST_MAIN(ProgressBoardTest)
+#include "progress_board_test.moc"
@@ -21,6 +21,7 @@ class QtFileOpsTest : public QObject {
     void copyFile();
     void moveFile();
     void deleteFile();
+    void resumableCopyKeepsJournalUntilDone();
 };
 
 static QString writeTempFile(const QTemporaryDir& dir, const QString& name, const QByteArray& data) {
@@ -114,5 +115,51 @@ void QtFileOpsTest::deleteFile() {
     QVERIFY(!QFileInfo::exists(src));
 }
 
+void QtFileOpsTest::resumableCopyKeepsJournalUntilDone() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    qputenv("XDG_STATE_HOME", QFile::encodeName(dir.path() + QLatin1String("/state")));
+
+    const QString first = writeTempFile(dir, QStringLiteral("first.txt"), "first-data");
+    const QString second = dir.path() + QLatin1String("/second.txt");
+    const QString dstDir = dir.path() + QLatin1String("/dst3");
+    QVERIFY(QDir().mkpath(dstDir));
+
+    QtFileOps ops;
+    QVERIFY(ops.supportsResume());
+    QVERIFY(ops.interruptedTransfers().isEmpty());
+    QSignalSpy finishedSpy(&ops, &QtFileOps::finished);
+
+    FileOpRequest req;
+    req.type = FileOpType::Copy;
+    req.sources = QStringList{first, second};
+    req.destination = dstDir;
+    req.followSymlinks = false;
+    req.overwriteExisting = false;
+    req.resumable = true;
+
+    // The second source is missing, so the request stops half way and stays resumable.
+    ops.start(req);
+    QTRY_VERIFY_WITH_TIMEOUT(finishedSpy.count() > 0, 2000);
+    QVERIFY(!finishedSpy.takeFirst().at(0).toBool());
+    QVERIFY(QFileInfo::exists(dstDir + QLatin1String("/first.txt")));
+
+    QList<FileOpRequest> interrupted = ops.interruptedTransfers();
+    QCOMPARE(interrupted.size(), 1);
+    QCOMPARE(interrupted.first().sources, req.sources);
+    QCOMPARE(interrupted.first().destination, req.destination);
+    QVERIFY(interrupted.first().resumable);
+
+    writeTempFile(dir, QStringLiteral("second.txt"), "second-data");
+    ops.start(interrupted.first());
+    QTRY_VERIFY_WITH_TIMEOUT(finishedSpy.count() > 0, 2000);
+    QVERIFY(finishedSpy.takeFirst().at(0).toBool());
+    QCOMPARE(QFile(dstDir + QLatin1String("/second.txt")).size(), QFile(second).size());
+    QVERIFY(ops.interruptedTransfers().isEmpty());
+    QVERIFY(!ops.discardInterruptedTransfer(req));
+
+    qunsetenv("XDG_STATE_HOME");
+}
+
 QTEST_MAIN(QtFileOpsTest)
 #include "qt_fileops_test.moc"
@@ -0,0 +1,186 @@
+/*
+ * Tests for bounded file previews
+ * tests/quick_preview_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+
+#include "../src/core/archive_writer.h"
+#include "../src/core/quick_preview.h"
+
+#include <algorithm>
+#include <errno.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::string writeFile(const QTemporaryDir& dir, const QString& name, const QByteArray& data) {
+    const QString path = dir.path() + QLatin1Char('/') + name;
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        return {};
+    }
+    return path.toLocal8Bit().toStdString();
+}
+
+bool looksLikeText(const QByteArray& data) {
+    return QuickPreview::looks_like_text(reinterpret_cast<const std::uint8_t*>(data.constData()),
+                                         static_cast<std::size_t>(data.size()));
+}
+
+}  // namespace
+
+class QuickPreviewTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void detectsText();
+    void keepsWholeLines();
+    void dumpsBinaryHead();
+    void listsArchives();
+    void brokenArchiveIsBinary();
+    void reportsErrors();
+    void cancels();
+};
+
+void QuickPreviewTest::detectsText() {
+    QVERIFY(looksLikeText(QByteArray("plain\ttext\r\n")));
+    QVERIFY(looksLikeText(QByteArray("gr\xc3\xbc\xc3\x9f \xe2\x82\xac")));
+    QVERIFY(looksLikeText(QByteArray("cut \xe2\x82")));  // the head ends inside a character
+    QVERIFY(!looksLikeText(QByteArray("nul\0inside", 10)));
+    QVERIFY(!looksLikeText(QByteArray("\xc0\xaf")));  // overlong
+    QVERIFY(!looksLikeText(QByteArray("\xed\xa0\x80")));  // a surrogate
+    QVERIFY(!looksLikeText(QByteArray("latin-1 \xe9t\xe9")));
+}
+
+void QuickPreviewTest::keepsWholeLines() {
+    QTemporaryDir dir;
+    QByteArray data;
+    for (int i = 0; i < 100; ++i) {
+        data += QByteArray("line ") + QByteArray::number(i) + '\n';
+    }
+    const std::string path = writeFile(dir, QStringLiteral("lines.txt"), data);
+
+    QuickPreview::Options options;
+    QuickPreview::Preview preview;
+    FsOps::Error err;
+    QVERIFY(QuickPreview::make_preview(path, options, preview, err));
+    QCOMPARE(preview.kind, QuickPreview::Kind::Text);
+    QCOMPARE(QByteArray::fromStdString(preview.text), data);
+    QVERIFY(!preview.truncated);
+
+    options.maxLines = 3;
+    QVERIFY(QuickPreview::make_preview(path, options, preview, err));
+    QCOMPARE(preview.text, std::string("line 0\nline 1\nline 2\n"));
+    QVERIFY(preview.truncated);
+
+    options = {};
+    options.textBytes = 20;  // "line 0\nline 1\nline 2" and no more
+    QVERIFY(QuickPreview::make_preview(path, options, preview, err));
+    QCOMPARE(preview.text, std::string("line 0\nline 1\n"));
+    QVERIFY(preview.truncated);
+}
+
+void QuickPreviewTest::dumpsBinaryHead() {
+    QTemporaryDir dir;
+    QByteArray data(10000, '\0');
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(i * 7);
+    }
+    const std::string path = writeFile(dir, QStringLiteral("blob"), data);
+
+    QuickPreview::Options options;
+    options.hexBytes = 40;
+    QuickPreview::Preview preview;
+    FsOps::Error err;
+    QVERIFY(QuickPreview::make_preview(path, options, preview, err));
+    QCOMPARE(preview.kind, QuickPreview::Kind::Binary);
+    QCOMPARE(preview.fileSize, std::uint64_t(10000));
+    QCOMPARE(preview.head.size(), std::size_t(40));
+    QVERIFY(preview.truncated);
+
+    const std::uint8_t bytes[] = {'A', 'b', 0x00, 0xff, '~', 0x7f};
+    QCOMPARE(QuickPreview::hex_dump(bytes, sizeof(bytes), 0x20),
+             std::string("00000020  41 62 00 ff 7e 7f                                 |Ab..~.|\n"));
+    const std::string twoLines = QuickPreview::hex_dump(preview.head.data(), 20);
+    QCOMPARE(twoLines.substr(0, 10), std::string("00000000  "));
+    QCOMPARE(std::count(twoLines.begin(), twoLines.end(), '\n'), std::ptrdiff_t(2));
+    QCOMPARE(twoLines.find('\n'), std::size_t(78));
+}
+
+void QuickPreviewTest::listsArchives() {
+    QTemporaryDir dir;
+    const QString root = dir.path() + QLatin1String("/tree");
+    QVERIFY(QDir().mkpath(root));
+    for (int i = 0; i < 5; ++i) {
+        QVERIFY(!writeFile(dir, QStringLiteral("tree/file%1").arg(i), QByteArray("x")).empty());
+    }
+    const std::string archive = (dir.path() + QLatin1String("/tree.tar.zst")).toLocal8Bit().toStdString();
+    FsOps::ProgressInfo progress;
+    FsOps::Error err;
+    QVERIFY2(ArchiveWriter::create_tar_zst({root.toLocal8Bit().toStdString()}, archive, progress, {}, err),
+             err.message.c_str());
+
+    QuickPreview::Options options;
+    QuickPreview::Preview preview;
+    QVERIFY(QuickPreview::make_preview(archive, options, preview, err));
+    QCOMPARE(preview.kind, QuickPreview::Kind::Archive);
+    QCOMPARE(preview.entries.size(), std::size_t(6));  // tree/ and its files
+    QVERIFY(!preview.truncated);
+
+    options.maxEntries = 2;
+    QVERIFY(QuickPreview::make_preview(archive, options, preview, err));
+    QCOMPARE(preview.entries.size(), std::size_t(2));
+    QVERIFY(preview.truncated);
+
+    options = {};
+    options.deadline = std::chrono::steady_clock::now();  // already passed
+    QVERIFY(QuickPreview::make_preview(archive, options, preview, err));
+    QCOMPARE(preview.kind, QuickPreview::Kind::Archive);
+    QVERIFY(preview.entries.empty());
+    QVERIFY(preview.truncated);
+}
+
+void QuickPreviewTest::brokenArchiveIsBinary() {
+    QTemporaryDir dir;
+    const std::string path = writeFile(dir, QStringLiteral("fake.zip"), QByteArray("PK\x03\x04 and nothing else"));
+    QuickPreview::Preview preview;
+    FsOps::Error err;
+    QVERIFY(QuickPreview::make_preview(path, {}, preview, err));
+    QCOMPARE(preview.kind, QuickPreview::Kind::Binary);
+    QVERIFY(!preview.truncated);
+}
+
+void QuickPreviewTest::reportsErrors() {
+    QTemporaryDir dir;
+    QuickPreview::Preview preview;
+    FsOps::Error err;
+    QVERIFY(!QuickPreview::make_preview((dir.path() + QLatin1String("/missing")).toStdString(), {}, preview, err));
+    QCOMPARE(err.code, ENOENT);
+    QVERIFY(!QuickPreview::make_preview(dir.path().toStdString(), {}, preview, err));
+    QCOMPARE(err.code, EISDIR);
+
+    const std::string empty = writeFile(dir, QStringLiteral("empty"), QByteArray());
+    QVERIFY(QuickPreview::make_preview(empty, {}, preview, err));
+    QCOMPARE(preview.kind, QuickPreview::Kind::Empty);
+}
+
+void QuickPreviewTest::cancels() {
+    QTemporaryDir dir;
+    const std::string path = writeFile(dir, QStringLiteral("text"), QByteArray("text\n"));
+    std::atomic<bool> cancel{true};
+    QuickPreview::Options options;
+    options.cancel = &cancel;
+    QuickPreview::Preview preview;
+    FsOps::Error err;
+    QVERIFY(!QuickPreview::make_preview(path, options, preview, err));
+    QCOMPARE(err.code, ECANCELED);
+}
+
+QTEST_MAIN(QuickPreviewTest)
+#include "quick_preview_test.moc"
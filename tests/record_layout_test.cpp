@@ -0,0 +1,105 @@
+/*
+ * Tests for the hex editor record layouts
+ * tests/record_layout_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/record_layout.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace PCManFM;
+
+class RecordLayoutTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void parsesFieldsAndOffsets();
+    void decodesBothByteOrders();
+    void formatsTextBytesAndArrays();
+    void rejectsBadLayouts();
+    void exportsCsv();
+};
+
+void RecordLayoutTest::parsesFieldsAndOffsets() {
+    RecordLayout layout;
+    std::string err;
+    QVERIFY2(layout.parse("# header\n"
+                          "u32be magic\n"
+                          "\n"
+                          "  u16 version   # little-endian by default\n"
+                          "char[6] name\n"
+                          "f64le when\n",
+                          err),
+             err.c_str());
+    QCOMPARE(layout.fields().size(), static_cast<std::size_t>(4));
+    QCOMPARE(layout.recordSize(), static_cast<std::uint32_t>(4 + 2 + 6 + 8));
+    QCOMPARE(QString::fromStdString(layout.fields()[1].name), QStringLiteral("version"));
+    QCOMPARE(layout.fields()[1].offset, static_cast<std::uint32_t>(4));
+    QVERIFY(layout.fields()[1].littleEndian);
+    QVERIFY(!layout.fields()[0].littleEndian);
+    QCOMPARE(layout.fields()[3].offset, static_cast<std::uint32_t>(12));
+    QVERIFY(layout.fields()[2].type == FieldType::Char);
+    QCOMPARE(layout.fields()[2].count, static_cast<std::uint32_t>(6));
+}
+
+void RecordLayoutTest::decodesBothByteOrders() {
+    RecordLayout layout;
+    std::string err;
+    QVERIFY(layout.parse("u16le a\nu16be b\ni32le c\ni8 d\nf32be e\nu64be f\n", err));
+    std::vector<std::uint8_t> record = {0x34, 0x12, 0x12, 0x34, 0xfe, 0xff, 0xff, 0xff, 0x80, 0x3f, 0xc0, 0x00,
+                                        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00};
+    QCOMPARE(layout.recordSize(), static_cast<std::uint32_t>(21));
+    QCOMPARE(layout.format(0, record.data()), std::string("4660"));
+    QCOMPARE(layout.format(1, record.data()), std::string("4660"));
+    QCOMPARE(layout.format(2, record.data()), std::string("-2"));
+    QCOMPARE(layout.format(3, record.data()), std::string("-128"));
+    QCOMPARE(layout.format(4, record.data()), std::string("1.5"));
+    QCOMPARE(layout.format(5, record.data()), std::string("256"));
+}
+
+void RecordLayoutTest::formatsTextBytesAndArrays() {
+    RecordLayout layout;
+    std::string err;
+    QVERIFY(layout.parse("char[8] name\nbytes[3] raw\nu16be[2] pair\n", err));
+    const std::uint8_t record[] = {'a', 'b', '\n', 'c', 0, 0, 0, 0, 0xde, 0xad, 0x01, 0x00, 0x01, 0x00, 0x02};
+    QCOMPARE(layout.format(0, record), std::string("ab\\x0ac"));
+    QCOMPARE(layout.format(1, record), std::string("de ad 01"));
+    QCOMPARE(layout.format(2, record), std::string("1 2"));
+}
+
+void RecordLayoutTest::rejectsBadLayouts() {
+    RecordLayout layout;
+    std::string err;
+    QVERIFY(!layout.parse("", err));
+    QVERIFY(!layout.parse("# only a comment\n", err));
+    QVERIFY(!layout.parse("u24 x\n", err));
+    QVERIFY(!layout.parse("u8le x\n", err));  // byte order on a single byte
+    QVERIFY(!layout.parse("u16\n", err));
+    QVERIFY(!layout.parse("u16 1abc\n", err));
+    QVERIFY(!layout.parse("u8[0] x\n", err));
+    QVERIFY(!layout.parse("u8[4 x\n", err));
+    QVERIFY(!layout.parse("u8 ok\nbytes[65536] a\nbytes[65536] b\nu64[65536] c\nu64[65536] d\n", err));
+    QVERIFY(err.rfind("Line 5", 0) == 0);
+    QVERIFY(layout.empty());
+}
+
+void RecordLayoutTest::exportsCsv() {
+    RecordLayout layout;
+    std::string err;
+    QVERIFY(!layout.parse("u8 id\nchar[4] \"label\n", err));
+    QVERIFY(layout.parse("u8 id\nchar[4] label\nu8 flags\n", err));
+    const std::vector<std::size_t> columns = {2, 1};
+    std::string csv = layout.csvHeader(columns);
+    const std::uint8_t first[] = {1, 'a', ',', 'b', 0, 7};
+    const std::uint8_t second[] = {2, '"', 'q', 0, 0, 9};
+    layout.appendCsvRow(first, columns, csv);
+    layout.appendCsvRow(second, columns, csv);
+    QCOMPARE(csv, std::string("flags,label\n7,\"a,b\"\n9,\"\"\"q\"\n"));
+}
+
+QTEST_MAIN(RecordLayoutTest)
+#include "record_layout_test.moc"
@@ -0,0 +1,124 @@
+/*
+ * Tests for the start-up trace
+ * tests/startup_trace_test.cpp
+ */
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "../src/core/startup_trace.h"
+
+#include <string>
+
+using namespace PCManFM;
+
+class StartupTraceTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void phasesNest();
+    void unbalancedEndIsIgnored();
+    void jsonHasCompleteAndInstantEvents();
+    void runningPhasesAreLeftOut();
+    void namesAreEscaped();
+    void writesFile();
+};
+
+void StartupTraceTest::phasesNest() {
+    StartupTrace trace;
+    {
+        StartupTrace::Scope outer(&trace, "outer");
+        StartupTrace::Scope inner(&trace, "inner");
+    }
+    const auto& events = trace.events();
+    QCOMPARE(events.size(), std::size_t(2));
+    QCOMPARE(events[0].name, std::string("outer"));
+    QCOMPARE(events[1].name, std::string("inner"));
+    QVERIFY(events[0].duration >= 0);
+    QVERIFY(events[1].duration >= 0);
+    // the inner phase lies within the outer one
+    QVERIFY(events[1].start >= events[0].start);
+    QVERIFY(events[1].start + events[1].duration <= events[0].start + events[0].duration);
+
+    // a scope without a trace does nothing
+    StartupTrace::Scope none(nullptr, "none");
+}
+
+void StartupTraceTest::unbalancedEndIsIgnored() {
+    StartupTrace trace;
+    trace.end();
+    trace.begin("a");
+    trace.end();
+    trace.end();
+    QCOMPARE(trace.events().size(), std::size_t(1));
+}
+
+void StartupTraceTest::jsonHasCompleteAndInstantEvents() {
+    StartupTrace trace;
+    trace.begin("settings");
+    trace.end();
+    trace.mark("event loop");
+
+    const QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromStdString(trace.toJson()));
+    QVERIFY(doc.isObject());
+    const QJsonArray events = doc.object().value(QStringLiteral("traceEvents")).toArray();
+    QCOMPARE(events.size(), 2);
+
+    const QJsonObject phase = events.at(0).toObject();
+    QCOMPARE(phase.value(QStringLiteral("name")).toString(), QStringLiteral("settings"));
+    QCOMPARE(phase.value(QStringLiteral("ph")).toString(), QStringLiteral("X"));
+    QVERIFY(phase.contains(QStringLiteral("dur")));
+    QVERIFY(phase.contains(QStringLiteral("pid")));
+
+    const QJsonObject mark = events.at(1).toObject();
+    QCOMPARE(mark.value(QStringLiteral("ph")).toString(), QStringLiteral("i"));
+    QVERIFY(!mark.contains(QStringLiteral("dur")));
+    QVERIFY(mark.value(QStringLiteral("ts")).toDouble() >= phase.value(QStringLiteral("ts")).toDouble());
+}
+
+void StartupTraceTest::runningPhasesAreLeftOut() {
+    StartupTrace trace;
+    trace.begin("done");
+    trace.end();
+    trace.begin("running");
+
+    const QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromStdString(trace.toJson()));
+    const QJsonArray events = doc.object().value(QStringLiteral("traceEvents")).toArray();
+    QCOMPARE(events.size(), 1);
+    QCOMPARE(events.at(0).toObject().value(QStringLiteral("name")).toString(), QStringLiteral("done"));
+}
+
+void StartupTraceTest::namesAreEscaped() {
+    StartupTrace trace;
+    trace.mark("a \"quoted\\name\"\n");
+
+    const QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromStdString(trace.toJson()));
+    QVERIFY(doc.isObject());
+    const QJsonArray events = doc.object().value(QStringLiteral("traceEvents")).toArray();
+    QCOMPARE(events.at(0).toObject().value(QStringLiteral("name")).toString(),
+             QStringLiteral("a \"quoted\\name\"\n"));
+}
+
+void StartupTraceTest::writesFile() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    StartupTrace trace;
+    trace.mark("x");
+
+    std::string error;
+    const std::string path = dir.filePath(QStringLiteral("trace.json")).toStdString();
+    QVERIFY(trace.write(path, error));
+    QFile file(QString::fromStdString(path));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll().toStdString(), trace.toJson());
+
+    QVERIFY(!trace.write(dir.filePath(QStringLiteral("missing/trace.json")).toStdString(), error));
+    QVERIFY(!error.empty());
+}
+
+QTEST_MAIN(StartupTraceTest)
+#include "startup_trace_test.moc"
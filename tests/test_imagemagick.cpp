@@ -59,6 +59,32 @@ class TestImageMagick : public QObject {
         // Alpha should be 255 (opaque)
         QCOMPARE(a, 255);
     }
+
+    void testConvertImage() {
+        QTemporaryDir tempDir;
+        QVERIFY(tempDir.isValid());
+
+        const QString src = tempDir.filePath("wide.png");
+        QImage image(100, 50, QImage::Format_RGB32);
+        image.fill(Qt::blue);
+        QVERIFY(image.save(src, "PNG"));
+
+        ImageMagickConversion conversion;
+        conversion.format = "jpg";
+        conversion.maxSize = 40;
+        const QString dst = tempDir.filePath("wide.jpg");
+        QVERIFY(ImageMagickSupport::convertImage(src, dst, conversion));
+
+        const QImage converted(dst);
+        QCOMPARE(converted.size(), QSize(40, 20));
+
+        // images are only ever made smaller
+        conversion.maxSize = 400;
+        const QString kept = tempDir.filePath("kept.png");
+        conversion.format = "png";
+        QVERIFY(ImageMagickSupport::convertImage(src, kept, conversion));
+        QCOMPARE(QImage(kept).size(), QSize(100, 50));
+    }
 };
 
 QTEST_MAIN(TestImageMagick)
@@ -62,6 +62,7 @@ void TestSettingsFunctionality::testSettingsInitialization() {
     QVERIFY(settings.showFullNames());
     QVERIFY(settings.shadowHidden());
     QVERIFY(!settings.noItemTooltip());
+    QVERIFY(!settings.showFolderSizes());
     QVERIFY(settings.scrollPerPixel());
 
     QVERIFY(!settings.onlyUserTemplates());
@@ -187,6 +188,7 @@ void TestSettingsFunctionality::testSettingsLoadSave() {
     settings.setShowFullNames(false);
     settings.setShadowHidden(false);
     settings.setNoItemTooltip(true);
+    settings.setShowFolderSizes(true);
     settings.setScrollPerPixel(false);
 
     settings.setOnlyUserTemplates(true);
@@ -252,6 +254,7 @@ void TestSettingsFunctionality::testSettingsLoadSave() {
     QCOMPARE(loadedSettings.showFullNames(), settings.showFullNames());
     QCOMPARE(loadedSettings.shadowHidden(), settings.shadowHidden());
     QCOMPARE(loadedSettings.noItemTooltip(), settings.noItemTooltip());
+    QCOMPARE(loadedSettings.showFolderSizes(), settings.showFolderSizes());
     QCOMPARE(loadedSettings.scrollPerPixel(), settings.scrollPerPixel());
 
     QCOMPARE(loadedSettings.onlyUserTemplates(), settings.onlyUserTemplates());
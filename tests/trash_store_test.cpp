@@ -0,0 +1,270 @@
+/*
+ * Tests for the native freedesktop.org trash
+ * tests/trash_store_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QDir>
+
+#include "../src/core/trash_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace PCManFM;
+
+namespace {
+
+std::string nativePath(const QTemporaryDir& dir, const QString& name) {
+    return (dir.path() + QLatin1Char('/') + name).toLocal8Bit().toStdString();
+}
+
+void writeFile(const std::string& path, const QByteArray& data) {
+    QFile file(QString::fromLocal8Bit(path.c_str()));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(data), data.size());
+}
+
+bool exists(const std::string& path) {
+    struct stat st;
+    return ::lstat(path.c_str(), &st) == 0;
+}
+
+QByteArray readFile(const std::string& path) {
+    QFile file(QString::fromLocal8Bit(path.c_str()));
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+}  // namespace
+
+class TrashStoreTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void defaultHomeTrashFollowsXdgDataHome();
+    void trashWritesInfoAndMovesFile();
+    void sameNamesGetDistinctEntries();
+    void refusesTrashItself();
+    void missingFileReportsErrno();
+    void tickCancelsRemainingPaths();
+    void itemsSeeExternalChanges();
+    void restoreMovesBack();
+    void restoreRefusesExistingTarget();
+    void emptyRemovesEverything();
+};
+
+void TrashStoreTest::defaultHomeTrashFollowsXdgDataHome() {
+    const QByteArray saved = qgetenv("XDG_DATA_HOME");
+    qputenv("XDG_DATA_HOME", "/tmp/pcmanfm-data-test");
+    QCOMPARE(TrashStore::defaultHomeTrash(), std::string("/tmp/pcmanfm-data-test/Trash"));
+    qputenv("XDG_DATA_HOME", "relative/ignored");
+    QVERIFY(TrashStore::defaultHomeTrash().find("relative") == std::string::npos);
+    if (saved.isNull()) {
+        qunsetenv("XDG_DATA_HOME");
+    }
+    else {
+        qputenv("XDG_DATA_HOME", saved);
+    }
+}
+
+void TrashStoreTest::trashWritesInfoAndMovesFile() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string trashDir = nativePath(dir, QStringLiteral("share/Trash"));
+    const std::string file = nativePath(dir, QStringLiteral("a file%.txt"));
+    writeFile(file, "payload");
+    QVERIFY(QDir().mkpath(QString::fromLocal8Bit(nativePath(dir, QStringLiteral("sub/deep")).c_str())));
+
+    TrashStore store(trashDir, std::string());
+    std::vector<int> results;
+    QVERIFY(store.trash({file, nativePath(dir, QStringLiteral("sub"))}, results));
+    QCOMPARE(results, std::vector<int>({0, 0}));
+
+    QVERIFY(!exists(file));
+    QCOMPARE(readFile(trashDir + "/files/a file%.txt"), QByteArray("payload"));
+    QVERIFY(exists(trashDir + "/files/sub/deep"));
+    const QByteArray info = readFile(trashDir + "/info/a file%.txt.trashinfo");
+    QVERIFY(info.startsWith("[Trash Info]\n"));
+    QVERIFY(info.contains("\nPath=" + QByteArray(file.c_str()).replace(" ", "%20").replace("%.", "%25.") + "\n"));
+    QVERIFY(info.contains("\nDeletionDate="));
+
+    const auto items = store.items();
+    QCOMPARE(items.size(), std::size_t(2));
+    for (const auto& item : items) {
+        QVERIFY(item.name == "a file%.txt" || item.name == "sub");
+        QCOMPARE(item.originalPath, item.name == "sub" ? nativePath(dir, QStringLiteral("sub")) : file);
+        QCOMPARE(item.trashDir, trashDir);
+        QCOMPARE(item.deletionDate.size(), std::size_t(19));
+    }
+}
+
+void TrashStoreTest::sameNamesGetDistinctEntries() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string trashDir = nativePath(dir, QStringLiteral("Trash"));
+    QVERIFY(QDir().mkpath(dir.path() + QStringLiteral("/one")));
+    QVERIFY(QDir().mkpath(dir.path() + QStringLiteral("/two")));
+    const std::string first = nativePath(dir, QStringLiteral("one/same"));
+    const std::string second = nativePath(dir, QStringLiteral("two/same"));
+    writeFile(first, "1");
+    writeFile(second, "2");
+    // a file left without info must not be replaced either
+    QVERIFY(QDir().mkpath(QString::fromLocal8Bit((trashDir + "/files").c_str())));
+    writeFile(trashDir + "/files/same.2", "orphan");
+
+    TrashStore store(trashDir, std::string());
+    std::vector<int> results;
+    QVERIFY(store.trash({first, second}, results));
+    QCOMPARE(readFile(trashDir + "/files/same"), QByteArray("1"));
+    QCOMPARE(readFile(trashDir + "/files/same.2"), QByteArray("orphan"));
+    QCOMPARE(readFile(trashDir + "/files/same.3"), QByteArray("2"));
+    QVERIFY(!exists(trashDir + "/info/same.2.trashinfo"));
+    QVERIFY(exists(trashDir + "/info/same.3.trashinfo"));
+}
+
+void TrashStoreTest::refusesTrashItself() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string trashDir = nativePath(dir, QStringLiteral("share/Trash"));
+    TrashStore store(trashDir, std::string());
+    const std::string file = nativePath(dir, QStringLiteral("f"));
+    writeFile(file, "x");
+    std::vector<int> results;
+    QVERIFY(store.trash({file}, results));
+
+    QVERIFY(!store.trash({trashDir, trashDir + "/files/f", nativePath(dir, QStringLiteral("share"))}, results));
+    QCOMPARE(results, std::vector<int>({EINVAL, EINVAL, EINVAL}));
+    QVERIFY(exists(trashDir + "/files/f"));
+}
+
+void TrashStoreTest::missingFileReportsErrno() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    TrashStore store(nativePath(dir, QStringLiteral("Trash")), std::string());
+    const std::string file = nativePath(dir, QStringLiteral("present"));
+    writeFile(file, "x");
+    std::vector<int> results;
+    QVERIFY(!store.trash({nativePath(dir, QStringLiteral("missing")), file, "relative"}, results));
+    QCOMPARE(results, std::vector<int>({ENOENT, 0, EINVAL}));
+}
+
+void TrashStoreTest::tickCancelsRemainingPaths() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    TrashStore store(nativePath(dir, QStringLiteral("Trash")), std::string());
+    const std::string first = nativePath(dir, QStringLiteral("first"));
+    const std::string second = nativePath(dir, QStringLiteral("second"));
+    writeFile(first, "1");
+    writeFile(second, "2");
+    int ticks = 0;
+    std::vector<int> results;
+    QVERIFY(!store.trash({first, second}, results, [&ticks]() { return ++ticks < 1; }));
+    QCOMPARE(ticks, 1);
+    QCOMPARE(results, std::vector<int>({0, ECANCELED}));
+    QVERIFY(!exists(first));
+    QVERIFY(exists(second));
+}
+
+void TrashStoreTest::itemsSeeExternalChanges() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string trashDir = nativePath(dir, QStringLiteral("Trash"));
+    TrashStore store(trashDir, std::string());
+    const std::string file = nativePath(dir, QStringLiteral("mine"));
+    writeFile(file, "x");
+    std::vector<int> results;
+    QVERIFY(store.trash({file}, results));
+    QCOMPARE(store.items().size(), std::size_t(1));
+
+    // another program trashes a file
+    writeFile(trashDir + "/files/theirs", "y");
+    writeFile(trashDir + "/info/theirs.trashinfo",
+              "[Trash Info]\nPath=/some/where/the%20irs\nDeletionDate=2024-01-02T03:04:05\n");
+    // their info file changes the directory, unless it landed in the same timestamp tick
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+    QCOMPARE(::utimensat(AT_FDCWD, (trashDir + "/info").c_str(), times, 0), 0);
+
+    const auto items = store.items();
+    QCOMPARE(items.size(), std::size_t(2));
+    bool found = false;
+    for (const auto& item : items) {
+        if (item.name == "theirs") {
+            found = true;
+            QCOMPARE(item.originalPath, std::string("/some/where/the irs"));
+            QCOMPARE(item.deletionDate, std::string("2024-01-02T03:04:05"));
+        }
+    }
+    QVERIFY(found);
+}
+
+void TrashStoreTest::restoreMovesBack() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string trashDir = nativePath(dir, QStringLiteral("Trash"));
+    TrashStore store(trashDir, std::string());
+    QVERIFY(QDir().mkpath(dir.path() + QStringLiteral("/gone")));
+    const std::string file = nativePath(dir, QStringLiteral("gone/file"));
+    writeFile(file, "back");
+    std::vector<int> results;
+    QVERIFY(store.trash({file}, results));
+    // the folder it was in has been removed since
+    QVERIFY(QDir(dir.path() + QStringLiteral("/gone")).removeRecursively());
+
+    FsOps::Error err;
+    QVERIFY2(store.restore(trashDir + "/files/file", err), err.message.c_str());
+    QCOMPARE(readFile(file), QByteArray("back"));
+    QVERIFY(!exists(trashDir + "/info/file.trashinfo"));
+    QVERIFY(store.items().empty());
+
+    QVERIFY(!store.restore(trashDir + "/files/file", err));
+    QCOMPARE(err.code, ENOENT);
+    QVERIFY(!store.restore(file, err));
+    QCOMPARE(err.code, EINVAL);
+}
+
+void TrashStoreTest::restoreRefusesExistingTarget() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string trashDir = nativePath(dir, QStringLiteral("Trash"));
+    TrashStore store(trashDir, std::string());
+    const std::string file = nativePath(dir, QStringLiteral("file"));
+    writeFile(file, "old");
+    std::vector<int> results;
+    QVERIFY(store.trash({file}, results));
+    writeFile(file, "new");
+
+    FsOps::Error err;
+    QVERIFY(!store.restore(trashDir + "/files/file", err));
+    QCOMPARE(err.code, EEXIST);
+    QCOMPARE(readFile(file), QByteArray("new"));
+    QCOMPARE(readFile(trashDir + "/files/file"), QByteArray("old"));
+    QCOMPARE(store.items().size(), std::size_t(1));
+}
+
+void TrashStoreTest::emptyRemovesEverything() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string trashDir = nativePath(dir, QStringLiteral("Trash"));
+    TrashStore store(trashDir, std::string());
+    QVERIFY(QDir().mkpath(dir.path() + QStringLiteral("/tree/a/b")));
+    writeFile(nativePath(dir, QStringLiteral("tree/a/b/leaf")), "x");
+    const std::string file = nativePath(dir, QStringLiteral("file"));
+    writeFile(file, "y");
+    std::vector<int> results;
+    QVERIFY(store.trash({nativePath(dir, QStringLiteral("tree")), file}, results));
+    writeFile(trashDir + "/info/stale.trashinfo", "[Trash Info]\nPath=/stale\n");
+    writeFile(trashDir + "/directorysizes", "");
+
+    FsOps::Error err;
+    QVERIFY2(store.empty(std::function<bool()>(), err), err.message.c_str());
+    QVERIFY(QDir(QString::fromLocal8Bit((trashDir + "/files").c_str())).isEmpty());
+    QVERIFY(QDir(QString::fromLocal8Bit((trashDir + "/info").c_str())).isEmpty(QDir::Files | QDir::Hidden));
+    QVERIFY(!exists(trashDir + "/directorysizes"));
+    QVERIFY(store.items().empty());
+}
+
+QTEST_MAIN(TrashStoreTest)
+#include "trash_store_test.moc"
@@ -0,0 +1,110 @@
+/*
+ * Tests for the squarified treemap layout
+ * tests/treemap_layout_test.cpp
+ */
+
+#include <QTest>
+
+#include "../src/core/treemap_layout.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+
+using namespace PCManFM;
+using namespace PCManFM::Treemap;
+
+namespace {
+
+constexpr double kEpsilon = 1e-6;
+
+bool overlaps(const Rect& a, const Rect& b) {
+    return a.x + kEpsilon < b.x + b.width && b.x + kEpsilon < a.x + a.width && a.y + kEpsilon < b.y + b.height &&
+           b.y + kEpsilon < a.y + a.height;
+}
+
+}  // namespace
+
+class TreemapLayoutTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void areasFollowSizes();
+    void fillsBoundsWithoutOverlap();
+    void keepsCellsSquarish();
+    void emptyInputs();
+};
+
+void TreemapLayoutTest::areasFollowSizes() {
+    const Rect bounds{10, 20, 600, 400};
+    const std::vector<std::uint64_t> sizes = {6, 6, 4, 3, 2, 2, 1};
+    const auto rects = squarify(sizes, bounds);
+    QCOMPARE(rects.size(), sizes.size());
+    const double scale = bounds.width * bounds.height / 24;
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        QVERIFY(std::abs(rects[i].width * rects[i].height - sizes[i] * scale) < 1e-3);
+    }
+}
+
+void TreemapLayoutTest::fillsBoundsWithoutOverlap() {
+    std::mt19937 rng(7);
+    for (int round = 0; round < 200; ++round) {
+        std::vector<std::uint64_t> sizes(1 + rng() % 60);
+        for (auto& size : sizes) {
+            size = rng() % 4 == 0 ? rng() % 100 : rng() % 1000000;
+        }
+        std::sort(sizes.begin(), sizes.end(), std::greater<>());
+        const Rect bounds{0, 0, 1.0 + rng() % 1000, 1.0 + rng() % 1000};
+        const auto rects = squarify(sizes, bounds);
+
+        double area = 0;
+        for (std::size_t i = 0; i < rects.size(); ++i) {
+            const Rect& r = rects[i];
+            QVERIFY(r.width >= 0 && r.height >= 0);
+            QVERIFY(r.x >= bounds.x - kEpsilon && r.x + r.width <= bounds.x + bounds.width + kEpsilon);
+            QVERIFY(r.y >= bounds.y - kEpsilon && r.y + r.height <= bounds.y + bounds.height + kEpsilon);
+            for (std::size_t j = i + 1; j < rects.size(); ++j) {
+                QVERIFY(!overlaps(r, rects[j]));
+            }
+            area += r.width * r.height;
+        }
+        if (sizes.front() != 0) {
+            QVERIFY(std::abs(area - bounds.width * bounds.height) < 1e-6 * bounds.width * bounds.height);
+        }
+    }
+}
+
+void TreemapLayoutTest::keepsCellsSquarish() {
+    // equal sizes in a square make a grid of squares
+    const auto rects = squarify(std::vector<std::uint64_t>(16, 5), Rect{0, 0, 100, 100});
+    for (const Rect& r : rects) {
+        QVERIFY(std::abs(r.width - 25) < 1e-6);
+        QVERIFY(std::abs(r.height - 25) < 1e-6);
+    }
+
+    // a wide strip is not cut into slivers
+    const auto strip = squarify({10, 9, 8, 7, 6, 5, 4, 3, 2, 1}, Rect{0, 0, 1000, 100});
+    for (const Rect& r : strip) {
+        QVERIFY(std::max(r.width / r.height, r.height / r.width) < 4);
+    }
+}
+
+void TreemapLayoutTest::emptyInputs() {
+    QVERIFY(squarify({}, Rect{0, 0, 10, 10}).empty());
+
+    const auto zeros = squarify({0, 0}, Rect{3, 4, 10, 10});
+    QCOMPARE(zeros.size(), std::size_t{2});
+    QCOMPARE(zeros[1].x, 3.0);
+    QCOMPARE(zeros[1].width, 0.0);
+
+    const auto trailing = squarify({5, 0}, Rect{0, 0, 10, 10});
+    QCOMPARE(trailing[0].width * trailing[0].height, 100.0);
+    QCOMPARE(trailing[1].width * trailing[1].height, 0.0);
+
+    const auto flat = squarify({5, 3}, Rect{0, 0, 10, 0});
+    QCOMPARE(flat[0].width * flat[0].height, 0.0);
+}
+
+QTEST_MAIN(TreemapLayoutTest)
+#include "treemap_layout_test.moc"
@@ -9,6 +9,11 @@
 
 #include "../src/core/windowed_file_reader.h"
 
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
 using namespace PCManFM;
 
 namespace {
@@ -40,6 +45,8 @@ class WindowedFileReaderTest : public QObject {
    private slots:
     void readsAcrossBoundaries();
     void shortReadAtEnd();
+    void alternatesRegionsConcurrently();
+    void leasePinsEvictedWindow();
 };
 
 void WindowedFileReaderTest::readsAcrossBoundaries() {
@@ -93,5 +100,85 @@ void WindowedFileReaderTest::shortReadAtEnd() {
     QCOMPARE(QByteArray(reinterpret_cast<const char*>(buffer.data()), 20), slice(full, fileSize - 20, 20));
 }
 
+void WindowedFileReaderTest::alternatesRegionsConcurrently() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Five windows, read through a cache of two, so readers keep evicting windows that other
+    // threads are still copying from.
+    const std::uint64_t window = WindowedFileReader::kWindowAlignment;
+    const int fileSize = static_cast<int>(5 * window - 100);
+    const QString path = writeTestFile(dir, fileSize);
+
+    std::string err;
+    WindowedFileReader reader(path.toLocal8Bit().constData(), 0, &err, 2);
+    QVERIFY2(reader.valid(), err.c_str());
+    QCOMPARE(static_cast<std::uint64_t>(reader.windowSize()), window);
+
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::vector<std::uint8_t> buffer(64 * 1024);
+            for (int i = 0; i < 500; ++i) {
+                // Alternate between the head and the tail, crossing window seams on the way.
+                const std::uint64_t region = (i % 2 == 0) ? 0 : static_cast<std::uint64_t>(fileSize) - window;
+                const std::uint64_t offset = region + rng() % window;
+                const std::size_t length = 1 + rng() % buffer.size();
+                std::size_t bytesRead = 0;
+                std::string readErr;
+                if (!reader.read(offset, length, buffer.data(), bytesRead, readErr) ||
+                    bytesRead != std::min<std::uint64_t>(length, static_cast<std::uint64_t>(fileSize) - offset)) {
+                    ++failures;
+                    continue;
+                }
+                for (std::size_t k = 0; k < bytesRead; ++k) {
+                    if (buffer[k] != static_cast<std::uint8_t>((offset + k) & 0xFF)) {
+                        ++failures;
+                        break;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    QCOMPARE(failures.load(), 0);
+}
+
+void WindowedFileReaderTest::leasePinsEvictedWindow() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const std::uint64_t window = WindowedFileReader::kWindowAlignment;
+    const int fileSize = static_cast<int>(3 * window);
+    const QString path = writeTestFile(dir, fileSize);
+
+    std::string err;
+    WindowedFileReader reader(path.toLocal8Bit().constData(), 0, &err, 1);
+    QVERIFY2(reader.valid(), err.c_str());
+
+    // A borrowed span stops at the window boundary.
+    WindowedFileReader::Lease lease;
+    QVERIFY(reader.borrow(window - 10, 100, lease, err));
+    QCOMPARE(lease.size(), static_cast<std::size_t>(10));
+    QCOMPARE(lease.data()[0], static_cast<std::uint8_t>((window - 10) & 0xFF));
+
+    // Reading every other window evicts the leased one from the cache, but not from the lease.
+    std::vector<std::uint8_t> buffer(64);
+    std::size_t bytesRead = 0;
+    for (std::uint64_t offset = window; offset < static_cast<std::uint64_t>(fileSize); offset += window / 2) {
+        QVERIFY(reader.read(offset, buffer.size(), buffer.data(), bytesRead, err));
+    }
+    for (std::size_t k = 0; k < lease.size(); ++k) {
+        QCOMPARE(lease.data()[k], static_cast<std::uint8_t>((window - 10 + k) & 0xFF));
+    }
+
+    QVERIFY(reader.borrow(static_cast<std::uint64_t>(fileSize), 16, lease, err));
+    QVERIFY(lease.empty());
+}
+
 QTEST_MAIN(WindowedFileReaderTest)
 #include "windowed_file_reader_test.moc"
@@ -0,0 +1,159 @@
+/*
+ * Tests for the disassembly cross-reference index
+ * tests/xref_index_test.cpp
+ */
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+#include "../src/core/xref_index.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace PCManFM;
+
+namespace {
+
+CodeBlock blockOf(std::uint64_t offset, std::uint64_t end, std::uint64_t address, std::uint64_t row) {
+    CodeBlock block;
+    block.firstOffset = offset;
+    block.endOffset = end;
+    block.readEnd = 0x3000;
+    block.firstAddress = address;
+    block.firstRow = row;
+    return block;
+}
+
+CodeReference refOf(std::uint64_t from, std::uint64_t to, CodeReference::Kind kind) {
+    CodeReference ref;
+    ref.from = from;
+    ref.to = to;
+    ref.kind = kind;
+    return ref;
+}
+
+ImageSymbol symbolOf(std::uint64_t address, std::uint64_t size, const std::string& name) {
+    ImageSymbol symbol;
+    symbol.address = address;
+    symbol.size = size;
+    symbol.name = name;
+    return symbol;
+}
+
+// Two sections whose addresses run opposite to their file order.
+XrefIndex sampleIndex() {
+    XrefIndex index;
+    index.assign({blockOf(0x1000, 0x2000, 0x500000, 0), blockOf(0x2000, 0x2800, 0x400000, 300),
+                  blockOf(0x2800, 0x3000, 0x400800, 420)},
+                 500,
+                 {refOf(0x400010, 0x500000, CodeReference::Kind::Call),
+                  refOf(0x500020, 0x400800, CodeReference::Kind::Branch),
+                  refOf(0x400004, 0x500000, CodeReference::Kind::Call)},
+                 {symbolOf(0x500000, 0x40, "start"), symbolOf(0x400000, 0, "init")});
+    return index;
+}
+
+}  // namespace
+
+class XrefIndexTest : public QObject {
+    Q_OBJECT
+
+   private slots:
+    void findsBlocksByAddress();
+    void findsReferencesAndSymbols();
+    void roundTripsThroughCache();
+    void rejectsStaleOrCorruptCache();
+    void cachePathFollowsXdg();
+};
+
+void XrefIndexTest::findsBlocksByAddress() {
+    const XrefIndex index = sampleIndex();
+    QCOMPARE(index.rowCount(), static_cast<std::uint64_t>(500));
+    QCOMPARE(index.blockForAddress(0x3fffff), index.blocks().size());
+    QCOMPARE(index.blockForAddress(0x400000), static_cast<std::size_t>(1));
+    QCOMPARE(index.blockForAddress(0x4007ff), static_cast<std::size_t>(1));
+    QCOMPARE(index.blockForAddress(0x400900), static_cast<std::size_t>(2));
+    QCOMPARE(index.blockForAddress(0x500123), static_cast<std::size_t>(0));
+}
+
+void XrefIndexTest::findsReferencesAndSymbols() {
+    const XrefIndex index = sampleIndex();
+    const auto callers = index.referencesTo(0x500000);
+    QCOMPARE(callers.second - callers.first, static_cast<std::size_t>(2));
+    QCOMPARE(index.references()[callers.first].from, static_cast<std::uint64_t>(0x400004));
+    QCOMPARE(index.references()[callers.first + 1].from, static_cast<std::uint64_t>(0x400010));
+    QVERIFY(index.isCallTarget(0x500000));
+    QVERIFY(!index.isCallTarget(0x400800));  // only branched to
+    const auto none = index.referencesTo(0x400001);
+    QCOMPARE(none.first, none.second);
+
+    QVERIFY(index.symbolAt(0x500000));
+    QCOMPARE(QString::fromStdString(index.symbolAt(0x500000)->name), QStringLiteral("start"));
+    QVERIFY(!index.symbolAt(0x500001));
+    QCOMPARE(QString::fromStdString(index.symbolContaining(0x50003f)->name), QStringLiteral("start"));
+    QVERIFY(!index.symbolContaining(0x500040));
+    QVERIFY(index.symbolContaining(0x400000));  // unsized symbols cover their own address
+    QVERIFY(!index.symbolContaining(0x400001));
+}
+
+void XrefIndexTest::roundTripsThroughCache() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const std::string path = QFile::encodeName(dir.filePath(QStringLiteral("sample.xref"))).toStdString();
+
+    const XrefIndex saved = sampleIndex();
+    std::string err;
+    QVERIFY2(saved.save(path, 7, err), err.c_str());
+
+    XrefIndex loaded;
+    QVERIFY2(loaded.load(path, 7, err), err.c_str());
+    QCOMPARE(loaded.rowCount(), saved.rowCount());
+    QCOMPARE(loaded.blocks().size(), saved.blocks().size());
+    QCOMPARE(loaded.blocks()[2].firstAddress, static_cast<std::uint64_t>(0x400800));
+    QCOMPARE(loaded.blocks()[2].readEnd, static_cast<std::uint64_t>(0x3000));
+    QCOMPARE(loaded.references().size(), saved.references().size());
+    QVERIFY(loaded.references()[0].kind == CodeReference::Kind::Branch);
+    QCOMPARE(loaded.blockForAddress(0x400900), static_cast<std::size_t>(2));
+    QCOMPARE(QString::fromStdString(loaded.symbolAt(0x400000)->name), QStringLiteral("init"));
+}
+
+void XrefIndexTest::rejectsStaleOrCorruptCache() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString qpath = dir.filePath(QStringLiteral("sample.xref"));
+    const std::string path = QFile::encodeName(qpath).toStdString();
+    std::string err;
+    QVERIFY(sampleIndex().save(path, 7, err));
+
+    XrefIndex loaded;
+    QVERIFY(!loaded.load(path, 8, err));
+    QCOMPARE(loaded.rowCount(), static_cast<std::uint64_t>(0));
+
+    QFile file(qpath);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() - 3));
+    file.close();
+    QVERIFY(!loaded.load(path, 7, err));
+    QVERIFY(loaded.blocks().empty());
+
+    QVERIFY(!loaded.load(path + ".missing", 7, err));
+}
+
+void XrefIndexTest::cachePathFollowsXdg() {
+    const QByteArray previous = qgetenv("XDG_CACHE_HOME");
+    qputenv("XDG_CACHE_HOME", "/tmp/xdg-cache");
+    QCOMPARE(QString::fromStdString(XrefIndex::cachePath("abcd")),
+             QStringLiteral("/tmp/xdg-cache/pcmanfm-qt/xref/abcd.xref"));
+    if (previous.isEmpty()) {
+        qunsetenv("XDG_CACHE_HOME");
+    }
+    else {
+        qputenv("XDG_CACHE_HOME", previous);
+    }
+}
+
+QTEST_MAIN(XrefIndexTest)
+#include "xref_index_test.moc"